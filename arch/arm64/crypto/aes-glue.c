@@ -17,6 +17,7 @@
 #include <crypto/scatterwalk.h>
 #include <linux/module.h>
 #include <linux/cpufeature.h>
+#include <linux/sizes.h>
 #include <crypto/xts.h>
 
 #include "aes-ce-setkey.h"
@@ -626,6 +627,91 @@ static int __maybe_unused xts_decrypt(struct skcipher_request *req)
 	return skcipher_walk_done(&walk, 0);
 }
 
+/* Bytes processed per NEON section of a batch, to bound preemption latency */
+#define XTS_BATCH_NEON_BYTES	SZ_16K
+
+/*
+ * Process a batch of whole-block requests, such as disk sectors, with the
+ * NEON unit kept enabled across them instead of once per walk step. Requests
+ * that need ciphertext stealing go through xts_encrypt()/xts_decrypt().
+ */
+static int __maybe_unused xts_crypt_batch(struct skcipher_request **reqs,
+					  unsigned int nreqs, bool enc)
+{
+	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(reqs[0]);
+	struct crypto_aes_xts_ctx *ctx = crypto_skcipher_ctx(tfm);
+	int err = 0, first, rounds = 6 + ctx->key1.key_length / 4;
+	unsigned int i, bytes = 0;
+	bool neon = false;
+
+	for (i = 0; i < nreqs && !err; i++) {
+		struct skcipher_request *req = reqs[i];
+		struct skcipher_walk walk;
+
+		if (req->cryptlen < AES_BLOCK_SIZE ||
+		    req->cryptlen % AES_BLOCK_SIZE) {
+			if (neon) {
+				kernel_neon_end();
+				neon = false;
+				bytes = 0;
+			}
+			err = enc ? xts_encrypt(req) : xts_decrypt(req);
+			continue;
+		}
+
+		/* atomic, the walk may be advanced with the NEON unit held */
+		err = skcipher_walk_virt(&walk, req, true);
+
+		for (first = 1; walk.nbytes >= AES_BLOCK_SIZE; first = 0) {
+			int nbytes = walk.nbytes;
+
+			if (walk.nbytes < walk.total)
+				nbytes &= ~(AES_BLOCK_SIZE - 1);
+
+			if (!neon) {
+				kernel_neon_begin();
+				neon = true;
+			}
+			if (enc)
+				aes_xts_encrypt(walk.dst.virt.addr,
+						walk.src.virt.addr,
+						ctx->key1.key_enc, rounds,
+						nbytes, ctx->key2.key_enc,
+						walk.iv, first);
+			else
+				aes_xts_decrypt(walk.dst.virt.addr,
+						walk.src.virt.addr,
+						ctx->key1.key_dec, rounds,
+						nbytes, ctx->key2.key_enc,
+						walk.iv, first);
+			err = skcipher_walk_done(&walk, walk.nbytes - nbytes);
+
+			bytes += nbytes;
+			if (bytes >= XTS_BATCH_NEON_BYTES) {
+				kernel_neon_end();
+				neon = false;
+				bytes = 0;
+			}
+		}
+	}
+
+	if (neon)
+		kernel_neon_end();
+	return err;
+}
+
+static int __maybe_unused xts_encrypt_batch(struct skcipher_request **reqs,
+					    unsigned int nreqs)
+{
+	return xts_crypt_batch(reqs, nreqs, true);
+}
+
+static int __maybe_unused xts_decrypt_batch(struct skcipher_request **reqs,
+					    unsigned int nreqs)
+{
+	return xts_crypt_batch(reqs, nreqs, false);
+}
+
 static struct skcipher_alg aes_algs[] = { {
 #if defined(USE_V8_CRYPTO_EXTENSIONS) || !IS_ENABLED(CONFIG_CRYPTO_AES_ARM64_BS)
 	.base = {
@@ -688,6 +774,8 @@ static struct skcipher_alg aes_algs[] = { {
 	.setkey		= xts_set_key,
 	.encrypt	= xts_encrypt,
 	.decrypt	= xts_decrypt,
+	.encrypt_batch	= xts_encrypt_batch,
+	.decrypt_batch	= xts_decrypt_batch,
 }, {
 #endif
 	.base = {
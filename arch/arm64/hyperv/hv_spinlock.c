@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Hyper-V specific spinlock code for ARM64.
+ *
+ * Unlike x86 there is no guest idle MSR: a WFI issued by the guest traps
+ * to Hyper-V, which deschedules the vCPU until an interrupt is pending for
+ * it. pv_wait() therefore becomes a masked WFI and pv_kick() a reschedule
+ * IPI aimed at the waiting vCPU.
+ */
+
+#define pr_fmt(fmt) "Hyper-V: " fmt
+
+#include <linux/spinlock.h>
+#include <linux/smp.h>
+
+#include <asm/barrier.h>
+#include <asm/daifflags.h>
+#include <asm/mshyperv.h>
+#include <asm/paravirt.h>
+
+static bool __initdata hv_pvspin = true;
+
+static void hv_qlock_kick(int cpu)
+{
+	smp_send_reschedule(cpu);
+}
+
+static void hv_qlock_wait(u8 *byte, u8 val)
+{
+	unsigned long flags;
+
+	if (in_nmi())
+		return;
+
+	/*
+	 * WFI completes on any pending interrupt, masked or not, so the
+	 * kick cannot be lost as long as the lock value is checked with
+	 * interrupts masked. local_daif_save() is used rather than
+	 * local_irq_save() because with GIC priority masking an interrupt
+	 * hidden by the PMR would not wake the vCPU at all.
+	 */
+	flags = local_daif_save();
+	if (READ_ONCE(*byte) == val)
+		wfi();
+	local_daif_restore(flags);
+}
+
+void __init hv_init_spinlocks(void)
+{
+	if (!hv_pvspin || !hv_is_hyperv_initialized() ||
+	    num_possible_cpus() == 1) {
+		pr_info("PV spinlocks disabled\n");
+		return;
+	}
+	pr_info("PV spinlocks enabled\n");
+
+	__pv_init_lock_hash();
+	pv_ops.lock.wait = hv_qlock_wait;
+	pv_ops.lock.kick = hv_qlock_kick;
+	static_branch_enable(&pv_qspinlock_enabled);
+}
+
+static __init int hv_parse_nopvspin(char *arg)
+{
+	hv_pvspin = false;
+	return 0;
+}
+early_param("hv_nopvspin", hv_parse_nopvspin);
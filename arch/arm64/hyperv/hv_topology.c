@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Host CPU topology hints for Hyper-V guests on ARM64.
+ *
+ * Hyper-V describes the vCPUs of a guest as flat cores without a PPTT, so
+ * the scheduler has no idea which vCPUs are backed by SMT siblings, share a
+ * cache or run on the big cores of the host. The VM launcher knows the
+ * placement of the vCPUs and can pass it on the kernel command line, one
+ * entry per vCPU in logical CPU order:
+ *
+ *   hv_topology=<package>.<core>.<llc>[:<capacity>],...
+ *
+ * vCPUs with the same package and core are SMT siblings, vCPUs with the
+ * same llc share the last level cache, and the optional capacity is
+ * relative to the other vCPUs. For example, two SMT pairs sharing a cache
+ * and two little cores with half their capacity:
+ *
+ *   hv_topology=0.0.0:2,0.0.0:2,0.1.0:2,0.1.0:2,0.2.1:1,0.3.1:1
+ */
+
+#define pr_fmt(fmt) "Hyper-V: " fmt
+
+#include <linux/arch_topology.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include <asm/mshyperv.h>
+
+static char *hv_topology_str __initdata;
+
+static int __init parse_hv_topology(char *arg)
+{
+	hv_topology_str = arg;
+	return 0;
+}
+early_param("hv_topology", parse_hv_topology);
+
+static int __init hv_parse_topology(char *str, struct cpu_topology_hint *hints)
+{
+	unsigned int cpu, sibling, nr = 0;
+	char *entry;
+
+	while ((entry = strsep(&str, ",")) != NULL) {
+		struct cpu_topology_hint *hint = &hints[nr];
+		int ret;
+
+		if (nr >= nr_cpu_ids)
+			return -E2BIG;
+
+		hint->capacity = 0;
+		ret = sscanf(entry, "%d.%d.%d:%lu", &hint->package_id,
+			     &hint->core_id, &hint->llc_id, &hint->capacity);
+		if (ret < 3 || hint->package_id < 0 || hint->core_id < 0 ||
+		    hint->llc_id < 0)
+			return -EINVAL;
+		nr++;
+	}
+
+	if (nr < nr_cpu_ids)
+		return -EINVAL;
+
+	/* number the SMT siblings, cores without any get no thread id */
+	for (cpu = 0; cpu < nr; cpu++) {
+		hints[cpu].thread_id = -1;
+		for (sibling = 0; sibling < nr; sibling++) {
+			if (sibling == cpu ||
+			    hints[sibling].package_id != hints[cpu].package_id ||
+			    hints[sibling].core_id != hints[cpu].core_id)
+				continue;
+			if (hints[cpu].thread_id < 0)
+				hints[cpu].thread_id = 0;
+			if (sibling < cpu)
+				hints[cpu].thread_id++;
+		}
+	}
+
+	return 0;
+}
+
+void __init hv_init_topology(void)
+{
+	struct cpu_topology_hint *hints;
+	int ret;
+
+	if (!hv_topology_str || !hv_is_hyperv_initialized())
+		return;
+
+	hints = kcalloc(nr_cpu_ids, sizeof(*hints), GFP_KERNEL);
+	if (!hints)
+		return;
+
+	ret = hv_parse_topology(hv_topology_str, hints);
+	if (!ret)
+		ret = topology_apply_hints(hints, nr_cpu_ids);
+
+	if (ret)
+		pr_warn("Ignoring invalid hv_topology: %d\n", ret);
+	else
+		pr_info("CPU topology taken from hv_topology\n");
+
+	kfree(hints);
+}
@@ -150,6 +150,8 @@ static int __init hyperv_init(void)
 
 	/* Query the VMs extended capability once, so that it can be cached. */
 	hv_query_ext_cap(0);
+
+	hv_init_topology();
 	return 0;
 }
 
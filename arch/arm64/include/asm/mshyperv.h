@@ -32,6 +32,14 @@ void __init hyperv_early_init(void);
 static inline void hyperv_early_init(void) {};
 #endif
 
+#if IS_ENABLED(CONFIG_HYPERV) && defined(CONFIG_PARAVIRT_SPINLOCKS)
+void __init hv_init_spinlocks(void);
+#else
+static inline void hv_init_spinlocks(void) {};
+#endif
+
+void __init hv_init_topology(void);
+
 /*
  * Declare calls to get and set Hyper-V VP register values on ARM64, which
  * requires a hypercall.
@@ -60,7 +68,12 @@ static inline u64 hv_get_register(unsigned int reg)
 
 static inline u64 hv_get_raw_timer(void)
 {
+#ifdef BUILD_VDSO
+	/* The vDSO can't call into the arch timer driver */
+	return __arch_counter_get_cntvct();
+#else
 	return arch_timer_read_counter();
+#endif
 }
 
 /* SMCCC hypercall parameters */
@@ -11,8 +11,16 @@ struct pv_time_ops {
 	unsigned long long (*steal_clock)(int cpu);
 };
 
+struct pv_lock_ops {
+	void (*wait)(u8 *ptr, u8 val);
+	void (*kick)(int cpu);
+};
+
 struct paravirt_patch_template {
 	struct pv_time_ops time;
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+	struct pv_lock_ops lock;
+#endif
 };
 
 extern struct paravirt_patch_template pv_ops;
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __ASM_QSPINLOCK_H
+#define __ASM_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+#include <linux/jump_label.h>
+#include <asm/barrier.h>
+#include <asm/paravirt.h>
+
+#define SPIN_THRESHOLD		(1 << 15)
+
+DECLARE_STATIC_KEY_FALSE(pv_qspinlock_enabled);
+
+extern void native_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+extern void __pv_init_lock_hash(void);
+extern void __pv_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val);
+extern void __pv_queued_spin_unlock(struct qspinlock *lock);
+
+static __always_inline void queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
+{
+	if (static_branch_unlikely(&pv_qspinlock_enabled))
+		__pv_queued_spin_lock_slowpath(lock, val);
+	else
+		native_queued_spin_lock_slowpath(lock, val);
+}
+
+#define queued_spin_unlock queued_spin_unlock
+static __always_inline void queued_spin_unlock(struct qspinlock *lock)
+{
+	if (static_branch_unlikely(&pv_qspinlock_enabled))
+		__pv_queued_spin_unlock(lock);
+	else
+		smp_store_release(&lock->locked, 0);
+}
+
+static __always_inline void pv_wait(u8 *ptr, u8 val)
+{
+	pv_ops.lock.wait(ptr, val);
+}
+
+static __always_inline void pv_kick(int cpu)
+{
+	pv_ops.lock.kick(cpu);
+}
+#endif /* CONFIG_PARAVIRT_SPINLOCKS */
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* __ASM_QSPINLOCK_H */
@@ -12,7 +12,7 @@
  */
 #define VDSO_LBASE	0x0
 
-#define __VVAR_PAGES    2
+#define __VVAR_PAGES    3
 
 #ifndef __ASSEMBLY__
 
@@ -6,6 +6,13 @@
 	/* vdso clocksource for both 32 and 64bit tasks */	\
 	VDSO_CLOCKMODE_ARCHTIMER,				\
 	/* vdso clocksource for 64bit tasks only */		\
-	VDSO_CLOCKMODE_ARCHTIMER_NOCOMPAT
+	VDSO_CLOCKMODE_ARCHTIMER_NOCOMPAT,			\
+	/* Hyper-V reference TSC page, 64bit tasks only */	\
+	VDSO_CLOCKMODE_HVCLOCK
+
+#define HAVE_VDSO_CLOCKMODE_HVCLOCK
+
+/* The Hyper-V reference TSC page follows the data and timens vvar pages */
+#define __VVAR_HVCLOCK_PAGE	2
 
 #endif
@@ -9,6 +9,8 @@
 
 #include <asm/barrier.h>
 #include <asm/unistd.h>
+#include <asm/vdso/clocksource.h>
+#include <clocksource/hyperv_timer.h>
 
 #define VDSO_HAS_CLOCK_GETRES		1
 
@@ -77,6 +79,12 @@ static __always_inline u64 __arch_get_hw_counter(s32 clock_mode,
 	if (clock_mode == VDSO_CLOCKMODE_NONE)
 		return 0;
 
+#ifdef CONFIG_HYPERV_TIMER
+	if (clock_mode == VDSO_CLOCKMODE_HVCLOCK)
+		return hv_read_tsc_page((const void *)_vdso_data +
+					__VVAR_HVCLOCK_PAGE * PAGE_SIZE);
+#endif
+
 	/*
 	 * This isb() is required to prevent that the counter value
 	 * is speculated.
@@ -102,6 +110,17 @@ const struct vdso_data *__arch_get_timens_vdso_data(void)
 }
 #endif
 
+/*
+ * The Hyper-V reference TSC page can be invalidated by the host at any
+ * time, which hv_read_tsc_page() reports by returning U64_MAX. Fall back
+ * to the syscall in that case.
+ */
+static inline bool arch_vdso_cycles_ok(u64 cycles)
+{
+	return (s64)cycles >= 0;
+}
+#define vdso_cycles_ok arch_vdso_cycles_ok
+
 #endif /* !__ASSEMBLY__ */
 
 #endif /* __ASM_VDSO_GETTIMEOFDAY_H */
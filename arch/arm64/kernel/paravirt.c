@@ -29,6 +29,16 @@ struct static_key paravirt_steal_rq_enabled;
 struct paravirt_patch_template pv_ops;
 EXPORT_SYMBOL_GPL(pv_ops);
 
+#ifdef CONFIG_PARAVIRT_SPINLOCKS
+/*
+ * Selects the paravirt qspinlock slowpath and unlock. Only a hypervisor
+ * specific init routine that has filled in pv_ops.lock may enable it, and
+ * it must do so before secondary CPUs are brought up.
+ */
+DEFINE_STATIC_KEY_FALSE(pv_qspinlock_enabled);
+EXPORT_SYMBOL(pv_qspinlock_enabled);
+#endif
+
 struct pv_time_stolen_time_region {
 	struct pvclock_vcpu_stolen_time *kaddr;
 };
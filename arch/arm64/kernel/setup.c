@@ -376,6 +376,9 @@ void __init __no_sanitize_address setup_arch(char **cmdline_p)
 	smp_init_cpus();
 	smp_build_mpidr_hash();
 
+	/* Sizes its lock hash by the possible CPUs, so after smp_init_cpus() */
+	hv_init_spinlocks();
+
 	/* Init percpu seeds for random tags after cpus are set up. */
 	kasan_init_sw_tags();
 
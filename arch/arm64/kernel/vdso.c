@@ -24,8 +24,10 @@
 #include <vdso/datapage.h>
 #include <vdso/helpers.h>
 #include <vdso/vsyscall.h>
+#include <clocksource/hyperv_timer.h>
 
 #include <asm/cacheflush.h>
+#include <asm/clocksource.h>
 #include <asm/signal32.h>
 #include <asm/vdso.h>
 
@@ -40,9 +42,12 @@ enum vdso_abi {
 enum vvar_pages {
 	VVAR_DATA_PAGE_OFFSET,
 	VVAR_TIMENS_PAGE_OFFSET,
+	VVAR_HVCLOCK_PAGE_OFFSET,
 	VVAR_NR_PAGES,
 };
 
+unsigned int vclocks_used __read_mostly;
+
 struct vdso_abi_info {
 	const char *name;
 	const char *vdso_code_start;
@@ -212,6 +217,13 @@ static vm_fault_t vvar_fault(const struct vm_special_mapping *sm,
 		pfn = sym_to_pfn(vdso_data);
 		break;
 #endif /* CONFIG_TIME_NS */
+#ifdef CONFIG_HYPERV_TIMER
+	case VVAR_HVCLOCK_PAGE_OFFSET:
+		if (!vclock_was_used(VDSO_CLOCKMODE_HVCLOCK))
+			return VM_FAULT_SIGBUS;
+		pfn = sym_to_pfn(hv_get_tsc_page());
+		break;
+#endif /* CONFIG_HYPERV_TIMER */
 	default:
 		return VM_FAULT_SIGBUS;
 	}
@@ -240,6 +252,7 @@ static int __setup_additional_pages(enum vdso_abi abi,
 	void *ret;
 
 	BUILD_BUG_ON(VVAR_NR_PAGES != __VVAR_PAGES);
+	BUILD_BUG_ON(VVAR_HVCLOCK_PAGE_OFFSET != __VVAR_HVCLOCK_PAGE);
 
 	vdso_text_len = vdso_info[abi].vdso_pages << PAGE_SHIFT;
 	/* Be sure to map the data page */
@@ -1444,6 +1444,7 @@ again:
 	}
 
 	blk_throtl_bio_endio(bio);
+	blkcg_lat_hist_bio_endio(bio);
 	/* release cgroup info */
 	bio_uninit(bio);
 	if (bio->bi_end_io)
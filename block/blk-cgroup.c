@@ -32,6 +32,7 @@
 #include <linux/psi.h>
 #include "blk.h"
 #include "blk-ioprio.h"
+#include "blk-stat.h"
 
 #define MAX_KEY_LEN 100
 
@@ -81,6 +82,7 @@ static void blkg_free(struct blkcg_gq *blkg)
 		if (blkg->pd[i])
 			blkcg_policy[i]->pd_free_fn(blkg->pd[i]);
 
+	free_percpu(blkg->lat_hist);
 	free_percpu(blkg->iostat_cpu);
 	percpu_ref_exit(&blkg->refcnt);
 	kfree(blkg);
@@ -166,6 +168,11 @@ static struct blkcg_gq *blkg_alloc(struct blkcg *blkcg, struct request_queue *q,
 	if (!blkg->iostat_cpu)
 		goto err_free;
 
+	/* a missing histogram only means the blkg is not accounted */
+	if (blk_stat_lat_hist_enabled(q))
+		blkg->lat_hist = alloc_percpu_gfp(struct blk_lat_hist,
+						  gfp_mask | __GFP_NOWARN);
+
 	blkg->q = q;
 	INIT_LIST_HEAD(&blkg->q_node);
 	spin_lock_init(&blkg->async_bio_lock);
@@ -1931,6 +1938,101 @@ void blk_cgroup_bio_start(struct bio *bio)
 	put_cpu();
 }
 
+/*
+ * Account the latency of @bio, from submission including any throttling to
+ * completion, into the histogram of its blkg.
+ */
+void blkcg_lat_hist_bio_endio(struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio->bi_blkg;
+	struct blk_lat_hist __percpu *hist;
+	u64 start, now;
+
+	if (!blkg || !READ_ONCE(blkg->lat_hist))
+		return;
+
+	start = bio_issue_time(&bio->bi_issue);
+	if (!start)
+		return;
+
+	rcu_read_lock();
+	hist = READ_ONCE(blkg->lat_hist);
+	if (hist && blk_stat_lat_hist_enabled(blkg->q)) {
+		now = __bio_issue_time(ktime_get_ns());
+		if (now > start)
+			blk_lat_hist_add(hist, bio_op(bio),
+					 bio_issue_size(&bio->bi_issue),
+					 now - start);
+	}
+	rcu_read_unlock();
+}
+
+void blkcg_enable_lat_hist(struct request_queue *q)
+{
+	struct blkcg_gq *blkg;
+
+	spin_lock_irq(&q->queue_lock);
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		if (blkg->lat_hist)
+			continue;
+		WRITE_ONCE(blkg->lat_hist,
+			   alloc_percpu_gfp(struct blk_lat_hist,
+					    GFP_NOWAIT | __GFP_NOWARN));
+	}
+	spin_unlock_irq(&q->queue_lock);
+}
+
+/* Called once no completion can see the queue histogram enabled anymore */
+void blkcg_disable_lat_hist(struct request_queue *q)
+{
+	struct blkcg_gq *blkg;
+
+	spin_lock_irq(&q->queue_lock);
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		free_percpu(blkg->lat_hist);
+		WRITE_ONCE(blkg->lat_hist, NULL);
+	}
+	spin_unlock_irq(&q->queue_lock);
+}
+
+/*
+ * Summing the per-cpu histograms is too slow to do under the queue lock, so
+ * walk the blkgs under RCU instead, which keeps both them and their
+ * histograms around. The caller holds blk_lat_hist_mutex, so the histograms
+ * are not disabled under us either. blkgs may come and go during the walk,
+ * so the record count in the header is only filled in at the end.
+ */
+void blkcg_lat_hist_show(struct request_queue *q, struct seq_file *m)
+{
+	struct blk_lat_hist __percpu *hist;
+	struct cgroup_subsys_state *pos_css;
+	struct blk_lat_hist_hdr *hdr;
+	struct blkcg_gq *blkg;
+	size_t hdr_pos = m->count;
+	unsigned int nr = 0;
+
+	blk_lat_hist_write_hdr(m, 0);
+
+	rcu_read_lock();
+	if (q->root_blkg) {
+		blkg_for_each_descendant_pre(blkg, pos_css, q->root_blkg) {
+			hist = READ_ONCE(blkg->lat_hist);
+			if (!hist)
+				continue;
+			blk_lat_hist_write(m, cgroup_id(blkg->blkcg->css.cgroup),
+					   hist);
+			nr++;
+		}
+	}
+	rcu_read_unlock();
+
+	/* On overflow seq_file retries with a larger buffer */
+	if (!seq_has_overflowed(m)) {
+		hdr = (struct blk_lat_hist_hdr *)(m->buf + hdr_pos);
+		hdr->nr_records = nr;
+	}
+}
+
 static int __init blkcg_init(void)
 {
 	blkcg_punt_bio_wq = alloc_workqueue("blkcg_punt_bio",
@@ -15,6 +15,7 @@
 #include <linux/blkdev.h>
 #include <linux/crypto.h>
 #include <linux/keyslot-manager.h>
+#include <linux/llist.h>
 #include <linux/mempool.h>
 #include <linux/module.h>
 #include <linux/random.h>
@@ -47,7 +48,7 @@ struct bio_fallback_crypt_ctx {
 	struct bvec_iter crypt_iter;
 	union {
 		struct {
-			struct work_struct work;
+			struct llist_node decrypt_node;
 			struct bio *bio;
 		};
 		struct {
@@ -81,6 +82,18 @@ static struct blk_keyslot_manager blk_crypto_ksm;
 static struct workqueue_struct *blk_crypto_wq;
 static mempool_t *blk_crypto_bounce_page_pool;
 
+/*
+ * Read bios to decrypt are queued on the CPU that completed them, and each
+ * CPU's batch is decrypted by a work item bound to that CPU.  Consecutive bios
+ * with the same key share a keyslot and a cipher request.
+ */
+struct blk_crypto_decrypt_batch {
+	struct llist_head bios;
+	struct work_struct work;
+};
+
+static struct blk_crypto_decrypt_batch __percpu *blk_crypto_decrypt_batches;
+
 /*
  * This is the key we set when evicting a keyslot. This *should* be the all 0's
  * key, but AES-XTS rejects that key, so we use some random bytes instead.
@@ -370,17 +383,15 @@ out_put_enc_bio:
 
 /*
  * The crypto API fallback's main decryption routine.
- * Decrypts input bio in place, and calls bio_endio on the bio.
+ * Decrypts input bio in place using the given cipher request.
  */
-static void blk_crypto_fallback_decrypt_bio(struct work_struct *work)
+static blk_status_t
+blk_crypto_fallback_decrypt_bio(struct bio_fallback_crypt_ctx *f_ctx,
+				struct skcipher_request *ciph_req,
+				struct crypto_wait *wait)
 {
-	struct bio_fallback_crypt_ctx *f_ctx =
-		container_of(work, struct bio_fallback_crypt_ctx, work);
 	struct bio *bio = f_ctx->bio;
 	struct bio_crypt_ctx *bc = &f_ctx->crypt_ctx;
-	struct blk_ksm_keyslot *slot;
-	struct skcipher_request *ciph_req = NULL;
-	DECLARE_CRYPTO_WAIT(wait);
 	u64 curr_dun[BLK_CRYPTO_DUN_ARRAY_SIZE];
 	union blk_crypto_iv iv;
 	struct scatterlist sg;
@@ -388,23 +399,6 @@ static void blk_crypto_fallback_decrypt_bio(struct work_struct *work)
 	struct bvec_iter iter;
 	const int data_unit_size = bc->bc_key->crypto_cfg.data_unit_size;
 	unsigned int i;
-	blk_status_t blk_st;
-
-	/*
-	 * Use the crypto API fallback keyslot manager to get a crypto_skcipher
-	 * for the algorithm and key specified for this bio.
-	 */
-	blk_st = blk_ksm_get_slot_for_key(&blk_crypto_ksm, bc->bc_key, &slot);
-	if (blk_st != BLK_STS_OK) {
-		bio->bi_status = blk_st;
-		goto out_no_keyslot;
-	}
-
-	/* and then allocate an skcipher_request for it */
-	if (!blk_crypto_alloc_cipher_req(slot, &ciph_req, &wait)) {
-		bio->bi_status = BLK_STS_RESOURCE;
-		goto out;
-	}
 
 	memcpy(curr_dun, bc->bc_dun, sizeof(curr_dun));
 	sg_init_table(&sg, 1);
@@ -421,21 +415,74 @@ static void blk_crypto_fallback_decrypt_bio(struct work_struct *work)
 		for (i = 0; i < bv.bv_len; i += data_unit_size) {
 			blk_crypto_dun_to_iv(curr_dun, &iv);
 			if (crypto_wait_req(crypto_skcipher_decrypt(ciph_req),
-					    &wait)) {
-				bio->bi_status = BLK_STS_IOERR;
-				goto out;
-			}
+					    wait))
+				return BLK_STS_IOERR;
 			bio_crypt_dun_increment(curr_dun, 1);
 			sg.offset += data_unit_size;
 		}
 	}
 
-out:
-	skcipher_request_free(ciph_req);
-	blk_ksm_put_slot(slot);
-out_no_keyslot:
-	mempool_free(f_ctx, bio_fallback_crypt_ctx_pool);
-	bio_endio(bio);
+	return BLK_STS_OK;
+}
+
+/*
+ * Decrypt the bios queued on this CPU, and call bio_endio on them.
+ */
+static void blk_crypto_fallback_decrypt_work(struct work_struct *work)
+{
+	struct blk_crypto_decrypt_batch *batch =
+		container_of(work, struct blk_crypto_decrypt_batch, work);
+	struct llist_node *bios = llist_reverse_order(llist_del_all(&batch->bios));
+	struct bio_fallback_crypt_ctx *f_ctx, *next;
+	const struct blk_crypto_key *key = NULL;
+	struct blk_ksm_keyslot *slot = NULL;
+	struct skcipher_request *ciph_req = NULL;
+	DECLARE_CRYPTO_WAIT(wait);
+
+	llist_for_each_entry_safe(f_ctx, next, bios, decrypt_node) {
+		struct bio *bio = f_ctx->bio;
+		const struct blk_crypto_key *bc_key = f_ctx->crypt_ctx.bc_key;
+		blk_status_t blk_st = BLK_STS_OK;
+
+		if (bc_key != key) {
+			/*
+			 * Use the crypto API fallback keyslot manager to get a
+			 * crypto_skcipher for the algorithm and key specified
+			 * for this bio, and allocate an skcipher_request for
+			 * it.
+			 */
+			blk_st = blk_ksm_get_slot_for_key(&blk_crypto_ksm,
+							  bc_key, &slot);
+			if (blk_st == BLK_STS_OK &&
+			    !blk_crypto_alloc_cipher_req(slot, &ciph_req,
+							 &wait))
+				blk_st = BLK_STS_RESOURCE;
+			if (blk_st == BLK_STS_OK)
+				key = bc_key;
+		}
+
+		if (blk_st == BLK_STS_OK)
+			blk_st = blk_crypto_fallback_decrypt_bio(f_ctx, ciph_req,
+								 &wait);
+		if (blk_st != BLK_STS_OK)
+			bio->bi_status = blk_st;
+
+		/*
+		 * The key may be evicted once its last bio has completed, and
+		 * eviction fails if the key's keyslot is still in use.
+		 */
+		if (key != bc_key || !next || next->crypt_ctx.bc_key != key) {
+			skcipher_request_free(ciph_req);
+			ciph_req = NULL;
+			blk_ksm_put_slot(slot);
+			slot = NULL;
+			key = NULL;
+		}
+
+		mempool_free(f_ctx, bio_fallback_crypt_ctx_pool);
+		bio_endio(bio);
+		cond_resched();
+	}
 }
 
 /**
@@ -443,12 +490,14 @@ out_no_keyslot:
  *
  * @bio: the bio to queue
  *
- * Restore bi_private and bi_end_io, and queue the bio for decryption into a
- * workqueue, since this function will be called from an atomic context.
+ * Restore bi_private and bi_end_io, and queue the bio for decryption into this
+ * CPU's batch, since this function will be called from an atomic context.
  */
 static void blk_crypto_fallback_decrypt_endio(struct bio *bio)
 {
 	struct bio_fallback_crypt_ctx *f_ctx = bio->bi_private;
+	struct blk_crypto_decrypt_batch *batch;
+	int cpu;
 
 	bio->bi_private = f_ctx->bi_private_orig;
 	bio->bi_end_io = f_ctx->bi_end_io_orig;
@@ -460,9 +509,13 @@ static void blk_crypto_fallback_decrypt_endio(struct bio *bio)
 		return;
 	}
 
-	INIT_WORK(&f_ctx->work, blk_crypto_fallback_decrypt_bio);
 	f_ctx->bio = bio;
-	queue_work(blk_crypto_wq, &f_ctx->work);
+	cpu = get_cpu();
+	batch = per_cpu_ptr(blk_crypto_decrypt_batches, cpu);
+	/* Only the first bio of a batch needs to kick the worker */
+	if (llist_add(&f_ctx->decrypt_node, &batch->bios))
+		queue_work_on(cpu, blk_crypto_wq, &batch->work);
+	put_cpu();
 }
 
 /**
@@ -553,16 +606,27 @@ static int blk_crypto_fallback_init(void)
 	blk_crypto_ksm.crypto_modes_supported[BLK_ENCRYPTION_MODE_INVALID] = 0;
 
 	blk_crypto_wq = alloc_workqueue("blk_crypto_wq",
-					WQ_UNBOUND | WQ_HIGHPRI |
-					WQ_MEM_RECLAIM, num_online_cpus());
+					WQ_HIGHPRI | WQ_MEM_RECLAIM, 0);
 	if (!blk_crypto_wq)
 		goto fail_free_ksm;
 
+	blk_crypto_decrypt_batches =
+		alloc_percpu(struct blk_crypto_decrypt_batch);
+	if (!blk_crypto_decrypt_batches)
+		goto fail_free_wq;
+	for_each_possible_cpu(i) {
+		struct blk_crypto_decrypt_batch *batch =
+			per_cpu_ptr(blk_crypto_decrypt_batches, i);
+
+		init_llist_head(&batch->bios);
+		INIT_WORK(&batch->work, blk_crypto_fallback_decrypt_work);
+	}
+
 	blk_crypto_keyslots = kcalloc(blk_crypto_num_keyslots,
 				      sizeof(blk_crypto_keyslots[0]),
 				      GFP_KERNEL);
 	if (!blk_crypto_keyslots)
-		goto fail_free_wq;
+		goto fail_free_batches;
 
 	blk_crypto_bounce_page_pool =
 		mempool_create_page_pool(num_prealloc_bounce_pg, 0);
@@ -588,6 +652,8 @@ fail_free_bounce_page_pool:
 	mempool_destroy(blk_crypto_bounce_page_pool);
 fail_free_keyslots:
 	kfree(blk_crypto_keyslots);
+fail_free_batches:
+	free_percpu(blk_crypto_decrypt_batches);
 fail_free_wq:
 	destroy_workqueue(blk_crypto_wq);
 fail_free_ksm:
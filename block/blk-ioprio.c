@@ -10,6 +10,12 @@
  *   controller affects page cache writeback I/O for filesystems that support
  *   assiociating a cgroup with writeback I/O. See also
  *   Documentation/admin-guide/cgroup-v2.rst.
+ *
+ * Independently of the class policy, reads and synchronous writes issued by
+ * a task whose effective uclamp.min is at least prio.uclamp_boost of its
+ * cgroup are promoted to IOPRIO_CLASS_RT. This lets latency sensitive work,
+ * e.g. an app being launched, get ahead of background writes without
+ * changing cgroup settings each time such a task comes and goes.
  */
 
 #include <linux/blk-cgroup.h>
@@ -17,6 +23,7 @@
 #include <linux/blk_types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 #include "blk-ioprio.h"
 #include "blk-rq-qos.h"
 
@@ -58,10 +65,13 @@ struct ioprio_blkg {
  * struct ioprio_blkcg - Per cgroup data.
  * @cpd: blkcg_policy_data structure.
  * @prio_policy: One of the IOPRIO_CLASS_* values. See also <linux/ioprio.h>.
+ * @uclamp_boost: Minimum effective uclamp.min for a task's I/O to be promoted
+ *		to IOPRIO_CLASS_RT. Zero disables the boost.
  */
 struct ioprio_blkcg {
 	struct blkcg_policy_data cpd;
 	enum prio_policy	 prio_policy;
+	unsigned int		 uclamp_boost;
 };
 
 static inline struct ioprio_blkg *pd_to_ioprio(struct blkg_policy_data *pd)
@@ -116,6 +126,35 @@ static ssize_t ioprio_set_prio_policy(struct kernfs_open_file *of, char *buf,
 	return nbytes;
 }
 
+static int ioprio_show_uclamp_boost(struct seq_file *sf, void *v)
+{
+	struct ioprio_blkcg *blkcg = ioprio_blkcg_from_css(seq_css(sf));
+
+	seq_printf(sf, "%u\n", blkcg->uclamp_boost);
+	return 0;
+}
+
+static ssize_t ioprio_set_uclamp_boost(struct kernfs_open_file *of, char *buf,
+				       size_t nbytes, loff_t off)
+{
+	struct ioprio_blkcg *blkcg = ioprio_blkcg_from_css(of_css(of));
+	unsigned int val;
+	int ret;
+
+	if (off != 0)
+		return -EIO;
+	ret = kstrtouint(strstrip(buf), 0, &val);
+	if (ret)
+		return ret;
+	if (val > SCHED_CAPACITY_SCALE)
+		return -ERANGE;
+	if (!IS_ENABLED(CONFIG_UCLAMP_TASK) && val)
+		return -EOPNOTSUPP;
+	WRITE_ONCE(blkcg->uclamp_boost, val);
+
+	return nbytes;
+}
+
 static struct blkg_policy_data *
 ioprio_alloc_pd(gfp_t gfp, struct request_queue *q, struct blkcg *blkcg)
 {
@@ -159,6 +198,11 @@ static void ioprio_free_cpd(struct blkcg_policy_data *cpd)
 		.seq_show	= ioprio_show_prio_policy,	\
 		.write		= ioprio_set_prio_policy,	\
 	},							\
+	{							\
+		.name		= "prio.uclamp_boost",		\
+		.seq_show	= ioprio_show_uclamp_boost,	\
+		.write		= ioprio_set_uclamp_boost,	\
+	},							\
 	{ } /* sentinel */
 
 /* cgroup v2 attributes */
@@ -186,6 +230,26 @@ struct blk_ioprio {
 	struct rq_qos rqos;
 };
 
+/*
+ * The rq-qos track hook runs in the context of the task submitting @bio, so
+ * its effective clamp is the one the scheduler currently applies. Only
+ * reads and synchronous writes are boosted, never background writeback.
+ */
+static bool ioprio_uclamp_boosted(struct ioprio_blkcg *blkcg, struct bio *bio)
+{
+#ifdef CONFIG_UCLAMP_TASK
+	unsigned int boost = READ_ONCE(blkcg->uclamp_boost);
+
+	if (!boost)
+		return false;
+	if (op_is_write(bio_op(bio)) && !op_is_sync(bio->bi_opf))
+		return false;
+	return current->uclamp[UCLAMP_MIN].value >= boost;
+#else
+	return false;
+#endif
+}
+
 static void blkcg_ioprio_track(struct rq_qos *rqos, struct request *rq,
 			       struct bio *bio)
 {
@@ -201,6 +265,12 @@ static void blkcg_ioprio_track(struct rq_qos *rqos, struct request *rq,
 	 */
 	bio->bi_ioprio = max_t(u16, bio->bi_ioprio,
 			       IOPRIO_PRIO_VALUE(blkcg->prio_policy, 0));
+
+	/* An explicit idle class is a request from userspace, respect it */
+	if (IOPRIO_PRIO_CLASS(bio->bi_ioprio) != IOPRIO_CLASS_IDLE &&
+	    ioprio_uclamp_boosted(blkcg, bio))
+		bio->bi_ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT,
+					IOPRIO_PRIO_DATA(bio->bi_ioprio));
 }
 
 static void blkcg_ioprio_exit(struct rq_qos *rqos)
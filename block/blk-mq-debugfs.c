@@ -13,6 +13,7 @@
 #include "blk-mq-debugfs.h"
 #include "blk-mq-tag.h"
 #include "blk-rq-qos.h"
+#include "blk-stat.h"
 
 static void print_stat(struct seq_file *m, struct blk_rq_stat *stat)
 {
@@ -203,6 +204,45 @@ static ssize_t queue_write_hint_store(void *data, const char __user *buf,
 	return count;
 }
 
+/*
+ * The lat_hist files are binary, see &struct blk_lat_hist_hdr for the
+ * layout. Writing 1 to either of them starts the accounting, 0 stops it
+ * and frees the histograms.
+ */
+static int queue_lat_hist_show(void *data, struct seq_file *m)
+{
+	return blk_stat_lat_hist_show(data, m, false);
+}
+
+static int queue_lat_hist_cgroup_show(void *data, struct seq_file *m)
+{
+	return blk_stat_lat_hist_show(data, m, true);
+}
+
+static ssize_t queue_lat_hist_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct request_queue *q = data;
+	bool enable;
+	int ret;
+
+	if (blk_queue_dead(q))
+		return -ENOENT;
+
+	ret = kstrtobool_from_user(buf, count, &enable);
+	if (ret)
+		return ret;
+
+	if (enable) {
+		ret = blk_stat_enable_lat_hist(q);
+		if (ret)
+			return ret;
+	} else {
+		blk_stat_disable_lat_hist(q);
+	}
+	return count;
+}
+
 static const struct blk_mq_debugfs_attr blk_mq_debugfs_queue_attrs[] = {
 	{ "poll_stat", 0400, queue_poll_stat_show },
 	{ "requeue_list", 0400, .seq_ops = &queue_requeue_list_seq_ops },
@@ -210,6 +250,9 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_queue_attrs[] = {
 	{ "state", 0600, queue_state_show, queue_state_write },
 	{ "write_hints", 0600, queue_write_hint_show, queue_write_hint_store },
 	{ "zone_wlock", 0400, queue_zone_wlock_show, NULL },
+	{ "lat_hist", 0600, queue_lat_hist_show, queue_lat_hist_write },
+	{ "lat_hist_cgroup", 0600, queue_lat_hist_cgroup_show,
+	  queue_lat_hist_write },
 	{ },
 };
 
@@ -73,17 +73,123 @@ void __blk_mq_tag_idle(struct blk_mq_hw_ctx *hctx)
 	blk_mq_tag_wakeup_all(tags, false);
 }
 
+/*
+ * Normal tags are taken from bitmap_tags BLK_MQ_TAG_BATCH at a time with a
+ * single atomic operation and handed out from a per-cpu cache, so that each
+ * request doesn't bounce the cacheline of a bitmap word between the CPUs
+ * submitting to the same hctx. Only tag maps deep enough that the caches
+ * can't starve the allocations get one.
+ */
+#define BLK_MQ_TAG_BATCH	8
+
+static bool blk_mq_tag_cache_wanted(unsigned int depth, int alloc_policy)
+{
+	return alloc_policy != BLK_TAG_ALLOC_RR &&
+		depth >= 4 * BLK_MQ_TAG_BATCH * nr_cpu_ids;
+}
+
+static int blk_mq_tag_cache_get(atomic64_t *cache)
+{
+	s64 old = atomic64_read(cache);
+	u32 mask;
+
+	/* take the lowest free tag */
+	do {
+		mask = lower_32_bits(old);
+		if (!mask)
+			return BLK_MQ_NO_TAG;
+	} while (!atomic64_try_cmpxchg(cache, &old,
+				       old & ~(s64)(mask & -mask)));
+
+	return upper_32_bits(old) + __ffs(mask);
+}
+
+/* Give the tags of a batch taken out of a cache back to bitmap_tags */
+static void blk_mq_tag_cache_free(struct blk_mq_tags *tags, s64 val)
+{
+	unsigned long mask = lower_32_bits(val);
+	unsigned int offset = tags->nr_reserved_tags + upper_32_bits(val);
+	int tag_array[BLK_MQ_TAG_BATCH];
+	int bit, nr = 0;
+
+	for_each_set_bit(bit, &mask, BLK_MQ_TAG_BATCH)
+		tag_array[nr++] = offset + bit;
+	if (nr)
+		blk_mq_put_tags(tags, tag_array, nr);
+}
+
+static int blk_mq_tag_cache_refill(struct blk_mq_tags *tags,
+				   atomic64_t *cache)
+{
+	unsigned long mask;
+	unsigned int offset;
+	s64 old, new;
+	int tag;
+
+	mask = __sbitmap_queue_get_batch(tags->bitmap_tags, BLK_MQ_TAG_BATCH,
+					 &offset);
+	if (!mask)
+		return BLK_MQ_NO_TAG;
+
+	tag = __ffs(mask);
+	mask &= ~BIT(tag);
+	tag += offset;
+	if (!mask)
+		return tag;
+
+	new = ((s64)offset << 32) | mask;
+	old = atomic64_read(cache);
+	/* someone else on this CPU refilled the cache meanwhile */
+	if (lower_32_bits(old) || !atomic64_try_cmpxchg(cache, &old, new))
+		blk_mq_tag_cache_free(tags, new);
+	return tag;
+}
+
+/*
+ * Give all cached tags back, before sleeping for a tag, shrinking the tag
+ * map or waiting for the requests of an hctx, so that they aren't stranded
+ * in the caches of other CPUs.
+ */
+void blk_mq_tag_cache_flush(struct blk_mq_tags *tags)
+{
+	int cpu;
+
+	if (!tags->cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		atomic64_t *cache = per_cpu_ptr(tags->cache, cpu);
+
+		blk_mq_tag_cache_free(tags, atomic64_xchg(cache, 0));
+	}
+}
+
 static int __blk_mq_get_tag(struct blk_mq_alloc_data *data,
 			    struct sbitmap_queue *bt)
 {
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
+
 	if (!data->q->elevator && !(data->flags & BLK_MQ_REQ_RESERVED) &&
 			!hctx_may_queue(data->hctx, bt))
 		return BLK_MQ_NO_TAG;
 
 	if (data->shallow_depth)
 		return __sbitmap_queue_get_shallow(bt, data->shallow_depth);
-	else
-		return __sbitmap_queue_get(bt);
+
+	/* queues sharing the tag map need the fair share of hctx_may_queue */
+	if (tags->cache && bt == tags->bitmap_tags &&
+	    !(data->hctx->flags & BLK_MQ_F_TAG_QUEUE_SHARED)) {
+		atomic64_t *cache = raw_cpu_ptr(tags->cache);
+		int tag;
+
+		tag = blk_mq_tag_cache_get(cache);
+		if (tag == BLK_MQ_NO_TAG)
+			tag = blk_mq_tag_cache_refill(tags, cache);
+		if (tag != BLK_MQ_NO_TAG)
+			return tag;
+	}
+
+	return __sbitmap_queue_get(bt);
 }
 
 unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
@@ -125,6 +231,9 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 		 */
 		blk_mq_run_hw_queue(data->hctx, false);
 
+		if (bt == tags->bitmap_tags)
+			blk_mq_tag_cache_flush(tags);
+
 		/*
 		 * Retry tag allocation after running the hardware queue,
 		 * as running the queue may also have found completions.
@@ -192,6 +301,13 @@ void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 	}
 }
 
+/* Free several normal tags at once, preferably sorted */
+void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags)
+{
+	sbitmap_queue_clear_batch(tags->bitmap_tags, tags->nr_reserved_tags,
+				  tag_array, nr_tags);
+}
+
 struct bt_iter_data {
 	struct blk_mq_hw_ctx *hctx;
 	busy_iter_fn *fn;
@@ -551,6 +667,10 @@ struct blk_mq_tags *blk_mq_init_tags(unsigned int total_tags,
 		kfree(tags);
 		return NULL;
 	}
+
+	/* the cache is only an optimization, go on without it */
+	if (blk_mq_tag_cache_wanted(total_tags - reserved_tags, alloc_policy))
+		tags->cache = alloc_percpu(atomic64_t);
 	return tags;
 }
 
@@ -560,6 +680,7 @@ void blk_mq_free_tags(struct blk_mq_tags *tags, unsigned int flags)
 		sbitmap_queue_free(tags->bitmap_tags);
 		sbitmap_queue_free(tags->breserved_tags);
 	}
+	free_percpu(tags->cache);
 	kfree(tags);
 }
 
@@ -611,6 +732,7 @@ int blk_mq_tag_update_depth(struct blk_mq_hw_ctx *hctx,
 		 * Don't need (or can't) update reserved tags here, they
 		 * remain static and should never need resizing.
 		 */
+		blk_mq_tag_cache_flush(tags);
 		sbitmap_queue_resize(tags->bitmap_tags,
 				tdepth - tags->nr_reserved_tags);
 	}
@@ -21,6 +21,13 @@ struct blk_mq_tags {
 	struct request **static_rqs;
 	struct list_head page_list;
 
+	/*
+	 * per-cpu batches of free normal tags taken from bitmap_tags, the
+	 * first tag in the upper and a mask of the free ones in the lower
+	 * 32 bits, NULL for small, shared or round robin tag maps
+	 */
+	atomic64_t __percpu *cache;
+
 	/*
 	 * used to clear request reference in rqs[] before freeing one
 	 * request pool
@@ -42,6 +49,8 @@ extern void blk_mq_exit_shared_sbitmap(struct blk_mq_tag_set *set);
 extern unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data);
 extern void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 			   unsigned int tag);
+void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags);
+void blk_mq_tag_cache_flush(struct blk_mq_tags *tags);
 extern int blk_mq_tag_update_depth(struct blk_mq_hw_ctx *hctx,
 					struct blk_mq_tags **tags,
 					unsigned int depth, bool can_grow);
@@ -2568,6 +2568,8 @@ static bool blk_mq_hctx_has_requests(struct blk_mq_hw_ctx *hctx)
 		.hctx	= hctx,
 	};
 
+	/* cached tags would be taken for requests by blk_mq_all_tag_iter() */
+	blk_mq_tag_cache_flush(tags);
 	blk_mq_all_tag_iter(tags, blk_mq_has_request, &data);
 	return data.has_rq;
 }
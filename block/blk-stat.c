@@ -7,6 +7,9 @@
 #include <linux/kernel.h>
 #include <linux/rculist.h>
 #include <linux/blk-mq.h>
+#include <linux/blk-cgroup.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
 
 #include "blk-stat.h"
 #include "blk-mq.h"
@@ -16,8 +19,14 @@ struct blk_queue_stats {
 	struct list_head callbacks;
 	spinlock_t lock;
 	bool enable_accounting;
+
+	/* read under RCU from the completion path */
+	struct blk_lat_hist __percpu *lat_hist;
 };
 
+/* serializes enabling and disabling the latency histograms */
+static DEFINE_MUTEX(blk_lat_hist_mutex);
+
 void blk_rq_stat_init(struct blk_rq_stat *stat)
 {
 	stat->min = -1ULL;
@@ -48,9 +57,100 @@ void blk_rq_stat_add(struct blk_rq_stat *stat, u64 value)
 	stat->nr_samples++;
 }
 
+static int blk_lat_hist_op(unsigned int op)
+{
+	switch (op) {
+	case REQ_OP_READ:
+		return BLK_LAT_HIST_READ;
+	case REQ_OP_WRITE:
+	case REQ_OP_ZONE_APPEND:
+	case REQ_OP_WRITE_SAME:
+	case REQ_OP_WRITE_ZEROES:
+		return BLK_LAT_HIST_WRITE;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		return BLK_LAT_HIST_DISCARD;
+	default:
+		return -1;
+	}
+}
+
+static unsigned int blk_lat_hist_size(unsigned int sectors)
+{
+	if (sectors <= (4096 >> SECTOR_SHIFT))
+		return 0;
+	if (sectors <= (32768 >> SECTOR_SHIFT))
+		return 1;
+	if (sectors <= (262144 >> SECTOR_SHIFT))
+		return 2;
+	return 3;
+}
+
+static unsigned int blk_lat_hist_bucket(u64 nsec)
+{
+	u64 val = nsec >> BLK_LAT_HIST_UNIT_SHIFT;
+	unsigned int shift, idx;
+
+	if (val < (1 << BLK_LAT_HIST_SUB_BITS))
+		return val;
+
+	shift = fls64(val) - 1 - BLK_LAT_HIST_SUB_BITS;
+	idx = ((shift + 1) << BLK_LAT_HIST_SUB_BITS) +
+	      ((val >> shift) & ((1 << BLK_LAT_HIST_SUB_BITS) - 1));
+
+	return min_t(unsigned int, idx, BLK_LAT_HIST_BUCKETS - 1);
+}
+
+void blk_lat_hist_add(struct blk_lat_hist __percpu *hist, unsigned int op,
+		      unsigned int sectors, u64 nsec)
+{
+	int idx = blk_lat_hist_op(op);
+
+	if (idx < 0)
+		return;
+
+	this_cpu_inc(hist->count[idx][blk_lat_hist_size(sectors)]
+				[blk_lat_hist_bucket(nsec)]);
+}
+
+void blk_lat_hist_write_hdr(struct seq_file *m, unsigned int nr_records)
+{
+	struct blk_lat_hist_hdr hdr = {
+		.magic		= BLK_LAT_HIST_MAGIC,
+		.unit_shift	= BLK_LAT_HIST_UNIT_SHIFT,
+		.sub_bits	= BLK_LAT_HIST_SUB_BITS,
+		.max_bits	= BLK_LAT_HIST_MAX_BITS,
+		.nr_ops		= BLK_LAT_HIST_OPS,
+		.nr_sizes	= BLK_LAT_HIST_SIZES,
+		.nr_buckets	= BLK_LAT_HIST_BUCKETS,
+		.record_size	= sizeof(u64) + sizeof(struct blk_lat_hist),
+		.nr_records	= nr_records,
+	};
+
+	seq_write(m, &hdr, sizeof(hdr));
+}
+
+/* Sum one counter at a time, struct blk_lat_hist is too large for the stack */
+void blk_lat_hist_write(struct seq_file *m, u64 id,
+			struct blk_lat_hist __percpu *hist)
+{
+	unsigned int i;
+	int cpu;
+
+	seq_write(m, &id, sizeof(id));
+	for (i = 0; i < sizeof(struct blk_lat_hist) / sizeof(u32); i++) {
+		u32 sum = 0;
+
+		for_each_possible_cpu(cpu)
+			sum += (&per_cpu_ptr(hist, cpu)->count[0][0][0])[i];
+		seq_write(m, &sum, sizeof(sum));
+	}
+}
+
 void blk_stat_add(struct request *rq, u64 now)
 {
 	struct request_queue *q = rq->q;
+	struct blk_lat_hist __percpu *hist;
 	struct blk_stat_callback *cb;
 	struct blk_rq_stat *stat;
 	int bucket, cpu;
@@ -61,6 +161,11 @@ void blk_stat_add(struct request *rq, u64 now)
 	blk_throtl_stat_add(rq, value);
 
 	rcu_read_lock();
+	hist = READ_ONCE(q->stats->lat_hist);
+	if (hist)
+		blk_lat_hist_add(hist, req_op(rq), blk_rq_stats_sectors(rq),
+				 value);
+
 	cpu = get_cpu();
 	list_for_each_entry_rcu(cb, &q->stats->callbacks, list) {
 		if (!blk_stat_is_active(cb))
@@ -161,7 +266,8 @@ void blk_stat_remove_callback(struct request_queue *q,
 
 	spin_lock_irqsave(&q->stats->lock, flags);
 	list_del_rcu(&cb->list);
-	if (list_empty(&q->stats->callbacks) && !q->stats->enable_accounting)
+	if (list_empty(&q->stats->callbacks) && !q->stats->enable_accounting &&
+	    !q->stats->lat_hist)
 		blk_queue_flag_clear(QUEUE_FLAG_STATS, q);
 	spin_unlock_irqrestore(&q->stats->lock, flags);
 
@@ -195,6 +301,85 @@ void blk_stat_enable_accounting(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_stat_enable_accounting);
 
+bool blk_stat_lat_hist_enabled(struct request_queue *q)
+{
+	return READ_ONCE(q->stats->lat_hist) != NULL;
+}
+
+/*
+ * Start accounting completion latencies of @q and of every blkcg issuing
+ * to it into histograms. Requests already in flight are not accounted.
+ */
+int blk_stat_enable_lat_hist(struct request_queue *q)
+{
+	struct blk_lat_hist __percpu *hist;
+	unsigned long flags;
+	int ret = 0;
+
+	mutex_lock(&blk_lat_hist_mutex);
+	if (q->stats->lat_hist)
+		goto out;
+
+	hist = alloc_percpu(struct blk_lat_hist);
+	if (!hist) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	spin_lock_irqsave(&q->stats->lock, flags);
+	WRITE_ONCE(q->stats->lat_hist, hist);
+	blk_queue_flag_set(QUEUE_FLAG_STATS, q);
+	spin_unlock_irqrestore(&q->stats->lock, flags);
+
+	blkcg_enable_lat_hist(q);
+out:
+	mutex_unlock(&blk_lat_hist_mutex);
+	return ret;
+}
+
+void blk_stat_disable_lat_hist(struct request_queue *q)
+{
+	struct blk_lat_hist __percpu *hist;
+	unsigned long flags;
+
+	mutex_lock(&blk_lat_hist_mutex);
+	hist = q->stats->lat_hist;
+	if (!hist)
+		goto out;
+
+	spin_lock_irqsave(&q->stats->lock, flags);
+	WRITE_ONCE(q->stats->lat_hist, NULL);
+	if (list_empty(&q->stats->callbacks) && !q->stats->enable_accounting)
+		blk_queue_flag_clear(QUEUE_FLAG_STATS, q);
+	spin_unlock_irqrestore(&q->stats->lock, flags);
+
+	/* the blkcg histograms are only touched while the queue one is set */
+	synchronize_rcu();
+	blkcg_disable_lat_hist(q);
+	free_percpu(hist);
+out:
+	mutex_unlock(&blk_lat_hist_mutex);
+}
+
+int blk_stat_lat_hist_show(struct request_queue *q, struct seq_file *m,
+			   bool per_cgroup)
+{
+	int ret = 0;
+
+	mutex_lock(&blk_lat_hist_mutex);
+	if (q->stats->lat_hist && per_cgroup) {
+		blkcg_lat_hist_show(q, m);
+	} else if (q->stats->lat_hist) {
+		blk_lat_hist_write_hdr(m, 1);
+		blk_lat_hist_write(m, 0, q->stats->lat_hist);
+	} else {
+		ret = -ENODATA;
+	}
+	mutex_unlock(&blk_lat_hist_mutex);
+
+	return ret;
+}
+
 struct blk_queue_stats *blk_alloc_queue_stats(void)
 {
 	struct blk_queue_stats *stats;
@@ -206,6 +391,7 @@ struct blk_queue_stats *blk_alloc_queue_stats(void)
 	INIT_LIST_HEAD(&stats->callbacks);
 	spin_lock_init(&stats->lock);
 	stats->enable_accounting = false;
+	stats->lat_hist = NULL;
 
 	return stats;
 }
@@ -217,5 +403,6 @@ void blk_free_queue_stats(struct blk_queue_stats *stats)
 
 	WARN_ON(!list_empty(&stats->callbacks));
 
+	free_percpu(stats->lat_hist);
 	kfree(stats);
 }
@@ -8,6 +8,8 @@
 #include <linux/rcupdate.h>
 #include <linux/timer.h>
 
+struct seq_file;
+
 /**
  * struct blk_stat_callback - Block statistics callback.
  *
@@ -62,6 +64,69 @@ struct blk_stat_callback {
 	struct rcu_head rcu;
 };
 
+/*
+ * Log-linear completion latency histogram, in units of
+ * 1 << BLK_LAT_HIST_UNIT_SHIFT ns. The first 1 << BLK_LAT_HIST_SUB_BITS
+ * buckets are linear, every further power of two is split into that many
+ * equal buckets, so a bucket is never wider than 1/8 of its lower bound.
+ * Latencies beyond 1 << BLK_LAT_HIST_MAX_BITS units land in the last bucket.
+ */
+#define BLK_LAT_HIST_UNIT_SHIFT	10
+#define BLK_LAT_HIST_SUB_BITS	3
+#define BLK_LAT_HIST_MAX_BITS	24
+#define BLK_LAT_HIST_BUCKETS	\
+	((BLK_LAT_HIST_MAX_BITS - BLK_LAT_HIST_SUB_BITS + 1) << BLK_LAT_HIST_SUB_BITS)
+
+enum {
+	BLK_LAT_HIST_READ,
+	BLK_LAT_HIST_WRITE,
+	BLK_LAT_HIST_DISCARD,
+	BLK_LAT_HIST_OPS,
+};
+
+/* <= 4k, <= 32k, <= 256k and anything larger */
+#define BLK_LAT_HIST_SIZES	4
+
+/*
+ * Counters are kept per-cpu and wrap; the sum of all cpus is still correct
+ * modulo 2^32, so readers should look at the difference of two snapshots.
+ */
+struct blk_lat_hist {
+	u32 count[BLK_LAT_HIST_OPS][BLK_LAT_HIST_SIZES][BLK_LAT_HIST_BUCKETS];
+};
+
+#define BLK_LAT_HIST_MAGIC	0x424c4831	/* "BLH1" */
+
+/*
+ * Header of the binary debugfs lat_hist files. It is followed by
+ * @nr_records records of @record_size bytes each, a record being a u64 id
+ * (0 for the queue itself, the cgroup id otherwise) and a
+ * &struct blk_lat_hist.
+ */
+struct blk_lat_hist_hdr {
+	u32 magic;
+	u8 unit_shift;
+	u8 sub_bits;
+	u8 max_bits;
+	u8 nr_ops;
+	u32 nr_sizes;
+	u32 nr_buckets;
+	u32 record_size;
+	u32 nr_records;
+};
+
+void blk_lat_hist_add(struct blk_lat_hist __percpu *hist, unsigned int op,
+		      unsigned int sectors, u64 nsec);
+void blk_lat_hist_write(struct seq_file *m, u64 id,
+			struct blk_lat_hist __percpu *hist);
+void blk_lat_hist_write_hdr(struct seq_file *m, unsigned int nr_records);
+
+bool blk_stat_lat_hist_enabled(struct request_queue *q);
+int blk_stat_enable_lat_hist(struct request_queue *q);
+void blk_stat_disable_lat_hist(struct request_queue *q);
+int blk_stat_lat_hist_show(struct request_queue *q, struct seq_file *m,
+			   bool per_cgroup);
+
 struct blk_queue_stats *blk_alloc_queue_stats(void);
 void blk_free_queue_stats(struct blk_queue_stats *);
 
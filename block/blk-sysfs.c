@@ -12,6 +12,7 @@
 #include <linux/blk-mq.h>
 #include <linux/blk-cgroup.h>
 #include <linux/debugfs.h>
+#include <linux/keyslot-manager.h>
 
 #include "blk.h"
 #include "blk-mq.h"
@@ -508,6 +509,58 @@ static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
 	return count;
 }
 
+static ssize_t queue_wb_pct_lat_show(struct request_queue *q, char *page,
+				     int cls)
+{
+	if (!wbt_rq_qos(q))
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n", div_u64(wbt_get_pct_lat(q, cls), 1000));
+}
+
+/* A non-zero target switches wbt to its percentile mode */
+static ssize_t queue_wb_pct_lat_store(struct request_queue *q,
+				      const char *page, size_t count, int cls)
+{
+	unsigned long val;
+	ssize_t ret;
+
+	ret = queue_var_store(&val, page, count);
+	if (ret < 0)
+		return ret;
+
+	if (!wbt_rq_qos(q)) {
+		ret = wbt_init(q);
+		if (ret)
+			return ret;
+	}
+
+	wbt_set_pct_lat(q, cls, val * 1000ULL);
+	return count;
+}
+
+static ssize_t queue_wb_sync_lat_show(struct request_queue *q, char *page)
+{
+	return queue_wb_pct_lat_show(q, page, WBT_PCT_SYNC);
+}
+
+static ssize_t queue_wb_sync_lat_store(struct request_queue *q,
+				       const char *page, size_t count)
+{
+	return queue_wb_pct_lat_store(q, page, count, WBT_PCT_SYNC);
+}
+
+static ssize_t queue_wb_async_lat_show(struct request_queue *q, char *page)
+{
+	return queue_wb_pct_lat_show(q, page, WBT_PCT_ASYNC);
+}
+
+static ssize_t queue_wb_async_lat_store(struct request_queue *q,
+					const char *page, size_t count)
+{
+	return queue_wb_pct_lat_store(q, page, count, WBT_PCT_ASYNC);
+}
+
 static ssize_t queue_wc_show(struct request_queue *q, char *page)
 {
 	if (test_bit(QUEUE_FLAG_WC, &q->queue_flags))
@@ -548,6 +601,13 @@ static ssize_t queue_dax_show(struct request_queue *q, char *page)
 	return queue_var_show(blk_queue_dax(q), page);
 }
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+static ssize_t queue_crypto_keyslots_show(struct request_queue *q, char *page)
+{
+	return blk_ksm_stats_show(q->ksm, page);
+}
+#endif
+
 #define QUEUE_RO_ENTRY(_prefix, _name)			\
 static struct queue_sysfs_entry _prefix##_entry = {	\
 	.attr	= { .name = _name, .mode = 0444 },	\
@@ -598,8 +658,13 @@ QUEUE_RW_ENTRY(queue_poll_delay, "io_poll_delay");
 QUEUE_RW_ENTRY(queue_wc, "write_cache");
 QUEUE_RO_ENTRY(queue_fua, "fua");
 QUEUE_RO_ENTRY(queue_dax, "dax");
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+QUEUE_RO_ENTRY(queue_crypto_keyslots, "crypto_keyslots");
+#endif
 QUEUE_RW_ENTRY(queue_io_timeout, "io_timeout");
 QUEUE_RW_ENTRY(queue_wb_lat, "wbt_lat_usec");
+QUEUE_RW_ENTRY(queue_wb_sync_lat, "wbt_sync_lat_usec");
+QUEUE_RW_ENTRY(queue_wb_async_lat, "wbt_async_lat_usec");
 
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
 QUEUE_RW_ENTRY(blk_throtl_sample_time, "throttle_sample_time");
@@ -653,7 +718,12 @@ static struct attribute *queue_attrs[] = {
 	&queue_wc_entry.attr,
 	&queue_fua_entry.attr,
 	&queue_dax_entry.attr,
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	&queue_crypto_keyslots_entry.attr,
+#endif
 	&queue_wb_lat_entry.attr,
+	&queue_wb_sync_lat_entry.attr,
+	&queue_wb_async_lat_entry.attr,
 	&queue_poll_delay_entry.attr,
 	&queue_io_timeout_entry.attr,
 #ifdef CONFIG_BLK_DEV_THROTTLING_LOW
@@ -677,6 +747,13 @@ static umode_t queue_attr_visible(struct kobject *kobj, struct attribute *attr,
 	    !blk_queue_is_zoned(q))
 		return 0;
 
+#ifdef CONFIG_BLK_INLINE_ENCRYPTION
+	/* Passthrough keyslot managers (e.g. dm) have no slots to report */
+	if (attr == &queue_crypto_keyslots_entry.attr &&
+	    (!q->ksm || !q->ksm->num_slots))
+		return 0;
+#endif
+
 	return attr->mode;
 }
 
@@ -16,6 +16,12 @@
  *   positive scaling steps where we shrink the monitoring window, a negative
  *   scaling step retains the default step==0 window size.
  *
+ * In percentile mode, which is meant for devices like virtualized storage
+ * where a host cache makes the minimum latency meaningless, a window is
+ * considered over target when more than 5% of the reads and sync writes, or
+ * of the async writes, completed slower than the target for that class. The
+ * decision looks at the last two windows, so it slides by one window.
+ *
  * Copyright (C) 2016 Jens Axboe
  *
  */
@@ -73,6 +79,12 @@ enum {
 	 * information to scale up or down, scale up.
 	 */
 	RWB_UNKNOWN_BUMP	= 5,
+
+	/*
+	 * Percentile of completion latency that must stay below the
+	 * target in percentile mode.
+	 */
+	RWB_PCT			= 95,
 };
 
 static inline bool rwb_enabled(struct rq_wb *rwb)
@@ -178,6 +190,38 @@ static void __wbt_done(struct rq_qos *rqos, enum wbt_flags wb_acct)
 	wbt_rqw_done(rwb, rqw, wb_acct);
 }
 
+static bool rwb_pct_enabled(struct rq_wb *rwb)
+{
+	return rwb->pct_lat_nsec[WBT_PCT_SYNC] ||
+		rwb->pct_lat_nsec[WBT_PCT_ASYNC];
+}
+
+static void wbt_pct_sample(struct rq_wb *rwb, struct request *rq)
+{
+	const int op = req_op(rq);
+	u64 target;
+	int cls;
+
+	/* merged or never started */
+	if (!rq->io_start_time_ns)
+		return;
+
+	if (op == REQ_OP_READ || (op_is_write(op) && op_is_sync(rq->cmd_flags)))
+		cls = WBT_PCT_SYNC;
+	else if (op_is_write(op))
+		cls = WBT_PCT_ASYNC;
+	else
+		return;
+
+	target = READ_ONCE(rwb->pct_lat_nsec[cls]);
+	if (!target)
+		return;
+
+	this_cpu_inc(rwb->pct_stat->nr[cls]);
+	if (ktime_get_ns() - rq->io_start_time_ns > target)
+		this_cpu_inc(rwb->pct_stat->over[cls]);
+}
+
 /*
  * Called on completion of a request. Note that it's also called when
  * a request is merged, when the request gets freed.
@@ -186,6 +230,9 @@ static void wbt_done(struct rq_qos *rqos, struct request *rq)
 {
 	struct rq_wb *rwb = RQWB(rqos);
 
+	if (rwb_pct_enabled(rwb))
+		wbt_pct_sample(rwb, rq);
+
 	if (!wbt_is_tracked(rq)) {
 		if (rwb->sync_cookie == rq) {
 			rwb->sync_issue = 0;
@@ -284,10 +331,71 @@ static int latency_exceeded(struct rq_wb *rwb, struct blk_rq_stat *stat)
 	return LAT_OK;
 }
 
+/* Counterpart of latency_exceeded() for the percentile mode */
+static int pct_latency_exceeded(struct rq_wb *rwb)
+{
+	struct backing_dev_info *bdi = rwb->rqos.q->backing_dev_info;
+	unsigned long nr, over, tot_nr, tot_over;
+	bool valid = false, exceeded = false;
+	u64 thislat;
+	int cls, cpu;
+
+	for (cls = 0; cls < WBT_PCT_NR; cls++) {
+		nr = over = 0;
+		for_each_possible_cpu(cpu) {
+			struct wbt_pct_stat *s = per_cpu_ptr(rwb->pct_stat, cpu);
+
+			nr += READ_ONCE(s->nr[cls]);
+			over += READ_ONCE(s->over[cls]);
+		}
+
+		/* This window, plus the one before it */
+		tot_nr = nr - rwb->pct_seen.nr[cls];
+		tot_over = over - rwb->pct_seen.over[cls];
+		rwb->pct_seen.nr[cls] = nr;
+		rwb->pct_seen.over[cls] = over;
+		swap(tot_nr, rwb->pct_prev.nr[cls]);
+		swap(tot_over, rwb->pct_prev.over[cls]);
+		tot_nr += rwb->pct_prev.nr[cls];
+		tot_over += rwb->pct_prev.over[cls];
+
+		if (!rwb->pct_lat_nsec[cls] || tot_nr < RWB_MIN_WRITE_SAMPLES)
+			continue;
+		valid = true;
+		if (tot_over * 100 > tot_nr * (100 - RWB_PCT))
+			exceeded = true;
+	}
+
+	/* A sync I/O stuck for longer than the window is a violation too */
+	thislat = rwb_sync_issue_lat(rwb);
+	if (thislat > rwb->cur_win_nsec || exceeded) {
+		trace_wbt_lat(bdi, thislat);
+		return LAT_EXCEEDED;
+	}
+
+	if (!valid) {
+		if (wb_recent_wait(rwb) || wbt_inflight(rwb))
+			return LAT_UNKNOWN_WRITES;
+		return LAT_UNKNOWN;
+	}
+
+	return LAT_OK;
+}
+
 static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
 {
 	struct backing_dev_info *bdi = rwb->rqos.q->backing_dev_info;
 	struct rq_depth *rqd = &rwb->rq_depth;
+	struct wbt_depth_sample *s;
+
+	spin_lock(&rwb->hist_lock);
+	s = &rwb->hist[rwb->hist_next++ % WBT_DEPTH_HISTORY];
+	s->time_ns = ktime_get_ns();
+	s->scale_step = rqd->scale_step;
+	s->max_depth = rqd->max_depth;
+	s->wb_normal = rwb->wb_normal;
+	s->wb_background = rwb->wb_background;
+	spin_unlock(&rwb->hist_lock);
 
 	trace_wbt_step(bdi, msg, rqd->scale_step, rwb->cur_win_nsec,
 			rwb->wb_background, rwb->wb_normal, rqd->max_depth);
@@ -356,7 +464,10 @@ static void wb_timer_fn(struct blk_stat_callback *cb)
 	unsigned int inflight = wbt_inflight(rwb);
 	int status;
 
-	status = latency_exceeded(rwb, cb->stat);
+	if (rwb_pct_enabled(rwb))
+		status = pct_latency_exceeded(rwb);
+	else
+		status = latency_exceeded(rwb, cb->stat);
 
 	trace_wbt_timer(rwb->rqos.q->backing_dev_info, status, rqd->scale_step,
 			inflight);
@@ -436,6 +547,24 @@ void wbt_set_min_lat(struct request_queue *q, u64 val)
 	wbt_update_limits(RQWB(rqos));
 }
 
+u64 wbt_get_pct_lat(struct request_queue *q, int cls)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	if (!rqos)
+		return 0;
+	return RQWB(rqos)->pct_lat_nsec[cls];
+}
+
+void wbt_set_pct_lat(struct request_queue *q, int cls, u64 val)
+{
+	struct rq_qos *rqos = wbt_rq_qos(q);
+	if (!rqos)
+		return;
+	WRITE_ONCE(RQWB(rqos)->pct_lat_nsec[cls], val);
+	if (val)
+		RQWB(rqos)->enable_state = WBT_STATE_ON_MANUAL;
+}
+
 
 static bool close_io(struct rq_wb *rwb)
 {
@@ -687,6 +816,7 @@ static void wbt_exit(struct rq_qos *rqos)
 
 	blk_stat_remove_callback(q, rwb->cb);
 	blk_stat_free_callback(rwb->cb);
+	free_percpu(rwb->pct_stat);
 	kfree(rwb);
 }
 
@@ -782,6 +912,29 @@ static int wbt_background_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int wbt_depth_history_show(void *data, struct seq_file *m)
+{
+	struct rq_qos *rqos = data;
+	struct rq_wb *rwb = RQWB(rqos);
+	struct wbt_depth_sample s;
+	unsigned int i, start, end;
+
+	spin_lock_bh(&rwb->hist_lock);
+	end = rwb->hist_next;
+	spin_unlock_bh(&rwb->hist_lock);
+	start = end > WBT_DEPTH_HISTORY ? end - WBT_DEPTH_HISTORY : 0;
+
+	/* oldest first: time_ns step max_depth wb_normal wb_background */
+	for (i = start; i != end; i++) {
+		spin_lock_bh(&rwb->hist_lock);
+		s = rwb->hist[i % WBT_DEPTH_HISTORY];
+		spin_unlock_bh(&rwb->hist_lock);
+		seq_printf(m, "%llu %d %u %u %u\n", s.time_ns, s.scale_step,
+			   s.max_depth, s.wb_normal, s.wb_background);
+	}
+	return 0;
+}
+
 static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"curr_win_nsec", 0400, wbt_curr_win_nsec_show},
 	{"enabled", 0400, wbt_enabled_show},
@@ -791,6 +944,7 @@ static const struct blk_mq_debugfs_attr wbt_debugfs_attrs[] = {
 	{"unknown_cnt", 0400, wbt_unknown_cnt_show},
 	{"wb_normal", 0400, wbt_normal_show},
 	{"wb_background", 0400, wbt_background_show},
+	{"depth_history", 0400, wbt_depth_history_show},
 	{},
 };
 #endif
@@ -818,11 +972,19 @@ int wbt_init(struct request_queue *q)
 	if (!rwb)
 		return -ENOMEM;
 
+	rwb->pct_stat = alloc_percpu(struct wbt_pct_stat);
+	if (!rwb->pct_stat) {
+		kfree(rwb);
+		return -ENOMEM;
+	}
+
 	rwb->cb = blk_stat_alloc_callback(wb_timer_fn, wbt_data_dir, 2, rwb);
 	if (!rwb->cb) {
+		free_percpu(rwb->pct_stat);
 		kfree(rwb);
 		return -ENOMEM;
 	}
+	spin_lock_init(&rwb->hist_lock);
 
 	for (i = 0; i < WBT_NUM_RWQ; i++)
 		rq_wait_init(&rwb->rq_wait[i]);
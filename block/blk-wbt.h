@@ -27,6 +27,32 @@ enum {
 	WBT_NUM_RWQ,
 };
 
+/*
+ * Completion latency classes of the percentile mode, each with its own
+ * target: reads and synchronous writes, and asynchronous writes.
+ */
+enum {
+	WBT_PCT_SYNC		= 0,
+	WBT_PCT_ASYNC,
+	WBT_PCT_NR,
+};
+
+struct wbt_pct_stat {
+	unsigned long nr[WBT_PCT_NR];		/* completions */
+	unsigned long over[WBT_PCT_NR];		/* ... slower than the target */
+};
+
+/* One depth change, as shown by the depth_history debugfs file */
+struct wbt_depth_sample {
+	u64 time_ns;
+	int scale_step;
+	unsigned int max_depth;
+	unsigned int wb_normal;
+	unsigned int wb_background;
+};
+
+#define WBT_DEPTH_HISTORY	64
+
 /*
  * Enable states. Either off, or on by default (done at init time),
  * or on through manual setup in sysfs.
@@ -64,6 +90,21 @@ struct rq_wb {
 	unsigned long last_issue;		/* last non-throttled issue */
 	unsigned long last_comp;		/* last non-throttled comp */
 	unsigned long min_lat_nsec;
+
+	/*
+	 * Percentile mode: scale on the share of completions slower than
+	 * pct_lat_nsec[] instead of on the minimum read latency. Enabled when
+	 * any of the targets is set.
+	 */
+	u64 pct_lat_nsec[WBT_PCT_NR];
+	struct wbt_pct_stat __percpu *pct_stat;
+	struct wbt_pct_stat pct_seen;		/* totals at the last window */
+	struct wbt_pct_stat pct_prev;		/* deltas of the last window */
+
+	spinlock_t hist_lock;
+	unsigned int hist_next;
+	struct wbt_depth_sample hist[WBT_DEPTH_HISTORY];
+
 	struct rq_qos rqos;
 	struct rq_wait rq_wait[WBT_NUM_RWQ];
 	struct rq_depth rq_depth;
@@ -93,6 +134,8 @@ void wbt_enable_default(struct request_queue *);
 
 u64 wbt_get_min_lat(struct request_queue *q);
 void wbt_set_min_lat(struct request_queue *q, u64 val);
+u64 wbt_get_pct_lat(struct request_queue *q, int cls);
+void wbt_set_pct_lat(struct request_queue *q, int cls, u64 val);
 
 void wbt_set_write_cache(struct request_queue *, bool);
 
@@ -123,6 +166,13 @@ static inline u64 wbt_get_min_lat(struct request_queue *q)
 static inline void wbt_set_min_lat(struct request_queue *q, u64 val)
 {
 }
+static inline u64 wbt_get_pct_lat(struct request_queue *q, int cls)
+{
+	return 0;
+}
+static inline void wbt_set_pct_lat(struct request_queue *q, int cls, u64 val)
+{
+}
 static inline u64 wbt_default_latency_nsec(struct request_queue *q)
 {
 	return 0;
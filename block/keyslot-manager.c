@@ -42,8 +42,17 @@ struct blk_ksm_keyslot {
 	struct hlist_node hash_node;
 	const struct blk_crypto_key *key;
 	struct blk_keyslot_manager *ksm;
+	unsigned int heat;	/* uses of the key, halved as it ages */
 };
 
+/*
+ * Number of idle slots, from the LRU end, considered when a key has to be
+ * programmed.  The coldest of them is replaced, so that the keys used the
+ * most stay programmed even if they were not used the most recently, e.g.
+ * when many per-file keys are streamed through a small keyslot table.
+ */
+#define BLK_KSM_VICTIM_SCAN	4
+
 static inline void blk_ksm_hw_enter(struct blk_keyslot_manager *ksm)
 {
 	/*
@@ -201,6 +210,8 @@ static struct blk_ksm_keyslot *blk_ksm_find_and_grab_keyslot(
 	slot = blk_ksm_find_keyslot(ksm, key);
 	if (!slot)
 		return NULL;
+	/* Racy under ksm->lock held for read, but it's only a heuristic */
+	WRITE_ONCE(slot->heat, READ_ONCE(slot->heat) + 1);
 	if (atomic_inc_return(&slot->slot_refs) == 1) {
 		/* Took first reference to this slot; remove it from LRU list */
 		blk_ksm_remove_slot_from_lru_list(slot);
@@ -214,6 +225,40 @@ unsigned int blk_ksm_get_slot_idx(struct blk_ksm_keyslot *slot)
 }
 EXPORT_SYMBOL_GPL(blk_ksm_get_slot_idx);
 
+/*
+ * Pick the idle slot to program a new key into: an empty slot if there is
+ * one near the LRU end, else the coldest of the least recently used ones.
+ * The slots passed over are aged.  Called with ksm->lock held for write and
+ * at least one idle slot.
+ */
+static struct blk_ksm_keyslot *blk_ksm_pick_victim(struct blk_keyslot_manager *ksm)
+{
+	struct blk_ksm_keyslot *slot, *victim = NULL;
+	unsigned long flags;
+	int n = 0;
+
+	spin_lock_irqsave(&ksm->idle_slots_lock, flags);
+	list_for_each_entry(slot, &ksm->idle_slots, idle_slot_node) {
+		if (!slot->key) {
+			victim = slot;
+			break;
+		}
+		if (!victim || slot->heat < victim->heat)
+			victim = slot;
+		if (++n == BLK_KSM_VICTIM_SCAN)
+			break;
+	}
+	list_for_each_entry(slot, &ksm->idle_slots, idle_slot_node) {
+		if (n-- <= 0)
+			break;
+		if (slot != victim)
+			slot->heat >>= 1;
+	}
+	spin_unlock_irqrestore(&ksm->idle_slots_lock, flags);
+
+	return victim;
+}
+
 /**
  * blk_ksm_get_slot_for_key() - Program a key into a keyslot.
  * @ksm: The keyslot manager to program the key into.
@@ -247,14 +292,14 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 	slot = blk_ksm_find_and_grab_keyslot(ksm, key);
 	up_read(&ksm->lock);
 	if (slot)
-		goto success;
+		goto hit;
 
 	for (;;) {
 		blk_ksm_hw_enter(ksm);
 		slot = blk_ksm_find_and_grab_keyslot(ksm, key);
 		if (slot) {
 			blk_ksm_hw_exit(ksm);
-			goto success;
+			goto hit;
 		}
 
 		/*
@@ -265,12 +310,12 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 			break;
 
 		blk_ksm_hw_exit(ksm);
+		atomic64_inc(&ksm->nr_waits);
 		wait_event(ksm->idle_slots_wait_queue,
 			   !list_empty(&ksm->idle_slots));
 	}
 
-	slot = list_first_entry(&ksm->idle_slots, struct blk_ksm_keyslot,
-				idle_slot_node);
+	slot = blk_ksm_pick_victim(ksm);
 	slot_idx = blk_ksm_get_slot_idx(slot);
 
 	err = ksm->ksm_ll_ops.keyslot_program(ksm, key, slot_idx);
@@ -281,9 +326,12 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 	}
 
 	/* Move this slot to the hash list for the new key. */
-	if (slot->key)
+	if (slot->key) {
 		hlist_del(&slot->hash_node);
+		atomic64_inc(&ksm->nr_evictions);
+	}
 	slot->key = key;
+	slot->heat = 1;
 	hlist_add_head(&slot->hash_node, blk_ksm_hash_bucket_for_key(ksm, key));
 
 	atomic_set(&slot->slot_refs, 1);
@@ -291,6 +339,10 @@ blk_status_t blk_ksm_get_slot_for_key(struct blk_keyslot_manager *ksm,
 	blk_ksm_remove_slot_from_lru_list(slot);
 
 	blk_ksm_hw_exit(ksm);
+	atomic64_inc(&ksm->nr_programs);
+	goto success;
+hit:
+	atomic64_inc(&ksm->nr_hits);
 success:
 	*slot_ptr = slot;
 	return BLK_STS_OK;
@@ -320,6 +372,33 @@ void blk_ksm_put_slot(struct blk_ksm_keyslot *slot)
 	}
 }
 
+/**
+ * blk_ksm_stats_show() - Format the keyslot usage statistics
+ * @ksm: The keyslot manager
+ * @page: sysfs buffer to print to
+ *
+ * Return: the number of bytes printed.
+ */
+ssize_t blk_ksm_stats_show(struct blk_keyslot_manager *ksm, char *page)
+{
+	unsigned int slot, nr_programmed = 0, nr_busy = 0;
+
+	for (slot = 0; slot < ksm->num_slots; slot++) {
+		if (READ_ONCE(ksm->slots[slot].key))
+			nr_programmed++;
+		if (atomic_read(&ksm->slots[slot].slot_refs))
+			nr_busy++;
+	}
+
+	return sprintf(page,
+		       "slots %u\nprogrammed %u\nbusy %u\nhits %lld\nprograms %lld\nevictions %lld\nwaits %lld\n",
+		       ksm->num_slots, nr_programmed, nr_busy,
+		       atomic64_read(&ksm->nr_hits),
+		       atomic64_read(&ksm->nr_programs),
+		       atomic64_read(&ksm->nr_evictions),
+		       atomic64_read(&ksm->nr_waits));
+}
+
 /**
  * blk_ksm_crypto_cfg_supported() - Find out if a crypto configuration is
  *				    supported by a ksm.
@@ -396,6 +475,11 @@ int blk_ksm_evict_key(struct blk_keyslot_manager *ksm,
 
 	hlist_del(&slot->hash_node);
 	slot->key = NULL;
+	slot->heat = 0;
+	/* The slot is idle; make it the first to be reused */
+	spin_lock_irq(&ksm->idle_slots_lock);
+	list_move(&slot->idle_slot_node, &ksm->idle_slots);
+	spin_unlock_irq(&ksm->idle_slots_lock);
 	err = 0;
 out_unlock:
 	blk_ksm_hw_exit(ksm);
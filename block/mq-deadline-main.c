@@ -38,6 +38,12 @@ static const int aging_expire = 10 * HZ;
 static const int writes_starved = 2;    /* max times reads can starve a write */
 static const int fifo_batch = 16;       /* # of sequential requests treated as one
 				     by the above parameters. For throughput. */
+/*
+ * Number of requests selected per dd->lock hold in dd_dispatch_request().
+ * All but the first are parked on dd->batch and handed out without taking
+ * dd->lock again.
+ */
+static const int dispatch_batch = 8;
 
 enum dd_data_dir {
 	DD_READ		= READ,
@@ -98,9 +104,23 @@ struct deadline_data {
 	int front_merges;
 	u32 async_depth;
 	int aging_expire;
+	int dispatch_batch;
 
 	spinlock_t lock;
 	spinlock_t zone_lock;
+
+	/*
+	 * Requests inserted but not yet sorted. Submitters only take
+	 * insert_lock, the requests are moved to per_prio[] by the next
+	 * dispatch while it holds dd->lock anyway.
+	 */
+	spinlock_t insert_lock ____cacheline_aligned_in_smp;
+	struct list_head at_head;
+	struct list_head insert_list;
+
+	/* Requests already selected for dispatch, see dispatch_batch */
+	spinlock_t batch_lock ____cacheline_aligned_in_smp;
+	struct list_head batch;
 };
 
 /* Count one event of type 'event_type' and with I/O priority 'prio' */
@@ -490,14 +510,11 @@ done:
  * different hardware queue. This is because mq-deadline has shared
  * state for all hardware queues, in terms of sorting, FIFOs, etc.
  */
-static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
+static struct request *dd_dispatch_next(struct deadline_data *dd, u64 now_ns)
 {
-	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
-	const u64 now_ns = ktime_get_ns();
-	struct request *rq = NULL;
+	struct request *rq;
 	enum dd_prio prio;
 
-	spin_lock(&dd->lock);
 	/*
 	 * Start with dispatching requests whose deadline expired more than
 	 * aging_expire jiffies ago.
@@ -506,7 +523,7 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 		rq = __dd_dispatch_request(dd, &dd->per_prio[prio], now_ns -
 					   jiffies_to_nsecs(dd->aging_expire));
 		if (rq)
-			goto unlock;
+			return rq;
 	}
 	/*
 	 * Next, dispatch requests in priority order. Ignore lower priority
@@ -515,12 +532,74 @@ static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++) {
 		rq = __dd_dispatch_request(dd, &dd->per_prio[prio], now_ns);
 		if (rq || dd_queued(dd, prio))
-			break;
+			return rq;
+	}
+
+	return NULL;
+}
+
+static void dd_insert_request(struct request_queue *q, struct request *rq,
+			      bool at_head);
+
+/* Sort the requests that dd_insert_requests() queued since the last call */
+static void dd_do_insert(struct request_queue *q, struct deadline_data *dd)
+{
+	LIST_HEAD(at_head);
+	LIST_HEAD(list);
+	struct request *rq;
+
+	lockdep_assert_held(&dd->lock);
+
+	spin_lock(&dd->insert_lock);
+	list_splice_init(&dd->at_head, &at_head);
+	list_splice_init(&dd->insert_list, &list);
+	spin_unlock(&dd->insert_lock);
+
+	while (!list_empty(&at_head)) {
+		rq = list_first_entry(&at_head, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		dd_insert_request(q, rq, true);
 	}
+	while (!list_empty(&list)) {
+		rq = list_first_entry(&list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+		dd_insert_request(q, rq, false);
+	}
+}
 
-unlock:
+static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
+	const u64 now_ns = ktime_get_ns();
+	struct request *rq, *next;
+	LIST_HEAD(batch);
+	int i;
+
+	spin_lock(&dd->batch_lock);
+	rq = list_first_entry_or_null(&dd->batch, struct request, queuelist);
+	if (rq)
+		list_del_init(&rq->queuelist);
+	spin_unlock(&dd->batch_lock);
+	if (rq)
+		return rq;
+
+	spin_lock(&dd->lock);
+	dd_do_insert(hctx->queue, dd);
+	rq = dd_dispatch_next(dd, now_ns);
+	for (i = 1; rq && i < dd->dispatch_batch; i++) {
+		next = dd_dispatch_next(dd, now_ns);
+		if (!next)
+			break;
+		list_add_tail(&next->queuelist, &batch);
+	}
 	spin_unlock(&dd->lock);
 
+	if (!list_empty(&batch)) {
+		spin_lock(&dd->batch_lock);
+		list_splice_tail(&batch, &dd->batch);
+		spin_unlock(&dd->batch_lock);
+	}
+
 	return rq;
 }
 
@@ -575,6 +654,9 @@ static void dd_exit_sched(struct elevator_queue *e)
 		WARN_ON_ONCE(!list_empty(&per_prio->fifo_list[DD_READ]));
 		WARN_ON_ONCE(!list_empty(&per_prio->fifo_list[DD_WRITE]));
 	}
+	WARN_ON_ONCE(!list_empty(&dd->at_head));
+	WARN_ON_ONCE(!list_empty(&dd->insert_list));
+	WARN_ON_ONCE(!list_empty(&dd->batch));
 
 	free_percpu(dd->stats);
 
@@ -630,8 +712,14 @@ static int dd_init_sched(struct request_queue *q, struct elevator_type *e)
 	dd->last_dir = DD_WRITE;
 	dd->fifo_batch = fifo_batch;
 	dd->aging_expire = aging_expire;
+	dd->dispatch_batch = dispatch_batch;
 	spin_lock_init(&dd->lock);
 	spin_lock_init(&dd->zone_lock);
+	spin_lock_init(&dd->insert_lock);
+	INIT_LIST_HEAD(&dd->at_head);
+	INIT_LIST_HEAD(&dd->insert_list);
+	spin_lock_init(&dd->batch_lock);
+	INIT_LIST_HEAD(&dd->batch);
 
 	ret = dd_activate_policy(q);
 	if (ret)
@@ -706,10 +794,9 @@ static bool dd_bio_merge(struct request_queue *q, struct bio *bio,
 /*
  * add rq to rbtree and fifo
  */
-static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
+static void dd_insert_request(struct request_queue *q, struct request *rq,
 			      bool at_head)
 {
-	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
 	const enum dd_data_dir data_dir = rq_data_dir(rq);
 	u16 ioprio = req_get_ioprio(rq);
@@ -720,12 +807,6 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 
 	lockdep_assert_held(&dd->lock);
 
-	/*
-	 * This may be a requeue of a write request that has locked its
-	 * target zone. If it is the case, this releases the zone lock.
-	 */
-	blk_req_zone_write_unlock(rq);
-
 	/*
 	 * If a block cgroup has been associated with the submitter and if an
 	 * I/O priority has been set in the associated block cgroup, use the
@@ -772,16 +853,19 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 {
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
+	struct request *rq;
 
-	spin_lock(&dd->lock);
-	while (!list_empty(list)) {
-		struct request *rq;
+	/*
+	 * This may be a requeue of a write request that has locked its
+	 * target zone. If it is the case, this releases the zone lock. Do it
+	 * now rather than when dd_do_insert() gets to the request.
+	 */
+	list_for_each_entry(rq, list, queuelist)
+		blk_req_zone_write_unlock(rq);
 
-		rq = list_first_entry(list, struct request, queuelist);
-		list_del_init(&rq->queuelist);
-		dd_insert_request(hctx, rq, at_head);
-	}
-	spin_unlock(&dd->lock);
+	spin_lock(&dd->insert_lock);
+	list_splice_tail_init(list, at_head ? &dd->at_head : &dd->insert_list);
+	spin_unlock(&dd->insert_lock);
 }
 
 /* Callback from inside blk_mq_rq_ctx_init(). */
@@ -841,6 +925,11 @@ static bool dd_has_work(struct blk_mq_hw_ctx *hctx)
 	struct deadline_data *dd = hctx->queue->elevator->elevator_data;
 	enum dd_prio prio;
 
+	if (!list_empty_careful(&dd->batch) ||
+	    !list_empty_careful(&dd->at_head) ||
+	    !list_empty_careful(&dd->insert_list))
+		return true;
+
 	for (prio = 0; prio <= DD_PRIO_MAX; prio++)
 		if (dd_has_work_for_prio(&dd->per_prio[prio]))
 			return true;
@@ -866,6 +955,7 @@ SHOW_INT(deadline_writes_starved_show, dd->writes_starved);
 SHOW_INT(deadline_front_merges_show, dd->front_merges);
 SHOW_INT(deadline_async_depth_show, dd->front_merges);
 SHOW_INT(deadline_fifo_batch_show, dd->fifo_batch);
+SHOW_INT(deadline_dispatch_batch_show, dd->dispatch_batch);
 #undef SHOW_INT
 #undef SHOW_JIFFIES
 
@@ -896,6 +986,7 @@ STORE_INT(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX);
 STORE_INT(deadline_front_merges_store, &dd->front_merges, 0, 1);
 STORE_INT(deadline_async_depth_store, &dd->front_merges, 1, INT_MAX);
 STORE_INT(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX);
+STORE_INT(deadline_dispatch_batch_store, &dd->dispatch_batch, 1, 64);
 #undef STORE_FUNCTION
 #undef STORE_INT
 #undef STORE_JIFFIES
@@ -911,6 +1002,7 @@ static struct elv_fs_entry deadline_attrs[] = {
 	DD_ATTR(async_depth),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(aging_expire),
+	DD_ATTR(dispatch_batch),
 	__ATTR_NULL
 };
 
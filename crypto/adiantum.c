@@ -319,7 +319,11 @@ static void adiantum_streamcipher_done(struct crypto_async_request *areq,
 	skcipher_request_complete(req, err);
 }
 
-static int adiantum_crypt(struct skcipher_request *req, bool enc)
+/*
+ * Do the first hash step and the block cipher, and set up the XChaCha
+ * request in rctx->u.streamcipher_req.
+ */
+static int adiantum_begin(struct skcipher_request *req, bool enc)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
 	const struct adiantum_tfm_ctx *tctx = crypto_skcipher_ctx(tfm);
@@ -380,7 +384,15 @@ static int adiantum_crypt(struct skcipher_request *req, bool enc)
 	skcipher_request_set_callback(&rctx->u.streamcipher_req,
 				      req->base.flags,
 				      adiantum_streamcipher_done, req);
-	return crypto_skcipher_encrypt(&rctx->u.streamcipher_req) ?:
+	return 0;
+}
+
+static int adiantum_crypt(struct skcipher_request *req, bool enc)
+{
+	struct adiantum_request_ctx *rctx = skcipher_request_ctx(req);
+
+	return adiantum_begin(req, enc) ?:
+		crypto_skcipher_encrypt(&rctx->u.streamcipher_req) ?:
 		adiantum_finish(req);
 }
 
@@ -394,6 +406,56 @@ static int adiantum_decrypt(struct skcipher_request *req)
 	return adiantum_crypt(req, false);
 }
 
+/* Maximum number of XChaCha requests handed to the stream cipher at once */
+#define ADIANTUM_BATCH_MAX	16
+
+/*
+ * Batches run the first hash step of all requests, then hand the XChaCha parts
+ * to the stream cipher as one batch, so that an implementation of it which
+ * supports batching can interleave them, and finally do the second hash step.
+ * The instance is asynchronous if the stream cipher is, and batches are only
+ * passed to synchronous tfms, so the stream cipher is synchronous here.
+ */
+static int adiantum_crypt_batch(struct skcipher_request **reqs,
+				unsigned int nreqs, bool enc)
+{
+	struct skcipher_request *subreqs[ADIANTUM_BATCH_MAX];
+	unsigned int i, n;
+	int err = 0;
+
+	while (nreqs && !err) {
+		n = min_t(unsigned int, nreqs, ADIANTUM_BATCH_MAX);
+
+		for (i = 0; i < n && !err; i++) {
+			struct adiantum_request_ctx *rctx =
+				skcipher_request_ctx(reqs[i]);
+
+			err = adiantum_begin(reqs[i], enc);
+			subreqs[i] = &rctx->u.streamcipher_req;
+		}
+		if (!err)
+			err = crypto_skcipher_encrypt_batch(subreqs, n);
+		for (i = 0; i < n && !err; i++)
+			err = adiantum_finish(reqs[i]);
+
+		reqs += n;
+		nreqs -= n;
+	}
+	return err;
+}
+
+static int adiantum_encrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs)
+{
+	return adiantum_crypt_batch(reqs, nreqs, true);
+}
+
+static int adiantum_decrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs)
+{
+	return adiantum_crypt_batch(reqs, nreqs, false);
+}
+
 static int adiantum_init_tfm(struct crypto_skcipher *tfm)
 {
 	struct skcipher_instance *inst = skcipher_alg_instance(tfm);
@@ -577,6 +639,8 @@ static int adiantum_create(struct crypto_template *tmpl, struct rtattr **tb)
 	inst->alg.setkey = adiantum_setkey;
 	inst->alg.encrypt = adiantum_encrypt;
 	inst->alg.decrypt = adiantum_decrypt;
+	inst->alg.encrypt_batch = adiantum_encrypt_batch;
+	inst->alg.decrypt_batch = adiantum_decrypt_batch;
 	inst->alg.init = adiantum_init_tfm;
 	inst->alg.exit = adiantum_exit_tfm;
 	inst->alg.min_keysize = crypto_skcipher_alg_min_keysize(streamcipher_alg);
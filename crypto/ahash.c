@@ -565,6 +565,18 @@ int crypto_has_ahash(const char *alg_name, u32 type, u32 mask)
 }
 EXPORT_SYMBOL_GPL(crypto_has_ahash);
 
+struct crypto_shash *crypto_ahash_shash(struct crypto_ahash *tfm)
+{
+	struct crypto_tfm *ctfm = crypto_ahash_tfm(tfm);
+
+	if (ctfm->__crt_alg->cra_type == &crypto_ahash_type)
+		return NULL;
+
+	/* set up by crypto_init_shash_ops_async() */
+	return *(struct crypto_shash **)crypto_tfm_ctx(ctfm);
+}
+EXPORT_SYMBOL_GPL(crypto_ahash_shash);
+
 static int ahash_prepare_alg(struct ahash_alg *alg)
 {
 	struct crypto_alg *base = &alg->halg.base;
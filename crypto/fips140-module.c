@@ -440,6 +440,8 @@ static bool __init update_live_fips140_algos(void)
 			old_skcipher->setkey	= new_skcipher->setkey;
 			old_skcipher->encrypt	= new_skcipher->encrypt;
 			old_skcipher->decrypt	= new_skcipher->decrypt;
+			old_skcipher->encrypt_batch = new_skcipher->encrypt_batch;
+			old_skcipher->decrypt_batch = new_skcipher->decrypt_batch;
 			old_skcipher->init	= new_skcipher->init;
 			old_skcipher->exit	= new_skcipher->exit;
 			break;
@@ -583,8 +585,7 @@ fips140_init(void)
 	 */
 	synchronize_rcu_tasks();
 
-	if (!fips140_run_selftests())
-		goto panic;
+	fips140_start_selftests();
 
 	/*
 	 * It may seem backward to perform the integrity check last, but this
@@ -592,8 +593,11 @@ fips140_init(void)
 	 * the algorithms that are replaced with versions from this module, and
 	 * the integrity check must use the replacement version.  Also, to be
 	 * ready for FIPS 140-3, the integrity check algorithm must have already
-	 * been self-tested.
+	 * been self-tested.  Only that one test is waited for here, the check
+	 * then overlaps with the remaining tests.
 	 */
+	if (!fips140_wait_selftest("hmac(sha256)"))
+		goto panic;
 
 	if (!check_fips140_module_hmac()) {
 		pr_crit("integrity check failed -- giving up!\n");
@@ -601,6 +605,9 @@ fips140_init(void)
 	}
 	pr_info("integrity check passed\n");
 
+	if (!fips140_wait_selftests())
+		goto panic;
+
 	pr_info("module successfully loaded\n");
 	return 0;
 
@@ -15,6 +15,8 @@
 extern char *fips140_broken_alg;
 #endif
 
-bool __init __must_check fips140_run_selftests(void);
+void __init fips140_start_selftests(void);
+bool __init __must_check fips140_wait_selftest(const char *alg);
+bool __init __must_check fips140_wait_selftests(void);
 
 #endif /* _CRYPTO_FIPS140_MODULE_H */
@@ -49,6 +49,12 @@
  *
  *   - Despite being more heavyweight in general, testmgr doesn't test the
  *     SHA-256 and AES library APIs, despite that being needed here.
+ *
+ * The tests don't depend on each other, so they are run in parallel with the
+ * async init infrastructure rather than one after the other on the boot
+ * critical path.  fips140_wait_selftest() lets the caller gate the first use
+ * of an algorithm on its own test only, and fips140_wait_selftests() waits for
+ * all of them before the module finishes loading.
  */
 #include <crypto/aead.h>
 #include <crypto/aes.h>
@@ -58,8 +64,11 @@
 #include <crypto/rng.h>
 #include <crypto/sha.h>
 #include <crypto/skcipher.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
 
 #include "fips140-module.h"
+#include "internal.h"
 
 /* Test vector for a block cipher algorithm */
 struct blockcipher_testvec {
@@ -845,23 +854,121 @@ static const struct fips_test fips140_selftests[] __initconst = {
 	}
 };
 
-bool __init fips140_run_selftests(void)
+/* State of the asynchronous run of fips140_selftests[i] */
+struct fips_test_run {
+	async_cookie_t cookie;
+	int err;
+	s64 duration_us;
+};
+
+static struct fips_test_run fips140_selftest_runs[ARRAY_SIZE(fips140_selftests)]
+	__initdata;
+static ktime_t fips140_selftests_start __initdata;
+static ASYNC_DOMAIN_EXCLUSIVE(fips140_selftest_domain);
+
+static void __init fips140_run_selftest(void *data, async_cookie_t cookie)
+{
+	const struct fips_test *test = data;
+	struct fips_test_run *run =
+		&fips140_selftest_runs[test - fips140_selftests];
+	ktime_t start = ktime_get();
+
+	run->err = test->func(test);
+	run->duration_us = ktime_us_delta(ktime_get(), start);
+}
+
+/*
+ * Look up each algorithm once from the calling thread before the tests are
+ * scheduled.  This instantiates the templates (e.g. "xts(aes)") here, as
+ * request_module() must not be waited for from an async worker.  Failures are
+ * left for the test itself to report.
+ */
+static void __init fips140_prepare_selftests(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fips140_selftests); i++) {
+		struct crypto_alg *alg;
+
+		alg = crypto_alg_mod_lookup(fips140_selftests[i].alg, 0, 0);
+		if (!IS_ERR(alg))
+			crypto_mod_put(alg);
+	}
+}
+
+void __init fips140_start_selftests(void)
 {
 	int i;
 
 	pr_info("running self-tests\n");
+	fips140_prepare_selftests();
+
+	fips140_selftests_start = ktime_get();
 	for (i = 0; i < ARRAY_SIZE(fips140_selftests); i++) {
-		const struct fips_test *test = &fips140_selftests[i];
-		int err;
+		/* async_schedule() drops the const, the tests don't write it */
+		void *test = (void *)&fips140_selftests[i];
 
-		err = test->func(test);
-		if (err) {
-			pr_emerg("self-tests failed for algorithm %s: %d\n",
-				 test->alg, err);
-			/* The caller is responsible for calling panic(). */
-			return false;
-		}
+		fips140_selftest_runs[i].cookie =
+			async_schedule_domain(fips140_run_selftest, test,
+					      &fips140_selftest_domain);
 	}
-	pr_info("all self-tests passed\n");
+}
+
+static bool __init fips140_check_selftest(int i)
+{
+	const struct fips_test *test = &fips140_selftests[i];
+	const struct fips_test_run *run = &fips140_selftest_runs[i];
+
+	if (run->err) {
+		pr_emerg("self-tests failed for algorithm %s: %d\n",
+			 test->alg, run->err);
+		/* The caller is responsible for calling panic(). */
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Wait for the self-test of @alg only, so that the algorithm can be used while
+ * the other tests are still running.
+ */
+bool __init fips140_wait_selftest(const char *alg)
+{
+	async_cookie_t cookie;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fips140_selftests); i++) {
+		if (strcmp(fips140_selftests[i].alg, alg) != 0)
+			continue;
+		/* waits for the entries scheduled before the cookie passed */
+		cookie = fips140_selftest_runs[i].cookie + 1;
+		async_synchronize_cookie_domain(cookie,
+						&fips140_selftest_domain);
+		return fips140_check_selftest(i);
+	}
+	pr_emerg("no self-test for algorithm %s\n", alg);
+	return false;
+}
+
+bool __init fips140_wait_selftests(void)
+{
+	bool ok = true;
+	int i;
+
+	async_synchronize_full_domain(&fips140_selftest_domain);
+
+	for (i = 0; i < ARRAY_SIZE(fips140_selftests); i++) {
+		pr_info("self-test %s: %s in %lld us\n",
+			fips140_selftests[i].alg,
+			fips140_selftest_runs[i].err ? "failed" : "passed",
+			fips140_selftest_runs[i].duration_us);
+		if (!fips140_check_selftest(i))
+			ok = false;
+	}
+	if (!ok)
+		return false;
+
+	pr_info("all self-tests passed in %lld us\n",
+		ktime_us_delta(ktime_get(), fips140_selftests_start));
 	return true;
 }
@@ -7,7 +7,9 @@
 
 #include <crypto/scatterwalk.h>
 #include <crypto/internal/hash.h>
+#include <linux/bvec.h>
 #include <linux/err.h>
+#include <linux/highmem.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/slab.h>
@@ -132,6 +134,29 @@ int crypto_shash_update(struct shash_desc *desc, const u8 *data,
 }
 EXPORT_SYMBOL_GPL(crypto_shash_update);
 
+int crypto_shash_update_bvec(struct shash_desc *desc,
+			     const struct bio_vec *bv)
+{
+	struct page *page = nth_page(bv->bv_page, bv->bv_offset >> PAGE_SHIFT);
+	unsigned int offset = offset_in_page(bv->bv_offset);
+	unsigned int len = bv->bv_len;
+	int err = 0;
+
+	while (len && !err) {
+		unsigned int n = min_t(unsigned int, len, PAGE_SIZE - offset);
+		u8 *vaddr = kmap_atomic(page);
+
+		err = crypto_shash_update(desc, vaddr + offset, n);
+		kunmap_atomic(vaddr);
+
+		page = nth_page(page, 1);
+		offset = 0;
+		len -= n;
+	}
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_shash_update_bvec);
+
 static int shash_final_unaligned(struct shash_desc *desc, u8 *out)
 {
 	struct crypto_shash *tfm = desc->tfm;
@@ -656,6 +656,66 @@ int crypto_skcipher_decrypt(struct skcipher_request *req)
 }
 EXPORT_SYMBOL_GPL(crypto_skcipher_decrypt);
 
+static int crypto_skcipher_crypt_batch(struct skcipher_request **reqs,
+				       unsigned int nreqs, bool enc)
+{
+	struct crypto_skcipher *tfm;
+	struct skcipher_alg *alg;
+	struct crypto_alg *calg;
+	unsigned int i;
+	int ret = 0;
+
+	if (!nreqs)
+		return 0;
+
+	tfm = crypto_skcipher_reqtfm(reqs[0]);
+	alg = crypto_skcipher_alg(tfm);
+	calg = tfm->base.__crt_alg;
+
+	if (WARN_ON_ONCE(calg->cra_flags & CRYPTO_ALG_ASYNC))
+		return -EINVAL;
+	for (i = 1; i < nreqs; i++)
+		if (WARN_ON_ONCE(crypto_skcipher_reqtfm(reqs[i]) != tfm))
+			return -EINVAL;
+
+	if (crypto_skcipher_get_flags(tfm) & CRYPTO_TFM_NEED_KEY)
+		ret = -ENOKEY;
+	else if (enc && alg->encrypt_batch)
+		ret = alg->encrypt_batch(reqs, nreqs);
+	else if (!enc && alg->decrypt_batch)
+		ret = alg->decrypt_batch(reqs, nreqs);
+	else
+		for (i = 0; i < nreqs && !ret; i++)
+			ret = enc ? alg->encrypt(reqs[i]) :
+				    alg->decrypt(reqs[i]);
+
+	/* account the requests one by one, as the unbatched calls do */
+	for (i = 0; i < nreqs; i++) {
+		crypto_stats_get(calg);
+		if (enc)
+			crypto_stats_skcipher_encrypt(reqs[i]->cryptlen, ret,
+						      calg);
+		else
+			crypto_stats_skcipher_decrypt(reqs[i]->cryptlen, ret,
+						      calg);
+	}
+	return ret;
+}
+
+int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs)
+{
+	return crypto_skcipher_crypt_batch(reqs, nreqs, true);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_encrypt_batch);
+
+int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs)
+{
+	return crypto_skcipher_crypt_batch(reqs, nreqs, false);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_decrypt_batch);
+
 static void crypto_skcipher_exit_tfm(struct crypto_tfm *tfm)
 {
 	struct crypto_skcipher *skcipher = __crypto_skcipher_cast(tfm);
@@ -33,6 +33,9 @@
 #include <linux/jiffies.h>
 #include <linux/timex.h>
 #include <linux/interrupt.h>
+#include <linux/prandom.h>
+#include <linux/vmalloc.h>
+#include <asm/unaligned.h>
 #include "tcrypt.h"
 
 /*
@@ -73,12 +76,17 @@ static const char *check[] = {
 	"khazad", "wp512", "wp384", "wp256", "tnepres", "xeta",  "fcrypt",
 	"camellia", "seed", "salsa20", "rmd128", "rmd160", "rmd256", "rmd320",
 	"lzo", "lzo-rle", "cts", "sha3-224", "sha3-256", "sha3-384",
-	"sha3-512", "streebog256", "streebog512",
+	"sha3-512", "streebog256", "streebog512", "lz4", "lz4hc", "zstd",
 	NULL
 };
 
 static u32 block_sizes[] = { 16, 64, 256, 1024, 1472, 8192, 0 };
 static u32 aead_sizes[] = { 16, 64, 256, 512, 1024, 2048, 4096, 8192, 0 };
+/* a zram/zswap page, an f2fs cluster and a large read-ahead chunk */
+static u32 comp_sizes[] = { 4096, 16384, 65536, 0 };
+static u32 sector_sizes[] = { 512, 4096, 0 };
+
+#define COMP_SPEED_MAX	65536
 
 #define XBUFSIZE 8
 #define MAX_IVLEN 32
@@ -1150,13 +1158,26 @@ struct test_mb_skcipher_data {
 	struct skcipher_request *req;
 	struct crypto_wait wait;
 	char *xbuf[XBUFSIZE];
+	u8 iv[MAX_IVLEN];
 };
 
-static int do_mult_acipher_op(struct test_mb_skcipher_data *data, int enc,
-				u32 num_mb, int *rc)
+static int do_mult_acipher_op(struct test_mb_skcipher_data *data,
+			      struct skcipher_request **reqs, int enc,
+			      u32 num_mb, int *rc)
 {
 	int i, err = 0;
 
+	/* Or pass them all at once, they complete synchronously */
+	if (reqs) {
+		if (enc == ENCRYPT)
+			err = crypto_skcipher_encrypt_batch(reqs, num_mb);
+		else
+			err = crypto_skcipher_decrypt_batch(reqs, num_mb);
+		if (err)
+			pr_info("batched requests error %d\n", err);
+		return err;
+	}
+
 	/* Fire up a bunch of concurrent requests */
 	for (i = 0; i < num_mb; i++) {
 		if (enc == ENCRYPT)
@@ -1178,8 +1199,9 @@ static int do_mult_acipher_op(struct test_mb_skcipher_data *data, int enc,
 	return err;
 }
 
-static int test_mb_acipher_jiffies(struct test_mb_skcipher_data *data, int enc,
-				int blen, int secs, u32 num_mb)
+static int test_mb_acipher_jiffies(struct test_mb_skcipher_data *data,
+				   struct skcipher_request **reqs, int enc,
+				   int blen, int secs, u32 num_mb)
 {
 	unsigned long start, end;
 	int bcount;
@@ -1192,7 +1214,7 @@ static int test_mb_acipher_jiffies(struct test_mb_skcipher_data *data, int enc,
 
 	for (start = jiffies, end = start + secs * HZ, bcount = 0;
 	     time_before(jiffies, end); bcount++) {
-		ret = do_mult_acipher_op(data, enc, num_mb, rc);
+		ret = do_mult_acipher_op(data, reqs, enc, num_mb, rc);
 		if (ret)
 			goto out;
 	}
@@ -1205,8 +1227,9 @@ out:
 	return ret;
 }
 
-static int test_mb_acipher_cycles(struct test_mb_skcipher_data *data, int enc,
-			       int blen, u32 num_mb)
+static int test_mb_acipher_cycles(struct test_mb_skcipher_data *data,
+				  struct skcipher_request **reqs, int enc,
+				  int blen, u32 num_mb)
 {
 	unsigned long cycles = 0;
 	int ret = 0;
@@ -1219,7 +1242,7 @@ static int test_mb_acipher_cycles(struct test_mb_skcipher_data *data, int enc,
 
 	/* Warm-up run. */
 	for (i = 0; i < 4; i++) {
-		ret = do_mult_acipher_op(data, enc, num_mb, rc);
+		ret = do_mult_acipher_op(data, reqs, enc, num_mb, rc);
 		if (ret)
 			goto out;
 	}
@@ -1229,7 +1252,7 @@ static int test_mb_acipher_cycles(struct test_mb_skcipher_data *data, int enc,
 		cycles_t start, end;
 
 		start = get_cycles();
-		ret = do_mult_acipher_op(data, enc, num_mb, rc);
+		ret = do_mult_acipher_op(data, reqs, enc, num_mb, rc);
 		end = get_cycles();
 
 		if (ret)
@@ -1246,10 +1269,12 @@ out:
 	return ret;
 }
 
-static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
-				   struct cipher_speed_template *template,
-				   unsigned int tcount, u8 *keysize, u32 num_mb)
+static void __test_mb_skcipher_speed(const char *algo, int enc, int secs,
+				     struct cipher_speed_template *template,
+				     unsigned int tcount, u8 *keysize,
+				     u32 num_mb, u32 *sizes, bool batch)
 {
+	struct skcipher_request **reqs = NULL;
 	struct test_mb_skcipher_data *data;
 	struct crypto_skcipher *tfm;
 	unsigned int i, j, iv_len;
@@ -1268,7 +1293,8 @@ static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
 	if (!data)
 		return;
 
-	tfm = crypto_alloc_skcipher(algo, 0, 0);
+	/* batches are only supported by synchronous implementations */
+	tfm = crypto_alloc_skcipher(algo, 0, batch ? CRYPTO_ALG_ASYNC : 0);
 	if (IS_ERR(tfm)) {
 		pr_err("failed to load transform for %s: %ld\n",
 			algo, PTR_ERR(tfm));
@@ -1302,6 +1328,14 @@ static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
 		}
 	}
 
+	if (batch) {
+		reqs = kcalloc(num_mb, sizeof(*reqs), GFP_KERNEL);
+		if (!reqs)
+			goto out;
+		for (i = 0; i < num_mb; ++i)
+			reqs[i] = data[i].req;
+	}
+
 	for (i = 0; i < num_mb; ++i) {
 		skcipher_request_set_callback(data[i].req,
 					      CRYPTO_TFM_REQ_MAY_BACKLOG,
@@ -1309,12 +1343,13 @@ static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
 		crypto_init_wait(&data[i].wait);
 	}
 
-	pr_info("\ntesting speed of multibuffer %s (%s) %s\n", algo,
+	pr_info("\ntesting speed of %s %s (%s) %s\n",
+		batch ? "batched" : "multibuffer", algo,
 		get_driver_name(crypto_skcipher, tfm), e);
 
 	i = 0;
 	do {
-		b_size = block_sizes;
+		b_size = sizes;
 		do {
 			if (*b_size > XBUFSIZE * PAGE_SIZE) {
 				pr_err("template (%u) too big for buffer (%lu)\n",
@@ -1370,18 +1405,25 @@ static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
 				sg_set_buf(cur->sg + p, cur->xbuf[p], k);
 				memset(cur->xbuf[p], 0xff, k);
 
+				/* batched requests are sectors in a row */
+				if (batch) {
+					memset(cur->iv, 0, iv_len);
+					put_unaligned_le32(j, cur->iv);
+				}
+
 				skcipher_request_set_crypt(cur->req, cur->sg,
 							   cur->sg, *b_size,
-							   iv);
+							   batch ? cur->iv :
+								   iv);
 			}
 
 			if (secs) {
-				ret = test_mb_acipher_jiffies(data, enc,
+				ret = test_mb_acipher_jiffies(data, reqs, enc,
 							      *b_size, secs,
 							      num_mb);
 				cond_resched();
 			} else {
-				ret = test_mb_acipher_cycles(data, enc,
+				ret = test_mb_acipher_cycles(data, reqs, enc,
 							     *b_size, num_mb);
 			}
 
@@ -1397,6 +1439,7 @@ static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
 	} while (*keysize);
 
 out:
+	kfree(reqs);
 	for (i = 0; i < num_mb; ++i)
 		skcipher_request_free(data[i].req);
 out_free_xbuf:
@@ -1408,6 +1451,25 @@ out_free_data:
 	kfree(data);
 }
 
+static void test_mb_skcipher_speed(const char *algo, int enc, int secs,
+				   struct cipher_speed_template *template,
+				   unsigned int tcount, u8 *keysize, u32 num_mb)
+{
+	__test_mb_skcipher_speed(algo, enc, secs, template, tcount, keysize,
+				 num_mb, block_sizes, false);
+}
+
+/*
+ * num_mb sectors with consecutive IVs are passed to
+ * crypto_skcipher_{en,de}crypt_batch() at once, as dm-crypt or fscrypt would.
+ */
+static void test_batch_skcipher_speed(const char *algo, int enc, int secs,
+				      u8 *keysize, u32 num_mb)
+{
+	__test_mb_skcipher_speed(algo, enc, secs, NULL, 0, keysize, num_mb,
+				 sector_sizes, true);
+}
+
 static inline int do_one_acipher_op(struct skcipher_request *req, int ret)
 {
 	struct crypto_wait *wait = req->base.data;
@@ -1633,6 +1695,183 @@ static void test_cipher_speed(const char *algo, int enc, unsigned int secs,
 				   false);
 }
 
+struct comp_speed_data {
+	struct crypto_comp *tfm;
+	const u8 *src;
+	unsigned int slen;
+	u8 *dst;
+	unsigned int dmax;
+};
+
+static int do_one_comp_op(struct comp_speed_data *data, bool compress)
+{
+	unsigned int dlen = data->dmax;
+
+	if (compress)
+		return crypto_comp_compress(data->tfm, data->src, data->slen,
+					    data->dst, &dlen);
+	return crypto_comp_decompress(data->tfm, data->src, data->slen,
+				      data->dst, &dlen);
+}
+
+static int test_comp_jiffies(struct comp_speed_data *data, bool compress,
+			     int blen, int secs)
+{
+	unsigned long start, end;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + secs * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		ret = do_one_comp_op(data, compress);
+		if (ret)
+			return ret;
+		cond_resched();
+	}
+
+	pr_cont("%d operations in %d seconds (%llu bytes)\n",
+		bcount, secs, (u64)bcount * blen);
+	return 0;
+}
+
+static int test_comp_cycles(struct comp_speed_data *data, bool compress,
+			    int blen)
+{
+	unsigned long cycles = 0;
+	int ret = 0;
+	int i;
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		ret = do_one_comp_op(data, compress);
+		if (ret)
+			goto out;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		start = get_cycles();
+		ret = do_one_comp_op(data, compress);
+		end = get_cycles();
+
+		if (ret)
+			goto out;
+
+		cycles += end - start;
+	}
+
+out:
+	if (ret == 0)
+		pr_cont("1 operation in %lu cycles (%d bytes)\n",
+			(cycles + 4) / 8, blen);
+
+	return ret;
+}
+
+/*
+ * Fill @buf with data that compresses to about half its size, like typical
+ * anonymous pages and file data: random runs alternate with short repeats
+ * of what came before.
+ */
+static void comp_speed_fill(u8 *buf, unsigned int len)
+{
+	struct rnd_state rnd;
+	unsigned int i, j, n;
+
+	prandom_seed_state(&rnd, 0x1234);
+	for (i = 0; i < len; i += n) {
+		u32 r = prandom_u32_state(&rnd);
+		unsigned int off = 1 + ((r >> 8) & 255);
+
+		n = min(len - i, 8 + (r & 63));
+		if (i >= off && (r & BIT(31))) {
+			/* byte by byte, the source may overlap */
+			for (j = 0; j < n; j++)
+				buf[i + j] = buf[i + j - off];
+		} else {
+			prandom_bytes_state(&rnd, buf + i, n);
+		}
+	}
+}
+
+/* Throughput is reported in uncompressed bytes in both directions */
+static void test_comp_speed(const char *algo, bool compress,
+			    unsigned int secs)
+{
+	struct comp_speed_data data;
+	struct crypto_comp *tfm;
+	u8 *src, *comp, *out;
+	unsigned int i;
+	int ret;
+
+	tfm = crypto_alloc_comp(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		pr_err("failed to load transform for %s: %ld\n", algo,
+		       PTR_ERR(tfm));
+		return;
+	}
+
+	pr_info("\ntesting speed of %s (%s) %s\n", algo,
+		get_driver_name(crypto_comp, tfm),
+		compress ? "compression" : "decompression");
+
+	src = vmalloc(COMP_SPEED_MAX);
+	comp = vmalloc(2 * COMP_SPEED_MAX);
+	out = vmalloc(COMP_SPEED_MAX);
+	if (!src || !comp || !out) {
+		pr_err("comp speed: out of memory\n");
+		goto out_free;
+	}
+	comp_speed_fill(src, COMP_SPEED_MAX);
+
+	for (i = 0; comp_sizes[i]; i++) {
+		unsigned int blen = comp_sizes[i];
+		unsigned int clen = 2 * blen;
+
+		ret = crypto_comp_compress(tfm, src, blen, comp, &clen);
+		if (ret) {
+			pr_err("compressing %u bytes failed: %d\n", blen, ret);
+			break;
+		}
+
+		data.tfm = tfm;
+		if (compress) {
+			data.src = src;
+			data.slen = blen;
+			data.dst = comp;
+			data.dmax = 2 * blen;
+		} else {
+			data.src = comp;
+			data.slen = clen;
+			data.dst = out;
+			data.dmax = blen;
+		}
+
+		pr_info("test %u (%u byte blocks, %u compressed): ", i, blen,
+			clen);
+
+		if (secs)
+			ret = test_comp_jiffies(&data, compress, blen, secs);
+		else
+			ret = test_comp_cycles(&data, compress, blen);
+
+		if (ret) {
+			pr_err("%s failed: %d\n",
+			       compress ? "compression" : "decompression", ret);
+			break;
+		}
+		cond_resched();
+	}
+
+out_free:
+	vfree(out);
+	vfree(comp);
+	vfree(src);
+	crypto_free_comp(tfm);
+}
+
 static void test_available(void)
 {
 	const char **name = check;
@@ -3015,6 +3254,54 @@ static int do_test(const char *alg, u32 type, u32 mask, int m, u32 num_mb)
 				       speed_template_8_32, num_mb);
 		break;
 
+	case 610:
+		test_batch_skcipher_speed("xts(aes)", ENCRYPT, sec,
+					  speed_template_32_64, num_mb);
+		test_batch_skcipher_speed("xts(aes)", DECRYPT, sec,
+					  speed_template_32_64, num_mb);
+		break;
+
+	case 611:
+		test_batch_skcipher_speed("adiantum(xchacha12,aes)", ENCRYPT,
+					  sec, speed_template_32, num_mb);
+		test_batch_skcipher_speed("adiantum(xchacha12,aes)", DECRYPT,
+					  sec, speed_template_32, num_mb);
+		test_batch_skcipher_speed("adiantum(xchacha20,aes)", ENCRYPT,
+					  sec, speed_template_32, num_mb);
+		test_batch_skcipher_speed("adiantum(xchacha20,aes)", DECRYPT,
+					  sec, speed_template_32, num_mb);
+		break;
+
+	case 700:
+		if (alg) {
+			test_comp_speed(alg, true, sec);
+			test_comp_speed(alg, false, sec);
+			break;
+		}
+		fallthrough;
+	case 701:
+		test_comp_speed("lz4", true, sec);
+		test_comp_speed("lz4", false, sec);
+		if (mode > 700 && mode < 800) break;
+		fallthrough;
+	case 702:
+		test_comp_speed("lz4hc", true, sec);
+		test_comp_speed("lz4hc", false, sec);
+		if (mode > 700 && mode < 800) break;
+		fallthrough;
+	case 703:
+		test_comp_speed("lzo-rle", true, sec);
+		test_comp_speed("lzo-rle", false, sec);
+		if (mode > 700 && mode < 800) break;
+		fallthrough;
+	case 704:
+		test_comp_speed("zstd", true, sec);
+		test_comp_speed("zstd", false, sec);
+		if (mode > 700 && mode < 800) break;
+		fallthrough;
+	case 799:
+		break;
+
 	case 1000:
 		test_available();
 		break;
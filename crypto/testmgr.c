@@ -3129,6 +3129,141 @@ static int test_skcipher(const char *driver, int enc,
 	return 0;
 }
 
+/* Number of requests in the batches built from each test vector */
+#define SKCIPHER_TEST_BATCH	4
+
+/*
+ * Test crypto_skcipher_{en,de}crypt_batch(). A batch is built from each test
+ * vector: the vector itself, whose result is known, followed by requests on
+ * the same input with other IVs, whose results are taken from the
+ * single-request path. Asynchronous algorithms don't support batches.
+ */
+static int test_skcipher_batch(const char *driver, int enc,
+			       const struct cipher_test_suite *suite,
+			       struct crypto_skcipher *tfm)
+{
+	const unsigned int ivsize = crypto_skcipher_ivsize(tfm);
+	const char *op = enc ? "encryption" : "decryption";
+	struct skcipher_request *reqs[SKCIPHER_TEST_BATCH] = {};
+	struct scatterlist sgs[SKCIPHER_TEST_BATCH];
+	u8 ivs[SKCIPHER_TEST_BATCH][MAX_IVLEN];
+	u8 *bufs = NULL, *refs = NULL;
+	unsigned int i, j, maxlen = 0;
+	int err = 0;
+
+	if (crypto_skcipher_alg(tfm)->base.cra_flags & CRYPTO_ALG_ASYNC)
+		return 0;
+	if (WARN_ON(ivsize > MAX_IVLEN))
+		return -EINVAL;
+
+	for (i = 0; i < suite->count; i++)
+		maxlen = max(maxlen, suite->vecs[i].len);
+	if (!maxlen)
+		return 0;
+
+	bufs = kmalloc_array(SKCIPHER_TEST_BATCH, maxlen, GFP_KERNEL);
+	refs = kmalloc_array(SKCIPHER_TEST_BATCH, maxlen, GFP_KERNEL);
+	if (!bufs || !refs) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (j = 0; j < SKCIPHER_TEST_BATCH; j++) {
+		reqs[j] = skcipher_request_alloc(tfm, GFP_KERNEL);
+		if (!reqs[j]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < suite->count; i++) {
+		const struct cipher_testvec *vec = &suite->vecs[i];
+		const char *input = enc ? vec->ptext : vec->ctext;
+		const char *output = enc ? vec->ctext : vec->ptext;
+		const unsigned int len = vec->len;
+
+		if ((fips_enabled && vec->fips_skip) || vec->setkey_error ||
+		    vec->crypt_error || vec->generates_iv || !len)
+			continue;
+
+		if (vec->wk)
+			crypto_skcipher_set_flags(tfm,
+						  CRYPTO_TFM_REQ_FORBID_WEAK_KEYS);
+		else
+			crypto_skcipher_clear_flags(tfm,
+						    CRYPTO_TFM_REQ_FORBID_WEAK_KEYS);
+		err = crypto_skcipher_setkey(tfm, vec->key, vec->klen);
+		if (err) {
+			pr_err("alg: skcipher: %s setkey failed on batch test vector %u; err=%d\n",
+			       driver, i, err);
+			goto out;
+		}
+
+		for (j = 0; j < SKCIPHER_TEST_BATCH; j++) {
+			u8 *buf = bufs + j * maxlen;
+			u8 *ref = refs + j * maxlen;
+			u8 iv[MAX_IVLEN];
+
+			if (vec->iv)
+				memcpy(ivs[j], vec->iv, ivsize);
+			else
+				memset(ivs[j], 0, ivsize);
+			if (ivsize)
+				ivs[j][0] ^= j;
+
+			skcipher_request_set_callback(reqs[j], 0, NULL, NULL);
+			if (j == 0) {
+				memcpy(ref, output, len);
+			} else {
+				/* the expected result, one request at a time */
+				memcpy(ref, input, len);
+				memcpy(iv, ivs[j], ivsize);
+				sg_init_one(&sgs[j], ref, len);
+				skcipher_request_set_crypt(reqs[j], &sgs[j],
+							   &sgs[j], len, iv);
+				err = enc ? crypto_skcipher_encrypt(reqs[j]) :
+					    crypto_skcipher_decrypt(reqs[j]);
+				if (err) {
+					pr_err("alg: skcipher: %s %s failed on batch test vector %u; err=%d\n",
+					       driver, op, i, err);
+					goto out;
+				}
+			}
+
+			memcpy(buf, input, len);
+			sg_init_one(&sgs[j], buf, len);
+			skcipher_request_set_crypt(reqs[j], &sgs[j], &sgs[j],
+						   len, ivs[j]);
+		}
+
+		err = enc ? crypto_skcipher_encrypt_batch(reqs,
+							  SKCIPHER_TEST_BATCH) :
+			    crypto_skcipher_decrypt_batch(reqs,
+							  SKCIPHER_TEST_BATCH);
+		if (err) {
+			pr_err("alg: skcipher: %s batch %s failed on test vector %u; err=%d\n",
+			       driver, op, i, err);
+			goto out;
+		}
+
+		for (j = 0; j < SKCIPHER_TEST_BATCH; j++) {
+			if (memcmp(bufs + j * maxlen, refs + j * maxlen,
+				   len)) {
+				pr_err("alg: skcipher: %s batch %s test failed (wrong result) on test vector %u, request %u\n",
+				       driver, op, i, j);
+				err = -EINVAL;
+				goto out;
+			}
+		}
+		cond_resched();
+	}
+out:
+	for (j = 0; j < SKCIPHER_TEST_BATCH; j++)
+		skcipher_request_free(reqs[j]);
+	kfree(refs);
+	kfree(bufs);
+	return err;
+}
+
 static int alg_test_skcipher(const struct alg_test_desc *desc,
 			     const char *driver, u32 type, u32 mask)
 {
@@ -3174,6 +3309,14 @@ static int alg_test_skcipher(const struct alg_test_desc *desc,
 	if (err)
 		goto out;
 
+	err = test_skcipher_batch(driver, ENCRYPT, suite, tfm);
+	if (err)
+		goto out;
+
+	err = test_skcipher_batch(driver, DECRYPT, suite, tfm);
+	if (err)
+		goto out;
+
 	err = test_skcipher_vs_generic_impl(driver, desc->generic_driver, req,
 					    tsgls);
 out:
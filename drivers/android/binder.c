@@ -26,6 +26,9 @@
  *    binder_inner_proc_lock() and binder_inner_proc_unlock()
  *    are used to acq/rel
  *
+ * Work a thread queues to itself (thread->incoming) is added without
+ * any lock and moved to thread->todo under proc->inner_lock.
+ *
  * Any lock under procA must never be nested under any lock at the same
  * level or below on procB.
  *
@@ -47,6 +50,7 @@
 #include <linux/freezer.h>
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -57,6 +61,7 @@
 #include <linux/sched/signal.h>
 #include <linux/sched/mm.h>
 #include <linux/seq_file.h>
+#include <linux/shmem_fs.h>
 #include <linux/string.h>
 #include <linux/uaccess.h>
 #include <linux/pid_namespace.h>
@@ -65,6 +70,7 @@
 #include <linux/ratelimit.h>
 #include <linux/syscalls.h>
 #include <linux/task_work.h>
+#include <linux/uio.h>
 #include <linux/sizes.h>
 #include <linux/android_vendor.h>
 
@@ -160,6 +166,9 @@ module_param_call(stop_on_user_error, binder_set_stop_on_user_error,
 #define to_binder_fd_array_object(hdr) \
 	container_of(hdr, struct binder_fd_array_object, hdr)
 
+#define to_binder_blob_object(hdr) \
+	container_of(hdr, struct binder_blob_object, hdr)
+
 static struct binder_stats binder_stats;
 
 static inline void binder_stats_deleted(enum binder_stat_types type)
@@ -393,6 +402,32 @@ binder_enqueue_work_ilocked(struct binder_work *work,
 	list_add_tail(&work->entry, target_list);
 }
 
+/**
+ * binder_drain_thread_incoming_ilocked() - Move lock-free work to @todo
+ * @thread:       thread whose incoming work should be moved
+ *
+ * Moves all work queued on @thread->incoming by binder_enqueue_thread_work()
+ * to the tail of @thread->todo, preserving the order in which it was queued,
+ * and enables processing of the todo queue if anything was moved.
+ *
+ * Requires the proc->inner_lock to be held.
+ */
+static void
+binder_drain_thread_incoming_ilocked(struct binder_thread *thread)
+{
+	struct llist_node *first;
+	struct binder_work *w, *tmp;
+
+	first = llist_del_all(&thread->incoming);
+	if (!first)
+		return;
+
+	first = llist_reverse_order(first);
+	llist_for_each_entry_safe(w, tmp, first, llnode)
+		binder_enqueue_work_ilocked(w, &thread->todo);
+	thread->process_todo = true;
+}
+
 /**
  * binder_enqueue_deferred_thread_work_ilocked() - Add deferred thread work
  * @thread:       thread to queue work to
@@ -409,6 +444,7 @@ binder_enqueue_deferred_thread_work_ilocked(struct binder_thread *thread,
 					    struct binder_work *work)
 {
 	WARN_ON(!list_empty(&thread->waiting_thread_node));
+	binder_drain_thread_incoming_ilocked(thread);
 	binder_enqueue_work_ilocked(work, &thread->todo);
 }
 
@@ -427,6 +463,7 @@ binder_enqueue_thread_work_ilocked(struct binder_thread *thread,
 				   struct binder_work *work)
 {
 	WARN_ON(!list_empty(&thread->waiting_thread_node));
+	binder_drain_thread_incoming_ilocked(thread);
 	binder_enqueue_work_ilocked(work, &thread->todo);
 	thread->process_todo = true;
 }
@@ -436,16 +473,21 @@ binder_enqueue_thread_work_ilocked(struct binder_thread *thread,
  * @thread:       thread to queue work to
  * @work:         struct binder_work to add to list
  *
- * Adds the work to the todo list of the thread, and enables processing
- * of the todo queue.
+ * Adds the work to the lock-free incoming list of the thread without
+ * taking the proc->inner_lock. The work is moved to the todo list, and
+ * processing of the todo queue enabled, the next time the list is
+ * drained under the lock.
+ *
+ * Must only be called by @thread itself for work it queues to itself,
+ * so no wakeup is needed.
  */
 static void
 binder_enqueue_thread_work(struct binder_thread *thread,
 			   struct binder_work *work)
 {
-	binder_inner_proc_lock(thread->proc);
-	binder_enqueue_thread_work_ilocked(thread, work);
-	binder_inner_proc_unlock(thread->proc);
+	WARN_ON_ONCE(thread->task != current);
+	BUG_ON(work->entry.next && !list_empty(&work->entry));
+	llist_add(&work->llnode, &thread->incoming);
 }
 
 static void
@@ -491,6 +533,7 @@ static bool binder_has_work_ilocked(struct binder_thread *thread,
 				    bool do_proc_work)
 {
 	return thread->process_todo ||
+		!llist_empty(&thread->incoming) ||
 		thread->looper_need_return ||
 		(do_proc_work &&
 		 !binder_worklist_empty_ilocked(&thread->proc->todo));
@@ -511,6 +554,7 @@ static bool binder_available_for_proc_work_ilocked(struct binder_thread *thread)
 {
 	return !thread->transaction_stack &&
 		binder_worklist_empty_ilocked(&thread->todo) &&
+		llist_empty(&thread->incoming) &&
 		(thread->looper & (BINDER_LOOPER_STATE_ENTERED |
 				   BINDER_LOOPER_STATE_REGISTERED));
 }
@@ -626,11 +670,149 @@ static bool is_fair_policy(int policy)
 	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
 }
 
+static bool is_dl_policy(int policy)
+{
+	return policy == SCHED_DEADLINE;
+}
+
 static bool binder_supported_policy(int policy)
 {
 	return is_fair_policy(policy) || is_rt_policy(policy);
 }
 
+/* Policies a synchronous transaction inherits from its caller */
+static bool binder_inherited_policy(int policy)
+{
+	return binder_supported_policy(policy) || is_dl_policy(policy);
+}
+
+/**
+ * binder_get_task_priority() - snapshot the scheduling parameters of a task
+ * @task:	task to read
+ * @prio:	returns policy, priority and deadline parameters of @task
+ */
+static void binder_get_task_priority(struct task_struct *task,
+				     struct binder_priority *prio)
+{
+	prio->sched_policy = task->policy;
+	prio->prio = task->normal_prio;
+	if (is_dl_policy(task->policy)) {
+		prio->dl_runtime = task->dl.dl_runtime;
+		prio->dl_deadline = task->dl.dl_deadline;
+		prio->dl_period = task->dl.dl_period;
+	}
+}
+
+#ifdef CONFIG_UCLAMP_TASK
+/**
+ * binder_get_task_uclamp() - snapshot the requested clamps of a task
+ * @task:	 task to read
+ * @prio:	 returns the clamps of @task
+ * @user_only:	 only report clamps explicitly requested via sched_setattr()
+ */
+static void binder_get_task_uclamp(struct task_struct *task,
+				   struct binder_priority *prio,
+				   bool user_only)
+{
+	struct uclamp_se *uc_min = &task->uclamp_req[UCLAMP_MIN];
+	struct uclamp_se *uc_max = &task->uclamp_req[UCLAMP_MAX];
+
+	if (user_only && !uc_min->user_defined && !uc_max->user_defined)
+		return;
+
+	prio->has_uclamp = true;
+	prio->uclamp_min = uc_min->value;
+	prio->uclamp_max = uc_max->value;
+}
+
+static void binder_set_uclamp(struct task_struct *task,
+			      const struct binder_priority *desired)
+{
+	struct sched_attr attr = {
+		.size = sizeof(attr),
+		.sched_policy = task->policy,
+		.sched_flags = SCHED_FLAG_KEEP_ALL | SCHED_FLAG_UTIL_CLAMP,
+		.sched_nice = task_nice(task),
+		.sched_priority = task->rt_priority,
+		.sched_util_min = desired->uclamp_min,
+		.sched_util_max = desired->uclamp_max,
+	};
+	int ret;
+
+	if (!desired->has_uclamp ||
+	    (task->uclamp_req[UCLAMP_MIN].value == desired->uclamp_min &&
+	     task->uclamp_req[UCLAMP_MAX].value == desired->uclamp_max))
+		return;
+
+	/* The current parameters are passed only to pass validation */
+	if (task->sched_reset_on_fork)
+		attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+	if (is_dl_policy(task->policy)) {
+		attr.sched_runtime = task->dl.dl_runtime;
+		attr.sched_deadline = task->dl.dl_deadline;
+		attr.sched_period = task->dl.dl_period;
+	}
+
+	ret = sched_setattr_nocheck(task, &attr);
+	if (ret)
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "%d: uclamp %u-%u not set (%d)\n",
+			     task->pid, desired->uclamp_min,
+			     desired->uclamp_max, ret);
+}
+#else
+static void binder_get_task_uclamp(struct task_struct *task,
+				   struct binder_priority *prio,
+				   bool user_only)
+{
+}
+
+static void binder_set_uclamp(struct task_struct *task,
+			      const struct binder_priority *desired)
+{
+}
+#endif
+
+/**
+ * binder_set_deadline() - move a task to SCHED_DEADLINE
+ * @task:	task to change
+ * @desired:	deadline parameters to apply
+ *
+ * Return: 0 on success, or the error from sched_setattr_nocheck(), e.g.
+ * -EBUSY if the parameters do not pass deadline admission control
+ */
+static int binder_set_deadline(struct task_struct *task,
+			       const struct binder_priority *desired)
+{
+	struct sched_attr attr = {
+		.size = sizeof(attr),
+		.sched_policy = SCHED_DEADLINE,
+		.sched_flags = SCHED_FLAG_RESET_ON_FORK,
+		.sched_runtime = desired->dl_runtime,
+		.sched_deadline = desired->dl_deadline,
+		.sched_period = desired->dl_period,
+	};
+	int ret;
+
+	if (task->policy == SCHED_DEADLINE &&
+	    task->dl.dl_runtime == desired->dl_runtime &&
+	    task->dl.dl_deadline == desired->dl_deadline &&
+	    task->dl.dl_period == desired->dl_period)
+		return 0;
+
+	ret = sched_setattr_nocheck(task, &attr);
+	if (ret) {
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "%d: SCHED_DEADLINE not admitted (%d)\n",
+			     task->pid, ret);
+		return ret;
+	}
+
+	trace_binder_set_priority(task->tgid, task->pid, task->normal_prio,
+				  desired->prio, desired->prio);
+	return 0;
+}
+
 static int to_userspace_prio(int policy, int kernel_priority)
 {
 	if (is_fair_policy(policy))
@@ -655,12 +837,27 @@ static void binder_do_set_priority(struct task_struct *task,
 	bool has_cap_nice;
 	unsigned int policy = desired.sched_policy;
 
-	if (task->policy == policy && task->normal_prio == desired.prio)
+	binder_set_uclamp(task, &desired);
+
+	if (task->policy == policy && task->normal_prio == desired.prio &&
+	    !is_dl_policy(policy))
 		return;
 
 	has_cap_nice = has_capability_noaudit(task, CAP_SYS_NICE);
 
-	priority = to_userspace_prio(policy, desired.prio);
+	if (is_dl_policy(policy)) {
+		if ((!verify || has_cap_nice) &&
+		    !binder_set_deadline(task, &desired))
+			return;
+		/*
+		 * SCHED_DEADLINE not allowed or not admitted: fall back to
+		 * the highest RT priority the task may use.
+		 */
+		policy = SCHED_FIFO;
+		priority = MAX_USER_RT_PRIO - 1;
+	} else {
+		priority = to_userspace_prio(policy, desired.prio);
+	}
 
 	if (verify && is_rt_policy(policy) && !has_cap_nice) {
 		long max_rtprio = task_rlimit(task, RLIMIT_RTPRIO);
@@ -734,14 +931,16 @@ static void binder_transaction_priority(struct task_struct *task,
 		return;
 
 	t->set_priority_called = true;
-	t->saved_priority.sched_policy = task->policy;
-	t->saved_priority.prio = task->normal_prio;
+	binder_get_task_priority(task, &t->saved_priority);
+	if (t->priority.has_uclamp)
+		binder_get_task_uclamp(task, &t->saved_priority, false);
 
 	trace_android_vh_binder_priority_skip(task, &skip);
 	if (skip)
 		return;
 
-	if (!inherit_rt && is_rt_policy(desired_prio.sched_policy)) {
+	if (!inherit_rt && (is_rt_policy(desired_prio.sched_policy) ||
+			    is_dl_policy(desired_prio.sched_policy))) {
 		desired_prio.prio = NICE_TO_PRIO(0);
 		desired_prio.sched_policy = SCHED_NORMAL;
 	}
@@ -754,9 +953,11 @@ static void binder_transaction_priority(struct task_struct *task,
 		 * higher (lower value), use that priority. If
 		 * the priority is the same, but the node uses
 		 * SCHED_FIFO, prefer SCHED_FIFO, since it can
-		 * run unbounded, unlike SCHED_RR.
+		 * run unbounded, unlike SCHED_RR. The caller's
+		 * utilization clamps still apply.
 		 */
-		desired_prio = node_prio;
+		desired_prio.sched_policy = node_prio.sched_policy;
+		desired_prio.prio = node_prio.prio;
 	}
 
 	binder_set_priority(task, desired_prio);
@@ -884,8 +1085,15 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	return node;
 }
 
+static void binder_node_latency_release(struct kref *kref)
+{
+	kfree(container_of(kref, struct binder_node_latency, kref));
+}
+
 static void binder_free_node(struct binder_node *node)
 {
+	if (node->latency)
+		kref_put(&node->latency->kref, binder_node_latency_release);
 	kfree(node);
 	binder_stats_deleted(BINDER_STAT_NODE);
 }
@@ -1626,6 +1834,97 @@ static void binder_free_txn_fixups(struct binder_transaction *t)
 	}
 }
 
+static void binder_latency_add(struct binder_latency_hist *hist, u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	int bucket = 0;
+
+	if (us)
+		bucket = min_t(int, ilog2(us) + 1, BINDER_LATENCY_BUCKETS - 1);
+	atomic_inc(&hist->buckets[bucket]);
+}
+
+/**
+ * binder_node_latency_get() - get the latency stats of a node
+ * @node:	node the stats are for
+ *
+ * Allocates the stats on first use. The returned stats are owned by
+ * @node; take a reference to use them after @node may be gone.
+ *
+ * Return: the stats, or NULL if they could not be allocated
+ */
+static struct binder_node_latency *
+binder_node_latency_get(struct binder_node *node)
+{
+	struct binder_node_latency *lat = READ_ONCE(node->latency);
+	struct binder_node_latency *old;
+
+	if (lat)
+		return lat;
+
+	lat = kzalloc(sizeof(*lat), GFP_KERNEL);
+	if (!lat)
+		return NULL;
+	kref_init(&lat->kref);
+	old = cmpxchg(&node->latency, NULL, lat);
+	if (old) {
+		kfree(lat);
+		lat = old;
+	}
+	return lat;
+}
+
+/**
+ * binder_latency_delivered() - account a transaction returned to user-space
+ * @proc:	proc receiving the transaction
+ * @t:		the transaction
+ * @node:	target node of @t
+ *
+ * Records the queueing and scheduling latency of @t in @proc and @node,
+ * and prepares @t for recording its handler latency when replied to.
+ */
+static void binder_latency_delivered(struct binder_proc *proc,
+				     struct binder_transaction *t,
+				     struct binder_node *node)
+{
+	struct binder_node_latency *lat = binder_node_latency_get(node);
+	u64 now = ktime_get_ns();
+	u64 wakeup = t->wakeup_ns ?: now;
+
+	t->deliver_ns = now;
+	binder_latency_add(&proc->latency.queue, wakeup - t->start_ns);
+	binder_latency_add(&proc->latency.sched, now - wakeup);
+	if (!lat)
+		return;
+
+	binder_latency_add(&lat->stats.queue, wakeup - t->start_ns);
+	binder_latency_add(&lat->stats.sched, now - wakeup);
+	if (!(t->flags & TF_ONE_WAY)) {
+		kref_get(&lat->kref);
+		t->node_latency = lat;
+	}
+}
+
+/**
+ * binder_latency_replied() - account the reply to a transaction
+ * @proc:	proc sending the reply
+ * @t:		the transaction being replied to
+ */
+static void binder_latency_replied(struct binder_proc *proc,
+				   struct binder_transaction *t)
+{
+	u64 handler_ns;
+
+	if (!t->deliver_ns)
+		return;
+
+	handler_ns = ktime_get_ns() - t->deliver_ns;
+	binder_latency_add(&proc->latency.handler, handler_ns);
+	if (t->node_latency)
+		binder_latency_add(&t->node_latency->stats.handler,
+				   handler_ns);
+}
+
 static void binder_free_transaction(struct binder_transaction *t)
 {
 	struct binder_proc *target_proc = t->to_proc;
@@ -1647,6 +1946,8 @@ static void binder_free_transaction(struct binder_transaction *t)
 	 * t->buffer->transaction has already been cleared.
 	 */
 	binder_free_txn_fixups(t);
+	if (t->node_latency)
+		kref_put(&t->node_latency->kref, binder_node_latency_release);
 	kfree(t);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 }
@@ -1773,6 +2074,9 @@ static size_t binder_get_object(struct binder_proc *proc,
 	case BINDER_TYPE_FDA:
 		object_size = sizeof(struct binder_fd_array_object);
 		break;
+	case BINDER_TYPE_BLOB:
+		object_size = sizeof(struct binder_blob_object);
+		break;
 	default:
 		return 0;
 	}
@@ -2070,6 +2374,12 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 			 * transaction buffer gets freed
 			 */
 			break;
+		case BINDER_TYPE_BLOB:
+			/*
+			 * Same as BINDER_TYPE_FD: the shmem file is either
+			 * closed by user-space or dropped with the fd fixups.
+			 */
+			break;
 		case BINDER_TYPE_FDA: {
 			struct binder_fd_array_object *fda;
 			struct binder_buffer_object *parent;
@@ -2336,6 +2646,97 @@ err_fd_not_accepted:
 	return ret;
 }
 
+/**
+ * binder_translate_blob() - copy a blob into a shmem file for the target
+ * @blob:	blob object in the transaction buffer
+ * @blob_offset: offset of @blob in the transaction buffer
+ * @t:		transaction the blob is part of
+ * @thread:	sending thread
+ * @in_reply_to: transaction being replied to, or NULL
+ *
+ * Copies the payload described by @blob from the sender into a new
+ * anonymous shmem file, and adds an fd fixup so that the file is
+ * installed in the target and its fd written to @blob->fd.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+static int binder_translate_blob(struct binder_blob_object *blob,
+				 binder_size_t blob_offset,
+				 struct binder_transaction *t,
+				 struct binder_thread *thread,
+				 struct binder_transaction *in_reply_to)
+{
+	struct binder_proc *proc = thread->proc;
+	struct binder_proc *target_proc = t->to_proc;
+	struct binder_txn_fd_fixup *fixup;
+	void __user *ubuf = u64_to_user_ptr(blob->buffer);
+	struct iov_iter iter;
+	struct iovec iov;
+	struct file *file;
+	bool target_allows_fd;
+	loff_t pos = 0;
+	ssize_t written;
+	int ret;
+
+	if (in_reply_to)
+		target_allows_fd = !!(in_reply_to->flags & TF_ACCEPT_FDS);
+	else
+		target_allows_fd = t->buffer->target_node->accept_fds;
+	if (!target_allows_fd) {
+		binder_user_error("%d:%d got %s with blob, but target does not allow fds\n",
+				  proc->pid, thread->pid,
+				  in_reply_to ? "reply" : "transaction");
+		return -EPERM;
+	}
+
+	if (!blob->length || blob->length > BINDER_BLOB_MAX_SIZE) {
+		binder_user_error("%d:%d got transaction with invalid blob size %llu\n",
+				  proc->pid, thread->pid, (u64)blob->length);
+		return -EINVAL;
+	}
+
+	ret = import_single_range(WRITE, ubuf, blob->length, &iov, &iter);
+	if (ret)
+		return ret;
+
+	file = shmem_file_setup("binder-blob", blob->length, VM_NORESERVE);
+	if (IS_ERR(file))
+		return PTR_ERR(file);
+
+	/*
+	 * The only copy of the payload: straight from the sender into
+	 * pages charged to the sender, never through the binder buffer.
+	 */
+	written = vfs_iter_write(file, &iter, &pos, 0);
+	if (written != blob->length) {
+		ret = written < 0 ? written : -EFAULT;
+		goto err_write;
+	}
+
+	ret = security_binder_transfer_file(proc->tsk, target_proc->tsk, file);
+	if (ret < 0) {
+		ret = -EPERM;
+		goto err_security;
+	}
+
+	fixup = kzalloc(sizeof(*fixup), GFP_KERNEL);
+	if (!fixup) {
+		ret = -ENOMEM;
+		goto err_alloc;
+	}
+	fixup->file = file;
+	fixup->offset = blob_offset + offsetof(struct binder_blob_object, fd);
+	list_add_tail(&fixup->fixup_entry, &t->fd_fixups);
+
+	return 0;
+
+err_alloc:
+err_security:
+err_write:
+	fput(file);
+	return ret;
+}
+
 static int binder_translate_fd_array(struct binder_fd_array_object *fda,
 				     struct binder_buffer_object *parent,
 				     struct binder_transaction *t,
@@ -2516,8 +2917,10 @@ static int binder_proc_transaction(struct binder_transaction *t,
 		binder_enqueue_work_ilocked(&t->work, &node->async_todo);
 	}
 
-	if (!pending_async)
+	if (!pending_async) {
+		t->wakeup_ns = ktime_get_ns();
 		binder_wakeup_thread_ilocked(proc, thread, !oneway /* sync */);
+	}
 
 	proc->outstanding_txns++;
 	binder_inner_proc_unlock(proc);
@@ -2723,6 +3126,7 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_invalid_target_handle;
 		}
 		binder_inner_proc_lock(proc);
+		binder_drain_thread_incoming_ilocked(thread);
 
 		w = list_first_entry_or_null(&thread->todo,
 					     struct binder_work, entry);
@@ -2808,6 +3212,7 @@ static void binder_transaction(struct binder_proc *proc,
 	binder_stats_created(BINDER_STAT_TRANSACTION_COMPLETE);
 
 	t->debug_id = t_debug_id;
+	t->start_ns = ktime_get_ns();
 
 	if (reply)
 		binder_debug(BINDER_DEBUG_TRANSACTION,
@@ -2838,10 +3243,10 @@ static void binder_transaction(struct binder_proc *proc,
 	t->code = tr->code;
 	t->flags = tr->flags;
 	if (!(t->flags & TF_ONE_WAY) &&
-	    binder_supported_policy(current->policy)) {
+	    binder_inherited_policy(current->policy)) {
 		/* Inherit supported policies for synchronous transactions */
-		t->priority.sched_policy = current->policy;
-		t->priority.prio = current->normal_prio;
+		binder_get_task_priority(current, &t->priority);
+		binder_get_task_uclamp(current, &t->priority, true);
 	} else {
 		/* Otherwise, fall back to the default priority */
 		t->priority = target_proc->default_priority;
@@ -3069,6 +3474,26 @@ static void binder_transaction(struct binder_proc *proc,
 				goto err_translate_failed;
 			}
 		} break;
+		case BINDER_TYPE_BLOB: {
+			struct binder_blob_object *bp =
+				to_binder_blob_object(hdr);
+			int ret = binder_translate_blob(bp, object_offset, t,
+							thread, in_reply_to);
+
+			/* Don't leak the sender's address to the target */
+			bp->fd = 0;
+			bp->buffer = 0;
+			if (ret < 0 ||
+			    binder_alloc_copy_to_buffer(&target_proc->alloc,
+							t->buffer,
+							object_offset,
+							bp, sizeof(*bp))) {
+				return_error = BR_FAILED_REPLY;
+				return_error_param = ret;
+				return_error_line = __LINE__;
+				goto err_translate_failed;
+			}
+		} break;
 		case BINDER_TYPE_FDA: {
 			struct binder_object ptr_object;
 			binder_size_t parent_offset;
@@ -3198,6 +3623,7 @@ static void binder_transaction(struct binder_proc *proc,
 		target_proc->outstanding_txns++;
 		binder_inner_proc_unlock(target_proc);
 		wake_up_interruptible_sync(&target_thread->wait);
+		binder_latency_replied(proc, in_reply_to);
 		trace_android_vh_binder_restore_priority(in_reply_to, current);
 		binder_restore_priority(current, in_reply_to->saved_priority);
 		binder_free_transaction(in_reply_to);
@@ -3247,7 +3673,10 @@ static void binder_transaction(struct binder_proc *proc,
 
 err_dead_proc_or_thread:
 	return_error_line = __LINE__;
-	binder_dequeue_work(proc, tcomplete);
+	binder_inner_proc_lock(proc);
+	binder_drain_thread_incoming_ilocked(thread);
+	binder_dequeue_work_ilocked(tcomplete);
+	binder_inner_proc_unlock(proc);
 err_translate_failed:
 err_bad_object_type:
 err_bad_offset:
@@ -3355,6 +3784,8 @@ binder_free_buf(struct binder_proc *proc, struct binder_buffer *buffer)
 		if (!w) {
 			buf_node->has_async_transaction = false;
 		} else {
+			container_of(w, struct binder_transaction,
+				     work)->wakeup_ns = ktime_get_ns();
 			binder_enqueue_work_ilocked(
 					w, &proc->todo);
 			binder_wakeup_proc_ilocked(proc);
@@ -3366,6 +3797,62 @@ binder_free_buf(struct binder_proc *proc, struct binder_buffer *buffer)
 	binder_alloc_free_buf(&proc->alloc, buffer);
 }
 
+/**
+ * binder_multi_entry_valid() - check a BC_TRANSACTION_MULTI entry up front
+ * @proc:	sending proc
+ * @thread:	sending thread
+ * @tr:		entry to check
+ * @i:		index of @tr, for the error message
+ *
+ * Catches what binder_transaction() would refuse about the entry itself,
+ * so that a batch with a bad entry is rejected before any entry is sent.
+ * The target can still die before its entry is sent, which is reported
+ * as for a single transaction.
+ *
+ * Return: true if @tr may be sent
+ */
+static bool binder_multi_entry_valid(struct binder_proc *proc,
+				     struct binder_thread *thread,
+				     struct binder_transaction_data *tr,
+				     binder_size_t i)
+{
+	struct binder_context *context = proc->context;
+	struct binder_node *mgr;
+	bool valid;
+
+	if (!(tr->flags & TF_ONE_WAY)) {
+		binder_user_error("%d:%d BC_TRANSACTION_MULTI entry %llu is not one-way\n",
+				  proc->pid, thread->pid, (u64)i);
+		return false;
+	}
+
+	if (!IS_ALIGNED(tr->offsets_size, sizeof(binder_size_t)) ||
+	    tr->data_size > SZ_4M || tr->offsets_size > SZ_4M ||
+	    tr->data_size + tr->offsets_size > SZ_4M) {
+		binder_user_error("%d:%d BC_TRANSACTION_MULTI entry %llu has invalid sizes %lld/%lld\n",
+				  proc->pid, thread->pid, (u64)i,
+				  (u64)tr->data_size, (u64)tr->offsets_size);
+		return false;
+	}
+
+	if (tr->target.handle) {
+		binder_proc_lock(proc);
+		valid = !!binder_get_ref_olocked(proc, tr->target.handle,
+						 true);
+		binder_proc_unlock(proc);
+	} else {
+		mutex_lock(&context->context_mgr_node_lock);
+		mgr = context->binder_context_mgr_node;
+		valid = mgr && mgr->proc != proc;
+		mutex_unlock(&context->context_mgr_node_lock);
+	}
+	if (!valid)
+		binder_user_error("%d:%d BC_TRANSACTION_MULTI entry %llu has invalid handle %u\n",
+				  proc->pid, thread->pid, (u64)i,
+				  tr->target.handle);
+	return valid;
+}
+
 static int binder_thread_write(struct binder_proc *proc,
 			struct binder_thread *thread,
 			binder_uintptr_t binder_buffer, size_t size,
@@ -3582,6 +4069,56 @@ static int binder_thread_write(struct binder_proc *proc,
 					   cmd == BC_REPLY, 0);
 			break;
 		}
+		case BC_TRANSACTION_MULTI: {
+			struct binder_transaction_multi multi;
+			struct binder_transaction_data *trs;
+			void __user *txns;
+			binder_size_t i;
+
+			if (copy_from_user(&multi, ptr, sizeof(multi)))
+				return -EFAULT;
+			ptr += sizeof(multi);
+			if (multi.count > BINDER_TRANSACTION_MULTI_MAX) {
+				binder_user_error("%d:%d BC_TRANSACTION_MULTI with %llu entries, max %d\n",
+					proc->pid, thread->pid,
+					(u64)multi.count,
+					BINDER_TRANSACTION_MULTI_MAX);
+				return -EINVAL;
+			}
+			if (!multi.count)
+				break;
+			txns = (void __user *)(uintptr_t)multi.txns;
+
+			/* Nothing is sent unless every entry is valid */
+			trs = kmalloc_array(multi.count, sizeof(*trs),
+					    GFP_KERNEL);
+			if (!trs)
+				return -ENOMEM;
+			if (copy_from_user(trs, txns,
+					   multi.count * sizeof(*trs))) {
+				kfree(trs);
+				return -EFAULT;
+			}
+			for (i = 0; i < multi.count; i++) {
+				if (!binder_multi_entry_valid(proc, thread,
+							      &trs[i], i)) {
+					kfree(trs);
+					return -EINVAL;
+				}
+			}
+
+			/*
+			 * Each entry is handled like a BC_TRANSACTION, so it
+			 * gets its own BR_TRANSACTION_COMPLETE. Stop at the
+			 * first failed entry; its error is returned to the
+			 * sender the same way as for a single transaction.
+			 */
+			for (i = 0; i < multi.count &&
+			     thread->return_error.cmd == BR_OK; i++)
+				binder_transaction(proc, thread, &trs[i], 0, 0);
+			kfree(trs);
+			break;
+		}
 
 		case BC_REGISTER_LOOPER:
 			binder_debug(BINDER_DEBUG_THREADS,
@@ -3965,6 +4502,7 @@ static int binder_thread_read(struct binder_proc *proc,
 
 retry:
 	binder_inner_proc_lock(proc);
+	binder_drain_thread_incoming_ilocked(thread);
 	wait_for_proc_work = binder_available_for_proc_work_ilocked(thread);
 	binder_inner_proc_unlock(proc);
 
@@ -4008,6 +4546,7 @@ retry:
 		size_t trsize = sizeof(*trd);
 
 		binder_inner_proc_lock(proc);
+		binder_drain_thread_incoming_ilocked(thread);
 		if (!binder_worklist_empty_ilocked(&thread->todo))
 			list = &thread->todo;
 		else if (!binder_worklist_empty_ilocked(&proc->todo) &&
@@ -4217,6 +4756,7 @@ retry:
 			node_prio.prio = target_node->min_priority;
 			binder_transaction_priority(current, t, node_prio,
 						    target_node->inherit_rt);
+			binder_latency_delivered(proc, t, target_node);
 			cmd = BR_TRANSACTION;
 		} else {
 			trd->target.ptr = 0;
@@ -4440,6 +4980,7 @@ static struct binder_thread *binder_get_thread_ilocked(
 	atomic_set(&thread->tmp_ref, 0);
 	init_waitqueue_head(&thread->wait);
 	INIT_LIST_HEAD(&thread->todo);
+	init_llist_head(&thread->incoming);
 	rb_link_node(&thread->rb_node, parent, p);
 	rb_insert_color(&thread->rb_node, &proc->threads);
 	thread->looper_need_return = true;
@@ -4495,6 +5036,7 @@ static void binder_free_proc(struct binder_proc *proc)
 static void binder_free_thread(struct binder_thread *thread)
 {
 	BUG_ON(!list_empty(&thread->todo));
+	BUG_ON(!llist_empty(&thread->incoming));
 	binder_stats_deleted(BINDER_STAT_THREAD);
 	binder_proc_dec_tmpref(thread->proc);
 	put_task_struct(thread->task);
@@ -4531,6 +5073,7 @@ static int binder_thread_release(struct binder_proc *proc,
 	} else {
 		__acquire(&t->lock);
 	}
+	binder_drain_thread_incoming_ilocked(thread);
 	thread->is_dead = true;
 
 	while (t) {
@@ -5189,6 +5732,8 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	refcount_inc(&binder_dev->ref);
 	proc->context = &binder_dev->context;
 	binder_alloc_init(&proc->alloc);
+	if (is_binderfs_device(nodp))
+		proc->alloc.prealloc_size = info->mount_opts.prealloc * SZ_1K;
 
 	binder_stats_created(BINDER_STAT_PROC);
 	proc->pid = current->group_leader->pid;
@@ -5608,6 +6153,7 @@ static void print_binder_thread_ilocked(struct seq_file *m,
 			t = NULL;
 		}
 	}
+	binder_drain_thread_incoming_ilocked(thread);
 	list_for_each_entry(w, &thread->todo, entry) {
 		print_binder_work_ilocked(m, thread->proc, "    ",
 					  "    pending transaction", w);
@@ -5769,6 +6315,7 @@ static const char * const binder_command_strings[] = {
 	"BC_DEAD_BINDER_DONE",
 	"BC_TRANSACTION_SG",
 	"BC_REPLY_SG",
+	"BC_TRANSACTION_MULTI",
 };
 
 static const char * const binder_objstat_strings[] = {
@@ -5927,6 +6474,52 @@ int binder_state_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void binder_latency_fill(struct binder_latency_record *rec,
+				const struct binder_latency_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < BINDER_LATENCY_BUCKETS; i++) {
+		rec->queue[i] = atomic_read(&stats->queue.buckets[i]);
+		rec->sched[i] = atomic_read(&stats->sched.buckets[i]);
+		rec->handler[i] = atomic_read(&stats->handler.buckets[i]);
+	}
+}
+
+int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_latency_record rec;
+	struct binder_proc *proc;
+	struct rb_node *n;
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, &binder_procs, proc_node) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = BINDER_LATENCY_RECORD_PROC;
+		rec.pid = proc->pid;
+		binder_latency_fill(&rec, &proc->latency);
+		seq_write(m, &rec, sizeof(rec));
+
+		binder_inner_proc_lock(proc);
+		for (n = rb_first(&proc->nodes); n; n = rb_next(n)) {
+			struct binder_node *node = rb_entry(n, struct binder_node,
+							    rb_node);
+			struct binder_node_latency *lat = READ_ONCE(node->latency);
+
+			if (!lat)
+				continue;
+			rec.type = BINDER_LATENCY_RECORD_NODE;
+			rec.node_debug_id = node->debug_id;
+			binder_latency_fill(&rec, &lat->stats);
+			seq_write(m, &rec, sizeof(rec));
+		}
+		binder_inner_proc_unlock(proc);
+	}
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+
 int binder_stats_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
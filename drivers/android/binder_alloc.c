@@ -66,6 +66,15 @@ static size_t binder_alloc_buffer_size(struct binder_alloc *alloc,
 	return binder_buffer_next(buffer)->user_data - buffer->user_data;
 }
 
+static unsigned int binder_alloc_bin_index(size_t size)
+{
+	if (size >= (1UL << BINDER_ALLOC_BIN_MAX_SHIFT))
+		return BINDER_ALLOC_NR_BINS;
+	if (size < (1UL << BINDER_ALLOC_BIN_MIN_SHIFT))
+		return 0;
+	return ilog2(size) - BINDER_ALLOC_BIN_MIN_SHIFT;
+}
+
 static void binder_insert_free_buffer(struct binder_alloc *alloc,
 				      struct binder_buffer *new_buffer)
 {
@@ -74,6 +83,7 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 	struct binder_buffer *buffer;
 	size_t buffer_size;
 	size_t new_buffer_size;
+	unsigned int bin;
 
 	BUG_ON(!new_buffer->free);
 
@@ -83,6 +93,18 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 		     "%d: add free buffer, size %zd, at %pK\n",
 		      alloc->pid, new_buffer_size, new_buffer);
 
+	bin = binder_alloc_bin_index(new_buffer_size);
+	new_buffer->free_bin = bin;
+	if (bin < BINDER_ALLOC_NR_BINS) {
+		/*
+		 * LIFO so that the most recently freed buffer, whose pages
+		 * are the most likely to still be resident, is reused first.
+		 */
+		list_add(&new_buffer->free_entry, &alloc->free_bins[bin]);
+		__set_bit(bin, &alloc->free_bins_map);
+		return;
+	}
+
 	while (*p) {
 		parent = *p;
 		buffer = rb_entry(parent, struct binder_buffer, rb_node);
@@ -99,6 +121,93 @@ static void binder_insert_free_buffer(struct binder_alloc *alloc,
 	rb_insert_color(&new_buffer->rb_node, &alloc->free_buffers);
 }
 
+/*
+ * Remove a free buffer from its bin or from the free_buffers tree. The
+ * bin recorded at insertion time is used rather than the current size,
+ * since callers may already have merged the buffer with a neighbour.
+ */
+static void binder_erase_free_buffer(struct binder_alloc *alloc,
+				     struct binder_buffer *buffer)
+{
+	unsigned int bin = buffer->free_bin;
+
+	BUG_ON(!buffer->free);
+
+	if (bin < BINDER_ALLOC_NR_BINS) {
+		list_del(&buffer->free_entry);
+		if (list_empty(&alloc->free_bins[bin]))
+			__clear_bit(bin, &alloc->free_bins_map);
+		return;
+	}
+	rb_erase(&buffer->rb_node, &alloc->free_buffers);
+}
+
+/*
+ * Find a free buffer of at least @size bytes. Small requests are served
+ * first-fit from their own size class, then from any buffer of the next
+ * non-empty larger class (all of which are big enough), and only then
+ * from a best-fit walk of the free_buffers tree.
+ */
+static struct binder_buffer *binder_alloc_find_free_buffer(
+				struct binder_alloc *alloc,
+				size_t size,
+				size_t *buffer_sizep)
+{
+	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *best_fit = NULL;
+	struct binder_buffer *buffer;
+	size_t buffer_size;
+	unsigned int bin, next;
+
+	bin = binder_alloc_bin_index(size);
+	if (bin < BINDER_ALLOC_NR_BINS) {
+		list_for_each_entry(buffer, &alloc->free_bins[bin],
+				    free_entry) {
+			buffer_size = binder_alloc_buffer_size(alloc, buffer);
+			if (buffer_size >= size)
+				goto found_in_bin;
+		}
+		next = find_next_bit(&alloc->free_bins_map,
+				     BINDER_ALLOC_NR_BINS, bin + 1);
+		if (next < BINDER_ALLOC_NR_BINS) {
+			buffer = list_first_entry(&alloc->free_bins[next],
+						  struct binder_buffer,
+						  free_entry);
+			buffer_size = binder_alloc_buffer_size(alloc, buffer);
+			goto found_in_bin;
+		}
+		alloc->bin_misses[bin]++;
+	}
+
+	while (n) {
+		buffer = rb_entry(n, struct binder_buffer, rb_node);
+		BUG_ON(!buffer->free);
+		buffer_size = binder_alloc_buffer_size(alloc, buffer);
+
+		if (size < buffer_size) {
+			best_fit = n;
+			n = n->rb_left;
+		} else if (size > buffer_size)
+			n = n->rb_right;
+		else {
+			*buffer_sizep = buffer_size;
+			return buffer;
+		}
+	}
+	if (best_fit == NULL)
+		return NULL;
+
+	buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
+	*buffer_sizep = binder_alloc_buffer_size(alloc, buffer);
+	return buffer;
+
+found_in_bin:
+	BUG_ON(!buffer->free);
+	alloc->bin_hits[bin]++;
+	*buffer_sizep = buffer_size;
+	return buffer;
+}
+
 static void binder_insert_allocated_buffer_locked(
 		struct binder_alloc *alloc, struct binder_buffer *new_buffer)
 {
@@ -179,6 +288,12 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+static inline bool binder_alloc_page_pinned(struct binder_alloc *alloc,
+					    size_t index)
+{
+	return index < alloc->pinned_pages;
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void __user *start, void __user *end)
 {
@@ -233,6 +348,9 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		page = &alloc->pages[index];
 
 		if (page->page_ptr) {
+			if (binder_alloc_page_pinned(alloc, index))
+				continue;
+
 			trace_binder_alloc_lru_start(alloc, index);
 
 			on_lru = list_lru_del(&binder_alloc_lru, &page->lru);
@@ -284,12 +402,16 @@ free_range:
 		index = (page_addr - alloc->buffer) / PAGE_SIZE;
 		page = &alloc->pages[index];
 
+		if (binder_alloc_page_pinned(alloc, index))
+			goto next_free_page;
+
 		trace_binder_free_lru_start(alloc, index);
 
 		ret = list_lru_add(&binder_alloc_lru, &page->lru);
 		WARN_ON(!ret);
 
 		trace_binder_free_lru_end(alloc, index);
+next_free_page:
 		if (page_addr == start)
 			break;
 		continue;
@@ -390,13 +512,13 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				int is_async,
 				int pid)
 {
-	struct rb_node *n = alloc->free_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
 	void __user *has_page_addr;
 	void __user *end_page_addr;
 	size_t size, data_offsets_size;
+	unsigned int bin;
 	int ret;
 
 	if (!binder_alloc_get_vma(alloc)) {
@@ -434,22 +556,8 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	/* Pad 0-size buffers so they get assigned unique addresses */
 	size = max(size, sizeof(void *));
 
-	while (n) {
-		buffer = rb_entry(n, struct binder_buffer, rb_node);
-		BUG_ON(!buffer->free);
-		buffer_size = binder_alloc_buffer_size(alloc, buffer);
-
-		if (size < buffer_size) {
-			best_fit = n;
-			n = n->rb_left;
-		} else if (size > buffer_size)
-			n = n->rb_right;
-		else {
-			best_fit = n;
-			break;
-		}
-	}
-	if (best_fit == NULL) {
+	buffer = binder_alloc_find_free_buffer(alloc, size, &buffer_size);
+	if (buffer == NULL) {
 		size_t allocated_buffers = 0;
 		size_t largest_alloc_size = 0;
 		size_t total_alloc_size = 0;
@@ -475,6 +583,17 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 			if (buffer_size > largest_free_size)
 				largest_free_size = buffer_size;
 		}
+		for (bin = 0; bin < BINDER_ALLOC_NR_BINS; bin++) {
+			list_for_each_entry(buffer, &alloc->free_bins[bin],
+					    free_entry) {
+				buffer_size = binder_alloc_buffer_size(alloc,
+								       buffer);
+				free_buffers++;
+				total_free_size += buffer_size;
+				if (buffer_size > largest_free_size)
+					largest_free_size = buffer_size;
+			}
+		}
 		binder_alloc_debug(BINDER_DEBUG_USER_ERROR,
 				   "%d: binder_alloc_buf size %zd failed, no address space\n",
 				   alloc->pid, size);
@@ -485,10 +604,6 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 				   free_buffers, largest_free_size);
 		return ERR_PTR(-ENOSPC);
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_alloc_buffer_size(alloc, buffer);
-	}
 
 	binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "%d: binder_alloc_buf size %zd got buffer %pK size %zd\n",
@@ -496,7 +611,6 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 
 	has_page_addr = (void __user *)
 		(((uintptr_t)buffer->user_data + buffer_size) & PAGE_MASK);
-	WARN_ON(n && buffer_size != size);
 	end_page_addr =
 		(void __user *)PAGE_ALIGN((uintptr_t)buffer->user_data + size);
 	if (end_page_addr > has_page_addr)
@@ -521,7 +635,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 		binder_insert_free_buffer(alloc, new_buffer);
 	}
 
-	rb_erase(best_fit, &alloc->free_buffers);
+	binder_erase_free_buffer(alloc, buffer);
 	buffer->free = 0;
 	buffer->allow_user_free = 0;
 	binder_insert_allocated_buffer_locked(alloc, buffer);
@@ -691,7 +805,7 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 		struct binder_buffer *next = binder_buffer_next(buffer);
 
 		if (next->free) {
-			rb_erase(&next->rb_node, &alloc->free_buffers);
+			binder_erase_free_buffer(alloc, next);
 			binder_delete_free_buffer(alloc, next);
 		}
 	}
@@ -700,7 +814,7 @@ static void binder_free_buf_locked(struct binder_alloc *alloc,
 
 		if (prev->free) {
 			binder_delete_free_buffer(alloc, buffer);
-			rb_erase(&prev->rb_node, &alloc->free_buffers);
+			binder_erase_free_buffer(alloc, prev);
 			buffer = prev;
 		}
 	}
@@ -736,6 +850,58 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 	mutex_unlock(&alloc->mutex);
 }
 
+/**
+ * binder_alloc_prealloc_pages() - populate the pinned head of the mapping
+ * @alloc:	alloc structure for this proc
+ * @vma:	vma passed to mmap()
+ *
+ * Allocates and maps the first @alloc->prealloc_size bytes of the
+ * mapping so that early transactions do not have to allocate pages.
+ * These pages are never put on binder_alloc_lru, so the shrinker never
+ * reclaims them; they are released in binder_alloc_deferred_release().
+ * This is best effort: on failure only the pages mapped so far stay
+ * pinned and the remainder is handled on demand as usual.
+ *
+ * Called with the mmap lock held for writing, before the vma is
+ * published to the allocator.
+ */
+static void binder_alloc_prealloc_pages(struct binder_alloc *alloc,
+					struct vm_area_struct *vma)
+{
+	struct binder_lru_page *page;
+	size_t index, nr_pages;
+	int ret;
+
+	nr_pages = min(alloc->prealloc_size, alloc->buffer_size) / PAGE_SIZE;
+
+	mutex_lock(&alloc->mutex);
+	for (index = 0; index < nr_pages; index++) {
+		page = &alloc->pages[index];
+		page->page_ptr = alloc_page(GFP_KERNEL |
+					    __GFP_HIGHMEM |
+					    __GFP_ZERO);
+		if (!page->page_ptr)
+			break;
+		page->alloc = alloc;
+		INIT_LIST_HEAD(&page->lru);
+
+		ret = vm_insert_page(vma, (uintptr_t)alloc->buffer +
+				     index * PAGE_SIZE, page->page_ptr);
+		if (ret) {
+			__free_page(page->page_ptr);
+			page->page_ptr = NULL;
+			break;
+		}
+	}
+	if (index < nr_pages)
+		binder_alloc_debug(BINDER_DEBUG_USER_ERROR,
+				   "%d: prealloc stopped at page %zu of %zu\n",
+				   alloc->pid, index, nr_pages);
+	alloc->pinned_pages = index;
+	alloc->pages_high = index;
+	mutex_unlock(&alloc->mutex);
+}
+
 /**
  * binder_alloc_mmap_handler() - map virtual address space for proc
  * @alloc:	alloc structure for this proc
@@ -789,6 +955,8 @@ int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 	buffer->free = 1;
 	binder_insert_free_buffer(alloc, buffer);
 	alloc->free_async_space = alloc->buffer_size / 2;
+	if (alloc->prealloc_size)
+		binder_alloc_prealloc_pages(alloc, vma);
 	binder_alloc_set_vma(alloc, vma);
 	mmgrab(alloc->vma_vm_mm);
 
@@ -907,6 +1075,39 @@ void binder_alloc_print_allocated(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 }
 
+/**
+ * binder_alloc_print_bins() - print size-class bin usage
+ * @m:     seq_file for output via seq_printf()
+ * @alloc: binder_alloc for this proc
+ *
+ * Prints the number of free buffers and the allocation hit/miss counts
+ * of every size-class bin that has seen any use.
+ */
+static void binder_alloc_print_bins(struct seq_file *m,
+				    struct binder_alloc *alloc)
+{
+	struct binder_buffer *buffer;
+	unsigned long hits, misses;
+	unsigned int bin;
+	int free;
+
+	mutex_lock(&alloc->mutex);
+	for (bin = 0; bin < BINDER_ALLOC_NR_BINS; bin++) {
+		hits = alloc->bin_hits[bin];
+		misses = alloc->bin_misses[bin];
+		free = 0;
+		list_for_each_entry(buffer, &alloc->free_bins[bin], free_entry)
+			free++;
+		if (!hits && !misses && !free)
+			continue;
+		seq_printf(m, "  bin %lu-%lu: free %d hits %lu misses %lu\n",
+			   1UL << (bin + BINDER_ALLOC_BIN_MIN_SHIFT),
+			   (1UL << (bin + BINDER_ALLOC_BIN_MIN_SHIFT + 1)) - 1,
+			   free, hits, misses);
+	}
+	mutex_unlock(&alloc->mutex);
+}
+
 /**
  * binder_alloc_print_pages() - print page usage
  * @m:     seq_file for output via seq_printf()
@@ -940,6 +1141,9 @@ void binder_alloc_print_pages(struct seq_file *m,
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
+	if (alloc->pinned_pages)
+		seq_printf(m, "  pages pinned: %zu\n", alloc->pinned_pages);
+	binder_alloc_print_bins(m, alloc);
 }
 
 /**
@@ -1080,9 +1284,13 @@ static struct shrinker binder_shrinker = {
  */
 void binder_alloc_init(struct binder_alloc *alloc)
 {
+	int i;
+
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	for (i = 0; i < BINDER_ALLOC_NR_BINS; i++)
+		INIT_LIST_HEAD(&alloc->free_bins[i]);
 }
 
 int binder_alloc_shrinker_init(void)
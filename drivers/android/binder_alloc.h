@@ -18,10 +18,23 @@
 extern struct list_lru binder_alloc_lru;
 struct binder_transaction;
 
+/*
+ * Free buffers smaller than 1 << BINDER_ALLOC_BIN_MAX_SHIFT bytes are kept
+ * on segregated power-of-two size-class lists instead of the free_buffers
+ * rb tree. Bin i holds buffers of size
+ * [1 << (i + BINDER_ALLOC_BIN_MIN_SHIFT), 1 << (i + BINDER_ALLOC_BIN_MIN_SHIFT + 1))
+ */
+#define BINDER_ALLOC_BIN_MIN_SHIFT	3
+#define BINDER_ALLOC_BIN_MAX_SHIFT	14
+#define BINDER_ALLOC_NR_BINS \
+	(BINDER_ALLOC_BIN_MAX_SHIFT - BINDER_ALLOC_BIN_MIN_SHIFT)
+
 /**
  * struct binder_buffer - buffer used for binder transactions
  * @entry:              entry alloc->buffers
  * @rb_node:            node for allocated_buffers/free_buffers rb trees
+ * @free_entry:         entry in alloc->free_bins[@free_bin] for small
+ *                      free buffers (shares storage with @rb_node)
  * @free:               %true if buffer is free
  * @clear_on_free:      %true if buffer must be zeroed after use
  * @allow_user_free:    %true if user is allowed to free buffer
@@ -29,6 +42,8 @@ struct binder_transaction;
  * @oneway_spam_suspect: %true if total async allocate size just exceed
  * spamming detect threshold
  * @debug_id:           unique ID for debugging
+ * @free_bin:           size-class bin holding this free buffer, or
+ *                      %BINDER_ALLOC_NR_BINS if it is in free_buffers
  * @transaction:        pointer to associated struct binder_transaction
  * @target_node:        struct binder_node associated with this buffer
  * @data_size:          size of @transaction data
@@ -41,14 +56,18 @@ struct binder_transaction;
  */
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by address */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head free_entry; /* small free entry by bin */
+	};
 	unsigned free:1;
 	unsigned clear_on_free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
 	unsigned oneway_spam_suspect:1;
 	unsigned debug_id:27;
+	u8 free_bin;
 
 	struct binder_transaction *transaction;
 
@@ -81,8 +100,14 @@ struct binder_lru_page {
  * @vma_vm_mm:          copy of vma->vm_mm (invarient after mmap)
  * @buffer:             base of per-proc address space mapped via mmap
  * @buffers:            list of all buffers for this proc
- * @free_buffers:       rb tree of buffers available for allocation
+ * @free_buffers:       rb tree of large buffers available for allocation
  *                      sorted by size
+ * @free_bins:          lists of small free buffers, one per size class
+ * @free_bins_map:      bitmap of non-empty @free_bins
+ * @bin_hits:           per size class count of allocations served from
+ *                      @free_bins
+ * @bin_misses:         per size class count of allocations that had to
+ *                      fall back to @free_buffers
  * @allocated_buffers:  rb tree of allocated buffers sorted by address
  * @free_async_space:   VA space available for async buffers. This is
  *                      initialized at mmap time to 1/2 the full VA space
@@ -90,6 +115,11 @@ struct binder_lru_page {
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @prealloc_size:      bytes at the start of the mapping to populate at
+ *                      mmap time and keep away from the shrinker
+ *                      (invariant after init)
+ * @pinned_pages:       number of pages at the start of @pages populated
+ *                      because of @prealloc_size (invariant after mmap)
  * @oneway_spam_detected: %true if oneway spam detection fired, clear that
  * flag once the async buffer has returned to a healthy state
  *
@@ -105,6 +135,10 @@ struct binder_alloc {
 	void __user *buffer;
 	struct list_head buffers;
 	struct rb_root free_buffers;
+	struct list_head free_bins[BINDER_ALLOC_NR_BINS];
+	unsigned long free_bins_map;
+	unsigned long bin_hits[BINDER_ALLOC_NR_BINS];
+	unsigned long bin_misses[BINDER_ALLOC_NR_BINS];
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 	struct binder_lru_page *pages;
@@ -112,6 +146,8 @@ struct binder_alloc {
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	size_t prealloc_size;
+	size_t pinned_pages;
 	bool oneway_spam_detected;
 };
 
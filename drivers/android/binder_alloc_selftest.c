@@ -287,7 +287,8 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 	if (!binder_selftest_run)
 		return;
 	mutex_lock(&binder_selftest_lock);
-	if (!binder_selftest_run || !alloc->vma)
+	/* Pinned pages never go to the lru, which the checks rely on */
+	if (!binder_selftest_run || !alloc->vma || alloc->pinned_pages)
 		goto done;
 	pr_info("STARTED\n");
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
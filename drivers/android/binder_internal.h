@@ -5,7 +5,9 @@
 
 #include <linux/export.h>
 #include <linux/fs.h>
+#include <linux/kref.h>
 #include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/miscdevice.h>
 #include <linux/mutex.h>
 #include <linux/refcount.h>
@@ -43,10 +45,13 @@ struct binder_device {
  * binderfs_mount_opts - mount options for binderfs
  * @max: maximum number of allocatable binderfs binder devices
  * @stats_mode: enable binder stats in binderfs.
+ * @prealloc: KiB at the start of each binder mmap to populate at mmap time
+ *            and keep resident.
  */
 struct binderfs_mount_opts {
 	int max;
 	int stats_mode;
+	int prealloc;
 };
 
 /**
@@ -119,6 +124,9 @@ DEFINE_SHOW_ATTRIBUTE(binder_transactions);
 int binder_transaction_log_show(struct seq_file *m, void *unused);
 DEFINE_SHOW_ATTRIBUTE(binder_transaction_log);
 
+int binder_latency_show(struct seq_file *m, void *unused);
+DEFINE_SHOW_ATTRIBUTE(binder_latency);
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int debug_id_done;
@@ -143,6 +151,121 @@ struct binder_transaction_log {
 	struct binder_transaction_log_entry entry[32];
 };
 
+/**
+ * struct binder_transaction_multi - batch of one-way transactions
+ * @count:     number of entries in @txns
+ * @txns:      userspace pointer to an array of @count
+ *             struct binder_transaction_data, all with TF_ONE_WAY set
+ *
+ * Payload of BC_TRANSACTION_MULTI. The command extends enum
+ * binder_driver_command_protocol in uapi/linux/android/binder.h.
+ */
+struct binder_transaction_multi {
+	binder_size_t		count;
+	binder_uintptr_t	txns;
+};
+
+enum {
+	BC_TRANSACTION_MULTI = _IOW('c', 19, struct binder_transaction_multi),
+};
+
+/**
+ * struct binder_blob_object - large payload passed out of line
+ * @hdr:       common header, type BINDER_TYPE_BLOB
+ * @fd:        fd of the blob in the receiver, filled in by the driver
+ * @buffer:    address of the payload in the sender
+ * @length:    length of the payload in bytes
+ *
+ * Payloads too large for the binder buffer (bitmaps, blobs) are copied
+ * once into an anonymous shmem file owned by the receiver, which gets
+ * it as @fd and can mmap() it. The payload doesn't consume binder
+ * buffer or async space in the receiver.
+ */
+struct binder_blob_object {
+	struct binder_object_header	hdr;
+	__u32				fd;
+	binder_uintptr_t		buffer;
+	binder_size_t			length;
+};
+
+enum {
+	BINDER_TYPE_BLOB = B_PACK_CHARS('b', 'l', '*', B_TYPE_LARGE),
+};
+
+/* Upper bound on the length of a single BINDER_TYPE_BLOB payload */
+#define BINDER_BLOB_MAX_SIZE	SZ_256M
+
+/* Upper bound on the entries of a single BC_TRANSACTION_MULTI */
+#define BINDER_TRANSACTION_MULTI_MAX	256
+
+#define BINDER_LATENCY_BUCKETS	24
+
+/**
+ * struct binder_latency_hist - log2 histogram of transaction latencies
+ * @buckets:   bucket 0 counts samples below 1us, bucket i counts samples
+ *             in [2^(i-1), 2^i) us; the last bucket also counts all
+ *             longer samples
+ */
+struct binder_latency_hist {
+	atomic_t buckets[BINDER_LATENCY_BUCKETS];
+};
+
+/**
+ * struct binder_latency_stats - latency of transactions to a proc or node
+ * @queue:     from BC_TRANSACTION until the transaction is handed to the
+ *             target proc and a thread is woken
+ * @sched:     from the hand-off until a target thread returns it as
+ *             BR_TRANSACTION
+ * @handler:   from BR_TRANSACTION until the matching BC_REPLY
+ *             (synchronous transactions only)
+ */
+struct binder_latency_stats {
+	struct binder_latency_hist queue;
+	struct binder_latency_hist sched;
+	struct binder_latency_hist handler;
+};
+
+/**
+ * struct binder_node_latency - latency statistics of a binder_node
+ * @kref:      held by the node and by each transaction delivered to the
+ *             node that is still waiting for its reply
+ * @stats:     the statistics
+ *
+ * Allocated on the first transaction delivered to the node.
+ */
+struct binder_node_latency {
+	struct kref kref;
+	struct binder_latency_stats stats;
+};
+
+enum {
+	BINDER_LATENCY_RECORD_PROC = 1,
+	BINDER_LATENCY_RECORD_NODE,
+};
+
+/**
+ * struct binder_latency_record - record in binder_logs/latency
+ * @type:          BINDER_LATENCY_RECORD_PROC or BINDER_LATENCY_RECORD_NODE
+ * @pid:           pid of the proc that received the transactions
+ * @node_debug_id: debug id of the node, 0 for proc records
+ * @reserved:      must be 0
+ * @queue:         queue histogram, see struct binder_latency_stats
+ * @sched:         scheduling histogram
+ * @handler:       handler histogram
+ *
+ * binder_logs/latency is a sequence of these records: one per proc,
+ * followed by one for each of its nodes that has received transactions.
+ */
+struct binder_latency_record {
+	__u32 type;
+	__u32 pid;
+	__u32 node_debug_id;
+	__u32 reserved;
+	__u32 queue[BINDER_LATENCY_BUCKETS];
+	__u32 sched[BINDER_LATENCY_BUCKETS];
+	__u32 handler[BINDER_LATENCY_BUCKETS];
+};
+
 enum binder_stat_types {
 	BINDER_STAT_PROC,
 	BINDER_STAT_THREAD,
@@ -156,7 +279,7 @@ enum binder_stat_types {
 
 struct binder_stats {
 	atomic_t br[_IOC_NR(BR_ONEWAY_SPAM_SUSPECT) + 1];
-	atomic_t bc[_IOC_NR(BC_REPLY_SG) + 1];
+	atomic_t bc[_IOC_NR(BC_TRANSACTION_MULTI) + 1];
 	atomic_t obj_created[BINDER_STAT_COUNT];
 	atomic_t obj_deleted[BINDER_STAT_COUNT];
 };
@@ -164,12 +287,14 @@ struct binder_stats {
 /**
  * struct binder_work - work enqueued on a worklist
  * @entry:             node enqueued on list
+ * @llnode:            node enqueued on &binder_thread->incoming
  * @type:              type of work to be performed
  *
  * There are separate work lists for proc, thread, and node (async).
  */
 struct binder_work {
 	struct list_head entry;
+	struct llist_node llnode;
 
 	enum binder_work_type {
 		BINDER_WORK_TRANSACTION = 1,
@@ -248,6 +373,8 @@ struct binder_error {
  *                        (invariant after initialized)
  * @async_todo:           list of async work items
  *                        (protected by @proc->inner_lock)
+ * @latency:              latency statistics, NULL until the first
+ *                        transaction is delivered (set once, cmpxchg)
  *
  * Bookkeeping structure for binder nodes.
  */
@@ -289,6 +416,7 @@ struct binder_node {
 	};
 	bool has_async_transaction;
 	struct list_head async_todo;
+	struct binder_node_latency *latency;
 };
 
 struct binder_ref_death {
@@ -354,17 +482,34 @@ struct binder_ref {
 /**
  * struct binder_priority - scheduler policy and priority
  * @sched_policy            scheduler policy
- * @prio                    [100..139] for SCHED_NORMAL, [0..99] for FIFO/RT
+ * @prio                    [100..139] for SCHED_NORMAL, [0..99] for FIFO/RT,
+ *                          -1 for SCHED_DEADLINE
+ * @dl_runtime              SCHED_DEADLINE runtime in ns
+ * @dl_deadline             SCHED_DEADLINE relative deadline in ns
+ * @dl_period               SCHED_DEADLINE period in ns
+ * @has_uclamp              @uclamp_min and @uclamp_max are to be applied
+ * @uclamp_min              requested minimum utilization clamp
+ * @uclamp_max              requested maximum utilization clamp
  *
  * The binder driver supports inheriting the following scheduler policies:
  * SCHED_NORMAL
  * SCHED_BATCH
  * SCHED_FIFO
  * SCHED_RR
+ * SCHED_DEADLINE (synchronous transactions only)
+ *
+ * and, with CONFIG_UCLAMP_TASK, the utilization clamps requested by the
+ * caller.
  */
 struct binder_priority {
 	unsigned int sched_policy;
 	int prio;
+	u64 dl_runtime;
+	u64 dl_deadline;
+	u64 dl_period;
+	bool has_uclamp;
+	unsigned int uclamp_min;
+	unsigned int uclamp_max;
 };
 
 /**
@@ -409,6 +554,8 @@ struct binder_priority {
  *                        (protected by @inner_lock)
  * @stats:                per-process binder statistics
  *                        (atomics, no lock needed)
+ * @latency:              latency of transactions received by this process
+ *                        (atomics, no lock needed)
  * @delivered_death:      list of delivered death notification
  *                        (protected by @inner_lock)
  * @max_threads:          cap on number of binder threads
@@ -456,6 +603,7 @@ struct binder_proc {
 
 	struct list_head todo;
 	struct binder_stats stats;
+	struct binder_latency_stats latency;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
@@ -491,6 +639,9 @@ struct binder_proc {
  *                        (protected by @proc->inner_lock)
  * @process_todo:         whether work in @todo should be processed
  *                        (protected by @proc->inner_lock)
+ * @incoming:             lock-free list of work queued by this thread to
+ *                        itself; moved to @todo under @proc->inner_lock
+ *                        (producer is this thread, no lock needed)
  * @return_error:         transaction errors reported by this thread
  *                        (only accessed by this thread)
  * @reply_error:          transaction errors reported by target thread
@@ -518,6 +669,7 @@ struct binder_thread {
 	struct binder_transaction *transaction_stack;
 	struct list_head todo;
 	bool process_todo;
+	struct llist_head incoming;
 	struct binder_error return_error;
 	struct binder_error reply_error;
 	wait_queue_head_t wait;
@@ -564,6 +716,17 @@ struct binder_transaction {
 	kuid_t	sender_euid;
 	struct list_head fd_fixups;
 	binder_uintptr_t security_ctx;
+	/**
+	 * @start_ns:     when the transaction was submitted
+	 * @wakeup_ns:    when it was handed to the target proc, 0 if not yet
+	 * @deliver_ns:   when a target thread returned it to user-space
+	 * @node_latency: latency stats of the target node, referenced from
+	 *                delivery until the reply for sync transactions
+	 */
+	u64 start_ns;
+	u64 wakeup_ns;
+	u64 deliver_ns;
+	struct binder_node_latency *node_latency;
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -582,6 +745,7 @@ struct binder_transaction {
  * @fdo:   file descriptor object
  * @bbo:   binder buffer pointer
  * @fdao:  file descriptor array
+ * @blob:  out-of-line payload
  *
  * Used for type-independent object copies
  */
@@ -592,6 +756,7 @@ struct binder_object {
 		struct binder_fd_object fdo;
 		struct binder_buffer_object bbo;
 		struct binder_fd_array_object fdao;
+		struct binder_blob_object blob;
 	};
 };
 
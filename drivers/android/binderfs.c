@@ -22,6 +22,7 @@
 #include <linux/radix-tree.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/spinlock_types.h>
 #include <linux/stddef.h>
@@ -51,6 +52,7 @@ static DEFINE_IDA(binderfs_minors);
 enum binderfs_param {
 	Opt_max,
 	Opt_stats_mode,
+	Opt_prealloc,
 };
 
 enum binderfs_stats_mode {
@@ -66,6 +68,7 @@ static const struct constant_table binderfs_param_stats[] = {
 static const struct fs_parameter_spec binderfs_fs_parameters[] = {
 	fsparam_u32("max",	Opt_max),
 	fsparam_enum("stats",	Opt_stats_mode, binderfs_param_stats),
+	fsparam_u32("prealloc",	Opt_prealloc),
 	{}
 };
 
@@ -292,6 +295,16 @@ static int binderfs_fs_context_parse_param(struct fs_context *fc,
 
 		ctx->stats_mode = result.uint_32;
 		break;
+	case Opt_prealloc:
+		/* Pinned pages are exempt from the shrinker */
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+
+		if (result.uint_32 > SZ_4M / SZ_1K)
+			return invalfc(fc, "Bad value for '%s'", param->key);
+
+		ctx->prealloc = result.uint_32;
+		break;
 	default:
 		return invalfc(fc, "Unsupported parameter '%s'", param->key);
 	}
@@ -309,6 +322,7 @@ static int binderfs_fs_context_reconfigure(struct fs_context *fc)
 
 	info->mount_opts.stats_mode = ctx->stats_mode;
 	info->mount_opts.max = ctx->max;
+	info->mount_opts.prealloc = ctx->prealloc;
 	return 0;
 }
 
@@ -327,6 +341,9 @@ static int binderfs_show_options(struct seq_file *seq, struct dentry *root)
 		break;
 	}
 
+	if (info->mount_opts.prealloc)
+		seq_printf(seq, ",prealloc=%d", info->mount_opts.prealloc);
+
 	return 0;
 }
 
@@ -633,6 +650,13 @@ static int init_binder_logs(struct super_block *sb)
 		goto out;
 	}
 
+	dentry = binderfs_create_file(binder_logs_root_dir, "latency",
+				      &binder_latency_fops, NULL);
+	if (IS_ERR(dentry)) {
+		ret = PTR_ERR(dentry);
+		goto out;
+	}
+
 	proc_log_dir = binderfs_create_dir(binder_logs_root_dir, "proc");
 	if (IS_ERR(proc_log_dir)) {
 		ret = PTR_ERR(proc_log_dir);
@@ -690,6 +714,7 @@ static int binderfs_fill_super(struct super_block *sb, struct fs_context *fc)
 		info->root_uid = GLOBAL_ROOT_UID;
 	info->mount_opts.max = ctx->max;
 	info->mount_opts.stats_mode = ctx->stats_mode;
+	info->mount_opts.prealloc = ctx->prealloc;
 
 	inode = new_inode(sb);
 	if (!inode)
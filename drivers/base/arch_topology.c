@@ -593,6 +593,57 @@ __weak int __init parse_acpi_topology(void)
 	return 0;
 }
 
+/**
+ * topology_apply_hints - replace the CPU topology with hypervisor hints
+ * @hints: topology of each CPU, indexed by logical CPU number
+ * @nr: number of entries in @hints
+ *
+ * Virtual machines are commonly described by their firmware as flat
+ * vCPUs, while the hypervisor knows which of them share a core, a cache or
+ * a package. The capacities in @hints are relative and get normalized so
+ * that the biggest CPU has SCHED_CAPACITY_SCALE.
+ *
+ * Must be called before the secondary CPUs are brought up: they keep the
+ * hinted ids in store_cpu_topology(), and the sched domains are built from
+ * the result.
+ */
+int __init topology_apply_hints(const struct cpu_topology_hint *hints,
+				unsigned int nr)
+{
+	unsigned long max_capacity = 0;
+	unsigned int cpu;
+
+	if (nr < nr_cpu_ids)
+		return -EINVAL;
+
+	for_each_possible_cpu(cpu) {
+		if (hints[cpu].package_id < 0 || hints[cpu].core_id < 0)
+			return -EINVAL;
+		max_capacity = max(max_capacity, hints[cpu].capacity);
+	}
+
+	for_each_online_cpu(cpu)
+		remove_cpu_topology(cpu);
+
+	for_each_possible_cpu(cpu) {
+		struct cpu_topology *cpu_topo = &cpu_topology[cpu];
+
+		cpu_topo->thread_id = hints[cpu].thread_id;
+		cpu_topo->core_id = hints[cpu].core_id;
+		cpu_topo->package_id = hints[cpu].package_id;
+		cpu_topo->llc_id = hints[cpu].llc_id;
+
+		if (hints[cpu].capacity)
+			topology_set_cpu_scale(cpu, hints[cpu].capacity *
+					       SCHED_CAPACITY_SCALE / max_capacity);
+	}
+
+	for_each_online_cpu(cpu)
+		update_siblings_masks(cpu);
+
+	return 0;
+}
+
 #if defined(CONFIG_ARM64) || defined(CONFIG_RISCV)
 void __init init_cpu_topology(void)
 {
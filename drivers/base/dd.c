@@ -25,6 +25,7 @@
 #include <linux/kthread.h>
 #include <linux/wait.h>
 #include <linux/async.h>
+#include <linux/boot_trace.h>
 #include <linux/pm_runtime.h>
 #include <linux/pinctrl/devinfo.h>
 #include <linux/slab.h>
@@ -727,6 +728,7 @@ EXPORT_SYMBOL_GPL(wait_for_device_probe);
 int driver_probe_device(struct device_driver *drv, struct device *dev)
 {
 	int ret = 0;
+	u64 start;
 
 	if (!device_is_registered(dev))
 		return -ENODEV;
@@ -739,10 +741,17 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 		pm_runtime_get_sync(dev->parent);
 
 	pm_runtime_barrier(dev);
+	start = boot_trace_start();
 	if (initcall_debug)
 		ret = really_probe_debug(dev, drv);
 	else
 		ret = really_probe(dev, drv);
+	if (start) {
+		char name[BOOT_TRACE_NAME_LEN];
+
+		snprintf(name, sizeof(name), "%s %s", drv->name, dev_name(dev));
+		boot_trace_end(BOOT_TRACE_PROBE, start, name);
+	}
 	pm_request_idle(dev);
 
 	if (dev->parent)
@@ -26,6 +26,12 @@ enum {
 
 struct loop_func_table;
 
+/* One worker per hardware queue, so queues don't wait on each other */
+struct loop_worker {
+	struct kthread_worker	worker;
+	struct task_struct	*task;
+};
+
 struct loop_device {
 	int		lo_number;
 	atomic_t	lo_refcnt;
@@ -54,9 +60,11 @@ struct loop_device {
 
 	spinlock_t		lo_lock;
 	int			lo_state;
-	struct kthread_worker	worker;
-	struct task_struct	*worker_task;
+	struct mutex		lo_mutex;
+	struct loop_worker	*workers;
+	unsigned int		nr_workers;
 	bool			use_dio;
+	bool			auto_dio;
 	bool			sysfs_inited;
 
 	struct request_queue	*lo_queue;
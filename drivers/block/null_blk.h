@@ -20,6 +20,7 @@ struct nullb_cmd {
 	blk_status_t error;
 	struct nullb_queue *nq;
 	struct hrtimer timer;
+	u64 issue_ns; /* only set with the latency model */
 	bool fake_timeout;
 };
 
@@ -67,6 +68,14 @@ struct nullb_device {
 	unsigned int hw_queue_depth; /* queue depth */
 	unsigned int index; /* index of the disk, only valid with a disk */
 	unsigned int mbps; /* Bandwidth throttle cap (in MB/s) */
+	unsigned long read_nsec; /* read latency, completion_nsec if 0 */
+	unsigned long write_nsec; /* write latency, completion_nsec if 0 */
+	unsigned long flush_nsec; /* flush latency, completion_nsec if 0 */
+	unsigned long nsec_per_kb; /* extra latency per KiB of data */
+	unsigned long tail_nsec; /* latency of the slow mode */
+	unsigned int tail_pct; /* percentage of requests in the slow mode */
+	unsigned int jitter_pct; /* uniform jitter around the latency */
+	unsigned int internal_depth; /* requests served at once, 0 = any */
 	bool blocking; /* blocking blk-mq device */
 	bool use_per_node_hctx; /* use per-node allocation for hardware context */
 	bool power; /* power on/off the device */
@@ -89,6 +98,15 @@ struct nullb {
 	unsigned long cache_flush_pos;
 	spinlock_t lock;
 
+	/* Latency model, see null_lat_delay() */
+	bool lat_model;
+	spinlock_t lat_lock;
+	u64 *lat_busy_until;
+	u64 lat_win_start;
+	u64 lat_win_ios;
+	u64 lat_win_sum;
+	u64 lat_win_max;
+
 	struct nullb_queue *queues;
 	unsigned int nr_queues;
 	char disk_name[DISK_NAME_LEN];
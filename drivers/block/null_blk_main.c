@@ -9,8 +9,12 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/init.h>
+#include <linux/prandom.h>
 #include "null_blk.h"
 
+#define CREATE_TRACE_POINTS
+#include "null_blk_trace.h"
+
 #define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
 #define SECTOR_MASK		(PAGE_SECTORS - 1)
@@ -361,6 +365,14 @@ NULLB_DEVICE_ATTR(zone_capacity, ulong, NULL);
 NULLB_DEVICE_ATTR(zone_nr_conv, uint, NULL);
 NULLB_DEVICE_ATTR(zone_max_open, uint, NULL);
 NULLB_DEVICE_ATTR(zone_max_active, uint, NULL);
+NULLB_DEVICE_ATTR(read_nsec, ulong, NULL);
+NULLB_DEVICE_ATTR(write_nsec, ulong, NULL);
+NULLB_DEVICE_ATTR(flush_nsec, ulong, NULL);
+NULLB_DEVICE_ATTR(nsec_per_kb, ulong, NULL);
+NULLB_DEVICE_ATTR(tail_nsec, ulong, NULL);
+NULLB_DEVICE_ATTR(tail_pct, uint, NULL);
+NULLB_DEVICE_ATTR(jitter_pct, uint, NULL);
+NULLB_DEVICE_ATTR(internal_depth, uint, NULL);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -480,6 +492,14 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_zone_nr_conv,
 	&nullb_device_attr_zone_max_open,
 	&nullb_device_attr_zone_max_active,
+	&nullb_device_attr_read_nsec,
+	&nullb_device_attr_write_nsec,
+	&nullb_device_attr_flush_nsec,
+	&nullb_device_attr_nsec_per_kb,
+	&nullb_device_attr_tail_nsec,
+	&nullb_device_attr_tail_pct,
+	&nullb_device_attr_jitter_pct,
+	&nullb_device_attr_internal_depth,
 	NULL,
 };
 
@@ -533,7 +553,7 @@ nullb_group_drop_item(struct config_group *group, struct config_item *item)
 static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
 	return snprintf(page, PAGE_SIZE,
-			"memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,zone_capacity,zone_nr_conv,zone_max_open,zone_max_active\n");
+			"memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,zone_capacity,zone_nr_conv,zone_max_open,zone_max_active,latency_model\n");
 }
 
 CONFIGFS_ATTR_RO(memb_group_, features);
@@ -700,17 +720,128 @@ static void end_cmd(struct nullb_cmd *cmd)
 	free_cmd(cmd);
 }
 
+/*
+ * Service time of one command: a per-operation base latency plus a size
+ * dependent part, optionally replaced by the slow mode of a bimodal
+ * distribution, with uniform jitter on top.
+ */
+static u64 null_cmd_latency(struct nullb_cmd *cmd)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	unsigned int bytes;
+	enum req_opf op;
+	u64 lat, span;
+
+	if (dev->queue_mode == NULL_Q_BIO) {
+		op = bio_op(cmd->bio);
+		bytes = cmd->bio->bi_iter.bi_size;
+	} else {
+		op = req_op(cmd->rq);
+		bytes = blk_rq_bytes(cmd->rq);
+	}
+
+	switch (op) {
+	case REQ_OP_READ:
+		lat = dev->read_nsec;
+		break;
+	case REQ_OP_WRITE:
+		lat = dev->write_nsec;
+		break;
+	case REQ_OP_FLUSH:
+		lat = dev->flush_nsec;
+		break;
+	default:
+		lat = 0;
+		break;
+	}
+	if (!lat)
+		lat = dev->completion_nsec;
+	lat += (u64)dev->nsec_per_kb * (bytes >> 10);
+
+	if (dev->tail_pct && prandom_u32_max(100) < dev->tail_pct)
+		lat = dev->tail_nsec;
+
+	if (dev->jitter_pct) {
+		span = min_t(u64, div_u64(lat * dev->jitter_pct, 100),
+			     U32_MAX / 2);
+		lat = lat - span + prandom_u32_max(2 * span + 1);
+	}
+
+	return lat;
+}
+
+/*
+ * With internal_depth set the device only serves that many commands at
+ * a time, the rest wait for the earliest slot to free up, so latency
+ * grows once the queue depth saturates the device.
+ */
+static ktime_t null_lat_delay(struct nullb *nullb, struct nullb_cmd *cmd)
+{
+	unsigned int depth = nullb->dev->internal_depth;
+	u64 now = ktime_get_ns();
+	u64 lat = null_cmd_latency(cmd);
+	unsigned long flags;
+	unsigned int i, slot = 0;
+	u64 start;
+
+	if (!depth)
+		return lat;
+
+	spin_lock_irqsave(&nullb->lat_lock, flags);
+	for (i = 1; i < depth; i++)
+		if (nullb->lat_busy_until[i] < nullb->lat_busy_until[slot])
+			slot = i;
+	start = max(now, nullb->lat_busy_until[slot]);
+	nullb->lat_busy_until[slot] = start + lat;
+	spin_unlock_irqrestore(&nullb->lat_lock, flags);
+
+	return start + lat - now;
+}
+
+/* Summarize achieved IOPS and latency once per second of completions */
+static void null_lat_account(struct nullb *nullb, struct nullb_cmd *cmd)
+{
+	u64 now = ktime_get_ns();
+	u64 lat = now - cmd->issue_ns;
+	unsigned long flags;
+
+	spin_lock_irqsave(&nullb->lat_lock, flags);
+	nullb->lat_win_ios++;
+	nullb->lat_win_sum += lat;
+	nullb->lat_win_max = max(nullb->lat_win_max, lat);
+	if (now - nullb->lat_win_start >= NSEC_PER_SEC) {
+		trace_nullb_lat_summary(nullb, nullb->lat_win_ios,
+					now - nullb->lat_win_start,
+					div64_u64(nullb->lat_win_sum,
+						  nullb->lat_win_ios),
+					nullb->lat_win_max);
+		nullb->lat_win_start = now;
+		nullb->lat_win_ios = 0;
+		nullb->lat_win_sum = 0;
+		nullb->lat_win_max = 0;
+	}
+	spin_unlock_irqrestore(&nullb->lat_lock, flags);
+}
+
 static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
-	end_cmd(container_of(timer, struct nullb_cmd, timer));
+	struct nullb_cmd *cmd = container_of(timer, struct nullb_cmd, timer);
+	struct nullb *nullb = cmd->nq->dev->nullb;
+
+	if (nullb->lat_model)
+		null_lat_account(nullb, cmd);
+	end_cmd(cmd);
 
 	return HRTIMER_NORESTART;
 }
 
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
+	struct nullb *nullb = cmd->nq->dev->nullb;
 	ktime_t kt = cmd->nq->dev->completion_nsec;
 
+	if (nullb->lat_model)
+		kt = null_lat_delay(nullb, cmd);
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
 
@@ -1355,6 +1486,9 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd, sector_t sector,
 	struct nullb *nullb = dev->nullb;
 	blk_status_t sts;
 
+	if (nullb->lat_model)
+		cmd->issue_ns = ktime_get_ns();
+
 	if (test_bit(NULLB_DEV_FL_THROTTLED, &dev->flags)) {
 		sts = null_handle_throttled(cmd);
 		if (sts != BLK_STS_OK)
@@ -1596,6 +1730,7 @@ static void null_del_dev(struct nullb *nullb)
 	cleanup_queues(nullb);
 	if (null_cache_active(nullb))
 		null_free_device_storage(nullb->dev, true);
+	kfree(nullb->lat_busy_until);
 	kfree(nullb);
 	dev->nullb = NULL;
 }
@@ -1764,6 +1899,12 @@ static int null_validate_conf(struct nullb_device *dev)
 	if (dev->queue_mode == NULL_Q_BIO)
 		dev->mbps = 0;
 
+	dev->tail_pct = min_t(unsigned int, dev->tail_pct, 100);
+	dev->jitter_pct = min_t(unsigned int, dev->jitter_pct, 100);
+	/* more slots than requests in flight can never saturate */
+	dev->internal_depth = min(dev->internal_depth,
+				  dev->hw_queue_depth * dev->submit_queues);
+
 	if (dev->zoned &&
 	    (!dev->zone_size || !is_power_of_2(dev->zone_size))) {
 		pr_err("zone_size must be power-of-two\n");
@@ -1800,6 +1941,29 @@ static bool null_setup_fault(void)
 	return true;
 }
 
+/* The latency model only shapes timer completions */
+static int null_init_lat_model(struct nullb *nullb)
+{
+	struct nullb_device *dev = nullb->dev;
+
+	spin_lock_init(&nullb->lat_lock);
+	nullb->lat_model = dev->irqmode == NULL_IRQ_TIMER &&
+		(dev->read_nsec || dev->write_nsec || dev->flush_nsec ||
+		 dev->nsec_per_kb || dev->tail_pct || dev->jitter_pct ||
+		 dev->internal_depth);
+	if (!nullb->lat_model)
+		return 0;
+
+	if (dev->internal_depth) {
+		nullb->lat_busy_until = kcalloc(dev->internal_depth,
+						sizeof(u64), GFP_KERNEL);
+		if (!nullb->lat_busy_until)
+			return -ENOMEM;
+	}
+	nullb->lat_win_start = ktime_get_ns();
+	return 0;
+}
+
 static int null_add_dev(struct nullb_device *dev)
 {
 	struct nullb *nullb;
@@ -1819,6 +1983,10 @@ static int null_add_dev(struct nullb_device *dev)
 
 	spin_lock_init(&nullb->lock);
 
+	rv = null_init_lat_model(nullb);
+	if (rv)
+		goto out_free_nullb;
+
 	rv = setup_queues(nullb);
 	if (rv)
 		goto out_free_nullb;
@@ -1906,6 +2074,7 @@ out_cleanup_tags:
 out_cleanup_queues:
 	cleanup_queues(nullb);
 out_free_nullb:
+	kfree(nullb->lat_busy_until);
 	kfree(nullb);
 	dev->nullb = NULL;
 out:
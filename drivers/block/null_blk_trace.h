@@ -68,6 +68,29 @@ TRACE_EVENT(nullb_report_zones,
 		      __print_disk_name(__entry->disk), __entry->nr_zones)
 );
 
+TRACE_EVENT(nullb_lat_summary,
+	    TP_PROTO(struct nullb *nullb, u64 ios, u64 window_ns, u64 avg_ns,
+		     u64 max_ns),
+	    TP_ARGS(nullb, ios, window_ns, avg_ns, max_ns),
+	    TP_STRUCT__entry(
+		__array(char, disk, DISK_NAME_LEN)
+		__field(u64, ios)
+		__field(u64, iops)
+		__field(u64, avg_ns)
+		__field(u64, max_ns)
+	    ),
+	    TP_fast_assign(
+		__entry->ios = ios;
+		__entry->iops = div64_u64(ios * NSEC_PER_SEC, window_ns);
+		__entry->avg_ns = avg_ns;
+		__entry->max_ns = max_ns;
+		__assign_disk_name(__entry->disk, nullb->disk);
+	    ),
+	    TP_printk("%s ios=%llu iops=%llu avg_ns=%llu max_ns=%llu",
+		      __print_disk_name(__entry->disk), __entry->ios,
+		      __entry->iops, __entry->avg_ns, __entry->max_ns)
+);
+
 #endif /* _TRACE_NULLB_H */
 
 #undef TRACE_INCLUDE_PATH
@@ -2,8 +2,6 @@
 #include <linux/vmalloc.h>
 #include <linux/bitmap.h>
 #include "null_blk.h"
-
-#define CREATE_TRACE_POINTS
 #include "null_blk_trace.h"
 
 #define MB_TO_SECTS(mb) (((sector_t)mb * SZ_1M) >> SECTOR_SHIFT)
@@ -327,6 +327,7 @@
 #include <linux/spinlock.h>
 #include <linux/kthread.h>
 #include <linux/percpu.h>
+#include <linux/local_lock.h>
 #include <linux/fips.h>
 #include <linux/ptrace.h>
 #include <linux/workqueue.h>
@@ -464,6 +465,8 @@ static int crng_init = 0;
 #define crng_ready() (likely(crng_init > 1))
 static int crng_init_cnt = 0;
 static unsigned long crng_global_init_time = 0;
+/* Bumped on every reseed, per-CPU keys and batches from before are stale */
+static atomic_long_t crng_generation = ATOMIC_LONG_INIT(0);
 #define CRNG_INIT_CNT_THRESH (2*CHACHA_KEY_SIZE)
 static void _extract_crng(struct crng_state *crng, __u8 out[CHACHA_BLOCK_SIZE]);
 static void _crng_backtrack_protect(struct crng_state *crng,
@@ -974,6 +977,7 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	memzero_explicit(&buf, sizeof(buf));
 	crng->init_time = jiffies;
 	spin_unlock_irqrestore(&crng->lock, flags);
+	atomic_long_inc(&crng_generation);
 	if (crng == &primary_crng && crng_init < 2) {
 		invalidate_batched_entropy();
 		numa_crng_init();
@@ -1063,11 +1067,143 @@ static void crng_backtrack_protect(__u8 tmp[CHACHA_BLOCK_SIZE], int used)
 	_crng_backtrack_protect(crng, tmp, used);
 }
 
+/*
+ * Once the crng is initialized, output is generated from a ChaCha20 key
+ * kept per CPU, so that get_random_bytes(), get_random_uXX() and reads of
+ * /dev/urandom do not serialize on the lock of the node crng. The key is
+ * derived from the node crng, and derived again after any crng got reseeded
+ * or CRNG_RESEED_INTERVAL passed. Fast key erasure keeps the backtracking
+ * protection: the first half of the block generated from the key replaces
+ * the key, and only the second half is handed out, either directly or as
+ * the key of a ChaCha20 state the caller generates more from without any
+ * lock held.
+ */
+struct crng_pcpu {
+	__u8		key[CHACHA_KEY_SIZE];
+	unsigned long	generation;
+	unsigned long	init_time;
+	local_lock_t	lock;
+};
+
+static DEFINE_PER_CPU(struct crng_pcpu, crng_pcpu) = {
+	.generation	= ULONG_MAX,
+	.lock		= INIT_LOCAL_LOCK(crng_pcpu.lock),
+};
+
+static void crng_fast_key_erasure(__u8 key[CHACHA_KEY_SIZE],
+				  __u32 chacha_state[CHACHA_STATE_WORDS],
+				  __u8 *random_data, size_t random_data_len)
+{
+	__u8 first_block[CHACHA_BLOCK_SIZE] __aligned(4);
+
+	chacha_init_consts(chacha_state);
+	memcpy(&chacha_state[4], key, CHACHA_KEY_SIZE);
+	memset(&chacha_state[12], 0, sizeof(__u32) * 4);
+	chacha20_block(chacha_state, first_block);
+
+	memcpy(key, first_block, CHACHA_KEY_SIZE);
+	memcpy(random_data, first_block + CHACHA_KEY_SIZE, random_data_len);
+	memzero_explicit(first_block, sizeof(first_block));
+}
+
+/*
+ * Fill @random_data with up to CHACHA_KEY_SIZE bytes from the key of this
+ * CPU. Passing the key words of @chacha_state as @random_data sets up a
+ * fresh state to generate more from. Only used once crng_ready().
+ */
+static void crng_make_state(__u32 chacha_state[CHACHA_STATE_WORDS],
+			    __u8 *random_data, size_t random_data_len)
+{
+	unsigned long generation = atomic_long_read(&crng_generation);
+	struct crng_pcpu *pc;
+	unsigned long flags;
+
+	BUG_ON(random_data_len > CHACHA_KEY_SIZE);
+
+	local_lock_irqsave(&crng_pcpu.lock, flags);
+	pc = this_cpu_ptr(&crng_pcpu);
+	if (unlikely(pc->generation != generation ||
+		     time_after(jiffies,
+				pc->init_time + CRNG_RESEED_INTERVAL))) {
+		__u8 tmp[CHACHA_BLOCK_SIZE] __aligned(4);
+
+		extract_crng(tmp);
+		memcpy(pc->key, tmp, CHACHA_KEY_SIZE);
+		crng_backtrack_protect(tmp, CHACHA_KEY_SIZE);
+		memzero_explicit(tmp, sizeof(tmp));
+		/* extract_crng() may have reseeded and bumped it */
+		pc->generation = atomic_long_read(&crng_generation);
+		pc->init_time = jiffies;
+	}
+	crng_fast_key_erasure(pc->key, chacha_state, random_data,
+			      random_data_len);
+	local_unlock_irqrestore(&crng_pcpu.lock, flags);
+}
+
+static void crng_state_block(__u32 chacha_state[CHACHA_STATE_WORDS],
+			     __u8 out[CHACHA_BLOCK_SIZE])
+{
+	chacha20_block(chacha_state, out);
+	if (chacha_state[12] == 0)
+		chacha_state[13]++;
+}
+
+/* get_random_bytes() without the tracepoint, also refills the batches */
+static void crng_get_bytes(void *buf, int nbytes)
+{
+	__u32 chacha_state[CHACHA_STATE_WORDS];
+	__u8 tmp[CHACHA_BLOCK_SIZE] __aligned(4);
+
+	if (!crng_ready()) {
+		while (nbytes >= CHACHA_BLOCK_SIZE) {
+			extract_crng(buf);
+			buf += CHACHA_BLOCK_SIZE;
+			nbytes -= CHACHA_BLOCK_SIZE;
+		}
+
+		if (nbytes > 0) {
+			extract_crng(tmp);
+			memcpy(buf, tmp, nbytes);
+			crng_backtrack_protect(tmp, nbytes);
+		} else
+			crng_backtrack_protect(tmp, CHACHA_BLOCK_SIZE);
+		memzero_explicit(tmp, sizeof(tmp));
+		return;
+	}
+
+	if (nbytes <= CHACHA_KEY_SIZE) {
+		if (nbytes > 0)
+			crng_make_state(chacha_state, buf, nbytes);
+		memzero_explicit(chacha_state, sizeof(chacha_state));
+		return;
+	}
+
+	crng_make_state(chacha_state, (__u8 *)&chacha_state[4],
+			CHACHA_KEY_SIZE);
+	while (nbytes >= CHACHA_BLOCK_SIZE) {
+		crng_state_block(chacha_state, buf);
+		buf += CHACHA_BLOCK_SIZE;
+		nbytes -= CHACHA_BLOCK_SIZE;
+	}
+	if (nbytes > 0) {
+		crng_state_block(chacha_state, tmp);
+		memcpy(buf, tmp, nbytes);
+		memzero_explicit(tmp, sizeof(tmp));
+	}
+	memzero_explicit(chacha_state, sizeof(chacha_state));
+}
+
 static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 {
 	ssize_t ret = 0, i = CHACHA_BLOCK_SIZE;
+	__u32 chacha_state[CHACHA_STATE_WORDS];
 	__u8 tmp[CHACHA_BLOCK_SIZE] __aligned(4);
 	int large_request = (nbytes > 256);
+	bool pcpu = crng_ready();
+
+	if (pcpu)
+		crng_make_state(chacha_state, (__u8 *)&chacha_state[4],
+				CHACHA_KEY_SIZE);
 
 	while (nbytes) {
 		if (large_request && need_resched()) {
@@ -1079,7 +1215,10 @@ static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 			schedule();
 		}
 
-		extract_crng(tmp);
+		if (pcpu)
+			crng_state_block(chacha_state, tmp);
+		else
+			extract_crng(tmp);
 		i = min_t(int, nbytes, CHACHA_BLOCK_SIZE);
 		if (copy_to_user(buf, tmp, i)) {
 			ret = -EFAULT;
@@ -1090,7 +1229,10 @@ static ssize_t extract_crng_user(void __user *buf, size_t nbytes)
 		buf += i;
 		ret += i;
 	}
-	crng_backtrack_protect(tmp, i);
+	if (pcpu)
+		memzero_explicit(chacha_state, sizeof(chacha_state));
+	else
+		crng_backtrack_protect(tmp, i);
 
 	/* Wipe data just written to memory */
 	memzero_explicit(tmp, sizeof(tmp));
@@ -1548,23 +1690,8 @@ static void _warn_unseeded_randomness(const char *func_name, void *caller,
  */
 static void _get_random_bytes(void *buf, int nbytes)
 {
-	__u8 tmp[CHACHA_BLOCK_SIZE] __aligned(4);
-
 	trace_get_random_bytes(nbytes, _RET_IP_);
-
-	while (nbytes >= CHACHA_BLOCK_SIZE) {
-		extract_crng(buf);
-		buf += CHACHA_BLOCK_SIZE;
-		nbytes -= CHACHA_BLOCK_SIZE;
-	}
-
-	if (nbytes > 0) {
-		extract_crng(tmp);
-		memcpy(buf, tmp, nbytes);
-		crng_backtrack_protect(tmp, nbytes);
-	} else
-		crng_backtrack_protect(tmp, CHACHA_BLOCK_SIZE);
-	memzero_explicit(tmp, sizeof(tmp));
+	crng_get_bytes(buf, nbytes);
 }
 
 void get_random_bytes(void *buf, int nbytes)
@@ -2170,90 +2297,69 @@ struct batched_entropy {
 	union {
 		u64 entropy_u64[CHACHA_BLOCK_SIZE / sizeof(u64)];
 		u32 entropy_u32[CHACHA_BLOCK_SIZE / sizeof(u32)];
+		u16 entropy_u16[CHACHA_BLOCK_SIZE / sizeof(u16)];
+		u8 entropy_u8[CHACHA_BLOCK_SIZE / sizeof(u8)];
 	};
 	unsigned int position;
-	spinlock_t batch_lock;
+	unsigned long generation;
+	local_lock_t lock;
 };
 
 /*
  * Get a random word for internal kernel use only. The quality of the random
- * number is good as /dev/urandom, but there is no backtrack protection, with
- * the goal of being quite fast and not depleting entropy. In order to ensure
- * that the randomness provided by this function is okay, the function
+ * number is good as /dev/urandom, with the goal of being quite fast and not
+ * depleting entropy. Words are wiped from the batch once handed out, and the
+ * batch is refilled after the crng got reseeded. In order to ensure that the
+ * randomness provided by this function is okay, the function
  * wait_for_random_bytes() should be called and return 0 at least once at any
  * point prior.
+ *
+ * The batches are per CPU and only disable interrupts locally, so callers
+ * such as fork and connection setup never contend on a lock.
  */
-static DEFINE_PER_CPU(struct batched_entropy, batched_entropy_u64) = {
-	.batch_lock	= __SPIN_LOCK_UNLOCKED(batched_entropy_u64.lock),
-};
-
-u64 get_random_u64(void)
-{
-	u64 ret;
-	unsigned long flags;
-	struct batched_entropy *batch;
-	static void *previous;
-
-	warn_unseeded_randomness(&previous);
-
-	batch = raw_cpu_ptr(&batched_entropy_u64);
-	spin_lock_irqsave(&batch->batch_lock, flags);
-	if (batch->position % ARRAY_SIZE(batch->entropy_u64) == 0) {
-		extract_crng((u8 *)batch->entropy_u64);
-		batch->position = 0;
-	}
-	ret = batch->entropy_u64[batch->position++];
-	spin_unlock_irqrestore(&batch->batch_lock, flags);
-	return ret;
-}
-EXPORT_SYMBOL(get_random_u64);
-
-static DEFINE_PER_CPU(struct batched_entropy, batched_entropy_u32) = {
-	.batch_lock	= __SPIN_LOCK_UNLOCKED(batched_entropy_u32.lock),
-};
-u32 get_random_u32(void)
-{
-	u32 ret;
-	unsigned long flags;
-	struct batched_entropy *batch;
-	static void *previous;
-
-	warn_unseeded_randomness(&previous);
-
-	batch = raw_cpu_ptr(&batched_entropy_u32);
-	spin_lock_irqsave(&batch->batch_lock, flags);
-	if (batch->position % ARRAY_SIZE(batch->entropy_u32) == 0) {
-		extract_crng((u8 *)batch->entropy_u32);
-		batch->position = 0;
-	}
-	ret = batch->entropy_u32[batch->position++];
-	spin_unlock_irqrestore(&batch->batch_lock, flags);
-	return ret;
-}
-EXPORT_SYMBOL(get_random_u32);
+#define DEFINE_BATCHED_ENTROPY(type)					\
+static DEFINE_PER_CPU(struct batched_entropy, batched_entropy_##type) = { \
+	.position = UINT_MAX,						\
+	.lock = INIT_LOCAL_LOCK(batched_entropy_##type.lock),		\
+};									\
+									\
+type get_random_##type(void)						\
+{									\
+	type ret;							\
+	unsigned long flags, generation;				\
+	struct batched_entropy *batch;					\
+	static void *previous;						\
+									\
+	warn_unseeded_randomness(&previous);				\
+									\
+	local_lock_irqsave(&batched_entropy_##type.lock, flags);	\
+	batch = this_cpu_ptr(&batched_entropy_##type);			\
+	generation = atomic_long_read(&crng_generation);		\
+	if (batch->position >= ARRAY_SIZE(batch->entropy_##type) ||	\
+	    batch->generation != generation) {				\
+		crng_get_bytes(batch->entropy_##type,			\
+			       sizeof(batch->entropy_##type));		\
+		batch->position = 0;					\
+		batch->generation = generation;				\
+	}								\
+	ret = batch->entropy_##type[batch->position];			\
+	batch->entropy_##type[batch->position++] = 0;			\
+	local_unlock_irqrestore(&batched_entropy_##type.lock, flags);	\
+	return ret;							\
+}									\
+EXPORT_SYMBOL(get_random_##type);
+
+DEFINE_BATCHED_ENTROPY(u64)
+DEFINE_BATCHED_ENTROPY(u32)
+DEFINE_BATCHED_ENTROPY(u16)
+DEFINE_BATCHED_ENTROPY(u8)
 
 /* It's important to invalidate all potential batched entropy that might
  * be stored before the crng is initialized, which we can do lazily by
- * simply resetting the counter to zero so that it's re-extracted on the
- * next usage. */
+ * bumping the generation so that it's re-extracted on the next usage. */
 static void invalidate_batched_entropy(void)
 {
-	int cpu;
-	unsigned long flags;
-
-	for_each_possible_cpu (cpu) {
-		struct batched_entropy *batched_entropy;
-
-		batched_entropy = per_cpu_ptr(&batched_entropy_u32, cpu);
-		spin_lock_irqsave(&batched_entropy->batch_lock, flags);
-		batched_entropy->position = 0;
-		spin_unlock(&batched_entropy->batch_lock);
-
-		batched_entropy = per_cpu_ptr(&batched_entropy_u64, cpu);
-		spin_lock(&batched_entropy->batch_lock);
-		batched_entropy->position = 0;
-		spin_unlock_irqrestore(&batched_entropy->batch_lock, flags);
-	}
+	atomic_long_inc(&crng_generation);
 }
 
 /**
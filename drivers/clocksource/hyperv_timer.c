@@ -21,6 +21,7 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/acpi.h>
+#include <linux/moduleparam.h>
 #include <clocksource/hyperv_timer.h>
 #include <asm/hyperv-tlfs.h>
 #include <asm/mshyperv.h>
@@ -50,6 +51,19 @@ static int stimer0_irq = -1;
 static int stimer0_message_sint;
 static DEFINE_PER_CPU(long, stimer0_evt);
 
+/*
+ * Writing STIMER0_COUNT is an MSR write on x86 and a hypercall on ARM64,
+ * both of which exit to the hypervisor. When the timer is already armed
+ * to expire no earlier than requested and at most stimer0_slack_ns later,
+ * keep it as is. 0 disables coalescing.
+ */
+static unsigned int stimer0_slack_ns = 1000;
+module_param(stimer0_slack_ns, uint, 0644);
+MODULE_PARM_DESC(stimer0_slack_ns, "Max lateness in ns to skip reprogramming stimer0");
+
+/* Reference counter value stimer0 is armed for, 0 if not armed */
+static DEFINE_PER_CPU(u64, stimer0_expiry);
+
 /*
  * Common code for stimer0 interrupts coming via Direct Mode or
  * as a VMbus message.
@@ -58,6 +72,7 @@ void hv_stimer0_isr(void)
 {
 	struct clock_event_device *ce;
 
+	__this_cpu_write(stimer0_expiry, 0);
 	ce = this_cpu_ptr(hv_clock_event);
 	ce->event_handler(ce);
 }
@@ -76,16 +91,24 @@ static irqreturn_t hv_stimer0_percpu_isr(int irq, void *dev_id)
 static int hv_ce_set_next_event(unsigned long delta,
 				struct clock_event_device *evt)
 {
-	u64 current_tick;
+	u64 current_tick, expiry, slack;
 
 	current_tick = hv_read_reference_counter();
+	expiry = __this_cpu_read(stimer0_expiry);
+	slack = READ_ONCE(stimer0_slack_ns) / (NSEC_PER_SEC / HV_CLOCK_HZ);
+	if (expiry > current_tick && expiry >= current_tick + delta &&
+	    expiry <= current_tick + delta + slack)
+		return 0;
+
 	current_tick += delta;
 	hv_set_register(HV_REGISTER_STIMER0_COUNT, current_tick);
+	__this_cpu_write(stimer0_expiry, current_tick);
 	return 0;
 }
 
 static int hv_ce_shutdown(struct clock_event_device *evt)
 {
+	per_cpu(stimer0_expiry, cpumask_first(evt->cpumask)) = 0;
 	hv_set_register(HV_REGISTER_STIMER0_COUNT, 0);
 	hv_set_register(HV_REGISTER_STIMER0_CONFIG, 0);
 	if (direct_mode_enabled && stimer0_irq >= 0)
@@ -98,6 +121,7 @@ static int hv_ce_set_oneshot(struct clock_event_device *evt)
 {
 	union hv_stimer_config timer_cfg;
 
+	per_cpu(stimer0_expiry, cpumask_first(evt->cpumask)) = 0;
 	timer_cfg.as_uint64 = 0;
 	timer_cfg.enable = 1;
 	timer_cfg.auto_enable = 1;
@@ -364,6 +388,10 @@ EXPORT_SYMBOL_GPL(hv_stimer_global_cleanup);
 u64 (*hv_read_reference_counter)(void);
 EXPORT_SYMBOL_GPL(hv_read_reference_counter);
 
+/* The registered Hyper-V clocksource, counting hv_read_reference_counter() */
+struct clocksource *hyperv_cs;
+EXPORT_SYMBOL_GPL(hyperv_cs);
+
 static union {
 	struct ms_hyperv_tsc_page page;
 	u8 reserved[PAGE_SIZE];
@@ -419,7 +447,7 @@ static void resume_hv_clock_tsc(struct clocksource *arg)
 	hv_set_register(HV_REGISTER_REFERENCE_TSC, tsc_msr);
 }
 
-#ifdef VDSO_CLOCKMODE_HVCLOCK
+#ifdef HAVE_VDSO_CLOCKMODE_HVCLOCK
 static int hv_cs_enable(struct clocksource *cs)
 {
 	vclocks_set_used(VDSO_CLOCKMODE_HVCLOCK);
@@ -435,7 +463,7 @@ static struct clocksource hyperv_cs_tsc = {
 	.flags	= CLOCK_SOURCE_IS_CONTINUOUS,
 	.suspend= suspend_hv_clock_tsc,
 	.resume	= resume_hv_clock_tsc,
-#ifdef VDSO_CLOCKMODE_HVCLOCK
+#ifdef HAVE_VDSO_CLOCKMODE_HVCLOCK
 	.enable = hv_cs_enable,
 	.vdso_clock_mode = VDSO_CLOCKMODE_HVCLOCK,
 #else
@@ -535,6 +563,7 @@ static bool __init hv_init_tsc_clocksource(void)
 	tsc_msr = tsc_msr | 0x1 | (u64)phys_addr;
 	hv_set_register(HV_REGISTER_REFERENCE_TSC, tsc_msr);
 
+	hyperv_cs = &hyperv_cs_tsc;
 	clocksource_register_hz(&hyperv_cs_tsc, NSEC_PER_SEC/100);
 
 	hv_sched_clock_offset = hv_read_reference_counter();
@@ -560,6 +589,7 @@ void __init hv_init_clocksource(void)
 		return;
 
 	hv_read_reference_counter = read_hv_clock_msr;
+	hyperv_cs = &hyperv_cs_msr;
 	clocksource_register_hz(&hyperv_cs_msr, NSEC_PER_SEC/100);
 
 	hv_sched_clock_offset = hv_read_reference_counter();
@@ -12,6 +12,9 @@
  */
 
 #include <linux/fs.h>
+#include <linux/hashtable.h>
+#include <linux/memcontrol.h>
+#include <linux/sched/mm.h>
 #include <linux/slab.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-fence.h>
@@ -38,6 +41,23 @@ struct dma_buf_list {
 
 static struct dma_buf_list db_list;
 
+/**
+ * struct dma_buf_owner - per-process total of charged dma-bufs
+ * @node: entry in dma_buf_owners
+ * @pid: thread group pid of the process
+ * @size: bytes of the buffers charged to the process
+ * @nr_bufs: number of buffers charged to the process
+ */
+struct dma_buf_owner {
+	struct hlist_node node;
+	struct pid *pid;
+	atomic_long_t size;
+	unsigned int nr_bufs;
+};
+
+static DEFINE_HASHTABLE(dma_buf_owners, 7);
+static DEFINE_SPINLOCK(dma_buf_owners_lock);
+
 /*
  * This function helps in traversing the db_list and calls the
  * callback function which can extract required info out of each
@@ -78,6 +98,208 @@ static char *dmabuffs_dname(struct dentry *dentry, char *buffer, int buflen)
 			     dentry->d_name.name, ret > 0 ? name : "");
 }
 
+/* Called with dma_buf_owners_lock held */
+static struct dma_buf_owner *dma_buf_owner_find(struct pid *pid)
+{
+	struct dma_buf_owner *owner;
+
+	hash_for_each_possible(dma_buf_owners, owner, node, (unsigned long)pid) {
+		if (owner->pid == pid)
+			return owner;
+	}
+
+	return NULL;
+}
+
+static struct dma_buf_owner *dma_buf_owner_get(struct task_struct *task,
+					       size_t size)
+{
+	struct pid *pid = task_tgid(task);
+	struct dma_buf_owner *owner, *new = NULL;
+
+	for (;;) {
+		spin_lock(&dma_buf_owners_lock);
+		owner = dma_buf_owner_find(pid);
+		if (!owner && new) {
+			new->pid = get_pid(pid);
+			hash_add(dma_buf_owners, &new->node, (unsigned long)pid);
+			owner = new;
+			new = NULL;
+		}
+		if (owner) {
+			owner->nr_bufs++;
+			atomic_long_add(size, &owner->size);
+		}
+		spin_unlock(&dma_buf_owners_lock);
+
+		if (owner)
+			break;
+
+		new = kzalloc(sizeof(*new), GFP_KERNEL);
+		if (!new)
+			return NULL;
+	}
+
+	kfree(new);
+	return owner;
+}
+
+static void dma_buf_owner_put(struct dma_buf_owner *owner, size_t size)
+{
+	spin_lock(&dma_buf_owners_lock);
+	atomic_long_sub(size, &owner->size);
+	if (--owner->nr_bufs)
+		owner = NULL;
+	else
+		hash_del(&owner->node);
+	spin_unlock(&dma_buf_owners_lock);
+
+	if (owner) {
+		put_pid(owner->pid);
+		kfree(owner);
+	}
+}
+
+static int __dma_buf_charge(struct dma_buf *dmabuf, struct task_struct *task,
+			    struct mem_cgroup **memcgp,
+			    struct dma_buf_owner **ownerp)
+{
+	unsigned int nr_pages = PAGE_ALIGN(dmabuf->size) >> PAGE_SHIFT;
+	struct mem_cgroup *memcg;
+	struct mm_struct *mm;
+	int ret;
+
+	mm = get_task_mm(task);
+	memcg = get_mem_cgroup_from_mm(mm);
+	if (mm)
+		mmput(mm);
+
+	if (memcg) {
+		ret = mem_cgroup_charge_dmabuf(memcg, nr_pages, GFP_KERNEL);
+		if (ret) {
+			mem_cgroup_put(memcg);
+			return ret;
+		}
+	}
+
+	*ownerp = dma_buf_owner_get(task, dmabuf->size);
+	if (!*ownerp) {
+		if (memcg) {
+			mem_cgroup_uncharge_dmabuf(memcg, nr_pages);
+			mem_cgroup_put(memcg);
+		}
+		return -ENOMEM;
+	}
+
+	*memcgp = memcg;
+	return 0;
+}
+
+static void __dma_buf_uncharge(struct dma_buf *dmabuf,
+			       struct mem_cgroup *memcg,
+			       struct dma_buf_owner *owner)
+{
+	if (memcg) {
+		mem_cgroup_uncharge_dmabuf(memcg,
+					   PAGE_ALIGN(dmabuf->size) >> PAGE_SHIFT);
+		mem_cgroup_put(memcg);
+	}
+	dma_buf_owner_put(owner, dmabuf->size);
+}
+
+/**
+ * dma_buf_charge - account a dma-buf to a process
+ * @dmabuf:	[in]	buffer to account
+ * @task:	[in]	task of the process to account the buffer to
+ *
+ * Charges the buffer's size to the memory cgroup of @task and adds it to
+ * the dma-buf total of @task's process, until the buffer is released or
+ * the charge is moved with dma_buf_transfer_charge(). Used by exporters
+ * allocating memory on behalf of user space, like the dma-buf heaps.
+ *
+ * Returns 0 on success, -EBUSY if the buffer is already charged or
+ * -ENOMEM if the charge exceeds the memory cgroup's limit.
+ */
+int dma_buf_charge(struct dma_buf *dmabuf, struct task_struct *task)
+{
+	int ret = -EBUSY;
+
+	mutex_lock(&dmabuf->lock);
+	if (!dmabuf->charge_owner)
+		ret = __dma_buf_charge(dmabuf, task, &dmabuf->memcg,
+				       &dmabuf->charge_owner);
+	mutex_unlock(&dmabuf->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_charge);
+
+/**
+ * dma_buf_transfer_charge - move the accounting of a dma-buf to a process
+ * @dmabuf:	[in]	buffer charged with dma_buf_charge()
+ * @task:	[in]	task of the process to move the charge to
+ *
+ * Moves the charge of the buffer to the memory cgroup and process of
+ * @task, e.g. once a buffer allocated by a service was handed to its
+ * client. On failure the buffer stays charged where it was.
+ *
+ * Returns 0 on success, -EINVAL if the buffer isn't charged or -ENOMEM
+ * if the charge exceeds the new memory cgroup's limit.
+ */
+int dma_buf_transfer_charge(struct dma_buf *dmabuf, struct task_struct *task)
+{
+	struct dma_buf_owner *owner;
+	struct mem_cgroup *memcg;
+	int ret = 0;
+
+	mutex_lock(&dmabuf->lock);
+	if (!dmabuf->charge_owner) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (dmabuf->charge_owner->pid == task_tgid(task))
+		goto out;
+
+	ret = __dma_buf_charge(dmabuf, task, &memcg, &owner);
+	if (ret)
+		goto out;
+
+	__dma_buf_uncharge(dmabuf, dmabuf->memcg, dmabuf->charge_owner);
+	dmabuf->memcg = memcg;
+	dmabuf->charge_owner = owner;
+out:
+	mutex_unlock(&dmabuf->lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_transfer_charge);
+
+/**
+ * dma_buf_charged_size - total size of the dma-bufs charged to a process
+ * @task:	[in]	any task of the process
+ *
+ * Returns the number of bytes currently charged to @task's process.
+ */
+size_t dma_buf_charged_size(struct task_struct *task)
+{
+	struct dma_buf_owner *owner;
+	size_t size = 0;
+
+	spin_lock(&dma_buf_owners_lock);
+	owner = dma_buf_owner_find(task_tgid(task));
+	if (owner)
+		size = atomic_long_read(&owner->size);
+	spin_unlock(&dma_buf_owners_lock);
+
+	return size;
+}
+EXPORT_SYMBOL_GPL(dma_buf_charged_size);
+
+static void dma_buf_uncharge(struct dma_buf *dmabuf)
+{
+	if (dmabuf->charge_owner)
+		__dma_buf_uncharge(dmabuf, dmabuf->memcg, dmabuf->charge_owner);
+}
+
 static void dma_buf_release(struct dentry *dentry)
 {
 	struct dma_buf *dmabuf;
@@ -99,6 +321,7 @@ static void dma_buf_release(struct dentry *dentry)
 	BUG_ON(dmabuf->cb_shared.active || dmabuf->cb_excl.active);
 
 	dma_buf_stats_teardown(dmabuf);
+	dma_buf_uncharge(dmabuf);
 	dmabuf->ops->release(dmabuf);
 
 	if (dmabuf->resv == (struct dma_resv *)&dmabuf[1])
@@ -229,14 +452,34 @@ static void dma_buf_poll_cb(struct dma_fence *fence, struct dma_fence_cb *cb)
 	spin_unlock_irqrestore(&dcb->poll->lock, flags);
 }
 
+/*
+ * Queue @dcb on the first unsignaled fence @write access has to wait for,
+ * returns false if there is none.
+ */
+static bool dma_buf_poll_add_cb(struct dma_resv *resv, bool write,
+				struct dma_buf_poll_cb_t *dcb)
+{
+	struct dma_resv_iter cursor;
+	struct dma_fence *fence;
+	bool queued = false;
+
+	dma_resv_iter_begin(&cursor, resv, write);
+	dma_resv_for_each_fence_unlocked(&cursor, fence) {
+		if (!dma_fence_add_callback(fence, &dcb->cb, dma_buf_poll_cb)) {
+			queued = true;
+			break;
+		}
+	}
+	dma_resv_iter_end(&cursor);
+
+	return queued;
+}
+
 static __poll_t dma_buf_poll(struct file *file, poll_table *poll)
 {
 	struct dma_buf *dmabuf;
 	struct dma_resv *resv;
-	struct dma_resv_list *fobj;
-	struct dma_fence *fence_excl;
 	__poll_t events;
-	unsigned shared_count, seq;
 
 	dmabuf = file->private_data;
 	if (!dmabuf || !dmabuf->resv)
@@ -250,101 +493,45 @@ static __poll_t dma_buf_poll(struct file *file, poll_table *poll)
 	if (!events)
 		return 0;
 
-retry:
-	seq = read_seqcount_begin(&resv->seq);
-	rcu_read_lock();
-
-	fobj = rcu_dereference(resv->fence);
-	if (fobj)
-		shared_count = fobj->shared_count;
-	else
-		shared_count = 0;
-	fence_excl = rcu_dereference(resv->fence_excl);
-	if (read_seqcount_retry(&resv->seq, seq)) {
-		rcu_read_unlock();
-		goto retry;
-	}
-
-	if (fence_excl && (!(events & EPOLLOUT) || shared_count == 0)) {
-		struct dma_buf_poll_cb_t *dcb = &dmabuf->cb_excl;
-		__poll_t pevents = EPOLLIN;
-
-		if (shared_count == 0)
-			pevents |= EPOLLOUT;
+	/* Writers wait for all fences, readers only for the exclusive one */
+	if (events & EPOLLOUT) {
+		struct dma_buf_poll_cb_t *dcb = &dmabuf->cb_shared;
 
+		/* Only queue a new callback if no event has fired yet */
 		spin_lock_irq(&dmabuf->poll.lock);
-		if (dcb->active) {
-			dcb->active |= pevents;
-			events &= ~pevents;
-		} else
-			dcb->active = pevents;
+		if (dcb->active)
+			events &= ~EPOLLOUT;
+		else
+			dcb->active = EPOLLOUT;
 		spin_unlock_irq(&dmabuf->poll.lock);
 
-		if (events & pevents) {
-			if (!dma_fence_get_rcu(fence_excl)) {
-				/* force a recheck */
-				events &= ~pevents;
-				dma_buf_poll_cb(NULL, &dcb->cb);
-			} else if (!dma_fence_add_callback(fence_excl, &dcb->cb,
-							   dma_buf_poll_cb)) {
-				events &= ~pevents;
-				dma_fence_put(fence_excl);
-			} else {
-				/*
-				 * No callback queued, wake up any additional
-				 * waiters.
-				 */
-				dma_fence_put(fence_excl);
+		if (events & EPOLLOUT) {
+			if (dma_buf_poll_add_cb(resv, true, dcb))
+				events &= ~EPOLLOUT;
+			else
+				/* No callback queued, wake up any other waiters */
 				dma_buf_poll_cb(NULL, &dcb->cb);
-			}
 		}
 	}
 
-	if ((events & EPOLLOUT) && shared_count > 0) {
-		struct dma_buf_poll_cb_t *dcb = &dmabuf->cb_shared;
-		int i;
+	if (events & EPOLLIN) {
+		struct dma_buf_poll_cb_t *dcb = &dmabuf->cb_excl;
 
-		/* Only queue a new callback if no event has fired yet */
 		spin_lock_irq(&dmabuf->poll.lock);
 		if (dcb->active)
-			events &= ~EPOLLOUT;
+			events &= ~EPOLLIN;
 		else
-			dcb->active = EPOLLOUT;
+			dcb->active = EPOLLIN;
 		spin_unlock_irq(&dmabuf->poll.lock);
 
-		if (!(events & EPOLLOUT))
-			goto out;
-
-		for (i = 0; i < shared_count; ++i) {
-			struct dma_fence *fence = rcu_dereference(fobj->shared[i]);
-
-			if (!dma_fence_get_rcu(fence)) {
-				/*
-				 * fence refcount dropped to zero, this means
-				 * that fobj has been freed
-				 *
-				 * call dma_buf_poll_cb and force a recheck!
-				 */
-				events &= ~EPOLLOUT;
+		if (events & EPOLLIN) {
+			if (dma_buf_poll_add_cb(resv, false, dcb))
+				events &= ~EPOLLIN;
+			else
 				dma_buf_poll_cb(NULL, &dcb->cb);
-				break;
-			}
-			if (!dma_fence_add_callback(fence, &dcb->cb,
-						    dma_buf_poll_cb)) {
-				dma_fence_put(fence);
-				events &= ~EPOLLOUT;
-				break;
-			}
-			dma_fence_put(fence);
 		}
-
-		/* No callback queued, wake up any additional waiters. */
-		if (i == shared_count)
-			dma_buf_poll_cb(NULL, &dcb->cb);
 	}
 
-out:
-	rcu_read_unlock();
 	return events;
 }
 
@@ -430,6 +617,9 @@ static long dma_buf_ioctl(struct file *file,
 	case DMA_BUF_SET_NAME_B:
 		return dma_buf_set_name(dmabuf, (const char __user *)arg);
 
+	case DMA_BUF_IOCTL_TRANSFER_CHARGE:
+		return dma_buf_transfer_charge(dmabuf, current);
+
 	default:
 		return -ENOTTY;
 	}
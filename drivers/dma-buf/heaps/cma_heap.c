@@ -21,6 +21,7 @@
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <uapi/linux/dma-heap.h>
 
 
 struct cma_heap {
@@ -284,6 +285,10 @@ static struct dma_buf *cma_heap_allocate(struct dma_heap *heap,
 	int ret = -ENOMEM;
 	pgoff_t pg;
 
+	/* cma_alloc() always migrates pages out of the area */
+	if (heap_flags & DMA_HEAP_FLAG_NO_RECLAIM)
+		return ERR_PTR(-EOPNOTSUPP);
+
 	buffer = kzalloc(sizeof(*buffer), GFP_KERNEL);
 	if (!buffer)
 		return ERR_PTR(-ENOMEM);
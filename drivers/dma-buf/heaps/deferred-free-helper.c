@@ -10,6 +10,7 @@
 
 #include <linux/freezer.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/sched/signal.h>
@@ -18,10 +19,14 @@
 
 static LIST_HEAD(free_list);
 static size_t list_nr_pages;
-wait_queue_head_t freelist_waitqueue;
+DECLARE_WAIT_QUEUE_HEAD(freelist_waitqueue);
 struct task_struct *freelist_task;
 static DEFINE_SPINLOCK(free_list_lock);
 
+static LIST_HEAD(idle_workers);
+static DEFINE_MUTEX(idle_workers_lock);
+static bool idle_pending;
+
 void deferred_free(struct deferred_freelist_item *item,
 		   void (*free)(struct deferred_freelist_item*,
 				enum df_reason),
@@ -74,6 +79,51 @@ unsigned long get_freelist_nr_pages(void)
 }
 EXPORT_SYMBOL_GPL(get_freelist_nr_pages);
 
+void deferred_idle_worker_register(struct deferred_idle_worker *w)
+{
+	mutex_lock(&idle_workers_lock);
+	list_add_tail(&w->list, &idle_workers);
+	mutex_unlock(&idle_workers_lock);
+	deferred_idle_kick();
+}
+EXPORT_SYMBOL_GPL(deferred_idle_worker_register);
+
+void deferred_idle_worker_unregister(struct deferred_idle_worker *w)
+{
+	mutex_lock(&idle_workers_lock);
+	list_del(&w->list);
+	mutex_unlock(&idle_workers_lock);
+}
+EXPORT_SYMBOL_GPL(deferred_idle_worker_unregister);
+
+void deferred_idle_kick(void)
+{
+	WRITE_ONCE(idle_pending, true);
+	wake_up(&freelist_waitqueue);
+}
+EXPORT_SYMBOL_GPL(deferred_idle_kick);
+
+static void run_idle_workers(void)
+{
+	struct deferred_idle_worker *w;
+	bool more = false;
+
+	/*
+	 * Workers look at their state after this, so a kick racing with
+	 * the run is either seen by the workers or leaves idle_pending set.
+	 */
+	if (!xchg(&idle_pending, false))
+		return;
+
+	mutex_lock(&idle_workers_lock);
+	list_for_each_entry(w, &idle_workers, list)
+		more |= w->run(w);
+	mutex_unlock(&idle_workers_lock);
+
+	if (more)
+		WRITE_ONCE(idle_pending, true);
+}
+
 static unsigned long freelist_shrink_count(struct shrinker *shrinker,
 					   struct shrink_control *sc)
 {
@@ -111,9 +161,15 @@ static int deferred_free_thread(void *data)
 {
 	while (true) {
 		wait_event_freezable(freelist_waitqueue,
-				     get_freelist_nr_pages() > 0);
+				     get_freelist_nr_pages() > 0 ||
+				     READ_ONCE(idle_pending));
+
+		/* Freeing always goes ahead of idle work */
+		if (free_one_item(DF_NORMAL))
+			continue;
 
-		free_one_item(DF_NORMAL);
+		run_idle_workers();
+		cond_resched();
 	}
 
 	return 0;
@@ -123,7 +179,6 @@ static int deferred_freelist_init(void)
 {
 	list_nr_pages = 0;
 
-	init_waitqueue_head(&freelist_waitqueue);
 	freelist_task = kthread_run(deferred_free_thread, NULL,
 				    "%s", "dmabuf-deferred-free-worker");
 	if (IS_ERR(freelist_task)) {
@@ -54,4 +54,23 @@ void deferred_free(struct deferred_freelist_item *item,
 		   size_t nr_pages);
 
 unsigned long get_freelist_nr_pages(void);
+
+/**
+ * deferred_idle_worker - background work run by the deferred free thread
+ *
+ * Idle workers are run by the deferred free thread whenever it has no
+ * items left to free, after deferred_idle_kick() was called.
+ *
+ * @run: function doing a bounded amount of work, returns true if more
+ *       work is left, in which case it will be called again
+ * @list: list entry for the idle worker list
+ */
+struct deferred_idle_worker {
+	bool (*run)(struct deferred_idle_worker *w);
+	struct list_head list;
+};
+
+void deferred_idle_worker_register(struct deferred_idle_worker *w);
+void deferred_idle_worker_unregister(struct deferred_idle_worker *w);
+void deferred_idle_kick(void);
 #endif
@@ -9,15 +9,21 @@
  */
 
 #include <linux/freezer.h>
+#include <linux/highmem.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/sched/signal.h>
+#include <linux/sizes.h>
 #include "page_pool.h"
 
 static LIST_HEAD(pool_list);
 static DEFINE_MUTEX(pool_list_lock);
 
+/* Bytes each per-cpu cache of a pool may hold before it is drained */
+#define DMABUF_PAGE_POOL_PCP_BYTES	SZ_1M
+
 static inline
 struct page *dmabuf_page_pool_alloc_pages(struct dmabuf_page_pool *pool)
 {
@@ -26,27 +32,51 @@ struct page *dmabuf_page_pool_alloc_pages(struct dmabuf_page_pool *pool)
 	return alloc_pages(pool->gfp_mask, pool->order);
 }
 
+static inline void dmabuf_page_pool_account(struct dmabuf_page_pool *pool,
+					    struct page *page, int sign)
+{
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    sign * (1 << pool->order));
+}
+
 static inline void dmabuf_page_pool_free_pages(struct dmabuf_page_pool *pool,
 					       struct page *page)
 {
+	dmabuf_page_pool_account(pool, page, -1);
 	__free_pages(page, pool->order);
 }
 
-static void dmabuf_page_pool_add(struct dmabuf_page_pool *pool, struct page *page)
+static inline int dmabuf_page_pool_index(struct page *page)
 {
-	int index;
+	return PageHighMem(page) ? POOL_HIGHPAGE : POOL_LOWPAGE;
+}
 
-	if (PageHighMem(page))
-		index = POOL_HIGHPAGE;
-	else
-		index = POOL_LOWPAGE;
+/*
+ * clear_highpage() ends up in the arch clear_page(), which avoids pulling
+ * the page into the cache where it can (DC ZVA on arm64, rep stos on x86).
+ */
+static void dmabuf_page_pool_clear(struct dmabuf_page_pool *pool,
+				   struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++)
+		clear_highpage(page + i);
+}
+
+static void dmabuf_page_pool_add(struct dmabuf_page_pool *pool,
+				 struct list_head *pages)
+{
+	struct page *page, *tmp;
+	int index;
 
 	mutex_lock(&pool->mutex);
-	list_add_tail(&page->lru, &pool->items[index]);
-	pool->count[index]++;
+	list_for_each_entry_safe(page, tmp, pages, lru) {
+		index = dmabuf_page_pool_index(page);
+		list_move_tail(&page->lru, &pool->items[index]);
+		pool->count[index]++;
+	}
 	mutex_unlock(&pool->mutex);
-	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
-			    1 << pool->order);
 }
 
 static struct page *dmabuf_page_pool_remove(struct dmabuf_page_pool *pool, int index)
@@ -58,34 +88,166 @@ static struct page *dmabuf_page_pool_remove(struct dmabuf_page_pool *pool, int i
 	if (page) {
 		pool->count[index]--;
 		list_del(&page->lru);
-		mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
-				    -(1 << pool->order));
 	}
 	mutex_unlock(&pool->mutex);
 
 	return page;
 }
 
-static struct page *dmabuf_page_pool_fetch(struct dmabuf_page_pool *pool)
+static struct page *dmabuf_page_pool_remove_dirty(struct dmabuf_page_pool *pool,
+						  int index)
 {
-	struct page *page = NULL;
+	struct page *page;
 
-	page = dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
-	if (!page)
-		page = dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+	mutex_lock(&pool->mutex);
+	page = list_first_entry_or_null(&pool->dirty_items[index], struct page,
+					lru);
+	if (page) {
+		pool->dirty_count[index]--;
+		list_del(&page->lru);
+	}
+	mutex_unlock(&pool->mutex);
+
+	return page;
+}
+
+/* Move up to @nr pages, highmem first, from the shared lists to @pages */
+static int dmabuf_page_pool_remove_batch(struct dmabuf_page_pool *pool,
+					 struct list_head *pages, int nr)
+{
+	struct page *page;
+	int index, n = 0;
+
+	mutex_lock(&pool->mutex);
+	for (index = POOL_HIGHPAGE; index >= POOL_LOWPAGE; index--) {
+		while (n < nr) {
+			page = list_first_entry_or_null(&pool->items[index],
+							struct page, lru);
+			if (!page)
+				break;
+			list_move_tail(&page->lru, pages);
+			pool->count[index]--;
+			n++;
+		}
+	}
+	mutex_unlock(&pool->mutex);
+
+	return n;
+}
+
+static void dmabuf_page_pool_pcp_add(struct dmabuf_page_pool_pcp *pcp,
+				     struct page *page)
+{
+	list_add(&page->lru, &pcp->items);
+	pcp->count[dmabuf_page_pool_index(page)]++;
+}
+
+static struct page *dmabuf_page_pool_pcp_take(struct dmabuf_page_pool_pcp *pcp,
+					      bool hot)
+{
+	struct page *page;
+
+	if (list_empty(&pcp->items))
+		return NULL;
+
+	page = hot ? list_first_entry(&pcp->items, struct page, lru) :
+		     list_last_entry(&pcp->items, struct page, lru);
+	list_del(&page->lru);
+	pcp->count[dmabuf_page_pool_index(page)]--;
+
+	return page;
+}
+
+static int dmabuf_page_pool_pcp_total(struct dmabuf_page_pool_pcp *pcp)
+{
+	return pcp->count[POOL_LOWPAGE] + pcp->count[POOL_HIGHPAGE];
+}
+
+/* Hand all pages of the per-cpu caches back to the shared lists */
+static void dmabuf_page_pool_drain_pcp(struct dmabuf_page_pool *pool)
+{
+	struct dmabuf_page_pool_pcp *pcp;
+	LIST_HEAD(pages);
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock(&pcp->lock);
+		list_splice_tail_init(&pcp->items, &pages);
+		for (i = 0; i < POOL_TYPE_SIZE; i++)
+			pcp->count[i] = 0;
+		spin_unlock(&pcp->lock);
+	}
+
+	dmabuf_page_pool_add(pool, &pages);
+}
+
+/**
+ * dmabuf_page_pool_fetch - take a page from the pool only
+ * @pool:	pool to take the page from
+ *
+ * Like dmabuf_page_pool_alloc(), but never falls back to the page
+ * allocator, so callers can pick their own gfp flags for that.
+ *
+ * Return: a zeroed page of the pool order, or NULL if the pool is empty.
+ */
+struct page *dmabuf_page_pool_fetch(struct dmabuf_page_pool *pool)
+{
+	struct dmabuf_page_pool_pcp *pcp;
+	struct page *page, *page_next, *tmp;
+	LIST_HEAD(pages);
+
+	if (WARN_ON(!pool))
+		return NULL;
+
+	/*
+	 * Migrating between taking the pointer and the lock only costs us
+	 * the locality of another cpu's cache; its lock still protects it.
+	 */
+	pcp = raw_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	page = dmabuf_page_pool_pcp_take(pcp, true);
+	if (page)
+		pcp->hits++;
+	spin_unlock(&pcp->lock);
+
+	if (!page && dmabuf_page_pool_remove_batch(pool, &pages,
+						   pool->pcp_batch)) {
+		page = list_first_entry(&pages, struct page, lru);
+		list_del(&page->lru);
+
+		pcp = raw_cpu_ptr(pool->pcp);
+		spin_lock(&pcp->lock);
+		list_for_each_entry_safe(page_next, tmp, &pages, lru)
+			dmabuf_page_pool_pcp_add(pcp, page_next);
+		pcp->refills++;
+		spin_unlock(&pcp->lock);
+	}
+
+	/* Out of clean pages, zeroing a dirty one still beats the buddy */
+	if (!page) {
+		page = dmabuf_page_pool_remove_dirty(pool, POOL_HIGHPAGE);
+		if (!page)
+			page = dmabuf_page_pool_remove_dirty(pool, POOL_LOWPAGE);
+		if (page)
+			dmabuf_page_pool_clear(pool, page);
+	}
 
+	if (page)
+		dmabuf_page_pool_account(pool, page, -1);
 	return page;
 }
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_fetch);
 
 struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool)
 {
-	struct page *page = NULL;
+	struct page *page;
 
 	if (WARN_ON(!pool))
 		return NULL;
 
 	page = dmabuf_page_pool_fetch(pool);
-
 	if (!page)
 		page = dmabuf_page_pool_alloc_pages(pool);
 	return page;
@@ -94,65 +256,241 @@ EXPORT_SYMBOL_GPL(dmabuf_page_pool_alloc);
 
 void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page)
 {
+	struct dmabuf_page_pool_pcp *pcp;
+	LIST_HEAD(pages);
+	int i;
+
 	if (WARN_ON(pool->order != compound_order(page)))
 		return;
 
-	dmabuf_page_pool_add(pool, page);
+	dmabuf_page_pool_account(pool, page, 1);
+
+	pcp = raw_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	dmabuf_page_pool_pcp_add(pcp, page);
+	if (dmabuf_page_pool_pcp_total(pcp) > pool->pcp_high) {
+		/* Return the coldest pages */
+		for (i = 0; i < pool->pcp_batch; i++)
+			list_add(&dmabuf_page_pool_pcp_take(pcp, false)->lru,
+				 &pages);
+		pcp->drains++;
+	}
+	spin_unlock(&pcp->lock);
+
+	if (!list_empty(&pages))
+		dmabuf_page_pool_add(pool, &pages);
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_free);
 
+/**
+ * dmabuf_page_pool_free_dirty - return a page that was not zeroed yet
+ * @pool: pool of the page's order
+ * @page: page to return
+ *
+ * The page is only handed out again after dmabuf_page_pool_zero_dirty()
+ * or an allocation finding no clean page zeroed it.
+ */
+void dmabuf_page_pool_free_dirty(struct dmabuf_page_pool *pool,
+				 struct page *page)
+{
+	int index = dmabuf_page_pool_index(page);
+
+	if (WARN_ON(pool->order != compound_order(page)))
+		return;
+
+	dmabuf_page_pool_account(pool, page, 1);
+
+	mutex_lock(&pool->mutex);
+	list_add_tail(&page->lru, &pool->dirty_items[index]);
+	pool->dirty_count[index]++;
+	mutex_unlock(&pool->mutex);
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_free_dirty);
+
+/**
+ * dmabuf_page_pool_zero_dirty - zero dirty pages and make them allocatable
+ * @pool: pool to work on
+ * @nr_pages: number of base pages to zero at most, rounded up to a
+ *            whole pool page
+ *
+ * Returns true if dirty pages are left in the pool.
+ */
+bool dmabuf_page_pool_zero_dirty(struct dmabuf_page_pool *pool,
+				 unsigned long nr_pages)
+{
+	unsigned long zeroed = 0;
+	struct page *page;
+	LIST_HEAD(pages);
+	int index;
+
+	for (index = POOL_HIGHPAGE; index >= POOL_LOWPAGE; index--) {
+		while (zeroed < nr_pages) {
+			page = dmabuf_page_pool_remove_dirty(pool, index);
+			if (!page)
+				break;
+
+			dmabuf_page_pool_clear(pool, page);
+			list_add_tail(&page->lru, &pages);
+			zeroed += 1 << pool->order;
+		}
+	}
+
+	if (!list_empty(&pages))
+		dmabuf_page_pool_add(pool, &pages);
+
+	return READ_ONCE(pool->dirty_count[POOL_LOWPAGE]) ||
+	       READ_ONCE(pool->dirty_count[POOL_HIGHPAGE]);
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_zero_dirty);
+
 static int dmabuf_page_pool_total(struct dmabuf_page_pool *pool, bool high)
 {
-	int count = pool->count[POOL_LOWPAGE];
+	int count = pool->count[POOL_LOWPAGE] + pool->dirty_count[POOL_LOWPAGE];
+	struct dmabuf_page_pool_pcp *pcp;
+	int cpu;
 
 	if (high)
-		count += pool->count[POOL_HIGHPAGE];
+		count += pool->count[POOL_HIGHPAGE] +
+			 pool->dirty_count[POOL_HIGHPAGE];
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+		count += READ_ONCE(pcp->count[POOL_LOWPAGE]);
+		if (high)
+			count += READ_ONCE(pcp->count[POOL_HIGHPAGE]);
+	}
 
 	return count << pool->order;
 }
 
+void dmabuf_page_pool_get_stats(struct dmabuf_page_pool *pool,
+				struct dmabuf_page_pool_stats *stats)
+{
+	struct dmabuf_page_pool_pcp *pcp;
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock(&pcp->lock);
+		stats->pcp_count += dmabuf_page_pool_pcp_total(pcp);
+		stats->hits += pcp->hits;
+		stats->refills += pcp->refills;
+		stats->drains += pcp->drains;
+		spin_unlock(&pcp->lock);
+	}
+
+	stats->dirty = READ_ONCE(pool->dirty_count[POOL_LOWPAGE]) +
+		       READ_ONCE(pool->dirty_count[POOL_HIGHPAGE]);
+	stats->count = READ_ONCE(pool->count[POOL_LOWPAGE]) +
+		       READ_ONCE(pool->count[POOL_HIGHPAGE]) + stats->pcp_count +
+		       stats->dirty;
+}
+EXPORT_SYMBOL_GPL(dmabuf_page_pool_get_stats);
+
+/**
+ * dmabuf_page_pool_create - get the pool of pages of a gfp_mask and order
+ * @gfp_mask:	flags to allocate new pages with
+ * @order:	order of the pages
+ *
+ * Pools are shared, if a pool for @gfp_mask and @order exists already a
+ * reference to it is returned. Every call must be paired with a call to
+ * dmabuf_page_pool_destroy().
+ *
+ * Return: the pool, or NULL if it could not be allocated.
+ */
 struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask, unsigned int order)
 {
-	struct dmabuf_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
-	int i;
+	struct dmabuf_page_pool *pool;
+	struct dmabuf_page_pool_pcp *pcp;
+	int i, cpu;
+
+	gfp_mask |= __GFP_COMP;
 
+	mutex_lock(&pool_list_lock);
+	list_for_each_entry(pool, &pool_list, list) {
+		if (pool->gfp_mask == gfp_mask && pool->order == order) {
+			kref_get(&pool->kref);
+			goto out;
+		}
+	}
+
+	pool = kmalloc(sizeof(*pool), GFP_KERNEL);
 	if (!pool)
-		return NULL;
+		goto out;
+
+	pool->pcp = alloc_percpu(struct dmabuf_page_pool_pcp);
+	if (!pool->pcp) {
+		kfree(pool);
+		pool = NULL;
+		goto out;
+	}
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(pool->pcp, cpu);
+		spin_lock_init(&pcp->lock);
+		INIT_LIST_HEAD(&pcp->items);
+	}
 
 	for (i = 0; i < POOL_TYPE_SIZE; i++) {
 		pool->count[i] = 0;
 		INIT_LIST_HEAD(&pool->items[i]);
+		pool->dirty_count[i] = 0;
+		INIT_LIST_HEAD(&pool->dirty_items[i]);
 	}
-	pool->gfp_mask = gfp_mask | __GFP_COMP;
+	pool->gfp_mask = gfp_mask;
 	pool->order = order;
+	pool->pcp_high = max_t(int, 2, DMABUF_PAGE_POOL_PCP_BYTES >>
+					 (PAGE_SHIFT + order));
+	pool->pcp_batch = pool->pcp_high / 2;
 	mutex_init(&pool->mutex);
+	kref_init(&pool->kref);
 
-	mutex_lock(&pool_list_lock);
 	list_add(&pool->list, &pool_list);
+out:
 	mutex_unlock(&pool_list_lock);
 
 	return pool;
 }
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_create);
 
-void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool)
+/* Called with pool_list_lock held */
+static void dmabuf_page_pool_release(struct kref *kref)
 {
+	struct dmabuf_page_pool *pool;
 	struct page *page;
 	int i;
 
-	/* Remove us from the pool list */
-	mutex_lock(&pool_list_lock);
+	pool = container_of(kref, struct dmabuf_page_pool, kref);
 	list_del(&pool->list);
-	mutex_unlock(&pool_list_lock);
 
 	/* Free any remaining pages in the pool */
+	dmabuf_page_pool_drain_pcp(pool);
 	for (i = 0; i < POOL_TYPE_SIZE; i++) {
 		while ((page = dmabuf_page_pool_remove(pool, i)))
 			dmabuf_page_pool_free_pages(pool, page);
+		while ((page = dmabuf_page_pool_remove_dirty(pool, i)))
+			dmabuf_page_pool_free_pages(pool, page);
 	}
 
+	free_percpu(pool->pcp);
 	kfree(pool);
 }
+
+/**
+ * dmabuf_page_pool_destroy - put a pool from dmabuf_page_pool_create()
+ * @pool:	pool to put
+ *
+ * The pool and the pages it holds are freed when its last user is gone.
+ */
+void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool)
+{
+	mutex_lock(&pool_list_lock);
+	kref_put(&pool->kref, dmabuf_page_pool_release);
+	mutex_unlock(&pool_list_lock);
+}
 EXPORT_SYMBOL_GPL(dmabuf_page_pool_destroy);
 
 static int dmabuf_page_pool_do_shrink(struct dmabuf_page_pool *pool, gfp_t gfp_mask,
@@ -169,11 +507,18 @@ static int dmabuf_page_pool_do_shrink(struct dmabuf_page_pool *pool, gfp_t gfp_m
 	if (nr_to_scan == 0)
 		return dmabuf_page_pool_total(pool, high);
 
+	dmabuf_page_pool_drain_pcp(pool);
+
 	while (freed < nr_to_scan) {
 		struct page *page;
 
-		/* Try to free low pages first */
-		page = dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
+		/* Try to free dirty pages, then low pages first */
+		page = dmabuf_page_pool_remove_dirty(pool, POOL_LOWPAGE);
+		if (!page)
+			page = dmabuf_page_pool_remove_dirty(pool,
+							     POOL_HIGHPAGE);
+		if (!page)
+			page = dmabuf_page_pool_remove(pool, POOL_LOWPAGE);
 		if (!page)
 			page = dmabuf_page_pool_remove(pool, POOL_HIGHPAGE);
 
@@ -15,6 +15,7 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/shrinker.h>
+#include <linux/spinlock.h>
 #include <linux/types.h>
 
 /* page types we track in the pool */
@@ -25,31 +26,96 @@ enum {
 	POOL_TYPE_SIZE,
 };
 
+/**
+ * struct dmabuf_page_pool_pcp - per-cpu front cache of a pagepool
+ * @lock:		lock protecting this struct, normally only taken by
+ *			the local cpu
+ * @count[]:		array of number of pages of that type in @items
+ * @items:		list of cached pages of both types
+ * @hits:		allocations served from @items
+ * @refills:		batches moved from the shared lists into @items
+ * @drains:		batches moved from @items back to the shared lists
+ */
+struct dmabuf_page_pool_pcp {
+	spinlock_t lock;
+	int count[POOL_TYPE_SIZE];
+	struct list_head items;
+	unsigned long hits;
+	unsigned long refills;
+	unsigned long drains;
+};
+
+/**
+ * struct dmabuf_page_pool_stats - pagepool statistics
+ * @count:		pages of the pool order held, including @pcp_count
+ *			and @dirty
+ * @pcp_count:		pages held in the per-cpu caches
+ * @dirty:		pages waiting to be zeroed
+ * @hits:		allocations served from the per-cpu caches
+ * @refills:		per-cpu cache refills from the shared lists
+ * @drains:		per-cpu cache drains to the shared lists
+ */
+struct dmabuf_page_pool_stats {
+	int count;
+	int pcp_count;
+	int dirty;
+	unsigned long hits;
+	unsigned long refills;
+	unsigned long drains;
+};
+
 /**
  * struct dmabuf_page_pool - pagepool struct
  * @count[]:		array of number of pages of that type in the pool
  * @items[]:		array of list of pages of the specific type
+ * @dirty_count[]:	array of number of pages of that type to be zeroed
+ * @dirty_items[]:	array of list of pages of the specific type that
+ *			still need to be zeroed
  * @mutex:		lock protecting this struct and especially the count
  *			item list
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		list node for list of pools
+ * @kref:		users sharing the pool
+ * @pcp:		per-cpu front caches
+ * @pcp_high:		pages a per-cpu cache may hold before it is drained
+ * @pcp_batch:		pages moved per refill or drain
+ *
+ * Allows you to keep a pool of pre allocated pages to use. Pages are
+ * allocated from and freed to the per-cpu caches, which only take the
+ * mutex to exchange @pcp_batch pages at a time with the shared lists.
+ * Pages freed with dmabuf_page_pool_free_dirty() are parked on the dirty
+ * lists until dmabuf_page_pool_zero_dirty() moves them to the clean ones.
  *
- * Allows you to keep a pool of pre allocated pages to use
+ * There is one pool per gfp_mask and order, shared by every heap asking
+ * for them, so that the dma-buf heaps and ION reuse each other's pages.
  */
 struct dmabuf_page_pool {
 	int count[POOL_TYPE_SIZE];
 	struct list_head items[POOL_TYPE_SIZE];
+	int dirty_count[POOL_TYPE_SIZE];
+	struct list_head dirty_items[POOL_TYPE_SIZE];
 	struct mutex mutex;
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct list_head list;
+	struct kref kref;
+	struct dmabuf_page_pool_pcp __percpu *pcp;
+	int pcp_high;
+	int pcp_batch;
 };
 
 struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
 						 unsigned int order);
 void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool);
 struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool);
+struct page *dmabuf_page_pool_fetch(struct dmabuf_page_pool *pool);
 void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page);
+void dmabuf_page_pool_free_dirty(struct dmabuf_page_pool *pool,
+				 struct page *page);
+bool dmabuf_page_pool_zero_dirty(struct dmabuf_page_pool *pool,
+				 unsigned long nr_pages);
+void dmabuf_page_pool_get_stats(struct dmabuf_page_pool *pool,
+				struct dmabuf_page_pool_stats *stats);
 
 #endif /* _DMABUF_PAGE_POOL_H */
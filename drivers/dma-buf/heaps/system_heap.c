@@ -10,20 +10,37 @@
  *	Andrew F. Davis <afd@ti.com>
  */
 
+#include <linux/debugfs.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-mapping.h>
 #include <linux/dma-heap.h>
 #include <linux/err.h>
 #include <linux/highmem.h>
+#include <linux/huge_mm.h>
+#include <linux/ktime.h>
 #include <linux/mm.h>
+#include <linux/pfn_t.h>
 #include <linux/module.h>
 #include <linux/scatterlist.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/dma-heap.h>
 
 #include "page_pool.h"
 #include "deferred-free-helper.h"
 
+enum system_heap_source {
+	SYSTEM_HEAP_SRC_POOL,
+	SYSTEM_HEAP_SRC_BUDDY,
+	SYSTEM_HEAP_SRC_RECLAIM,
+	SYSTEM_HEAP_SRC_RESERVE,
+};
+
+#define CREATE_TRACE_POINTS
+#include "system_heap_trace.h"
+
 static struct dma_heap *sys_heap;
 static struct dma_heap *sys_uncached_heap;
 
@@ -37,33 +54,109 @@ struct system_heap_buffer {
 	void *vaddr;
 	struct deferred_freelist_item deferred_free;
 
+	/* The buffer's page chunks and their offsets, for mmap faults */
+	struct system_heap_chunk *chunks;
+	unsigned int nr_chunks;
+
+	/* Idle and in use DMA mappings, if cache_mappings was set */
+	struct list_head mappings;
+	bool cache_mappings;
+
 	bool uncached;
 };
 
+struct system_heap_mapping {
+	struct device *dev;
+	struct sg_table *table;
+	enum dma_data_direction dir;
+	unsigned long attrs;
+	int users;
+	struct list_head list;
+};
+
+struct system_heap_chunk {
+	pgoff_t pgoff;
+	struct page *page;
+};
+
 struct dma_heap_attachment {
 	struct device *dev;
 	struct sg_table *table;
 	struct list_head list;
 	bool mapped;
+	struct system_heap_mapping *mapping;
 
 	bool uncached;
+	bool cached;
 };
 
+/*
+ * Keep a buffer's DMA mapping for a device after it was unmapped, so the
+ * next map_dma_buf from that device, through any attachment, reuses it
+ * without touching the IOMMU or the caches. Idle mappings are torn down
+ * on begin_cpu_access and on release, so CPU access to such buffers must
+ * be bracketed by DMA_BUF_IOCTL_SYNC.
+ */
+static bool cache_mappings;
+module_param(cache_mappings, bool, 0644);
+MODULE_PARM_DESC(cache_mappings, "Reuse DMA mappings across unmap/map cycles");
+
+/*
+ * Memory set aside for DMA_HEAP_FLAG_NO_RECLAIM allocations that find
+ * neither pooled pages nor free memory in the buddy allocator. It is only
+ * sized at heap creation and refilled in the background as it is used.
+ */
+static unsigned int reserve_mb;
+module_param(reserve_mb, uint, 0444);
+MODULE_PARM_DESC(reserve_mb, "MiB reserved for no-reclaim allocations");
+
 #define HIGH_ORDER_GFP  (((GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN \
 				| __GFP_NORETRY) & ~__GFP_RECLAIM) \
 				| __GFP_COMP)
 #define LOW_ORDER_GFP (GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP)
-static gfp_t order_flags[] = {HIGH_ORDER_GFP, LOW_ORDER_GFP, LOW_ORDER_GFP};
+/* Background refills of the reserve may reclaim, but must not OOM */
+#define RESERVE_GFP (LOW_ORDER_GFP | __GFP_NOWARN | __GFP_NORETRY)
+static gfp_t order_flags[] = {HIGH_ORDER_GFP, HIGH_ORDER_GFP, LOW_ORDER_GFP,
+			      LOW_ORDER_GFP};
 /*
  * The selection of the orders used for allocation (1MB, 64K, 4K) is designed
  * to match with the sizes often found in IOMMUs. Using order 4 pages instead
  * of order 0 pages can significantly improve the performance of many IOMMUs
  * by reducing TLB pressure and time spent updating page tables.
+ *
+ * On top of that, order 9 (2MB) chunks can be mapped to user space with a
+ * single PMD each, see system_heap_vm_huge_fault().
  */
-static const unsigned int orders[] = {8, 4, 0};
+static const unsigned int orders[] = {9, 8, 4, 0};
 #define NUM_ORDERS ARRAY_SIZE(orders)
+/* Base pages zeroed per pool in one pass of the zero worker */
+#define SYSTEM_HEAP_ZERO_BATCH	256
 struct dmabuf_page_pool *pools[NUM_ORDERS];
 
+/* The reserve holds order 4 pages, plus order 0 ones for buffer tails */
+#define RESERVE_HIGH_ORDER	4
+#define RESERVE_LOW_PAGES	256
+
+/**
+ * struct system_heap_reserve - pages held back for no-reclaim allocations
+ * @lock:	protects @items, @count and @pages
+ * @items:	list of free pages per index in orders[]
+ * @count:	number of pages in each of @items
+ * @pages:	base pages held in all of @items
+ * @target:	base pages the refill work keeps in the reserve
+ * @refill:	work topping the reserve back up to @target
+ */
+struct system_heap_reserve {
+	spinlock_t lock;
+	struct list_head items[NUM_ORDERS];
+	unsigned long count[NUM_ORDERS];
+	unsigned long pages;
+	unsigned long target;
+	struct work_struct refill;
+};
+
+static struct system_heap_reserve reserve;
+
 static struct sg_table *dup_sg_table(struct sg_table *table)
 {
 	struct sg_table *new_table;
@@ -100,17 +193,21 @@ static int system_heap_attach(struct dma_buf *dmabuf,
 	if (!a)
 		return -ENOMEM;
 
-	table = dup_sg_table(&buffer->sg_table);
-	if (IS_ERR(table)) {
-		kfree(a);
-		return -ENOMEM;
+	/* Cached mappings come with their own table */
+	if (!buffer->cache_mappings) {
+		table = dup_sg_table(&buffer->sg_table);
+		if (IS_ERR(table)) {
+			kfree(a);
+			return -ENOMEM;
+		}
+		a->table = table;
 	}
 
-	a->table = table;
 	a->dev = attachment->dev;
 	INIT_LIST_HEAD(&a->list);
 	a->mapped = false;
 	a->uncached = buffer->uncached;
+	a->cached = buffer->cache_mappings;
 	attachment->priv = a;
 
 	mutex_lock(&buffer->lock);
@@ -130,11 +227,96 @@ static void system_heap_detach(struct dma_buf *dmabuf,
 	list_del(&a->list);
 	mutex_unlock(&buffer->lock);
 
-	sg_free_table(a->table);
-	kfree(a->table);
+	if (!a->cached) {
+		sg_free_table(a->table);
+		kfree(a->table);
+	}
 	kfree(a);
 }
 
+static struct sg_table *system_heap_map_cached(struct system_heap_buffer *buffer,
+					       struct dma_heap_attachment *a,
+					       enum dma_data_direction direction,
+					       unsigned long attr)
+{
+	struct system_heap_mapping *m;
+	struct sg_table *table;
+	int ret;
+
+	mutex_lock(&buffer->lock);
+	list_for_each_entry(m, &buffer->mappings, list) {
+		if (m->dev == a->dev && m->dir == direction && m->attrs == attr)
+			goto found;
+	}
+
+	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	if (!m) {
+		ret = -ENOMEM;
+		goto err_unlock;
+	}
+
+	table = dup_sg_table(&buffer->sg_table);
+	if (IS_ERR(table)) {
+		ret = PTR_ERR(table);
+		goto err_free;
+	}
+
+	ret = dma_map_sgtable(a->dev, table, direction, attr);
+	if (ret) {
+		sg_free_table(table);
+		kfree(table);
+		goto err_free;
+	}
+
+	m->dev = get_device(a->dev);
+	m->table = table;
+	m->dir = direction;
+	m->attrs = attr;
+	list_add(&m->list, &buffer->mappings);
+found:
+	m->users++;
+	a->mapping = m;
+	a->table = m->table;
+	a->mapped = true;
+	mutex_unlock(&buffer->lock);
+
+	return m->table;
+
+err_free:
+	kfree(m);
+err_unlock:
+	mutex_unlock(&buffer->lock);
+	return ERR_PTR(ret);
+}
+
+static void system_heap_unmap_cached(struct system_heap_buffer *buffer,
+				     struct dma_heap_attachment *a)
+{
+	mutex_lock(&buffer->lock);
+	a->mapping->users--;
+	a->mapping = NULL;
+	a->mapped = false;
+	mutex_unlock(&buffer->lock);
+}
+
+/* Tear down the cached mappings no attachment is using, under buffer->lock */
+static void system_heap_drop_idle_mappings(struct system_heap_buffer *buffer)
+{
+	struct system_heap_mapping *m, *tmp;
+
+	list_for_each_entry_safe(m, tmp, &buffer->mappings, list) {
+		if (m->users)
+			continue;
+
+		dma_unmap_sgtable(m->dev, m->table, m->dir, m->attrs);
+		sg_free_table(m->table);
+		kfree(m->table);
+		put_device(m->dev);
+		list_del(&m->list);
+		kfree(m);
+	}
+}
+
 static struct sg_table *system_heap_map_dma_buf(struct dma_buf_attachment *attachment,
 						enum dma_data_direction direction)
 {
@@ -146,6 +328,10 @@ static struct sg_table *system_heap_map_dma_buf(struct dma_buf_attachment *attac
 	if (a->uncached)
 		attr |= DMA_ATTR_SKIP_CPU_SYNC;
 
+	if (a->cached)
+		return system_heap_map_cached(attachment->dmabuf->priv, a,
+					      direction, attr);
+
 	ret = dma_map_sgtable(attachment->dev, table, direction, attr);
 	if (ret)
 		return ERR_PTR(ret);
@@ -161,6 +347,11 @@ static void system_heap_unmap_dma_buf(struct dma_buf_attachment *attachment,
 	struct dma_heap_attachment *a = attachment->priv;
 	int attr = attachment->dma_map_attrs;
 
+	if (a->cached) {
+		system_heap_unmap_cached(attachment->dmabuf->priv, a);
+		return;
+	}
+
 	if (a->uncached)
 		attr |= DMA_ATTR_SKIP_CPU_SYNC;
 	a->mapped = false;
@@ -178,6 +369,9 @@ static int system_heap_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 	if (buffer->vmap_cnt)
 		invalidate_kernel_vmap_range(buffer->vaddr, buffer->len);
 
+	/* Unmapping syncs idle cached mappings for the cpu */
+	system_heap_drop_idle_mappings(buffer);
+
 	if (!buffer->uncached) {
 		list_for_each_entry(a, &buffer->attachments, list) {
 			if (!a->mapped)
@@ -213,6 +407,104 @@ static int system_heap_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	return 0;
 }
 
+static struct system_heap_chunk *
+system_heap_find_chunk(struct system_heap_buffer *buffer, pgoff_t pgoff)
+{
+	unsigned int lo = 0, hi = buffer->nr_chunks;
+	struct system_heap_chunk *chunk;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		chunk = &buffer->chunks[mid];
+		if (pgoff < chunk->pgoff)
+			hi = mid;
+		else if (pgoff >= chunk->pgoff +
+				  (1UL << compound_order(chunk->page)))
+			lo = mid + 1;
+		else
+			return chunk;
+	}
+
+	return NULL;
+}
+
+static vm_fault_t system_heap_vm_fault(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	struct system_heap_buffer *buffer = vma->vm_private_data;
+	struct system_heap_chunk *chunk;
+	unsigned long addr, pfn, nr, i;
+	vm_fault_t ret = VM_FAULT_NOPAGE;
+
+	chunk = system_heap_find_chunk(buffer, vmf->pgoff);
+	if (!chunk)
+		return VM_FAULT_SIGBUS;
+
+	/* Map the whole chunk, as far as the vma covers it. */
+	pfn = page_to_pfn(chunk->page);
+	nr = 1UL << compound_order(chunk->page);
+	addr = vmf->address - ((vmf->pgoff - chunk->pgoff) << PAGE_SHIFT);
+	for (i = 0; i < nr; i++, addr += PAGE_SIZE) {
+		vm_fault_t r;
+
+		if (addr < vma->vm_start)
+			continue;
+		if (addr >= vma->vm_end)
+			break;
+
+		r = vmf_insert_pfn(vma, addr, pfn + i);
+		if (addr == (vmf->address & PAGE_MASK))
+			ret = r;
+		else if (r & VM_FAULT_ERROR)
+			break;
+	}
+
+	return ret;
+}
+
+static vm_fault_t system_heap_vm_huge_fault(struct vm_fault *vmf,
+					    enum page_entry_size pe_size)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	struct vm_area_struct *vma = vmf->vma;
+	struct system_heap_buffer *buffer = vma->vm_private_data;
+	unsigned long haddr = vmf->address & PMD_MASK;
+	struct system_heap_chunk *chunk;
+	unsigned long pfn;
+	pgoff_t pgoff;
+
+	if (pe_size != PE_SIZE_PMD)
+		return VM_FAULT_FALLBACK;
+
+	if (haddr < vma->vm_start || haddr + PMD_SIZE > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	pgoff = vmf->pgoff - ((vmf->address - haddr) >> PAGE_SHIFT);
+	chunk = system_heap_find_chunk(buffer, pgoff);
+	if (!chunk || compound_order(chunk->page) < HPAGE_PMD_ORDER)
+		return VM_FAULT_FALLBACK;
+
+	/*
+	 * Chunks are naturally aligned, so an aligned pfn inside a chunk of
+	 * at least PMD size has the whole PMD inside the chunk.
+	 */
+	pfn = page_to_pfn(chunk->page) + (pgoff - chunk->pgoff);
+	if (!IS_ALIGNED(pfn, HPAGE_PMD_NR))
+		return VM_FAULT_FALLBACK;
+
+	return vmf_insert_pfn_pmd(vmf, __pfn_to_pfn_t(pfn, PFN_DEV),
+				  vmf->flags & FAULT_FLAG_WRITE);
+#else
+	return VM_FAULT_FALLBACK;
+#endif
+}
+
+static const struct vm_operations_struct system_heap_vm_ops = {
+	.fault = system_heap_vm_fault,
+	.huge_fault = system_heap_vm_huge_fault,
+};
+
 static int system_heap_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 {
 	struct system_heap_buffer *buffer = dmabuf->priv;
@@ -224,6 +516,19 @@ static int system_heap_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
 	if (buffer->uncached)
 		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
 
+	/*
+	 * Shared mappings are populated on fault, a chunk at a time and with
+	 * PMDs where possible. Private writable mappings can't take PFN
+	 * PMDs, so keep remapping those up front.
+	 */
+	if ((vma->vm_flags & (VM_SHARED | VM_MAYWRITE)) != VM_MAYWRITE) {
+		vma->vm_flags |= VM_IO | VM_PFNMAP | VM_DONTEXPAND |
+				 VM_DONTDUMP | VM_HUGEPAGE;
+		vma->vm_ops = &system_heap_vm_ops;
+		vma->vm_private_data = buffer;
+		return 0;
+	}
+
 	for_each_sgtable_page(table, &piter, vma->vm_pgoff) {
 		struct page *page = sg_page_iter_page(&piter);
 
@@ -304,24 +609,6 @@ static void system_heap_vunmap(struct dma_buf *dmabuf, void *vaddr)
 	mutex_unlock(&buffer->lock);
 }
 
-static int system_heap_zero_buffer(struct system_heap_buffer *buffer)
-{
-	struct sg_table *sgt = &buffer->sg_table;
-	struct sg_page_iter piter;
-	struct page *p;
-	void *vaddr;
-	int ret = 0;
-
-	for_each_sgtable_page(sgt, &piter, 0) {
-		p = sg_page_iter_page(&piter);
-		vaddr = kmap_atomic(p);
-		memset(vaddr, 0, PAGE_SIZE);
-		kunmap_atomic(vaddr);
-	}
-
-	return ret;
-}
-
 static void system_heap_buf_free(struct deferred_freelist_item *item,
 				 enum df_reason reason)
 {
@@ -331,10 +618,6 @@ static void system_heap_buf_free(struct deferred_freelist_item *item,
 	int i, j;
 
 	buffer = container_of(item, struct system_heap_buffer, deferred_free);
-	/* Zero the buffer pages before adding back to the pool */
-	if (reason == DF_NORMAL)
-		if (system_heap_zero_buffer(buffer))
-			reason = DF_UNDER_PRESSURE; // On failure, just free
 
 	table = &buffer->sg_table;
 	for_each_sg(table->sgl, sg, table->nents, i) {
@@ -347,10 +630,14 @@ static void system_heap_buf_free(struct deferred_freelist_item *item,
 				if (compound_order(page) == orders[j])
 					break;
 			}
-			dmabuf_page_pool_free(pools[j], page);
+			/* Zeroed later by system_heap_zero_worker */
+			dmabuf_page_pool_free_dirty(pools[j], page);
 		}
 	}
+	if (reason == DF_NORMAL)
+		deferred_idle_kick();
 	sg_free_table(table);
+	kvfree(buffer->chunks);
 	kfree(buffer);
 }
 
@@ -359,9 +646,33 @@ static void system_heap_dma_buf_release(struct dma_buf *dmabuf)
 	struct system_heap_buffer *buffer = dmabuf->priv;
 	int npages = PAGE_ALIGN(buffer->len) / PAGE_SIZE;
 
+	mutex_lock(&buffer->lock);
+	system_heap_drop_idle_mappings(buffer);
+	mutex_unlock(&buffer->lock);
+
 	deferred_free(&buffer->deferred_free, system_heap_buf_free, npages);
 }
 
+/*
+ * Zero the pages freed back to the pools from the deferred free thread,
+ * once it has nothing left to free, so that allocations find clean pages.
+ */
+static bool system_heap_zero_pools(struct deferred_idle_worker *w)
+{
+	bool more = false;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		more |= dmabuf_page_pool_zero_dirty(pools[i],
+						    SYSTEM_HEAP_ZERO_BATCH);
+
+	return more;
+}
+
+static struct deferred_idle_worker system_heap_zero_worker = {
+	.run = system_heap_zero_pools,
+};
+
 static const struct dma_buf_ops system_heap_buf_ops = {
 	.attach = system_heap_attach,
 	.detach = system_heap_detach,
@@ -375,23 +686,137 @@ static const struct dma_buf_ops system_heap_buf_ops = {
 	.release = system_heap_dma_buf_release,
 };
 
-static struct page *alloc_largest_available(unsigned long size,
-					    unsigned int max_order)
+static int order_index(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (orders[i] == order)
+			break;
+	}
+	return i;
+}
+
+static void system_heap_reserve_refill(struct work_struct *work)
+{
+	unsigned long want, low;
+	struct page *page;
+	unsigned int order;
+	int i;
+
+	for (;;) {
+		spin_lock(&reserve.lock);
+		want = reserve.target - reserve.pages;
+		low = reserve.count[order_index(0)];
+		spin_unlock(&reserve.lock);
+		if (!want)
+			return;
+
+		if (low < RESERVE_LOW_PAGES || want < (1UL << RESERVE_HIGH_ORDER))
+			order = 0;
+		else
+			order = RESERVE_HIGH_ORDER;
+
+		page = alloc_pages(RESERVE_GFP, order);
+		if (!page)
+			return;
+
+		i = order_index(order);
+		spin_lock(&reserve.lock);
+		list_add(&page->lru, &reserve.items[i]);
+		reserve.count[i]++;
+		reserve.pages += 1UL << order;
+		spin_unlock(&reserve.lock);
+
+		cond_resched();
+	}
+}
+
+static struct page *system_heap_reserve_take(unsigned long size,
+					     unsigned int max_order)
+{
+	struct page *page = NULL;
+	int i;
+
+	spin_lock(&reserve.lock);
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << orders[i]) || max_order < orders[i])
+			continue;
+		page = list_first_entry_or_null(&reserve.items[i], struct page,
+						lru);
+		if (!page)
+			continue;
+		list_del(&page->lru);
+		reserve.count[i]--;
+		reserve.pages -= 1UL << orders[i];
+		break;
+	}
+	spin_unlock(&reserve.lock);
+
+	if (page)
+		queue_work(system_unbound_wq, &reserve.refill);
+	return page;
+}
+
+/*
+ * Allocate a page of orders[i] from its pool, else from the buddy
+ * allocator. Direct reclaim and compaction, if orders[i] allows them at
+ * all, are only attempted after a plain allocation failed and never for
+ * @no_reclaim allocations.
+ */
+static struct page *system_heap_alloc_order(int i, bool no_reclaim,
+					    enum system_heap_source *src)
 {
+	gfp_t gfp = order_flags[i];
 	struct page *page;
+
+	*src = SYSTEM_HEAP_SRC_POOL;
+	page = dmabuf_page_pool_fetch(pools[i]);
+	if (page)
+		return page;
+
+	*src = SYSTEM_HEAP_SRC_BUDDY;
+	page = alloc_pages((gfp & ~__GFP_DIRECT_RECLAIM) | __GFP_NOWARN,
+			   orders[i]);
+	if (page || no_reclaim || !(gfp & __GFP_DIRECT_RECLAIM))
+		return page;
+
+	*src = SYSTEM_HEAP_SRC_RECLAIM;
+	return alloc_pages(gfp, orders[i]);
+}
+
+static struct page *alloc_largest_available(unsigned long size,
+					    unsigned int max_order,
+					    bool no_reclaim)
+{
+	enum system_heap_source src;
+	struct page *page = NULL;
+	u64 start = 0;
 	int i;
 
+	if (trace_system_heap_alloc_chunk_enabled())
+		start = ktime_get_ns();
+
 	for (i = 0; i < NUM_ORDERS; i++) {
 		if (size <  (PAGE_SIZE << orders[i]))
 			continue;
 		if (max_order < orders[i])
 			continue;
-		page = dmabuf_page_pool_alloc(pools[i]);
-		if (!page)
-			continue;
-		return page;
+		page = system_heap_alloc_order(i, no_reclaim, &src);
+		if (page)
+			break;
 	}
-	return NULL;
+
+	if (!page && no_reclaim) {
+		src = SYSTEM_HEAP_SRC_RESERVE;
+		page = system_heap_reserve_take(size, max_order);
+	}
+
+	/* The latency includes the failed attempts at larger orders */
+	if (page && start)
+		trace_system_heap_alloc_chunk(compound_order(page), src,
+					      ktime_get_ns() - start);
+	return page;
 }
 
 static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
@@ -404,11 +829,15 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
 	unsigned long size_remaining = len;
 	unsigned int max_order = orders[0];
+	bool no_reclaim = heap_flags & DMA_HEAP_FLAG_NO_RECLAIM;
+	u64 start = ktime_get_ns();
 	struct dma_buf *dmabuf;
 	struct sg_table *table;
 	struct scatterlist *sg;
 	struct list_head pages;
 	struct page *page, *tmp_page;
+	unsigned int nr_chunks = 0;
+	pgoff_t pgoff;
 	int i, ret = -ENOMEM;
 
 	buffer = kzalloc(sizeof(*buffer), GFP_KERNEL);
@@ -416,13 +845,14 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 		return ERR_PTR(-ENOMEM);
 
 	INIT_LIST_HEAD(&buffer->attachments);
+	INIT_LIST_HEAD(&buffer->mappings);
 	mutex_init(&buffer->lock);
+	buffer->cache_mappings = READ_ONCE(cache_mappings);
 	buffer->heap = heap;
 	buffer->len = len;
 	buffer->uncached = uncached;
 
 	INIT_LIST_HEAD(&pages);
-	i = 0;
 	while (size_remaining > 0) {
 		/*
 		 * Avoid trying to allocate memory if the process
@@ -431,25 +861,39 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 		if (fatal_signal_pending(current))
 			goto free_buffer;
 
-		page = alloc_largest_available(size_remaining, max_order);
+		page = alloc_largest_available(size_remaining, max_order,
+					       no_reclaim);
 		if (!page)
 			goto free_buffer;
 
 		list_add_tail(&page->lru, &pages);
 		size_remaining -= page_size(page);
 		max_order = compound_order(page);
-		i++;
+		nr_chunks++;
 	}
 
 	table = &buffer->sg_table;
-	if (sg_alloc_table(table, i, GFP_KERNEL))
+	if (sg_alloc_table(table, nr_chunks, GFP_KERNEL))
+		goto free_buffer;
+
+	buffer->chunks = kvmalloc_array(nr_chunks, sizeof(*buffer->chunks),
+					GFP_KERNEL);
+	if (!buffer->chunks) {
+		sg_free_table(table);
 		goto free_buffer;
+	}
 
 	sg = table->sgl;
+	pgoff = 0;
 	list_for_each_entry_safe(page, tmp_page, &pages, lru) {
 		sg_set_page(sg, page, page_size(page), 0);
 		sg = sg_next(sg);
 		list_del(&page->lru);
+
+		buffer->chunks[buffer->nr_chunks].pgoff = pgoff;
+		buffer->chunks[buffer->nr_chunks].page = page;
+		buffer->nr_chunks++;
+		pgoff += 1UL << compound_order(page);
 	}
 
 	/* create the dmabuf */
@@ -475,6 +919,8 @@ static struct dma_buf *system_heap_do_allocate(struct dma_heap *heap,
 		dma_unmap_sgtable(dma_heap_get_dev(heap), table, DMA_BIDIRECTIONAL, 0);
 	}
 
+	trace_system_heap_alloc(len, heap_flags, buffer->nr_chunks,
+				ktime_get_ns() - start, 0);
 	return dmabuf;
 
 free_pages:
@@ -484,11 +930,14 @@ free_pages:
 		__free_pages(p, compound_order(p));
 	}
 	sg_free_table(table);
+	kvfree(buffer->chunks);
 free_buffer:
 	list_for_each_entry_safe(page, tmp_page, &pages, lru)
 		__free_pages(page, compound_order(page));
 	kfree(buffer);
 
+	trace_system_heap_alloc(len, heap_flags, nr_chunks,
+				ktime_get_ns() - start, ret);
 	return ERR_PTR(ret);
 }
 
@@ -505,16 +954,42 @@ static long system_get_pool_size(struct dma_heap *heap)
 	int i;
 	long num_pages = 0;
 	struct dmabuf_page_pool **pool;
+	struct dmabuf_page_pool_stats stats;
 
 	pool = pools;
 	for (i = 0; i < NUM_ORDERS; i++, pool++) {
-		num_pages += ((*pool)->count[POOL_LOWPAGE] +
-			      (*pool)->count[POOL_HIGHPAGE]) << (*pool)->order;
+		dmabuf_page_pool_get_stats(*pool, &stats);
+		num_pages += stats.count << (*pool)->order;
 	}
+	num_pages += READ_ONCE(reserve.pages);
 
 	return num_pages << PAGE_SHIFT;
 }
 
+/* Pool sizes and per-cpu cache efficiency, per allocation order */
+static int system_heap_pool_stats_show(struct seq_file *m, void *unused)
+{
+	struct dmabuf_page_pool_stats stats;
+	int i;
+
+	seq_puts(m, "order      pages  pcp_pages      dirty       hits    refills     drains\n");
+	for (i = 0; i < NUM_ORDERS; i++) {
+		dmabuf_page_pool_get_stats(pools[i], &stats);
+		seq_printf(m, "%5u %10d %10d %10d %10lu %10lu %10lu\n",
+			   orders[i], stats.count << orders[i],
+			   stats.pcp_count << orders[i], stats.dirty << orders[i],
+			   stats.hits, stats.refills, stats.drains);
+	}
+
+	spin_lock(&reserve.lock);
+	seq_printf(m, "reserve pages %lu target %lu\n", reserve.pages,
+		   reserve.target);
+	spin_unlock(&reserve.lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(system_heap_pool_stats);
+
 static const struct dma_heap_ops system_heap_ops = {
 	.allocate = system_heap_allocate,
 	.get_pool_size = system_get_pool_size,
@@ -559,6 +1034,15 @@ static int system_heap_create(void)
 			return -ENOMEM;
 		}
 	}
+	deferred_idle_worker_register(&system_heap_zero_worker);
+
+	spin_lock_init(&reserve.lock);
+	for (i = 0; i < NUM_ORDERS; i++)
+		INIT_LIST_HEAD(&reserve.items[i]);
+	INIT_WORK(&reserve.refill, system_heap_reserve_refill);
+	reserve.target = (unsigned long)reserve_mb << (20 - PAGE_SHIFT);
+	if (reserve.target)
+		queue_work(system_unbound_wq, &reserve.refill);
 
 	exp_info.name = "system";
 	exp_info.ops = &system_heap_ops;
@@ -576,6 +1060,9 @@ static int system_heap_create(void)
 	if (IS_ERR(sys_uncached_heap))
 		return PTR_ERR(sys_uncached_heap);
 
+	debugfs_create_file("system_heap_pools", 0444, NULL, NULL,
+			    &system_heap_pool_stats_fops);
+
 	dma_coerce_mask_and_coherent(dma_heap_get_dev(sys_uncached_heap), DMA_BIT_MASK(64));
 	mb(); /* make sure we only set allocate after dma_mask is set */
 	system_uncached_heap_ops.allocate = system_uncached_heap_allocate;
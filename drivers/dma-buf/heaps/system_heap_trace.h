@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_INCLUDE_PATH ../../drivers/dma-buf/heaps
+#define TRACE_SYSTEM system_heap
+
+#if !defined(_TRACE_SYSTEM_HEAP_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_SYSTEM_HEAP_H
+
+#include <linux/tracepoint.h>
+
+/* Where system_heap_alloc_chunk found its pages */
+#define SYSTEM_HEAP_SOURCES				\
+	EM(SYSTEM_HEAP_SRC_POOL,	"pool")		\
+	EM(SYSTEM_HEAP_SRC_BUDDY,	"buddy")	\
+	EM(SYSTEM_HEAP_SRC_RECLAIM,	"reclaim")	\
+	EMe(SYSTEM_HEAP_SRC_RESERVE,	"reserve")
+
+#undef EM
+#undef EMe
+#define EM(a, b)	TRACE_DEFINE_ENUM(a);
+#define EMe(a, b)	TRACE_DEFINE_ENUM(a);
+
+SYSTEM_HEAP_SOURCES
+
+#undef EM
+#undef EMe
+#define EM(a, b)	{ a, b },
+#define EMe(a, b)	{ a, b }
+
+TRACE_EVENT(system_heap_alloc_chunk,
+	TP_PROTO(unsigned int order, int source, u64 latency_ns),
+
+	TP_ARGS(order, source, latency_ns),
+
+	TP_STRUCT__entry(
+			__field(unsigned int, order)
+			__field(int, source)
+			__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+			__entry->order = order;
+			__entry->source = source;
+			__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("order=%u source=%s latency_ns=%llu", __entry->order,
+		  __print_symbolic(__entry->source, SYSTEM_HEAP_SOURCES),
+		  __entry->latency_ns)
+);
+
+TRACE_EVENT(system_heap_alloc,
+	TP_PROTO(unsigned long len, unsigned long heap_flags,
+		 unsigned int nr_chunks, u64 latency_ns, int ret),
+
+	TP_ARGS(len, heap_flags, nr_chunks, latency_ns, ret),
+
+	TP_STRUCT__entry(
+			__field(unsigned long, len)
+			__field(unsigned long, heap_flags)
+			__field(unsigned int, nr_chunks)
+			__field(u64, latency_ns)
+			__field(int, ret)
+	),
+
+	TP_fast_assign(
+			__entry->len = len;
+			__entry->heap_flags = heap_flags;
+			__entry->nr_chunks = nr_chunks;
+			__entry->latency_ns = latency_ns;
+			__entry->ret = ret;
+	),
+
+	TP_printk("len=%lu heap_flags=0x%lx nr_chunks=%u latency_ns=%llu ret=%d",
+		  __entry->len, __entry->heap_flags, __entry->nr_chunks,
+		  __entry->latency_ns, __entry->ret)
+);
+
+#endif /* _TRACE_SYSTEM_HEAP_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
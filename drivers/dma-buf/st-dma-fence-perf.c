@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * Throughput of the dma-fence create, signal and wait paths.
+ *
+ * Nothing here can fail short of running out of memory, the rates are
+ * only reported for comparison between kernels and machines.
+ */
+
+#include <linux/dma-fence.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/sched/task.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "selftest.h"
+
+/* Fences per timeline, like the points of one sw_sync timeline */
+#define PERF_FENCES	1024
+#define PERF_TIME_NS	(100 * NSEC_PER_MSEC)
+
+static struct kmem_cache *slab_fences;
+
+static struct mock_fence {
+	struct dma_fence base;
+} *to_mock_fence(struct dma_fence *f) {
+	return container_of(f, struct mock_fence, base);
+}
+
+static const char *mock_name(struct dma_fence *f)
+{
+	return "mock";
+}
+
+static void mock_fence_release(struct dma_fence *f)
+{
+	kmem_cache_free(slab_fences, to_mock_fence(f));
+}
+
+static const struct dma_fence_ops mock_ops = {
+	.get_driver_name = mock_name,
+	.get_timeline_name = mock_name,
+	.release = mock_fence_release,
+};
+
+struct mock_timeline {
+	spinlock_t lock;
+	u64 context;
+	u64 seqno;
+	struct dma_fence *fences[PERF_FENCES];
+};
+
+static void mock_timeline_init(struct mock_timeline *tl)
+{
+	spin_lock_init(&tl->lock);
+	tl->context = dma_fence_context_alloc(1);
+	tl->seqno = 0;
+}
+
+static struct dma_fence *mock_fence(struct mock_timeline *tl)
+{
+	struct mock_fence *f;
+
+	f = kmem_cache_alloc(slab_fences, GFP_KERNEL);
+	if (!f)
+		return NULL;
+
+	dma_fence_init(&f->base, &mock_ops, &tl->lock, tl->context,
+		       ++tl->seqno);
+
+	return &f->base;
+}
+
+static int mock_timeline_fill(struct mock_timeline *tl)
+{
+	int i;
+
+	for (i = 0; i < PERF_FENCES; i++) {
+		tl->fences[i] = mock_fence(tl);
+		if (!tl->fences[i]) {
+			while (i--)
+				dma_fence_put(tl->fences[i]);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void mock_timeline_put(struct mock_timeline *tl)
+{
+	int i;
+
+	for (i = 0; i < PERF_FENCES; i++)
+		dma_fence_put(tl->fences[i]);
+}
+
+static void report(const char *what, u64 count, u64 ns)
+{
+	pr_info("%s: %llu in %llu ms, %llu/s\n", what, count,
+		div_u64(ns, NSEC_PER_MSEC),
+		div64_u64(count * NSEC_PER_SEC, max_t(u64, ns, 1)));
+}
+
+static u64 perf_elapsed(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int perf_create(void *arg)
+{
+	struct mock_timeline *tl = arg;
+	ktime_t start = ktime_get();
+	u64 count = 0;
+
+	do {
+		if (mock_timeline_fill(tl))
+			return -ENOMEM;
+		mock_timeline_put(tl);
+		count += PERF_FENCES;
+		cond_resched();
+	} while (perf_elapsed(start) < PERF_TIME_NS);
+
+	report("create", count, perf_elapsed(start));
+	return 0;
+}
+
+static void perf_nop_cb(struct dma_fence *f, struct dma_fence_cb *cb)
+{
+}
+
+static int perf_signal(void *arg)
+{
+	static struct dma_fence_cb cb[PERF_FENCES];
+	struct mock_timeline *tl = arg;
+	u64 count = 0, ns = 0;
+	ktime_t start, t;
+	int i;
+
+	start = ktime_get();
+	do {
+		if (mock_timeline_fill(tl))
+			return -ENOMEM;
+		for (i = 0; i < PERF_FENCES; i++)
+			dma_fence_add_callback(tl->fences[i], &cb[i],
+					       perf_nop_cb);
+
+		/* Signal in order under one lock hold, as an irq handler would */
+		t = ktime_get();
+		spin_lock_irq(&tl->lock);
+		for (i = 0; i < PERF_FENCES; i++)
+			dma_fence_signal_timestamp_locked(tl->fences[i], t);
+		spin_unlock_irq(&tl->lock);
+		ns += perf_elapsed(t);
+
+		mock_timeline_put(tl);
+		count += PERF_FENCES;
+		cond_resched();
+	} while (perf_elapsed(start) < PERF_TIME_NS);
+
+	/* Only the signalling itself is timed */
+	report("signal", count, ns);
+	return 0;
+}
+
+struct perf_wait {
+	struct mock_timeline ping;
+	struct mock_timeline pong;
+};
+
+static int perf_waiter(void *arg)
+{
+	struct perf_wait *w = arg;
+	int i;
+
+	for (i = 0; i < PERF_FENCES; i++) {
+		if (dma_fence_wait(w->ping.fences[i], false))
+			return -EIO;
+		dma_fence_signal(w->pong.fences[i]);
+	}
+
+	return 0;
+}
+
+static int perf_wait(void *arg)
+{
+	struct perf_wait *w;
+	struct task_struct *tsk;
+	ktime_t start;
+	u64 count = 0;
+	int err = 0;
+	int i;
+
+	w = kmalloc(sizeof(*w), GFP_KERNEL);
+	if (!w)
+		return -ENOMEM;
+
+	mock_timeline_init(&w->ping);
+	mock_timeline_init(&w->pong);
+
+	start = ktime_get();
+	do {
+		if (mock_timeline_fill(&w->ping)) {
+			err = -ENOMEM;
+			break;
+		}
+		if (mock_timeline_fill(&w->pong)) {
+			mock_timeline_put(&w->ping);
+			err = -ENOMEM;
+			break;
+		}
+
+		tsk = kthread_run(perf_waiter, w, "dmabuf/perf");
+		if (IS_ERR(tsk)) {
+			err = PTR_ERR(tsk);
+		} else {
+			get_task_struct(tsk);
+
+			/* Each round trip is one wait on either side */
+			for (i = 0; i < PERF_FENCES; i++) {
+				dma_fence_signal(w->ping.fences[i]);
+				if (dma_fence_wait(w->pong.fences[i], false))
+					err = -EIO;
+			}
+
+			err = kthread_stop(tsk) ?: err;
+			put_task_struct(tsk);
+		}
+
+		mock_timeline_put(&w->ping);
+		mock_timeline_put(&w->pong);
+		count += 2 * PERF_FENCES;
+	} while (!err && perf_elapsed(start) < PERF_TIME_NS);
+
+	if (!err)
+		report("wait", count, perf_elapsed(start));
+	kfree(w);
+	return err;
+}
+
+int dma_fence_perf(void)
+{
+	static const struct subtest tests[] = {
+		SUBTEST(perf_create),
+		SUBTEST(perf_signal),
+		SUBTEST(perf_wait),
+	};
+	struct mock_timeline *tl;
+	int ret;
+
+	slab_fences = KMEM_CACHE(mock_fence,
+				 SLAB_TYPESAFE_BY_RCU |
+				 SLAB_HWCACHE_ALIGN);
+	if (!slab_fences)
+		return -ENOMEM;
+
+	tl = kmalloc(sizeof(*tl), GFP_KERNEL);
+	if (!tl) {
+		kmem_cache_destroy(slab_fences);
+		return -ENOMEM;
+	}
+	mock_timeline_init(tl);
+
+	ret = subtests(tests, tl);
+
+	kfree(tl);
+	kmem_cache_destroy(slab_fences);
+	return ret;
+}
@@ -59,6 +59,9 @@ struct sw_sync_create_fence_data {
 
 #define SW_SYNC_IOC_INC			_IOW(SW_SYNC_IOC_MAGIC, 1, __u32)
 
+/* Points signalled per hold of the timeline lock by SW_SYNC_IOC_INC */
+#define SYNC_TIMELINE_SIGNAL_BATCH	256
+
 static const struct dma_fence_ops timeline_fence_ops;
 
 static inline struct sync_pt *dma_fence_to_sync_pt(struct dma_fence *fence)
@@ -191,7 +194,9 @@ static const struct dma_fence_ops timeline_fence_ops = {
  */
 static void sync_timeline_signal(struct sync_timeline *obj, unsigned int inc)
 {
-	struct sync_pt *pt, *next;
+	ktime_t timestamp = ktime_get();
+	unsigned int count = 0;
+	struct sync_pt *pt;
 
 	trace_sync_timeline(obj);
 
@@ -199,7 +204,8 @@ static void sync_timeline_signal(struct sync_timeline *obj, unsigned int inc)
 
 	obj->value += inc;
 
-	list_for_each_entry_safe(pt, next, &obj->pt_list, link) {
+	while (!list_empty(&obj->pt_list)) {
+		pt = list_first_entry(&obj->pt_list, typeof(*pt), link);
 		if (!timeline_fence_signaled(&pt->base))
 			break;
 
@@ -213,8 +219,21 @@ static void sync_timeline_signal(struct sync_timeline *obj, unsigned int inc)
 		 * be after we remove the fence from the timeline in order to
 		 * prevent deadlocking on timeline->lock inside
 		 * timeline_fence_release().
+		 *
+		 * All points passed by this increment share one timestamp.
 		 */
-		dma_fence_signal_locked(&pt->base);
+		dma_fence_signal_timestamp_locked(&pt->base, timestamp);
+
+		/*
+		 * Bound the time spent with interrupts off. Points left on the
+		 * list already report as signaled, so dropping the lock here
+		 * is safe.
+		 */
+		if (!(++count % SYNC_TIMELINE_SIGNAL_BATCH)) {
+			spin_unlock_irq(&obj->lock);
+			cond_resched();
+			spin_lock_irq(&obj->lock);
+		}
 	}
 
 	spin_unlock_irq(&obj->lock);
@@ -248,6 +267,24 @@ static struct sync_pt *sync_pt_create(struct sync_timeline *obj,
 	if (!dma_fence_is_signaled_locked(&pt->base)) {
 		struct rb_node **p = &obj->pt_tree.rb_node;
 		struct rb_node *parent = NULL;
+		struct sync_pt *last;
+
+		/*
+		 * Points are nearly always created in timeline order. The last
+		 * point on the list is the rightmost node of the tree, so a
+		 * later point can be linked in as its right child without
+		 * walking the tree.
+		 */
+		if (!list_empty(&obj->pt_list)) {
+			last = list_last_entry(&obj->pt_list, typeof(*pt), link);
+			if ((int)(value - last->base.seqno) > 0) {
+				rb_link_node(&pt->node, &last->node,
+					     &last->node.rb_right);
+				rb_insert_color(&pt->node, &obj->pt_tree);
+				list_add_tail(&pt->link, &obj->pt_list);
+				goto unlock;
+			}
+		}
 
 		while (*p) {
 			struct sync_pt *other;
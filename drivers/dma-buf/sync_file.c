@@ -9,6 +9,8 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
@@ -482,3 +484,338 @@ static const struct file_operations sync_file_fops = {
 	.unlocked_ioctl = sync_file_ioctl,
 	.compat_ioctl = compat_ptr_ioctl,
 };
+
+/* Upper bound on the fences in one waitset */
+#define SYNC_WAITSET_MAX_FENCES	4096
+
+/**
+ * struct sync_waitset - set of fences polled together
+ * @lock:	protects @pending and @signaled against the fence callbacks
+ * @mutex:	serializes changes to the membership of the set
+ * @wq:		wait queue woken when @signaled becomes non-empty
+ * @pending:	entries whose fence has not signaled
+ * @signaled:	entries whose fence signaled, in signaling order
+ * @count:	number of entries on both lists
+ */
+struct sync_waitset {
+	spinlock_t lock;
+	struct mutex mutex;
+	wait_queue_head_t wq;
+	struct list_head pending;
+	struct list_head signaled;
+	unsigned int count;
+};
+
+struct sync_waitset_entry {
+	struct dma_fence_cb cb;
+	struct dma_fence *fence;
+	struct sync_waitset *ws;
+	struct list_head node;
+	u64 cookie;
+};
+
+static void sync_waitset_signal(struct sync_waitset_entry *e)
+{
+	struct sync_waitset *ws = e->ws;
+	unsigned long flags;
+	bool wake;
+
+	spin_lock_irqsave(&ws->lock, flags);
+	wake = list_empty(&ws->signaled);
+	list_move_tail(&e->node, &ws->signaled);
+	spin_unlock_irqrestore(&ws->lock, flags);
+
+	/* Only the first fence to signal since the last read wakes waiters */
+	if (wake)
+		wake_up_all(&ws->wq);
+}
+
+static void sync_waitset_cb_func(struct dma_fence *f, struct dma_fence_cb *cb)
+{
+	sync_waitset_signal(container_of(cb, struct sync_waitset_entry, cb));
+}
+
+static void sync_waitset_entry_free(struct sync_waitset_entry *e)
+{
+	dma_fence_put(e->fence);
+	kfree(e);
+}
+
+static int sync_waitset_add(struct sync_waitset *ws,
+			    struct sync_waitset_fence *wf)
+{
+	struct sync_waitset_entry *e;
+	struct dma_fence *fence;
+
+	if (wf->flags)
+		return -EINVAL;
+
+	if (ws->count >= SYNC_WAITSET_MAX_FENCES)
+		return -ENOSPC;
+
+	fence = sync_file_get_fence(wf->fd);
+	if (!fence)
+		return -EINVAL;
+
+	e = kmalloc(sizeof(*e), GFP_KERNEL);
+	if (!e) {
+		dma_fence_put(fence);
+		return -ENOMEM;
+	}
+
+	e->fence = fence;
+	e->ws = ws;
+	e->cookie = wf->cookie;
+
+	spin_lock_irq(&ws->lock);
+	list_add_tail(&e->node, &ws->pending);
+	ws->count++;
+	spin_unlock_irq(&ws->lock);
+
+	if (dma_fence_add_callback(fence, &e->cb, sync_waitset_cb_func))
+		sync_waitset_signal(e);
+
+	return 0;
+}
+
+static int sync_waitset_remove(struct sync_waitset *ws, u64 cookie)
+{
+	struct sync_waitset_entry *e, *found = NULL;
+
+	spin_lock_irq(&ws->lock);
+	list_for_each_entry(e, &ws->signaled, node) {
+		if (e->cookie == cookie) {
+			found = e;
+			break;
+		}
+	}
+	if (!found) {
+		list_for_each_entry(e, &ws->pending, node) {
+			if (e->cookie == cookie) {
+				found = e;
+				break;
+			}
+		}
+	}
+	spin_unlock_irq(&ws->lock);
+
+	if (!found)
+		return -ENOENT;
+
+	/*
+	 * Fence callbacks run under the fence lock, so once this returns the
+	 * callback is either gone or done moving the entry to @signaled.
+	 * Only the ioctls, serialized on ws->mutex, free entries.
+	 */
+	dma_fence_remove_callback(found->fence, &found->cb);
+
+	spin_lock_irq(&ws->lock);
+	list_del(&found->node);
+	ws->count--;
+	spin_unlock_irq(&ws->lock);
+
+	sync_waitset_entry_free(found);
+	return 0;
+}
+
+static long sync_waitset_ioctl_update(struct sync_waitset *ws,
+				      unsigned int cmd, unsigned long arg)
+{
+	struct sync_waitset_data data;
+	struct sync_waitset_fence wf;
+	struct sync_waitset_fence __user *ufences;
+	u32 i;
+	int ret = 0;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+		return -EFAULT;
+
+	if (data.flags)
+		return -EINVAL;
+
+	ufences = u64_to_user_ptr(data.ptr);
+
+	mutex_lock(&ws->mutex);
+	for (i = 0; i < data.count; i++) {
+		if (copy_from_user(&wf, &ufences[i], sizeof(wf))) {
+			ret = -EFAULT;
+			break;
+		}
+
+		if (cmd == SYNC_IOC_WAITSET_ADD)
+			ret = sync_waitset_add(ws, &wf);
+		else
+			ret = sync_waitset_remove(ws, wf.cookie);
+		if (ret)
+			break;
+	}
+	mutex_unlock(&ws->mutex);
+
+	if (ret) {
+		data.count = i;
+		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+			return -EFAULT;
+	}
+
+	return ret;
+}
+
+static long sync_waitset_ioctl_read(struct sync_waitset *ws, unsigned long arg)
+{
+	struct sync_waitset_entry *e, *tmp;
+	struct sync_waitset_event *events;
+	struct sync_waitset_data data;
+	LIST_HEAD(taken);
+	u32 n = 0;
+	int ret = 0;
+
+	if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+		return -EFAULT;
+
+	if (data.flags)
+		return -EINVAL;
+
+	data.count = min_t(u32, data.count, SYNC_WAITSET_MAX_FENCES);
+	events = kcalloc(data.count, sizeof(*events), GFP_KERNEL);
+	if (data.count && !events)
+		return -ENOMEM;
+
+	mutex_lock(&ws->mutex);
+	spin_lock_irq(&ws->lock);
+	list_for_each_entry_safe(e, tmp, &ws->signaled, node) {
+		if (n == data.count)
+			break;
+		list_move_tail(&e->node, &taken);
+		events[n].cookie = e->cookie;
+		events[n].status = dma_fence_get_status(e->fence);
+		n++;
+	}
+	ws->count -= n;
+	spin_unlock_irq(&ws->lock);
+
+	if (n && copy_to_user(u64_to_user_ptr(data.ptr), events,
+			      n * sizeof(*events))) {
+		/* Leave the fences readable */
+		spin_lock_irq(&ws->lock);
+		list_splice(&taken, &ws->signaled);
+		ws->count += n;
+		spin_unlock_irq(&ws->lock);
+		ret = -EFAULT;
+	}
+	mutex_unlock(&ws->mutex);
+
+	kfree(events);
+	if (ret)
+		return ret;
+
+	list_for_each_entry_safe(e, tmp, &taken, node)
+		sync_waitset_entry_free(e);
+
+	data.count = n;
+	if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static long sync_waitset_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct sync_waitset *ws = file->private_data;
+
+	switch (cmd) {
+	case SYNC_IOC_WAITSET_ADD:
+	case SYNC_IOC_WAITSET_REMOVE:
+		return sync_waitset_ioctl_update(ws, cmd, arg);
+
+	case SYNC_IOC_WAITSET_READ:
+		return sync_waitset_ioctl_read(ws, arg);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+static __poll_t sync_waitset_poll(struct file *file, poll_table *wait)
+{
+	struct sync_waitset *ws = file->private_data;
+
+	poll_wait(file, &ws->wq, wait);
+
+	return list_empty_careful(&ws->signaled) ? 0 : EPOLLIN;
+}
+
+static int sync_waitset_open(struct inode *inode, struct file *file)
+{
+	struct sync_waitset *ws;
+
+	ws = kzalloc(sizeof(*ws), GFP_KERNEL);
+	if (!ws)
+		return -ENOMEM;
+
+	spin_lock_init(&ws->lock);
+	mutex_init(&ws->mutex);
+	init_waitqueue_head(&ws->wq);
+	INIT_LIST_HEAD(&ws->pending);
+	INIT_LIST_HEAD(&ws->signaled);
+	file->private_data = ws;
+
+	return 0;
+}
+
+static int sync_waitset_release(struct inode *inode, struct file *file)
+{
+	struct sync_waitset *ws = file->private_data;
+	struct sync_waitset_entry *e, *tmp;
+
+	/*
+	 * Callbacks may still move entries around until removed, see
+	 * sync_waitset_remove(), so take the pending ones one at a time.
+	 * Nothing moves once @pending is empty.
+	 */
+	for (;;) {
+		spin_lock_irq(&ws->lock);
+		e = list_first_entry_or_null(&ws->pending,
+					     struct sync_waitset_entry, node);
+		if (e)
+			list_move(&e->node, &ws->signaled);
+		spin_unlock_irq(&ws->lock);
+		if (!e)
+			break;
+
+		dma_fence_remove_callback(e->fence, &e->cb);
+	}
+
+	/*
+	 * A callback that already moved its entry may still be waking @wq.
+	 * It runs under the fence lock, which dma_fence_remove_callback()
+	 * takes even for a signaled fence, so this waits it out.
+	 */
+	list_for_each_entry_safe(e, tmp, &ws->signaled, node) {
+		dma_fence_remove_callback(e->fence, &e->cb);
+		sync_waitset_entry_free(e);
+	}
+
+	kfree(ws);
+	return 0;
+}
+
+static const struct file_operations sync_waitset_fops = {
+	.open = sync_waitset_open,
+	.release = sync_waitset_release,
+	.poll = sync_waitset_poll,
+	.unlocked_ioctl = sync_waitset_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+};
+
+static struct miscdevice sync_waitset_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "sync_waitset",
+	.fops = &sync_waitset_fops,
+};
+
+static int __init sync_waitset_init(void)
+{
+	return misc_register(&sync_waitset_misc);
+}
+device_initcall(sync_waitset_init);
@@ -2,12 +2,16 @@
 #include <linux/cred.h>
 #include <linux/device.h>
 #include <linux/dma-buf.h>
+#include <linux/fadvise.h>
+#include <linux/fs.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/memfd.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/pagemap.h>
+#include <linux/page_pinner.h>
 #include <linux/shmem_fs.h>
 #include <linux/slab.h>
 #include <linux/udmabuf.h>
@@ -20,8 +24,27 @@ struct udmabuf {
 	struct page **pages;
 	struct sg_table *sg;
 	struct miscdevice *device;
+
+	/* Files whose page cache backs a UDMABUF_FLAGS_FILE buffer */
+	struct file **files;
+	u32 nr_files;
+	bool readonly;
 };
 
+static void udmabuf_pin_page(struct page *page)
+{
+	page = compound_head(page);
+	set_page_pinner(page, compound_order(page));
+}
+
+static void udmabuf_unpin_page(struct page *page)
+{
+	struct page *head = compound_head(page);
+
+	reset_page_pinner(head, compound_order(head));
+	put_page(page);
+}
+
 static vm_fault_t udmabuf_vm_fault(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
@@ -42,6 +65,11 @@ static int mmap_udmabuf(struct dma_buf *buf, struct vm_area_struct *vma)
 
 	if ((vma->vm_flags & (VM_SHARED | VM_MAYSHARE)) == 0)
 		return -EINVAL;
+	if (ubuf->readonly) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
 
 	vma->vm_ops = &udmabuf_vm_ops;
 	vma->vm_private_data = ubuf;
@@ -85,6 +113,12 @@ static void put_sg_table(struct device *dev, struct sg_table *sg,
 static struct sg_table *map_udmabuf(struct dma_buf_attachment *at,
 				    enum dma_data_direction direction)
 {
+	struct udmabuf *ubuf = at->dmabuf->priv;
+
+	/* Device writes would never reach the file, refuse them */
+	if (ubuf->readonly && direction != DMA_TO_DEVICE)
+		return ERR_PTR(-EPERM);
+
 	return get_sg_table(at->dev, at->dmabuf, direction);
 }
 
@@ -95,6 +129,17 @@ static void unmap_udmabuf(struct dma_buf_attachment *at,
 	return put_sg_table(at->dev, sg, direction);
 }
 
+static void udmabuf_put_files(struct udmabuf *ubuf)
+{
+	while (ubuf->nr_files > 0) {
+		struct file *file = ubuf->files[--ubuf->nr_files];
+
+		allow_write_access(file);
+		fput(file);
+	}
+	kfree(ubuf->files);
+}
+
 static void release_udmabuf(struct dma_buf *buf)
 {
 	struct udmabuf *ubuf = buf->priv;
@@ -105,7 +150,8 @@ static void release_udmabuf(struct dma_buf *buf)
 		put_sg_table(dev, ubuf->sg, DMA_BIDIRECTIONAL);
 
 	for (pg = 0; pg < ubuf->pagecount; pg++)
-		put_page(ubuf->pages[pg]);
+		udmabuf_unpin_page(ubuf->pages[pg]);
+	udmabuf_put_files(ubuf);
 	kfree(ubuf->pages);
 	kfree(ubuf);
 }
@@ -154,6 +200,34 @@ static const struct dma_buf_ops udmabuf_ops = {
 #define SEALS_WANTED (F_SEAL_SHRINK)
 #define SEALS_DENIED (F_SEAL_WRITE)
 
+/*
+ * Check and hold a regular file for a UDMABUF_FLAGS_FILE buffer. Write
+ * access is denied, as for a running executable, until the buffer is
+ * released, so neither write(2) nor truncate(2) can change or drop the
+ * page cache under the importing devices.
+ */
+static int udmabuf_hold_file(struct udmabuf *ubuf, struct file *file,
+			     struct udmabuf_create_item *item)
+{
+	struct inode *inode = file_inode(file);
+	int ret;
+
+	if (!S_ISREG(inode->i_mode) || !(file->f_mode & FMODE_READ) ||
+	    IS_DAX(inode) || !file->f_mapping->a_ops->readpage)
+		return -EBADFD;
+	if (item->offset + item->size < item->offset ||
+	    item->offset + item->size > i_size_read(inode))
+		return -EINVAL;
+
+	ret = deny_write_access(file);
+	if (ret)
+		return ret;
+
+	get_file(file);
+	ubuf->files[ubuf->nr_files++] = file;
+	return 0;
+}
+
 static long udmabuf_create(struct miscdevice *device,
 			   struct udmabuf_create_list *head,
 			   struct udmabuf_create_item *list)
@@ -167,9 +241,13 @@ static long udmabuf_create(struct miscdevice *device,
 	int seals, ret = -EINVAL;
 	u32 i, flags;
 
+	if (head->flags & ~UDMABUF_FLAGS_VALID)
+		return -EINVAL;
+
 	ubuf = kzalloc(sizeof(*ubuf), GFP_KERNEL);
 	if (!ubuf)
 		return -ENOMEM;
+	ubuf->readonly = head->flags & UDMABUF_FLAGS_FILE;
 
 	pglimit = (size_limit_mb * 1024 * 1024) >> PAGE_SHIFT;
 	for (i = 0; i < head->count; i++) {
@@ -187,6 +265,14 @@ static long udmabuf_create(struct miscdevice *device,
 		ret = -ENOMEM;
 		goto err;
 	}
+	if (ubuf->readonly) {
+		ubuf->files = kcalloc(head->count, sizeof(*ubuf->files),
+				      GFP_KERNEL);
+		if (!ubuf->files) {
+			ret = -ENOMEM;
+			goto err;
+		}
+	}
 
 	pgbuf = 0;
 	for (i = 0; i < head->count; i++) {
@@ -194,24 +280,39 @@ static long udmabuf_create(struct miscdevice *device,
 		memfd = fget(list[i].memfd);
 		if (!memfd)
 			goto err;
-		if (!shmem_mapping(file_inode(memfd)->i_mapping))
-			goto err;
-		seals = memfd_fcntl(memfd, F_GET_SEALS, 0);
-		if (seals == -EINVAL)
-			goto err;
-		ret = -EINVAL;
-		if ((seals & SEALS_WANTED) != SEALS_WANTED ||
-		    (seals & SEALS_DENIED) != 0)
-			goto err;
+		if (ubuf->readonly) {
+			ret = udmabuf_hold_file(ubuf, memfd, &list[i]);
+			if (ret)
+				goto err;
+			/* Start reading it all in before waiting on each page */
+			vfs_fadvise(memfd, list[i].offset, list[i].size,
+				    POSIX_FADV_WILLNEED);
+		} else {
+			if (!shmem_mapping(file_inode(memfd)->i_mapping))
+				goto err;
+			seals = memfd_fcntl(memfd, F_GET_SEALS, 0);
+			if (seals == -EINVAL)
+				goto err;
+			ret = -EINVAL;
+			if ((seals & SEALS_WANTED) != SEALS_WANTED ||
+			    (seals & SEALS_DENIED) != 0)
+				goto err;
+		}
 		pgoff = list[i].offset >> PAGE_SHIFT;
 		pgcnt = list[i].size   >> PAGE_SHIFT;
 		for (pgidx = 0; pgidx < pgcnt; pgidx++) {
-			page = shmem_read_mapping_page(
-				file_inode(memfd)->i_mapping, pgoff + pgidx);
+			if (ubuf->readonly)
+				page = read_mapping_page(memfd->f_mapping,
+							 pgoff + pgidx, memfd);
+			else
+				page = shmem_read_mapping_page(
+					file_inode(memfd)->i_mapping,
+					pgoff + pgidx);
 			if (IS_ERR(page)) {
 				ret = PTR_ERR(page);
 				goto err;
 			}
+			udmabuf_pin_page(page);
 			ubuf->pages[pgbuf++] = page;
 		}
 		fput(memfd);
@@ -221,7 +322,7 @@ static long udmabuf_create(struct miscdevice *device,
 	exp_info.ops  = &udmabuf_ops;
 	exp_info.size = ubuf->pagecount << PAGE_SHIFT;
 	exp_info.priv = ubuf;
-	exp_info.flags = O_RDWR;
+	exp_info.flags = ubuf->readonly ? O_RDONLY : O_RDWR;
 
 	ubuf->device = device;
 	buf = dma_buf_export(&exp_info);
@@ -237,9 +338,10 @@ static long udmabuf_create(struct miscdevice *device,
 
 err:
 	while (pgbuf > 0)
-		put_page(ubuf->pages[--pgbuf]);
+		udmabuf_unpin_page(ubuf->pages[--pgbuf]);
 	if (memfd)
 		fput(memfd);
+	udmabuf_put_files(ubuf);
 	kfree(ubuf->pages);
 	kfree(ubuf);
 	return ret;
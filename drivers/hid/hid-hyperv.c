@@ -12,7 +12,10 @@
 #include <linux/hid.h>
 #include <linux/hiddev.h>
 #include <linux/hyperv.h>
+#include <linux/ktime.h>
 
+#define CREATE_TRACE_POINTS
+#include "hid_hyperv_trace.h"
 
 struct hv_input_dev_info {
 	unsigned int size;
@@ -150,6 +153,16 @@ struct mousevsc_dev {
 	struct hv_input_dev_info hid_dev_info;
 	struct hid_device       *hid_device;
 	u8			input_buf[HID_MAX_BUFFER_SIZE];
+
+	/*
+	 * Input reports delivered by one channel callback are batched into
+	 * a single input frame; see mousevsc_batch_report().
+	 */
+	struct input_dev	*batch_input;
+	unsigned int		batch_reports;
+	ktime_t			batch_start;
+	unsigned long		batch_keys[BITS_TO_LONGS(KEY_CNT)];
+	bool			wakeup_pending;
 };
 
 
@@ -246,6 +259,42 @@ cleanup:
 	return;
 }
 
+/* Close the input frame holding the reports batched so far */
+static void mousevsc_input_sync(struct mousevsc_dev *input_dev)
+{
+	struct input_dev *input = input_dev->batch_input;
+
+	if (!input_dev->batch_reports)
+		return;
+
+	input_sync(input);
+	bitmap_copy(input_dev->batch_keys, input->key, KEY_CNT);
+
+	trace_mousevsc_input_sync(input_dev->hid_device,
+				  input_dev->batch_reports,
+				  ktime_to_ns(ktime_sub(ktime_get(),
+							input_dev->batch_start)));
+	input_dev->batch_reports = 0;
+}
+
+/*
+ * With HID_QUIRK_NO_INPUT_SYNC set, HID core leaves the SYN_REPORT to us
+ * and every report drained in one channel callback goes into the same
+ * frame: relative motion adds up and absolute axes keep their latest
+ * value. A key or button transition still ends the frame, so that a
+ * press and its release are never merged away.
+ */
+static void mousevsc_batch_report(struct mousevsc_dev *input_dev)
+{
+	if (!input_dev->batch_input)
+		return;
+
+	input_dev->batch_reports++;
+	if (!bitmap_equal(input_dev->batch_input->key, input_dev->batch_keys,
+			  KEY_CNT))
+		mousevsc_input_sync(input_dev);
+}
+
 static void mousevsc_on_receive(struct hv_device *device,
 				struct vmpacket_descriptor *packet)
 {
@@ -304,8 +353,9 @@ static void mousevsc_on_receive(struct hv_device *device,
 		memcpy(input_dev->input_buf, input_report->buffer, len);
 		hid_input_report(input_dev->hid_device, HID_INPUT_REPORT,
 				 input_dev->input_buf, len, 1);
+		mousevsc_batch_report(input_dev);
 
-		pm_wakeup_hard_event(&input_dev->device->device);
+		input_dev->wakeup_pending = true;
 
 		break;
 	default:
@@ -319,8 +369,11 @@ static void mousevsc_on_receive(struct hv_device *device,
 static void mousevsc_on_channel_callback(void *context)
 {
 	struct hv_device *device = context;
+	struct mousevsc_dev *input_dev = hv_get_drvdata(device);
 	struct vmpacket_descriptor *desc;
 
+	input_dev->batch_start = ktime_get();
+
 	foreach_vmbus_pkt(desc, device->channel) {
 		switch (desc->type) {
 		case VM_PKT_COMP:
@@ -336,6 +389,13 @@ static void mousevsc_on_channel_callback(void *context)
 			break;
 		}
 	}
+
+	mousevsc_input_sync(input_dev);
+
+	if (input_dev->wakeup_pending) {
+		input_dev->wakeup_pending = false;
+		pm_wakeup_hard_event(&device->device);
+	}
 }
 
 static int mousevsc_connect_to_vsp(struct hv_device *device)
@@ -516,6 +576,17 @@ static int mousevsc_probe(struct hv_device *device,
 
 	device_init_wakeup(&device->device, true);
 
+	/*
+	 * Batch reports only for the usual single input device, where
+	 * one SYN_REPORT closes the frame for everything reported.
+	 */
+	if (list_is_singular(&hid_dev->inputs)) {
+		input_dev->batch_input =
+			list_first_entry(&hid_dev->inputs,
+					 struct hid_input, list)->input;
+		hid_dev->quirks |= HID_QUIRK_NO_INPUT_SYNC;
+	}
+
 	input_dev->connected = true;
 	input_dev->init_complete = true;
 
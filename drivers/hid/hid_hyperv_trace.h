@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hid_hyperv
+
+#if !defined(_HID_HYPERV_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HID_HYPERV_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(mousevsc_input_sync,
+	    TP_PROTO(const struct hid_device *hid, unsigned int reports,
+		     s64 latency_ns),
+	    TP_ARGS(hid, reports, latency_ns),
+	    TP_STRUCT__entry(
+		    __string(name, dev_name(&hid->dev))
+		    __field(unsigned int, reports)
+		    __field(s64, latency_ns)
+		    ),
+	    TP_fast_assign(
+		    __assign_str(name, dev_name(&hid->dev));
+		    __entry->reports = reports;
+		    __entry->latency_ns = latency_ns;
+		    ),
+	    TP_printk("%s: %u reports in frame, latency %lld ns",
+		      __get_str(name), __entry->reports, __entry->latency_ns)
+	);
+
+#endif /* _HID_HYPERV_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hid_hyperv_trace
+#include <trace/define_trace.h>
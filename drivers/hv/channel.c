@@ -748,6 +748,10 @@ void vmbus_reset_channel_cb(struct vmbus_channel *channel)
 	channel->onchannel_callback = NULL;
 	spin_unlock_irqrestore(&channel->sched_lock, flags);
 
+	/* Nor may a poll thread still be looking at the inbound ring. */
+	vmbus_poll_stop(channel);
+	vmbus_chan_moder_stop(channel);
+
 	channel->sc_creation_callback = NULL;
 
 	/* Re-enable tasklet for use on re-open */
@@ -998,6 +1002,51 @@ int vmbus_sendpacket_mpb_desc(struct vmbus_channel *channel,
 }
 EXPORT_SYMBOL_GPL(vmbus_sendpacket_mpb_desc);
 
+/**
+ * vmbus_sendpacket_gpadl() - Send a packet referring to an established GPADL
+ * @channel: Pointer to vmbus_channel structure
+ * @gpadl_handle: Handle returned by vmbus_establish_gpadl()
+ * @buffer: In-band data, describing the data in the GPADL as defined
+ *	    by the device protocol
+ * @bufferlen: Size of @buffer
+ * @requestid: Identifier of the request
+ *
+ * Unlike vmbus_sendpacket_pagebuffer() and vmbus_sendpacket_mpb_desc(),
+ * no page ranges are written to the ring: the host resolves the data
+ * through a GPADL registered once, so a payload of any size costs only
+ * the fixed-size header plus @buffer in the ring.
+ *
+ * Only usable with devices whose protocol accepts
+ * VM_PKT_DATA_USING_GPADL packets.
+ */
+int vmbus_sendpacket_gpadl(struct vmbus_channel *channel, u32 gpadl_handle,
+			   void *buffer, u32 bufferlen, u64 requestid)
+{
+	struct vmgpadl_packet_header desc;
+	u32 packetlen = sizeof(desc) + bufferlen;
+	u32 packetlen_aligned = ALIGN(packetlen, sizeof(u64));
+	struct kvec bufferlist[3];
+	u64 aligned_data = 0;
+
+	/* Setup the descriptor */
+	desc.d.type = VM_PKT_DATA_USING_GPADL;
+	desc.d.flags = VMBUS_DATA_PACKET_FLAG_COMPLETION_REQUESTED;
+	desc.d.offset8 = sizeof(desc) >> 3; /* in 8-bytes granularity */
+	desc.d.len8 = (u16)(packetlen_aligned >> 3);
+	desc.d.trans_id = requestid;
+	desc.gpadl = gpadl_handle;
+	desc.reserved = 0;
+
+	bufferlist[0].iov_base = &desc;
+	bufferlist[0].iov_len = sizeof(desc);
+	bufferlist[1].iov_base = buffer;
+	bufferlist[1].iov_len = bufferlen;
+	bufferlist[2].iov_base = &aligned_data;
+	bufferlist[2].iov_len = (packetlen_aligned - packetlen);
+
+	return hv_ringbuffer_write(channel, bufferlist, 3);
+}
+
 /**
  * __vmbus_recvpacket() - Retrieve the user packet on the specified channel
  * @channel: Pointer to vmbus_channel structure
@@ -320,9 +320,12 @@ static struct vmbus_channel *alloc_channel(void)
 	init_completion(&channel->rescind_event);
 
 	INIT_LIST_HEAD(&channel->sc_list);
+	INIT_LIST_HEAD(&channel->poll_node);
+	INIT_LIST_HEAD(&channel->offer_node);
 
 	tasklet_init(&channel->callback_event,
 		     vmbus_on_event, (unsigned long)channel);
+	vmbus_chan_moder_init(channel);
 
 	hv_ringbuffer_pre_init(channel);
 
@@ -344,6 +347,10 @@ void vmbus_channel_map_relid(struct vmbus_channel *channel)
 {
 	if (WARN_ON(channel->offermsg.child_relid >= MAX_CHANNEL_RELIDS))
 		return;
+
+	/* Before the host can signal the relid, see vmbus_chan_sched(). */
+	vmbus_chan_index_add(channel, channel->target_cpu);
+
 	/*
 	 * The mapping of the channel's relid is visible from the CPUs that
 	 * execute vmbus_chan_sched() by the time that vmbus_chan_sched() will
@@ -381,6 +388,7 @@ void vmbus_channel_unmap_relid(struct vmbus_channel *channel)
 	WRITE_ONCE(
 		vmbus_connection.channels[channel->offermsg.child_relid],
 		NULL);
+	vmbus_chan_index_remove(channel);
 }
 
 static void vmbus_release_relid(u32 relid)
@@ -458,13 +466,13 @@ void vmbus_free_channels(void)
 }
 
 /* Note: the function can run concurrently for primary/sub channels. */
-static void vmbus_add_channel_work(struct work_struct *work)
+static void vmbus_add_channel(struct vmbus_channel *newchannel)
 {
-	struct vmbus_channel *newchannel =
-		container_of(work, struct vmbus_channel, add_channel_work);
 	struct vmbus_channel *primary_channel = newchannel->primary_channel;
 	int ret;
 
+	newchannel->probe_start = ktime_get();
+
 	/*
 	 * This state is used to indicate a successful open
 	 * so that when we do close the channel normally, we
@@ -482,6 +490,7 @@ static void vmbus_add_channel_work(struct work_struct *work)
 		if (primary_channel->sc_creation_callback != NULL)
 			primary_channel->sc_creation_callback(newchannel);
 
+		newchannel->probe_end = ktime_get();
 		newchannel->probe_done = true;
 		return;
 	}
@@ -511,6 +520,7 @@ static void vmbus_add_channel_work(struct work_struct *work)
 		goto err_deq_chan;
 	}
 
+	newchannel->probe_end = ktime_get();
 	newchannel->probe_done = true;
 	return;
 
@@ -521,6 +531,7 @@ err_deq_chan:
 	 * We need to set the flag, otherwise
 	 * vmbus_onoffer_rescind() can be blocked.
 	 */
+	newchannel->probe_end = ktime_get();
 	newchannel->probe_done = true;
 
 	if (primary_channel == NULL)
@@ -538,6 +549,127 @@ err_deq_chan:
 	free_channel(newchannel);
 }
 
+static void vmbus_add_channel_work(struct work_struct *work)
+{
+	struct vmbus_channel *newchannel =
+		container_of(work, struct vmbus_channel, add_channel_work);
+
+	vmbus_add_channel(newchannel);
+}
+
+/*
+ * Primary channel offers are added to the bus one device class at a time
+ * and in offer order, so that e.g. NICs and disks keep probing in the
+ * order the host offered them, while different classes probe in parallel
+ * on the unbound handle_primary_chan_wq.  Utility classes that are not
+ * needed to boot are held back until the boot time offers of all other
+ * classes have been probed; see vmbus_onoffers_delivered().
+ */
+struct vmbus_offer_class {
+	struct list_head offers;
+	struct work_struct work;
+	bool deferred;
+};
+
+static struct vmbus_offer_class vmbus_offer_classes[HV_UNKNOWN + 1];
+
+/* Protects the offers lists and the deferred flags of vmbus_offer_classes. */
+static DEFINE_SPINLOCK(vmbus_offer_lock);
+
+static void vmbus_offer_release_work(struct work_struct *work);
+static DECLARE_WORK(vmbus_offer_release, vmbus_offer_release_work);
+
+static bool defer_util_probe = true;
+module_param(defer_util_probe, bool, 0444);
+MODULE_PARM_DESC(defer_util_probe,
+		 "Probe KVP, FCopy and VSS only after the boot time devices");
+
+static void vmbus_offer_class_work(struct work_struct *work)
+{
+	struct vmbus_offer_class *class =
+		container_of(work, struct vmbus_offer_class, work);
+	struct vmbus_channel *channel;
+
+	for (;;) {
+		spin_lock(&vmbus_offer_lock);
+		channel = list_first_entry_or_null(&class->offers,
+						   struct vmbus_channel,
+						   offer_node);
+		if (channel)
+			list_del_init(&channel->offer_node);
+		spin_unlock(&vmbus_offer_lock);
+
+		if (!channel)
+			return;
+
+		vmbus_add_channel(channel);
+	}
+}
+
+static void vmbus_queue_offer(struct vmbus_channel *channel)
+{
+	struct vmbus_offer_class *class;
+
+	class = &vmbus_offer_classes[min_t(u16, channel->device_id,
+					   HV_UNKNOWN)];
+
+	spin_lock(&vmbus_offer_lock);
+	list_add_tail(&channel->offer_node, &class->offers);
+	if (!class->deferred)
+		queue_work(vmbus_connection.handle_primary_chan_wq,
+			   &class->work);
+	spin_unlock(&vmbus_offer_lock);
+}
+
+/* Let the deferred classes probe, without waiting for the other ones. */
+static void vmbus_release_deferred_offers(void)
+{
+	struct vmbus_offer_class *class;
+	int i;
+
+	spin_lock(&vmbus_offer_lock);
+	for (i = 0; i < ARRAY_SIZE(vmbus_offer_classes); i++) {
+		class = &vmbus_offer_classes[i];
+		if (!class->deferred)
+			continue;
+
+		class->deferred = false;
+		if (!list_empty(&class->offers))
+			queue_work(vmbus_connection.handle_primary_chan_wq,
+				   &class->work);
+	}
+	spin_unlock(&vmbus_offer_lock);
+}
+
+static void vmbus_offer_release_work(struct work_struct *work)
+{
+	int i;
+
+	/* The deferred flags only ever go from true to false. */
+	for (i = 0; i < ARRAY_SIZE(vmbus_offer_classes); i++) {
+		if (!READ_ONCE(vmbus_offer_classes[i].deferred))
+			flush_work(&vmbus_offer_classes[i].work);
+	}
+
+	vmbus_release_deferred_offers();
+}
+
+void vmbus_offer_classes_init(void)
+{
+	struct vmbus_offer_class *class;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(vmbus_offer_classes); i++) {
+		class = &vmbus_offer_classes[i];
+
+		INIT_LIST_HEAD(&class->offers);
+		INIT_WORK(&class->work, vmbus_offer_class_work);
+		class->deferred = defer_util_probe &&
+				  (i == HV_KVP || i == HV_FCOPY ||
+				   i == HV_BACKUP);
+	}
+}
+
 /*
  * vmbus_process_offer - Process the offer by creating a channel/device
  * associated with this offer
@@ -545,7 +677,6 @@ err_deq_chan:
 static void vmbus_process_offer(struct vmbus_channel *newchannel)
 {
 	struct vmbus_channel *channel;
-	struct workqueue_struct *wq;
 	bool fnew = true;
 
 	/*
@@ -647,10 +778,15 @@ static void vmbus_process_offer(struct vmbus_channel *newchannel)
 	 * can't get the rtnl_lock and this blocks the handling of
 	 * sub-channels.
 	 */
+	newchannel->offer_time = ktime_get();
+	if (fnew) {
+		vmbus_queue_offer(newchannel);
+		return;
+	}
+
 	INIT_WORK(&newchannel->add_channel_work, vmbus_add_channel_work);
-	wq = fnew ? vmbus_connection.handle_primary_chan_wq :
-		    vmbus_connection.handle_sub_chan_wq;
-	queue_work(wq, &newchannel->add_channel_work);
+	queue_work(vmbus_connection.handle_sub_chan_wq,
+		   &newchannel->add_channel_work);
 }
 
 /*
@@ -1092,6 +1228,11 @@ static void vmbus_onoffer_rescind(struct vmbus_channel_message_header *hdr)
 	 * Now wait for offer handling to complete.
 	 */
 	vmbus_rescind_cleanup(channel);
+
+	/* A deferred offer must not make us wait for the boot devices. */
+	if (!READ_ONCE(channel->probe_done))
+		vmbus_release_deferred_offers();
+
 	while (READ_ONCE(channel->probe_done) == false) {
 		/*
 		 * We wait here until any channel offer is currently
@@ -1166,11 +1307,14 @@ EXPORT_SYMBOL_GPL(vmbus_hvsock_device_unregister);
  * vmbus_onoffers_delivered -
  * This is invoked when all offers have been delivered.
  *
- * Nothing to do here.
+ * The boot time offers are all queued now; probe the deferred classes
+ * once the others are done.
  */
 static void vmbus_onoffers_delivered(
 			struct vmbus_channel_message_header *hdr)
 {
+	queue_work(vmbus_connection.handle_primary_chan_wq,
+		   &vmbus_offer_release);
 }
 
 /*
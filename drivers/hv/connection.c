@@ -17,6 +17,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/smpboot.h>
 #include <linux/hyperv.h>
 #include <linux/export.h>
 #include <asm/mshyperv.h>
@@ -165,8 +166,9 @@ int vmbus_connect(void)
 		goto cleanup;
 	}
 
+	/* Unbound, so that device classes can probe in parallel. */
 	vmbus_connection.handle_primary_chan_wq =
-		create_workqueue("hv_pri_chan");
+		alloc_workqueue("hv_pri_chan", WQ_UNBOUND, 0);
 	if (!vmbus_connection.handle_primary_chan_wq) {
 		ret = -ENOMEM;
 		goto cleanup;
@@ -184,6 +186,7 @@ int vmbus_connect(void)
 
 	INIT_LIST_HEAD(&vmbus_connection.chn_list);
 	mutex_init(&vmbus_connection.channel_mutex);
+	vmbus_offer_classes_init();
 
 	/*
 	 * Setup the vmbus event connection for channel interrupt
@@ -346,6 +349,10 @@ void vmbus_on_event(unsigned long data)
 		if (channel->callback_mode != HV_CALL_BATCHED)
 			return;
 
+		/* Under load, leave the host masked for a while longer */
+		if (vmbus_chan_moder_hold(channel))
+			return;
+
 		if (likely(hv_end_read(&channel->inbound) == 0))
 			return;
 
@@ -356,6 +363,363 @@ void vmbus_on_event(unsigned long data)
 	tasklet_schedule(&channel->callback_event);
 }
 
+/*
+ * Busy-poll mode
+ *
+ * For latency sensitive channels, taking an interrupt, raising the tasklet
+ * and unmasking host signaling again for every packet costs more than the
+ * packet itself.  Channels with a non-zero poll_usecs are instead handed
+ * to a per-CPU "vmbus_poll" thread on their first interrupt.  The thread
+ * keeps host signaling masked and polls the inbound ring, running the
+ * channel callback whenever data shows up, until the ring has been empty
+ * for poll_usecs.  Then signaling is unmasked and the channel goes back
+ * to interrupt driven operation.
+ *
+ * The poll thread runs the callback with softirqs disabled and holding the
+ * channel's tasklet lock, so the driver sees exactly the same context as
+ * with the tasklet, and the tasklet and the poll thread never run the
+ * callback concurrently.
+ */
+struct vmbus_poller {
+	spinlock_t lock;		/* protects channels */
+	struct list_head channels;
+	struct vmbus_channel *running;
+};
+
+static DEFINE_PER_CPU(struct vmbus_poller, vmbus_pollers);
+static DEFINE_PER_CPU(struct task_struct *, vmbus_poll_task);
+static DEFINE_MUTEX(vmbus_poll_mutex);
+static bool vmbus_poll_registered;
+
+/*
+ * vmbus_poll_queue - Hand a channel over to this CPU's poll thread
+ *
+ * Called from vmbus_chan_sched() with the channel's sched_lock held, and
+ * from the poll thread itself when data raced with unmasking.
+ */
+void vmbus_poll_queue(struct vmbus_channel *channel)
+{
+	struct vmbus_poller *poller = this_cpu_ptr(&vmbus_pollers);
+
+	lockdep_assert_held(&channel->sched_lock);
+
+	if (channel->poll_queued || !channel->onchannel_callback)
+		return;
+
+	hv_begin_read(&channel->inbound);
+	channel->poll_queued = true;
+	channel->poll_cpu = smp_processor_id();
+	channel->poll_last_busy = ktime_get();
+
+	spin_lock(&poller->lock);
+	list_add_tail(&channel->poll_node, &poller->channels);
+	spin_unlock(&poller->lock);
+
+	wake_up_process(__this_cpu_read(vmbus_poll_task));
+}
+
+/*
+ * vmbus_poll_channel - Poll a channel once
+ *
+ * Returns false when the channel should leave poll mode.
+ */
+static bool vmbus_poll_channel(struct vmbus_channel *channel)
+{
+	struct tasklet_struct *t = &channel->callback_event;
+	u32 poll_usecs = READ_ONCE(channel->poll_usecs);
+	void (*callback_fn)(void *);
+	bool keep = true;
+	ktime_t now;
+
+	local_bh_disable();
+
+	/* The tasklet is running the callback; look again later. */
+	if (!tasklet_trylock(t))
+		goto out;
+
+	/*
+	 * A disabled tasklet means the channel is being closed or suspended;
+	 * leave it alone in the same way tasklet_action() would.
+	 */
+	callback_fn = READ_ONCE(channel->onchannel_callback);
+	if (atomic_read(&t->count) || !callback_fn || !poll_usecs) {
+		keep = false;
+		goto unlock;
+	}
+
+	now = ktime_get();
+	if (hv_get_bytes_to_read(&channel->inbound)) {
+		(*callback_fn)(channel->channel_callback_context);
+		channel->poll_last_busy = now;
+	} else if (ktime_us_delta(now, channel->poll_last_busy) > poll_usecs) {
+		keep = false;
+	}
+
+unlock:
+	tasklet_unlock(t);
+out:
+	local_bh_enable();
+	return keep;
+}
+
+static int vmbus_poll_should_run(unsigned int cpu)
+{
+	return !list_empty_careful(&this_cpu_ptr(&vmbus_pollers)->channels);
+}
+
+static void vmbus_poll_run(unsigned int cpu)
+{
+	struct vmbus_poller *poller = this_cpu_ptr(&vmbus_pollers);
+	struct vmbus_channel *channel;
+	bool unmask = false;
+
+	/* Round robin over the channels of this CPU, one poll at a time. */
+	spin_lock_irq(&poller->lock);
+	channel = list_first_entry_or_null(&poller->channels,
+					   struct vmbus_channel, poll_node);
+	if (channel) {
+		list_move_tail(&channel->poll_node, &poller->channels);
+		WRITE_ONCE(poller->running, channel);
+	}
+	spin_unlock_irq(&poller->lock);
+
+	if (!channel)
+		return;
+
+	if (!vmbus_poll_channel(channel)) {
+		spin_lock_irq(&channel->sched_lock);
+		if (channel->poll_queued) {
+			spin_lock(&poller->lock);
+			list_del_init(&channel->poll_node);
+			spin_unlock(&poller->lock);
+			channel->poll_queued = false;
+			unmask = true;
+		}
+		spin_unlock_irq(&channel->sched_lock);
+	}
+
+	/*
+	 * Back to interrupts.  As in vmbus_on_event(), check for data that
+	 * arrived before the host saw the unmask and would not be signaled.
+	 */
+	if (unmask && hv_end_read(&channel->inbound)) {
+		spin_lock_irq(&channel->sched_lock);
+		if (READ_ONCE(channel->poll_usecs) &&
+		    !atomic_read(&channel->callback_event.count))
+			vmbus_poll_queue(channel);
+		else
+			tasklet_schedule(&channel->callback_event);
+		spin_unlock_irq(&channel->sched_lock);
+	}
+
+	/* Pairs with the wait in vmbus_poll_stop(). */
+	smp_store_release(&poller->running, NULL);
+
+	cond_resched();
+}
+
+static struct smp_hotplug_thread vmbus_poll_threads = {
+	.store			= &vmbus_poll_task,
+	.thread_should_run	= vmbus_poll_should_run,
+	.thread_fn		= vmbus_poll_run,
+	.thread_comm		= "vmbus_poll/%u",
+};
+
+/*
+ * vmbus_poll_init - Create the poll threads on first use of poll mode
+ */
+int vmbus_poll_init(void)
+{
+	int cpu, ret = 0;
+
+	mutex_lock(&vmbus_poll_mutex);
+	if (vmbus_poll_registered)
+		goto out;
+
+	for_each_possible_cpu(cpu) {
+		struct vmbus_poller *poller = per_cpu_ptr(&vmbus_pollers, cpu);
+
+		spin_lock_init(&poller->lock);
+		INIT_LIST_HEAD(&poller->channels);
+	}
+
+	ret = smpboot_register_percpu_thread(&vmbus_poll_threads);
+	if (!ret)
+		vmbus_poll_registered = true;
+out:
+	mutex_unlock(&vmbus_poll_mutex);
+	return ret;
+}
+
+void vmbus_poll_exit(void)
+{
+	mutex_lock(&vmbus_poll_mutex);
+	if (vmbus_poll_registered)
+		smpboot_unregister_percpu_thread(&vmbus_poll_threads);
+	vmbus_poll_registered = false;
+	mutex_unlock(&vmbus_poll_mutex);
+}
+
+/*
+ * vmbus_poll_stop - Take a channel out of poll mode for good
+ *
+ * Called from vmbus_reset_channel_cb() after the channel tasklet has been
+ * disabled and onchannel_callback cleared, so the channel cannot be queued
+ * again.  On return no poll thread references the channel any more.
+ */
+void vmbus_poll_stop(struct vmbus_channel *channel)
+{
+	struct vmbus_poller *poller;
+	unsigned long flags;
+	int cpu;
+
+	if (!vmbus_poll_registered)
+		return;
+
+	spin_lock_irqsave(&channel->sched_lock, flags);
+	if (channel->poll_queued) {
+		poller = per_cpu_ptr(&vmbus_pollers, channel->poll_cpu);
+		spin_lock(&poller->lock);
+		list_del_init(&channel->poll_node);
+		spin_unlock(&poller->lock);
+		channel->poll_queued = false;
+	}
+	spin_unlock_irqrestore(&channel->sched_lock, flags);
+
+	/* Pairs with the smp_store_release() in vmbus_poll_run(). */
+	for_each_online_cpu(cpu) {
+		poller = per_cpu_ptr(&vmbus_pollers, cpu);
+		while (smp_load_acquire(&poller->running) == channel)
+			cpu_relax();
+	}
+}
+
+/*
+ * Adaptive interrupt moderation
+ *
+ * Unmasking host interrupts as soon as the inbound ring is empty costs an
+ * interrupt and a callback for nearly every packet under load.  Channels
+ * whose driver enables moderation instead keep the interrupts masked for a
+ * few microseconds after a callback that found packets, and moder_timer
+ * runs the callback again when they are up.  Only a callback that found
+ * nothing unmasks, so an idle channel is back to interrupts after one more
+ * look at the ring.
+ *
+ * The hold time is picked by lib/dim from the packets and callbacks per
+ * millisecond.  The lowest profile doesn't hold at all, which is where
+ * channels at low load stay, since holding there only adds callbacks.
+ */
+#define VMBUS_MODER_PROFILES	5
+
+static const u32 vmbus_moder_profile[VMBUS_MODER_PROFILES] = {
+	0, 8, 16, 32, 64,
+};
+
+static void vmbus_chan_moder_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct vmbus_channel *channel =
+		container_of(dim, struct vmbus_channel, moder_dim);
+
+	WRITE_ONCE(channel->moder_usecs, vmbus_moder_profile[dim->profile_ix]);
+	dim->state = DIM_START_MEASURE;
+}
+
+/* Kick the channel as an interrupt from the host would */
+static enum hrtimer_restart vmbus_chan_moder_timer(struct hrtimer *timer)
+{
+	struct vmbus_channel *channel =
+		container_of(timer, struct vmbus_channel, moder_timer);
+	void (*callback_fn)(void *);
+
+	/* See the inline comments in vmbus_chan_sched(). */
+	spin_lock(&channel->sched_lock);
+
+	callback_fn = channel->onchannel_callback;
+	if (unlikely(callback_fn == NULL))
+		goto unlock;
+
+	if (READ_ONCE(channel->poll_usecs))
+		vmbus_poll_queue(channel);
+	else if (channel->callback_mode == HV_CALL_ISR)
+		(*callback_fn)(channel->channel_callback_context);
+	else
+		tasklet_schedule(&channel->callback_event);
+
+unlock:
+	spin_unlock(&channel->sched_lock);
+	return HRTIMER_NORESTART;
+}
+
+void vmbus_chan_moder_init(struct vmbus_channel *channel)
+{
+	INIT_WORK(&channel->moder_dim.work, vmbus_chan_moder_work);
+	channel->moder_dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	hrtimer_init(&channel->moder_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	channel->moder_timer.function = vmbus_chan_moder_timer;
+}
+
+/*
+ * vmbus_chan_moder_enable - Turn adaptive interrupt moderation on or off
+ *
+ * For HV_CALL_BATCHED channels vmbus_on_event() takes care of everything.
+ * HV_CALL_ISR drivers call vmbus_chan_moder_hold() themselves where they
+ * would unmask host interrupts.  Either way the driver accounts the packets
+ * its callback reads with vmbus_chan_moder_account().
+ */
+void vmbus_chan_moder_enable(struct vmbus_channel *channel, bool enable)
+{
+	WRITE_ONCE(channel->moder_enabled, enable);
+}
+EXPORT_SYMBOL_GPL(vmbus_chan_moder_enable);
+
+/*
+ * vmbus_chan_moder_hold - Decide whether to unmask host interrupts
+ *
+ * Called with host interrupts masked from the callback context, once the
+ * inbound ring is empty.  Returns true if they are to stay masked, in
+ * which case moder_timer runs the callback again.
+ */
+bool vmbus_chan_moder_hold(struct vmbus_channel *channel)
+{
+	struct dim_sample sample = {};
+	u32 usecs;
+
+	if (!READ_ONCE(channel->moder_enabled))
+		return false;
+
+	dim_update_sample(++channel->moder_events, channel->moder_packets, 0,
+			  &sample);
+	net_dim(&channel->moder_dim, sample);
+
+	if (channel->moder_packets == channel->moder_last_packets)
+		return false;
+	channel->moder_last_packets = channel->moder_packets;
+
+	usecs = READ_ONCE(channel->moder_usecs);
+	if (!usecs)
+		return false;
+
+	hrtimer_start(&channel->moder_timer, us_to_ktime(usecs),
+		      HRTIMER_MODE_REL);
+	return true;
+}
+EXPORT_SYMBOL_GPL(vmbus_chan_moder_hold);
+
+/*
+ * vmbus_chan_moder_stop - Called from vmbus_reset_channel_cb() after
+ * onchannel_callback has been cleared, so the timer cannot kick the
+ * channel any more
+ */
+void vmbus_chan_moder_stop(struct vmbus_channel *channel)
+{
+	hrtimer_cancel(&channel->moder_timer);
+	cancel_work_sync(&channel->moder_dim.work);
+	WRITE_ONCE(channel->moder_usecs, 0);
+	channel->moder_dim.profile_ix = 0;
+	channel->moder_dim.state = DIM_START_MEASURE;
+}
+
 /*
  * vmbus_post_msg - Send a msg on the vmbus's message connection
  */
@@ -22,6 +22,8 @@
 #include <linux/notifier.h>
 #include <linux/percpu_counter.h>
 #include <linux/page_reporting.h>
+#include <linux/psi.h>
+#include <linux/vmstat.h>
 
 #include <linux/hyperv.h>
 #include <asm/hyperv-tlfs.h>
@@ -450,6 +452,7 @@ struct hv_hotadd_gap {
 
 struct balloon_state {
 	__u32 num_pages;
+	ktime_t start;
 	struct work_struct wrk;
 };
 
@@ -461,6 +464,7 @@ struct hot_add_wrk {
 
 static bool allow_hibernation;
 static bool hot_add = true;
+static bool hot_add_movable;
 static bool do_hot_add;
 /*
  * Delay reporting memory pressure by
@@ -468,6 +472,26 @@ static bool do_hot_add;
  */
 static uint pressure_report_delay = 45;
 
+/*
+ * Pages handed back by the host are parked in a pool for a while, so that
+ * a balloon-up request shortly after can be satisfied without going through
+ * the page allocator again.
+ */
+static uint balloon_pool_pages = (128 * 1024 * 1024) / PAGE_SIZE;
+static uint balloon_pool_hold = 5;
+
+/*
+ * When adaptive_reporting is set the free page reporting order and rate
+ * follow the memory pressure of the guest: free memory is reported at
+ * the smallest order and a fast rate while the memory PSI stays below
+ * reporting_psi_low, and reporting is suspended while it is above
+ * reporting_psi_high or when little page cache is left to reclaim.
+ * Both thresholds are in hundredths of a percent.
+ */
+static bool adaptive_reporting = true;
+static uint reporting_psi_low = 10;
+static uint reporting_psi_high = 500;
+
 /*
  * The last time we posted a pressure report to host.
  */
@@ -476,8 +500,26 @@ static unsigned long last_post_time;
 module_param(hot_add, bool, (S_IRUGO | S_IWUSR));
 MODULE_PARM_DESC(hot_add, "If set attempt memory hot_add");
 
+module_param(hot_add_movable, bool, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(hot_add_movable, "Online hot-added memory to ZONE_MOVABLE");
+
 module_param(pressure_report_delay, uint, (S_IRUGO | S_IWUSR));
 MODULE_PARM_DESC(pressure_report_delay, "Delay in secs in reporting pressure");
+
+module_param(balloon_pool_pages, uint, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(balloon_pool_pages, "Max pages kept back after balloon-down");
+
+module_param(balloon_pool_hold, uint, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(balloon_pool_hold, "Secs to keep unballooned pages pooled");
+
+module_param(adaptive_reporting, bool, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(adaptive_reporting, "Drive page reporting by memory pressure");
+
+module_param(reporting_psi_low, uint, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(reporting_psi_low, "Memory PSI below which reporting speeds up");
+
+module_param(reporting_psi_high, uint, (S_IRUGO | S_IWUSR));
+MODULE_PARM_DESC(reporting_psi_high, "Memory PSI above which reporting stops");
 static atomic_t trans_id = ATOMIC_INIT(0);
 
 static int dm_ring_size = 20 * 1024;
@@ -519,6 +561,25 @@ struct hv_dynmem_device {
 	 */
 	struct balloon_state balloon_wrk;
 
+	/*
+	 * Pages returned by the host which are kept offline and ready to be
+	 * ballooned out again. The first page of each range is linked on
+	 * pool_list and carries the length of the range in page_private.
+	 * Protected by pool_lock.
+	 */
+	spinlock_t pool_lock;
+	struct list_head pool_list;
+	unsigned int num_pages_pooled;
+	unsigned long pool_expire;
+
+	/*
+	 * Accounting for the balloon-down request in progress, which may be
+	 * spread over several messages from the host.
+	 */
+	ktime_t unballoon_start;
+	unsigned int unballoon_pages;
+	unsigned int unballoon_pooled;
+
 	/*
 	 * State to execute the "hot-add" operation.
 	 */
@@ -571,6 +632,7 @@ struct hv_dynmem_device {
 static struct hv_dynmem_device dm_device;
 
 static void post_status(struct hv_dynmem_device *dm);
+static void tune_page_reporting(void);
 
 #ifdef CONFIG_MEMORY_HOTPLUG
 static inline bool has_pfn_is_backed(struct hv_hotadd_state *has,
@@ -591,6 +653,24 @@ static inline bool has_pfn_is_backed(struct hv_hotadd_state *has,
 	return true;
 }
 
+/* Check whether all pfns in [pfn, pfn + nr_pages) are backed. */
+static bool has_range_is_backed(struct hv_hotadd_state *has,
+				unsigned long pfn, unsigned long nr_pages)
+{
+	struct hv_hotadd_gap *gap;
+
+	if ((pfn < has->covered_start_pfn) ||
+	    (pfn + nr_pages > has->covered_end_pfn))
+		return false;
+
+	list_for_each_entry(gap, &has->gap_list, list) {
+		if ((pfn < gap->end_pfn) && (pfn + nr_pages > gap->start_pfn))
+			return false;
+	}
+
+	return true;
+}
+
 static unsigned long hv_page_offline_check(unsigned long start_pfn,
 					   unsigned long nr_pages)
 {
@@ -687,14 +767,50 @@ static void hv_page_online_one(struct hv_hotadd_state *has, struct page *pg)
 	dm_device.num_pages_onlined++;
 }
 
+/*
+ * Online the largest naturally aligned block at pfn that is fully backed
+ * and ends before end_pfn in one go. Returns the number of pages handled.
+ */
+static unsigned long hv_page_online_block(struct hv_hotadd_state *has,
+					  unsigned long pfn,
+					  unsigned long end_pfn)
+{
+	unsigned int order = pfn ? min_t(unsigned int, __ffs(pfn),
+					 MAX_ORDER - 1) : MAX_ORDER - 1;
+	unsigned long i;
+	struct page *pg;
+
+	while (order && (pfn + (1UL << order) > end_pfn ||
+			 !has_range_is_backed(has, pfn, 1UL << order)))
+		order--;
+
+	if (!order) {
+		hv_page_online_one(has, pfn_to_page(pfn));
+		return 1;
+	}
+
+	pg = pfn_to_page(pfn);
+	for (i = 0; i < (1UL << order); i++) {
+		if (PageOffline(pg + i))
+			__ClearPageOffline(pg + i);
+	}
+
+	generic_online_page(pg, order);
+
+	lockdep_assert_held(&dm_device.ha_lock);
+	dm_device.num_pages_onlined += 1UL << order;
+
+	return 1UL << order;
+}
+
 static void hv_bring_pgs_online(struct hv_hotadd_state *has,
 				unsigned long start_pfn, unsigned long size)
 {
-	int i;
+	unsigned long pfn = start_pfn, end_pfn = start_pfn + size;
 
 	pr_debug("Online %lu pages starting at pfn 0x%lx\n", size, start_pfn);
-	for (i = 0; i < size; i++)
-		hv_page_online_one(has, pfn_to_page(start_pfn + i));
+	while (pfn < end_pfn)
+		pfn += hv_page_online_block(has, pfn, end_pfn);
 }
 
 static void hv_mem_hot_add(unsigned long start, unsigned long size,
@@ -729,7 +845,8 @@ static void hv_mem_hot_add(unsigned long start, unsigned long size,
 
 		nid = memory_add_physaddr_to_nid(PFN_PHYS(start_pfn));
 		ret = add_memory(nid, PFN_PHYS((start_pfn)),
-				(HA_CHUNK << PAGE_SHIFT), MEMHP_MERGE_RESOURCE);
+				(HA_CHUNK << PAGE_SHIFT), MEMHP_MERGE_RESOURCE |
+				(hot_add_movable ? MEMHP_ONLINE_MOVABLE : MHP_NONE));
 
 		if (ret) {
 			pr_err("hot_add memory failed error is %d\n", ret);
@@ -1153,11 +1270,13 @@ static void post_status(struct hv_dynmem_device *dm)
 	 * balloon. Compute this and add it to the pressure report.
 	 * We also need to report all offline pages (num_pages_added -
 	 * num_pages_onlined) as committed to the host, otherwise it can try
-	 * asking us to balloon them out.
+	 * asking us to balloon them out. The same goes for the pages kept
+	 * back in the pool, which the guest can't use either.
 	 */
 	status.num_avail = si_mem_available();
 	status.num_committed = vm_memory_committed() +
 		dm->num_pages_ballooned +
+		READ_ONCE(dm->num_pages_pooled) +
 		(dm->num_pages_added > dm->num_pages_onlined ?
 		 dm->num_pages_added - dm->num_pages_onlined : 0) +
 		compute_balloon_floor();
@@ -1188,20 +1307,145 @@ static void post_status(struct hv_dynmem_device *dm)
 
 }
 
+static void release_balloon_range(unsigned long start_pfn,
+				  unsigned long num_pages)
+{
+	struct page *pg;
+	unsigned long i;
+
+	for (i = 0; i < num_pages; i++) {
+		pg = pfn_to_page(start_pfn + i);
+		__ClearPageOffline(pg);
+		__free_page(pg);
+	}
+}
+
 static void free_balloon_pages(struct hv_dynmem_device *dm,
 			 union dm_mem_page_range *range_array)
 {
 	int num_pages = range_array->finfo.page_cnt;
 	__u64 start_frame = range_array->finfo.start_page;
+
+	release_balloon_range(start_frame, num_pages);
+	dm->num_pages_ballooned -= num_pages;
+}
+
+/*
+ * Take back a range the host has returned to us. As much of it as fits
+ * in the pool stays offline so that it can be handed out again by the
+ * next balloon-up request; the rest goes back to the page allocator.
+ * Returns the number of pages pooled.
+ */
+static unsigned int pool_balloon_pages(struct hv_dynmem_device *dm,
+				       union dm_mem_page_range *range_array)
+{
+	unsigned int num_pages = range_array->finfo.page_cnt;
+	unsigned long start_frame = range_array->finfo.start_page;
+	unsigned int pooled = 0;
+	unsigned long flags;
 	struct page *pg;
-	int i;
 
-	for (i = 0; i < num_pages; i++) {
-		pg = pfn_to_page(i + start_frame);
-		__ClearPageOffline(pg);
-		__free_page(pg);
-		dm->num_pages_ballooned--;
+	spin_lock_irqsave(&dm->pool_lock, flags);
+	if (dm->num_pages_pooled < balloon_pool_pages) {
+		pooled = min(num_pages,
+			     balloon_pool_pages - dm->num_pages_pooled);
+		pg = pfn_to_page(start_frame);
+		set_page_private(pg, pooled);
+		list_add(&pg->lru, &dm->pool_list);
+		dm->num_pages_pooled += pooled;
+		dm->pool_expire = jiffies + balloon_pool_hold * HZ;
 	}
+	dm->num_pages_ballooned -= num_pages;
+	spin_unlock_irqrestore(&dm->pool_lock, flags);
+
+	if (pooled < num_pages)
+		release_balloon_range(start_frame + pooled,
+				      num_pages - pooled);
+
+	return pooled;
+}
+
+/*
+ * Satisfy as much of a balloon-up request as possible from the pool.
+ * Returns the number of pages added to bl_resp.
+ */
+static unsigned int reuse_balloon_pages(struct hv_dynmem_device *dm,
+					unsigned int num_pages,
+					struct dm_balloon_response *bl_resp)
+{
+	unsigned int got = 0, cnt;
+	unsigned long flags, pfn;
+	struct page *pg, *rest;
+
+	spin_lock_irqsave(&dm->pool_lock, flags);
+	while (got < num_pages && !list_empty(&dm->pool_list)) {
+		if (bl_resp->hdr.size + sizeof(union dm_mem_page_range) >
+			HV_HYP_PAGE_SIZE)
+			break;
+
+		pg = list_first_entry(&dm->pool_list, struct page, lru);
+		list_del(&pg->lru);
+		pfn = page_to_pfn(pg);
+		cnt = page_private(pg);
+		set_page_private(pg, 0);
+
+		/* Leave the tail of a range we don't need in the pool. */
+		if (cnt > num_pages - got) {
+			rest = pfn_to_page(pfn + num_pages - got);
+			set_page_private(rest, cnt - (num_pages - got));
+			list_add(&rest->lru, &dm->pool_list);
+			cnt = num_pages - got;
+		}
+
+		bl_resp->range_array[bl_resp->range_count].finfo.start_page =
+			pfn;
+		bl_resp->range_array[bl_resp->range_count].finfo.page_cnt =
+			cnt;
+		bl_resp->range_count++;
+		bl_resp->hdr.size += sizeof(union dm_mem_page_range);
+
+		dm->num_pages_pooled -= cnt;
+		dm->num_pages_ballooned += cnt;
+		got += cnt;
+	}
+	spin_unlock_irqrestore(&dm->pool_lock, flags);
+
+	return got;
+}
+
+/*
+ * Give pooled pages back to the page allocator. Unless forced, this only
+ * happens once the pool has been idle for balloon_pool_hold seconds or
+ * when the guest is getting short of memory.
+ */
+static void drain_balloon_pool(struct hv_dynmem_device *dm, bool force)
+{
+	unsigned int drained;
+	unsigned long flags;
+	struct page *pg, *tmp;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&dm->pool_lock, flags);
+	if (!dm->num_pages_pooled ||
+	    (!force && time_before(jiffies, dm->pool_expire) &&
+	     si_mem_available() >= compute_balloon_floor())) {
+		spin_unlock_irqrestore(&dm->pool_lock, flags);
+		return;
+	}
+	list_splice_init(&dm->pool_list, &list);
+	drained = dm->num_pages_pooled;
+	dm->num_pages_pooled = 0;
+	spin_unlock_irqrestore(&dm->pool_lock, flags);
+
+	list_for_each_entry_safe(pg, tmp, &list, lru) {
+		unsigned long cnt = page_private(pg);
+
+		list_del(&pg->lru);
+		set_page_private(pg, 0);
+		release_balloon_range(page_to_pfn(pg), cnt);
+	}
+
+	trace_balloon_pool_drain(drained, force);
 }
 
 
@@ -1244,10 +1488,11 @@ static unsigned int alloc_balloon_pages(struct hv_dynmem_device *dm,
 		for (j = 0; j < (1 << get_order(alloc_unit << PAGE_SHIFT)); j++)
 			__SetPageOffline(pg + j);
 
-		bl_resp->range_count++;
-		bl_resp->range_array[i].finfo.start_page =
+		bl_resp->range_array[bl_resp->range_count].finfo.start_page =
 			page_to_pfn(pg);
-		bl_resp->range_array[i].finfo.page_cnt = alloc_unit;
+		bl_resp->range_array[bl_resp->range_count].finfo.page_cnt =
+			alloc_unit;
+		bl_resp->range_count++;
 		bl_resp->hdr.size += sizeof(union dm_mem_page_range);
 
 	}
@@ -1259,6 +1504,7 @@ static void balloon_up(struct work_struct *dummy)
 {
 	unsigned int num_pages = dm_device.balloon_wrk.num_pages;
 	unsigned int num_ballooned = 0;
+	unsigned int total_ballooned = 0, total_reused = 0, reused;
 	struct dm_balloon_response *bl_resp;
 	int alloc_unit;
 	int ret;
@@ -1293,8 +1539,10 @@ static void balloon_up(struct work_struct *dummy)
 		bl_resp->more_pages = 1;
 
 		num_pages -= num_ballooned;
-		num_ballooned = alloc_balloon_pages(&dm_device, num_pages,
-						    bl_resp, alloc_unit);
+		reused = reuse_balloon_pages(&dm_device, num_pages, bl_resp);
+		num_ballooned = reused +
+			alloc_balloon_pages(&dm_device, num_pages - reused,
+					    bl_resp, alloc_unit);
 
 		if (alloc_unit != 1 && num_ballooned == 0) {
 			alloc_unit = 1;
@@ -1340,9 +1588,16 @@ static void balloon_up(struct work_struct *dummy)
 						 &bl_resp->range_array[i]);
 
 			done = true;
+		} else {
+			total_ballooned += num_ballooned;
+			total_reused += reused;
 		}
 	}
 
+	trace_balloon_up_done(dm_device.balloon_wrk.num_pages,
+			      total_ballooned, total_reused,
+			      ktime_us_delta(ktime_get(),
+					     dm_device.balloon_wrk.start));
 }
 
 static void balloon_down(struct hv_dynmem_device *dm,
@@ -1355,16 +1610,23 @@ static void balloon_down(struct hv_dynmem_device *dm,
 	unsigned int prev_pages_ballooned = dm->num_pages_ballooned;
 
 	for (i = 0; i < range_count; i++) {
-		free_balloon_pages(dm, &range_array[i]);
+		dm->unballoon_pooled += pool_balloon_pages(dm, &range_array[i]);
 		complete(&dm_device.config_event);
 	}
 
 	pr_debug("Freed %u ballooned pages.\n",
 		prev_pages_ballooned - dm->num_pages_ballooned);
+	dm->unballoon_pages += prev_pages_ballooned - dm->num_pages_ballooned;
 
 	if (req->more_pages == 1)
 		return;
 
+	trace_balloon_down_done(dm->unballoon_pages, dm->unballoon_pooled,
+				ktime_us_delta(ktime_get(),
+					       dm->unballoon_start));
+	dm->unballoon_pages = 0;
+	dm->unballoon_pooled = 0;
+
 	memset(&resp, 0, sizeof(struct dm_unballoon_response));
 	resp.hdr.type = DM_UNBALLOON_RESPONSE;
 	resp.hdr.trans_id = atomic_inc_return(&trans_id);
@@ -1393,6 +1655,8 @@ static int dm_thread_func(void *dm_dev)
 		 */
 		reinit_completion(&dm_device.config_event);
 		post_status(dm);
+		drain_balloon_pool(dm, false);
+		tune_page_reporting();
 	}
 
 	return 0;
@@ -1513,6 +1777,7 @@ static void balloon_onchannelcallback(void *context)
 			bal_msg = (struct dm_balloon *)recv_buffer;
 			dm->state = DM_BALLOON_UP;
 			dm_device.balloon_wrk.num_pages = bal_msg->num_pages;
+			dm_device.balloon_wrk.start = ktime_get();
 			schedule_work(&dm_device.balloon_wrk.wrk);
 			break;
 
@@ -1522,6 +1787,8 @@ static void balloon_onchannelcallback(void *context)
 				break;
 			}
 
+			if (dm->state != DM_BALLOON_DOWN)
+				dm->unballoon_start = ktime_get();
 			dm->state = DM_BALLOON_DOWN;
 			balloon_down(dm,
 				 (struct dm_unballoon_request *)recv_buffer);
@@ -1617,6 +1884,52 @@ static int hv_free_page_report(struct page_reporting_dev_info *pr_dev_info,
 	return 0;
 }
 
+/*
+ * Pick the reporting order and rate from the current memory pressure.
+ * Called once a second from dm_thread_func().
+ *
+ * While the guest is idle, report every free 2M block quickly so the
+ * host can reuse cold memory. Under moderate pressure only report the
+ * largest blocks at the default rate, and stop reporting altogether
+ * during bursts: pages the host discards now would most likely be
+ * faulted back in right away.
+ */
+static void tune_page_reporting(void)
+{
+	struct page_reporting_dev_info *prdev = &dm_device.pr_dev_info;
+	unsigned int order = 0, old_order;
+	unsigned long pressure = 0, cache = 0;
+	unsigned long delay = 0;
+
+	if (!prdev->report)
+		return;
+
+	if (adaptive_reporting) {
+		pressure = psi_mem_pressure();
+		cache = global_node_page_state(NR_INACTIVE_FILE);
+
+		if (pressure >= reporting_psi_high ||
+		    cache < compute_balloon_floor()) {
+			order = MAX_ORDER;
+		} else if (pressure <= reporting_psi_low) {
+			order = pageblock_order;
+			delay = HZ / 2;
+		} else {
+			order = MAX_ORDER - 1;
+		}
+	}
+
+	old_order = prdev->order;
+	if (order == old_order && delay == prdev->delay)
+		return;
+
+	WRITE_ONCE(prdev->order, order);
+	WRITE_ONCE(prdev->delay, delay);
+	page_reporting_request(prdev);
+
+	trace_balloon_page_reporting(pressure, cache, old_order, order, delay);
+}
+
 static void enable_page_reporting(void)
 {
 	int ret;
@@ -1780,6 +2093,8 @@ static int balloon_probe(struct hv_device *dev,
 	init_completion(&dm_device.config_event);
 	INIT_LIST_HEAD(&dm_device.ha_region_list);
 	spin_lock_init(&dm_device.ha_lock);
+	INIT_LIST_HEAD(&dm_device.pool_list);
+	spin_lock_init(&dm_device.pool_lock);
 	INIT_WORK(&dm_device.balloon_wrk.wrk, balloon_up);
 	INIT_WORK(&dm_device.ha_wrk.wrk, hot_add_req);
 	dm_device.host_specified_ha_region = false;
@@ -1836,6 +2151,7 @@ static int balloon_remove(struct hv_device *dev)
 	kthread_stop(dm->thread);
 	disable_page_reporting();
 	vmbus_close(dev->channel);
+	drain_balloon_pool(dm, true);
 #ifdef CONFIG_MEMORY_HOTPLUG
 	unregister_memory_notifier(&hv_memory_nb);
 	restore_online_page_callback(&hv_online_page);
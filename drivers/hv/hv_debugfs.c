@@ -8,6 +8,7 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/err.h>
+#include <linux/seq_file.h>
 
 #include "hyperv_vmbus.h"
 
@@ -98,6 +99,203 @@ static int hv_debug_set_test_state(struct hv_device *dev, struct dentry *root)
 	return 0;
 }
 
+static void hv_debug_ring_stats_one(struct seq_file *m,
+				    struct vmbus_channel *channel)
+{
+	u32 send = channel->ringbuffer_send_offset << PAGE_SHIFT;
+	u32 recv = (channel->ringbuffer_pagecount << PAGE_SHIFT) - send;
+
+	seq_printf(m, "%5u %8u %8u %10llu %10llu %10llu %14llu %12llu\n",
+		   channel->offermsg.child_relid, send, recv,
+		   channel->intr_in_full, channel->out_full_first,
+		   channel->out_full_total,
+		   channel->out_full_stall_ns / NSEC_PER_USEC,
+		   channel->out_full_stall_max_ns / NSEC_PER_USEC);
+}
+
+/* Per-channel ring sizes and outbound backpressure of a vmbus device */
+static int hv_debugfs_ring_stats_show(struct seq_file *m, void *unused)
+{
+	struct vmbus_channel *channel = m->private;
+	struct vmbus_channel *sc;
+
+	seq_puts(m, "relid     send     recv    in_full out_first   out_total  stall_total_us stall_max_us\n");
+
+	mutex_lock(&vmbus_connection.channel_mutex);
+	hv_debug_ring_stats_one(m, channel);
+	list_for_each_entry(sc, &channel->sc_list, sc_list)
+		hv_debug_ring_stats_one(m, sc);
+	mutex_unlock(&vmbus_connection.channel_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hv_debugfs_ring_stats);
+
+/* Setup ring buffer statistics file for vmbus device */
+static int hv_debug_ring_stats_file(struct hv_device *dev, struct dentry *root)
+{
+	char *name = "ring_stats";
+	struct dentry *file;
+
+	file = debugfs_create_file(name, 0444, root, dev->channel,
+				   &hv_debugfs_ring_stats_fops);
+	if (IS_ERR(file)) {
+		pr_debug("debugfs_hyperv: file %s not created\n", name);
+		return PTR_ERR(file);
+	}
+
+	return 0;
+}
+
+/* Per-CPU event page scans done by vmbus_chan_sched() */
+static int hv_debugfs_chan_sched_show(struct seq_file *m, void *unused)
+{
+	int cpu;
+
+	seq_puts(m, "cpu      scans full_scans   spurious\n");
+
+	for_each_online_cpu(cpu) {
+		struct hv_per_cpu_context *hv_cpu
+			= per_cpu_ptr(hv_context.cpu_context, cpu);
+
+		seq_printf(m, "%3d %10llu %10llu %10llu\n", cpu,
+			   READ_ONCE(hv_cpu->chan_sched_scans),
+			   READ_ONCE(hv_cpu->chan_sched_full_scans),
+			   READ_ONCE(hv_cpu->chan_sched_spurious));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hv_debugfs_chan_sched);
+
+static void hv_debug_offer_times_one(struct seq_file *m,
+				     struct vmbus_channel *channel)
+{
+	s64 queued = -1, probe = -1;
+
+	if (READ_ONCE(channel->probe_done)) {
+		queued = ktime_us_delta(channel->probe_start,
+					channel->offer_time);
+		probe = ktime_us_delta(channel->probe_end,
+				       channel->probe_start);
+	}
+
+	seq_printf(m, "%5u %5u %5u %10lld %10lld\n",
+		   channel->offermsg.child_relid, channel->device_id,
+		   channel->offermsg.offer.sub_channel_index, queued, probe);
+}
+
+/* Time each offer waited to be probed, and how long the probe took */
+static int hv_debugfs_offer_times_show(struct seq_file *m, void *unused)
+{
+	struct vmbus_channel *channel, *sc;
+
+	seq_puts(m, "relid class subch  queued_us   probe_us\n");
+
+	mutex_lock(&vmbus_connection.channel_mutex);
+	list_for_each_entry(channel, &vmbus_connection.chn_list, listentry) {
+		hv_debug_offer_times_one(m, channel);
+		list_for_each_entry(sc, &channel->sc_list, sc_list)
+			hv_debug_offer_times_one(m, sc);
+	}
+	mutex_unlock(&vmbus_connection.channel_mutex);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hv_debugfs_offer_times);
+
+/*
+ * Loopback benchmark of the ring buffer code. The inbound and outbound rings
+ * of a channel that is not known to the host map the same pages, packets are
+ * sent with vmbus_sendpacket() until the ring is full and received again with
+ * vmbus_recvpacket(). The interrupt mask is set and flow control is off, so
+ * neither side signals the host. One line per packet size, in key=value form
+ * for scripts.
+ */
+#define HV_RING_BENCH_PAGES	64
+#define HV_RING_BENCH_BYTES	(64 << 20)
+
+static const u32 hv_ring_bench_sizes[] = { 64, 256, 1024, 4096 };
+
+static void hv_ring_bench_one(struct seq_file *m,
+			      struct vmbus_channel *channel, void *buf,
+			      u32 size)
+{
+	u64 write_ns = 0, read_ns = 0, packets = 0, start, mid;
+	u32 actual;
+	u64 reqid;
+	int i, n;
+
+	while (packets * size < HV_RING_BENCH_BYTES) {
+		start = ktime_get_ns();
+		for (n = 0; !vmbus_sendpacket(channel, buf, size, n,
+					      VM_PKT_DATA_INBAND, 0); n++)
+			;
+		mid = ktime_get_ns();
+		for (i = 0; i < n; i++)
+			vmbus_recvpacket(channel, buf, size, &actual, &reqid);
+		write_ns += mid - start;
+		read_ns += ktime_get_ns() - mid;
+		packets += n;
+		if (!n)
+			break;
+		cond_resched();
+	}
+
+	if (!packets || !write_ns || !read_ns)
+		return;
+
+	seq_printf(m, "vmbus_ring size=%u packets=%llu write_ns_per_pkt=%llu read_ns_per_pkt=%llu write_mbps=%llu read_mbps=%llu\n",
+		   size, packets, div64_u64(write_ns, packets),
+		   div64_u64(read_ns, packets),
+		   div64_u64(packets * size * 1000, write_ns),
+		   div64_u64(packets * size * 1000, read_ns));
+}
+
+static int hv_debugfs_ring_bench_show(struct seq_file *m, void *unused)
+{
+	struct vmbus_channel *channel;
+	struct page *pages;
+	void *buf;
+	int i, ret = -ENOMEM;
+
+	channel = kzalloc(sizeof(*channel), GFP_KERNEL);
+	buf = kzalloc(hv_ring_bench_sizes[ARRAY_SIZE(hv_ring_bench_sizes) - 1],
+		      GFP_KERNEL);
+	pages = alloc_pages(GFP_KERNEL | __GFP_ZERO,
+			    get_order(HV_RING_BENCH_PAGES << PAGE_SHIFT));
+	if (!channel || !buf || !pages)
+		goto out;
+
+	hv_ringbuffer_pre_init(channel);
+	ret = hv_ringbuffer_init(&channel->outbound, pages,
+				 HV_RING_BENCH_PAGES);
+	if (ret)
+		goto out;
+	ret = hv_ringbuffer_init(&channel->inbound, pages, HV_RING_BENCH_PAGES);
+	if (ret)
+		goto out_outbound;
+
+	/* both map the same header page */
+	channel->outbound.ring_buffer->interrupt_mask = 1;
+	channel->outbound.ring_buffer->feature_bits.value = 0;
+
+	for (i = 0; i < ARRAY_SIZE(hv_ring_bench_sizes); i++)
+		hv_ring_bench_one(m, channel, buf, hv_ring_bench_sizes[i]);
+
+	hv_ringbuffer_cleanup(&channel->inbound);
+out_outbound:
+	hv_ringbuffer_cleanup(&channel->outbound);
+out:
+	if (pages)
+		__free_pages(pages,
+			     get_order(HV_RING_BENCH_PAGES << PAGE_SHIFT));
+	kfree(buf);
+	kfree(channel);
+	return ret;
+}
+DEFINE_SHOW_ATTRIBUTE(hv_debugfs_ring_bench);
+
 /* Bind hv device to a dentry for debugfs */
 static void hv_debug_set_dir_dentry(struct hv_device *dev, struct dentry *root)
 {
@@ -121,6 +319,7 @@ int hv_debug_add_dev_dir(struct hv_device *dev)
 			return PTR_ERR(dev_root);
 		}
 		hv_debug_set_test_state(dev, dev_root);
+		hv_debug_ring_stats_file(dev, dev_root);
 		hv_debug_set_dir_dentry(dev, dev_root);
 		delay = debugfs_create_dir(delay_name, dev_root);
 
@@ -174,5 +373,12 @@ int hv_debug_init(void)
 		pr_debug("debugfs_hyperv: hyperv/ not created\n");
 		return PTR_ERR(hv_debug_root);
 	}
+
+	debugfs_create_file("chan_sched", 0444, hv_debug_root, NULL,
+			    &hv_debugfs_chan_sched_fops);
+	debugfs_create_file("offer_times", 0444, hv_debug_root, NULL,
+			    &hv_debugfs_offer_times_fops);
+	debugfs_create_file("ring_bench", 0400, hv_debug_root, NULL,
+			    &hv_debugfs_ring_bench_fops);
 	return 0;
 }
@@ -13,6 +13,8 @@
 #include <linux/workqueue.h>
 #include <linux/hyperv.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/module.h>
 #include <asm/hyperv-tlfs.h>
 
 #include "hyperv_vmbus.h"
@@ -54,11 +56,47 @@ static struct {
 	u64 recv_req_id; /* request ID. */
 } fcopy_transaction;
 
+/*
+ * Write-behind of WRITE_TO_FILE fragments. The host does not send the next
+ * fragment before the previous one is acknowledged, so waiting for the
+ * daemon to write each fragment serializes the copy on a full host to
+ * guest to disk round trip. Instead, fragments are copied into a queue of
+ * up to fcopy_queue_depth entries and acknowledged right away; the daemon
+ * writes them in order while the host sends more. A failed write is
+ * latched and reported to the host with every following response, up to
+ * and including the COMPLETE_FCOPY or CANCEL_FCOPY of that file.
+ *
+ * Any other operation, or a fragment arriving with the queue full, is a
+ * regular transaction that is handed to the daemon once the queue is
+ * empty, which keeps all operations in host order.
+ */
+static unsigned int fcopy_queue_depth = 32;
+module_param(fcopy_queue_depth, uint, 0644);
+MODULE_PARM_DESC(fcopy_queue_depth,
+		 "Max file copy fragments acknowledged before written (0 = off)");
+
+struct fcopy_fragment {
+	struct list_head list;
+	struct hv_do_fcopy msg;
+};
+
+static struct {
+	spinlock_t lock;		/* protects the members below */
+	struct list_head queue;		/* acknowledged, not yet written */
+	unsigned int count;		/* entries in queue */
+	struct fcopy_fragment *active;	/* the fragment the daemon works on */
+	int error;			/* latched write error */
+} fcopy_wb;
+
 static void fcopy_respond_to_host(int error);
+static void fcopy_flush_queue(void);
+static void fcopy_drop_queue(void);
 static void fcopy_send_data(struct work_struct *dummy);
 static void fcopy_timeout_func(struct work_struct *dummy);
+static void fcopy_reset_func(struct work_struct *dummy);
 static DECLARE_DELAYED_WORK(fcopy_timeout_work, fcopy_timeout_func);
 static DECLARE_WORK(fcopy_send_work, fcopy_send_data);
+static DECLARE_WORK(fcopy_reset_work, fcopy_reset_func);
 static const char fcopy_devname[] = "vmbus/hv_fcopy";
 static u8 *recv_buffer;
 static struct hvutil_transport *hvt;
@@ -80,10 +118,161 @@ static void fcopy_timeout_func(struct work_struct *dummy)
 	 * If the timer fires, the user-mode component has not responded;
 	 * process the pending transaction.
 	 */
+	fcopy_flush_queue();
 	fcopy_respond_to_host(HV_E_FAIL);
 	hv_poll_channel(fcopy_transaction.recv_channel, fcopy_poll_wrapper);
 }
 
+static void fcopy_reset_func(struct work_struct *dummy)
+{
+	fcopy_flush_queue();
+}
+
+/*
+ * Drop the fragments the daemon has not written yet. They have been
+ * acknowledged to the host, so the copy has failed: latch an error for
+ * the COMPLETE_FCOPY unless one is latched already. Only to be called
+ * from, or with no, fcopy_send_work running, which may be handing the
+ * active fragment to the daemon.
+ */
+static void fcopy_drop_queue(void)
+{
+	struct fcopy_fragment *frag, *tmp;
+	unsigned long flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&fcopy_wb.lock, flags);
+	list_splice_init(&fcopy_wb.queue, &list);
+	fcopy_wb.count = 0;
+	fcopy_wb.active = NULL;
+	if (!list_empty(&list) && !fcopy_wb.error)
+		fcopy_wb.error = HV_E_FAIL;
+	spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+
+	list_for_each_entry_safe(frag, tmp, &list, list)
+		kfree(frag);
+}
+
+static void fcopy_flush_queue(void)
+{
+	cancel_work_sync(&fcopy_send_work);
+	fcopy_drop_queue();
+}
+
+/*
+ * Called from the channel callback: queue a WRITE_TO_FILE fragment and
+ * acknowledge it to the host. Returns false if the fragment has to be
+ * handled as a regular transaction instead.
+ */
+static bool fcopy_queue_fragment(struct hv_fcopy_hdr *fcopy_msg)
+{
+	struct fcopy_fragment *frag;
+	unsigned long flags;
+	int error;
+
+	if (fcopy_msg->operation != WRITE_TO_FILE ||
+	    READ_ONCE(fcopy_wb.count) >= READ_ONCE(fcopy_queue_depth))
+		return false;
+
+	frag = kmalloc(sizeof(*frag), GFP_ATOMIC);
+	if (!frag)
+		return false;
+	memcpy(&frag->msg, fcopy_msg, sizeof(frag->msg));
+
+	spin_lock_irqsave(&fcopy_wb.lock, flags);
+	list_add_tail(&frag->list, &fcopy_wb.queue);
+	fcopy_wb.count++;
+	error = fcopy_wb.error;
+	spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+
+	fcopy_respond_to_host(error ? error : HV_S_OK);
+	schedule_work(&fcopy_send_work);
+
+	return true;
+}
+
+/*
+ * Hand the oldest queued fragment to the daemon. Returns true while
+ * fragments are outstanding, so that no transaction overtakes them.
+ */
+static bool fcopy_send_fragment(void)
+{
+	struct fcopy_fragment *frag;
+	unsigned long flags;
+	int rc;
+
+	spin_lock_irqsave(&fcopy_wb.lock, flags);
+	if (fcopy_wb.active) {
+		spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+		return true;
+	}
+	frag = list_first_entry_or_null(&fcopy_wb.queue,
+					struct fcopy_fragment, list);
+	fcopy_wb.active = frag;
+	spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+
+	if (!frag)
+		return false;
+
+	rc = hvutil_transport_send(hvt, &frag->msg, sizeof(frag->msg), NULL);
+	if (rc) {
+		pr_debug("FCP: failed to communicate to the daemon: %d\n", rc);
+		fcopy_drop_queue();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Retire the fragment the daemon has just written. Returns false if the
+ * reply does not belong to a queued fragment.
+ */
+static bool fcopy_fragment_done(int status)
+{
+	struct fcopy_fragment *frag;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fcopy_wb.lock, flags);
+	frag = fcopy_wb.active;
+	if (frag) {
+		fcopy_wb.active = NULL;
+		list_del(&frag->list);
+		fcopy_wb.count--;
+		if (status != HV_S_OK && !fcopy_wb.error)
+			fcopy_wb.error = status;
+	}
+	spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+
+	if (!frag)
+		return false;
+
+	kfree(frag);
+	schedule_work(&fcopy_send_work);
+
+	return true;
+}
+
+/*
+ * Fold the latched write error into the status of a regular transaction.
+ * A new file starts with a clean slate; a file's error is reported until
+ * its COMPLETE_FCOPY or CANCEL_FCOPY.
+ */
+static int fcopy_transaction_status(int status)
+{
+	int operation = fcopy_transaction.fcopy_msg->operation;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fcopy_wb.lock, flags);
+	if (status == HV_S_OK && operation != START_FILE_COPY)
+		status = fcopy_wb.error ? fcopy_wb.error : HV_S_OK;
+	if (operation != WRITE_TO_FILE)
+		fcopy_wb.error = 0;
+	spin_unlock_irqrestore(&fcopy_wb.lock, flags);
+
+	return status;
+}
+
 static void fcopy_register_done(void)
 {
 	pr_debug("FCP: userspace daemon registered\n");
@@ -122,11 +311,19 @@ static int fcopy_handle_handshake(u32 version)
 static void fcopy_send_data(struct work_struct *dummy)
 {
 	struct hv_start_fcopy *smsg_out = NULL;
-	int operation = fcopy_transaction.fcopy_msg->operation;
 	struct hv_start_fcopy *smsg_in;
+	int operation;
 	void *out_src;
 	int rc, out_len;
 
+	if (fcopy_send_fragment())
+		return;
+
+	if (fcopy_transaction.state != HVUTIL_HOSTMSG_RECEIVED)
+		return;
+
+	operation = fcopy_transaction.fcopy_msg->operation;
+
 	/*
 	 * The  strings sent from the host are encoded in
 	 * in utf16; convert it to utf8 strings.
@@ -271,6 +468,11 @@ void hv_fcopy_onchannelcallback(void *context)
 			fcopy_respond_to_host(HV_E_FAIL);
 			return;
 		}
+
+		/* Acknowledged at once, the daemon writes it later */
+		if (fcopy_queue_fragment(fcopy_msg))
+			return;
+
 		fcopy_transaction.state = HVUTIL_HOSTMSG_RECEIVED;
 
 		/*
@@ -297,6 +499,10 @@ static int fcopy_on_msg(void *msg, int len)
 	if (fcopy_transaction.state == HVUTIL_DEVICE_INIT)
 		return fcopy_handle_handshake(*val);
 
+	/* The daemon replies in order; queued fragments come first */
+	if (fcopy_fragment_done(*val))
+		return 0;
+
 	if (fcopy_transaction.state != HVUTIL_USERSPACE_REQ)
 		return -EINVAL;
 
@@ -306,7 +512,7 @@ static int fcopy_on_msg(void *msg, int len)
 	 */
 	if (cancel_delayed_work_sync(&fcopy_timeout_work)) {
 		fcopy_transaction.state = HVUTIL_USERSPACE_RECV;
-		fcopy_respond_to_host(*val);
+		fcopy_respond_to_host(fcopy_transaction_status(*val));
 		hv_poll_channel(fcopy_transaction.recv_channel,
 				fcopy_poll_wrapper);
 	}
@@ -320,6 +526,11 @@ static void fcopy_on_reset(void)
 	 * The daemon has exited; reset the state.
 	 */
 	fcopy_transaction.state = HVUTIL_DEVICE_INIT;
+	/*
+	 * Called with the transport lock held, which the send work may be
+	 * waiting for, so it can't be cancelled from here.
+	 */
+	schedule_work(&fcopy_reset_work);
 
 	if (cancel_delayed_work_sync(&fcopy_timeout_work))
 		fcopy_respond_to_host(HV_E_FAIL);
@@ -338,6 +549,9 @@ int hv_fcopy_init(struct hv_util_service *srv)
 	 */
 	fcopy_transaction.state = HVUTIL_DEVICE_INIT;
 
+	spin_lock_init(&fcopy_wb.lock);
+	INIT_LIST_HEAD(&fcopy_wb.queue);
+
 	hvt = hvutil_transport_init(fcopy_devname, 0, 0,
 				    fcopy_on_msg, fcopy_on_reset);
 	if (!hvt)
@@ -349,6 +563,7 @@ int hv_fcopy_init(struct hv_util_service *srv)
 static void hv_fcopy_cancel_work(void)
 {
 	cancel_delayed_work_sync(&fcopy_timeout_work);
+	cancel_work_sync(&fcopy_reset_work);
 	cancel_work_sync(&fcopy_send_work);
 }
 
@@ -375,6 +590,7 @@ int hv_fcopy_pre_suspend(void)
 	fcopy_msg->operation = CANCEL_FCOPY;
 
 	hv_fcopy_cancel_work();
+	fcopy_flush_queue();
 
 	/* We don't care about the return value. */
 	hvutil_transport_send(hvt, fcopy_msg, sizeof(*fcopy_msg), NULL);
@@ -403,4 +619,7 @@ void hv_fcopy_deinit(void)
 	hv_fcopy_cancel_work();
 
 	hvutil_transport_destroy(hvt);
+	/* the daemon may have been reset while the transport went away */
+	cancel_work_sync(&fcopy_reset_work);
+	fcopy_flush_queue();
 }
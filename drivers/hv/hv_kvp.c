@@ -191,6 +191,208 @@ static int kvp_handle_handshake(struct hv_kvp_msg *msg)
 	return 0;
 }
 
+/*
+ * In-kernel cache of the guest owned pools, filled by the daemon through
+ * KVP_OP_CACHE_SET.  Host GET and ENUMERATE requests on a pool holding
+ * cached pairs are answered from the channel callback, so that frequent
+ * host polling does not wake the daemon every time.
+ */
+#define KVP_CACHE_MAX_ENTRIES	256
+
+struct kvp_cache_entry {
+	struct list_head list;
+	char *key;
+	char *value;
+};
+
+static struct {
+	struct list_head entries;
+	int count;
+} kvp_cache[KVP_POOL_COUNT];
+
+/* Protects kvp_cache; taken from the channel tasklet and the daemon. */
+static DEFINE_SPINLOCK(kvp_cache_lock);
+
+/* Reply built by kvp_cache_respond(); transactions are serialized. */
+static struct hv_kvp_msg *kvp_cache_msg;
+
+static bool kvp_pool_cacheable(int pool)
+{
+	return pool == KVP_POOL_GUEST || pool == KVP_POOL_AUTO;
+}
+
+static struct kvp_cache_entry *kvp_cache_find(int pool, const char *key)
+{
+	struct kvp_cache_entry *entry;
+
+	list_for_each_entry(entry, &kvp_cache[pool].entries, list) {
+		if (!strcmp(entry->key, key))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void kvp_cache_entry_free(struct kvp_cache_entry *entry)
+{
+	kfree(entry->key);
+	kfree(entry->value);
+	kfree(entry);
+}
+
+static void kvp_cache_flush(int pool)
+{
+	struct kvp_cache_entry *entry, *tmp;
+	LIST_HEAD(dead);
+
+	spin_lock_bh(&kvp_cache_lock);
+	list_splice_init(&kvp_cache[pool].entries, &dead);
+	kvp_cache[pool].count = 0;
+	spin_unlock_bh(&kvp_cache_lock);
+
+	list_for_each_entry_safe(entry, tmp, &dead, list)
+		kvp_cache_entry_free(entry);
+}
+
+static void kvp_cache_flush_all(void)
+{
+	int pool;
+
+	for (pool = 0; pool < KVP_POOL_COUNT; pool++)
+		kvp_cache_flush(pool);
+}
+
+static bool kvp_is_cache_update(struct hv_kvp_msg *msg)
+{
+	/*
+	 * Daemon replies may carry an HRESULT in the error field, which
+	 * overlays kvp_hdr; those all have the upper half set.
+	 */
+	return msg->kvp_hdr.pad == 0 &&
+	       (msg->kvp_hdr.operation == KVP_OP_CACHE_SET ||
+		msg->kvp_hdr.operation == KVP_OP_CACHE_FLUSH);
+}
+
+static int kvp_cache_update(struct hv_kvp_msg *msg)
+{
+	struct hv_kvp_exchg_msg_value *data = &msg->body.kvp_set.data;
+	struct kvp_cache_entry *entry, *old;
+	int pool = msg->kvp_hdr.pool;
+	int ret = 0;
+
+	if (!kvp_pool_cacheable(pool))
+		return -EINVAL;
+
+	if (msg->kvp_hdr.operation == KVP_OP_CACHE_FLUSH) {
+		kvp_cache_flush(pool);
+		return 0;
+	}
+
+	if (!data->key_size || data->key_size > HV_KVP_EXCHANGE_MAX_KEY_SIZE ||
+	    data->value_size > HV_KVP_EXCHANGE_MAX_VALUE_SIZE)
+		return -EINVAL;
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+
+	entry->key = kstrndup(data->key, data->key_size, GFP_KERNEL);
+	entry->value = kstrndup(data->value, data->value_size, GFP_KERNEL);
+	if (!entry->key || !entry->value) {
+		kvp_cache_entry_free(entry);
+		return -ENOMEM;
+	}
+
+	spin_lock_bh(&kvp_cache_lock);
+	old = kvp_cache_find(pool, entry->key);
+	if (old) {
+		list_replace(&old->list, &entry->list);
+	} else if (kvp_cache[pool].count < KVP_CACHE_MAX_ENTRIES) {
+		list_add_tail(&entry->list, &kvp_cache[pool].entries);
+		kvp_cache[pool].count++;
+	} else {
+		old = entry;
+		ret = -ENOSPC;
+	}
+	spin_unlock_bh(&kvp_cache_lock);
+
+	if (old)
+		kvp_cache_entry_free(old);
+
+	return ret;
+}
+
+/*
+ * Answer the host request stashed in kvp_transaction from the cache.
+ * Returns false if the request has to go to the daemon.
+ */
+static bool kvp_cache_respond(struct hv_kvp_msg *in_msg)
+{
+	struct hv_kvp_exchg_msg_value *data;
+	struct kvp_cache_entry *entry = NULL;
+	int pool = in_msg->kvp_hdr.pool;
+	u32 index, i = 0;
+	int len, error = 0;
+
+	if (!kvp_cache_msg || !kvp_pool_cacheable(pool))
+		return false;
+
+	switch (in_msg->kvp_hdr.operation) {
+	case KVP_OP_SET:
+	case KVP_OP_DELETE:
+		/* The daemon owns the pool again until it refills the cache. */
+		kvp_cache_flush(pool);
+		return false;
+	case KVP_OP_GET:
+	case KVP_OP_ENUMERATE:
+		break;
+	default:
+		return false;
+	}
+
+	/* kvp_respond_to_host() takes the pair from the enumerate data. */
+	data = &kvp_cache_msg->body.kvp_enum_data.data;
+	memset(data, 0, sizeof(*data));
+
+	if (in_msg->kvp_hdr.operation == KVP_OP_GET) {
+		len = utf16s_to_utf8s((wchar_t *)in_msg->body.kvp_get.data.key,
+				      in_msg->body.kvp_get.data.key_size,
+				      UTF16_LITTLE_ENDIAN, data->key,
+				      HV_KVP_EXCHANGE_MAX_KEY_SIZE - 1);
+		if (len < 0)
+			return false;
+	}
+
+	spin_lock_bh(&kvp_cache_lock);
+	if (list_empty(&kvp_cache[pool].entries)) {
+		spin_unlock_bh(&kvp_cache_lock);
+		return false;
+	}
+
+	if (in_msg->kvp_hdr.operation == KVP_OP_GET) {
+		entry = kvp_cache_find(pool, data->key);
+	} else {
+		index = in_msg->body.kvp_enum_data.index;
+		list_for_each_entry(entry, &kvp_cache[pool].entries, list) {
+			if (i++ == index)
+				break;
+		}
+		if (list_entry_is_head(entry, &kvp_cache[pool].entries, list))
+			entry = NULL;
+	}
+
+	if (entry) {
+		strscpy(data->key, entry->key, sizeof(data->key));
+		strscpy(data->value, entry->value, sizeof(data->value));
+	} else {
+		/* Same as the daemon: no such key, or end of enumeration. */
+		error = HV_S_CONT;
+	}
+	spin_unlock_bh(&kvp_cache_lock);
+
+	kvp_respond_to_host(kvp_cache_msg, error);
+	return true;
+}
 
 /*
  * Callback when data is received from user mode.
@@ -214,6 +416,10 @@ static int kvp_on_msg(void *msg, int len)
 		return kvp_handle_handshake(message);
 	}
 
+	/* Cache updates are not replies and may come at any time. */
+	if (kvp_is_cache_update(message))
+		return kvp_cache_update(message);
+
 	/* We didn't send anything to userspace so the reply is spurious */
 	if (kvp_transaction.state < HVUTIL_USERSPACE_REQ)
 		return -EINVAL;
@@ -697,6 +903,12 @@ void hv_kvp_onchannelcallback(void *context)
 				kvp_respond_to_host(NULL, HV_E_FAIL);
 				return;
 			}
+
+			if (kvp_cache_respond(kvp_msg)) {
+				hv_poll_channel(channel, kvp_poll_wrapper);
+				return;
+			}
+
 			kvp_transaction.state = HVUTIL_HOSTMSG_RECEIVED;
 
 			/*
@@ -734,11 +946,23 @@ static void kvp_on_reset(void)
 	if (cancel_delayed_work_sync(&kvp_timeout_work))
 		kvp_respond_to_host(NULL, HV_E_FAIL);
 	kvp_transaction.state = HVUTIL_DEVICE_INIT;
+
+	/* A restarted daemon refills whatever it still wants cached. */
+	kvp_cache_flush_all();
 }
 
 int
 hv_kvp_init(struct hv_util_service *srv)
 {
+	int pool;
+
+	for (pool = 0; pool < KVP_POOL_COUNT; pool++)
+		INIT_LIST_HEAD(&kvp_cache[pool].entries);
+
+	kvp_cache_msg = kzalloc(sizeof(*kvp_cache_msg), GFP_KERNEL);
+	if (!kvp_cache_msg)
+		return -ENOMEM;
+
 	recv_buffer = srv->recv_buffer;
 	kvp_transaction.recv_channel = srv->channel;
 
@@ -752,8 +976,11 @@ hv_kvp_init(struct hv_util_service *srv)
 
 	hvt = hvutil_transport_init(kvp_devname, CN_KVP_IDX, CN_KVP_VAL,
 				    kvp_on_msg, kvp_on_reset);
-	if (!hvt)
+	if (!hvt) {
+		kfree(kvp_cache_msg);
+		kvp_cache_msg = NULL;
 		return -EFAULT;
+	}
 
 	return 0;
 }
@@ -804,4 +1031,8 @@ void hv_kvp_deinit(void)
 	hv_kvp_cancel_work();
 
 	hvutil_transport_destroy(hvt);
+
+	kvp_cache_flush_all();
+	kfree(kvp_cache_msg);
+	kvp_cache_msg = NULL;
 }
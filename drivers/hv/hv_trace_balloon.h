@@ -38,6 +38,89 @@ TRACE_EVENT(balloon_status,
 		    )
 	);
 
+TRACE_EVENT(balloon_up_done,
+	    TP_PROTO(unsigned int requested, unsigned int ballooned,
+		     unsigned int reused, s64 duration_us),
+	    TP_ARGS(requested, ballooned, reused, duration_us),
+	    TP_STRUCT__entry(
+		    __field(unsigned int, requested)
+		    __field(unsigned int, ballooned)
+		    __field(unsigned int, reused)
+		    __field(s64, duration_us)
+		    ),
+	    TP_fast_assign(
+		    __entry->requested = requested;
+		    __entry->ballooned = ballooned;
+		    __entry->reused = reused;
+		    __entry->duration_us = duration_us;
+		    ),
+	    TP_printk("requested %u, ballooned %u (%u from pool) in %lld us",
+		      __entry->requested, __entry->ballooned,
+		      __entry->reused, __entry->duration_us
+		    )
+	);
+
+TRACE_EVENT(balloon_down_done,
+	    TP_PROTO(unsigned int pages, unsigned int pooled,
+		     s64 duration_us),
+	    TP_ARGS(pages, pooled, duration_us),
+	    TP_STRUCT__entry(
+		    __field(unsigned int, pages)
+		    __field(unsigned int, pooled)
+		    __field(s64, duration_us)
+		    ),
+	    TP_fast_assign(
+		    __entry->pages = pages;
+		    __entry->pooled = pooled;
+		    __entry->duration_us = duration_us;
+		    ),
+	    TP_printk("unballooned %u (%u pooled) in %lld us",
+		      __entry->pages, __entry->pooled, __entry->duration_us
+		    )
+	);
+
+TRACE_EVENT(balloon_pool_drain,
+	    TP_PROTO(unsigned int pages, bool force),
+	    TP_ARGS(pages, force),
+	    TP_STRUCT__entry(
+		    __field(unsigned int, pages)
+		    __field(bool, force)
+		    ),
+	    TP_fast_assign(
+		    __entry->pages = pages;
+		    __entry->force = force;
+		    ),
+	    TP_printk("released %u pooled pages%s",
+		      __entry->pages, __entry->force ? " (forced)" : ""
+		    )
+	);
+
+TRACE_EVENT(balloon_page_reporting,
+	    TP_PROTO(unsigned long pressure, unsigned long cache,
+		     unsigned int old_order, unsigned int order,
+		     unsigned long delay),
+	    TP_ARGS(pressure, cache, old_order, order, delay),
+	    TP_STRUCT__entry(
+		    __field(unsigned long, pressure)
+		    __field(unsigned long, cache)
+		    __field(unsigned int, old_order)
+		    __field(unsigned int, order)
+		    __field(unsigned long, delay)
+		    ),
+	    TP_fast_assign(
+		    __entry->pressure = pressure;
+		    __entry->cache = cache;
+		    __entry->old_order = old_order;
+		    __entry->order = order;
+		    __entry->delay = delay;
+		    ),
+	    TP_printk("psi %lu.%02lu%%, inactive cache %lu; order %u -> %u, delay %lu",
+		      __entry->pressure / 100, __entry->pressure % 100,
+		      __entry->cache, __entry->old_order, __entry->order,
+		      __entry->delay
+		    )
+	);
+
 #undef TRACE_INCLUDE_PATH
 #define TRACE_INCLUDE_PATH .
 #undef TRACE_INCLUDE_FILE
@@ -17,6 +17,7 @@
 #include <linux/hyperv.h>
 #include <linux/clockchips.h>
 #include <linux/ptp_clock_kernel.h>
+#include <linux/timekeeping.h>
 #include <clocksource/hyperv_timer.h>
 #include <asm/mshyperv.h>
 
@@ -292,14 +293,23 @@ static inline u64 reftime_to_ns(u64 reftime)
  */
 static const u64 HOST_TIMESYNC_DELAY_THRESH = 600 * (u64)NSEC_PER_SEC;
 
-static int hv_get_adj_host_time(struct timespec64 *ts)
+/*
+ * Compute the host time for the current reference count. The reference
+ * count that was read is returned in @reftime, so that the result can
+ * be correlated with the Hyper-V clocksource. The optional system
+ * timestamp @sts brackets that read for PTP_SYS_OFFSET_EXTENDED.
+ */
+static int __hv_get_adj_host_time(u64 *hosttime, u64 *reftime,
+				  struct ptp_system_timestamp *sts)
 {
-	u64 newtime, reftime, timediff_adj;
+	u64 newtime, timediff_adj;
 	unsigned long flags;
 	int ret = 0;
 
 	spin_lock_irqsave(&host_ts.lock, flags);
-	reftime = hv_read_reference_counter();
+	ptp_read_system_prets(sts);
+	*reftime = hv_read_reference_counter();
+	ptp_read_system_postts(sts);
 
 	/*
 	 * We need to let the caller know that last update from host
@@ -307,7 +317,7 @@ static int hv_get_adj_host_time(struct timespec64 *ts)
 	 * and PTP ioctl do not have a documented error that we could
 	 * return for this specific case. Use ESTALE to report this.
 	 */
-	timediff_adj = reftime - host_ts.ref_time;
+	timediff_adj = *reftime - host_ts.ref_time;
 	if (timediff_adj * 100 > HOST_TIMESYNC_DELAY_THRESH) {
 		pr_warn_once("TIMESYNC IC: Stale time stamp, %llu nsecs old\n",
 			     (timediff_adj * 100));
@@ -315,12 +325,23 @@ static int hv_get_adj_host_time(struct timespec64 *ts)
 	}
 
 	newtime = host_ts.host_time + timediff_adj;
-	*ts = ns_to_timespec64(reftime_to_ns(newtime));
+	*hosttime = reftime_to_ns(newtime);
 	spin_unlock_irqrestore(&host_ts.lock, flags);
 
 	return ret;
 }
 
+static int hv_get_adj_host_time(struct timespec64 *ts)
+{
+	u64 hosttime, reftime;
+	int ret;
+
+	ret = __hv_get_adj_host_time(&hosttime, &reftime, NULL);
+	*ts = ns_to_timespec64(hosttime);
+
+	return ret;
+}
+
 static void hv_set_host_time(struct work_struct *work)
 {
 
@@ -667,12 +688,64 @@ static int hv_ptp_gettime(struct ptp_clock_info *info, struct timespec64 *ts)
 	return hv_get_adj_host_time(ts);
 }
 
+static int hv_ptp_gettimex(struct ptp_clock_info *info, struct timespec64 *ts,
+			   struct ptp_system_timestamp *sts)
+{
+	u64 hosttime, reftime;
+	int ret;
+
+	ret = __hv_get_adj_host_time(&hosttime, &reftime, sts);
+	*ts = ns_to_timespec64(hosttime);
+
+	return ret;
+}
+
+/*
+ * The host time is derived from the partition reference count, which is
+ * also what the Hyper-V clocksource counts. Handing that count to the
+ * timekeeping core yields system time and host time for the very same
+ * instant, without the read latency that PTP_SYS_OFFSET has to bracket.
+ */
+static int hv_ptp_get_syncdevicetime(ktime_t *device,
+				     struct system_counterval_t *system,
+				     void *ctx)
+{
+	u64 hosttime, reftime;
+	int ret;
+
+	ret = __hv_get_adj_host_time(&hosttime, &reftime, NULL);
+	if (ret)
+		return ret;
+
+	*device = ns_to_ktime(hosttime);
+	system->cycles = reftime;
+	system->cs = hyperv_cs;
+
+	return 0;
+}
+
+/*
+ * Fails with -ENODEV unless the Hyper-V clocksource is the current
+ * system clocksource, e.g. when the guest prefers an invariant TSC.
+ */
+static int hv_ptp_getcrosststamp(struct ptp_clock_info *info,
+				 struct system_device_crosststamp *cts)
+{
+	if (!hyperv_cs)
+		return -EOPNOTSUPP;
+
+	return get_device_system_crosststamp(hv_ptp_get_syncdevicetime,
+					     NULL, NULL, cts);
+}
+
 static struct ptp_clock_info ptp_hyperv_info = {
 	.name		= "hyperv",
 	.enable         = hv_ptp_enable,
 	.adjtime        = hv_ptp_adjtime,
 	.adjfreq        = hv_ptp_adjfreq,
 	.gettime64      = hv_ptp_gettime,
+	.gettimex64     = hv_ptp_gettimex,
+	.getcrosststamp = hv_ptp_getcrosststamp,
 	.settime64      = hv_ptp_settime,
 	.owner		= THIS_MODULE,
 };
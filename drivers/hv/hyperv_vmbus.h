@@ -132,6 +132,18 @@ struct hv_per_cpu_context {
 	 * basis.
 	 */
 	struct tasklet_struct msg_dpc;
+
+	/*
+	 * Relids that may be signaled on this CPU's event page, and the
+	 * event flag words holding them; see vmbus_chan_index_add().
+	 */
+	DECLARE_BITMAP(chan_relids, HV_EVENT_FLAGS_COUNT);
+	DECLARE_BITMAP(chan_words, HV_EVENT_FLAGS_LONG_COUNT);
+
+	/* Event page scans, full page scans, and scans finding no event */
+	u64 chan_sched_scans;
+	u64 chan_sched_full_scans;
+	u64 chan_sched_spurious;
 };
 
 struct hv_context {
@@ -343,6 +355,7 @@ void vmbus_channel_unmap_relid(struct vmbus_channel *channel);
 struct vmbus_channel *relid2channel(u32 relid);
 
 void vmbus_free_channels(void);
+void vmbus_offer_classes_init(void);
 
 /* Connection interface */
 
@@ -352,6 +365,14 @@ void vmbus_disconnect(void);
 int vmbus_post_msg(void *buffer, size_t buflen, bool can_sleep);
 
 void vmbus_on_event(unsigned long data);
+void vmbus_chan_index_add(struct vmbus_channel *channel, u32 cpu);
+void vmbus_chan_index_remove(struct vmbus_channel *channel);
+void vmbus_poll_queue(struct vmbus_channel *channel);
+void vmbus_poll_stop(struct vmbus_channel *channel);
+int vmbus_poll_init(void);
+void vmbus_poll_exit(void);
+void vmbus_chan_moder_init(struct vmbus_channel *channel);
+void vmbus_chan_moder_stop(struct vmbus_channel *channel);
 void vmbus_on_msg_dpc(unsigned long data);
 
 int hv_kvp_init(struct hv_util_service *srv);
@@ -280,13 +280,15 @@ int hv_ringbuffer_write(struct vmbus_channel *channel,
 		if (!channel->out_full_flag) {
 			++channel->out_full_first;
 			channel->out_full_flag = true;
+			channel->out_full_start = ktime_get();
 		}
 
 		spin_unlock_irqrestore(&outring_info->ring_lock, flags);
 		return -EAGAIN;
 	}
 
-	channel->out_full_flag = false;
+	if (channel->out_full_flag)
+		vmbus_chan_out_full_end(channel);
 
 	/* Write to the ring buffer */
 	next_write_location = hv_get_next_write_location(outring_info);
@@ -433,6 +435,44 @@ __hv_pkt_iter_next(struct vmbus_channel *channel,
 }
 EXPORT_SYMBOL_GPL(__hv_pkt_iter_next);
 
+/*
+ * Get up to n vmbus packets from ring buffer in one pass.
+ *
+ * Reads the host's write_index once and advances the current location
+ * (priv_read_index) past every packet returned in descs. Like the packets
+ * returned by hv_pkt_iter_first()/__hv_pkt_iter_next(), they stay valid
+ * until hv_pkt_iter_close() publishes the new read_index to the host.
+ *
+ * Returns the number of packets stored in descs, 0 if the ring is empty.
+ */
+u32 hv_pkt_iter_bulk(struct vmbus_channel *channel,
+		     const struct vmpacket_descriptor **descs, u32 n)
+{
+	struct hv_ring_buffer_info *rbi = &channel->inbound;
+	u32 dsize = rbi->ring_datasize;
+	u32 avail, packetlen, count = 0;
+	struct vmpacket_descriptor *desc;
+
+	hv_debug_delay_test(channel, MESSAGE_DELAY);
+	avail = hv_pkt_iter_avail(rbi);
+
+	while (count < n && avail >= sizeof(struct vmpacket_descriptor)) {
+		desc = hv_get_ring_buffer(rbi) + rbi->priv_read_index;
+		packetlen = (desc->len8 << 3) + VMBUS_PKT_TRAILER;
+		if (packetlen > avail)
+			break;
+
+		descs[count++] = desc;
+		avail -= packetlen;
+		rbi->priv_read_index += packetlen;
+		if (rbi->priv_read_index >= dsize)
+			rbi->priv_read_index -= dsize;
+	}
+
+	return count;
+}
+EXPORT_SYMBOL_GPL(hv_pkt_iter_bulk);
+
 /* How many bytes were read in this iterator cycle */
 static u32 hv_pkt_iter_bytes_read(const struct hv_ring_buffer_info *rbi,
 					u32 start_read_index)
@@ -1210,13 +1210,153 @@ static void vmbus_force_channel_rescinded(struct vmbus_channel *channel)
 }
 #endif /* CONFIG_PM_SLEEP */
 
+/*
+ * Each CPU keeps an index of the relids that may be signaled on its event
+ * page, i.e. of the channels that are, or have been, targeted at it, so
+ * that vmbus_chan_sched() only needs to look at the event flag words that
+ * hold such relids rather than at the whole page.  A relid is added before
+ * the host can signal it on the CPU (before OPENCHANNEL or MODIFYCHANNEL
+ * is sent) and only dropped when the relid is unmapped, so that interrupts
+ * still in flight to a previous target CPU are found as well.  Whatever
+ * the index misses is still caught by the full scan done when the indexed
+ * words turn out to be empty.
+ */
+static DEFINE_SPINLOCK(vmbus_chan_index_lock);
+
+void vmbus_chan_index_add(struct vmbus_channel *channel, u32 cpu)
+{
+	struct hv_per_cpu_context *hv_cpu
+		= per_cpu_ptr(hv_context.cpu_context, cpu);
+	u32 relid = channel->offermsg.child_relid;
+	unsigned long flags;
+
+	if (WARN_ON(relid >= HV_EVENT_FLAGS_COUNT))
+		return;
+
+	spin_lock_irqsave(&vmbus_chan_index_lock, flags);
+	set_bit(relid, hv_cpu->chan_relids);
+	set_bit(BIT_WORD(relid), hv_cpu->chan_words);
+	spin_unlock_irqrestore(&vmbus_chan_index_lock, flags);
+}
+
+void vmbus_chan_index_remove(struct vmbus_channel *channel)
+{
+	u32 relid = channel->offermsg.child_relid;
+	struct hv_per_cpu_context *hv_cpu;
+	unsigned long flags;
+	int cpu;
+
+	if (relid >= HV_EVENT_FLAGS_COUNT)
+		return;
+
+	spin_lock_irqsave(&vmbus_chan_index_lock, flags);
+	for_each_possible_cpu(cpu) {
+		hv_cpu = per_cpu_ptr(hv_context.cpu_context, cpu);
+		if (!test_and_clear_bit(relid, hv_cpu->chan_relids))
+			continue;
+		if (!hv_cpu->chan_relids[BIT_WORD(relid)])
+			clear_bit(BIT_WORD(relid), hv_cpu->chan_words);
+	}
+	spin_unlock_irqrestore(&vmbus_chan_index_lock, flags);
+}
+
+/*
+ * Schedule the channel with an event pending on relid
+ */
+static void vmbus_chan_sched_relid(u32 relid)
+{
+	void (*callback_fn)(void *context);
+	struct vmbus_channel *channel;
+
+	/*
+	 * Pairs with the kfree_rcu() in vmbus_chan_release().
+	 * Guarantees that the channel data structure doesn't
+	 * get freed while the channel pointer below is being
+	 * dereferenced.
+	 */
+	rcu_read_lock();
+
+	/* Find channel based on relid */
+	channel = relid2channel(relid);
+	if (channel == NULL)
+		goto sched_unlock_rcu;
+
+	if (channel->rescind)
+		goto sched_unlock_rcu;
+
+	/*
+	 * Make sure that the ring buffer data structure doesn't get
+	 * freed while we dereference the ring buffer pointer.  Test
+	 * for the channel's onchannel_callback being NULL within a
+	 * sched_lock critical section.  See also the inline comments
+	 * in vmbus_reset_channel_cb().
+	 */
+	spin_lock(&channel->sched_lock);
+
+	callback_fn = channel->onchannel_callback;
+	if (unlikely(callback_fn == NULL))
+		goto sched_unlock;
+
+	trace_vmbus_chan_sched(channel);
+
+	++channel->interrupts;
+
+	if (READ_ONCE(channel->poll_usecs)) {
+		vmbus_poll_queue(channel);
+		goto sched_unlock;
+	}
+
+	switch (channel->callback_mode) {
+	case HV_CALL_ISR:
+		(*callback_fn)(channel->channel_callback_context);
+		break;
+
+	case HV_CALL_BATCHED:
+		hv_begin_read(&channel->inbound);
+		fallthrough;
+	case HV_CALL_DIRECT:
+		tasklet_schedule(&channel->callback_event);
+	}
+
+sched_unlock:
+	spin_unlock(&channel->sched_lock);
+sched_unlock_rcu:
+	rcu_read_unlock();
+}
+
+/*
+ * Schedule the channels with events pending in one word of the event
+ * flags, returning how many were found
+ */
+static u32 vmbus_chan_sched_word(unsigned long *recv_int_page, u32 word)
+{
+	unsigned long pending = READ_ONCE(recv_int_page[word]);
+	u32 bit, relid, found = 0;
+
+	for_each_set_bit(bit, &pending, BITS_PER_LONG) {
+		relid = word * BITS_PER_LONG + bit;
+
+		if (!sync_test_and_clear_bit(relid, recv_int_page))
+			continue;
+
+		/* Special case - vmbus channel protocol msg */
+		if (relid == 0)
+			continue;
+
+		vmbus_chan_sched_relid(relid);
+		found++;
+	}
+
+	return found;
+}
+
 /*
  * Schedule all channels with events pending
  */
 static void vmbus_chan_sched(struct hv_per_cpu_context *hv_cpu)
 {
 	unsigned long *recv_int_page;
-	u32 maxbits, relid;
+	u32 maxbits, word, found = 0;
 
 	if (vmbus_proto_version < VERSION_WIN8) {
 		maxbits = MAX_NUM_CHANNELS_SUPPORTED;
@@ -1239,67 +1379,28 @@ static void vmbus_chan_sched(struct hv_per_cpu_context *hv_cpu)
 	if (unlikely(!recv_int_page))
 		return;
 
-	for_each_set_bit(relid, recv_int_page, maxbits) {
-		void (*callback_fn)(void *context);
-		struct vmbus_channel *channel;
-
-		if (!sync_test_and_clear_bit(relid, recv_int_page))
-			continue;
-
-		/* Special case - vmbus channel protocol msg */
-		if (relid == 0)
-			continue;
-
-		/*
-		 * Pairs with the kfree_rcu() in vmbus_chan_release().
-		 * Guarantees that the channel data structure doesn't
-		 * get freed while the channel pointer below is being
-		 * dereferenced.
-		 */
-		rcu_read_lock();
-
-		/* Find channel based on relid */
-		channel = relid2channel(relid);
-		if (channel == NULL)
-			goto sched_unlock_rcu;
-
-		if (channel->rescind)
-			goto sched_unlock_rcu;
-
-		/*
-		 * Make sure that the ring buffer data structure doesn't get
-		 * freed while we dereference the ring buffer pointer.  Test
-		 * for the channel's onchannel_callback being NULL within a
-		 * sched_lock critical section.  See also the inline comments
-		 * in vmbus_reset_channel_cb().
-		 */
-		spin_lock(&channel->sched_lock);
+	hv_cpu->chan_sched_scans++;
 
-		callback_fn = channel->onchannel_callback;
-		if (unlikely(callback_fn == NULL))
-			goto sched_unlock;
+	/*
+	 * Before win8 all channels share the interrupt page of CPU 0, so
+	 * there is nothing to narrow down.
+	 */
+	if (vmbus_proto_version >= VERSION_WIN8) {
+		for_each_set_bit(word, hv_cpu->chan_words,
+				 HV_EVENT_FLAGS_LONG_COUNT)
+			found += vmbus_chan_sched_word(recv_int_page, word);
 
-		trace_vmbus_chan_sched(channel);
+		if (likely(found))
+			return;
 
-		++channel->interrupts;
+		hv_cpu->chan_sched_full_scans++;
+	}
 
-		switch (channel->callback_mode) {
-		case HV_CALL_ISR:
-			(*callback_fn)(channel->channel_callback_context);
-			break;
+	for (word = 0; word < BITS_TO_LONGS(maxbits); word++)
+		found += vmbus_chan_sched_word(recv_int_page, word);
 
-		case HV_CALL_BATCHED:
-			hv_begin_read(&channel->inbound);
-			fallthrough;
-		case HV_CALL_DIRECT:
-			tasklet_schedule(&channel->callback_event);
-		}
-
-sched_unlock:
-		spin_unlock(&channel->sched_lock);
-sched_unlock_rcu:
-		rcu_read_unlock();
-	}
+	if (!found)
+		hv_cpu->chan_sched_spurious++;
 }
 
 static void vmbus_isr(void)
@@ -1813,6 +1914,9 @@ static ssize_t target_cpu_store(struct vmbus_channel *channel,
 	if (target_cpu == origin_cpu)
 		goto cpu_store_unlock;
 
+	/* The old target CPU stays indexed for interrupts still in flight. */
+	vmbus_chan_index_add(channel, target_cpu);
+
 	if (vmbus_send_modifychannel(channel->offermsg.child_relid,
 				     hv_cpu_number_to_vp_number(target_cpu))) {
 		ret = -EIO;
@@ -1928,6 +2032,48 @@ static ssize_t subchannel_id_show(struct vmbus_channel *channel,
 }
 static VMBUS_CHAN_ATTR_RO(subchannel_id);
 
+/* Upper bound for the busy-poll window of a channel, in microseconds. */
+#define VMBUS_POLL_USECS_MAX	10000
+
+static ssize_t poll_usecs_show(struct vmbus_channel *channel, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(channel->poll_usecs));
+}
+static ssize_t poll_usecs_store(struct vmbus_channel *channel,
+				const char *buf, size_t count)
+{
+	u32 poll_usecs;
+	int ret;
+
+	if (kstrtou32(buf, 0, &poll_usecs))
+		return -EINVAL;
+
+	if (poll_usecs > VMBUS_POLL_USECS_MAX)
+		return -EINVAL;
+
+	/*
+	 * ISR mode callbacks defer to their own polling context (NAPI for
+	 * netvsc) and manage host signaling themselves.
+	 */
+	if (poll_usecs && channel->callback_mode == HV_CALL_ISR)
+		return -EOPNOTSUPP;
+
+	if (poll_usecs) {
+		ret = vmbus_poll_init();
+		if (ret)
+			return ret;
+	}
+
+	/*
+	 * Switching modes needs no further synchronization: a queued channel
+	 * notices poll_usecs == 0 on its next poll and returns to the
+	 * tasklet, and the tasklet lock keeps the callback single threaded.
+	 */
+	WRITE_ONCE(channel->poll_usecs, poll_usecs);
+	return count;
+}
+static VMBUS_CHAN_ATTR_RW(poll_usecs);
+
 static struct attribute *vmbus_chan_attrs[] = {
 	&chan_attr_out_mask.attr,
 	&chan_attr_in_mask.attr,
@@ -1944,6 +2090,7 @@ static struct attribute *vmbus_chan_attrs[] = {
 	&chan_attr_out_full_total.attr,
 	&chan_attr_monitor_id.attr,
 	&chan_attr_subchannel_id.attr,
+	&chan_attr_poll_usecs.attr,
 	NULL
 };
 
@@ -2710,6 +2857,7 @@ static void __exit vmbus_exit(void)
 
 	hv_remove_kexec_handler();
 	hv_remove_crash_handler();
+	vmbus_poll_exit();
 	vmbus_connection.conn_state = DISCONNECTED;
 	hv_stimer_global_cleanup();
 	vmbus_disconnect();
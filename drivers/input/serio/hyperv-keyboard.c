@@ -8,9 +8,13 @@
 #include <linux/device.h>
 #include <linux/completion.h>
 #include <linux/hyperv.h>
+#include <linux/ktime.h>
 #include <linux/serio.h>
 #include <linux/slab.h>
 
+#define CREATE_TRACE_POINTS
+#include "hyperv_keyboard_trace.h"
+
 /*
  * Current version 1.0
  *
@@ -95,6 +99,9 @@ struct hv_kbd_dev {
 	struct completion wait_event;
 	spinlock_t lock; /* protects 'started' field */
 	bool started;
+	/* When the current channel callback started draining packets */
+	ktime_t recv_start;
+	bool wakeup_pending;
 };
 
 static void hv_kbd_on_receive(struct hv_device *hv_dev,
@@ -160,6 +167,10 @@ static void hv_kbd_on_receive(struct hv_device *hv_dev,
 				scan_code |= XTKBD_RELEASE;
 
 			serio_interrupt(kbd_dev->hv_serio, scan_code, 0);
+
+			trace_hv_kbd_keystroke(hv_dev, scan_code, info,
+				ktime_to_ns(ktime_sub(ktime_get(),
+						      kbd_dev->recv_start)));
 		}
 		spin_unlock_irqrestore(&kbd_dev->lock, flags);
 
@@ -167,9 +178,10 @@ static void hv_kbd_on_receive(struct hv_device *hv_dev,
 		 * Only trigger a wakeup on key down, otherwise
 		 * "echo freeze > /sys/power/state" can't really enter the
 		 * state because the Enter-UP can trigger a wakeup at once.
+		 * The wakeup itself is signalled once per channel callback.
 		 */
 		if (!(info & IS_BREAK))
-			pm_wakeup_hard_event(&hv_dev->device);
+			kbd_dev->wakeup_pending = true;
 
 		break;
 
@@ -239,9 +251,12 @@ static void hv_kbd_on_channel_callback(void *context)
 {
 	struct vmpacket_descriptor *desc;
 	struct hv_device *hv_dev = context;
+	struct hv_kbd_dev *kbd_dev = hv_get_drvdata(hv_dev);
 	u32 bytes_recvd;
 	u64 req_id;
 
+	kbd_dev->recv_start = ktime_get();
+
 	foreach_vmbus_pkt(desc, hv_dev->channel) {
 		bytes_recvd = desc->len8 * 8;
 		req_id = desc->trans_id;
@@ -249,6 +264,11 @@ static void hv_kbd_on_channel_callback(void *context)
 		hv_kbd_handle_received_packet(hv_dev, desc, bytes_recvd,
 					      req_id);
 	}
+
+	if (kbd_dev->wakeup_pending) {
+		kbd_dev->wakeup_pending = false;
+		pm_wakeup_hard_event(&hv_dev->device);
+	}
 }
 
 static int hv_kbd_connect_to_vsp(struct hv_device *hv_dev)
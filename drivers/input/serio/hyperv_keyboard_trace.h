@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM hyperv_keyboard
+
+#if !defined(_HYPERV_KEYBOARD_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _HYPERV_KEYBOARD_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(hv_kbd_keystroke,
+	    TP_PROTO(const struct hv_device *hv_dev, u16 scan_code, u32 info,
+		     s64 latency_ns),
+	    TP_ARGS(hv_dev, scan_code, info, latency_ns),
+	    TP_STRUCT__entry(
+		    __string(name, dev_name(&hv_dev->device))
+		    __field(u16, scan_code)
+		    __field(u32, info)
+		    __field(s64, latency_ns)
+		    ),
+	    TP_fast_assign(
+		    __assign_str(name, dev_name(&hv_dev->device));
+		    __entry->scan_code = scan_code;
+		    __entry->info = info;
+		    __entry->latency_ns = latency_ns;
+		    ),
+	    TP_printk("%s: scan code 0x%x info 0x%x, latency %lld ns",
+		      __get_str(name), __entry->scan_code, __entry->info,
+		      __entry->latency_ns)
+	);
+
+#endif /* _HYPERV_KEYBOARD_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE hyperv_keyboard_trace
+#include <trace/define_trace.h>
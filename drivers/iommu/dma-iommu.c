@@ -48,6 +48,9 @@ struct iommu_dma_cookie {
 
 	/* Domain for flush queue callback; NULL if flush queue not in use */
 	struct iommu_domain		*fq_domain;
+
+	/* IOTLB syncs done by unmaps in strict mode */
+	atomic64_t			strict_syncs;
 };
 
 static inline size_t cookie_msi_granule(struct iommu_dma_cookie *cookie)
@@ -148,6 +151,34 @@ void iommu_put_dma_cookie(struct iommu_domain *domain)
 }
 EXPORT_SYMBOL(iommu_put_dma_cookie);
 
+/**
+ * iommu_dma_show_flush_stats - Report the IOTLB flushes of a DMA domain
+ * @domain: IOMMU domain with a DMA cookie
+ * @buf: sysfs buffer to print to
+ *
+ * Strict domains sync the IOTLB on every unmap, domains with a flush queue
+ * flush it once for a batch of unmaps, either from the timer, early when a
+ * per-CPU queue is half full, or synchronously when one is full.
+ */
+ssize_t iommu_dma_show_flush_stats(struct iommu_domain *domain, char *buf)
+{
+	struct iommu_dma_cookie *cookie = domain->iova_cookie;
+	struct iova_domain *iovad;
+
+	if (!cookie || cookie->type != IOMMU_DMA_IOVA_COOKIE)
+		return -ENODEV;
+
+	iovad = &cookie->iovad;
+	if (!cookie->fq_domain)
+		return sprintf(buf, "mode strict\nsyncs %lld\n",
+			       atomic64_read(&cookie->strict_syncs));
+
+	return sprintf(buf, "mode flush-queue\nflushes %lld\nearly %lld\nfull %lld\n",
+		       atomic64_read(&iovad->fq_flush_finish_cnt),
+		       atomic64_read(&iovad->fq_flush_early_cnt),
+		       atomic64_read(&iovad->fq_flush_full_cnt));
+}
+
 /**
  * iommu_dma_get_resv_regions - Reserved region driver helper
  * @dev: Device from iommu_get_resv_regions()
@@ -527,8 +558,10 @@ static void __iommu_dma_unmap(struct device *dev, dma_addr_t dma_addr,
 	unmapped = iommu_unmap_fast(domain, dma_addr, size, &iotlb_gather);
 	WARN_ON(unmapped != size);
 
-	if (!cookie->fq_domain)
+	if (!cookie->fq_domain) {
 		iommu_iotlb_sync(domain, &iotlb_gather);
+		atomic64_inc(&cookie->strict_syncs);
+	}
 	iommu_dma_free_iova(cookie, dma_addr, size);
 }
 
@@ -10,6 +10,7 @@
 #include <linux/kernel.h>
 #include <linux/bits.h>
 #include <linux/bug.h>
+#include <linux/dma-iommu.h>
 #include <linux/types.h>
 #include <linux/init.h>
 #include <linux/export.h>
@@ -523,6 +524,20 @@ static ssize_t iommu_group_show_type(struct iommu_group *group,
 	return strlen(type);
 }
 
+static ssize_t iommu_group_show_dma_flush_stats(struct iommu_group *group,
+						char *buf)
+{
+	ssize_t ret = -ENODEV;
+
+	mutex_lock(&group->mutex);
+	if (group->default_domain &&
+	    group->default_domain->type == IOMMU_DOMAIN_DMA)
+		ret = iommu_dma_show_flush_stats(group->default_domain, buf);
+	mutex_unlock(&group->mutex);
+
+	return ret;
+}
+
 static IOMMU_GROUP_ATTR(name, S_IRUGO, iommu_group_show_name, NULL);
 
 static IOMMU_GROUP_ATTR(reserved_regions, 0444,
@@ -530,6 +545,9 @@ static IOMMU_GROUP_ATTR(reserved_regions, 0444,
 
 static IOMMU_GROUP_ATTR(type, 0444, iommu_group_show_type, NULL);
 
+static IOMMU_GROUP_ATTR(dma_flush_stats, 0444,
+			iommu_group_show_dma_flush_stats, NULL);
+
 static void iommu_group_release(struct kobject *kobj)
 {
 	struct iommu_group *group = to_iommu_group(kobj);
@@ -616,6 +634,10 @@ struct iommu_group *iommu_group_alloc(void)
 	if (ret)
 		return ERR_PTR(ret);
 
+	ret = iommu_group_create_file(group, &iommu_group_attr_dma_flush_stats);
+	if (ret)
+		return ERR_PTR(ret);
+
 	pr_debug("Allocated group %d\n", group->id);
 
 	return group;
@@ -85,6 +85,8 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 
 	atomic64_set(&iovad->fq_flush_start_cnt,  0);
 	atomic64_set(&iovad->fq_flush_finish_cnt, 0);
+	atomic64_set(&iovad->fq_flush_full_cnt,   0);
+	atomic64_set(&iovad->fq_flush_early_cnt,  0);
 
 	queue = alloc_percpu(struct iova_fq);
 	if (!queue)
@@ -565,6 +567,12 @@ static inline bool fq_full(struct iova_fq *fq)
 	return (((fq->tail + 1) % IOVA_FQ_SIZE) == fq->head);
 }
 
+static inline unsigned fq_ring_pending(struct iova_fq *fq)
+{
+	assert_spin_locked(&fq->lock);
+	return (fq->tail + IOVA_FQ_SIZE - fq->head) % IOVA_FQ_SIZE;
+}
+
 static inline unsigned fq_ring_add(struct iova_fq *fq)
 {
 	unsigned idx = fq->tail;
@@ -653,6 +661,7 @@ void queue_iova(struct iova_domain *iovad,
 	struct iova_fq *fq = raw_cpu_ptr(iovad->fq);
 	unsigned long flags;
 	unsigned idx;
+	bool kick;
 
 	spin_lock_irqsave(&fq->lock, flags);
 
@@ -664,6 +673,7 @@ void queue_iova(struct iova_domain *iovad,
 	fq_ring_free(iovad, fq);
 
 	if (fq_full(fq)) {
+		atomic64_inc(&iovad->fq_flush_full_cnt);
 		iova_domain_flush(iovad);
 		fq_ring_free(iovad, fq);
 	}
@@ -675,8 +685,24 @@ void queue_iova(struct iova_domain *iovad,
 	fq->entries[idx].data     = data;
 	fq->entries[idx].counter  = atomic64_read(&iovad->fq_flush_start_cnt);
 
+	/*
+	 * Under a high unmap rate the queue would fill up before the timer
+	 * expires and the unlucky caller would flush and free the whole ring
+	 * with interrupts off. Have the timer run on the next tick instead
+	 * once half of the ring waits. Only the call crossing the threshold
+	 * does so, the timer is not modified on every call.
+	 */
+	kick = fq_ring_pending(fq) == IOVA_FQ_FLUSH_THRESHOLD;
+
 	spin_unlock_irqrestore(&fq->lock, flags);
 
+	if (kick) {
+		atomic64_inc(&iovad->fq_flush_early_cnt);
+		atomic_set(&iovad->fq_timer_on, 1);
+		mod_timer(&iovad->fq_timer, jiffies);
+		return;
+	}
+
 	/* Avoid false sharing as much as possible. */
 	if (!atomic_read(&iovad->fq_timer_on) &&
 	    !atomic_xchg(&iovad->fq_timer_on, 1))
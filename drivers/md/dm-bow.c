@@ -10,6 +10,7 @@
 #include <linux/crc32.h>
 #include <linux/dm-bufio.h>
 #include <linux/module.h>
+#include <linux/sort.h>
 
 #define DM_MSG_PREFIX "bow"
 
@@ -78,6 +79,22 @@ enum state {
 	COMMITTED,
 };
 
+/*
+ * Writes queued in CHECKPOINT state are handled in batches of up to
+ * BOW_BATCH_MAX bios, sorted by sector so that adjacent first writes are
+ * backed up by one copy and one log entry, with a single log commit for
+ * the whole batch.
+ */
+#define BOW_BATCH_MAX 64
+
+/*
+ * The device is also tracked in chunks of BOW_CHUNK_SECTORS.  A chunk is
+ * marked once it lies entirely within a CHANGED range whose log entry is on
+ * disk.  Changed ranges never change type again before COMMITTED, so writes
+ * to marked chunks are remapped without the ranges lock or the workqueue.
+ */
+#define BOW_CHUNK_SECTORS 128
+
 struct bow_context {
 	struct dm_dev *dev;
 	u32 block_size;
@@ -92,6 +109,20 @@ struct bow_context {
 	struct log_sector *log_sector;
 	struct list_head trimmed_list;
 	bool forward_trims;
+	bool log_dirty;	/* log_sector has entries not yet on disk */
+
+	spinlock_t pending_lock;
+	struct bio_list pending_writes;
+	struct work_struct write_work;
+	unsigned long *changed_chunks;
+
+	/* statistics, protected by ranges_lock unless atomic */
+	atomic64_t bytes_written;
+	atomic64_t fast_writes;
+	u64 bytes_copied;
+	u64 batches;
+	u64 batched_writes;
+	u64 log_commits;
 };
 
 sector_t range_top(struct bow_range *br)
@@ -271,7 +302,7 @@ static sector_t sector_to_page(struct bow_context const *bc, sector_t sector)
 	return sector >> (bc->block_shift - SECTOR_SHIFT);
 }
 
-static int copy_data(struct bow_context const *bc,
+static int copy_data(struct bow_context *bc,
 		     struct bow_range *source, struct bow_range *dest,
 		     u32 *checksum)
 {
@@ -285,6 +316,10 @@ static int copy_data(struct bow_context const *bc,
 	if (checksum)
 		*checksum = sector_to_page(bc, source->sector);
 
+	/* Read the whole source range with large sequential I/O */
+	dm_bufio_prefetch(bc->bufio, sector_to_page(bc, source->sector),
+			  range_size(source) >> bc->block_shift);
+
 	for (i = 0; i < range_size(source) >> bc->block_shift; ++i) {
 		struct dm_buffer *read_buffer, *write_buffer;
 		u8 *read, *write;
@@ -316,7 +351,8 @@ static int copy_data(struct bow_context const *bc,
 		dm_bufio_release(read_buffer);
 	}
 
-	dm_bufio_write_dirty_buffers(bc->bufio);
+	/* The copy is written out by commit_log() or by the caller */
+	bc->bytes_copied += range_size(source);
 	return BLK_STS_OK;
 }
 
@@ -324,6 +360,7 @@ static int copy_data(struct bow_context const *bc,
 
 static int add_log_entry(struct bow_context *bc, sector_t source, sector_t dest,
 			 unsigned int size, u32 checksum);
+static int commit_log(struct bow_context *bc);
 
 static int backup_log_sector(struct bow_context *bc)
 {
@@ -373,26 +410,24 @@ static int backup_log_sector(struct bow_context *bc)
 	return BLK_STS_OK;
 }
 
+/*
+ * Only updates the in-memory log, commit_log() writes it out.
+ */
 static int add_log_entry(struct bow_context *bc, sector_t source, sector_t dest,
 			 unsigned int size, u32 checksum)
 {
-	struct dm_buffer *sector_buffer;
-	u8 *sector;
-
 	if (sizeof(struct log_sector)
 	    + sizeof(struct log_entry) * (bc->log_sector->count + 1)
 		> bc->block_size) {
-		int ret = backup_log_sector(bc);
+		/* The full log must be on disk before it is backed up */
+		int ret = commit_log(bc);
 
 		if (ret)
 			return ret;
-	}
 
-	sector = dm_bufio_new(bc->bufio, 0, &sector_buffer);
-	if (IS_ERR(sector)) {
-		DMERR("Cannot write boot sector");
-		dm_bufio_release(sector_buffer);
-		return BLK_STS_NOSPC;
+		ret = backup_log_sector(bc);
+		if (ret)
+			return ret;
 	}
 
 	bc->log_sector->entries[bc->log_sector->count].source = source;
@@ -400,11 +435,41 @@ static int add_log_entry(struct bow_context *bc, sector_t source, sector_t dest,
 	bc->log_sector->entries[bc->log_sector->count].size = size;
 	bc->log_sector->entries[bc->log_sector->count].checksum = checksum;
 	bc->log_sector->count++;
+	bc->log_dirty = true;
+
+	return BLK_STS_OK;
+}
+
+/*
+ * Writes out the backup copies made since the last commit and then the log
+ * sector describing them.  The original data may only be overwritten once
+ * this has returned successfully.
+ */
+static int commit_log(struct bow_context *bc)
+{
+	struct dm_buffer *sector_buffer;
+	u8 *sector;
+
+	if (!bc->log_dirty)
+		return BLK_STS_OK;
+
+	if (dm_bufio_write_dirty_buffers(bc->bufio))
+		return BLK_STS_IOERR;
+
+	sector = dm_bufio_new(bc->bufio, 0, &sector_buffer);
+	if (IS_ERR(sector)) {
+		DMERR("Cannot write boot sector");
+		return BLK_STS_NOSPC;
+	}
 
 	memcpy(sector, bc->log_sector, bc->block_size);
 	dm_bufio_mark_buffer_dirty(sector_buffer);
 	dm_bufio_release(sector_buffer);
-	dm_bufio_write_dirty_buffers(bc->bufio);
+	if (dm_bufio_write_dirty_buffers(bc->bufio))
+		return BLK_STS_IOERR;
+
+	bc->log_dirty = false;
+	bc->log_commits++;
 	return BLK_STS_OK;
 }
 
@@ -487,6 +552,10 @@ static int prepare_log(struct bow_context *bc)
 	if (ret)
 		return ret;
 
+	ret = commit_log(bc);
+	if (ret)
+		return ret;
+
 	set_type(bc, &free_br, BACKUP);
 	return BLK_STS_OK;
 }
@@ -538,11 +607,26 @@ static ssize_t state_store(struct kobject *kobj, struct kobj_attribute *attr,
 	       : state == COMMITTED ? "Committed" : "Unknown");
 
 	if (state == CHECKPOINT) {
+		struct bow_range *top_br = container_of(rb_last(&bc->ranges),
+							struct bow_range, node);
+		unsigned long *chunks;
+
+		chunks = kvcalloc(BITS_TO_LONGS(DIV_ROUND_UP(top_br->sector,
+							     BOW_CHUNK_SECTORS)),
+				  sizeof(unsigned long), GFP_KERNEL);
+		if (!chunks) {
+			ret = -ENOMEM;
+			goto bad;
+		}
+
 		ret = prepare_log(bc);
 		if (ret) {
 			DMERR("Failed to switch to checkpoint state");
+			kvfree(chunks);
 			goto bad;
 		}
+		/* Pairs with the READ_ONCE in bio_in_changed_chunks() */
+		smp_store_release(&bc->changed_chunks, chunks);
 	} else if (state == COMMITTED) {
 		struct bow_range *br = find_sector0_current(bc);
 		struct bow_range *sector0_br =
@@ -550,6 +634,8 @@ static ssize_t state_store(struct kobject *kobj, struct kobj_attribute *attr,
 				     node);
 
 		ret = copy_data(bc, br, sector0_br, 0);
+		if (!ret && dm_bufio_write_dirty_buffers(bc->bufio))
+			ret = BLK_STS_IOERR;
 		if (ret) {
 			DMERR("Failed to switch to committed state");
 			goto bad;
@@ -577,12 +663,49 @@ static ssize_t free_show(struct kobject *kobj, struct kobj_attribute *attr,
 	return scnprintf(buf, PAGE_SIZE, "%llu\n", trims_total);
 }
 
+/*
+ * Bytes written by the user in checkpoint state, bytes copied to back them
+ * up, and the ratio of the two.
+ */
+static ssize_t stats_show(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	struct bow_context *bc = container_of(kobj, struct bow_context,
+					      kobj_holder.kobj);
+	u64 written, copied, batches, batched, commits, amp = 0;
+
+	mutex_lock(&bc->ranges_lock);
+	copied = bc->bytes_copied;
+	batches = bc->batches;
+	batched = bc->batched_writes;
+	commits = bc->log_commits;
+	mutex_unlock(&bc->ranges_lock);
+	written = atomic64_read(&bc->bytes_written);
+
+	if (written)
+		amp = div64_u64(copied * 100, written);
+
+	return scnprintf(buf, PAGE_SIZE,
+			 "bytes_written %llu\n"
+			 "bytes_copied %llu\n"
+			 "copy_amplification %llu.%02llu\n"
+			 "fast_writes %lld\n"
+			 "batched_writes %llu\n"
+			 "batches %llu\n"
+			 "log_commits %llu\n",
+			 written, copied, div_u64(amp, 100), amp % 100,
+			 (long long)atomic64_read(&bc->fast_writes),
+			 batched, batches, commits);
+}
+
 static struct kobj_attribute attr_state = __ATTR_RW(state);
 static struct kobj_attribute attr_free = __ATTR_RO(free);
+static struct kobj_attribute attr_stats = __ATTR_RO(stats);
 
 static struct attribute *bow_attrs[] = {
 	&attr_state.attr,
 	&attr_free.attr,
+	&attr_stats.attr,
 	NULL
 };
 
@@ -594,6 +717,8 @@ static struct kobj_type bow_ktype = {
 
 /****** constructor/destructor ******/
 
+static void bow_write(struct work_struct *work);
+
 static void dm_bow_dtr(struct dm_target *ti)
 {
 	struct bow_context *bc = (struct bow_context *) ti->private;
@@ -617,6 +742,7 @@ static void dm_bow_dtr(struct dm_target *ti)
 		wait_for_completion(dm_get_completion_from_kobject(kobj));
 	}
 
+	kvfree(bc->changed_chunks);
 	kfree(bc->log_sector);
 	kfree(bc);
 }
@@ -743,7 +869,7 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	mutex_init(&bc->ranges_lock);
 	bc->ranges = RB_ROOT;
 	bc->bufio = dm_bufio_client_create(bc->dev->bdev, bc->block_size, 1, 0,
-					   NULL, NULL);
+					   NULL, NULL, 0);
 	if (IS_ERR(bc->bufio)) {
 		ti->error = "Cannot initialize dm-bufio";
 		ret = PTR_ERR(bc->bufio);
@@ -761,6 +887,9 @@ static int dm_bow_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 	}
 
 	INIT_LIST_HEAD(&bc->trimmed_list);
+	spin_lock_init(&bc->pending_lock);
+	bio_list_init(&bc->pending_writes);
+	INIT_WORK(&bc->write_work, bow_write);
 
 	br = kzalloc(sizeof(*br), GFP_KERNEL);
 	if (!br) {
@@ -930,56 +1059,162 @@ static int prepare_one_range(struct bow_context *bc,
 	}
 }
 
-struct write_work {
-	struct work_struct work;
-	struct bow_context *bc;
-	struct bio *bio;
-};
-
-static void bow_write(struct work_struct *work)
+/*
+ * Prepares the sectors [start, end) for being overwritten
+ */
+static int prepare_extent(struct bow_context *bc, sector_t start, sector_t end)
 {
-	struct write_work *ww = container_of(work, struct write_work, work);
-	struct bow_context *bc = ww->bc;
-	struct bio *bio = ww->bio;
-	struct bvec_iter bi_iter = bio->bi_iter;
-	int ret = BLK_STS_OK;
-
-	kfree(ww);
+	struct bvec_iter bi_iter;
+	int ret;
 
-	mutex_lock(&bc->ranges_lock);
+	bi_iter.bi_sector = start;
+	bi_iter.bi_size = (end - start) * SECTOR_SIZE;
 	do {
 		ret = prepare_one_range(bc, &bi_iter);
 		bi_iter.bi_sector += bi_iter.bi_size / SECTOR_SIZE;
-		bi_iter.bi_size = bio->bi_iter.bi_size
-			- (bi_iter.bi_sector - bio->bi_iter.bi_sector)
-			  * SECTOR_SIZE;
+		bi_iter.bi_size = (end - bi_iter.bi_sector) * SECTOR_SIZE;
 	} while (!ret && bi_iter.bi_size);
 
+	return ret;
+}
+
+/*
+ * Marks the chunks lying entirely within the changed ranges covering
+ * [start, end).  Must only be called once the log is committed.
+ */
+static void mark_changed_chunks(struct bow_context *bc, sector_t start,
+				sector_t end)
+{
+	struct bvec_iter bi_iter;
+	struct bow_range *br;
+
+	bi_iter.bi_sector = start;
+	while (bi_iter.bi_sector < end) {
+		sector_t first, last;
+
+		bi_iter.bi_size = min_t(sector_t, end - bi_iter.bi_sector,
+					UINT_MAX >> SECTOR_SHIFT) * SECTOR_SIZE;
+		br = find_first_overlapping_range(&bc->ranges, &bi_iter);
+		if (!br)
+			return;
+
+		if (br->type == CHANGED) {
+			first = DIV_ROUND_UP(br->sector, BOW_CHUNK_SECTORS);
+			last = range_top(br) / BOW_CHUNK_SECTORS;
+			if (last > first)
+				bitmap_set(bc->changed_chunks, first,
+					   last - first);
+		}
+		bi_iter.bi_sector = range_top(br);
+	}
+}
+
+static bool bio_in_changed_chunks(struct bow_context *bc, struct bio *bio)
+{
+	unsigned long *chunks = READ_ONCE(bc->changed_chunks);
+	sector_t first = bio->bi_iter.bi_sector / BOW_CHUNK_SECTORS;
+	sector_t last = DIV_ROUND_UP(bio_end_sector(bio), BOW_CHUNK_SECTORS);
+
+	if (!chunks || !bio->bi_iter.bi_size)
+		return false;
+
+	return find_next_zero_bit(chunks, last, first) >= last;
+}
+
+static int bio_sector_cmp(const void *a, const void *b)
+{
+	const struct bio *x = *(const struct bio **)a;
+	const struct bio *y = *(const struct bio **)b;
+
+	if (x->bi_iter.bi_sector < y->bi_iter.bi_sector)
+		return -1;
+	return x->bi_iter.bi_sector > y->bi_iter.bi_sector;
+}
+
+static void bow_write_batch(struct bow_context *bc, struct bio **bios,
+			    unsigned int n)
+{
+	unsigned int i, j, k;
+	int ret;
+
+	sort(bios, n, sizeof(*bios), bio_sector_cmp, NULL);
+
+	mutex_lock(&bc->ranges_lock);
+
+	/* Back up each run of adjacent or overlapping bios in one go */
+	for (i = 0; i < n; i = j) {
+		sector_t start = bios[i]->bi_iter.bi_sector;
+		sector_t end = bio_end_sector(bios[i]);
+
+		for (j = i + 1; j < n; j++) {
+			if (bios[j]->bi_iter.bi_sector > end ||
+			    bio_end_sector(bios[j]) - start >
+			    (UINT_MAX >> SECTOR_SHIFT))
+				break;
+			end = max(end, bio_end_sector(bios[j]));
+		}
+
+		ret = end > start ? prepare_extent(bc, start, end) : BLK_STS_OK;
+		for (k = i; k < j; k++)
+			bios[k]->bi_status = ret;
+	}
+
+	ret = commit_log(bc);
+	for (i = 0; i < n; i++) {
+		if (ret)
+			bios[i]->bi_status = ret;
+		if (!bios[i]->bi_status)
+			mark_changed_chunks(bc, bios[i]->bi_iter.bi_sector,
+					    bio_end_sector(bios[i]));
+	}
+	bc->batches++;
+	bc->batched_writes += n;
+
 	mutex_unlock(&bc->ranges_lock);
 
-	if (!ret) {
-		bio_set_dev(bio, bc->dev->bdev);
-		submit_bio(bio);
-	} else {
-		DMERR("Write failure with error %d", -ret);
-		bio->bi_status = ret;
-		bio_endio(bio);
+	for (i = 0; i < n; i++) {
+		struct bio *bio = bios[i];
+
+		if (!bio->bi_status) {
+			bio_set_dev(bio, bc->dev->bdev);
+			submit_bio(bio);
+		} else {
+			DMERR("Write failure with error %d", -bio->bi_status);
+			bio_endio(bio);
+		}
 	}
 }
 
+static void bow_write(struct work_struct *work)
+{
+	struct bow_context *bc = container_of(work, struct bow_context,
+					      write_work);
+	struct bio *bios[BOW_BATCH_MAX];
+	unsigned int n;
+
+	do {
+		spin_lock(&bc->pending_lock);
+		for (n = 0; n < BOW_BATCH_MAX; n++) {
+			bios[n] = bio_list_pop(&bc->pending_writes);
+			if (!bios[n])
+				break;
+		}
+		spin_unlock(&bc->pending_lock);
+
+		if (n)
+			bow_write_batch(bc, bios, n);
+	} while (n == BOW_BATCH_MAX);
+}
+
 static int queue_write(struct bow_context *bc, struct bio *bio)
 {
-	struct write_work *ww = kmalloc(sizeof(*ww), GFP_NOIO | __GFP_NORETRY
-					| __GFP_NOMEMALLOC | __GFP_NOWARN);
-	if (!ww) {
-		DMERR("Failed to allocate write_work");
-		return -ENOMEM;
-	}
+	atomic64_add(bio->bi_iter.bi_size, &bc->bytes_written);
 
-	INIT_WORK(&ww->work, bow_write);
-	ww->bc = bc;
-	ww->bio = bio;
-	queue_work(bc->workqueue, &ww->work);
+	spin_lock(&bc->pending_lock);
+	bio_list_add(&bc->pending_writes, bio);
+	spin_unlock(&bc->pending_lock);
+
+	queue_work(bc->workqueue, &bc->write_work);
 	return DM_MAPIO_SUBMITTED;
 }
 
@@ -1115,6 +1350,13 @@ static int dm_bow_map(struct dm_target *ti, struct bio *bio)
 	if (bio_data_dir(bio) == READ && bio->bi_iter.bi_sector != 0)
 		return remap_unless_illegal_trim(bc, bio);
 
+	if (atomic_read(&bc->state) == CHECKPOINT &&
+	    bio->bi_iter.bi_sector != 0 && bio_in_changed_chunks(bc, bio)) {
+		atomic64_add(bio->bi_iter.bi_size, &bc->bytes_written);
+		atomic64_inc(&bc->fast_writes);
+		return remap_unless_illegal_trim(bc, bio);
+	}
+
 	if (atomic_read(&bc->state) != COMMITTED) {
 		enum state state;
 
@@ -81,6 +81,8 @@
  */
 struct dm_bufio_client {
 	struct mutex lock;
+	spinlock_t spinlock;
+	bool no_sleep;
 
 	struct list_head lru[LIST_SIZE];
 	unsigned long n_buffers[LIST_SIZE];
@@ -165,19 +167,40 @@ struct dm_buffer {
 
 #define dm_bufio_in_request()	(!!current->bio_list)
 
+/*
+ * A client created with DM_BUFIO_CLIENT_NO_SLEEP is locked with a spinlock
+ * so that dm_bufio_get and dm_bufio_release may be called from softirq
+ * context.  Such a client must never dirty its buffers, and paths that
+ * would wait for a busy buffer with the lock held skip it or drop the lock
+ * first.
+ */
 static void dm_bufio_lock(struct dm_bufio_client *c)
 {
-	mutex_lock_nested(&c->lock, dm_bufio_in_request());
+	if (c->no_sleep)
+		spin_lock_bh(&c->spinlock);
+	else
+		mutex_lock_nested(&c->lock, dm_bufio_in_request());
 }
 
 static int dm_bufio_trylock(struct dm_bufio_client *c)
 {
+	if (c->no_sleep)
+		return spin_trylock_bh(&c->spinlock);
 	return mutex_trylock(&c->lock);
 }
 
 static void dm_bufio_unlock(struct dm_bufio_client *c)
 {
-	mutex_unlock(&c->lock);
+	if (c->no_sleep)
+		spin_unlock_bh(&c->spinlock);
+	else
+		mutex_unlock(&c->lock);
+}
+
+static void dm_bufio_cond_resched(struct dm_bufio_client *c)
+{
+	if (!c->no_sleep)
+		cond_resched();
 }
 
 /*----------------------------------------------------------------*/
@@ -333,7 +356,7 @@ static void adjust_total_allocated(struct dm_buffer *b, bool unlink)
 	if (unlink)
 		diff = -diff;
 
-	spin_lock(&global_spinlock);
+	spin_lock_bh(&global_spinlock);
 
 	*class_ptr[data_mode] += diff;
 
@@ -354,7 +377,7 @@ static void adjust_total_allocated(struct dm_buffer *b, bool unlink)
 		global_num--;
 	}
 
-	spin_unlock(&global_spinlock);
+	spin_unlock_bh(&global_spinlock);
 }
 
 /*
@@ -799,18 +822,37 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 {
 	struct dm_buffer *b;
 
+retry:
 	list_for_each_entry_reverse(b, &c->lru[LIST_CLEAN], lru_list) {
 		BUG_ON(test_bit(B_WRITING, &b->state));
 		BUG_ON(test_bit(B_DIRTY, &b->state));
 
+		if (!b->hold_count && unlikely(c->no_sleep && b->state)) {
+			/*
+			 * A prefetch is still reading the buffer, we can't
+			 * wait for it under the spinlock.  Only process
+			 * context gets here, so drop the lock and wait.
+			 */
+			b->hold_count++;
+			dm_bufio_unlock(c);
+			wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
+			dm_bufio_lock(c);
+			b->hold_count--;
+			goto retry;
+		}
+
 		if (!b->hold_count) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
 		}
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
+	/* no-sleep clients are read-only */
+	if (c->no_sleep)
+		return NULL;
+
 	list_for_each_entry_reverse(b, &c->lru[LIST_DIRTY], lru_list) {
 		BUG_ON(test_bit(B_READING, &b->state));
 
@@ -962,7 +1004,7 @@ static void __write_dirty_buffers_async(struct dm_bufio_client *c, int no_wait,
 			return;
 
 		__write_dirty_buffer(b, write_list);
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 }
 
@@ -1620,7 +1662,7 @@ static void drop_buffers(struct dm_bufio_client *c)
  */
 static bool __try_evict_buffer(struct dm_buffer *b, gfp_t gfp)
 {
-	if (!(gfp & __GFP_FS)) {
+	if (!(gfp & __GFP_FS) || b->c->no_sleep) {
 		if (test_bit(B_READING, &b->state) ||
 		    test_bit(B_WRITING, &b->state) ||
 		    test_bit(B_DIRTY, &b->state))
@@ -1666,7 +1708,7 @@ static void __scan(struct dm_bufio_client *c)
 				atomic_long_dec(&c->need_shrink);
 				freed++;
 			}
-			cond_resched();
+			dm_bufio_cond_resched(c);
 		}
 	}
 }
@@ -1718,7 +1760,8 @@ static unsigned long dm_bufio_shrink_count(struct shrinker *shrink, struct shrin
 struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsigned block_size,
 					       unsigned reserved_buffers, unsigned aux_size,
 					       void (*alloc_callback)(struct dm_buffer *),
-					       void (*write_callback)(struct dm_buffer *))
+					       void (*write_callback)(struct dm_buffer *),
+					       unsigned int flags)
 {
 	int r;
 	struct dm_bufio_client *c;
@@ -1753,7 +1796,11 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 		c->n_buffers[i] = 0;
 	}
 
+	if (flags & DM_BUFIO_CLIENT_NO_SLEEP)
+		c->no_sleep = true;
+
 	mutex_init(&c->lock);
+	spin_lock_init(&c->spinlock);
 	INIT_LIST_HEAD(&c->reserved_buffers);
 	c->need_reserved_buffers = reserved_buffers;
 
@@ -1931,7 +1978,7 @@ static void __evict_old_buffers(struct dm_bufio_client *c, unsigned long age_hz)
 		if (__try_evict_buffer(b, 0))
 			count--;
 
-		cond_resched();
+		dm_bufio_cond_resched(c);
 	}
 
 	dm_bufio_unlock(c);
@@ -1952,7 +1999,7 @@ static void do_global_cleanup(struct work_struct *w)
 	while (1) {
 		cond_resched();
 
-		spin_lock(&global_spinlock);
+		spin_lock_bh(&global_spinlock);
 		if (unlikely(dm_bufio_current_allocated <= threshold))
 			break;
 
@@ -1969,7 +2016,7 @@ get_next:
 			list_move(&b->global_list, &global_queue);
 			if (likely(++spinlock_hold_count < 16))
 				goto get_next;
-			spin_unlock(&global_spinlock);
+			spin_unlock_bh(&global_spinlock);
 			continue;
 		}
 
@@ -1979,7 +2026,7 @@ get_next:
 				dm_bufio_unlock(locked_client);
 
 			if (!dm_bufio_trylock(current_client)) {
-				spin_unlock(&global_spinlock);
+				spin_unlock_bh(&global_spinlock);
 				dm_bufio_lock(current_client);
 				locked_client = current_client;
 				continue;
@@ -1988,16 +2035,16 @@ get_next:
 			locked_client = current_client;
 		}
 
-		spin_unlock(&global_spinlock);
+		spin_unlock_bh(&global_spinlock);
 
 		if (unlikely(!__try_evict_buffer(b, GFP_KERNEL))) {
-			spin_lock(&global_spinlock);
+			spin_lock_bh(&global_spinlock);
 			list_move(&b->global_list, &global_queue);
-			spin_unlock(&global_spinlock);
+			spin_unlock_bh(&global_spinlock);
 		}
 	}
 
-	spin_unlock(&global_spinlock);
+	spin_unlock_bh(&global_spinlock);
 
 	if (locked_client)
 		dm_bufio_unlock(locked_client);
@@ -8,12 +8,16 @@
 #include <uapi/linux/dm-user.h>
 
 #include <linux/bio.h>
+#include <linux/highmem.h>
 #include <linux/init.h>
 #include <linux/mempool.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/poll.h>
+#include <linux/uaccess.h>
 #include <linux/uio.h>
+#include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
 
@@ -55,6 +59,13 @@ MODULE_PARM_DESC(dm_user_daemon_timeout_msec,
  *  - dev_write(), which looks up a message (keyed by sequence number) and
  *    completes the corresponding BIO.
  *
+ * A channel may instead be switched to the ring transport, in which case
+ * ring_enter() replaces both dev_read() and dev_write(): it completes every
+ * response userspace has posted to the shared response ring and then moves
+ * as many queued messages as there are free data slots onto the request
+ * ring, all under a single system call.  BIO data is copied once between
+ * the BIO pages and the slot, which is mapped by userspace.
+ *
  * Lock ordering (outer to inner)
  *
  * 1) miscdevice's global lock.  This is held around dev_open, so it has to be
@@ -182,6 +193,33 @@ struct channel {
 	 * only ever be pointer to by from_user_cur, and will never have a BIO.
 	 */
 	struct message scratch_message_from_user;
+
+	/* Set once DM_USER_IOC_SETUP_RING succeeded, never changes after. */
+	struct user_ring *ring;
+};
+
+/*
+ * State of the ring transport of a channel.  Userspace can scribble over the
+ * mapped dm_user_ring_ctrl at any time, so the kernel keeps its own copy of
+ * the indices it owns and validates everything it reads back.  There is one
+ * data slot per ring entry, so holding a free slot guarantees room in both
+ * rings.
+ */
+struct user_ring {
+	void *area;
+	size_t size;
+	struct dm_user_ring_ctrl *ctrl;
+	struct dm_user_ring_req *req;
+	struct dm_user_ring_rsp *rsp;
+	void *data;
+
+	u32 nr_entries;
+	u32 req_prod;
+	u32 rsp_cons;
+
+	u32 nr_free;
+	u32 *free_slots;
+	struct message **slots;
 };
 
 static void message_kill(struct message *m, mempool_t *pool)
@@ -716,6 +754,14 @@ void target_put(struct target *t)
 	}
 }
 
+static void ring_free(struct user_ring *r)
+{
+	vfree(r->area);
+	kfree(r->free_slots);
+	kfree(r->slots);
+	kfree(r);
+}
+
 static struct channel *channel_alloc(struct target *t)
 {
 	struct channel *c;
@@ -760,6 +806,15 @@ void channel_free(struct channel *c)
 	list_for_each_safe (cur, tmp, &c->from_user)
 		message_kill(list_entry(cur, struct message, from_user),
 			     &c->target->message_pool);
+	if (c->ring) {
+		u32 i;
+
+		for (i = 0; i < c->ring->nr_entries; i++)
+			if (c->ring->slots[i])
+				message_kill(c->ring->slots[i],
+					     &c->target->message_pool);
+		ring_free(c->ring);
+	}
 
 	mutex_lock(&c->target->lock);
 	target_put(c->target);
@@ -768,6 +823,241 @@ void channel_free(struct channel *c)
 	kfree(c);
 }
 
+static int ring_setup(struct channel *c, struct dm_user_ring_setup *s)
+{
+	struct user_ring *r;
+	size_t req_size, rsp_size;
+	u32 i;
+
+	lockdep_assert_held(&c->lock);
+
+	if (s->flags || !is_power_of_2(s->nr_entries) ||
+	    s->nr_entries > DM_USER_RING_MAX_ENTRIES)
+		return -EINVAL;
+
+	/* Messages already handed out by read() can't move to the ring. */
+	if (c->ring || c->cur_to_user || !list_empty(&c->from_user) ||
+	    c->scratch_message_from_user.posn_from_user)
+		return -EBUSY;
+
+	req_size = PAGE_ALIGN(s->nr_entries * sizeof(struct dm_user_ring_req));
+	rsp_size = PAGE_ALIGN(s->nr_entries * sizeof(struct dm_user_ring_rsp));
+	s->req_offset = PAGE_SIZE;
+	s->rsp_offset = s->req_offset + req_size;
+	s->data_offset = s->rsp_offset + rsp_size;
+	s->ring_size = s->data_offset +
+		       (u64)s->nr_entries * DM_USER_RING_SLOT_SIZE;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (r == NULL)
+		return -ENOMEM;
+
+	r->size = s->ring_size;
+	r->area = vmalloc_user(r->size);
+	r->free_slots = kcalloc(s->nr_entries, sizeof(*r->free_slots),
+				GFP_KERNEL);
+	r->slots = kcalloc(s->nr_entries, sizeof(*r->slots), GFP_KERNEL);
+	if (!r->area || !r->free_slots || !r->slots) {
+		ring_free(r);
+		return -ENOMEM;
+	}
+
+	r->ctrl = r->area;
+	r->req = r->area + s->req_offset;
+	r->rsp = r->area + s->rsp_offset;
+	r->data = r->area + s->data_offset;
+	r->nr_entries = s->nr_entries;
+	r->ctrl->nr_entries = s->nr_entries;
+
+	for (i = 0; i < r->nr_entries; i++)
+		r->free_slots[i] = r->nr_entries - 1 - i;
+	r->nr_free = r->nr_entries;
+
+	c->ring = r;
+	return 0;
+}
+
+static void *ring_slot_data(struct user_ring *r, u32 slot)
+{
+	return r->data + (size_t)slot * DM_USER_RING_SLOT_SIZE;
+}
+
+static void ring_copy_bio(struct bio *bio, void *buf, bool to_bio)
+{
+	struct bio_vec bvec;
+	struct bvec_iter biter;
+
+	bio_for_each_segment (bvec, bio, biter) {
+		char *p = kmap_atomic(bvec.bv_page);
+
+		if (to_bio) {
+			memcpy(p + bvec.bv_offset, buf, bvec.bv_len);
+			flush_dcache_page(bvec.bv_page);
+		} else {
+			memcpy(buf, p + bvec.bv_offset, bvec.bv_len);
+		}
+		kunmap_atomic(p);
+		buf += bvec.bv_len;
+	}
+}
+
+static void ring_publish(struct user_ring *r, struct message *m)
+{
+	struct dm_user_ring_req *req;
+	u32 slot;
+
+	slot = r->free_slots[--r->nr_free];
+	r->slots[slot] = m;
+
+	req = &r->req[r->req_prod & (r->nr_entries - 1)];
+	req->seq = m->msg.seq;
+	req->type = m->msg.type;
+	req->flags = m->msg.flags;
+	req->sector = m->msg.sector;
+	req->len = m->msg.len;
+	req->slot = slot;
+
+	if (bio_op(m->bio) == REQ_OP_WRITE)
+		ring_copy_bio(m->bio, ring_slot_data(r, slot), false);
+
+	r->req_prod++;
+}
+
+/*
+ * Moves queued messages onto the request ring.  They are pulled off the
+ * target in one go so that the data copies happen without the target lock,
+ * which user_map() needs.  Returns the number of published requests.
+ */
+static int ring_fill(struct channel *c)
+{
+	struct user_ring *r = c->ring;
+	struct target *t = target_from_channel(c);
+	struct message *m, *tmp;
+	LIST_HEAD(batch);
+	u32 prod = r->req_prod;
+	u32 n = 0;
+
+	lockdep_assert_held(&c->lock);
+
+	mutex_lock(&t->lock);
+	while (n < r->nr_free && !list_empty(&t->to_user)) {
+		/* Pairs with the barrier in user_map() */
+		smp_rmb();
+		m = msg_get_to_user(t);
+		list_add_tail(&m->to_user, &batch);
+		n++;
+	}
+	mutex_unlock(&t->lock);
+
+	list_for_each_entry_safe (m, tmp, &batch, to_user) {
+		list_del(&m->to_user);
+
+		/* user_ctr() caps BIOs at the slot size, this can't happen */
+		if (WARN_ON(m->msg.len > DM_USER_RING_SLOT_SIZE &&
+			    (bio_op(m->bio) == REQ_OP_READ ||
+			     bio_op(m->bio) == REQ_OP_WRITE))) {
+			message_kill(m, &t->message_pool);
+			continue;
+		}
+		ring_publish(r, m);
+	}
+
+	/* The request entries and write data must be visible first */
+	smp_store_release(&r->ctrl->req_prod, r->req_prod);
+	return r->req_prod - prod;
+}
+
+/*
+ * Completes every response userspace has posted since the last call.
+ */
+static int ring_reap(struct channel *c)
+{
+	struct user_ring *r = c->ring;
+	int ret = 0;
+	u32 prod;
+
+	lockdep_assert_held(&c->lock);
+
+	/* Orders the reads of the responses and read data after the index */
+	prod = smp_load_acquire(&r->ctrl->rsp_prod);
+
+	if (prod - r->rsp_cons > r->nr_entries)
+		return -EINVAL;
+
+	while (r->rsp_cons != prod) {
+		struct dm_user_ring_rsp *rsp;
+		struct message *m;
+		u64 seq;
+		u32 slot, type;
+
+		rsp = &r->rsp[r->rsp_cons & (r->nr_entries - 1)];
+		seq = READ_ONCE(rsp->seq);
+		slot = READ_ONCE(rsp->slot);
+		type = READ_ONCE(rsp->type);
+
+		if (slot >= r->nr_entries || r->slots[slot] == NULL ||
+		    r->slots[slot]->msg.seq != seq) {
+			pr_info("user provided an invalid ring response seq %llx slot %u\n",
+				seq, slot);
+			ret = -EINVAL;
+			break;
+		}
+
+		m = r->slots[slot];
+		r->slots[slot] = NULL;
+		r->free_slots[r->nr_free++] = slot;
+		r->rsp_cons++;
+
+		if (type == DM_USER_RESP_SUCCESS) {
+			m->bio->bi_status = BLK_STS_OK;
+			if (bio_op(m->bio) == REQ_OP_READ)
+				ring_copy_bio(m->bio, ring_slot_data(r, slot),
+					      true);
+		} else {
+			m->bio->bi_status = BLK_STS_IOERR;
+		}
+
+		bio_endio(m->bio);
+		bio_put(m->bio);
+		mempool_free(m, &c->target->message_pool);
+	}
+
+	WRITE_ONCE(r->ctrl->rsp_cons, r->rsp_cons);
+	return ret;
+}
+
+static long ring_enter(struct channel *c, unsigned long flags)
+{
+	struct target *t = target_from_channel(c);
+	int r;
+
+	lockdep_assert_held(&c->lock);
+
+	if (flags & ~DM_USER_RING_ENTER_WAIT)
+		return -EINVAL;
+
+	r = ring_reap(c);
+	if (r)
+		return r;
+
+	for (;;) {
+		r = ring_fill(c);
+		if (r || !(flags & DM_USER_RING_ENTER_WAIT) ||
+		    !c->ring->nr_free)
+			return r;
+
+		/* As in dev_read(), lock userspace out of a dead target */
+		if (READ_ONCE(t->dm_destroyed))
+			return -ENOTBLK;
+
+		mutex_unlock(&c->lock);
+		r = wait_event_interruptible(t->wq, target_poll(t));
+		mutex_lock(&c->lock);
+		if (r)
+			return r;
+	}
+}
+
 static int dev_open(struct inode *inode, struct file *file)
 {
 	struct channel *c;
@@ -806,6 +1096,11 @@ static ssize_t dev_read(struct kiocb *iocb, struct iov_iter *to)
 
 	mutex_lock(&c->lock);
 
+	if (unlikely(c->ring)) {
+		total_processed = -EINVAL;
+		goto cleanup_unlock;
+	}
+
 	if (unlikely(c->to_user_error)) {
 		total_processed = c->to_user_error;
 		goto cleanup_unlock;
@@ -901,6 +1196,11 @@ static ssize_t dev_write(struct kiocb *iocb, struct iov_iter *from)
 
 	mutex_lock(&c->lock);
 
+	if (unlikely(c->ring)) {
+		total_processed = -EINVAL;
+		goto cleanup_unlock;
+	}
+
 	if (unlikely(c->from_user_error)) {
 		total_processed = c->from_user_error;
 		goto cleanup_unlock;
@@ -1017,12 +1317,75 @@ static int dev_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static __poll_t dev_poll(struct file *file, poll_table *wait)
+{
+	struct channel *c = channel_from_file(file);
+	struct target *t = target_from_channel(c);
+
+	poll_wait(file, &t->wq, wait);
+
+	return target_poll(t) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct channel *c = channel_from_file(file);
+	struct dm_user_ring_setup s;
+	void __user *argp = (void __user *)arg;
+	long r;
+
+	switch (cmd) {
+	case DM_USER_IOC_SETUP_RING:
+		/*
+		 * The user copies happen outside the channel lock, dev_mmap()
+		 * takes it under the mmap lock.
+		 */
+		if (copy_from_user(&s, argp, sizeof(s)))
+			return -EFAULT;
+		mutex_lock(&c->lock);
+		r = ring_setup(c, &s);
+		mutex_unlock(&c->lock);
+		if (!r && copy_to_user(argp, &s, sizeof(s)))
+			r = -EFAULT;
+		return r;
+
+	case DM_USER_IOC_RING_ENTER:
+		mutex_lock(&c->lock);
+		r = c->ring ? ring_enter(c, arg) : -EINVAL;
+		mutex_unlock(&c->lock);
+		return r;
+
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct channel *c = channel_from_file(file);
+	int r;
+
+	mutex_lock(&c->lock);
+	if (c->ring == NULL || vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start != c->ring->size)
+		r = -EINVAL;
+	else
+		r = remap_vmalloc_range(vma, c->ring->area, 0);
+	mutex_unlock(&c->lock);
+
+	return r;
+}
+
 static const struct file_operations file_operations = {
 	.owner = THIS_MODULE,
 	.open = dev_open,
 	.llseek = no_llseek,
 	.read_iter = dev_read,
 	.write_iter = dev_write,
+	.poll = dev_poll,
+	.unlocked_ioctl = dev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = dev_mmap,
 	.release = dev_release,
 };
 
@@ -1037,6 +1400,11 @@ static int user_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		goto cleanup_none;
 	}
 
+	/* Every BIO has to fit into a single data slot of the ring transport */
+	r = dm_set_target_max_io_len(ti, DM_USER_RING_SLOT_SIZE >> SECTOR_SHIFT);
+	if (r)
+		goto cleanup_none;
+
 	t = kzalloc(sizeof(*t), GFP_KERNEL);
 	if (t == NULL) {
 		r = -ENOMEM;
@@ -1258,7 +1626,7 @@ static int user_map(struct dm_target *ti, struct bio *bio)
 
 static struct target_type user_target = {
 	.name = "user",
-	.version = { 1, 0, 0 },
+	.version = { 1, 1, 0 },
 	.module = THIS_MODULE,
 	.ctr = user_ctr,
 	.dtr = user_dtr,
@@ -33,8 +33,15 @@
 #define DM_VERITY_OPT_PANIC		"panic_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
 #define DM_VERITY_OPT_AT_MOST_ONCE	"check_at_most_once"
+#define DM_VERITY_OPT_TASKLET_VERIFY	"try_verify_in_tasklet"
 
-#define DM_VERITY_OPTS_MAX		(3 + DM_VERITY_OPTS_FEC + \
+/*
+ * Larger bios are verified in the workqueue straight away, hashing them
+ * would keep softirqs disabled for too long.
+ */
+#define DM_VERITY_TASKLET_MAX_BLOCKS	8
+
+#define DM_VERITY_OPTS_MAX		(4 + DM_VERITY_OPTS_FEC + \
 					 DM_VERITY_ROOT_HASH_VERIFICATION_OPTS)
 
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
@@ -94,12 +101,26 @@ static sector_t verity_position_at_level(struct dm_verity *v, sector_t block,
 	return block >> (level * v->hash_per_block_bits);
 }
 
+/*
+ * When the ahash is only a wrapper around an shash, the request context is
+ * used as shash descriptor, and data and pages are hashed directly without
+ * building scatterlists.
+ */
+static inline struct shash_desc *verity_shash_desc(struct ahash_request *req)
+{
+	return ahash_request_ctx(req);
+}
+
 static int verity_hash_update(struct dm_verity *v, struct ahash_request *req,
 				const u8 *data, size_t len,
 				struct crypto_wait *wait)
 {
 	struct scatterlist sg;
 
+	/* vmalloc'ed data is virtually contiguous too */
+	if (v->shash)
+		return crypto_shash_update(verity_shash_desc(req), data, len);
+
 	if (likely(!is_vmalloc_addr(data))) {
 		sg_init_one(&sg, data, len);
 		ahash_request_set_crypt(req, &sg, NULL, len);
@@ -126,17 +147,22 @@ static int verity_hash_update(struct dm_verity *v, struct ahash_request *req,
  * Wrapper for crypto_ahash_init, which handles verity salting.
  */
 static int verity_hash_init(struct dm_verity *v, struct ahash_request *req,
-				struct crypto_wait *wait)
+				struct crypto_wait *wait, bool may_sleep)
 {
 	int r;
 
 	ahash_request_set_tfm(req, v->tfm);
-	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
-					CRYPTO_TFM_REQ_MAY_BACKLOG,
-					crypto_req_done, (void *)wait);
+	ahash_request_set_callback(req,
+		may_sleep ? CRYPTO_TFM_REQ_MAY_SLEEP | CRYPTO_TFM_REQ_MAY_BACKLOG : 0,
+		crypto_req_done, (void *)wait);
 	crypto_init_wait(wait);
 
-	r = crypto_wait_req(crypto_ahash_init(req), wait);
+	if (v->shash) {
+		verity_shash_desc(req)->tfm = v->shash;
+		r = crypto_shash_init(verity_shash_desc(req));
+	} else {
+		r = crypto_wait_req(crypto_ahash_init(req), wait);
+	}
 
 	if (unlikely(r < 0)) {
 		DMERR("crypto_ahash_init failed: %d", r);
@@ -163,6 +189,11 @@ static int verity_hash_final(struct dm_verity *v, struct ahash_request *req,
 		}
 	}
 
+	if (v->shash) {
+		r = crypto_shash_final(verity_shash_desc(req), digest);
+		goto out;
+	}
+
 	ahash_request_set_crypt(req, NULL, digest, 0);
 	r = crypto_wait_req(crypto_ahash_final(req), wait);
 out:
@@ -170,12 +201,12 @@ out:
 }
 
 int verity_hash(struct dm_verity *v, struct ahash_request *req,
-		const u8 *data, size_t len, u8 *digest)
+		const u8 *data, size_t len, u8 *digest, bool may_sleep)
 {
 	int r;
 	struct crypto_wait wait;
 
-	r = verity_hash_init(v, req, &wait);
+	r = verity_hash_init(v, req, &wait, may_sleep);
 	if (unlikely(r < 0))
 		goto out;
 
@@ -271,6 +302,9 @@ out:
  * If "skip_unverified" is true, unverified buffer is skipped and 1 is returned.
  * If "skip_unverified" is false, unverified buffer is hashed and verified
  * against current value of verity_io_want_digest(v, io).
+ *
+ * In a tasklet only cached hash blocks are used and -EAGAIN is returned
+ * if the block would have to be read or if error handling would sleep.
  */
 static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 			       sector_t block, int level, bool skip_unverified,
@@ -285,7 +319,13 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 
 	verity_hash_at_level(v, block, level, &hash_block, &offset);
 
-	data = dm_bufio_read(v->bufio, hash_block, &buf);
+	if (io->in_tasklet) {
+		data = dm_bufio_get(v->bufio, hash_block, &buf);
+		if (!data)
+			return -EAGAIN;
+	} else {
+		data = dm_bufio_read(v->bufio, hash_block, &buf);
+	}
 	if (IS_ERR(data))
 		return PTR_ERR(data);
 
@@ -299,14 +339,17 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 
 		r = verity_hash(v, verity_io_hash_req(v, io),
 				data, 1 << v->hash_dev_block_bits,
-				verity_io_real_digest(v, io));
+				verity_io_real_digest(v, io), !io->in_tasklet);
 		if (unlikely(r < 0))
 			goto release_ret_r;
 
 		if (likely(memcmp(verity_io_real_digest(v, io), want_digest,
 				  v->digest_size) == 0))
 			aux->hash_verified = 1;
-		else if (verity_fec_decode(v, io,
+		else if (io->in_tasklet) {
+			r = -EAGAIN;
+			goto release_ret_r;
+		} else if (verity_fec_decode(v, io,
 					   DM_VERITY_BLOCK_TYPE_METADATA,
 					   hash_block, data, NULL) == 0)
 			aux->hash_verified = 1;
@@ -392,9 +435,15 @@ static int verity_for_io_block(struct dm_verity *v, struct dm_verity_io *io,
 		 * until you consider the typical block size is 4,096B.
 		 * Going through this loops twice should be very rare.
 		 */
-		sg_set_page(&sg, bv.bv_page, len, bv.bv_offset);
-		ahash_request_set_crypt(req, &sg, NULL, len);
-		r = crypto_wait_req(crypto_ahash_update(req), wait);
+		if (v->shash) {
+			bv.bv_len = len;
+			r = crypto_shash_update_bvec(verity_shash_desc(req),
+						     &bv);
+		} else {
+			sg_set_page(&sg, bv.bv_page, len, bv.bv_offset);
+			ahash_request_set_crypt(req, &sg, NULL, len);
+			r = crypto_wait_req(crypto_ahash_update(req), wait);
+		}
 
 		if (unlikely(r < 0)) {
 			DMERR("verity_for_io_block crypto op failed: %d", r);
@@ -473,9 +522,22 @@ static int verity_verify_io(struct dm_verity_io *io)
 	bool is_zero;
 	struct dm_verity *v = io->v;
 	struct bvec_iter start;
+	struct bvec_iter iter_copy;
+	struct bvec_iter *iter;
 	unsigned b;
 	struct crypto_wait wait;
 
+	/*
+	 * A tasklet may give up half way through, leave io->iter alone so
+	 * that the workqueue can start over from the first block.
+	 */
+	if (io->in_tasklet) {
+		iter_copy = io->iter;
+		iter = &iter_copy;
+	} else {
+		iter = &io->iter;
+	}
+
 	for (b = 0; b < io->n_blocks; b++) {
 		int r;
 		sector_t cur_block = io->block + b;
@@ -483,7 +545,7 @@ static int verity_verify_io(struct dm_verity_io *io)
 
 		if (v->validated_blocks &&
 		    likely(test_bit(cur_block, v->validated_blocks))) {
-			verity_bv_skip_block(v, io, &io->iter);
+			verity_bv_skip_block(v, io, iter);
 			continue;
 		}
 
@@ -498,7 +560,7 @@ static int verity_verify_io(struct dm_verity_io *io)
 			 * If we expect a zero block, don't validate, just
 			 * return zeros.
 			 */
-			r = verity_for_bv_block(v, io, &io->iter,
+			r = verity_for_bv_block(v, io, iter,
 						verity_bv_zero);
 			if (unlikely(r < 0))
 				return r;
@@ -506,12 +568,12 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash_init(v, req, &wait);
+		r = verity_hash_init(v, req, &wait, !io->in_tasklet);
 		if (unlikely(r < 0))
 			return r;
 
-		start = io->iter;
-		r = verity_for_io_block(v, io, &io->iter, &wait);
+		start = *iter;
+		r = verity_for_io_block(v, io, iter, &wait);
 		if (unlikely(r < 0))
 			return r;
 
@@ -526,11 +588,15 @@ static int verity_verify_io(struct dm_verity_io *io)
 				set_bit(cur_block, v->validated_blocks);
 			continue;
 		}
-		else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block, NULL, &start) == 0)
+
+		if (io->in_tasklet)
+			return -EAGAIN;
+
+		if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
+				      cur_block, NULL, &start) == 0)
 			continue;
-		else if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
-					   cur_block))
+		if (verity_handle_err(v, DM_VERITY_BLOCK_TYPE_DATA,
+				      cur_block))
 			return -EIO;
 	}
 
@@ -557,6 +623,10 @@ static void verity_finish_io(struct dm_verity_io *io, blk_status_t status)
 	bio->bi_end_io = io->orig_bi_end_io;
 	bio->bi_status = status;
 
+	atomic64_inc(&v->nr_ios);
+	atomic64_add(io->end_io_ns - io->submit_ns, &v->io_wait_ns);
+	atomic64_add(ktime_get_ns() - io->end_io_ns, &v->verify_ns);
+
 	verity_fec_finish_io(io);
 
 	bio_endio(bio);
@@ -566,19 +636,65 @@ static void verity_work(struct work_struct *w)
 {
 	struct dm_verity_io *io = container_of(w, struct dm_verity_io, work);
 
+	io->in_tasklet = false;
+
 	verity_finish_io(io, errno_to_blk_status(verity_verify_io(io)));
 }
 
+static void verity_tasklet_io(struct dm_verity_io *io)
+{
+	int err;
+
+	io->in_tasklet = true;
+	err = verity_verify_io(io);
+	if (err == -EAGAIN) {
+		/* a hash block was not cached or the block is corrupted */
+		atomic64_inc(&io->v->nr_tasklet_requeued);
+		INIT_WORK(&io->work, verity_work);
+		queue_work(io->v->verify_wq, &io->work);
+		return;
+	}
+
+	atomic64_inc(&io->v->nr_tasklet_ios);
+	verity_finish_io(io, errno_to_blk_status(err));
+}
+
+/*
+ * The tasklet is per CPU and per device rather than per io: bio_endio()
+ * frees the io, which the tasklet core still touches after the callback.
+ */
+static void verity_tasklet(struct tasklet_struct *t)
+{
+	struct dm_verity_tasklet *vt = from_tasklet(vt, t, tasklet);
+	struct dm_verity_io *io, *tmp;
+	struct llist_node *ios;
+
+	ios = llist_reverse_order(llist_del_all(&vt->ios));
+	llist_for_each_entry_safe(io, tmp, ios, tasklet_node)
+		verity_tasklet_io(io);
+}
+
 static void verity_end_io(struct bio *bio)
 {
 	struct dm_verity_io *io = bio->bi_private;
 
+	io->end_io_ns = ktime_get_ns();
+
 	if (bio->bi_status &&
 	    (!verity_fec_is_enabled(io->v) || verity_is_system_shutting_down())) {
 		verity_finish_io(io, bio->bi_status);
 		return;
 	}
 
+	if (io->v->use_tasklet && !bio->bi_status &&
+	    io->n_blocks <= DM_VERITY_TASKLET_MAX_BLOCKS) {
+		struct dm_verity_tasklet *vt = raw_cpu_ptr(io->v->tasklets);
+
+		llist_add(&io->tasklet_node, &vt->ios);
+		tasklet_schedule(&vt->tasklet);
+		return;
+	}
+
 	INIT_WORK(&io->work, verity_work);
 	queue_work(io->v->verify_wq, &io->work);
 }
@@ -683,6 +799,8 @@ static int verity_map(struct dm_target *ti, struct bio *bio)
 
 	io = dm_per_bio_data(bio, ti->per_io_data_size);
 	io->v = v;
+	io->submit_ns = ktime_get_ns();
+	io->in_tasklet = false;
 	io->orig_bi_end_io = bio->bi_end_io;
 	io->block = bio->bi_iter.bi_sector >> (v->data_dev_block_bits - SECTOR_SHIFT);
 	io->n_blocks = bio->bi_iter.bi_size >> v->data_dev_block_bits;
@@ -742,6 +860,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			args++;
 		if (v->validated_blocks)
 			args++;
+		if (v->use_tasklet)
+			args++;
 		if (v->signature_key_desc)
 			args += DM_VERITY_ROOT_HASH_VERIFICATION_OPTS;
 		if (!args)
@@ -767,6 +887,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
 		if (v->validated_blocks)
 			DMEMIT(" " DM_VERITY_OPT_AT_MOST_ONCE);
+		if (v->use_tasklet)
+			DMEMIT(" " DM_VERITY_OPT_TASKLET_VERIFY);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		if (v->signature_key_desc)
 			DMEMIT(" " DM_VERITY_ROOT_HASH_VERIFICATION_OPT_SIG_KEY
@@ -775,6 +897,42 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 	}
 }
 
+/*
+ * "stats" message: number of completed bios, how many of them were verified
+ * in a tasklet and how many were handed back to the workqueue, followed by
+ * the average time in microseconds spent waiting for the data device and
+ * spent verifying.
+ */
+static int verity_message(struct dm_target *ti, unsigned argc, char **argv,
+			  char *result, unsigned maxlen)
+{
+	struct dm_verity *v = ti->private;
+	u64 nr_ios, io_wait_ns, verify_ns;
+	unsigned sz = 0;
+
+	if (argc != 1 || strcasecmp(argv[0], "stats")) {
+		DMWARN("Unrecognised message received.");
+		return -EINVAL;
+	}
+
+	nr_ios = atomic64_read(&v->nr_ios);
+	io_wait_ns = atomic64_read(&v->io_wait_ns);
+	verify_ns = atomic64_read(&v->verify_ns);
+	if (nr_ios) {
+		io_wait_ns = div64_u64(io_wait_ns, nr_ios);
+		verify_ns = div64_u64(verify_ns, nr_ios);
+	}
+
+	DMEMIT("%llu %lld %lld %llu %llu\n",
+	       (unsigned long long)nr_ios,
+	       (long long)atomic64_read(&v->nr_tasklet_ios),
+	       (long long)atomic64_read(&v->nr_tasklet_requeued),
+	       (unsigned long long)div_u64(io_wait_ns, NSEC_PER_USEC),
+	       (unsigned long long)div_u64(verify_ns, NSEC_PER_USEC));
+
+	return 1;
+}
+
 static int verity_prepare_ioctl(struct dm_target *ti, struct block_device **bdev)
 {
 	struct dm_verity *v = ti->private;
@@ -811,6 +969,13 @@ static void verity_io_hints(struct dm_target *ti, struct queue_limits *limits)
 static void verity_dtr(struct dm_target *ti)
 {
 	struct dm_verity *v = ti->private;
+	int cpu;
+
+	if (v->tasklets) {
+		for_each_possible_cpu(cpu)
+			tasklet_kill(&per_cpu_ptr(v->tasklets, cpu)->tasklet);
+		free_percpu(v->tasklets);
+	}
 
 	if (v->verify_wq)
 		destroy_workqueue(v->verify_wq);
@@ -884,7 +1049,7 @@ static int verity_alloc_zero_digest(struct dm_verity *v)
 		goto out;
 
 	r = verity_hash(v, req, zero_data, 1 << v->data_dev_block_bits,
-			v->zero_digest);
+			v->zero_digest, true);
 
 out:
 	kfree(req);
@@ -942,6 +1107,10 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v,
 				return r;
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_TASKLET_VERIFY)) {
+			v->use_tasklet = true;
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1101,6 +1270,7 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	 */
 	DMINFO("%s using implementation \"%s\"", v->alg_name,
 	       crypto_hash_alg_common(v->tfm)->base.cra_driver_name);
+	v->shash = crypto_ahash_shash(v->tfm);
 
 	v->digest_size = crypto_ahash_digestsize(v->tfm);
 	if ((1 << v->hash_dev_block_bits) < v->digest_size * 2) {
@@ -1194,9 +1364,37 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	}
 	v->hash_blocks = hash_position;
 
+	/*
+	 * An asynchronous hash implementation would have to sleep waiting
+	 * for the result, such a device is verified in the workqueue only.
+	 */
+	if (v->use_tasklet &&
+	    crypto_ahash_tfm(v->tfm)->__crt_alg->cra_flags & CRYPTO_ALG_ASYNC) {
+		DMWARN("%s is asynchronous, ignoring " DM_VERITY_OPT_TASKLET_VERIFY,
+		       crypto_hash_alg_common(v->tfm)->base.cra_driver_name);
+		v->use_tasklet = false;
+	}
+
+	if (v->use_tasklet) {
+		v->tasklets = alloc_percpu(struct dm_verity_tasklet);
+		if (!v->tasklets) {
+			ti->error = "Cannot allocate tasklets";
+			r = -ENOMEM;
+			goto bad;
+		}
+		for_each_possible_cpu(i) {
+			struct dm_verity_tasklet *vt;
+
+			vt = per_cpu_ptr(v->tasklets, i);
+			tasklet_setup(&vt->tasklet, verity_tasklet);
+			init_llist_head(&vt->ios);
+		}
+	}
+
 	v->bufio = dm_bufio_client_create(v->hash_dev->bdev,
 		1 << v->hash_dev_block_bits, 1, sizeof(struct buffer_aux),
-		dm_bufio_alloc_callback, NULL);
+		dm_bufio_alloc_callback, NULL,
+		v->use_tasklet ? DM_BUFIO_CLIENT_NO_SLEEP : 0);
 	if (IS_ERR(v->bufio)) {
 		ti->error = "Cannot initialize dm-bufio";
 		r = PTR_ERR(v->bufio);
@@ -1242,12 +1440,13 @@ bad:
 
 static struct target_type verity_target = {
 	.name		= "verity",
-	.version	= {1, 7, 0},
+	.version	= {1, 8, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
 	.map		= verity_map,
 	.status		= verity_status,
+	.message	= verity_message,
 	.prepare_ioctl	= verity_prepare_ioctl,
 	.iterate_devices = verity_iterate_devices,
 	.io_hints	= verity_io_hints,
@@ -13,6 +13,8 @@
 
 #include <linux/dm-bufio.h>
 #include <linux/device-mapper.h>
+#include <linux/interrupt.h>
+#include <linux/llist.h>
 #include <crypto/hash.h>
 
 #define DM_VERITY_MAX_LEVELS		63
@@ -38,6 +40,7 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_shash *shash;	/* shash behind tfm, if synchronous */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -57,6 +60,9 @@ struct dm_verity {
 	enum verity_mode mode;	/* mode for handling verification errors */
 	unsigned corrupted_errs;/* Number of errors for corrupted blocks */
 
+	bool use_tasklet;	/* try to verify in softirq context first */
+	struct dm_verity_tasklet __percpu *tasklets;
+
 	struct workqueue_struct *verify_wq;
 
 	/* starting blocks for each tree level. 0 is the lowest level. */
@@ -66,6 +72,19 @@ struct dm_verity {
 	unsigned long *validated_blocks; /* bitset blocks validated */
 
 	char *signature_key_desc; /* signature keyring reference */
+
+	/* latency accounting, reported by the "stats" message */
+	atomic64_t nr_ios;
+	atomic64_t nr_tasklet_ios;	/* verified without leaving softirq */
+	atomic64_t nr_tasklet_requeued;	/* fell back to the workqueue */
+	atomic64_t io_wait_ns;		/* map to data bio completion */
+	atomic64_t verify_ns;		/* data bio completion to bio_endio */
+};
+
+/* Verifies the ios queued on it by data bio completion */
+struct dm_verity_tasklet {
+	struct tasklet_struct tasklet;
+	struct llist_head ios;
 };
 
 struct dm_verity_io {
@@ -79,7 +98,13 @@ struct dm_verity_io {
 
 	struct bvec_iter iter;
 
+	u64 submit_ns;
+	u64 end_io_ns;
+
+	bool in_tasklet;
+
 	struct work_struct work;
+	struct llist_node tasklet_node;
 
 	/*
 	 * Three variably-size fields follow this struct:
@@ -124,7 +149,7 @@ extern int verity_for_bv_block(struct dm_verity *v, struct dm_verity_io *io,
 					      u8 *data, size_t len));
 
 extern int verity_hash(struct dm_verity *v, struct ahash_request *req,
-		       const u8 *data, size_t len, u8 *digest);
+		       const u8 *data, size_t len, u8 *digest, bool may_sleep);
 
 extern int verity_hash_for_block(struct dm_verity *v, struct dm_verity_io *io,
 				 sector_t block, u8 *digest, bool *is_zero);
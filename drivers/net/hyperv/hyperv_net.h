@@ -13,6 +13,7 @@
 #define _HYPERV_NET_H
 
 #include <linux/list.h>
+#include <linux/dim.h>
 #include <linux/hyperv.h>
 #include <linux/rndis.h>
 
@@ -836,7 +837,8 @@ struct nvsp_message {
 #define NETVSC_SUPPORTED_HW_FEATURES (NETIF_F_RXCSUM | NETIF_F_IP_CSUM | \
 				      NETIF_F_TSO | NETIF_F_IPV6_CSUM | \
 				      NETIF_F_TSO6 | NETIF_F_LRO | \
-				      NETIF_F_SG | NETIF_F_RXHASH)
+				      NETIF_F_SG | NETIF_F_RXHASH | \
+				      NETIF_F_GSO_UDP_L4)
 
 #define VRSS_SEND_TAB_SIZE 16  /* must be power of 2 */
 #define VRSS_CHANNEL_MAX 64
@@ -846,6 +848,7 @@ struct nvsp_message {
 #define RNDIS_PKT_ALIGN_DEFAULT 8
 
 #define NETVSC_XDP_HDRM 256
+#define NETVSC_XDP_POOL_SIZE 256 /* pages per channel page pool */
 
 #define NETVSC_XFER_HEADER_SIZE(rng_cnt) \
 		(offsetof(struct vmtransfer_page_packet_header, ranges) + \
@@ -857,6 +860,21 @@ struct multi_send_data {
 	u32 count; /* counter of batched packets */
 };
 
+/* Free send buffer sections cached per TX queue, so that copy-mode sends
+ * on different queues don't all bounce the cache lines of the shared
+ * send_section_map. Sections move between the cache and the map in
+ * batches of NETVSC_SEND_CACHE_BATCH.
+ */
+#define NETVSC_SEND_CACHE_SIZE			16
+#define NETVSC_SEND_CACHE_BATCH			8
+
+struct send_section_cache {
+	spinlock_t lock; /* xmit path vs. send completions of the queue */
+	u32 count; /* number of cached sections */
+	u32 next; /* where the next refill scan of the map starts */
+	u32 slots[NETVSC_SEND_CACHE_SIZE];
+};
+
 struct recv_comp_data {
 	u64 tid; /* transaction id */
 	u32 status;
@@ -887,6 +905,7 @@ struct netvsc_stats {
 	u64 broadcast;
 	u64 multicast;
 	u64 xdp_drop;
+	u64 xdp_redirect;
 	struct u64_stats_sync syncp;
 };
 
@@ -897,8 +916,14 @@ struct netvsc_ethtool_stats {
 	unsigned long tx_too_big;
 	unsigned long tx_busy;
 	unsigned long tx_send_full;
+	unsigned long tx_agg_flush_nomore;
+	unsigned long tx_agg_flush_idle;
+	unsigned long tx_agg_flush_limit;
+	unsigned long tx_agg_flush_size;
 	unsigned long rx_comp_busy;
 	unsigned long rx_no_memory;
+	unsigned long rx_pool_alloc;
+	unsigned long rx_pool_recycle;
 	unsigned long stop_queue;
 	unsigned long wake_queue;
 	unsigned long vlan_error;
@@ -968,6 +993,13 @@ struct net_device_context {
 	u32 l4_hash; /* L4 hash settings */
 	struct netvsc_ethtool_stats eth_stats;
 
+	/* Send aggregation: packets per RNDIS message, 0 is the host limit */
+	u32 tx_agg_frames;
+	/* Let tx_dim choose the aggregation limit of each queue instead */
+	bool tx_agg_adaptive;
+	/* Let the channels hold host interrupts back under load */
+	bool rx_moder_adaptive;
+
 	/* State to manage the associated VF interface. */
 	struct net_device __rcu *vf_netdev;
 	struct netvsc_vf_pcpu_stats __percpu *vf_stats;
@@ -992,12 +1024,18 @@ struct netvsc_channel {
 	const struct vmpacket_descriptor *desc;
 	struct napi_struct napi;
 	struct multi_send_data msd;
+	struct send_section_cache ssc;
+	struct dim tx_dim; /* adaptive send aggregation */
+	u16 tx_dim_events; /* send completions, fed to tx_dim */
+	u32 tx_agg_max; /* aggregation limit chosen by tx_dim */
 	struct multi_recv_comp mrc;
 	atomic_t queue_sends;
 	struct nvsc_rsc rsc;
 
 	struct bpf_prog __rcu *bpf_prog;
 	struct xdp_rxq_info xdp_rxq;
+	struct page_pool *page_pool; /* XDP receive pages */
+	bool xdp_flush; /* frames were redirected in this NAPI poll */
 
 	struct netvsc_stats tx_stats;
 	struct netvsc_stats rx_stats;
@@ -1202,6 +1240,9 @@ enum ndis_per_pkt_info_type {
 	MAX_PER_PKT_INFO
 };
 
+/* NDIS 6.83 UdpSegmentationOffloadInfo, outside of the NDIS 5 range above */
+#define UDP_SEGMENTATION_PKTINFO	25
+
 enum rndis_per_pkt_info_interal_type {
 	RNDIS_PKTINFO_ID = 1,
 	/* Add more members here */
@@ -1240,6 +1281,7 @@ struct ndis_object_header {
 };
 
 #define NDIS_OBJECT_TYPE_DEFAULT	0x80
+#define NDIS_OFFLOAD_PARAMETERS_REVISION_5 5
 #define NDIS_OFFLOAD_PARAMETERS_REVISION_3 3
 #define NDIS_OFFLOAD_PARAMETERS_REVISION_2 2
 #define NDIS_OFFLOAD_PARAMETERS_REVISION_1 1
@@ -1250,6 +1292,8 @@ struct ndis_object_header {
 #define NDIS_OFFLOAD_PARAMETERS_LSOV1_ENABLED  2
 #define NDIS_OFFLOAD_PARAMETERS_RSC_DISABLED 1
 #define NDIS_OFFLOAD_PARAMETERS_RSC_ENABLED 2
+#define NDIS_OFFLOAD_PARAMETERS_USO_DISABLED 1
+#define NDIS_OFFLOAD_PARAMETERS_USO_ENABLED 2
 #define NDIS_OFFLOAD_PARAMETERS_TX_RX_DISABLED 1
 #define NDIS_OFFLOAD_PARAMETERS_TX_ENABLED_RX_DISABLED 2
 #define NDIS_OFFLOAD_PARAMETERS_RX_ENABLED_TX_DISABLED 3
@@ -1379,6 +1423,28 @@ struct ndis_encap_offload {
 	u32	maxhdr;
 };
 
+struct ndis_encap_offload_v2 {
+	u32	tx_csum;
+	u32	rx_csum;
+	u32	lsov2;
+	u32	rss;
+	u32	vmq;
+	u32	maxhdr;
+};
+
+struct ndis_uso_offload {
+	u32	ip4_encap;
+	u32	ip4_maxsz;
+	u32	ip4_minsg;
+	u32	ip4_submss;
+	u32	ip6_encap;
+	u32	ip6_maxsz;
+	u32	ip6_minsg;
+	u32	ip6_submss;
+	u32	ip6_opts;
+#define	NDIS_USO_CAP_IP6EXT		0x001
+};
+
 struct ndis_offload {
 	struct ndis_object_header	header;
 	struct ndis_csum_offload	csum;
@@ -1391,6 +1457,10 @@ struct ndis_offload {
 	/* NDIS >= 6.30 */
 	struct ndis_rsc_offload		rsc;
 	struct ndis_encap_offload	encap_gre;
+	/* NDIS >= 6.80 */
+	struct ndis_encap_offload_v2	encap_v2;
+	/* NDIS >= 6.83 */
+	struct ndis_uso_offload		uso;
 };
 
 #define	NDIS_OFFLOAD_SIZE		sizeof(struct ndis_offload)
@@ -1421,6 +1491,11 @@ struct ndis_offload_params {
 		u8 encapsulated_packet_task_offload;
 		u8 encapsulation_types;
 	};
+	/* revision 5, in what used to be tail padding */
+	struct {
+		u8 uso_ip_v4;
+		u8 uso_ip_v6;
+	};
 };
 
 struct ndis_tcp_ip_checksum_info {
@@ -1494,6 +1569,22 @@ struct ndis_tcp_lso_info {
 #define NDIS_HASH_PPI_SIZE (sizeof(struct rndis_per_packet_info) + \
 		sizeof(u32))
 
+struct ndis_udp_seg_info {
+	union {
+		struct {
+			u32 mss:20;
+			u32 udp_header_offset:10;
+			u32 reserved:1;
+			u32 ip_version:1;
+		} transmit;
+		u32 value;
+	};
+};
+
+/* sent instead of the LSO info, so NDIS_ALL_PPI_SIZE covers it */
+#define NDIS_USO_PPI_SIZE (sizeof(struct rndis_per_packet_info) + \
+		sizeof(struct ndis_udp_seg_info))
+
 /* Total size of all PPI data */
 #define NDIS_ALL_PPI_SIZE (NDIS_VLAN_PPI_SIZE + NDIS_CSUM_PPI_SIZE + \
 			   NDIS_LSO_PPI_SIZE + NDIS_HASH_PPI_SIZE)
@@ -20,6 +20,8 @@
 #include <linux/vmalloc.h>
 #include <linux/rtnetlink.h>
 #include <linux/prefetch.h>
+#include <linux/filter.h>
+#include <net/page_pool.h>
 
 #include <asm/sync_bitops.h>
 
@@ -656,6 +658,7 @@ void netvsc_device_remove(struct hv_device *device)
 		/* See also vmbus_reset_channel_cb(). */
 		napi_disable(&net_device->chan_table[i].napi);
 		netif_napi_del(&net_device->chan_table[i].napi);
+		cancel_work_sync(&net_device->chan_table[i].tx_dim.work);
 	}
 
 	/*
@@ -683,10 +686,25 @@ void netvsc_device_remove(struct hv_device *device)
 #define RING_AVAIL_PERCENT_HIWATER 20
 #define RING_AVAIL_PERCENT_LOWATER 10
 
-static inline void netvsc_free_send_slot(struct netvsc_device *net_device,
-					 u32 index)
+static void netvsc_free_send_slot(struct netvsc_device *net_device,
+				  u16 q_idx, u32 index)
 {
-	sync_change_bit(index, net_device->send_section_map);
+	struct send_section_cache *ssc = &net_device->chan_table[q_idx].ssc;
+	int i;
+
+	spin_lock(&ssc->lock);
+	if (ssc->count == NETVSC_SEND_CACHE_SIZE) {
+		/* Give the least recently freed sections back to the map */
+		for (i = 0; i < NETVSC_SEND_CACHE_BATCH; i++)
+			sync_change_bit(ssc->slots[i],
+					net_device->send_section_map);
+
+		ssc->count -= NETVSC_SEND_CACHE_BATCH;
+		memmove(ssc->slots, &ssc->slots[NETVSC_SEND_CACHE_BATCH],
+			ssc->count * sizeof(ssc->slots[0]));
+	}
+	ssc->slots[ssc->count++] = index;
+	spin_unlock(&ssc->lock);
 }
 
 static void netvsc_send_tx_complete(struct net_device *ndev,
@@ -707,11 +725,12 @@ static void netvsc_send_tx_complete(struct net_device *ndev,
 		u32 send_index = packet->send_buf_index;
 		struct netvsc_stats *tx_stats;
 
-		if (send_index != NETVSC_INVALID_INDEX)
-			netvsc_free_send_slot(net_device, send_index);
 		q_idx = packet->q_idx;
+		if (send_index != NETVSC_INVALID_INDEX)
+			netvsc_free_send_slot(net_device, q_idx, send_index);
 
 		tx_stats = &net_device->chan_table[q_idx].tx_stats;
+		net_device->chan_table[q_idx].tx_dim_events++;
 
 		u64_stats_update_begin(&tx_stats->syncp);
 		tx_stats->packets += packet->total_packets;
@@ -807,17 +826,55 @@ static void netvsc_send_completion(struct net_device *ndev,
 	}
 }
 
-static u32 netvsc_get_next_send_section(struct netvsc_device *net_device)
+/* Move up to NETVSC_SEND_CACHE_BATCH free sections from the map to @ssc */
+static void netvsc_refill_send_cache(struct netvsc_device *net_device,
+				     struct send_section_cache *ssc)
 {
 	unsigned long *map_addr = net_device->send_section_map;
-	unsigned int i;
+	u32 cnt = net_device->send_section_cnt;
+	bool wrapped = false;
+	u32 start, i;
+
+	if (!cnt)
+		return;
 
-	for_each_clear_bit(i, map_addr, net_device->send_section_cnt) {
-		if (sync_test_and_set_bit(i, map_addr) == 0)
-			return i;
+	start = ssc->next % cnt;
+	i = start;
+	for (;;) {
+		i = find_next_zero_bit(map_addr, wrapped ? start : cnt, i);
+		if (i >= (wrapped ? start : cnt)) {
+			if (wrapped)
+				break;
+			wrapped = true;
+			i = 0;
+			continue;
+		}
+
+		if (sync_test_and_set_bit(i, map_addr) == 0) {
+			ssc->slots[ssc->count++] = i;
+			if (ssc->count == NETVSC_SEND_CACHE_BATCH)
+				break;
+		}
+		i++;
 	}
 
-	return NETVSC_INVALID_INDEX;
+	ssc->next = i + 1;
+}
+
+static u32 netvsc_get_next_send_section(struct netvsc_device *net_device,
+					u16 q_idx)
+{
+	struct send_section_cache *ssc = &net_device->chan_table[q_idx].ssc;
+	u32 index = NETVSC_INVALID_INDEX;
+
+	spin_lock(&ssc->lock);
+	if (!ssc->count)
+		netvsc_refill_send_cache(net_device, ssc);
+	if (ssc->count)
+		index = ssc->slots[--ssc->count];
+	spin_unlock(&ssc->lock);
+
+	return index;
 }
 
 static void netvsc_copy_to_send_buf(struct netvsc_device *net_device,
@@ -941,6 +998,57 @@ static inline int netvsc_send_pkt(
 	return ret;
 }
 
+/* Packets per RNDIS message for each tx_dim profile, clamped to the host's
+ * max_pkt. net_dim() moves between NETVSC_TX_AGG_PROFILES profiles.
+ */
+#define NETVSC_TX_AGG_PROFILES 5
+
+static const u32 netvsc_tx_agg_profile[NETVSC_TX_AGG_PROFILES] = {
+	1, 2, 4, 8, 16,
+};
+
+static void netvsc_tx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct netvsc_channel *nvchan
+		= container_of(dim, struct netvsc_channel, tx_dim);
+
+	WRITE_ONCE(nvchan->tx_agg_max, netvsc_tx_agg_profile[dim->profile_ix]);
+	dim->state = DIM_START_MEASURE;
+}
+
+/* Feed the send completions of this poll to tx_dim */
+static void netvsc_tx_dim_update(struct net_device_context *ndev_ctx,
+				 struct netvsc_channel *nvchan)
+{
+	struct dim_sample sample = {};
+
+	if (!ndev_ctx->tx_agg_adaptive)
+		return;
+
+	dim_update_sample(nvchan->tx_dim_events, nvchan->tx_stats.packets,
+			  nvchan->tx_stats.bytes, &sample);
+	net_dim(&nvchan->tx_dim, sample);
+}
+
+/* Maximum number of packets to aggregate into one RNDIS message */
+static u32 netvsc_tx_agg_limit(const struct net_device_context *ndev_ctx,
+			       const struct netvsc_device *net_device,
+			       const struct netvsc_channel *nvchan)
+{
+	u32 limit;
+
+	if (ndev_ctx->tx_agg_adaptive)
+		limit = READ_ONCE(nvchan->tx_agg_max);
+	else
+		limit = ndev_ctx->tx_agg_frames;
+
+	if (!limit || limit > net_device->max_pkt)
+		limit = net_device->max_pkt;
+
+	return limit;
+}
+
 /* Move packet out of multi send data (msd), and clear msd */
 static inline void move_pkt_msd(struct hv_netvsc_packet **msd_send,
 				struct sk_buff **msd_skb,
@@ -972,7 +1080,8 @@ int netvsc_send(struct net_device *ndev,
 	struct multi_send_data *msdp;
 	struct hv_netvsc_packet *msd_send = NULL, *cur_send = NULL;
 	struct sk_buff *msd_skb = NULL;
-	bool try_batch, xmit_more;
+	bool try_batch, xmit_more, agg_full, idle = false;
+	u32 agg_max;
 
 	/* If device is rescinded, return error and packet will get dropped. */
 	if (unlikely(!net_device || net_device->destroy))
@@ -994,7 +1103,9 @@ int netvsc_send(struct net_device *ndev,
 	if (msdp->pkt)
 		msd_len = msdp->pkt->total_data_buflen;
 
-	try_batch =  msd_len > 0 && msdp->count < net_device->max_pkt;
+	agg_max = netvsc_tx_agg_limit(ndev_ctx, net_device, nvchan);
+	agg_full = msd_len > 0 && msdp->count >= agg_max;
+	try_batch = msd_len > 0 && !agg_full;
 	if (try_batch && msd_len + pktlen + net_device->pkt_align <
 	    net_device->send_section_size) {
 		section_index = msdp->pkt->send_buf_index;
@@ -1006,7 +1117,8 @@ int netvsc_send(struct net_device *ndev,
 
 	} else if (pktlen + net_device->pkt_align <
 		   net_device->send_section_size) {
-		section_index = netvsc_get_next_send_section(net_device);
+		section_index = netvsc_get_next_send_section(net_device,
+							     packet->q_idx);
 		if (unlikely(section_index == NETVSC_INVALID_INDEX)) {
 			++ndev_ctx->eth_stats.tx_send_full;
 		} else {
@@ -1022,6 +1134,17 @@ int netvsc_send(struct net_device *ndev,
 		!packet->cp_partial &&
 		!netif_xmit_stopped(netdev_get_tx_queue(ndev, packet->q_idx));
 
+	/* Holding a packet makes no sense if it can't be aggregated, and
+	 * in adaptive mode an idle host gets the packet right away: batching
+	 * pays off only while earlier sends are still in flight.
+	 */
+	if (xmit_more && (agg_max == 1 ||
+			  (ndev_ctx->tx_agg_adaptive &&
+			   !atomic_read(&nvchan->queue_sends)))) {
+		xmit_more = false;
+		idle = agg_max > 1;
+	}
+
 	if (section_index != NETVSC_INVALID_INDEX) {
 		netvsc_copy_to_send_buf(net_device,
 					section_index, msd_len,
@@ -1054,6 +1177,11 @@ int netvsc_send(struct net_device *ndev,
 			msdp->skb = NULL;
 			msdp->pkt = NULL;
 			msdp->count = 0;
+
+			if (idle)
+				++ndev_ctx->eth_stats.tx_agg_flush_idle;
+			else
+				++ndev_ctx->eth_stats.tx_agg_flush_nomore;
 		}
 	} else {
 		move_pkt_msd(&msd_send, &msd_skb, msdp);
@@ -1061,11 +1189,18 @@ int netvsc_send(struct net_device *ndev,
 	}
 
 	if (msd_send) {
-		int m_ret = netvsc_send_pkt(device, msd_send, net_device,
-					    NULL, msd_skb);
+		int m_ret;
+
+		if (agg_full)
+			++ndev_ctx->eth_stats.tx_agg_flush_limit;
+		else
+			++ndev_ctx->eth_stats.tx_agg_flush_size;
+
+		m_ret = netvsc_send_pkt(device, msd_send, net_device,
+					NULL, msd_skb);
 
 		if (m_ret != 0) {
-			netvsc_free_send_slot(net_device,
+			netvsc_free_send_slot(net_device, msd_send->q_idx,
 					      msd_send->send_buf_index);
 			dev_kfree_skb_any(msd_skb);
 		}
@@ -1075,7 +1210,8 @@ int netvsc_send(struct net_device *ndev,
 		ret = netvsc_send_pkt(device, cur_send, net_device, pb, skb);
 
 	if (ret != 0 && section_index != NETVSC_INVALID_INDEX)
-		netvsc_free_send_slot(net_device, section_index);
+		netvsc_free_send_slot(net_device, packet->q_idx,
+				      section_index);
 
 	return ret;
 }
@@ -1412,6 +1548,14 @@ int netvsc_poll(struct napi_struct *napi, int budget)
 	int work_done = 0;
 	int ret;
 
+	/* sk_busy_loop() takes the NAPI context without the channel callback,
+	 * so the host still interrupts for every packet the socket is about
+	 * to poll anyway. Mask it until busy polling stops, the last poll
+	 * from busy_poll_stop() completes NAPI and unmasks it below.
+	 */
+	if (test_bit(NAPI_STATE_IN_BUSY_POLL, &napi->state))
+		hv_begin_read(&channel->inbound);
+
 	/* If starting a new interval */
 	if (!nvchan->desc)
 		nvchan->desc = hv_pkt_iter_first(channel);
@@ -1422,18 +1566,29 @@ int netvsc_poll(struct napi_struct *napi, int budget)
 		nvchan->desc = hv_pkt_iter_next(channel, nvchan->desc);
 	}
 
+	if (nvchan->xdp_flush) {
+		xdp_do_flush();
+		nvchan->xdp_flush = false;
+	}
+
+	netvsc_tx_dim_update(netdev_priv(ndev), nvchan);
+
 	/* Send any pending receive completions */
 	ret = send_recv_completions(ndev, net_device, nvchan);
 
+	vmbus_chan_moder_account(channel, work_done);
+
 	/* If it did not exhaust NAPI budget this time
 	 *  and not doing busy poll
-	 * then re-enable host interrupts
+	 * then re-enable host interrupts, unless the moderation holds
+	 * them back and polls again later,
 	 *  and reschedule if ring is not empty
 	 *   or sending receive completion failed.
 	 */
 	if (work_done < budget &&
 	    napi_complete_done(napi, work_done) &&
-	    (ret || hv_end_read(&channel->inbound)) &&
+	    (ret || (!vmbus_chan_moder_hold(channel) &&
+		     hv_end_read(&channel->inbound))) &&
 	    napi_schedule_prep(napi)) {
 		hv_begin_read(&channel->inbound);
 		__napi_schedule(napi);
@@ -1496,12 +1651,26 @@ struct netvsc_device *netvsc_device_add(struct hv_device *device,
 
 	for (i = 0; i < VRSS_CHANNEL_MAX; i++) {
 		struct netvsc_channel *nvchan = &net_device->chan_table[i];
+		struct page_pool_params pp_params = {
+			.order = 0,
+			.pool_size = NETVSC_XDP_POOL_SIZE,
+			.nid = NUMA_NO_NODE,
+		};
 
 		nvchan->channel = device->channel;
 		nvchan->net_device = net_device;
+		spin_lock_init(&nvchan->ssc.lock);
+		/* Start each queue's scan of the section map on its own line */
+		nvchan->ssc.next = i * L1_CACHE_BYTES * BITS_PER_BYTE;
 		u64_stats_init(&nvchan->tx_stats.syncp);
 		u64_stats_init(&nvchan->rx_stats.syncp);
 
+		/* Start from the largest batches, which is the old behaviour */
+		INIT_WORK(&nvchan->tx_dim.work, netvsc_tx_dim_work);
+		nvchan->tx_dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+		nvchan->tx_dim.profile_ix = NETVSC_TX_AGG_PROFILES - 1;
+		nvchan->tx_agg_max = netvsc_tx_agg_profile[nvchan->tx_dim.profile_ix];
+
 		ret = xdp_rxq_info_reg(&nvchan->xdp_rxq, ndev, i);
 
 		if (ret) {
@@ -1509,11 +1678,23 @@ struct netvsc_device *netvsc_device_add(struct hv_device *device,
 			goto cleanup2;
 		}
 
+		nvchan->page_pool = page_pool_create(&pp_params);
+		if (IS_ERR(nvchan->page_pool)) {
+			ret = PTR_ERR(nvchan->page_pool);
+			nvchan->page_pool = NULL;
+			netdev_err(ndev, "page_pool_create fail: %d\n", ret);
+			goto cleanup2;
+		}
+
+		/* The pool is destroyed by xdp_rxq_info_unreg() from now on */
 		ret = xdp_rxq_info_reg_mem_model(&nvchan->xdp_rxq,
-						 MEM_TYPE_PAGE_SHARED, NULL);
+						 MEM_TYPE_PAGE_POOL,
+						 nvchan->page_pool);
 
 		if (ret) {
 			netdev_err(ndev, "xdp reg_mem_model fail: %d\n", ret);
+			page_pool_destroy(nvchan->page_pool);
+			nvchan->page_pool = NULL;
 			goto cleanup2;
 		}
 	}
@@ -1523,6 +1704,9 @@ struct netvsc_device *netvsc_device_add(struct hv_device *device,
 		       netvsc_poll, NAPI_POLL_WEIGHT);
 
 	/* Open the channel */
+	vmbus_chan_moder_enable(device->channel,
+				net_device_ctx->rx_moder_adaptive);
+
 	ret = vmbus_open(device->channel, netvsc_ring_bytes,
 			 netvsc_ring_bytes,  NULL, 0,
 			 netvsc_channel_cb, net_device->chan_table);
@@ -1555,6 +1739,7 @@ struct netvsc_device *netvsc_device_add(struct hv_device *device,
 close:
 	RCU_INIT_POINTER(net_device_ctx->nvdev, NULL);
 	napi_disable(&net_device->chan_table[0].napi);
+	cancel_work_sync(&net_device->chan_table[0].tx_dim.work);
 
 	/* Now, we can close the channel safely */
 	vmbus_close(device->channel);
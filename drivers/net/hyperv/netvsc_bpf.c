@@ -13,6 +13,7 @@
 #include <linux/bpf.h>
 #include <linux/bpf_trace.h>
 #include <linux/kernel.h>
+#include <net/page_pool.h>
 #include <net/xdp.h>
 
 #include <linux/mutex.h>
@@ -23,6 +24,7 @@
 u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
 		   struct xdp_buff *xdp)
 {
+	struct net_device_context *ndev_ctx = netdev_priv(ndev);
 	void *data = nvchan->rsc.data[0];
 	u32 len = nvchan->rsc.len[0];
 	struct page *page = NULL;
@@ -38,11 +40,12 @@ u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
 		goto out;
 
 	/* allocate page buffer for data */
-	page = alloc_page(GFP_ATOMIC);
+	page = page_pool_dev_alloc_pages(nvchan->page_pool);
 	if (!page) {
 		act = XDP_DROP;
 		goto out;
 	}
+	++ndev_ctx->eth_stats.rx_pool_alloc;
 
 	xdp->data_hard_start = page_address(page);
 	xdp->data = xdp->data_hard_start + NETVSC_XDP_HDRM;
@@ -61,6 +64,22 @@ u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
 	case XDP_DROP:
 		break;
 
+	case XDP_REDIRECT:
+		/* On success the page belongs to the redirect target, e.g.
+		 * an AF_XDP socket that copies it into its UMEM and returns
+		 * it to the page pool.
+		 */
+		if (!xdp_do_redirect(ndev, xdp, prog)) {
+			nvchan->xdp_flush = true;
+			xdp->data_hard_start = NULL;
+			rcu_read_unlock();
+			return act;
+		}
+
+		act = XDP_ABORTED;
+		trace_xdp_exception(ndev, prog, act);
+		break;
+
 	case XDP_ABORTED:
 		trace_xdp_exception(ndev, prog, act);
 		break;
@@ -72,9 +91,17 @@ u32 netvsc_run_xdp(struct net_device *ndev, struct netvsc_channel *nvchan,
 out:
 	rcu_read_unlock();
 
-	if (page && act != XDP_PASS && act != XDP_TX) {
-		__free_page(page);
+	if (!page)
+		return act;
+
+	if (act != XDP_PASS && act != XDP_TX) {
+		/* Still in NAPI context, so recycle straight into the cache */
+		page_pool_recycle_direct(nvchan->page_pool, page);
+		++ndev_ctx->eth_stats.rx_pool_recycle;
 		xdp->data_hard_start = NULL;
+	} else {
+		/* The page is handed to the stack as a regular page */
+		page_pool_release_page(nvchan->page_pool, page);
 	}
 
 	return act;
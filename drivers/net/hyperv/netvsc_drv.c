@@ -22,6 +22,7 @@
 #include <linux/skbuff.h>
 #include <linux/if_vlan.h>
 #include <linux/in.h>
+#include <linux/udp.h>
 #include <linux/slab.h>
 #include <linux/rtnetlink.h>
 #include <linux/netpoll.h>
@@ -44,6 +45,9 @@
 #define LINKCHANGE_INT (2 * HZ)
 #define VF_TAKEOVER_INT (HZ / 10)
 
+/* most headers a received packet can have in the linear area of its skb */
+#define RX_HDR_MAX	256
+
 static unsigned int ring_size __ro_after_init = 128;
 module_param(ring_size, uint, 0444);
 MODULE_PARM_DESC(ring_size, "Ring buffer size (# of pages)");
@@ -642,7 +646,35 @@ static int netvsc_xmit(struct sk_buff *skb, struct net_device *net, bool xdp_tx)
 		vlan->pri = skb_vlan_tag_get_prio(skb);
 	}
 
-	if (skb_is_gso(skb)) {
+	if (skb_is_gso(skb) &&
+	    (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)) {
+		struct ndis_udp_seg_info *uso_info;
+
+		rndis_msg_size += NDIS_USO_PPI_SIZE;
+		uso_info = init_ppi_data(rndis_msg, NDIS_USO_PPI_SIZE,
+					 UDP_SEGMENTATION_PKTINFO);
+
+		/* the host fixes up the lengths and checksums per segment */
+		uso_info->value = 0;
+		if (skb->protocol == htons(ETH_P_IP)) {
+			uso_info->transmit.ip_version =
+				NDIS_TCP_LARGE_SEND_OFFLOAD_IPV4;
+			ip_hdr(skb)->tot_len = 0;
+			ip_hdr(skb)->check = 0;
+			udp_hdr(skb)->check =
+				~csum_tcpudp_magic(ip_hdr(skb)->saddr,
+						   ip_hdr(skb)->daddr, 0, IPPROTO_UDP, 0);
+		} else {
+			uso_info->transmit.ip_version =
+				NDIS_TCP_LARGE_SEND_OFFLOAD_IPV6;
+			ipv6_hdr(skb)->payload_len = 0;
+			udp_hdr(skb)->check =
+				~csum_ipv6_magic(&ipv6_hdr(skb)->saddr,
+						 &ipv6_hdr(skb)->daddr, 0, IPPROTO_UDP, 0);
+		}
+		uso_info->transmit.udp_header_offset = skb_transport_offset(skb);
+		uso_info->transmit.mss = skb_shinfo(skb)->gso_size;
+	} else if (skb_is_gso(skb)) {
 		struct ndis_tcp_lso_info *lso_info;
 
 		rndis_msg_size += NDIS_LSO_PPI_SIZE;
@@ -810,6 +842,66 @@ static void netvsc_comp_ipcsum(struct sk_buff *skb)
 	iph->check = ip_fast_csum(iph, iph->ihl);
 }
 
+/*
+ * Copy the headers of a large received packet into the linear area and the
+ * payload into whole pages. Full, page aligned frags can be mapped to user
+ * space by TCP_ZEROCOPY_RECEIVE, the payload of a linear skb cannot.
+ */
+static struct sk_buff *netvsc_alloc_paged_skb(struct napi_struct *napi,
+					      struct netvsc_channel *nvchan)
+{
+	u32 remaining, hlen, off;
+	struct sk_buff *skb;
+	int i = 0, nr_frags = 0;
+
+	/* the headers are in the first fragment of a coalesced packet */
+	hlen = eth_get_headlen(napi->dev, nvchan->rsc.data[0],
+			       min_t(u32, nvchan->rsc.len[0], RX_HDR_MAX));
+
+	skb = napi_alloc_skb(napi, hlen);
+	if (!skb)
+		return NULL;
+	skb_put_data(skb, nvchan->rsc.data[0], hlen);
+
+	off = hlen;
+	remaining = nvchan->rsc.pktlen - hlen;
+	while (remaining) {
+		u32 size = min_t(u32, remaining, PAGE_SIZE), done = 0;
+		struct page *page;
+		void *va;
+
+		if (nr_frags == MAX_SKB_FRAGS)
+			goto drop;
+		page = dev_alloc_page();
+		if (!page)
+			goto drop;
+		va = page_address(page);
+
+		while (done < size) {
+			u32 n;
+
+			if (off == nvchan->rsc.len[i]) {
+				i++;
+				off = 0;
+				continue;
+			}
+			n = min(size - done, nvchan->rsc.len[i] - off);
+			memcpy(va + done, nvchan->rsc.data[i] + off, n);
+			done += n;
+			off += n;
+		}
+
+		skb_add_rx_frag(skb, nr_frags++, page, 0, size, PAGE_SIZE);
+		remaining -= size;
+	}
+
+	return skb;
+
+drop:
+	kfree_skb(skb);
+	return NULL;
+}
+
 static struct sk_buff *netvsc_alloc_recv_skb(struct net_device *net,
 					     struct netvsc_channel *nvchan,
 					     struct xdp_buff *xdp)
@@ -838,6 +930,11 @@ static struct sk_buff *netvsc_alloc_recv_skb(struct net_device *net,
 		skb_reserve(skb, hdroom);
 		skb_put(skb, xlen);
 		skb->dev = napi->dev;
+	} else if (nvchan->rsc.pktlen >= RX_HDR_MAX + PAGE_SIZE) {
+		skb = netvsc_alloc_paged_skb(napi, nvchan);
+
+		if (!skb)
+			return NULL;
 	} else {
 		skb = napi_alloc_skb(napi, nvchan->rsc.pktlen);
 
@@ -909,6 +1006,14 @@ int netvsc_recv_callback(struct net_device *net,
 
 	act = netvsc_run_xdp(net, nvchan, &xdp);
 
+	if (act == XDP_REDIRECT) {
+		u64_stats_update_begin(&rx_stats->syncp);
+		rx_stats->xdp_redirect++;
+		u64_stats_update_end(&rx_stats->syncp);
+
+		return NVSP_STAT_SUCCESS; /* consumed by XDP */
+	}
+
 	if (act != XDP_PASS && act != XDP_TX) {
 		u64_stats_update_begin(&rx_stats->syncp);
 		rx_stats->xdp_drop++;
@@ -1177,6 +1282,8 @@ static void netvsc_init_settings(struct net_device *dev)
 	struct net_device_context *ndc = netdev_priv(dev);
 
 	ndc->l4_hash = HV_DEFAULT_L4HASH;
+	ndc->tx_agg_adaptive = true;
+	ndc->rx_moder_adaptive = true;
 
 	ndc->speed = SPEED_UNKNOWN;
 	ndc->duplex = DUPLEX_FULL;
@@ -1454,8 +1561,19 @@ static const struct {
 	{ "tx_too_big",	  offsetof(struct netvsc_ethtool_stats, tx_too_big) },
 	{ "tx_busy",	  offsetof(struct netvsc_ethtool_stats, tx_busy) },
 	{ "tx_send_full", offsetof(struct netvsc_ethtool_stats, tx_send_full) },
+	{ "tx_agg_flush_nomore",
+		offsetof(struct netvsc_ethtool_stats, tx_agg_flush_nomore) },
+	{ "tx_agg_flush_idle",
+		offsetof(struct netvsc_ethtool_stats, tx_agg_flush_idle) },
+	{ "tx_agg_flush_limit",
+		offsetof(struct netvsc_ethtool_stats, tx_agg_flush_limit) },
+	{ "tx_agg_flush_size",
+		offsetof(struct netvsc_ethtool_stats, tx_agg_flush_size) },
 	{ "rx_comp_busy", offsetof(struct netvsc_ethtool_stats, rx_comp_busy) },
 	{ "rx_no_memory", offsetof(struct netvsc_ethtool_stats, rx_no_memory) },
+	{ "rx_pool_alloc", offsetof(struct netvsc_ethtool_stats, rx_pool_alloc) },
+	{ "rx_pool_recycle",
+		offsetof(struct netvsc_ethtool_stats, rx_pool_recycle) },
 	{ "stop_queue", offsetof(struct netvsc_ethtool_stats, stop_queue) },
 	{ "wake_queue", offsetof(struct netvsc_ethtool_stats, wake_queue) },
 	{ "vlan_error", offsetof(struct netvsc_ethtool_stats, vlan_error) },
@@ -1490,8 +1608,10 @@ static const struct {
 /* statistics per queue (rx/tx packets/bytes) */
 #define NETVSC_PCPU_STATS_LEN (num_present_cpus() * ARRAY_SIZE(pcpu_stats))
 
-/* 5 statistics per queue (rx/tx packets/bytes, rx xdp_drop) */
-#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * 5)
+/* 7 statistics per queue (rx/tx packets/bytes, tx agg_max,
+ * rx xdp_drop/xdp_redirect)
+ */
+#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * 7)
 
 static int netvsc_get_sset_count(struct net_device *dev, int string_set)
 {
@@ -1523,7 +1643,7 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 	struct netvsc_ethtool_pcpu_stats *pcpu_sum;
 	unsigned int start;
 	u64 packets, bytes;
-	u64 xdp_drop;
+	u64 xdp_drop, xdp_redirect;
 	int i, j, cpu;
 
 	if (!nvdev)
@@ -1546,6 +1666,7 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 		} while (u64_stats_fetch_retry_irq(&qstats->syncp, start));
 		data[i++] = packets;
 		data[i++] = bytes;
+		data[i++] = READ_ONCE(nvdev->chan_table[j].tx_agg_max);
 
 		qstats = &nvdev->chan_table[j].rx_stats;
 		do {
@@ -1553,10 +1674,12 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 			packets = qstats->packets;
 			bytes = qstats->bytes;
 			xdp_drop = qstats->xdp_drop;
+			xdp_redirect = qstats->xdp_redirect;
 		} while (u64_stats_fetch_retry_irq(&qstats->syncp, start));
 		data[i++] = packets;
 		data[i++] = bytes;
 		data[i++] = xdp_drop;
+		data[i++] = xdp_redirect;
 	}
 
 	pcpu_sum = kvmalloc_array(num_possible_cpus(),
@@ -1600,12 +1723,16 @@ static void netvsc_get_strings(struct net_device *dev, u32 stringset, u8 *data)
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "tx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
+			sprintf(p, "tx_queue_%u_agg_max", i);
+			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_packets", i);
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_xdp_drop", i);
 			p += ETH_GSTRING_LEN;
+			sprintf(p, "rx_queue_%u_xdp_redirect", i);
+			p += ETH_GSTRING_LEN;
 		}
 
 		for_each_present_cpu(cpu) {
@@ -1906,6 +2033,44 @@ out:
 	return ret;
 }
 
+static int netvsc_get_coalesce(struct net_device *ndev,
+			       struct ethtool_coalesce *ec)
+{
+	struct net_device_context *ndevctx = netdev_priv(ndev);
+
+	ec->use_adaptive_tx_coalesce = ndevctx->tx_agg_adaptive;
+	ec->tx_max_coalesced_frames = ndevctx->tx_agg_frames;
+	ec->use_adaptive_rx_coalesce = ndevctx->rx_moder_adaptive;
+
+	return 0;
+}
+
+/* tx-frames caps the packets aggregated into one RNDIS message; 0 means the
+ * host's limit. With adaptive-tx each queue picks its own limit instead.
+ * adaptive-rx lets each channel hold host interrupts back under load.
+ */
+static int netvsc_set_coalesce(struct net_device *ndev,
+			       struct ethtool_coalesce *ec)
+{
+	struct net_device_context *ndevctx = netdev_priv(ndev);
+	struct netvsc_device *nvdev = rtnl_dereference(ndevctx->nvdev);
+	int i;
+
+	WRITE_ONCE(ndevctx->tx_agg_frames, ec->tx_max_coalesced_frames);
+	WRITE_ONCE(ndevctx->tx_agg_adaptive, !!ec->use_adaptive_tx_coalesce);
+
+	ndevctx->rx_moder_adaptive = !!ec->use_adaptive_rx_coalesce;
+	for (i = 0; nvdev && i < nvdev->num_chn; i++) {
+		struct vmbus_channel *channel = nvdev->chan_table[i].channel;
+
+		if (channel)
+			vmbus_chan_moder_enable(channel,
+						ndevctx->rx_moder_adaptive);
+	}
+
+	return 0;
+}
+
 static netdev_features_t netvsc_fix_features(struct net_device *ndev,
 					     netdev_features_t features)
 {
@@ -1998,6 +2163,9 @@ static void netvsc_set_msglevel(struct net_device *ndev, u32 val)
 }
 
 static const struct ethtool_ops ethtool_ops = {
+	.supported_coalesce_params = ETHTOOL_COALESCE_TX_MAX_FRAMES |
+				     ETHTOOL_COALESCE_USE_ADAPTIVE_TX |
+				     ETHTOOL_COALESCE_USE_ADAPTIVE_RX,
 	.get_drvinfo	= netvsc_get_drvinfo,
 	.get_regs_len	= netvsc_get_regs_len,
 	.get_regs	= netvsc_get_regs,
@@ -2020,6 +2188,8 @@ static const struct ethtool_ops ethtool_ops = {
 	.set_link_ksettings = netvsc_set_link_ksettings,
 	.get_ringparam	= netvsc_get_ringparam,
 	.set_ringparam	= netvsc_set_ringparam,
+	.get_coalesce	= netvsc_get_coalesce,
+	.set_coalesce	= netvsc_set_coalesce,
 };
 
 static const struct net_device_ops device_ops = {
@@ -806,6 +806,9 @@ rndis_filter_set_offload_params(struct net_device *ndev,
 	*offload_params = *req_offloads;
 	offload_params->header.type = NDIS_OBJECT_TYPE_DEFAULT;
 	offload_params->header.revision = NDIS_OFFLOAD_PARAMETERS_REVISION_3;
+	if (req_offloads->uso_ip_v4 || req_offloads->uso_ip_v6)
+		offload_params->header.revision =
+			NDIS_OFFLOAD_PARAMETERS_REVISION_5;
 	offload_params->header.size = extlen;
 
 	ret = rndis_filter_send_request(rdev, request);
@@ -1166,6 +1169,7 @@ static void netvsc_sc_open(struct vmbus_channel *new_sc)
 	 * control is done via Net softirq, not the channel handling
 	 */
 	set_channel_read_mode(new_sc, HV_CALL_ISR);
+	vmbus_chan_moder_enable(new_sc, ndev_ctx->rx_moder_adaptive);
 
 	/* Set the channel before opening.*/
 	nvchan->channel = new_sc;
@@ -1315,6 +1319,25 @@ static int rndis_netdev_set_hwcaps(struct rndis_device *rndis_device,
 		}
 	}
 
+	/* Segment UDP_SEGMENT sends on the host. Only offered when both the
+	 * UDP checksums and USO are available for both IP versions, like
+	 * NETIF_F_GSO_UDP_L4 covers both.
+	 */
+	if ((net_device_ctx->tx_checksum_mask & TRANSPORT_INFO_IPV4_UDP) &&
+	    (net_device_ctx->tx_checksum_mask & TRANSPORT_INFO_IPV6_UDP) &&
+	    (hwcaps.uso.ip4_encap & NDIS_OFFLOAD_ENCAP_8023) &&
+	    (hwcaps.uso.ip6_encap & NDIS_OFFLOAD_ENCAP_8023) &&
+	    (hwcaps.uso.ip6_opts & NDIS_USO_CAP_IP6EXT)) {
+		offloads.uso_ip_v4 = NDIS_OFFLOAD_PARAMETERS_USO_ENABLED;
+		offloads.uso_ip_v6 = NDIS_OFFLOAD_PARAMETERS_USO_ENABLED;
+		net->hw_features |= NETIF_F_GSO_UDP_L4;
+
+		if (hwcaps.uso.ip4_maxsz < gso_max_size)
+			gso_max_size = hwcaps.uso.ip4_maxsz;
+		if (hwcaps.uso.ip6_maxsz < gso_max_size)
+			gso_max_size = hwcaps.uso.ip6_maxsz;
+	}
+
 	if (hwcaps.rsc.ip4 && hwcaps.rsc.ip6) {
 		net->hw_features |= NETIF_F_LRO;
 
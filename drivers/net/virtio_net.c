@@ -91,6 +91,8 @@ struct virtnet_rq_stats {
 	u64 xdp_tx;
 	u64 xdp_redirects;
 	u64 xdp_drops;
+	u64 xdp_linearize;
+	u64 xdp_linearize_avoided;
 	u64 kicks;
 };
 
@@ -113,6 +115,8 @@ static const struct virtnet_stat_desc virtnet_rq_stats_desc[] = {
 	{ "xdp_tx",		VIRTNET_RQ_STAT(xdp_tx) },
 	{ "xdp_redirects",	VIRTNET_RQ_STAT(xdp_redirects) },
 	{ "xdp_drops",		VIRTNET_RQ_STAT(xdp_drops) },
+	{ "xdp_linearize",	VIRTNET_RQ_STAT(xdp_linearize) },
+	{ "xdp_linearize_avoided", VIRTNET_RQ_STAT(xdp_linearize_avoided) },
 	{ "kicks",		VIRTNET_RQ_STAT(kicks) },
 };
 
@@ -585,6 +589,9 @@ static unsigned int virtnet_get_headroom(struct virtnet_info *vi)
  * XDP should preclude the underlying device from sending packets
  * across multiple buffers (num_buf > 1), and we make sure buffers
  * have enough headroom.
+ *
+ * Programs loaded with BPF_F_XDP_HAS_FRAGS only see the first of several
+ * mergeable buffers, so packets larger than a page are not copied for them.
  */
 static struct page *xdp_linearize_page(struct receive_queue *rq,
 				       u16 *num_buf,
@@ -685,6 +692,7 @@ static struct sk_buff *receive_small(struct net_device *dev,
 			xdp_page = xdp_linearize_page(rq, &num_buf, page,
 						      offset, header_offset,
 						      &tlen);
+			stats->xdp_linearize++;
 			if (!xdp_page)
 				goto err_xdp;
 
@@ -811,6 +819,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 	unsigned int headroom = mergeable_ctx_to_headroom(ctx);
 	unsigned int metasize = 0;
 	unsigned int frame_sz;
+	bool frags = false;
 	int err;
 
 	head_skb = NULL;
@@ -822,7 +831,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 		struct xdp_frame *xdpf;
 		struct page *xdp_page;
 		struct xdp_buff xdp;
-		void *data;
+		void *data, *data_end;
 		u32 act;
 
 		/* Transient failure which in theory could occur if
@@ -843,19 +852,26 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 		 * happen for the first several packets, so we don't
 		 * care much about its performance.
 		 */
-		if (unlikely(num_buf > 1 ||
-			     headroom < virtnet_get_headroom(vi))) {
+		if (unlikely(headroom < virtnet_get_headroom(vi) ||
+			     (num_buf > 1 && !xdp_prog->aux->xdp_has_frags))) {
 			/* linearize data for XDP */
 			xdp_page = xdp_linearize_page(rq, &num_buf,
 						      page, offset,
 						      VIRTIO_XDP_HEADROOM,
 						      &len);
 			frame_sz = PAGE_SIZE;
+			stats->xdp_linearize++;
 
 			if (!xdp_page)
 				goto err_xdp;
 			offset = VIRTIO_XDP_HEADROOM;
 		} else {
+			/* the program only sees the first buffer, the others
+			 * are added to the skb below on XDP_PASS
+			 */
+			frags = num_buf > 1;
+			if (frags)
+				stats->xdp_linearize_avoided++;
 			xdp_page = page;
 		}
 
@@ -869,10 +885,21 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 		xdp.data_meta = xdp.data;
 		xdp.rxq = &rq->xdp_rxq;
 		xdp.frame_sz = frame_sz - vi->hdr_len;
+		data_end = xdp.data_end;
 
 		act = bpf_prog_run_xdp(xdp_prog, &xdp);
 		stats->xdp_packets++;
 
+		/* xdp_frame cannot describe the other buffers, and the tail
+		 * of the first one is in the middle of the packet
+		 */
+		if (unlikely(frags && (act == XDP_TX || act == XDP_REDIRECT ||
+				       (act == XDP_PASS &&
+					xdp.data_end != data_end)))) {
+			trace_xdp_exception(vi->dev, xdp_prog, act);
+			goto err_xdp;
+		}
+
 		switch (act) {
 		case XDP_PASS:
 			metasize = xdp.data - xdp.data_meta;
@@ -2396,6 +2423,7 @@ static int virtnet_xdp_set(struct net_device *dev, struct bpf_prog *prog,
 {
 	unsigned long int max_sz = PAGE_SIZE - sizeof(struct padded_vnet_hdr);
 	struct virtnet_info *vi = netdev_priv(dev);
+	bool frags = prog && prog->aux->xdp_has_frags && vi->mergeable_rx_bufs;
 	struct bpf_prog *old_prog;
 	u16 xdp_qp = 0, curr_qp;
 	int i, err;
@@ -2415,8 +2443,9 @@ static int virtnet_xdp_set(struct net_device *dev, struct bpf_prog *prog,
 		return -EINVAL;
 	}
 
-	if (dev->mtu > max_sz) {
-		NL_SET_ERR_MSG_MOD(extack, "MTU too large to enable XDP");
+	/* larger packets span several mergeable buffers */
+	if (prog && !frags && dev->mtu > max_sz) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large to enable XDP without frags support");
 		netdev_warn(dev, "XDP requires MTU less than %lu\n", max_sz);
 		return -EINVAL;
 	}
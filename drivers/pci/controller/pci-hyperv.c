@@ -253,6 +253,18 @@ struct tran_int_desc {
 	u64	address;
 } __packed;
 
+/*
+ * Driver private per-interrupt state, stored as the chip data of the irq:
+ * the interrupt remapping entry allocated by the host and the target last
+ * programmed into it with HVCALL_RETARGET_INTERRUPT.
+ */
+struct hv_pci_irq {
+	struct tran_int_desc int_desc;
+	bool retargeted;
+	unsigned int vector;
+	unsigned int cpu;
+};
+
 /*
  * A generic message format for virtual PCI.
  * Specific message formats are defined later in the file.
@@ -1113,7 +1125,7 @@ static int hv_register_block_invalidate(struct pci_dev *pdev, void *context,
 
 /* Interrupt management hooks */
 static void hv_int_desc_free(struct hv_pci_dev *hpdev,
-			     struct tran_int_desc *int_desc)
+			     struct hv_pci_irq *hv_irq)
 {
 	struct pci_delete_interrupt *int_pkt;
 	struct {
@@ -1126,10 +1138,10 @@ static void hv_int_desc_free(struct hv_pci_dev *hpdev,
 	int_pkt->message_type.type =
 		PCI_DELETE_INTERRUPT_MESSAGE;
 	int_pkt->wslot.slot = hpdev->desc.win_slot.slot;
-	int_pkt->int_desc = *int_desc;
+	int_pkt->int_desc = hv_irq->int_desc;
 	vmbus_sendpacket(hpdev->hbus->hdev->channel, int_pkt, sizeof(*int_pkt),
 			 (unsigned long)&ctxt.pkt, VM_PKT_DATA_INBAND, 0);
-	kfree(int_desc);
+	kfree(hv_irq);
 }
 
 /**
@@ -1149,24 +1161,24 @@ static void hv_msi_free(struct irq_domain *domain, struct msi_domain_info *info,
 	struct hv_pcibus_device *hbus;
 	struct hv_pci_dev *hpdev;
 	struct pci_dev *pdev;
-	struct tran_int_desc *int_desc;
+	struct hv_pci_irq *hv_irq;
 	struct irq_data *irq_data = irq_domain_get_irq_data(domain, irq);
 	struct msi_desc *msi = irq_data_get_msi_desc(irq_data);
 
 	pdev = msi_desc_to_pci_dev(msi);
 	hbus = info->data;
-	int_desc = irq_data_get_irq_chip_data(irq_data);
-	if (!int_desc)
+	hv_irq = irq_data_get_irq_chip_data(irq_data);
+	if (!hv_irq)
 		return;
 
 	irq_data->chip_data = NULL;
 	hpdev = get_pcichild_wslot(hbus, devfn_to_wslot(pdev->devfn));
 	if (!hpdev) {
-		kfree(int_desc);
+		kfree(hv_irq);
 		return;
 	}
 
-	hv_int_desc_free(hpdev, int_desc);
+	hv_int_desc_free(hpdev, hv_irq);
 	put_pcichild(hpdev);
 }
 
@@ -1198,8 +1210,10 @@ static void hv_irq_mask(struct irq_data *data)
 static void hv_irq_unmask(struct irq_data *data)
 {
 	struct msi_desc *msi_desc = irq_data_get_msi_desc(data);
+	struct hv_pci_irq *hv_irq = data->chip_data;
 	struct hv_retarget_device_interrupt *params;
 	struct hv_pcibus_device *hbus;
+	unsigned int vector, target;
 	struct cpumask *dest;
 	cpumask_var_t tmp;
 	struct pci_bus *pbus;
@@ -1213,6 +1227,21 @@ static void hv_irq_unmask(struct irq_data *data)
 	pdev = msi_desc_to_pci_dev(msi_desc);
 	pbus = pdev->bus;
 	hbus = container_of(pbus->sysdata, struct hv_pcibus_device, sysdata);
+	vector = hv_msi_get_int_vector(data);
+
+	/*
+	 * The remapping entry keeps its target while the interrupt is
+	 * masked, so an unmask that changes neither the vector nor the
+	 * (single) destination CPU needs no hypercall. This is the common
+	 * case when a driver masks and unmasks its vectors, and for all the
+	 * interrupts not affected by a CPU going away.
+	 */
+	target = cpumask_first_and(dest, cpu_online_mask);
+	if (cpumask_next_and(target, dest, cpu_online_mask) < nr_cpu_ids)
+		target = nr_cpu_ids;
+	if (hv_irq && hv_irq->retargeted && target < nr_cpu_ids &&
+	    hv_irq->vector == vector && hv_irq->cpu == target)
+		goto unmask;
 
 	spin_lock_irqsave(&hbus->retarget_msi_interrupt_lock, flags);
 
@@ -1226,7 +1255,7 @@ static void hv_irq_unmask(struct irq_data *data)
 			   (hbus->hdev->dev_instance.b[7] << 8) |
 			   (hbus->hdev->dev_instance.b[6] & 0xf8) |
 			   PCI_FUNC(pdev->devfn);
-	params->int_target.vector = hv_msi_get_int_vector(data);
+	params->int_target.vector = vector;
 
 	/*
 	 * Honoring apic->irq_delivery_mode set to dest_Fixed by
@@ -1299,6 +1328,13 @@ exit_unlock:
 		dev_err(&hbus->hdev->device,
 			"%s() failed: %#llx", __func__, res);
 
+	if (hv_irq) {
+		hv_irq->retargeted = !res && target < nr_cpu_ids;
+		hv_irq->vector = vector;
+		hv_irq->cpu = target;
+	}
+
+unmask:
 	if (data->parent_data->chip->irq_unmask)
 		irq_chip_unmask_parent(data);
 	pci_msi_unmask_irq(data);
@@ -1365,17 +1401,25 @@ static u32 hv_compose_msi_req_v2(
 }
 
 /**
- * hv_compose_msi_msg() - Supplies a valid MSI address/data
+ * __hv_compose_msi_msg() - Supplies a valid MSI address/data
  * @data:	Everything about this MSI
  * @msg:	Buffer that is filled in by this function
+ * @reuse:	Whether an existing host allocation may be reused
  *
  * This function unpacks the IRQ looking for target CPU set, IDT
  * vector and mode and sends a message to the parent partition
  * asking for a mapping for that tuple in this partition.  The
  * response supplies a data value and address to which that data
  * should be written to trigger that interrupt.
+ *
+ * The CPU and vector only matter to the host until the entry is
+ * retargeted in hv_irq_unmask(), so if @reuse is set and this interrupt
+ * already has an entry (e.g. a managed interrupt being started up again
+ * after its CPUs came back online) the message is composed from it
+ * without another round trip to the host.
  */
-static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
+static void __hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg,
+				 bool reuse)
 {
 	struct hv_pcibus_device *hbus;
 	struct vmbus_channel *channel;
@@ -1384,7 +1428,7 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 	struct pci_dev *pdev;
 	struct cpumask *dest;
 	struct compose_comp_ctxt comp;
-	struct tran_int_desc *int_desc;
+	struct hv_pci_irq *hv_irq;
 	struct {
 		struct pci_packet pci_pkt;
 		union {
@@ -1396,6 +1440,14 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 	u32 size;
 	int ret;
 
+	if (reuse && data->chip_data) {
+		hv_irq = data->chip_data;
+		msg->address_hi = hv_irq->int_desc.address >> 32;
+		msg->address_lo = hv_irq->int_desc.address & 0xffffffff;
+		msg->data = hv_irq->int_desc.data;
+		return;
+	}
+
 	pdev = msi_desc_to_pci_dev(irq_data_get_msi_desc(data));
 	dest = irq_data_get_effective_affinity_mask(data);
 	pbus = pdev->bus;
@@ -1407,13 +1459,13 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 
 	/* Free any previous message that might have already been composed. */
 	if (data->chip_data) {
-		int_desc = data->chip_data;
+		hv_irq = data->chip_data;
 		data->chip_data = NULL;
-		hv_int_desc_free(hpdev, int_desc);
+		hv_int_desc_free(hpdev, hv_irq);
 	}
 
-	int_desc = kzalloc(sizeof(*int_desc), GFP_ATOMIC);
-	if (!int_desc)
+	hv_irq = kzalloc(sizeof(*hv_irq), GFP_ATOMIC);
+	if (!hv_irq)
 		goto drop_reference;
 
 	memset(&ctxt, 0, sizeof(ctxt));
@@ -1444,7 +1496,7 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 		 */
 		dev_err(&hbus->hdev->device,
 			"Unexpected vPCI protocol, update driver.");
-		goto free_int_desc;
+		goto free_hv_irq;
 	}
 
 	ret = vmbus_sendpacket(hpdev->hbus->hdev->channel, &ctxt.int_pkts,
@@ -1455,7 +1507,7 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 		dev_err(&hbus->hdev->device,
 			"Sending request for interrupt failed: 0x%x",
 			comp.comp_pkt.completion_status);
-		goto free_int_desc;
+		goto free_hv_irq;
 	}
 
 	/*
@@ -1508,7 +1560,7 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 		dev_err(&hbus->hdev->device,
 			"Request for interrupt failed: 0x%x",
 			comp.comp_pkt.completion_status);
-		goto free_int_desc;
+		goto free_hv_irq;
 	}
 
 	/*
@@ -1516,8 +1568,8 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 	 * irq_set_chip_data() here would be appropriate, but the lock it takes
 	 * is already held.
 	 */
-	*int_desc = comp.int_desc;
-	data->chip_data = int_desc;
+	hv_irq->int_desc = comp.int_desc;
+	data->chip_data = hv_irq;
 
 	/* Pass up the result. */
 	msg->address_hi = comp.int_desc.address >> 32;
@@ -1529,8 +1581,8 @@ static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
 
 enable_tasklet:
 	tasklet_enable(&channel->callback_event);
-free_int_desc:
-	kfree(int_desc);
+free_hv_irq:
+	kfree(hv_irq);
 drop_reference:
 	put_pcichild(hpdev);
 return_null_message:
@@ -1539,6 +1591,11 @@ return_null_message:
 	msg->data = 0;
 }
 
+static void hv_compose_msi_msg(struct irq_data *data, struct msi_msg *msg)
+{
+	__hv_compose_msi_msg(data, msg, true);
+}
+
 /* HW Interrupt Chip Descriptor */
 static struct irq_chip hv_msi_irq_chip = {
 	.name			= "Hyper-V PCIe MSI",
@@ -3405,7 +3462,7 @@ static int hv_pci_restore_msi_msg(struct pci_dev *pdev, void *arg)
 		if (WARN_ON_ONCE(!irq_data))
 			return -EINVAL;
 
-		hv_compose_msi_msg(irq_data, &entry->msg);
+		__hv_compose_msi_msg(irq_data, &entry->msg, false);
 	}
 
 	return 0;
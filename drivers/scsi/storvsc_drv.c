@@ -21,6 +21,7 @@
 #include <linux/device.h>
 #include <linux/hyperv.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <scsi/scsi.h>
 #include <scsi/scsi_cmnd.h>
 #include <scsi/scsi_host.h>
@@ -385,6 +386,11 @@ MODULE_PARM_DESC(storvsc_ringbuffer_size, "Ring buffer size (bytes)");
 module_param(storvsc_vcpus_per_sub_channel, int, S_IRUGO);
 MODULE_PARM_DESC(storvsc_vcpus_per_sub_channel, "Ratio of VCPUs to subchannels");
 
+static bool storvsc_adaptive_moderation = true;
+module_param(storvsc_adaptive_moderation, bool, S_IRUGO);
+MODULE_PARM_DESC(storvsc_adaptive_moderation,
+		 "Hold host interrupts back on busy channels");
+
 static int ring_avail_percent_lowater = 10;
 module_param(ring_avail_percent_lowater, int, S_IRUGO);
 MODULE_PARM_DESC(ring_avail_percent_lowater,
@@ -405,6 +411,9 @@ static void storvsc_on_channel_callback(void *context);
 #define STORVSC_MAX_TARGETS				2
 #define STORVSC_MAX_CHANNELS				8
 
+/* Packets fetched per pass by the channel callback */
+#define STORVSC_PKT_BATCH				16
+
 #define STORVSC_FC_MAX_LUNS_PER_TARGET			255
 #define STORVSC_FC_MAX_TARGETS				128
 #define STORVSC_FC_MAX_CHANNELS				8
@@ -425,9 +434,21 @@ struct storvsc_cmd_request {
 	struct vmbus_packet_mpb_array *payload;
 	u32 payload_sz;
 
+	/* Entry on the completion batch of storvsc_on_channel_callback() */
+	struct list_head done_entry;
+
 	struct vstor_packet vstor_packet;
 };
 
+/* Per-LUN state, hung off scsi_device->hostdata */
+struct storvsc_lun {
+	/*
+	 * Complete I/O for this LUN after the whole ring has been drained
+	 * (default), or while draining it, for latency-sensitive LUNs.
+	 */
+	bool batch_completions;
+};
+
 
 /* A storvsc device is a device object that contains a vmbus channel */
 struct storvsc_device {
@@ -458,6 +479,11 @@ struct storvsc_device {
 	 */
 	u16 num_sc;
 	struct vmbus_channel **stor_chns;
+	/*
+	 * Channel of each blk-mq hardware queue, indexed by the VMBus
+	 * sub_channel_index (0 is the primary channel).
+	 */
+	struct vmbus_channel **hctx_chns;
 	/*
 	 * Mask of CPUs bound to subchannels.
 	 */
@@ -711,11 +737,16 @@ static void handle_sc_creation(struct vmbus_channel *new_sc)
 		return;
 	}
 
+	vmbus_chan_moder_enable(new_sc, storvsc_adaptive_moderation);
 	new_sc->change_target_cpu_callback = storvsc_change_target_cpu;
 
 	/* Add the sub-channel to the array of available channels. */
 	stor_device->stor_chns[new_sc->target_cpu] = new_sc;
 	cpumask_set_cpu(new_sc->target_cpu, &stor_device->alloced_cpus);
+
+	if (new_sc->offermsg.offer.sub_channel_index <= stor_device->num_sc)
+		WRITE_ONCE(stor_device->hctx_chns[
+			new_sc->offermsg.offer.sub_channel_index], new_sc);
 }
 
 static void  handle_multichannel_storage(struct hv_device *device, int max_chns)
@@ -941,6 +972,12 @@ static int storvsc_channel_init(struct hv_device *device, bool is_fc)
 	if (stor_device->stor_chns == NULL)
 		return -ENOMEM;
 
+	stor_device->hctx_chns = kcalloc(num_possible_cpus(), sizeof(void *),
+					 GFP_KERNEL);
+	if (stor_device->hctx_chns == NULL)
+		return -ENOMEM;
+	stor_device->hctx_chns[0] = device->channel;
+
 	device->channel->change_target_cpu_callback = storvsc_change_target_cpu;
 
 	stor_device->stor_chns[device->channel->target_cpu] = device->channel;
@@ -1119,10 +1156,22 @@ static void storvsc_command_completion(struct storvsc_cmd_request *cmd_request,
 		kfree(payload);
 }
 
+static void storvsc_end_request(struct storvsc_cmd_request *request,
+				struct storvsc_device *stor_device)
+{
+	storvsc_command_completion(request, stor_device);
+
+	if (atomic_dec_and_test(&stor_device->num_outstanding_req) &&
+		stor_device->drain_notify)
+		wake_up(&stor_device->waiting_to_drain);
+}
+
 static void storvsc_on_io_completion(struct storvsc_device *stor_device,
 				  struct vstor_packet *vstor_packet,
-				  struct storvsc_cmd_request *request)
+				  struct storvsc_cmd_request *request,
+				  struct list_head *done)
 {
+	struct storvsc_lun *lun = request->cmd->device->hostdata;
 	struct vstor_packet *stor_pkt;
 	struct hv_device *device = stor_device->device;
 
@@ -1185,23 +1234,26 @@ static void storvsc_on_io_completion(struct storvsc_device *stor_device,
 	stor_pkt->vm_srb.data_transfer_length =
 	vstor_packet->vm_srb.data_transfer_length;
 
-	storvsc_command_completion(request, stor_device);
-
-	if (atomic_dec_and_test(&stor_device->num_outstanding_req) &&
-		stor_device->drain_notify)
-		wake_up(&stor_device->waiting_to_drain);
-
-
+	/*
+	 * Everything needed from the ring packet has been copied, so the
+	 * request can be completed after the ring space has been released.
+	 */
+	if (lun && READ_ONCE(lun->batch_completions))
+		list_add_tail(&request->done_entry, done);
+	else
+		storvsc_end_request(request, stor_device);
 }
 
 static void storvsc_on_receive(struct storvsc_device *stor_device,
 			     struct vstor_packet *vstor_packet,
-			     struct storvsc_cmd_request *request)
+			     struct storvsc_cmd_request *request,
+			     struct list_head *done)
 {
 	struct hv_host_device *host_dev;
 	switch (vstor_packet->operation) {
 	case VSTOR_OPERATION_COMPLETE_IO:
-		storvsc_on_io_completion(stor_device, vstor_packet, request);
+		storvsc_on_io_completion(stor_device, vstor_packet, request,
+					 done);
 		break;
 
 	case VSTOR_OPERATION_REMOVE_DEVICE:
@@ -1226,9 +1278,12 @@ static void storvsc_on_receive(struct storvsc_device *stor_device,
 static void storvsc_on_channel_callback(void *context)
 {
 	struct vmbus_channel *channel = (struct vmbus_channel *)context;
-	const struct vmpacket_descriptor *desc;
+	const struct vmpacket_descriptor *descs[STORVSC_PKT_BATCH];
+	struct storvsc_cmd_request *request, *tmp;
 	struct hv_device *device;
 	struct storvsc_device *stor_device;
+	u32 i, n, total = 0;
+	LIST_HEAD(done);
 
 	if (channel->primary_channel != NULL)
 		device = channel->primary_channel->device_obj;
@@ -1239,22 +1294,41 @@ static void storvsc_on_channel_callback(void *context)
 	if (!stor_device)
 		return;
 
-	foreach_vmbus_pkt(desc, channel) {
-		void *packet = hv_pkt_data(desc);
-		struct storvsc_cmd_request *request;
-
-		request = (struct storvsc_cmd_request *)
-			((unsigned long)desc->trans_id);
-
-		if (request == &stor_device->init_request ||
-		    request == &stor_device->reset_request) {
-			memcpy(&request->vstor_packet, packet,
-			       (sizeof(struct vstor_packet) - vmscsi_size_delta));
-			complete(&request->wait_event);
-		} else {
-			storvsc_on_receive(stor_device, packet, request);
+	/*
+	 * Drain the ring in batches; the host read_index is published once,
+	 * by hv_pkt_iter_close(), after the ring has been found empty.
+	 */
+	while ((n = hv_pkt_iter_bulk(channel, descs, ARRAY_SIZE(descs)))) {
+		total += n;
+		for (i = 0; i < n; i++) {
+			void *packet = hv_pkt_data(descs[i]);
+			struct storvsc_cmd_request *request;
+
+			request = (struct storvsc_cmd_request *)
+				((unsigned long)descs[i]->trans_id);
+
+			if (request == &stor_device->init_request ||
+			    request == &stor_device->reset_request) {
+				memcpy(&request->vstor_packet, packet,
+				       (sizeof(struct vstor_packet) -
+					vmscsi_size_delta));
+				complete(&request->wait_event);
+			} else {
+				storvsc_on_receive(stor_device, packet,
+						   request, &done);
+			}
 		}
 	}
+	if (total)
+		hv_pkt_iter_close(channel);
+	vmbus_chan_moder_account(channel, total);
+
+	/*
+	 * Complete the batch only now: the host already has the ring space
+	 * back and can post further completions while we run scsi_done().
+	 */
+	list_for_each_entry_safe(request, tmp, &done, done_entry)
+		storvsc_end_request(request, stor_device);
 }
 
 static int storvsc_connect_to_vsp(struct hv_device *device, u32 ring_size,
@@ -1275,6 +1349,8 @@ static int storvsc_connect_to_vsp(struct hv_device *device, u32 ring_size,
 	if (ret != 0)
 		return ret;
 
+	vmbus_chan_moder_enable(device->channel, storvsc_adaptive_moderation);
+
 	ret = storvsc_channel_init(device, is_fc);
 
 	return ret;
@@ -1312,6 +1388,7 @@ static int storvsc_dev_remove(struct hv_device *device)
 	vmbus_close(device->channel);
 
 	kfree(stor_device->stor_chns);
+	kfree(stor_device->hctx_chns);
 	kfree(stor_device);
 	return 0;
 }
@@ -1369,7 +1446,8 @@ static struct vmbus_channel *get_og_chn(struct storvsc_device *stor_device,
 
 
 static int storvsc_do_io(struct hv_device *device,
-			 struct storvsc_cmd_request *request, u16 q_num)
+			 struct storvsc_cmd_request *request, u16 q_num,
+			 u16 hwq)
 {
 	struct storvsc_device *stor_device;
 	struct vstor_packet *vstor_packet;
@@ -1387,6 +1465,17 @@ static int storvsc_do_io(struct hv_device *device,
 
 
 	request->device  = device;
+
+	/*
+	 * Each hardware queue owns one channel and its tag depth fits in the
+	 * ring, so use it as long as the sub-channel has been opened.
+	 */
+	if (hwq <= stor_device->num_sc) {
+		outgoing_channel = READ_ONCE(stor_device->hctx_chns[hwq]);
+		if (outgoing_channel)
+			goto found_channel;
+	}
+
 	/*
 	 * Select an appropriate channel to send the request out.
 	 */
@@ -1508,11 +1597,55 @@ static int storvsc_device_alloc(struct scsi_device *sdevice)
 	 * Hypervisor reports SCSI_UNKNOWN type for DVD ROM device but
 	 * still supports REPORT LUN.
 	 */
+	struct storvsc_lun *lun;
+
 	sdevice->sdev_bflags = BLIST_REPORTLUN2 | BLIST_TRY_VPD_PAGES;
 
+	lun = kzalloc(sizeof(*lun), GFP_KERNEL);
+	if (!lun)
+		return -ENOMEM;
+	lun->batch_completions = true;
+	sdevice->hostdata = lun;
+
 	return 0;
 }
 
+static void storvsc_device_destroy(struct scsi_device *sdevice)
+{
+	kfree(sdevice->hostdata);
+	sdevice->hostdata = NULL;
+}
+
+static ssize_t batch_completions_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct storvsc_lun *lun = to_scsi_device(dev)->hostdata;
+
+	return sprintf(buf, "%d\n", READ_ONCE(lun->batch_completions));
+}
+
+static ssize_t batch_completions_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct storvsc_lun *lun = to_scsi_device(dev)->hostdata;
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	WRITE_ONCE(lun->batch_completions, val);
+	return count;
+}
+static DEVICE_ATTR_RW(batch_completions);
+
+static struct device_attribute *storvsc_sdev_attrs[] = {
+	&dev_attr_batch_completions,
+	NULL,
+};
+
 static int storvsc_device_configure(struct scsi_device *sdevice)
 {
 	blk_queue_rq_timeout(sdevice->request_queue, (storvsc_timeout * HZ));
@@ -1805,7 +1938,9 @@ static int storvsc_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *scmnd)
 	cmd_request->payload_sz = payload_sz;
 
 	/* Invokes the vsc to start an IO */
-	ret = storvsc_do_io(dev, cmd_request, get_cpu());
+	ret = storvsc_do_io(dev, cmd_request, get_cpu(),
+			    blk_mq_unique_tag_to_hwq(
+				blk_mq_unique_tag(scmnd->request)));
 	put_cpu();
 
 	if (ret == -EAGAIN) {
@@ -1818,17 +1953,75 @@ static int storvsc_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *scmnd)
 	return 0;
 }
 
+/*
+ * Map every CPU to the hardware queue whose channel interrupts that CPU, so
+ * that completions arrive where the request was issued. CPUs without a
+ * channel of their own are spread over the channels of their NUMA node.
+ */
+static int storvsc_map_queues(struct Scsi_Host *shost)
+{
+	struct hv_host_device *host_dev = shost_priv(shost);
+	struct blk_mq_queue_map *qmap = &shost->tag_set.map[HCTX_TYPE_DEFAULT];
+	struct storvsc_device *stor_device;
+	struct vmbus_channel *channel;
+	cpumask_var_t mapped;
+	unsigned int cpu, next = 0;
+	int q, ret;
+
+	ret = blk_mq_map_queues(qmap);
+	stor_device = get_out_stor_device(host_dev->dev);
+	if (ret || !stor_device || qmap->nr_queues <= 1)
+		return ret;
+
+	if (!zalloc_cpumask_var(&mapped, GFP_KERNEL))
+		return 0;
+
+	for (q = 0; q < qmap->nr_queues && q <= stor_device->num_sc; q++) {
+		channel = READ_ONCE(stor_device->hctx_chns[q]);
+		if (!channel)
+			continue;
+		qmap->mq_map[channel->target_cpu] = qmap->queue_offset + q;
+		cpumask_set_cpu(channel->target_cpu, mapped);
+	}
+
+	for_each_possible_cpu(cpu) {
+		const struct cpumask *node_mask;
+		int tgt_cpu, nr = 0, pick;
+
+		if (cpumask_test_cpu(cpu, mapped))
+			continue;
+
+		node_mask = cpumask_of_node(cpu_to_node(cpu));
+		for_each_cpu_and(tgt_cpu, mapped, node_mask)
+			nr++;
+		if (!nr)
+			continue;
+
+		pick = next++ % nr;
+		for_each_cpu_and(tgt_cpu, mapped, node_mask)
+			if (pick-- == 0)
+				break;
+		qmap->mq_map[cpu] = qmap->mq_map[tgt_cpu];
+	}
+
+	free_cpumask_var(mapped);
+	return 0;
+}
+
 static struct scsi_host_template scsi_driver = {
 	.module	=		THIS_MODULE,
 	.name =			"storvsc_host_t",
 	.cmd_size =             sizeof(struct storvsc_cmd_request),
 	.bios_param =		storvsc_get_chs,
 	.queuecommand =		storvsc_queuecommand,
+	.map_queues =		storvsc_map_queues,
 	.eh_host_reset_handler =	storvsc_host_reset_handler,
 	.proc_name =		"storvsc_host",
 	.eh_timed_out =		storvsc_eh_timed_out,
 	.slave_alloc =		storvsc_device_alloc,
 	.slave_configure =	storvsc_device_configure,
+	.slave_destroy =	storvsc_device_destroy,
+	.sdev_attrs =		storvsc_sdev_attrs,
 	.cmd_per_lun =		2048,
 	.this_id =		-1,
 	/* Make sure we dont get a sg segment crosses a page boundary */
@@ -1982,10 +2175,14 @@ static int storvsc_probe(struct hv_device *device,
 	host->sg_tablesize = (stor_device->max_transfer_bytes >> PAGE_SHIFT);
 	/*
 	 * For non-IDE disks, the host supports multiple channels.
-	 * Set the number of HW queues we are supporting.
+	 * Use one HW queue per channel, each with the depth that the ring
+	 * of a single channel can take.
 	 */
-	if (!dev_is_ide)
-		host->nr_hw_queues = num_present_cpus();
+	if (!dev_is_ide) {
+		host->nr_hw_queues = stor_device->num_sc + 1;
+		host->can_queue = max_outstanding_req_per_channel *
+				  (100 - ring_avail_percent_lowater) / 100;
+	}
 
 	/*
 	 * Set the error handler work queue.
@@ -2048,6 +2245,7 @@ err_out2:
 
 err_out1:
 	kfree(stor_device->stor_chns);
+	kfree(stor_device->hctx_chns);
 	kfree(stor_device);
 
 err_out0:
@@ -2098,6 +2296,8 @@ static int storvsc_suspend(struct hv_device *hv_dev)
 
 	kfree(stor_device->stor_chns);
 	stor_device->stor_chns = NULL;
+	kfree(stor_device->hctx_chns);
+	stor_device->hctx_chns = NULL;
 
 	cpumask_clear(&stor_device->alloced_cpus);
 
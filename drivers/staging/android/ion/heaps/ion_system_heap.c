@@ -16,7 +16,7 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 
-#include "ion_page_pool.h"
+#include "page_pool.h"
 
 #define NUM_ORDERS ARRAY_SIZE(orders)
 
@@ -43,22 +43,22 @@ static inline unsigned int order_to_size(int order)
 
 struct ion_system_heap {
 	struct ion_heap heap;
-	struct ion_page_pool *pools[NUM_ORDERS];
+	struct dmabuf_page_pool *pools[NUM_ORDERS];
 };
 
 static struct page *alloc_buffer_page(struct ion_system_heap *heap,
 				      struct ion_buffer *buffer,
 				      unsigned long order)
 {
-	struct ion_page_pool *pool = heap->pools[order_to_index(order)];
+	struct dmabuf_page_pool *pool = heap->pools[order_to_index(order)];
 
-	return ion_page_pool_alloc(pool);
+	return dmabuf_page_pool_alloc(pool);
 }
 
 static void free_buffer_page(struct ion_system_heap *heap,
 			     struct ion_buffer *buffer, struct page *page)
 {
-	struct ion_page_pool *pool;
+	struct dmabuf_page_pool *pool;
 	unsigned int order = compound_order(page);
 
 	/* go to system */
@@ -69,7 +69,7 @@ static void free_buffer_page(struct ion_system_heap *heap,
 
 	pool = heap->pools[order_to_index(order)];
 
-	ion_page_pool_free(pool, page);
+	dmabuf_page_pool_free(pool, page);
 }
 
 static struct page *alloc_largest_available(struct ion_system_heap *heap,
@@ -173,75 +173,47 @@ static void ion_system_heap_free(struct ion_buffer *buffer)
 	kfree(table);
 }
 
-static int ion_system_heap_shrink(struct ion_heap *heap, gfp_t gfp_mask,
-				  int nr_to_scan)
-{
-	struct ion_page_pool *pool;
-	struct ion_system_heap *sys_heap;
-	int nr_total = 0;
-	int i, nr_freed;
-	int only_scan = 0;
-
-	sys_heap = container_of(heap, struct ion_system_heap, heap);
-
-	if (!nr_to_scan)
-		only_scan = 1;
-
-	for (i = 0; i < NUM_ORDERS; i++) {
-		pool = sys_heap->pools[i];
-
-		if (only_scan) {
-			nr_total += ion_page_pool_shrink(pool,
-							 gfp_mask,
-							 nr_to_scan);
-
-		} else {
-			nr_freed = ion_page_pool_shrink(pool,
-							gfp_mask,
-							nr_to_scan);
-			nr_to_scan -= nr_freed;
-			nr_total += nr_freed;
-			if (nr_to_scan <= 0)
-				break;
-		}
-	}
-	return nr_total;
-}
-
+/*
+ * The pools are shared with the dma-buf system heap and reclaimed by the
+ * page pool shrinker, so there is no shrink op.
+ */
 static long ion_system_get_pool_size(struct ion_heap *heap)
 {
+	struct dmabuf_page_pool_stats stats;
 	struct ion_system_heap *sys_heap;
 	long total_pages = 0;
 	int i;
 
 	sys_heap = container_of(heap, struct ion_system_heap, heap);
-	for (i = 0; i < NUM_ORDERS; i++)
-		total_pages += ion_page_pool_nr_pages(sys_heap->pools[i]);
+	for (i = 0; i < NUM_ORDERS; i++) {
+		dmabuf_page_pool_get_stats(sys_heap->pools[i], &stats);
+		total_pages += (long)stats.count << orders[i];
+	}
 
 	return total_pages;
 }
 
-static void ion_system_heap_destroy_pools(struct ion_page_pool **pools)
+static void ion_system_heap_destroy_pools(struct dmabuf_page_pool **pools)
 {
 	int i;
 
 	for (i = 0; i < NUM_ORDERS; i++)
 		if (pools[i])
-			ion_page_pool_destroy(pools[i]);
+			dmabuf_page_pool_destroy(pools[i]);
 }
 
-static int ion_system_heap_create_pools(struct ion_page_pool **pools)
+static int ion_system_heap_create_pools(struct dmabuf_page_pool **pools)
 {
 	int i;
 
 	for (i = 0; i < NUM_ORDERS; i++) {
-		struct ion_page_pool *pool;
+		struct dmabuf_page_pool *pool;
 		gfp_t gfp_flags = low_order_gfp_flags;
 
 		if (orders[i] > 4)
 			gfp_flags = high_order_gfp_flags;
 
-		pool = ion_page_pool_create(gfp_flags, orders[i]);
+		pool = dmabuf_page_pool_create(gfp_flags, orders[i]);
 		if (!pool)
 			goto err_create_pool;
 		pools[i] = pool;
@@ -257,7 +229,6 @@ err_create_pool:
 static struct ion_heap_ops system_heap_ops = {
 	.allocate = ion_system_heap_allocate,
 	.free = ion_system_heap_free,
-	.shrink = ion_system_heap_shrink,
 	.get_pool_size = ion_system_get_pool_size,
 };
 
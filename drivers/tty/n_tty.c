@@ -45,6 +45,7 @@
 #include <linux/bitops.h>
 #include <linux/audit.h>
 #include <linux/file.h>
+#include <linux/hrtimer.h>
 #include <linux/uaccess.h>
 #include <linux/module.h>
 #include <linux/ratelimit.h>
@@ -64,6 +65,19 @@
 #define TTY_THRESHOLD_THROTTLE		128 /* now based on remaining room */
 #define TTY_THRESHOLD_UNTHROTTLE	128
 
+/*
+ * Readers of a raw tty are woken once rx_batch_bytes are queued, or
+ * rx_batch_usecs after the first bytes arrived, rather than on every flip
+ * buffer push. Batching is off while rx_batch_bytes is 0.
+ */
+static unsigned int rx_batch_bytes;
+module_param(rx_batch_bytes, uint, 0644);
+MODULE_PARM_DESC(rx_batch_bytes, "Queued bytes waking up raw mode readers (0 = every push)");
+
+static unsigned int rx_batch_usecs = 1000;
+module_param(rx_batch_usecs, uint, 0644);
+MODULE_PARM_DESC(rx_batch_usecs, "Longest delay of a batched raw mode wakeup in us");
+
 /*
  * Special byte codes used in the echo buffer to represent operations
  * or special handling of characters.  Bytes in the echo buffer that
@@ -104,6 +118,10 @@ struct n_tty_data {
 	/* non-atomic */
 	bool no_room;
 
+	/* batched reader wakeups in raw mode */
+	struct hrtimer rx_wakeup;
+	struct tty_struct *tty;
+
 	/* must hold exclusive termios_rwsem to reset these */
 	unsigned char lnext:1, erasing:1, raw:1, real_raw:1, icanon:1;
 	unsigned char push:1;
@@ -1529,6 +1547,12 @@ n_tty_receive_buf_raw(struct tty_struct *tty, const unsigned char *cp,
 	struct n_tty_data *ldata = tty->disc_data;
 	char flag = TTY_NORMAL;
 
+	/* without flags every char is queued as is */
+	if (!fp) {
+		n_tty_receive_buf_real_raw(tty, cp, fp, count);
+		return;
+	}
+
 	while (count--) {
 		if (fp)
 			flag = *fp++;
@@ -1613,6 +1637,39 @@ n_tty_receive_buf_fast(struct tty_struct *tty, const unsigned char *cp,
 	}
 }
 
+static void n_tty_wakeup_readers(struct tty_struct *tty)
+{
+	kill_fasync(&tty->fasync, SIGIO, POLL_IN);
+	wake_up_interruptible_poll(&tty->read_wait, EPOLLIN);
+}
+
+static enum hrtimer_restart n_tty_rx_wakeup(struct hrtimer *timer)
+{
+	struct n_tty_data *ldata = container_of(timer, struct n_tty_data,
+						rx_wakeup);
+
+	n_tty_wakeup_readers(ldata->tty);
+	return HRTIMER_NORESTART;
+}
+
+/* Returns true if waking up the readers is left to the batch timer */
+static bool n_tty_batch_wakeup(struct tty_struct *tty)
+{
+	struct n_tty_data *ldata = tty->disc_data;
+	size_t bytes = READ_ONCE(rx_batch_bytes);
+
+	if (!bytes || read_cnt(ldata) >= min_t(size_t, bytes,
+					       N_TTY_BUF_SIZE / 2))
+		return false;
+
+	/* a timer that is firing may have missed the bytes just published */
+	if (!hrtimer_is_queued(&ldata->rx_wakeup))
+		hrtimer_start(&ldata->rx_wakeup,
+			      us_to_ktime(READ_ONCE(rx_batch_usecs)),
+			      HRTIMER_MODE_REL_SOFT);
+	return true;
+}
+
 static void __receive_buf(struct tty_struct *tty, const unsigned char *cp,
 			  char *fp, int count)
 {
@@ -1651,10 +1708,8 @@ static void __receive_buf(struct tty_struct *tty, const unsigned char *cp,
 	/* publish read_head to consumer */
 	smp_store_release(&ldata->commit_head, ldata->read_head);
 
-	if (read_cnt(ldata)) {
-		kill_fasync(&tty->fasync, SIGIO, POLL_IN);
-		wake_up_interruptible_poll(&tty->read_wait, EPOLLIN);
-	}
+	if (read_cnt(ldata) && !(ldata->raw && n_tty_batch_wakeup(tty)))
+		n_tty_wakeup_readers(tty);
 }
 
 /**
@@ -1887,6 +1942,7 @@ static void n_tty_close(struct tty_struct *tty)
 	if (tty->link)
 		n_tty_packet_mode_flush(tty);
 
+	hrtimer_cancel(&ldata->rx_wakeup);
 	vfree(ldata);
 	tty->disc_data = NULL;
 }
@@ -1913,6 +1969,9 @@ static int n_tty_open(struct tty_struct *tty)
 	ldata->overrun_time = jiffies;
 	mutex_init(&ldata->atomic_read_lock);
 	mutex_init(&ldata->output_lock);
+	hrtimer_init(&ldata->rx_wakeup, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	ldata->rx_wakeup.function = n_tty_rx_wakeup;
+	ldata->tty = tty;
 
 	tty->disc_data = ldata;
 	tty->closing = 0;
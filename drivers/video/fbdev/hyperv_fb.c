@@ -54,8 +54,11 @@
 #include <linux/pci.h>
 #include <linux/efi.h>
 #include <linux/console.h>
+#include <linux/compat.h>
+#include <linux/uaccess.h>
 
 #include <linux/hyperv.h>
+#include <uapi/linux/hyperv_fb.h>
 
 
 /* Hyper-V Synthetic Video Protocol definitions and structures */
@@ -213,10 +216,12 @@ struct rect {
 	s32 x2, y2; /* bottom right corner, exclusive */
 } __packed;
 
+#define SYNTHVID_DIRT_MAX 16
+
 struct synthvid_dirt {
 	u8 video_output;
 	u8 dirt_count;
-	struct rect rect[1];
+	struct rect rect[SYNTHVID_DIRT_MAX];
 } __packed;
 
 struct synthvid_msg {
@@ -278,8 +283,9 @@ struct hvfb_par {
 	unsigned char *mmio_vp;
 	phys_addr_t mmio_pp;
 
-	/* Dirty rectangle, protected by delayed_refresh_lock */
-	int x1, y1, x2, y2;
+	/* Dirty rectangles, protected by delayed_refresh_lock */
+	struct rect damage[SYNTHVID_DIRT_MAX];
+	int damage_count;
 	bool delayed_refresh;
 	spinlock_t delayed_refresh_lock;
 };
@@ -376,36 +382,124 @@ static int synthvid_send_ptr(struct hv_device *hdev)
 	return 0;
 }
 
-/* Send updated screen area (dirty rectangle) location to host */
+/* Send a list of updated screen areas (dirty rectangles) to host */
 static int
-synthvid_update(struct fb_info *info, int x1, int y1, int x2, int y2)
+synthvid_update_rects(struct fb_info *info, const struct rect *rects,
+		      int count)
 {
 	struct hv_device *hdev = device_to_hv_device(info->device);
 	struct synthvid_msg msg;
 
-	memset(&msg, 0, sizeof(struct synthvid_msg));
-	if (x2 == INT_MAX)
-		x2 = info->var.xres;
-	if (y2 == INT_MAX)
-		y2 = info->var.yres;
+	if (count <= 0)
+		return 0;
 
+	memset(&msg, 0, sizeof(struct synthvid_msg));
 	msg.vid_hdr.type = SYNTHVID_DIRT;
 	msg.vid_hdr.size = sizeof(struct synthvid_msg_hdr) +
-		sizeof(struct synthvid_dirt);
+		offsetof(struct synthvid_dirt, rect) +
+		count * sizeof(struct rect);
 	msg.dirt.video_output = 0;
-	msg.dirt.dirt_count = 1;
-	msg.dirt.rect[0].x1 = (x1 > x2) ? 0 : x1;
-	msg.dirt.rect[0].y1 = (y1 > y2) ? 0 : y1;
-	msg.dirt.rect[0].x2 =
-		(x2 < x1 || x2 > info->var.xres) ? info->var.xres : x2;
-	msg.dirt.rect[0].y2 =
-		(y2 < y1 || y2 > info->var.yres) ? info->var.yres : y2;
+	msg.dirt.dirt_count = count;
+	memcpy(msg.dirt.rect, rects, count * sizeof(struct rect));
 
 	synthvid_send(hdev, &msg);
 
 	return 0;
 }
 
+/* Send updated screen area (dirty rectangle) location to host */
+static int
+synthvid_update(struct fb_info *info, int x1, int y1, int x2, int y2)
+{
+	struct rect rect;
+
+	if (x2 == INT_MAX)
+		x2 = info->var.xres;
+	if (y2 == INT_MAX)
+		y2 = info->var.yres;
+
+	rect.x1 = (x1 > x2) ? 0 : x1;
+	rect.y1 = (y1 > y2) ? 0 : y1;
+	rect.x2 = (x2 < x1 || x2 > info->var.xres) ? info->var.xres : x2;
+	rect.y2 = (y2 < y1 || y2 > info->var.yres) ? info->var.yres : y2;
+
+	return synthvid_update_rects(info, &rect, 1);
+}
+
+static bool hvfb_rect_touch(const struct rect *a, const struct rect *b)
+{
+	return a->x1 <= b->x2 && b->x1 <= a->x2 &&
+	       a->y1 <= b->y2 && b->y1 <= a->y2;
+}
+
+static void hvfb_rect_union(struct rect *a, const struct rect *b)
+{
+	a->x1 = min(a->x1, b->x1);
+	a->y1 = min(a->y1, b->y1);
+	a->x2 = max(a->x2, b->x2);
+	a->y2 = max(a->y2, b->y2);
+}
+
+static u64 hvfb_rect_area(const struct rect *r)
+{
+	return (u64)(r->x2 - r->x1) * (r->y2 - r->y1);
+}
+
+/*
+ * Add the rectangle (x1, y1) - (x2, y2) to a damage list of at most
+ * SYNTHVID_DIRT_MAX entries. The rectangle is clipped to the visible
+ * screen, then merged with every entry it overlaps or touches, so the
+ * list only ever holds disjoint areas. When the list is full, the new
+ * rectangle is folded into the entry whose area grows the least.
+ */
+static void hvfb_damage_add(struct fb_info *info, struct rect *list,
+			    int *count, int x1, int y1, int x2, int y2)
+{
+	struct rect r, u;
+	u64 cost, best_cost;
+	int i, best;
+
+	r.x1 = clamp_t(int, x1, 0, info->var.xres);
+	r.y1 = clamp_t(int, y1, 0, info->var.yres);
+	r.x2 = clamp_t(int, x2, 0, info->var.xres);
+	r.y2 = clamp_t(int, y2, 0, info->var.yres);
+	if (r.x2 <= r.x1 || r.y2 <= r.y1)
+		return;
+
+	for (;;) {
+		i = 0;
+		while (i < *count) {
+			if (!hvfb_rect_touch(&list[i], &r)) {
+				i++;
+				continue;
+			}
+			/* The union may now reach entries already checked */
+			hvfb_rect_union(&r, &list[i]);
+			list[i] = list[--(*count)];
+			i = 0;
+		}
+
+		if (*count < SYNTHVID_DIRT_MAX)
+			break;
+
+		best = 0;
+		best_cost = U64_MAX;
+		for (i = 0; i < *count; i++) {
+			u = list[i];
+			hvfb_rect_union(&u, &r);
+			cost = hvfb_rect_area(&u) - hvfb_rect_area(&list[i]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best = i;
+			}
+		}
+		hvfb_rect_union(&r, &list[best]);
+		list[best] = list[--(*count)];
+	}
+
+	list[(*count)++] = r;
+}
+
 static void hvfb_docopy(struct hvfb_par *par,
 			unsigned long offset,
 			unsigned long size)
@@ -425,24 +519,34 @@ static void synthvid_deferred_io(struct fb_info *p,
 				 struct list_head *pagelist)
 {
 	struct hvfb_par *par = p->par;
+	struct rect damage[SYNTHVID_DIRT_MAX];
+	int damage_count = 0;
 	struct page *page;
 	unsigned long start, end;
 	int y1, y2, miny, maxy;
 
 	miny = INT_MAX;
-	maxy = 0;
+	maxy = -1;
 
 	/*
-	 * Merge dirty pages. It is possible that last page cross
-	 * over the end of frame buffer row yres. This is taken care of
-	 * in synthvid_update function by clamping the y2
-	 * value to yres.
+	 * The page list is sorted by index. Merge each run of adjacent
+	 * dirty pages into one band of rows, so that writes to distant
+	 * parts of the screen are reported as separate rectangles. It is
+	 * possible that last page cross over the end of frame buffer row
+	 * yres. This is taken care of in hvfb_damage_add by clamping the
+	 * y2 value to yres.
 	 */
 	list_for_each_entry(page, pagelist, lru) {
 		start = page->index << PAGE_SHIFT;
 		end = start + PAGE_SIZE - 1;
 		y1 = start / p->fix.line_length;
 		y2 = end / p->fix.line_length;
+		if (y1 > maxy + 1) {
+			if (maxy >= 0)
+				hvfb_damage_add(p, damage, &damage_count,
+						0, miny, p->var.xres, maxy + 1);
+			miny = y1;
+		}
 		miny = min_t(int, miny, y1);
 		maxy = max_t(int, maxy, y2);
 
@@ -451,8 +555,12 @@ static void synthvid_deferred_io(struct fb_info *p,
 			hvfb_docopy(par, start, PAGE_SIZE);
 	}
 
+	if (maxy >= 0)
+		hvfb_damage_add(p, damage, &damage_count,
+				0, miny, p->var.xres, maxy + 1);
+
 	if (par->fb_ready && par->update)
-		synthvid_update(p, 0, miny, p->var.xres, maxy + 1);
+		synthvid_update_rects(p, damage, damage_count);
 }
 
 static struct fb_deferred_io synthvid_defio = {
@@ -739,41 +847,48 @@ static void hvfb_update_work(struct work_struct *w)
 {
 	struct hvfb_par *par = container_of(w, struct hvfb_par, dwork.work);
 	struct fb_info *info = par->info;
+	struct rect damage[SYNTHVID_DIRT_MAX];
+	struct rect *r;
 	unsigned long flags;
-	int x1, x2, y1, y2;
-	int j;
+	int count, i, j;
 
 	spin_lock_irqsave(&par->delayed_refresh_lock, flags);
 	/* Reset the request flag */
 	par->delayed_refresh = false;
 
-	/* Store the dirty rectangle to local variables */
-	x1 = par->x1;
-	x2 = par->x2;
-	y1 = par->y1;
-	y2 = par->y2;
+	/* Store the dirty rectangles to local variables */
+	count = par->damage_count;
+	memcpy(damage, par->damage, count * sizeof(struct rect));
 
-	/* Clear dirty rectangle */
-	par->x1 = par->y1 = INT_MAX;
-	par->x2 = par->y2 = 0;
+	/* Clear dirty rectangles */
+	par->damage_count = 0;
 
 	spin_unlock_irqrestore(&par->delayed_refresh_lock, flags);
 
-	if (x1 > info->var.xres || x2 > info->var.xres ||
-	    y1 > info->var.yres || y2 > info->var.yres || x2 <= x1)
-		return;
+	for (i = 0; i < count; i++) {
+		r = &damage[i];
 
-	/* Copy the dirty rectangle to frame buffer memory */
-	if (par->need_docopy)
-		for (j = y1; j < y2; j++)
-			hvfb_docopy(par,
-				    j * info->fix.line_length +
-				    (x1 * screen_depth / 8),
-				    (x2 - x1) * screen_depth / 8);
+		/* The mode may have changed since the damage was recorded */
+		r->x2 = min_t(int, r->x2, info->var.xres);
+		r->y2 = min_t(int, r->y2, info->var.yres);
+		if (r->x2 <= r->x1 || r->y2 <= r->y1) {
+			*r = damage[--count];
+			i--;
+			continue;
+		}
+
+		/* Copy the dirty rectangle to frame buffer memory */
+		if (par->need_docopy)
+			for (j = r->y1; j < r->y2; j++)
+				hvfb_docopy(par,
+					    j * info->fix.line_length +
+					    (r->x1 * screen_depth / 8),
+					    (r->x2 - r->x1) * screen_depth / 8);
+	}
 
 	/* Refresh */
 	if (par->fb_ready && par->update)
-		synthvid_update(info, x1, y1, x2, y2);
+		synthvid_update_rects(info, damage, count);
 }
 
 /*
@@ -784,16 +899,12 @@ static void hvfb_ondemand_refresh_throttle(struct hvfb_par *par,
 					   int x1, int y1, int w, int h)
 {
 	unsigned long flags;
-	int x2 = x1 + w;
-	int y2 = y1 + h;
 
 	spin_lock_irqsave(&par->delayed_refresh_lock, flags);
 
 	/* Merge dirty rectangle */
-	par->x1 = min_t(int, par->x1, x1);
-	par->y1 = min_t(int, par->y1, y1);
-	par->x2 = max_t(int, par->x2, x2);
-	par->y2 = max_t(int, par->y2, y2);
+	hvfb_damage_add(par->info, par->damage, &par->damage_count,
+			x1, y1, x1 + w, y1 + h);
 
 	/* Schedule a delayed screen update if not yet */
 	if (par->delayed_refresh == false) {
@@ -909,6 +1020,66 @@ static void hvfb_cfb_imageblit(struct fb_info *p,
 					       image->width, image->height);
 }
 
+/* Merge a user supplied damage list into the pending refresh */
+static int hvfb_ioctl_damage(struct fb_info *info,
+			     struct hvfb_damage __user *udamage)
+{
+	struct hvfb_par *par = info->par;
+	struct hvfb_damage_rect __user *urects;
+	struct hvfb_damage_rect rect;
+	struct hvfb_damage damage;
+	u32 i;
+
+	if (copy_from_user(&damage, udamage, sizeof(damage)))
+		return -EFAULT;
+
+	if (damage.reserved || damage.count > HVFB_DAMAGE_RECTS_MAX)
+		return -EINVAL;
+
+	urects = u64_to_user_ptr(damage.rects);
+	for (i = 0; i < damage.count; i++) {
+		if (copy_from_user(&rect, &urects[i], sizeof(rect)))
+			return -EFAULT;
+
+		if (rect.x >= info->var.xres || rect.y >= info->var.yres ||
+		    !rect.width || !rect.height)
+			continue;
+
+		rect.width = min(rect.width, info->var.xres - rect.x);
+		rect.height = min(rect.height, info->var.yres - rect.y);
+
+		if (par->synchronous_fb)
+			synthvid_update(info, rect.x, rect.y,
+					rect.x + rect.width,
+					rect.y + rect.height);
+		else
+			hvfb_ondemand_refresh_throttle(par, rect.x, rect.y,
+						       rect.width,
+						       rect.height);
+	}
+
+	return 0;
+}
+
+static int hvfb_ioctl(struct fb_info *info, unsigned int cmd,
+		      unsigned long arg)
+{
+	switch (cmd) {
+	case HVFB_IOC_DAMAGE:
+		return hvfb_ioctl_damage(info, (void __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+static int hvfb_compat_ioctl(struct fb_info *info, unsigned int cmd,
+			     unsigned long arg)
+{
+	return hvfb_ioctl(info, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
 static const struct fb_ops hvfb_ops = {
 	.owner = THIS_MODULE,
 	.fb_check_var = hvfb_check_var,
@@ -918,6 +1089,10 @@ static const struct fb_ops hvfb_ops = {
 	.fb_copyarea = hvfb_cfb_copyarea,
 	.fb_imageblit = hvfb_cfb_imageblit,
 	.fb_blank = hvfb_blank,
+	.fb_ioctl = hvfb_ioctl,
+#ifdef CONFIG_COMPAT
+	.fb_compat_ioctl = hvfb_compat_ioctl,
+#endif
 };
 
 
@@ -1181,8 +1356,7 @@ static int hvfb_probe(struct hv_device *hdev,
 
 	par->delayed_refresh = false;
 	spin_lock_init(&par->delayed_refresh_lock);
-	par->x1 = par->y1 = INT_MAX;
-	par->x2 = par->y2 = 0;
+	par->damage_count = 0;
 
 	/* Connect to VSP */
 	hv_set_drvdata(hdev, info);
@@ -149,8 +149,9 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
-	 * single linked chain of items.
+	 * Works together "struct eventpoll"->ovflist, or with the per-CPU
+	 * ready chains outside of a scan, in keeping the single linked chain
+	 * of items.
 	 */
 	struct epitem *next;
 
@@ -212,6 +213,23 @@ struct eventpoll {
 	 */
 	struct epitem *ovflist;
 
+	/*
+	 * Per-CPU single linked chains of items that became ready outside of
+	 * a scan. They are spliced into ->rdllist under the write lock by
+	 * ep_pcp_merge(), so ep_poll_callback() never touches ->rdllist.
+	 */
+	struct epitem * __percpu *pcp_ready;
+
+	/* Set once any of the ->pcp_ready chains is non-empty */
+	int pcp_pending;
+
+	/*
+	 * Set when an EPOLLEXCLUSIVE wakeup has been issued and the woken
+	 * waiter has not yet started to harvest events. Further exclusive
+	 * wakeups are coalesced into that one.
+	 */
+	unsigned int wake_pending;
+
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
 
@@ -378,7 +396,38 @@ static void ep_nested_calls_init(struct nested_calls *ncalls)
 static inline int ep_events_available(struct eventpoll *ep)
 {
 	return !list_empty_careful(&ep->rdllist) ||
-		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR ||
+		READ_ONCE(ep->pcp_pending);
+}
+
+/*
+ * Splices the per-CPU ready chains into ->rdllist. Must be called with
+ * ep->lock held for writing, which keeps ep_poll_callback() away from the
+ * chains. Each chain is LIFO, so it is reversed to keep the items of one
+ * CPU in FIFO order.
+ */
+static void ep_pcp_merge(struct eventpoll *ep)
+{
+	struct epitem *epi, *nepi;
+	int cpu;
+
+	if (!READ_ONCE(ep->pcp_pending))
+		return;
+	WRITE_ONCE(ep->pcp_pending, 0);
+
+	for_each_possible_cpu(cpu) {
+		struct epitem **head = per_cpu_ptr(ep->pcp_ready, cpu);
+		LIST_HEAD(batch);
+
+		for (nepi = *head; (epi = nepi) != NULL;
+		     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
+			/* ep_modify() may have linked it in the meantime */
+			if (!ep_is_linked(epi))
+				list_add(&epi->rdllink, &batch);
+		}
+		*head = NULL;
+		list_splice_tail(&batch, &ep->rdllist);
+	}
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
@@ -705,6 +754,7 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 	 * in a lockless way.
 	 */
 	write_lock_irq(&ep->lock);
+	ep_pcp_merge(ep);
 	list_splice_init(&ep->rdllist, &txlist);
 	WRITE_ONCE(ep->ovflist, NULL);
 	write_unlock_irq(&ep->lock);
@@ -751,8 +801,10 @@ static __poll_t ep_scan_ready_list(struct eventpoll *ep,
 	__pm_relax(ep->ws);
 
 	if (!list_empty(&ep->rdllist)) {
-		if (waitqueue_active(&ep->wq))
+		if (waitqueue_active(&ep->wq)) {
+			WRITE_ONCE(ep->wake_pending, 1);
 			wake_up(&ep->wq);
+		}
 	}
 
 	write_unlock_irq(&ep->lock);
@@ -792,6 +844,9 @@ static int ep_remove(struct eventpoll *ep, struct epitem *epi)
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
 	write_lock_irq(&ep->lock);
+	/* Callers hold "mtx", so a chained item sits on a per-CPU chain */
+	if (epi->next != EP_UNACTIVE_PTR)
+		ep_pcp_merge(ep);
 	if (ep_is_linked(epi))
 		list_del_init(&epi->rdllink);
 	write_unlock_irq(&ep->lock);
@@ -860,6 +915,7 @@ static void ep_free(struct eventpoll *ep)
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
+	free_percpu(ep->pcp_ready);
 	kfree(ep);
 }
 
@@ -1024,6 +1080,10 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		goto free_uid;
 
+	ep->pcp_ready = alloc_percpu(struct epitem *);
+	if (unlikely(!ep->pcp_ready))
+		goto free_ep;
+
 	mutex_init(&ep->mtx);
 	rwlock_init(&ep->lock);
 	init_waitqueue_head(&ep->wq);
@@ -1037,6 +1097,8 @@ static int ep_alloc(struct eventpoll **pep)
 
 	return 0;
 
+free_ep:
+	kfree(ep);
 free_uid:
 	free_uid(user);
 	return error;
@@ -1116,54 +1178,34 @@ struct file *get_epoll_tfile_raw_ptr(struct file *file, int tfd,
 #endif /* CONFIG_KCMP */
 
 /**
- * Adds a new entry to the tail of the list in a lockless way, i.e.
- * multiple CPUs are allowed to call this function concurrently.
- *
- * Beware: it is necessary to prevent any other modifications of the
- *         existing list until all changes are completed, in other words
- *         concurrent list_add_tail_lockless() calls should be protected
- *         with a read lock, where write lock acts as a barrier which
- *         makes sure all list_add_tail_lockless() calls are fully
- *         completed.
+ * Chains a ready epi entry to the per-CPU ready chain of the current CPU.
+ * ep_poll_callback() runs with ep->lock held for reading and interrupts
+ * disabled, and ep_pcp_merge() holds the lock for writing, so nobody else
+ * can touch this CPU's chain meanwhile. The cmpxchg() on epi->next still
+ * detects the same epi being chained from another CPU, exactly like
+ * chain_epi_lockless() does for ->ovflist.
  *
- *        Also an element can be locklessly added to the list only in one
- *        direction i.e. either to the tail either to the head, otherwise
- *        concurrent access will corrupt the list.
- *
- * Returns %false if element has been already added to the list, %true
- * otherwise.
+ * Returns %false if epi element has been already chained, %true otherwise.
  */
-static inline bool list_add_tail_lockless(struct list_head *new,
-					  struct list_head *head)
+static inline bool chain_epi_pcp(struct epitem *epi)
 {
-	struct list_head *prev;
+	struct eventpoll *ep = epi->ep;
+	struct epitem **head;
 
-	/*
-	 * This is simple 'new->next = head' operation, but cmpxchg()
-	 * is used in order to detect that same element has been just
-	 * added to the list from another CPU: the winner observes
-	 * new->next == new.
-	 */
-	if (cmpxchg(&new->next, new, head) != new)
+	/* Fast preliminary check */
+	if (epi->next != EP_UNACTIVE_PTR)
 		return false;
 
-	/*
-	 * Initially ->next of a new element must be updated with the head
-	 * (we are inserting to the tail) and only then pointers are atomically
-	 * exchanged.  XCHG guarantees memory ordering, thus ->next should be
-	 * updated before pointers are actually swapped and pointers are
-	 * swapped before prev->next is updated.
-	 */
-
-	prev = xchg(&head->prev, new);
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
 
-	/*
-	 * It is safe to modify prev->next and new->prev, because a new element
-	 * is added only to the tail and new->next is updated before XCHG.
-	 */
+	head = this_cpu_ptr(ep->pcp_ready);
+	epi->next = *head;
+	*head = epi;
 
-	prev->next = new;
-	new->prev = prev;
+	/* Only the first item of a batch dirties the shared cacheline */
+	if (!epi->next && !READ_ONCE(ep->pcp_pending))
+		WRITE_ONCE(ep->pcp_pending, 1);
 
 	return true;
 }
@@ -1198,10 +1240,14 @@ static inline bool chain_epi_lockless(struct epitem *epi)
  * have events to report.
  *
  * This callback takes a read lock in order not to content with concurrent
- * events from another file descriptors, thus all modifications to ->rdllist
- * or ->ovflist are lockless.  Read lock is paired with the write lock from
- * ep_scan_ready_list(), which stops all list modifications and guarantees
- * that lists state is seen correctly.
+ * events from another file descriptors, thus all modifications to the
+ * per-CPU ready chains or ->ovflist are lockless.  Read lock is paired with
+ * the write lock from ep_scan_ready_list(), which stops all list
+ * modifications and guarantees that lists state is seen correctly.
+ *
+ * Ready items are not appended to ->rdllist directly: that would make every
+ * CPU signalling an event bounce the list head. They go to the chain of the
+ * local CPU instead, and the chains are merged when events are harvested.
  *
  * Another thing worth to mention is that ep_poll_callback() can be called
  * concurrently for the same @epi from different CPUs if poll table was inited
@@ -1251,8 +1297,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 		if (chain_epi_lockless(epi))
 			ep_pm_stay_awake_rcu(epi);
 	} else if (!ep_is_linked(epi)) {
-		/* In the usual case, add event to ready list. */
-		if (list_add_tail_lockless(&epi->rdllink, &ep->rdllist))
+		/* In the usual case, add event to this CPU's ready chain. */
+		if (chain_epi_pcp(epi))
 			ep_pm_stay_awake_rcu(epi);
 	}
 
@@ -1261,6 +1307,8 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq)) {
+		bool coalesced = false;
+
 		if ((epi->event.events & EPOLLEXCLUSIVE) &&
 					!(pollflags & POLLFREE)) {
 			switch (pollflags & EPOLLINOUT_BITS) {
@@ -1276,8 +1324,15 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 				ewake = 1;
 				break;
 			}
+			/*
+			 * A waiter has already been woken and has not started
+			 * harvesting yet; it will pick this event up as well,
+			 * so there is no point in waking another one.
+			 */
+			coalesced = xchg(&ep->wake_pending, 1);
 		}
-		wake_up(&ep->wq);
+		if (!coalesced)
+			wake_up(&ep->wq);
 	}
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
@@ -1614,9 +1669,12 @@ error_remove_epi:
 	 * We need to do this because an event could have been arrived on some
 	 * allocated wait queue. Note that we don't care about the ep->ovflist
 	 * list, since that is used/cleaned only inside a section bound by "mtx".
-	 * And ep_insert() is called with "mtx" held.
+	 * And ep_insert() is called with "mtx" held. The per-CPU ready
+	 * chains are not bound by "mtx" though, so flush them first.
 	 */
 	write_lock_irq(&ep->lock);
+	if (epi->next != EP_UNACTIVE_PTR)
+		ep_pcp_merge(ep);
 	if (ep_is_linked(epi))
 		list_del_init(&epi->rdllink);
 	write_unlock_irq(&ep->lock);
@@ -1945,14 +2003,23 @@ fetch_events:
 	}
 
 send_events:
+	/*
+	 * We are about to harvest, so events arriving from now on need a
+	 * wakeup of their own. The xchg() orders the clear before the scan.
+	 */
+	if (READ_ONCE(ep->wake_pending))
+		xchg(&ep->wake_pending, 0);
+
 	if (fatal_signal_pending(current)) {
 		/*
 		 * Always short-circuit for fatal signals to allow
 		 * threads to make a timely exit without the chance of
 		 * finding more events available and fetching
-		 * repeatedly.
+		 * repeatedly. Pass a possibly coalesced wakeup on.
 		 */
 		res = -EINTR;
+		if (ep_events_available(ep) && waitqueue_active(&ep->wq))
+			wake_up(&ep->wq);
 	}
 	/*
 	 * Try to transfer events to user space. In case we get 0 events and
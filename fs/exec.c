@@ -1134,6 +1134,7 @@ static int de_thread(struct task_struct *tsk)
 
 		tsk->group_leader = tsk;
 		leader->group_leader = tsk;
+		oom_bucket_replace(leader, tsk);
 
 		tsk->exit_signal = SIGCHLD;
 		leader->exit_signal = -1;
@@ -1529,9 +1529,15 @@ struct ext4_sb_info {
 	unsigned int s_mb_group_prealloc;
 	unsigned int s_mb_max_inode_prealloc;
 	unsigned int s_max_dir_size_kb;
-	/* where last allocation was done - for stream allocation */
-	unsigned long s_mb_last_group;
-	unsigned long s_mb_last_start;
+	unsigned int s_mb_optimize_scan;
+	/* where last allocation was done on each cpu - for stream allocation */
+	struct ext4_mb_goal __percpu *s_mb_last_goal;
+	/*
+	 * Initialized groups indexed by bb_largest_free_order, so that
+	 * cr=0 can go straight to a group with a large enough free extent.
+	 */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 	unsigned int s_mb_prefetch;
 	unsigned int s_mb_prefetch_limit;
 
@@ -1543,6 +1549,7 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_cr0_indexed;	/* 2^order hits found via the index */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1623,6 +1630,17 @@ struct ext4_sb_info {
 	/* Ext4 fast commit stuff */
 	atomic_t s_fc_subtid;
 	atomic_t s_fc_ineligible_updates;
+	/*
+	 * Group commit: s_fc_seq counts the fast commits that have been
+	 * started, s_fc_done is the sequence of the last one that completed
+	 * successfully. An fsync is covered by any commit that started after
+	 * it arrived, so callers that queue up behind an ongoing commit can
+	 * share the next one instead of each writing their own.
+	 */
+	atomic_t s_fc_seq;
+	int s_fc_done;
+	pid_t s_fc_last_sync_pid;
+	ktime_t s_fc_last_commit;
 	/*
 	 * After commit starts, the main queue gets locked, and the further
 	 * updates get added in the staging queue.
@@ -3329,6 +3347,8 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
+	struct		list_head bb_largest_free_order_node;
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
@@ -1069,18 +1069,52 @@ out:
 	return ret;
 }
 
+/*
+ * Give other fsync callers a chance to join the fast commit we are about to
+ * write, the same way jbd2_journal_stop() batches synchronous handles. We
+ * only wait if the previous fast commit was done on behalf of a different
+ * process and finished less than an average commit time ago, i.e. when
+ * several processes are fsyncing back to back. A single process doing a
+ * stream of fsyncs never waits. Setting max_batch_time to 0 disables this.
+ */
+static void ext4_fc_batch_wait(journal_t *journal, struct ext4_sb_info *sbi)
+{
+	pid_t pid = current->pid;
+	u64 commit_time, since;
+
+	if (!journal->j_max_batch_time || sbi->s_fc_last_sync_pid == pid)
+		return;
+	sbi->s_fc_last_sync_pid = pid;
+
+	commit_time = max_t(u64, sbi->s_fc_avg_commit_time,
+			    1000 * journal->j_min_batch_time);
+	commit_time = min_t(u64, commit_time,
+			    1000 * journal->j_max_batch_time);
+	since = ktime_to_ns(ktime_sub(ktime_get(), sbi->s_fc_last_commit));
+	if (since < commit_time) {
+		ktime_t expires = ktime_add_ns(ktime_get(), commit_time);
+
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	}
+}
+
 /*
  * The main commit entry point. Performs a fast commit for transaction
  * commit_tid if needed. If it's not possible to perform a fast commit
  * due to various reasons, we fall back to full commit. Returns 0
  * on success, error otherwise.
+ *
+ * Concurrent callers are batched: everything tracked before a caller got
+ * here is written by any fast commit that starts afterwards, so a caller
+ * that finds such a commit completed while it was waiting is done.
  */
 int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 {
 	struct super_block *sb = (struct super_block *)(journal->j_private);
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int nblks = 0, ret, bsize = journal->j_blocksize;
-	int subtid = atomic_read(&sbi->s_fc_subtid);
+	int seq = atomic_read(&sbi->s_fc_seq) + 1;
 	int reason = EXT4_FC_REASON_OK, fc_bufs_before = 0;
 	ktime_t start_time, commit_time;
 
@@ -1094,12 +1128,26 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 		goto out;
 	}
 
+	ext4_fc_batch_wait(journal, sbi);
+	/* The batching delay must not feed back into s_fc_avg_commit_time */
+	start_time = ktime_get();
+
 restart_fc:
+	/* Did a commit that started after we got here write our updates? */
+	if (READ_ONCE(sbi->s_fc_done) - seq >= 0) {
+		reason = EXT4_FC_REASON_ALREADY_COMMITTED;
+		spin_lock(&sbi->s_fc_lock);
+		sbi->s_fc_stats.fc_batched++;
+		spin_unlock(&sbi->s_fc_lock);
+		goto out;
+	}
 	ret = jbd2_fc_begin_commit(journal, commit_tid);
 	if (ret == -EALREADY) {
-		/* There was an ongoing commit, check if we need to restart */
-		if (atomic_read(&sbi->s_fc_subtid) <= subtid &&
-			commit_tid > journal->j_commit_sequence)
+		/*
+		 * Either a full commit covered commit_tid, or we waited for
+		 * an ongoing fast commit which may have started before us.
+		 */
+		if (commit_tid > journal->j_commit_sequence)
 			goto restart_fc;
 		reason = EXT4_FC_REASON_ALREADY_COMMITTED;
 		goto out;
@@ -1109,6 +1157,7 @@ restart_fc:
 		goto out;
 	}
 
+	seq = atomic_inc_return(&sbi->s_fc_seq);
 	fc_bufs_before = (sbi->s_fc_bytes + bsize - 1) / bsize;
 	ret = ext4_fc_perform_commit(journal);
 	if (ret < 0) {
@@ -1124,6 +1173,8 @@ restart_fc:
 		goto out;
 	}
 	atomic_inc(&sbi->s_fc_subtid);
+	WRITE_ONCE(sbi->s_fc_done, seq);
+	sbi->s_fc_last_commit = ktime_get();
 	jbd2_fc_end_commit(journal);
 out:
 	/* Has any ineligible update happened since we started? */
@@ -1154,8 +1205,8 @@ out:
 	else
 		sbi->s_fc_avg_commit_time = commit_time;
 	jbd_debug(1,
-		"Fast commit ended with blks = %d, reason = %d, subtid - %d",
-		nblks, reason, subtid);
+		"Fast commit ended with blks = %d, reason = %d, seq - %d",
+		nblks, reason, seq);
 	if (reason == EXT4_FC_REASON_FC_FAILED)
 		return jbd2_fc_end_commit_fallback(journal);
 	if (reason == EXT4_FC_REASON_FC_START_FAILED ||
@@ -2132,16 +2183,23 @@ int ext4_fc_info_show(struct seq_file *seq, void *v)
 {
 	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *)seq->private);
 	struct ext4_fc_stats *stats = &sbi->s_fc_stats;
+	unsigned long writes, factor;
 	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
 
+	/* fsyncs served per fast commit actually written, in hundredths */
+	writes = stats->fc_num_commits - stats->fc_batched;
+	factor = writes ? stats->fc_num_commits * 100 / writes : 100;
+
 	seq_printf(seq,
 		"fc stats:\n%ld commits\n%ld ineligible\n%ld numblks\n%lluus avg_commit_time\n",
 		   stats->fc_num_commits, stats->fc_ineligible_commits,
 		   stats->fc_numblks,
 		   div_u64(sbi->s_fc_avg_commit_time, 1000));
+	seq_printf(seq, "%ld batched\n%lu.%02lu batching factor\n",
+		   stats->fc_batched, factor / 100, factor % 100);
 	seq_puts(seq, "Ineligible reasons:\n");
 	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
 		seq_printf(seq, "\"%s\":\t%d\n", fc_ineligible_reasons[i],
@@ -112,6 +112,7 @@ struct ext4_fc_stats {
 	unsigned long fc_num_commits;
 	unsigned long fc_ineligible_commits;
 	unsigned long fc_numblks;
+	unsigned long fc_batched;	/* served by another caller's commit */
 };
 
 #define EXT4_FC_REPLAY_REALLOC_INCREMENT	4
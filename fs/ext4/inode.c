@@ -3680,12 +3680,15 @@ void ext4_set_aops(struct inode *inode)
 	default:
 		BUG();
 	}
-	if (IS_DAX(inode))
+	if (IS_DAX(inode)) {
 		inode->i_mapping->a_ops = &ext4_dax_aops;
-	else if (test_opt(inode->i_sb, DELALLOC))
+		return;
+	}
+	if (test_opt(inode->i_sb, DELALLOC))
 		inode->i_mapping->a_ops = &ext4_da_aops;
 	else
 		inode->i_mapping->a_ops = &ext4_aops;
+	mapping_set_ra_contig(inode->i_mapping);
 }
 
 static int __ext4_block_zero_page_range(handle_t *handle,
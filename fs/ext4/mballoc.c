@@ -746,23 +746,42 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the matching s_mb_largest_free_orders list.
+ * Called with the group lock held.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
 	int i;
-	int bits;
 
 	grp->bb_largest_free_order = -1; /* uninit */
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
 			grp->bb_largest_free_order = i;
 			break;
 		}
 	}
+
+	if (grp->bb_largest_free_order == old &&
+	    !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (old >= 0 && !list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+
+	i = grp->bb_largest_free_order;
+	if (i >= 0 && grp->bb_free) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
 }
 
 static noinline_for_stack
@@ -1721,10 +1740,10 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	get_page(ac->ac_buddy_page);
 	/* store last allocated for subsequent stream allocation */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		spin_lock(&sbi->s_md_lock);
-		sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
-		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
-		spin_unlock(&sbi->s_md_lock);
+		struct ext4_mb_goal *goal = raw_cpu_ptr(sbi->s_mb_last_goal);
+
+		WRITE_ONCE(goal->group, ac->ac_f_ex.fe_group);
+		WRITE_ONCE(goal->start, ac->ac_f_ex.fe_start);
 	}
 	/*
 	 * As we've just preallocated more space than
@@ -2295,6 +2314,65 @@ void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
 	}
 }
 
+/*
+ * cr=0 without the linear scan: take candidate groups from the largest free
+ * order lists, starting at the order of the request, and try them in turn.
+ * Returns 1 if the search should continue with cr=1, 0 if it is done
+ * (allocation found) or a negative error.
+ */
+static int ext4_mb_scan_indexed(struct ext4_allocation_context *ac)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t groups[MB_CR0_INDEX_CANDIDATES];
+	struct ext4_group_info *grp;
+	struct ext4_buddy e4b;
+	int i, n = 0, err;
+
+	for (i = ac->ac_2order; i < MB_NUM_ORDERS(sb) &&
+			n < MB_CR0_INDEX_CANDIDATES; i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (!ext4_mb_good_group(ac, grp->bb_group, 0))
+				continue;
+			groups[n++] = grp->bb_group;
+			if (n == MB_CR0_INDEX_CANDIDATES)
+				break;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
+	for (i = 0; i < n && ac->ac_status == AC_STATUS_CONTINUE; i++) {
+		/* non-extent files are limited to low blocks/groups */
+		if (!ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS) &&
+		    groups[i] >= sbi->s_blockfile_groups)
+			continue;
+
+		err = ext4_mb_load_buddy(sb, groups[i], &e4b);
+		if (err)
+			return err;
+
+		ext4_lock_group(sb, groups[i]);
+		/* The group may have been used up since we looked at it */
+		if (ext4_mb_good_group(ac, groups[i], 0)) {
+			ac->ac_groups_scanned++;
+			ext4_mb_simple_scan_group(ac, &e4b);
+		}
+		ext4_unlock_group(sb, groups[i]);
+		ext4_mb_unload_buddy(&e4b);
+	}
+
+	if (ac->ac_status != AC_STATUS_CONTINUE) {
+		if (sbi->s_mb_stats)
+			atomic_inc(&sbi->s_bal_cr0_indexed);
+		return 0;
+	}
+	return 1;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2347,17 +2425,29 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 							   sb->s_blocksize_bits + 2);
 	}
 
-	/* if stream allocation is enabled, use global goal */
+	/*
+	 * if stream allocation is enabled, use the goal of this cpu, so that
+	 * parallel streams don't contend on, and pile into, a single group
+	 */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		/* TBD: may be hot point */
-		spin_lock(&sbi->s_md_lock);
-		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
-		ac->ac_g_ex.fe_start = sbi->s_mb_last_start;
-		spin_unlock(&sbi->s_md_lock);
+		struct ext4_mb_goal *goal = raw_cpu_ptr(sbi->s_mb_last_goal);
+
+		group = READ_ONCE(goal->group);
+		if (group < ngroups) {
+			ac->ac_g_ex.fe_group = group;
+			ac->ac_g_ex.fe_start = READ_ONCE(goal->start);
+		}
 	}
 
 	/* Let's just scan groups to find more-less suitable blocks */
 	cr = ac->ac_2order ? 0 : 1;
+	if (cr == 0 && sbi->s_mb_optimize_scan) {
+		err = ext4_mb_scan_indexed(ac);
+		if (err <= 0)
+			goto out;
+		err = 0;
+		cr = 1;
+	}
 	/*
 	 * cr == 0 try to get exact allocation,
 	 * cr == 3  try to get anything
@@ -2676,6 +2766,8 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 
 	mb_group_bb_bitmap_alloc(sb, meta_group_info[i], group);
 	return 0;
@@ -2872,6 +2964,31 @@ int ext4_mb_init(struct super_block *sb)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
+	sbi->s_mb_last_goal = alloc_percpu(struct ext4_mb_goal);
+	if (!sbi->s_mb_last_goal) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 	sbi->s_mb_free_pending = 0;
@@ -2883,6 +3000,7 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_max_inode_prealloc = MB_DEFAULT_MAX_INODE_PREALLOC;
+	sbi->s_mb_optimize_scan = 1;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2935,6 +3053,12 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	free_percpu(sbi->s_mb_last_goal);
+	sbi->s_mb_last_goal = NULL;
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2993,6 +3117,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
 		ext4_msg(sb, KERN_INFO,
@@ -3002,10 +3128,11 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_success));
 		ext4_msg(sb, KERN_INFO,
 		      "mballoc: %u extents scanned, %u goal hits, "
-				"%u 2^N hits, %u breaks, %u lost",
+				"%u 2^N hits (%u indexed), %u breaks, %u lost",
 				atomic_read(&sbi->s_bal_ex_scanned),
 				atomic_read(&sbi->s_bal_goals),
 				atomic_read(&sbi->s_bal_2orders),
+				atomic_read(&sbi->s_bal_cr0_indexed),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
 		ext4_msg(sb, KERN_INFO,
@@ -3019,6 +3146,7 @@ int ext4_mb_release(struct super_block *sb)
 	}
 
 	free_percpu(sbi->s_locality_groups);
+	free_percpu(sbi->s_mb_last_goal);
 
 	return 0;
 }
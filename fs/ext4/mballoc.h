@@ -78,6 +78,19 @@
  */
 #define MB_DEFAULT_MAX_INODE_PREALLOC	512
 
+/*
+ * number of groups taken from the largest free order index per cr=0 pass
+ */
+#define MB_CR0_INDEX_CANDIDATES		8
+
+/* number of buddy orders, including the bitmap (order 0) */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
+struct ext4_mb_goal {
+	ext4_group_t	group;
+	ext4_grpblk_t	start;
+};
+
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
 	struct list_head		efd_list;
@@ -1182,6 +1182,7 @@ static int block_operations(struct f2fs_sb_info *sbi)
 
 retry_flush_quotas:
 	f2fs_lock_all(sbi);
+	sbi->cp_block_start = ktime_get();
 	if (__need_flush_quota(sbi)) {
 		int locked;
 
@@ -1256,8 +1257,15 @@ retry_flush_nodes:
 
 static void unblock_operations(struct f2fs_sb_info *sbi)
 {
+	s64 msecs;
+
 	up_write(&sbi->node_write);
 	f2fs_unlock_all(sbi);
+
+	/* bucket 0 is < 1ms, bucket i is < 2^i ms, the last one the rest */
+	msecs = ktime_ms_delta(ktime_get(), sbi->cp_block_start);
+	sbi->cp_block_hist[msecs > 0 ? min_t(int, fls64(msecs),
+					NR_CP_BLOCK_HIST - 1) : 0]++;
 }
 
 void f2fs_wait_on_all_pages(struct f2fs_sb_info *sbi, int type)
@@ -1386,6 +1394,83 @@ static void commit_checkpoint(struct f2fs_sb_info *sbi,
 	f2fs_submit_merged_write(sbi, META_FLUSH);
 }
 
+/*
+ * Once FS operations run again, writers can keep dirtying meta pages and
+ * submitting node writes, so the counts may never drain. Give them a few
+ * rounds, then block operations again for the rest of the wait.
+ */
+#define ASYNC_CP_WAIT_ROUNDS	8
+
+static void f2fs_wait_on_pages_unblocked(struct f2fs_sb_info *sbi, int type)
+{
+	DEFINE_WAIT(wait);
+	int i;
+
+	for (i = 0; i < ASYNC_CP_WAIT_ROUNDS; i++) {
+		if (!get_pages(sbi, type) || unlikely(f2fs_cp_error(sbi)))
+			break;
+
+		if (type == F2FS_DIRTY_META)
+			f2fs_sync_meta_pages(sbi, META, LONG_MAX,
+							FS_CP_META_IO);
+		else if (type == F2FS_WB_CP_DATA)
+			f2fs_submit_merged_write(sbi, DATA);
+
+		prepare_to_wait(&sbi->cp_wait, &wait, TASK_UNINTERRUPTIBLE);
+		io_schedule_timeout(DEFAULT_IO_TIMEOUT);
+	}
+	finish_wait(&sbi->cp_wait, &wait);
+
+	if (!get_pages(sbi, type) || unlikely(f2fs_cp_error(sbi)))
+		return;
+
+	f2fs_lock_all(sbi);
+	down_write(&sbi->node_write);
+	sbi->cp_block_start = ktime_get();
+	f2fs_wait_on_all_pages(sbi, type);
+	unblock_operations(sbi);
+}
+
+static void f2fs_wait_on_cp_pages(struct f2fs_sb_info *sbi, int type,
+							bool unblocked)
+{
+	if (unblocked)
+		f2fs_wait_on_pages_unblocked(sbi, type);
+	else
+		f2fs_wait_on_all_pages(sbi, type);
+}
+
+static int __commit_checkpoint(struct f2fs_sb_info *sbi,
+				void *src, block_t blk_addr, bool unblocked)
+{
+	int err;
+
+	/* Wait for all dirty meta pages to be submitted for IO */
+	f2fs_wait_on_cp_pages(sbi, F2FS_DIRTY_META, unblocked);
+
+	/* wait for previous submitted meta pages writeback */
+	f2fs_wait_on_cp_pages(sbi, F2FS_WB_CP_DATA, unblocked);
+
+	/* flush all device cache */
+	err = f2fs_flush_device_cache(sbi);
+	if (err)
+		return err;
+
+	/* barrier and flush checkpoint cp pack 2 page if it can */
+	commit_checkpoint(sbi, src, blk_addr);
+	f2fs_wait_on_cp_pages(sbi, F2FS_WB_CP_DATA, unblocked);
+
+	/*
+	 * invalidate intermediate page cache borrowed from meta inode which are
+	 * used for migration of encrypted, verity or compressed inode's blocks.
+	 */
+	if (f2fs_sb_has_encrypt(sbi) || f2fs_sb_has_verity(sbi) ||
+		f2fs_sb_has_compression(sbi))
+		invalidate_mapping_pages(META_MAPPING(sbi),
+				MAIN_BLKADDR(sbi), MAX_BLKADDR(sbi) - 1);
+	return 0;
+}
+
 static inline u64 get_sectors_written(struct block_device *bdev)
 {
 	return (u64)part_stat_read(bdev->bd_part, sectors[STAT_WRITE]);
@@ -1525,30 +1610,21 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	/* Here, we have one bio having CP pack except cp pack 2 page */
 	f2fs_sync_meta_pages(sbi, META, LONG_MAX, FS_CP_META_IO);
-	/* Wait for all dirty meta pages to be submitted for IO */
-	f2fs_wait_on_all_pages(sbi, F2FS_DIRTY_META);
-
-	/* wait for previous submitted meta pages writeback */
-	f2fs_wait_on_all_pages(sbi, F2FS_WB_CP_DATA);
-
-	/* flush all device cache */
-	err = f2fs_flush_device_cache(sbi);
-	if (err)
-		return err;
-
-	/* barrier and flush checkpoint cp pack 2 page if it can */
-	commit_checkpoint(sbi, ckpt, start_blk);
-	f2fs_wait_on_all_pages(sbi, F2FS_WB_CP_DATA);
 
 	/*
-	 * invalidate intermediate page cache borrowed from meta inode which are
-	 * used for migration of encrypted, verity or compressed inode's blocks.
+	 * Async checkpoint commits cp pack 2 once FS operations are running
+	 * again, from a copy as they may update ckpt meanwhile.
 	 */
-	if (f2fs_sb_has_encrypt(sbi) || f2fs_sb_has_verity(sbi) ||
-		f2fs_sb_has_compression(sbi))
-		invalidate_mapping_pages(META_MAPPING(sbi),
-				MAIN_BLKADDR(sbi), MAX_BLKADDR(sbi) - 1);
+	if (cpc->cp_pack2) {
+		memcpy(cpc->cp_pack2, ckpt, PAGE_SIZE);
+		cpc->cp_pack2_blk = start_blk;
+		goto release;
+	}
 
+	err = __commit_checkpoint(sbi, ckpt, start_blk, false);
+	if (err)
+		return err;
+release:
 	f2fs_release_ino_entry(sbi, false);
 
 	f2fs_reset_fsync_node_info(sbi);
@@ -1561,7 +1637,8 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	sbi->unusable_block_count = 0;
 	spin_unlock(&sbi->stat_lock);
 
-	__set_cp_next_pack(sbi);
+	if (!cpc->cp_pack2)
+		__set_cp_next_pack(sbi);
 
 	/*
 	 * redirty superblock if metadata like node page or inode cache is
@@ -1576,10 +1653,92 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	return unlikely(f2fs_cp_error(sbi)) ? -EIO : 0;
 }
 
+/*
+ * With ckpt_async, a CP_SYNC checkpoint only snapshots NAT/SIT and the cp
+ * pack into the meta cache while FS operations are blocked. Writeback of
+ * the meta pages and the cp pack 2 commit run after unblocking, with
+ * cp_global_sem still held so the caller waits for the commit as before.
+ * Nodes written meanwhile carry the new checkpoint version and are only
+ * recoverable once the commit is done, so fsync waits for it.
+ *
+ * Until cp pack 2 is on disk the previous checkpoint is the stable one,
+ * but ckpt_valid_map already reflects the new one. Only plain LFS
+ * allocation never writes to blocks that are free in ckpt_valid_map yet
+ * still valid in the previous checkpoint: SSR, ATGC and in-place updates
+ * would, so they keep the synchronous path.
+ */
+static bool prepare_async_checkpoint(struct f2fs_sb_info *sbi,
+						struct cp_control *cpc)
+{
+	/* not every caller initializes the whole cp_control */
+	cpc->cp_pack2 = NULL;
+	cpc->prefree_map = NULL;
+
+	if (!sbi->ckpt_async || cpc->reason != CP_SYNC)
+		return false;
+
+	if (!f2fs_lfs_mode(sbi) || sbi->am.atgc_enabled)
+		return false;
+
+	/*
+	 * f2fs_clear_prefree_segments() rounds prefree ranges up to whole
+	 * sections here, which could free segments not in the snapshot.
+	 */
+	if (__is_large_section(sbi))
+		return false;
+
+	cpc->cp_pack2 = f2fs_kmalloc(sbi, PAGE_SIZE, GFP_NOFS);
+	cpc->prefree_map = f2fs_kvzalloc(sbi,
+				f2fs_bitmap_size(MAIN_SEGS(sbi)), GFP_NOFS);
+	if (cpc->cp_pack2 && cpc->prefree_map)
+		return true;
+
+	kfree(cpc->cp_pack2);
+	kvfree(cpc->prefree_map);
+	cpc->cp_pack2 = NULL;
+	cpc->prefree_map = NULL;
+	return false;
+}
+
+static int finish_async_checkpoint(struct f2fs_sb_info *sbi,
+					struct cp_control *cpc, int err)
+{
+	/* do_checkpoint() failed, discard addresses are already released */
+	if (err)
+		goto out;
+
+	err = __commit_checkpoint(sbi, cpc->cp_pack2, cpc->cp_pack2_blk, true);
+	if (!err && unlikely(f2fs_cp_error(sbi)))
+		err = -EIO;
+
+	if (!err) {
+		__set_cp_next_pack(sbi);
+		/*
+		 * Segments which became prefree after the snapshot have
+		 * blocks still valid in this checkpoint, keep them.
+		 */
+		f2fs_clear_prefree_segments(sbi, cpc);
+	} else {
+		f2fs_release_discard_addrs(sbi);
+		set_sbi_flag(sbi, SBI_IS_DIRTY);
+		set_sbi_flag(sbi, SBI_NEED_CP);
+	}
+out:
+	WRITE_ONCE(sbi->cp_async_busy, false);
+	wake_up_all(&sbi->cp_async_wait);
+	return err;
+}
+
+void f2fs_wait_on_async_checkpoint(struct f2fs_sb_info *sbi)
+{
+	wait_event(sbi->cp_async_wait, !READ_ONCE(sbi->cp_async_busy));
+}
+
 int f2fs_write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 {
 	struct f2fs_checkpoint *ckpt = F2FS_CKPT(sbi);
 	unsigned long long ckpt_ver;
+	bool async = false;
 	int err = 0;
 
 	if (f2fs_readonly(sbi->sb) || f2fs_hw_is_readonly(sbi))
@@ -1604,10 +1763,16 @@ int f2fs_write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "start block_ops");
 
+	async = prepare_async_checkpoint(sbi, cpc);
+
 	err = block_operations(sbi);
 	if (err)
 		goto out;
 
+	/* before fsync can see ino entries dropped by this checkpoint */
+	if (async)
+		WRITE_ONCE(sbi->cp_async_busy, true);
+
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "finish block_ops");
 
 	f2fs_flush_merged_writes(sbi);
@@ -1648,14 +1813,27 @@ int f2fs_write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	f2fs_save_inmem_curseg(sbi);
 
 	err = do_checkpoint(sbi, cpc);
-	if (err)
+	if (err) {
 		f2fs_release_discard_addrs(sbi);
-	else
+	} else if (async) {
+		struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+
+		mutex_lock(&dirty_i->seglist_lock);
+		bitmap_copy(cpc->prefree_map, dirty_i->dirty_segmap[PRE],
+							MAIN_SEGS(sbi));
+		mutex_unlock(&dirty_i->seglist_lock);
+	} else {
 		f2fs_clear_prefree_segments(sbi, cpc);
+	}
 
 	f2fs_restore_inmem_curseg(sbi);
 stop:
 	unblock_operations(sbi);
+	if (async) {
+		trace_f2fs_write_checkpoint(sbi->sb, cpc->reason,
+							"start async commit");
+		err = finish_async_checkpoint(sbi, cpc, err);
+	}
 	stat_inc_cp_count(sbi->stat_info);
 
 	if (cpc->reason & CP_RECOVERY)
@@ -1665,6 +1843,12 @@ stop:
 	f2fs_update_time(sbi, CP_TIME);
 	trace_f2fs_write_checkpoint(sbi->sb, cpc->reason, "finish checkpoint");
 out:
+	if (async) {
+		kfree(cpc->cp_pack2);
+		kvfree(cpc->prefree_map);
+		cpc->cp_pack2 = NULL;
+		cpc->prefree_map = NULL;
+	}
 	if (cpc->reason != CP_RESIZE)
 		up_write(&sbi->cp_global_sem);
 	return err;
@@ -13,6 +13,7 @@
 #include <linux/lz4.h>
 #include <linux/zstd.h>
 #include <linux/pagevec.h>
+#include <linux/swap.h>
 
 #include "f2fs.h"
 #include "node.h"
@@ -619,7 +620,9 @@ static int f2fs_compress_pages(struct compress_ctx *cc)
 				f2fs_cops[fi->i_compress_algorithm];
 	unsigned int max_len, new_nr_cpages;
 	struct page **new_cpages;
+	struct f2fs_sb_info *sbi;
 	u32 chksum = 0;
+	u64 start;
 	int i, ret;
 
 	trace_f2fs_compress_pages_start(cc->inode, cc->cluster_idx,
@@ -660,10 +663,18 @@ static int f2fs_compress_pages(struct compress_ctx *cc)
 		goto out_vunmap_rbuf;
 	}
 
+	start = ktime_get_ns();
 	ret = cops->compress_pages(cc);
 	if (ret)
 		goto out_vunmap_cbuf;
 
+	sbi = F2FS_I_SB(cc->inode);
+	atomic64_add(ktime_get_ns() - start,
+		     &sbi->compr_time_ns[fi->i_compress_algorithm]);
+	atomic64_add(cc->rlen, &sbi->compr_in_bytes[fi->i_compress_algorithm]);
+	atomic64_add(min_t(size_t, cc->clen, cc->rlen),
+		     &sbi->compr_out_bytes[fi->i_compress_algorithm]);
+
 	max_len = PAGE_SIZE * (cc->cluster_size - 1) - COMPRESS_HEADER_SIZE;
 
 	if (cc->clen > max_len) {
@@ -1465,16 +1476,14 @@ out_err:
 	return err;
 }
 
-int f2fs_write_multi_pages(struct compress_ctx *cc,
+/* Write out a cluster, err is what compressing it returned */
+static int __f2fs_write_multi_pages(struct compress_ctx *cc, int err,
 					int *submitted,
 					struct writeback_control *wbc,
 					enum iostat_type io_type)
 {
-	int err;
-
 	*submitted = 0;
 	if (cluster_may_compress(cc)) {
-		err = f2fs_compress_pages(cc);
 		if (err == -EAGAIN) {
 			goto write;
 		} else if (err) {
@@ -1498,6 +1507,156 @@ destroy_out:
 	return err;
 }
 
+int f2fs_write_multi_pages(struct compress_ctx *cc,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	int err = 0;
+
+	if (cluster_may_compress(cc))
+		err = f2fs_compress_pages(cc);
+	return __f2fs_write_multi_pages(cc, err, submitted, wbc, io_type);
+}
+
+static void f2fs_compress_work(struct work_struct *work)
+{
+	struct compress_work *cw = container_of(work, struct compress_work,
+						work);
+
+	cw->err = f2fs_compress_pages(&cw->cc);
+	complete(&cw->done);
+}
+
+/*
+ * Writeback of a compressed file compresses up to this many clusters on
+ * the compress workqueue while it goes on collecting the next ones, so
+ * that bulk writes use more than the writeback thread's CPU. Clusters are
+ * still written in order, keeping the block layout sequential.
+ */
+struct compress_batch *f2fs_alloc_compress_batch(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct compress_batch *cb;
+	unsigned int i;
+
+	if (!sbi->compress_wq || num_online_cpus() < 2)
+		return NULL;
+
+	cb = f2fs_kmalloc(sbi, sizeof(*cb), GFP_NOFS);
+	if (!cb)
+		return NULL;
+
+	cb->max = min_t(unsigned int, num_online_cpus(), COMPRESS_BATCH_MAX);
+	cb->head = 0;
+	cb->nr = 0;
+	for (i = 0; i < cb->max; i++) {
+		INIT_WORK(&cb->works[i].work, f2fs_compress_work);
+		init_completion(&cb->works[i].done);
+	}
+	return cb;
+}
+
+void f2fs_free_compress_batch(struct compress_batch *cb)
+{
+	if (cb)
+		WARN_ON(cb->nr);
+	kfree(cb);
+}
+
+/* Wait for the oldest cluster in flight to be compressed and write it */
+static int f2fs_write_batch_head(struct compress_batch *cb, int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_work *cw = &cb->works[cb->head];
+	int err;
+
+	wait_for_completion(&cw->done);
+	err = __f2fs_write_multi_pages(&cw->cc, cw->err, submitted,
+							wbc, io_type);
+	cb->head = (cb->head + 1) % cb->max;
+	cb->nr--;
+	return err;
+}
+
+int f2fs_flush_compress_batch(struct compress_batch *cb, int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	int _submitted, ret, err = 0;
+
+	*submitted = 0;
+	if (!cb)
+		return 0;
+
+	/* Every cluster still has its pages locked, write them all */
+	while (cb->nr) {
+		ret = f2fs_write_batch_head(cb, &_submitted, wbc, io_type);
+		*submitted += _submitted;
+		if (!err)
+			err = ret;
+	}
+	return err;
+}
+
+/*
+ * Like f2fs_write_multi_pages(), but for a compressible cluster only queue
+ * its compression and take the pages out of cc. What gets written now, and
+ * what *submitted and the return value are about, are older clusters.
+ */
+int f2fs_write_multi_pages_batch(struct compress_batch *cb,
+					struct compress_ctx *cc,
+					int *submitted,
+					struct writeback_control *wbc,
+					enum iostat_type io_type)
+{
+	struct compress_work *cw;
+	int _submitted, err, ret;
+
+	if (!cb || !cluster_may_compress(cc)) {
+		err = f2fs_flush_compress_batch(cb, submitted, wbc, io_type);
+		ret = f2fs_write_multi_pages(cc, &_submitted, wbc, io_type);
+		*submitted += _submitted;
+		return err ? err : ret;
+	}
+
+	*submitted = 0;
+	err = 0;
+	if (cb->nr == cb->max)
+		err = f2fs_write_batch_head(cb, submitted, wbc, io_type);
+
+	cw = &cb->works[(cb->head + cb->nr) % cb->max];
+	cw->cc = *cc;
+	cb->nr++;
+	reinit_completion(&cw->done);
+	queue_work(F2FS_I_SB(cc->inode)->compress_wq, &cw->work);
+
+	/* The pages belong to the queued context now */
+	cc->rpages = NULL;
+	cc->nr_rpages = 0;
+	cc->cluster_idx = NULL_CLUSTER;
+	return err;
+}
+
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi)
+{
+	if (!f2fs_sb_has_compression(sbi) || num_possible_cpus() < 2)
+		return 0;
+
+	sbi->compress_wq = alloc_workqueue("f2fs_compress_wq",
+					    WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!sbi->compress_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi)
+{
+	if (sbi->compress_wq)
+		destroy_workqueue(sbi->compress_wq);
+}
+
 static void f2fs_free_dic(struct decompress_io_ctx *dic);
 
 struct decompress_io_ctx *f2fs_alloc_dic(struct compress_ctx *cc)
@@ -1526,6 +1685,7 @@ struct decompress_io_ctx *f2fs_alloc_dic(struct compress_ctx *cc)
 	refcount_set(&dic->refcnt, 1);
 	dic->failed = false;
 	dic->need_verity = f2fs_need_verity(cc->inode, start_idx);
+	dic->hot = false;
 
 	for (i = 0; i < dic->cluster_size; i++)
 		dic->rpages[i] = cc->rpages[i];
@@ -1609,6 +1769,13 @@ static void __f2fs_decompress_end_io(struct decompress_io_ctx *dic, bool failed)
 			ClearPageError(rpage);
 		} else {
 			SetPageUptodate(rpage);
+			/*
+			 * Start out referenced, so that the next access
+			 * activates the page instead of it being among the
+			 * first to be reclaimed again.
+			 */
+			if (dic->hot)
+				mark_page_accessed(rpage);
 		}
 		unlock_page(rpage);
 	}
@@ -1747,9 +1914,64 @@ bool f2fs_load_compressed_page(struct f2fs_sb_info *sbi, struct page *page,
 		f2fs_put_page(cpage, 1);
 	}
 
+	if (!hitted)
+		atomic_inc(&sbi->compress_page_miss);
 	return hitted;
 }
 
+unsigned long f2fs_count_compress_pages(struct f2fs_sb_info *sbi)
+{
+	if (!sbi->compress_inode)
+		return 0;
+	return COMPRESS_MAPPING(sbi)->nrpages;
+}
+
+/*
+ * Drop clean pages of the compressed block cache under memory pressure.
+ * They can be read back from disk cheaply, so the cache gives its memory
+ * back before the decompressed pages of hot files have to go.
+ */
+unsigned long f2fs_shrink_compress_pages(struct f2fs_sb_info *sbi,
+						unsigned long nr_shrink)
+{
+	struct address_space *mapping;
+	struct pagevec pvec;
+	unsigned long freed = 0, scanned = 0;
+	pgoff_t index, first, last;
+	bool wrapped = false;
+	unsigned int nr_pages;
+
+	if (!sbi->compress_inode)
+		return 0;
+
+	mapping = COMPRESS_MAPPING(sbi);
+	index = READ_ONCE(sbi->compress_shrink_index);
+	pagevec_init(&pvec);
+
+	while (freed < nr_shrink && scanned < 2 * nr_shrink) {
+		nr_pages = pagevec_lookup_range(&pvec, mapping, &index,
+							(pgoff_t)-1);
+		if (!nr_pages) {
+			if (wrapped)
+				break;
+			wrapped = true;
+			index = 0;
+			continue;
+		}
+
+		first = pvec.pages[0]->index;
+		last = pvec.pages[nr_pages - 1]->index;
+		pagevec_release(&pvec);
+
+		freed += invalidate_mapping_pages(mapping, first, last);
+		scanned += nr_pages;
+		cond_resched();
+	}
+
+	WRITE_ONCE(sbi->compress_shrink_index, index);
+	return freed;
+}
+
 void f2fs_invalidate_compress_pages(struct f2fs_sb_info *sbi, nid_t ino)
 {
 	struct address_space *mapping = sbi->compress_inode->i_mapping;
@@ -1812,6 +2034,8 @@ int f2fs_init_compress_inode(struct f2fs_sb_info *sbi)
 	sbi->compress_watermark = COMPRESS_WATERMARK;
 
 	atomic_set(&sbi->compress_page_hit, 0);
+	atomic_set(&sbi->compress_page_miss, 0);
+	sbi->compress_shrink_index = 0;
 
 	return 0;
 }
@@ -2207,6 +2207,8 @@ int f2fs_read_multi_pages(struct compress_ctx *cc, struct bio **bio_ret,
 		f2fs_wait_on_block_writeback(inode, blkaddr);
 
 		if (f2fs_load_compressed_page(sbi, page, blkaddr)) {
+			/* Only cached when the cluster was read before */
+			dic->hot = true;
 			if (atomic_dec_and_test(&dic->remaining_pages))
 				f2fs_decompress_cluster(dic);
 			continue;
@@ -2881,6 +2883,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 		.rlen = PAGE_SIZE * F2FS_I(inode)->i_cluster_size,
 		.private = NULL,
 	};
+	struct compress_batch *cb = NULL;
 #endif
 	int nr_pages;
 	pgoff_t index;
@@ -2894,6 +2897,11 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 
 	pagevec_init(&pvec);
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	if (f2fs_compressed_file(inode))
+		cb = f2fs_alloc_compress_batch(inode);
+#endif
+
 	if (get_dirty_pages(mapping->host) <=
 				SM_I(F2FS_M_SB(mapping))->min_hot_blocks)
 		set_inode_flag(mapping->host, FI_HOT_DATA);
@@ -2939,8 +2947,8 @@ readd:
 
 				if (!f2fs_cluster_can_merge_page(&cc,
 								page->index)) {
-					ret = f2fs_write_multi_pages(&cc,
-						&submitted, wbc, io_type);
+					ret = f2fs_write_multi_pages_batch(cb,
+						&cc, &submitted, wbc, io_type);
 					if (!ret)
 						need_readd = true;
 					goto result;
@@ -3064,7 +3072,8 @@ next:
 #ifdef CONFIG_F2FS_FS_COMPRESSION
 	/* flush remained pages in compress cluster */
 	if (f2fs_compressed_file(inode) && !f2fs_cluster_is_empty(&cc)) {
-		ret = f2fs_write_multi_pages(&cc, &submitted, wbc, io_type);
+		ret = f2fs_write_multi_pages_batch(cb, &cc, &submitted,
+							wbc, io_type);
 		nwritten += submitted;
 		wbc->nr_to_write -= submitted;
 		if (ret) {
@@ -3072,6 +3081,19 @@ next:
 			retry = 0;
 		}
 	}
+	/* and the clusters still being compressed */
+	if (cb) {
+		int ret2 = f2fs_flush_compress_batch(cb, &submitted,
+							wbc, io_type);
+
+		nwritten += submitted;
+		wbc->nr_to_write -= submitted;
+		if (ret2 && !ret) {
+			ret = ret2;
+			done = 1;
+			retry = 0;
+		}
+	}
 	if (f2fs_compressed_file(inode))
 		f2fs_destroy_compress_ctx(&cc, false);
 #endif
@@ -3085,6 +3107,9 @@ next:
 	if (wbc->range_cyclic || (range_whole && wbc->nr_to_write > 0))
 		mapping->writeback_index = done_index;
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	f2fs_free_compress_batch(cb);
+#endif
 	if (nwritten)
 		f2fs_submit_merged_write_cond(F2FS_M_SB(mapping), mapping->host,
 								NULL, 0, DATA);
@@ -34,9 +34,10 @@ void f2fs_update_sit_info(struct f2fs_sb_info *sbi)
 	struct f2fs_stat_info *si = F2FS_STAT(sbi);
 	unsigned long long blks_per_sec, hblks_per_sec, total_vblocks;
 	unsigned long long bimodal, dist;
-	unsigned int segno, vblocks;
+	unsigned int segno, vblocks, heat;
 	int ndirty = 0;
 
+	memset(si->heat_hist, 0, sizeof(si->heat_hist));
 	bimodal = 0;
 	total_vblocks = 0;
 	blks_per_sec = BLKS_PER_SEC(sbi);
@@ -49,6 +50,12 @@ void f2fs_update_sit_info(struct f2fs_sb_info *sbi)
 		if (vblocks > 0 && vblocks < blks_per_sec) {
 			total_vblocks += vblocks;
 			ndirty++;
+
+			/* buckets of 0, <4, <16, <64 and the rest */
+			heat = get_sec_heat(sbi, segno);
+			si->heat_hist[heat ? min_t(unsigned int,
+					(ilog2(heat) >> 1) + 1,
+					NR_SEG_HEAT_BUCKETS - 1) : 0]++;
 		}
 	}
 	dist = div_u64(MAIN_SECS(sbi) * hblks_per_sec * hblks_per_sec, 100);
@@ -73,11 +80,16 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 				le32_to_cpu(raw_super->secs_per_zone);
 
 	/* validation check of the segment numbers */
-	si->hit_largest = atomic64_read(&sbi->read_hit_largest);
-	si->hit_cached = atomic64_read(&sbi->read_hit_cached);
-	si->hit_rbtree = atomic64_read(&sbi->read_hit_rbtree);
+	si->hit_largest = si->hit_cached = si->hit_rbtree = si->total_ext = 0;
+	for_each_possible_cpu(i) {
+		struct extent_hit_stat *hits = per_cpu_ptr(sbi->ext_hits, i);
+
+		si->hit_largest += hits->largest;
+		si->hit_cached += hits->cached;
+		si->hit_rbtree += hits->rbtree;
+		si->total_ext += hits->total;
+	}
 	si->hit_total = si->hit_largest + si->hit_cached + si->hit_rbtree;
-	si->total_ext = atomic64_read(&sbi->total_hit_ext);
 	si->ext_tree = atomic_read(&sbi->total_ext_tree);
 	si->zombie_tree = atomic_read(&sbi->total_zombie_tree);
 	si->ext_node = atomic_read(&sbi->total_ext_node);
@@ -157,6 +169,11 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 		si->compress_pages = COMPRESS_MAPPING(sbi)->nrpages;
 		si->compress_page_hit = atomic_read(&sbi->compress_page_hit);
 	}
+	for (i = 0; i < COMPRESS_MAX; i++) {
+		si->compr_in_bytes[i] = atomic64_read(&sbi->compr_in_bytes[i]);
+		si->compr_out_bytes[i] = atomic64_read(&sbi->compr_out_bytes[i]);
+		si->compr_time_ns[i] = atomic64_read(&sbi->compr_time_ns[i]);
+	}
 #endif
 	si->nats = NM_I(sbi)->nat_cnt[TOTAL_NAT];
 	si->dirty_nats = NM_I(sbi)->nat_cnt[DIRTY_NAT];
@@ -323,6 +340,22 @@ get_cache:
 #endif
 }
 
+static const char * const compr_alg_name[COMPRESS_MAX] = {
+	[COMPRESS_LZO]		= "lzo",
+	[COMPRESS_LZ4]		= "lz4",
+	[COMPRESS_ZSTD]		= "zstd",
+	[COMPRESS_LZORLE]	= "lzo-rle",
+};
+
+/* blocks GC had to move for each segment it reclaimed in @gc_mode */
+static unsigned long long gc_cost(struct f2fs_sb_info *sbi, int gc_mode)
+{
+	if (!sbi->gc_reclaimed_segs[gc_mode])
+		return 0;
+	return div_u64(sbi->gc_moved_blks[gc_mode],
+				sbi->gc_reclaimed_segs[gc_mode]);
+}
+
 static int stat_show(struct seq_file *s, void *v)
 {
 	struct f2fs_stat_info *si;
@@ -367,6 +400,16 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->inline_dir);
 		seq_printf(s, "  - Compressed Inode: %u, Blocks: %llu\n",
 			   si->compr_inode, si->compr_blocks);
+		for (j = 0; j < COMPRESS_MAX; j++) {
+			if (!si->compr_in_bytes[j])
+				continue;
+			/* bytes per microsecond is MB/s */
+			seq_printf(s, "  - Compress %s: %llu KB -> %llu KB, %llu MB/s\n",
+				   compr_alg_name[j], si->compr_in_bytes[j] >> 10,
+				   si->compr_out_bytes[j] >> 10,
+				   div64_u64(si->compr_in_bytes[j] * NSEC_PER_USEC,
+					     max_t(u64, si->compr_time_ns[j], 1)));
+		}
 		seq_printf(s, "  - Orphan/Append/Update Inode: %u, %u, %u\n",
 			   si->orphans, si->append, si->update);
 		seq_printf(s, "\nMain area: %d segs, %d secs %d zones\n",
@@ -444,6 +487,13 @@ static int stat_show(struct seq_file *s, void *v)
 				si->nr_queued_ckpt, si->nr_issued_ckpt,
 				si->nr_total_ckpt, si->cur_ckpt_time,
 				si->peak_ckpt_time);
+		seq_puts(s, "CP blocked (ms):");
+		for (j = 0; j < NR_CP_BLOCK_HIST; j++)
+			seq_printf(s, " %s%u: %u", j < NR_CP_BLOCK_HIST - 1 ?
+				   "<" : ">=", j < NR_CP_BLOCK_HIST - 1 ?
+				   1 << j : 1 << (j - 1),
+				   si->sbi->cp_block_hist[j]);
+		seq_putc(s, '\n');
 		seq_printf(s, "GC calls: %d (BG: %d)\n",
 			   si->call_count, si->bg_gc);
 		seq_printf(s, "  - data segments : %d (%d)\n",
@@ -452,13 +502,26 @@ static int stat_show(struct seq_file *s, void *v)
 				si->node_segs, si->bg_node_segs);
 		seq_printf(s, "  - Reclaimed segs : Normal (%d), Idle CB (%d), "
 				"Idle Greedy (%d), Idle AT (%d), "
-				"Urgent High (%d), Urgent Low (%d)\n",
+				"Urgent High (%d), Urgent Low (%d), "
+				"Idle Cold (%d)\n",
 				si->sbi->gc_reclaimed_segs[GC_NORMAL],
 				si->sbi->gc_reclaimed_segs[GC_IDLE_CB],
 				si->sbi->gc_reclaimed_segs[GC_IDLE_GREEDY],
 				si->sbi->gc_reclaimed_segs[GC_IDLE_AT],
 				si->sbi->gc_reclaimed_segs[GC_URGENT_HIGH],
-				si->sbi->gc_reclaimed_segs[GC_URGENT_LOW]);
+				si->sbi->gc_reclaimed_segs[GC_URGENT_LOW],
+				si->sbi->gc_reclaimed_segs[GC_IDLE_COLD]);
+		seq_printf(s, "  - Moved blks/seg : Normal (%llu), Idle CB (%llu), "
+				"Idle Greedy (%llu), Idle AT (%llu), "
+				"Urgent High (%llu), Urgent Low (%llu), "
+				"Idle Cold (%llu)\n",
+				gc_cost(si->sbi, GC_NORMAL),
+				gc_cost(si->sbi, GC_IDLE_CB),
+				gc_cost(si->sbi, GC_IDLE_GREEDY),
+				gc_cost(si->sbi, GC_IDLE_AT),
+				gc_cost(si->sbi, GC_URGENT_HIGH),
+				gc_cost(si->sbi, GC_URGENT_LOW),
+				gc_cost(si->sbi, GC_IDLE_COLD));
 		seq_printf(s, "Try to move %d blocks (BG: %d)\n", si->tot_blks,
 				si->bg_data_blks + si->bg_node_blks);
 		seq_printf(s, "  - data blocks : %d (%d)\n", si->data_blks,
@@ -539,6 +602,10 @@ static int stat_show(struct seq_file *s, void *v)
 		f2fs_update_sit_info(si->sbi);
 		seq_printf(s, "\nBDF: %u, avg. vblocks: %u\n",
 			   si->bimodal, si->avg_vblocks);
+		seq_printf(s, "Dirty section heat: 0: %u, <4: %u, <16: %u, "
+			   "<64: %u, >=64: %u\n",
+			   si->heat_hist[0], si->heat_hist[1], si->heat_hist[2],
+			   si->heat_hist[3], si->heat_hist[4]);
 
 		/* memory footprint */
 		update_mem_info(si->sbi);
@@ -579,10 +646,11 @@ int f2fs_build_stats(struct f2fs_sb_info *sbi)
 	si->sbi = sbi;
 	sbi->stat_info = si;
 
-	atomic64_set(&sbi->total_hit_ext, 0);
-	atomic64_set(&sbi->read_hit_rbtree, 0);
-	atomic64_set(&sbi->read_hit_largest, 0);
-	atomic64_set(&sbi->read_hit_cached, 0);
+	sbi->ext_hits = alloc_percpu(struct extent_hit_stat);
+	if (!sbi->ext_hits) {
+		kfree(si);
+		return -ENOMEM;
+	}
 
 	atomic_set(&sbi->inline_xattr, 0);
 	atomic_set(&sbi->inline_inode, 0);
@@ -612,6 +680,7 @@ void f2fs_destroy_stats(struct f2fs_sb_info *sbi)
 	list_del(&si->stat_list);
 	mutex_unlock(&f2fs_stat_mutex);
 
+	free_percpu(sbi->ext_hits);
 	kfree(si);
 }
 
@@ -232,6 +232,32 @@ next:
 static struct kmem_cache *extent_tree_slab;
 static struct kmem_cache *extent_node_slab;
 
+/*
+ * Lookups walk the rb-tree of extent nodes without et->lock, and retry
+ * under it if et->seq says the tree was modified meanwhile. Nodes come
+ * from a SLAB_TYPESAFE_BY_RCU cache, so a node detached under a reader
+ * stays an extent_node until the reader leaves its RCU section.
+ */
+static inline void extent_tree_write_lock(struct extent_tree *et)
+{
+	write_lock(&et->lock);
+	write_seqcount_begin(&et->seq);
+}
+
+static inline bool extent_tree_write_trylock(struct extent_tree *et)
+{
+	if (!write_trylock(&et->lock))
+		return false;
+	write_seqcount_begin(&et->seq);
+	return true;
+}
+
+static inline void extent_tree_write_unlock(struct extent_tree *et)
+{
+	write_seqcount_end(&et->seq);
+	write_unlock(&et->lock);
+}
+
 static struct extent_node *__attach_extent_node(struct f2fs_sb_info *sbi,
 				struct extent_tree *et, struct extent_info *ei,
 				struct rb_node *parent, struct rb_node **p,
@@ -247,7 +273,9 @@ static struct extent_node *__attach_extent_node(struct f2fs_sb_info *sbi,
 	INIT_LIST_HEAD(&en->list);
 	en->et = et;
 
-	rb_link_node(&en->rb_node, parent, p);
+	en->referenced = false;
+
+	rb_link_node_rcu(&en->rb_node, parent, p);
 	rb_insert_color_cached(&en->rb_node, &et->root, leftmost);
 	atomic_inc(&et->node_cnt);
 	atomic_inc(&sbi->total_ext_node);
@@ -299,6 +327,7 @@ static struct extent_tree *__grab_extent_tree(struct inode *inode)
 		et->root = RB_ROOT_CACHED;
 		et->cached_en = NULL;
 		rwlock_init(&et->lock);
+		seqcount_rwlock_init(&et->seq, &et->lock);
 		INIT_LIST_HEAD(&et->list);
 		atomic_set(&et->node_cnt, 0);
 		atomic_inc(&sbi->total_ext_tree);
@@ -384,7 +413,7 @@ static void __f2fs_init_extent_tree(struct inode *inode, struct page *ipage)
 
 	get_extent_info(&ei, i_ext);
 
-	write_lock(&et->lock);
+	extent_tree_write_lock(et);
 	if (atomic_read(&et->node_cnt))
 		goto out;
 
@@ -395,7 +424,7 @@ static void __f2fs_init_extent_tree(struct inode *inode, struct page *ipage)
 		spin_unlock(&sbi->extent_lock);
 	}
 out:
-	write_unlock(&et->lock);
+	extent_tree_write_unlock(et);
 }
 
 void f2fs_init_extent_tree(struct inode *inode, struct page *ipage)
@@ -406,52 +435,90 @@ void f2fs_init_extent_tree(struct inode *inode, struct page *ipage)
 		set_inode_flag(inode, FI_NO_EXTENT);
 }
 
+enum {
+	EXTENT_MISS,
+	EXTENT_HIT_LARGEST,
+	EXTENT_HIT_CACHED,
+	EXTENT_HIT_RBTREE,
+};
+
+/*
+ * Safe both under et->lock and under RCU, where everything read may be
+ * stale and must be validated with et->seq before it is used.
+ */
+static int __lookup_extent_tree(struct extent_tree *et, pgoff_t pgofs,
+				struct extent_info *ei, struct extent_node **enp)
+{
+	struct extent_node *en = READ_ONCE(et->cached_en);
+	struct rb_node *node;
+
+	*ei = et->largest;
+	if (ei->fofs <= pgofs && ei->fofs + ei->len > pgofs)
+		return EXTENT_HIT_LARGEST;
+
+	if (en) {
+		*ei = en->ei;
+		if (ei->fofs <= pgofs && ei->fofs + ei->len > pgofs) {
+			*enp = en;
+			return EXTENT_HIT_CACHED;
+		}
+	}
+
+	node = rcu_dereference_raw(et->root.rb_root.rb_node);
+	while (node) {
+		en = rb_entry(node, struct extent_node, rb_node);
+		*ei = en->ei;
+
+		if (pgofs < ei->fofs) {
+			node = rcu_dereference_raw(node->rb_left);
+		} else if (pgofs >= ei->fofs + ei->len) {
+			node = rcu_dereference_raw(node->rb_right);
+		} else {
+			*enp = en;
+			return EXTENT_HIT_RBTREE;
+		}
+	}
+	return EXTENT_MISS;
+}
+
 static bool f2fs_lookup_extent_tree(struct inode *inode, pgoff_t pgofs,
 							struct extent_info *ei)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	struct extent_tree *et = F2FS_I(inode)->extent_tree;
-	struct extent_node *en;
-	bool ret = false;
+	struct extent_node *en = NULL;
+	unsigned int seq;
+	int hit;
 
 	f2fs_bug_on(sbi, !et);
 
 	trace_f2fs_lookup_extent_tree_start(inode, pgofs);
 
-	read_lock(&et->lock);
-
-	if (et->largest.fofs <= pgofs &&
-			et->largest.fofs + et->largest.len > pgofs) {
-		*ei = et->largest;
-		ret = true;
-		stat_inc_largest_node_hit(sbi);
-		goto out;
+	rcu_read_lock();
+	seq = read_seqcount_begin(&et->seq);
+	hit = __lookup_extent_tree(et, pgofs, ei, &en);
+	if (read_seqcount_retry(&et->seq, seq)) {
+		read_lock(&et->lock);
+		en = NULL;
+		hit = __lookup_extent_tree(et, pgofs, ei, &en);
+		read_unlock(&et->lock);
 	}
 
-	en = (struct extent_node *)f2fs_lookup_rb_tree(&et->root,
-				(struct rb_entry *)et->cached_en, pgofs);
-	if (!en)
-		goto out;
+	/* let the shrinker rotate it rather than moving it on every hit */
+	if (en && !READ_ONCE(en->referenced))
+		WRITE_ONCE(en->referenced, true);
+	rcu_read_unlock();
 
-	if (en == et->cached_en)
+	if (hit == EXTENT_HIT_LARGEST)
+		stat_inc_largest_node_hit(sbi);
+	else if (hit == EXTENT_HIT_CACHED)
 		stat_inc_cached_node_hit(sbi);
-	else
+	else if (hit == EXTENT_HIT_RBTREE)
 		stat_inc_rbtree_node_hit(sbi);
-
-	*ei = en->ei;
-	spin_lock(&sbi->extent_lock);
-	if (!list_empty(&en->list)) {
-		list_move_tail(&en->list, &sbi->extent_list);
-		et->cached_en = en;
-	}
-	spin_unlock(&sbi->extent_lock);
-	ret = true;
-out:
 	stat_inc_total_hit(sbi);
-	read_unlock(&et->lock);
 
 	trace_f2fs_lookup_extent_tree_end(inode, pgofs, ei);
-	return ret;
+	return hit != EXTENT_MISS;
 }
 
 static struct extent_node *__try_merge_extent_node(struct f2fs_sb_info *sbi,
@@ -545,10 +612,10 @@ static void f2fs_update_extent_tree_range(struct inode *inode,
 
 	trace_f2fs_update_extent_tree_range(inode, fofs, blkaddr, len);
 
-	write_lock(&et->lock);
+	extent_tree_write_lock(et);
 
 	if (is_inode_flag_set(inode, FI_NO_EXTENT)) {
-		write_unlock(&et->lock);
+		extent_tree_write_unlock(et);
 		return;
 	}
 
@@ -655,7 +722,7 @@ static void f2fs_update_extent_tree_range(struct inode *inode,
 		updated = true;
 	}
 
-	write_unlock(&et->lock);
+	extent_tree_write_unlock(et);
 
 	if (updated)
 		f2fs_mark_inode_dirty_sync(inode, true);
@@ -680,9 +747,9 @@ unsigned int f2fs_shrink_extent_tree(struct f2fs_sb_info *sbi, int nr_shrink)
 	/* 1. remove unreferenced extent tree */
 	list_for_each_entry_safe(et, next, &sbi->zombie_list, list) {
 		if (atomic_read(&et->node_cnt)) {
-			write_lock(&et->lock);
+			extent_tree_write_lock(et);
 			node_cnt += __free_extent_tree(sbi, et);
-			write_unlock(&et->lock);
+			extent_tree_write_unlock(et);
 		}
 		f2fs_bug_on(sbi, atomic_read(&et->node_cnt));
 		list_del_init(&et->list);
@@ -712,7 +779,15 @@ free_node:
 		en = list_first_entry(&sbi->extent_list,
 					struct extent_node, list);
 		et = en->et;
-		if (!write_trylock(&et->lock)) {
+
+		/* give nodes looked up since the last pass a second chance */
+		if (READ_ONCE(en->referenced)) {
+			WRITE_ONCE(en->referenced, false);
+			list_move_tail(&en->list, &sbi->extent_list);
+			continue;
+		}
+
+		if (!extent_tree_write_trylock(et)) {
 			/* refresh this extent node's position in extent list */
 			list_move_tail(&en->list, &sbi->extent_list);
 			continue;
@@ -723,7 +798,7 @@ free_node:
 
 		__detach_extent_node(sbi, et, en);
 
-		write_unlock(&et->lock);
+		extent_tree_write_unlock(et);
 		node_cnt++;
 		spin_lock(&sbi->extent_lock);
 	}
@@ -746,9 +821,9 @@ unsigned int f2fs_destroy_extent_node(struct inode *inode)
 	if (!et || !atomic_read(&et->node_cnt))
 		return 0;
 
-	write_lock(&et->lock);
+	extent_tree_write_lock(et);
 	node_cnt = __free_extent_tree(sbi, et);
-	write_unlock(&et->lock);
+	extent_tree_write_unlock(et);
 
 	return node_cnt;
 }
@@ -764,13 +839,13 @@ void f2fs_drop_extent_tree(struct inode *inode)
 
 	set_inode_flag(inode, FI_NO_EXTENT);
 
-	write_lock(&et->lock);
+	extent_tree_write_lock(et);
 	__free_extent_tree(sbi, et);
 	if (et->largest.len) {
 		et->largest.len = 0;
 		updated = true;
 	}
-	write_unlock(&et->lock);
+	extent_tree_write_unlock(et);
 	if (updated)
 		f2fs_mark_inode_dirty_sync(inode, true);
 }
@@ -864,8 +939,9 @@ int __init f2fs_create_extent_cache(void)
 			sizeof(struct extent_tree));
 	if (!extent_tree_slab)
 		return -ENOMEM;
-	extent_node_slab = f2fs_kmem_cache_create("f2fs_extent_node",
-			sizeof(struct extent_node));
+	extent_node_slab = kmem_cache_create("f2fs_extent_node",
+			sizeof(struct extent_node), 0,
+			SLAB_RECLAIM_ACCOUNT | SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!extent_node_slab) {
 		kmem_cache_destroy(extent_tree_slab);
 		return -ENOMEM;
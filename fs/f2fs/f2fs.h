@@ -219,8 +219,14 @@ struct cp_control {
 	__u64 trim_start;
 	__u64 trim_end;
 	__u64 trim_minlen;
+	void *cp_pack2;			/* async: cp pack 2 written after unblock */
+	block_t cp_pack2_blk;		/* async: address of cp pack 2 */
+	unsigned long *prefree_map;	/* async: prefree segments committed */
 };
 
+/* log2 buckets of the time checkpoint blocks FS operations, in ms */
+#define NR_CP_BLOCK_HIST	12
+
 /*
  * indicate meta/data type
  */
@@ -580,6 +586,7 @@ struct extent_node {
 	struct extent_info ei;		/* extent info */
 	struct list_head list;		/* node in global extent list of sbi */
 	struct extent_tree *et;		/* extent tree pointer */
+	bool referenced;		/* looked up since last LRU scan */
 };
 
 struct extent_tree {
@@ -589,6 +596,7 @@ struct extent_tree {
 	struct extent_info largest;	/* largested extent info */
 	struct list_head list;		/* to be used by sbi->zombie_list */
 	rwlock_t lock;			/* protect extent info rb-tree */
+	seqcount_rwlock_t seq;		/* lockless lookup of rb-tree */
 	atomic_t node_cnt;		/* # of extent node in rb-tree*/
 	bool largest_updated;		/* largest extent updated */
 };
@@ -1251,6 +1259,7 @@ enum {
 	GC_IDLE_AT,
 	GC_URGENT_HIGH,
 	GC_URGENT_LOW,
+	GC_IDLE_COLD,
 	MAX_GC_MODE,
 };
 
@@ -1460,6 +1469,25 @@ struct compress_ctx {
 	void *private2;			/* extra payload buffer */
 };
 
+/* max clusters of one writeback being compressed in parallel */
+#define COMPRESS_BATCH_MAX		8
+
+/* a cluster handed to the compress workqueue */
+struct compress_work {
+	struct work_struct work;
+	struct compress_ctx cc;		/* context moved out of writeback */
+	int err;			/* result of compression */
+	struct completion done;		/* compression finished */
+};
+
+/* clusters compressed ahead of writeback, written in cluster order */
+struct compress_batch {
+	unsigned int max;		/* clusters in flight at most */
+	unsigned int head;		/* oldest cluster in flight */
+	unsigned int nr;		/* clusters in flight */
+	struct compress_work works[COMPRESS_BATCH_MAX];
+};
+
 /* compress context for write IO path */
 struct compress_io_ctx {
 	u32 magic;			/* magic number to indicate page is compressed */
@@ -1513,6 +1541,7 @@ struct decompress_io_ctx {
 
 	bool failed;			/* IO error occurred before decompression? */
 	bool need_verity;		/* need fs-verity verification after decompression? */
+	bool hot;			/* decompressed before, then reclaimed */
 	void *private;			/* payload buffer for specified decompression algorithm */
 	void *private2;			/* extra payload buffer */
 	struct work_struct verity_work;	/* work to verify the decompressed pages */
@@ -1560,6 +1589,11 @@ struct f2fs_sb_info {
 	struct rw_semaphore node_write;		/* locking node writes */
 	struct rw_semaphore node_change;	/* locking node change */
 	wait_queue_head_t cp_wait;
+	unsigned int ckpt_async;		/* commit CP_SYNC after unblocking */
+	bool cp_async_busy;			/* async commit in flight */
+	wait_queue_head_t cp_async_wait;	/* wait for async commit */
+	ktime_t cp_block_start;			/* FS operations blocked since */
+	unsigned int cp_block_hist[NR_CP_BLOCK_HIST];	/* blocked time */
 	unsigned long last_time[MAX_TIME];	/* to store time in jiffies */
 	long interval_time[MAX_TIME];		/* to store thresholds */
 	struct ckpt_req_control cprc_info;	/* for checkpoint request control */
@@ -1668,10 +1702,7 @@ struct f2fs_sb_info {
 	unsigned int segment_count[2];		/* # of allocated segments */
 	unsigned int block_count[2];		/* # of allocated blocks */
 	atomic_t inplace_count;		/* # of inplace update */
-	atomic64_t total_hit_ext;		/* # of lookup extent cache */
-	atomic64_t read_hit_rbtree;		/* # of hit rbtree extent node */
-	atomic64_t read_hit_largest;		/* # of hit largest extent node */
-	atomic64_t read_hit_cached;		/* # of hit cached extent node */
+	struct extent_hit_stat __percpu *ext_hits; /* extent cache lookups */
 	atomic_t inline_xattr;			/* # of inline_xattr inodes */
 	atomic_t inline_inode;			/* # of inline_data inodes */
 	atomic_t inline_dir;			/* # of inline_dentry inodes */
@@ -1735,6 +1766,8 @@ struct f2fs_sb_info {
 	/* For reclaimed segs statistics per each GC mode */
 	unsigned int gc_segment_mode;		/* GC state for reclaimed segments */
 	unsigned int gc_reclaimed_segs[MAX_GC_MODE];	/* Reclaimed segs for each mode */
+	unsigned long long gc_moved_blks[MAX_GC_MODE];	/* Moved blocks for each mode */
+	unsigned int gc_hot_threshold;		/* section heat skipped by GC_COLD */
 
 #ifdef CONFIG_F2FS_FS_COMPRESSION
 	struct kmem_cache *page_array_slab;	/* page array entry */
@@ -1745,11 +1778,21 @@ struct f2fs_sb_info {
 	u64 compr_saved_block;
 	u32 compr_new_inode;
 
+	/* workqueue compressing clusters ahead of writeback */
+	struct workqueue_struct *compress_wq;
+
+	/* For per-algorithm compression throughput */
+	atomic64_t compr_in_bytes[COMPRESS_MAX];
+	atomic64_t compr_out_bytes[COMPRESS_MAX];
+	atomic64_t compr_time_ns[COMPRESS_MAX];
+
 	/* For compressed block cache */
 	struct inode *compress_inode;		/* cache compressed blocks */
 	unsigned int compress_percent;		/* cache page percentage */
 	unsigned int compress_watermark;	/* cache page watermark */
 	atomic_t compress_page_hit;		/* cache hit count */
+	atomic_t compress_page_miss;		/* cache miss count */
+	pgoff_t compress_shrink_index;		/* where the shrinker goes on */
 #endif
 };
 
@@ -3575,6 +3618,7 @@ int f2fs_issue_checkpoint(struct f2fs_sb_info *sbi);
 int f2fs_start_ckpt_thread(struct f2fs_sb_info *sbi);
 void f2fs_stop_ckpt_thread(struct f2fs_sb_info *sbi);
 void f2fs_init_ckpt_req_control(struct f2fs_sb_info *sbi);
+void f2fs_wait_on_async_checkpoint(struct f2fs_sb_info *sbi);
 
 /*
  * data.c
@@ -3665,6 +3709,16 @@ void f2fs_destroy_recovery_cache(void);
  * debug.c
  */
 #ifdef CONFIG_F2FS_STAT_FS
+#define NR_SEG_HEAT_BUCKETS	5	/* section heat: 0, <4, <16, <64, >=64 */
+
+/* per-cpu, so that extent cache hits don't write shared cache lines */
+struct extent_hit_stat {
+	u64 total;			/* # of lookup extent cache */
+	u64 rbtree;			/* # of hit rbtree extent node */
+	u64 largest;			/* # of hit largest extent node */
+	u64 cached;			/* # of hit cached extent node */
+};
+
 struct f2fs_stat_info {
 	struct list_head stat_list;
 	struct f2fs_sb_info *sbi;
@@ -3696,10 +3750,14 @@ struct f2fs_stat_info {
 	int aw_cnt, max_aw_cnt, vw_cnt, max_vw_cnt;
 	unsigned int valid_count, valid_node_count, valid_inode_count, discard_blks;
 	unsigned int bimodal, avg_vblocks;
+	unsigned int heat_hist[NR_SEG_HEAT_BUCKETS];
 	int util_free, util_valid, util_invalid;
 	int rsvd_segs, overp_segs;
 	int dirty_count, node_pages, meta_pages, compress_pages;
 	int compress_page_hit;
+	unsigned long long compr_in_bytes[COMPRESS_MAX];
+	unsigned long long compr_out_bytes[COMPRESS_MAX];
+	unsigned long long compr_time_ns[COMPRESS_MAX];
 	int prefree_count, call_count, cp_count, bg_cp_count;
 	int tot_segs, node_segs, data_segs, free_segs, free_secs;
 	int bg_node_segs, bg_data_segs;
@@ -3733,10 +3791,10 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 #define stat_other_skip_bggc_count(sbi)	((sbi)->other_skip_bggc++)
 #define stat_inc_dirty_inode(sbi, type)	((sbi)->ndirty_inode[type]++)
 #define stat_dec_dirty_inode(sbi, type)	((sbi)->ndirty_inode[type]--)
-#define stat_inc_total_hit(sbi)		(atomic64_inc(&(sbi)->total_hit_ext))
-#define stat_inc_rbtree_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_rbtree))
-#define stat_inc_largest_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_largest))
-#define stat_inc_cached_node_hit(sbi)	(atomic64_inc(&(sbi)->read_hit_cached))
+#define stat_inc_total_hit(sbi)		this_cpu_inc((sbi)->ext_hits->total)
+#define stat_inc_rbtree_node_hit(sbi)	this_cpu_inc((sbi)->ext_hits->rbtree)
+#define stat_inc_largest_node_hit(sbi)	this_cpu_inc((sbi)->ext_hits->largest)
+#define stat_inc_cached_node_hit(sbi)	this_cpu_inc((sbi)->ext_hits->cached)
 #define stat_inc_inline_xattr(inode)					\
 	do {								\
 		if (f2fs_has_inline_xattr(inode))			\
@@ -4045,6 +4103,19 @@ int f2fs_write_multi_pages(struct compress_ctx *cc,
 						int *submitted,
 						struct writeback_control *wbc,
 						enum iostat_type io_type);
+struct compress_batch *f2fs_alloc_compress_batch(struct inode *inode);
+void f2fs_free_compress_batch(struct compress_batch *cb);
+int f2fs_write_multi_pages_batch(struct compress_batch *cb,
+						struct compress_ctx *cc,
+						int *submitted,
+						struct writeback_control *wbc,
+						enum iostat_type io_type);
+int f2fs_flush_compress_batch(struct compress_batch *cb,
+						int *submitted,
+						struct writeback_control *wbc,
+						enum iostat_type io_type);
+int f2fs_init_compress_wq(struct f2fs_sb_info *sbi);
+void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi);
 int f2fs_is_compressed_cluster(struct inode *inode, pgoff_t index);
 int f2fs_read_multi_pages(struct compress_ctx *cc, struct bio **bio_ret,
 				unsigned nr_pages, sector_t *last_block_in_bio,
@@ -4068,6 +4139,9 @@ void f2fs_cache_compressed_page(struct f2fs_sb_info *sbi, struct page *page,
 bool f2fs_load_compressed_page(struct f2fs_sb_info *sbi, struct page *page,
 								block_t blkaddr);
 void f2fs_invalidate_compress_pages(struct f2fs_sb_info *sbi, nid_t ino);
+unsigned long f2fs_count_compress_pages(struct f2fs_sb_info *sbi);
+unsigned long f2fs_shrink_compress_pages(struct f2fs_sb_info *sbi,
+						unsigned long nr_shrink);
 #define inc_compr_inode_stat(inode)					\
 	do {								\
 		struct f2fs_sb_info *sbi = F2FS_I_SB(inode);		\
@@ -4110,6 +4184,8 @@ static inline int f2fs_init_compress_inode(struct f2fs_sb_info *sbi) { return 0;
 static inline void f2fs_destroy_compress_inode(struct f2fs_sb_info *sbi) { }
 static inline int f2fs_init_page_array_cache(struct f2fs_sb_info *sbi) { return 0; }
 static inline void f2fs_destroy_page_array_cache(struct f2fs_sb_info *sbi) { }
+static inline int f2fs_init_compress_wq(struct f2fs_sb_info *sbi) { return 0; }
+static inline void f2fs_destroy_compress_wq(struct f2fs_sb_info *sbi) { }
 static inline int __init f2fs_init_compress_cache(void) { return 0; }
 static inline void f2fs_destroy_compress_cache(void) { }
 static inline void f2fs_invalidate_compress_page(struct f2fs_sb_info *sbi,
@@ -4120,6 +4196,15 @@ static inline bool f2fs_load_compressed_page(struct f2fs_sb_info *sbi,
 				struct page *page, block_t blkaddr) { return false; }
 static inline void f2fs_invalidate_compress_pages(struct f2fs_sb_info *sbi,
 							nid_t ino) { }
+static inline unsigned long f2fs_count_compress_pages(struct f2fs_sb_info *sbi)
+{
+	return 0;
+}
+static inline unsigned long f2fs_shrink_compress_pages(struct f2fs_sb_info *sbi,
+						unsigned long nr_shrink)
+{
+	return 0;
+}
 #define inc_compr_inode_stat(inode)		do { } while (0)
 #endif
 
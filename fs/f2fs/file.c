@@ -372,6 +372,15 @@ flush_out:
 	}
 	f2fs_update_time(sbi, REQ_TIME);
 out:
+	/*
+	 * Data covered by, or nodes written during, an async checkpoint
+	 * commit are only stable once it completed.
+	 */
+	if (!ret && unlikely(READ_ONCE(sbi->cp_async_busy))) {
+		f2fs_wait_on_async_checkpoint(sbi);
+		if (f2fs_cp_error(sbi))
+			ret = -EIO;
+	}
 	trace_f2fs_sync_file_exit(inode, cp_reason, datasync, ret);
 	return ret;
 }
@@ -538,7 +547,7 @@ static int f2fs_file_open(struct inode *inode, struct file *filp)
 	if (err)
 		return err;
 
-	filp->f_mode |= FMODE_NOWAIT;
+	filp->f_mode |= FMODE_NOWAIT | FMODE_BUF_RASYNC;
 
 	return dquot_file_open(inode, filp);
 }
@@ -2977,6 +2986,7 @@ static int f2fs_ioc_flush_device(struct file *filp, unsigned long arg)
 		}
 		sm->last_victim[GC_CB] = end_segno + 1;
 		sm->last_victim[GC_GREEDY] = end_segno + 1;
+		sm->last_victim[GC_COLD] = end_segno + 1;
 		sm->last_victim[ALLOC_NEXT] = end_segno + 1;
 		ret = f2fs_gc(sbi, true, true, true, start_segno);
 		if (ret == -EAGAIN)
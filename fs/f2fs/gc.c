@@ -212,6 +212,9 @@ static int select_gc_type(struct f2fs_sb_info *sbi, int gc_type)
 	case GC_IDLE_AT:
 		gc_mode = GC_AT;
 		break;
+	case GC_IDLE_COLD:
+		gc_mode = GC_COLD;
+		break;
 	}
 
 	return gc_mode;
@@ -279,6 +282,8 @@ static unsigned int get_max_cost(struct f2fs_sb_info *sbi,
 		return UINT_MAX;
 	else if (p->gc_mode == GC_AT)
 		return UINT_MAX;
+	else if (p->gc_mode == GC_COLD)
+		return UINT_MAX;
 	else /* No other gc_mode */
 		return 0;
 }
@@ -344,7 +349,7 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 	/* alloc_mode == LFS */
 	if (p->gc_mode == GC_GREEDY)
 		return get_valid_blocks(sbi, segno, true);
-	else if (p->gc_mode == GC_CB)
+	else if (p->gc_mode == GC_CB || p->gc_mode == GC_COLD)
 		return get_cb_cost(sbi, segno);
 
 	f2fs_bug_on(sbi, 1);
@@ -767,6 +772,12 @@ retry:
 		if (gc_type == BG_GC && test_bit(secno, dirty_i->victim_secmap))
 			goto next;
 
+		/* leave sections still being rewritten to invalidate themselves */
+		if (gc_type == BG_GC && p.gc_mode == GC_COLD &&
+				sbi->gc_hot_threshold &&
+				get_sec_heat(sbi, segno) >= sbi->gc_hot_threshold)
+			goto next;
+
 		if (is_atgc) {
 			add_victim_entry(sbi, &p, segno);
 			goto next;
@@ -1155,7 +1166,8 @@ static int move_data_block(struct inode *inode, block_t bidx,
 	int err = 0;
 	bool lfs_mode = f2fs_lfs_mode(fio.sbi);
 	int type = fio.sbi->am.atgc_enabled && (gc_type == BG_GC) &&
-				(fio.sbi->gc_mode != GC_URGENT_HIGH) ?
+				(fio.sbi->gc_mode != GC_URGENT_HIGH) &&
+				(fio.sbi->gc_mode != GC_IDLE_COLD) ?
 				CURSEG_ALL_DATA_ATGC : CURSEG_COLD_DATA;
 
 	/* do not read out */
@@ -1303,6 +1315,19 @@ out:
 	return err;
 }
 
+/*
+ * Blocks are copied through the meta mapping instead of being dirtied in
+ * the page cache when their contents can't be used as is, and by GC_COLD
+ * so cold blocks go straight to the cold log in one batch instead of being
+ * written back among user data.
+ */
+static bool gc_copy_data_block(struct inode *inode, int gc_type)
+{
+	if (f2fs_post_read_required(inode))
+		return true;
+	return gc_type == BG_GC && F2FS_I_SB(inode)->gc_mode == GC_IDLE_COLD;
+}
+
 static int move_data_page(struct inode *inode, block_t bidx, int gc_type,
 							unsigned int segno, int off)
 {
@@ -1464,7 +1489,7 @@ next_step:
 			start_bidx = f2fs_start_bidx_of_node(nofs, inode) +
 								ofs_in_node;
 
-			if (f2fs_post_read_required(inode)) {
+			if (gc_copy_data_block(inode, gc_type)) {
 				int err = ra_data_block(inode, start_bidx);
 
 				up_write(&F2FS_I(inode)->i_gc_rwsem[WRITE]);
@@ -1513,7 +1538,7 @@ next_step:
 
 			start_bidx = f2fs_start_bidx_of_node(nofs, inode)
 								+ ofs_in_node;
-			if (f2fs_post_read_required(inode))
+			if (gc_copy_data_block(inode, gc_type))
 				err = move_data_block(inode, start_bidx,
 							gc_type, segno, off);
 			else
@@ -1521,7 +1546,7 @@ next_step:
 								segno, off);
 
 			if (!err && (gc_type == FG_GC ||
-					f2fs_post_read_required(inode)))
+					gc_copy_data_block(inode, gc_type)))
 				submitted++;
 
 			if (locked) {
@@ -1630,6 +1655,9 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 			goto skip;
 		}
 
+		sbi->gc_moved_blks[sbi->gc_mode] +=
+					get_valid_blocks(sbi, segno, false);
+
 		/*
 		 * this is to avoid deadlock:
 		 * - lock_page(sum_page)         - f2fs_replace_block
@@ -1830,6 +1858,7 @@ void f2fs_build_gc_manager(struct f2fs_sb_info *sbi)
 	DIRTY_I(sbi)->v_ops = &default_v_ops;
 
 	sbi->gc_pin_file_threshold = DEF_GC_FAILED_PINNED_FILES;
+	sbi->gc_hot_threshold = DEF_GC_HOT_THRESHOLD;
 
 	/* give warm/cold data area from slower device */
 	if (f2fs_is_multi_device(sbi) && !__is_large_section(sbi))
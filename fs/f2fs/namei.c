@@ -351,6 +351,7 @@ static int f2fs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
 	inode->i_op = &f2fs_file_inode_operations;
 	inode->i_fop = &f2fs_file_operations;
 	inode->i_mapping->a_ops = &f2fs_dblock_aops;
+	mapping_set_ra_contig(inode->i_mapping);
 	ino = inode->i_ino;
 
 	f2fs_lock_op(sbi);
@@ -1999,7 +1999,8 @@ void f2fs_clear_prefree_segments(struct f2fs_sb_info *sbi,
 	struct list_head *head = &dcc->entry_list;
 	struct discard_entry *entry, *this;
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
-	unsigned long *prefree_map = dirty_i->dirty_segmap[PRE];
+	unsigned long *prefree_map = cpc->prefree_map ? :
+					dirty_i->dirty_segmap[PRE];
 	unsigned int start = 0, end = -1;
 	unsigned int secno, start_segno;
 	bool force = (cpc->reason & CP_DISCARD);
@@ -2024,7 +2025,7 @@ void f2fs_clear_prefree_segments(struct f2fs_sb_info *sbi,
 		}
 
 		for (i = start; i < end; i++) {
-			if (test_and_clear_bit(i, prefree_map))
+			if (test_and_clear_bit(i, dirty_i->dirty_segmap[PRE]))
 				dirty_i->nr_dirty[PRE]--;
 		}
 
@@ -2299,6 +2300,13 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 		if (f2fs_test_and_clear_bit(offset, se->discard_map))
 			sbi->discard_blks++;
+
+		/* migrating blocks out of a GC victim does not make it hot */
+		if (!se->valid_blocks)
+			se->heat = 0;
+		else if (exist && !is_gc_victim_sec(sbi,
+					GET_SEC_FROM_SEG(sbi, segno)))
+			update_segment_heat(sbi, se);
 	}
 	if (!f2fs_test_bit(offset, se->ckpt_valid_map))
 		se->ckpt_valid_blocks += del;
@@ -159,11 +159,13 @@ enum {
  * GC_CB is based on cost-benefit algorithm.
  * GC_GREEDY is based on greedy algorithm.
  * GC_AT is based on age-threshold algorithm.
+ * GC_COLD is cost-benefit skipping sections with recent hot writes.
  */
 enum {
 	GC_CB = 0,
 	GC_GREEDY,
 	GC_AT,
+	GC_COLD,
 	ALLOC_NEXT,
 	FLUSH_DEVICE,
 	MAX_GC_POLICY,
@@ -212,6 +214,8 @@ struct seg_entry {
 	unsigned char *ckpt_valid_map;	/* validity bitmap of blocks last cp */
 	unsigned char *discard_map;
 	unsigned long long mtime;	/* modification time of the segment */
+	unsigned int heat_window;	/* heat window of the last invalidation */
+	unsigned short heat;		/* invalidations, halved every window */
 };
 
 struct sec_entry {
@@ -224,6 +228,14 @@ struct segment_allocation {
 
 #define MAX_SKIP_GC_COUNT			16
 
+/*
+ * Write frequency of a segment is the number of its blocks invalidated by
+ * overwrites or deletes, decayed by half every SEG_HEAT_WINDOW seconds.
+ */
+#define SEG_HEAT_WINDOW			60
+#define SEG_HEAT_MAX			USHRT_MAX
+#define DEF_GC_HOT_THRESHOLD		64	/* heat to skip a section in GC_COLD */
+
 struct inmem_pages {
 	struct list_head list;
 	struct page *page;
@@ -816,6 +828,51 @@ static inline unsigned long long get_mtime(struct f2fs_sb_info *sbi,
 	return sit_i->elapsed_time;
 }
 
+static inline unsigned int get_heat_window(struct f2fs_sb_info *sbi)
+{
+	return div_u64(get_mtime(sbi, false), SEG_HEAT_WINDOW);
+}
+
+static inline unsigned int __seg_heat(struct seg_entry *se,
+						unsigned int window)
+{
+	unsigned int age = window - se->heat_window;
+
+	if (age >= 16)
+		return 0;
+	return se->heat >> age;
+}
+
+static inline bool is_gc_victim_sec(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	return secno == sbi->cur_victim_sec ||
+		test_bit(secno, DIRTY_I(sbi)->victim_secmap);
+}
+
+static inline void update_segment_heat(struct f2fs_sb_info *sbi,
+						struct seg_entry *se)
+{
+	unsigned int window = get_heat_window(sbi);
+	unsigned int heat = __seg_heat(se, window) + 1;
+
+	se->heat = min_t(unsigned int, heat, SEG_HEAT_MAX);
+	se->heat_window = window;
+}
+
+/* sum of the decayed write frequency of all segments in the section */
+static inline unsigned int get_sec_heat(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned int start = rounddown(segno, sbi->segs_per_sec);
+	unsigned int window = get_heat_window(sbi);
+	unsigned int i, heat = 0;
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		heat += __seg_heat(get_seg_entry(sbi, start + i), window);
+	return heat;
+}
+
 static inline void set_summary(struct f2fs_summary *sum, nid_t nid,
 			unsigned int ofs_in_node, unsigned char version)
 {
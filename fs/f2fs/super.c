@@ -1454,6 +1454,7 @@ static void f2fs_put_super(struct super_block *sb)
 	f2fs_destroy_node_manager(sbi);
 	f2fs_destroy_segment_manager(sbi);
 
+	f2fs_destroy_compress_wq(sbi);
 	f2fs_destroy_post_read_wq(sbi);
 
 	kvfree(sbi->ckpt);
@@ -3849,6 +3850,7 @@ try_onemore:
 	init_rwsem(&sbi->cp_rwsem);
 	init_rwsem(&sbi->quota_sem);
 	init_waitqueue_head(&sbi->cp_wait);
+	init_waitqueue_head(&sbi->cp_async_wait);
 	init_sb_info(sbi);
 
 	err = init_percpu_info(sbi);
@@ -3909,6 +3911,12 @@ try_onemore:
 		goto free_devices;
 	}
 
+	err = f2fs_init_compress_wq(sbi);
+	if (err) {
+		f2fs_err(sbi, "Failed to initialize compress workqueue");
+		goto free_post_read_wq;
+	}
+
 	sbi->total_valid_node_count =
 				le32_to_cpu(sbi->ckpt->valid_node_count);
 	percpu_counter_set(&sbi->total_valid_inode_count,
@@ -4168,9 +4176,11 @@ free_nm:
 	f2fs_destroy_node_manager(sbi);
 free_sm:
 	f2fs_destroy_segment_manager(sbi);
+free_post_read_wq:
 	f2fs_destroy_post_read_wq(sbi);
 stop_ckpt_thread:
 	f2fs_stop_ckpt_thread(sbi);
+	f2fs_destroy_compress_wq(sbi);
 free_devices:
 	destroy_device_list(sbi);
 	kvfree(sbi->ckpt);
@@ -241,6 +241,20 @@ static ssize_t avg_vblocks_show(struct f2fs_attr *a,
 }
 #endif
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+static ssize_t compr_cache_hit_show(struct f2fs_attr *a,
+				struct f2fs_sb_info *sbi, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", atomic_read(&sbi->compress_page_hit));
+}
+
+static ssize_t compr_cache_miss_show(struct f2fs_attr *a,
+				struct f2fs_sb_info *sbi, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", atomic_read(&sbi->compress_page_miss));
+}
+#endif
+
 static ssize_t main_blkaddr_show(struct f2fs_attr *a,
 				struct f2fs_sb_info *sbi, char *buf)
 {
@@ -315,6 +329,11 @@ static ssize_t f2fs_sbi_show(struct f2fs_attr *a,
 			sbi->gc_reclaimed_segs[sbi->gc_segment_mode]);
 	}
 
+	if (!strcmp(a->attr.name, "gc_moved_blocks")) {
+		return sysfs_emit(buf, "%llu\n",
+			sbi->gc_moved_blks[sbi->gc_segment_mode]);
+	}
+
 	ui = (unsigned int *)(ptr + a->offset);
 
 	return sprintf(buf, "%u\n", *ui);
@@ -469,12 +488,22 @@ out:
 			if (!sbi->am.atgc_enabled)
 				return -EINVAL;
 			sbi->gc_mode = GC_AT;
+		} else if (t == GC_IDLE_COLD) {
+			/* don't resume from where the last cold pass stopped */
+			if (sbi->gc_mode != GC_IDLE_COLD)
+				SIT_I(sbi)->last_victim[GC_COLD] = 0;
+			sbi->gc_mode = GC_IDLE_COLD;
 		} else {
 			sbi->gc_mode = GC_NORMAL;
 		}
 		return count;
 	}
 
+	if (!strcmp(a->attr.name, "ckpt_async")) {
+		sbi->ckpt_async = !!t;
+		return count;
+	}
+
 	if (!strcmp(a->attr.name, "iostat_enable")) {
 		sbi->iostat_enable = !!t;
 		if (!sbi->iostat_enable)
@@ -538,6 +567,13 @@ out:
 		return count;
 	}
 
+	if (!strcmp(a->attr.name, "gc_moved_blocks")) {
+		if (t != 0)
+			return -EINVAL;
+		sbi->gc_moved_blks[sbi->gc_segment_mode] = 0;
+		return count;
+	}
+
 	*ui = (unsigned int)t;
 
 	return count;
@@ -691,6 +727,7 @@ F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_idle_interval, interval_time[GC_TIME]);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info,
 		umount_discard_timeout, interval_time[UMOUNT_DISCARD_TIMEOUT]);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, iostat_enable, iostat_enable);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, ckpt_async, ckpt_async);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, iostat_period_ms, iostat_period_ms);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, readdir_ra, readdir_ra);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, max_io_bytes, max_io_bytes);
@@ -754,6 +791,8 @@ F2FS_FEATURE_RO_ATTR(compression);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, compr_written_block, compr_written_block);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, compr_saved_block, compr_saved_block);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, compr_new_inode, compr_new_inode);
+F2FS_GENERAL_RO_ATTR(compr_cache_hit);
+F2FS_GENERAL_RO_ATTR(compr_cache_miss);
 #endif
 F2FS_FEATURE_RO_ATTR(pin_file);
 
@@ -765,6 +804,8 @@ F2FS_RW_ATTR(ATGC_INFO, atgc_management, atgc_age_threshold, age_threshold);
 
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_segment_mode, gc_segment_mode);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_reclaimed_segments, gc_reclaimed_segs);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_moved_blocks, gc_moved_blks);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_hot_threshold, gc_hot_threshold);
 
 #define ATTR_LIST(name) (&f2fs_attr_##name.attr)
 static struct attribute *f2fs_attrs[] = {
@@ -797,6 +838,7 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(gc_idle_interval),
 	ATTR_LIST(umount_discard_timeout),
 	ATTR_LIST(iostat_enable),
+	ATTR_LIST(ckpt_async),
 	ATTR_LIST(iostat_period_ms),
 	ATTR_LIST(readdir_ra),
 	ATTR_LIST(max_io_bytes),
@@ -832,6 +874,8 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(compr_written_block),
 	ATTR_LIST(compr_saved_block),
 	ATTR_LIST(compr_new_inode),
+	ATTR_LIST(compr_cache_hit),
+	ATTR_LIST(compr_cache_miss),
 #endif
 	/* For ATGC */
 	ATTR_LIST(atgc_candidate_ratio),
@@ -840,6 +884,8 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(atgc_age_threshold),
 	ATTR_LIST(gc_segment_mode),
 	ATTR_LIST(gc_reclaimed_segments),
+	ATTR_LIST(gc_moved_blocks),
+	ATTR_LIST(gc_hot_threshold),
 	NULL,
 };
 ATTRIBUTE_GROUPS(f2fs);
@@ -11,6 +11,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/fs_context.h>
+#include <linux/seq_file.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -227,6 +228,44 @@ static const struct file_operations fuse_conn_congestion_threshold_ops = {
 	.llseek = no_llseek,
 };
 
+#ifdef CONFIG_FUSE_DAX
+static int fuse_conn_dax_ranges_show(struct seq_file *m, void *v)
+{
+	fuse_dax_show_ranges(m, m->private);
+	return 0;
+}
+
+static int fuse_conn_dax_ranges_open(struct inode *inode, struct file *file)
+{
+	struct fuse_conn *fc = fuse_ctl_file_conn_get(file);
+	int ret;
+
+	if (!fc)
+		return -ENOTCONN;
+
+	ret = single_open(file, fuse_conn_dax_ranges_show, fc);
+	if (ret)
+		fuse_conn_put(fc);
+	return ret;
+}
+
+static int fuse_conn_dax_ranges_release(struct inode *inode,
+					struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	fuse_conn_put(m->private);
+	return single_release(inode, file);
+}
+
+static const struct file_operations fuse_conn_dax_ranges_ops = {
+	.open = fuse_conn_dax_ranges_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = fuse_conn_dax_ranges_release,
+};
+#endif
+
 static struct dentry *fuse_ctl_add_dentry(struct dentry *parent,
 					  struct fuse_conn *fc,
 					  const char *name,
@@ -298,6 +337,13 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 &fuse_conn_congestion_threshold_ops))
 		goto err;
 
+#ifdef CONFIG_FUSE_DAX
+	if (fc->dax &&
+	    !fuse_ctl_add_dentry(parent, fc, "dax_ranges", S_IFREG | 0400, 1,
+				 NULL, &fuse_conn_dax_ranges_ops))
+		goto err;
+#endif
+
 	return 0;
 
  err:
@@ -12,6 +12,7 @@
 #include <linux/pfn_t.h>
 #include <linux/iomap.h>
 #include <linux/interval_tree.h>
+#include <linux/seq_file.h>
 
 /*
  * Default memory range size.  A power of 2 so it agrees with common FUSE_INIT
@@ -56,6 +57,9 @@ struct fuse_dax_mapping {
 
 	/* reference count when the mapping is used by dax iomap. */
 	refcount_t refcnt;
+
+	/* Used since the reclaimer last passed, gets it a second chance */
+	bool referenced;
 };
 
 /* Per-inode dax map */
@@ -66,6 +70,10 @@ struct fuse_inode_dax {
 	/* Sorted rb tree of struct fuse_dax_mapping elements */
 	struct rb_root_cached tree;
 	unsigned long nr;
+
+	/* Ranges mapped and reclaimed over the lifetime of the inode */
+	unsigned long nr_setup;
+	unsigned long nr_reclaimed;
 };
 
 struct fuse_conn_dax {
@@ -90,6 +98,12 @@ struct fuse_conn_dax {
 	struct list_head free_ranges;
 
 	unsigned long nr_ranges;
+
+	/* Statistics, shown in the fusectl dax_ranges file */
+	atomic_long_t nr_setupmapping;
+	atomic_long_t nr_removemapping;
+	atomic_long_t nr_reclaimed;
+	atomic_long_t nr_second_chance;
 };
 
 static inline struct fuse_dax_mapping *
@@ -209,7 +223,9 @@ static int fuse_setup_one_mapping(struct inode *inode, unsigned long start_idx,
 	err = fuse_simple_request(fm, &args);
 	if (err < 0)
 		return err;
+	atomic_long_inc(&fcd->nr_setupmapping);
 	dmap->writable = writable;
+	WRITE_ONCE(dmap->referenced, true);
 	if (!upgrade) {
 		/*
 		 * We don't take a refernce on inode. inode is valid right now
@@ -221,6 +237,7 @@ static int fuse_setup_one_mapping(struct inode *inode, unsigned long start_idx,
 		/* Protected by fi->dax->sem */
 		interval_tree_insert(&dmap->itn, &fi->dax->tree);
 		fi->dax->nr++;
+		fi->dax->nr_setup++;
 		spin_lock(&fcd->lock);
 		list_add_tail(&dmap->busy_list, &fcd->busy_ranges);
 		fcd->nr_busy_ranges++;
@@ -237,6 +254,7 @@ static int fuse_send_removemapping(struct inode *inode,
 	struct fuse_mount *fm = get_fuse_mount(inode);
 	FUSE_ARGS(args);
 
+	atomic_long_inc(&fm->fc->dax->nr_removemapping);
 	args.opcode = FUSE_REMOVEMAPPING;
 	args.nodeid = fi->nodeid;
 	args.in_numargs = 2;
@@ -417,6 +435,9 @@ static void fuse_fill_iomap(struct inode *inode, loff_t pos, loff_t length,
 		 * shared/exclusive.
 		 */
 		refcount_inc(&dmap->refcnt);
+		/* Racy, but only a hint for the reclaimer */
+		if (!READ_ONCE(dmap->referenced))
+			WRITE_ONCE(dmap->referenced, true);
 
 		/* iomap->private should be NULL */
 		WARN_ON_ONCE(iomap->private);
@@ -892,8 +913,12 @@ static int dmap_writeback_invalidate(struct inode *inode,
 	return ret;
 }
 
-static int reclaim_one_dmap_locked(struct inode *inode,
-				   struct fuse_dax_mapping *dmap)
+/*
+ * Write back and unmap a range, and take it out of the inode interval tree.
+ * The caller still has to tell the daemon with FUSE_REMOVEMAPPING.
+ */
+static int detach_one_dmap_locked(struct inode *inode,
+				  struct fuse_dax_mapping *dmap)
 {
 	int ret;
 	struct fuse_inode *fi = get_fuse_inode(inode);
@@ -909,6 +934,19 @@ static int reclaim_one_dmap_locked(struct inode *inode,
 	/* Remove dax mapping from inode interval tree now */
 	interval_tree_remove(&dmap->itn, &fi->dax->tree);
 	fi->dax->nr--;
+	fi->dax->nr_reclaimed++;
+	atomic_long_inc(&get_fuse_conn(inode)->dax->nr_reclaimed);
+	return 0;
+}
+
+static int reclaim_one_dmap_locked(struct inode *inode,
+				   struct fuse_dax_mapping *dmap)
+{
+	int ret;
+
+	ret = detach_one_dmap_locked(inode, dmap);
+	if (ret)
+		return ret;
 
 	/* It is possible that umount/shutdown has killed the fuse connection
 	 * and worker thread is trying to reclaim memory in parallel.  Don't
@@ -1072,57 +1110,34 @@ alloc_dax_mapping_reclaim(struct fuse_conn_dax *fcd, struct inode *inode)
 	}
 }
 
-static int lookup_and_reclaim_dmap_locked(struct fuse_conn_dax *fcd,
-					  struct inode *inode,
-					  unsigned long start_idx)
-{
-	int ret;
-	struct fuse_inode *fi = get_fuse_inode(inode);
-	struct fuse_dax_mapping *dmap;
-	struct interval_tree_node *node;
-
-	/* Find fuse dax mapping at file offset inode. */
-	node = interval_tree_iter_first(&fi->dax->tree, start_idx, start_idx);
-
-	/* Range already got cleaned up by somebody else */
-	if (!node)
-		return 0;
-	dmap = node_to_dmap(node);
-
-	/* still in use. */
-	if (refcount_read(&dmap->refcnt) > 1)
-		return 0;
-
-	ret = reclaim_one_dmap_locked(inode, dmap);
-	if (ret < 0)
-		return ret;
-
-	/* Cleanup dmap entry and add back to free list */
-	spin_lock(&fcd->lock);
-	dmap_reinit_add_to_free_pool(fcd, dmap);
-	spin_unlock(&fcd->lock);
-	return ret;
-}
-
 /*
- * Free a range of memory.
+ * Free the ranges of an inode starting at the given indexes that are still
+ * mapped and idle, with one FUSE_REMOVEMAPPING for all of them.
  * Locking:
  * 1. Take fi->i_mmap_sem to block dax faults.
  * 2. Take fi->dax->sem to protect interval tree and also to make sure
  *    read/write can not reuse a dmap which we might be freeing.
  */
-static int lookup_and_reclaim_dmap(struct fuse_conn_dax *fcd,
-				   struct inode *inode,
-				   unsigned long start_idx,
-				   unsigned long end_idx)
+static int lookup_and_reclaim_dmaps(struct fuse_conn_dax *fcd,
+				    struct inode *inode,
+				    const unsigned long *idx, unsigned int nr)
 {
-	int ret;
 	struct fuse_inode *fi = get_fuse_inode(inode);
-	loff_t dmap_start = start_idx << FUSE_DAX_SHIFT;
-	loff_t dmap_end = (dmap_start + FUSE_DAX_SZ) - 1;
+	struct fuse_dax_mapping *dmap, *n;
+	struct interval_tree_node *node;
+	unsigned long first = idx[0], last = idx[0];
+	unsigned int i, num = 0;
+	LIST_HEAD(to_remove);
+	int ret;
+
+	for (i = 1; i < nr; i++) {
+		first = min(first, idx[i]);
+		last = max(last, idx[i]);
+	}
 
 	down_write(&fi->i_mmap_sem);
-	ret = fuse_dax_break_layouts(inode, dmap_start, dmap_end);
+	ret = fuse_dax_break_layouts(inode, (loff_t)first << FUSE_DAX_SHIFT,
+				     ((loff_t)(last + 1) << FUSE_DAX_SHIFT) - 1);
 	if (ret) {
 		pr_debug("virtio_fs: fuse_dax_break_layouts() failed. err=%d\n",
 			 ret);
@@ -1130,67 +1145,126 @@ static int lookup_and_reclaim_dmap(struct fuse_conn_dax *fcd,
 	}
 
 	down_write(&fi->dax->sem);
-	ret = lookup_and_reclaim_dmap_locked(fcd, inode, start_idx);
+	for (i = 0; i < nr; i++) {
+		/* Find fuse dax mapping at file offset inode. */
+		node = interval_tree_iter_first(&fi->dax->tree, idx[i], idx[i]);
+
+		/* Range already got cleaned up by somebody else */
+		if (!node)
+			continue;
+		dmap = node_to_dmap(node);
+
+		/* still in use. */
+		if (refcount_read(&dmap->refcnt) > 1)
+			continue;
+
+		ret = detach_one_dmap_locked(inode, dmap);
+		if (ret < 0)
+			break;
+		list_add_tail(&dmap->list, &to_remove);
+		num++;
+	}
+
+	if (num) {
+		int err = dmap_removemapping_list(inode, num, &to_remove);
+
+		if (err && err != -ENOTCONN)
+			pr_warn("Failed to remove %u mappings. ret=%d\n", num,
+				err);
+
+		/* Cleanup dmap entries and add back to free list */
+		spin_lock(&fcd->lock);
+		list_for_each_entry_safe(dmap, n, &to_remove, list) {
+			list_del_init(&dmap->list);
+			dmap_reinit_add_to_free_pool(fcd, dmap);
+		}
+		spin_unlock(&fcd->lock);
+	}
 	up_write(&fi->dax->sem);
 out_mmap_sem:
 	up_write(&fi->i_mmap_sem);
 	return ret;
 }
 
-static int try_to_free_dmap_chunks(struct fuse_conn_dax *fcd,
-				   unsigned long nr_to_free)
+/*
+ * Pick the ranges to free next. The busy list works as a CLOCK: the scan
+ * starts at its head and moves what it passes to the tail, ranges used
+ * since the last pass lose their referenced bit and the first idle one is
+ * the victim. Up to nr_max other idle ranges of the same inode go along
+ * so that they are removed together. Called with fcd->lock held, returns
+ * the inode with a reference or NULL if nothing can be freed.
+ */
+static struct inode *dmap_pick_victims(struct fuse_conn_dax *fcd,
+				       unsigned long *idx, unsigned int *nr,
+				       unsigned int nr_max)
 {
-	struct fuse_dax_mapping *dmap, *pos, *temp;
-	int ret, nr_freed = 0;
-	unsigned long start_idx = 0, end_idx = 0;
+	struct fuse_dax_mapping *dmap = NULL, *pos;
+	unsigned long scan = 2 * fcd->nr_busy_ranges;
 	struct inode *inode = NULL;
 
-	/* Pick first busy range and free it for now*/
-	while (1) {
-		if (nr_freed >= nr_to_free)
-			break;
+	while (scan-- && !inode) {
+		pos = list_first_entry(&fcd->busy_ranges,
+				       struct fuse_dax_mapping, busy_list);
+		list_move_tail(&pos->busy_list, &fcd->busy_ranges);
 
-		dmap = NULL;
-		spin_lock(&fcd->lock);
+		/* skip this range if it's in use. */
+		if (refcount_read(&pos->refcnt) > 1)
+			continue;
 
-		if (!fcd->nr_busy_ranges) {
-			spin_unlock(&fcd->lock);
-			return 0;
+		if (READ_ONCE(pos->referenced)) {
+			WRITE_ONCE(pos->referenced, false);
+			atomic_long_inc(&fcd->nr_second_chance);
+			continue;
 		}
 
-		list_for_each_entry_safe(pos, temp, &fcd->busy_ranges,
-						busy_list) {
-			/* skip this range if it's in use. */
-			if (refcount_read(&pos->refcnt) > 1)
-				continue;
-
-			inode = igrab(pos->inode);
-			/*
-			 * This inode is going away. That will free
-			 * up all the ranges anyway, continue to
-			 * next range.
-			 */
-			if (!inode)
-				continue;
-			/*
-			 * Take this element off list and add it tail. If
-			 * this element can't be freed, it will help with
-			 * selecting new element in next iteration of loop.
-			 */
-			dmap = pos;
-			list_move_tail(&dmap->busy_list, &fcd->busy_ranges);
-			start_idx = end_idx = dmap->itn.start;
+		/*
+		 * If the inode is going away that will free up all the
+		 * ranges anyway, continue to next range.
+		 */
+		inode = igrab(pos->inode);
+		dmap = pos;
+	}
+	if (!inode)
+		return NULL;
+
+	idx[0] = dmap->itn.start;
+	*nr = 1;
+	list_for_each_entry(pos, &fcd->busy_ranges, busy_list) {
+		if (*nr >= nr_max)
 			break;
-		}
+		if (pos == dmap || pos->inode != inode ||
+		    refcount_read(&pos->refcnt) > 1 ||
+		    READ_ONCE(pos->referenced))
+			continue;
+		idx[(*nr)++] = pos->itn.start;
+	}
+
+	return inode;
+}
+
+static int try_to_free_dmap_chunks(struct fuse_conn_dax *fcd,
+				   unsigned long nr_to_free)
+{
+	unsigned long idx[FUSE_DAX_RECLAIM_CHUNK];
+	unsigned long nr_freed = 0;
+	struct inode *inode;
+	unsigned int nr;
+	int ret;
+
+	while (nr_freed < nr_to_free) {
+		spin_lock(&fcd->lock);
+		inode = dmap_pick_victims(fcd, idx, &nr,
+				min_t(unsigned long, nr_to_free - nr_freed,
+				      ARRAY_SIZE(idx)));
 		spin_unlock(&fcd->lock);
-		if (!dmap)
+		if (!inode)
 			return 0;
 
-		ret = lookup_and_reclaim_dmap(fcd, inode, start_idx, end_idx);
+		ret = lookup_and_reclaim_dmaps(fcd, inode, idx, nr);
 		iput(inode);
 		if (ret)
 			return ret;
-		nr_freed++;
+		nr_freed += nr;
 	}
 	return 0;
 }
@@ -1354,6 +1428,41 @@ bool fuse_dax_check_alignment(struct fuse_conn *fc, unsigned int map_alignment)
 	return true;
 }
 
+/*
+ * Window usage and reclaim counters, then a line per mapped range with the
+ * counters of the inode it belongs to.
+ */
+void fuse_dax_show_ranges(struct seq_file *m, struct fuse_conn *fc)
+{
+	struct fuse_conn_dax *fcd = fc->dax;
+	struct fuse_dax_mapping *dmap;
+	struct fuse_inode *fi;
+
+	seq_printf(m, "setupmapping: %ld\nremovemapping: %ld\n",
+		   atomic_long_read(&fcd->nr_setupmapping),
+		   atomic_long_read(&fcd->nr_removemapping));
+	seq_printf(m, "reclaimed: %ld\nsecond_chance: %ld\n",
+		   atomic_long_read(&fcd->nr_reclaimed),
+		   atomic_long_read(&fcd->nr_second_chance));
+
+	spin_lock(&fcd->lock);
+	seq_printf(m, "ranges: %lu\nfree: %ld\nbusy: %lu\n", fcd->nr_ranges,
+		   fcd->nr_free_ranges, fcd->nr_busy_ranges);
+	seq_puts(m, "nodeid offset window_offset writable referenced users inode_ranges inode_setup inode_reclaimed\n");
+	/* Ranges leave the busy list under fcd->lock before the inode goes */
+	list_for_each_entry(dmap, &fcd->busy_ranges, busy_list) {
+		fi = get_fuse_inode(dmap->inode);
+		seq_printf(m, "%llu 0x%llx 0x%llx %d %d %u %lu %lu %lu\n",
+			   fi->nodeid, (u64)dmap->itn.start << FUSE_DAX_SHIFT,
+			   dmap->window_offset, dmap->writable,
+			   READ_ONCE(dmap->referenced),
+			   refcount_read(&dmap->refcnt) - 1,
+			   READ_ONCE(fi->dax->nr), READ_ONCE(fi->dax->nr_setup),
+			   READ_ONCE(fi->dax->nr_reclaimed));
+	}
+	spin_unlock(&fcd->lock);
+}
+
 void fuse_dax_cancel_work(struct fuse_conn *fc)
 {
 	struct fuse_conn_dax *fcd = fc->dax;
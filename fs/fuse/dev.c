@@ -49,6 +49,7 @@ static void fuse_request_init(struct fuse_mount *fm, struct fuse_req *req)
 	refcount_set(&req->count, 1);
 	__set_bit(FR_PENDING, &req->flags);
 	req->fm = fm;
+	req->iq = &fm->fc->iq;
 }
 
 static struct fuse_req *fuse_request_alloc(struct fuse_mount *fm, gfp_t flags)
@@ -223,6 +224,56 @@ const struct fuse_iqueue_ops fuse_dev_fiq_ops = {
 };
 EXPORT_SYMBOL_GPL(fuse_dev_fiq_ops);
 
+/*
+ * Lock the input queue for requests issued on this CPU: its per-CPU queue
+ * if a device is bound to that, fc->iq otherwise.
+ */
+static struct fuse_iqueue *fuse_iq_lock(struct fuse_conn *fc)
+__acquires(fiq->lock)
+{
+	/* Pairs with smp_store_release() in fuse_dev_bind_queue() */
+	struct fuse_iqueue *cpu_iqs = smp_load_acquire(&fc->cpu_iqs);
+	struct fuse_iqueue *fiq;
+
+	if (cpu_iqs) {
+		fiq = &cpu_iqs[raw_smp_processor_id()];
+		if (READ_ONCE(fiq->nr_readers)) {
+			spin_lock(&fiq->lock);
+			if (fiq->nr_readers)
+				return fiq;
+			spin_unlock(&fiq->lock);
+		}
+	}
+
+	fiq = &fc->iq;
+	spin_lock(&fiq->lock);
+	return fiq;
+}
+
+/*
+ * Lock the input queue req was queued on. The request moves to fc->iq if
+ * the last device bound to its queue goes away, so check again once the
+ * lock is held.
+ */
+static struct fuse_iqueue *fuse_req_iq_lock(struct fuse_req *req)
+__acquires(fiq->lock)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->iq);
+		spin_lock(&fiq->lock);
+		if (fiq == req->iq)
+			return fiq;
+		spin_unlock(&fiq->lock);
+	}
+}
+
+static struct fuse_iqueue *fuse_dev_iq(struct fuse_dev *fud)
+{
+	return READ_ONCE(fud->iq) ?: &fud->fc->iq;
+}
+
 static void queue_request_and_unlock(struct fuse_iqueue *fiq,
 				     struct fuse_req *req)
 __releases(fiq->lock)
@@ -230,6 +281,7 @@ __releases(fiq->lock)
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		fuse_len_args(req->args->in_numargs,
 			      (struct fuse_arg *) req->args->in_args);
+	req->iq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
@@ -237,12 +289,12 @@ __releases(fiq->lock)
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fiq->lock);
+	fiq = fuse_iq_lock(fc);
 	if (fiq->connected) {
 		fiq->forget_list_tail->next = forget;
 		fiq->forget_list_tail = forget;
@@ -255,7 +307,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
@@ -264,7 +316,7 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->lock);
+		fiq = fuse_iq_lock(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
 	}
@@ -282,7 +334,7 @@ void fuse_request_end(struct fuse_req *req)
 {
 	struct fuse_mount *fm = req->fm;
 	struct fuse_conn *fc = fm->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	if (test_and_set_bit(FR_FINISHED, &req->flags))
 		goto put_request;
@@ -293,7 +345,7 @@ void fuse_request_end(struct fuse_req *req)
 	 * smp_mb() from queue_interrupt().
 	 */
 	if (!list_empty(&req->intr_entry)) {
-		spin_lock(&fiq->lock);
+		fiq = fuse_req_iq_lock(req);
 		list_del_init(&req->intr_entry);
 		spin_unlock(&fiq->lock);
 	}
@@ -338,9 +390,9 @@ EXPORT_SYMBOL_GPL(fuse_request_end);
 
 static int queue_interrupt(struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &req->fm->fc->iq;
+	/* Readers of the queue the request came from see the interrupt */
+	struct fuse_iqueue *fiq = fuse_req_iq_lock(req);
 
-	spin_lock(&fiq->lock);
 	/* Check for we've sent request to interrupt this req */
 	if (unlikely(!test_bit(FR_INTERRUPTED, &req->flags))) {
 		spin_unlock(&fiq->lock);
@@ -369,7 +421,7 @@ static int queue_interrupt(struct fuse_req *req)
 static void request_wait_answer(struct fuse_req *req)
 {
 	struct fuse_conn *fc = req->fm->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 	int err;
 
 	if (!fc->no_interrupt) {
@@ -393,7 +445,7 @@ static void request_wait_answer(struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
+		fiq = fuse_req_iq_lock(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -414,10 +466,10 @@ static void request_wait_answer(struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &req->fm->fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
+	fiq = fuse_iq_lock(req->fm->fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->lock);
 		req->out.h.error = -ENOTCONN;
@@ -587,7 +639,7 @@ static int fuse_simple_notify_reply(struct fuse_mount *fm,
 				    struct fuse_args *args, u64 unique)
 {
 	struct fuse_req *req;
-	struct fuse_iqueue *fiq = &fm->fc->iq;
+	struct fuse_iqueue *fiq;
 	int err = 0;
 
 	req = fuse_get_req(fm, false);
@@ -599,7 +651,7 @@ static int fuse_simple_notify_reply(struct fuse_mount *fm,
 
 	fuse_args_to_req(req, args);
 
-	spin_lock(&fiq->lock);
+	fiq = fuse_iq_lock(fm->fc);
 	if (fiq->connected) {
 		queue_request_and_unlock(fiq, req);
 	} else {
@@ -1203,7 +1255,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = fuse_dev_iq(fud);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_args *args;
@@ -2055,7 +2107,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = fuse_dev_iq(fud);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->lock);
@@ -2114,10 +2166,25 @@ static void end_polls(struct fuse_conn *fc)
  * is OK, the request will in that case be removed from the list before we touch
  * it.
  */
-void fuse_abort_conn(struct fuse_conn *fc)
+/* Disconnect an input queue, moving what is pending to to_end */
+static void fuse_abort_iq(struct fuse_iqueue *fiq, struct list_head *to_end)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->lock);
+	fiq->connected = 0;
+	list_for_each_entry(req, &fiq->pending, list)
+		clear_bit(FR_PENDING, &req->flags);
+	list_splice_tail_init(&fiq->pending, to_end);
+	while (forget_pending(fiq))
+		kfree(fuse_dequeue_forget(fiq, 1, NULL));
+	wake_up_all(&fiq->waitq);
+	spin_unlock(&fiq->lock);
+	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+}
 
+void fuse_abort_conn(struct fuse_conn *fc)
+{
 	spin_lock(&fc->lock);
 	if (fc->connected) {
 		struct fuse_dev *fud;
@@ -2158,16 +2225,13 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		flush_bg_queue(fc);
 		spin_unlock(&fc->bg_lock);
 
-		spin_lock(&fiq->lock);
-		fiq->connected = 0;
-		list_for_each_entry(req, &fiq->pending, list)
-			clear_bit(FR_PENDING, &req->flags);
-		list_splice_tail_init(&fiq->pending, &to_end);
-		while (forget_pending(fiq))
-			kfree(fuse_dequeue_forget(fiq, 1, NULL));
-		wake_up_all(&fiq->waitq);
-		spin_unlock(&fiq->lock);
-		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		fuse_abort_iq(&fc->iq, &to_end);
+		if (fc->cpu_iqs) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				fuse_abort_iq(&fc->cpu_iqs[cpu], &to_end);
+		}
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2186,6 +2250,116 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+static struct fuse_iqueue *fuse_alloc_cpu_iqs(void)
+{
+	struct fuse_iqueue *cpu_iqs;
+	int cpu;
+
+	cpu_iqs = kcalloc(nr_cpu_ids, sizeof(*cpu_iqs), GFP_KERNEL);
+	if (!cpu_iqs)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *fiq = &cpu_iqs[cpu];
+
+		fuse_iqueue_init(fiq, &fuse_dev_fiq_ops, NULL);
+		/*
+		 * Keep request IDs unique across the connection, each queue
+		 * hands them out from its own range.
+		 */
+		fiq->reqctr = (u64)(cpu + 1) << 48;
+	}
+
+	return cpu_iqs;
+}
+
+/*
+ * Make the device read the requests issued on the given CPU instead of the
+ * shared queue. A daemon binding a thread per CPU no longer has all of
+ * them contend on fc->iq, and requests are served by the thread bound where
+ * they were issued. Requests from CPUs without a bound device still go to
+ * fc->iq, so unbound devices must keep reading that.
+ *
+ * The fasync entry of the file lives on the queue the device reads, so
+ * O_ASYNC has to be set after binding; it cannot be moved over here.
+ */
+static int fuse_dev_bind_queue(struct fuse_dev *fud, struct file *file,
+			       u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *cpu_iqs = NULL;
+	struct fuse_iqueue *fiq;
+	int err = 0;
+
+	/* virtio-fs and friends have their own idea of queues */
+	if (fc->iq.ops != &fuse_dev_fiq_ops)
+		return -EINVAL;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	if (!READ_ONCE(fc->cpu_iqs)) {
+		cpu_iqs = fuse_alloc_cpu_iqs();
+		if (!cpu_iqs)
+			return -ENOMEM;
+	}
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		err = -ENODEV;
+	} else if (fud->iq || (file->f_flags & FASYNC)) {
+		err = -EBUSY;
+	} else {
+		if (!fc->cpu_iqs) {
+			/* Queues are set up before they are visible */
+			smp_store_release(&fc->cpu_iqs, cpu_iqs);
+			cpu_iqs = NULL;
+		}
+		fiq = &fc->cpu_iqs[cpu];
+		spin_lock(&fiq->lock);
+		fiq->nr_readers++;
+		spin_unlock(&fiq->lock);
+		WRITE_ONCE(fud->iq, fiq);
+	}
+	spin_unlock(&fc->lock);
+
+	kfree(cpu_iqs);
+	return err;
+}
+
+/*
+ * Once the last device bound to a per-CPU queue goes away, hand what is
+ * still queued there over to fc->iq so that the other devices serve it.
+ */
+static void fuse_dev_unbind_queue(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = fud->iq;
+	struct fuse_iqueue *shared = &fud->fc->iq;
+	struct fuse_req *req;
+
+	spin_lock(&fiq->lock);
+	if (--fiq->nr_readers || !fiq->connected) {
+		spin_unlock(&fiq->lock);
+		return;
+	}
+
+	spin_lock_nested(&shared->lock, SINGLE_DEPTH_NESTING);
+	list_for_each_entry(req, &fiq->pending, list)
+		req->iq = shared;
+	list_splice_tail_init(&fiq->pending, &shared->pending);
+	list_for_each_entry(req, &fiq->interrupts, intr_entry)
+		req->iq = shared;
+	list_splice_tail_init(&fiq->interrupts, &shared->interrupts);
+	if (forget_pending(fiq)) {
+		shared->forget_list_tail->next = fiq->forget_list_head.next;
+		shared->forget_list_tail = fiq->forget_list_tail;
+		fiq->forget_list_head.next = NULL;
+		fiq->forget_list_tail = &fiq->forget_list_head;
+	}
+	spin_unlock(&fiq->lock);
+	shared->ops->wake_pending_and_unlock(shared);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2204,6 +2378,13 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 
 		end_requests(&to_end);
 
+		/* Don't leave a stale entry behind on any queue */
+		fasync_helper(-1, file, 0, &fc->iq.fasync);
+		if (fud->iq) {
+			fasync_helper(-1, file, 0, &fud->iq->fasync);
+			fuse_dev_unbind_queue(fud);
+		}
+
 		/* Are we the last open device? */
 		if (atomic_dec_and_test(&fc->dev_count)) {
 			WARN_ON(fc->iq.fasync != NULL);
@@ -2222,8 +2403,13 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 	if (!fud)
 		return -EPERM;
 
-	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
+	/*
+	 * No locking - fasync_helper does its own locking. Removal looks at
+	 * both queues in case the device was bound while O_ASYNC was set.
+	 */
+	if (!on && fud->iq)
+		fasync_helper(fd, file, 0, &fud->fc->iq.fasync);
+	return fasync_helper(fd, file, on, &fuse_dev_iq(fud)->fasync);
 }
 
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
@@ -2276,6 +2462,18 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 			}
 		}
 		break;
+	case FUSE_DEV_IOC_BIND_QUEUE: {
+		struct fuse_bind_queue bq;
+
+		res = -EFAULT;
+		if (!copy_from_user(&bq, (void __user *)arg, sizeof(bq))) {
+			res = -EINVAL;
+			fud = fuse_get_dev(file);
+			if (fud && !bq.flags)
+				res = fuse_dev_bind_queue(fud, file, bq.cpu);
+		}
+		break;
+	}
 	case FUSE_DEV_IOC_PASSTHROUGH_OPEN:
 		res = -EFAULT;
 		if (!get_user(oldfd, (__u32 __user *)arg)) {
@@ -116,6 +116,21 @@ u64 entry_attr_timeout(struct fuse_entry_out *o)
 	return time_to_jiffies(o->attr_valid, o->attr_valid_nsec);
 }
 
+/*
+ * Entries and attributes that READDIRPLUS of a cached directory filled in
+ * don't time out with FUSE_CACHE_READDIRPLUS, the filesystem tells us when
+ * they change instead
+ */
+u64 fuse_cached_entry_timeout(void)
+{
+	return get_jiffies_64() + MAX_JIFFY_OFFSET;
+}
+
+void fuse_cache_entry(struct dentry *entry)
+{
+	fuse_dentry_settime(entry, fuse_cached_entry_timeout());
+}
+
 static void fuse_invalidate_attr_mask(struct inode *inode, u32 mask)
 {
 	set_mask_bits(&get_fuse_inode(inode)->inval_mask, 0, mask);
@@ -159,6 +174,33 @@ void fuse_invalidate_entry_cache(struct dentry *entry)
 	fuse_dentry_settime(entry, 0);
 }
 
+/*
+ * Drop what READDIRPLUS cached for the children of a directory, so that
+ * the next access looks them up again. Used when the filesystem invalidates
+ * the whole directory.
+ */
+void fuse_invalidate_dir_entries(struct inode *dir)
+{
+	struct dentry *parent, *child;
+
+	parent = d_find_alias(dir);
+	if (!parent)
+		return;
+
+	spin_lock(&parent->d_lock);
+	list_for_each_entry(child, &parent->d_subdirs, d_child) {
+		spin_lock_nested(&child->d_lock, DENTRY_D_LOCK_NESTED);
+		if (d_really_is_positive(child)) {
+			/* Can't take d_lock again for the DCACHE_OP_DELETE dance */
+			__fuse_dentry_settime(child, 0);
+			fuse_invalidate_attr(d_inode(child));
+		}
+		spin_unlock(&child->d_lock);
+	}
+	spin_unlock(&parent->d_lock);
+	dput(parent);
+}
+
 /*
  * Same as fuse_invalidate_entry_cache(), but also try to remove the
  * dentry from the hash
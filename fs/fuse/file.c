@@ -213,6 +213,10 @@ void fuse_finish_open(struct inode *inode, struct file *file)
 	}
 	if ((file->f_mode & FMODE_WRITE) && fc->writeback_cache)
 		fuse_link_write_file(file);
+	/* buffered passthrough reads wait on the backing file's page cache */
+	if (ff->passthrough.filp &&
+	    (ff->passthrough.filp->f_mode & FMODE_BUF_RASYNC))
+		file->f_mode |= FMODE_BUF_RASYNC;
 }
 
 int fuse_open_common(struct inode *inode, struct file *file, bool isdir)
@@ -2370,6 +2374,37 @@ static const struct vm_operations_struct fuse_file_vm_ops = {
 	.page_mkwrite	= fuse_page_mkwrite,
 };
 
+static ssize_t fuse_file_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+
+	if (fuse_is_bad(file_inode(in)))
+		return -EIO;
+
+	if (ff->passthrough.filp)
+		return fuse_passthrough_splice_read(in, ppos, pipe, len, flags);
+
+	return generic_file_splice_read(in, ppos, pipe, len, flags);
+}
+
+static ssize_t fuse_file_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags)
+{
+	struct fuse_file *ff = out->private_data;
+
+	if (fuse_is_bad(file_inode(out)))
+		return -EIO;
+
+	if (ff->passthrough.filp)
+		return fuse_passthrough_splice_write(pipe, out, ppos, len,
+						     flags);
+
+	return iter_file_splice_write(pipe, out, ppos, len, flags);
+}
+
 static int fuse_file_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct fuse_file *ff = file->private_data;
@@ -3460,8 +3495,15 @@ static ssize_t fuse_copy_file_range(struct file *src_file, loff_t src_off,
 				    struct file *dst_file, loff_t dst_off,
 				    size_t len, unsigned int flags)
 {
+	struct fuse_file *ff_in = src_file->private_data;
+	struct fuse_file *ff_out = dst_file->private_data;
 	ssize_t ret;
 
+	if (ff_in->passthrough.filp && ff_out->passthrough.filp)
+		return fuse_passthrough_copy_file_range(src_file, src_off,
+							dst_file, dst_off,
+							len, flags);
+
 	ret = __fuse_copy_file_range(src_file, src_off, dst_file, dst_off,
 				     len, flags);
 
@@ -3483,8 +3525,8 @@ static const struct file_operations fuse_file_operations = {
 	.lock		= fuse_file_lock,
 	.get_unmapped_area = thp_get_unmapped_area,
 	.flock		= fuse_file_flock,
-	.splice_read	= generic_file_splice_read,
-	.splice_write	= iter_file_splice_write,
+	.splice_read	= fuse_file_splice_read,
+	.splice_write	= fuse_file_splice_write,
 	.unlocked_ioctl	= fuse_file_ioctl,
 	.compat_ioctl	= fuse_file_compat_ioctl,
 	.poll		= fuse_file_poll,
@@ -45,7 +45,7 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
 
 /** List of active connections */
 extern struct list_head fuse_conn_list;
@@ -395,6 +395,9 @@ struct fuse_req {
 
 	/** fuse_mount this request belongs to */
 	struct fuse_mount *fm;
+
+	/** Input queue the request was queued on, protected by its lock */
+	struct fuse_iqueue *iq;
 };
 
 struct fuse_iqueue;
@@ -469,6 +472,9 @@ struct fuse_iqueue {
 
 	/** Device-specific state */
 	void *priv;
+
+	/** Devices bound to this queue, only used for per-CPU queues */
+	unsigned int nr_readers;
 };
 
 #define FUSE_PQ_HASH_BITS 8
@@ -500,6 +506,9 @@ struct fuse_dev {
 
 	/** list entry on fc->devices */
 	struct list_head entry;
+
+	/** Per-CPU input queue this device reads, NULL for fc->iq */
+	struct fuse_iqueue *iq;
 };
 
 struct fuse_fs_context {
@@ -729,6 +738,9 @@ struct fuse_conn {
 	/** Does the filesystem want adaptive readdirplus? */
 	unsigned readdirplus_auto:1;
 
+	/** Keep readdirplus results of cached directories until invalidated */
+	unsigned cache_readdirplus:1;
+
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
@@ -814,6 +826,13 @@ struct fuse_conn {
 
 	/** Protects passthrough_req */
 	spinlock_t passthrough_req_lock;
+
+	/**
+	 * Per-CPU input queues, indexed by CPU number. Allocated when the
+	 * first device is bound to one; requests issued on a CPU whose queue
+	 * has no device bound go to iq.
+	 */
+	struct fuse_iqueue *cpu_iqs;
 };
 
 /*
@@ -1040,16 +1059,29 @@ void fuse_invalidate_attr(struct inode *inode);
 
 void fuse_invalidate_entry_cache(struct dentry *entry);
 
+/**
+ * Invalidate the cached entries and attributes of a directory's children
+ */
+void fuse_invalidate_dir_entries(struct inode *dir);
+
 void fuse_invalidate_atime(struct inode *inode);
 
 u64 entry_attr_timeout(struct fuse_entry_out *o);
 void fuse_change_entry_timeout(struct dentry *entry, struct fuse_entry_out *o);
+u64 fuse_cached_entry_timeout(void);
+void fuse_cache_entry(struct dentry *entry);
 
 /**
  * Acquire reference to fuse_conn
  */
 struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 
+/**
+ * Initialize an input queue
+ */
+void fuse_iqueue_init(struct fuse_iqueue *fiq,
+		      const struct fuse_iqueue_ops *ops, void *priv);
+
 /**
  * Initialize fuse_conn
  */
@@ -1247,6 +1279,7 @@ void fuse_dax_inode_init(struct inode *inode);
 void fuse_dax_inode_cleanup(struct inode *inode);
 bool fuse_dax_check_alignment(struct fuse_conn *fc, unsigned int map_alignment);
 void fuse_dax_cancel_work(struct fuse_conn *fc);
+void fuse_dax_show_ranges(struct seq_file *m, struct fuse_conn *fc);
 
 /* passthrough.c */
 int fuse_passthrough_open(struct fuse_dev *fud, u32 lower_fd);
@@ -1256,5 +1289,14 @@ void fuse_passthrough_release(struct fuse_passthrough *passthrough);
 ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
 ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags);
+ssize_t fuse_passthrough_copy_file_range(struct file *file_in, loff_t pos_in,
+					 struct file *file_out, loff_t pos_out,
+					 size_t len, unsigned int flags);
 
 #endif /* _FS_FUSE_I_H */
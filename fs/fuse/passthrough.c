@@ -4,6 +4,7 @@
 
 #include <linux/fuse.h>
 #include <linux/idr.h>
+#include <linux/splice.h>
 #include <linux/uio.h>
 
 #define PASSTHROUGH_IOCB_MASK                                                  \
@@ -65,6 +66,18 @@ ssize_t fuse_passthrough_read_iter(struct kiocb *iocb_fuse,
 		ret = vfs_iter_read(passthrough_filp, iter, &iocb_fuse->ki_pos,
 				    iocb_to_rw_flags(iocb_fuse->ki_flags,
 						     PASSTHROUGH_IOCB_MASK));
+	} else if (iocb_fuse->ki_flags & IOCB_WAITQ) {
+		struct kiocb iocb;
+
+		/*
+		 * Buffered read with an async page waiter armed. It never
+		 * completes through ->ki_complete, -EIOCBQUEUED only means
+		 * that the waiter is queued on a locked page.
+		 */
+		kiocb_clone(&iocb, iocb_fuse, passthrough_filp);
+		iocb.ki_waitq = iocb_fuse->ki_waitq;
+		ret = call_read_iter(passthrough_filp, &iocb, iter);
+		iocb_fuse->ki_pos = iocb.ki_pos;
 	} else {
 		struct fuse_aio_req *aio_req;
 
@@ -138,6 +151,88 @@ out:
 	return ret;
 }
 
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	ssize_t ret;
+	const struct cred *old_cred;
+	struct fuse_file *ff = in->private_data;
+	struct file *passthrough_filp = ff->passthrough.filp;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	if (passthrough_filp->f_op->splice_read)
+		ret = passthrough_filp->f_op->splice_read(passthrough_filp,
+							  ppos, pipe, len,
+							  flags);
+	else
+		ret = generic_file_splice_read(passthrough_filp, ppos, pipe,
+					       len, flags);
+	revert_creds(old_cred);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_splice_write(struct pipe_inode_info *pipe,
+				      struct file *out, loff_t *ppos,
+				      size_t len, unsigned int flags)
+{
+	ssize_t ret;
+	const struct cred *old_cred;
+	struct fuse_file *ff = out->private_data;
+	struct inode *fuse_inode = file_inode(out);
+	struct file *passthrough_filp = ff->passthrough.filp;
+
+	inode_lock(fuse_inode);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(passthrough_filp);
+	if (passthrough_filp->f_op->splice_write)
+		ret = passthrough_filp->f_op->splice_write(pipe,
+							   passthrough_filp,
+							   ppos, len, flags);
+	else
+		ret = iter_file_splice_write(pipe, passthrough_filp, ppos, len,
+					     flags);
+	file_end_write(passthrough_filp);
+	if (ret > 0)
+		fuse_copyattr(out, passthrough_filp);
+	revert_creds(old_cred);
+
+	inode_unlock(fuse_inode);
+
+	return ret;
+}
+
+/*
+ * Both files are in passthrough mode, copy between the lower files and
+ * leave it to the lower filesystem to clone or copy in kernel.
+ */
+ssize_t fuse_passthrough_copy_file_range(struct file *file_in, loff_t pos_in,
+					 struct file *file_out, loff_t pos_out,
+					 size_t len, unsigned int flags)
+{
+	ssize_t ret;
+	const struct cred *old_cred;
+	struct fuse_file *ff_in = file_in->private_data;
+	struct fuse_file *ff_out = file_out->private_data;
+	struct inode *fuse_inode_out = file_inode(file_out);
+
+	inode_lock(fuse_inode_out);
+
+	old_cred = override_creds(ff_out->passthrough.cred);
+	ret = vfs_copy_file_range(ff_in->passthrough.filp, pos_in,
+				  ff_out->passthrough.filp, pos_out, len,
+				  flags);
+	if (ret > 0)
+		fuse_copyattr(file_out, ff_out->passthrough.filp);
+	revert_creds(old_cred);
+
+	inode_unlock(fuse_inode_out);
+
+	return ret;
+}
+
 ssize_t fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	int ret;
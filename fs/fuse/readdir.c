@@ -151,6 +151,7 @@ static int fuse_direntplus_link(struct file *file,
 {
 	struct fuse_entry_out *o = &direntplus->entry_out;
 	struct fuse_dirent *dirent = &direntplus->dirent;
+	struct fuse_file *ff = file->private_data;
 	struct dentry *parent = file->f_path.dentry;
 	struct qstr name = QSTR_INIT(dirent->name, dirent->namelen);
 	struct dentry *dentry;
@@ -158,6 +159,8 @@ static int fuse_direntplus_link(struct file *file,
 	struct inode *dir = d_inode(parent);
 	struct fuse_conn *fc;
 	struct inode *inode;
+	bool cache;
+	u64 attr_valid;
 	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
 
 	if (!o->nodeid) {
@@ -188,6 +191,9 @@ static int fuse_direntplus_link(struct file *file,
 		return -EIO;
 
 	fc = get_fuse_conn(dir);
+	cache = fc->cache_readdirplus && (ff->open_flags & FOPEN_CACHE_DIR);
+	attr_valid = cache ? fuse_cached_entry_timeout() :
+			     entry_attr_timeout(o);
 
 	name.hash = full_name_hash(parent, name.name, name.len);
 	dentry = d_lookup(parent, &name);
@@ -218,8 +224,7 @@ retry:
 		spin_unlock(&fi->lock);
 
 		forget_all_cached_acls(inode);
-		fuse_change_attributes(inode, &o->attr,
-				       entry_attr_timeout(o),
+		fuse_change_attributes(inode, &o->attr, attr_valid,
 				       attr_version);
 		/*
 		 * The other branch comes via fuse_iget()
@@ -227,8 +232,7 @@ retry:
 		 */
 	} else {
 		inode = fuse_iget(dir->i_sb, o->nodeid, o->generation,
-				  &o->attr, entry_attr_timeout(o),
-				  attr_version);
+				  &o->attr, attr_valid, attr_version);
 		if (!inode)
 			inode = ERR_PTR(-ENOMEM);
 
@@ -243,7 +247,10 @@ retry:
 	}
 	if (fc->readdirplus_auto)
 		set_bit(FUSE_I_INIT_RDPLUS, &get_fuse_inode(inode)->state);
-	fuse_change_entry_timeout(dentry, o);
+	if (cache)
+		fuse_cache_entry(dentry);
+	else
+		fuse_change_entry_timeout(dentry, o);
 
 	dput(dentry);
 	return 0;
@@ -7,13 +7,17 @@
 #include <linux/file.h>
 #include <linux/fsverity.h>
 #include <linux/gfp.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
 #include <linux/kobject.h>
 #include <linux/ktime.h>
 #include <linux/lz4.h>
 #include <linux/mm.h>
 #include <linux/namei.h>
 #include <linux/pagemap.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/types.h>
 #include <linux/workqueue.h>
 
@@ -24,6 +28,7 @@
 #include "verity.h"
 
 static int incfs_scan_metadata_chain(struct data_file *df);
+static void log_merge_pcpu(struct read_log *log);
 
 static void log_wake_up_all(struct work_struct *work)
 {
@@ -37,12 +42,206 @@ static void zstd_free_workspace(struct work_struct *work)
 	struct delayed_work *dw = container_of(work, struct delayed_work, work);
 	struct mount_info *mi =
 		container_of(dw, struct mount_info, mi_zstd_cleanup_work);
+	int cpu;
 
-	mutex_lock(&mi->mi_zstd_workspace_mutex);
-	kvfree(mi->mi_zstd_workspace);
-	mi->mi_zstd_workspace = NULL;
-	mi->mi_zstd_stream = NULL;
-	mutex_unlock(&mi->mi_zstd_workspace_mutex);
+	for_each_possible_cpu(cpu) {
+		struct incfs_zstd_ctx *ctx = per_cpu_ptr(mi->mi_zstd_ctx, cpu);
+
+		mutex_lock(&ctx->zc_mutex);
+		kvfree(ctx->zc_workspace);
+		ctx->zc_workspace = NULL;
+		ctx->zc_stream = NULL;
+		mutex_unlock(&ctx->zc_mutex);
+	}
+}
+
+static void hash_cache_free_block(struct verified_hash_block *vhb)
+{
+	free_page((unsigned long)vhb->vhb_data);
+	kfree(vhb);
+}
+
+/* Unlink up to nr blocks from the cold end of the LRU onto evicted */
+static unsigned long hash_cache_evict(struct hash_block_cache *hbc,
+				      unsigned long nr,
+				      struct list_head *evicted)
+{
+	struct verified_hash_block *vhb, *tmp;
+	unsigned long freed = 0;
+
+	lockdep_assert_held(&hbc->hbc_lock);
+
+	list_for_each_entry_safe(vhb, tmp, &hbc->hbc_lru, vhb_lru) {
+		if (freed == nr)
+			break;
+		hlist_del(&vhb->vhb_hash_node);
+		list_move(&vhb->vhb_lru, evicted);
+		hbc->hbc_count--;
+		freed++;
+	}
+
+	return freed;
+}
+
+static void hash_cache_free_list(struct list_head *evicted)
+{
+	struct verified_hash_block *vhb, *tmp;
+
+	list_for_each_entry_safe(vhb, tmp, evicted, vhb_lru)
+		hash_cache_free_block(vhb);
+}
+
+static unsigned long hash_cache_count(struct shrinker *shrink,
+				      struct shrink_control *sc)
+{
+	struct hash_block_cache *hbc =
+		container_of(shrink, struct hash_block_cache, hbc_shrinker);
+
+	return READ_ONCE(hbc->hbc_count) ?: SHRINK_EMPTY;
+}
+
+static unsigned long hash_cache_scan(struct shrinker *shrink,
+				     struct shrink_control *sc)
+{
+	struct hash_block_cache *hbc =
+		container_of(shrink, struct hash_block_cache, hbc_shrinker);
+	LIST_HEAD(evicted);
+	unsigned long freed;
+
+	spin_lock(&hbc->hbc_lock);
+	freed = hash_cache_evict(hbc, sc->nr_to_scan, &evicted);
+	spin_unlock(&hbc->hbc_lock);
+
+	hash_cache_free_list(&evicted);
+	return freed;
+}
+
+static int hash_cache_init(struct hash_block_cache *hbc)
+{
+	int error;
+	int i;
+
+	spin_lock_init(&hbc->hbc_lock);
+	INIT_LIST_HEAD(&hbc->hbc_lru);
+	hbc->hbc_table = kcalloc(1 << INCFS_HASH_CACHE_BITS,
+				 sizeof(*hbc->hbc_table), GFP_NOFS);
+	if (!hbc->hbc_table)
+		return -ENOMEM;
+	for (i = 0; i < 1 << INCFS_HASH_CACHE_BITS; i++)
+		INIT_HLIST_HEAD(&hbc->hbc_table[i]);
+
+	hbc->hbc_shrinker.count_objects = hash_cache_count;
+	hbc->hbc_shrinker.scan_objects = hash_cache_scan;
+	hbc->hbc_shrinker.seeks = DEFAULT_SEEKS;
+	error = register_shrinker(&hbc->hbc_shrinker);
+	if (error) {
+		kfree(hbc->hbc_table);
+		hbc->hbc_table = NULL;
+	}
+	return error;
+}
+
+static void hash_cache_destroy(struct hash_block_cache *hbc)
+{
+	LIST_HEAD(evicted);
+
+	if (!hbc->hbc_table)
+		return;
+
+	unregister_shrinker(&hbc->hbc_shrinker);
+	spin_lock(&hbc->hbc_lock);
+	hash_cache_evict(hbc, ULONG_MAX, &evicted);
+	spin_unlock(&hbc->hbc_lock);
+	hash_cache_free_list(&evicted);
+	kfree(hbc->hbc_table);
+}
+
+static struct hlist_head *hash_cache_bucket(struct hash_block_cache *hbc,
+					    incfs_uuid_t *id, loff_t offset)
+{
+	u32 hash = jhash(id->bytes, sizeof(id->bytes), (u32)offset);
+
+	return &hbc->hbc_table[hash_32(hash ^ (u32)(offset >> 32),
+				       INCFS_HASH_CACHE_BITS)];
+}
+
+static struct verified_hash_block *
+hash_cache_find(struct hash_block_cache *hbc, incfs_uuid_t *id,
+		loff_t offset, struct mtree *tree)
+{
+	struct verified_hash_block *vhb;
+
+	lockdep_assert_held(&hbc->hbc_lock);
+
+	hlist_for_each_entry(vhb, hash_cache_bucket(hbc, id, offset),
+			     vhb_hash_node) {
+		if (vhb->vhb_offset == offset &&
+		    !memcmp(&vhb->vhb_file_id, id, sizeof(*id)) &&
+		    !memcmp(vhb->vhb_root_hash, tree->root_hash,
+			    tree->alg->digest_size))
+			return vhb;
+	}
+
+	return NULL;
+}
+
+/* Copy the digest at offset_in_block of a cached block, if there is one */
+static bool hash_cache_get_digest(struct hash_block_cache *hbc,
+				  incfs_uuid_t *id, struct mtree *tree,
+				  loff_t offset, size_t offset_in_block,
+				  u8 *digest)
+{
+	struct verified_hash_block *vhb;
+
+	spin_lock(&hbc->hbc_lock);
+	vhb = hash_cache_find(hbc, id, offset, tree);
+	if (vhb) {
+		memcpy(digest, vhb->vhb_data + offset_in_block,
+		       tree->alg->digest_size);
+		list_move_tail(&vhb->vhb_lru, &hbc->hbc_lru);
+	}
+	spin_unlock(&hbc->hbc_lock);
+
+	return vhb;
+}
+
+/* Best effort, the block is simply verified again if this fails */
+static void hash_cache_add(struct hash_block_cache *hbc, incfs_uuid_t *id,
+			   struct mtree *tree, loff_t offset, const u8 *data)
+{
+	const gfp_t gfp = GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN;
+	struct verified_hash_block *vhb;
+	LIST_HEAD(evicted);
+
+	vhb = kzalloc(sizeof(*vhb), gfp);
+	if (!vhb)
+		return;
+
+	vhb->vhb_data = (u8 *)__get_free_page(gfp);
+	if (!vhb->vhb_data) {
+		kfree(vhb);
+		return;
+	}
+
+	vhb->vhb_file_id = *id;
+	vhb->vhb_offset = offset;
+	memcpy(vhb->vhb_root_hash, tree->root_hash, tree->alg->digest_size);
+	memcpy(vhb->vhb_data, data, INCFS_DATA_FILE_BLOCK_SIZE);
+
+	spin_lock(&hbc->hbc_lock);
+	if (hash_cache_find(hbc, id, offset, tree)) {
+		/* Somebody else verified the same block meanwhile */
+		list_add(&vhb->vhb_lru, &evicted);
+	} else {
+		hlist_add_head(&vhb->vhb_hash_node,
+			       hash_cache_bucket(hbc, id, offset));
+		list_add_tail(&vhb->vhb_lru, &hbc->hbc_lru);
+		if (++hbc->hbc_count > INCFS_HASH_CACHE_MAX_BLOCKS)
+			hash_cache_evict(hbc, 1, &evicted);
+	}
+	spin_unlock(&hbc->hbc_lock);
+
+	hash_cache_free_list(&evicted);
 }
 
 struct mount_info *incfs_alloc_mount_info(struct super_block *sb,
@@ -52,11 +251,20 @@ struct mount_info *incfs_alloc_mount_info(struct super_block *sb,
 	struct mount_info *mi = NULL;
 	int error = 0;
 	struct incfs_sysfs_node *node;
+	int cpu, i;
 
 	mi = kzalloc(sizeof(*mi), GFP_NOFS);
 	if (!mi)
 		return ERR_PTR(-ENOMEM);
 
+	mi->mi_zstd_ctx = alloc_percpu(struct incfs_zstd_ctx);
+	if (!mi->mi_zstd_ctx) {
+		kfree(mi);
+		return ERR_PTR(-ENOMEM);
+	}
+	for_each_possible_cpu(cpu)
+		mutex_init(&per_cpu_ptr(mi->mi_zstd_ctx, cpu)->zc_mutex);
+
 	mi->mi_sb = sb;
 	mi->mi_backing_dir_path = *backing_dir_path;
 	mi->mi_owner = get_current_cred();
@@ -71,10 +279,37 @@ struct mount_info *incfs_alloc_mount_info(struct super_block *sb,
 	spin_lock_init(&mi->pending_read_lock);
 	INIT_LIST_HEAD(&mi->mi_reads_list_head);
 	spin_lock_init(&mi->mi_per_uid_read_timeouts_lock);
-	mutex_init(&mi->mi_zstd_workspace_mutex);
 	INIT_DELAYED_WORK(&mi->mi_zstd_cleanup_work, zstd_free_workspace);
 	mutex_init(&mi->mi_le_mutex);
 
+	mi->mi_pending_reads_hash =
+		kvcalloc(1 << INCFS_PENDING_READS_HASH_BITS,
+			 sizeof(*mi->mi_pending_reads_hash), GFP_NOFS);
+	if (!mi->mi_pending_reads_hash) {
+		error = -ENOMEM;
+		goto err;
+	}
+	for (i = 0; i < 1 << INCFS_PENDING_READS_HASH_BITS; i++) {
+		INIT_HLIST_HEAD(&mi->mi_pending_reads_hash[i].prb_reads);
+		init_waitqueue_head(&mi->mi_pending_reads_hash[i].prb_wq);
+	}
+
+	error = hash_cache_init(&mi->mi_hash_cache);
+	if (error)
+		goto err;
+
+	mi->mi_log.rl_pcpu = alloc_percpu(struct read_log_pcpu);
+	mi->mi_log.rl_merge_buf = kvmalloc_array(nr_cpu_ids *
+						 INCFS_READ_LOG_PCPU_ENTRIES,
+						 sizeof(struct read_log_entry),
+						 GFP_NOFS);
+	if (!mi->mi_log.rl_pcpu || !mi->mi_log.rl_merge_buf) {
+		error = -ENOMEM;
+		goto err;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(mi->mi_log.rl_pcpu, cpu)->rlp_lock);
+
 	node = incfs_add_sysfs_node(options->sysfs_name, mi);
 	if (IS_ERR(node)) {
 		error = PTR_ERR(node);
@@ -117,6 +352,8 @@ int incfs_realloc_mount_info(struct mount_info *mi,
 		}
 
 		spin_lock(&mi->mi_log.rl_lock);
+		/* Reads still in the per-cpu buffers belong to the old log */
+		log_merge_pcpu(&mi->mi_log);
 		old_buffer = mi->mi_log.rl_ring_buf;
 		mi->mi_log.rl_ring_buf = new_buffer;
 		mi->mi_log.rl_size = new_buffer_size;
@@ -157,20 +394,30 @@ int incfs_realloc_mount_info(struct mount_info *mi,
 
 void incfs_free_mount_info(struct mount_info *mi)
 {
-	int i;
+	int i, cpu;
 	if (!mi)
 		return;
 
 	flush_delayed_work(&mi->mi_log.ml_wakeup_work);
-	flush_delayed_work(&mi->mi_zstd_cleanup_work);
+	cancel_delayed_work_sync(&mi->mi_zstd_cleanup_work);
+	for_each_possible_cpu(cpu) {
+		struct incfs_zstd_ctx *ctx = per_cpu_ptr(mi->mi_zstd_ctx, cpu);
+
+		kvfree(ctx->zc_workspace);
+		mutex_destroy(&ctx->zc_mutex);
+	}
+	free_percpu(mi->mi_zstd_ctx);
 
 	dput(mi->mi_index_dir);
 	dput(mi->mi_incomplete_dir);
 	path_put(&mi->mi_backing_dir_path);
 	mutex_destroy(&mi->mi_dir_struct_mutex);
-	mutex_destroy(&mi->mi_zstd_workspace_mutex);
 	put_cred(mi->mi_owner);
 	kfree(mi->mi_log.rl_ring_buf);
+	kvfree(mi->mi_log.rl_merge_buf);
+	free_percpu(mi->mi_log.rl_pcpu);
+	kvfree(mi->mi_pending_reads_hash);
+	hash_cache_destroy(&mi->mi_hash_cache);
 	for (i = 0; i < ARRAY_SIZE(mi->pseudo_file_xattr); ++i)
 		kfree(mi->pseudo_file_xattr[i].data);
 	kfree(mi->mi_per_uid_read_timeouts);
@@ -180,9 +427,7 @@ void incfs_free_mount_info(struct mount_info *mi)
 
 static void data_file_segment_init(struct data_file_segment *segment)
 {
-	init_waitqueue_head(&segment->new_data_arrival_wq);
 	init_rwsem(&segment->rwsem);
-	INIT_LIST_HEAD(&segment->reads_list_head);
 }
 
 char *file_id_to_str(incfs_uuid_t id)
@@ -421,18 +666,25 @@ void incfs_free_dir_file(struct dir_file *dir)
 	kfree(dir);
 }
 
+/*
+ * Every cpu has its own decompression context, so readers on different
+ * cpus never wait for each other. A reader migrating after picking the
+ * context only costs it the cache locality, the mutex still protects it.
+ */
 static ssize_t zstd_decompress_safe(struct mount_info *mi,
 				    struct mem_range src, struct mem_range dst)
 {
+	struct incfs_zstd_ctx *ctx = raw_cpu_ptr(mi->mi_zstd_ctx);
 	ssize_t result;
+	size_t ret;
 	ZSTD_inBuffer inbuf = {.src = src.data,	.size = src.len};
 	ZSTD_outBuffer outbuf = {.dst = dst.data, .size = dst.len};
 
-	result = mutex_lock_interruptible(&mi->mi_zstd_workspace_mutex);
+	result = mutex_lock_interruptible(&ctx->zc_mutex);
 	if (result)
 		return result;
 
-	if (!mi->mi_zstd_stream) {
+	if (!ctx->zc_stream) {
 		unsigned int workspace_size = ZSTD_DStreamWorkspaceBound(
 						INCFS_DATA_FILE_BLOCK_SIZE);
 		void *workspace = kvmalloc(workspace_size, GFP_NOFS);
@@ -451,18 +703,24 @@ static ssize_t zstd_decompress_safe(struct mount_info *mi,
 			goto out;
 		}
 
-		mi->mi_zstd_workspace = workspace;
-		mi->mi_zstd_stream = stream;
+		ctx->zc_workspace = workspace;
+		ctx->zc_stream = stream;
 	}
 
-	result = ZSTD_decompressStream(mi->mi_zstd_stream, &outbuf, &inbuf) ?
-		-EBADMSG : outbuf.pos;
+	ret = ZSTD_decompressStream(ctx->zc_stream, &outbuf, &inbuf);
+	if (ZSTD_isError(ret)) {
+		/* Don't let a corrupt block break the next one */
+		ZSTD_resetDStream(ctx->zc_stream);
+		result = -EBADMSG;
+	} else {
+		result = outbuf.pos;
+	}
 
 	mod_delayed_work(system_wq, &mi->mi_zstd_cleanup_work,
 			 msecs_to_jiffies(5000));
 
 out:
-	mutex_unlock(&mi->mi_zstd_workspace_mutex);
+	mutex_unlock(&ctx->zc_mutex);
 	return result;
 }
 
@@ -548,37 +806,30 @@ static void log_read_one_record(struct read_log *rl, struct read_log_state *rs)
 	++rs->current_record_no;
 }
 
-static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
-			   int block_index)
+/* Append one read to the ring buffer, called with rl_lock held */
+static void log_append_record(struct read_log *log,
+			      const struct read_log_entry *entry)
 {
-	struct read_log *log = &mi->mi_log;
 	struct read_log_state *head, *tail;
+	const incfs_uuid_t *id = &entry->file_id;
+	int block_index = entry->block_index;
+	uid_t uid = entry->uid;
 	s64 now_us;
 	s64 relative_us;
 	union log_record record;
 	size_t record_size;
-	uid_t uid = current_uid().val;
 	int block_delta;
 	bool same_file, same_uid;
 	bool next_block, close_block, very_close_block;
 	bool close_time, very_close_time, very_very_close_time;
 
+	head = &log->rl_head;
 	/*
-	 * This may read the old value, but it's OK to delay the logging start
-	 * right after the configuration update.
+	 * Reads merged from different cpus are sorted, but one taken just
+	 * before the last merge may still show up in the next one. Records
+	 * only store forward deltas, so log it at the latest time instead.
 	 */
-	if (READ_ONCE(log->rl_size) == 0)
-		return;
-
-	now_us = ktime_to_us(ktime_get());
-
-	spin_lock(&log->rl_lock);
-	if (log->rl_size == 0) {
-		spin_unlock(&log->rl_lock);
-		return;
-	}
-
-	head = &log->rl_head;
+	now_us = max_t(s64, entry->ts_us, head->base_record.absolute_ts_us);
 	tail = &log->rl_tail;
 	relative_us = now_us - head->base_record.absolute_ts_us;
 
@@ -660,9 +911,125 @@ static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
 		++head->current_pass_no;
 	}
 	++head->current_record_no;
+}
 
-	spin_unlock(&log->rl_lock);
-	schedule_delayed_work(&log->ml_wakeup_work, msecs_to_jiffies(16));
+static int log_entry_cmp(const void *a, const void *b)
+{
+	const struct read_log_entry *ea = a, *eb = b;
+
+	if (ea->ts_us < eb->ts_us)
+		return -1;
+	return ea->ts_us > eb->ts_us;
+}
+
+/*
+ * Move all reads in the per-cpu buffers into the ring buffer in time
+ * order. Called with rl_lock held, which nests outside the per-cpu locks.
+ */
+static void log_merge_pcpu(struct read_log *log)
+{
+	struct read_log_entry *merge = log->rl_merge_buf;
+	size_t count = 0, i;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct read_log_pcpu *pcpu = per_cpu_ptr(log->rl_pcpu, cpu);
+
+		if (!READ_ONCE(pcpu->rlp_count))
+			continue;
+
+		spin_lock(&pcpu->rlp_lock);
+		memcpy(merge + count, pcpu->rlp_entries,
+		       pcpu->rlp_count * sizeof(*merge));
+		count += pcpu->rlp_count;
+		pcpu->rlp_count = 0;
+		spin_unlock(&pcpu->rlp_lock);
+	}
+
+	if (!count || log->rl_size == 0)
+		return;
+
+	sort(merge, count, sizeof(*merge), log_entry_cmp, NULL);
+	for (i = 0; i < count; i++)
+		log_append_record(log, &merge[i]);
+}
+
+static void log_block_read(struct mount_info *mi, incfs_uuid_t *id,
+			   int block_index)
+{
+	struct read_log *log = &mi->mi_log;
+	struct read_log_pcpu *pcpu;
+	struct read_log_entry *entry;
+	s64 now_us;
+
+	/*
+	 * This may read the old value, but it's OK to delay the logging start
+	 * right after the configuration update.
+	 */
+	if (READ_ONCE(log->rl_size) == 0)
+		return;
+
+	now_us = ktime_to_us(ktime_get());
+
+	for (;;) {
+		/* Migrating after this only costs us the locality */
+		pcpu = raw_cpu_ptr(log->rl_pcpu);
+		spin_lock(&pcpu->rlp_lock);
+		if (pcpu->rlp_count < INCFS_READ_LOG_PCPU_ENTRIES)
+			break;
+		spin_unlock(&pcpu->rlp_lock);
+
+		spin_lock(&log->rl_lock);
+		log_merge_pcpu(log);
+		spin_unlock(&log->rl_lock);
+	}
+
+	entry = &pcpu->rlp_entries[pcpu->rlp_count++];
+	*entry = (struct read_log_entry){
+		.file_id = *id,
+		.ts_us = now_us,
+		.block_index = block_index,
+		.uid = current_uid().val,
+	};
+	spin_unlock(&pcpu->rlp_lock);
+
+	/* Coalesce the wakeups, readers merge the per-cpu entries anyway */
+	if (!delayed_work_pending(&log->ml_wakeup_work)) {
+		unsigned int delay_ms = READ_ONCE(mi->mi_options.read_log_wakeup_ms);
+
+		schedule_delayed_work(&log->ml_wakeup_work,
+				      msecs_to_jiffies(delay_ms));
+	}
+}
+
+/*
+ * Get the digest at offset_in_block of the hash block at offset if that
+ * block has been verified already, either in the page cache of the inode
+ * or in the mount's cache of hash blocks.
+ */
+static bool get_verified_digest(struct file *f, struct data_file *df,
+				struct mtree *tree, pgoff_t hash_page,
+				loff_t offset, size_t offset_in_block,
+				u8 *digest)
+{
+	struct page *page = find_get_page_flags(f->f_inode->i_mapping,
+						hash_page, FGP_ACCESSED);
+
+	if (page && PageChecked(page)) {
+		u8 *addr = kmap_atomic(page);
+
+		memcpy(digest, addr + offset_in_block, tree->alg->digest_size);
+		kunmap_atomic(addr);
+		put_page(page);
+		return true;
+	}
+
+	if (page)
+		put_page(page);
+
+	return hash_cache_get_digest(&df->df_mount_info->mi_hash_cache,
+				     &df->df_id, tree, offset,
+				     offset_in_block, digest);
 }
 
 static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
@@ -706,26 +1073,26 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 
 	memcpy(stored_digest, tree->root_hash, digest_size);
 
+	/*
+	 * Start from the lowest level whose hash block is already known to be
+	 * good, only the levels below it need to be read and hashed again.
+	 */
 	file_pages = DIV_ROUND_UP(df->df_size, INCFS_DATA_FILE_BLOCK_SIZE);
-	for (lvl = tree->depth - 1; lvl >= 0; lvl--) {
+	for (lvl = 0; lvl < tree->depth; lvl++) {
+		if (get_verified_digest(f, df, tree,
+					file_pages + hash_block_offset[lvl] /
+						INCFS_DATA_FILE_BLOCK_SIZE,
+					hash_block_offset[lvl],
+					hash_offset_in_block[lvl],
+					stored_digest))
+			break;
+	}
+
+	for (lvl--; lvl >= 0; lvl--) {
 		pgoff_t hash_page =
 			file_pages +
 			hash_block_offset[lvl] / INCFS_DATA_FILE_BLOCK_SIZE;
-		struct page *page = find_get_page_flags(
-			f->f_inode->i_mapping, hash_page, FGP_ACCESSED);
-
-		if (page && PageChecked(page)) {
-			u8 *addr = kmap_atomic(page);
-
-			memcpy(stored_digest, addr + hash_offset_in_block[lvl],
-			       digest_size);
-			kunmap_atomic(addr);
-			put_page(page);
-			continue;
-		}
-
-		if (page)
-			put_page(page);
+		struct page *page;
 
 		res = incfs_kread(bfc, buf, INCFS_DATA_FILE_BLOCK_SIZE,
 				  hash_block_offset[lvl] + sig->hash_offset);
@@ -769,6 +1136,8 @@ static int validate_hash_tree(struct backing_file_context *bfc, struct file *f,
 			unlock_page(page);
 			put_page(page);
 		}
+		hash_cache_add(&df->df_mount_info->mi_hash_cache, &df->df_id,
+			       tree, hash_block_offset[lvl], buf);
 	}
 
 	res = incfs_calc_digest(tree->alg, data,
@@ -1007,6 +1376,15 @@ static bool is_read_done(struct pending_read *read)
 	return atomic_read_acquire(&read->done) != 0;
 }
 
+static struct pending_read_bucket *
+pending_read_bucket(struct mount_info *mi, incfs_uuid_t *id, int block_index)
+{
+	u32 hash = jhash(id, sizeof(*id), block_index);
+
+	return &mi->mi_pending_reads_hash[hash_32(hash,
+					INCFS_PENDING_READS_HASH_BITS)];
+}
+
 static void set_read_done(struct pending_read *read)
 {
 	atomic_set_release(&read->done, 1);
@@ -1017,14 +1395,15 @@ static void set_read_done(struct pending_read *read)
  * Returns a new pending read entry.
  */
 static struct pending_read *add_pending_read(struct data_file *df,
-					     int block_index)
+					     int block_index,
+					     struct incfs_read_hint *hint)
 {
 	struct pending_read *result = NULL;
-	struct data_file_segment *segment = NULL;
+	struct pending_read_bucket *bucket = NULL;
 	struct mount_info *mi = NULL;
 
-	segment = get_file_segment(df, block_index);
 	mi = df->df_mount_info;
+	bucket = pending_read_bucket(mi, &df->df_id, block_index);
 
 	result = kzalloc(sizeof(*result), GFP_NOFS);
 	if (!result)
@@ -1034,14 +1413,20 @@ static struct pending_read *add_pending_read(struct data_file *df,
 	result->block_index = block_index;
 	result->timestamp_us = ktime_to_us(ktime_get());
 	result->uid = current_uid().val;
+	if (hint)
+		result->prefetch_blocks = hint->prefetch_blocks;
 
 	spin_lock(&mi->pending_read_lock);
 
 	result->serial_number = ++mi->mi_last_pending_read_number;
 	mi->mi_pending_reads_count++;
+	if (result->prefetch_blocks) {
+		mi->mi_reads_prefetch_hinted++;
+		mi->mi_reads_prefetch_blocks += result->prefetch_blocks;
+	}
 
 	list_add_rcu(&result->mi_reads_list, &mi->mi_reads_list_head);
-	list_add_rcu(&result->segment_reads_list, &segment->reads_list_head);
+	hlist_add_head_rcu(&result->hash_node, &bucket->prb_reads);
 
 	spin_unlock(&mi->pending_read_lock);
 
@@ -1074,7 +1459,7 @@ static void remove_pending_read(struct data_file *df, struct pending_read *read)
 	spin_lock(&mi->pending_read_lock);
 
 	list_del_rcu(&read->mi_reads_list);
-	list_del_rcu(&read->segment_reads_list);
+	hlist_del_rcu(&read->hash_node);
 
 	mi->mi_pending_reads_count--;
 
@@ -1085,20 +1470,27 @@ static void remove_pending_read(struct data_file *df, struct pending_read *read)
 }
 
 static void notify_pending_reads(struct mount_info *mi,
-		struct data_file_segment *segment,
+		struct data_file *df,
 		int index)
 {
+	struct pending_read_bucket *bucket;
 	struct pending_read *entry = NULL;
+	bool found = false;
+
+	bucket = pending_read_bucket(mi, &df->df_id, index);
 
 	/* Notify pending reads waiting for this block. */
 	rcu_read_lock();
-	list_for_each_entry_rcu(entry, &segment->reads_list_head,
-						segment_reads_list) {
-		if (entry->block_index == index)
+	hlist_for_each_entry_rcu(entry, &bucket->prb_reads, hash_node) {
+		if (entry->block_index == index &&
+		    !memcmp(&entry->file_id, &df->df_id, sizeof(df->df_id))) {
 			set_read_done(entry);
+			found = true;
+		}
 	}
 	rcu_read_unlock();
-	wake_up_all(&segment->new_data_arrival_wq);
+	if (found)
+		wake_up_all(&bucket->prb_wq);
 
 	atomic_inc(&mi->mi_blocks_written);
 	wake_up_all(&mi->mi_blocks_written_notif_wq);
@@ -1122,10 +1514,12 @@ static int usleep_interruptible(u32 us)
 
 static int wait_for_data_block(struct data_file *df, int block_index,
 			       struct data_file_block *res_block,
-			       struct incfs_read_data_file_timeouts *timeouts)
+			       struct incfs_read_data_file_timeouts *timeouts,
+			       struct incfs_read_hint *hint)
 {
 	struct data_file_block block = {};
 	struct data_file_segment *segment = NULL;
+	struct pending_read_bucket *bucket = NULL;
 	struct pending_read *read = NULL;
 	struct mount_info *mi = NULL;
 	int error;
@@ -1157,6 +1551,13 @@ static int wait_for_data_block(struct data_file *df, int block_index,
 	if (error)
 		return error;
 
+	if (hint && hint->readahead) {
+		if (is_data_block_present(&block))
+			mi->mi_reads_prefetch_hit++;
+		else
+			mi->mi_reads_prefetch_miss++;
+	}
+
 	/* If the block was found, just return it. No need to wait. */
 	if (is_data_block_present(&block)) {
 		*res_block = block;
@@ -1169,7 +1570,7 @@ static int wait_for_data_block(struct data_file *df, int block_index,
 	} else {
 		/* If it's not found, create a pending read */
 		if (timeouts && timeouts->max_pending_time_us) {
-			read = add_pending_read(df, block_index);
+			read = add_pending_read(df, block_index, hint);
 			if (!read)
 				return -ENOMEM;
 		} else {
@@ -1185,8 +1586,9 @@ static int wait_for_data_block(struct data_file *df, int block_index,
 	}
 
 	/* Wait for notifications about block's arrival */
+	bucket = pending_read_bucket(mi, &df->df_id, block_index);
 	wait_res =
-		wait_event_interruptible_timeout(segment->new_data_arrival_wq,
+		wait_event_interruptible_timeout(bucket->prb_wq,
 			(is_read_done(read)),
 			usecs_to_jiffies(timeouts->max_pending_time_us));
 
@@ -1282,7 +1684,8 @@ static int incfs_update_sysfs_error(struct file *file, int index, int result,
 
 ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 			int index, struct mem_range tmp,
-			struct incfs_read_data_file_timeouts *timeouts)
+			struct incfs_read_data_file_timeouts *timeouts,
+			struct incfs_read_hint *hint)
 {
 	loff_t pos;
 	ssize_t result;
@@ -1301,7 +1704,7 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 	mi = df->df_mount_info;
 	bfc = df->df_backing_file_context;
 
-	result = wait_for_data_block(df, index, &block, timeouts);
+	result = wait_for_data_block(df, index, &block, timeouts, hint);
 	if (result < 0)
 		goto out;
 
@@ -1317,9 +1720,14 @@ ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 		bytes_to_read = min(tmp.len, block.db_stored_size);
 		result = incfs_kread(bfc, tmp.data, bytes_to_read, pos);
 		if (result == bytes_to_read) {
+			ktime_t start = ktime_get();
+
 			result =
 				decompress(mi, range(tmp.data, bytes_to_read),
 					   dst, block.db_comp_alg);
+			mi->mi_reads_decompressed++;
+			mi->mi_reads_decompress_ns +=
+				ktime_to_ns(ktime_sub(ktime_get(), start));
 			if (result < 0) {
 				const char *name =
 				    bfc->bc_file->f_path.dentry->d_name.name;
@@ -1378,6 +1786,108 @@ ssize_t incfs_read_merkle_tree_blocks(struct mem_range dst,
 	return incfs_kread(bfc, dst.data, to_read, sig->hash_offset + offset);
 }
 
+/*
+ * Fill a run of consecutive uncompressed blocks. All segments are locked
+ * for the whole run, the blocks that are missing are written with one
+ * write per contiguous gap and the blocks already present are skipped.
+ */
+static int process_new_data_range(struct data_file *df,
+				  struct incfs_fill_block *block, u8 *data)
+{
+	struct mount_info *mi = df->df_mount_info;
+	struct backing_file_context *bfc = df->df_backing_file_context;
+	struct incfs_blockmap_entry *bme = NULL;
+	struct data_file_block dfb = {};
+	int count = DIV_ROUND_UP(block->data_len, INCFS_DATA_FILE_BLOCK_SIZE);
+	int first = block->block_index;
+	int seg, i, j, done = 0;
+	int error = 0;
+
+	if (block->compression != COMPRESSION_NONE || count == 0)
+		return -EINVAL;
+
+	if (block->block_index >= df->df_data_block_count ||
+	    count > df->df_data_block_count - first)
+		return -ERANGE;
+
+	/* Only the last block of the file may be short */
+	if (block->data_len % INCFS_DATA_FILE_BLOCK_SIZE &&
+	    first + count != df->df_data_block_count)
+		return -EINVAL;
+
+	bme = kcalloc(count, sizeof(*bme), GFP_NOFS);
+	if (!bme)
+		return -ENOMEM;
+
+	for (seg = 0; seg < SEGMENTS_PER_FILE; seg++) {
+		error = down_write_killable_nested(&df->df_segments[seg].rwsem,
+						   seg);
+		if (error)
+			goto out_unlock;
+	}
+
+	error = incfs_read_blockmap_entries(bfc, bme, first, count,
+					    df->df_blockmap_off);
+	if (error < 0)
+		goto out_unlock;
+	if (error != count) {
+		error = -EIO;
+		goto out_unlock;
+	}
+
+	error = mutex_lock_interruptible(&bfc->bc_mutex);
+	if (error)
+		goto out_unlock;
+
+	for (i = 0; i < count; i = j) {
+		size_t start = (size_t)i * INCFS_DATA_FILE_BLOCK_SIZE;
+		size_t end;
+
+		convert_data_file_block(bme + i, &dfb);
+		if (is_data_block_present(&dfb)) {
+			j = i + 1;
+			done = j;
+			continue;
+		}
+
+		for (j = i + 1; j < count; j++) {
+			convert_data_file_block(bme + j, &dfb);
+			if (is_data_block_present(&dfb))
+				break;
+		}
+
+		end = min_t(size_t, block->data_len,
+			    (size_t)j * INCFS_DATA_FILE_BLOCK_SIZE);
+		error = incfs_write_data_blocks_to_backing_file(
+			bfc, range(data + start, end - start), first + i, j - i,
+			df->df_blockmap_off);
+		if (error)
+			break;
+
+		/* Mark the gap as filled for the notification pass below */
+		memset(bme + i, 0, (j - i) * sizeof(*bme));
+		done = j;
+	}
+	mutex_unlock(&bfc->bc_mutex);
+
+	for (i = 0; i < done; i++) {
+		convert_data_file_block(bme + i, &dfb);
+		if (is_data_block_present(&dfb))
+			continue;
+		notify_pending_reads(mi, df, first + i);
+		atomic_inc(&df->df_data_blocks_written);
+	}
+
+out_unlock:
+	while (seg--)
+		up_write(&df->df_segments[seg].rwsem);
+	kfree(bme);
+
+	if (error)
+		pr_debug("%d+%d error: %d\n", first, count, error);
+	return error;
+}
+
 int incfs_process_new_data_block(struct data_file *df,
 				 struct incfs_fill_block *block, u8 *data)
 {
@@ -1391,6 +1901,9 @@ int incfs_process_new_data_block(struct data_file *df,
 	if (!df || !block)
 		return -EFAULT;
 
+	if (block->flags & INCFS_BLOCK_FLAGS_RANGE)
+		return process_new_data_range(df, block, data);
+
 	bfc = df->df_backing_file_context;
 	mi = df->df_mount_info;
 
@@ -1435,7 +1948,7 @@ int incfs_process_new_data_block(struct data_file *df,
 		mutex_unlock(&bfc->bc_mutex);
 	}
 	if (!error) {
-		notify_pending_reads(mi, segment, block->block_index);
+		notify_pending_reads(mi, df, block->block_index);
 		atomic_inc(&df->df_data_blocks_written);
 	}
 
@@ -1482,6 +1995,7 @@ int incfs_process_new_hash_block(struct data_file *df,
 	struct incfs_df_signature *sig = NULL;
 	loff_t hash_area_base = 0;
 	loff_t hash_area_size = 0;
+	int count = 1;
 	int error = 0;
 
 	if (!df || !block)
@@ -1509,15 +2023,24 @@ int incfs_process_new_hash_block(struct data_file *df,
 		return -ERANGE;
 	}
 
+	/* A range is a run of full hash blocks, written in one go */
+	if (block->flags & INCFS_BLOCK_FLAGS_RANGE) {
+		if (!block->data_len ||
+		    block->data_len % INCFS_DATA_FILE_BLOCK_SIZE)
+			return -EINVAL;
+		count = block->data_len / INCFS_DATA_FILE_BLOCK_SIZE;
+	}
+
 	error = mutex_lock_interruptible(&bfc->bc_mutex);
 	if (!error) {
-		error = incfs_write_hash_block_to_backing_file(
+		error = incfs_write_hash_blocks_to_backing_file(
 			bfc, range(data, block->data_len), block->block_index,
-			hash_area_base, df->df_blockmap_off, df->df_size);
+			count, hash_area_base, df->df_blockmap_off,
+			df->df_size);
 		mutex_unlock(&bfc->bc_mutex);
 	}
 	if (!error)
-		atomic_inc(&df->df_hash_blocks_written);
+		atomic_add(count, &df->df_hash_blocks_written);
 
 	return error;
 }
@@ -1781,6 +2304,8 @@ int incfs_collect_pending_reads(struct mount_info *mi, int sn_lowerbound,
 			reads2[reported_reads].timestamp_us =
 				entry->timestamp_us;
 			reads2[reported_reads].uid = entry->uid;
+			reads2[reported_reads].prefetch_blocks =
+				entry->prefetch_blocks;
 		}
 
 		if (entry->serial_number > *new_max_sn)
@@ -1802,6 +2327,7 @@ struct read_log_state incfs_get_log_state(struct mount_info *mi)
 	struct read_log_state result;
 
 	spin_lock(&log->rl_lock);
+	log_merge_pcpu(log);
 	result = log->rl_head;
 	spin_unlock(&log->rl_lock);
 	return result;
@@ -1815,6 +2341,7 @@ int incfs_get_uncollected_logs_count(struct mount_info *mi,
 	u64 head_no, tail_no;
 
 	spin_lock(&log->rl_lock);
+	log_merge_pcpu(log);
 	tail_no = log->rl_tail.current_record_no;
 	head_no = log->rl_head.current_record_no;
 	generation = log->rl_head.generation_id;
@@ -1837,6 +2364,7 @@ int incfs_collect_logged_reads(struct mount_info *mi,
 	struct read_log_state *head, *tail;
 
 	spin_lock(&log->rl_lock);
+	log_merge_pcpu(log);
 	head = &log->rl_head;
 	tail = &log->rl_tail;
 
@@ -16,6 +16,7 @@
 #include <linux/zstd.h>
 #include <crypto/hash.h>
 #include <linux/rwsem.h>
+#include <linux/shrinker.h>
 
 #include <uapi/linux/incrementalfs.h>
 
@@ -24,6 +25,13 @@
 
 #define SEGMENTS_PER_FILE 3
 
+/* Buckets of the per-mount pending read hash, see pending_read_bucket() */
+#define INCFS_PENDING_READS_HASH_BITS 8
+
+/* Verified hash blocks kept per mount, on top of the page cache */
+#define INCFS_HASH_CACHE_BITS 8
+#define INCFS_HASH_CACHE_MAX_BLOCKS 1024
+
 enum LOG_RECORD_TYPE {
 	FULL,
 	SAME_FILE,
@@ -96,6 +104,27 @@ struct read_log_state {
 	u64 current_record_no;
 };
 
+/* A read waiting in a per-cpu buffer to be added to the read log */
+struct read_log_entry {
+	incfs_uuid_t file_id;
+	s64 ts_us;
+	u32 block_index;
+	uid_t uid;
+};
+
+#define INCFS_READ_LOG_PCPU_ENTRIES 32
+
+/*
+ * Reads are first collected per cpu, each buffer lock normally only being
+ * taken by its cpu, and only merged into the shared ring buffer when a
+ * buffer is full or when the log is read.
+ */
+struct read_log_pcpu {
+	spinlock_t rlp_lock;
+	u32 rlp_count;
+	struct read_log_entry rlp_entries[INCFS_READ_LOG_PCPU_ENTRIES];
+};
+
 /* A ring buffer to save records about data blocks which were recently read. */
 struct read_log {
 	void *rl_ring_buf;
@@ -106,9 +135,15 @@ struct read_log {
 
 	struct read_log_state rl_tail;
 
+	/* Room to sort the per-cpu entries by time when merging them */
+	struct read_log_entry *rl_merge_buf;
+
 	/* A lock to protect the above fields */
 	spinlock_t rl_lock;
 
+	/* Reads not yet merged into rl_ring_buf */
+	struct read_log_pcpu __percpu *rl_pcpu;
+
 	/* A queue of waiters who want to be notified about reads */
 	wait_queue_head_t ml_notif_wq;
 
@@ -121,10 +156,57 @@ struct mount_options {
 	unsigned int readahead_pages;
 	unsigned int read_log_pages;
 	unsigned int read_log_wakeup_count;
+	unsigned int read_log_wakeup_ms;
 	bool report_uid;
 	char *sysfs_name;
 };
 
+/* A zstd decompression context, see zstd_decompress_safe() */
+struct incfs_zstd_ctx {
+	struct mutex zc_mutex;
+	void *zc_workspace;
+	ZSTD_DStream *zc_stream;
+};
+
+/*
+ * A hash tree block that has been verified up to the root hash. The root
+ * hash is part of the key, so a file recreated under the same id with a
+ * different tree never sees the blocks of the old one.
+ */
+struct verified_hash_block {
+	struct hlist_node vhb_hash_node;
+
+	struct list_head vhb_lru;
+
+	incfs_uuid_t vhb_file_id;
+
+	/* Offset of the block in the hash tree */
+	loff_t vhb_offset;
+
+	u8 vhb_root_hash[INCFS_MAX_HASH_SIZE];
+
+	/* INCFS_DATA_FILE_BLOCK_SIZE bytes */
+	u8 *vhb_data;
+};
+
+/*
+ * Bounded LRU of verified hash blocks. Hash pages in the page cache of an
+ * incfs inode go away with the inode, these survive until evicted by size
+ * or by the shrinker.
+ */
+struct hash_block_cache {
+	/* Protects everything below */
+	spinlock_t hbc_lock;
+
+	struct hlist_head *hbc_table;
+
+	struct list_head hbc_lru;
+
+	unsigned long hbc_count;
+
+	struct shrinker hbc_shrinker;
+};
+
 struct mount_info {
 	struct super_block *mi_sb;
 
@@ -151,13 +233,16 @@ struct mount_info {
 	 *  - reads_list_head
 	 *  - mi_pending_reads_count
 	 *  - mi_last_pending_read_number
-	 *  - data_file_segment.reads_list_head
+	 *  - mi_pending_reads_hash[].prb_reads
 	 */
 	spinlock_t pending_read_lock;
 
 	/* List of active pending_read objects */
 	struct list_head mi_reads_list_head;
 
+	/* The same objects hashed by file id and block index */
+	struct pending_read_bucket *mi_pending_reads_hash;
+
 	/* Total number of items in reads_list_head */
 	int mi_pending_reads_count;
 
@@ -184,10 +269,11 @@ struct mount_info {
 	struct incfs_per_uid_read_timeouts *mi_per_uid_read_timeouts;
 	int mi_per_uid_read_timeouts_size;
 
-	/* zstd workspace */
-	struct mutex mi_zstd_workspace_mutex;
-	void *mi_zstd_workspace;
-	ZSTD_DStream *mi_zstd_stream;
+	/* Hash tree blocks already checked against their root hash */
+	struct hash_block_cache mi_hash_cache;
+
+	/* Per-cpu zstd workspaces, freed once idle for a while */
+	struct incfs_zstd_ctx __percpu *mi_zstd_ctx;
 	struct delayed_work mi_zstd_cleanup_work;
 
 	/* sysfs node */
@@ -231,6 +317,24 @@ struct mount_info {
 	 * time.
 	 */
 	u64 mi_reads_delayed_min_us;
+
+	/* Number of compressed blocks decompressed */
+	u32 mi_reads_decompressed;
+
+	/* Total time spent decompressing them */
+	u64 mi_reads_decompress_ns;
+
+	/* Number of pending reads reported with a prefetch hint */
+	u32 mi_reads_prefetch_hinted;
+
+	/* Total number of blocks in those hints */
+	u64 mi_reads_prefetch_blocks;
+
+	/* Number of readahead blocks that were present when read */
+	u32 mi_reads_prefetch_hit;
+
+	/* Number of readahead blocks that had to be waited for */
+	u32 mi_reads_prefetch_miss;
 };
 
 struct data_file_block {
@@ -254,22 +358,29 @@ struct pending_read {
 
 	uid_t uid;
 
+	u32 prefetch_blocks;
+
 	struct list_head mi_reads_list;
 
-	struct list_head segment_reads_list;
+	struct hlist_node hash_node;
 
 	struct rcu_head rcu;
 };
 
-struct data_file_segment {
-	wait_queue_head_t new_data_arrival_wq;
+/*
+ * Pending reads of blocks that hash to the same bucket, and the queue
+ * their readers wait on, so filling a block only wakes up the readers of
+ * that block and the rare ones colliding with it.
+ */
+struct pending_read_bucket {
+	struct hlist_head prb_reads;
+
+	wait_queue_head_t prb_wq;
+};
 
+struct data_file_segment {
 	/* Protects reads and writes from the blockmap */
 	struct rw_semaphore rwsem;
-
-	/* List of active pending_read objects belonging to this segment */
-	/* Protected by mount_info.pending_reads_mutex */
-	struct list_head reads_list_head;
 };
 
 /*
@@ -421,9 +532,19 @@ struct incfs_read_data_file_timeouts {
 	u32 max_pending_time_us;
 };
 
+/* How a block read relates to the reader's readahead */
+struct incfs_read_hint {
+	/* The read is done on behalf of readahead */
+	bool readahead;
+
+	/* Reported as incfs_pending_read_info2.prefetch_blocks */
+	u32 prefetch_blocks;
+};
+
 ssize_t incfs_read_data_file_block(struct mem_range dst, struct file *f,
 			int index, struct mem_range tmp,
-			struct incfs_read_data_file_timeouts *timeouts);
+			struct incfs_read_data_file_timeouts *timeouts,
+			struct incfs_read_hint *hint);
 
 ssize_t incfs_read_merkle_tree_blocks(struct mem_range dst,
 				      struct data_file *df, size_t offset);
@@ -512,14 +512,79 @@ int incfs_write_data_block_to_backing_file(struct backing_file_context *bfc,
 				bm_entry_off);
 }
 
-int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
-					   struct mem_range block,
-					   int block_index,
-					   loff_t hash_area_off,
-					   loff_t bm_base_off,
-					   loff_t file_size)
+/*
+ * Write count consecutive uncompressed data blocks with a single write and
+ * update their blockmap entries with another one. All blocks but the last
+ * one are full size.
+ */
+int incfs_write_data_blocks_to_backing_file(struct backing_file_context *bfc,
+					    struct mem_range blocks,
+					    int block_index, int count,
+					    loff_t bm_base_off)
+{
+	struct incfs_blockmap_entry *bm_entries;
+	loff_t data_offset = 0;
+	loff_t bm_entry_off =
+		bm_base_off + sizeof(struct incfs_blockmap_entry) * block_index;
+	size_t pos;
+	int result;
+	int i;
+
+	if (!bfc)
+		return -EFAULT;
+
+	if (block_index < 0 || count <= 0 ||
+	    blocks.len <= (size_t)(count - 1) * INCFS_DATA_FILE_BLOCK_SIZE ||
+	    blocks.len > (size_t)count * INCFS_DATA_FILE_BLOCK_SIZE)
+		return -EINVAL;
+
+	LOCK_REQUIRED(bfc->bc_mutex);
+
+	data_offset = incfs_get_end_offset(bfc->bc_file);
+	if (data_offset <= bm_entry_off) {
+		/* Blockmap entry is beyond the file's end. It is not normal. */
+		return -EINVAL;
+	}
+
+	bm_entries = kcalloc(count, sizeof(*bm_entries), GFP_NOFS);
+	if (!bm_entries)
+		return -ENOMEM;
+
+	result = write_to_bf(bfc, blocks.data, blocks.len, data_offset);
+	if (result)
+		goto out;
+
+	for (i = 0, pos = 0; i < count; i++, pos += INCFS_DATA_FILE_BLOCK_SIZE) {
+		loff_t off = data_offset + pos;
+		size_t size = min_t(size_t, blocks.len - pos,
+				    INCFS_DATA_FILE_BLOCK_SIZE);
+
+		bm_entries[i].me_data_offset_lo = cpu_to_le32((u32)off);
+		bm_entries[i].me_data_offset_hi = cpu_to_le16((u16)(off >> 32));
+		bm_entries[i].me_data_size = cpu_to_le16((u16)size);
+	}
+
+	result = write_to_bf(bfc, bm_entries, count * sizeof(*bm_entries),
+			     bm_entry_off);
+out:
+	kfree(bm_entries);
+	return result;
+}
+
+/*
+ * Write a run of count consecutive hash blocks starting at block_index and
+ * update their blockmap entries. The blocks are stored at fixed offsets of
+ * the hash area, so the run is a single write either way.
+ */
+int incfs_write_hash_blocks_to_backing_file(struct backing_file_context *bfc,
+					    struct mem_range blocks,
+					    int block_index, int count,
+					    loff_t hash_area_off,
+					    loff_t bm_base_off,
+					    loff_t file_size)
 {
 	struct incfs_blockmap_entry bm_entry = {};
+	struct incfs_blockmap_entry *bm_entries = &bm_entry;
 	int result;
 	loff_t data_offset = 0;
 	loff_t file_end = 0;
@@ -527,28 +592,60 @@ int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
 		bm_base_off +
 		sizeof(struct incfs_blockmap_entry) *
 			(block_index + get_blocks_count_for_size(file_size));
+	int i;
 
 	if (!bfc)
 		return -EFAULT;
 
+	if (count <= 0)
+		return -EINVAL;
+
 	LOCK_REQUIRED(bfc->bc_mutex);
 
 	data_offset = hash_area_off + block_index * INCFS_DATA_FILE_BLOCK_SIZE;
 	file_end = incfs_get_end_offset(bfc->bc_file);
-	if (data_offset + block.len > file_end) {
+	if (data_offset + blocks.len > file_end) {
 		/* Block is located beyond the file's end. It is not normal. */
 		return -EINVAL;
 	}
 
-	result = write_to_bf(bfc, block.data, block.len, data_offset);
+	if (count > 1) {
+		bm_entries = kcalloc(count, sizeof(*bm_entries), GFP_NOFS);
+		if (!bm_entries)
+			return -ENOMEM;
+	}
+
+	result = write_to_bf(bfc, blocks.data, blocks.len, data_offset);
 	if (result)
-		return result;
+		goto out;
 
-	bm_entry.me_data_offset_lo = cpu_to_le32((u32)data_offset);
-	bm_entry.me_data_offset_hi = cpu_to_le16((u16)(data_offset >> 32));
-	bm_entry.me_data_size = cpu_to_le16(INCFS_DATA_FILE_BLOCK_SIZE);
+	for (i = 0; i < count; i++) {
+		loff_t off = data_offset + i * INCFS_DATA_FILE_BLOCK_SIZE;
+
+		bm_entries[i].me_data_offset_lo = cpu_to_le32((u32)off);
+		bm_entries[i].me_data_offset_hi = cpu_to_le16((u16)(off >> 32));
+		bm_entries[i].me_data_size =
+			cpu_to_le16(INCFS_DATA_FILE_BLOCK_SIZE);
+	}
+
+	result = write_to_bf(bfc, bm_entries, count * sizeof(*bm_entries),
+			     bm_entry_off);
+out:
+	if (bm_entries != &bm_entry)
+		kfree(bm_entries);
+	return result;
+}
 
-	return write_to_bf(bfc, &bm_entry, sizeof(bm_entry), bm_entry_off);
+int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
+					   struct mem_range block,
+					   int block_index,
+					   loff_t hash_area_off,
+					   loff_t bm_base_off,
+					   loff_t file_size)
+{
+	return incfs_write_hash_blocks_to_backing_file(bfc, block, block_index,
+						       1, hash_area_off,
+						       bm_base_off, file_size);
 }
 
 int incfs_read_blockmap_entry(struct backing_file_context *bfc, int block_index,
@@ -363,6 +363,18 @@ int incfs_write_data_block_to_backing_file(struct backing_file_context *bfc,
 					   int block_index, loff_t bm_base_off,
 					   u16 flags);
 
+int incfs_write_data_blocks_to_backing_file(struct backing_file_context *bfc,
+					    struct mem_range blocks,
+					    int block_index, int count,
+					    loff_t bm_base_off);
+
+int incfs_write_hash_blocks_to_backing_file(struct backing_file_context *bfc,
+					    struct mem_range blocks,
+					    int block_index, int count,
+					    loff_t hash_area_off,
+					    loff_t bm_base_off,
+					    loff_t file_size);
+
 int incfs_write_hash_block_to_backing_file(struct backing_file_context *bfc,
 					   struct mem_range block,
 					   int block_index,
@@ -23,14 +23,24 @@ static int __init init_incfs_module(void)
 {
 	int err = 0;
 
-	err = incfs_init_sysfs();
+	err = incfs_init_readahead();
 	if (err)
 		return err;
 
+	err = incfs_init_sysfs();
+	if (err)
+		goto err_readahead;
+
 	err = register_filesystem(&incfs_fs_type);
 	if (err)
-		incfs_cleanup_sysfs();
+		goto err_sysfs;
+
+	return 0;
 
+err_sysfs:
+	incfs_cleanup_sysfs();
+err_readahead:
+	incfs_cleanup_readahead();
 	return err;
 }
 
@@ -38,6 +48,7 @@ static void __exit cleanup_incfs_module(void)
 {
 	incfs_cleanup_sysfs();
 	unregister_filesystem(&incfs_fs_type);
+	incfs_cleanup_readahead();
 }
 
 module_init(init_incfs_module);
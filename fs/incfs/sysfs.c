@@ -33,11 +33,15 @@ static struct kobj_attribute name##_attr = __ATTR_RO(name)
 DECLARE_FEATURE_FLAG(corefs);
 DECLARE_FEATURE_FLAG(zstd);
 DECLARE_FEATURE_FLAG(v2);
+DECLARE_FEATURE_FLAG(fill_range);
+DECLARE_FEATURE_FLAG(prefetch_hint);
 
 static struct attribute *attributes[] = {
 	&corefs_attr.attr,
 	&zstd_attr.attr,
 	&v2_attr.attr,
+	&fill_range_attr.attr,
+	&prefetch_hint_attr.attr,
 	NULL,
 };
 
@@ -124,6 +128,12 @@ __DECLARE_STATUS_FLAG(reads_delayed_pending);
 __DECLARE_STATUS_FLAG64(reads_delayed_pending_us);
 __DECLARE_STATUS_FLAG(reads_delayed_min);
 __DECLARE_STATUS_FLAG64(reads_delayed_min_us);
+__DECLARE_STATUS_FLAG(reads_decompressed);
+__DECLARE_STATUS_FLAG64(reads_decompress_ns);
+__DECLARE_STATUS_FLAG(reads_prefetch_hinted);
+__DECLARE_STATUS_FLAG64(reads_prefetch_blocks);
+__DECLARE_STATUS_FLAG(reads_prefetch_hit);
+__DECLARE_STATUS_FLAG(reads_prefetch_miss);
 
 static struct attribute *mount_attributes[] = {
 	&reads_failed_timed_out_attr.attr,
@@ -133,6 +143,12 @@ static struct attribute *mount_attributes[] = {
 	&reads_delayed_pending_us_attr.attr,
 	&reads_delayed_min_attr.attr,
 	&reads_delayed_min_us_attr.attr,
+	&reads_decompressed_attr.attr,
+	&reads_decompress_ns_attr.attr,
+	&reads_prefetch_hinted_attr.attr,
+	&reads_prefetch_blocks_attr.attr,
+	&reads_prefetch_hit_attr.attr,
+	&reads_prefetch_miss_attr.attr,
 	NULL,
 };
 
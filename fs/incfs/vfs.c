@@ -14,6 +14,7 @@
 #include <linux/namei.h>
 #include <linux/parser.h>
 #include <linux/seq_file.h>
+#include <linux/workqueue.h>
 
 #include <uapi/linux/incrementalfs.h>
 
@@ -45,6 +46,7 @@ static int dir_rename(struct inode *old_dir, struct dentry *old_dentry,
 static int file_open(struct inode *inode, struct file *file);
 static int file_release(struct inode *inode, struct file *file);
 static int read_single_page(struct file *f, struct page *page);
+static void incfs_readahead(struct readahead_control *rac);
 static long dispatch_ioctl(struct file *f, unsigned int req, unsigned long arg);
 
 #ifdef CONFIG_COMPAT
@@ -109,7 +111,7 @@ static const struct dentry_operations incfs_dentry_ops = {
 
 static const struct address_space_operations incfs_address_space_ops = {
 	.readpage = read_single_page,
-	/* .readpages = readpages */
+	.readahead = incfs_readahead,
 };
 
 static vm_fault_t incfs_fault(struct vm_fault *vmf)
@@ -198,6 +200,7 @@ enum parse_parameter {
 	Opt_readahead_pages,
 	Opt_rlog_pages,
 	Opt_rlog_wakeup_cnt,
+	Opt_rlog_wakeup_ms,
 	Opt_report_uid,
 	Opt_sysfs_name,
 	Opt_err
@@ -208,6 +211,7 @@ static const match_table_t option_tokens = {
 	{ Opt_readahead_pages, "readahead=%u" },
 	{ Opt_rlog_pages, "rlog_pages=%u" },
 	{ Opt_rlog_wakeup_cnt, "rlog_wakeup_cnt=%u" },
+	{ Opt_rlog_wakeup_ms, "rlog_wakeup_ms=%u" },
 	{ Opt_report_uid, "report_uid" },
 	{ Opt_sysfs_name, "sysfs_name=%s" },
 	{ Opt_err, NULL }
@@ -233,6 +237,7 @@ static int parse_options(struct mount_options *opts, char *str)
 		.readahead_pages = 10,
 		.read_log_pages = 2,
 		.read_log_wakeup_count = 10,
+		.read_log_wakeup_ms = 16,
 	};
 
 	if (str == NULL || *str == 0)
@@ -269,6 +274,13 @@ static int parse_options(struct mount_options *opts, char *str)
 				return -EINVAL;
 			opts->read_log_wakeup_count = value;
 			break;
+		case Opt_rlog_wakeup_ms:
+			if (match_int(&args[0], &value))
+				return -EINVAL;
+			if (value > 10000)
+				return -EINVAL;
+			opts->read_log_wakeup_ms = value;
+			break;
 		case Opt_report_uid:
 			opts->report_uid = true;
 			break;
@@ -472,7 +484,8 @@ static struct dentry *open_or_create_special_dir(struct dentry *backing_dir,
 
 static int read_single_page_timeouts(struct data_file *df, struct file *f,
 				     int block_index, struct mem_range range,
-				     struct mem_range tmp)
+				     struct mem_range tmp,
+				     struct incfs_read_hint *hint)
 {
 	struct mount_info *mi = df->df_mount_info;
 	struct incfs_read_data_file_timeouts timeouts = {
@@ -504,10 +517,11 @@ static int read_single_page_timeouts(struct data_file *df, struct file *f,
 	}
 
 	return incfs_read_data_file_block(range, f, block_index, tmp,
-					  &timeouts);
+					  &timeouts, hint);
 }
 
-static int read_single_page(struct file *f, struct page *page)
+static int read_page(struct file *f, struct page *page,
+		     struct incfs_read_hint *hint)
 {
 	loff_t offset = 0;
 	loff_t size = 0;
@@ -542,7 +556,8 @@ static int read_single_page(struct file *f, struct page *page)
 		bytes_to_read = min_t(loff_t, size - offset, PAGE_SIZE);
 
 		read_result = read_single_page_timeouts(df, f, block_index,
-					range(page_start, bytes_to_read), tmp);
+					range(page_start, bytes_to_read), tmp,
+					hint);
 
 		free_pages((unsigned long)tmp.data, get_order(tmp.len));
 	} else {
@@ -567,6 +582,152 @@ err:
 	return result;
 }
 
+static int read_single_page(struct file *f, struct page *page)
+{
+	return read_page(f, page, NULL);
+}
+
+/*
+ * Readahead reads, decompresses and verifies the blocks after the first
+ * one on incfs_ra_wq, in parallel, while the reader takes care of the
+ * first block itself. The workers act with the reader's credentials, so
+ * pending reads, the read log and the per-uid timeouts still see the
+ * reader's uid. Blocks that are not there yet make the workers wait for
+ * them, so they get a workqueue of their own.
+ */
+static struct workqueue_struct *incfs_ra_wq;
+
+struct incfs_ra_work {
+	struct work_struct work;
+	struct incfs_ra_batch *batch;
+	struct page *page;
+};
+
+struct incfs_ra_batch {
+	struct file *file;
+	const struct cred *cred;
+	atomic_t pending;
+	struct incfs_ra_work works[];
+};
+
+static void incfs_ra_batch_put(struct incfs_ra_batch *batch)
+{
+	if (!atomic_dec_and_test(&batch->pending))
+		return;
+
+	put_cred(batch->cred);
+	fput(batch->file);
+	kfree(batch);
+}
+
+static void incfs_readahead_work(struct work_struct *work)
+{
+	struct incfs_ra_work *w = container_of(work, struct incfs_ra_work,
+					       work);
+	struct incfs_ra_batch *batch = w->batch;
+	struct incfs_read_hint ra_hint = { .readahead = true };
+	const struct cred *old_cred;
+
+	old_cred = override_creds(batch->cred);
+	read_page(batch->file, w->page, &ra_hint);
+	revert_creds(old_cred);
+
+	put_page(w->page);
+	incfs_ra_batch_put(batch);
+}
+
+/*
+ * Blocks after index the reader is going to need soon: the rest of the
+ * current readahead window and, as the window only grows while the reads
+ * stay sequential, one more window of the same size after it.
+ */
+static u32 readahead_prefetch_blocks(struct readahead_control *rac)
+{
+	struct data_file *df = get_incfs_data_file(rac->file);
+	pgoff_t index = readahead_index(rac);
+	pgoff_t end = index + readahead_count(rac);
+	struct file_ra_state *ra = &rac->file->f_ra;
+	pgoff_t file_pages;
+
+	if (!df)
+		return 0;
+
+	if (ra->size && ra->start <= index && ra->start + ra->size > end)
+		end = ra->start + ra->size;
+	end += end - index;
+
+	file_pages = DIV_ROUND_UP(df->df_size, PAGE_SIZE);
+	if (end > file_pages)
+		end = file_pages;
+
+	return end > index + 1 ? end - index - 1 : 0;
+}
+
+static void incfs_readahead(struct readahead_control *rac)
+{
+	unsigned int nr = readahead_count(rac);
+	struct incfs_read_hint hint = {};
+	struct incfs_read_hint ra_hint = { .readahead = true };
+	struct incfs_ra_batch *batch = NULL;
+	struct page *first, *page;
+	unsigned int i = 0;
+
+	/* read_page() needs the file, the caller unlocks what is left */
+	if (!rac->file)
+		return;
+
+	hint.prefetch_blocks = readahead_prefetch_blocks(rac);
+	first = readahead_page(rac);
+	if (!first)
+		return;
+
+	if (nr > 1)
+		batch = kmalloc(struct_size(batch, works, nr - 1),
+				GFP_NOFS | __GFP_NOWARN);
+	if (batch) {
+		batch->file = get_file(rac->file);
+		batch->cred = get_current_cred();
+		/* One reference for each work plus one for us */
+		atomic_set(&batch->pending, 1);
+
+		while (i < nr - 1 && (page = readahead_page(rac))) {
+			struct incfs_ra_work *w = &batch->works[i++];
+
+			w->batch = batch;
+			w->page = page;
+			INIT_WORK(&w->work, incfs_readahead_work);
+			atomic_inc(&batch->pending);
+			queue_work(incfs_ra_wq, &w->work);
+		}
+	}
+
+	/* Only the first block of the window carries the prefetch hint */
+	read_page(rac->file, first, &hint);
+	put_page(first);
+
+	/* Without a batch, or if it ran short, read the rest in order */
+	while ((page = readahead_page(rac))) {
+		read_page(rac->file, page, &ra_hint);
+		put_page(page);
+	}
+
+	if (batch)
+		incfs_ra_batch_put(batch);
+}
+
+int __init incfs_init_readahead(void)
+{
+	incfs_ra_wq = alloc_workqueue("incfs_readahead", WQ_UNBOUND, 0);
+	if (!incfs_ra_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void incfs_cleanup_readahead(void)
+{
+	destroy_workqueue(incfs_ra_wq);
+}
+
 int incfs_link(struct dentry *what, struct dentry *where)
 {
 	struct dentry *parent_dentry = dget_parent(where);
@@ -726,6 +887,7 @@ static long ioctl_fill_blocks(struct file *f, void __user *arg)
 	struct incfs_file_data *fd = f->private_data;
 	const ssize_t data_buf_size = 2 * INCFS_DATA_FILE_BLOCK_SIZE;
 	u8 *data_buf = NULL;
+	u8 *range_buf = NULL;
 	ssize_t error = 0;
 	int i = 0;
 
@@ -746,6 +908,8 @@ static long ioctl_fill_blocks(struct file *f, void __user *arg)
 
 	for (i = 0; i < fill_blocks.count; i++) {
 		struct incfs_fill_block fill_block = {};
+		ssize_t buf_size;
+		u8 *buf;
 
 		if (copy_from_user(&fill_block, &usr_fill_block_array[i],
 				   sizeof(fill_block)) > 0) {
@@ -753,12 +917,28 @@ static long ioctl_fill_blocks(struct file *f, void __user *arg)
 			break;
 		}
 
-		if (fill_block.data_len > data_buf_size) {
+		if (fill_block.flags & INCFS_BLOCK_FLAGS_RANGE) {
+			buf = range_buf;
+			buf_size = INCFS_FILL_RANGE_MAX_SIZE;
+			if (!buf && fill_block.data_len <= buf_size) {
+				range_buf = kvmalloc(buf_size, GFP_KERNEL);
+				if (!range_buf) {
+					error = -ENOMEM;
+					break;
+				}
+				buf = range_buf;
+			}
+		} else {
+			buf = data_buf;
+			buf_size = data_buf_size;
+		}
+
+		if (fill_block.data_len > buf_size) {
 			error = -E2BIG;
 			break;
 		}
 
-		if (copy_from_user(data_buf, u64_to_user_ptr(fill_block.data),
+		if (copy_from_user(buf, u64_to_user_ptr(fill_block.data),
 				   fill_block.data_len) > 0) {
 			error = -EFAULT;
 			break;
@@ -766,10 +946,10 @@ static long ioctl_fill_blocks(struct file *f, void __user *arg)
 		fill_block.data = 0; /* To make sure nobody uses it. */
 		if (fill_block.flags & INCFS_BLOCK_FLAGS_HASH) {
 			error = incfs_process_new_hash_block(df, &fill_block,
-							     data_buf);
+							     buf);
 		} else {
 			error = incfs_process_new_data_block(df, &fill_block,
-							     data_buf);
+							     buf);
 		}
 		if (error)
 			break;
@@ -777,6 +957,7 @@ static long ioctl_fill_blocks(struct file *f, void __user *arg)
 
 	if (data_buf)
 		free_pages((unsigned long)data_buf, get_order(data_buf_size));
+	kvfree(range_buf);
 
 	maybe_delete_incomplete_file(f, df);
 
@@ -1893,6 +2074,8 @@ static int show_options(struct seq_file *m, struct dentry *root)
 		seq_printf(m, ",rlog_pages=%u", mi->mi_options.read_log_pages);
 		seq_printf(m, ",rlog_wakeup_cnt=%u",
 			   mi->mi_options.read_log_wakeup_count);
+		seq_printf(m, ",rlog_wakeup_ms=%u",
+			   mi->mi_options.read_log_wakeup_ms);
 	}
 	if (mi->mi_options.report_uid)
 		seq_puts(m, ",report_uid");
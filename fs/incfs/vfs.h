@@ -14,6 +14,8 @@ struct dentry *incfs_mount_fs(struct file_system_type *type, int flags,
 			      const char *dev_name, void *data);
 int incfs_link(struct dentry *what, struct dentry *where);
 int incfs_unlink(struct dentry *dentry);
+int incfs_init_readahead(void);
+void incfs_cleanup_readahead(void);
 
 static inline struct mount_info *get_mount_info(struct super_block *sb)
 {
@@ -68,6 +68,8 @@ struct io_worker {
 	struct files_struct *restore_files;
 	struct nsproxy *restore_nsproxy;
 	struct fs_struct *restore_fs;
+
+	unsigned long nr_work;
 };
 
 #if BITS_PER_LONG == 64
@@ -82,6 +84,7 @@ struct io_wqe_acct {
 	unsigned nr_workers;
 	unsigned max_workers;
 	atomic_t nr_running;
+	unsigned long nr_created;
 };
 
 enum {
@@ -108,6 +111,14 @@ struct io_wqe {
 
 	struct io_wq *wq;
 	struct io_wq_work *hash_tail[IO_WQ_NR_HASH_BUCKETS];
+
+	/* node CPUs that are also in wq->cpu_mask */
+	cpumask_var_t cpu_mask;
+
+	/* work done by workers that have exited, under ->lock */
+	unsigned long nr_work_exited;
+	/* work handed to an idle worker instead of forking a new one */
+	atomic_long_t nr_reused;
 };
 
 /*
@@ -128,6 +139,13 @@ struct io_wq {
 	struct hlist_node cpuhp_node;
 
 	refcount_t use_refs;
+
+	/* RLIMIT_NPROC of the creator, checked against user->processes */
+	unsigned long nproc_limit;
+	/* CPUs set by io_wq_cpu_affinity(), all possible CPUs by default */
+	cpumask_var_t cpu_mask;
+	/* serializes cpu_mask updates against worker creation */
+	struct mutex aff_lock;
 };
 
 static enum cpuhp_state io_wq_online;
@@ -247,6 +265,7 @@ static void io_worker_exit(struct io_worker *worker)
 		raw_spin_lock_irq(&wqe->lock);
 	}
 	acct->nr_workers--;
+	wqe->nr_work_exited += worker->nr_work;
 	raw_spin_unlock_irq(&wqe->lock);
 
 	kfree_rcu(worker, rcu);
@@ -254,6 +273,14 @@ static void io_worker_exit(struct io_worker *worker)
 		complete(&wqe->wq->done);
 }
 
+/* wqes of offline nodes have no CPUs of their own */
+static const struct cpumask *io_wqe_node_mask(struct io_wqe *wqe)
+{
+	if (wqe->node == NUMA_NO_NODE)
+		return cpu_possible_mask;
+	return cpumask_of_node(wqe->node);
+}
+
 static inline bool io_wqe_run_queue(struct io_wqe *wqe)
 	__must_hold(wqe->lock)
 {
@@ -281,6 +308,7 @@ static bool io_wqe_activate_free_worker(struct io_wqe *wqe)
 	if (io_worker_get(worker)) {
 		wake_up_process(worker->task);
 		io_worker_release(worker);
+		atomic_long_inc(&wqe->nr_reused);
 		return true;
 	}
 
@@ -570,6 +598,7 @@ get_next:
 
 			old_work = work;
 			linked = wq->do_work(work);
+			worker->nr_work++;
 
 			work = next_hashed;
 			if (!work && linked && !io_wq_is_hashed(linked)) {
@@ -700,7 +729,9 @@ static bool create_io_worker(struct io_wq *wq, struct io_wqe *wqe, int index)
 		kfree(worker);
 		return false;
 	}
-	kthread_bind_mask(worker->task, cpumask_of_node(wqe->node));
+	mutex_lock(&wq->aff_lock);
+	kthread_bind_mask(worker->task, wqe->cpu_mask);
+	mutex_unlock(&wq->aff_lock);
 
 	raw_spin_lock_irq(&wqe->lock);
 	hlist_nulls_add_head_rcu(&worker->nulls_node, &wqe->free_list);
@@ -711,6 +742,7 @@ static bool create_io_worker(struct io_wq *wq, struct io_wqe *wqe, int index)
 	if (!acct->nr_workers && (worker->flags & IO_WORKER_F_BOUND))
 		worker->flags |= IO_WORKER_F_FIXED;
 	acct->nr_workers++;
+	acct->nr_created++;
 	raw_spin_unlock_irq(&wqe->lock);
 
 	if (index == IO_WQ_ACCT_UNBOUND)
@@ -851,7 +883,7 @@ static bool io_wq_can_queue(struct io_wqe *wqe, struct io_wqe_acct *acct,
 	if (free_worker)
 		return true;
 
-	if (atomic_read(&wqe->wq->user->processes) >= acct->max_workers &&
+	if (atomic_read(&wqe->wq->user->processes) >= wqe->wq->nproc_limit &&
 	    !(capable(CAP_SYS_RESOURCE) || capable(CAP_SYS_ADMIN)))
 		return false;
 
@@ -1103,8 +1135,13 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 
 	/* caller must already hold a reference to this */
 	wq->user = data->user;
+	wq->nproc_limit = task_rlimit(current, RLIMIT_NPROC);
+	mutex_init(&wq->aff_lock);
 
 	ret = -ENOMEM;
+	if (!alloc_cpumask_var(&wq->cpu_mask, GFP_KERNEL))
+		goto err;
+	cpumask_copy(wq->cpu_mask, cpu_possible_mask);
 	for_each_node(node) {
 		struct io_wqe *wqe;
 		int alloc_node = node;
@@ -1115,13 +1152,14 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 		if (!wqe)
 			goto err;
 		wq->wqes[node] = wqe;
+		if (!alloc_cpumask_var(&wqe->cpu_mask, GFP_KERNEL))
+			goto err;
 		wqe->node = alloc_node;
+		cpumask_copy(wqe->cpu_mask, io_wqe_node_mask(wqe));
 		wqe->acct[IO_WQ_ACCT_BOUND].max_workers = bounded;
 		atomic_set(&wqe->acct[IO_WQ_ACCT_BOUND].nr_running, 0);
-		if (wq->user) {
-			wqe->acct[IO_WQ_ACCT_UNBOUND].max_workers =
-					task_rlimit(current, RLIMIT_NPROC);
-		}
+		if (wq->user)
+			wqe->acct[IO_WQ_ACCT_UNBOUND].max_workers = wq->nproc_limit;
 		atomic_set(&wqe->acct[IO_WQ_ACCT_UNBOUND].nr_running, 0);
 		wqe->wq = wq;
 		raw_spin_lock_init(&wqe->lock);
@@ -1149,8 +1187,13 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 	complete(&wq->done);
 err:
 	cpuhp_state_remove_instance_nocalls(io_wq_online, &wq->cpuhp_node);
-	for_each_node(node)
+	for_each_node(node) {
+		if (!wq->wqes[node])
+			continue;
+		free_cpumask_var(wq->wqes[node]->cpu_mask);
 		kfree(wq->wqes[node]);
+	}
+	free_cpumask_var(wq->cpu_mask);
 err_wqes:
 	kfree(wq->wqes);
 err_wq:
@@ -1183,8 +1226,11 @@ static void __io_wq_destroy(struct io_wq *wq)
 
 	wait_for_completion(&wq->done);
 
-	for_each_node(node)
+	for_each_node(node) {
+		free_cpumask_var(wq->wqes[node]->cpu_mask);
 		kfree(wq->wqes[node]);
+	}
+	free_cpumask_var(wq->cpu_mask);
 	kfree(wq->wqes);
 	kfree(wq);
 }
@@ -1207,24 +1253,155 @@ static bool io_wq_worker_affinity(struct io_worker *worker, void *data)
 	struct rq *rq;
 
 	rq = task_rq_lock(task, &rf);
-	do_set_cpus_allowed(task, cpumask_of_node(worker->wqe->node));
+	do_set_cpus_allowed(task, worker->wqe->cpu_mask);
 	task->flags |= PF_NO_SETAFFINITY;
 	task_rq_unlock(rq, task, &rf);
 	return false;
 }
 
+/*
+ * Workers of a node run on the node CPUs in wq->cpu_mask, or anywhere in
+ * wq->cpu_mask if the node has none of them.
+ */
+static void io_wq_update_affinity(struct io_wq *wq)
+	__must_hold(&wq->aff_lock)
+{
+	int node;
+
+	for_each_node(node) {
+		struct io_wqe *wqe = wq->wqes[node];
+
+		if (!cpumask_and(wqe->cpu_mask, io_wqe_node_mask(wqe),
+				 wq->cpu_mask))
+			cpumask_copy(wqe->cpu_mask, wq->cpu_mask);
+	}
+
+	rcu_read_lock();
+	for_each_node(node)
+		io_wq_for_each_worker(wq->wqes[node], io_wq_worker_affinity, NULL);
+	rcu_read_unlock();
+}
+
 static int io_wq_cpu_online(unsigned int cpu, struct hlist_node *node)
 {
 	struct io_wq *wq = hlist_entry_safe(node, struct io_wq, cpuhp_node);
+
+	mutex_lock(&wq->aff_lock);
+	io_wq_update_affinity(wq);
+	mutex_unlock(&wq->aff_lock);
+	return 0;
+}
+
+/*
+ * The CPUs that share a cluster with @cpu: same cache domain and, on
+ * asymmetric (big.LITTLE) systems, the same CPU capacity.
+ */
+void io_wq_cluster_mask(struct cpumask *mask, int cpu)
+{
+	unsigned long cap = arch_scale_cpu_capacity(cpu);
 	int i;
 
-	rcu_read_lock();
-	for_each_node(i)
-		io_wq_for_each_worker(wq->wqes[i], io_wq_worker_affinity, NULL);
-	rcu_read_unlock();
+#ifdef CONFIG_SCHED_MC
+	cpumask_copy(mask, cpu_coregroup_mask(cpu));
+#else
+	cpumask_copy(mask, cpu_possible_mask);
+#endif
+	for_each_cpu(i, mask) {
+		if (arch_scale_cpu_capacity(i) != cap)
+			cpumask_clear_cpu(i, mask);
+	}
+}
+
+/*
+ * Restrict the workers to the CPUs in @mask, or let them use all CPUs of
+ * their node again if @mask is NULL.
+ */
+int io_wq_cpu_affinity(struct io_wq *wq, const struct cpumask *mask)
+{
+	if (mask && !cpumask_intersects(mask, cpu_online_mask))
+		return -EINVAL;
+
+	mutex_lock(&wq->aff_lock);
+	cpumask_copy(wq->cpu_mask, mask ? mask : cpu_possible_mask);
+	io_wq_update_affinity(wq);
+	mutex_unlock(&wq->aff_lock);
 	return 0;
 }
 
+void io_wq_get_affinity(struct io_wq *wq, struct cpumask *mask)
+{
+	mutex_lock(&wq->aff_lock);
+	cpumask_copy(mask, wq->cpu_mask);
+	mutex_unlock(&wq->aff_lock);
+}
+
+/*
+ * Set the per-node bounded and unbounded worker limits to @new_count, a
+ * zero entry leaves that limit alone. The previous limits are returned in
+ * @new_count. Workers above a lowered limit go away as they idle out.
+ */
+int io_wq_max_workers(struct io_wq *wq, int *new_count)
+{
+	int prev[2] = { -1, -1 };
+	int i, node;
+
+	for (i = 0; i < 2; i++) {
+		if (new_count[i] < 0)
+			return -EINVAL;
+		if (new_count[i] > wq->nproc_limit)
+			new_count[i] = wq->nproc_limit;
+	}
+
+	for_each_node(node) {
+		struct io_wqe *wqe = wq->wqes[node];
+
+		raw_spin_lock_irq(&wqe->lock);
+		for (i = 0; i < 2; i++) {
+			if (prev[i] < 0)
+				prev[i] = wqe->acct[i].max_workers;
+			if (new_count[i])
+				wqe->acct[i].max_workers = new_count[i];
+		}
+		raw_spin_unlock_irq(&wqe->lock);
+	}
+
+	for (i = 0; i < 2; i++)
+		new_count[i] = prev[i];
+	return 0;
+}
+
+static bool io_wq_worker_stats(struct io_worker *worker, void *data)
+{
+	struct io_wq_stats *stats = data;
+
+	stats->nr_work += READ_ONCE(worker->nr_work);
+	return false;
+}
+
+void io_wq_get_stats(struct io_wq *wq, struct io_wq_stats *stats)
+{
+	int i, node;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_node(node) {
+		struct io_wqe *wqe = wq->wqes[node];
+
+		raw_spin_lock_irq(&wqe->lock);
+		for (i = 0; i < 2; i++) {
+			stats->nr_workers[i] += wqe->acct[i].nr_workers;
+			stats->max_workers[i] = wqe->acct[i].max_workers;
+			stats->nr_created += wqe->acct[i].nr_created;
+		}
+		stats->nr_work += wqe->nr_work_exited;
+		raw_spin_unlock_irq(&wqe->lock);
+		stats->nr_reused += atomic_long_read(&wqe->nr_reused);
+
+		rcu_read_lock();
+		io_wq_for_each_worker(wqe, io_wq_worker_stats, stats);
+		rcu_read_unlock();
+	}
+}
+
 static __init int io_wq_init(void)
 {
 	int ret;
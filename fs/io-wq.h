@@ -138,6 +138,20 @@ enum io_wq_cancel io_wq_cancel_cb(struct io_wq *wq, work_cancel_fn *cancel,
 
 struct task_struct *io_wq_get_task(struct io_wq *wq);
 
+struct io_wq_stats {
+	unsigned nr_workers[2];		/* bounded, unbounded */
+	unsigned max_workers[2];	/* per node */
+	unsigned long nr_created;
+	unsigned long nr_reused;
+	unsigned long nr_work;
+};
+
+void io_wq_cluster_mask(struct cpumask *mask, int cpu);
+int io_wq_cpu_affinity(struct io_wq *wq, const struct cpumask *mask);
+void io_wq_get_affinity(struct io_wq *wq, struct cpumask *mask);
+int io_wq_max_workers(struct io_wq *wq, int *new_count);
+void io_wq_get_stats(struct io_wq *wq, struct io_wq_stats *stats);
+
 #if defined(CONFIG_IO_WQ)
 extern void io_wq_worker_sleeping(struct task_struct *);
 extern void io_wq_worker_running(struct task_struct *);
@@ -61,6 +61,7 @@
 #include <linux/blkdev.h>
 #include <linux/bvec.h>
 #include <linux/net.h>
+#include <linux/in.h>
 #include <net/sock.h>
 #include <net/af_unix.h>
 #include <net/scm.h>
@@ -82,6 +83,7 @@
 #include <linux/io_uring.h>
 #include <linux/blk-cgroup.h>
 #include <linux/audit.h>
+#include <linux/vmalloc.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/io_uring.h>
@@ -226,6 +228,22 @@ struct io_buffer {
 	__u16 bid;
 };
 
+#define IO_BUFFER_RING_MAX_ENTRIES	32768
+
+/*
+ * Provided buffer group backed by a ring shared with user space. Entries
+ * are consumed without ctx->uring_lock by advancing ->head with cmpxchg;
+ * lookups are RCU protected and the ring is only torn down after a grace
+ * period.
+ */
+struct io_buffer_ring {
+	struct io_uring_buf_ring	*ring;
+	struct page			**pages;
+	unsigned int			nr_pages;
+	u32				head;
+	u32				mask;
+};
+
 struct io_restriction {
 	DECLARE_BITMAP(register_op, IORING_REGISTER_LAST);
 	DECLARE_BITMAP(sqe_op, IORING_OP_LAST);
@@ -245,8 +263,24 @@ struct io_sq_data {
 
 	struct task_struct	*thread;
 	struct wait_queue_head	wait;
+
+	/*
+	 * CPU budget, in percent of one CPU per IO_SQ_BUDGET_PERIOD, 0 if
+	 * unlimited. Only the thread itself touches the accounting below.
+	 */
+	unsigned		budget;
+	u64			last_ts;
+	u64			period_start;
+	u64			period_busy;
+
+	/* for fdinfo */
+	u64			busy_ns;
+	u64			idle_ns;
+	u64			throttled_ns;
 };
 
+#define IO_SQ_BUDGET_PERIOD	(100 * NSEC_PER_MSEC)
+
 struct io_ring_ctx {
 	struct {
 		struct percpu_ref	refs;
@@ -293,6 +327,9 @@ struct io_ring_ctx {
 
 	/* IO offload */
 	struct io_wq		*io_wq;
+	/* requests punted to io_wq, and how many of those were reads */
+	atomic_long_t		nr_punted;
+	atomic_long_t		nr_punted_reads;
 
 	/*
 	 * For SQPOLL usage - we hold a reference to the parent task, so we
@@ -312,6 +349,9 @@ struct io_ring_ctx {
 	struct wait_queue_head	sqo_sq_wait;
 	struct wait_queue_entry	sqo_wait_entry;
 	struct list_head	sqd_list;
+	/* SQPOLL submission interarrival tracking, see io_sq_spin_ns() */
+	u64			sq_last_submit;
+	u64			sq_gap_avg;
 
 	/*
 	 * If used, fixed file set. Writers must ensure that ->refs is dead,
@@ -345,6 +385,7 @@ struct io_ring_ctx {
 #endif
 
 	struct idr		io_buffer_idr;
+	struct idr		io_buf_ring_idr;
 
 	struct idr		personality_idr;
 
@@ -354,6 +395,8 @@ struct io_ring_ctx {
 		unsigned		cq_mask;
 		atomic_t		cq_timeouts;
 		unsigned		cq_last_tm_flush;
+		/* CQEs posted by multishot requests, not matched by an SQE */
+		unsigned		cq_extra;
 		unsigned long		cq_check_overflow;
 		struct wait_queue_head	cq_wait;
 		struct fasync_struct	*cq_fasync;
@@ -424,6 +467,7 @@ struct io_accept {
 	struct sockaddr __user		*addr;
 	int __user			*addr_len;
 	int				flags;
+	bool				multishot;
 	unsigned long			nofile;
 };
 
@@ -474,7 +518,13 @@ struct io_sr_msg {
 	int				msg_flags;
 	int				bgid;
 	size_t				len;
-	struct io_buffer		*kbuf;
+	union {
+		struct io_buffer	*kbuf;
+		/* user address of a buffer taken from a buffer ring */
+		u64			ring_addr;
+		/* IORING_OP_SEND_ZC buffer release notification */
+		struct io_kiocb		*notif;
+	};
 };
 
 struct io_open {
@@ -589,6 +639,7 @@ enum {
 	REQ_F_NO_FILE_TABLE_BIT,
 	REQ_F_WORK_INITIALIZED_BIT,
 	REQ_F_LTIMEOUT_ACTIVE_BIT,
+	REQ_F_BUFFER_RING_BIT,
 
 	/* not a real bit, just to check we're not overflowing the space */
 	__REQ_F_LAST_BIT,
@@ -634,6 +685,8 @@ enum {
 	REQ_F_WORK_INITIALIZED	= BIT(REQ_F_WORK_INITIALIZED_BIT),
 	/* linked timeout is active, i.e. prepared by link's head */
 	REQ_F_LTIMEOUT_ACTIVE	= BIT(REQ_F_LTIMEOUT_ACTIVE_BIT),
+	/* selected buffer came from a buffer ring, bid in ->buf_index */
+	REQ_F_BUFFER_RING	= BIT(REQ_F_BUFFER_RING_BIT),
 };
 
 struct async_poll {
@@ -935,6 +988,12 @@ static const struct io_op_def io_op_defs[] = {
 		.hash_reg_file		= 1,
 		.unbound_nonreg_file	= 1,
 	},
+	[IORING_OP_SEND_ZC] = {
+		.needs_file		= 1,
+		.unbound_nonreg_file	= 1,
+		.pollout		= 1,
+		.work_flags		= IO_WQ_WORK_BLKCG,
+	},
 };
 
 enum io_mem_account {
@@ -1212,6 +1271,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	init_completion(&ctx->ref_comp);
 	init_completion(&ctx->sq_thread_comp);
 	idr_init(&ctx->io_buffer_idr);
+	idr_init(&ctx->io_buf_ring_idr);
 	idr_init(&ctx->personality_idr);
 	mutex_init(&ctx->uring_lock);
 	init_waitqueue_head(&ctx->wait);
@@ -1237,7 +1297,7 @@ static bool req_need_defer(struct io_kiocb *req, u32 seq)
 	if (unlikely(req->flags & REQ_F_IO_DRAIN)) {
 		struct io_ring_ctx *ctx = req->ctx;
 
-		return seq != ctx->cached_cq_tail
+		return seq + READ_ONCE(ctx->cq_extra) != ctx->cached_cq_tail
 				+ READ_ONCE(ctx->cached_cq_overflow);
 	}
 
@@ -1473,6 +1533,10 @@ static struct io_kiocb *__io_queue_async_work(struct io_kiocb *req)
 
 	trace_io_uring_queue_async_work(ctx, io_wq_is_hashed(&req->work), req,
 					&req->work, req->flags);
+	atomic_long_inc(&ctx->nr_punted);
+	if (req->opcode == IORING_OP_READ || req->opcode == IORING_OP_READV ||
+	    req->opcode == IORING_OP_READ_FIXED)
+		atomic_long_inc(&ctx->nr_punted_reads);
 	io_wq_enqueue(ctx->io_wq, &req->work);
 	return link;
 }
@@ -1757,6 +1821,51 @@ static void io_cqring_fill_event(struct io_kiocb *req, long res)
 	__io_cqring_fill_event(req, res, 0);
 }
 
+/*
+ * Post a CQE with IORING_CQE_F_MORE for a multishot request. The request
+ * stays armed afterwards, so unlike a final completion it can't be parked
+ * on the overflow list. Returns false if there is no room in the CQ ring
+ * (or older CQEs are still waiting in the overflow list), in which case
+ * the caller must terminate the request with a normal completion.
+ */
+static bool io_cqring_fill_more(struct io_kiocb *req, long res,
+				unsigned int cflags)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_uring_cqe *cqe;
+
+	if (unlikely(test_bit(0, &ctx->cq_check_overflow)))
+		return false;
+	cqe = io_get_cqring(ctx);
+	if (unlikely(!cqe))
+		return false;
+
+	trace_io_uring_complete(ctx, req->user_data, res);
+	WRITE_ONCE(cqe->user_data, req->user_data);
+	WRITE_ONCE(cqe->res, res);
+	WRITE_ONCE(cqe->flags, cflags | IORING_CQE_F_MORE);
+	ctx->cq_extra++;
+	return true;
+}
+
+static bool io_cqring_add_more(struct io_kiocb *req, long res,
+			       unsigned int cflags)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	unsigned long flags;
+	bool posted;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	posted = io_cqring_fill_more(req, res, cflags);
+	if (posted)
+		io_commit_cqring(ctx);
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	if (posted)
+		io_cqring_ev_posted(ctx);
+	return posted;
+}
+
 static void io_cqring_add_event(struct io_kiocb *req, long res, long cflags)
 {
 	struct io_ring_ctx *ctx = req->ctx;
@@ -2293,6 +2402,13 @@ static unsigned int io_put_kbuf(struct io_kiocb *req, struct io_buffer *kbuf)
 {
 	unsigned int cflags;
 
+	if (req->flags & REQ_F_BUFFER_RING) {
+		cflags = req->buf_index << IORING_CQE_BUFFER_SHIFT;
+		cflags |= IORING_CQE_F_BUFFER;
+		req->flags &= ~(REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING);
+		return cflags;
+	}
+
 	cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
 	cflags |= IORING_CQE_F_BUFFER;
 	req->flags &= ~REQ_F_BUFFER_SELECTED;
@@ -2890,21 +3006,18 @@ static void kiocb_done(struct kiocb *kiocb, ssize_t ret,
 		io_rw_done(kiocb, ret);
 }
 
-static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
-			       struct iov_iter *iter)
+static ssize_t __io_import_fixed(struct io_ring_ctx *ctx, int rw,
+				 struct iov_iter *iter, u16 buf_index,
+				 u64 buf_addr, size_t len)
 {
-	struct io_ring_ctx *ctx = req->ctx;
-	size_t len = req->rw.len;
 	struct io_mapped_ubuf *imu;
-	u16 index, buf_index = req->buf_index;
 	size_t offset;
-	u64 buf_addr;
+	u16 index;
 
 	if (unlikely(buf_index >= ctx->nr_user_bufs))
 		return -EFAULT;
 	index = array_index_nospec(buf_index, ctx->nr_user_bufs);
 	imu = &ctx->user_bufs[index];
-	buf_addr = req->rw.addr;
 
 	/* overflow */
 	if (buf_addr + len < buf_addr)
@@ -2958,6 +3071,13 @@ static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
 	return len;
 }
 
+static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
+			       struct iov_iter *iter)
+{
+	return __io_import_fixed(req->ctx, rw, iter, req->buf_index,
+				 req->rw.addr, req->rw.len);
+}
+
 static void io_ring_submit_unlock(struct io_ring_ctx *ctx, bool needs_lock)
 {
 	if (needs_lock)
@@ -2976,6 +3096,51 @@ static void io_ring_submit_lock(struct io_ring_ctx *ctx, bool needs_lock)
 		mutex_lock(&ctx->uring_lock);
 }
 
+/*
+ * Take the next buffer from the ring of group @bgid. No lock is needed:
+ * user space only rewrites an entry after it has seen the CQE for it, and
+ * concurrent consumers serialize on the cmpxchg of ->head. Returns -ENOENT
+ * if @bgid isn't a buffer ring, so the caller can fall back to the classic
+ * provided buffer lists.
+ */
+static int io_ring_buffer_select(struct io_kiocb *req, size_t *len, int bgid,
+				 u64 *addr)
+{
+	struct io_buffer_ring *br;
+	struct io_uring_buf *buf;
+	u32 head, blen;
+	u16 tail, bid;
+
+	rcu_read_lock();
+	br = idr_find(&req->ctx->io_buf_ring_idr, bgid);
+	if (!br) {
+		rcu_read_unlock();
+		return -ENOENT;
+	}
+
+	do {
+		head = READ_ONCE(br->head);
+		/* pairs with the release store of the tail in user space */
+		tail = smp_load_acquire(&br->ring->tail);
+		if ((u16)head == tail) {
+			rcu_read_unlock();
+			return -ENOBUFS;
+		}
+		buf = &br->ring->bufs[head & br->mask];
+		*addr = READ_ONCE(buf->addr);
+		blen = READ_ONCE(buf->len);
+		bid = READ_ONCE(buf->bid);
+	} while (cmpxchg(&br->head, head, head + 1) != head);
+	rcu_read_unlock();
+
+	blen = min_t(u32, blen, MAX_RW_COUNT);
+	if (*len > blen)
+		*len = blen;
+	req->buf_index = bid;
+	req->flags |= REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING;
+	return 0;
+}
+
 static struct io_buffer *io_buffer_select(struct io_kiocb *req, size_t *len,
 					  int bgid, struct io_buffer *kbuf,
 					  bool needs_lock)
@@ -3015,9 +3180,26 @@ static void __user *io_rw_buffer_select(struct io_kiocb *req, size_t *len,
 {
 	struct io_buffer *kbuf;
 	u16 bgid;
+	int ret;
+
+	if (req->flags & REQ_F_BUFFER_RING)
+		return u64_to_user_ptr(req->rw.addr);
 
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
 	bgid = req->buf_index;
+	if (!(req->flags & REQ_F_BUFFER_SELECTED)) {
+		u64 addr;
+
+		ret = io_ring_buffer_select(req, len, bgid, &addr);
+		if (!ret) {
+			req->rw.addr = addr;
+			req->rw.len = *len;
+			return u64_to_user_ptr(addr);
+		}
+		if (ret != -ENOENT)
+			return ERR_PTR(ret);
+	}
+
+	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
 	kbuf = io_buffer_select(req, len, bgid, kbuf, needs_lock);
 	if (IS_ERR(kbuf))
 		return kbuf;
@@ -3077,6 +3259,11 @@ static ssize_t __io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 static ssize_t io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 				    bool needs_lock)
 {
+	if (req->flags & REQ_F_BUFFER_RING) {
+		iov[0].iov_base = u64_to_user_ptr(req->rw.addr);
+		iov[0].iov_len = req->rw.len;
+		return 0;
+	}
 	if (req->flags & REQ_F_BUFFER_SELECTED) {
 		struct io_buffer *kbuf;
 
@@ -3376,10 +3563,11 @@ static bool io_rw_should_retry(struct io_kiocb *req)
 		return false;
 
 	/*
-	 * just use poll if we can, and don't attempt if the fs doesn't
-	 * support callback based unlocks
+	 * don't attempt if the fs doesn't support callback based unlocks. Files
+	 * that do are read through the page cache even if they can be polled,
+	 * like FUSE passthrough, the others just use poll if they can.
 	 */
-	if (file_can_poll(req->file) || !(req->file->f_mode & FMODE_BUF_RASYNC))
+	if (!(req->file->f_mode & FMODE_BUF_RASYNC))
 		return false;
 
 	wait->wait.func = io_async_buf_func;
@@ -4068,6 +4256,12 @@ static int io_provide_buffers(struct io_kiocb *req, bool force_nonblock,
 
 	lockdep_assert_held(&ctx->uring_lock);
 
+	/* ring mapped groups are refilled through the ring only */
+	if (idr_find(&ctx->io_buf_ring_idr, p->bgid)) {
+		ret = -EEXIST;
+		goto out;
+	}
+
 	list = head = idr_find(&ctx->io_buffer_idr, p->bgid);
 
 	ret = io_add_buffers(p, &head);
@@ -4348,6 +4542,91 @@ static int io_sync_file_range(struct io_kiocb *req, bool force_nonblock)
 	return 0;
 }
 
+static void io_notif_task_func(struct callback_head *cb)
+{
+	struct io_kiocb *notif = container_of(cb, struct io_kiocb, task_work);
+	struct io_ring_ctx *ctx = notif->ctx;
+
+	spin_lock_irq(&ctx->completion_lock);
+	__io_cqring_fill_event(notif, 0, IORING_CQE_F_NOTIF);
+	/* not backed by an SQE of its own */
+	ctx->cq_extra++;
+	io_commit_cqring(ctx);
+	spin_unlock_irq(&ctx->completion_lock);
+
+	io_cqring_ev_posted(ctx);
+	io_put_req(notif);
+}
+
+/*
+ * Called by the network stack for every skb that referenced the
+ * notification once it is done with the pages, and once by io_uring itself
+ * when the send completes. The last reference posts the notification CQE
+ * from task context, this may run from softirq.
+ */
+static void io_uring_tx_zerocopy_callback(struct ubuf_info *uarg,
+					  bool zerocopy_success)
+{
+	struct io_kiocb *notif = uarg->ctx;
+	int ret;
+
+	if (!refcount_dec_and_test(&uarg->refcnt))
+		return;
+
+	init_task_work(&notif->task_work, io_notif_task_func);
+	ret = io_req_task_work_add(notif, true);
+	if (unlikely(ret)) {
+		struct task_struct *tsk;
+
+		tsk = io_wq_get_task(notif->ctx->io_wq);
+		task_work_add(tsk, &notif->task_work, TWA_NONE);
+		wake_up_process(tsk);
+	}
+}
+
+/*
+ * Allocate the request that carries the IORING_CQE_F_NOTIF completion of a
+ * zero-copy send. It's never submitted, but is accounted and released like
+ * any other request, and its ubuf_info lives in ->async_data.
+ */
+static struct io_kiocb *io_alloc_notif(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_kiocb *notif;
+	struct ubuf_info *uarg;
+
+	notif = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (unlikely(!notif))
+		return NULL;
+	uarg = kzalloc(sizeof(*uarg), GFP_KERNEL);
+	if (unlikely(!uarg)) {
+		kmem_cache_free(req_cachep, notif);
+		return NULL;
+	}
+
+	uarg->callback = io_uring_tx_zerocopy_callback;
+	uarg->ctx = notif;
+	/* the skbs hold page references, fixed buffers need no copy */
+	uarg->flags = UBUF_F_DONT_ORPHAN;
+	refcount_set(&uarg->refcnt, 1);
+
+	notif->opcode = IORING_OP_NOP;
+	notif->user_data = req->user_data;
+	notif->async_data = uarg;
+	notif->file = NULL;
+	notif->ctx = ctx;
+	notif->flags = 0;
+	refcount_set(&notif->refs, 1);
+	notif->task = req->task;
+	notif->result = 0;
+
+	/* dropped again by __io_free_req() */
+	get_task_struct(notif->task);
+	percpu_counter_inc(&notif->task->io_uring->inflight);
+	percpu_ref_get(&ctx->refs);
+	return notif;
+}
+
 #if defined(CONFIG_NET)
 static int io_setup_async_msg(struct io_kiocb *req,
 			      struct io_async_msghdr *kmsg)
@@ -4476,6 +4755,7 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
 	msg.msg_namelen = 0;
+	msg.msg_ubuf = NULL;
 
 	flags = req->sr_msg.msg_flags | MSG_NOSIGNAL;
 	if (flags & MSG_DONTWAIT)
@@ -4499,6 +4779,93 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	return 0;
 }
 
+static int io_sendzc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_sr_msg *sr = &req->sr_msg;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->off)
+		return -EINVAL;
+
+	sr->buf = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	sr->len = READ_ONCE(sqe->len);
+	/* the completion is ours, not the socket error queue's */
+	sr->msg_flags = READ_ONCE(sqe->msg_flags) & ~MSG_ZEROCOPY;
+	req->buf_index = READ_ONCE(sqe->buf_index);
+	sr->notif = NULL;
+	return 0;
+}
+
+/*
+ * Send from a registered buffer without copying it. The pages are attached
+ * to the skbs as frags, and the application must not reuse the buffer until
+ * it sees the IORING_CQE_F_NOTIF completion, which follows the regular one
+ * (flagged IORING_CQE_F_MORE) once the stack has dropped all references.
+ * Only TCP does zero-copy for now, other sockets copy and notify at once.
+ */
+static int io_sendzc(struct io_kiocb *req, bool force_nonblock,
+		     struct io_comp_state *cs)
+{
+	struct io_sr_msg *sr = &req->sr_msg;
+	struct msghdr msg;
+	struct socket *sock;
+	unsigned flags;
+	int min_ret = 0;
+	int ret;
+
+	sock = sock_from_file(req->file, &ret);
+	if (unlikely(!sock))
+		return ret;
+
+	ret = __io_import_fixed(req->ctx, WRITE, &msg.msg_iter, req->buf_index,
+				(u64)(unsigned long)sr->buf, sr->len);
+	if (unlikely(ret < 0))
+		return ret;
+
+	/* kept across -EAGAIN retries, nothing was queued on it then */
+	if (!sr->notif) {
+		sr->notif = io_alloc_notif(req);
+		if (unlikely(!sr->notif))
+			return -ENOMEM;
+		req->flags |= REQ_F_NEED_CLEANUP;
+	}
+
+	msg.msg_name = NULL;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_namelen = 0;
+	msg.msg_ubuf = sr->notif->async_data;
+
+	flags = sr->msg_flags | MSG_NOSIGNAL;
+	if (sock->sk->sk_protocol == IPPROTO_TCP)
+		flags |= MSG_ZEROCOPY | MSG_UBUF;
+	if (flags & MSG_DONTWAIT)
+		req->flags |= REQ_F_NOWAIT;
+	else if (force_nonblock)
+		flags |= MSG_DONTWAIT;
+
+	if (flags & MSG_WAITALL)
+		min_ret = iov_iter_count(&msg.msg_iter);
+
+	msg.msg_flags = flags;
+	ret = sock_sendmsg(sock, &msg);
+	if (force_nonblock && ret == -EAGAIN)
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	/* drop our reference, the notification fires once the skbs are gone */
+	io_uring_tx_zerocopy_callback(sr->notif->async_data, true);
+	sr->notif = NULL;
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+
+	if (ret < min_ret)
+		req_set_fail_links(req);
+	__io_req_complete(req, ret, IORING_CQE_F_MORE, cs);
+	return 0;
+}
+
 static int __io_recvmsg_copy_hdr(struct io_kiocb *req,
 				 struct io_async_msghdr *iomsg)
 {
@@ -4590,19 +4957,35 @@ static int io_recvmsg_copy_hdr(struct io_kiocb *req,
 	return __io_recvmsg_copy_hdr(req, iomsg);
 }
 
-static struct io_buffer *io_recv_buffer_select(struct io_kiocb *req,
-					       bool needs_lock)
+static void __user *io_recv_buffer_select(struct io_kiocb *req,
+					  bool needs_lock)
 {
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct io_buffer *kbuf;
+	int ret;
+
+	if (req->flags & REQ_F_BUFFER_RING)
+		return u64_to_user_ptr(sr->ring_addr);
+
+	if (!(req->flags & REQ_F_BUFFER_SELECTED)) {
+		u64 addr;
+
+		ret = io_ring_buffer_select(req, &sr->len, sr->bgid, &addr);
+		if (!ret) {
+			sr->ring_addr = addr;
+			return u64_to_user_ptr(addr);
+		}
+		if (ret != -ENOENT)
+			return ERR_PTR(ret);
+	}
 
 	kbuf = io_buffer_select(req, &sr->len, sr->bgid, sr->kbuf, needs_lock);
 	if (IS_ERR(kbuf))
-		return kbuf;
+		return ERR_CAST(kbuf);
 
 	sr->kbuf = kbuf;
 	req->flags |= REQ_F_BUFFER_SELECTED;
-	return kbuf;
+	return u64_to_user_ptr(kbuf->addr);
 }
 
 static inline unsigned int io_put_recv_kbuf(struct io_kiocb *req)
@@ -4643,7 +5026,7 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 {
 	struct io_async_msghdr iomsg, *kmsg;
 	struct socket *sock;
-	struct io_buffer *kbuf;
+	void __user *buf;
 	unsigned flags;
 	int min_ret = 0;
 	int ret, cflags = 0;
@@ -4667,10 +5050,10 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 	}
 
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		kmsg->fast_iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
+		kmsg->fast_iov[0].iov_base = buf;
 		iov_iter_init(&kmsg->msg.msg_iter, READ, kmsg->iov,
 				1, req->sr_msg.len);
 	}
@@ -4705,7 +5088,6 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 static int io_recv(struct io_kiocb *req, bool force_nonblock,
 		   struct io_comp_state *cs)
 {
-	struct io_buffer *kbuf;
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct msghdr msg;
 	void __user *buf = sr->buf;
@@ -4720,10 +5102,9 @@ static int io_recv(struct io_kiocb *req, bool force_nonblock,
 		return ret;
 
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		buf = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
 	}
 
 	ret = import_single_range(READ, buf, sr->len, &iov, &msg.msg_iter);
@@ -4735,6 +5116,7 @@ static int io_recv(struct io_kiocb *req, bool force_nonblock,
 	msg.msg_controllen = 0;
 	msg.msg_namelen = 0;
 	msg.msg_iocb = NULL;
+	msg.msg_ubuf = NULL;
 	msg.msg_flags = 0;
 
 	flags = req->sr_msg.msg_flags | MSG_NOSIGNAL;
@@ -4764,14 +5146,21 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_accept *accept = &req->accept;
 
+	unsigned int flags;
+
 	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL|IORING_SETUP_SQPOLL)))
 		return -EINVAL;
-	if (sqe->ioprio || sqe->len || sqe->buf_index)
+	if (sqe->len || sqe->buf_index)
+		return -EINVAL;
+
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_ACCEPT_MULTISHOT)
 		return -EINVAL;
 
 	accept->addr = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	accept->addr_len = u64_to_user_ptr(READ_ONCE(sqe->addr2));
 	accept->flags = READ_ONCE(sqe->accept_flags);
+	accept->multishot = flags & IORING_ACCEPT_MULTISHOT;
 	accept->nofile = rlimit(RLIMIT_NOFILE);
 	return 0;
 }
@@ -4786,11 +5175,23 @@ static int io_accept(struct io_kiocb *req, bool force_nonblock,
 	if (req->file->f_flags & O_NONBLOCK)
 		req->flags |= REQ_F_NOWAIT;
 
+retry:
 	ret = __sys_accept4_file(req->file, file_flags, accept->addr,
 					accept->addr_len, accept->flags,
 					accept->nofile);
-	if (ret == -EAGAIN && force_nonblock)
+	if (ret == -EAGAIN && force_nonblock) {
+		/*
+		 * A multishot accept goes back to waiting on the listening
+		 * socket once the backlog is drained, so let the poll handler
+		 * be armed again rather than punting to io-wq.
+		 */
+		if (accept->multishot)
+			req->flags &= ~REQ_F_POLLED;
 		return -EAGAIN;
+	}
+	if (ret >= 0 && accept->multishot &&
+	    io_cqring_add_more(req, ret, 0))
+		goto retry;
 	if (ret < 0) {
 		if (ret == -ERESTARTSYS)
 			ret = -EINTR;
@@ -4879,6 +5280,17 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	return -EOPNOTSUPP;
 }
 
+static int io_sendzc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	return -EOPNOTSUPP;
+}
+
+static int io_sendzc(struct io_kiocb *req, bool force_nonblock,
+		     struct io_comp_state *cs)
+{
+	return -EOPNOTSUPP;
+}
+
 static int io_recvmsg_prep(struct io_kiocb *req,
 			   const struct io_uring_sqe *sqe)
 {
@@ -5023,14 +5435,26 @@ static void io_poll_remove_double(struct io_kiocb *req)
 	}
 }
 
-static void io_poll_complete(struct io_kiocb *req, __poll_t mask, int error)
+/*
+ * Returns false if a multishot poll posted its CQE and must be re-armed,
+ * true if the request completed.
+ */
+static bool io_poll_complete(struct io_kiocb *req, __poll_t mask, int error)
 {
 	struct io_ring_ctx *ctx = req->ctx;
 
+	if (!error && !(req->poll.events & EPOLLONESHOT) &&
+	    !READ_ONCE(req->poll.canceled) &&
+	    io_cqring_fill_more(req, mangle_poll(mask), 0)) {
+		io_commit_cqring(ctx);
+		return false;
+	}
+
 	io_poll_remove_double(req);
 	req->poll.done = true;
 	io_cqring_fill_event(req, error ? error : mangle_poll(mask));
 	io_commit_cqring(ctx);
+	return true;
 }
 
 static void io_poll_task_func(struct callback_head *cb)
@@ -5041,9 +5465,14 @@ static void io_poll_task_func(struct callback_head *cb)
 
 	if (io_poll_rewait(req, &req->poll)) {
 		spin_unlock_irq(&ctx->completion_lock);
+	} else if (!io_poll_complete(req, req->result, 0)) {
+		/* multishot, wait for the next event on the same request */
+		req->result = 0;
+		add_wait_queue(req->poll.head, &req->poll.wait);
+		spin_unlock_irq(&ctx->completion_lock);
+		io_cqring_ev_posted(ctx);
 	} else {
 		hash_del(&req->hash_node);
-		io_poll_complete(req, req->result, 0);
 		spin_unlock_irq(&ctx->completion_lock);
 
 		nxt = io_put_req_find_next(req);
@@ -5120,6 +5549,11 @@ static void __io_queue_proc(struct io_poll_iocb *poll, struct io_poll_table *pt,
 		/* double add on the same waitqueue head, ignore */
 		if (poll->head == head)
 			return;
+		/*
+		 * Multishot can't re-arm on two waitqueues at once, turn it
+		 * into a one-shot poll.
+		 */
+		poll_one->events |= EPOLLONESHOT;
 		poll = kmalloc(sizeof(*poll), GFP_ATOMIC);
 		if (!poll) {
 			pt->error = -ENOMEM;
@@ -5448,19 +5882,24 @@ static void io_poll_queue_proc(struct file *file, struct wait_queue_head *head,
 static int io_poll_add_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_poll_iocb *poll = &req->poll;
-	u32 events;
+	u32 events, flags;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
 		return -EINVAL;
-	if (sqe->addr || sqe->ioprio || sqe->off || sqe->len || sqe->buf_index)
+	if (sqe->addr || sqe->ioprio || sqe->off || sqe->buf_index)
+		return -EINVAL;
+	flags = READ_ONCE(sqe->len);
+	if (flags & ~IORING_POLL_ADD_MULTI)
 		return -EINVAL;
 
 	events = READ_ONCE(sqe->poll32_events);
 #ifdef __BIG_ENDIAN
 	events = swahw32(events);
 #endif
+	if (!(flags & IORING_POLL_ADD_MULTI))
+		events |= EPOLLONESHOT;
 	poll->events = demangle_poll(events) | EPOLLERR | EPOLLHUP |
-		       (events & EPOLLEXCLUSIVE);
+		       (events & (EPOLLEXCLUSIVE | EPOLLONESHOT));
 	return 0;
 }
 
@@ -5469,6 +5908,7 @@ static int io_poll_add(struct io_kiocb *req)
 	struct io_poll_iocb *poll = &req->poll;
 	struct io_ring_ctx *ctx = req->ctx;
 	struct io_poll_table ipt;
+	bool done = true;
 	__poll_t mask;
 
 	ipt.pt._qproc = io_poll_queue_proc;
@@ -5478,13 +5918,21 @@ static int io_poll_add(struct io_kiocb *req)
 
 	if (mask) { /* no async, we'd stolen it */
 		ipt.error = 0;
-		io_poll_complete(req, mask, 0);
+		/* nothing to wait on for a multishot re-arm */
+		if (!poll->head)
+			poll->events |= EPOLLONESHOT;
+		done = io_poll_complete(req, mask, 0);
+		if (!done) {
+			add_wait_queue(poll->head, &poll->wait);
+			io_poll_req_insert(req);
+		}
 	}
 	spin_unlock_irq(&ctx->completion_lock);
 
 	if (mask) {
 		io_cqring_ev_posted(ctx);
-		io_put_req(req);
+		if (done)
+			io_put_req(req);
 	}
 	return ipt.error;
 }
@@ -5855,6 +6303,8 @@ static int io_req_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return io_remove_buffers_prep(req, sqe);
 	case IORING_OP_TEE:
 		return io_tee_prep(req, sqe);
+	case IORING_OP_SEND_ZC:
+		return io_sendzc_prep(req, sqe);
 	}
 
 	printk_once(KERN_WARNING "io_uring: unhandled opcode %d\n",
@@ -5950,7 +6400,10 @@ static void io_req_drop_files(struct io_kiocb *req)
 
 static void __io_clean_op(struct io_kiocb *req)
 {
-	if (req->flags & REQ_F_BUFFER_SELECTED) {
+	if (req->flags & REQ_F_BUFFER_RING) {
+		/* nothing to free, the entry was consumed from the ring */
+		req->flags &= ~(REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING);
+	} else if (req->flags & REQ_F_BUFFER_SELECTED) {
 		switch (req->opcode) {
 		case IORING_OP_READV:
 		case IORING_OP_READ_FIXED:
@@ -5995,6 +6448,15 @@ static void __io_clean_op(struct io_kiocb *req)
 			if (req->open.filename)
 				putname(req->open.filename);
 			break;
+		case IORING_OP_SEND_ZC: {
+			struct io_kiocb *notif = req->sr_msg.notif;
+			struct ubuf_info *uarg = notif->async_data;
+
+			/* never completed, so no CQE promised for it */
+			if (refcount_dec_and_test(&uarg->refcnt))
+				io_put_req(notif);
+			break;
+		}
 		}
 		req->flags &= ~REQ_F_NEED_CLEANUP;
 	}
@@ -6098,6 +6560,9 @@ static int io_issue_sqe(struct io_kiocb *req, bool force_nonblock,
 	case IORING_OP_TEE:
 		ret = io_tee(req, force_nonblock);
 		break;
+	case IORING_OP_SEND_ZC:
+		ret = io_sendzc(req, force_nonblock, cs);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -6766,10 +7231,32 @@ enum sq_ret {
 	SQT_DID_WORK	= 4,
 };
 
-static enum sq_ret __io_sq_thread(struct io_ring_ctx *ctx,
-				  unsigned long start_jiffies, bool cap_entries)
+/*
+ * How long to keep polling a ring without work. Twice the average gap
+ * between submissions catches the next one for a steady stream without
+ * burning the whole idle period after it dried up, and there is no point
+ * in spinning at all if submissions are further apart than the idle period.
+ */
+static u64 io_sq_spin_ns(struct io_ring_ctx *ctx)
+{
+	u64 idle = jiffies_to_nsecs(ctx->sq_thread_idle);
+
+	if (ctx->sq_gap_avg > idle)
+		return 0;
+	return min(2 * ctx->sq_gap_avg, idle);
+}
+
+static void io_sq_update_gap(struct io_ring_ctx *ctx, u64 now)
+{
+	s64 diff = (s64)(now - ctx->sq_last_submit) - (s64)ctx->sq_gap_avg;
+
+	/* EWMA with a weight of 1/8 for the new sample */
+	ctx->sq_gap_avg += diff / 8;
+	ctx->sq_last_submit = now;
+}
+
+static enum sq_ret __io_sq_thread(struct io_ring_ctx *ctx, bool cap_entries)
 {
-	unsigned long timeout = start_jiffies + ctx->sq_thread_idle;
 	struct io_sq_data *sqd = ctx->sq_data;
 	unsigned int to_submit;
 	int ret = 0;
@@ -6807,8 +7294,8 @@ again:
 		 * reap events and wake us up.
 		 */
 		if (!list_empty(&ctx->iopoll_list) || need_resched() ||
-		    (!time_after(jiffies, timeout) && ret != -EBUSY &&
-		    !percpu_ref_is_dying(&ctx->refs)))
+		    (local_clock() - ctx->sq_last_submit < io_sq_spin_ns(ctx) &&
+		    ret != -EBUSY && !percpu_ref_is_dying(&ctx->refs)))
 			return SQT_SPIN;
 
 		prepare_to_wait(&sqd->wait, &ctx->sqo_wait_entry,
@@ -6843,6 +7330,7 @@ again:
 	if (likely(!percpu_ref_is_dying(&ctx->refs) && !ctx->sqo_dead))
 		ret = io_submit_sqes(ctx, to_submit);
 	mutex_unlock(&ctx->uring_lock);
+	io_sq_update_gap(ctx, local_clock());
 
 	if (!io_sqring_full(ctx) && wq_has_sleeper(&ctx->sqo_sq_wait))
 		wake_up(&ctx->sqo_sq_wait);
@@ -6858,20 +7346,62 @@ static void io_sqd_init_new(struct io_sq_data *sqd)
 		ctx = list_first_entry(&sqd->ctx_new_list, struct io_ring_ctx, sqd_list);
 		init_wait(&ctx->sqo_wait_entry);
 		ctx->sqo_wait_entry.func = io_sq_wake_function;
+		/* start out spinning for the whole idle period */
+		ctx->sq_last_submit = local_clock();
+		ctx->sq_gap_avg = jiffies_to_nsecs(ctx->sq_thread_idle) / 2;
 		list_move_tail(&ctx->sqd_list, &sqd->ctx_list);
 		complete(&ctx->sq_thread_comp);
 	}
 }
 
+/* charge the time since the last call to the busy time */
+static void io_sqd_account_busy(struct io_sq_data *sqd, u64 now)
+{
+	u64 delta = now - sqd->last_ts;
+
+	sqd->busy_ns += delta;
+	sqd->period_busy += delta;
+	sqd->last_ts = now;
+}
+
+static bool io_sqd_over_budget(struct io_sq_data *sqd, u64 now)
+{
+	if (!sqd->budget)
+		return false;
+	if (now - sqd->period_start >= IO_SQ_BUDGET_PERIOD) {
+		sqd->period_start = now;
+		sqd->period_busy = 0;
+		return false;
+	}
+	return sqd->period_busy >= IO_SQ_BUDGET_PERIOD / 100 * sqd->budget;
+}
+
+/*
+ * Out of budget: sleep until the current period ends. NEED_WAKEUP isn't
+ * set, new SQEs simply wait for the next period instead of waking us up.
+ */
+static void io_sqd_throttle(struct io_sq_data *sqd, u64 now)
+{
+	u64 left = sqd->period_start + IO_SQ_BUDGET_PERIOD - now;
+
+	io_sq_thread_drop_mm();
+	set_current_state(TASK_INTERRUPTIBLE);
+	if (!kthread_should_park() && !kthread_should_stop())
+		schedule_timeout(nsecs_to_jiffies(left) + 1);
+	__set_current_state(TASK_RUNNING);
+
+	sqd->last_ts = local_clock();
+	sqd->throttled_ns += sqd->last_ts - now;
+}
+
 static int io_sq_thread(void *data)
 {
 	struct cgroup_subsys_state *cur_css = NULL;
 	const struct cred *old_cred = NULL;
 	struct io_sq_data *sqd = data;
 	struct io_ring_ctx *ctx;
-	unsigned long start_jiffies;
 
-	start_jiffies = jiffies;
+	sqd->last_ts = sqd->period_start = local_clock();
 	while (!kthread_should_stop()) {
 		enum sq_ret ret = 0;
 		bool cap_entries;
@@ -6896,6 +7426,9 @@ static int io_sq_thread(void *data)
 			io_sqd_init_new(sqd);
 
 		cap_entries = !list_is_singular(&sqd->ctx_list);
+		/* start with a different ring on every pass */
+		if (cap_entries)
+			list_rotate_left(&sqd->ctx_list);
 
 		list_for_each_entry(ctx, &sqd->ctx_list, sqd_list) {
 			if (current->cred != ctx->creds) {
@@ -6909,11 +7442,23 @@ static int io_sq_thread(void *data)
 			current->sessionid = ctx->sessionid;
 #endif
 
-			ret |= __io_sq_thread(ctx, start_jiffies, cap_entries);
+			ret |= __io_sq_thread(ctx, cap_entries);
 
 			io_sq_thread_drop_mm();
 		}
 
+		if (ret != SQT_IDLE) {
+			u64 now = local_clock();
+
+			io_sqd_account_busy(sqd, now);
+			if (io_sqd_over_budget(sqd, now)) {
+				list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
+					finish_wait(&sqd->wait, &ctx->sqo_wait_entry);
+				io_sqd_throttle(sqd, now);
+				continue;
+			}
+		}
+
 		if (ret & SQT_SPIN) {
 			io_run_task_work();
 			io_sq_thread_drop_mm();
@@ -6923,8 +7468,10 @@ static int io_sq_thread(void *data)
 				continue;
 			list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
 				io_ring_set_wakeup_flag(ctx);
+			io_sqd_account_busy(sqd, local_clock());
 			schedule();
-			start_jiffies = jiffies;
+			sqd->idle_ns += local_clock() - sqd->last_ts;
+			sqd->last_ts = local_clock();
 			list_for_each_entry(ctx, &sqd->ctx_list, sqd_list)
 				io_ring_clear_wakeup_flag(ctx);
 		}
@@ -7941,16 +8488,20 @@ static int io_sq_offload_create(struct io_ring_ctx *ctx,
 		}
 
 		ctx->sq_data = sqd;
+		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
+		if (!ctx->sq_thread_idle)
+			ctx->sq_thread_idle = HZ;
+
 		io_sq_thread_park(sqd);
 		mutex_lock(&sqd->ctx_lock);
 		list_add(&ctx->sqd_list, &sqd->ctx_new_list);
 		mutex_unlock(&sqd->ctx_lock);
+		/* a shared thread gets the tightest budget asked for */
+		if (p->sq_thread_budget &&
+		    (!sqd->budget || p->sq_thread_budget < sqd->budget))
+			sqd->budget = p->sq_thread_budget;
 		io_sq_thread_unpark(sqd);
 
-		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
-		if (!ctx->sq_thread_idle)
-			ctx->sq_thread_idle = HZ;
-
 		if (sqd->thread)
 			goto done;
 
@@ -8419,10 +8970,112 @@ static int __io_destroy_buffers(int id, void *p, void *data)
 	return 0;
 }
 
+static void io_free_buffer_ring(struct io_buffer_ring *br)
+{
+	vunmap(br->ring);
+	unpin_user_pages(br->pages, br->nr_pages);
+	kvfree(br->pages);
+	kfree(br);
+}
+
+static int __io_destroy_buffer_ring(int id, void *p, void *data)
+{
+	io_free_buffer_ring(p);
+	return 0;
+}
+
 static void io_destroy_buffers(struct io_ring_ctx *ctx)
 {
 	idr_for_each(&ctx->io_buffer_idr, __io_destroy_buffers, ctx);
 	idr_destroy(&ctx->io_buffer_idr);
+	idr_for_each(&ctx->io_buf_ring_idr, __io_destroy_buffer_ring, NULL);
+	idr_destroy(&ctx->io_buf_ring_idr);
+}
+
+static int io_register_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_ring *br;
+	unsigned long size;
+	long pret;
+	int ret;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+	if (!reg.ring_addr || !PAGE_ALIGNED(reg.ring_addr))
+		return -EINVAL;
+	if (!is_power_of_2(reg.ring_entries) ||
+	    reg.ring_entries > IO_BUFFER_RING_MAX_ENTRIES)
+		return -EINVAL;
+	if (idr_find(&ctx->io_buffer_idr, reg.bgid) ||
+	    idr_find(&ctx->io_buf_ring_idr, reg.bgid))
+		return -EEXIST;
+
+	br = kzalloc(sizeof(*br), GFP_KERNEL);
+	if (!br)
+		return -ENOMEM;
+
+	size = reg.ring_entries * sizeof(struct io_uring_buf);
+	br->nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	br->mask = reg.ring_entries - 1;
+	ret = -ENOMEM;
+	br->pages = kvmalloc_array(br->nr_pages, sizeof(struct page *),
+				   GFP_KERNEL);
+	if (!br->pages)
+		goto err_free;
+
+	mmap_read_lock(current->mm);
+	pret = pin_user_pages(reg.ring_addr, br->nr_pages,
+			      FOLL_WRITE | FOLL_LONGTERM, br->pages, NULL);
+	mmap_read_unlock(current->mm);
+	if (pret != br->nr_pages) {
+		if (pret > 0)
+			unpin_user_pages(br->pages, pret);
+		ret = pret < 0 ? pret : -EFAULT;
+		goto err_free;
+	}
+
+	ret = -ENOMEM;
+	br->ring = vmap(br->pages, br->nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!br->ring)
+		goto err_unpin;
+
+	ret = idr_alloc(&ctx->io_buf_ring_idr, br, reg.bgid, reg.bgid + 1,
+			GFP_KERNEL);
+	if (ret < 0)
+		goto err_unmap;
+	return 0;
+
+err_unmap:
+	vunmap(br->ring);
+err_unpin:
+	unpin_user_pages(br->pages, br->nr_pages);
+err_free:
+	kvfree(br->pages);
+	kfree(br);
+	return ret;
+}
+
+static int io_unregister_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_ring *br;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+
+	br = idr_remove(&ctx->io_buf_ring_idr, reg.bgid);
+	if (!br)
+		return -ENOENT;
+
+	/* wait for lockless io_ring_buffer_select() users of the ring */
+	synchronize_rcu();
+	io_free_buffer_ring(br);
+	return 0;
 }
 
 static void io_ring_ctx_free(struct io_ring_ctx *ctx)
@@ -9181,6 +9834,21 @@ static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 
 	seq_printf(m, "SqThread:\t%d\n", sq ? task_pid_nr(sq->thread) : -1);
 	seq_printf(m, "SqThreadCpu:\t%d\n", sq ? task_cpu(sq->thread) : -1);
+	if (sq) {
+		u64 busy = READ_ONCE(sq->busy_ns), idle = READ_ONCE(sq->idle_ns);
+		u64 throttled = READ_ONCE(sq->throttled_ns);
+		u64 total = busy + idle + throttled;
+
+		seq_printf(m, "SqBudget:\t%u%%\n", sq->budget);
+		seq_printf(m, "SqBusy:\t%llu ms (%llu%%)\n",
+			   div_u64(busy, NSEC_PER_MSEC),
+			   total ? div64_u64(busy * 100, total) : 0);
+		seq_printf(m, "SqIdle:\t%llu ms\n", div_u64(idle, NSEC_PER_MSEC));
+		seq_printf(m, "SqThrottled:\t%llu ms\n",
+			   div_u64(throttled, NSEC_PER_MSEC));
+		seq_printf(m, "SqSpin:\t%llu us\n",
+			   div_u64(io_sq_spin_ns(ctx), NSEC_PER_USEC));
+	}
 	seq_printf(m, "UserFiles:\t%u\n", ctx->nr_user_files);
 	for (i = 0; has_lock && i < ctx->nr_user_files; i++) {
 		struct fixed_file_table *table;
@@ -9204,6 +9872,27 @@ static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 		seq_printf(m, "Personalities:\n");
 		idr_for_each(&ctx->personality_idr, io_uring_show_cred, m);
 	}
+	seq_printf(m, "Punted:\t%lu\n", atomic_long_read(&ctx->nr_punted));
+	seq_printf(m, "PuntedReads:\t%lu\n",
+		   atomic_long_read(&ctx->nr_punted_reads));
+	if (has_lock && ctx->io_wq) {
+		struct io_wq_stats stats;
+		cpumask_var_t mask;
+
+		io_wq_get_stats(ctx->io_wq, &stats);
+		seq_printf(m, "IoWqBound:\t%u/%u\n", stats.nr_workers[0],
+			   stats.max_workers[0]);
+		seq_printf(m, "IoWqUnbound:\t%u/%u\n", stats.nr_workers[1],
+			   stats.max_workers[1]);
+		seq_printf(m, "IoWqCreated:\t%lu\n", stats.nr_created);
+		seq_printf(m, "IoWqReused:\t%lu\n", stats.nr_reused);
+		seq_printf(m, "IoWqWork:\t%lu\n", stats.nr_work);
+		if (alloc_cpumask_var(&mask, GFP_KERNEL)) {
+			io_wq_get_affinity(ctx->io_wq, mask);
+			seq_printf(m, "IoWqCpus:\t%*pbl\n", cpumask_pr_args(mask));
+			free_cpumask_var(mask);
+		}
+	}
 	seq_printf(m, "PollList:\n");
 	spin_lock_irq(&ctx->completion_lock);
 	for (i = 0; i < (1U << ctx->cancel_hash_bits); i++) {
@@ -9531,6 +10220,9 @@ static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
 		if (p.resv[i])
 			return -EINVAL;
 	}
+	if (p.sq_thread_budget > 100 ||
+	    (p.sq_thread_budget && !(p.flags & IORING_SETUP_SQPOLL)))
+		return -EINVAL;
 
 	if (p.flags & ~(IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
 			IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE |
@@ -9703,6 +10395,80 @@ static int io_register_enable_rings(struct io_ring_ctx *ctx)
 	return 0;
 }
 
+/*
+ * Pin the io-wq workers to the CPUs in the user cpumask at @arg, @len bytes
+ * long. A NULL mask picks the CPU cluster the caller is running on, which
+ * keeps offloaded work off the big cores of a big.LITTLE system when the
+ * submitter runs on a little one, and vice versa.
+ */
+static int io_register_iowq_aff(struct io_ring_ctx *ctx, void __user *arg,
+				unsigned len)
+{
+	cpumask_var_t new_mask;
+	int ret;
+
+	if (!ctx->io_wq)
+		return -EINVAL;
+	if (!alloc_cpumask_var(&new_mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	if (!arg) {
+		io_wq_cluster_mask(new_mask, raw_smp_processor_id());
+	} else {
+		cpumask_clear(new_mask);
+		if (len > cpumask_size())
+			len = cpumask_size();
+#ifdef CONFIG_COMPAT
+		if (in_compat_syscall())
+			ret = compat_get_bitmap(cpumask_bits(new_mask),
+						(const compat_ulong_t __user *)arg,
+						len * 8);
+		else
+#endif
+			ret = copy_from_user(new_mask, arg, len) ? -EFAULT : 0;
+		if (ret) {
+			free_cpumask_var(new_mask);
+			return ret;
+		}
+	}
+
+	ret = io_wq_cpu_affinity(ctx->io_wq, new_mask);
+	free_cpumask_var(new_mask);
+	return ret;
+}
+
+static int io_unregister_iowq_aff(struct io_ring_ctx *ctx)
+{
+	if (!ctx->io_wq)
+		return -EINVAL;
+
+	return io_wq_cpu_affinity(ctx->io_wq, NULL);
+}
+
+/*
+ * @arg points to two __u32s, the bounded and unbounded worker limits. Zero
+ * leaves a limit unchanged, the previous limits are copied back.
+ */
+static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
+					void __user *arg)
+{
+	int new_count[2];
+	int ret;
+
+	if (!ctx->io_wq)
+		return -EINVAL;
+	if (copy_from_user(new_count, arg, sizeof(new_count)))
+		return -EFAULT;
+
+	ret = io_wq_max_workers(ctx->io_wq, new_count);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(arg, new_count, sizeof(new_count)))
+		return -EFAULT;
+	return 0;
+}
+
 static bool io_register_op_must_quiesce(int op)
 {
 	switch (op) {
@@ -9711,6 +10477,11 @@ static bool io_register_op_must_quiesce(int op)
 	case IORING_REGISTER_PROBE:
 	case IORING_REGISTER_PERSONALITY:
 	case IORING_UNREGISTER_PERSONALITY:
+	case IORING_REGISTER_PBUF_RING:
+	case IORING_UNREGISTER_PBUF_RING:
+	case IORING_REGISTER_IOWQ_AFF:
+	case IORING_UNREGISTER_IOWQ_AFF:
+	case IORING_REGISTER_IOWQ_MAX_WORKERS:
 		return false;
 	default:
 		return true;
@@ -9841,6 +10612,36 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 	case IORING_REGISTER_RESTRICTIONS:
 		ret = io_register_restrictions(ctx, arg, nr_args);
 		break;
+	case IORING_REGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_register_pbuf_ring(ctx, arg);
+		break;
+	case IORING_UNREGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_unregister_pbuf_ring(ctx, arg);
+		break;
+	case IORING_REGISTER_IOWQ_AFF:
+		ret = -EINVAL;
+		if (!arg != !nr_args)
+			break;
+		ret = io_register_iowq_aff(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_IOWQ_AFF:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = io_unregister_iowq_aff(ctx);
+		break;
+	case IORING_REGISTER_IOWQ_MAX_WORKERS:
+		ret = -EINVAL;
+		if (!arg || nr_args != 2)
+			break;
+		ret = io_register_iowq_max_workers(ctx, arg);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -11,6 +11,7 @@
 #include <linux/syscalls.h>
 #include <linux/export.h>
 #include <linux/capability.h>
+#include <linux/boot_trace.h>
 #include <linux/mnt_namespace.h>
 #include <linux/user_namespace.h>
 #include <linux/namei.h>
@@ -2843,11 +2844,14 @@ static int do_new_mount(struct path *path, const char *fstype, int sb_flags,
 	struct file_system_type *type;
 	struct fs_context *fc;
 	const char *subtype = NULL;
+	u64 start;
 	int err = 0;
 
 	if (!fstype)
 		return -EINVAL;
 
+	start = boot_trace_start();
+
 	type = get_fs_type(fstype);
 	if (!type)
 		return -ENODEV;
@@ -2882,6 +2886,14 @@ static int do_new_mount(struct path *path, const char *fstype, int sb_flags,
 	if (!err)
 		err = do_new_mount_fc(fc, path, mnt_flags);
 
+	if (start) {
+		char bt_name[BOOT_TRACE_NAME_LEN];
+
+		snprintf(bt_name, sizeof(bt_name), "%s %s", fstype,
+			 name ?: "none");
+		boot_trace_end(BOOT_TRACE_MOUNT, start, bt_name);
+	}
+
 	put_fs_context(fc);
 	return err;
 }
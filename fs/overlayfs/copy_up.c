@@ -918,6 +918,8 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			err = ovl_link_up(&ctx);
 		if (!err && ovl_dentry_needs_data_copy_up_locked(dentry, flags))
 			err = ovl_copy_up_meta_inode_data(&ctx);
+		if (parent)
+			ovl_lookup_cache_forget(parent, &ctx.destname);
 		ovl_copy_up_end(dentry);
 	}
 	do_delayed_call(&done);
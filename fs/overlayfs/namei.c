@@ -12,8 +12,36 @@
 #include <linux/ratelimit.h>
 #include <linux/mount.h>
 #include <linux/exportfs.h>
+#include <linux/hash.h>
 #include "overlayfs.h"
 
+/*
+ * Per-directory cache of lower layer lookups.
+ *
+ * Lower layers are read-only, so for a name that is not found in the upper
+ * layer, the index of the first lower layer that has it (or that stops the
+ * lookup with a whiteout) never changes. Remember it, together with whether
+ * that dentry carries any overlay xattrs, so that a repeated lookup skips
+ * the layers above it and the xattr reads on it.
+ */
+#define OVL_LC_SLOTS	32
+
+#define OVL_LC_VALID	0x1
+#define OVL_LC_PLAIN	0x2	/* no metacopy/opaque/redirect xattr */
+#define OVL_LC_DIR	0x4	/* first hit is a directory */
+
+struct ovl_lookup_cache_entry {
+	u64 hash_len;
+	unsigned short layer;	/* numlower if no lower has the name */
+	unsigned short flags;
+	unsigned char name[DNAME_INLINE_LEN];
+};
+
+struct ovl_lookup_cache {
+	spinlock_t lock;
+	struct ovl_lookup_cache_entry ent[OVL_LC_SLOTS];
+};
+
 struct ovl_lookup_data {
 	struct super_block *sb;
 	struct qstr name;
@@ -23,8 +51,95 @@ struct ovl_lookup_data {
 	bool last;
 	char *redirect;
 	bool metacopy;
+	unsigned short lc_flags;
 };
 
+static struct ovl_lookup_cache_entry *
+ovl_lookup_cache_slot(struct ovl_lookup_cache *lc, const struct qstr *name)
+{
+	return &lc->ent[hash_32(name->hash, ilog2(OVL_LC_SLOTS))];
+}
+
+static bool ovl_lookup_cache_match(struct ovl_lookup_cache_entry *e,
+				   const struct qstr *name)
+{
+	return (e->flags & OVL_LC_VALID) && e->hash_len == name->hash_len &&
+	       !memcmp(e->name, name->name, name->len);
+}
+
+static bool ovl_lookup_cache_get(struct ovl_entry *poe,
+				 const struct qstr *name,
+				 unsigned int *layer, unsigned short *flags)
+{
+	struct ovl_lookup_cache *lc = READ_ONCE(poe->lookup_cache);
+	struct ovl_lookup_cache_entry *e;
+	bool found = false;
+
+	if (!lc)
+		return false;
+
+	e = ovl_lookup_cache_slot(lc, name);
+	spin_lock(&lc->lock);
+	if (ovl_lookup_cache_match(e, name)) {
+		*layer = e->layer;
+		*flags = e->flags;
+		found = true;
+	}
+	spin_unlock(&lc->lock);
+
+	return found;
+}
+
+static void ovl_lookup_cache_set(struct ovl_entry *poe,
+				 const struct qstr *name,
+				 unsigned int layer, unsigned short flags)
+{
+	struct ovl_lookup_cache *lc = READ_ONCE(poe->lookup_cache);
+	struct ovl_lookup_cache_entry *e;
+
+	if (name->len >= DNAME_INLINE_LEN)
+		return;
+
+	if (!lc) {
+		struct ovl_lookup_cache *old;
+
+		lc = kzalloc(sizeof(*lc), GFP_KERNEL);
+		if (!lc)
+			return;
+		spin_lock_init(&lc->lock);
+		old = cmpxchg(&poe->lookup_cache, NULL, lc);
+		if (old) {
+			kfree(lc);
+			lc = old;
+		}
+	}
+
+	e = ovl_lookup_cache_slot(lc, name);
+	spin_lock(&lc->lock);
+	e->hash_len = name->hash_len;
+	e->layer = layer;
+	e->flags = flags | OVL_LC_VALID;
+	memcpy(e->name, name->name, name->len);
+	spin_unlock(&lc->lock);
+}
+
+/* Called on copy up, after which the name is found in the upper layer */
+void ovl_lookup_cache_forget(struct dentry *parent, const struct qstr *name)
+{
+	struct ovl_entry *poe = OVL_E(parent);
+	struct ovl_lookup_cache *lc = READ_ONCE(poe->lookup_cache);
+	struct ovl_lookup_cache_entry *e;
+
+	if (!lc)
+		return;
+
+	e = ovl_lookup_cache_slot(lc, name);
+	spin_lock(&lc->lock);
+	if (ovl_lookup_cache_match(e, name))
+		e->flags = 0;
+	spin_unlock(&lc->lock);
+}
+
 static int ovl_check_redirect(struct dentry *dentry, struct ovl_lookup_data *d,
 			      size_t prelen, const char *post)
 {
@@ -222,6 +337,7 @@ static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 	struct dentry *this;
 	int err;
 	bool last_element = !post[0];
+	bool noxattr;
 
 	this = ovl_lookup_positive_unlocked(name, base, namelen, drop_negative);
 	if (IS_ERR(this)) {
@@ -237,6 +353,9 @@ static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 		err = -EREMOTE;
 		goto out_err;
 	}
+	/* The lookup cache knows this lower dentry has no overlay xattrs */
+	noxattr = (d->lc_flags & OVL_LC_PLAIN) &&
+		  !(d->lc_flags & OVL_LC_DIR) == !d_can_lookup(this);
 	if (ovl_is_whiteout(this)) {
 		d->stop = d->opaque = true;
 		goto put_and_out;
@@ -254,7 +373,7 @@ static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 			d->stop = true;
 			goto put_and_out;
 		}
-		err = ovl_check_metacopy_xattr(OVL_FS(d->sb), this);
+		err = noxattr ? 0 : ovl_check_metacopy_xattr(OVL_FS(d->sb), this);
 		if (err < 0)
 			goto out_err;
 
@@ -271,7 +390,7 @@ static int ovl_lookup_single(struct dentry *base, struct ovl_lookup_data *d,
 
 		if (last_element)
 			d->is_dir = true;
-		if (d->last)
+		if (d->last || noxattr)
 			goto out;
 
 		if (ovl_is_opaquedir(d->sb, this)) {
@@ -831,7 +950,10 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 	bool upperopaque = false;
 	char *upperredirect = NULL;
 	struct dentry *this;
-	unsigned int i;
+	unsigned int i, lc_layer = 0;
+	unsigned short lc_flags = 0;
+	bool lc_use, lc_hit = false;
+	int lc_first = -1;
 	int err;
 	bool uppermetacopy = false;
 	struct ovl_lookup_data d = {
@@ -890,6 +1012,18 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		upperopaque = d.opaque;
 	}
 
+	/*
+	 * Only a plain name lookup in the lower layers of the parent is a
+	 * function of the (read-only) lowers alone, and can be cached.
+	 */
+	lc_use = !upperdentry && !d.stop && !d.redirect && poe->numlower;
+	if (lc_use)
+		lc_hit = ovl_lookup_cache_get(poe, &dentry->d_name, &lc_layer,
+					      &lc_flags);
+	/* No lower layer has the name: nothing to look up */
+	if (lc_hit && lc_layer >= poe->numlower)
+		d.stop = true;
+
 	if (!d.stop && poe->numlower) {
 		err = -ENOMEM;
 		stack = kcalloc(ofs->numlayer - 1, sizeof(struct ovl_path),
@@ -898,7 +1032,7 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 			goto out_put_upper;
 	}
 
-	for (i = 0; !d.stop && i < poe->numlower; i++) {
+	for (i = lc_hit ? lc_layer : 0; !d.stop && i < poe->numlower; i++) {
 		struct ovl_path lower = poe->lowerstack[i];
 
 		if (!ofs->config.redirect_follow)
@@ -906,10 +1040,21 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		else
 			d.last = lower.layer->idx == roe->numlower;
 
+		d.lc_flags = lc_hit && i == lc_layer ? lc_flags : 0;
 		err = ovl_lookup_layer(lower.dentry, &d, &this, false);
+		d.lc_flags = 0;
 		if (err)
 			goto out_put;
 
+		if (lc_use && !lc_hit && lc_first < 0 && (this || d.stop)) {
+			lc_first = i;
+			if (this && (d.is_dir ? !d.stop && !d.redirect
+					      : !d.metacopy))
+				lc_flags = OVL_LC_PLAIN;
+			if (d.is_dir)
+				lc_flags |= OVL_LC_DIR;
+		}
+
 		if (!this)
 			continue;
 
@@ -996,6 +1141,14 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		}
 	}
 
+	/* poe may have been reset to roe by an absolute redirect */
+	if (lc_use && !lc_hit) {
+		poe = OVL_E(dentry->d_parent);
+		ovl_lookup_cache_set(poe, &dentry->d_name,
+				     lc_first < 0 ? poe->numlower : lc_first,
+				     lc_flags);
+	}
+
 	/*
 	 * For regular non-metacopy upper dentries, there is no lower
 	 * path based lookup, hence ctr will be zero. If a dentry is found
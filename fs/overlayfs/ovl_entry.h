@@ -108,6 +108,7 @@ struct ovl_entry {
 		struct rcu_head rcu;
 	};
 	unsigned numlower;
+	struct ovl_lookup_cache *lookup_cache;	/* directory */
 	struct ovl_path lowerstack[];
 };
 
@@ -77,6 +77,7 @@ static void ovl_dentry_release(struct dentry *dentry)
 
 	if (oe) {
 		ovl_entry_stack_free(oe);
+		kfree(oe->lookup_cache);
 		kfree_rcu(oe, rcu);
 	}
 }
@@ -127,7 +127,8 @@ static bool anon_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) != 1)
+	/* the page cache cannot take high-order buffers */
+	if (page_count(page) != 1 || PageCompound(page))
 		return false;
 	memcg_kmem_uncharge_page(page, 0);
 	__SetPageLocked(page);
@@ -397,6 +398,41 @@ static inline bool pipe_writable(const struct pipe_inode_info *pipe)
 		!READ_ONCE(pipe->readers);
 }
 
+/*
+ * Get a page for a new write() buffer: the cached one if it has the order
+ * the pipe currently uses, else a fresh one. High-order allocations are
+ * opportunistic and fall back to any page at hand, so callers must size
+ * the buffer with page_size(). They stay in lowmem, which lets the copy
+ * helpers address the whole compound page through one mapping.
+ */
+static struct page *pipe_alloc_buf_page(struct pipe_inode_info *pipe)
+{
+	struct page *page = pipe->tmp_page;
+	unsigned int order = pipe->buf_order;
+
+	if (page && compound_order(page) == order)
+		return page;
+
+	if (order) {
+		struct page *hpage;
+
+		hpage = alloc_pages(GFP_USER | __GFP_ACCOUNT | __GFP_COMP |
+				    __GFP_NOWARN | __GFP_NORETRY, order);
+		if (hpage) {
+			if (page)
+				put_page(page);
+			pipe->tmp_page = NULL;
+			return hpage;
+		}
+	}
+
+	/* any cached page will do, its buffer is just sized differently */
+	if (page)
+		return page;
+
+	return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+}
+
 static ssize_t
 pipe_write(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -441,14 +477,14 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	 */
 	head = pipe->head;
 	was_empty = true;
-	chars = total_len & (PAGE_SIZE-1);
+	chars = total_len & (pipe_buf_size(pipe) - 1);
 	if (chars && !pipe_empty(head, pipe->tail)) {
 		unsigned int mask = pipe->ring_size - 1;
 		struct pipe_buffer *buf = &pipe->bufs[(head - 1) & mask];
 		int offset = buf->offset + buf->len;
 
 		if ((buf->flags & PIPE_BUF_FLAG_CAN_MERGE) &&
-		    offset + chars <= PAGE_SIZE) {
+		    offset + chars <= page_size(buf->page)) {
 			ret = pipe_buf_confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -477,17 +513,17 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		if (!pipe_full(head, pipe->tail, pipe->max_usage)) {
 			unsigned int mask = pipe->ring_size - 1;
 			struct pipe_buffer *buf = &pipe->bufs[head & mask];
-			struct page *page = pipe->tmp_page;
+			struct page *page;
+			size_t size;
 			int copied;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			page = pipe_alloc_buf_page(pipe);
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
+			pipe->tmp_page = page;
+			size = page_size(page);
 
 			/* Allocate a slot in the ring in advance and attach an
 			 * empty buffer.  If we fault or otherwise fail to use
@@ -517,8 +553,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
 			pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -830,7 +866,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 			pipe_buf_release(pipe, buf);
 	}
 	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+		put_page(pipe->tmp_page);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1288,26 +1324,19 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 }
 
 /*
- * Allocate a new array of pipe buffers and copy the info over. Returns the
- * pipe size if successful, or return -ERROR on error.
+ * Allocate a new array of @nr_slots pipe buffers of @order and copy the
+ * info over. The pipe accounts for the pages its buffers may hold, so
+ * user->pipe_bufs keeps counting pages whatever the buffer order is.
+ * Returns the pipe size if successful, or return -ERROR on error.
  */
-static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
+static long pipe_set_geometry(struct pipe_inode_info *pipe,
+			      unsigned int nr_slots, unsigned int order)
 {
 	unsigned long user_bufs;
-	unsigned int nr_slots, size;
+	unsigned int nr_pages = nr_slots << order;
+	unsigned long size = (unsigned long)nr_pages << PAGE_SHIFT;
 	long ret = 0;
 
-#ifdef CONFIG_WATCH_QUEUE
-	if (pipe->watch_queue)
-		return -EBUSY;
-#endif
-
-	size = round_pipe_size(arg);
-	nr_slots = size >> PAGE_SHIFT;
-
-	if (!nr_slots)
-		return -EINVAL;
-
 	/*
 	 * If trying to increase the pipe capacity, check that an
 	 * unprivileged user is not trying to exceed various limits
@@ -1315,13 +1344,13 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 	 * Decreasing the pipe capacity is always permitted, even
 	 * if the user is currently over a limit.
 	 */
-	if (nr_slots > pipe->max_usage &&
+	if (nr_pages > pipe->nr_accounted &&
 			size > pipe_max_size && !capable(CAP_SYS_RESOURCE))
 		return -EPERM;
 
-	user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted, nr_slots);
+	user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted, nr_pages);
 
-	if (nr_slots > pipe->max_usage &&
+	if (nr_pages > pipe->nr_accounted &&
 			(too_many_pipe_buffers_hard(user_bufs) ||
 			 too_many_pipe_buffers_soft(user_bufs)) &&
 			pipe_is_unprivileged_user()) {
@@ -1334,14 +1363,59 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
 		goto out_revert_acct;
 
 	pipe->max_usage = nr_slots;
-	pipe->nr_accounted = nr_slots;
-	return pipe->max_usage * PAGE_SIZE;
+	pipe->nr_accounted = nr_pages;
+	pipe->buf_order = order;
+	return size;
 
 out_revert_acct:
-	(void) account_pipe_buffers(pipe->user, nr_slots, pipe->nr_accounted);
+	(void) account_pipe_buffers(pipe->user, nr_pages, pipe->nr_accounted);
 	return ret;
 }
 
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long arg)
+{
+	unsigned int nr_slots, size;
+
+#ifdef CONFIG_WATCH_QUEUE
+	if (pipe->watch_queue)
+		return -EBUSY;
+#endif
+
+	size = round_pipe_size(arg);
+	if (!size)
+		return -EINVAL;
+
+	/* A pipe holds at least one buffer, however large it is */
+	nr_slots = max(size >> (PAGE_SHIFT + pipe->buf_order), 1U);
+
+	return pipe_set_geometry(pipe, nr_slots, pipe->buf_order);
+}
+
+/*
+ * Switch write() to buffers of 2^@order pages, keeping the pipe size: a
+ * 64K pipe becomes four 16K buffers at order 2. Large buffers cut the
+ * per-page overhead of bulk writes and let splice hand whole high-order
+ * pages to the consumer, e.g. a socket.
+ */
+static long pipe_set_buf_order(struct pipe_inode_info *pipe, unsigned long arg)
+{
+	unsigned long size;
+	unsigned int nr_slots;
+
+#ifdef CONFIG_WATCH_QUEUE
+	if (pipe->watch_queue)
+		return -EBUSY;
+#endif
+
+	if (arg > PIPE_MAX_BUF_ORDER)
+		return -EINVAL;
+
+	size = (unsigned long)pipe->max_usage * pipe_buf_size(pipe);
+	nr_slots = max_t(unsigned long, size >> (PAGE_SHIFT + arg), 1);
+
+	return pipe_set_geometry(pipe, nr_slots, arg);
+}
+
 /*
  * After the inode slimming patch, i_pipe/i_bdev/i_cdev share the same
  * location, so checking ->i_pipe is not enough to verify that this is a
@@ -1376,7 +1450,15 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 		ret = pipe_set_size(pipe, arg);
 		break;
 	case F_GETPIPE_SZ:
-		ret = pipe->max_usage * PAGE_SIZE;
+		ret = pipe->max_usage * pipe_buf_size(pipe);
+		break;
+	case F_SETPIPE_ORDER:
+		ret = pipe_set_buf_order(pipe, arg);
+		if (ret > 0)
+			ret = pipe->buf_order;
+		break;
+	case F_GETPIPE_ORDER:
+		ret = pipe->buf_order;
 		break;
 	default:
 		ret = -EINVAL;
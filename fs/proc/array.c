@@ -81,6 +81,7 @@
 #include <linux/fdtable.h>
 #include <linux/times.h>
 #include <linux/cpuset.h>
+#include <linux/dma-buf.h>
 #include <linux/rcupdate.h>
 #include <linux/delayacct.h>
 #include <linux/seq_file.h>
@@ -404,6 +405,24 @@ static inline void task_thp_status(struct seq_file *m, struct mm_struct *mm)
 	seq_printf(m, "THP_enabled:\t%d\n", thp_enabled);
 }
 
+static inline void task_membarrier(struct seq_file *m, struct mm_struct *mm)
+{
+#ifdef CONFIG_MEMBARRIER
+	seq_put_decimal_ull(m, "MembarrierIPIs:\t",
+			    atomic_long_read(&mm->membarrier_ipis));
+	seq_putc(m, '\n');
+#endif
+}
+
+static inline void task_dma_buf(struct seq_file *m, struct task_struct *task)
+{
+#ifdef CONFIG_DMA_SHARED_BUFFER
+	seq_put_decimal_ull_width(m, "DmaBufCharged:\t",
+				  dma_buf_charged_size(task) >> 10, 8);
+	seq_puts(m, " kB\n");
+#endif
+}
+
 int proc_pid_status(struct seq_file *m, struct pid_namespace *ns,
 			struct pid *pid, struct task_struct *task)
 {
@@ -419,8 +438,10 @@ int proc_pid_status(struct seq_file *m, struct pid_namespace *ns,
 		task_mem(m, mm);
 		task_core_dumping(m, mm);
 		task_thp_status(m, mm);
+		task_membarrier(m, mm);
 		mmput(mm);
 	}
+	task_dma_buf(m, task);
 	task_sig(m, task);
 	task_cap(m, task);
 	task_seccomp(m, task);
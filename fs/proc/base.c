@@ -1109,6 +1109,7 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 	if (!legacy && has_capability_noaudit(current, CAP_SYS_RESOURCE))
 		task->signal->oom_score_adj_min = (short)oom_adj;
 	trace_oom_score_adj_update(task);
+	oom_bucket_update(task);
 
 	if (mm) {
 		struct task_struct *p;
@@ -1129,6 +1130,7 @@ static int __set_oom_adj(struct file *file, int oom_adj, bool legacy)
 					p->signal->oom_score_adj_min = (short)oom_adj;
 			}
 			task_unlock(p);
+			oom_bucket_update(p);
 		}
 		rcu_read_unlock();
 		mmdrop(mm);
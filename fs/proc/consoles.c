@@ -53,6 +53,8 @@ static int show_console_dev(struct seq_file *m, void *v)
 			flags);
 	if (dev)
 		seq_printf(m, " %4d:%d", MAJOR(dev), MINOR(dev));
+	/* records this console has yet to print */
+	seq_printf(m, " backlog:%llu", console_backlog(con));
 
 	seq_putc(m, '\n');
 	return 0;
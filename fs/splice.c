@@ -33,6 +33,7 @@
 #include <linux/security.h>
 #include <linux/gfp.h>
 #include <linux/socket.h>
+#include <linux/net.h>
 #include <linux/sched/signal.h>
 
 #include "internal.h"
@@ -724,6 +725,135 @@ done:
 
 EXPORT_SYMBOL(iter_file_splice_write);
 
+/*
+ * SPLICE_F_ZEROCOPY variant of generic_splice_sendpage(): gather the pipe
+ * buffers into one bvec and hand them to the socket with MSG_ZEROCOPY.
+ * The socket takes its own page references, so the buffers are released
+ * from the pipe as soon as they are queued, but pages vmspliced from user
+ * memory stay shared with the network stack until the socket posts a
+ * SO_EE_ORIGIN_ZEROCOPY completion for the send on its error queue. That
+ * is the point at which the caller may reuse the memory. Sockets without
+ * SO_ZEROCOPY enabled, or devices that cannot do scatter-gather, fall
+ * back to copying as sendmsg() does.
+ */
+static ssize_t splice_to_socket_zc(struct pipe_inode_info *pipe,
+				   struct file *out, size_t len,
+				   unsigned int flags)
+{
+	struct splice_desc sd = {
+		.total_len = len,
+		.flags = flags,
+		.u.file = out,
+	};
+	int nbufs = pipe->max_usage;
+	struct bio_vec *array;
+	struct socket *sock;
+	ssize_t ret;
+	int err;
+
+	sock = sock_from_file(out, &err);
+	if (!sock)
+		return err;
+
+	array = kcalloc(nbufs, sizeof(struct bio_vec), GFP_KERNEL);
+	if (unlikely(!array))
+		return -ENOMEM;
+
+	pipe_lock(pipe);
+
+	splice_from_pipe_begin(&sd);
+	while (sd.total_len) {
+		struct msghdr msg = {};
+		unsigned int head, tail, mask;
+		size_t left;
+		int n;
+
+		ret = splice_from_pipe_next(pipe, &sd);
+		if (ret <= 0)
+			break;
+
+		if (unlikely(nbufs < pipe->max_usage)) {
+			kfree(array);
+			nbufs = pipe->max_usage;
+			array = kcalloc(nbufs, sizeof(struct bio_vec),
+					GFP_KERNEL);
+			if (!array) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		head = pipe->head;
+		tail = pipe->tail;
+		mask = pipe->ring_size - 1;
+
+		/* build the vector */
+		left = sd.total_len;
+		for (n = 0; !pipe_empty(head, tail) && left && n < nbufs; tail++, n++) {
+			struct pipe_buffer *buf = &pipe->bufs[tail & mask];
+			size_t this_len = buf->len;
+
+			if (this_len > left)
+				this_len = left;
+
+			ret = pipe_buf_confirm(pipe, buf);
+			if (unlikely(ret)) {
+				if (ret == -ENODATA)
+					ret = 0;
+				goto done;
+			}
+
+			array[n].bv_page = buf->page;
+			array[n].bv_len = this_len;
+			array[n].bv_offset = buf->offset;
+			left -= this_len;
+		}
+
+		msg.msg_flags = MSG_ZEROCOPY;
+		if (flags & SPLICE_F_MORE)
+			msg.msg_flags |= MSG_MORE;
+		if (out->f_flags & O_NONBLOCK)
+			msg.msg_flags |= MSG_DONTWAIT;
+		iov_iter_bvec(&msg.msg_iter, WRITE, array, n,
+			      sd.total_len - left);
+		ret = sock_sendmsg(sock, &msg);
+		if (ret <= 0)
+			break;
+
+		sd.num_spliced += ret;
+		sd.total_len -= ret;
+
+		/* dismiss the fully eaten buffers, adjust the partial one */
+		tail = pipe->tail;
+		while (ret) {
+			struct pipe_buffer *buf = &pipe->bufs[tail & mask];
+			if (ret >= buf->len) {
+				ret -= buf->len;
+				buf->len = 0;
+				pipe_buf_release(pipe, buf);
+				tail++;
+				pipe->tail = tail;
+				if (pipe->files)
+					sd.need_wakeup = true;
+			} else {
+				buf->offset += ret;
+				buf->len -= ret;
+				ret = 0;
+			}
+		}
+	}
+done:
+	kfree(array);
+	splice_from_pipe_end(pipe, &sd);
+
+	pipe_unlock(pipe);
+
+	if (sd.num_spliced)
+		ret = sd.num_spliced;
+
+	return ret;
+}
+
 /**
  * generic_splice_sendpage - splice data from a pipe to a socket
  * @pipe:	pipe to splice from
@@ -734,12 +864,15 @@ EXPORT_SYMBOL(iter_file_splice_write);
  *
  * Description:
  *    Will send @len bytes from the pipe to a network socket. No data copying
- *    is involved.
+ *    is involved. With %SPLICE_F_ZEROCOPY the socket also reports when it
+ *    is done with the pages, see splice_to_socket_zc().
  *
  */
 ssize_t generic_splice_sendpage(struct pipe_inode_info *pipe, struct file *out,
 				loff_t *ppos, size_t len, unsigned int flags)
 {
+	if (IS_ENABLED(CONFIG_NET) && (flags & SPLICE_F_ZEROCOPY))
+		return splice_to_socket_zc(pipe, out, len, flags);
 	return splice_from_pipe(pipe, out, ppos, len, flags, pipe_to_sendpage);
 }
 
@@ -1210,8 +1210,33 @@ static void __wake_userfault(struct userfaultfd_ctx *ctx,
 	spin_unlock_irq(&ctx->fault_pending_wqh.lock);
 }
 
-static __always_inline void wake_userfault(struct userfaultfd_ctx *ctx,
-					   struct userfaultfd_wake_range *range)
+/* Ranges woken per fault_pending_wqh.lock hold in __wake_userfault_nr() */
+#define UFFD_WAKE_BATCH		32
+
+static void __wake_userfault_nr(struct userfaultfd_ctx *ctx,
+				struct userfaultfd_wake_range *ranges,
+				unsigned long nr)
+{
+	unsigned long i = 0;
+
+	while (i < nr) {
+		unsigned long end = min(nr, i + UFFD_WAKE_BATCH);
+
+		spin_lock_irq(&ctx->fault_pending_wqh.lock);
+		for (; i < end; i++) {
+			if (waitqueue_active(&ctx->fault_pending_wqh))
+				__wake_up_locked_key(&ctx->fault_pending_wqh,
+						     TASK_NORMAL, &ranges[i]);
+			if (waitqueue_active(&ctx->fault_wqh))
+				__wake_up(&ctx->fault_wqh, TASK_NORMAL, 1,
+					  &ranges[i]);
+		}
+		spin_unlock_irq(&ctx->fault_pending_wqh.lock);
+		cond_resched();
+	}
+}
+
+static __always_inline bool userfault_need_wakeup(struct userfaultfd_ctx *ctx)
 {
 	unsigned seq;
 	bool need_wakeup;
@@ -1237,7 +1262,13 @@ static __always_inline void wake_userfault(struct userfaultfd_ctx *ctx,
 			waitqueue_active(&ctx->fault_wqh);
 		cond_resched();
 	} while (read_seqcount_retry(&ctx->refile_seq, seq));
-	if (need_wakeup)
+	return need_wakeup;
+}
+
+static __always_inline void wake_userfault(struct userfaultfd_ctx *ctx,
+					   struct userfaultfd_wake_range *range)
+{
+	if (userfault_need_wakeup(ctx))
 		__wake_userfault(ctx, range);
 }
 
@@ -1756,6 +1787,88 @@ out:
 	return ret;
 }
 
+static int userfaultfd_copy_multi(struct userfaultfd_ctx *ctx,
+				  unsigned long arg)
+{
+	__s64 ret, copied = 0;
+	struct uffdio_copy_multi uffdio_copy_multi;
+	struct uffdio_copy_multi __user *user_uffdio_copy_multi;
+	struct uffdio_copy_range __user *user_ranges;
+	struct uffdio_copy_range copy_range;
+	struct userfaultfd_wake_range *ranges;
+	unsigned long i, nr_done = 0;
+
+	user_uffdio_copy_multi = (struct uffdio_copy_multi __user *) arg;
+
+	if (READ_ONCE(ctx->mmap_changing))
+		return -EAGAIN;
+
+	if (copy_from_user(&uffdio_copy_multi, user_uffdio_copy_multi,
+			   /* don't copy "copy" last field */
+			   sizeof(uffdio_copy_multi)-sizeof(__s64)))
+		return -EFAULT;
+
+	if (!uffdio_copy_multi.nr_ranges ||
+	    uffdio_copy_multi.nr_ranges > UFFDIO_COPY_MULTI_MAX)
+		return -EINVAL;
+	if (uffdio_copy_multi.mode &
+	    ~(UFFDIO_COPY_MODE_DONTWAKE|UFFDIO_COPY_MODE_WP))
+		return -EINVAL;
+
+	ranges = kmalloc_array(uffdio_copy_multi.nr_ranges, sizeof(*ranges),
+			       GFP_KERNEL);
+	if (!ranges)
+		return -ENOMEM;
+
+	if (!mmget_not_zero(ctx->mm)) {
+		kfree(ranges);
+		return -ESRCH;
+	}
+
+	user_ranges = u64_to_user_ptr(uffdio_copy_multi.ranges);
+	for (i = 0; i < uffdio_copy_multi.nr_ranges; i++) {
+		ret = -EFAULT;
+		if (copy_from_user(&copy_range, &user_ranges[i],
+				   sizeof(copy_range)))
+			break;
+		ret = validate_range(ctx->mm, &copy_range.dst, copy_range.len);
+		if (ret)
+			break;
+		/* see userfaultfd_copy() */
+		ret = -EINVAL;
+		if (copy_range.src + copy_range.len <= copy_range.src)
+			break;
+
+		ret = mcopy_atomic(ctx->mm, copy_range.dst, copy_range.src,
+				   copy_range.len, &ctx->mmap_changing,
+				   uffdio_copy_multi.mode);
+		if (ret < 0)
+			break;
+		BUG_ON(!ret);
+
+		copied += ret;
+		ranges[nr_done].start = copy_range.dst;
+		ranges[nr_done].len = ret;
+		nr_done++;
+		if (ret != copy_range.len) {
+			ret = -EAGAIN;
+			break;
+		}
+		ret = 0;
+	}
+	mmput(ctx->mm);
+
+	if (nr_done && !(uffdio_copy_multi.mode & UFFDIO_COPY_MODE_DONTWAKE) &&
+	    userfault_need_wakeup(ctx))
+		__wake_userfault_nr(ctx, ranges, nr_done);
+	kfree(ranges);
+
+	if (unlikely(put_user(copied ? copied : ret,
+			      &user_uffdio_copy_multi->copy)))
+		return -EFAULT;
+	return ret;
+}
+
 static int userfaultfd_zeropage(struct userfaultfd_ctx *ctx,
 				unsigned long arg)
 {
@@ -1997,6 +2110,9 @@ static long userfaultfd_ioctl(struct file *file, unsigned cmd,
 	case UFFDIO_COPY:
 		ret = userfaultfd_copy(ctx, arg);
 		break;
+	case UFFDIO_COPY_MULTI:
+		ret = userfaultfd_copy_multi(ctx, arg);
+		break;
 	case UFFDIO_ZEROPAGE:
 		ret = userfaultfd_zeropage(ctx, arg);
 		break;
@@ -8,6 +8,7 @@
 #include "fsverity_private.h"
 
 #include <crypto/hash.h>
+#include <linux/bvec.h>
 #include <linux/scatterlist.h>
 
 /* The hash algorithms supported by fs-verity */
@@ -96,6 +97,13 @@ struct fsverity_hash_alg *fsverity_get_hash_alg(const struct inode *inode,
 	pr_info("%s using implementation \"%s\"\n",
 		alg->name, crypto_ahash_driver_name(tfm));
 
+	/*
+	 * Usually the ahash only wraps an shash.  Then the shash is called
+	 * directly on the pages, without building a scatterlist and a request
+	 * for every block.
+	 */
+	alg->shash = crypto_ahash_shash(tfm);
+
 	/* pairs with smp_load_acquire() above */
 	smp_store_release(&alg->tfm, tfm);
 	goto out_unlock;
@@ -217,6 +225,38 @@ err_free:
 	goto out;
 }
 
+/* The request context of an ahash wrapping an shash is an shash_desc */
+static int fsverity_shash_page(const struct merkle_tree_params *params,
+			       const struct inode *inode,
+			       struct ahash_request *req, struct page *page,
+			       u8 *out)
+{
+	struct shash_desc *desc = ahash_request_ctx(req);
+	const struct bio_vec bv = {
+		.bv_page = page,
+		.bv_len = PAGE_SIZE,
+	};
+	int err;
+
+	desc->tfm = params->hash_alg->shash;
+	if (params->hashstate) {
+		err = crypto_shash_import(desc, params->hashstate);
+		if (err) {
+			fsverity_err(inode,
+				     "Error %d importing hash state", err);
+			return err;
+		}
+	} else {
+		err = crypto_shash_init(desc);
+	}
+
+	err = err ?: crypto_shash_update_bvec(desc, &bv) ?:
+	      crypto_shash_final(desc, out);
+	if (err)
+		fsverity_err(inode, "Error %d computing page hash", err);
+	return err;
+}
+
 /**
  * fsverity_hash_page() - hash a single data or hash page
  * @params: the Merkle tree's parameters
@@ -241,6 +281,9 @@ int fsverity_hash_page(const struct merkle_tree_params *params,
 	if (WARN_ON(params->block_size != PAGE_SIZE))
 		return -EINVAL;
 
+	if (params->hash_alg->shash)
+		return fsverity_shash_page(params, inode, req, page, out);
+
 	sg_init_table(&sg, 1);
 	sg_set_page(&sg, page, PAGE_SIZE, 0);
 	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
@@ -286,6 +329,9 @@ int fsverity_hash_buffer(struct fsverity_hash_alg *alg,
 	DECLARE_CRYPTO_WAIT(wait);
 	int err;
 
+	if (alg->shash)
+		return crypto_shash_tfm_digest(alg->shash, data, size, out);
+
 	/* This allocation never fails, since it's mempool-backed. */
 	req = fsverity_alloc_hash_request(alg, GFP_KERNEL);
 
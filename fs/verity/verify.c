@@ -13,6 +13,13 @@
 
 static struct workqueue_struct *fsverity_read_workqueue;
 
+/*
+ * Large bios are verified by several workers in parallel, each taking a range
+ * of at least this many pages.
+ */
+#define FS_VERITY_MIN_CHUNK_PAGES	16
+#define FS_VERITY_MAX_CHUNKS		8U
+
 /**
  * hash_at_level() - compute the location of the block's hash at the given level
  *
@@ -205,6 +212,112 @@ bool fsverity_verify_page(struct page *page)
 EXPORT_SYMBOL_GPL(fsverity_verify_page);
 
 #ifdef CONFIG_BLOCK
+/* A range of the pages of a bio, verified by a separate worker */
+struct verify_chunk {
+	struct work_struct work;
+	struct bio *bio;
+	unsigned int first;
+	unsigned int count;
+	unsigned long max_ra_pages;
+	bool done;
+};
+
+static void verify_bio_range(struct bio *bio, struct ahash_request *req,
+			     unsigned int first, unsigned int count,
+			     unsigned long max_ra_pages)
+{
+	struct inode *inode = bio_first_page_all(bio)->mapping->host;
+	const struct fsverity_info *vi = inode->i_verity_info;
+	const struct merkle_tree_params *params = &vi->tree_params;
+	struct bio_vec *bv;
+	struct bvec_iter_all iter_all;
+	unsigned int i = 0;
+
+	bio_for_each_segment_all(bv, bio, iter_all) {
+		struct page *page = bv->bv_page;
+		unsigned long level0_index = page->index >> params->log_arity;
+		unsigned long level0_ra_pages =
+			min(max_ra_pages, params->level0_blocks - level0_index);
+
+		if (i++ < first)
+			continue;
+		if (i > first + count)
+			break;
+
+		if (!PageError(page) &&
+		    !verify_page(inode, vi, req, page, level0_ra_pages))
+			SetPageError(page);
+	}
+}
+
+static void verify_chunk_work(struct work_struct *work)
+{
+	struct verify_chunk *chunk = container_of(work, struct verify_chunk,
+						  work);
+	struct inode *inode = bio_first_page_all(chunk->bio)->mapping->host;
+	struct fsverity_hash_alg *alg = inode->i_verity_info->tree_params.hash_alg;
+	struct ahash_request *req;
+
+	/*
+	 * The mempool's reserved request may be held by the submitter, which
+	 * can't make progress until we're done.  So don't wait for it; if no
+	 * request is available, the submitter verifies this range itself.
+	 */
+	req = fsverity_alloc_hash_request(alg, GFP_NOWAIT | __GFP_NOWARN);
+	if (!req)
+		return;
+
+	verify_bio_range(chunk->bio, req, chunk->first, chunk->count,
+			 chunk->max_ra_pages);
+	fsverity_free_hash_request(alg, req);
+	chunk->done = true;
+}
+
+/*
+ * Split the pages of a large bio into ranges to be verified by other
+ * workers, while the caller verifies the first range.  Returns the number of
+ * chunks queued, and the size of the caller's range in *@count.
+ */
+static unsigned int queue_verify_chunks(struct bio *bio,
+					struct verify_chunk **chunksp,
+					unsigned int npages,
+					unsigned long max_ra_pages,
+					unsigned int *count)
+{
+	struct verify_chunk *chunks;
+	unsigned int nchunks, size, i;
+
+	*count = npages;
+	nchunks = min3(npages / FS_VERITY_MIN_CHUNK_PAGES,
+		       num_online_cpus(), FS_VERITY_MAX_CHUNKS);
+	if (nchunks < 2)
+		return 0;
+
+	size = DIV_ROUND_UP(npages, nchunks);
+	nchunks = DIV_ROUND_UP(npages, size) - 1;
+
+	chunks = kmalloc_array(nchunks, sizeof(*chunks),
+			       GFP_NOFS | __GFP_NOWARN);
+	if (!chunks)
+		return 0;
+
+	for (i = 0; i < nchunks; i++) {
+		struct verify_chunk *chunk = &chunks[i];
+
+		INIT_WORK(&chunk->work, verify_chunk_work);
+		chunk->bio = bio;
+		chunk->first = (i + 1) * size;
+		chunk->count = min(size, npages - chunk->first);
+		chunk->max_ra_pages = max_ra_pages;
+		chunk->done = false;
+		queue_work(fsverity_read_workqueue, &chunk->work);
+	}
+
+	*chunksp = chunks;
+	*count = size;
+	return nchunks;
+}
+
 /**
  * fsverity_verify_bio() - verify a 'read' bio that has just completed
  * @bio: the bio to verify
@@ -225,14 +338,19 @@ void fsverity_verify_bio(struct bio *bio)
 	struct inode *inode = bio_first_page_all(bio)->mapping->host;
 	const struct fsverity_info *vi = inode->i_verity_info;
 	const struct merkle_tree_params *params = &vi->tree_params;
+	struct verify_chunk *chunks = NULL;
 	struct ahash_request *req;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
 	unsigned long max_ra_pages = 0;
+	unsigned int npages = 0, count, nchunks, i;
 
 	/* This allocation never fails, since it's mempool-backed. */
 	req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
 
+	bio_for_each_segment_all(bv, bio, iter_all)
+		npages++;
+
 	if (bio->bi_opf & REQ_RAHEAD) {
 		/*
 		 * If this bio is for data readahead, then we also do readahead
@@ -243,21 +361,28 @@ void fsverity_verify_bio(struct bio *bio)
 		 * This improves sequential read performance, as it greatly
 		 * reduces the number of I/O requests made to the Merkle tree.
 		 */
-		bio_for_each_segment_all(bv, bio, iter_all)
-			max_ra_pages++;
-		max_ra_pages /= 4;
+		max_ra_pages = npages / 4;
 	}
 
-	bio_for_each_segment_all(bv, bio, iter_all) {
-		struct page *page = bv->bv_page;
-		unsigned long level0_index = page->index >> params->log_arity;
-		unsigned long level0_ra_pages =
-			min(max_ra_pages, params->level0_blocks - level0_index);
+	/*
+	 * Hashing is CPU bound, so spread the pages of a large bio (e.g. a
+	 * readahead window on cold start) over several CPUs.
+	 */
+	nchunks = queue_verify_chunks(bio, &chunks, npages, max_ra_pages,
+				      &count);
 
-		if (!PageError(page) &&
-		    !verify_page(inode, vi, req, page, level0_ra_pages))
-			SetPageError(page);
+	verify_bio_range(bio, req, 0, count, max_ra_pages);
+
+	for (i = 0; i < nchunks; i++) {
+		struct verify_chunk *chunk = &chunks[i];
+
+		/* Do it here if no worker got to it, or it had no request */
+		cancel_work_sync(&chunk->work);
+		if (!chunk->done)
+			verify_bio_range(bio, req, chunk->first, chunk->count,
+					 max_ra_pages);
 	}
+	kfree(chunks);
 
 	fsverity_free_hash_request(params->hash_alg, req);
 }
@@ -30,6 +30,7 @@ extern void hv_stimer0_isr(void);
 
 #ifdef CONFIG_HYPERV_TIMER
 extern u64 (*hv_read_reference_counter)(void);
+extern struct clocksource *hyperv_cs;
 extern void hv_init_clocksource(void);
 
 extern struct ms_hyperv_tsc_page *hv_get_tsc_page(void);
@@ -11,6 +11,7 @@
 #include <linux/crypto.h>
 #include <linux/string.h>
 
+struct bio_vec;
 struct crypto_ahash;
 
 /**
@@ -301,6 +302,21 @@ static inline void crypto_free_ahash(struct crypto_ahash *tfm)
  */
 int crypto_has_ahash(const char *alg_name, u32 type, u32 mask);
 
+/**
+ * crypto_ahash_shash() - get the shash behind an ahash
+ * @tfm: ahash handle
+ *
+ * Most ahash handles are thin wrappers around a synchronous shash. Users that
+ * hash one block at a time can call the shash directly on linear buffers or
+ * pages instead of building a scatterlist for every request. The request
+ * context of such an ahash is a struct shash_desc followed by the state of
+ * the shash, so ahash_request_ctx() of a request can be used as descriptor
+ * after setting its tfm, and the exported state is the same for both.
+ *
+ * Return: the shash handle, owned by @tfm, or NULL if @tfm is a real ahash
+ */
+struct crypto_shash *crypto_ahash_shash(struct crypto_ahash *tfm);
+
 static inline const char *crypto_ahash_alg_name(struct crypto_ahash *tfm)
 {
 	return crypto_tfm_alg_name(crypto_ahash_tfm(tfm));
@@ -996,6 +1012,21 @@ int crypto_shash_final(struct shash_desc *desc, u8 *out);
 int crypto_shash_finup(struct shash_desc *desc, const u8 *data,
 		       unsigned int len, u8 *out);
 
+/**
+ * crypto_shash_update_bvec() - add the data of a bio_vec to a message digest
+ * @desc: operational state handle that is already initialized
+ * @bv: the data to add, which may span several pages
+ *
+ * Like crypto_shash_update(), but maps the pages one at a time, so that users
+ * hashing bios don't need to build a scatterlist.
+ *
+ * Context: Any context.
+ * Return: 0 if the message digest update was successful; < 0 if an error
+ *	   occurred
+ */
+int crypto_shash_update_bvec(struct shash_desc *desc,
+			     const struct bio_vec *bv);
+
 static inline void shash_desc_zero(struct shash_desc *desc)
 {
 	memzero_explicit(desc,
@@ -79,6 +79,15 @@ struct crypto_sync_skcipher {
  *	     be called in parallel with the same transformation object.
  * @decrypt: Decrypt a single block. This is a reverse counterpart to @encrypt
  *	     and the conditions are exactly the same.
+ * @encrypt_batch: Optional. Encrypt an array of independent requests on the
+ *		   same transformation object, e.g. disk sectors with
+ *		   different IVs, in one call. Only used for synchronous
+ *		   algorithms; the requests must be completed before returning
+ *		   and their completion callbacks are not called. An
+ *		   implementation can interleave the requests or keep its
+ *		   state loaded across them. Without it, @encrypt is called
+ *		   for each request.
+ * @decrypt_batch: Optional. Reverse counterpart to @encrypt_batch.
  * @init: Initialize the cryptographic transformation object. This function
  *	  is used to initialize the cryptographic transformation object.
  *	  This function is called only once at the instantiation time, right
@@ -106,6 +115,10 @@ struct skcipher_alg {
 	              unsigned int keylen);
 	int (*encrypt)(struct skcipher_request *req);
 	int (*decrypt)(struct skcipher_request *req);
+	int (*encrypt_batch)(struct skcipher_request **reqs,
+			     unsigned int nreqs);
+	int (*decrypt_batch)(struct skcipher_request **reqs,
+			     unsigned int nreqs);
 	int (*init)(struct crypto_skcipher *tfm);
 	void (*exit)(struct crypto_skcipher *tfm);
 
@@ -431,6 +444,39 @@ int crypto_skcipher_encrypt(struct skcipher_request *req);
  */
 int crypto_skcipher_decrypt(struct skcipher_request *req);
 
+/**
+ * crypto_skcipher_encrypt_batch() - encrypt several independent requests
+ * @reqs: array of skcipher_request handles, all on the same synchronous tfm
+ * @nreqs: number of requests in @reqs
+ *
+ * Encrypt the requests in @reqs as if crypto_skcipher_encrypt() was called on
+ * each of them in order, but let the implementation process them together.
+ * This is meant for bulk users that encrypt many small independent messages,
+ * such as disk sectors with different IVs. The tfm must not be asynchronous;
+ * all requests are completed when the function returns and their completion
+ * callbacks are not called.
+ *
+ * Return: 0 if all cipher operations were successful; < 0 if an error
+ *	   occurred, in which case the requests after the failing one may not
+ *	   have been processed
+ */
+int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs);
+
+/**
+ * crypto_skcipher_decrypt_batch() - decrypt several independent requests
+ * @reqs: array of skcipher_request handles, all on the same synchronous tfm
+ * @nreqs: number of requests in @reqs
+ *
+ * Decrypt counterpart of crypto_skcipher_encrypt_batch().
+ *
+ * Return: 0 if all cipher operations were successful; < 0 if an error
+ *	   occurred, in which case the requests after the failing one may not
+ *	   have been processed
+ */
+int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs,
+				  unsigned int nreqs);
+
 /**
  * DOC: Symmetric Key Cipher Request Handle
  *
@@ -74,6 +74,19 @@ void update_siblings_masks(unsigned int cpu);
 void remove_cpu_topology(unsigned int cpuid);
 void reset_cpu_topology(void);
 int parse_acpi_topology(void);
+
+/* Topology of a CPU as seen by the hypervisor, -1 for an unknown id */
+struct cpu_topology_hint {
+	int thread_id;
+	int core_id;
+	int package_id;
+	int llc_id;
+	/* relative capacity, 0 if not known */
+	unsigned long capacity;
+};
+
+int topology_apply_hints(const struct cpu_topology_hint *hints,
+			 unsigned int nr);
 #endif
 extern bool topology_update_done;
 
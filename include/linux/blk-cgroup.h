@@ -42,6 +42,8 @@ enum blkg_iostat_type {
 };
 
 struct blkcg_gq;
+struct blk_lat_hist;
+struct seq_file;
 
 struct blkcg {
 	struct cgroup_subsys_state	css;
@@ -121,6 +123,9 @@ struct blkcg_gq {
 	struct blkg_iostat_set __percpu	*iostat_cpu;
 	struct blkg_iostat_set		iostat;
 
+	/* only allocated while the queue's latency histogram is enabled */
+	struct blk_lat_hist __percpu	*lat_hist;
+
 	struct blkg_policy_data		*pd[BLKCG_MAX_POLS];
 
 	spinlock_t			async_bio_lock;
@@ -600,6 +605,10 @@ static inline void blkcg_clear_delay(struct blkcg_gq *blkg)
 }
 
 void blk_cgroup_bio_start(struct bio *bio);
+void blkcg_lat_hist_bio_endio(struct bio *bio);
+void blkcg_enable_lat_hist(struct request_queue *q);
+void blkcg_disable_lat_hist(struct request_queue *q);
+void blkcg_lat_hist_show(struct request_queue *q, struct seq_file *m);
 void blkcg_add_delay(struct blkcg_gq *blkg, u64 now, u64 delta);
 void blkcg_schedule_throttle(struct request_queue *q, bool use_memdelay);
 void blkcg_maybe_throttle_current(void);
@@ -654,6 +663,11 @@ static inline void blkg_put(struct blkcg_gq *blkg) { }
 static inline bool blkcg_punt_bio_submit(struct bio *bio) { return false; }
 static inline void blkcg_bio_issue_init(struct bio *bio) { }
 static inline void blk_cgroup_bio_start(struct bio *bio) { }
+static inline void blkcg_lat_hist_bio_endio(struct bio *bio) { }
+static inline void blkcg_enable_lat_hist(struct request_queue *q) { }
+static inline void blkcg_disable_lat_hist(struct request_queue *q) { }
+static inline void blkcg_lat_hist_show(struct request_queue *q,
+				       struct seq_file *m) { }
 
 #define blk_queue_for_each_rl(rl, q)	\
 	for ((rl) = &(q)->root_rl; (rl); (rl) = NULL)
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Built-in boot timeline of initcalls, async work, probes, module loads and
+ * mounts, see kernel/boot_trace.c.
+ */
+#ifndef _LINUX_BOOT_TRACE_H
+#define _LINUX_BOOT_TRACE_H
+
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+#define BOOT_TRACE_NAME_LEN	48
+
+enum boot_trace_cat {
+	BOOT_TRACE_INITCALL,
+	BOOT_TRACE_ASYNC,
+	BOOT_TRACE_PROBE,
+	BOOT_TRACE_MODULE,
+	BOOT_TRACE_MOUNT,
+	BOOT_TRACE_MARK,
+	BOOT_TRACE_NR_CATS,
+};
+
+#ifdef CONFIG_BOOT_TRACE
+extern bool boot_trace_enabled;
+
+u64 boot_trace_clock(void);
+void __boot_trace_event(enum boot_trace_cat cat, u64 start, const char *name,
+			void *fn);
+
+/* Timestamp to pass to boot_trace_end(), 0 while not recording */
+static inline u64 boot_trace_start(void)
+{
+	return READ_ONCE(boot_trace_enabled) ? boot_trace_clock() : 0;
+}
+
+/* Record an event named @name that lasted from @start until now */
+static inline void boot_trace_end(enum boot_trace_cat cat, u64 start,
+				  const char *name)
+{
+	if (start)
+		__boot_trace_event(cat, start, name, NULL);
+}
+
+/* Record an event named after the function @fn */
+static inline void boot_trace_end_fn(enum boot_trace_cat cat, u64 start,
+				     void *fn)
+{
+	if (start)
+		__boot_trace_event(cat, start, NULL, fn);
+}
+
+/* Record an instant event */
+static inline void boot_trace_mark(const char *name)
+{
+	if (READ_ONCE(boot_trace_enabled))
+		__boot_trace_event(BOOT_TRACE_MARK, 0, name, NULL);
+}
+#else
+static inline u64 boot_trace_start(void)
+{
+	return 0;
+}
+
+static inline void boot_trace_end(enum boot_trace_cat cat, u64 start,
+				  const char *name)
+{
+}
+
+static inline void boot_trace_end_fn(enum boot_trace_cat cat, u64 start,
+				     void *fn)
+{
+}
+
+static inline void boot_trace_mark(const char *name)
+{
+}
+#endif /* CONFIG_BOOT_TRACE */
+
+#endif /* _LINUX_BOOT_TRACE_H */
@@ -15,6 +15,7 @@
 #include <linux/mm_types.h>
 #include <linux/wait.h>
 #include <linux/u64_stats_sync.h>
+#include <linux/sched/clock.h>
 #include <linux/refcount.h>
 #include <linux/mutex.h>
 #include <linux/module.h>
@@ -509,12 +510,50 @@ enum bpf_cgroup_storage_type {
  */
 #define MAX_BPF_FUNC_ARGS 12
 
+/* The first bucket of the run time histogram ends at 1 << shift ns */
+#define BPF_PROG_STATS_HIST_SHIFT 7
+
 struct bpf_prog_stats {
 	u64 cnt;
 	u64 nsecs;
+	u64 sampled;
+	u64 hist[BPF_PROG_RUN_HIST_LEN];
+	u32 sample_left;
 	struct u64_stats_sync syncp;
 } __aligned(2 * sizeof(u64));
 
+/* Time only one in sysctl_bpf_stats_sample_rate runs, all are counted */
+extern int sysctl_bpf_stats_sample_rate;
+
+static inline bool bpf_stats_sample(u32 *sample_left)
+{
+	if (likely(*sample_left)) {
+		(*sample_left)--;
+		return false;
+	}
+	*sample_left = READ_ONCE(sysctl_bpf_stats_sample_rate) - 1;
+	return true;
+}
+
+/* Account a run that started at @start, or an untimed one if @start is 0 */
+static inline void bpf_prog_stats_update(struct bpf_prog_stats *stats,
+					 u64 start)
+{
+	u64 nsecs = start ? sched_clock() - start : 0;
+	int bucket;
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->cnt++;
+	if (start) {
+		bucket = fls64(nsecs) - BPF_PROG_STATS_HIST_SHIFT;
+		bucket = clamp(bucket, 0, BPF_PROG_RUN_HIST_LEN - 1);
+		stats->nsecs += nsecs;
+		stats->sampled++;
+		stats->hist[bucket]++;
+	}
+	u64_stats_update_end(&stats->syncp);
+}
+
 struct btf_func_model {
 	u8 ret_size;
 	u8 nr_args;
@@ -805,6 +844,7 @@ struct bpf_prog_aux {
 	bool func_proto_unreliable;
 	bool sleepable;
 	bool tail_call_reachable;
+	bool xdp_has_frags;
 	struct hlist_node tramp_hlist;
 	/* BTF_KIND_FUNC_PROTO for valid attach_btf_id */
 	const struct btf_type *attach_func_proto;
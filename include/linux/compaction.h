@@ -87,6 +87,9 @@ extern int sysctl_compaction_handler(struct ctl_table *table, int write,
 			void *buffer, size_t *length, loff_t *ppos);
 extern int compaction_proactiveness_sysctl_handler(struct ctl_table *table,
 		int write, void *buffer, size_t *length, loff_t *ppos);
+extern unsigned int sysctl_compaction_demand;
+extern int compaction_demand_sysctl_handler(struct ctl_table *table,
+		int write, void *buffer, size_t *length, loff_t *ppos);
 extern int sysctl_extfrag_threshold;
 extern int sysctl_compact_unevictable_allowed;
 
@@ -187,6 +190,19 @@ extern void wakeup_kcompactd(pg_data_t *pgdat, int order, int highest_zoneidx);
 extern unsigned long isolate_and_split_free_page(struct page *page,
 				struct list_head *list);
 
+/* Lowest order whose allocation demand kcompactd tracks */
+#define COMPACT_DEMAND_MIN_ORDER	(PAGE_ALLOC_COSTLY_ORDER + 1)
+
+extern void __compaction_note_demand(pg_data_t *pgdat, unsigned int order);
+
+/* Account a high-order allocation request to the demand of @pgdat */
+static inline void compaction_note_demand(pg_data_t *pgdat,
+					  unsigned int order)
+{
+	if (unlikely(order >= COMPACT_DEMAND_MIN_ORDER))
+		__compaction_note_demand(pgdat, order);
+}
+
 #else
 static inline void reset_isolation_suitable(pg_data_t *pgdat)
 {
@@ -246,6 +262,11 @@ static inline unsigned long isolate_and_split_free_page(struct page *page,
 	return 0;
 }
 
+static inline void compaction_note_demand(pg_data_t *pgdat,
+					  unsigned int order)
+{
+}
+
 #endif /* CONFIG_COMPACTION */
 
 struct node;
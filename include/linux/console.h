@@ -152,6 +152,11 @@ struct console {
 	int	cflag;
 	void	*data;
 	struct	 console *next;
+
+	/* the next printk record to write, and those that were lost */
+	u64	seq;
+	unsigned long dropped;
+	struct task_struct *thread;	/* printer thread, if any */
 };
 
 /*
@@ -161,6 +166,7 @@ struct console {
 	for (con = console_drivers; con != NULL; con = con->next)
 
 extern int console_set_on_cmdline;
+extern u64 console_backlog(struct console *con);
 extern struct console *early_console;
 
 enum con_flush_mode {
@@ -26,6 +26,9 @@
 struct device;
 struct dma_buf;
 struct dma_buf_attachment;
+struct dma_buf_owner;
+struct mem_cgroup;
+struct task_struct;
 
 /**
  * struct dma_buf_ops - operations possible on struct dma_buf
@@ -383,6 +386,8 @@ struct dma_buf_ops {
  * @cb_excl: for userspace poll support
  * @cb_shared: for userspace poll support
  * @sysfs_entry: for exposing information about this buffer in sysfs.
+ * @memcg: memory cgroup the buffer is charged to, protected by @lock.
+ * @charge_owner: process the buffer is accounted to, protected by @lock.
  *
  * This represents a shared buffer, created by calling dma_buf_export(). The
  * userspace representation is a normal file descriptor, which can be created by
@@ -426,6 +431,10 @@ struct dma_buf {
 	} *sysfs_entry;
 #endif
 
+	/* memory accounting, see dma_buf_charge() */
+	struct mem_cgroup *memcg;
+	struct dma_buf_owner *charge_owner;
+
 	ANDROID_KABI_RESERVE(1);
 	ANDROID_KABI_RESERVE(2);
 };
@@ -603,6 +612,10 @@ int dma_buf_fd(struct dma_buf *dmabuf, int flags);
 struct dma_buf *dma_buf_get(int fd);
 void dma_buf_put(struct dma_buf *dmabuf);
 
+int dma_buf_charge(struct dma_buf *dmabuf, struct task_struct *task);
+int dma_buf_transfer_charge(struct dma_buf *dmabuf, struct task_struct *task);
+size_t dma_buf_charged_size(struct task_struct *task);
+
 struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *,
 					enum dma_data_direction);
 void dma_buf_unmap_attachment(struct dma_buf_attachment *, struct sg_table *,
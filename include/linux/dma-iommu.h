@@ -42,6 +42,8 @@ int iommu_dma_reserve_iova(struct device *dev, dma_addr_t base,
 
 int iommu_dma_enable_best_fit_algo(struct device *dev);
 
+ssize_t iommu_dma_show_flush_stats(struct iommu_domain *domain, char *buf);
+
 #else /* CONFIG_IOMMU_DMA */
 
 struct iommu_domain;
@@ -94,5 +96,11 @@ static inline int iommu_dma_enable_best_fit_algo(struct device *dev)
 	return -ENODEV;
 }
 
+static inline ssize_t iommu_dma_show_flush_stats(struct iommu_domain *domain,
+						 char *buf)
+{
+	return -ENODEV;
+}
+
 #endif	/* CONFIG_IOMMU_DMA */
 #endif	/* __DMA_IOMMU_H */
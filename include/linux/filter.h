@@ -562,13 +562,12 @@ DECLARE_STATIC_KEY_FALSE(bpf_stats_enabled_key);
 	cant_migrate();							\
 	if (static_branch_unlikely(&bpf_stats_enabled_key)) {		\
 		struct bpf_prog_stats *__stats;				\
-		u64 __start = sched_clock();				\
-		__ret = dfunc(ctx, (prog)->insnsi, (prog)->bpf_func);	\
+		u64 __start = 0;					\
 		__stats = this_cpu_ptr(prog->aux->stats);		\
-		u64_stats_update_begin(&__stats->syncp);		\
-		__stats->cnt++;						\
-		__stats->nsecs += sched_clock() - __start;		\
-		u64_stats_update_end(&__stats->syncp);			\
+		if (bpf_stats_sample(&__stats->sample_left))		\
+			__start = sched_clock();			\
+		__ret = dfunc(ctx, (prog)->insnsi, (prog)->bpf_func);	\
+		bpf_prog_stats_update(__stats, __start);		\
 	} else {							\
 		__ret = dfunc(ctx, (prog)->insnsi, (prog)->bpf_func);	\
 	}								\
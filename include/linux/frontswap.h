@@ -18,6 +18,9 @@ struct frontswap_ops {
 	void (*init)(unsigned); /* this swap type was just swapon'ed */
 	int (*store)(unsigned, pgoff_t, struct page *); /* store a page */
 	int (*load)(unsigned, pgoff_t, struct page *); /* load a page */
+	/* optional: load the pages with a @pending bit, clear it on success */
+	void (*load_batch)(swp_entry_t *entries, struct page **pages,
+			   unsigned int nr, unsigned long *pending);
 	void (*invalidate_page)(unsigned, pgoff_t); /* page no longer needed */
 	void (*invalidate_area)(unsigned); /* swap type just swapoff'ed */
 	struct frontswap_ops *next; /* private pointer to next ops */
@@ -34,6 +37,8 @@ extern bool __frontswap_test(struct swap_info_struct *, pgoff_t);
 extern void __frontswap_init(unsigned type, unsigned long *map);
 extern int __frontswap_store(struct page *page);
 extern int __frontswap_load(struct page *page);
+extern void __frontswap_load_batch(struct page **pages, unsigned int nr,
+				   unsigned long *loaded);
 extern void __frontswap_invalidate_page(unsigned, pgoff_t);
 extern void __frontswap_invalidate_area(unsigned);
 
@@ -100,6 +105,13 @@ static inline int frontswap_load(struct page *page)
 	return -1;
 }
 
+static inline void frontswap_load_batch(struct page **pages, unsigned int nr,
+					unsigned long *loaded)
+{
+	if (frontswap_enabled())
+		__frontswap_load_batch(pages, nr, loaded);
+}
+
 static inline void frontswap_invalidate_page(unsigned type, pgoff_t offset)
 {
 	if (frontswap_enabled())
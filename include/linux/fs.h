@@ -951,6 +951,9 @@ struct file {
 	struct fown_struct	f_owner;
 	const struct cred	*f_cred;
 	struct file_ra_state	f_ra;
+#ifdef CONFIG_READAHEAD_PROFILE
+	struct ra_profile	*f_ra_profile;
+#endif
 
 	u64			f_version;
 #ifdef CONFIG_SECURITY
@@ -3056,6 +3059,20 @@ extern long do_splice_direct(struct file *in, loff_t *ppos, struct file *out,
 
 extern void
 file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping);
+#ifdef CONFIG_READAHEAD_PROFILE
+extern int sysctl_readahead_profile;
+extern void readahead_profile_note(struct file *file, pgoff_t index,
+				   unsigned long nr_pages);
+extern void readahead_profile_release(struct file *file);
+#else
+static inline void readahead_profile_note(struct file *file, pgoff_t index,
+					  unsigned long nr_pages)
+{
+}
+static inline void readahead_profile_release(struct file *file)
+{
+}
+#endif
 extern loff_t noop_llseek(struct file *file, loff_t offset, int whence);
 extern loff_t no_llseek(struct file *file, loff_t offset, int whence);
 extern loff_t vfs_setpos(struct file *file, loff_t offset, loff_t maxsize);
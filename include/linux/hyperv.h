@@ -21,6 +21,8 @@
 #include <linux/timer.h>
 #include <linux/completion.h>
 #include <linux/device.h>
+#include <linux/dim.h>
+#include <linux/hrtimer.h>
 #include <linux/mod_devicetable.h>
 #include <linux/interrupt.h>
 #include <linux/reciprocal_div.h>
@@ -830,6 +832,35 @@ struct vmbus_channel {
 	 */
 	spinlock_t sched_lock;
 
+	/*
+	 * Busy-poll mode, enabled through the poll_usecs sysfs attribute.
+	 * While poll_queued, host interrupts are masked and the per-CPU
+	 * vmbus_poll thread of poll_cpu runs the callback whenever the
+	 * inbound ring is non-empty, until it has stayed empty for
+	 * poll_usecs.  poll_queued and poll_cpu are protected by sched_lock.
+	 */
+	u32 poll_usecs;
+	bool poll_queued;
+	int poll_cpu;
+	ktime_t poll_last_busy;
+	struct list_head poll_node;
+
+	/*
+	 * Adaptive interrupt moderation, enabled by the driver with
+	 * vmbus_chan_moder_enable().  Once the inbound ring is empty, host
+	 * interrupts stay masked for moder_usecs, which moder_dim picks from
+	 * the rate of packets the driver accounts with
+	 * vmbus_chan_moder_account(), and moder_timer looks at the ring
+	 * again.  The counters belong to the context running the callback.
+	 */
+	bool moder_enabled;
+	u16 moder_events;
+	u32 moder_usecs;
+	u64 moder_packets;
+	u64 moder_last_packets;
+	struct dim moder_dim;
+	struct hrtimer moder_timer;
+
 	/*
 	 * A channel can be marked for one of three modes of reading:
 	 *   BATCHED - callback called from taslket and should read
@@ -956,6 +987,16 @@ struct vmbus_channel {
 	 */
 	struct work_struct add_channel_work;
 
+	/*
+	 * Primary channels wait on the offer list of their device class
+	 * before being added to the bus; see vmbus_queue_offer().  The
+	 * offer and probe times are reported in debugfs.
+	 */
+	struct list_head offer_node;
+	ktime_t offer_time;
+	ktime_t probe_start;
+	ktime_t probe_end;
+
 	/*
 	 * Guest to host interrupts caused by the inbound ring buffer changing
 	 * from full to not full while a packet is waiting.
@@ -974,6 +1015,17 @@ struct vmbus_channel {
 	 */
 	u64 out_full_first;
 
+	/*
+	 * Time at which the outbound ring buffer was first found full, valid
+	 * while out_full_flag is set. The interval until the next successful
+	 * write is accounted as a write stall.
+	 */
+	ktime_t out_full_start;
+
+	/* Total and longest time writers were stalled on a full ring */
+	u64 out_full_stall_ns;
+	u64 out_full_stall_max_ns;
+
 	/* enabling/disabling fuzz testing on the channel (default is false)*/
 	bool fuzz_testing_state;
 
@@ -1007,6 +1059,16 @@ static inline void set_channel_read_mode(struct vmbus_channel *c,
 	c->callback_mode = mode;
 }
 
+void vmbus_chan_moder_enable(struct vmbus_channel *c, bool enable);
+bool vmbus_chan_moder_hold(struct vmbus_channel *c);
+
+/* Count packets read by the channel callback, for the moderation */
+static inline void vmbus_chan_moder_account(struct vmbus_channel *c,
+					    u32 packets)
+{
+	c->moder_packets += packets;
+}
+
 static inline void set_per_channel_state(struct vmbus_channel *c, void *s)
 {
 	c->per_channel_state = s;
@@ -1017,6 +1079,20 @@ static inline void *get_per_channel_state(struct vmbus_channel *c)
 	return c->per_channel_state;
 }
 
+/*
+ * Account the time the outbound ring buffer stayed full once a writer makes
+ * progress again. Called with out_full_flag still set.
+ */
+static inline void vmbus_chan_out_full_end(struct vmbus_channel *c)
+{
+	u64 stall = ktime_to_ns(ktime_sub(ktime_get(), c->out_full_start));
+
+	c->out_full_stall_ns += stall;
+	if (stall > c->out_full_stall_max_ns)
+		c->out_full_stall_max_ns = stall;
+	c->out_full_flag = false;
+}
+
 static inline void set_channel_pending_send_size(struct vmbus_channel *c,
 						 u32 size)
 {
@@ -1029,10 +1105,11 @@ static inline void set_channel_pending_send_size(struct vmbus_channel *c,
 		if (!c->out_full_flag) {
 			++c->out_full_first;
 			c->out_full_flag = true;
+			c->out_full_start = ktime_get();
 		}
 		spin_unlock_irqrestore(&c->outbound.ring_lock, flags);
-	} else {
-		c->out_full_flag = false;
+	} else if (c->out_full_flag) {
+		vmbus_chan_out_full_end(c);
 	}
 
 	c->outbound.ring_buffer->pending_send_sz = size;
@@ -1151,6 +1228,12 @@ extern int vmbus_sendpacket_mpb_desc(struct vmbus_channel *channel,
 				     u32 bufferlen,
 				     u64 requestid);
 
+extern int vmbus_sendpacket_gpadl(struct vmbus_channel *channel,
+				  u32 gpadl_handle,
+				  void *buffer,
+				  u32 bufferlen,
+				  u64 requestid);
+
 extern int vmbus_establish_gpadl(struct vmbus_channel *channel,
 				      void *kbuffer,
 				      u32 size,
@@ -1642,6 +1725,9 @@ struct vmpacket_descriptor *
 __hv_pkt_iter_next(struct vmbus_channel *channel,
 		   const struct vmpacket_descriptor *pkt);
 
+u32 hv_pkt_iter_bulk(struct vmbus_channel *channel,
+		     const struct vmpacket_descriptor **descs, u32 n);
+
 void hv_pkt_iter_close(struct vmbus_channel *channel);
 
 /*
@@ -49,6 +49,9 @@ typedef void (* iova_entry_dtor)(unsigned long data);
 /* Timeout (in ms) after which entries are flushed from the Flush-Queue */
 #define IOVA_FQ_TIMEOUT	10
 
+/* Entries pending in a Flush-Queue at which the flush is started early */
+#define IOVA_FQ_FLUSH_THRESHOLD	(IOVA_FQ_SIZE / 2)
+
 /* Flush Queue entry for defered flushing */
 struct iova_fq_entry {
 	unsigned long iova_pfn;
@@ -82,6 +85,12 @@ struct iova_domain {
 	atomic64_t	fq_flush_finish_cnt;	/* Number of TLB flushes that
 						   have been finished */
 
+	atomic64_t	fq_flush_full_cnt;	/* Number of TLB flushes done
+						   on a full flush-queue */
+
+	atomic64_t	fq_flush_early_cnt;	/* Number of times the timer
+						   was fired early */
+
 	struct iova	anchor;		/* rbtree lookup anchor */
 	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
 
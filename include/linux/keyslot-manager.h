@@ -103,6 +103,12 @@ struct blk_keyslot_manager {
 
 	/* Per-keyslot data */
 	struct blk_ksm_keyslot *slots;
+
+	/* Keyslot usage statistics */
+	atomic64_t nr_hits;		/* key was already in a keyslot */
+	atomic64_t nr_programs;		/* key had to be programmed */
+	atomic64_t nr_evictions;	/* ... replacing another key */
+	atomic64_t nr_waits;		/* ... after waiting for an idle slot */
 };
 
 int blk_ksm_init(struct blk_keyslot_manager *ksm, unsigned int num_slots);
@@ -118,6 +124,8 @@ unsigned int blk_ksm_get_slot_idx(struct blk_ksm_keyslot *slot);
 
 void blk_ksm_put_slot(struct blk_ksm_keyslot *slot);
 
+ssize_t blk_ksm_stats_show(struct blk_keyslot_manager *ksm, char *page);
+
 bool blk_ksm_crypto_cfg_supported(struct blk_keyslot_manager *ksm,
 				  const struct blk_crypto_config *cfg);
 
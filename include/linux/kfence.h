@@ -92,6 +92,15 @@ void __init kfence_init(void);
  */
 void kfence_shutdown_cache(struct kmem_cache *s);
 
+/**
+ * kfence_init_cache() - apply the kfence.caches filter to a new cache
+ * @s: cache just created
+ *
+ * Sets SLAB_SKIP_KFENCE on @s unless its name matches kfence.caches, so that
+ * the allocation path only tests a flag.
+ */
+void kfence_init_cache(struct kmem_cache *s);
+
 /*
  * Allocate a KFENCE object. Allocators must not call this function directly,
  * use kfence_alloc() instead.
@@ -111,8 +120,8 @@ void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags);
  *
  * kfence_alloc() should be inserted into the heap allocation fast path,
  * allowing it to transparently return KFENCE-allocated objects with a low
- * probability using a static branch (the probability is controlled by the
- * kfence.sample_interval boot parameter).
+ * probability using a static branch or a check of the allocation gate (the
+ * probability is controlled by the kfence.sample_interval boot parameter).
  */
 static __always_inline void *kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 {
@@ -207,6 +216,7 @@ static inline bool is_kfence_address(const void *addr) { return false; }
 static inline void kfence_alloc_pool(void) { }
 static inline void kfence_init(void) { }
 static inline void kfence_shutdown_cache(struct kmem_cache *s) { }
+static inline void kfence_init_cache(struct kmem_cache *s) { }
 static inline void *kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags) { return NULL; }
 static inline size_t kfence_ksize(const void *addr) { return 0; }
 static inline void *kfence_object_start(const void *addr) { return NULL; }
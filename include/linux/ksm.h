@@ -23,6 +23,31 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags);
 int __ksm_enter(struct mm_struct *mm);
 void __ksm_exit(struct mm_struct *mm);
+int ksm_enable_merge_any(struct mm_struct *mm);
+int ksm_disable_merge_any(struct mm_struct *mm);
+unsigned long __ksm_vma_flags(struct mm_struct *mm, struct file *file,
+			      unsigned long vm_flags);
+void __ksm_add_vma(struct vm_area_struct *vma);
+
+/*
+ * With PR_SET_MEMORY_MERGE, new anonymous vmas start out VM_MERGEABLE, so
+ * that they still merge with their mergeable neighbours.
+ */
+static inline unsigned long ksm_vma_flags(struct mm_struct *mm,
+					  struct file *file,
+					  unsigned long vm_flags)
+{
+	if (test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return __ksm_vma_flags(mm, file, vm_flags);
+	return vm_flags;
+}
+
+/* File vmas are only marked once ->mmap() settled their flags */
+static inline void ksm_add_vma(struct vm_area_struct *vma)
+{
+	if (test_bit(MMF_VM_MERGE_ANY, &vma->vm_mm->flags))
+		__ksm_add_vma(vma);
+}
 
 static inline int ksm_fork(struct mm_struct *mm, struct mm_struct *oldmm)
 {
@@ -65,6 +90,27 @@ static inline void ksm_exit(struct mm_struct *mm)
 {
 }
 
+static inline int ksm_enable_merge_any(struct mm_struct *mm)
+{
+	return -EINVAL;
+}
+
+static inline int ksm_disable_merge_any(struct mm_struct *mm)
+{
+	return 0;
+}
+
+static inline unsigned long ksm_vma_flags(struct mm_struct *mm,
+					  struct file *file,
+					  unsigned long vm_flags)
+{
+	return vm_flags;
+}
+
+static inline void ksm_add_vma(struct vm_area_struct *vma)
+{
+}
+
 #ifdef CONFIG_MMU
 static inline int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
@@ -33,6 +33,7 @@ enum memcg_stat_item {
 	MEMCG_SWAP = NR_VM_NODE_STAT_ITEMS,
 	MEMCG_SOCK,
 	MEMCG_PERCPU_B,
+	MEMCG_DMABUF,
 	MEMCG_NR_STAT,
 };
 
@@ -82,6 +83,19 @@ struct memcg_vmstats_percpu {
 	unsigned long targets[MEM_CGROUP_NTARGETS];
 };
 
+/*
+ * Refault distances are bucketed by powers of two: bucket 0 holds the
+ * distances below 2^MEMCG_REFAULT_HIST_SHIFT pages, bucket i the ones below
+ * 2^(MEMCG_REFAULT_HIST_SHIFT + i) pages, and the last bucket all the rest.
+ */
+#define MEMCG_REFAULT_HIST_SHIFT	8
+#define MEMCG_REFAULT_HIST_BUCKETS	16
+
+struct memcg_refault_hist {
+	/* indexed by page_is_file_lru() */
+	unsigned long count[2][MEMCG_REFAULT_HIST_BUCKETS];
+};
+
 struct mem_cgroup_reclaim_iter {
 	struct mem_cgroup *position;
 	/* scan generation, increased every round-trip */
@@ -317,6 +331,9 @@ struct mem_cgroup {
 	/* Subtree VM stats and events (batched updates) */
 	struct memcg_vmstats_percpu __percpu *vmstats_percpu;
 
+	/* Subtree workingset refault distances */
+	struct memcg_refault_hist __percpu *refault_hist;
+
 #ifdef CONFIG_CGROUP_WRITEBACK
 	struct list_head cgwb_list;
 	struct wb_domain cgwb_domain;
@@ -961,6 +978,9 @@ static inline void memcg_memory_event_mm(struct mm_struct *mm,
 
 void split_page_memcg(struct page *head, unsigned int nr);
 
+void mem_cgroup_note_refault(struct mem_cgroup *memcg, bool file,
+			     unsigned long distance);
+
 #else /* CONFIG_MEMCG */
 
 #define MEM_CGROUP_ID_SHIFT	0
@@ -1312,6 +1332,11 @@ static inline
 void count_memcg_event_mm(struct mm_struct *mm, enum vm_event_item idx)
 {
 }
+
+static inline void mem_cgroup_note_refault(struct mem_cgroup *memcg,
+					   bool file, unsigned long distance)
+{
+}
 #endif /* CONFIG_MEMCG */
 
 /* idx can be of type enum memcg_stat_item or node_stat_item */
@@ -1512,6 +1537,11 @@ extern int memcg_expand_shrinker_maps(int new_id);
 
 extern void memcg_set_shrinker_bit(struct mem_cgroup *memcg,
 				   int nid, int shrinker_id);
+
+int mem_cgroup_charge_dmabuf(struct mem_cgroup *memcg, unsigned int nr_pages,
+			     gfp_t gfp_mask);
+void mem_cgroup_uncharge_dmabuf(struct mem_cgroup *memcg,
+				unsigned int nr_pages);
 #else
 #define mem_cgroup_sockets_enabled 0
 static inline void mem_cgroup_sk_alloc(struct sock *sk) { };
@@ -1525,6 +1555,18 @@ static inline void memcg_set_shrinker_bit(struct mem_cgroup *memcg,
 					  int nid, int shrinker_id)
 {
 }
+
+static inline int mem_cgroup_charge_dmabuf(struct mem_cgroup *memcg,
+					   unsigned int nr_pages,
+					   gfp_t gfp_mask)
+{
+	return 0;
+}
+
+static inline void mem_cgroup_uncharge_dmabuf(struct mem_cgroup *memcg,
+					      unsigned int nr_pages)
+{
+}
 #endif
 
 #ifdef CONFIG_MEMCG_KMEM
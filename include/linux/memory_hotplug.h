@@ -69,6 +69,12 @@ typedef int __bitwise mhp_t;
  * might be stale, or the resource might have changed.
  */
 #define MEMHP_MERGE_RESOURCE	((__force mhp_t)BIT(0))
+/*
+ * If the added memory is onlined right away (i.e., memhp_default_online_type
+ * is not MMOP_OFFLINE), online it to ZONE_MOVABLE irrespective of the
+ * default online type, so that it can be offlined again later.
+ */
+#define MEMHP_ONLINE_MOVABLE	((__force mhp_t)BIT(1))
 
 /*
  * Extended parameters for memory hotplug:
@@ -495,6 +495,14 @@ struct mm_struct {
 					  * init_mm.mmlist, and are protected
 					  * by mmlist_lock
 					  */
+#ifdef CONFIG_PT_AGING
+		/* on the list of mm's walked by page table aging */
+		struct list_head pt_aging_list;
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		/* huge pages collapsed with MADV_COLLAPSE */
+		atomic_t thp_sync_collapsed;
+#endif
 
 
 		unsigned long hiwater_rss; /* High-watermark of RSS usage */
@@ -529,6 +537,14 @@ struct mm_struct {
 		 */
 		struct mm_rss_stat rss_stat;
 
+#ifdef CONFIG_MEMBARRIER
+		/**
+		 * @membarrier_ipis: Number of IPIs sent by the membarrier
+		 * calls of this mm, reported in /proc/<pid>/status.
+		 */
+		atomic_long_t membarrier_ipis;
+#endif
+
 		struct linux_binfmt *binfmt;
 
 		/* Architecture-specific MM context */
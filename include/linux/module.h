@@ -424,6 +424,10 @@ struct module {
 
 	bool async_probe_requested;
 
+	/* Time taken by load_module() and by the init function, in ns */
+	u64 load_ns;
+	u64 init_ns;
+
 	/* symbols that will be GPL-only in the near future. */
 	const struct kernel_symbol *gpl_future_syms;
 	const s32 *gpl_future_crcs;
@@ -13,6 +13,7 @@
 struct zonelist;
 struct notifier_block;
 struct mem_cgroup;
+struct cgroup;
 struct task_struct;
 
 enum oom_constraint {
@@ -125,9 +126,18 @@ extern void oom_killer_enable(void);
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+extern void oom_bucket_add(struct task_struct *p);
+extern void oom_bucket_del(struct task_struct *p);
+extern void oom_bucket_update(struct task_struct *p);
+extern void oom_bucket_replace(struct task_struct *old,
+			       struct task_struct *new);
+extern void oom_refresh_candidates(void);
+extern bool oom_kill_psi_victim(struct cgroup *cgrp, short min_score_adj);
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
+extern int sysctl_oom_fast_select;
 extern int sysctl_panic_on_oom;
 
 /* call for adding killed process to reaper. */
@@ -18,9 +18,20 @@ struct page_reporting_dev_info {
 
 	/* Current state of page reporting */
 	atomic_t state;
+
+	/*
+	 * Minimal order of pages to report, 0 selects pageblock_order and
+	 * MAX_ORDER or above suspends reporting. May be changed at any time,
+	 * followed by a call to page_reporting_request().
+	 */
+	unsigned int order;
+
+	/* Delay between reporting passes in jiffies, 0 selects the default */
+	unsigned long delay;
 };
 
 /* Tear-down and bring-up for page reporting devices */
 void page_reporting_unregister(struct page_reporting_dev_info *prdev);
 int page_reporting_register(struct page_reporting_dev_info *prdev);
+void page_reporting_request(struct page_reporting_dev_info *prdev);
 #endif /*_LINUX_PAGE_REPORTING_H */
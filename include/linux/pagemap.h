@@ -31,6 +31,8 @@ enum mapping_flags {
 	/* writeback related tags are not used */
 	AS_NO_WRITEBACK_TAGS = 5,
 	AS_THP_SUPPORT = 6,	/* THPs supported */
+	AS_RA_PROFILE_REPLAYED = 7,	/* readahead profile prefetched */
+	AS_RA_CONTIG = 8,	/* readahead prefers contiguous pages */
 };
 
 /**
@@ -127,6 +129,21 @@ static inline bool mapping_thp_support(struct address_space *mapping)
 	return test_bit(AS_THP_SUPPORT, &mapping->flags);
 }
 
+/*
+ * Ask readahead to back consecutive indices of @mapping with physically
+ * contiguous pages where that is cheap, so that buffered reads can copy
+ * them in large runs.
+ */
+static inline void mapping_set_ra_contig(struct address_space *mapping)
+{
+	set_bit(AS_RA_CONTIG, &mapping->flags);
+}
+
+static inline bool mapping_ra_contig(struct address_space *mapping)
+{
+	return test_bit(AS_RA_CONTIG, &mapping->flags);
+}
+
 static inline int filemap_nr_thps(struct address_space *mapping)
 {
 #ifdef CONFIG_READ_ONLY_THP_FOR_FS
@@ -868,6 +868,13 @@ struct perf_cpu_context {
 	struct hrtimer			hrtimer;
 	ktime_t				hrtimer_interval;
 	unsigned int			hrtimer_active;
+	/* hrtimer_interval << hrtimer_scale while rotating is expensive */
+	unsigned int			hrtimer_scale;
+	u64				rotate_cost;	/* average, in ns */
+
+	/* time spent reprogramming the PMU, in ns */
+	u64				switch_time;
+	u64				rotate_time;
 
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp;
@@ -66,6 +66,9 @@ struct pid
 	struct hlist_head inodes;
 	/* wait queue for pidfd notifications */
 	wait_queue_head_t wait_pidfd;
+	/* process_madvise(PMADV_ASYNC) requests queued for this pid */
+	atomic_t async_madvise_pending;
+	bool async_madvise_issued;
 	struct rcu_head rcu;
 	struct upid numbers[1];
 };
@@ -4,6 +4,9 @@
 
 #define PIPE_DEF_BUFFERS	16
 
+/* Largest buffer order F_SETPIPE_ORDER accepts (64K with 4K pages) */
+#define PIPE_MAX_BUF_ORDER	4
+
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
 #define PIPE_BUF_FLAG_GIFT	0x04	/* page is a gift */
@@ -42,6 +45,7 @@ struct pipe_buffer {
  *	@max_usage: The maximum number of slots that may be used in the ring
  *	@ring_size: total number of buffers (should be a power of 2)
  *	@nr_accounted: The amount this pipe accounts for in user->pipe_bufs
+ *	@buf_order: page order of the buffers allocated by write()
  *	@tmp_page: cached released page
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
@@ -65,6 +69,7 @@ struct pipe_inode_info {
 	bool note_loss;
 #endif
 	unsigned int nr_accounted;
+	unsigned int buf_order;
 	unsigned int readers;
 	unsigned int writers;
 	unsigned int files;
@@ -154,6 +159,15 @@ static inline bool pipe_full(unsigned int head, unsigned int tail,
 	return pipe_occupancy(head, tail) >= limit;
 }
 
+/**
+ * pipe_buf_size - Return the size of the buffers write() fills in the pipe
+ * @pipe: The pipe info structure
+ */
+static inline unsigned int pipe_buf_size(const struct pipe_inode_info *pipe)
+{
+	return PAGE_SIZE << pipe->buf_order;
+}
+
 /**
  * pipe_space_for_user - Return number of slots available to userspace
  * @head: The pipe ring head pointer
@@ -1,6 +1,7 @@
 #ifndef _LINUX_PSI_TYPES_H
 #define _LINUX_PSI_TYPES_H
 
+#include <linux/hrtimer.h>
 #include <linux/kthread.h>
 #include <linux/seqlock.h>
 #include <linux/types.h>
@@ -58,6 +59,7 @@ enum psi_states {
 enum psi_aggregators {
 	PSI_AVGS = 0,
 	PSI_POLL,
+	PSI_RT,
 	NR_PSI_AGGREGATORS,
 };
 
@@ -129,6 +131,20 @@ struct psi_trigger {
 	 */
 	u64 last_event_time;
 
+	/*
+	 * Memory triggers only: kill a task with at least this
+	 * oom_score_adj on every event, see oom_kill_psi_victim()
+	 */
+	bool kill;
+	short kill_min_score_adj;
+
+	/*
+	 * Window below WINDOW_MIN_US, evaluated from the group's rt_timer
+	 * rather than the psimon kthread. Kills are deferred to kill_work.
+	 */
+	bool rt;
+	struct work_struct kill_work;
+
 	/* Refcounting to prevent premature destruction */
 	struct kref refcount;
 };
@@ -172,6 +188,23 @@ struct psi_group {
 	u64 polling_total[NR_PSI_STATES - 1];
 	u64 polling_next_update;
 	u64 polling_until;
+
+	/*
+	 * Short window triggers, polled from a hardirq hrtimer so that they
+	 * never wait for a kthread to get the CPU. rt_lock protects them.
+	 */
+	raw_spinlock_t rt_lock;
+	struct hrtimer rt_timer;
+	atomic_t rt_scheduled;
+	struct list_head rt_triggers;
+	u32 rt_nr_triggers[NR_PSI_STATES - 1];
+	u32 rt_states;
+	u64 rt_min_period;
+	u64 rt_total[NR_PSI_STATES - 1];
+	u64 rt_until;
+
+	/* Stall accounting of the group, see cgroup.pressure */
+	bool enabled;
 };
 
 #else /* CONFIG_PSI */
@@ -42,6 +42,11 @@ static inline void synchronize_rcu_expedited(void)
  */
 extern void kvfree(const void *addr);
 
+static inline void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	call_rcu(head, func);
+}
+
 static inline void kvfree_call_rcu(struct rcu_head *head, rcu_callback_t func)
 {
 	if (head) {
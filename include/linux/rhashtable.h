@@ -25,6 +25,7 @@
 #include <linux/workqueue.h>
 #include <linux/rculist.h>
 #include <linux/bit_spinlock.h>
+#include <linux/prefetch.h>
 
 #include <linux/rhashtable-types.h>
 /*
@@ -578,22 +579,18 @@ static inline int rhashtable_compare(struct rhashtable_compare_arg *arg,
 }
 
 /* Internal function, do not use. */
-static inline struct rhash_head *__rhashtable_lookup(
-	struct rhashtable *ht, const void *key,
-	const struct rhashtable_params params)
+static inline struct rhash_head *__rhashtable_lookup_hashed(
+	struct rhashtable *ht, struct bucket_table *tbl, unsigned int hash,
+	const void *key, const struct rhashtable_params params)
 {
 	struct rhashtable_compare_arg arg = {
 		.ht = ht,
 		.key = key,
 	};
 	struct rhash_lock_head __rcu *const *bkt;
-	struct bucket_table *tbl;
 	struct rhash_head *he;
-	unsigned int hash;
 
-	tbl = rht_dereference_rcu(ht->tbl, ht);
 restart:
-	hash = rht_key_hashfn(ht, tbl, key, params);
 	bkt = rht_bucket(tbl, hash);
 	do {
 		rht_for_each_rcu_from(he, rht_ptr_rcu(bkt), tbl, hash) {
@@ -612,12 +609,95 @@ restart:
 	smp_rmb();
 
 	tbl = rht_dereference_rcu(tbl->future_tbl, ht);
-	if (unlikely(tbl))
+	if (unlikely(tbl)) {
+		hash = rht_key_hashfn(ht, tbl, key, params);
 		goto restart;
+	}
 
 	return NULL;
 }
 
+/* Internal function, do not use. */
+static inline struct rhash_head *__rhashtable_lookup(
+	struct rhashtable *ht, const void *key,
+	const struct rhashtable_params params)
+{
+	struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+
+	return __rhashtable_lookup_hashed(ht, tbl,
+					  rht_key_hashfn(ht, tbl, key, params),
+					  key, params);
+}
+
+/* Number of keys hashed and prefetched at once by the bulk operations */
+#define RHT_BULK_MAX	16
+
+/* Internal function, do not use. */
+static inline void __rhashtable_prefetch_buckets(struct bucket_table *tbl,
+						 const unsigned int *hashes,
+						 unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		prefetch(rht_bucket(tbl, hashes[i]));
+}
+
+/**
+ * rhashtable_lookup_bulk - search hash table for several keys
+ * @ht:		hash table
+ * @keys:	array of pointers to the keys
+ * @objs:	array filled with the first matching entry of each key, or NULL
+ * @n:		number of keys
+ * @params:	hash table parameters
+ *
+ * Same as rhashtable_lookup() on each key, but the hashes of up to
+ * RHT_BULK_MAX keys are computed and their buckets and first entries are
+ * prefetched before any chain is walked, so that the cache misses of a burst
+ * of lookups, e.g. the packets of a NAPI poll, overlap.
+ *
+ * This must only be called under the RCU read lock.
+ *
+ * Returns the number of keys found.
+ */
+static inline unsigned int rhashtable_lookup_bulk(
+	struct rhashtable *ht, const void * const *keys, void **objs,
+	unsigned int n, const struct rhashtable_params params)
+{
+	unsigned int hashes[RHT_BULK_MAX];
+	struct bucket_table *tbl;
+	unsigned int i, j, nr, found = 0;
+
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (i = 0; i < n; i += nr) {
+		nr = min_t(unsigned int, n - i, RHT_BULK_MAX);
+
+		for (j = 0; j < nr; j++)
+			hashes[j] = rht_key_hashfn(ht, tbl, keys[i + j], params);
+		__rhashtable_prefetch_buckets(tbl, hashes, nr);
+
+		for (j = 0; j < nr; j++) {
+			struct rhash_head *he;
+
+			he = rht_ptr_rcu(rht_bucket(tbl, hashes[j]));
+			if (!rht_is_a_nulls(he))
+				prefetch(he);
+		}
+
+		for (j = 0; j < nr; j++) {
+			struct rhash_head *he;
+
+			he = __rhashtable_lookup_hashed(ht, tbl, hashes[j],
+							keys[i + j], params);
+			objs[i + j] = he ? rht_obj(ht, he) : NULL;
+			if (he)
+				found++;
+		}
+	}
+
+	return found;
+}
+
 /**
  * rhashtable_lookup - search hash table
  * @ht:		hash table
@@ -829,6 +909,49 @@ static inline int rhashtable_insert_fast(
 	return ret == NULL ? 0 : -EEXIST;
 }
 
+/**
+ * rhashtable_insert_bulk - insert several objects into hash table
+ * @ht:		hash table
+ * @objs:	array of pointers to the hash heads inside the objects
+ * @n:		number of objects
+ * @params:	hash table parameters
+ *
+ * Same as rhashtable_insert_fast() on each object, but the buckets of up to
+ * RHT_BULK_MAX objects are prefetched for writing before the first one is
+ * locked.
+ *
+ * It is safe to call this function from atomic context.
+ *
+ * Returns the number of objects inserted. Insertion stops at the first
+ * object that fails, the caller can retry it with rhashtable_insert_fast()
+ * to learn the error.
+ */
+static inline unsigned int rhashtable_insert_bulk(
+	struct rhashtable *ht, struct rhash_head **objs, unsigned int n,
+	const struct rhashtable_params params)
+{
+	struct bucket_table *tbl;
+	unsigned int i, j, nr;
+
+	for (i = 0; i < n; i += nr) {
+		nr = min_t(unsigned int, n - i, RHT_BULK_MAX);
+
+		rcu_read_lock();
+		tbl = rht_dereference_rcu(ht->tbl, ht);
+		for (j = 0; j < nr; j++)
+			prefetchw(rht_bucket(tbl,
+					     rht_head_hashfn(ht, tbl, objs[i + j],
+							     params)));
+		rcu_read_unlock();
+
+		for (j = 0; j < nr; j++)
+			if (rhashtable_insert_fast(ht, objs[i + j], params))
+				return i + j;
+	}
+
+	return n;
+}
+
 /**
  * rhltable_insert_key - insert object into hash list table
  * @hlt:	hash list table
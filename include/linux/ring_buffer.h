@@ -196,6 +196,17 @@ void ring_buffer_free_read_page(struct trace_buffer *buffer, int cpu, void *data
 int ring_buffer_read_page(struct trace_buffer *buffer, void **data_page,
 			  size_t len, int cpu, int full);
 
+struct trace_buffer_meta;
+
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma);
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu);
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu);
+struct trace_buffer_meta *ring_buffer_map_meta(struct trace_buffer *buffer,
+					       int cpu);
+void *ring_buffer_map_subbuf(struct trace_buffer *buffer, int cpu,
+			     unsigned int id);
+
 struct trace_seq;
 
 int ring_buffer_print_entry_header(struct trace_seq *s);
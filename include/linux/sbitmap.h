@@ -414,6 +414,23 @@ int __sbitmap_queue_get(struct sbitmap_queue *sbq);
 int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 				unsigned int shallow_depth);
 
+/**
+ * __sbitmap_queue_get_batch() - Try to allocate a batch of free bits from a
+ * &struct sbitmap_queue with a single atomic operation.
+ * @sbq: Bitmap queue to allocate from.
+ * @nr_tags: Number of bits to try to allocate, less than BITS_PER_LONG.
+ * @offset: Output parameter; bit number of the lowest bit of the mask.
+ *
+ * The bits are taken from the first free bit of a word on, so fewer than
+ * @nr_tags of them may be allocated. They must be freed with
+ * sbitmap_queue_clear() or sbitmap_queue_clear_batch(). Round robin queues
+ * are never allocated from in batches.
+ *
+ * Return: Mask of the allocated bits relative to @offset, 0 if none.
+ */
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset);
+
 /**
  * sbitmap_queue_get() - Try to allocate a free bit from a &struct
  * sbitmap_queue.
@@ -487,6 +504,20 @@ void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 			 unsigned int cpu);
 
+/**
+ * sbitmap_queue_clear_batch() - Free a batch of allocated bits and wake up
+ * waiters on a &struct sbitmap_queue.
+ * @sbq: Bitmap to free from.
+ * @offset: Value subtracted from each of @tags to get its bit number.
+ * @tags: Bits to free.
+ * @nr_tags: Number of entries in @tags.
+ *
+ * Bits of the same word that follow each other in @tags are cleared with a
+ * single atomic operation, so @tags should be sorted if possible.
+ */
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags);
+
 static inline int sbq_index_inc(int index)
 {
 	return (index + 1) & (SBQ_WAIT_QUEUES - 1);
@@ -412,6 +412,8 @@ struct sched_avg {
 	unsigned long			runnable_avg;
 	unsigned long			util_avg;
 	struct util_est			util_est;
+	/* Tasks only: growth of util_est.enqueued over the previous activation */
+	unsigned int			util_est_ramp;
 } ____cacheline_aligned;
 
 struct sched_statistics {
@@ -464,6 +466,9 @@ struct sched_entity {
 
 	u64				nr_migrations;
 
+	/* MIN_LATENCY_NICE..MAX_LATENCY_NICE, of the task or task group */
+	int				latency_nice;
+
 	struct sched_statistics		statistics;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -1339,6 +1344,10 @@ struct task_struct {
 #ifdef CONFIG_MMU
 	struct task_struct		*oom_reaper_list;
 #endif
+	/* Entry in the oom_score_adj buckets, thread group leaders only */
+	struct hlist_node		oom_bucket_node;
+	/* rss, swap and page tables at the last candidate refresh, in pages */
+	unsigned long			oom_rss_cache;
 #ifdef CONFIG_VMAP_STACK
 	struct vm_struct		*stack_vm_area;
 #endif
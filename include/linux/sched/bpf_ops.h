@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_SCHED_BPF_OPS_H
+#define _LINUX_SCHED_BPF_OPS_H
+
+#define SCHED_POLICY_NAME_MAX	16
+
+struct task_struct;
+
+/*
+ * Scheduling decisions a BPF struct_ops map can take over, all optional.
+ * They are called with the runqueue or pi lock held and must not sleep.
+ *
+ * @select_task_rq_fair: CPU for a FAIR task being woken up, forked or
+ *			 exec'd, or a negative value for the default choice
+ * @select_task_rq_rt:	 the same for an RT task
+ * @can_migrate_task:	 0 to keep @p from being pulled to @dst_cpu by the
+ *			 FAIR load balancer
+ */
+struct sched_policy_ops {
+	int (*select_task_rq_fair)(struct task_struct *p, int prev_cpu,
+				   int sd_flag, int wake_flags);
+	int (*select_task_rq_rt)(struct task_struct *p, int prev_cpu,
+				 int sd_flag, int wake_flags);
+	int (*can_migrate_task)(struct task_struct *p, int dst_cpu);
+	char name[SCHED_POLICY_NAME_MAX];
+};
+
+#endif /* _LINUX_SCHED_BPF_OPS_H */
@@ -9,6 +9,16 @@
  */
 
 #define SCHED_CPUFREQ_IOWAIT	(1U << 0)
+#define SCHED_CPUFREQ_PREDICT	(1U << 1)
+
+/*
+ * Why schedutil picked a frequency, reported by the sugov_next_freq
+ * tracepoint:
+ */
+#define SUGOV_REASON_UTIL	(1U << 0)
+#define SUGOV_REASON_IOWAIT	(1U << 1)
+#define SUGOV_REASON_PREDICT	(1U << 2)
+#define SUGOV_REASON_LIMITS	(1U << 3)
 
 #ifdef CONFIG_CPU_FREQ
 struct cpufreq_policy;
@@ -120,6 +120,13 @@
 /* Slab deactivation flag */
 #define SLAB_DEACTIVATED	((slab_flags_t __force)0x10000000U)
 
+/* Do not sample allocations with KFENCE, see kfence.caches */
+#ifdef CONFIG_KFENCE
+# define SLAB_SKIP_KFENCE	((slab_flags_t __force)0x20000000U)
+#else
+# define SLAB_SKIP_KFENCE	0
+#endif
+
 /*
  * ZERO_SIZE_PTR will be returned for zero sized kmalloc requests.
  *
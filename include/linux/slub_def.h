@@ -93,6 +93,8 @@ struct kmem_cache {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	/* Number of per cpu partial objects to keep around */
 	unsigned int cpu_partial;
+	/* cpu_partial as configured, it is scaled up from there under load */
+	unsigned int cpu_partial_base;
 #endif
 	struct kmem_cache_order_objects oo;
 
@@ -27,11 +27,15 @@ struct pagevec;
 #define SWAP_FLAG_DISCARD_ONCE	0x20000 /* discard swap area at swapon-time */
 #define SWAP_FLAG_DISCARD_PAGES 0x40000 /* discard page-clusters after use */
 
+#define SWAP_FLAG_NO_READAHEAD	0x80000 /* never read ahead of a fault */
 #define SWAP_FLAGS_VALID	(SWAP_FLAG_PRIO_MASK | SWAP_FLAG_PREFER | \
 				 SWAP_FLAG_DISCARD | SWAP_FLAG_DISCARD_ONCE | \
-				 SWAP_FLAG_DISCARD_PAGES)
+				 SWAP_FLAG_DISCARD_PAGES | SWAP_FLAG_NO_READAHEAD)
 #define SWAP_BATCH 64
 
+/* Swap entries free_swap_and_cache_nr() takes at once */
+#define SWAP_FREE_BATCH 16
+
 static inline int current_is_kswapd(void)
 {
 	return current->flags & PF_KSWAPD;
@@ -176,8 +180,9 @@ enum {
 	SWP_STABLE_WRITES = (1 << 11),	/* no overwrite PG_writeback pages */
 	SWP_SYNCHRONOUS_IO = (1 << 12),	/* synchronous IO is efficient */
 	SWP_VALID	= (1 << 13),	/* swap is valid to be operated on? */
+	SWP_NO_READAHEAD = (1 << 14),	/* swapped in one page at a time */
 					/* add others here before... */
-	SWP_SCANNING	= (1 << 14),	/* refcount in scan_swap_map */
+	SWP_SCANNING	= (1 << 15),	/* refcount in scan_swap_map */
 };
 
 #define SWAP_CLUSTER_MAX 32UL
@@ -293,6 +298,9 @@ struct swap_info_struct {
 					   */
 };
 
+/* Swap readahead hands at most this many pages to swap_readpage_batch() */
+#define SWAP_READ_BATCH		16
+
 #ifdef CONFIG_64BIT
 #define SWAP_RA_ORDER_CEILING	5
 #else
@@ -383,6 +391,27 @@ extern int vm_swappiness;
 extern int remove_mapping(struct address_space *mapping, struct page *page);
 
 extern unsigned long reclaim_pages(struct list_head *page_list);
+
+/* linux/mm/pt_aging.c */
+#ifdef CONFIG_PT_AGING
+extern void pt_aging_add_mm(struct mm_struct *mm);
+extern void pt_aging_del_mm(struct mm_struct *mm);
+extern bool pt_aging_ready(bool may_walk);
+#else
+static inline void pt_aging_add_mm(struct mm_struct *mm)
+{
+}
+
+static inline void pt_aging_del_mm(struct mm_struct *mm)
+{
+}
+
+static inline bool pt_aging_ready(bool may_walk)
+{
+	return false;
+}
+#endif
+
 #ifdef CONFIG_NUMA
 extern int node_reclaim_mode;
 extern int sysctl_min_unmapped_ratio;
@@ -402,6 +431,7 @@ extern void kswapd_stop(int nid);
 
 /* linux/mm/page_io.c */
 extern int swap_readpage(struct page *page, bool do_poll);
+extern void swap_readpage_batch(struct page **pages, unsigned int nr);
 extern int swap_writepage(struct page *page, struct writeback_control *wbc);
 extern void end_swap_bio_write(struct bio *bio);
 extern int __swap_writepage(struct page *page, struct writeback_control *wbc,
@@ -478,6 +508,7 @@ extern int swapcache_prepare(swp_entry_t);
 extern void swap_free(swp_entry_t);
 extern void swapcache_free_entries(swp_entry_t *entries, int n);
 extern int free_swap_and_cache(swp_entry_t);
+extern void free_swap_and_cache_nr(swp_entry_t *entries, int n);
 int swap_type_of(dev_t device, sector_t offset);
 int find_first_swap(dev_t *device);
 extern unsigned int count_swap_pages(int, int);
@@ -534,6 +565,7 @@ static inline void show_swap_cache_info(void)
 }
 
 #define free_swap_and_cache(e) ({(is_migration_entry(e) || is_device_private_entry(e));})
+#define free_swap_and_cache_nr(e, n) do { } while (0)
 #define swapcache_prepare(e) ({(is_migration_entry(e) || is_device_private_entry(e));})
 
 static inline int add_swap_count_continuation(swp_entry_t swp, gfp_t gfp_mask)
@@ -7,8 +7,9 @@
 #include <linux/mutex.h>
 
 #define SWAP_SLOTS_CACHE_SIZE			SWAP_BATCH
-#define THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE	(5*SWAP_SLOTS_CACHE_SIZE)
-#define THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE	(2*SWAP_SLOTS_CACHE_SIZE)
+#define SWAP_SLOTS_CACHE_MAX			(4*SWAP_SLOTS_CACHE_SIZE)
+#define THRESHOLD_ACTIVATE_SWAP_SLOTS_CACHE	(5*SWAP_SLOTS_CACHE_MAX)
+#define THRESHOLD_DEACTIVATE_SWAP_SLOTS_CACHE	(2*SWAP_SLOTS_CACHE_MAX)
 
 struct swap_slots_cache {
 	bool		lock_initialized;
@@ -16,6 +17,8 @@ struct swap_slots_cache {
 	swp_entry_t	*slots;
 	int		nr;
 	int		cur;
+	int		batch;	    /* slots per refill, adapts to demand */
+	unsigned long	refill_time;
 	spinlock_t	free_lock;  /* protects slots_ret, n_ret */
 	swp_entry_t	*slots_ret;
 	int		n_ret;
@@ -25,6 +28,7 @@ void disable_swap_slots_cache_lock(void);
 void reenable_swap_slots_cache_unlock(void);
 void enable_swap_slots_cache(void);
 int free_swap_slot(swp_entry_t entry);
+void free_swap_slots(swp_entry_t *entries, int n);
 
 extern bool swap_slot_cache_enabled;
 
@@ -15,6 +15,7 @@ struct array_buffer;
 struct tracer;
 struct dentry;
 struct bpf_prog;
+union bpf_attr;
 
 const char *trace_print_flags_seq(struct trace_seq *p, const char *delim,
 				  unsigned long flags,
@@ -674,6 +675,17 @@ static inline int bpf_get_perf_event_info(const struct perf_event *event,
 }
 #endif
 
+#if defined(CONFIG_BPF_EVENTS) && defined(CONFIG_DYNAMIC_FTRACE_WITH_REGS)
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr,
+				 struct bpf_prog *prog);
+#else
+static inline int
+bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
+#endif
+
 enum {
 	FILTER_OTHER = 0,
 	FILTER_STATIC_STRING,
@@ -135,6 +135,23 @@ struct rcu_work {
 	struct workqueue_struct *wq;
 };
 
+/*
+ * Affinity scopes of unbound workqueues. The CPUs are split into pods of
+ * the scope's granularity and work items issued on a CPU are executed by
+ * a pool serving its pod, to keep them close to the data they touch.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,		/* use system default */
+	WQ_AFFN_CPU,		/* one pod per CPU */
+	WQ_AFFN_SMT,		/* one pod per SMT core */
+	WQ_AFFN_CLUSTER,	/* one pod per LLC and CPU capacity */
+	WQ_AFFN_CACHE,		/* one pod per LLC */
+	WQ_AFFN_NUMA,		/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,		/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /**
  * struct workqueue_attrs - A struct for workqueue attributes.
  *
@@ -152,11 +169,38 @@ struct workqueue_attrs {
 	cpumask_var_t cpumask;
 
 	/**
-	 * @no_numa: disable NUMA affinity
+	 * @__pod_cpumask: internal attribute used to create per-pod pools
+	 *
+	 * Internal use only. The CPUs of the pod a pool serves. Equal to
+	 * @cpumask for the default pool of a workqueue and for per-cpu pools.
+	 */
+	cpumask_var_t __pod_cpumask;
+
+	/**
+	 * @affn_strict: affinity scope is strict
+	 *
+	 * If clear, the workers of a per-pod pool may run on any CPU of
+	 * @cpumask and are only started inside @__pod_cpumask. If set, they
+	 * are confined to @__pod_cpumask.
+	 */
+	bool affn_strict;
+
+	/**
+	 * @affn_scope: unbound CPU affinity scope
+	 *
+	 * Like ``no_numa`` below, this isn't a property of a worker_pool and
+	 * only decides how :c:func:`apply_workqueue_attrs` splits the CPUs
+	 * into per-pod pools.
+	 */
+	enum wq_affn_scope affn_scope;
+
+	/**
+	 * @no_numa: disable pod affinity
 	 *
 	 * Unlike other fields, ``no_numa`` isn't a property of a worker_pool. It
 	 * only modifies how :c:func:`apply_workqueue_attrs` select pools and thus
 	 * doesn't participate in pool hash calculations or equality comparisons.
+	 * When set, a single pool covers @cpumask whatever @affn_scope says.
 	 */
 	bool no_numa;
 };
@@ -673,5 +717,6 @@ int workqueue_offline_cpu(unsigned int cpu);
 
 void __init workqueue_init_early(void);
 void __init workqueue_init(void);
+void __init workqueue_init_topology(void);
 
 #endif
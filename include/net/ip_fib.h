@@ -343,6 +343,10 @@ static inline unsigned int fib4_rules_seq_read(struct net *net)
 	return 0;
 }
 
+static inline void fib4_lookup_cache_invalidate(void)
+{
+}
+
 static inline bool fib4_rules_early_flow_dissect(struct net *net,
 						 struct sk_buff *skb,
 						 struct flowi4 *fl4,
@@ -404,6 +408,16 @@ int fib4_rules_dump(struct net *net, struct notifier_block *nb,
 		    struct netlink_ext_ack *extack);
 unsigned int fib4_rules_seq_read(struct net *net);
 
+extern atomic_t fib4_lookup_cache_gen;
+
+/* Must be called before freeing a fib_info or trie leaf that a result
+ * cached by __fib_lookup() may still point to.
+ */
+static inline void fib4_lookup_cache_invalidate(void)
+{
+	atomic_inc(&fib4_lookup_cache_gen);
+}
+
 static inline bool fib4_rules_early_flow_dissect(struct net *net,
 						 struct sk_buff *skb,
 						 struct flowi4 *fl4,
@@ -109,6 +109,7 @@ struct netns_ct {
 	int			sysctl_auto_assign_helper;
 	int			sysctl_tstamp;
 	int			sysctl_checksum;
+	int			sysctl_skip_linklocal;
 
 	struct ct_pcpu __percpu *pcpu_lists;
 	struct ip_conntrack_stat __percpu *stat;
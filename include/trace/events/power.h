@@ -8,6 +8,7 @@
 #include <linux/cpufreq.h>
 #include <linux/ktime.h>
 #include <linux/pm_qos.h>
+#include <linux/sched/cpufreq.h>
 #include <linux/tracepoint.h>
 #include <linux/trace_events.h>
 
@@ -173,6 +174,42 @@ TRACE_EVENT(cpu_frequency_limits,
 		  (unsigned long)__entry->cpu_id)
 );
 
+TRACE_EVENT(sugov_next_freq,
+
+	TP_PROTO(unsigned int cpu, unsigned long util, unsigned long max,
+		 unsigned int old_freq, unsigned int freq, unsigned int reason),
+
+	TP_ARGS(cpu, util, max, old_freq, freq, reason),
+
+	TP_STRUCT__entry(
+		__field(u32, cpu_id)
+		__field(unsigned long, util)
+		__field(unsigned long, max)
+		__field(u32, old_freq)
+		__field(u32, freq)
+		__field(u32, reason)
+	),
+
+	TP_fast_assign(
+		__entry->cpu_id = cpu;
+		__entry->util = util;
+		__entry->max = max;
+		__entry->old_freq = old_freq;
+		__entry->freq = freq;
+		__entry->reason = reason;
+	),
+
+	TP_printk("cpu_id=%lu util=%lu max=%lu old_freq=%lu freq=%lu reason=%s",
+		  (unsigned long)__entry->cpu_id, __entry->util, __entry->max,
+		  (unsigned long)__entry->old_freq,
+		  (unsigned long)__entry->freq,
+		  __print_flags(__entry->reason, "|",
+				{ SUGOV_REASON_UTIL,	"util" },
+				{ SUGOV_REASON_IOWAIT,	"iowait" },
+				{ SUGOV_REASON_PREDICT,	"predict" },
+				{ SUGOV_REASON_LIMITS,	"limits" }))
+);
+
 TRACE_EVENT(device_pm_callback_start,
 
 	TP_PROTO(struct device *dev, const char *pm_ops, int event),
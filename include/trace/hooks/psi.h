@@ -14,6 +14,11 @@
 
 struct psi_trigger;
 struct psi_group;
+/*
+ * psi_event and psi_group are called under the trigger locks, and for
+ * groups with rt triggers from the hrtimer in hardirq context: they must
+ * not sleep. psi_kill always runs in process context.
+ */
 DECLARE_HOOK(android_vh_psi_event,
 	TP_PROTO(struct psi_trigger *t),
 	TP_ARGS(t));
@@ -22,9 +27,14 @@ DECLARE_HOOK(android_vh_psi_group,
 	TP_PROTO(struct psi_group *group),
 	TP_ARGS(group));
 
+DECLARE_HOOK(android_vh_psi_kill,
+	TP_PROTO(struct psi_trigger *t, bool *handled),
+	TP_ARGS(t, handled));
+
 #else
 #define trace_android_vh_psi_event(t)
 #define trace_android_vh_psi_group(group)
+#define trace_android_vh_psi_kill(t, handled)
 #endif
 
 #endif /* _TRACE_HOOK_PSI_H */
@@ -7,13 +7,15 @@
 #ifndef _LINUX_DM_USER_H
 #define _LINUX_DM_USER_H
 
+#include <linux/ioctl.h>
 #include <linux/types.h>
 
 /*
  * dm-user proxies device mapper ops between the kernel and userspace.  It's
  * essentially just an RPC mechanism: all kernel calls create a request,
  * userspace handles that with a response.  Userspace obtains requests via
- * read() and provides responses via write().
+ * read() and provides responses via write(), or it switches the channel to
+ * the shared memory ring transport described at the end of this file.
  *
  * See Documentation/block/dm-user.rst for more information.
  */
@@ -65,4 +67,67 @@ struct dm_user_message {
 	__u8 buf[];
 };
 
+/*
+ * Ring transport.
+ *
+ * DM_USER_IOC_SETUP_RING switches a freshly opened channel from read()/write()
+ * to a ring shared with the kernel, which userspace maps with mmap() at
+ * offset 0 and length ring_size.  The mapping holds a dm_user_ring_ctrl, the
+ * request ring, the response ring and a data area of nr_entries slots of
+ * DM_USER_RING_SLOT_SIZE bytes each.
+ *
+ * The kernel publishes requests by advancing req_prod.  Each request owns the
+ * data slot it names until userspace answers it: write data has been placed
+ * there by the kernel, read data must be placed there by userspace.  Userspace
+ * answers any number of requests, in any order, by filling response entries
+ * and advancing rsp_prod, then calls DM_USER_IOC_RING_ENTER.  That completes
+ * every pending response and publishes as many new requests as there are
+ * free slots, optionally sleeping until at least one is available.  poll()
+ * reports POLLIN while requests are waiting to be published.
+ *
+ * Indices are free running and wrap at 2^32; entry i lives at
+ * i & (nr_entries - 1).
+ */
+#define DM_USER_RING_MAX_ENTRIES 128
+#define DM_USER_RING_SLOT_SIZE (256 * 1024)
+
+struct dm_user_ring_setup {
+	__u32 nr_entries;	/* in: power of 2, at most DM_USER_RING_MAX_ENTRIES */
+	__u32 flags;		/* in: must be 0 */
+	__u64 ring_size;	/* out: length of the mapping */
+	__u64 req_offset;	/* out: offset of the request ring */
+	__u64 rsp_offset;	/* out: offset of the response ring */
+	__u64 data_offset;	/* out: offset of data slot 0 */
+};
+
+struct dm_user_ring_ctrl {
+	__u32 req_prod;		/* written by the kernel */
+	__u32 rsp_prod;		/* written by userspace */
+	__u32 rsp_cons;		/* written by the kernel */
+	__u32 nr_entries;
+};
+
+struct dm_user_ring_req {
+	__u64 seq;
+	__u64 type;
+	__u64 flags;
+	__u64 sector;
+	__u64 len;
+	__u32 slot;
+	__u32 pad;
+};
+
+struct dm_user_ring_rsp {
+	__u64 seq;		/* of the request being answered */
+	__u32 slot;		/* of the request being answered */
+	__u32 type;		/* DM_USER_RESP_* */
+};
+
+/* DM_USER_IOC_RING_ENTER flags */
+#define DM_USER_RING_ENTER_WAIT 0x1
+
+#define DM_USER_IOC_MAGIC 0xfd
+#define DM_USER_IOC_SETUP_RING _IOWR(DM_USER_IOC_MAGIC, 0x80, struct dm_user_ring_setup)
+#define DM_USER_IOC_RING_ENTER _IO(DM_USER_IOC_MAGIC, 0x81)
+
 #endif
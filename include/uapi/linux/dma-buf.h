@@ -47,4 +47,10 @@ struct dma_buf_sync {
 #define DMA_BUF_SET_NAME_A	_IOW(DMA_BUF_BASE, 1, u32)
 #define DMA_BUF_SET_NAME_B	_IOW(DMA_BUF_BASE, 1, u64)
 
+/*
+ * Move the memory accounting of the buffer, if any, to the calling process
+ * and its memory cgroup, e.g. after receiving it from an allocator service.
+ */
+#define DMA_BUF_IOCTL_TRANSFER_CHARGE	_IO(DMA_BUF_BASE, 8)
+
 #endif
@@ -18,8 +18,14 @@
 /* Valid FD_FLAGS are O_CLOEXEC, O_RDONLY, O_WRONLY, O_RDWR */
 #define DMA_HEAP_VALID_FD_FLAGS (O_CLOEXEC | O_ACCMODE)
 
-/* Currently no heap flags */
-#define DMA_HEAP_VALID_HEAP_FLAGS (0)
+/*
+ * Fail the allocation rather than entering direct reclaim or compaction.
+ * Heaps that keep a reserve may fall back to it. Heaps that cannot
+ * allocate without blocking on reclaim reject the flag with -EOPNOTSUPP.
+ */
+#define DMA_HEAP_FLAG_NO_RECLAIM	(1 << 0)
+
+#define DMA_HEAP_VALID_HEAP_FLAGS (DMA_HEAP_FLAG_NO_RECLAIM)
 
 /**
  * struct dma_heap_allocation_data - metadata passed from userspace for
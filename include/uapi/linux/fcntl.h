@@ -55,6 +55,13 @@
 #define F_GET_FILE_RW_HINT	(F_LINUX_SPECIFIC_BASE + 13)
 #define F_SET_FILE_RW_HINT	(F_LINUX_SPECIFIC_BASE + 14)
 
+/*
+ * Set and get the page order of the buffers write() fills in a pipe. The
+ * pipe size in bytes is kept, so larger buffers mean fewer of them.
+ */
+#define F_SETPIPE_ORDER		(F_LINUX_SPECIFIC_BASE + 15)
+#define F_GETPIPE_ORDER		(F_LINUX_SPECIFIC_BASE + 16)
+
 /*
  * Valid hint values for F_{GET,SET}_RW_HINT. 0 is "not set", or can be
  * used to clear any hints previously set.
@@ -175,6 +175,10 @@
  *
  *  7.32
  *  - add flags to fuse_attr, add FUSE_ATTR_SUBMOUNT, add FUSE_SUBMOUNTS
+ *
+ *  7.33
+ *  - add FUSE_INIT_EXT, add flags2 to fuse_init_in and fuse_init_out
+ *  - add FUSE_CACHE_READDIRPLUS
  */
 
 #ifndef _LINUX_FUSE_H
@@ -210,7 +214,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 32
+#define FUSE_KERNEL_MINOR_VERSION 33
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -320,6 +324,13 @@ struct fuse_file_lock {
  *		       foffset and moffset fields in struct
  *		       fuse_setupmapping_out and fuse_removemapping_one.
  * FUSE_SUBMOUNTS: kernel supports auto-mounting directory submounts
+ * FUSE_INIT_EXT: extended fuse_init_in request
+ * FUSE_CACHE_READDIRPLUS: entries and attributes from READDIRPLUS of a
+ *			   FOPEN_CACHE_DIR directory stay valid until
+ *			   explicitly invalidated
+ *
+ * Flags from bit 32 on are passed in flags2, shifted down by 32, along with
+ * FUSE_INIT_EXT. Flags not in upstream are allocated from bit 63 down.
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -349,7 +360,10 @@ struct fuse_file_lock {
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
 #define FUSE_SUBMOUNTS		(1 << 27)
+#define FUSE_INIT_EXT		(1 << 30)
 #define FUSE_PASSTHROUGH	(1 << 31)
+/* bits 32..63 get shifted down 32 bits into the flags2 field */
+#define FUSE_CACHE_READDIRPLUS	(1ULL << 63)
 
 /**
  * CUSE INIT request/reply flags
@@ -700,6 +714,8 @@ struct fuse_init_in {
 	uint32_t	minor;
 	uint32_t	max_readahead;
 	uint32_t	flags;
+	uint32_t	flags2;
+	uint32_t	unused[11];
 };
 
 #define FUSE_COMPAT_INIT_OUT_SIZE 8
@@ -716,7 +732,8 @@ struct fuse_init_out {
 	uint32_t	time_gran;
 	uint16_t	max_pages;
 	uint16_t	map_alignment;
-	uint32_t	unused[8];
+	uint32_t	flags2;
+	uint32_t	unused[7];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -884,9 +901,21 @@ struct fuse_notify_retrieve_in {
 	uint64_t	dummy4;
 };
 
+/**
+ * struct fuse_bind_queue - argument of FUSE_DEV_IOC_BIND_QUEUE
+ * @cpu: CPU whose requests the device reads
+ * @flags: must be zero
+ */
+struct fuse_bind_queue {
+	uint32_t	cpu;
+	uint32_t	flags;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_MAGIC		229
 #define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, uint32_t)
+/* Read requests issued on the given CPU from this device */
+#define FUSE_DEV_IOC_BIND_QUEUE		_IOW(FUSE_DEV_IOC_MAGIC, 125, struct fuse_bind_queue)
 /* 127 is reserved for the V1 interface implementation in Android (deprecated) */
 /* 126 is reserved for the V2 interface implementation in Android */
 #define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(FUSE_DEV_IOC_MAGIC, 126, __u32)
@@ -282,6 +282,20 @@ struct hv_do_fcopy {
 
 #define KVP_OP_REGISTER1 100
 
+/*
+ * Daemon to kernel only, with kvp_hdr.pad set to zero: maintain the
+ * in-kernel cache of a guest owned pool (KVP_POOL_GUEST or KVP_POOL_AUTO).
+ * Once a pool holds cached pairs, the kernel answers host GET and
+ * ENUMERATE requests on it without waking the daemon.
+ *
+ * KVP_OP_CACHE_SET adds or replaces the utf8 pair in body.kvp_set.data;
+ * KVP_OP_CACHE_FLUSH empties the pool and hands it back to the daemon.
+ * A host SET or DELETE on a cached pool flushes it as well.
+ */
+
+#define KVP_OP_CACHE_SET	101
+#define KVP_OP_CACHE_FLUSH	102
+
 enum hv_kvp_exchg_op {
 	KVP_OP_GET = 0,
 	KVP_OP_SET,
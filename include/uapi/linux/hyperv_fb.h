@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_HYPERV_FB_H
+#define _UAPI_LINUX_HYPERV_FB_H
+
+#include <linux/types.h>
+
+/* Upper bound on the rectangles accepted by one HVFB_IOC_DAMAGE call */
+#define HVFB_DAMAGE_RECTS_MAX	256
+
+struct hvfb_damage_rect {
+	__u32 x;
+	__u32 y;
+	__u32 width;
+	__u32 height;
+};
+
+/*
+ * Explicit damage list for HVFB_IOC_DAMAGE. 'rects' points to 'count'
+ * struct hvfb_damage_rect in pixel coordinates; 'reserved' must be 0.
+ * The rectangles are merged with any damage pending for the next
+ * refresh, so only their union is sent to the host.
+ */
+struct hvfb_damage {
+	__u32 count;
+	__u32 reserved;
+	__u64 rects;
+};
+
+#define HVFB_IOC_DAMAGE		_IOW('F', 0xB0, struct hvfb_damage)
+
+#endif /* _UAPI_LINUX_HYPERV_FB_H */
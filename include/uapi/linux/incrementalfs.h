@@ -169,6 +169,16 @@
  */
 #define INCFS_FEATURE_FLAG_V2 "v2"
 
+/*
+ * INCFS_BLOCK_FLAGS_RANGE support in INCFS_IOC_FILL_BLOCKS
+ */
+#define INCFS_FEATURE_FLAG_FILL_RANGE "fill_range"
+
+/*
+ * incfs_pending_read_info2.prefetch_blocks is filled in
+ */
+#define INCFS_FEATURE_FLAG_PREFETCH_HINT "prefetch_hint"
+
 enum incfs_compression_alg {
 	COMPRESSION_NONE = 0,
 	COMPRESSION_LZ4 = 1,
@@ -178,8 +188,18 @@ enum incfs_compression_alg {
 enum incfs_block_flags {
 	INCFS_BLOCK_FLAGS_NONE = 0,
 	INCFS_BLOCK_FLAGS_HASH = 1,
+
+	/*
+	 * data_len bytes of consecutive uncompressed blocks starting at
+	 * block_index, all but the last of them full size. May be combined
+	 * with INCFS_BLOCK_FLAGS_HASH.
+	 */
+	INCFS_BLOCK_FLAGS_RANGE = 2,
 };
 
+/* Maximal data_len of an INCFS_BLOCK_FLAGS_RANGE fill */
+#define INCFS_FILL_RANGE_MAX_SIZE (64 * INCFS_DATA_FILE_BLOCK_SIZE)
+
 typedef struct {
 	__u8 bytes[16];
 } incfs_uuid_t __attribute__((aligned (8)));
@@ -227,7 +247,12 @@ struct incfs_pending_read_info2 {
 	/* The UID of the reading process */
 	__u32 uid;
 
-	__u32 reserved;
+	/*
+	 * Number of blocks after block_index the reader is expected to ask
+	 * for soon, going by its readahead window. Zero if the read is not
+	 * part of a readahead.
+	 */
+	__u32 prefetch_blocks;
 };
 
 /*
@@ -132,6 +132,7 @@ enum {
 	IORING_OP_PROVIDE_BUFFERS,
 	IORING_OP_REMOVE_BUFFERS,
 	IORING_OP_TEE,
+	IORING_OP_SEND_ZC,
 
 	/* this goes last, obviously */
 	IORING_OP_LAST,
@@ -153,6 +154,25 @@ enum {
  */
 #define SPLICE_F_FD_IN_FIXED	(1U << 31) /* the last bit of __u32 */
 
+/*
+ * POLL_ADD flags. Note that since sqe->poll_events is the flag space, the
+ * command flags for POLL_ADD are stored in sqe->len.
+ *
+ * IORING_POLL_ADD_MULTI	Multishot poll. Sets IORING_CQE_F_MORE if
+ *				the poll handler will continue to report
+ *				CQEs on behalf of the same SQE.
+ */
+#define IORING_POLL_ADD_MULTI	(1U << 0)
+
+/*
+ * ACCEPT flags, stored in sqe->ioprio
+ *
+ * IORING_ACCEPT_MULTISHOT	Keep accepting connections and post one CQE
+ *				per accepted fd, with IORING_CQE_F_MORE set,
+ *				until an error or cancellation.
+ */
+#define IORING_ACCEPT_MULTISHOT	(1U << 0)
+
 /*
  * IO completion data structure (Completion Queue Entry)
  */
@@ -166,8 +186,13 @@ struct io_uring_cqe {
  * cqe->flags
  *
  * IORING_CQE_F_BUFFER	If set, the upper 16 bits are the buffer ID
+ * IORING_CQE_F_MORE	If set, parent SQE will generate more CQE entries
+ * IORING_CQE_F_NOTIF	Set for IORING_OP_SEND_ZC notifications, posted once
+ *			the network stack no longer references the buffer
  */
 #define IORING_CQE_F_BUFFER		(1U << 0)
+#define IORING_CQE_F_MORE		(1U << 1)
+#define IORING_CQE_F_NOTIF		(1U << 2)
 
 enum {
 	IORING_CQE_BUFFER_SHIFT		= 16,
@@ -238,7 +263,8 @@ struct io_uring_params {
 	__u32 sq_thread_idle;
 	__u32 features;
 	__u32 wq_fd;
-	__u32 resv[3];
+	__u32 sq_thread_budget;
+	__u32 resv[2];
 	struct io_sqring_offsets sq_off;
 	struct io_cqring_offsets cq_off;
 };
@@ -272,6 +298,17 @@ enum {
 	IORING_REGISTER_RESTRICTIONS		= 11,
 	IORING_REGISTER_ENABLE_RINGS		= 12,
 
+	/* register ring based provide buffer group */
+	IORING_REGISTER_PBUF_RING		= 13,
+	IORING_UNREGISTER_PBUF_RING		= 14,
+
+	/* set/clear io-wq worker CPU affinity */
+	IORING_REGISTER_IOWQ_AFF		= 15,
+	IORING_UNREGISTER_IOWQ_AFF		= 16,
+
+	/* set/get max number of io-wq workers */
+	IORING_REGISTER_IOWQ_MAX_WORKERS	= 17,
+
 	/* this goes last */
 	IORING_REGISTER_LAST
 };
@@ -299,6 +336,39 @@ struct io_uring_probe {
 	struct io_uring_probe_op ops[0];
 };
 
+struct io_uring_buf {
+	__u64	addr;
+	__u32	len;
+	__u16	bid;
+	__u16	resv;
+};
+
+/*
+ * Shared ring of provided buffers. User space fills in bufs[] and then
+ * publishes them by storing the new tail with release semantics; the tail
+ * overlays the resv field of bufs[0].
+ */
+struct io_uring_buf_ring {
+	union {
+		struct {
+			__u64	resv1;
+			__u32	resv2;
+			__u16	resv3;
+			__u16	tail;
+		};
+		struct io_uring_buf	bufs[0];
+	};
+};
+
+/* argument for IORING_(UN)REGISTER_PBUF_RING */
+struct io_uring_buf_reg {
+	__u64	ring_addr;
+	__u32	ring_entries;
+	__u16	bgid;
+	__u16	pad;
+	__u64	resv[3];
+};
+
 struct io_uring_restriction {
 	__u16 opcode;
 	union {
@@ -141,6 +141,25 @@
  * Command to be passed to the membarrier system call. The commands need to
  * be a single bit each, except for MEMBARRIER_CMD_QUERY which is assigned to
  * the value 0.
+ *
+ * MEMBARRIER_CMD_PRIVATE_EXPEDITED, MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE
+ * and MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ also accept one of the
+ * following flags, which limit the command to some of the threads of
+ * the process. They are allocated from bit 30 down so that they stay
+ * clear of the flags upstream allocates from bit 0 up:
+ *
+ * @MEMBARRIER_CMD_FLAG_CPU_MASK:
+ *                          Only interrupt the threads running on the CPUs
+ *                          set in the CPU mask pointed to by the fourth
+ *                          argument, which is the size of the mask in
+ *                          bytes (at most 4096) in the fifth argument.
+ * @MEMBARRIER_CMD_FLAG_TIDS:
+ *                          Only interrupt the threads whose thread IDs
+ *                          are in the array of pid_t pointed to by the
+ *                          fourth argument, which is the size of the
+ *                          array in bytes (at most 4096) in the fifth
+ *                          argument. Thread IDs that do not belong to
+ *                          the process are ignored.
  */
 enum membarrier_cmd {
 	MEMBARRIER_CMD_QUERY					= 0,
@@ -160,6 +179,8 @@ enum membarrier_cmd {
 
 enum membarrier_cmd_flag {
 	MEMBARRIER_CMD_FLAG_CPU		= (1 << 0),
+	MEMBARRIER_CMD_FLAG_CPU_MASK	= (1 << 30),
+	MEMBARRIER_CMD_FLAG_TIDS	= (1 << 29),
 };
 
 #endif /* _UAPI_LINUX_MEMBARRIER_H */
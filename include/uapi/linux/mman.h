@@ -9,6 +9,9 @@
 #define MREMAP_FIXED		2
 #define MREMAP_DONTUNMAP	4
 
+/* process_madvise() flags */
+#define PMADV_ASYNC		1	/* queue MADV_COLD/PAGEOUT, poll pidfd */
+
 #define OVERCOMMIT_GUESS		0
 #define OVERCOMMIT_ALWAYS		1
 #define OVERCOMMIT_NEVER		2
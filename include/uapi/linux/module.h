@@ -5,5 +5,9 @@
 /* Flags for sys_finit_module: */
 #define MODULE_INIT_IGNORE_MODVERSIONS	1
 #define MODULE_INIT_IGNORE_VERMAGIC	2
+/* Return once the file is read, load in the background */
+#define MODULE_INIT_ASYNC		4
+/* With fd -1: wait for the background loads, return their first error */
+#define MODULE_INIT_ASYNC_WAIT		8
 
 #endif /* _UAPI_LINUX_MODULE_H */
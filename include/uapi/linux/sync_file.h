@@ -67,6 +67,43 @@ struct sync_file_info {
 	__u64	sync_fence_info;
 };
 
+/**
+ * struct sync_waitset_fence - fence to add to or remove from a waitset
+ * @cookie:	caller chosen value identifying the fence in the waitset
+ * @fd:		sync_file fd of the fence, ignored on removal
+ * @flags:	waitset_fence flags, should always be zero
+ */
+struct sync_waitset_fence {
+	__u64	cookie;
+	__s32	fd;
+	__u32	flags;
+};
+
+/**
+ * struct sync_waitset_event - signaled fence read from a waitset
+ * @cookie:	cookie the fence was added with
+ * @status:	status of the fence 1:signaled <0:error
+ * @pad:	padding for 64-bit alignment, always zero
+ */
+struct sync_waitset_event {
+	__u64	cookie;
+	__s32	status;
+	__u32	pad;
+};
+
+/**
+ * struct sync_waitset_data - data passed to the waitset ioctls
+ * @ptr:	pointer to an array of struct sync_waitset_fence (add, remove)
+ *		or struct sync_waitset_event (read)
+ * @count:	number of array elements, returns the number processed
+ * @flags:	waitset_data flags, should always be zero
+ */
+struct sync_waitset_data {
+	__u64	ptr;
+	__u32	count;
+	__u32	flags;
+};
+
 #define SYNC_IOC_MAGIC		'>'
 
 /**
@@ -95,4 +132,44 @@ struct sync_file_info {
  */
 #define SYNC_IOC_FILE_INFO	_IOWR(SYNC_IOC_MAGIC, 4, struct sync_file_info)
 
+/**
+ * DOC: Fence waitsets
+ *
+ * Opening /dev/sync_waitset returns a waitset, a set of fences that can
+ * be waited on with a single poll(). The fd is readable as long as at
+ * least one fence in the set has signaled; signaled fences stay in the
+ * set until read back with SYNC_IOC_WAITSET_READ. Any number of fences
+ * signaling between two reads cause only a single wakeup.
+ */
+
+/**
+ * DOC: SYNC_IOC_WAITSET_ADD - add fences to a waitset
+ *
+ * Takes a struct sync_waitset_data pointing to count struct
+ * sync_waitset_fence. Each fence is added with its cookie, a fence that
+ * already signaled is immediately readable. On error count is updated
+ * with the number of fences added before the failure.
+ */
+#define SYNC_IOC_WAITSET_ADD	_IOWR(SYNC_IOC_MAGIC, 8, struct sync_waitset_data)
+
+/**
+ * DOC: SYNC_IOC_WAITSET_REMOVE - remove fences from a waitset
+ *
+ * Takes a struct sync_waitset_data pointing to count struct
+ * sync_waitset_fence, and removes one fence with each cookie, signaled or
+ * not. Fails with ENOENT for a cookie not in the set, count is updated
+ * like for SYNC_IOC_WAITSET_ADD.
+ */
+#define SYNC_IOC_WAITSET_REMOVE	_IOWR(SYNC_IOC_MAGIC, 9, struct sync_waitset_data)
+
+/**
+ * DOC: SYNC_IOC_WAITSET_READ - take signaled fences out of a waitset
+ *
+ * Takes a struct sync_waitset_data pointing to room for count struct
+ * sync_waitset_event. Fills in up to count signaled fences, in signaling
+ * order, removes them from the set and updates count with their number.
+ * Never blocks, count is set to 0 if no fence has signaled.
+ */
+#define SYNC_IOC_WAITSET_READ	_IOWR(SYNC_IOC_MAGIC, 10, struct sync_waitset_data)
+
 #endif /* _UAPI_LINUX_SYNC_H */
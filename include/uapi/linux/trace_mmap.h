@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _TRACE_MMAP_H_
+#define _TRACE_MMAP_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - Meta page of a memory mapped ring buffer
+ * @meta_page_size:	Size of the meta page, the sub-buffers follow it.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer.
+ * @nr_subbufs:		Number of sub-buffers, including the reader one.
+ * @reader.lost_events:	Events lost before the current reader sub-buffer.
+ * @reader.id:		ID of the reader sub-buffer, in [0, @nr_subbufs - 1].
+ * @reader.read:	Offset of the unread data in the reader sub-buffer.
+ * @entries:		Number of entries in the ring buffer.
+ * @overrun:		Number of entries overwritten by the writer.
+ * @read:		Number of entries consumed.
+ *
+ * Sub-buffer ID n is mapped at offset @meta_page_size + n * @subbuf_size.
+ * A sub-buffer starts with a u64 time stamp and a commit field giving the
+ * size of the events that follow. The fields are only updated by
+ * TRACE_MMAP_IOCTL_GET_READER.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64		entries;
+	__u64		overrun;
+	__u64		read;
+};
+
+/*
+ * Account the data of the reader sub-buffer as read if there is any left,
+ * otherwise swap in the next sub-buffer if the writer has left the reader
+ * one, and update the meta page. A consumer reads the events of the reader
+ * sub-buffer from @reader.read up to its commit when the ID changed, from
+ * where it stopped otherwise, and issues the ioctl again.
+ */
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('T', 0x1)
+
+#endif /* _TRACE_MMAP_H_ */
@@ -6,6 +6,15 @@
 #include <linux/ioctl.h>
 
 #define UDMABUF_FLAGS_CLOEXEC	0x01
+/*
+ * Take the pages from the page cache of regular files opened for reading
+ * instead of from sealed memfds. The buffer is read-only, both for mmap
+ * and for devices, and the files can't be opened for writing or
+ * truncated until it is released.
+ */
+#define UDMABUF_FLAGS_FILE	0x02
+
+#define UDMABUF_FLAGS_VALID	(UDMABUF_FLAGS_CLOEXEC | UDMABUF_FLAGS_FILE)
 
 struct udmabuf_create {
 	__u32 memfd;
@@ -42,11 +42,13 @@
 	 (__u64)1 << _UFFDIO_COPY |		\
 	 (__u64)1 << _UFFDIO_ZEROPAGE |		\
 	 (__u64)1 << _UFFDIO_WRITEPROTECT |	\
-	 (__u64)1 << _UFFDIO_CONTINUE)
+	 (__u64)1 << _UFFDIO_CONTINUE |		\
+	 (__u64)1 << _UFFDIO_COPY_MULTI)
 #define UFFD_API_RANGE_IOCTLS_BASIC		\
 	((__u64)1 << _UFFDIO_WAKE |		\
 	 (__u64)1 << _UFFDIO_COPY |		\
-	 (__u64)1 << _UFFDIO_CONTINUE)
+	 (__u64)1 << _UFFDIO_CONTINUE |		\
+	 (__u64)1 << _UFFDIO_COPY_MULTI)
 
 /*
  * Valid ioctl command number range with this API is from 0x00 to
@@ -63,6 +65,7 @@
 #define _UFFDIO_ZEROPAGE		(0x04)
 #define _UFFDIO_WRITEPROTECT		(0x06)
 #define _UFFDIO_CONTINUE		(0x07)
+#define _UFFDIO_COPY_MULTI		(0x08)
 #define _UFFDIO_API			(0x3F)
 
 /* userfaultfd ioctl ids */
@@ -83,6 +86,8 @@
 				      struct uffdio_writeprotect)
 #define UFFDIO_CONTINUE		_IOWR(UFFDIO, _UFFDIO_CONTINUE,	\
 				      struct uffdio_continue)
+#define UFFDIO_COPY_MULTI	_IOWR(UFFDIO, _UFFDIO_COPY_MULTI, \
+				      struct uffdio_copy_multi)
 
 /* read() structure */
 struct uffd_msg {
@@ -246,6 +251,32 @@ struct uffdio_copy {
 	__s64 copy;
 };
 
+struct uffdio_copy_range {
+	__u64 dst;
+	__u64 src;
+	__u64 len;
+};
+
+/*
+ * UFFDIO_COPY_MULTI resolves up to UFFDIO_COPY_MULTI_MAX discontiguous
+ * ranges, in order, and wakes the waiters of all of them at once. It stops
+ * at the first range that fails or is only partially copied.
+ */
+#define UFFDIO_COPY_MULTI_MAX			1024
+struct uffdio_copy_multi {
+	/* pointer to an array of nr_ranges struct uffdio_copy_range */
+	__u64 ranges;
+	__u64 nr_ranges;
+	/* UFFDIO_COPY_MODE_* flags, applied to every range */
+	__u64 mode;
+
+	/*
+	 * "copy" is written by the ioctl and must be at the end: the bytes
+	 * copied over all ranges, or the error if nothing could be copied.
+	 */
+	__s64 copy;
+};
+
 struct uffdio_zeropage {
 	struct uffdio_range range;
 #define UFFDIO_ZEROPAGE_MODE_DONTWAKE		((__u64)1<<0)
@@ -31,7 +31,7 @@
 #include <sound/compress_params.h>
 
 
-#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 2, 0)
+#define SNDRV_COMPRESS_VERSION SNDRV_PROTOCOL_VERSION(0, 3, 0)
 /**
  * struct snd_compressed_buffer - compressed buffer
  * @fragment_size: size of buffer fragment in bytes
@@ -144,6 +144,27 @@ struct snd_compr_metadata {
 	 __u32 value[8];
 } __attribute__((packed, aligned(4)));
 
+/**
+ * struct snd_compr_dmabuf - dma-buf to use as the ring buffer
+ * @fd: dma-buf file descriptor
+ * @reserved: must be 0
+ */
+struct snd_compr_dmabuf {
+	__s32 fd;
+	__u32 reserved;
+} __attribute__((packed, aligned(4)));
+
+/**
+ * struct snd_compr_dmabuf_commit - data written to the attached dma-buf
+ * @bytes: number of bytes written after the data of the previous commit
+ * @fence_fd: sync_file signaled once the data is written, or -1 if it is
+ * written already
+ */
+struct snd_compr_dmabuf_commit {
+	__u32 bytes;
+	__s32 fence_fd;
+} __attribute__((packed, aligned(4)));
+
 /*
  * compress path ioctl definitions
  * SNDRV_COMPRESS_GET_CAPS: Query capability of DSP
@@ -161,6 +182,11 @@ struct snd_compr_metadata {
  * and the buffers currently with DSP
  * SNDRV_COMPRESS_DRAIN: Play till end of buffers and stop after that
  * SNDRV_COMPRESS_IOCTL_VERSION: Query the API version
+ * SNDRV_COMPRESS_DMABUF_ATTACH: Use a dma-buf as the ring buffer of a playback
+ * stream, must be called before SNDRV_COMPRESS_SET_PARAMS
+ * SNDRV_COMPRESS_DMABUF_COMMIT: Hand data written to the dma-buf to the DSP,
+ * replaces write(). Data with a fence is handed over once the fence signals,
+ * in the order of the commits
  */
 #define SNDRV_COMPRESS_IOCTL_VERSION	_IOR('C', 0x00, int)
 #define SNDRV_COMPRESS_GET_CAPS		_IOWR('C', 0x10, struct snd_compr_caps)
@@ -181,6 +207,10 @@ struct snd_compr_metadata {
 #define SNDRV_COMPRESS_DRAIN		_IO('C', 0x34)
 #define SNDRV_COMPRESS_NEXT_TRACK	_IO('C', 0x35)
 #define SNDRV_COMPRESS_PARTIAL_DRAIN	_IO('C', 0x36)
+#define SNDRV_COMPRESS_DMABUF_ATTACH	_IOW('C', 0x40,\
+						 struct snd_compr_dmabuf)
+#define SNDRV_COMPRESS_DMABUF_COMMIT	_IOW('C', 0x41,\
+						 struct snd_compr_dmabuf_commit)
 /*
  * TODO
  * 1. add mmap support
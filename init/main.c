@@ -100,6 +100,7 @@
 #include <linux/kcsan.h>
 #include <linux/init_syscalls.h>
 #include <linux/stackdepot.h>
+#include <linux/boot_trace.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -1203,14 +1204,17 @@ int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
 	char msgbuf[64];
+	u64 start;
 	int ret;
 
 	if (initcall_blacklisted(fn))
 		return -EPERM;
 
+	start = boot_trace_start();
 	do_trace_initcall_start(fn);
 	ret = fn();
 	do_trace_initcall_finish(fn, ret);
+	boot_trace_end_fn(BOOT_TRACE_INITCALL, start, fn);
 
 	msgbuf[0] = 0;
 
@@ -1281,6 +1285,7 @@ static void __init do_initcall_level(int level, char *command_line)
 		   NULL, ignore_unknown_bootoption);
 
 	trace_initcall_level(initcall_level_names[level]);
+	boot_trace_mark(initcall_level_names[level]);
 	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
 		do_one_initcall(initcall_from_entry(fn));
 }
@@ -1326,6 +1331,7 @@ static void __init do_pre_smp_initcalls(void)
 	initcall_entry_t *fn;
 
 	trace_initcall_level("early");
+	boot_trace_mark("early");
 	for (fn = __initcall_start; fn < __initcall0_start; fn++)
 		do_one_initcall(initcall_from_entry(fn));
 }
@@ -1423,6 +1429,7 @@ static int __ref kernel_init(void *unused)
 	pti_finalize();
 
 	system_state = SYSTEM_RUNNING;
+	boot_trace_mark("running");
 	numa_default_policy();
 
 	rcu_end_inkernel_boot();
@@ -1514,6 +1521,7 @@ static noinline void __init kernel_init_freeable(void)
 
 	smp_init();
 	sched_init_smp();
+	workqueue_init_topology();
 
 	padata_init();
 	page_alloc_init_late();
@@ -46,6 +46,7 @@ asynchronous and synchronous parts of the kernel.
 
 #include <linux/async.h>
 #include <linux/atomic.h>
+#include <linux/boot_trace.h>
 #include <linux/ktime.h>
 #include <linux/export.h>
 #include <linux/wait.h>
@@ -112,6 +113,7 @@ static void async_run_entry_fn(struct work_struct *work)
 		container_of(work, struct async_entry, work);
 	unsigned long flags;
 	ktime_t calltime, delta, rettime;
+	u64 start = boot_trace_start();
 
 	/* 1) run (and print duration) */
 	if (initcall_debug && system_state < SYSTEM_RUNNING) {
@@ -129,6 +131,7 @@ static void async_run_entry_fn(struct work_struct *work)
 			entry->func,
 			(long long)ktime_to_ns(delta) >> 10);
 	}
+	boot_trace_end_fn(BOOT_TRACE_ASYNC, start, entry->func);
 
 	/* 2) remove self from the pending queues */
 	spin_lock_irqsave(&async_lock, flags);
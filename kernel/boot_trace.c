@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Built-in boot tracer
+ *
+ * Finding where boot time goes usually takes initcall_debug or a full ftrace
+ * session, which are too heavy to leave on for every boot. This records
+ * initcalls, async work, driver probes, module loads and mounts into a fixed
+ * buffer from the first initcall on, until the buffer is full or recording
+ * is switched off, at the cost of a clock read and a few stores per event.
+ *
+ * /sys/kernel/debug/boot_trace/trace.json exports the events in the Chrome
+ * JSON trace event format, which Perfetto and chrome://tracing open as is.
+ * Timestamps are on the CLOCK_MONOTONIC time line and events are grouped by
+ * the task that ran them, so nested events such as probes from an initcall
+ * show up as such.
+ */
+
+#include <linux/atomic.h>
+#include <linux/boot_trace.h>
+#include <linux/ctype.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kallsyms.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+
+struct boot_trace_event {
+	u64	ts;
+	u64	dur;
+	void	*fn;
+	pid_t	pid;
+	u8	cat;
+	bool	valid;
+	char	name[BOOT_TRACE_NAME_LEN];
+};
+
+static struct boot_trace_event boot_trace_buf[CONFIG_BOOT_TRACE_ENTRIES];
+static atomic_t boot_trace_next = ATOMIC_INIT(0);
+static atomic_t boot_trace_dropped = ATOMIC_INIT(0);
+
+bool boot_trace_enabled __read_mostly = true;
+
+static const char * const boot_trace_cat_names[] = {
+	[BOOT_TRACE_INITCALL]	= "initcall",
+	[BOOT_TRACE_ASYNC]	= "async",
+	[BOOT_TRACE_PROBE]	= "probe",
+	[BOOT_TRACE_MODULE]	= "module",
+	[BOOT_TRACE_MOUNT]	= "mount",
+	[BOOT_TRACE_MARK]	= "mark",
+};
+static_assert(ARRAY_SIZE(boot_trace_cat_names) == BOOT_TRACE_NR_CATS);
+
+static int __init boot_trace_setup(char *str)
+{
+	if (kstrtobool(str, &boot_trace_enabled))
+		return 0;
+	return 1;
+}
+__setup("boot_trace=", boot_trace_setup);
+
+u64 boot_trace_clock(void)
+{
+	return ktime_get_mono_fast_ns();
+}
+
+void __boot_trace_event(enum boot_trace_cat cat, u64 start, const char *name,
+			void *fn)
+{
+	u64 now = boot_trace_clock();
+	struct boot_trace_event *ev;
+	unsigned int idx;
+	char *p;
+
+	if (!READ_ONCE(boot_trace_enabled))
+		return;
+
+	idx = atomic_inc_return(&boot_trace_next) - 1;
+	if (idx >= ARRAY_SIZE(boot_trace_buf)) {
+		WRITE_ONCE(boot_trace_enabled, false);
+		atomic_inc(&boot_trace_dropped);
+		return;
+	}
+
+	ev = &boot_trace_buf[idx];
+	ev->ts = start ?: now;
+	ev->dur = start ? now - start : 0;
+	ev->pid = task_pid_nr(current);
+	ev->cat = cat;
+
+	/* module init code and its symbols are gone by the time we dump */
+	if (fn && !core_kernel_text((unsigned long)fn)) {
+		snprintf(ev->name, sizeof(ev->name), "%ps", fn);
+		fn = NULL;
+	} else if (name) {
+		strscpy(ev->name, name, sizeof(ev->name));
+	}
+	ev->fn = fn;
+
+	/* keep the JSON valid whatever the names contain */
+	for (p = ev->name; *p; p++)
+		if (*p == '"' || *p == '\\' || !isprint(*p))
+			*p = '_';
+
+	smp_store_release(&ev->valid, true);
+}
+
+/* Chrome traces count in microseconds */
+static void boot_trace_put_us(struct seq_file *m, const char *key, u64 ns)
+{
+	u32 rem;
+	u64 us = div_u64_rem(ns, NSEC_PER_USEC, &rem);
+
+	seq_printf(m, ",\"%s\":%llu.%03u", key, us, rem);
+}
+
+/*
+ * Position 0 is the header, 1 to count the events and count + 1 the
+ * trailer, which also closes the array without a trailing comma. The
+ * count is taken at open, events recorded while reading come next time.
+ */
+static void *boot_trace_seq_start(struct seq_file *m, loff_t *pos)
+{
+	unsigned long count = (unsigned long)m->private;
+
+	if (*pos > count + 1)
+		return NULL;
+	return (void *)(unsigned long)(*pos + 1);
+}
+
+static void *boot_trace_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return boot_trace_seq_start(m, pos);
+}
+
+static void boot_trace_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int boot_trace_seq_show(struct seq_file *m, void *v)
+{
+	unsigned long count = (unsigned long)m->private;
+	unsigned long idx = (unsigned long)v - 1;
+	struct boot_trace_event *ev;
+
+	if (idx == 0) {
+		seq_puts(m, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		return 0;
+	}
+	if (idx > count) {
+		seq_puts(m, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+			    "\"args\":{\"name\":\"kernel boot\"}}\n]}\n");
+		return 0;
+	}
+
+	ev = &boot_trace_buf[idx - 1];
+	if (!smp_load_acquire(&ev->valid))
+		return 0;
+
+	if (ev->fn)
+		seq_printf(m, "{\"name\":\"%ps\"", ev->fn);
+	else
+		seq_printf(m, "{\"name\":\"%s\"", ev->name);
+	seq_printf(m, ",\"cat\":\"%s\"", boot_trace_cat_names[ev->cat]);
+	boot_trace_put_us(m, "ts", ev->ts);
+	if (ev->cat == BOOT_TRACE_MARK) {
+		seq_puts(m, ",\"ph\":\"i\",\"s\":\"g\"");
+	} else {
+		seq_puts(m, ",\"ph\":\"X\"");
+		boot_trace_put_us(m, "dur", ev->dur);
+	}
+	seq_printf(m, ",\"pid\":0,\"tid\":%d},\n", ev->pid);
+	return 0;
+}
+
+static const struct seq_operations boot_trace_seq_ops = {
+	.start	= boot_trace_seq_start,
+	.next	= boot_trace_seq_next,
+	.stop	= boot_trace_seq_stop,
+	.show	= boot_trace_seq_show,
+};
+
+static int boot_trace_open(struct inode *inode, struct file *file)
+{
+	unsigned int count = min_t(unsigned int, atomic_read(&boot_trace_next),
+				   ARRAY_SIZE(boot_trace_buf));
+	int ret;
+
+	ret = seq_open(file, &boot_trace_seq_ops);
+	if (ret)
+		return ret;
+	((struct seq_file *)file->private_data)->private =
+		(void *)(unsigned long)count;
+	return 0;
+}
+
+static const struct file_operations boot_trace_fops = {
+	.open		= boot_trace_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int __init boot_trace_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("boot_trace", NULL);
+
+	debugfs_create_file("trace.json", 0400, dir, NULL, &boot_trace_fops);
+	debugfs_create_bool("enable", 0600, dir, &boot_trace_enabled);
+	debugfs_create_atomic_t("dropped", 0400, dir, &boot_trace_dropped);
+	return 0;
+}
+late_initcall(boot_trace_debugfs_init);
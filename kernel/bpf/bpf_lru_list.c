@@ -9,6 +9,13 @@
 
 #define LOCAL_FREE_TARGET		(128)
 #define LOCAL_NR_SCANS			LOCAL_FREE_TARGET
+/* Free nodes a CPU keeps before giving a batch back to the global list */
+#define LOCAL_FREE_HIGH			(2 * LOCAL_FREE_TARGET)
+/* Free nodes taken at once from the local list of another CPU */
+#define LOCAL_STEAL_BATCH		(16)
+
+/* Nodes sampled by the CLOCK hand of the approximate LRU */
+#define APPROX_NR_SCANS			(16)
 
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
@@ -300,6 +307,7 @@ static void __local_list_flush(struct bpf_lru_list *l,
 			__bpf_lru_node_move_in(l, node,
 					       BPF_LRU_LIST_T_INACTIVE);
 	}
+	loc_l->nr_pending = 0;
 }
 
 static void bpf_lru_list_push_free(struct bpf_lru_list *l,
@@ -326,8 +334,6 @@ static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 
 	__local_list_flush(l, loc_l);
 
-	__bpf_lru_list_rotate(lru, l);
-
 	list_for_each_entry_safe(node, tmp_node, &l->lists[BPF_LRU_LIST_T_FREE],
 				 list) {
 		__bpf_lru_node_move_to_free(l, node, local_free_list(loc_l),
@@ -336,12 +342,47 @@ static void bpf_lru_list_pop_free_to_local(struct bpf_lru *lru,
 			break;
 	}
 
-	if (nfree < LOCAL_FREE_TARGET)
-		__bpf_lru_list_shrink(lru, l, LOCAL_FREE_TARGET - nfree,
-				      local_free_list(loc_l),
-				      BPF_LRU_LOCAL_LIST_T_FREE);
+	/* Only age the lists when nodes have to be evicted.  Refilling
+	 * from the free list does not need it, and the rotation is most
+	 * of the time spent under the global lock otherwise.
+	 */
+	if (nfree < LOCAL_FREE_TARGET) {
+		__bpf_lru_list_rotate(lru, l);
+		nfree += __bpf_lru_list_shrink(lru, l,
+					       LOCAL_FREE_TARGET - nfree,
+					       local_free_list(loc_l),
+					       BPF_LRU_LOCAL_LIST_T_FREE);
+	}
 
 	raw_spin_unlock(&l->lock);
+
+	loc_l->nr_free += nfree;
+}
+
+/* Give LOCAL_FREE_TARGET of the oldest local free nodes back to the
+ * global free list under a single acquisition of the global lock, so
+ * that a CPU deleting a lot does not hoard free nodes while the others
+ * evict.
+ */
+static void __local_list_free_to_global(struct bpf_lru_list *l,
+					struct bpf_lru_locallist *loc_l)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	unsigned int nfree = 0;
+
+	raw_spin_lock(&l->lock);
+
+	list_for_each_entry_safe_reverse(node, tmp_node, local_free_list(loc_l),
+					 list) {
+		node->type = BPF_LRU_LIST_T_FREE;
+		list_move(&node->list, &l->lists[BPF_LRU_LIST_T_FREE]);
+		if (++nfree == LOCAL_FREE_TARGET)
+			break;
+	}
+
+	raw_spin_unlock(&l->lock);
+
+	loc_l->nr_free -= nfree;
 }
 
 static void __local_list_add_pending(struct bpf_lru *lru,
@@ -355,6 +396,7 @@ static void __local_list_add_pending(struct bpf_lru *lru,
 	node->type = BPF_LRU_LOCAL_LIST_T_PENDING;
 	node->ref = 0;
 	list_add(&node->list, local_pending_list(loc_l));
+	loc_l->nr_pending++;
 }
 
 static struct bpf_lru_node *
@@ -365,12 +407,31 @@ __local_list_pop_free(struct bpf_lru_locallist *loc_l)
 	node = list_first_entry_or_null(local_free_list(loc_l),
 					struct bpf_lru_node,
 					list);
-	if (node)
+	if (node) {
 		list_del(&node->list);
+		loc_l->nr_free--;
+	}
 
 	return node;
 }
 
+/* Move up to LOCAL_STEAL_BATCH free nodes to @stolen */
+static unsigned int __local_list_steal_free(struct bpf_lru_locallist *loc_l,
+					    struct list_head *stolen)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	unsigned int nstolen = 0;
+
+	list_for_each_entry_safe(node, tmp_node, local_free_list(loc_l), list) {
+		list_move(&node->list, stolen);
+		if (++nstolen == LOCAL_STEAL_BATCH)
+			break;
+	}
+	loc_l->nr_free -= nstolen;
+
+	return nstolen;
+}
+
 static struct bpf_lru_node *
 __local_list_pop_pending(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
 {
@@ -384,6 +445,7 @@ ignore_ref:
 		if ((!bpf_lru_node_is_ref(node) || force) &&
 		    lru->del_from_htab(lru->del_arg, node)) {
 			list_del(&node->list);
+			loc_l->nr_pending--;
 			return node;
 		}
 	}
@@ -396,6 +458,42 @@ ignore_ref:
 	return NULL;
 }
 
+/* CLOCK eviction for the approximate LRU.  The pending list of a CPU
+ * holds all the nodes it handed out, newest first.  Sample up to
+ * nr_scans nodes from its tail: a referenced node gets its ref bit
+ * cleared and a second chance at the head, the first unreferenced one
+ * is evicted.  If all the sampled nodes were referenced, evict the
+ * oldest node regardless.
+ */
+static struct bpf_lru_node *
+__local_list_evict(struct bpf_lru *lru, struct bpf_lru_locallist *loc_l)
+{
+	struct list_head *pending = local_pending_list(loc_l);
+	struct bpf_lru_node *node;
+	unsigned int i;
+
+	for (i = 0; i < lru->nr_scans && !list_empty(pending); i++) {
+		node = list_last_entry(pending, struct bpf_lru_node, list);
+		if (!bpf_lru_node_is_ref(node) &&
+		    lru->del_from_htab(lru->del_arg, node))
+			goto evict;
+		node->ref = 0;
+		list_move(&node->list, pending);
+	}
+
+	list_for_each_entry_reverse(node, pending, list) {
+		if (lru->del_from_htab(lru->del_arg, node))
+			goto evict;
+	}
+
+	return NULL;
+
+evict:
+	list_del(&node->list);
+	loc_l->nr_pending--;
+	return node;
+}
+
 static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 						    u32 hash)
 {
@@ -428,13 +526,66 @@ static struct bpf_lru_node *bpf_percpu_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+/* Steal from the local free list of the current CPU and remote CPUs in
+ * RR, starting with the loc_l->next_steal CPU, and from their pending
+ * lists too if @pending.  Free nodes are taken LOCAL_STEAL_BATCH at a
+ * time, the ones not used right away go to the local free list.
+ */
+static struct bpf_lru_node *bpf_common_lru_steal(struct bpf_lru *lru,
+						 struct bpf_lru_locallist *loc_l,
+						 int cpu, u32 hash, bool pending)
+{
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_locallist *steal_loc_l;
+	struct bpf_lru_node *node = NULL;
+	unsigned int nstolen = 0;
+	int steal, first_steal;
+	unsigned long flags;
+	LIST_HEAD(stolen);
+
+	first_steal = loc_l->next_steal;
+	steal = first_steal;
+	do {
+		steal_loc_l = per_cpu_ptr(clru->local_list, steal);
+
+		/* Racy, only saves taking the lock of an empty free list */
+		if (pending || READ_ONCE(steal_loc_l->nr_free)) {
+			raw_spin_lock_irqsave(&steal_loc_l->lock, flags);
+
+			nstolen = __local_list_steal_free(steal_loc_l, &stolen);
+			if (!nstolen && pending)
+				node = __local_list_pop_pending(lru,
+								steal_loc_l);
+
+			raw_spin_unlock_irqrestore(&steal_loc_l->lock, flags);
+		}
+
+		steal = get_next_cpu(steal);
+	} while (!node && !nstolen && steal != first_steal);
+
+	loc_l->next_steal = steal;
+
+	if (!node && !nstolen)
+		return NULL;
+
+	raw_spin_lock_irqsave(&loc_l->lock, flags);
+	if (nstolen) {
+		list_splice(&stolen, local_free_list(loc_l));
+		loc_l->nr_free += nstolen;
+		node = __local_list_pop_free(loc_l);
+	}
+	__local_list_add_pending(lru, loc_l, cpu, node, hash);
+	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
+
+	return node;
+}
+
 static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 						    u32 hash)
 {
-	struct bpf_lru_locallist *loc_l, *steal_loc_l;
+	struct bpf_lru_locallist *loc_l;
 	struct bpf_common_lru *clru = &lru->common_lru;
 	struct bpf_lru_node *node;
-	int steal, first_steal;
 	unsigned long flags;
 	int cpu = raw_smp_processor_id();
 
@@ -458,35 +609,46 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 
 	/* No free nodes found from the local free list and
 	 * the global LRU list.
-	 *
-	 * Steal from the local free/pending list of the
-	 * current CPU and remote CPU in RR.  It starts
-	 * with the loc_l->next_steal CPU.
 	 */
+	return bpf_common_lru_steal(lru, loc_l, cpu, hash, true);
+}
 
-	first_steal = loc_l->next_steal;
-	steal = first_steal;
-	do {
-		steal_loc_l = per_cpu_ptr(clru->local_list, steal);
-
-		raw_spin_lock_irqsave(&steal_loc_l->lock, flags);
+/* The approximate LRU never touches the global list.  A CPU takes free
+ * nodes from its own local free list, then from the ones of the other
+ * CPUs.  Once none are left, it evicts one of its own nodes if it holds
+ * at least its share of the map, else the oldest node of another CPU.
+ */
+static struct bpf_lru_node *bpf_approx_lru_pop_free(struct bpf_lru *lru,
+						    u32 hash)
+{
+	struct bpf_lru_locallist *loc_l;
+	struct bpf_common_lru *clru = &lru->common_lru;
+	struct bpf_lru_node *node;
+	unsigned long flags;
+	int cpu = raw_smp_processor_id();
 
-		node = __local_list_pop_free(steal_loc_l);
-		if (!node)
-			node = __local_list_pop_pending(lru, steal_loc_l);
+	loc_l = per_cpu_ptr(clru->local_list, cpu);
 
-		raw_spin_unlock_irqrestore(&steal_loc_l->lock, flags);
+	raw_spin_lock_irqsave(&loc_l->lock, flags);
+	node = __local_list_pop_free(loc_l);
+	if (node)
+		__local_list_add_pending(lru, loc_l, cpu, node, hash);
+	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 
-		steal = get_next_cpu(steal);
-	} while (!node && steal != first_steal);
+	if (node)
+		return node;
 
-	loc_l->next_steal = steal;
+	node = bpf_common_lru_steal(lru, loc_l, cpu, hash, false);
+	if (!node && READ_ONCE(loc_l->nr_pending) < lru->local_share)
+		node = bpf_common_lru_steal(lru, loc_l, cpu, hash, true);
+	if (node)
+		return node;
 
-	if (node) {
-		raw_spin_lock_irqsave(&loc_l->lock, flags);
+	raw_spin_lock_irqsave(&loc_l->lock, flags);
+	node = __local_list_evict(lru, loc_l);
+	if (node)
 		__local_list_add_pending(lru, loc_l, cpu, node, hash);
-		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
-	}
+	raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 
 	return node;
 }
@@ -495,6 +657,8 @@ struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
 	if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
+	else if (lru->approx)
+		return bpf_approx_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
 }
@@ -524,6 +688,11 @@ static void bpf_common_lru_push_free(struct bpf_lru *lru,
 		node->type = BPF_LRU_LOCAL_LIST_T_FREE;
 		node->ref = 0;
 		list_move(&node->list, local_free_list(loc_l));
+		loc_l->nr_pending--;
+
+		if (++loc_l->nr_free > LOCAL_FREE_HIGH && !lru->approx)
+			__local_list_free_to_global(&lru->common_lru.lru_list,
+						    loc_l);
 
 		raw_spin_unlock_irqrestore(&loc_l->lock, flags);
 		return;
@@ -605,12 +774,42 @@ again:
 	}
 }
 
+/* The approximate LRU has no global free list, spread the nodes over
+ * the local free lists instead.
+ */
+static void bpf_approx_lru_populate(struct bpf_lru *lru, void *buf,
+				    u32 node_offset, u32 elem_size,
+				    u32 nr_elems)
+{
+	struct bpf_lru_locallist *loc_l;
+	int cpu = cpumask_first(cpu_possible_mask);
+	u32 i;
+
+	lru->local_share = max_t(u32, nr_elems / num_possible_cpus(), 1);
+
+	for (i = 0; i < nr_elems; i++) {
+		struct bpf_lru_node *node;
+
+		loc_l = per_cpu_ptr(lru->common_lru.local_list, cpu);
+		node = (struct bpf_lru_node *)(buf + node_offset);
+		node->type = BPF_LRU_LOCAL_LIST_T_FREE;
+		node->ref = 0;
+		list_add(&node->list, local_free_list(loc_l));
+		loc_l->nr_free++;
+		buf += elem_size;
+		cpu = get_next_cpu(cpu);
+	}
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
 	if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
+	else if (lru->approx)
+		bpf_approx_lru_populate(lru, buf, node_offset, elem_size,
+					nr_elems);
 	else
 		bpf_common_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
@@ -624,6 +823,8 @@ static void bpf_lru_locallist_init(struct bpf_lru_locallist *loc_l, int cpu)
 		INIT_LIST_HEAD(&loc_l->lists[i]);
 
 	loc_l->next_steal = cpu;
+	loc_l->nr_free = 0;
+	loc_l->nr_pending = 0;
 
 	raw_spin_lock_init(&loc_l->lock);
 }
@@ -643,8 +844,9 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *del_arg)
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool approx,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *del_arg)
 {
 	int cpu;
 
@@ -675,10 +877,11 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 		}
 
 		bpf_lru_list_init(&clru->lru_list);
-		lru->nr_scans = LOCAL_NR_SCANS;
+		lru->nr_scans = approx ? APPROX_NR_SCANS : LOCAL_NR_SCANS;
 	}
 
 	lru->percpu = percpu;
+	lru->approx = approx;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
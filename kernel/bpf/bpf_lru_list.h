@@ -38,6 +38,8 @@ struct bpf_lru_list {
 
 struct bpf_lru_locallist {
 	struct list_head lists[NR_BPF_LRU_LOCAL_LIST_T];
+	unsigned int nr_free;
+	unsigned int nr_pending;
 	u16 next_steal;
 	raw_spinlock_t lock;
 };
@@ -58,7 +60,10 @@ struct bpf_lru {
 	void *del_arg;
 	unsigned int hash_offset;
 	unsigned int nr_scans;
+	/* approx: nodes a CPU may hold before recycling its own */
+	unsigned int local_share;
 	bool percpu;
+	bool approx;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -70,8 +75,9 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		node->ref = 1;
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
-		 del_from_htab_func del_from_htab, void *delete_arg);
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool approx,
+		 u32 hash_offset, del_from_htab_func del_from_htab,
+		 void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
 void bpf_lru_destroy(struct bpf_lru *lru);
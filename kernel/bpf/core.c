@@ -2296,6 +2296,7 @@ int __weak bpf_arch_text_poke(void *ip, enum bpf_text_poke_type t,
 
 DEFINE_STATIC_KEY_FALSE(bpf_stats_enabled_key);
 EXPORT_SYMBOL(bpf_stats_enabled_key);
+int sysctl_bpf_stats_sample_rate __read_mostly = 1;
 
 /* All definitions of tracepoints related to BPF. */
 #undef TRACE_INCLUDE_PATH
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Resizable hash map on top of lib/rhashtable.c.
+ *
+ * BPF_MAP_TYPE_HASH either preallocates max_entries elements up front or
+ * sizes its bucket array for max_entries, both of which cost a lot of memory
+ * for flow and connection tables that are usually far from full. Here the
+ * bucket table starts small and is grown and shrunk by rhashtable's deferred
+ * worker as elements come and go, elements are allocated on update and freed
+ * after an RCU grace period, and max_entries is only an upper bound on the
+ * number of elements.
+ *
+ * Lookups are lockless and work from any context. Updates and deletes take
+ * rhashtable's bucket locks, which disable softirqs, so they fail with
+ * -EBUSY in hardirq and NMI context, with interrupts disabled, and when a
+ * program attached inside an update of the same map on this CPU tries to
+ * update it again.
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/percpu.h>
+#include <linux/rhashtable.h>
+#include <linux/slab.h>
+#include <uapi/linux/btf.h>
+
+#define RHTAB_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK)
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhashtable ht;
+	struct rhashtable_params params;
+	atomic_t count;
+	int __percpu *busy;
+	u32 elem_size;
+};
+
+struct rhtab_elem {
+	struct rhash_head node;
+	struct rcu_head rcu;
+	char key[] __aligned(8);
+};
+
+static void *rhtab_elem_value(struct bpf_rhtab *htab, struct rhtab_elem *l)
+{
+	return l->key + round_up(htab->map.key_size, 8);
+}
+
+/* Serialize against a program updating the map from inside an update */
+static bool rhtab_lock(struct bpf_rhtab *htab)
+{
+	if (in_irq() || in_nmi() || irqs_disabled())
+		return false;
+
+	preempt_disable();
+	if (unlikely(__this_cpu_inc_return(*htab->busy) != 1)) {
+		__this_cpu_dec(*htab->busy);
+		preempt_enable();
+		return false;
+	}
+	return true;
+}
+
+static void rhtab_unlock(struct bpf_rhtab *htab)
+{
+	__this_cpu_dec(*htab->busy);
+	preempt_enable();
+}
+
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags))
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > MAX_BPF_STACK)
+		/* eBPF programs initialize keys on stack, so they cannot be
+		 * larger than max stack size
+		 */
+		return -E2BIG;
+
+	if (attr->value_size >= KMALLOC_MAX_SIZE -
+	    MAX_BPF_STACK - sizeof(struct rhtab_elem))
+		/* same limit as BPF_MAP_TYPE_HASH, so that the value can be
+		 * accessed through the bpf syscall and elements stay
+		 * kmalloc-able
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_rhtab *htab;
+	u64 cost;
+	int err;
+
+	htab = kzalloc(sizeof(*htab), GFP_USER);
+	if (!htab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&htab->map, attr);
+
+	htab->elem_size = sizeof(struct rhtab_elem) +
+			  round_up(htab->map.key_size, 8) +
+			  round_up(htab->map.value_size, 8);
+
+	/* charge the map as if it was full, like BPF_MAP_TYPE_HASH does
+	 * without preallocation, only the memory used is allocated
+	 */
+	cost = sizeof(*htab) + (u64)htab->map.max_entries *
+	       (htab->elem_size + 2 * sizeof(struct rhash_head *));
+	err = bpf_map_charge_init(&htab->map.memory, cost);
+	if (err)
+		goto free_htab;
+
+	err = -ENOMEM;
+	htab->busy = alloc_percpu_gfp(int, GFP_USER);
+	if (!htab->busy)
+		goto free_charge;
+
+	htab->params = (struct rhashtable_params) {
+		.key_len = htab->map.key_size,
+		.key_offset = offsetof(struct rhtab_elem, key),
+		.head_offset = offsetof(struct rhtab_elem, node),
+		.automatic_shrinking = true,
+	};
+	err = rhashtable_init(&htab->ht, &htab->params);
+	if (err)
+		goto free_busy;
+
+	return &htab->map;
+
+free_busy:
+	free_percpu(htab->busy);
+free_charge:
+	bpf_map_charge_finish(&htab->map.memory);
+free_htab:
+	kfree(htab);
+	return ERR_PTR(err);
+}
+
+static void rhtab_elem_free(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *htab = container_of(map, struct bpf_rhtab, map);
+
+	/* Elements deleted before are freed by kfree_rcu(), the rest is
+	 * only reachable from the table.
+	 */
+	rhashtable_free_and_destroy(&htab->ht, rhtab_elem_free, NULL);
+	free_percpu(htab->busy);
+	kfree(htab);
+}
+
+/* Called from syscall or from eBPF program */
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *htab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+
+	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_bh_held());
+
+	l = rhashtable_lookup(&htab->ht, key, htab->params);
+	return l ? rhtab_elem_value(htab, l) : NULL;
+}
+
+static struct rhtab_elem *rhtab_elem_alloc(struct bpf_rhtab *htab, void *key,
+					   void *value)
+{
+	struct rhtab_elem *l;
+
+	l = kmalloc_node(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN,
+			 htab->map.numa_node);
+	if (!l)
+		return NULL;
+
+	memcpy(l->key, key, htab->map.key_size);
+	copy_map_value(&htab->map, rhtab_elem_value(htab, l), value);
+	return l;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *htab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l_new, *l_old;
+	int ret;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_bh_held());
+
+	if (!rhtab_lock(htab))
+		return -EBUSY;
+
+	l_new = rhtab_elem_alloc(htab, key, value);
+	if (!l_new) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+again:
+	l_old = rhashtable_lookup(&htab->ht, key, htab->params);
+	if (l_old) {
+		if (map_flags == BPF_NOEXIST) {
+			ret = -EEXIST;
+			goto out_free;
+		}
+		ret = rhashtable_replace_fast(&htab->ht, &l_old->node,
+					      &l_new->node, htab->params);
+		/* deleted under us, insert instead */
+		if (ret == -ENOENT && map_flags == BPF_ANY)
+			goto again;
+		if (ret)
+			goto out_free;
+		kfree_rcu(l_old, rcu);
+		goto out;
+	}
+
+	if (map_flags == BPF_EXIST) {
+		ret = -ENOENT;
+		goto out_free;
+	}
+
+	if (atomic_inc_return(&htab->count) > map->max_entries) {
+		atomic_dec(&htab->count);
+		ret = -E2BIG;
+		goto out_free;
+	}
+
+	ret = rhashtable_lookup_insert_fast(&htab->ht, &l_new->node,
+					    htab->params);
+	if (ret) {
+		atomic_dec(&htab->count);
+		/* inserted under us, replace it instead */
+		if (ret == -EEXIST && map_flags == BPF_ANY)
+			goto again;
+		goto out_free;
+	}
+	goto out;
+
+out_free:
+	kfree(l_new);
+out:
+	rhtab_unlock(htab);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *htab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+	int ret = -ENOENT;
+
+	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_bh_held());
+
+	if (!rhtab_lock(htab))
+		return -EBUSY;
+
+	/* retry if the element was replaced under us */
+	while ((l = rhashtable_lookup(&htab->ht, key, htab->params))) {
+		if (!rhashtable_remove_fast(&htab->ht, &l->node, htab->params)) {
+			atomic_dec(&htab->count);
+			kfree_rcu(l, rcu);
+			ret = 0;
+			break;
+		}
+	}
+
+	rhtab_unlock(htab);
+	return ret;
+}
+
+/* Called from syscall. Walks the buckets of the current table, starting at
+ * the one of @key. While the table is being resized, elements may be
+ * missed or returned twice, as with BPF_MAP_TYPE_HASH under concurrent
+ * updates.
+ */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *htab = container_of(map, struct bpf_rhtab, map);
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	struct rhtab_elem *l;
+	unsigned int hash = 0;
+	bool found = !key;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	tbl = rht_dereference_rcu(htab->ht.tbl, &htab->ht);
+	if (key)
+		hash = rht_key_hashfn(&htab->ht, tbl, key, htab->params);
+
+	for (; hash < tbl->size; hash++) {
+		rht_for_each_entry_rcu(l, pos, tbl, hash, node) {
+			if (found) {
+				memcpy(next_key, l->key, map->key_size);
+				return 0;
+			}
+			if (!memcmp(l->key, key, map->key_size))
+				found = true;
+		}
+		/* a key deleted meanwhile continues with the next bucket */
+		found = true;
+	}
+
+	return -ENOENT;
+}
+
+static void rhtab_map_seq_show_elem(struct bpf_map *map, void *key,
+				    struct seq_file *m)
+{
+	void *value;
+
+	rcu_read_lock();
+
+	value = rhtab_map_lookup_elem(map, key);
+	if (!value) {
+		rcu_read_unlock();
+		return;
+	}
+
+	btf_type_seq_show(map->btf, map->btf_key_type_id, key, m);
+	seq_puts(m, ": ");
+	btf_type_seq_show(map->btf, map->btf_value_type_id, value, m);
+	seq_puts(m, "\n");
+
+	rcu_read_unlock();
+}
+
+static int rhtab_map_btf_id;
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_seq_show_elem = rhtab_map_seq_show_elem,
+	.map_btf_name = "bpf_rhtab",
+	.map_btf_id = &rhtab_map_btf_id,
+};
@@ -1,6 +1,7 @@
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
 #include <linux/irq_work.h>
 #include <linux/slab.h>
 #include <linux/filter.h>
@@ -29,12 +30,22 @@
 #define RINGBUF_MAX_DATA_SZ \
 	(((1ULL << 24) - RINGBUF_POS_PAGES - RINGBUF_PGOFF) * PAGE_SIZE)
 
+/* longest a batched wakeup may be delayed */
+#define RINGBUF_MAX_WAKEUP_US USEC_PER_SEC
+
 struct bpf_ringbuf {
 	wait_queue_head_t waitq;
+	wait_queue_head_t *wq;	/* &waitq, or the per-CPU map's one */
 	struct irq_work work;
+	struct irq_work timer_work;
+	struct hrtimer timer;
 	u64 mask;
 	struct page **pages;
 	int nr_pages;
+	/* wakeup batching, see bpf_ringbuf_batch_wakeup() */
+	u32 wakeup_bytes;
+	u32 wakeup_us;
+	unsigned long wakeup_pos;
 	spinlock_t spinlock ____cacheline_aligned_in_smp;
 	/* Consumer and producer counters are put into separate pages to allow
 	 * mapping consumer page as r/w, but restrict producer page to r/o.
@@ -52,6 +63,17 @@ struct bpf_ringbuf_map {
 	struct bpf_ringbuf *rb;
 };
 
+/* One ring per possible CPU, all reporting to the same wait queue so that a
+ * single map fd can be polled for all of them. In the mmap() offset space,
+ * the consumer, producer and data pages of each CPU's ring follow the ones
+ * of the previous CPU, see ringbuf_percpu_span().
+ */
+struct bpf_ringbuf_percpu_map {
+	struct bpf_map map;
+	wait_queue_head_t waitq;
+	struct bpf_ringbuf *rbs[];
+};
+
 /* 8-byte ring buffer record header structure */
 struct bpf_ringbuf_hdr {
 	u32 len;
@@ -125,10 +147,33 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 {
 	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf, work);
 
-	wake_up_all(&rb->waitq);
+	if (rb->wakeup_us)
+		hrtimer_try_to_cancel(&rb->timer);
+	wake_up_all(rb->wq);
 }
 
-static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
+/* Runs on the producing CPU, as hrtimers cannot be started from NMI */
+static void bpf_ringbuf_arm_timer(struct irq_work *work)
+{
+	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf,
+					      timer_work);
+
+	if (!hrtimer_active(&rb->timer))
+		hrtimer_start(&rb->timer, ns_to_ktime(rb->wakeup_us *
+						      NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+static enum hrtimer_restart bpf_ringbuf_timer_fn(struct hrtimer *timer)
+{
+	struct bpf_ringbuf *rb = container_of(timer, struct bpf_ringbuf, timer);
+
+	wake_up_all(rb->wq);
+	return HRTIMER_NORESTART;
+}
+
+static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node,
+					     u64 map_extra)
 {
 	struct bpf_ringbuf *rb;
 
@@ -138,35 +183,55 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 
 	spin_lock_init(&rb->spinlock);
 	init_waitqueue_head(&rb->waitq);
+	rb->wq = &rb->waitq;
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
+	init_irq_work(&rb->timer_work, bpf_ringbuf_arm_timer);
+	hrtimer_init(&rb->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	rb->timer.function = bpf_ringbuf_timer_fn;
 
 	rb->mask = data_sz - 1;
 	rb->consumer_pos = 0;
 	rb->producer_pos = 0;
+	rb->wakeup_bytes = lower_32_bits(map_extra);
+	rb->wakeup_us = upper_32_bits(map_extra);
 
 	return rb;
 }
 
-static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
+static int ringbuf_map_check_attr(union bpf_attr *attr)
 {
-	struct bpf_ringbuf_map *rb_map;
-	u64 cost;
-	int err;
-
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
 
 	if (attr->key_size || attr->value_size ||
 	    !is_power_of_2(attr->max_entries) ||
 	    !PAGE_ALIGNED(attr->max_entries))
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
 
 #ifdef CONFIG_64BIT
 	/* on 32-bit arch, it's impossible to overflow record's hdr->pgoff */
 	if (attr->max_entries > RINGBUF_MAX_DATA_SZ)
-		return ERR_PTR(-E2BIG);
+		return -E2BIG;
 #endif
 
+	/* map_extra holds the wakeup batching thresholds */
+	if (lower_32_bits(attr->map_extra) > attr->max_entries ||
+	    upper_32_bits(attr->map_extra) > RINGBUF_MAX_WAKEUP_US)
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_ringbuf_map *rb_map;
+	u64 cost;
+	int err;
+
+	err = ringbuf_map_check_attr(attr);
+	if (err)
+		return ERR_PTR(err);
+
 	rb_map = kzalloc(sizeof(*rb_map), GFP_USER);
 	if (!rb_map)
 		return ERR_PTR(-ENOMEM);
@@ -180,7 +245,8 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	if (err)
 		goto err_free_map;
 
-	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
+	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node,
+				       attr->map_extra);
 	if (IS_ERR(rb_map->rb)) {
 		err = PTR_ERR(rb_map->rb);
 		goto err_uncharge;
@@ -203,6 +269,9 @@ static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
 	struct page **pages = rb->pages;
 	int i, nr_pages = rb->nr_pages;
 
+	irq_work_sync(&rb->timer_work);
+	hrtimer_cancel(&rb->timer);
+	irq_work_sync(&rb->work);
 	vunmap(rb);
 	for (i = 0; i < nr_pages; i++)
 		__free_page(pages[i]);
@@ -240,22 +309,26 @@ static int ringbuf_map_get_next_key(struct bpf_map *map, void *key,
 	return -ENOTSUPP;
 }
 
-static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
+static int bpf_ringbuf_mmap(struct bpf_ringbuf *rb, struct vm_area_struct *vma,
+			    unsigned long pgoff)
 {
-	struct bpf_ringbuf_map *rb_map;
-
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-
 	if (vma->vm_flags & VM_WRITE) {
 		/* allow writable mapping for the consumer_pos only */
-		if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		if (pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
 			return -EPERM;
 	} else {
 		vma->vm_flags &= ~VM_MAYWRITE;
 	}
 	/* remap_vmalloc_range() checks size and offset constraints */
-	return remap_vmalloc_range(vma, rb_map->rb,
-				   vma->vm_pgoff + RINGBUF_PGOFF);
+	return remap_vmalloc_range(vma, rb, pgoff + RINGBUF_PGOFF);
+}
+
+static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	return bpf_ringbuf_mmap(rb_map->rb, vma, vma->vm_pgoff);
 }
 
 static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb)
@@ -295,6 +368,134 @@ const struct bpf_map_ops ringbuf_map_ops = {
 	.map_btf_id = &ringbuf_map_btf_id,
 };
 
+/* Pages of the mmap() offset space taken by the ring of each CPU */
+static unsigned long ringbuf_percpu_span(const struct bpf_map *map)
+{
+	return RINGBUF_POS_PAGES + 2 * (map->max_entries >> PAGE_SHIFT);
+}
+
+static void ringbuf_percpu_map_free(struct bpf_map *map)
+{
+	struct bpf_ringbuf_percpu_map *rb_map;
+	int cpu;
+
+	rb_map = container_of(map, struct bpf_ringbuf_percpu_map, map);
+	for_each_possible_cpu(cpu) {
+		if (rb_map->rbs[cpu])
+			bpf_ringbuf_free(rb_map->rbs[cpu]);
+	}
+	kfree(rb_map);
+}
+
+static struct bpf_map *ringbuf_percpu_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_ringbuf_percpu_map *rb_map;
+	u64 cost;
+	int cpu, err;
+
+	err = ringbuf_map_check_attr(attr);
+	if (err)
+		return ERR_PTR(err);
+
+	rb_map = kzalloc(struct_size(rb_map, rbs, nr_cpu_ids), GFP_USER);
+	if (!rb_map)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rb_map->map, attr);
+	init_waitqueue_head(&rb_map->waitq);
+
+	cost = struct_size(rb_map, rbs, nr_cpu_ids) +
+	       (u64)num_possible_cpus() * (sizeof(struct bpf_ringbuf) +
+					   attr->max_entries);
+	err = bpf_map_charge_init(&rb_map->map.memory, cost);
+	if (err)
+		goto err_free_map;
+
+	for_each_possible_cpu(cpu) {
+		int numa_node = rb_map->map.numa_node;
+		struct bpf_ringbuf *rb;
+
+		if (numa_node == NUMA_NO_NODE)
+			numa_node = cpu_to_node(cpu);
+		rb = bpf_ringbuf_alloc(attr->max_entries, numa_node,
+				       attr->map_extra);
+		if (IS_ERR(rb)) {
+			err = PTR_ERR(rb);
+			goto err_uncharge;
+		}
+		rb->wq = &rb_map->waitq;
+		rb_map->rbs[cpu] = rb;
+	}
+
+	return &rb_map->map;
+
+err_uncharge:
+	bpf_map_charge_finish(&rb_map->map.memory);
+	for_each_possible_cpu(cpu) {
+		if (rb_map->rbs[cpu])
+			bpf_ringbuf_free(rb_map->rbs[cpu]);
+	}
+err_free_map:
+	kfree(rb_map);
+	return ERR_PTR(err);
+}
+
+static int ringbuf_percpu_map_mmap(struct bpf_map *map,
+				   struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_percpu_map *rb_map;
+	unsigned long span = ringbuf_percpu_span(map);
+	unsigned long cpu = vma->vm_pgoff / span;
+
+	rb_map = container_of(map, struct bpf_ringbuf_percpu_map, map);
+	if (cpu >= nr_cpu_ids || !rb_map->rbs[cpu])
+		return -ENXIO;
+	return bpf_ringbuf_mmap(rb_map->rbs[cpu], vma, vma->vm_pgoff % span);
+}
+
+static __poll_t ringbuf_percpu_map_poll(struct bpf_map *map, struct file *filp,
+					struct poll_table_struct *pts)
+{
+	struct bpf_ringbuf_percpu_map *rb_map;
+	int cpu;
+
+	rb_map = container_of(map, struct bpf_ringbuf_percpu_map, map);
+	poll_wait(filp, &rb_map->waitq, pts);
+
+	for_each_possible_cpu(cpu) {
+		if (ringbuf_avail_data_sz(rb_map->rbs[cpu]))
+			return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static int ringbuf_percpu_map_btf_id;
+const struct bpf_map_ops ringbuf_percpu_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = ringbuf_percpu_map_alloc,
+	.map_free = ringbuf_percpu_map_free,
+	.map_mmap = ringbuf_percpu_map_mmap,
+	.map_poll = ringbuf_percpu_map_poll,
+	.map_lookup_elem = ringbuf_map_lookup_elem,
+	.map_update_elem = ringbuf_map_update_elem,
+	.map_delete_elem = ringbuf_map_delete_elem,
+	.map_get_next_key = ringbuf_map_get_next_key,
+	.map_btf_name = "bpf_ringbuf_percpu_map",
+	.map_btf_id = &ringbuf_percpu_map_btf_id,
+};
+
+/* The ring the helpers of a BPF program running on this CPU work on. BPF
+ * programs run with migration disabled, and commit finds the ring from the
+ * record anyway.
+ */
+static struct bpf_ringbuf *bpf_ringbuf_from_map(struct bpf_map *map)
+{
+	if (map->map_type == BPF_MAP_TYPE_PERCPU_RINGBUF)
+		return container_of(map, struct bpf_ringbuf_percpu_map,
+				    map)->rbs[smp_processor_id()];
+	return container_of(map, struct bpf_ringbuf_map, map)->rb;
+}
+
 /* Given pointer to ring buffer record metadata and struct bpf_ringbuf itself,
  * calculate offset from record metadata to ring buffer in pages, rounded
  * down. This page offset is stored as part of record metadata and allows to
@@ -367,13 +568,11 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 
 BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
-
 	if (unlikely(flags))
 		return 0;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
+	return (unsigned long)__bpf_ringbuf_reserve(bpf_ringbuf_from_map(map),
+						    size);
 }
 
 const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
@@ -384,6 +583,31 @@ const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
 	.arg3_type	= ARG_ANYTHING,
 };
 
+/*
+ * With batching configured, the consumer is woken up once wakeup_bytes are
+ * pending, at most once per wakeup_bytes produced, or wakeup_us after the
+ * first record it did not see yet, whichever comes first. A ring with only
+ * wakeup_bytes set leaves smaller batches to a consumer polling with a
+ * timeout.
+ */
+static void bpf_ringbuf_batch_wakeup(struct bpf_ringbuf *rb, bool caught_up)
+{
+	unsigned long cons_pos, prod_pos;
+
+	if (rb->wakeup_bytes) {
+		cons_pos = smp_load_acquire(&rb->consumer_pos);
+		prod_pos = smp_load_acquire(&rb->producer_pos);
+		if (prod_pos - cons_pos >= rb->wakeup_bytes &&
+		    prod_pos - READ_ONCE(rb->wakeup_pos) >= rb->wakeup_bytes) {
+			WRITE_ONCE(rb->wakeup_pos, prod_pos);
+			irq_work_queue(&rb->work);
+			return;
+		}
+	}
+	if (rb->wakeup_us && caught_up)
+		irq_work_queue(&rb->timer_work);
+}
+
 static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 {
 	unsigned long rec_pos, cons_pos;
@@ -408,7 +632,11 @@ static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 
 	if (flags & BPF_RB_FORCE_WAKEUP)
 		irq_work_queue(&rb->work);
-	else if (cons_pos == rec_pos && !(flags & BPF_RB_NO_WAKEUP))
+	else if (flags & BPF_RB_NO_WAKEUP)
+		return;
+	else if (rb->wakeup_bytes || rb->wakeup_us)
+		bpf_ringbuf_batch_wakeup(rb, cons_pos == rec_pos);
+	else if (cons_pos == rec_pos)
 		irq_work_queue(&rb->work);
 }
 
@@ -441,14 +669,12 @@ const struct bpf_func_proto bpf_ringbuf_discard_proto = {
 BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 	   u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *rec;
 
 	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
 		return -EINVAL;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
+	rec = __bpf_ringbuf_reserve(bpf_ringbuf_from_map(map), size);
 	if (!rec)
 		return -EAGAIN;
 
@@ -468,9 +694,7 @@ const struct bpf_func_proto bpf_ringbuf_output_proto = {
 
 BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
-	struct bpf_ringbuf *rb;
-
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	struct bpf_ringbuf *rb = bpf_ringbuf_from_map(map);
 
 	switch (flags) {
 	case BPF_RB_AVAIL_DATA:
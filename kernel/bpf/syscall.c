@@ -792,7 +792,7 @@ static int map_check_btf(struct bpf_map *map, const struct btf *btf,
 	return ret;
 }
 
-#define BPF_MAP_CREATE_LAST_FIELD btf_vmlinux_value_type_id
+#define BPF_MAP_CREATE_LAST_FIELD map_extra
 /* called via syscall */
 static int map_create(union bpf_attr *attr)
 {
@@ -814,6 +814,10 @@ static int map_create(union bpf_attr *attr)
 		return -EINVAL;
 	}
 
+	if (attr->map_extra && attr->map_type != BPF_MAP_TYPE_RINGBUF &&
+	    attr->map_type != BPF_MAP_TYPE_PERCPU_RINGBUF)
+		return -EINVAL;
+
 	f_flags = bpf_get_file_flag(attr->map_flags);
 	if (f_flags < 0)
 		return f_flags;
@@ -1773,25 +1777,34 @@ static int bpf_prog_release(struct inode *inode, struct file *filp)
 static void bpf_prog_get_stats(const struct bpf_prog *prog,
 			       struct bpf_prog_stats *stats)
 {
-	u64 nsecs = 0, cnt = 0;
-	int cpu;
+	int cpu, i;
+
+	memset(stats, 0, sizeof(*stats));
 
 	for_each_possible_cpu(cpu) {
 		const struct bpf_prog_stats *st;
+		struct bpf_prog_stats tst;
 		unsigned int start;
-		u64 tnsecs, tcnt;
 
 		st = per_cpu_ptr(prog->aux->stats, cpu);
 		do {
 			start = u64_stats_fetch_begin_irq(&st->syncp);
-			tnsecs = st->nsecs;
-			tcnt = st->cnt;
+			tst.nsecs = st->nsecs;
+			tst.cnt = st->cnt;
+			tst.sampled = st->sampled;
+			memcpy(tst.hist, st->hist, sizeof(tst.hist));
 		} while (u64_stats_fetch_retry_irq(&st->syncp, start));
-		nsecs += tnsecs;
-		cnt += tcnt;
+		stats->nsecs += tst.nsecs;
+		stats->cnt += tst.cnt;
+		stats->sampled += tst.sampled;
+		for (i = 0; i < BPF_PROG_RUN_HIST_LEN; i++)
+			stats->hist[i] += tst.hist[i];
 	}
-	stats->nsecs = nsecs;
-	stats->cnt = cnt;
+
+	/* Extrapolate the run time of all runs from the sampled ones */
+	if (stats->sampled && stats->sampled != stats->cnt)
+		stats->nsecs = mul_u64_u64_div_u64(stats->nsecs, stats->cnt,
+						   stats->sampled);
 }
 
 #ifdef CONFIG_PROC_FS
@@ -1800,6 +1813,7 @@ static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 	const struct bpf_prog *prog = filp->private_data;
 	char prog_tag[sizeof(prog->tag) * 2 + 1] = { };
 	struct bpf_prog_stats stats;
+	int i;
 
 	bpf_prog_get_stats(prog, &stats);
 	bin2hex(prog_tag, prog->tag, sizeof(prog->tag));
@@ -1810,14 +1824,20 @@ static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "memlock:\t%llu\n"
 		   "prog_id:\t%u\n"
 		   "run_time_ns:\t%llu\n"
-		   "run_cnt:\t%llu\n",
+		   "run_cnt:\t%llu\n"
+		   "run_sampled_cnt:\t%llu\n",
 		   prog->type,
 		   prog->jited,
 		   prog_tag,
 		   prog->pages * 1ULL << PAGE_SHIFT,
 		   prog->aux->id,
 		   stats.nsecs,
-		   stats.cnt);
+		   stats.cnt,
+		   stats.sampled);
+	seq_puts(m, "run_time_hist:\t");
+	for (i = 0; i < BPF_PROG_RUN_HIST_LEN; i++)
+		seq_printf(m, "%s%llu", i ? " " : "", stats.hist[i]);
+	seq_putc(m, '\n');
 }
 #endif
 
@@ -2113,7 +2133,12 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 				 BPF_F_ANY_ALIGNMENT |
 				 BPF_F_TEST_STATE_FREQ |
 				 BPF_F_SLEEPABLE |
-				 BPF_F_TEST_RND_HI32))
+				 BPF_F_TEST_RND_HI32 |
+				 BPF_F_XDP_HAS_FRAGS))
+		return -EINVAL;
+
+	if ((attr->prog_flags & BPF_F_XDP_HAS_FRAGS) &&
+	    type != BPF_PROG_TYPE_XDP)
 		return -EINVAL;
 
 	if (!IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) &&
@@ -2169,6 +2194,7 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 
 	prog->aux->offload_requested = !!attr->prog_ifindex;
 	prog->aux->sleepable = attr->prog_flags & BPF_F_SLEEPABLE;
+	prog->aux->xdp_has_frags = attr->prog_flags & BPF_F_XDP_HAS_FRAGS;
 
 	err = security_bpf_prog_alloc(prog->aux);
 	if (err)
@@ -2959,6 +2985,8 @@ attach_type_to_prog_type(enum bpf_attach_type attach_type)
 		return BPF_PROG_TYPE_SK_LOOKUP;
 	case BPF_XDP:
 		return BPF_PROG_TYPE_XDP;
+	case BPF_TRACE_KPROBE_MULTI:
+		return BPF_PROG_TYPE_KPROBE;
 	default:
 		return BPF_PROG_TYPE_UNSPEC;
 	}
@@ -3445,6 +3473,9 @@ static int bpf_prog_get_info_by_fd(struct file *file,
 	bpf_prog_get_stats(prog, &stats);
 	info.run_time_ns = stats.nsecs;
 	info.run_cnt = stats.cnt;
+	info.attach_btf_id = prog->aux->attach_btf_id;
+	info.run_sampled_cnt = stats.sampled;
+	memcpy(info.run_time_hist, stats.hist, sizeof(info.run_time_hist));
 
 	if (!bpf_capable()) {
 		info.jited_prog_len = 0;
@@ -4029,7 +4060,7 @@ static int tracing_bpf_link_attach(const union bpf_attr *attr, struct bpf_prog *
 	return -EINVAL;
 }
 
-#define BPF_LINK_CREATE_LAST_FIELD link_create.iter_info_len
+#define BPF_LINK_CREATE_LAST_FIELD link_create.kprobe_multi.cookies
 static int link_create(union bpf_attr *attr)
 {
 	enum bpf_prog_type ptype;
@@ -4081,6 +4112,9 @@ static int link_create(union bpf_attr *attr)
 		ret = bpf_xdp_link_attach(attr, prog);
 		break;
 #endif
+	case BPF_PROG_TYPE_KPROBE:
+		ret = bpf_kprobe_multi_link_attach(attr, prog);
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -499,6 +499,14 @@ out:
  * call prog->bpf_func
  * call __bpf_prog_exit
  */
+/* Returned by __bpf_prog_enter() for a run that is counted but not timed */
+#define BPF_STATS_UNTIMED	1
+
+/* The trampoline does not pass the program to __bpf_prog_enter(), so the
+ * runs of all the programs on a CPU share one sampling countdown.
+ */
+static DEFINE_PER_CPU(u32, bpf_stats_sample_left);
+
 u64 notrace __bpf_prog_enter(void)
 	__acquires(RCU)
 {
@@ -506,8 +514,12 @@ u64 notrace __bpf_prog_enter(void)
 
 	rcu_read_lock();
 	migrate_disable();
-	if (static_branch_unlikely(&bpf_stats_enabled_key))
-		start = sched_clock();
+	if (static_branch_unlikely(&bpf_stats_enabled_key)) {
+		if (bpf_stats_sample(this_cpu_ptr(&bpf_stats_sample_left)))
+			start = sched_clock();
+		else
+			start = BPF_STATS_UNTIMED;
+	}
 	return start;
 }
 
@@ -524,10 +536,8 @@ void notrace __bpf_prog_exit(struct bpf_prog *prog, u64 start)
 	     */
 	    start) {
 		stats = this_cpu_ptr(prog->aux->stats);
-		u64_stats_update_begin(&stats->syncp);
-		stats->cnt++;
-		stats->nsecs += sched_clock() - start;
-		u64_stats_update_end(&stats->syncp);
+		bpf_prog_stats_update(stats,
+				      start == BPF_STATS_UNTIMED ? 0 : start);
 	}
 	migrate_enable();
 	rcu_read_unlock();
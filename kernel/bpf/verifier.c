@@ -4713,6 +4713,7 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 			goto error;
 		break;
 	case BPF_MAP_TYPE_RINGBUF:
+	case BPF_MAP_TYPE_PERCPU_RINGBUF:
 		if (func_id != BPF_FUNC_ringbuf_output &&
 		    func_id != BPF_FUNC_ringbuf_reserve &&
 		    func_id != BPF_FUNC_ringbuf_submit &&
@@ -4824,6 +4825,13 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		if (map->map_type != BPF_MAP_TYPE_STACK_TRACE)
 			goto error;
 		break;
+	case BPF_FUNC_ringbuf_output:
+	case BPF_FUNC_ringbuf_reserve:
+	case BPF_FUNC_ringbuf_query:
+		if (map->map_type != BPF_MAP_TYPE_RINGBUF &&
+		    map->map_type != BPF_MAP_TYPE_PERCPU_RINGBUF)
+			goto error;
+		break;
 	case BPF_FUNC_current_task_under_cgroup:
 	case BPF_FUNC_skb_under_cgroup:
 		if (map->map_type != BPF_MAP_TYPE_CGROUP_ARRAY)
@@ -10136,6 +10144,10 @@ static int check_pseudo_btf_id(struct bpf_verifier_env *env,
 
 static int check_map_prealloc(struct bpf_map *map)
 {
+	/* elements are always allocated on update */
+	if (map->map_type == BPF_MAP_TYPE_RHASH)
+		return false;
+
 	return (map->map_type != BPF_MAP_TYPE_HASH &&
 		map->map_type != BPF_MAP_TYPE_PERCPU_HASH &&
 		map->map_type != BPF_MAP_TYPE_HASH_OF_MAPS) ||
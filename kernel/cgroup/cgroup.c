@@ -3638,6 +3638,37 @@ static ssize_t cgroup_cpu_pressure_write(struct kernfs_open_file *of,
 	return cgroup_pressure_write(of, buf, nbytes, PSI_CPU);
 }
 
+static int cgroup_pressure_show(struct seq_file *seq, void *v)
+{
+	struct cgroup *cgrp = seq_css(seq)->cgroup;
+
+	seq_printf(seq, "%d\n", READ_ONCE(cgrp->psi.enabled));
+	return 0;
+}
+
+static ssize_t cgroup_pressure_enable_write(struct kernfs_open_file *of,
+					    char *buf, size_t nbytes,
+					    loff_t off)
+{
+	struct cgroup *cgrp;
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(strstrip(buf), &enable);
+	if (ret)
+		return ret;
+
+	cgrp = cgroup_kn_lock_live(of->kn, false);
+	if (!cgrp)
+		return -ENODEV;
+
+	ret = psi_cgroup_set_enabled(&cgrp->psi, enable);
+
+	cgroup_kn_unlock(of->kn);
+
+	return ret ?: nbytes;
+}
+
 static __poll_t cgroup_pressure_poll(struct kernfs_open_file *of,
 					  poll_table *pt)
 {
@@ -4951,6 +4982,12 @@ static struct cftype cgroup_base_files[] = {
 		.poll = cgroup_pressure_poll,
 		.release = cgroup_pressure_release,
 	},
+	{
+		.name = "cgroup.pressure",
+		.flags = CFTYPE_PRESSURE | CFTYPE_NOT_ON_ROOT,
+		.seq_show = cgroup_pressure_show,
+		.write = cgroup_pressure_enable_write,
+	},
 #endif /* CONFIG_PSI */
 	{ }	/* terminate */
 };
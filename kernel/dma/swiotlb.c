@@ -74,17 +74,32 @@ phys_addr_t io_tlb_start, io_tlb_end;
  */
 static unsigned long io_tlb_nslabs;
 
-/*
- * The number of used IO TLB block
- */
-static unsigned long io_tlb_used;
-
 /*
  * This is a free list describing the number of free entries available from
  * each index
  */
 static unsigned int *io_tlb_list;
-static unsigned int io_tlb_index;
+
+/*
+ * The slots are split into areas with their own lock and search index, so
+ * that CPUs bouncing DMA at the same time don't serialize on one lock.  A
+ * CPU allocates from its own area first and falls back to the others when
+ * it is full.  The areas are a power of two in number and made of whole
+ * segments, so a free run never crosses into the next area.
+ */
+struct io_tlb_area {
+	unsigned long used;		/* slots in use */
+	unsigned int index;		/* where to start the next search */
+	spinlock_t lock;		/* protects the area's free list */
+	unsigned long contended;	/* lock found taken */
+} ____cacheline_aligned_in_smp;
+
+static struct io_tlb_area *io_tlb_areas;
+static unsigned int io_tlb_nareas = 1;
+static unsigned long io_tlb_area_nslabs;
+
+/* "swiotlb=<nslabs>,<nareas>", 0 sizes the areas by the number of CPUs */
+static unsigned int io_tlb_default_nareas;
 
 /*
  * Max segment that we can provide which (if pages are contingous) will
@@ -99,11 +114,6 @@ static unsigned int max_segment;
 #define INVALID_PHYS_ADDR (~(phys_addr_t)0)
 static phys_addr_t *io_tlb_orig_addr;
 
-/*
- * Protect the above data structures in the map and unmap calls
- */
-static DEFINE_SPINLOCK(io_tlb_lock);
-
 static int late_alloc;
 
 static int __init
@@ -114,6 +124,14 @@ setup_io_tlb_npages(char *str)
 		/* avoid tail segment of size < IO_TLB_SEGSIZE */
 		io_tlb_nslabs = ALIGN(io_tlb_nslabs, IO_TLB_SEGSIZE);
 	}
+	if (*str == ',')
+		++str;
+	if (isdigit(*str)) {
+		io_tlb_default_nareas = simple_strtoul(str, &str, 0);
+		if (io_tlb_default_nareas)
+			io_tlb_default_nareas =
+				roundup_pow_of_two(io_tlb_default_nareas);
+	}
 	if (*str == ',')
 		++str;
 	if (!strcmp(str, "force")) {
@@ -183,6 +201,47 @@ static inline unsigned long nr_slots(u64 val)
 	return DIV_ROUND_UP(val, IO_TLB_SIZE);
 }
 
+/*
+ * One area per CPU unless asked otherwise, halved until every area is made
+ * of whole segments.
+ */
+static void swiotlb_set_nareas(unsigned long nslabs)
+{
+	unsigned int nareas = io_tlb_default_nareas;
+
+	if (!nareas)
+		nareas = roundup_pow_of_two(num_possible_cpus());
+	while (nareas > 1 && nslabs % (nareas * IO_TLB_SEGSIZE))
+		nareas >>= 1;
+
+	io_tlb_nareas = nareas;
+	io_tlb_area_nslabs = nslabs / nareas;
+}
+
+static void swiotlb_init_areas(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < io_tlb_nareas; i++) {
+		spin_lock_init(&io_tlb_areas[i].lock);
+		io_tlb_areas[i].index = 0;
+		io_tlb_areas[i].used = 0;
+		io_tlb_areas[i].contended = 0;
+	}
+}
+
+static unsigned long swiotlb_used(void)
+{
+	unsigned long used = 0;
+	unsigned int i;
+
+	if (!io_tlb_areas)
+		return 0;
+	for (i = 0; i < io_tlb_nareas; i++)
+		used += READ_ONCE(io_tlb_areas[i].used);
+	return used;
+}
+
 /*
  * Early SWIOTLB allocation may be too early to allow an architecture to
  * perform the desired operations.  This function allows the architecture to
@@ -231,11 +290,18 @@ int __init swiotlb_init_with_tbl(char *tlb, unsigned long nslabs, int verbose)
 		panic("%s: Failed to allocate %zu bytes align=0x%lx\n",
 		      __func__, alloc_size, PAGE_SIZE);
 
+	swiotlb_set_nareas(io_tlb_nslabs);
+	alloc_size = array_size(io_tlb_nareas, sizeof(*io_tlb_areas));
+	io_tlb_areas = memblock_alloc(alloc_size, SMP_CACHE_BYTES);
+	if (!io_tlb_areas)
+		panic("%s: Failed to allocate %zu bytes align=0x%x\n",
+		      __func__, alloc_size, SMP_CACHE_BYTES);
+
 	for (i = 0; i < io_tlb_nslabs; i++) {
 		io_tlb_list[i] = IO_TLB_SEGSIZE - io_tlb_offset(i);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas();
 	no_iotlb_memory = false;
 
 	if (verbose)
@@ -331,6 +397,9 @@ static void swiotlb_cleanup(void)
 	io_tlb_end = 0;
 	io_tlb_start = 0;
 	io_tlb_nslabs = 0;
+	io_tlb_areas = NULL;
+	io_tlb_nareas = 1;
+	io_tlb_area_nslabs = 0;
 	max_segment = 0;
 }
 
@@ -365,11 +434,17 @@ swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 	if (!io_tlb_orig_addr)
 		goto cleanup4;
 
+	swiotlb_set_nareas(io_tlb_nslabs);
+	io_tlb_areas = kcalloc(io_tlb_nareas, sizeof(*io_tlb_areas),
+			       GFP_KERNEL);
+	if (!io_tlb_areas)
+		goto cleanup5;
+
 	for (i = 0; i < io_tlb_nslabs; i++) {
 		io_tlb_list[i] = IO_TLB_SEGSIZE - io_tlb_offset(i);
 		io_tlb_orig_addr[i] = INVALID_PHYS_ADDR;
 	}
-	io_tlb_index = 0;
+	swiotlb_init_areas();
 	no_iotlb_memory = false;
 
 	swiotlb_print_info();
@@ -380,6 +455,10 @@ swiotlb_late_init_with_tbl(char *tlb, unsigned long nslabs)
 
 	return 0;
 
+cleanup5:
+	free_pages((unsigned long)io_tlb_orig_addr,
+		   get_order(io_tlb_nslabs * sizeof(phys_addr_t)));
+	io_tlb_orig_addr = NULL;
 cleanup4:
 	free_pages((unsigned long)io_tlb_list, get_order(io_tlb_nslabs *
 	                                                 sizeof(int)));
@@ -395,6 +474,7 @@ void __init swiotlb_exit(void)
 		return;
 
 	if (late_alloc) {
+		kfree(io_tlb_areas);
 		free_pages((unsigned long)io_tlb_orig_addr,
 			   get_order(io_tlb_nslabs * sizeof(phys_addr_t)));
 		free_pages((unsigned long)io_tlb_list, get_order(io_tlb_nslabs *
@@ -402,6 +482,9 @@ void __init swiotlb_exit(void)
 		free_pages((unsigned long)phys_to_virt(io_tlb_start),
 			   get_order(io_tlb_nslabs << IO_TLB_SHIFT));
 	} else {
+		memblock_free_late(__pa(io_tlb_areas),
+				   array_size(io_tlb_nareas,
+					      sizeof(*io_tlb_areas)));
 		memblock_free_late(__pa(io_tlb_orig_addr),
 				   PAGE_ALIGN(io_tlb_nslabs * sizeof(phys_addr_t)));
 		memblock_free_late(__pa(io_tlb_list),
@@ -472,20 +555,34 @@ static inline unsigned long get_max_slots(unsigned long boundary_mask)
 	return nr_slots(boundary_mask + 1);
 }
 
-static unsigned int wrap_index(unsigned int index)
+/* wrap an index relative to the start of an area */
+static unsigned int wrap_area_index(unsigned int index)
 {
-	if (index >= io_tlb_nslabs)
+	if (index >= io_tlb_area_nslabs)
 		return 0;
 	return index;
 }
 
+static unsigned long swiotlb_area_lock(struct io_tlb_area *area)
+{
+	unsigned long flags;
+
+	if (!spin_trylock_irqsave(&area->lock, flags)) {
+		spin_lock_irqsave(&area->lock, flags);
+		area->contended++;
+	}
+	return flags;
+}
+
 /*
  * Find a suitable number of IO TLB entries size that will fit this request and
- * allocate a buffer from that IO TLB pool.
+ * allocate a buffer from the given area.
  */
-static int find_slots(struct device *dev, phys_addr_t orig_addr,
-		size_t alloc_size)
+static int area_find_slots(struct device *dev, unsigned int area_index,
+		phys_addr_t orig_addr, size_t alloc_size)
 {
+	struct io_tlb_area *area = &io_tlb_areas[area_index];
+	unsigned int area_start = area_index * io_tlb_area_nslabs;
 	unsigned long boundary_mask = dma_get_seg_boundary(dev);
 	dma_addr_t tbl_dma_addr =
 		phys_to_dma_unencrypted(dev, io_tlb_start) & boundary_mask;
@@ -493,7 +590,7 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 	unsigned int iotlb_align_mask =
 		dma_get_min_align_mask(dev) & ~(IO_TLB_SIZE - 1);
 	unsigned int nslots = nr_slots(alloc_size), stride;
-	unsigned int index, wrap, count = 0, i;
+	unsigned int index, slot, wrap, count = 0, i;
 	unsigned long flags;
 
 	BUG_ON(!nslots);
@@ -507,15 +604,16 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 	if (alloc_size >= PAGE_SIZE)
 		stride = max(stride, stride << (PAGE_SHIFT - IO_TLB_SHIFT));
 
-	spin_lock_irqsave(&io_tlb_lock, flags);
-	if (unlikely(nslots > io_tlb_nslabs - io_tlb_used))
+	flags = swiotlb_area_lock(area);
+	if (unlikely(nslots > io_tlb_area_nslabs - area->used))
 		goto not_found;
 
-	index = wrap = wrap_index(ALIGN(io_tlb_index, stride));
+	slot = wrap = wrap_area_index(ALIGN(area->index, stride));
 	do {
+		index = area_start + slot;
 		if ((slot_addr(tbl_dma_addr, index) & iotlb_align_mask) !=
 		    (orig_addr & iotlb_align_mask)) {
-			index = wrap_index(index + 1);
+			slot = wrap_area_index(slot + 1);
 			continue;
 		}
 
@@ -530,11 +628,11 @@ static int find_slots(struct device *dev, phys_addr_t orig_addr,
 			if (io_tlb_list[index] >= nslots)
 				goto found;
 		}
-		index = wrap_index(index + stride);
-	} while (index != wrap);
+		slot = wrap_area_index(slot + stride);
+	} while (slot != wrap);
 
 not_found:
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	spin_unlock_irqrestore(&area->lock, flags);
 	return -1;
 
 found:
@@ -548,16 +646,33 @@ found:
 	/*
 	 * Update the indices to avoid searching in the next round.
 	 */
-	if (index + nslots < io_tlb_nslabs)
-		io_tlb_index = index + nslots;
-	else
-		io_tlb_index = 0;
-	io_tlb_used += nslots;
+	area->index = wrap_area_index(slot + nslots);
+	area->used += nslots;
 
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	spin_unlock_irqrestore(&area->lock, flags);
 	return index;
 }
 
+/* start with the area of this CPU, then try the others */
+static int find_slots(struct device *dev, phys_addr_t orig_addr,
+		size_t alloc_size)
+{
+	unsigned int start = raw_smp_processor_id() & (io_tlb_nareas - 1);
+	unsigned int i, area_index;
+	int index;
+
+	for (i = 0, area_index = start; i < io_tlb_nareas; i++) {
+		index = area_find_slots(dev, area_index, orig_addr,
+					alloc_size);
+		if (index >= 0)
+			return index;
+		if (++area_index >= io_tlb_nareas)
+			area_index = 0;
+	}
+
+	return -1;
+}
+
 phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 		size_t mapping_size, size_t alloc_size,
 		enum dma_data_direction dir, unsigned long attrs)
@@ -584,7 +699,7 @@ phys_addr_t swiotlb_tbl_map_single(struct device *dev, phys_addr_t orig_addr,
 		if (!(attrs & DMA_ATTR_NO_WARN))
 			dev_warn_ratelimited(dev,
 	"swiotlb buffer is full (sz: %zd bytes), total %lu (slots), used %lu (slots)\n",
-				 alloc_size, io_tlb_nslabs, io_tlb_used);
+				 alloc_size, io_tlb_nslabs, swiotlb_used());
 		return (phys_addr_t)DMA_MAPPING_ERROR;
 	}
 
@@ -614,6 +729,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	unsigned int offset = swiotlb_align_offset(hwdev, tlb_addr);
 	int i, count, nslots = nr_slots(alloc_size + offset);
 	int index = (tlb_addr - offset - io_tlb_start) >> IO_TLB_SHIFT;
+	struct io_tlb_area *area = &io_tlb_areas[index / io_tlb_area_nslabs];
 	phys_addr_t orig_addr = io_tlb_orig_addr[index];
 
 	/*
@@ -630,7 +746,7 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	 * While returning the entries to the free list, we merge the entries
 	 * with slots below and above the pool being returned.
 	 */
-	spin_lock_irqsave(&io_tlb_lock, flags);
+	flags = swiotlb_area_lock(area);
 	if (index + nslots < ALIGN(index + 1, IO_TLB_SEGSIZE))
 		count = io_tlb_list[index + nslots];
 	else
@@ -653,8 +769,8 @@ void swiotlb_tbl_unmap_single(struct device *hwdev, phys_addr_t tlb_addr,
 	     io_tlb_offset(i) != IO_TLB_SEGSIZE - 1 && io_tlb_list[i];
 	     i--)
 		io_tlb_list[i] = ++count;
-	io_tlb_used -= nslots;
-	spin_unlock_irqrestore(&io_tlb_lock, flags);
+	area->used -= nslots;
+	spin_unlock_irqrestore(&area->lock, flags);
 }
 
 void swiotlb_tbl_sync_single(struct device *hwdev, phys_addr_t tlb_addr,
@@ -740,13 +856,40 @@ bool is_swiotlb_active(void)
 
 #ifdef CONFIG_DEBUG_FS
 
+static int io_tlb_used_get(void *data, u64 *val)
+{
+	*val = swiotlb_used();
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(fops_io_tlb_used, io_tlb_used_get, NULL, "%llu\n");
+
+/* per area: slots in use out of the area's, next search index, contention */
+static int io_tlb_areas_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	for (i = 0; i < io_tlb_nareas && io_tlb_areas; i++) {
+		struct io_tlb_area *area = &io_tlb_areas[i];
+
+		seq_printf(m, "%u: used %lu/%lu index %u contended %lu\n", i,
+			   READ_ONCE(area->used), io_tlb_area_nslabs,
+			   READ_ONCE(area->index), READ_ONCE(area->contended));
+	}
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(io_tlb_areas);
+
 static int __init swiotlb_create_debugfs(void)
 {
 	struct dentry *root;
 
 	root = debugfs_create_dir("swiotlb", NULL);
 	debugfs_create_ulong("io_tlb_nslabs", 0400, root, &io_tlb_nslabs);
-	debugfs_create_ulong("io_tlb_used", 0400, root, &io_tlb_used);
+	debugfs_create_file("io_tlb_used", 0400, root, NULL,
+			    &fops_io_tlb_used);
+	debugfs_create_u32("io_tlb_nareas", 0400, root, &io_tlb_nareas);
+	debugfs_create_file("io_tlb_areas", 0400, root, NULL,
+			    &io_tlb_areas_fops);
 	return 0;
 }
 
@@ -1123,6 +1123,38 @@ perf_cgroup_event_disable(struct perf_event *event, struct perf_event_context *c
  * like original code
  */
 #define PERF_CPU_HRTIMER (1000 / HZ)
+
+/*
+ * Rotating reprograms the counters, which costs a lot more where the PMU
+ * accesses trap to a hypervisor. Let the rotations take at most 1/64th of
+ * the time by stretching the multiplexing interval up to 8 times.
+ */
+#define PERF_MUX_COST_SHIFT	6
+#define PERF_MUX_MAX_SCALE	3
+
+static ktime_t perf_mux_interval(struct perf_cpu_context *cpuctx)
+{
+	return ns_to_ktime(ktime_to_ns(cpuctx->hrtimer_interval) <<
+			   cpuctx->hrtimer_scale);
+}
+
+static void perf_mux_account(struct perf_cpu_context *cpuctx, u64 cost)
+{
+	u64 interval = ktime_to_ns(perf_mux_interval(cpuctx));
+	u64 avg;
+
+	cpuctx->rotate_time += cost;
+	avg = cpuctx->rotate_cost = (cpuctx->rotate_cost * 7 + cost) >> 3;
+
+	/* grow over budget, shrink back well under it not to flip-flop */
+	if ((avg << PERF_MUX_COST_SHIFT) > interval &&
+	    cpuctx->hrtimer_scale < PERF_MUX_MAX_SCALE)
+		cpuctx->hrtimer_scale++;
+	else if ((avg << (PERF_MUX_COST_SHIFT + 2)) < interval &&
+		 cpuctx->hrtimer_scale)
+		cpuctx->hrtimer_scale--;
+}
+
 /*
  * function must be called with interrupts disabled
  */
@@ -1138,7 +1170,7 @@ static enum hrtimer_restart perf_mux_hrtimer_handler(struct hrtimer *hr)
 
 	raw_spin_lock(&cpuctx->hrtimer_lock);
 	if (rotations)
-		hrtimer_forward_now(hr, cpuctx->hrtimer_interval);
+		hrtimer_forward_now(hr, perf_mux_interval(cpuctx));
 	else
 		cpuctx->hrtimer_active = 0;
 	raw_spin_unlock(&cpuctx->hrtimer_lock);
@@ -1184,7 +1216,7 @@ static int perf_mux_hrtimer_restart(struct perf_cpu_context *cpuctx)
 	raw_spin_lock_irqsave(&cpuctx->hrtimer_lock, flags);
 	if (!cpuctx->hrtimer_active) {
 		cpuctx->hrtimer_active = 1;
-		hrtimer_forward_now(timer, cpuctx->hrtimer_interval);
+		hrtimer_forward_now(timer, perf_mux_interval(cpuctx));
 		hrtimer_start_expires(timer, HRTIMER_MODE_ABS_PINNED_HARD);
 	}
 	raw_spin_unlock_irqrestore(&cpuctx->hrtimer_lock, flags);
@@ -3397,6 +3429,7 @@ static void perf_event_context_sched_out(struct task_struct *task, int ctxn,
 	struct perf_cpu_context *cpuctx;
 	int do_switch = 1;
 	struct pmu *pmu;
+	u64 start;
 
 	if (likely(!ctx))
 		return;
@@ -3406,6 +3439,7 @@ static void perf_event_context_sched_out(struct task_struct *task, int ctxn,
 	if (!cpuctx->task_ctx)
 		return;
 
+	start = local_clock();
 	rcu_read_lock();
 	next_ctx = next->perf_event_ctxp[ctxn];
 	if (!next_ctx)
@@ -3484,6 +3518,8 @@ unlock:
 		perf_pmu_enable(pmu);
 		raw_spin_unlock(&ctx->lock);
 	}
+
+	cpuctx->switch_time += local_clock() - start;
 }
 
 static DEFINE_PER_CPU(struct list_head, sched_cb_list);
@@ -3811,6 +3847,7 @@ static void perf_event_context_sched_in(struct perf_event_context *ctx,
 {
 	struct perf_cpu_context *cpuctx;
 	struct pmu *pmu = ctx->pmu;
+	u64 start;
 
 	cpuctx = __get_cpu_context(ctx);
 	if (cpuctx->task_ctx == ctx) {
@@ -3819,6 +3856,7 @@ static void perf_event_context_sched_in(struct perf_event_context *ctx,
 		return;
 	}
 
+	start = local_clock();
 	perf_ctx_lock(cpuctx, ctx);
 	/*
 	 * We must check ctx->nr_events while holding ctx->lock, such
@@ -3847,6 +3885,8 @@ static void perf_event_context_sched_in(struct perf_event_context *ctx,
 
 unlock:
 	perf_ctx_unlock(cpuctx, ctx);
+
+	cpuctx->switch_time += local_clock() - start;
 }
 
 /*
@@ -4114,6 +4154,7 @@ static bool perf_rotate_context(struct perf_cpu_context *cpuctx)
 	struct perf_event *cpu_event = NULL, *task_event = NULL;
 	struct perf_event_context *task_ctx = NULL;
 	int cpu_rotate, task_rotate;
+	u64 start;
 
 	/*
 	 * Since we run this from IRQ context, nobody can install new
@@ -4127,6 +4168,7 @@ static bool perf_rotate_context(struct perf_cpu_context *cpuctx)
 	if (!(cpu_rotate || task_rotate))
 		return false;
 
+	start = local_clock();
 	perf_ctx_lock(cpuctx, cpuctx->task_ctx);
 	perf_pmu_disable(cpuctx->ctx.pmu);
 
@@ -4154,6 +4196,8 @@ static bool perf_rotate_context(struct perf_cpu_context *cpuctx)
 	perf_pmu_enable(cpuctx->ctx.pmu);
 	perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
 
+	perf_mux_account(cpuctx, local_clock() - start);
+
 	return true;
 }
 
@@ -9810,6 +9854,12 @@ static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
 		return -EINVAL;
 	}
 
+	/* Kprobe multi programs are only attached through a link. */
+	if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI) {
+		bpf_prog_put(prog);
+		return -EINVAL;
+	}
+
 	/* Kprobe override only works for kprobes, not uprobes. */
 	if (prog->kprobe_override &&
 	    !(event->tp_event->flags & TRACE_EVENT_FL_KPROBE)) {
@@ -10699,6 +10749,7 @@ perf_event_mux_interval_ms_store(struct device *dev,
 		struct perf_cpu_context *cpuctx;
 		cpuctx = per_cpu_ptr(pmu->pmu_cpu_context, cpu);
 		cpuctx->hrtimer_interval = ns_to_ktime(NSEC_PER_MSEC * timer);
+		cpuctx->hrtimer_scale = 0;
 
 		cpu_function_call(cpu,
 			(remote_function_f)perf_mux_hrtimer_restart, cpuctx);
@@ -10710,9 +10761,45 @@ perf_event_mux_interval_ms_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(perf_event_mux_interval_ms);
 
+/* Time spent reprogramming the PMU on context switch and rotation */
+static ssize_t perf_event_time_show(struct pmu *pmu, char *page,
+				    size_t offset)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		void *cpuctx = per_cpu_ptr(pmu->pmu_cpu_context, cpu);
+
+		sum += READ_ONCE(*(u64 *)(cpuctx + offset));
+	}
+
+	return snprintf(page, PAGE_SIZE - 1, "%llu\n", sum);
+}
+
+static ssize_t
+perf_event_switch_ns_show(struct device *dev, struct device_attribute *attr,
+			  char *page)
+{
+	return perf_event_time_show(dev_get_drvdata(dev), page,
+			offsetof(struct perf_cpu_context, switch_time));
+}
+static DEVICE_ATTR_RO(perf_event_switch_ns);
+
+static ssize_t
+perf_event_mux_ns_show(struct device *dev, struct device_attribute *attr,
+		       char *page)
+{
+	return perf_event_time_show(dev_get_drvdata(dev), page,
+			offsetof(struct perf_cpu_context, rotate_time));
+}
+static DEVICE_ATTR_RO(perf_event_mux_ns);
+
 static struct attribute *pmu_dev_attrs[] = {
 	&dev_attr_type.attr,
 	&dev_attr_perf_event_mux_interval_ms.attr,
+	&dev_attr_perf_event_switch_ns.attr,
+	&dev_attr_perf_event_mux_ns.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(pmu_dev);
@@ -80,6 +80,7 @@ static void __unhash_process(struct task_struct *p, bool group_dead)
 		detach_pid(p, PIDTYPE_SID);
 
 		list_del_rcu(&p->tasks);
+		oom_bucket_del(p);
 		list_del_init(&p->sibling);
 		__this_cpu_dec(process_counts);
 	}
@@ -1063,6 +1063,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	atomic_set(&mm->has_pinned, 0);
 	atomic64_set(&mm->pinned_vm, 0);
 	memset(&mm->rss_stat, 0, sizeof(mm->rss_stat));
+#ifdef CONFIG_MEMBARRIER
+	atomic_long_set(&mm->membarrier_ipis, 0);
+#endif
 	spin_lock_init(&mm->page_table_lock);
 	spin_lock_init(&mm->arg_lock);
 	mm_init_cpumask(mm);
@@ -1074,6 +1077,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	init_tlb_flush_pending(mm);
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	atomic_set(&mm->thp_sync_collapsed, 0);
 #endif
 	mm_init_uprobes_state(mm);
 
@@ -1092,6 +1098,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 		goto fail_nocontext;
 
 	mm->user_ns = get_user_ns(user_ns);
+	pt_aging_add_mm(mm);
 	return mm;
 
 fail_nocontext:
@@ -1120,6 +1127,7 @@ static inline void __mmput(struct mm_struct *mm)
 {
 	VM_BUG_ON(atomic_read(&mm->mm_users));
 
+	pt_aging_del_mm(mm);
 	uprobe_clear_state(mm);
 	exit_aio(mm);
 	ksm_exit(mm);
@@ -1834,6 +1842,14 @@ static __poll_t pidfd_poll(struct file *file, struct poll_table_struct *pts)
 	if (thread_group_exited(pid))
 		poll_flags = EPOLLIN | EPOLLRDNORM;
 
+	/*
+	 * EPOLLPRI once all process_madvise(PMADV_ASYNC) requests against
+	 * the pid have been carried out, if there ever were any.
+	 */
+	if (READ_ONCE(pid->async_madvise_issued) &&
+	    !atomic_read(&pid->async_madvise_pending))
+		poll_flags |= EPOLLPRI;
+
 	return poll_flags;
 }
 
@@ -1876,6 +1892,7 @@ static void copy_oom_score_adj(u64 clone_flags, struct task_struct *tsk)
 	/* Update the values in case they were changed after copy_signal */
 	tsk->signal->oom_score_adj = current->signal->oom_score_adj;
 	tsk->signal->oom_score_adj_min = current->signal->oom_score_adj_min;
+	oom_bucket_update(tsk);
 	mutex_unlock(&oom_adj_mutex);
 }
 
@@ -2036,6 +2053,8 @@ static __latent_entropy struct task_struct *copy_process(
 	p->flags |= PF_FORKNOEXEC;
 	INIT_LIST_HEAD(&p->children);
 	INIT_LIST_HEAD(&p->sibling);
+	INIT_HLIST_NODE(&p->oom_bucket_node);
+	p->oom_rss_cache = 0;
 	rcu_copy_process(p);
 	p->vfork_done = NULL;
 	spin_lock_init(&p->alloc_lock);
@@ -2326,6 +2345,7 @@ static __latent_entropy struct task_struct *copy_process(
 							 p->real_parent->signal->is_child_subreaper;
 			list_add_tail(&p->sibling, &p->real_parent->children);
 			list_add_tail_rcu(&p->tasks, &init_task.tasks);
+			oom_bucket_add(p);
 			attach_pid(p, PIDTYPE_TGID);
 			attach_pid(p, PIDTYPE_PGID);
 			attach_pid(p, PIDTYPE_SID);
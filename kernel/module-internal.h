@@ -20,6 +20,12 @@ struct load_info {
 	struct _ddebug *debug;
 	unsigned int num_debug;
 	bool sig_ok;
+	/* module parameters, handed over to the module */
+	char *args;
+	/* time spent in the image checks, in ns */
+	u64 check_ns;
+	/* completed once the module is COMING, for background loads */
+	struct completion *formed;
 #ifdef CONFIG_KALLSYMS
 	unsigned long mod_kallsyms_init_off;
 #endif
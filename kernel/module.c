@@ -29,6 +29,7 @@
 #include <linux/fcntl.h>
 #include <linux/rcupdate.h>
 #include <linux/capability.h>
+#include <linux/boot_trace.h>
 #include <linux/cpu.h>
 #include <linux/moduleparam.h>
 #include <linux/errno.h>
@@ -1255,6 +1256,26 @@ static ssize_t show_initsize(struct module_attribute *mattr,
 static struct module_attribute modinfo_initsize =
 	__ATTR(initsize, 0444, show_initsize, NULL);
 
+static ssize_t show_load_usecs(struct module_attribute *mattr,
+			       struct module_kobject *mk, char *buffer)
+{
+	return sprintf(buffer, "%llu\n", div_u64(mk->mod->load_ns,
+						 NSEC_PER_USEC));
+}
+
+static struct module_attribute modinfo_load_usecs =
+	__ATTR(load_usecs, 0444, show_load_usecs, NULL);
+
+static ssize_t show_init_usecs(struct module_attribute *mattr,
+			       struct module_kobject *mk, char *buffer)
+{
+	return sprintf(buffer, "%llu\n", div_u64(mk->mod->init_ns,
+						 NSEC_PER_USEC));
+}
+
+static struct module_attribute modinfo_init_usecs =
+	__ATTR(init_usecs, 0444, show_init_usecs, NULL);
+
 static ssize_t show_taint(struct module_attribute *mattr,
 			  struct module_kobject *mk, char *buffer)
 {
@@ -1276,6 +1297,8 @@ static struct module_attribute *modinfo_attrs[] = {
 	&modinfo_initstate,
 	&modinfo_coresize,
 	&modinfo_initsize,
+	&modinfo_load_usecs,
+	&modinfo_init_usecs,
 	&modinfo_taint,
 #ifdef CONFIG_MODULE_UNLOAD
 	&modinfo_refcnt,
@@ -3168,6 +3191,8 @@ out:
 static void free_copy(struct load_info *info)
 {
 	vfree(info->hdr);
+	kfree(info->args);
+	info->args = NULL;
 }
 
 static int rewrite_section_headers(struct load_info *info, int flags)
@@ -3727,6 +3752,7 @@ static noinline int do_init_module(struct module *mod)
 {
 	int ret = 0;
 	struct mod_initfree *freeinit;
+	u64 start;
 
 	freeinit = kmalloc(sizeof(*freeinit), GFP_KERNEL);
 	if (!freeinit) {
@@ -3741,10 +3767,15 @@ static noinline int do_init_module(struct module *mod)
 	 */
 	current->flags &= ~PF_USED_ASYNC;
 
+	start = ktime_get_ns();
 	do_mod_ctors(mod);
 	/* Start the module */
 	if (mod->init != NULL)
 		ret = do_one_initcall(mod->init);
+	mod->init_ns = ktime_get_ns() - start;
+	pr_debug("%s: loaded in %llu us, init took %llu us\n", mod->name,
+		 div_u64(mod->load_ns, NSEC_PER_USEC),
+		 div_u64(mod->init_ns, NSEC_PER_USEC));
 	if (ret < 0) {
 		goto fail_free_freeinit;
 	}
@@ -3960,14 +3991,15 @@ static int unknown_module_param_cb(char *param, char *val, const char *modname,
 
 static void cfi_init(struct module *mod);
 
-/* Allocate and load the module: note that size of section 0 is always
-   zero, and we rely on this for optional sections. */
-static int load_module(struct load_info *info, const char __user *uargs,
-		       int flags)
+/*
+ * Check the module image up to the point where it is known to be a valid
+ * module for this kernel. This only looks at the image, so background
+ * loads run it in parallel. The caller frees the copy on error.
+ */
+static int module_check_image(struct load_info *info, int flags)
 {
-	struct module *mod;
-	long err = 0;
-	char *after_dashes;
+	u64 start = ktime_get_ns();
+	int err;
 
 	/*
 	 * Do the signature check (if any) first. All that
@@ -3983,7 +4015,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	 */
 	err = module_sig_check(info, flags);
 	if (err)
-		goto free_copy;
+		return err;
 
 	/*
 	 * Do basic sanity checks against the ELF header and
@@ -3992,7 +4024,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	err = elf_validity_check(info);
 	if (err) {
 		pr_err("Module has invalid ELF structures\n");
-		goto free_copy;
+		return err;
 	}
 
 	/*
@@ -4001,27 +4033,37 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	 */
 	err = setup_load_info(info, flags);
 	if (err)
-		goto free_copy;
+		return err;
 
 	/*
 	 * Now that we know we have the correct module name, check
 	 * if it's blacklisted.
 	 */
 	if (blacklisted(info->name)) {
-		err = -EPERM;
 		pr_err("Module %s is blacklisted\n", info->name);
-		goto free_copy;
+		return -EPERM;
 	}
 
 	err = rewrite_section_headers(info, flags);
 	if (err)
-		goto free_copy;
+		return err;
 
 	/* Check module struct version now, before we try to use module. */
-	if (!check_modstruct_version(info, info->mod)) {
-		err = -ENOEXEC;
-		goto free_copy;
-	}
+	if (!check_modstruct_version(info, info->mod))
+		return -ENOEXEC;
+
+	info->check_ns = ktime_get_ns() - start;
+	return 0;
+}
+
+/* Allocate and load the module: note that size of section 0 is always
+   zero, and we rely on this for optional sections. */
+static int load_checked_module(struct load_info *info, int flags)
+{
+	u64 start = ktime_get_ns();
+	struct module *mod;
+	long err = 0;
+	char *after_dashes;
 
 	/* Figure out module layout, and allocate all the memory. */
 	mod = layout_and_allocate(info, flags);
@@ -4030,8 +4072,6 @@ static int load_module(struct load_info *info, const char __user *uargs,
 		goto free_copy;
 	}
 
-	audit_log_kern_module(mod->name);
-
 	/* Reserve our place in the list. */
 	err = add_unformed_module(mod);
 	if (err)
@@ -4090,12 +4130,9 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Setup CFI for the module. */
 	cfi_init(mod);
 
-	/* Now copy in args */
-	mod->args = strndup_user(uargs, ~0UL >> 1);
-	if (IS_ERR(mod->args)) {
-		err = PTR_ERR(mod->args);
-		goto free_arch_cleanup;
-	}
+	/* Now hand over args */
+	mod->args = info->args;
+	info->args = NULL;
 
 	dynamic_debug_setup(mod, info->debug, info->num_debug);
 
@@ -4107,6 +4144,10 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	if (err)
 		goto ddebug_cleanup;
 
+	/* Modules loaded after this one can resolve its symbols now */
+	if (info->formed)
+		complete_all(info->formed);
+
 	err = prepare_coming_module(mod);
 	if (err)
 		goto bug_cleanup;
@@ -4140,6 +4181,9 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Done! */
 	trace_module_load(mod);
 
+	mod->load_ns = info->check_ns + ktime_get_ns() - start;
+	/* the init function is recorded by do_one_initcall() */
+	boot_trace_end(BOOT_TRACE_MODULE, start - info->check_ns, mod->name);
 	return do_init_module(mod);
 
  sysfs_cleanup:
@@ -4162,7 +4206,6 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	dynamic_debug_remove(mod, info->debug);
 	synchronize_rcu();
 	kfree(mod->args);
- free_arch_cleanup:
 	cfi_cleanup(mod);
 	module_arch_cleanup(mod);
  free_modinfo:
@@ -4188,6 +4231,220 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	return err;
 }
 
+static int load_module(struct load_info *info, int flags)
+{
+	int err;
+
+	err = module_check_image(info, flags);
+	if (err) {
+		free_copy(info);
+		return err;
+	}
+
+	audit_log_kern_module(info->name);
+
+	return load_checked_module(info, flags);
+}
+
+/*
+ * Background loading
+ *
+ * Boot loads a hundred or more vendor modules one finit_module() after the
+ * other, verifying, relocating and initializing each before reading the
+ * next one. With MODULE_INIT_ASYNC, finit_module() only reads the file and
+ * leaves the load to module_load_wq, so the image checks with the
+ * signature verification run in parallel. A module then waits for the
+ * background loads of the modules it depends on (modinfo "depends") that
+ * were started before it to come up, so its symbols resolve just as when
+ * loading them one by one, while independent modules are relocated and
+ * initialized in parallel. finit_module(-1, NULL, MODULE_INIT_ASYNC_WAIT)
+ * waits for all background loads and returns the first error one of them
+ * hit since the previous wait. Plain loads don't wait for background ones,
+ * so modules depending on a background load are to be loaded in the
+ * background too, or after the wait.
+ *
+ * The loads are only freed when none is running, so that a load can wait
+ * on those started before it without holding a reference.
+ *
+ * The KERN_MODULE audit record belongs to the finit_module() syscall, a
+ * kworker has no audit context. When the syscall is audited, its image is
+ * checked before returning, so that the record can carry the module name.
+ */
+struct module_async_load {
+	struct list_head list;
+	struct work_struct work;
+	struct load_info info;
+	int flags;
+	int err;
+	bool checked_early;		/* module_check_image() was done */
+	char name[MODULE_NAME_LEN];
+	struct completion checked;	/* name is set, or err */
+	struct completion formed;	/* module is COMING, or err */
+};
+
+static DEFINE_MUTEX(module_async_mutex);
+static LIST_HEAD(module_async_loads);
+static struct workqueue_struct *module_load_wq;
+static unsigned int module_async_running;
+static int module_async_err;
+static DECLARE_WAIT_QUEUE_HEAD(module_async_wq);
+
+/*
+ * modpost lists dependencies by file name, e.g. "snd-pcm" for snd_pcm, so
+ * '-' and '_' compare equal as for parameter names.
+ */
+static bool module_depends_on(const char *depends, const char *name)
+{
+	size_t len = strlen(name);
+
+	while (depends && *depends) {
+		if (strcspn(depends, ",") == len &&
+		    parameqn(depends, name, len))
+			return true;
+		depends = strchr(depends, ',');
+		if (depends)
+			depends++;
+	}
+	return false;
+}
+
+/* Wait for the dependencies of @load that are loaded before it */
+static void module_async_wait_deps(struct module_async_load *load)
+{
+	const char *depends = get_modinfo(&load->info, "depends");
+	struct module_async_load *prev;
+
+	if (!depends || !*depends)
+		return;
+
+	/*
+	 * Loads are only added at the tail and not freed while this one
+	 * runs, so the part of the list before it doesn't change.
+	 */
+	list_for_each_entry(prev, &module_async_loads, list) {
+		if (prev == load)
+			break;
+		wait_for_completion(&prev->checked);
+		if (!prev->err && module_depends_on(depends, prev->name))
+			wait_for_completion(&prev->formed);
+	}
+}
+
+static void module_async_load_work(struct work_struct *work)
+{
+	struct module_async_load *load =
+		container_of(work, struct module_async_load, work);
+	int err;
+
+	err = 0;
+	if (!load->checked_early)
+		err = module_check_image(&load->info, load->flags);
+	if (!err)
+		strscpy(load->name, load->info.name, sizeof(load->name));
+	load->err = err;
+	complete_all(&load->checked);
+
+	if (err) {
+		free_copy(&load->info);
+	} else {
+		module_async_wait_deps(load);
+		load->info.formed = &load->formed;
+		err = load_checked_module(&load->info, load->flags);
+	}
+	complete_all(&load->formed);
+
+	if (err && err != -EEXIST)
+		pr_err("%s: background load failed: %d\n",
+		       load->name[0] ? load->name : "module", err);
+
+	mutex_lock(&module_async_mutex);
+	load->err = err;
+	if (err && err != -EEXIST && !module_async_err)
+		module_async_err = err;
+	if (!--module_async_running)
+		wake_up_all(&module_async_wq);
+	mutex_unlock(&module_async_mutex);
+}
+
+/* Free the finished loads, with module_async_mutex held */
+static void module_async_reap(void)
+{
+	struct module_async_load *load, *tmp;
+
+	if (module_async_running)
+		return;
+
+	list_for_each_entry_safe(load, tmp, &module_async_loads, list) {
+		list_del(&load->list);
+		kfree(load);
+	}
+}
+
+static int module_async_load(struct load_info *info, int flags)
+{
+	struct module_async_load *load;
+	int err;
+
+	load = kzalloc(sizeof(*load), GFP_KERNEL);
+	if (!load) {
+		free_copy(info);
+		return -ENOMEM;
+	}
+
+	if (!audit_dummy_context()) {
+		err = module_check_image(info, flags);
+		if (err) {
+			kfree(load);
+			free_copy(info);
+			return err;
+		}
+		audit_log_kern_module(info->name);
+		load->checked_early = true;
+	}
+
+	load->info = *info;
+	load->flags = flags;
+	INIT_WORK(&load->work, module_async_load_work);
+	init_completion(&load->checked);
+	init_completion(&load->formed);
+
+	mutex_lock(&module_async_mutex);
+	if (!module_load_wq) {
+		module_load_wq = alloc_workqueue("module_load", WQ_UNBOUND, 0);
+		if (!module_load_wq) {
+			mutex_unlock(&module_async_mutex);
+			kfree(load);
+			free_copy(info);
+			return -ENOMEM;
+		}
+	}
+	module_async_reap();
+	list_add_tail(&load->list, &module_async_loads);
+	module_async_running++;
+	queue_work(module_load_wq, &load->work);
+	mutex_unlock(&module_async_mutex);
+
+	return 0;
+}
+
+static int module_async_wait(void)
+{
+	int err;
+
+	err = wait_event_killable(module_async_wq,
+				  !READ_ONCE(module_async_running));
+	if (err)
+		return err;
+
+	mutex_lock(&module_async_mutex);
+	module_async_reap();
+	err = module_async_err;
+	module_async_err = 0;
+	mutex_unlock(&module_async_mutex);
+
+	return err;
+}
+
 SYSCALL_DEFINE3(init_module, void __user *, umod,
 		unsigned long, len, const char __user *, uargs)
 {
@@ -4201,11 +4458,17 @@ SYSCALL_DEFINE3(init_module, void __user *, umod,
 	pr_debug("init_module: umod=%p, len=%lu, uargs=%p\n",
 	       umod, len, uargs);
 
+	info.args = strndup_user(uargs, ~0UL >> 1);
+	if (IS_ERR(info.args))
+		return PTR_ERR(info.args);
+
 	err = copy_module_from_user(umod, len, &info);
-	if (err)
+	if (err) {
+		kfree(info.args);
 		return err;
+	}
 
-	return load_module(&info, uargs, 0);
+	return load_module(&info, 0);
 }
 
 SYSCALL_DEFINE3(finit_module, int, fd, const char __user *, uargs, int, flags)
@@ -4221,17 +4484,34 @@ SYSCALL_DEFINE3(finit_module, int, fd, const char __user *, uargs, int, flags)
 	pr_debug("finit_module: fd=%d, uargs=%p, flags=%i\n", fd, uargs, flags);
 
 	if (flags & ~(MODULE_INIT_IGNORE_MODVERSIONS
-		      |MODULE_INIT_IGNORE_VERMAGIC))
+		      |MODULE_INIT_IGNORE_VERMAGIC
+		      |MODULE_INIT_ASYNC
+		      |MODULE_INIT_ASYNC_WAIT))
 		return -EINVAL;
 
+	if (flags & MODULE_INIT_ASYNC_WAIT) {
+		if (fd != -1 || flags != MODULE_INIT_ASYNC_WAIT)
+			return -EINVAL;
+		return module_async_wait();
+	}
+
+	info.args = strndup_user(uargs, ~0UL >> 1);
+	if (IS_ERR(info.args))
+		return PTR_ERR(info.args);
+
 	err = kernel_read_file_from_fd(fd, 0, &hdr, INT_MAX, NULL,
 				       READING_MODULE);
-	if (err < 0)
+	if (err < 0) {
+		kfree(info.args);
 		return err;
+	}
 	info.hdr = hdr;
 	info.len = err;
 
-	return load_module(&info, uargs, flags);
+	if (flags & MODULE_INIT_ASYNC)
+		return module_async_load(&info, flags & ~MODULE_INIT_ASYNC);
+
+	return load_module(&info, flags);
 }
 
 static inline int within(unsigned long addr, void *start, unsigned long size)
@@ -31,12 +31,14 @@
 #include <linux/genhd.h>
 #include <linux/ktime.h>
 #include <linux/security.h>
+#include <linux/moduleparam.h>
 #include <trace/events/power.h>
 
 #include "power.h"
 
 
 static int nocompress;
+static bool compress_lz4;
 static int noresume;
 static int nohibernate;
 static int resume_wait;
@@ -752,6 +754,8 @@ int hibernate(void)
 			flags |= SF_NOCOMPRESS_MODE;
 		else
 		        flags |= SF_CRC32_MODE;
+		if (!nocompress && compress_lz4)
+			flags |= SF_COMPRESSION_LZ4;
 
 		pm_pr_dbg("Writing hibernation image.\n");
 		error = swsusp_write(flags);
@@ -1290,6 +1294,38 @@ static int __init resume_offset_setup(char *str)
 	return 1;
 }
 
+/*
+ * hibernate.compressor selects how the image is compressed, LZO by default
+ * or LZ4, which decompresses several times faster for a slightly bigger
+ * image. The resume kernel takes the choice from the image header.
+ */
+static const char * const hibernate_compressors[] = { "lzo", "lz4" };
+
+static int hibernate_compressor_set(const char *val,
+				    const struct kernel_param *kp)
+{
+	int idx = sysfs_match_string(hibernate_compressors, val);
+
+	if (idx < 0)
+		return idx;
+
+	compress_lz4 = idx == 1;
+	return 0;
+}
+
+static int hibernate_compressor_get(char *buffer,
+				    const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%s\n", hibernate_compressors[compress_lz4]);
+}
+
+static const struct kernel_param_ops hibernate_compressor_ops = {
+	.set = hibernate_compressor_set,
+	.get = hibernate_compressor_get,
+};
+module_param_cb(compressor, &hibernate_compressor_ops, NULL, 0644);
+MODULE_PARM_DESC(compressor, "Image compression algorithm: lzo or lz4");
+
 static int __init hibernate_setup(char *str)
 {
 	if (!strncmp(str, "noresume", 8)) {
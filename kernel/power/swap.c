@@ -25,6 +25,7 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
@@ -518,7 +519,10 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 #define LZO_UNC_PAGES	32
 #define LZO_UNC_SIZE	(LZO_UNC_PAGES * PAGE_SIZE)
 
-/* Number of pages/bytes we need for compressed data (worst case). */
+/*
+ * Number of pages/bytes we need for compressed data (worst case). The LZO
+ * bound is above LZ4_COMPRESSBOUND(), so the buffers fit either algorithm.
+ */
 #define LZO_CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(LZO_UNC_SIZE) + \
 			             LZO_HEADER, PAGE_SIZE)
 #define LZO_CMP_SIZE	(LZO_CMP_PAGES * PAGE_SIZE)
@@ -621,21 +625,30 @@ static int crc32_threadfn(void *data)
 	}
 	return 0;
 }
+static size_t hib_worst_compress(bool lz4, size_t len)
+{
+	return lz4 ? LZ4_COMPRESSBOUND(len) : lzo1x_worst_compress(len);
+}
+
 /**
- * Structure used for LZO data compression.
+ * Structure used for LZO or LZ4 data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	bool lz4;                                 /* LZ4 instead of LZO */
 	wait_queue_head_t go;                     /* start compression */
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
 	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
 	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
+	union {                                   /* compression workspace */
+		unsigned char lzo[LZO1X_1_MEM_COMPRESS];
+		unsigned char lz4[LZ4_MEM_COMPRESS];
+	} wrk;
 };
 
 /**
@@ -657,9 +670,20 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		if (d->lz4) {
+			int len = LZ4_compress_default((char *)d->unc,
+						(char *)d->cmp + LZO_HEADER,
+						d->unc_len,
+						LZO_CMP_SIZE - LZO_HEADER,
+						d->wrk.lz4);
+
+			d->cmp_len = len;
+			d->ret = len ? 0 : -1;
+		} else {
+			d->ret = lzo1x_1_compress(d->unc, d->unc_len,
+						  d->cmp + LZO_HEADER,
+						  &d->cmp_len, d->wrk.lzo);
+		}
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -667,15 +691,17 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_image_lzo - Save the suspend image data compressed with LZO or LZ4.
  * @handle: Swap map handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
+ * @lz4: Compress with LZ4 instead of LZO.
  */
 static int save_image_lzo(struct swap_map_handle *handle,
                           struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+                          unsigned int nr_to_write, bool lz4)
 {
+	const char *alg = lz4 ? "LZ4" : "LZO";
 	unsigned int m;
 	int ret = 0;
 	int nr_pages;
@@ -711,8 +737,10 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct cmp_data, go));
+		data[thr].lz4 = lz4;
+	}
 
 	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
 	if (!crc) {
@@ -767,7 +795,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	 */
 	handle->reqd_free_pages = reqd_free_pages();
 
-	pr_info("Using %u thread(s) for compression\n", nr_threads);
+	pr_info("Using %u thread(s) for %s compression\n", nr_threads, alg);
 	pr_info("Compressing and saving image data (%u pages)...\n",
 		nr_to_write);
 	m = nr_to_write / 10;
@@ -817,14 +845,15 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				pr_err("LZO compression failed\n");
+				pr_err("%s compression failed\n", alg);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(data[thr].unc_len))) {
-				pr_err("Invalid LZO compressed length\n");
+			             hib_worst_compress(lz4,
+							data[thr].unc_len))) {
+				pr_err("Invalid %s compressed length\n", alg);
 				ret = -1;
 				goto out_finish;
 			}
@@ -942,7 +971,8 @@ int swsusp_write(unsigned int flags)
 	if (!error) {
 		error = (flags & SF_NOCOMPRESS_MODE) ?
 			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+			save_image_lzo(&handle, &snapshot, pages - 1,
+				       flags & SF_COMPRESSION_LZ4);
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1109,13 +1139,15 @@ static int load_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for LZO or LZ4 data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	bool lz4;                                 /* LZ4 instead of LZO */
+	u64 ns;                                   /* time spent decompressing */
 	wait_queue_head_t go;                     /* start decompression */
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
@@ -1130,6 +1162,7 @@ struct dec_data {
 static int lzo_decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
+	u64 start;
 
 	while (1) {
 		wait_event(d->go, atomic_read(&d->ready) ||
@@ -1143,9 +1176,22 @@ static int lzo_decompress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		start = ktime_get_ns();
+		if (d->lz4) {
+			int len = LZ4_decompress_safe((char *)d->cmp +
+						      LZO_HEADER,
+						      (char *)d->unc, d->cmp_len,
+						      LZO_UNC_SIZE);
+
+			d->unc_len = max(len, 0);
+			d->ret = min(len, 0);
+		} else {
+			d->unc_len = LZO_UNC_SIZE;
+			d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER,
+						       d->cmp_len, d->unc,
+						       &d->unc_len);
+		}
+		d->ns += ktime_get_ns() - start;
 		if (clean_pages_on_decompress)
 			flush_icache_range((unsigned long)d->unc,
 					   (unsigned long)d->unc + d->unc_len);
@@ -1157,15 +1203,23 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_image_lzo - Load compressed image data and decompress them with LZO
+ * or LZ4.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
+ * @lz4: The image was compressed with LZ4 instead of LZO.
+ *
+ * The time spent waiting for reads, waiting for the decompression threads
+ * and copying pages into the image is reported at the end, to tell which
+ * one bounds the restore.
  */
 static int load_image_lzo(struct swap_map_handle *handle,
                           struct snapshot_handle *snapshot,
-                          unsigned int nr_to_read)
+                          unsigned int nr_to_read, bool lz4)
 {
+	const char *alg = lz4 ? "LZ4" : "LZO";
+	u64 io_ns = 0, dec_ns = 0, copy_ns = 0, thr_ns = 0, t;
 	unsigned int m;
 	int ret = 0;
 	int eof = 0;
@@ -1204,8 +1258,10 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct dec_data, go));
+		data[thr].lz4 = lz4;
+	}
 
 	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
 	if (!crc) {
@@ -1286,7 +1342,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	}
 	want = ring_size = i;
 
-	pr_info("Using %u thread(s) for decompression\n", nr_threads);
+	pr_info("Using %u thread(s) for %s decompression\n", nr_threads,
+		alg);
 	pr_info("Loading and decompressing image data (%u pages)...\n",
 		nr_to_read);
 	m = nr_to_read / 10;
@@ -1328,7 +1385,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			if (!asked)
 				break;
 
+			t = ktime_get_ns();
 			ret = hib_wait_io(&hb);
+			io_ns += ktime_get_ns() - t;
 			if (ret)
 				goto out_finish;
 			have += asked;
@@ -1347,8 +1406,8 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
-				pr_err("Invalid LZO compressed length\n");
+			             hib_worst_compress(lz4, LZO_UNC_SIZE))) {
+				pr_err("Invalid %s compressed length\n", alg);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1382,7 +1441,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		 * Wait for more data while we are decompressing.
 		 */
 		if (have < LZO_CMP_PAGES && asked) {
+			t = ktime_get_ns();
 			ret = hib_wait_io(&hb);
+			io_ns += ktime_get_ns() - t;
 			if (ret)
 				goto out_finish;
 			have += asked;
@@ -1392,25 +1453,29 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		}
 
 		for (run_threads = thr, thr = 0; thr < run_threads; thr++) {
+			t = ktime_get_ns();
 			wait_event(data[thr].done,
 			           atomic_read(&data[thr].stop));
 			atomic_set(&data[thr].stop, 0);
+			dec_ns += ktime_get_ns() - t;
 
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				pr_err("LZO decompression failed\n");
+				pr_err("%s decompression failed\n", alg);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].unc_len ||
 			             data[thr].unc_len > LZO_UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
-				pr_err("Invalid LZO uncompressed length\n");
+				pr_err("Invalid %s uncompressed length\n",
+				       alg);
 				ret = -1;
 				goto out_finish;
 			}
 
+			t = ktime_get_ns();
 			for (off = 0;
 			     off < data[thr].unc_len; off += PAGE_SIZE) {
 				memcpy(data_of(*snapshot),
@@ -1429,6 +1494,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 					goto out_finish;
 				}
 			}
+			copy_ns += ktime_get_ns() - t;
 		}
 
 		crc->run_threads = thr;
@@ -1457,6 +1523,13 @@ out_finish:
 		}
 	}
 	swsusp_show_speed(start, stop, nr_to_read, "Read");
+	for (thr = 0; thr < nr_threads; thr++)
+		thr_ns += data[thr].ns;
+	pr_info("Read wait %llu ms, %s wait %llu ms (%llu ms in %u threads), copy %llu ms\n",
+		div_u64(io_ns, NSEC_PER_MSEC), alg,
+		div_u64(dec_ns, NSEC_PER_MSEC),
+		div_u64(thr_ns, NSEC_PER_MSEC), nr_threads,
+		div_u64(copy_ns, NSEC_PER_MSEC));
 out_clean:
 	hib_finish_batch(&hb);
 	for (i = 0; i < ring_size; i++)
@@ -1503,7 +1576,8 @@ int swsusp_read(unsigned int *flags_p)
 	if (!error) {
 		error = (*flags_p & SF_NOCOMPRESS_MODE) ?
 			load_image(&handle, &snapshot, header->pages - 1) :
-			load_image_lzo(&handle, &snapshot, header->pages - 1);
+			load_image_lzo(&handle, &snapshot, header->pages - 1,
+				       *flags_p & SF_COMPRESSION_LZ4);
 	}
 	swap_reader_finish(&handle);
 end:
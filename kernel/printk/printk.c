@@ -47,6 +47,7 @@
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
 #include <linux/sched/task_stack.h>
+#include <linux/kthread.h>
 
 #include <linux/uaccess.h>
 #include <asm/sections.h>
@@ -269,6 +270,9 @@ static void __up_console_sem(unsigned long ip)
  */
 static int console_locked, console_suspended;
 
+/* the consoles have printer threads, see printk_kthread_func() */
+static bool printk_kthreads_running;
+
 /*
  * If exclusive_console is non-NULL then only this console is to be printed to.
  */
@@ -405,6 +409,9 @@ static u64 console_seq;
 static u64 exclusive_console_stop_seq;
 static unsigned long console_dropped;
 
+static bool printk_kthreads_active(void);
+static bool console_is_threaded(struct console *con);
+
 /* the next printk record to read after the last 'clear' command */
 static u64 clear_seq;
 
@@ -1879,8 +1886,8 @@ static int console_trylock_spinning(void)
  * log_buf[start] to log_buf[end - 1].
  * The console_lock must be held.
  */
-static void call_console_drivers(const char *ext_text, size_t ext_len,
-				 const char *text, size_t len)
+static void call_console_drivers(u64 seq, const char *ext_text,
+				 size_t ext_len, const char *text, size_t len)
 {
 	static char dropped_text[64];
 	size_t dropped_len = 0;
@@ -1908,6 +1915,12 @@ static void call_console_drivers(const char *ext_text, size_t ext_len,
 		if (!cpu_online(smp_processor_id()) &&
 		    !(con->flags & CON_ANYTIME))
 			continue;
+		if (console_is_threaded(con))
+			continue;
+		/* already printed by its thread */
+		if (con->seq > seq)
+			continue;
+		con->seq = seq + 1;
 		if (con->flags & CON_EXTENDED)
 			con->write(con, ext_text, ext_len);
 		else {
@@ -2044,8 +2057,11 @@ asmlinkage int vprintk_emit(int facility, int level,
 	printed_len = vprintk_store(facility, level, dev_info, fmt, args);
 	logbuf_unlock_irqrestore(flags);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (printk_kthreads_active()) {
+		/* the printer threads get woken up from irq_work */
+		defer_console_output();
+	} else if (!in_sched) {
+		/* If called from the scheduler, we can not call up(). */
 		/*
 		 * Disable preemption to avoid being preempted while holding
 		 * console_sem which would prevent anyone from printing to
@@ -2113,6 +2129,274 @@ asmlinkage __visible int printk(const char *fmt, ...)
 }
 EXPORT_SYMBOL(printk);
 
+/*
+ * Once the kthreads are up, every console gets its own printer thread and
+ * printk() only wakes them up: the caller never runs the console drivers,
+ * however slow they are. The threads take the console_lock to print, as
+ * the console drivers expect, a batch of records at a time. Each console
+ * follows the ringbuffer at its own pace with its own sequence number and
+ * drops what gets overwritten before it catches up.
+ *
+ * Early in boot, in panic, with an oops in progress and on shutdown, the
+ * consoles are printed to directly from console_unlock() again, starting
+ * from where the slowest console is.
+ */
+static bool printk_threaded = true;
+module_param_named(threaded, printk_threaded, bool, 0444);
+MODULE_PARM_DESC(threaded, "print to the consoles from kthreads");
+
+static DECLARE_WAIT_QUEUE_HEAD(printk_kthread_wait);
+
+/* the records a thread prints before it lets others have the console_lock */
+#define PRINTK_KTHREAD_BATCH	32
+
+static bool printk_kthreads_active(void)
+{
+	return READ_ONCE(printk_kthreads_running) && !oops_in_progress &&
+	       atomic_read(&panic_cpu) == PANIC_CPU_INVALID &&
+	       system_state <= SYSTEM_RUNNING;
+}
+
+static bool printk_kthread_should_wake(struct console *con)
+{
+	return kthread_should_stop() ||
+	       (printk_kthreads_active() && (con->flags & CON_ENABLED) &&
+		prb_read_valid(prb, con->seq, NULL));
+}
+
+/* Returns false if the console has nothing left to print for now */
+static bool printk_kthread_print(struct console *con, struct printk_record *r,
+				 char *ext_text, char *dropped_text)
+{
+	unsigned long flags;
+	bool more = true;
+	int i;
+
+	console_lock();
+	if (console_suspended) {
+		up_console_sem();
+		return false;
+	}
+
+	for (i = 0; i < PRINTK_KTHREAD_BATCH; i++) {
+		size_t len, ext_len = 0, dropped_len = 0;
+
+		if (!printk_kthreads_active() || !(con->flags & CON_ENABLED) ||
+		    !prb_read_valid(prb, con->seq, r)) {
+			more = false;
+			break;
+		}
+
+		if (con->seq != r->info->seq) {
+			con->dropped += r->info->seq - con->seq;
+			con->seq = r->info->seq;
+		}
+
+		if (suppress_message_printing(r->info->level)) {
+			con->seq++;
+			continue;
+		}
+
+		if (con->flags & CON_EXTENDED) {
+			ext_len = info_print_ext_header(ext_text,
+						CONSOLE_EXT_LOG_MAX, r->info);
+			ext_len += msg_print_ext_body(ext_text + ext_len,
+						CONSOLE_EXT_LOG_MAX - ext_len,
+						&r->text_buf[0],
+						r->info->text_len,
+						&r->info->dev_info);
+		} else if (con->dropped) {
+			dropped_len = snprintf(dropped_text, 64,
+				"** %lu printk messages dropped **\n",
+				con->dropped);
+			con->dropped = 0;
+		}
+		len = record_print_text(r,
+				console_msg_format & MSG_FORMAT_SYSLOG,
+				printk_time);
+		con->seq++;
+
+		trace_console_rcuidle(r->text_buf, len);
+
+		printk_safe_enter_irqsave(flags);
+		stop_critical_timings();	/* don't trace print latency */
+		if (ext_len) {
+			con->write(con, ext_text, ext_len);
+		} else {
+			if (dropped_len)
+				con->write(con, dropped_text, dropped_len);
+			con->write(con, r->text_buf, len);
+		}
+		start_critical_timings();
+		printk_safe_exit_irqrestore(flags);
+	}
+
+	console_locked = 0;
+	up_console_sem();
+	return more;
+}
+
+/* The buffers of a printer thread, allocated before it is started */
+struct printk_kthread_data {
+	struct console *con;
+	char *text;
+	char *ext_text;
+	char *dropped_text;
+};
+
+static void printk_kthread_data_free(struct printk_kthread_data *d)
+{
+	kfree(d->ext_text);
+	kfree(d->dropped_text);
+	kfree(d->text);
+	kfree(d);
+}
+
+static struct printk_kthread_data *
+printk_kthread_data_alloc(struct console *con)
+{
+	struct printk_kthread_data *d;
+
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	if (!d)
+		return NULL;
+
+	d->con = con;
+	d->text = kmalloc(LOG_LINE_MAX + PREFIX_MAX, GFP_KERNEL);
+	d->dropped_text = kmalloc(64, GFP_KERNEL);
+	if (con->flags & CON_EXTENDED)
+		d->ext_text = kmalloc(CONSOLE_EXT_LOG_MAX, GFP_KERNEL);
+	if (!d->text || !d->dropped_text ||
+	    ((con->flags & CON_EXTENDED) && !d->ext_text)) {
+		printk_kthread_data_free(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+static int printk_kthread_func(void *data)
+{
+	struct printk_kthread_data *d = data;
+	struct console *con = d->con;
+	struct printk_info info;
+	struct printk_record r;
+
+	prb_rec_init_rd(&r, &info, d->text, LOG_LINE_MAX + PREFIX_MAX);
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(printk_kthread_wait,
+					 printk_kthread_should_wake(con));
+		if (kthread_should_stop())
+			break;
+
+		while (printk_kthread_print(con, &r, d->ext_text,
+					    d->dropped_text))
+			cond_resched();
+	}
+
+	return 0;
+}
+
+/*
+ * Called with the console_lock held. A console without a thread, because
+ * it could not be started, keeps being printed to from console_unlock().
+ */
+static void printk_start_kthread(struct console *con)
+{
+	struct printk_kthread_data *d;
+	struct task_struct *thread;
+
+	if (!con->write || con->thread)
+		return;
+
+	d = printk_kthread_data_alloc(con);
+	if (!d)
+		goto err;
+
+	thread = kthread_run(printk_kthread_func, d, "pr/%s%d",
+			     con->name, con->index);
+	if (IS_ERR(thread)) {
+		printk_kthread_data_free(d);
+		goto err;
+	}
+	con->thread = thread;
+	return;
+err:
+	pr_err("%s%d: failed to start the printer thread, printing directly\n",
+	       con->name, con->index);
+}
+
+/* Must not be called with the console_lock held, the thread may wait on it */
+static void printk_stop_kthread(struct console *con)
+{
+	struct printk_kthread_data *d;
+
+	if (con->thread) {
+		/* the thread function may not even have run */
+		d = kthread_data(con->thread);
+		kthread_stop(con->thread);
+		printk_kthread_data_free(d);
+		con->thread = NULL;
+	}
+}
+
+/* Whether @con is printed to by its thread rather than by console_unlock() */
+static bool console_is_threaded(struct console *con)
+{
+	return con->thread && printk_kthreads_active();
+}
+
+/* Whether some console has to be printed to from console_unlock() */
+static bool console_direct_pending(void)
+{
+	struct console *con;
+
+	for_each_console(con) {
+		if ((con->flags & CON_ENABLED) && con->write &&
+		    !console_is_threaded(con))
+			return true;
+	}
+	return false;
+}
+
+static void printk_kthreads_wake(void)
+{
+	if (printk_kthreads_active() && wq_has_sleeper(&printk_kthread_wait))
+		wake_up_interruptible_all(&printk_kthread_wait);
+}
+
+static void console_sync_seqs(void);
+
+static int __init printk_kthreads_init(void)
+{
+	struct console *con;
+
+	if (!printk_threaded)
+		return 0;
+
+	console_lock();
+	/* start from where console_unlock() left the consoles */
+	console_sync_seqs();
+	exclusive_console = NULL;
+	for_each_console(con)
+		printk_start_kthread(con);
+	WRITE_ONCE(printk_kthreads_running, true);
+	console_unlock();
+
+	return 0;
+}
+late_initcall(printk_kthreads_init);
+
+/* How many records the console has yet to go through */
+u64 console_backlog(struct console *con)
+{
+	u64 next = prb_next_seq(prb);
+	u64 seq = READ_ONCE(con->seq);
+
+	return next > seq ? next - seq : 0;
+}
+
 #else /* CONFIG_PRINTK */
 
 #define LOG_LINE_MAX		0
@@ -2121,6 +2405,7 @@ EXPORT_SYMBOL(printk);
 
 #define prb_read_valid(rb, seq, r)	false
 #define prb_first_valid_seq(rb)		0
+#define prb_next_seq(rb)		0
 
 static u64 syslog_seq;
 static u64 console_seq;
@@ -2142,9 +2427,17 @@ static ssize_t msg_print_ext_body(char *buf, size_t size,
 				  struct dev_printk_info *dev_info) { return 0; }
 static void console_lock_spinning_enable(void) { }
 static int console_lock_spinning_disable_and_check(void) { return 0; }
-static void call_console_drivers(const char *ext_text, size_t ext_len,
-				 const char *text, size_t len) {}
+static void call_console_drivers(u64 seq, const char *ext_text,
+				 size_t ext_len, const char *text,
+				 size_t len) {}
 static bool suppress_message_printing(int level) { return false; }
+static bool printk_kthreads_active(void) { return false; }
+static bool console_is_threaded(struct console *con) { return false; }
+static bool console_direct_pending(void) { return true; }
+static void printk_kthreads_wake(void) { }
+static void printk_start_kthread(struct console *con) { }
+static void printk_stop_kthread(struct console *con) { }
+u64 console_backlog(struct console *con) { return 0; }
 
 #endif /* CONFIG_PRINTK */
 
@@ -2416,6 +2709,48 @@ static inline int can_use_console(void)
 	return cpu_online(raw_smp_processor_id()) || have_callable_console();
 }
 
+/*
+ * Bring the consoles up to console_seq: the records before it were printed
+ * or skipped for all of them, but for a console replaying the buffer alone
+ * and those that have a thread of their own.
+ */
+static void console_sync_seqs(void)
+{
+	struct console *con;
+
+	for_each_console(con) {
+		u64 seq = console_seq;
+
+		if (console_is_threaded(con))
+			continue;
+
+		if (exclusive_console && con != exclusive_console)
+			seq = exclusive_console_stop_seq;
+		if (con->seq < seq)
+			con->seq = seq;
+	}
+}
+
+/*
+ * Printing directly after the threads did, resume from the slowest console
+ * that is not left to its thread. That may be behind console_seq when the
+ * threads just stopped, call_console_drivers() skips what is done already.
+ */
+static void console_seq_from_consoles(void)
+{
+	u64 seq = U64_MAX;
+	struct console *con;
+
+	for_each_console(con) {
+		if (!(con->flags & CON_ENABLED) || console_is_threaded(con))
+			continue;
+		if (con->seq < seq)
+			seq = con->seq;
+	}
+	if (seq != U64_MAX)
+		console_seq = seq;
+}
+
 /**
  * console_unlock - unlock the console system
  *
@@ -2438,12 +2773,21 @@ void console_unlock(void)
 	bool do_cond_resched, retry;
 	struct printk_info info;
 	struct printk_record r;
+	u64 seq;
 
 	if (console_suspended) {
 		up_console_sem();
 		return;
 	}
 
+	/* the printer threads do the printing, but for consoles without one */
+	if (printk_kthreads_active() && !console_direct_pending()) {
+		console_locked = 0;
+		up_console_sem();
+		printk_kthreads_wake();
+		return;
+	}
+
 	prb_rec_init_rd(&r, &info, text, sizeof(text));
 
 	/*
@@ -2475,6 +2819,12 @@ again:
 		return;
 	}
 
+	if (READ_ONCE(printk_kthreads_running)) {
+		logbuf_lock_irqsave(flags);
+		console_seq_from_consoles();
+		logbuf_unlock_irqrestore(flags);
+	}
+
 	for (;;) {
 		size_t ext_len = 0;
 		size_t len;
@@ -2523,7 +2873,7 @@ skip:
 		len = record_print_text(&r,
 				console_msg_format & MSG_FORMAT_SYSLOG,
 				printk_time);
-		console_seq++;
+		seq = console_seq++;
 		raw_spin_unlock(&logbuf_lock);
 
 		/*
@@ -2535,7 +2885,7 @@ skip:
 		console_lock_spinning_enable();
 
 		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(ext_text, ext_len, text, len);
+		call_console_drivers(seq, ext_text, ext_len, text, len);
 		start_critical_timings();
 
 		if (console_lock_spinning_disable_and_check()) {
@@ -2549,6 +2899,9 @@ skip:
 			cond_resched();
 	}
 
+	/* the consoles that skipped the last records are done with them too */
+	console_sync_seqs();
+
 	console_locked = 0;
 
 	raw_spin_unlock(&logbuf_lock);
@@ -2566,6 +2919,9 @@ skip:
 	raw_spin_unlock(&logbuf_lock);
 	printk_safe_exit_irqrestore(flags);
 
+	/* the consoles that have a thread were left to it */
+	printk_kthreads_wake();
+
 	if (retry && console_trylock())
 		goto again;
 }
@@ -2629,9 +2985,12 @@ void console_flush_on_panic(enum con_flush_mode mode)
 
 	if (mode == CONSOLE_REPLAY_ALL) {
 		unsigned long flags;
+		struct console *c;
 
 		logbuf_lock_irqsave(flags);
 		console_seq = prb_first_valid_seq(prb);
+		for_each_console(c)
+			c->seq = console_seq;
 		logbuf_unlock_irqrestore(flags);
 	}
 	console_unlock();
@@ -2856,7 +3215,15 @@ void register_console(struct console *newcon)
 	if (newcon->flags & CON_EXTENDED)
 		nr_ext_console_drivers++;
 
-	if (newcon->flags & CON_PRINTBUFFER) {
+	newcon->seq = printk_kthreads_running ? prb_next_seq(prb) : console_seq;
+	newcon->dropped = 0;
+
+	if ((newcon->flags & CON_PRINTBUFFER) && printk_kthreads_running) {
+		/* the thread of the console replays the log buffer on its own */
+		logbuf_lock_irqsave(flags);
+		newcon->seq = syslog_seq;
+		logbuf_unlock_irqrestore(flags);
+	} else if (newcon->flags & CON_PRINTBUFFER) {
 		/*
 		 * console_unlock(); will print out the buffered messages
 		 * for us.
@@ -2874,8 +3241,11 @@ void register_console(struct console *newcon)
 		exclusive_console = newcon;
 		exclusive_console_stop_seq = console_seq;
 		console_seq = syslog_seq;
+		newcon->seq = syslog_seq;
 		logbuf_unlock_irqrestore(flags);
 	}
+	if (printk_kthreads_running)
+		printk_start_kthread(newcon);
 	console_unlock();
 	console_sysfs_notify();
 
@@ -2917,6 +3287,9 @@ int unregister_console(struct console *console)
 	if (res > 0)
 		return 0;
 
+	/* before the console_lock, the thread may be waiting for it */
+	printk_stop_kthread(console);
+
 	res = -ENODEV;
 	console_lock();
 	if (console_drivers == console) {
@@ -3056,7 +3429,9 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_kthreads_active())
+			printk_kthreads_wake();
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -60,6 +60,8 @@
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
 #include <linux/kasan.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "../time/tick-internal.h"
 
 #include "tree.h"
@@ -84,10 +86,13 @@ static DEFINE_PER_CPU_SHARED_ALIGNED(struct rcu_data, rcu_data) = {
 	.dynticks_nmi_nesting = DYNTICK_IRQ_NONIDLE,
 	.dynticks = ATOMIC_INIT(RCU_DYNTICK_CTRL_CTR),
 };
+/* Start grace-period numbering near wrap to flush out overflow bugs. */
+#define RCU_GP_SEQ_INIT	((0UL - 300UL) << RCU_SEQ_CTR_SHIFT)
+
 static struct rcu_state rcu_state = {
 	.level = { &rcu_state.node[0] },
 	.gp_state = RCU_GP_IDLE,
-	.gp_seq = (0UL - 300UL) << RCU_SEQ_CTR_SHIFT,
+	.gp_seq = RCU_GP_SEQ_INIT,
 	.barrier_mutex = __MUTEX_INITIALIZER(rcu_state.barrier_mutex),
 	.name = RCU_NAME,
 	.abbr = RCU_ABBR,
@@ -2762,6 +2767,7 @@ static void invoke_rcu_core(void)
 {
 	if (!cpu_online(smp_processor_id()))
 		return;
+	this_cpu_inc(rcu_data.n_cb_wakeups);
 	if (use_softirq)
 		raise_softirq(RCU_SOFTIRQ);
 	else
@@ -3036,6 +3042,238 @@ void call_rcu(struct rcu_head *head, rcu_callback_t func)
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
+/*
+ * Lazy callbacks.  Callers that only free memory, and so do not care
+ * when their callback runs, can use call_rcu_lazy() to have it parked on
+ * a per-CPU list for up to lazy_flush_jiffies before it is handed to
+ * call_rcu().  On a mostly idle system this batches the frees of many
+ * seconds into one grace period, instead of having each close() or
+ * dentry kill start a grace period of its own and wake up the CPUs for
+ * it.  The flush timer is deferrable so it does not wake an idle CPU
+ * either; the list is flushed early once it holds lazy_max callbacks,
+ * under memory pressure, for rcu_barrier() and when the CPU goes offline.
+ *
+ * Boot and sysfs tunables:
+ * rcutree.lazy_cbs=		[bool] Park call_rcu_lazy() callbacks.
+ *				When off they go straight to call_rcu().
+ * rcutree.lazy_flush_jiffies=	[ulong] Longest a callback stays parked.
+ * rcutree.lazy_max=		[long] Per-CPU count of parked callbacks
+ *				that triggers an early flush.
+ */
+static bool lazy_cbs = true;
+module_param(lazy_cbs, bool, 0644);
+static ulong lazy_flush_jiffies = 10 * HZ;
+module_param(lazy_flush_jiffies, ulong, 0644);
+static long lazy_max = 10000;
+module_param(lazy_max, long, 0644);
+
+struct rcu_lazy_cpu {
+	raw_spinlock_t lock;
+	struct rcu_head *head;
+	struct rcu_head **tail;
+	long len;
+	unsigned long n_queued;
+	struct timer_list timer;
+};
+
+static DEFINE_PER_CPU(struct rcu_lazy_cpu, rcu_lazy_data);
+
+enum rcu_lazy_reason {
+	RCU_LAZY_TIMER,
+	RCU_LAZY_FULL,
+	RCU_LAZY_SHRINKER,
+	RCU_LAZY_BARRIER,
+	RCU_LAZY_HOTPLUG,
+	RCU_LAZY_NR_REASONS,
+};
+
+static const char * const rcu_lazy_reason_names[] = {
+	"timer", "full", "shrinker", "barrier", "hotplug",
+};
+
+static atomic_long_t rcu_lazy_flushes[RCU_LAZY_NR_REASONS];
+
+/* Flushes that took a list but did not pass it to call_rcu() yet. */
+static atomic_t rcu_lazy_flushing;
+
+static unsigned long rcu_lazy_flush(struct rcu_lazy_cpu *rlp,
+				    enum rcu_lazy_reason reason)
+{
+	struct rcu_head *head, *next;
+	unsigned long flags;
+	long len;
+
+	raw_spin_lock_irqsave(&rlp->lock, flags);
+	len = rlp->len;
+	head = rlp->head;
+	if (len)
+		atomic_inc(&rcu_lazy_flushing);
+	rlp->head = NULL;
+	rlp->tail = &rlp->head;
+	rlp->len = 0;
+	raw_spin_unlock_irqrestore(&rlp->lock, flags);
+	if (!len)
+		return 0;
+
+	for (; head; head = next) {
+		next = head->next;
+		call_rcu(head, head->func);
+	}
+	atomic_dec(&rcu_lazy_flushing);
+	atomic_long_inc(&rcu_lazy_flushes[reason]);
+	return len;
+}
+
+static void rcu_lazy_timer(struct timer_list *t)
+{
+	rcu_lazy_flush(from_timer(rlp, t, timer), RCU_LAZY_TIMER);
+}
+
+/* Hand all lazy callbacks to call_rcu(), for rcu_barrier(). */
+static void rcu_lazy_flush_all(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		rcu_lazy_flush(per_cpu_ptr(&rcu_lazy_data, cpu),
+			       RCU_LAZY_BARRIER);
+	/* A concurrent flush may still hold callbacks queued before us. */
+	while (atomic_read(&rcu_lazy_flushing))
+		schedule_timeout_uninterruptible(1);
+}
+
+/**
+ * call_rcu_lazy() - Queue an RCU callback that may be delayed.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Like call_rcu(), except that the grace period the callback waits for
+ * may start up to a few seconds later, so that the callbacks of an idle
+ * system can be batched.  Only use it for callbacks that free memory and
+ * nothing waits for.  rcu_barrier() waits for lazy callbacks too.
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	struct rcu_lazy_cpu *rlp;
+	unsigned long flags;
+	long len;
+
+	if (!READ_ONCE(lazy_cbs) ||
+	    rcu_scheduler_active != RCU_SCHEDULER_RUNNING) {
+		call_rcu(head, func);
+		return;
+	}
+
+	head->func = func;
+	head->next = NULL;
+	local_irq_save(flags);
+	rlp = this_cpu_ptr(&rcu_lazy_data);
+	raw_spin_lock(&rlp->lock);
+	*rlp->tail = head;
+	rlp->tail = &head->next;
+	len = ++rlp->len;
+	rlp->n_queued++;
+	if (len == 1)
+		mod_timer(&rlp->timer, jiffies + READ_ONCE(lazy_flush_jiffies));
+	raw_spin_unlock(&rlp->lock);
+	local_irq_restore(flags);
+
+	if (len >= READ_ONCE(lazy_max))
+		rcu_lazy_flush(rlp, RCU_LAZY_FULL);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+
+static unsigned long
+rcu_lazy_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(&rcu_lazy_data, cpu)->len);
+
+	return count;
+}
+
+static unsigned long
+rcu_lazy_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
+{
+	unsigned long freed = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		freed += rcu_lazy_flush(per_cpu_ptr(&rcu_lazy_data, cpu),
+					RCU_LAZY_SHRINKER);
+		if (freed >= sc->nr_to_scan)
+			break;
+	}
+
+	return freed == 0 ? SHRINK_STOP : freed;
+}
+
+static struct shrinker rcu_lazy_shrinker = {
+	.count_objects = rcu_lazy_shrink_count,
+	.scan_objects = rcu_lazy_shrink_scan,
+	.batch = 0,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static void __init rcu_lazy_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_lazy_cpu *rlp = per_cpu_ptr(&rcu_lazy_data, cpu);
+
+		raw_spin_lock_init(&rlp->lock);
+		rlp->tail = &rlp->head;
+		timer_setup(&rlp->timer, rcu_lazy_timer, TIMER_DEFERRABLE);
+	}
+	if (register_shrinker(&rcu_lazy_shrinker))
+		pr_err("Failed to register call_rcu_lazy() shrinker!\n");
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int rcu_stats_show(struct seq_file *m, void *v)
+{
+	unsigned long wakeups = 0, nocb_wakeups = 0, queued = 0;
+	long pending = 0;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_data *rdp = per_cpu_ptr(&rcu_data, cpu);
+		struct rcu_lazy_cpu *rlp = per_cpu_ptr(&rcu_lazy_data, cpu);
+
+		wakeups += READ_ONCE(rdp->n_cb_wakeups);
+#ifdef CONFIG_RCU_NOCB_CPU
+		nocb_wakeups += READ_ONCE(rdp->n_nocb_gp_wakeups);
+#endif
+		queued += READ_ONCE(rlp->n_queued);
+		pending += READ_ONCE(rlp->len);
+	}
+
+	seq_printf(m, "gps_completed: %lu\n",
+		   rcu_seq_ctr(READ_ONCE(rcu_state.gp_seq) - RCU_GP_SEQ_INIT));
+	seq_printf(m, "core_wakeups: %lu\n", wakeups);
+	seq_printf(m, "nocb_gp_wakeups: %lu\n", nocb_wakeups);
+	seq_printf(m, "lazy_queued: %lu\n", queued);
+	seq_printf(m, "lazy_pending: %ld\n", pending);
+	for (i = 0; i < RCU_LAZY_NR_REASONS; i++)
+		seq_printf(m, "lazy_flush_%s: %ld\n", rcu_lazy_reason_names[i],
+			   atomic_long_read(&rcu_lazy_flushes[i]));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(rcu_stats);
+
+static int __init rcu_debugfs_init(void)
+{
+	struct dentry *dir = debugfs_create_dir("rcu", NULL);
+
+	debugfs_create_file("stats", 0444, dir, NULL, &rcu_stats_fops);
+	return 0;
+}
+late_initcall(rcu_debugfs_init);
+#endif /* #ifdef CONFIG_DEBUG_FS */
 
 /* Maximum number of jiffies to wait before draining a batch. */
 #define KFREE_DRAIN_JIFFIES (HZ / 50)
@@ -3834,7 +4072,11 @@ void rcu_barrier(void)
 {
 	uintptr_t cpu;
 	struct rcu_data *rdp;
-	unsigned long s = rcu_seq_snap(&rcu_state.barrier_sequence);
+	unsigned long s;
+
+	/* Lazy callbacks queued before us must be waited for as well. */
+	rcu_lazy_flush_all();
+	s = rcu_seq_snap(&rcu_state.barrier_sequence);
 
 	rcu_barrier_trace(TPS("Begin"), -1, s);
 
@@ -4171,6 +4413,7 @@ void rcutree_migrate_callbacks(int cpu)
 	struct rcu_data *rdp = per_cpu_ptr(&rcu_data, cpu);
 	bool needwake;
 
+	rcu_lazy_flush(per_cpu_ptr(&rcu_lazy_data, cpu), RCU_LAZY_HOTPLUG);
 	if (rcu_segcblist_is_offloaded(&rdp->cblist) ||
 	    rcu_segcblist_empty(&rdp->cblist))
 		return;  /* No callbacks to migrate. */
@@ -4511,6 +4754,7 @@ void __init rcu_init(void)
 	rcu_early_boot_tests();
 
 	kfree_rcu_batch_init();
+	rcu_lazy_init();
 	rcu_bootup_announce();
 	rcu_init_geometry();
 	rcu_init_one();
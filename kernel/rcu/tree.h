@@ -174,6 +174,7 @@ struct rcu_data {
 	long		qlen_last_fqs_check;
 					/* qlen at last check for QS forcing */
 	unsigned long	n_cbs_invoked;	/* # callbacks invoked since boot. */
+	unsigned long	n_cb_wakeups;	/* # RCU core wakeups since boot. */
 	unsigned long	n_force_qs_snap;
 					/* did other CPU force QS recently? */
 	long		blimit;		/* Upper limit on a processed batch */
@@ -222,6 +223,7 @@ struct rcu_data {
 	u8 nocb_gp_gp;			/* GP to wait for on last scan? */
 	unsigned long nocb_gp_seq;	/*  If so, ->gp_seq to wait for. */
 	unsigned long nocb_gp_loops;	/* # passes through wait code. */
+	unsigned long n_nocb_gp_wakeups; /* # GP kthread wakeups. */
 	struct swait_queue_head nocb_gp_wq; /* For nocb kthreads to sleep on. */
 	bool nocb_cb_sleep;		/* Is the nocb CB thread asleep? */
 	struct task_struct *nocb_cb_kthread;
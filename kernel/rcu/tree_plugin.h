@@ -1650,6 +1650,8 @@ static void wake_nocb_gp(struct rcu_data *rdp, bool force,
 	raw_spin_lock_irqsave(&rdp_gp->nocb_gp_lock, flags);
 	if (force || READ_ONCE(rdp_gp->nocb_gp_sleep)) {
 		WRITE_ONCE(rdp_gp->nocb_gp_sleep, false);
+		WRITE_ONCE(rdp_gp->n_nocb_gp_wakeups,
+			   rdp_gp->n_nocb_gp_wakeups + 1);
 		needwake = true;
 		trace_rcu_nocb_wake(rcu_state.name, rdp->cpu, TPS("DoWake"));
 	}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Scheduling policy hooks implemented in BPF.
+ *
+ * The Android vendor hooks let a module take over task placement, which
+ * needs a rebuilt module for every change of the policy. A BPF_MAP_TYPE_
+ * STRUCT_OPS map of type sched_policy_ops is consulted at the same points
+ * right after the vendor hooks, so policies can be loaded, compared and
+ * dropped at runtime. Only one policy is attached at a time, and the
+ * scheduler falls back to its own choice for every callback a policy
+ * leaves out or answers with a negative value.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+
+#include "sched.h"
+
+DEFINE_STATIC_KEY_FALSE(sched_policy_ops_enabled);
+struct sched_policy_ops __rcu *sched_policy_ops;
+static DEFINE_MUTEX(sched_policy_ops_mutex);
+
+static int sched_policy_ops_init(struct btf *btf)
+{
+	return 0;
+}
+
+static bool sched_policy_ops_is_valid_access(int off, int size,
+					     enum bpf_access_type type,
+					     const struct bpf_prog *prog,
+					     struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off >= sizeof(__u64) * MAX_BPF_FUNC_ARGS)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+
+	return btf_ctx_access(off, size, type, prog, info);
+}
+
+/* The callbacks run under scheduler locks, tasks are only read */
+static int sched_policy_ops_btf_struct_access(struct bpf_verifier_log *log,
+					      const struct btf_type *t, int off,
+					      int size,
+					      enum bpf_access_type atype,
+					      u32 *next_btf_id)
+{
+	if (atype != BPF_READ) {
+		bpf_log(log, "only read is supported\n");
+		return -EACCES;
+	}
+
+	return btf_struct_access(log, t, off, size, atype, next_btf_id);
+}
+
+static const struct bpf_func_proto *
+sched_policy_ops_get_func_proto(enum bpf_func_id func_id,
+				const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id);
+}
+
+static const struct bpf_verifier_ops sched_policy_ops_verifier_ops = {
+	.get_func_proto		= sched_policy_ops_get_func_proto,
+	.is_valid_access	= sched_policy_ops_is_valid_access,
+	.btf_struct_access	= sched_policy_ops_btf_struct_access,
+};
+
+static int sched_policy_ops_init_member(const struct btf_type *t,
+					const struct btf_member *member,
+					void *kdata, const void *udata)
+{
+	const struct sched_policy_ops *uops = udata;
+	struct sched_policy_ops *ops = kdata;
+	u32 moff;
+
+	moff = btf_member_bit_offset(t, member) / 8;
+	switch (moff) {
+	case offsetof(struct sched_policy_ops, name):
+		if (bpf_obj_name_cpy(ops->name, uops->name,
+				     sizeof(ops->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	/* all callbacks are optional */
+	return 0;
+}
+
+static int sched_policy_ops_reg(void *kdata)
+{
+	struct sched_policy_ops *ops = kdata;
+	int err = 0;
+
+	mutex_lock(&sched_policy_ops_mutex);
+	if (rcu_access_pointer(sched_policy_ops)) {
+		err = -EBUSY;
+		goto out;
+	}
+	rcu_assign_pointer(sched_policy_ops, ops);
+	static_branch_enable(&sched_policy_ops_enabled);
+	pr_info("sched: BPF policy %s attached\n", ops->name);
+out:
+	mutex_unlock(&sched_policy_ops_mutex);
+	return err;
+}
+
+static void sched_policy_ops_unreg(void *kdata)
+{
+	struct sched_policy_ops *ops = kdata;
+
+	mutex_lock(&sched_policy_ops_mutex);
+	if (rcu_access_pointer(sched_policy_ops) == ops) {
+		static_branch_disable(&sched_policy_ops_enabled);
+		RCU_INIT_POINTER(sched_policy_ops, NULL);
+		pr_info("sched: BPF policy %s detached\n", ops->name);
+	}
+	mutex_unlock(&sched_policy_ops_mutex);
+
+	/* the callers run with preemption disabled */
+	synchronize_rcu();
+}
+
+/* Avoid sparse warning.  It is only used in bpf_struct_ops.c. */
+extern struct bpf_struct_ops bpf_sched_policy_ops;
+
+struct bpf_struct_ops bpf_sched_policy_ops = {
+	.verifier_ops = &sched_policy_ops_verifier_ops,
+	.reg = sched_policy_ops_reg,
+	.unreg = sched_policy_ops_unreg,
+	.init_member = sched_policy_ops_init_member,
+	.init = sched_policy_ops_init,
+	.name = "sched_policy_ops",
+};
@@ -313,6 +313,29 @@ static void update_rq_clock_task(struct rq *rq, s64 delta)
 	update_rq_clock_pelt(rq, delta);
 }
 
+/*
+ * Track which share of its time the host has recently been taking away from
+ * this vCPU, as an average over the last ~8 ticks.
+ */
+static void update_steal_avg(struct rq *rq)
+{
+#ifdef CONFIG_PARAVIRT_TIME_ACCOUNTING
+	u64 period = rq_clock(rq) - rq->steal_stamp_time;
+	u64 steal = rq->prev_steal_time_rq - rq->steal_stamp;
+	unsigned int avg = rq->avg_steal, sample;
+
+	if (!static_key_false(&paravirt_steal_rq_enabled) || !period)
+		return;
+
+	rq->steal_stamp_time = rq_clock(rq);
+	rq->steal_stamp = rq->prev_steal_time_rq;
+
+	sample = min_t(u64, div64_u64(steal << SCHED_CAPACITY_SHIFT, period),
+		       SCHED_CAPACITY_SCALE);
+	WRITE_ONCE(rq->avg_steal, avg - (avg >> 3) + (sample >> 3));
+#endif
+}
+
 void update_rq_clock(struct rq *rq)
 {
 	s64 delta;
@@ -3484,6 +3507,7 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 
 		p->prio = p->normal_prio = __normal_prio(p);
 		set_load_weight(p, false);
+		p->se.latency_nice = 0;
 
 		/*
 		 * We don't need the reset flag anymore after the fork. It has
@@ -4238,6 +4262,7 @@ void scheduler_tick(void)
 
 	trace_android_rvh_tick_entry(rq);
 	update_rq_clock(rq);
+	update_steal_avg(rq);
 	thermal_pressure = arch_scale_thermal_pressure(cpu_of(rq));
 	update_thermal_load_avg(rq_clock_thermal(rq), rq, thermal_pressure);
 	curr->sched_class->task_tick(rq, curr, 0);
@@ -5559,6 +5584,11 @@ recheck:
 		/* Can't change util-clamps */
 		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
 			return -EPERM;
+
+		/* Can't ask for a lower wakeup latency */
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice < p->se.latency_nice)
+			return -EPERM;
 	}
 
 	if (user) {
@@ -5577,6 +5607,11 @@ recheck:
 			return retval;
 	}
 
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    (attr->sched_latency_nice < MIN_LATENCY_NICE ||
+	     attr->sched_latency_nice > MAX_LATENCY_NICE))
+		return -EINVAL;
+
 	/*
 	 * Make sure no PI-waiters arrive (or leave) while we are
 	 * changing the priority of the task:
@@ -5608,6 +5643,9 @@ recheck:
 			goto change;
 		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
 			goto change;
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice != p->se.latency_nice)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		retval = 0;
@@ -5691,6 +5729,8 @@ change:
 
 	__setscheduler(rq, p, attr, pi);
 	__setscheduler_uclamp(p, attr);
+	if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE)
+		p->se.latency_nice = attr->sched_latency_nice;
 
 	if (queued) {
 		/*
@@ -5893,6 +5933,10 @@ static int sched_copy_attr(struct sched_attr __user *uattr, struct sched_attr *a
 	    size < SCHED_ATTR_SIZE_VER1)
 		return -EINVAL;
 
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    size < SCHED_ATTR_SIZE_VER2)
+		return -EINVAL;
+
 	/*
 	 * XXX: Do we want to be lenient like existing syscalls; or do we want
 	 * to be strict and return an error on out-of-bounds values?
@@ -6139,6 +6183,7 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	kattr.sched_util_min = p->uclamp_req[UCLAMP_MIN].value;
 	kattr.sched_util_max = p->uclamp_req[UCLAMP_MAX].value;
 #endif
+	kattr.sched_latency_nice = p->se.latency_nice;
 
 	rcu_read_unlock();
 
@@ -8299,6 +8344,18 @@ static u64 cpu_shares_read_u64(struct cgroup_subsys_state *css,
 	return (u64) scale_load_down(tg->shares);
 }
 
+static s64 cpu_latency_nice_read_s64(struct cgroup_subsys_state *css,
+				     struct cftype *cft)
+{
+	return css_tg(css)->latency_nice;
+}
+
+static int cpu_latency_nice_write_s64(struct cgroup_subsys_state *css,
+				      struct cftype *cft, s64 nice)
+{
+	return sched_group_set_latency(css_tg(css), nice);
+}
+
 #ifdef CONFIG_CFS_BANDWIDTH
 static DEFINE_MUTEX(cfs_constraints_mutex);
 
@@ -8606,6 +8663,12 @@ static struct cftype cpu_legacy_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency.nice",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -8813,6 +8876,12 @@ static struct cftype cpu_files[] = {
 		.read_s64 = cpu_weight_nice_read_s64,
 		.write_s64 = cpu_weight_nice_write_s64,
 	},
+	{
+		.name = "latency.nice",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -18,7 +18,10 @@
 
 struct sugov_tunables {
 	struct gov_attr_set	attr_set;
-	unsigned int		rate_limit_us;
+	unsigned int		up_rate_limit_us;
+	unsigned int		down_rate_limit_us;
+	unsigned int		iowait_boost_max;
+	bool			predictive_boost;
 };
 
 struct sugov_policy {
@@ -29,9 +32,20 @@ struct sugov_policy {
 
 	raw_spinlock_t		update_lock;	/* For shared policies */
 	u64			last_freq_update_time;
-	s64			freq_update_delay_ns;
+	s64			min_rate_limit_ns;
+	s64			up_rate_delay_ns;
+	s64			down_rate_delay_ns;
 	unsigned int		next_freq;
 	unsigned int		cached_raw_freq;
+	unsigned int		prev_cached_raw_freq;
+
+	unsigned int		iowait_boost_max;
+	bool			predictive_boost;
+
+	/* Input of the last frequency request, for tracing */
+	unsigned long		util;
+	unsigned long		max;
+	unsigned int		reason;
 
 	/* The next fields are only needed if fast switch cannot be used: */
 	struct			irq_work irq_work;
@@ -52,7 +66,10 @@ struct sugov_cpu {
 
 	bool			iowait_boost_pending;
 	unsigned int		iowait_boost;
+	bool			pred_boost_pending;
+	unsigned long		pred_boost;
 	u64			last_update;
+	unsigned int		reason;
 
 	unsigned long		bw_dl;
 	unsigned long		max;
@@ -97,19 +114,49 @@ static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
 
 	delta_ns = time - sg_policy->last_freq_update_time;
 
-	return delta_ns >= sg_policy->freq_update_delay_ns;
+	/* No need to recalculate next freq for min_rate_limit_us at least */
+	return delta_ns >= sg_policy->min_rate_limit_ns;
+}
+
+static bool sugov_up_down_rate_limit(struct sugov_policy *sg_policy, u64 time,
+				     unsigned int next_freq)
+{
+	s64 delta_ns = time - sg_policy->last_freq_update_time;
+
+	if (next_freq > sg_policy->next_freq &&
+	    delta_ns < sg_policy->up_rate_delay_ns)
+		return true;
+
+	if (next_freq < sg_policy->next_freq &&
+	    delta_ns < sg_policy->down_rate_delay_ns)
+		return true;
+
+	return false;
 }
 
 static bool sugov_update_next_freq(struct sugov_policy *sg_policy, u64 time,
 				   unsigned int next_freq)
 {
+	unsigned int reason = sg_policy->reason;
+
 	if (!sg_policy->need_freq_update) {
 		if (sg_policy->next_freq == next_freq)
 			return false;
+
+		if (sugov_up_down_rate_limit(sg_policy, time, next_freq)) {
+			/* Restore cached freq as next_freq is not changed */
+			sg_policy->cached_raw_freq = sg_policy->prev_cached_raw_freq;
+			return false;
+		}
 	} else {
 		sg_policy->need_freq_update = cpufreq_driver_test_flags(CPUFREQ_NEED_UPDATE_LIMITS);
+		reason |= SUGOV_REASON_LIMITS;
 	}
 
+	trace_sugov_next_freq(sg_policy->policy->cpu, sg_policy->util,
+			      sg_policy->max, sg_policy->next_freq, next_freq,
+			      reason);
+
 	sg_policy->next_freq = next_freq;
 	sg_policy->last_freq_update_time = time;
 
@@ -175,6 +222,7 @@ static unsigned int get_next_freq(struct sugov_policy *sg_policy,
 	if (freq == sg_policy->cached_raw_freq && !sg_policy->need_freq_update)
 		return sg_policy->next_freq;
 
+	sg_policy->prev_cached_raw_freq = sg_policy->cached_raw_freq;
 	sg_policy->cached_raw_freq = freq;
 	return cpufreq_driver_resolve_freq(policy, freq);
 }
@@ -294,6 +342,7 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 
 	sg_cpu->max = max;
 	sg_cpu->bw_dl = cpu_bw_dl(rq);
+	sg_cpu->reason = SUGOV_REASON_UTIL;
 
 	return schedutil_cpu_util(sg_cpu->cpu, util, max, FREQUENCY_UTIL, NULL);
 }
@@ -336,12 +385,15 @@ static bool sugov_iowait_reset(struct sugov_cpu *sg_cpu, u64 time,
  * of the maximum OPP.
  *
  * To keep doubling, an IO boost has to be requested at least once per tick,
- * otherwise we restart from the utilization of the minimum OPP.
+ * otherwise we restart from the utilization of the minimum OPP. The boost
+ * never goes beyond the iowait_boost_max tunable of the policy, and a zero
+ * iowait_boost_max disables it.
  */
 static void sugov_iowait_boost(struct sugov_cpu *sg_cpu, u64 time,
 			       unsigned int flags)
 {
-	bool set_iowait_boost = flags & SCHED_CPUFREQ_IOWAIT;
+	unsigned int boost_max = sg_cpu->sg_policy->iowait_boost_max;
+	bool set_iowait_boost = (flags & SCHED_CPUFREQ_IOWAIT) && boost_max;
 
 	/* Reset boost if the CPU appears to have been idle enough */
 	if (sg_cpu->iowait_boost &&
@@ -360,7 +412,7 @@ static void sugov_iowait_boost(struct sugov_cpu *sg_cpu, u64 time,
 	/* Double the boost at each request */
 	if (sg_cpu->iowait_boost) {
 		sg_cpu->iowait_boost =
-			min_t(unsigned int, sg_cpu->iowait_boost << 1, SCHED_CAPACITY_SCALE);
+			min_t(unsigned int, sg_cpu->iowait_boost << 1, boost_max);
 		return;
 	}
 
@@ -418,7 +470,65 @@ static unsigned long sugov_iowait_apply(struct sugov_cpu *sg_cpu, u64 time,
 	 * into the same scale so we can compare.
 	 */
 	boost = (sg_cpu->iowait_boost * max) >> SCHED_CAPACITY_SHIFT;
-	return max(boost, util);
+	if (boost <= util)
+		return util;
+
+	sg_cpu->reason = SUGOV_REASON_IOWAIT;
+	return boost;
+}
+
+/**
+ * sugov_predict_boost() - Updates the predictive boost of a CPU.
+ * @sg_cpu: the sugov data for the CPU to boost
+ * @flags: SCHED_CPUFREQ_PREDICT if a growing task is waking up
+ *
+ * A task waking up with SCHED_CPUFREQ_PREDICT grew over its last activations
+ * and rq->cpufreq_pred holds by how much, see util_est_predict(). Keep the
+ * largest such growth seen until the next frequency update consumes it.
+ */
+static void sugov_predict_boost(struct sugov_cpu *sg_cpu, unsigned int flags)
+{
+	struct rq *rq = cpu_rq(sg_cpu->cpu);
+
+	if (!(flags & SCHED_CPUFREQ_PREDICT) ||
+	    !sg_cpu->sg_policy->predictive_boost)
+		return;
+
+	sg_cpu->pred_boost = max(sg_cpu->pred_boost, rq->cpufreq_pred);
+	sg_cpu->pred_boost_pending = true;
+}
+
+/**
+ * sugov_predict_apply() - Apply the predictive boost to a CPU.
+ * @sg_cpu: the sugov data for the cpu to boost
+ * @time: the update time from the caller
+ * @util: the utilization to (eventually) boost
+ * @max: the maximum value the utilization can be boosted to
+ *
+ * The predicted growth is added on top of @util, since util_est already
+ * accounts for the last activation of the waking task. Like the IO boost, it
+ * is halved at each update that does not renew it and dropped once the CPU
+ * has been idle for a tick.
+ */
+static unsigned long sugov_predict_apply(struct sugov_cpu *sg_cpu, u64 time,
+					 unsigned long util, unsigned long max)
+{
+	if (!sg_cpu->pred_boost)
+		return util;
+
+	if (time - sg_cpu->last_update > TICK_NSEC) {
+		sg_cpu->pred_boost = 0;
+		return util;
+	}
+
+	if (!sg_cpu->pred_boost_pending)
+		sg_cpu->pred_boost >>= 1;
+	sg_cpu->pred_boost_pending = false;
+	if (!sg_cpu->pred_boost)
+		return util;
+
+	sg_cpu->reason |= SUGOV_REASON_PREDICT;
+	return min(max, util + sg_cpu->pred_boost);
 }
 
 #ifdef CONFIG_NO_HZ_COMMON
@@ -454,6 +564,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 	unsigned int cached_freq = sg_policy->cached_raw_freq;
 
 	sugov_iowait_boost(sg_cpu, time, flags);
+	sugov_predict_boost(sg_cpu, flags);
 	sg_cpu->last_update = time;
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
@@ -464,6 +575,10 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 	util = sugov_get_util(sg_cpu);
 	max = sg_cpu->max;
 	util = sugov_iowait_apply(sg_cpu, time, util, max);
+	util = sugov_predict_apply(sg_cpu, time, util, max);
+	sg_policy->util = util;
+	sg_policy->max = max;
+	sg_policy->reason = sg_cpu->reason;
 	next_f = get_next_freq(sg_policy, util, max);
 	/*
 	 * Do not reduce the frequency if the CPU has not been idle
@@ -495,7 +610,7 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
 	struct cpufreq_policy *policy = sg_policy->policy;
 	unsigned long util = 0, max = 1;
-	unsigned int j;
+	unsigned int j, reason = SUGOV_REASON_UTIL;
 
 	for_each_cpu(j, policy->cpus) {
 		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
@@ -504,13 +619,18 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 		j_util = sugov_get_util(j_sg_cpu);
 		j_max = j_sg_cpu->max;
 		j_util = sugov_iowait_apply(j_sg_cpu, time, j_util, j_max);
+		j_util = sugov_predict_apply(j_sg_cpu, time, j_util, j_max);
 
 		if (j_util * max > j_max * util) {
 			util = j_util;
 			max = j_max;
+			reason = j_sg_cpu->reason;
 		}
 	}
 
+	sg_policy->util = util;
+	sg_policy->max = max;
+	sg_policy->reason = reason;
 	return get_next_freq(sg_policy, util, max);
 }
 
@@ -524,6 +644,7 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 	raw_spin_lock(&sg_policy->update_lock);
 
 	sugov_iowait_boost(sg_cpu, time, flags);
+	sugov_predict_boost(sg_cpu, flags);
 	sg_cpu->last_update = time;
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
@@ -585,35 +706,155 @@ static inline struct sugov_tunables *to_sugov_tunables(struct gov_attr_set *attr
 	return container_of(attr_set, struct sugov_tunables, attr_set);
 }
 
+static void sugov_update_tunables(struct sugov_policy *sg_policy)
+{
+	struct sugov_tunables *tunables = sg_policy->tunables;
+
+	sg_policy->up_rate_delay_ns = tunables->up_rate_limit_us * NSEC_PER_USEC;
+	sg_policy->down_rate_delay_ns = tunables->down_rate_limit_us * NSEC_PER_USEC;
+	sg_policy->min_rate_limit_ns = min(sg_policy->up_rate_delay_ns,
+					   sg_policy->down_rate_delay_ns);
+	sg_policy->iowait_boost_max = tunables->iowait_boost_max;
+	sg_policy->predictive_boost = tunables->predictive_boost;
+}
+
+static void sugov_update_policies(struct gov_attr_set *attr_set)
+{
+	struct sugov_policy *sg_policy;
+
+	list_for_each_entry(sg_policy, &attr_set->policy_list, tunables_hook)
+		sugov_update_tunables(sg_policy);
+}
+
 static ssize_t rate_limit_us_show(struct gov_attr_set *attr_set, char *buf)
 {
 	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
 
-	return sprintf(buf, "%u\n", tunables->rate_limit_us);
+	return sprintf(buf, "%u\n", min(tunables->up_rate_limit_us,
+					tunables->down_rate_limit_us));
 }
 
 static ssize_t
 rate_limit_us_store(struct gov_attr_set *attr_set, const char *buf, size_t count)
 {
 	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
-	struct sugov_policy *sg_policy;
 	unsigned int rate_limit_us;
 
 	if (kstrtouint(buf, 10, &rate_limit_us))
 		return -EINVAL;
 
-	tunables->rate_limit_us = rate_limit_us;
+	tunables->up_rate_limit_us = rate_limit_us;
+	tunables->down_rate_limit_us = rate_limit_us;
+	sugov_update_policies(attr_set);
 
-	list_for_each_entry(sg_policy, &attr_set->policy_list, tunables_hook)
-		sg_policy->freq_update_delay_ns = rate_limit_us * NSEC_PER_USEC;
+	return count;
+}
+
+static ssize_t up_rate_limit_us_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->up_rate_limit_us);
+}
+
+static ssize_t up_rate_limit_us_store(struct gov_attr_set *attr_set,
+				      const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	unsigned int rate_limit_us;
+
+	if (kstrtouint(buf, 10, &rate_limit_us))
+		return -EINVAL;
+
+	tunables->up_rate_limit_us = rate_limit_us;
+	sugov_update_policies(attr_set);
+
+	return count;
+}
+
+static ssize_t down_rate_limit_us_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->down_rate_limit_us);
+}
+
+static ssize_t down_rate_limit_us_store(struct gov_attr_set *attr_set,
+					const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	unsigned int rate_limit_us;
+
+	if (kstrtouint(buf, 10, &rate_limit_us))
+		return -EINVAL;
+
+	tunables->down_rate_limit_us = rate_limit_us;
+	sugov_update_policies(attr_set);
+
+	return count;
+}
+
+static ssize_t iowait_boost_max_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->iowait_boost_max);
+}
+
+static ssize_t iowait_boost_max_store(struct gov_attr_set *attr_set,
+				      const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	unsigned int boost_max;
+
+	if (kstrtouint(buf, 10, &boost_max))
+		return -EINVAL;
+
+	/* 0 disables the IO boost, otherwise it starts at IOWAIT_BOOST_MIN */
+	if (boost_max > SCHED_CAPACITY_SCALE ||
+	    (boost_max && boost_max < IOWAIT_BOOST_MIN))
+		return -EINVAL;
+
+	tunables->iowait_boost_max = boost_max;
+	sugov_update_policies(attr_set);
+
+	return count;
+}
+
+static ssize_t predictive_boost_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%d\n", tunables->predictive_boost);
+}
+
+static ssize_t predictive_boost_store(struct gov_attr_set *attr_set,
+				      const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	tunables->predictive_boost = enable;
+	sugov_update_policies(attr_set);
 
 	return count;
 }
 
 static struct governor_attr rate_limit_us = __ATTR_RW(rate_limit_us);
+static struct governor_attr up_rate_limit_us = __ATTR_RW(up_rate_limit_us);
+static struct governor_attr down_rate_limit_us = __ATTR_RW(down_rate_limit_us);
+static struct governor_attr iowait_boost_max = __ATTR_RW(iowait_boost_max);
+static struct governor_attr predictive_boost = __ATTR_RW(predictive_boost);
 
 static struct attribute *sugov_attrs[] = {
 	&rate_limit_us.attr,
+	&up_rate_limit_us.attr,
+	&down_rate_limit_us.attr,
+	&iowait_boost_max.attr,
+	&predictive_boost.attr,
 	NULL
 };
 ATTRIBUTE_GROUPS(sugov);
@@ -770,7 +1011,9 @@ static int sugov_init(struct cpufreq_policy *policy)
 		goto stop_kthread;
 	}
 
-	tunables->rate_limit_us = cpufreq_policy_transition_delay_us(policy);
+	tunables->up_rate_limit_us = cpufreq_policy_transition_delay_us(policy);
+	tunables->down_rate_limit_us = tunables->up_rate_limit_us;
+	tunables->iowait_boost_max = SCHED_CAPACITY_SCALE;
 
 	policy->governor_data = sg_policy;
 	sg_policy->tunables = tunables;
@@ -829,12 +1072,14 @@ static int sugov_start(struct cpufreq_policy *policy)
 	struct sugov_policy *sg_policy = policy->governor_data;
 	unsigned int cpu;
 
-	sg_policy->freq_update_delay_ns	= sg_policy->tunables->rate_limit_us * NSEC_PER_USEC;
+	sugov_update_tunables(sg_policy);
 	sg_policy->last_freq_update_time	= 0;
 	sg_policy->next_freq			= 0;
 	sg_policy->work_in_progress		= false;
 	sg_policy->limits_changed		= false;
 	sg_policy->cached_raw_freq		= 0;
+	sg_policy->prev_cached_raw_freq		= 0;
+	sg_policy->reason			= SUGOV_REASON_UTIL;
 
 	sg_policy->need_freq_update = cpufreq_driver_test_flags(CPUFREQ_NEED_UPDATE_LIMITS);
 
@@ -61,6 +61,22 @@ drop_nopreempt_cpus(struct cpumask *lowest_mask)
 }
 #endif
 
+/*
+ * pri_active is only a hint: cpupri_set() sets the bit of a vector after
+ * adding a CPU to it, and the bit is only cleared here, by a lookup finding
+ * the vector empty. Both sides do a full barrier between their two accesses,
+ * so a racing cpupri_set() either sees the bit cleared and sets it again, or
+ * its count is seen here and the bit is restored.
+ */
+static void cpupri_clear_active(struct cpupri *cp, int idx)
+{
+	clear_bit(idx, cp->pri_active);
+	/* Pairs with the smp_mb__after_atomic() in cpupri_set() */
+	smp_mb__after_atomic();
+	if (atomic_read(&cp->pri_to_cpu[idx].count))
+		set_bit(idx, cp->pri_active);
+}
+
 static inline int __cpupri_find(struct cpupri *cp, struct task_struct *p,
 				struct cpumask *lowest_mask, int idx,
 				bool drop_nopreempts)
@@ -68,8 +84,10 @@ static inline int __cpupri_find(struct cpupri *cp, struct task_struct *p,
 	struct cpupri_vec *vec  = &cp->pri_to_cpu[idx];
 	int skip = 0;
 
-	if (!atomic_read(&(vec)->count))
+	if (!atomic_read(&(vec)->count)) {
+		cpupri_clear_active(cp, idx);
 		skip = 1;
+	}
 	/*
 	 * When looking at the vector, we need to read the counter,
 	 * do a memory barrier, then read the mask.
@@ -157,7 +175,7 @@ int cpupri_find_fitness(struct cpupri *cp, struct task_struct *p,
 #ifdef CONFIG_RT_SOFTINT_OPTIMIZATION
 retry:
 #endif
-	for (idx = 0; idx < task_pri; idx++) {
+	for_each_set_bit(idx, cp->pri_active, task_pri) {
 
 		if (!__cpupri_find(cp, p, lowest_mask, idx, drop_nopreempts))
 			continue;
@@ -257,6 +275,11 @@ void cpupri_set(struct cpupri *cp, int cpu, int newpri)
 		smp_mb__before_atomic();
 		atomic_inc(&(vec)->count);
 		do_mb = 1;
+
+		/* Pairs with the barrier in cpupri_clear_active() */
+		smp_mb__after_atomic();
+		if (!test_bit(newpri, cp->pri_active))
+			set_bit(newpri, cp->pri_active);
 	}
 	if (likely(oldpri != CPUPRI_INVALID)) {
 		struct cpupri_vec *vec  = &cp->pri_to_cpu[oldpri];
@@ -305,6 +328,7 @@ int cpupri_init(struct cpupri *cp)
 		if (!zalloc_cpumask_var(&vec->mask, GFP_KERNEL))
 			goto cleanup;
 	}
+	bitmap_zero(cp->pri_active, CPUPRI_NR_PRIORITIES);
 
 	cp->cpu_to_pri = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
 	if (!cp->cpu_to_pri)
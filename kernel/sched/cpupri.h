@@ -14,6 +14,8 @@ struct cpupri_vec {
 
 struct cpupri {
 	struct cpupri_vec	pri_to_cpu[CPUPRI_NR_PRIORITIES];
+	/* Vectors that may have CPUs, so that lookups skip the empty ones */
+	DECLARE_BITMAP(pri_active, CPUPRI_NR_PRIORITIES);
 	int			*cpu_to_pri;
 };
 
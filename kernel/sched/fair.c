@@ -4022,6 +4022,10 @@ static inline void util_est_update(struct cfs_rq *cfs_rq,
 	 * to smooth utilization decreases.
 	 */
 	ue.enqueued = (task_util(p) | UTIL_AVG_UNCHANGED);
+
+	/* Remember how much this activation grew, see util_est_predict() */
+	p->se.avg.util_est_ramp = max_t(long, (long)task_util(p) -
+				(long)(last_enqueued_diff & ~UTIL_AVG_UNCHANGED), 0);
 	if (sched_feat(UTIL_EST_FASTUP)) {
 		if (ue.ewma < ue.enqueued) {
 			ue.ewma = ue.enqueued;
@@ -4075,6 +4079,27 @@ done:
 	trace_sched_util_est_se_tp(&p->se);
 }
 
+/*
+ * A task whose last activation ran longer than the one before is likely to
+ * keep growing, while util_est only accounts for the last activation. Pass
+ * that growth on to schedutil at wakeup so that the frequency ramps up with
+ * the task rather than a few PELT periods behind it.
+ */
+static inline bool util_est_predict(struct rq *rq, struct task_struct *p)
+{
+	unsigned int ramp;
+
+	if (!sched_feat(UTIL_EST))
+		return false;
+
+	ramp = READ_ONCE(p->se.avg.util_est_ramp);
+	if (ramp < UTIL_EST_MARGIN)
+		return false;
+
+	rq->cpufreq_pred = ramp;
+	return true;
+}
+
 static inline int task_fits_capacity(struct task_struct *p, long capacity)
 {
 	return fits_capacity(uclamp_task_util(p), capacity);
@@ -4137,6 +4162,11 @@ util_est_dequeue(struct cfs_rq *cfs_rq, struct task_struct *p) {}
 static inline void
 util_est_update(struct cfs_rq *cfs_rq, struct task_struct *p,
 		bool task_sleep) {}
+
+static inline bool util_est_predict(struct rq *rq, struct task_struct *p)
+{
+	return false;
+}
 static inline void update_misfit_status(struct task_struct *p, struct rq *rq) {}
 
 #endif /* CONFIG_SMP */
@@ -5533,6 +5563,16 @@ static int sched_idle_cpu(int cpu)
 {
 	return sched_idle_rq(cpu_rq(cpu));
 }
+
+/*
+ * The host has been taking more than a quarter of the time of this vCPU
+ * lately: work placed on it is likely to wait for the host to run it again.
+ */
+static inline bool cpu_steal_heavy(int cpu)
+{
+	return sched_feat(STEAL_AWARE) &&
+	       cpu_steal_avg(cpu) > SCHED_CAPACITY_SCALE / 4;
+}
 #endif
 
 /*
@@ -5547,6 +5587,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct sched_entity *se = &p->se;
 	int idle_h_nr_running = task_has_idle_policy(p);
 	int task_new = !(flags & ENQUEUE_WAKEUP);
+	unsigned int cpufreq_flags = 0;
 	int should_iowait_boost;
 
 	/*
@@ -5560,12 +5601,16 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	/*
 	 * If in_iowait is set, the code below may not trigger any cpufreq
 	 * utilization updates, so do it here explicitly with the IOWAIT flag
-	 * passed.
+	 * passed. Same for the predicted growth of a waking task.
 	 */
 	should_iowait_boost = p->in_iowait;
 	trace_android_rvh_set_iowait(p, &should_iowait_boost);
 	if (should_iowait_boost)
-		cpufreq_update_util(rq, SCHED_CPUFREQ_IOWAIT);
+		cpufreq_flags |= SCHED_CPUFREQ_IOWAIT;
+	if (!task_new && util_est_predict(rq, p))
+		cpufreq_flags |= SCHED_CPUFREQ_PREDICT;
+	if (cpufreq_flags)
+		cpufreq_update_util(rq, cpufreq_flags);
 
 	for_each_sched_entity(se) {
 		if (se->on_rq)
@@ -6200,7 +6245,7 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	u64 avg_cost, avg_idle;
 	u64 time;
 	int this = smp_processor_id();
-	int cpu, nr = INT_MAX;
+	int cpu, nr = INT_MAX, fallback = -1;
 
 	this_sd = rcu_dereference(*this_cpu_ptr(&sd_llc));
 	if (!this_sd)
@@ -6213,7 +6258,9 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	avg_idle = this_rq()->avg_idle / 512;
 	avg_cost = this_sd->avg_scan_cost + 1;
 
-	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost)
+	/* latency sensitive tasks always look for an idle CPU */
+	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost &&
+	    p->se.latency_nice >= 0)
 		return -1;
 
 	if (sched_feat(SIS_PROP)) {
@@ -6222,6 +6269,16 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 			nr = div_u64(span_avg, avg_cost);
 		else
 			nr = 4;
+
+		/*
+		 * Scan up to twice as deep for latency_nice -20, and down
+		 * to nr == 2 for latency tolerant tasks. The loop below
+		 * decrements nr before looking at a CPU, so that is one CPU.
+		 */
+		if (p->se.latency_nice)
+			nr = max(2, nr * (LATENCY_NICE_WIDTH / 2 -
+					  p->se.latency_nice) /
+				    (LATENCY_NICE_WIDTH / 2));
 	}
 
 	time = cpu_clock(this);
@@ -6230,14 +6287,21 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 
 	for_each_cpu_wrap(cpu, cpus, target) {
 		if (!--nr)
-			return -1;
-		if (available_idle_cpu(cpu) || sched_idle_cpu(cpu))
-			break;
+			return fallback;
+		if (available_idle_cpu(cpu) || sched_idle_cpu(cpu)) {
+			if (!cpu_steal_heavy(cpu))
+				break;
+			if (fallback < 0)
+				fallback = cpu;
+		}
 	}
 
 	time = cpu_clock(this) - time;
 	update_avg(&this_sd->avg_scan_cost, time);
 
+	if (cpu >= nr_cpumask_bits && fallback >= 0)
+		return fallback;
+
 	return cpu;
 }
 
@@ -6302,6 +6366,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	}
 
 	if ((available_idle_cpu(target) || sched_idle_cpu(target)) &&
+	    !cpu_steal_heavy(target) &&
 	    asym_fits_capacity(task_util, target))
 		return target;
 
@@ -6310,6 +6375,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	 */
 	if (prev != target && cpus_share_cache(prev, target) &&
 	    (available_idle_cpu(prev) || sched_idle_cpu(prev)) &&
+	    !cpu_steal_heavy(prev) &&
 	    asym_fits_capacity(task_util, prev))
 		return prev;
 
@@ -6333,6 +6399,7 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	    recent_used_cpu != target &&
 	    cpus_share_cache(recent_used_cpu, target) &&
 	    (available_idle_cpu(recent_used_cpu) || sched_idle_cpu(recent_used_cpu)) &&
+	    !cpu_steal_heavy(recent_used_cpu) &&
 	    cpumask_test_cpu(p->recent_used_cpu, p->cpus_ptr) &&
 	    asym_fits_capacity(task_util, recent_used_cpu)) {
 		/*
@@ -6562,21 +6629,75 @@ static unsigned long cpu_util_next(int cpu, struct task_struct *p, int dst_cpu)
 }
 
 /*
- * compute_energy(): Estimates the energy that @pd would consume if @p was
- * migrated to @dst_cpu. compute_energy() predicts what will be the utilization
- * landscape of @pd's CPUs after the task migration, and uses the Energy Model
- * to compute what would be the energy if we decided to actually migrate that
- * task.
+ * Utilization landscape of a performance domain without the waking task,
+ * computed once per wake-up so that each candidate CPU of the domain can be
+ * evaluated by only recomputing the utilization of that CPU.
  */
-static long
-compute_energy(struct task_struct *p, int dst_cpu, struct perf_domain *pd)
+struct energy_env {
+	unsigned long cpu_cap;
+	/* sum of the ENERGY_UTIL of the CPUs */
+	unsigned long sum_util;
+	/* two highest FREQUENCY_UTIL, and the CPU with the highest */
+	unsigned long max_util;
+	unsigned long max_util2;
+	int max_cpu;
+	unsigned long base_energy;
+};
+
+static unsigned long
+em_pd_energy(struct perf_domain *pd, unsigned long max_util,
+	     unsigned long sum_util)
 {
-	struct cpumask *pd_mask = perf_domain_span(pd);
-	unsigned long cpu_cap = arch_scale_cpu_capacity(cpumask_first(pd_mask));
-	unsigned long max_util = 0, sum_util = 0;
 	unsigned long energy = 0;
+
+	trace_android_vh_em_cpu_energy(pd->em_pd, max_util, sum_util, &energy);
+	if (!energy)
+		energy = em_cpu_energy(pd->em_pd, max_util, sum_util);
+
+	return energy;
+}
+
+/*
+ * Busy time computation: utilization clamping is not required since the
+ * ratio (sum_util / cpu_capacity) is already enough to scale the EM reported
+ * power consumption at the (eventually clamped) cpu_capacity.
+ *
+ * Performance domain frequency: utilization clamping must be considered
+ * since it affects the selection of the performance domain frequency.
+ * NOTE: in case RT tasks are running, by default the FREQUENCY_UTIL's
+ * utilization can be max OPP.
+ */
+static void eenv_cpu_util(struct task_struct *p, int cpu, int dst_cpu,
+			  unsigned long cpu_cap, unsigned long *energy_util,
+			  unsigned long *freq_util)
+{
+	unsigned long util_cfs = cpu_util_next(cpu, p, dst_cpu);
+	struct task_struct *tsk = cpu == dst_cpu ? p : NULL;
+
+	*energy_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
+					  ENERGY_UTIL, NULL);
+	*freq_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
+					FREQUENCY_UTIL, tsk);
+}
+
+/*
+ * eenv_pd_init(): Computes the utilization landscape of @pd's CPUs with @p
+ * removed from the rq it is accounted to, and the 'base' energy @pd would
+ * consume in that state.
+ */
+static void
+eenv_pd_init(struct energy_env *eenv, struct task_struct *p,
+	     struct perf_domain *pd)
+{
+	struct cpumask *pd_mask = perf_domain_span(pd);
 	int cpu;
 
+	eenv->cpu_cap = arch_scale_cpu_capacity(cpumask_first(pd_mask));
+	eenv->sum_util = 0;
+	eenv->max_util = 0;
+	eenv->max_util2 = 0;
+	eenv->max_cpu = -1;
+
 	/*
 	 * The capacity state of CPUs of the current rd can be driven by CPUs
 	 * of another rd if they belong to the same pd. So, account for the
@@ -6584,38 +6705,58 @@ compute_energy(struct task_struct *p, int dst_cpu, struct perf_domain *pd)
 	 * instead of the rd span.
 	 *
 	 * If an entire pd is outside of the current rd, it will not appear in
-	 * its pd list and will not be accounted by compute_energy().
+	 * its pd list and will not be accounted.
 	 */
 	for_each_cpu_and(cpu, pd_mask, cpu_online_mask) {
-		unsigned long cpu_util, util_cfs = cpu_util_next(cpu, p, dst_cpu);
-		struct task_struct *tsk = cpu == dst_cpu ? p : NULL;
+		unsigned long energy_util, freq_util;
+
+		eenv_cpu_util(p, cpu, -1, eenv->cpu_cap, &energy_util,
+			      &freq_util);
+		eenv->sum_util += energy_util;
+		if (freq_util > eenv->max_util) {
+			eenv->max_util2 = eenv->max_util;
+			eenv->max_util = freq_util;
+			eenv->max_cpu = cpu;
+		} else if (freq_util > eenv->max_util2) {
+			eenv->max_util2 = freq_util;
+		}
+	}
 
-		/*
-		 * Busy time computation: utilization clamping is not
-		 * required since the ratio (sum_util / cpu_capacity)
-		 * is already enough to scale the EM reported power
-		 * consumption at the (eventually clamped) cpu_capacity.
-		 */
-		sum_util += schedutil_cpu_util(cpu, util_cfs, cpu_cap,
-					       ENERGY_UTIL, NULL);
+	eenv->base_energy = em_pd_energy(pd, eenv->max_util, eenv->sum_util);
+}
 
-		/*
-		 * Performance domain frequency: utilization clamping
-		 * must be considered since it affects the selection
-		 * of the performance domain frequency.
-		 * NOTE: in case RT tasks are running, by default the
-		 * FREQUENCY_UTIL's utilization can be max OPP.
-		 */
-		cpu_util = schedutil_cpu_util(cpu, util_cfs, cpu_cap,
-					      FREQUENCY_UTIL, tsk);
-		max_util = max(max_util, cpu_util);
-	}
+/*
+ * compute_energy(): Estimates the energy that @pd would consume if @p was
+ * migrated to @dst_cpu. Only the utilization of @dst_cpu differs from the
+ * landscape cached in @eenv, so it is the only CPU looked at again before
+ * using the Energy Model to compute what would be the energy if we decided
+ * to actually migrate that task.
+ */
+static unsigned long
+compute_energy(struct energy_env *eenv, struct task_struct *p, int dst_cpu,
+	       struct perf_domain *pd)
+{
+	unsigned long old_energy_util, old_freq_util;
+	unsigned long energy_util, freq_util;
+	unsigned long sum_util, max_util;
 
-	trace_android_vh_em_cpu_energy(pd->em_pd, max_util, sum_util, &energy);
-	if (!energy)
-		energy = em_cpu_energy(pd->em_pd, max_util, sum_util);
+	if (!cpumask_test_cpu(dst_cpu, cpu_online_mask))
+		return eenv->base_energy;
 
-	return energy;
+	eenv_cpu_util(p, dst_cpu, -1, eenv->cpu_cap, &old_energy_util,
+		      &old_freq_util);
+	eenv_cpu_util(p, dst_cpu, dst_cpu, eenv->cpu_cap, &energy_util,
+		      &freq_util);
+
+	/* PELT may have moved since eenv_pd_init(), never underflow */
+	sum_util = eenv->sum_util;
+	lsub_positive(&sum_util, old_energy_util);
+	sum_util += energy_util;
+
+	max_util = dst_cpu == eenv->max_cpu ? eenv->max_util2 : eenv->max_util;
+	max_util = max(max_util, freq_util);
+
+	return em_pd_energy(pd, max_util, sum_util);
 }
 
 /*
@@ -6709,12 +6850,17 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sy
 
 	for (; pd; pd = pd->next) {
 		unsigned long cur_delta, spare_cap, max_spare_cap = 0;
-		unsigned long base_energy_pd;
+		struct energy_env eenv;
 		int max_spare_cap_cpu = -1;
 
-		/* Compute the 'base' energy of the pd, without @p */
-		base_energy_pd = compute_energy(p, -1, pd);
-		base_energy += base_energy_pd;
+		/*
+		 * Compute the 'base' energy of the pd, without @p. Latency
+		 * sensitive tasks are placed without the Energy Model.
+		 */
+		if (!latency_sensitive) {
+			eenv_pd_init(&eenv, p, pd);
+			base_energy += eenv.base_energy;
+		}
 
 		for_each_cpu_and(cpu, perf_domain_span(pd), sched_domain_span(sd)) {
 			if (!cpumask_test_cpu(cpu, p->cpus_ptr))
@@ -6738,8 +6884,9 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sy
 
 			/* Always use prev_cpu as a candidate. */
 			if (!latency_sensitive && cpu == prev_cpu) {
-				prev_delta = compute_energy(p, prev_cpu, pd);
-				prev_delta -= base_energy_pd;
+				prev_delta = compute_energy(&eenv, p, prev_cpu,
+							    pd);
+				lsub_positive(&prev_delta, eenv.base_energy);
 				best_delta = min(best_delta, prev_delta);
 			}
 
@@ -6779,13 +6926,24 @@ static int find_energy_efficient_cpu(struct task_struct *p, int prev_cpu, int sy
 		/* Evaluate the energy impact of using this CPU. */
 		if (!latency_sensitive && max_spare_cap_cpu >= 0 &&
 						max_spare_cap_cpu != prev_cpu) {
-			cur_delta = compute_energy(p, max_spare_cap_cpu, pd);
-			cur_delta -= base_energy_pd;
+			cur_delta = compute_energy(&eenv, p, max_spare_cap_cpu,
+						   pd);
+			lsub_positive(&cur_delta, eenv.base_energy);
 			if (cur_delta < best_delta) {
 				best_delta = cur_delta;
 				best_energy_cpu = max_spare_cap_cpu;
 			}
 		}
+
+		/*
+		 * Nothing can beat placing @p on prev_cpu for free, and the
+		 * remaining pds would only grow base_energy, which cannot
+		 * change that outcome.
+		 */
+		if (!latency_sensitive && !prev_delta) {
+			rcu_read_unlock();
+			return prev_cpu;
+		}
 	}
 unlock:
 	rcu_read_unlock();
@@ -6841,6 +6999,11 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 	if (target_cpu >= 0)
 		return target_cpu;
 
+	target_cpu = sched_policy_select_task_rq_fair(p, prev_cpu, sd_flag,
+						      wake_flags);
+	if (target_cpu >= 0)
+		return target_cpu;
+
 	if (sd_flag & SD_BALANCE_WAKE) {
 		record_wakee(p);
 
@@ -7004,15 +7167,40 @@ static unsigned long wakeup_gran(struct sched_entity *se)
  *  w(c, s3) =  1
  *
  */
+static inline s64 latency_offset(struct sched_entity *se)
+{
+	return (s64)sysctl_sched_latency * READ_ONCE(se->latency_nice) /
+	       (LATENCY_NICE_WIDTH / 2);
+}
+
+/*
+ * How much earlier than by vruntime alone @se may preempt @curr. A latency
+ * sensitive (negative latency_nice) @se gets an advantage relative to
+ * @curr; a positive latency_nice only holds @se back against a @curr that
+ * is not latency sensitive itself.
+ */
+static s64 wakeup_latency_gran(struct sched_entity *curr,
+			       struct sched_entity *se)
+{
+	s64 offset = latency_offset(se);
+	s64 curr_offset = latency_offset(curr);
+
+	if (offset < 0 || curr_offset < 0)
+		offset -= curr_offset;
+
+	return min_t(s64, offset, sysctl_sched_latency);
+}
+
 static int
 wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
+	s64 offset = wakeup_latency_gran(curr, se);
 
-	if (vdiff <= 0)
+	if (vdiff <= offset)
 		return -1;
 
-	gran = wakeup_gran(se);
+	gran = offset + wakeup_gran(se);
 	if (vdiff > gran)
 		return 1;
 
@@ -7685,6 +7873,9 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 	if (!can_migrate)
 		return 0;
 
+	if (!sched_policy_can_migrate_task(p, env->dst_cpu))
+		return 0;
+
 	/*
 	 * We do not migrate tasks that are:
 	 * 1) throttled_lb_pair, or
@@ -10764,7 +10955,7 @@ static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 	rq_unpin_lock(this_rq, rf);
 
 	if (this_rq->avg_idle < sysctl_sched_migration_cost ||
-	    !READ_ONCE(this_rq->rd->overload)) {
+	    !READ_ONCE(this_rq->rd->overload) || cpu_steal_heavy(this_cpu)) {
 
 		rcu_read_lock();
 		sd = rcu_dereference_check_sched_domain(this_rq->sd);
@@ -11331,11 +11522,32 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 	se->my_q = cfs_rq;
 	/* guarantee group entities always have weight */
 	update_load_set(&se->load, NICE_0_LOAD);
+	se->latency_nice = tg->latency_nice;
 	se->parent = parent;
 }
 
 static DEFINE_MUTEX(shares_mutex);
 
+int sched_group_set_latency(struct task_group *tg, long latency_nice)
+{
+	int i;
+
+	/* We can't change the latency of the root cgroup. */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	if (latency_nice < MIN_LATENCY_NICE || latency_nice > MAX_LATENCY_NICE)
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	tg->latency_nice = latency_nice;
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_nice, latency_nice);
+	mutex_unlock(&shares_mutex);
+
+	return 0;
+}
+
 int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 {
 	int i;
@@ -57,6 +57,12 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_AVG_CPU, false)
 SCHED_FEAT(SIS_PROP, true)
 
+/*
+ * Avoid idle vCPUs, and pulling work to vCPUs, that the host has recently
+ * been stealing a large share of time from.
+ */
+SCHED_FEAT(STEAL_AWARE, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
@@ -75,6 +81,13 @@ SCHED_FEAT(WARN_DOUBLE_CLOCK, false)
  * it should go may be a better scenario.
  */
 SCHED_FEAT(RT_PUSH_IPI, true)
+
+/*
+ * Let the CPU running the push IPI also push the RT tasks of the next
+ * overloaded CPUs sharing its cache, when their rq lock is free, instead
+ * of forwarding the IPI to each of them in turn.
+ */
+SCHED_FEAT(RT_PUSH_IPI_BATCH, true)
 #endif
 
 SCHED_FEAT(RT_RUNTIME_SHARE, false)
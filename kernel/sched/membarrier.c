@@ -33,6 +33,12 @@
 	| MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED			\
 	| MEMBARRIER_PRIVATE_EXPEDITED_SYNC_CORE_BITMASK)
 
+#define MEMBARRIER_CMD_FLAG_TARGETS					\
+	(MEMBARRIER_CMD_FLAG_CPU_MASK | MEMBARRIER_CMD_FLAG_TIDS)
+
+/* Largest CPU mask or thread ID array accepted from user space */
+#define MEMBARRIER_TARGETS_MAX_SIZE	4096
+
 static void ipi_mb(void *info)
 {
 	smp_mb();	/* IPIs should be serializing but paranoid. */
@@ -85,6 +91,18 @@ static void ipi_sync_rq_state(void *info)
 	smp_mb();
 }
 
+/* Must be called with preemption disabled, before sending the IPIs. */
+static void membarrier_account_ipis(struct mm_struct *mm,
+				    const struct cpumask *mask)
+{
+	unsigned int nr = cpumask_weight(mask);
+
+	if (cpumask_test_cpu(smp_processor_id(), mask))
+		nr--;
+	if (nr)
+		atomic_long_add(nr, &mm->membarrier_ipis);
+}
+
 void membarrier_exec_mmap(struct mm_struct *mm)
 {
 	/*
@@ -152,6 +170,7 @@ static int membarrier_global_expedited(void)
 	rcu_read_unlock();
 
 	preempt_disable();
+	membarrier_account_ipis(current->mm, tmpmask);
 	smp_call_function_many(tmpmask, ipi_mb, NULL, 1);
 	preempt_enable();
 
@@ -167,7 +186,14 @@ static int membarrier_global_expedited(void)
 	return 0;
 }
 
-static int membarrier_private_expedited(int flags, int cpu_id)
+/*
+ * @cpus and @tids, when set, limit the barrier to the threads running on
+ * those CPUs or to those threads. At most one of them is set, and only when
+ * @cpu_id is negative.
+ */
+static int membarrier_private_expedited(int flags, int cpu_id,
+					const struct cpumask *cpus,
+					const pid_t *tids, unsigned int nr_tids)
 {
 	cpumask_var_t tmpmask;
 	struct mm_struct *mm = current->mm;
@@ -221,11 +247,27 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 			goto out;
 		}
 		rcu_read_unlock();
+	} else if (tids) {
+		unsigned int i;
+
+		rcu_read_lock();
+		for (i = 0; i < nr_tids; i++) {
+			struct task_struct *p = find_task_by_vpid(tids[i]);
+
+			/*
+			 * Threads not running right now will go through the
+			 * barriers of the scheduler before they run again.
+			 */
+			if (p && p->mm == mm && task_curr(p))
+				__cpumask_set_cpu(task_cpu(p), tmpmask);
+		}
+		rcu_read_unlock();
 	} else {
 		int cpu;
 
 		rcu_read_lock();
-		for_each_online_cpu(cpu) {
+		for_each_cpu_and(cpu, cpus ? cpus : cpu_online_mask,
+				 cpu_online_mask) {
 			struct task_struct *p;
 
 			p = rcu_dereference(cpu_rq(cpu)->curr);
@@ -240,6 +282,10 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 		 * smp_call_function_single() will call ipi_func() if cpu_id
 		 * is the calling CPU.
 		 */
+		preempt_disable();
+		if (cpu_id != smp_processor_id())
+			atomic_long_inc(&mm->membarrier_ipis);
+		preempt_enable();
 		smp_call_function_single(cpu_id, ipi_func, NULL, 1);
 	} else {
 		/*
@@ -259,13 +305,13 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 		 * is not supposed to issue syscalls at all from inside an
 		 * rseq critical section.
 		 */
-		if (flags != MEMBARRIER_FLAG_SYNC_CORE) {
-			preempt_disable();
+		preempt_disable();
+		membarrier_account_ipis(mm, tmpmask);
+		if (flags != MEMBARRIER_FLAG_SYNC_CORE)
 			smp_call_function_many(tmpmask, ipi_func, NULL, true);
-			preempt_enable();
-		} else {
+		else
 			on_each_cpu_mask(tmpmask, ipi_func, NULL, true);
-		}
+		preempt_enable();
 	}
 
 out:
@@ -283,6 +329,46 @@ out:
 	return 0;
 }
 
+/*
+ * Private expedited membarrier limited to the threads designated by
+ * MEMBARRIER_CMD_FLAG_CPU_MASK or MEMBARRIER_CMD_FLAG_TIDS.
+ */
+static int membarrier_private_expedited_targets(int flags,
+						unsigned int cmd_flags,
+						const void __user *targets,
+						unsigned int size)
+{
+	cpumask_var_t cpus;
+	pid_t *tids;
+	int ret;
+
+	if (!size || size > MEMBARRIER_TARGETS_MAX_SIZE)
+		return -EINVAL;
+
+	if (cmd_flags & MEMBARRIER_CMD_FLAG_TIDS) {
+		if (size % sizeof(pid_t))
+			return -EINVAL;
+		tids = memdup_user(targets, size);
+		if (IS_ERR(tids))
+			return PTR_ERR(tids);
+		ret = membarrier_private_expedited(flags, -1, NULL, tids,
+						   size / sizeof(pid_t));
+		kfree(tids);
+		return ret;
+	}
+
+	if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+	/* Like sched_setaffinity(), ignore the CPUs beyond nr_cpu_ids */
+	if (copy_from_user(cpumask_bits(cpus), targets,
+			   min_t(unsigned int, size, cpumask_size())))
+		ret = -EFAULT;
+	else
+		ret = membarrier_private_expedited(flags, -1, cpus, NULL, 0);
+	free_cpumask_var(cpus);
+	return ret;
+}
+
 static int sync_runqueues_membarrier_state(struct mm_struct *mm)
 {
 	int membarrier_state = atomic_read(&mm->membarrier_state);
@@ -404,14 +490,20 @@ static int membarrier_register_private_expedited(int flags)
 /**
  * sys_membarrier - issue memory barriers on a set of threads
  * @cmd:    Takes command values defined in enum membarrier_cmd.
- * @flags:  Currently needs to be 0 for all commands other than
- *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ: in the latter
- *          case it can be MEMBARRIER_CMD_FLAG_CPU, indicating that @cpu_id
+ * @flags:  Currently needs to be 0 for all commands other than the
+ *          private expedited ones. Those accept MEMBARRIER_CMD_FLAG_CPU_MASK
+ *          or MEMBARRIER_CMD_FLAG_TIDS, indicating that @targets designates
+ *          the threads to issue the barrier on. In addition,
+ *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ accepts
+ *          MEMBARRIER_CMD_FLAG_CPU, indicating that @cpu_id
  *          contains the CPU on which to interrupt (= restart)
  *          the RSEQ critical section.
  * @cpu_id: if @flags == MEMBARRIER_CMD_FLAG_CPU, indicates the cpu on which
  *          RSEQ CS should be interrupted (@cmd must be
  *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ).
+ * @targets: if @flags == MEMBARRIER_CMD_FLAG_CPU_MASK, a CPU mask, if @flags
+ *          == MEMBARRIER_CMD_FLAG_TIDS, an array of thread IDs.
+ * @targets_size: size of @targets in bytes.
  *
  * If this system call is not implemented, -ENOSYS is returned. If the
  * command specified does not exist, not available on the running
@@ -437,11 +529,20 @@ static int membarrier_register_private_expedited(int flags)
  *        smp_mb()           X           O            O
  *        sys_membarrier()   O           O            O
  */
-SYSCALL_DEFINE3(membarrier, int, cmd, unsigned int, flags, int, cpu_id)
+SYSCALL_DEFINE5(membarrier, int, cmd, unsigned int, flags, int, cpu_id,
+		const void __user *, targets, unsigned int, targets_size)
 {
 	switch (cmd) {
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ:
-		if (unlikely(flags && flags != MEMBARRIER_CMD_FLAG_CPU))
+		if (unlikely(flags && flags != MEMBARRIER_CMD_FLAG_CPU &&
+			     flags != MEMBARRIER_CMD_FLAG_CPU_MASK &&
+			     flags != MEMBARRIER_CMD_FLAG_TIDS))
+			return -EINVAL;
+		break;
+	case MEMBARRIER_CMD_PRIVATE_EXPEDITED:
+	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE:
+		if (unlikely(flags && flags != MEMBARRIER_CMD_FLAG_CPU_MASK &&
+			     flags != MEMBARRIER_CMD_FLAG_TIDS))
 			return -EINVAL;
 		break;
 	default:
@@ -473,15 +574,28 @@ SYSCALL_DEFINE3(membarrier, int, cmd, unsigned int, flags, int, cpu_id)
 	case MEMBARRIER_CMD_REGISTER_GLOBAL_EXPEDITED:
 		return membarrier_register_global_expedited();
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED:
-		return membarrier_private_expedited(0, cpu_id);
+		if (flags & MEMBARRIER_CMD_FLAG_TARGETS)
+			return membarrier_private_expedited_targets(0, flags,
+						targets, targets_size);
+		return membarrier_private_expedited(0, cpu_id, NULL, NULL, 0);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED:
 		return membarrier_register_private_expedited(0);
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE:
-		return membarrier_private_expedited(MEMBARRIER_FLAG_SYNC_CORE, cpu_id);
+		if (flags & MEMBARRIER_CMD_FLAG_TARGETS)
+			return membarrier_private_expedited_targets(
+				MEMBARRIER_FLAG_SYNC_CORE, flags, targets,
+				targets_size);
+		return membarrier_private_expedited(MEMBARRIER_FLAG_SYNC_CORE,
+						    cpu_id, NULL, NULL, 0);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE:
 		return membarrier_register_private_expedited(MEMBARRIER_FLAG_SYNC_CORE);
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ:
-		return membarrier_private_expedited(MEMBARRIER_FLAG_RSEQ, cpu_id);
+		if (flags & MEMBARRIER_CMD_FLAG_TARGETS)
+			return membarrier_private_expedited_targets(
+				MEMBARRIER_FLAG_RSEQ, flags, targets,
+				targets_size);
+		return membarrier_private_expedited(MEMBARRIER_FLAG_RSEQ,
+						    cpu_id, NULL, NULL, 0);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ:
 		return membarrier_register_private_expedited(MEMBARRIER_FLAG_RSEQ);
 	default:
@@ -140,6 +140,7 @@
 #include <linux/file.h>
 #include <linux/poll.h>
 #include <linux/psi.h>
+#include <linux/oom.h>
 #include "sched.h"
 
 #include <trace/hooks/psi.h>
@@ -168,6 +169,7 @@ __setup("psi=", setup_psi);
 
 /* PSI trigger definitions */
 #define WINDOW_MIN_US 500000	/* Min window size is 500ms */
+#define WINDOW_RT_MIN_US 10000	/* Down to 10ms for rt triggers */
 #define WINDOW_MAX_US 10000000	/* Max window size is 10s */
 #define UPDATES_PER_WINDOW 10	/* 10 updates per window */
 
@@ -181,6 +183,7 @@ struct psi_group psi_system = {
 };
 
 static void psi_avgs_work(struct work_struct *work);
+static enum hrtimer_restart psi_rt_timer_fn(struct hrtimer *timer);
 
 static void group_init(struct psi_group *group)
 {
@@ -203,6 +206,17 @@ static void group_init(struct psi_group *group)
 	group->polling_next_update = ULLONG_MAX;
 	group->polling_until = 0;
 	rcu_assign_pointer(group->poll_task, NULL);
+	raw_spin_lock_init(&group->rt_lock);
+	hrtimer_init(&group->rt_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	group->rt_timer.function = psi_rt_timer_fn;
+	atomic_set(&group->rt_scheduled, 0);
+	INIT_LIST_HEAD(&group->rt_triggers);
+	memset(group->rt_nr_triggers, 0, sizeof(group->rt_nr_triggers));
+	group->rt_states = 0;
+	group->rt_min_period = U32_MAX;
+	memset(group->rt_total, 0, sizeof(group->rt_total));
+	group->rt_until = 0;
+	group->enabled = true;
 }
 
 void __init psi_init(void)
@@ -332,7 +346,11 @@ static void collect_percpu_times(struct psi_group *group,
 				&cpu_changed_states);
 		changed_states |= cpu_changed_states;
 
-		nonidle = nsecs_to_jiffies(times[PSI_NONIDLE]);
+		/* rt periods can be shorter than a jiffy, weigh in usecs */
+		if (aggregator == PSI_RT)
+			nonidle = times[PSI_NONIDLE] >> 10;
+		else
+			nonidle = nsecs_to_jiffies(times[PSI_NONIDLE]);
 		nonidle_total += nonidle;
 
 		for (s = 0; s < PSI_NONIDLE; s++)
@@ -494,33 +512,68 @@ static u64 window_update(struct psi_window *win, u64 now, u64 value)
 	return growth;
 }
 
-static void init_triggers(struct psi_group *group, u64 now)
+static void __init_triggers(struct list_head *triggers, u64 *total,
+			    u64 *polling_total, u64 now)
 {
 	struct psi_trigger *t;
 
-	list_for_each_entry(t, &group->triggers, node)
-		window_reset(&t->win, now,
-				group->total[PSI_POLL][t->state], 0);
-	memcpy(group->polling_total, group->total[PSI_POLL],
-		   sizeof(group->polling_total));
+	list_for_each_entry(t, triggers, node)
+		window_reset(&t->win, now, total[t->state], 0);
+	memcpy(polling_total, total,
+		   sizeof(u64) * (NR_PSI_STATES - 1));
+}
+
+static void init_triggers(struct psi_group *group, u64 now)
+{
+	__init_triggers(&group->triggers, group->total[PSI_POLL],
+			group->polling_total, now);
 	group->polling_next_update = now + group->poll_min_period;
 }
 
-static u64 update_triggers(struct psi_group *group, u64 now)
+/*
+ * A vendor policy gets the first say, the default one kills within the
+ * cgroup that owns the trigger, or the whole system for /proc/pressure.
+ */
+static void psi_trigger_kill(struct psi_group *group, struct psi_trigger *t)
+{
+	struct cgroup *cgrp = NULL;
+	bool handled = false;
+
+	trace_android_vh_psi_kill(t, &handled);
+	if (handled)
+		return;
+
+#ifdef CONFIG_CGROUPS
+	if (group != &psi_system)
+		cgrp = container_of(group, struct cgroup, psi);
+#endif
+	oom_kill_psi_victim(cgrp, t->kill_min_score_adj);
+}
+
+static void psi_trigger_kill_workfn(struct work_struct *work)
+{
+	struct psi_trigger *t = container_of(work, struct psi_trigger,
+					     kill_work);
+
+	psi_trigger_kill(t->group, t);
+}
+
+static void __update_triggers(struct psi_group *group,
+			      struct list_head *triggers, u64 *total,
+			      u64 *polling_total, u64 now)
 {
 	struct psi_trigger *t;
 	bool new_stall = false;
-	u64 *total = group->total[PSI_POLL];
 
 	/*
 	 * On subsequent updates, calculate growth deltas and let
 	 * watchers know when their specified thresholds are exceeded.
 	 */
-	list_for_each_entry(t, &group->triggers, node) {
+	list_for_each_entry(t, triggers, node) {
 		u64 growth;
 
 		/* Check for stall activity */
-		if (group->polling_total[t->state] == total[t->state])
+		if (polling_total[t->state] == total[t->state])
 			continue;
 
 		/*
@@ -540,23 +593,97 @@ static u64 update_triggers(struct psi_group *group, u64 now)
 		if (now < t->last_event_time + t->win.size)
 			continue;
 
+		/* may be in hardirq context, see trace/hooks/psi.h */
 		trace_android_vh_psi_event(t);
 
 		/* Generate an event */
 		if (cmpxchg(&t->event, 0, 1) == 0)
 			wake_up_interruptible(&t->event_wait);
 		t->last_event_time = now;
+
+		/* Act right away instead of waiting for userspace */
+		if (t->kill) {
+			if (t->rt)
+				schedule_work(&t->kill_work);
+			else
+				psi_trigger_kill(group, t);
+		}
 	}
 
 	trace_android_vh_psi_group(group);
 
 	if (new_stall)
-		memcpy(group->polling_total, total,
-				sizeof(group->polling_total));
+		memcpy(polling_total, total,
+				sizeof(u64) * (NR_PSI_STATES - 1));
+}
+
+static u64 update_triggers(struct psi_group *group, u64 now)
+{
+	__update_triggers(group, &group->triggers, group->total[PSI_POLL],
+			  group->polling_total, now);
 
 	return now + group->poll_min_period;
 }
 
+static void psi_schedule_rt_poll(struct psi_group *group)
+{
+	if (atomic_xchg(&group->rt_scheduled, 1))
+		return;
+
+	hrtimer_start(&group->rt_timer,
+		      ns_to_ktime(READ_ONCE(group->rt_min_period)),
+		      HRTIMER_MODE_REL_HARD);
+}
+
+/*
+ * The rt counterpart of psi_poll_work(), running in hardirq context. It
+ * follows the same protocol to start and stop polling, with rt_scheduled
+ * in place of poll_scheduled.
+ */
+static enum hrtimer_restart psi_rt_timer_fn(struct hrtimer *timer)
+{
+	struct psi_group *group = container_of(timer, struct psi_group,
+					       rt_timer);
+	u32 changed_states;
+	u64 now;
+
+	raw_spin_lock(&group->rt_lock);
+
+	now = sched_clock();
+
+	if (now > group->rt_until) {
+		atomic_set(&group->rt_scheduled, 0);
+		/* pairs with the atomic_xchg() in psi_schedule_rt_poll() */
+		smp_mb();
+	}
+
+	collect_percpu_times(group, PSI_RT, &changed_states);
+
+	if (changed_states & group->rt_states) {
+		if (now > group->rt_until)
+			__init_triggers(&group->rt_triggers,
+					group->total[PSI_RT], group->rt_total,
+					now);
+		group->rt_until = now +
+			group->rt_min_period * UPDATES_PER_WINDOW;
+	}
+
+	if (now > group->rt_until) {
+		raw_spin_unlock(&group->rt_lock);
+		return HRTIMER_NORESTART;
+	}
+
+	__update_triggers(group, &group->rt_triggers, group->total[PSI_RT],
+			  group->rt_total, now);
+
+	atomic_set(&group->rt_scheduled, 1);
+	hrtimer_forward_now(timer, ns_to_ktime(group->rt_min_period));
+
+	raw_spin_unlock(&group->rt_lock);
+
+	return HRTIMER_RESTART;
+}
+
 /* Schedule polling if it's not already scheduled or forced. */
 static void psi_schedule_poll_work(struct psi_group *group, unsigned long delay,
 				   bool force)
@@ -740,6 +867,7 @@ static void psi_group_change(struct psi_group *group, int cpu,
 			     unsigned int clear, unsigned int set,
 			     bool wake_clock)
 {
+	bool enabled = READ_ONCE(group->enabled);
 	struct psi_group_cpu *groupc;
 	u32 state_mask = 0;
 	unsigned int t, m;
@@ -754,10 +882,16 @@ static void psi_group_change(struct psi_group *group, int cpu,
 	 *
 	 * Then we update the task counts according to the state
 	 * change requested through the @clear and @set bits.
+	 *
+	 * Disabled groups only keep their task counts up to date, so
+	 * that accounting can resume when they are enabled again. The
+	 * state they were in when disabled is concluded on the first
+	 * change.
 	 */
 	write_seqcount_begin(&groupc->seq);
 
-	record_times(groupc, cpu, false);
+	if (enabled || groupc->state_mask)
+		record_times(groupc, cpu, false);
 
 	for (t = 0, m = clear; m; m &= ~(1 << t), t++) {
 		if (!(m & (1 << t)))
@@ -777,6 +911,12 @@ static void psi_group_change(struct psi_group *group, int cpu,
 		if (set & (1 << t))
 			groupc->tasks[t]++;
 
+	if (!enabled) {
+		groupc->state_mask = 0;
+		write_seqcount_end(&groupc->seq);
+		return;
+	}
+
 	/* Calculate state mask representing active states */
 	for (s = 0; s < NR_PSI_STATES; s++) {
 		if (test_state(groupc->tasks, s))
@@ -789,6 +929,9 @@ static void psi_group_change(struct psi_group *group, int cpu,
 	if (state_mask & group->poll_states)
 		psi_schedule_poll_work(group, 1, false);
 
+	if (state_mask & group->rt_states)
+		psi_schedule_rt_poll(group);
+
 	if (wake_clock && !delayed_work_pending(&group->avgs_work))
 		schedule_delayed_work(&group->avgs_work, PSI_FREQ);
 }
@@ -997,6 +1140,7 @@ void psi_cgroup_free(struct cgroup *cgroup)
 		return;
 
 	cancel_delayed_work_sync(&cgroup->psi.avgs_work);
+	hrtimer_cancel(&cgroup->psi.rt_timer);
 	free_percpu(cgroup->psi.pcpu);
 	/* All triggers must be removed by now */
 	WARN_ONCE(cgroup->psi.poll_states, "psi: trigger leak\n");
@@ -1052,6 +1196,48 @@ void cgroup_move_task(struct task_struct *task, struct css_set *to)
 
 	task_rq_unlock(rq, task, &rf);
 }
+
+/**
+ * psi_cgroup_set_enabled - turn stall accounting of a cgroup on or off
+ * @group: the psi group of the cgroup
+ * @enabled: the new state
+ *
+ * Task state changes still walk a disabled group to keep its task counts,
+ * but skip the time accounting and state evaluation, the bulk of the cost
+ * per group. A group with triggers cannot be disabled.
+ */
+int psi_cgroup_set_enabled(struct psi_group *group, bool enabled)
+{
+	int cpu, ret = 0;
+
+	if (static_branch_likely(&psi_disabled))
+		return -EOPNOTSUPP;
+
+	mutex_lock(&group->trigger_lock);
+
+	if (group->enabled == enabled)
+		goto out;
+
+	if (!enabled && (group->poll_states || group->rt_states)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	WRITE_ONCE(group->enabled, enabled);
+
+	/* Conclude, or pick the accounting back up, on every CPU */
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		struct rq_flags rf;
+
+		rq_lock_irq(rq, &rf);
+		psi_group_change(group, cpu, 0, 0, true);
+		rq_unlock_irq(rq, &rf);
+	}
+out:
+	mutex_unlock(&group->trigger_lock);
+	return ret;
+}
 #endif /* CONFIG_CGROUPS */
 
 int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
@@ -1091,6 +1277,34 @@ int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
 	return 0;
 }
 
+/**
+ * psi_mem_pressure - recent system-wide memory pressure
+ *
+ * Return the 10 second average of the share of time in which at least one
+ * task was stalled on memory, in hundredths of a percent. Must be called
+ * from a context that can sleep.
+ */
+unsigned long psi_mem_pressure(void)
+{
+	struct psi_group *group = &psi_system;
+	unsigned long avg;
+	u64 now;
+
+	if (static_branch_likely(&psi_disabled))
+		return 0;
+
+	mutex_lock(&group->avgs_lock);
+	now = sched_clock();
+	collect_percpu_times(group, PSI_AVGS, NULL);
+	if (now >= group->avg_next_update)
+		group->avg_next_update = update_averages(group, now);
+	avg = group->avg[PSI_MEM_SOME][0];
+	mutex_unlock(&group->avgs_lock);
+
+	return LOAD_INT(avg) * 100 + LOAD_FRAC(avg);
+}
+EXPORT_SYMBOL_GPL(psi_mem_pressure);
+
 static int psi_io_show(struct seq_file *m, void *v)
 {
 	return psi_show(m, &psi_system, PSI_IO);
@@ -1128,24 +1342,46 @@ struct psi_trigger *psi_trigger_create(struct psi_group *group,
 	enum psi_states state;
 	u32 threshold_us;
 	u32 window_us;
+	int kill_adj = 0;
+	bool rt;
+	int nr;
 
 	if (static_branch_likely(&psi_disabled))
 		return ERR_PTR(-EOPNOTSUPP);
 
-	if (sscanf(buf, "some %u %u", &threshold_us, &window_us) == 2)
+	nr = sscanf(buf, "some %u %u kill %d", &threshold_us, &window_us,
+		    &kill_adj);
+	if (nr >= 2) {
 		state = PSI_IO_SOME + res * 2;
-	else if (sscanf(buf, "full %u %u", &threshold_us, &window_us) == 2)
+	} else {
+		nr = sscanf(buf, "full %u %u kill %d", &threshold_us,
+			    &window_us, &kill_adj);
+		if (nr < 2)
+			return ERR_PTR(-EINVAL);
 		state = PSI_IO_FULL + res * 2;
-	else
-		return ERR_PTR(-EINVAL);
+	}
+
+	/* "kill <min oom_score_adj>" lets the kernel kill on each event */
+	if (nr == 3) {
+		if (res != PSI_MEM || kill_adj <= OOM_SCORE_ADJ_MIN ||
+		    kill_adj > OOM_SCORE_ADJ_MAX)
+			return ERR_PTR(-EINVAL);
+		if (!capable(CAP_KILL))
+			return ERR_PTR(-EPERM);
+	}
 
 	if (state >= PSI_NONIDLE)
 		return ERR_PTR(-EINVAL);
 
-	if (window_us < WINDOW_MIN_US ||
+	if (window_us < WINDOW_RT_MIN_US ||
 		window_us > WINDOW_MAX_US)
 		return ERR_PTR(-EINVAL);
 
+	/* Short windows cost a timer interrupt per update */
+	rt = window_us < WINDOW_MIN_US;
+	if (rt && !capable(CAP_SYS_RESOURCE))
+		return ERR_PTR(-EPERM);
+
 	/* Check threshold */
 	if (threshold_us == 0 || threshold_us > window_us)
 		return ERR_PTR(-EINVAL);
@@ -1162,11 +1398,35 @@ struct psi_trigger *psi_trigger_create(struct psi_group *group,
 
 	t->event = 0;
 	t->last_event_time = 0;
+	t->kill = nr == 3;
+	t->kill_min_score_adj = kill_adj;
+	t->rt = rt;
+	INIT_WORK(&t->kill_work, psi_trigger_kill_workfn);
 	init_waitqueue_head(&t->event_wait);
 	kref_init(&t->refcount);
 
 	mutex_lock(&group->trigger_lock);
 
+	if (!group->enabled) {
+		kfree(t);
+		mutex_unlock(&group->trigger_lock);
+		return ERR_PTR(-EOPNOTSUPP);
+	}
+
+	if (rt) {
+		raw_spin_lock_irq(&group->rt_lock);
+		list_add(&t->node, &group->rt_triggers);
+		group->rt_min_period = min(group->rt_min_period,
+			div_u64(t->win.size, UPDATES_PER_WINDOW));
+		group->rt_nr_triggers[t->state]++;
+		group->rt_states |= (1 << t->state);
+		raw_spin_unlock_irq(&group->rt_lock);
+
+		mutex_unlock(&group->trigger_lock);
+
+		return t;
+	}
+
 	if (!rcu_access_pointer(group->poll_task)) {
 		struct task_struct *task;
 
@@ -1199,6 +1459,7 @@ static void psi_trigger_destroy(struct kref *ref)
 	struct psi_trigger *t = container_of(ref, struct psi_trigger, refcount);
 	struct psi_group *group = t->group;
 	struct task_struct *task_to_destroy = NULL;
+	bool stop_rt_timer = false;
 
 	if (static_branch_likely(&psi_disabled))
 		return;
@@ -1211,7 +1472,25 @@ static void psi_trigger_destroy(struct kref *ref)
 
 	mutex_lock(&group->trigger_lock);
 
-	if (!list_empty(&t->node)) {
+	if (t->rt) {
+		struct psi_trigger *tmp;
+		u64 period = U32_MAX;
+
+		raw_spin_lock_irq(&group->rt_lock);
+		list_del(&t->node);
+		group->rt_nr_triggers[t->state]--;
+		if (!group->rt_nr_triggers[t->state])
+			group->rt_states &= ~(1 << t->state);
+		list_for_each_entry(tmp, &group->rt_triggers, node)
+			period = min(period, div_u64(tmp->win.size,
+					UPDATES_PER_WINDOW));
+		group->rt_min_period = period;
+		if (!group->rt_states) {
+			group->rt_until = 0;
+			stop_rt_timer = true;
+		}
+		raw_spin_unlock_irq(&group->rt_lock);
+	} else if (!list_empty(&t->node)) {
 		struct psi_trigger *tmp;
 		u64 period = ULLONG_MAX;
 
@@ -1257,6 +1536,11 @@ static void psi_trigger_destroy(struct kref *ref)
 		kthread_stop(task_to_destroy);
 		atomic_set(&group->poll_scheduled, 0);
 	}
+	if (stop_rt_timer) {
+		hrtimer_cancel(&group->rt_timer);
+		atomic_set(&group->rt_scheduled, 0);
+	}
+	cancel_work_sync(&t->kill_work);
 	kfree(t);
 }
 
@@ -1305,7 +1589,7 @@ __poll_t psi_trigger_poll(void **trigger_ptr,
 static ssize_t psi_write(struct file *file, const char __user *user_buf,
 			 size_t nbytes, enum psi_res res)
 {
-	char buf[32];
+	char buf[48];
 	size_t buf_size;
 	struct seq_file *seq;
 	struct psi_trigger *new;
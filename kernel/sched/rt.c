@@ -1497,6 +1497,10 @@ select_task_rq_rt(struct task_struct *p, int cpu, int sd_flag, int flags)
 	if (target_cpu >= 0)
 		return target_cpu;
 
+	target_cpu = sched_policy_select_task_rq_rt(p, cpu, sd_flag, flags);
+	if (target_cpu >= 0)
+		return target_cpu;
+
 	/* For anything but wake ups, just return the task_cpu */
 	if (sd_flag != SD_BALANCE_WAKE && sd_flag != SD_BALANCE_FORK)
 		goto out;
@@ -2173,11 +2177,39 @@ static void tell_cpu_to_push(struct rq *rq)
 	}
 }
 
+/* Most overloaded rqs one hop of the IPI chain pushes from */
+#define RTO_PUSH_BATCH		8
+
+/*
+ * Push the RT tasks of @cpu from this CPU rather than passing the IPI on to
+ * it. Only done for CPUs sharing our cache, where taking their rq lock is
+ * cheap, and never spinning on it: a busy lock means the IPI is the better
+ * way to reach that CPU.
+ */
+static bool rto_push_remote(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	if (!cpus_share_cache(smp_processor_id(), cpu))
+		return false;
+
+	if (!has_pushable_tasks(rq))
+		return true;
+
+	if (!raw_spin_trylock(&rq->lock))
+		return false;
+	push_rt_tasks(rq);
+	raw_spin_unlock(&rq->lock);
+
+	return true;
+}
+
 /* Called from hardirq context */
 void rto_push_irq_work_func(struct irq_work *work)
 {
 	struct root_domain *rd =
 		container_of(work, struct root_domain, rto_push_work);
+	int batch = sched_feat(RT_PUSH_IPI_BATCH) ? RTO_PUSH_BATCH : 1;
 	struct rq *rq;
 	int cpu;
 
@@ -2193,16 +2225,21 @@ void rto_push_irq_work_func(struct irq_work *work)
 		raw_spin_unlock(&rq->lock);
 	}
 
-	raw_spin_lock(&rd->rto_lock);
+	for (;;) {
+		raw_spin_lock(&rd->rto_lock);
 
-	/* Pass the IPI to the next rt overloaded queue */
-	cpu = rto_next_cpu(rd);
+		/* Pass the IPI to the next rt overloaded queue */
+		cpu = rto_next_cpu(rd);
 
-	raw_spin_unlock(&rd->rto_lock);
+		raw_spin_unlock(&rd->rto_lock);
 
-	if (cpu < 0) {
-		sched_put_rd(rd);
-		return;
+		if (cpu < 0) {
+			sched_put_rd(rd);
+			return;
+		}
+
+		if (--batch <= 0 || !rto_push_remote(cpu))
+			break;
 	}
 
 	/* Try the next RT overloaded CPU */
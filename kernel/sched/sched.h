@@ -5,6 +5,7 @@
 #include <linux/sched.h>
 
 #include <linux/sched/autogroup.h>
+#include <linux/sched/bpf_ops.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/coredump.h>
 #include <linux/sched/cpufreq.h>
@@ -395,6 +396,7 @@ struct task_group {
 	/* runqueue "owned" by this group on each CPU */
 	struct cfs_rq		**cfs_rq;
 	unsigned long		shares;
+	int			latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -512,6 +514,7 @@ extern void sched_move_task(struct task_struct *tsk);
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency(struct task_group *tg, long latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -995,6 +998,9 @@ struct rq {
 	unsigned long		cpu_capacity;
 	unsigned long		cpu_capacity_orig;
 
+	/* Boost passed along with SCHED_CPUFREQ_PREDICT */
+	unsigned long		cpufreq_pred;
+
 	struct callback_head	*balance_callback;
 
 	unsigned char		nohz_idle_balance;
@@ -1036,6 +1042,11 @@ struct rq {
 #endif
 #ifdef CONFIG_PARAVIRT_TIME_ACCOUNTING
 	u64			prev_steal_time_rq;
+	/* rq clock and prev_steal_time_rq at the last avg_steal update */
+	u64			steal_stamp;
+	u64			steal_stamp_time;
+	/* fraction of time stolen by the host, SCHED_CAPACITY_SCALE based */
+	unsigned int		avg_steal;
 #endif
 
 	/* calc_load related fields */
@@ -2558,6 +2569,18 @@ static inline unsigned long capacity_orig_of(int cpu)
 }
 #endif
 
+#ifdef CONFIG_PARAVIRT_TIME_ACCOUNTING
+static inline unsigned int cpu_steal_avg(int cpu)
+{
+	return READ_ONCE(cpu_rq(cpu)->avg_steal);
+}
+#else
+static inline unsigned int cpu_steal_avg(int cpu)
+{
+	return 0;
+}
+#endif
+
 /**
  * enum schedutil_type - CPU utilization type
  * @FREQUENCY_UTIL:	Utilization used to select frequency
@@ -2690,6 +2713,79 @@ static inline void membarrier_switch_mm(struct rq *rq,
 }
 #endif
 
+#ifdef CONFIG_SCHED_BPF_OPS
+DECLARE_STATIC_KEY_FALSE(sched_policy_ops_enabled);
+extern struct sched_policy_ops __rcu *sched_policy_ops;
+
+#define sched_policy_call(op, def, args...)				\
+({									\
+	struct sched_policy_ops *__ops;					\
+	int __ret = (def);						\
+									\
+	if (static_branch_unlikely(&sched_policy_ops_enabled)) {	\
+		rcu_read_lock();					\
+		__ops = rcu_dereference(sched_policy_ops);		\
+		if (__ops && __ops->op)					\
+			__ret = __ops->op(args);			\
+		rcu_read_unlock();					\
+	}								\
+	__ret;								\
+})
+
+/*
+ * A CPU picked by the BPF policy, or -1 for the default choice. The policy
+ * is not trusted with CPUs the task is not allowed on.
+ */
+static inline int sched_policy_check_cpu(struct task_struct *p, int cpu)
+{
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpumask_test_cpu(cpu, p->cpus_ptr))
+		return -1;
+	return cpu;
+}
+
+static inline int sched_policy_select_task_rq_fair(struct task_struct *p,
+						   int prev_cpu, int sd_flag,
+						   int wake_flags)
+{
+	return sched_policy_check_cpu(p, sched_policy_call(select_task_rq_fair,
+				-1, p, prev_cpu, sd_flag, wake_flags));
+}
+
+static inline int sched_policy_select_task_rq_rt(struct task_struct *p,
+						 int prev_cpu, int sd_flag,
+						 int wake_flags)
+{
+	return sched_policy_check_cpu(p, sched_policy_call(select_task_rq_rt,
+				-1, p, prev_cpu, sd_flag, wake_flags));
+}
+
+static inline bool sched_policy_can_migrate_task(struct task_struct *p,
+						 int dst_cpu)
+{
+	return sched_policy_call(can_migrate_task, 1, p, dst_cpu);
+}
+#else
+static inline int sched_policy_select_task_rq_fair(struct task_struct *p,
+						   int prev_cpu, int sd_flag,
+						   int wake_flags)
+{
+	return -1;
+}
+
+static inline int sched_policy_select_task_rq_rt(struct task_struct *p,
+						 int prev_cpu, int sd_flag,
+						 int wake_flags)
+{
+	return -1;
+}
+
+static inline bool sched_policy_can_migrate_task(struct task_struct *p,
+						 int dst_cpu)
+{
+	return true;
+}
+#endif
+
 #ifdef CONFIG_SMP
 static inline bool is_per_cpu_kthread(struct task_struct *p)
 {
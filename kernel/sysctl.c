@@ -2641,6 +2641,15 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= bpf_stats_handler,
 	},
+	{
+		.procname	= "bpf_stats_sample_rate",
+		.data		= &sysctl_bpf_stats_sample_rate,
+		.maxlen		= sizeof(sysctl_bpf_stats_sample_rate),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ONE,
+		.extra2		= SYSCTL_INT_MAX,
+	},
 #endif
 #if defined(CONFIG_TREE_RCU)
 	{
@@ -2700,6 +2709,15 @@ static struct ctl_table vm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "oom_fast_select",
+		.data		= &sysctl_oom_fast_select,
+		.maxlen		= sizeof(sysctl_oom_fast_select),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
 	{
 		.procname	= "overcommit_ratio",
 		.data		= &sysctl_overcommit_ratio,
@@ -2862,6 +2880,15 @@ static struct ctl_table vm_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= &one_hundred,
 	},
+	{
+		.procname	= "compaction_demand",
+		.data		= &sysctl_compaction_demand,
+		.maxlen		= sizeof(sysctl_compaction_demand),
+		.mode		= 0644,
+		.proc_handler	= compaction_demand_sysctl_handler,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= &one_hundred,
+	},
 	{
 		.procname	= "extfrag_threshold",
 		.data		= &sysctl_extfrag_threshold,
@@ -2882,6 +2909,17 @@ static struct ctl_table vm_table[] = {
 	},
 
 #endif /* CONFIG_COMPACTION */
+#ifdef CONFIG_READAHEAD_PROFILE
+	{
+		.procname	= "readahead_profile",
+		.data		= &sysctl_readahead_profile,
+		.maxlen		= sizeof(sysctl_readahead_profile),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= &two,
+	},
+#endif
 	{
 		.procname	= "min_free_kbytes",
 		.data		= &min_free_kbytes,
@@ -1347,6 +1347,9 @@ kprobe_prog_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_get_stack_proto;
 #ifdef CONFIG_BPF_KPROBE_OVERRIDE
 	case BPF_FUNC_override_return:
+		/* ftrace ops of a multi link cannot modify the ip */
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return NULL;
 		return &bpf_override_return_proto;
 #endif
 	default:
@@ -2166,6 +2169,194 @@ int bpf_get_perf_event_info(const struct perf_event *event, u32 *prog_id,
 	return err;
 }
 
+#ifdef CONFIG_DYNAMIC_FTRACE_WITH_REGS
+/* upper bound on the functions of one link, the addresses are copied in */
+#define KPROBE_MULTI_MAX_CNT	(1U << 20)
+
+/*
+ * A kprobe multi link runs one BPF_PROG_TYPE_KPROBE program at the entry
+ * of many functions. Instead of one kprobe per function, each registered
+ * and patched on its own, all functions go into the filter of a single
+ * ftrace_ops, so attaching and detaching patch the call sites in one pass.
+ */
+struct bpf_kprobe_multi_link {
+	struct bpf_link link;
+	struct ftrace_ops ops;
+	unsigned long *addrs;
+	u32 cnt;
+};
+
+/*
+ * Called with preemption disabled and ftrace recursion protection, as the
+ * ops are not FTRACE_OPS_FL_RECURSION_SAFE.
+ */
+static void bpf_kprobe_multi_func(unsigned long ip, unsigned long parent_ip,
+				  struct ftrace_ops *ops, struct pt_regs *regs)
+{
+	struct bpf_kprobe_multi_link *link =
+		container_of(ops, struct bpf_kprobe_multi_link, ops);
+
+	/* see trace_call_bpf() */
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		goto out;
+
+	rcu_read_lock();
+	BPF_PROG_RUN(link->link.prog, regs);
+	rcu_read_unlock();
+out:
+	__this_cpu_dec(bpf_prog_active);
+}
+
+static void bpf_kprobe_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link =
+		container_of(link, struct bpf_kprobe_multi_link, link);
+
+	/* waits for running handlers */
+	unregister_ftrace_function(&kmulti_link->ops);
+}
+
+static void bpf_kprobe_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link =
+		container_of(link, struct bpf_kprobe_multi_link, link);
+
+	ftrace_free_filter(&kmulti_link->ops);
+	kvfree(kmulti_link->addrs);
+	kfree(kmulti_link);
+}
+
+static void bpf_kprobe_multi_link_show_fdinfo(const struct bpf_link *link,
+					      struct seq_file *seq)
+{
+	struct bpf_kprobe_multi_link *kmulti_link =
+		container_of(link, struct bpf_kprobe_multi_link, link);
+
+	seq_printf(seq, "func_cnt:\t%u\n", kmulti_link->cnt);
+}
+
+static const struct bpf_link_ops bpf_kprobe_multi_link_lops = {
+	.release = bpf_kprobe_multi_link_release,
+	.dealloc = bpf_kprobe_multi_link_dealloc,
+	.show_fdinfo = bpf_kprobe_multi_link_show_fdinfo,
+};
+
+/* Resolve the @cnt function names at @usyms into @addrs */
+static int kprobe_multi_resolve_syms(const void __user *usyms, u32 cnt,
+				     unsigned long *addrs)
+{
+	unsigned long __user *syms = (unsigned long __user *)usyms;
+	unsigned long usym;
+	char *name;
+	long len;
+	int err = 0;
+	u32 i;
+
+	name = kmalloc(KSYM_NAME_LEN, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		if (get_user(usym, syms + i)) {
+			err = -EFAULT;
+			break;
+		}
+		len = strncpy_from_user(name, (const char __user *)usym,
+					KSYM_NAME_LEN);
+		if (len == KSYM_NAME_LEN)
+			len = -E2BIG;
+		if (len < 0) {
+			err = len;
+			break;
+		}
+		addrs[i] = kallsyms_lookup_name(name);
+		if (!addrs[i]) {
+			err = -ENOENT;
+			break;
+		}
+		cond_resched();
+	}
+
+	kfree(name);
+	return err;
+}
+
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr,
+				 struct bpf_prog *prog)
+{
+	struct bpf_kprobe_multi_link *link;
+	struct bpf_link_primer link_primer;
+	void __user *uaddrs, *usyms;
+	unsigned long *addrs;
+	u32 cnt;
+	int err;
+
+	if (prog->expected_attach_type != BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+	if (attr->link_create.flags || attr->link_create.kprobe_multi.flags)
+		return -EINVAL;
+
+	/* there is no helper to read a cookie back */
+	if (attr->link_create.kprobe_multi.cookies)
+		return -EINVAL;
+
+	cnt = attr->link_create.kprobe_multi.cnt;
+	uaddrs = u64_to_user_ptr(attr->link_create.kprobe_multi.addrs);
+	usyms = u64_to_user_ptr(attr->link_create.kprobe_multi.syms);
+	if (!cnt || !uaddrs == !usyms)
+		return -EINVAL;
+	if (cnt > KPROBE_MULTI_MAX_CNT)
+		return -E2BIG;
+
+	addrs = kvmalloc_array(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return -ENOMEM;
+	if (usyms) {
+		err = kprobe_multi_resolve_syms(usyms, cnt, addrs);
+		if (err)
+			goto error;
+	} else if (copy_from_user(addrs, uaddrs, cnt * sizeof(*addrs))) {
+		err = -EFAULT;
+		goto error;
+	}
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	bpf_link_init(&link->link, BPF_LINK_TYPE_KPROBE_MULTI,
+		      &bpf_kprobe_multi_link_lops, prog);
+	link->ops.func = bpf_kprobe_multi_func;
+	link->ops.flags = FTRACE_OPS_FL_SAVE_REGS;
+	link->addrs = addrs;
+	link->cnt = cnt;
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err) {
+		kfree(link);
+		goto error;
+	}
+
+	/* fails for any address that is not the entry of a traced function */
+	err = ftrace_set_filter_ips(&link->ops, addrs, cnt, 0, 0);
+	if (!err)
+		err = register_ftrace_function(&link->ops);
+	if (err) {
+		/* frees addrs */
+		bpf_link_cleanup(&link_primer);
+		return err;
+	}
+
+	return bpf_link_settle(&link_primer);
+
+error:
+	kvfree(addrs);
+	return err;
+}
+#endif /* CONFIG_DYNAMIC_FTRACE_WITH_REGS */
+
 static int __init send_signal_irq_work_init(void)
 {
 	int cpu;
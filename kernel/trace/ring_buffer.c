@@ -4,6 +4,7 @@
  *
  * Copyright (C) 2008 Steven Rostedt <srostedt@redhat.com>
  */
+#include <uapi/linux/trace_mmap.h>
 #include <linux/trace_events.h>
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
@@ -18,6 +19,7 @@
 #include <linux/module.h>
 #include <linux/percpu.h>
 #include <linux/mutex.h>
+#include <linux/mm.h>
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/init.h>
@@ -332,6 +334,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* ID for external mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -531,6 +534,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* memory mapping, under buffer->mutex and reader_lock */
+	int				mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* ID to data page */
 };
 
 struct trace_buffer {
@@ -1606,6 +1614,11 @@ static void rb_free_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 		free_buffer_page(bpage);
 	}
 
+	/* the pages of a live mapping keep their own reference */
+	if (cpu_buffer->meta_page)
+		free_page((unsigned long)cpu_buffer->meta_page);
+	kfree(cpu_buffer->subbuf_ids);
+
 	kfree(cpu_buffer);
 }
 
@@ -4886,6 +4899,23 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	rb_head_page_activate(cpu_buffer);
 }
 
+/* Must be called with the reader_lock held */
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	if (!meta)
+		return;
+
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+}
+
 /* Must have disabled the cpu buffer then done a synchronize_rcu */
 static void reset_disabled_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4899,6 +4929,7 @@ static void reset_disabled_cpu_buffer(struct ring_buffer_per_cpu *cpu_buffer)
 	arch_spin_lock(&cpu_buffer->lock);
 
 	rb_reset_cpu(cpu_buffer);
+	rb_update_meta_page(cpu_buffer);
 
 	arch_spin_unlock(&cpu_buffer->lock);
 
@@ -5086,6 +5117,11 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* The pages of a mapped buffer cannot change hands */
+	ret = -EBUSY;
+	if (READ_ONCE(cpu_buffer_a->mapped) || READ_ONCE(cpu_buffer_b->mapped))
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -5305,12 +5341,14 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the buffer is memory mapped, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -5419,6 +5457,268 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+/*
+ * Give an ID to every data page, the reader page first and then the
+ * others from the head on, and describe the buffer in the meta page.
+ * The IDs stay with the pages as the reader swaps them around.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer,
+				   unsigned long *subbuf_ids)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	struct buffer_page *first_subbuf, *subbuf;
+	unsigned int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first_subbuf = subbuf = rb_set_head_page(cpu_buffer);
+	do {
+		if (RB_WARN_ON(cpu_buffer, id >= nr_subbufs))
+			break;
+
+		subbuf_ids[id] = (unsigned long)subbuf->page;
+		subbuf->id = id++;
+
+		rb_inc_page(cpu_buffer, &subbuf);
+	} while (subbuf != first_subbuf);
+
+	cpu_buffer->subbuf_ids = subbuf_ids;
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = nr_subbufs;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+/* The meta page comes first, then the data pages in ID order */
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_pages = cpu_buffer->nr_pages + 2;
+	unsigned long pgoff = vma->vm_pgoff, p;
+	struct page *page;
+	int err;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	if (pgoff + vma_pages(vma) > nr_pages)
+		return -EINVAL;
+
+	/* Only the kernel writes to the buffer */
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+
+	for (p = 0; p < vma_pages(vma); p++) {
+		if (pgoff + p == 0)
+			page = virt_to_page(cpu_buffer->meta_page);
+		else
+			page = virt_to_page((void *)
+				cpu_buffer->subbuf_ids[pgoff + p - 1]);
+
+		err = vm_insert_page(vma, vma->vm_start + p * PAGE_SIZE, page);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map the pages of a per CPU buffer
+ * @buffer: the buffer
+ * @cpu: the CPU buffer to map
+ * @vma: the user mapping, or NULL for an in kernel consumer
+ *
+ * While a CPU buffer is mapped, it cannot be resized or swapped with
+ * another buffer, and ring_buffer_read_page() copies instead of swapping
+ * pages. Every successful call must be paired with ring_buffer_unmap().
+ */
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long flags, *subbuf_ids;
+	struct trace_buffer_meta *meta;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		if (vma)
+			err = __rb_map_vma(cpu_buffer, vma);
+		if (!err) {
+			raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+			cpu_buffer->mapped++;
+			raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock,
+						   flags);
+		}
+		goto unlock;
+	}
+
+	/* resizing takes buffer->mutex, it cannot be under way */
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!meta || !subbuf_ids) {
+		free_page((unsigned long)meta);
+		kfree(subbuf_ids);
+		err = -ENOMEM;
+		goto unlock;
+	}
+
+	atomic_inc(&cpu_buffer->resize_disabled);
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->meta_page = meta;
+	rb_setup_ids_meta_page(cpu_buffer, subbuf_ids);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	if (vma) {
+		err = __rb_map_vma(cpu_buffer, vma);
+		if (err) {
+			mutex_unlock(&buffer->mutex);
+			ring_buffer_unmap(buffer, cpu);
+			return err;
+		}
+	}
+
+unlock:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta = NULL;
+	unsigned long flags, *subbuf_ids = NULL;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto unlock;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	if (!--cpu_buffer->mapped) {
+		meta = cpu_buffer->meta_page;
+		subbuf_ids = cpu_buffer->subbuf_ids;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+	}
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	if (meta) {
+		atomic_dec(&cpu_buffer->resize_disabled);
+		free_page((unsigned long)meta);
+		kfree(subbuf_ids);
+	}
+
+unlock:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - move the reader of a mapped buffer on
+ * @buffer: the buffer
+ * @cpu: the mapped CPU buffer
+ *
+ * If the reader page still has data not accounted as read, the consumer
+ * has seen it by now: account it. Otherwise swap in the next page, if the
+ * writer has left the reader page. Either way, update the meta page with
+ * the reader page ID and where its unread data starts.
+ */
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	reader = cpu_buffer->reader_page;
+	if (reader->read < rb_page_size(reader)) {
+		/* the entries of a page the writer left are all committed */
+		if (!reader->read && reader != cpu_buffer->commit_page) {
+			cpu_buffer->read += rb_page_entries(reader);
+			cpu_buffer->read_bytes += BUF_PAGE_SIZE;
+			reader->read = rb_page_size(reader);
+		}
+		while (reader->read < rb_page_size(reader))
+			rb_advance_reader(cpu_buffer);
+	} else {
+		rb_get_reader_page(cpu_buffer);
+	}
+
+	rb_update_meta_page(cpu_buffer);
+	cpu_buffer->lost_events = 0;
+
+ out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
+/* For in kernel consumers of a buffer mapped without a vma */
+struct trace_buffer_meta *ring_buffer_map_meta(struct trace_buffer *buffer,
+					       int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return NULL;
+
+	return buffer->buffers[cpu]->meta_page;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_meta);
+
+void *ring_buffer_map_subbuf(struct trace_buffer *buffer, int cpu,
+			     unsigned int id)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return NULL;
+
+	cpu_buffer = buffer->buffers[cpu];
+	if (!cpu_buffer->subbuf_ids || id > cpu_buffer->nr_pages)
+		return NULL;
+
+	return (void *)cpu_buffer->subbuf_ids[id];
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_subbuf);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -10,6 +10,8 @@
 #include <uapi/linux/sched/types.h>
 #include <linux/module.h>
 #include <linux/ktime.h>
+#include <linux/percpu.h>
+#include <uapi/linux/trace_mmap.h>
 #include <asm/local.h>
 
 struct rb_page {
@@ -33,6 +35,7 @@ static struct trace_buffer *buffer;
 static struct task_struct *producer;
 static struct task_struct *consumer;
 static unsigned long read;
+static u64 consumer_time;
 
 static unsigned int disable_reader;
 module_param(disable_reader, uint, 0644);
@@ -60,7 +63,29 @@ MODULE_PARM_DESC(producer_fifo, "use fifo for producer: 0 - disabled, 1 - low pr
 module_param(consumer_fifo, int, 0644);
 MODULE_PARM_DESC(consumer_fifo, "use fifo for consumer: 0 - disabled, 1 - low prio, 2 - fifo");
 
-static int read_events;
+/* the consumer goes through these in turn */
+enum read_mode {
+	READ_EVENTS,
+	READ_PAGES,
+	READ_MAPPED,
+	NR_READ_MODES,
+};
+
+static const char *read_mode_names[NR_READ_MODES] = {
+	[READ_EVENTS]	= "events",
+	[READ_PAGES]	= "pages",
+	[READ_MAPPED]	= "mapped pages",
+};
+
+static enum read_mode read_mode = NR_READ_MODES - 1;
+
+/* where the mapped consumer stopped in the reader page of a CPU */
+struct mapped_reader {
+	unsigned int	id;
+	unsigned long	off;
+};
+
+static DEFINE_PER_CPU(struct mapped_reader, mapped_reader);
 
 static int test_error;
 
@@ -102,75 +127,83 @@ static enum event_status read_event(int cpu)
 	return EVENT_FOUND;
 }
 
-static enum event_status read_page(int cpu)
+/* Check and count the events of @rpage from offset @start to @commit */
+static void read_page_events(struct rb_page *rpage, int cpu,
+			     unsigned long start, unsigned long commit)
 {
 	struct ring_buffer_event *event;
-	struct rb_page *rpage;
-	unsigned long commit;
-	void *bpage;
 	int *entry;
-	int ret;
 	int inc;
 	int i;
 
-	bpage = ring_buffer_alloc_read_page(buffer, cpu);
-	if (IS_ERR(bpage))
-		return EVENT_DROPPED;
+	for (i = start; i < commit && !test_error ; i += inc) {
 
-	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
-	if (ret >= 0) {
-		rpage = bpage;
-		/* The commit may have missed event flags set, clear them */
-		commit = local_read(&rpage->commit) & 0xfffff;
-		for (i = 0; i < commit && !test_error ; i += inc) {
+		if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+			TEST_ERROR();
+			break;
+		}
 
-			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+		inc = -1;
+		event = (void *)&rpage->data[i];
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* failed writes may be discarded events */
+			if (!event->time_delta)
+				TEST_ERROR();
+			inc = event->array[0] + 4;
+			break;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			inc = 8;
+			break;
+		case 0:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				TEST_ERROR();
 				break;
 			}
-
-			inc = -1;
-			event = (void *)&rpage->data[i];
-			switch (event->type_len) {
-			case RINGBUF_TYPE_PADDING:
-				/* failed writes may be discarded events */
-				if (!event->time_delta)
-					TEST_ERROR();
-				inc = event->array[0] + 4;
-				break;
-			case RINGBUF_TYPE_TIME_EXTEND:
-				inc = 8;
-				break;
-			case 0:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					TEST_ERROR();
-					break;
-				}
-				read++;
-				if (!event->array[0]) {
-					TEST_ERROR();
-					break;
-				}
-				inc = event->array[0] + 4;
+			read++;
+			if (!event->array[0]) {
+				TEST_ERROR();
 				break;
-			default:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					TEST_ERROR();
-					break;
-				}
-				read++;
-				inc = ((event->type_len + 1) * 4);
 			}
-			if (test_error)
-				break;
-
-			if (inc <= 0) {
+			inc = event->array[0] + 4;
+			break;
+		default:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				TEST_ERROR();
 				break;
 			}
+			read++;
+			inc = ((event->type_len + 1) * 4);
 		}
+		if (test_error)
+			break;
+
+		if (inc <= 0) {
+			TEST_ERROR();
+			break;
+		}
+	}
+}
+
+static enum event_status read_page(int cpu)
+{
+	struct rb_page *rpage;
+	unsigned long commit;
+	void *bpage;
+	int ret;
+
+	bpage = ring_buffer_alloc_read_page(buffer, cpu);
+	if (IS_ERR(bpage))
+		return EVENT_DROPPED;
+
+	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
+	if (ret >= 0) {
+		rpage = bpage;
+		/* The commit may have missed event flags set, clear them */
+		commit = local_read(&rpage->commit) & 0xfffff;
+		read_page_events(rpage, cpu, 0, commit);
 	}
 	ring_buffer_free_read_page(buffer, cpu, bpage);
 
@@ -179,12 +212,92 @@ static enum event_status read_page(int cpu)
 	return EVENT_FOUND;
 }
 
+/*
+ * Read the reader page in place, as a user space consumer of the mmapped
+ * buffer would. The writer may still be adding events to it, read up to
+ * the commit and remember where we stopped.
+ */
+static enum event_status read_mapped(int cpu)
+{
+	struct mapped_reader *mr = per_cpu_ptr(&mapped_reader, cpu);
+	struct trace_buffer_meta *meta = ring_buffer_map_meta(buffer, cpu);
+	struct rb_page *rpage;
+	unsigned long commit;
+	int tries;
+
+	/* the first GET_READER may only account what we read before */
+	for (tries = 0; tries < 2; tries++) {
+		if (ring_buffer_map_get_reader(buffer, cpu)) {
+			TEST_ERROR();
+			return EVENT_DROPPED;
+		}
+
+		if (meta->reader.id != mr->id) {
+			mr->id = meta->reader.id;
+			mr->off = meta->reader.read;
+		}
+
+		rpage = ring_buffer_map_subbuf(buffer, cpu, mr->id);
+		if (!rpage) {
+			TEST_ERROR();
+			return EVENT_DROPPED;
+		}
+
+		commit = local_read(&rpage->commit) & 0xfffff;
+		/* the events must be there before we look at them */
+		smp_rmb();
+		if (commit > mr->off) {
+			read_page_events(rpage, cpu, mr->off, commit);
+			mr->off = commit;
+			return EVENT_FOUND;
+		}
+	}
+
+	return EVENT_DROPPED;
+}
+
+static void unmap_cpus(void)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		if (ring_buffer_map_meta(buffer, cpu))
+			ring_buffer_unmap(buffer, cpu);
+	}
+}
+
+static int map_cpus(void)
+{
+	int cpu, ret;
+
+	for_each_online_cpu(cpu) {
+		ret = ring_buffer_map(buffer, cpu, NULL);
+		if (ret) {
+			unmap_cpus();
+			return ret;
+		}
+		/* no reader page ID is ever this one */
+		per_cpu_ptr(&mapped_reader, cpu)->id = UINT_MAX;
+	}
+
+	return 0;
+}
+
 static void ring_buffer_consumer(void)
 {
-	/* toggle between reading pages and events */
-	read_events ^= 1;
+	ktime_t start;
+
+	/* go through reading events, pages and mapped pages */
+	read_mode = (read_mode + 1) % NR_READ_MODES;
 
 	read = 0;
+	consumer_time = 0;
+
+	if (read_mode == READ_MAPPED && map_cpus()) {
+		pr_info("Cannot map the buffer, reading pages instead\n");
+		read_mode = READ_PAGES;
+	}
+
 	/*
 	 * Continue running until the producer specifically asks to stop
 	 * and is ready for the completion.
@@ -192,6 +305,7 @@ static void ring_buffer_consumer(void)
 	while (!READ_ONCE(reader_finish)) {
 		int found = 1;
 
+		start = ktime_get();
 		while (found && !test_error) {
 			int cpu;
 
@@ -199,10 +313,12 @@ static void ring_buffer_consumer(void)
 			for_each_online_cpu(cpu) {
 				enum event_status stat;
 
-				if (read_events)
+				if (read_mode == READ_EVENTS)
 					stat = read_event(cpu);
-				else
+				else if (read_mode == READ_PAGES)
 					stat = read_page(cpu);
+				else
+					stat = read_mapped(cpu);
 
 				if (test_error)
 					break;
@@ -212,6 +328,7 @@ static void ring_buffer_consumer(void)
 
 			}
 		}
+		consumer_time += ktime_us_delta(ktime_get(), start);
 
 		/* Wait till the producer wakes us up when there is more data
 		 * available or when the producer wants us to finish reading.
@@ -223,6 +340,10 @@ static void ring_buffer_consumer(void)
 		schedule();
 	}
 	__set_current_state(TASK_RUNNING);
+
+	if (read_mode == READ_MAPPED)
+		unmap_cpus();
+
 	reader_finish = 0;
 	complete(&read_done);
 }
@@ -236,6 +357,7 @@ static void ring_buffer_producer(void)
 	unsigned long missed = 0;
 	unsigned long hit = 0;
 	unsigned long avg;
+	u64 ctime;
 	int cnt = 0;
 
 	/*
@@ -328,7 +450,7 @@ static void ring_buffer_producer(void)
 		trace_printk("Read:     (reader disabled)\n");
 	else
 		trace_printk("Read:     %ld  (by %s)\n", read,
-			read_events ? "events" : "pages");
+			read_mode_names[read_mode]);
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
@@ -366,6 +488,16 @@ static void ring_buffer_producer(void)
 		avg = NSEC_PER_MSEC / (hit + missed);
 		trace_printk("%ld ns per entry\n", avg);
 	}
+
+	if (!disable_reader) {
+		/* time spent reading, the consumer sleeps in between */
+		ctime = consumer_time;
+		trace_printk("Consumer time: %lld (usecs)\n", ctime);
+		do_div(ctime, USEC_PER_MSEC);
+		if (ctime)
+			trace_printk("Read per millisec: %lld\n",
+				     div64_u64(read, ctime));
+	}
 }
 
 static void wait_to_die(void)
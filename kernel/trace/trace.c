@@ -48,6 +48,7 @@
 #include <linux/fsnotify.h>
 #include <linux/irq_work.h>
 #include <linux/workqueue.h>
+#include <uapi/linux/trace_mmap.h>
 #include <trace/hooks/ftrace_dump.h>
 
 #include "trace.h"
@@ -1125,6 +1126,12 @@ static void tracing_snapshot_instance_cond(struct trace_array *tr,
 		return;
 	}
 
+	if (READ_ONCE(tr->mapped)) {
+		internal_trace_puts("*** BUFFER MEMORY MAPPED ***\n");
+		internal_trace_puts("*** Can not use snapshot (sorry) ***\n");
+		return;
+	}
+
 	local_irq_save(flags);
 	update_max_tr(tr, current, smp_processor_id(), cond_data);
 	local_irq_restore(flags);
@@ -1830,6 +1837,10 @@ update_max_tr(struct trace_array *tr, struct task_struct *tsk, int cpu,
 	if (tr->cond_snapshot && !tr->cond_snapshot->update(tr, cond_data))
 		goto out_unlock;
 #endif
+	/* the mapped pages must stay with the buffer being written */
+	if (tr->mapped)
+		goto out_unlock;
+
 	swap(tr->array_buffer.buffer, tr->max_buffer.buffer);
 
 	__update_max_tr(tr, tsk, cpu);
@@ -5957,6 +5968,12 @@ int tracing_set_tracer(struct trace_array *tr, const char *buf)
 		goto out;
 	}
 
+	/* A memory mapped buffer cannot be swapped with the max buffer */
+	if (t->use_max_tr && READ_ONCE(tr->mapped)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
 	trace_branch_disable();
 
 	tr->current_trace->enabled--;
@@ -7007,10 +7024,12 @@ tracing_snapshot_write(struct file *filp, const char __user *ubuf, size_t cnt,
 		goto out;
 	}
 
+	local_irq_disable();
 	arch_spin_lock(&tr->max_lock);
-	if (tr->cond_snapshot)
+	if (tr->cond_snapshot || (val == 1 && tr->mapped))
 		ret = -EBUSY;
 	arch_spin_unlock(&tr->max_lock);
+	local_irq_enable();
 	if (ret)
 		goto out;
 
@@ -7769,12 +7788,95 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	return ring_buffer_map_get_reader(iter->array_buffer->buffer,
+					  iter->cpu_file);
+}
+
+static void tracing_set_mapped(struct trace_array *tr, int delta)
+{
+	local_irq_disable();
+	arch_spin_lock(&tr->max_lock);
+	tr->mapped += delta;
+	arch_spin_unlock(&tr->max_lock);
+	local_irq_enable();
+}
+
+/* The vma holds a reference on the file, info stays around */
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	/* a copy of a mapping already mapped, this cannot fail */
+	WARN_ON(ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file,
+				NULL));
+	tracing_set_mapped(iter->tr, 1);
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->array_buffer->buffer, iter->cpu_file));
+	tracing_set_mapped(iter->tr, -1);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	struct trace_array *tr = iter->tr;
+	int ret;
+
+	if (iter->cpu_file == RING_BUFFER_ALL_CPUS)
+		return -EINVAL;
+
+	mutex_lock(&trace_types_lock);
+
+	/* the latency tracers swap the buffers from under the mapping */
+	if (tr->current_trace->use_max_tr) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file, vma);
+	if (ret)
+		goto out;
+
+	tracing_set_mapped(tr, 1);
+	vma->vm_ops = &tracing_buffers_vmops;
+
+ out:
+	mutex_unlock(&trace_types_lock);
+	return ret;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -358,6 +358,7 @@ struct trace_array {
 	cpumask_var_t		tracing_cpumask; /* only trace on set CPUs */
 	int			ref;
 	int			trace_ref;
+	int			mapped;		/* protected by max_lock */
 #ifdef CONFIG_FUNCTION_TRACER
 	struct ftrace_ops	*ops;
 	struct trace_pid_list	__rcu *function_pids;
@@ -1445,9 +1446,11 @@ struct ftrace_event_field {
 };
 
 struct prog_entry;
+struct bpf_prog;
 
 struct event_filter {
 	struct prog_entry __rcu	*prog;
+	struct bpf_prog		*bpf_prog;	/* prog compiled, if it could be */
 	char			*filter_string;
 };
 
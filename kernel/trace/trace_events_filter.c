@@ -9,6 +9,7 @@
 #include <linux/ctype.h>
 #include <linux/mutex.h>
 #include <linux/perf_event.h>
+#include <linux/filter.h>
 #include <linux/slab.h>
 
 #include "trace.h"
@@ -892,6 +893,209 @@ static void filter_build_regex(struct filter_pred *pred)
 	}
 }
 
+#ifdef CONFIG_BPF_JIT
+/*
+ * Filters on numeric fields only are compiled into an eBPF program that
+ * does what filter_match_preds() does, with the record as context: every
+ * predicate becomes a load of the field and a conditional jump to where
+ * the program would branch, and the TRUE and FALSE entries at the end
+ * return 1 and 0. The program is only kept if the JIT compiled it, the
+ * BPF interpreter is no faster than walking the predicates.
+ */
+
+/* BPF jump ops of the predicate ops, as unsigned, signed and negated */
+static const struct {
+	u8	op;
+	u8	sop;
+	u8	nop;
+	u8	snop;
+} filter_bpf_jmp[OP_MAX] = {
+	[OP_EQ]	= { BPF_JEQ, BPF_JEQ,  BPF_JNE, BPF_JNE  },
+	[OP_NE]	= { BPF_JEQ, BPF_JEQ,  BPF_JNE, BPF_JNE  },
+	[OP_LE]	= { BPF_JLE, BPF_JSLE, BPF_JGT, BPF_JSGT },
+	[OP_LT]	= { BPF_JLT, BPF_JSLT, BPF_JGE, BPF_JSGE },
+	[OP_GE]	= { BPF_JGE, BPF_JSGE, BPF_JLT, BPF_JSLT },
+	[OP_GT]	= { BPF_JGT, BPF_JSGT, BPF_JLE, BPF_JSLE },
+	/* the AND is done first, then the result tested against zero */
+	[OP_BAND] = { BPF_JNE, BPF_JNE, BPF_JEQ, BPF_JEQ },
+};
+
+static bool filter_pred_compilable(struct filter_pred *pred)
+{
+	struct ftrace_event_field *field = pred->field;
+
+	if (!field || pred->fn == filter_pred_none ||
+	    is_string_field(field) || is_function_field(field) ||
+	    field->filter_type == FILTER_CPU)
+		return false;
+
+	switch (pred->op) {
+	case OP_EQ:
+	case OP_NE:
+	case OP_LE:
+	case OP_LT:
+	case OP_GE:
+	case OP_GT:
+	case OP_BAND:
+		break;
+	default:
+		return false;
+	}
+
+	switch (field->size) {
+	case 1:
+	case 2:
+	case 4:
+	case 8:
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Emit the code of the predicates, or with @insn NULL only compute the
+ * offset of each entry in @addrs. Returns the number of instructions.
+ */
+static int filter_bpf_emit(struct prog_entry *prog, int N,
+			   struct bpf_insn *insn, int *addrs)
+{
+	static const u8 bpf_size[] = {
+		[1] = BPF_B, [2] = BPF_H, [4] = BPF_W, [8] = BPF_DW,
+	};
+	int pc = 0;
+	int i;
+
+#define EMIT(x) do { if (insn) insn[pc] = (x); pc++; } while (0)
+
+	for (i = 0; i < N; i++) {
+		struct filter_pred *pred = prog[i].pred;
+		struct ftrace_event_field *field = pred->field;
+		int shift = 64 - field->size * 8;
+		bool sign = field->is_signed &&
+			    pred->op != OP_EQ && pred->op != OP_NE &&
+			    pred->op != OP_BAND;
+		bool sext = sign && shift;
+		bool neg = !(prog[i].when_to_branch ^ pred->not);
+		u64 val = pred->val;
+		bool imm;
+		int off;
+		u8 op;
+
+		if (shift) {
+			val &= (1ULL << (64 - shift)) - 1;
+			if (sext)
+				val = (s64)(val << shift) >> shift;
+		}
+		/* immediates are sign extended to 64 bits */
+		imm = val == (u64)(s64)(s32)val;
+
+		if (sign)
+			op = neg ? filter_bpf_jmp[pred->op].snop :
+				   filter_bpf_jmp[pred->op].sop;
+		else
+			op = neg ? filter_bpf_jmp[pred->op].nop :
+				   filter_bpf_jmp[pred->op].op;
+
+		if (!insn)
+			addrs[i] = pc;
+
+		EMIT(BPF_LDX_MEM(bpf_size[field->size], BPF_REG_2, BPF_REG_1,
+				 pred->offset));
+		if (sext) {
+			EMIT(BPF_ALU64_IMM(BPF_LSH, BPF_REG_2, shift));
+			EMIT(BPF_ALU64_IMM(BPF_ARSH, BPF_REG_2, shift));
+		}
+		if (!imm) {
+			struct bpf_insn ld[2] = { BPF_LD_IMM64(BPF_REG_3, val) };
+
+			EMIT(ld[0]);
+			EMIT(ld[1]);
+		}
+
+		/* the interpreter continues after the target on a branch */
+		off = insn ? addrs[prog[i].target + 1] : 0;
+
+		if (pred->op == OP_BAND) {
+			if (imm)
+				EMIT(BPF_ALU64_IMM(BPF_AND, BPF_REG_2, val));
+			else
+				EMIT(BPF_ALU64_REG(BPF_AND, BPF_REG_2,
+						   BPF_REG_3));
+			EMIT(BPF_JMP_IMM(op, BPF_REG_2, 0, off - pc - 1));
+		} else if (imm) {
+			EMIT(BPF_JMP_IMM(op, BPF_REG_2, val, off - pc - 1));
+		} else {
+			EMIT(BPF_JMP_REG(op, BPF_REG_2, BPF_REG_3,
+					 off - pc - 1));
+		}
+	}
+
+	/* prog[N] is TRUE and prog[N + 1] FALSE */
+	for (; i < N + 2; i++) {
+		if (!insn)
+			addrs[i] = pc;
+		EMIT(BPF_MOV64_IMM(BPF_REG_0, prog[i].target));
+		EMIT(BPF_EXIT_INSN());
+	}
+
+#undef EMIT
+
+	return pc;
+}
+
+static struct bpf_prog *filter_bpf_compile(struct prog_entry *prog)
+{
+	struct bpf_prog *fp;
+	int *addrs;
+	int len, N;
+	int err;
+
+	for (N = 0; prog[N].pred; N++) {
+		if (!filter_pred_compilable(prog[N].pred))
+			return NULL;
+	}
+
+	addrs = kmalloc_array(N + 2, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return NULL;
+
+	len = filter_bpf_emit(prog, N, NULL, addrs);
+	/* like the programs loaded by user space */
+	if (len > BPF_MAXINSNS) {
+		fp = NULL;
+		goto out;
+	}
+
+	fp = bpf_prog_alloc(bpf_prog_size(len), 0);
+	if (!fp)
+		goto out;
+
+	fp->len = filter_bpf_emit(prog, N, fp->insnsi, addrs);
+	fp = bpf_prog_select_runtime(fp, &err);
+	if (err || !fp->jited) {
+		bpf_prog_free(fp);
+		fp = NULL;
+	}
+ out:
+	kfree(addrs);
+	return fp;
+}
+
+static void filter_bpf_free(struct event_filter *filter)
+{
+	if (filter->bpf_prog)
+		bpf_prog_free(filter->bpf_prog);
+	filter->bpf_prog = NULL;
+}
+#else
+static inline struct bpf_prog *filter_bpf_compile(struct prog_entry *prog)
+{
+	return NULL;
+}
+
+static inline void filter_bpf_free(struct event_filter *filter) { }
+#endif /* CONFIG_BPF_JIT */
+
 /* return 1 if event matches, 0 otherwise (discard) */
 int filter_match_preds(struct event_filter *filter, void *rec)
 {
@@ -902,6 +1106,12 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 	if (!filter)
 		return 1;
 
+#ifdef CONFIG_BPF_JIT
+	/* set before the filter is, and stays for its lifetime */
+	if (filter->bpf_prog)
+		return BPF_PROG_RUN(filter->bpf_prog, rec);
+#endif
+
 	/* Protected by either SRCU(tracepoint_srcu) or preempt_disable */
 	prog = rcu_dereference_raw(filter->prog);
 	if (!prog)
@@ -1008,6 +1218,8 @@ static void free_prog(struct event_filter *filter)
 	struct prog_entry *prog;
 	int i;
 
+	filter_bpf_free(filter);
+
 	prog = rcu_access_pointer(filter->prog);
 	if (!prog)
 		return;
@@ -1536,6 +1748,8 @@ static int process_preds(struct trace_event_call *call,
 	if (IS_ERR(prog))
 		return PTR_ERR(prog);
 
+	/* the filter is not visible yet, no reader sees it half set */
+	filter->bpf_prog = filter_bpf_compile(prog);
 	rcu_assign_pointer(filter->prog, prog);
 	return 0;
 }
@@ -2109,6 +2323,13 @@ out_unlock:
 	.match  = m, \
 	.not_visited = nvisit, \
 }
+#define DATA_REC_S64(m, vi) \
+{ \
+	.filter = FILTER, \
+	.rec    = { .i = vi }, \
+	.match  = m, \
+	.not_visited = "", \
+}
 #define YES 1
 #define NO  0
 
@@ -2166,9 +2387,19 @@ static struct test_filter_data_t {
 	DATA_REC(YES, 1, 1, 1, 1, 1, 1, 1, 1, "bdfh"),
 	DATA_REC(YES, 0, 1, 0, 1, 0, 1, 0, 1, ""),
 	DATA_REC(YES, 1, 0, 1, 0, 1, 0, 1, 0, "bdfh"),
+#undef FILTER
+/* 64 bit signed compares, of the compiled program too */
+#define FILTER "i < -1"
+	DATA_REC_S64(YES, -2),
+	DATA_REC_S64(NO,  0),
+#undef FILTER
+#define FILTER "i >= -10"
+	DATA_REC_S64(YES, 5),
+	DATA_REC_S64(NO,  -11),
 };
 
 #undef DATA_REC
+#undef DATA_REC_S64
 #undef FILTER
 #undef YES
 #undef NO
@@ -2238,8 +2469,11 @@ static __init int ftrace_test_event_filter(void)
 		 * tests, but the rcu dereference will complain without it.
 		 */
 		preempt_disable();
-		if (*d->not_visited)
+		/* the walk is checked here, the compiled program elsewhere */
+		if (*d->not_visited) {
+			filter_bpf_free(filter);
 			update_pred_fn(filter, d->not_visited);
+		}
 
 		test_pred_visited = 0;
 		err = filter_match_preds(filter, &d->rec);
@@ -480,6 +480,64 @@ int __sbitmap_queue_get_shallow(struct sbitmap_queue *sbq,
 }
 EXPORT_SYMBOL_GPL(__sbitmap_queue_get_shallow);
 
+unsigned long __sbitmap_queue_get_batch(struct sbitmap_queue *sbq, int nr_tags,
+					unsigned int *offset)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned int hint, depth;
+	unsigned long index, nr;
+	int i;
+
+	if (unlikely(sbq->round_robin))
+		return 0;
+
+	depth = READ_ONCE(sb->depth);
+	hint = this_cpu_read(*sbq->alloc_hint);
+	if (unlikely(hint >= depth))
+		hint = 0;
+
+	index = SB_NR_TO_INDEX(sb, hint);
+
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long get_mask, val;
+
+		sbitmap_deferred_clear(sb, index);
+
+		/*
+		 * Only take a run of free bits starting at the first free
+		 * one, words too full for the whole batch are left to the
+		 * single bit allocations.
+		 */
+		nr = find_first_zero_bit(&map->word, map->depth);
+		if (nr + nr_tags <= map->depth) {
+			atomic_long_t *ptr = (atomic_long_t *)&map->word;
+
+			get_mask = ((1UL << nr_tags) - 1) << nr;
+			val = READ_ONCE(map->word);
+			while (!atomic_long_try_cmpxchg(ptr, (long *)&val,
+							(long)(val | get_mask)))
+				;
+			get_mask = (get_mask & ~val) >> nr;
+			if (get_mask) {
+				*offset = nr + (index << sb->shift);
+				hint = *offset + nr_tags;
+				if (hint >= depth - 1)
+					hint = 0;
+				this_cpu_write(*sbq->alloc_hint, hint);
+				return get_mask;
+			}
+		}
+
+		/* Jump to next index. */
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__sbitmap_queue_get_batch);
+
 void sbitmap_queue_min_shallow_depth(struct sbitmap_queue *sbq,
 				     unsigned int min_shallow_depth)
 {
@@ -589,6 +647,49 @@ void sbitmap_queue_clear(struct sbitmap_queue *sbq, unsigned int nr,
 }
 EXPORT_SYMBOL_GPL(sbitmap_queue_clear);
 
+void sbitmap_queue_clear_batch(struct sbitmap_queue *sbq, int offset,
+			       int *tags, int nr_tags)
+{
+	struct sbitmap *sb = &sbq->sb;
+	unsigned long *addr = NULL;
+	unsigned long mask = 0;
+	int i;
+
+	/* Pairs with the barrier in __sbitmap_queue_get_batch(), as above */
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_tags; i++) {
+		const int tag = tags[i] - offset;
+		unsigned long *this_addr;
+
+		/* since we're clearing a batch, skip the deferred map */
+		this_addr = &sb->map[SB_NR_TO_INDEX(sb, tag)].word;
+		if (!addr) {
+			addr = this_addr;
+		} else if (addr != this_addr) {
+			atomic_long_andnot(mask, (atomic_long_t *)addr);
+			mask = 0;
+			addr = this_addr;
+		}
+		mask |= (1UL << SB_NR_TO_BIT(sb, tag));
+	}
+
+	if (mask)
+		atomic_long_andnot(mask, (atomic_long_t *)addr);
+
+	/* Pairs with set_current_state() in the waiters, as above */
+	smp_mb__after_atomic();
+	for (i = 0; i < nr_tags; i++)
+		sbitmap_queue_wake_up(sbq);
+
+	if (nr_tags && likely(!sbq->round_robin)) {
+		const int tag = tags[nr_tags - 1] - offset;
+
+		if (tag < sb->depth)
+			this_cpu_write(*sbq->alloc_hint, tag);
+	}
+}
+EXPORT_SYMBOL_GPL(sbitmap_queue_clear_batch);
+
 void sbitmap_queue_wake_all(struct sbitmap_queue *sbq)
 {
 	int i, wake_index;
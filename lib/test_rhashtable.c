@@ -54,6 +54,10 @@ static bool enomem_retry = false;
 module_param(enomem_retry, bool, 0);
 MODULE_PARM_DESC(enomem_retry, "Retry insert even if -ENOMEM was returned (default: off)");
 
+static bool bulk = false;
+module_param(bulk, bool, 0);
+MODULE_PARM_DESC(bulk, "Insert in bulk and compare single and bulk lookups (default: off)");
+
 struct test_obj_val {
 	int	id;
 	int	tid;
@@ -172,6 +176,58 @@ static int __init test_rht_lookup(struct rhashtable *ht, struct test_obj *array,
 	return 0;
 }
 
+/* Scatter the keys looked up, like the flows of a packet burst */
+static unsigned int test_bulk_key(unsigned int i, unsigned int entries)
+{
+	return (i * 7919u) % (2 * entries);
+}
+
+static int __init test_rht_lookup_bulk(struct rhashtable *ht,
+				       unsigned int entries)
+{
+	struct test_obj_val keys[RHT_BULK_MAX] = {};
+	const void *kptrs[RHT_BULK_MAX];
+	void *objs[RHT_BULK_MAX];
+	unsigned int i, j, nr, found = 0, found_bulk = 0;
+	s64 start, single, batched;
+
+	for (j = 0; j < RHT_BULK_MAX; j++)
+		kptrs[j] = &keys[j];
+
+	rcu_read_lock();
+	start = ktime_get_ns();
+	for (i = 0; i < entries; i++) {
+		struct test_obj_val key = {
+			.id = test_bulk_key(i, entries),
+		};
+
+		if (rhashtable_lookup(ht, &key, test_rht_params))
+			found++;
+	}
+	single = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < entries; i += nr) {
+		nr = min_t(unsigned int, entries - i, RHT_BULK_MAX);
+		for (j = 0; j < nr; j++)
+			keys[j].id = test_bulk_key(i + j, entries);
+		found_bulk += rhashtable_lookup_bulk(ht, kptrs, objs, nr,
+						     test_rht_params);
+	}
+	batched = ktime_get_ns() - start;
+	rcu_read_unlock();
+
+	pr_info("  Lookups of %u keys: single %lld ns, bulk %lld ns\n",
+		entries, single, batched);
+
+	if (found != found_bulk) {
+		pr_warn("Test failed: bulk lookup found %u keys, single %u\n",
+			found_bulk, found);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static void test_bucket_stats(struct rhashtable *ht, unsigned int entries)
 {
 	unsigned int total = 0, chain_len = 0;
@@ -210,7 +266,7 @@ static s64 __init test_rhashtable(struct rhashtable *ht, struct test_obj *array,
 {
 	struct test_obj *obj;
 	int err;
-	unsigned int i, insert_retries = 0;
+	unsigned int i, nr, insert_retries = 0;
 	s64 start, end;
 
 	/*
@@ -219,16 +275,31 @@ static s64 __init test_rhashtable(struct rhashtable *ht, struct test_obj *array,
 	 */
 	pr_info("  Adding %d keys\n", entries);
 	start = ktime_get_ns();
-	for (i = 0; i < entries; i++) {
-		struct test_obj *obj = &array[i];
-
-		obj->value.id = i * 2;
-		err = insert_retry(ht, obj, test_rht_params);
-		if (err > 0)
-			insert_retries += err;
-		else if (err)
-			return err;
+	for (i = 0; i < entries; i += nr) {
+		struct rhash_head *heads[RHT_BULK_MAX];
+		unsigned int j, done = 0;
+
+		nr = bulk ? min_t(unsigned int, entries - i, RHT_BULK_MAX) : 1;
+		for (j = 0; j < nr; j++) {
+			array[i + j].value.id = (i + j) * 2;
+			heads[j] = &array[i + j].node;
+		}
+		if (bulk)
+			done = rhashtable_insert_bulk(ht, heads, nr,
+						      test_rht_params);
+
+		/* and one at a time what is left over, retrying as needed */
+		for (j = done; j < nr; j++) {
+			err = insert_retry(ht, &array[i + j], test_rht_params);
+			if (err > 0)
+				insert_retries += err;
+			else if (err)
+				return err;
+		}
 	}
+	if (bulk)
+		pr_info("  Bulk insertion took %lld ns\n",
+			ktime_get_ns() - start);
 
 	if (insert_retries)
 		pr_info("  %u insertions retried due to memory pressure\n",
@@ -239,6 +310,12 @@ static s64 __init test_rhashtable(struct rhashtable *ht, struct test_obj *array,
 	test_rht_lookup(ht, array, entries);
 	rcu_read_unlock();
 
+	if (bulk) {
+		err = test_rht_lookup_bulk(ht, entries);
+		if (err)
+			return err;
+	}
+
 	test_bucket_stats(ht, entries);
 
 	pr_info("  Deleting %d keys\n", entries);
@@ -35,6 +35,8 @@
 #include <linux/kmemleak.h>
 #include <linux/sched.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
 #include <trace/events/cma.h>
 
 #undef CREATE_TRACE_POINTS
@@ -45,6 +47,20 @@
 struct cma cma_areas[MAX_CMA_AREAS];
 unsigned cma_area_count;
 
+/* Prepare chunks once allocations in the area have been quiet for 1s */
+#define CMA_PREP_DELAY		HZ
+#define CMA_PREP_RETRY_DELAY	(10 * HZ)
+
+/* Most workers migrating the range of one allocation in parallel */
+#define CMA_MAX_PARALLEL	8
+
+/*
+ * Ranges of at least this many pages are migrated in parallel. The default
+ * keeps small allocations, which finish quickly, from waking up workers.
+ */
+static unsigned long parallel_migrate_pages = SZ_4M >> PAGE_SHIFT;
+module_param(parallel_migrate_pages, ulong, 0644);
+
 phys_addr_t cma_get_base(const struct cma *cma)
 {
 	return PFN_PHYS(cma->base_pfn);
@@ -99,6 +115,211 @@ static void cma_clear_bitmap(struct cma *cma, unsigned long pfn,
 	mutex_unlock(&cma->lock);
 }
 
+struct cma_migrate_work {
+	struct work_struct work;
+	unsigned long start;
+	unsigned long end;
+	gfp_t gfp_mask;
+	struct acr_info info;
+	int ret;
+};
+
+static void cma_migrate_work_fn(struct work_struct *work)
+{
+	struct cma_migrate_work *mw = container_of(work,
+					struct cma_migrate_work, work);
+
+	mw->ret = alloc_contig_range(mw->start, mw->end, MIGRATE_CMA,
+				     mw->gfp_mask, &mw->info);
+}
+
+/*
+ * alloc_contig_range() for [pfn, pfn + count), with large ranges split into
+ * MAX_ORDER aligned pieces that are migrated by several workers at once. The
+ * pieces never share a pageblock, so their isolation does not conflict.
+ * Either the whole range gets allocated or none of it.
+ */
+static int cma_alloc_contig(unsigned long pfn, unsigned long count,
+			    gfp_t gfp_mask, struct acr_info *info)
+{
+	unsigned long align = max_t(unsigned long, MAX_ORDER_NR_PAGES,
+				    pageblock_nr_pages);
+	unsigned long chunk, start, end = pfn + count;
+	struct cma_migrate_work *mw;
+	unsigned int nr, i;
+	int ret = 0;
+
+	nr = min_t(unsigned int, num_online_cpus(), CMA_MAX_PARALLEL);
+	if (count < READ_ONCE(parallel_migrate_pages) || nr < 2 ||
+	    count < 2 * align)
+		return alloc_contig_range(pfn, end, MIGRATE_CMA, gfp_mask, info);
+
+	chunk = ALIGN(DIV_ROUND_UP(count, nr), align);
+	nr = DIV_ROUND_UP(count, chunk) + 1;
+	mw = kcalloc(nr, sizeof(*mw), GFP_KERNEL | __GFP_NOWARN);
+	if (!mw)
+		return alloc_contig_range(pfn, end, MIGRATE_CMA, gfp_mask, info);
+
+	for (nr = 0, start = pfn; start < end; nr++) {
+		mw[nr].start = start;
+		mw[nr].end = min(end, round_down(start, align) + chunk);
+		mw[nr].gfp_mask = gfp_mask;
+		INIT_WORK(&mw[nr].work, cma_migrate_work_fn);
+		/* the caller takes the first piece itself */
+		if (nr)
+			queue_work(system_unbound_wq, &mw[nr].work);
+		start = mw[nr].end;
+	}
+
+	cma_migrate_work_fn(&mw[0].work);
+	for (i = 1; i < nr; i++)
+		flush_work(&mw[i].work);
+
+	for (i = 0; i < nr; i++) {
+		info->nr_mapped += mw[i].info.nr_mapped;
+		info->nr_migrated += mw[i].info.nr_migrated;
+		info->nr_reclaimed += mw[i].info.nr_reclaimed;
+		info->err |= mw[i].info.err;
+		if (mw[i].ret && !ret) {
+			ret = mw[i].ret;
+			info->failed_pfn = mw[i].info.failed_pfn;
+		}
+	}
+
+	if (ret) {
+		for (i = 0; i < nr; i++) {
+			if (!mw[i].ret)
+				free_contig_range(mw[i].start,
+						  mw[i].end - mw[i].start);
+		}
+	}
+
+	kfree(mw);
+	return ret;
+}
+
+/* Give the prepared chunk back, if it is smaller than @keep pages */
+static bool cma_drop_prepared(struct cma *cma, unsigned long keep)
+{
+	unsigned long pfn, count = 0;
+
+	mutex_lock(&cma->lock);
+	if (cma->prep_count < keep) {
+		pfn = cma->prep_pfn;
+		count = cma->prep_count;
+		cma->prep_count = 0;
+	}
+	mutex_unlock(&cma->lock);
+
+	if (!count)
+		return false;
+
+	free_contig_range(pfn, count);
+	cma_clear_bitmap(cma, pfn, count);
+	return true;
+}
+
+/*
+ * Keep a chunk of prep_target pages at the lowest free offset of the area
+ * migrated out and allocated, so that the next cma_alloc() that fits does
+ * not need to migrate anything. A leftover of less than half the target is
+ * given back and replaced by a fresh chunk.
+ */
+static void cma_prep_work_fn(struct work_struct *work)
+{
+	struct cma *cma = container_of(to_delayed_work(work), struct cma,
+				       prep_work);
+	unsigned long target = READ_ONCE(cma->prep_target);
+	unsigned long bitmap_no, bitmap_count, pfn;
+	struct acr_info info = {0};
+
+	cma_drop_prepared(cma, target ? target / 2 : ULONG_MAX);
+
+	mutex_lock(&cma->lock);
+	if (!target || cma->prep_count) {
+		mutex_unlock(&cma->lock);
+		return;
+	}
+
+	bitmap_count = cma_bitmap_pages_to_bits(cma, target);
+	bitmap_no = bitmap_find_next_zero_area_off(cma->bitmap,
+			cma_bitmap_maxno(cma), 0, bitmap_count,
+			cma_bitmap_aligned_mask(cma, pageblock_order),
+			cma_bitmap_aligned_offset(cma, pageblock_order));
+	if (bitmap_no >= cma_bitmap_maxno(cma)) {
+		mutex_unlock(&cma->lock);
+		return;
+	}
+	bitmap_set(cma->bitmap, bitmap_no, bitmap_count);
+	mutex_unlock(&cma->lock);
+
+	pfn = cma->base_pfn + (bitmap_no << cma->order_per_bit);
+	if (alloc_contig_range(pfn, pfn + target, MIGRATE_CMA,
+			       GFP_KERNEL | __GFP_NORETRY, &info)) {
+		cma_clear_bitmap(cma, pfn, target);
+		queue_delayed_work(system_unbound_wq, &cma->prep_work,
+				   CMA_PREP_RETRY_DELAY);
+		return;
+	}
+
+	mutex_lock(&cma->lock);
+	cma->prep_pfn = pfn;
+	cma->prep_count = target;
+	mutex_unlock(&cma->lock);
+}
+
+/*
+ * Serve an allocation from the head of the prepared chunk. Pages skipped
+ * for alignment go back to the buddy allocator. Returns the first pfn of
+ * the allocation, or -1 if it does not fit into the chunk.
+ */
+static unsigned long cma_take_prepared(struct cma *cma, size_t count,
+				       unsigned int align)
+{
+	unsigned long head, pfn, end;
+
+	mutex_lock(&cma->lock);
+	head = cma->prep_pfn;
+	pfn = ALIGN(head, 1UL << max(align, cma->order_per_bit));
+	end = pfn + ALIGN(count, 1UL << cma->order_per_bit);
+	if (!cma->prep_count || end > head + cma->prep_count) {
+		mutex_unlock(&cma->lock);
+		return -1UL;
+	}
+	cma->prep_count -= end - head;
+	cma->prep_pfn = end;
+	mutex_unlock(&cma->lock);
+
+	if (pfn > head) {
+		free_contig_range(head, pfn - head);
+		cma_clear_bitmap(cma, head, pfn - head);
+	}
+	/* the rest of the last bitmap bit, as alloc_contig_range() leaves it */
+	if (end > pfn + count)
+		free_contig_range(pfn + count, end - pfn - count);
+
+	return pfn;
+}
+
+/**
+ * cma_set_prep_pages() - set how many pages to keep prepared in an area
+ * @cma:      Contiguous memory region.
+ * @nr_pages: Size of the chunk, rounded up to whole pageblocks, 0 to stop.
+ */
+int cma_set_prep_pages(struct cma *cma, unsigned long nr_pages)
+{
+	if (!cma->bitmap)
+		return -EINVAL;
+
+	nr_pages = ALIGN(nr_pages, pageblock_nr_pages);
+	if (nr_pages > cma->count / 2)
+		return -EINVAL;
+
+	WRITE_ONCE(cma->prep_target, nr_pages);
+	mod_delayed_work(system_unbound_wq, &cma->prep_work, 0);
+	return 0;
+}
+
 static void __init cma_activate_area(struct cma *cma)
 {
 	unsigned long base_pfn = cma->base_pfn, pfn;
@@ -126,6 +347,7 @@ static void __init cma_activate_area(struct cma *cma)
 		init_cma_reserved_pageblock(pfn_to_page(pfn));
 
 	mutex_init(&cma->lock);
+	INIT_DELAYED_WORK(&cma->prep_work, cma_prep_work_fn);
 
 #ifdef CONFIG_CMA_DEBUGFS
 	INIT_HLIST_HEAD(&cma->mem_head);
@@ -443,6 +665,7 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align,
 	int num_attempts = 0;
 	int max_retries = 5;
 	s64 ts;
+	u64 start_ns = ktime_get_ns();
 	struct cma_alloc_info cma_info = {0};
 
 	trace_android_vh_cma_alloc_start(&ts);
@@ -466,13 +689,27 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align,
 	if (bitmap_count > bitmap_maxno)
 		goto out;
 
-	for (;;) {
+	pfn = cma_take_prepared(cma, count, align);
+	if (pfn != -1UL) {
+		page = pfn_to_page(pfn);
+		ret = 0;
+		cma_sysfs_account_prep_hit(cma);
+	}
+
+	while (!page) {
 		struct acr_info info = {0};
 
 		mutex_lock(&cma->lock);
 		bitmap_no = bitmap_find_next_zero_area_off(cma->bitmap,
 				bitmap_maxno, start, bitmap_count, mask,
 				offset);
+		if (bitmap_no >= bitmap_maxno && cma->prep_count) {
+			/* the prepared chunk is in the way, give it up */
+			mutex_unlock(&cma->lock);
+			cma_drop_prepared(cma, ULONG_MAX);
+			start = 0;
+			continue;
+		}
 		if (bitmap_no >= bitmap_maxno) {
 			if ((num_attempts < max_retries) && (ret == -EBUSY)) {
 				mutex_unlock(&cma->lock);
@@ -507,7 +744,7 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align,
 		mutex_unlock(&cma->lock);
 
 		pfn = cma->base_pfn + (bitmap_no << cma->order_per_bit);
-		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA, gfp_mask, &info);
+		ret = cma_alloc_contig(pfn, count, gfp_mask, &info);
 		cma_info.nr_migrated += info.nr_migrated;
 		cma_info.nr_reclaimed += info.nr_reclaimed;
 		cma_info.nr_mapped += info.nr_mapped;
@@ -565,6 +802,10 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align,
 	}
 
 	pr_debug("%s(): returned %p\n", __func__, page);
+	cma_sysfs_account_latency(cma, ktime_get_ns() - start_ns);
+	if (READ_ONCE(cma->prep_target))
+		mod_delayed_work(system_unbound_wq, &cma->prep_work,
+				 CMA_PREP_DELAY);
 out:
 	trace_android_vh_cma_alloc_finish(cma, page, count, align, gfp_mask, ts);
 	if (page) {
@@ -4,8 +4,12 @@
 
 #include <linux/debugfs.h>
 #include <linux/kobject.h>
+#include <linux/workqueue.h>
 #include <linux/android_vendor.h>
 
+/* Allocation latency buckets: < 1ms, < 2ms, ... < 512ms, >= 512ms */
+#define CMA_LATENCY_BUCKETS	11
+
 struct cma_kobject {
 	struct kobject kobj;
 	struct cma *cma;
@@ -17,6 +21,14 @@ struct cma {
 	unsigned long   *bitmap;
 	unsigned int order_per_bit; /* Order of pages represented by one bit */
 	struct mutex    lock;
+	/*
+	 * Chunk the prep_work already migrated out and keeps allocated for
+	 * the next cma_alloc(), protected by @lock. Its bits are set.
+	 */
+	unsigned long	prep_pfn;
+	unsigned long	prep_count;
+	unsigned long	prep_target; /* pages to keep prepared, 0 = off */
+	struct delayed_work prep_work;
 #ifdef CONFIG_CMA_DEBUGFS
 	struct hlist_head mem_head;
 	spinlock_t mem_head_lock;
@@ -28,6 +40,10 @@ struct cma {
 	atomic64_t nr_pages_succeeded;
 	/* the number of CMA page allocation failures */
 	atomic64_t nr_pages_failed;
+	/* the number of allocations served from the prepared chunk */
+	atomic64_t nr_prep_hits;
+	/* cma_alloc() latencies, see CMA_LATENCY_BUCKETS */
+	atomic64_t alloc_latency[CMA_LATENCY_BUCKETS];
 	/* kobject requires dynamic object */
 	struct cma_kobject *cma_kobj;
 #endif
@@ -42,13 +58,19 @@ static inline unsigned long cma_bitmap_maxno(struct cma *cma)
 	return cma->count >> cma->order_per_bit;
 }
 
+int cma_set_prep_pages(struct cma *cma, unsigned long nr_pages);
+
 #ifdef CONFIG_CMA_SYSFS
 void cma_sysfs_account_success_pages(struct cma *cma, unsigned long nr_pages);
 void cma_sysfs_account_fail_pages(struct cma *cma, unsigned long nr_pages);
+void cma_sysfs_account_prep_hit(struct cma *cma);
+void cma_sysfs_account_latency(struct cma *cma, u64 ns);
 #else
 static inline void cma_sysfs_account_success_pages(struct cma *cma,
 						   unsigned long nr_pages) {};
 static inline void cma_sysfs_account_fail_pages(struct cma *cma,
 						unsigned long nr_pages) {};
+static inline void cma_sysfs_account_prep_hit(struct cma *cma) {};
+static inline void cma_sysfs_account_latency(struct cma *cma, u64 ns) {};
 #endif
 #endif
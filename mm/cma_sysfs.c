@@ -7,6 +7,7 @@
 
 #include <linux/cma.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/module.h>
 
@@ -27,6 +28,19 @@ void cma_sysfs_account_fail_pages(struct cma *cma, unsigned long nr_pages)
 	atomic64_add(nr_pages, &cma->nr_pages_failed);
 }
 
+void cma_sysfs_account_prep_hit(struct cma *cma)
+{
+	atomic64_inc(&cma->nr_prep_hits);
+}
+
+void cma_sysfs_account_latency(struct cma *cma, u64 ns)
+{
+	unsigned long ms = div_u64(ns, NSEC_PER_MSEC);
+	int idx = min_t(int, fls_long(ms), CMA_LATENCY_BUCKETS - 1);
+
+	atomic64_inc(&cma->alloc_latency[idx]);
+}
+
 static inline struct cma *cma_from_kobj(struct kobject *kobj)
 {
 	return container_of(kobj, struct cma_kobject, kobj)->cma;
@@ -51,6 +65,57 @@ static ssize_t alloc_pages_fail_show(struct kobject *kobj,
 }
 CMA_ATTR_RO(alloc_pages_fail);
 
+static ssize_t alloc_prep_hits_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	struct cma *cma = cma_from_kobj(kobj);
+
+	return sysfs_emit(buf, "%llu\n", atomic64_read(&cma->nr_prep_hits));
+}
+CMA_ATTR_RO(alloc_prep_hits);
+
+/* One "<upper bound in ms> <count>" line per bucket, the last one open */
+static ssize_t alloc_latency_histogram_show(struct kobject *kobj,
+					    struct kobj_attribute *attr,
+					    char *buf)
+{
+	struct cma *cma = cma_from_kobj(kobj);
+	int i, len = 0;
+
+	for (i = 0; i < CMA_LATENCY_BUCKETS - 1; i++)
+		len += sysfs_emit_at(buf, len, "%u %llu\n", 1U << i,
+				     atomic64_read(&cma->alloc_latency[i]));
+	len += sysfs_emit_at(buf, len, "inf %llu\n",
+			     atomic64_read(&cma->alloc_latency[i]));
+	return len;
+}
+CMA_ATTR_RO(alloc_latency_histogram);
+
+static ssize_t prep_pages_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	struct cma *cma = cma_from_kobj(kobj);
+
+	return sysfs_emit(buf, "%lu\n", READ_ONCE(cma->prep_target));
+}
+
+static ssize_t prep_pages_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct cma *cma = cma_from_kobj(kobj);
+	unsigned long nr_pages;
+	int err;
+
+	err = kstrtoul(buf, 0, &nr_pages);
+	if (err)
+		return err;
+
+	err = cma_set_prep_pages(cma, nr_pages);
+	return err ? err : count;
+}
+static struct kobj_attribute prep_pages_attr = __ATTR_RW(prep_pages);
+
 static void cma_kobj_release(struct kobject *kobj)
 {
 	struct cma *cma = cma_from_kobj(kobj);
@@ -63,6 +128,9 @@ static void cma_kobj_release(struct kobject *kobj)
 static struct attribute *cma_attrs[] = {
 	&alloc_pages_success_attr.attr,
 	&alloc_pages_fail_attr.attr,
+	&alloc_prep_hits_attr.attr,
+	&alloc_latency_histogram_attr.attr,
+	&prep_pages_attr.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(cma);
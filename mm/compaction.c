@@ -52,6 +52,7 @@ static inline void count_compact_events(enum vm_event_item item, long delta)
 
 /*
  * Fragmentation score check interval for proactive compaction purposes.
+ * Also the interval in which kcompactd samples the high-order demand.
  */
 static const unsigned int HPAGE_FRAG_CHECK_INTERVAL_MSEC = 500;
 
@@ -1912,6 +1913,17 @@ static bool kswapd_is_running(pg_data_t *pgdat)
 	return pgdat->kswapd && (pgdat->kswapd->state == TASK_RUNNING);
 }
 
+/* Number of free blocks of @order in @zone, counting the larger ones too */
+static unsigned long zone_free_blocks(struct zone *zone, unsigned int order)
+{
+	unsigned long nr = 0;
+	unsigned int o;
+
+	for (o = order; o < MAX_ORDER; o++)
+		nr += READ_ONCE(zone->free_area[o].nr_free) << (o - order);
+	return nr;
+}
+
 /*
  * A zone's fragmentation score is the external fragmentation wrt to the
  * COMPACTION_HPAGE_ORDER. It returns a value in the range [0, 100].
@@ -2030,6 +2042,22 @@ static enum compact_result __compact_finished(struct compact_control *cc)
 		goto out;
 	}
 
+	if (cc->demand_target) {
+		if (kswapd_is_running(cc->zone->zone_pgdat))
+			return COMPACT_PARTIAL_SKIPPED;
+
+		/* finish the pageblock, like the direct compactor below */
+		if (!IS_ALIGNED(cc->migrate_pfn, pageblock_nr_pages))
+			return COMPACT_CONTINUE;
+
+		if (zone_free_blocks(cc->zone, cc->order) >= cc->demand_target)
+			ret = COMPACT_SUCCESS;
+		else
+			ret = COMPACT_CONTINUE;
+
+		goto out;
+	}
+
 	if (is_via_compact_memory(cc->order))
 		return COMPACT_CONTINUE;
 
@@ -2251,6 +2279,9 @@ compact_zone(struct compact_control *cc, struct capture_control *capc)
 	cc->migratetype = gfp_migratetype(cc->gfp_mask);
 	ret = compaction_suitable(cc->zone, cc->order, cc->alloc_flags,
 							cc->highest_zoneidx);
+	/* One free block is not enough for demand driven compaction */
+	if (ret == COMPACT_SUCCESS && cc->demand_target)
+		ret = COMPACT_CONTINUE;
 	/* Compaction is likely to fail */
 	if (ret == COMPACT_SUCCESS || ret == COMPACT_SKIPPED)
 		return ret;
@@ -2606,6 +2637,98 @@ static void proactive_compact_node(pg_data_t *pgdat)
 	}
 }
 
+/*
+ * Fold the requests of the last check interval into the per order averages
+ * of @pgdat. The averages are scaled by 64 and lose 1/8 per interval, so a
+ * burst is remembered for a few seconds. Returns true if any order still
+ * has demand.
+ */
+static bool compaction_demand_update(pg_data_t *pgdat)
+{
+	unsigned int order;
+	bool any = false;
+
+	for (order = COMPACT_DEMAND_MIN_ORDER; order < MAX_ORDER; order++) {
+		unsigned int avg = pgdat->compact_demand_avg[order];
+		unsigned int nr = atomic_xchg(&pgdat->compact_demand[order], 0);
+
+		avg -= DIV_ROUND_UP(avg, 8);
+		avg += min(nr, UINT_MAX / 128) * 8;
+		pgdat->compact_demand_avg[order] = avg;
+		if (avg)
+			any = true;
+	}
+
+	return any;
+}
+
+/*
+ * Compact the zones of @pgdat until they hold enough free blocks of every
+ * order with recent demand to serve sysctl_compaction_demand intervals of
+ * it. Orders are handled from the highest down, as the blocks built for a
+ * high order also count for the lower ones.
+ */
+static void demand_compact_node(pg_data_t *pgdat)
+{
+	unsigned int intervals = READ_ONCE(sysctl_compaction_demand);
+	int order, zoneid;
+
+	for (order = MAX_ORDER - 1; order >= COMPACT_DEMAND_MIN_ORDER; order--) {
+		unsigned long target;
+
+		target = DIV_ROUND_UP((unsigned long)pgdat->compact_demand_avg[order] *
+				      intervals, 64);
+		if (!target)
+			continue;
+
+		for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+			struct zone *zone = &pgdat->node_zones[zoneid];
+			struct compact_control cc = {
+				.order = order,
+				.search_order = order,
+				.highest_zoneidx = zoneid,
+				.mode = MIGRATE_SYNC_LIGHT,
+				.gfp_mask = GFP_KERNEL,
+				.zone = zone,
+			};
+
+			if (!populated_zone(zone))
+				continue;
+
+			/* never turn more than 1/64 of a zone into free blocks */
+			cc.demand_target = min(target,
+					zone_managed_pages(zone) >> (order + 6));
+			if (!cc.demand_target ||
+			    zone_free_blocks(zone, order) >= cc.demand_target)
+				continue;
+
+			if (compaction_deferred(zone, order) ||
+			    compaction_suitable(zone, order, 0, zoneid) ==
+							COMPACT_SKIPPED)
+				continue;
+
+			if (kthread_should_stop())
+				return;
+
+			count_compact_event(COMPACT_DEMAND_RUN);
+			if (compact_zone(&cc, NULL) == COMPACT_SUCCESS) {
+				count_compact_event(COMPACT_DEMAND_SUCCESS);
+				compaction_defer_reset(zone, order, false);
+			} else {
+				defer_compaction(zone, order);
+			}
+
+			count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+					     cc.total_migrate_scanned);
+			count_compact_events(KCOMPACTD_FREE_SCANNED,
+					     cc.total_free_scanned);
+
+			VM_BUG_ON(!list_empty(&cc.freepages));
+			VM_BUG_ON(!list_empty(&cc.migratepages));
+		}
+	}
+}
+
 /* Compact all zones within a node */
 static void compact_node(int nid)
 {
@@ -2658,26 +2781,62 @@ int sysctl_compact_memory;
  */
 unsigned int __read_mostly sysctl_compaction_proactiveness = 20;
 
+/*
+ * Tunable for demand driven compaction. When set, kcompactd keeps enough
+ * free blocks of every order above PAGE_ALLOC_COSTLY_ORDER to serve this
+ * many check intervals of the recent allocation requests of that order.
+ * It takes values in the range [0, 100], 0 disables it.
+ */
+unsigned int __read_mostly sysctl_compaction_demand;
+
+void __compaction_note_demand(pg_data_t *pgdat, unsigned int order)
+{
+	if (READ_ONCE(sysctl_compaction_demand))
+		atomic_inc(&pgdat->compact_demand[order]);
+}
+
+/* Kick every kcompactd into a check, so it picks up the new tunables */
+static void kcompactd_trigger_all(void)
+{
+	int nid;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (pgdat->proactive_compact_trigger)
+			continue;
+
+		pgdat->proactive_compact_trigger = true;
+		wake_up_interruptible(&pgdat->kcompactd_wait);
+	}
+}
+
 int compaction_proactiveness_sysctl_handler(struct ctl_table *table, int write,
 		void *buffer, size_t *length, loff_t *ppos)
 {
-	int rc, nid;
+	int rc;
 
 	rc = proc_dointvec_minmax(table, write, buffer, length, ppos);
 	if (rc)
 		return rc;
 
-	if (write && sysctl_compaction_proactiveness) {
-		for_each_online_node(nid) {
-			pg_data_t *pgdat = NODE_DATA(nid);
+	if (write && sysctl_compaction_proactiveness)
+		kcompactd_trigger_all();
 
-			if (pgdat->proactive_compact_trigger)
-				continue;
+	return 0;
+}
 
-			pgdat->proactive_compact_trigger = true;
-			wake_up_interruptible(&pgdat->kcompactd_wait);
-		}
-	}
+int compaction_demand_sysctl_handler(struct ctl_table *table, int write,
+		void *buffer, size_t *length, loff_t *ppos)
+{
+	int rc;
+
+	rc = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (rc)
+		return rc;
+
+	if (write && sysctl_compaction_demand)
+		kcompactd_trigger_all();
 
 	return 0;
 }
@@ -2878,7 +3037,8 @@ static int kcompactd(void *p)
 		unsigned long pflags;
 		long timeout;
 
-		timeout = sysctl_compaction_proactiveness ?
+		timeout = sysctl_compaction_proactiveness ||
+			  sysctl_compaction_demand ?
 			msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC) :
 			MAX_SCHEDULE_TIMEOUT;
 		trace_mm_compaction_kcompactd_sleep(pgdat->node_id);
@@ -2893,6 +3053,10 @@ static int kcompactd(void *p)
 		}
 
 		/* kcompactd wait timeout */
+		if (sysctl_compaction_demand && !kswapd_is_running(pgdat) &&
+		    compaction_demand_update(pgdat))
+			demand_compact_node(pgdat);
+
 		if (should_proactive_compact_node(pgdat)) {
 			unsigned int prev_score, score;
 
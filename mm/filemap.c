@@ -2178,6 +2178,106 @@ static void shrink_readahead_size_eio(struct file_ra_state *ra)
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Fast path of generic_file_buffered_read() for data that is already cached:
+ * look up a pagevec worth of pages with a single walk of the xarray, and copy
+ * each run of physically contiguous lowmem pages with one copy_to_iter().
+ * The batch ends at the first page that is not uptodate, carries PG_readahead
+ * or holds the end of the file; the page by page loop deals with those.
+ * Pipes always take the slow path so that splice keeps getting references
+ * to the page cache pages instead of copies.
+ *
+ * Returns the number of bytes copied, and advances @index, @offset and the
+ * prev_* state the same way the page by page loop does. *@fault is set if
+ * the copy came up short while @iter still had room.
+ */
+static size_t filemap_read_batch(struct address_space *mapping,
+		struct iov_iter *iter, pgoff_t *index, unsigned long *offset,
+		pgoff_t last_index, pgoff_t *prev_index,
+		unsigned int *prev_offset, bool *fault)
+{
+	struct page *pages[PAGEVEC_SIZE];
+	bool writably_mapped;
+	unsigned int i, j, k, nr, nr_ok;
+	pgoff_t end_index;
+	size_t copied = 0;
+	loff_t isize;
+
+	if (iov_iter_is_pipe(iter) || last_index - *index < 2)
+		return 0;
+
+	nr = find_get_pages_contig(mapping, *index,
+			min_t(pgoff_t, last_index - *index, PAGEVEC_SIZE), pages);
+	for (nr_ok = 0; nr_ok < nr; nr_ok++) {
+		if (!PageUptodate(pages[nr_ok]) || PageReadahead(pages[nr_ok]))
+			break;
+	}
+
+	/*
+	 * i_size must be checked after we know the pages are uptodate. Only
+	 * pages entirely below the last one of the file are copied here.
+	 */
+	isize = i_size_read(mapping->host);
+	end_index = (isize - 1) >> PAGE_SHIFT;
+	if (!isize || *index >= end_index)
+		nr_ok = 0;
+	else
+		nr_ok = min_t(pgoff_t, nr_ok, end_index - *index);
+
+	writably_mapped = mapping_writably_mapped(mapping);
+	for (i = 0; i < nr_ok; i = j) {
+		size_t len, ret;
+
+		j = i + 1;
+		if (!PageHighMem(pages[i])) {
+			while (j < nr_ok && !PageHighMem(pages[j]) &&
+			       page_to_pfn(pages[j]) ==
+			       page_to_pfn(pages[j - 1]) + 1)
+				j++;
+		}
+
+		for (k = i; k < j; k++) {
+			pgoff_t idx = *index + k - i;
+
+			if (writably_mapped)
+				flush_dcache_page(pages[k]);
+			/*
+			 * When a sequential read accesses a page several
+			 * times, only mark it as accessed the first time.
+			 */
+			if (*prev_index != idx ||
+			    (k == i ? *offset : 0) != *prev_offset)
+				mark_page_accessed(pages[k]);
+			*prev_index = idx;
+			*prev_offset = 0;
+		}
+
+		len = ((size_t)(j - i) << PAGE_SHIFT) - *offset;
+		if (j - i == 1)
+			ret = copy_page_to_iter(pages[i], *offset, len, iter);
+		else
+			ret = copy_to_iter(page_address(pages[i]) + *offset,
+					   len, iter);
+		copied += ret;
+
+		if (ret)
+			*prev_index = *index + ((*offset + ret - 1) >> PAGE_SHIFT);
+		*offset += ret;
+		*index += *offset >> PAGE_SHIFT;
+		*offset &= ~PAGE_MASK;
+		*prev_offset = *offset;
+
+		if (ret < len) {
+			*fault = iov_iter_count(iter) != 0;
+			break;
+		}
+	}
+
+	for (i = 0; i < nr; i++)
+		put_page(pages[i]);
+	return copied;
+}
+
 /**
  * generic_file_buffered_read - generic file read routine
  * @iocb:	the iocb to read
@@ -2232,6 +2332,7 @@ ssize_t generic_file_buffered_read(struct kiocb *iocb,
 		pgoff_t end_index;
 		loff_t isize;
 		unsigned long nr, ret;
+		bool fault = false;
 
 		cond_resched();
 find_page:
@@ -2240,6 +2341,20 @@ find_page:
 			goto out;
 		}
 
+		ret = filemap_read_batch(mapping, iter, &index, &offset,
+					 last_index, &prev_index, &prev_offset,
+					 &fault);
+		if (ret) {
+			written += ret;
+			if (!iov_iter_count(iter))
+				goto out;
+			if (fault) {
+				error = -EFAULT;
+				goto out;
+			}
+			continue;
+		}
+
 		page = find_get_page(mapping, index);
 		if (!page) {
 			if (iocb->ki_flags & IOCB_NOIO)
@@ -2630,6 +2745,9 @@ static struct file *do_sync_mmap_readahead(struct vm_fault *vmf)
 	struct file *fpin = NULL;
 	unsigned int mmap_miss;
 
+	/* Random faults are what a profile is best at replaying */
+	readahead_profile_note(file, vmf->pgoff, 1);
+
 	/* If we don't want any read-ahead, don't bother */
 	if (vmf->vma->vm_flags & VM_RAND_READ)
 		return fpin;
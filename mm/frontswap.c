@@ -324,6 +324,60 @@ int __frontswap_load(struct page *page)
 }
 EXPORT_SYMBOL(__frontswap_load);
 
+/*
+ * Batched __frontswap_load() for swap readahead: @pages are up to
+ * SWAP_READ_BATCH locked swap cache pages. On return, bit i of @loaded is set
+ * for every page that was filled from frontswap; the caller reads the rest
+ * from the swap device.
+ */
+void __frontswap_load_batch(struct page **pages, unsigned int nr,
+			    unsigned long *loaded)
+{
+	DECLARE_BITMAP(pending, SWAP_READ_BATCH);
+	swp_entry_t entries[SWAP_READ_BATCH];
+	struct frontswap_ops *ops;
+	unsigned int i;
+
+	VM_BUG_ON(!frontswap_ops);
+	VM_BUG_ON(nr > SWAP_READ_BATCH);
+
+	bitmap_zero(pending, SWAP_READ_BATCH);
+	for (i = 0; i < nr; i++) {
+		VM_BUG_ON_PAGE(!PageLocked(pages[i]), pages[i]);
+		entries[i].val = page_private(pages[i]);
+		if (__frontswap_test(swap_info[swp_type(entries[i])],
+				     swp_offset(entries[i])))
+			__set_bit(i, pending);
+	}
+	bitmap_copy(loaded, pending, nr);
+
+	/* Try loading from each implementation, until all succeeded. */
+	for_each_frontswap_ops(ops) {
+		if (bitmap_empty(pending, nr))
+			break;
+		if (ops->load_batch) {
+			ops->load_batch(entries, pages, nr, pending);
+			continue;
+		}
+		for_each_set_bit(i, pending, nr) {
+			if (!ops->load(swp_type(entries[i]),
+				       swp_offset(entries[i]), pages[i]))
+				__clear_bit(i, pending);
+		}
+	}
+
+	bitmap_andnot(loaded, loaded, pending, nr);
+	for_each_set_bit(i, loaded, nr) {
+		inc_frontswap_loads();
+		if (frontswap_tmem_exclusive_gets_enabled) {
+			SetPageDirty(pages[i]);
+			__frontswap_clear(swap_info[swp_type(entries[i])],
+					  swp_offset(entries[i]));
+		}
+	}
+}
+EXPORT_SYMBOL(__frontswap_load_batch);
+
 /*
  * Invalidate any data from frontswap associated with the specified swaptype
  * and offset so that a subsequent "get" will fail.
@@ -20,6 +20,7 @@
 #include <linux/moduleparam.h>
 #include <linux/random.h>
 #include <linux/rcupdate.h>
+#include <linux/sched/clock.h>
 #include <linux/sched/sysctl.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
@@ -81,6 +82,23 @@ static const struct kernel_param_ops sample_interval_param_ops = {
 };
 module_param_cb(sample_interval, &sample_interval_param_ops, &kfence_sample_interval, 0600);
 
+/*
+ * Upper bound of the sample interval in milliseconds, 0 disables the dynamic
+ * interval. See kfence_next_interval().
+ */
+static unsigned long kfence_sample_interval_max __read_mostly;
+module_param_named(sample_interval_max, kfence_sample_interval_max, ulong, 0600);
+
+/* The sample interval currently in use, for debugfs. */
+static unsigned long kfence_cur_interval;
+
+/*
+ * Comma-separated list of cache name prefixes to sample exclusively, e.g.
+ * "binder,dma_buf,kmalloc-256". Empty samples all caches.
+ */
+static char kfence_caches[128];
+module_param_string(caches, kfence_caches, sizeof(kfence_caches), 0400);
+
 /* The pool of pages used for guard pages and objects. */
 char *__kfence_pool __ro_after_init;
 EXPORT_SYMBOL(__kfence_pool); /* Export for test modules. */
@@ -111,6 +129,10 @@ enum kfence_counter_id {
 	KFENCE_COUNTER_FREES,
 	KFENCE_COUNTER_ZOMBIES,
 	KFENCE_COUNTER_BUGS,
+	KFENCE_COUNTER_WINDOWS,
+	KFENCE_COUNTER_WAIT_MS,
+	KFENCE_COUNTER_ALLOC_NS,
+	KFENCE_COUNTER_FREE_NS,
 	KFENCE_COUNTER_COUNT,
 };
 static atomic_long_t counters[KFENCE_COUNTER_COUNT];
@@ -120,6 +142,10 @@ static const char *const counter_names[] = {
 	[KFENCE_COUNTER_FREES]		= "total frees",
 	[KFENCE_COUNTER_ZOMBIES]	= "zombie allocations",
 	[KFENCE_COUNTER_BUGS]		= "total bugs",
+	[KFENCE_COUNTER_WINDOWS]	= "sample windows",
+	[KFENCE_COUNTER_WAIT_MS]	= "sample window wait ms",
+	[KFENCE_COUNTER_ALLOC_NS]	= "allocation time ns",
+	[KFENCE_COUNTER_FREE_NS]	= "free time ns",
 };
 static_assert(ARRAY_SIZE(counter_names) == KFENCE_COUNTER_COUNT);
 
@@ -417,8 +443,30 @@ static void kfence_guarded_free(void *addr, struct kfence_metadata *meta, bool z
 static void rcu_guarded_free(struct rcu_head *h)
 {
 	struct kfence_metadata *meta = container_of(h, struct kfence_metadata, rcu_head);
+	u64 start = local_clock();
 
 	kfence_guarded_free((void *)meta->addr, meta, false);
+	atomic_long_add(local_clock() - start, &counters[KFENCE_COUNTER_FREE_NS]);
+}
+
+/* Return true if allocations from @s may be sampled, see kfence.caches. */
+static bool kfence_cache_targeted(const struct kmem_cache *s)
+{
+	const char *p = kfence_caches;
+	size_t len;
+
+	if (!*p)
+		return true;
+
+	while (*p) {
+		len = strcspn(p, ",");
+		if (len && !strncmp(s->name, p, len))
+			return true;
+		p += len;
+		if (*p)
+			p++;
+	}
+	return false;
 }
 
 static bool __init kfence_init_pool(void)
@@ -516,6 +564,7 @@ static int stats_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "enabled: %i\n", READ_ONCE(kfence_enabled));
 	for (i = 0; i < KFENCE_COUNTER_COUNT; i++)
 		seq_printf(seq, "%s: %ld\n", counter_names[i], atomic_long_read(&counters[i]));
+	seq_printf(seq, "sample interval ms: %lu\n", READ_ONCE(kfence_cur_interval));
 
 	return 0;
 }
@@ -600,6 +649,25 @@ static void wake_up_kfence_timer(struct irq_work *work)
 static DEFINE_IRQ_WORK(wake_up_kfence_timer_work, wake_up_kfence_timer);
 #endif
 
+/*
+ * With kfence.sample_interval_max set, the interval grows from sample_interval
+ * towards it as the pool fills up: a busy system that allocates and keeps many
+ * guarded objects backs off before the pool runs out, and samples at the full
+ * rate again once the objects are freed.
+ */
+static unsigned long kfence_next_interval(void)
+{
+	unsigned long base = READ_ONCE(kfence_sample_interval);
+	unsigned long max = READ_ONCE(kfence_sample_interval_max);
+	long allocated = atomic_long_read(&counters[KFENCE_COUNTER_ALLOCATED]);
+
+	if (max <= base)
+		return base;
+
+	allocated = clamp_t(long, allocated, 0, CONFIG_KFENCE_NUM_OBJECTS);
+	return base + (max - base) * allocated / CONFIG_KFENCE_NUM_OBJECTS;
+}
+
 /*
  * Set up delayed work, which will enable and disable the static key. We need to
  * use a work queue (rather than a simple timer), since enabling and disabling a
@@ -614,11 +682,19 @@ static DEFINE_IRQ_WORK(wake_up_kfence_timer_work, wake_up_kfence_timer);
 static struct delayed_work kfence_timer;
 static void toggle_allocation_gate(struct work_struct *work)
 {
+	unsigned long interval = kfence_next_interval();
+#ifdef CONFIG_KFENCE_STATIC_KEYS
+	unsigned long start, waited;
+#endif
+
 	if (!READ_ONCE(kfence_enabled))
 		return;
 
+	WRITE_ONCE(kfence_cur_interval, interval);
+	atomic_long_inc(&counters[KFENCE_COUNTER_WINDOWS]);
 	atomic_set(&kfence_allocation_gate, 0);
 #ifdef CONFIG_KFENCE_STATIC_KEYS
+	start = jiffies;
 	/* Enable static key, and await allocation to happen. */
 	static_branch_enable(&kfence_allocation_key);
 
@@ -635,9 +711,19 @@ static void toggle_allocation_gate(struct work_struct *work)
 
 	/* Disable static key and reset timer. */
 	static_branch_disable(&kfence_allocation_key);
+
+	waited = jiffies_to_msecs(jiffies - start);
+	atomic_long_add(waited, &counters[KFENCE_COUNTER_WAIT_MS]);
+	/*
+	 * On a quiet system the wait for an allocation dominates the period,
+	 * count it towards the interval so the sample rate stays close to the
+	 * configured one when the dynamic interval is on.
+	 */
+	if (READ_ONCE(kfence_sample_interval_max))
+		interval -= min(interval, waited);
 #endif
 	queue_delayed_work(system_unbound_wq, &kfence_timer,
-			   msecs_to_jiffies(kfence_sample_interval));
+			   msecs_to_jiffies(interval));
 }
 static DECLARE_DELAYED_WORK(kfence_timer, toggle_allocation_gate);
 
@@ -672,6 +758,12 @@ void __init kfence_init(void)
 		(void *)(__kfence_pool + KFENCE_POOL_SIZE));
 }
 
+void kfence_init_cache(struct kmem_cache *s)
+{
+	if (!kfence_cache_targeted(s))
+		s->flags |= SLAB_SKIP_KFENCE;
+}
+
 void kfence_shutdown_cache(struct kmem_cache *s)
 {
 	unsigned long flags;
@@ -733,6 +825,9 @@ void kfence_shutdown_cache(struct kmem_cache *s)
 
 void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 {
+	void *ret;
+	u64 start;
+
 	/*
 	 * Perform size check before switching kfence_allocation_gate, so that
 	 * we don't disable KFENCE without making an allocation.
@@ -749,6 +844,10 @@ void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 	    (s->flags & (SLAB_CACHE_DMA | SLAB_CACHE_DMA32)))
 		return NULL;
 
+	/* Keep the gate open for the next allocation from a targeted cache. */
+	if (s->flags & SLAB_SKIP_KFENCE)
+		return NULL;
+
 	/*
 	 * allocation_gate only needs to become non-zero, so it doesn't make
 	 * sense to continue writing to it and pay the associated contention
@@ -773,7 +872,10 @@ void *__kfence_alloc(struct kmem_cache *s, size_t size, gfp_t flags)
 	if (!READ_ONCE(kfence_enabled))
 		return NULL;
 
-	return kfence_guarded_alloc(s, size, flags);
+	start = local_clock();
+	ret = kfence_guarded_alloc(s, size, flags);
+	atomic_long_add(local_clock() - start, &counters[KFENCE_COUNTER_ALLOC_NS]);
+	return ret;
 }
 
 size_t kfence_ksize(const void *addr)
@@ -801,6 +903,7 @@ void *kfence_object_start(const void *addr)
 void __kfence_free(void *addr)
 {
 	struct kfence_metadata *meta = addr_to_metadata((unsigned long)addr);
+	u64 start = local_clock();
 
 	/*
 	 * If the objects of the cache are SLAB_TYPESAFE_BY_RCU, defer freeing
@@ -812,6 +915,7 @@ void __kfence_free(void *addr)
 		call_rcu(&meta->rcu_head, rcu_guarded_free);
 	else
 		kfence_guarded_free(addr, meta, false);
+	atomic_long_add(local_clock() - start, &counters[KFENCE_COUNTER_FREE_NS]);
 }
 
 bool kfence_handle_page_fault(unsigned long addr, bool is_write, struct pt_regs *regs)
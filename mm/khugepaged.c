@@ -77,6 +77,7 @@ static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
 static unsigned int khugepaged_max_ptes_none __read_mostly;
 static unsigned int khugepaged_max_ptes_swap __read_mostly;
 static unsigned int khugepaged_max_ptes_shared __read_mostly;
+static unsigned int khugepaged_max_sync_collapse __read_mostly = 64;
 
 #define MM_SLOTS_HASH_BITS 10
 static __read_mostly DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
@@ -323,11 +324,46 @@ static struct kobj_attribute khugepaged_max_ptes_shared_attr =
 	__ATTR(max_ptes_shared, 0644, khugepaged_max_ptes_shared_show,
 	       khugepaged_max_ptes_shared_store);
 
+/*
+ * max_sync_collapse is the number of huge pages a process may collapse
+ * from its own context with MADV_COLLAPSE, over its whole lifetime. The
+ * collapse costs the caller a huge page allocation and a copy per range,
+ * the budget keeps a misbehaving process from turning that into a way of
+ * hogging CPU and huge pages.
+ */
+static ssize_t khugepaged_max_sync_collapse_show(struct kobject *kobj,
+						 struct kobj_attribute *attr,
+						 char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_max_sync_collapse);
+}
+
+static ssize_t khugepaged_max_sync_collapse_store(struct kobject *kobj,
+						  struct kobj_attribute *attr,
+						  const char *buf, size_t count)
+{
+	int err;
+	unsigned int max_sync_collapse;
+
+	err = kstrtouint(buf, 10, &max_sync_collapse);
+	if (err)
+		return -EINVAL;
+
+	khugepaged_max_sync_collapse = max_sync_collapse;
+
+	return count;
+}
+
+static struct kobj_attribute khugepaged_max_sync_collapse_attr =
+	__ATTR(max_sync_collapse, 0644, khugepaged_max_sync_collapse_show,
+	       khugepaged_max_sync_collapse_store);
+
 static struct attribute *khugepaged_attr[] = {
 	&khugepaged_defrag_attr.attr,
 	&khugepaged_max_ptes_none_attr.attr,
 	&khugepaged_max_ptes_swap_attr.attr,
 	&khugepaged_max_ptes_shared_attr.attr,
+	&khugepaged_max_sync_collapse_attr.attr,
 	&pages_to_scan_attr.attr,
 	&pages_collapsed_attr.attr,
 	&full_scans_attr.attr,
@@ -1635,7 +1671,7 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + restore gaps in the page cache;
  *    + unlock and free huge page;
  */
-static void collapse_file(struct mm_struct *mm,
+static int collapse_file(struct mm_struct *mm,
 		struct file *file, pgoff_t start,
 		struct page **hpage, int node)
 {
@@ -1978,9 +2014,10 @@ out:
 	if (!IS_ERR_OR_NULL(*hpage))
 		mem_cgroup_uncharge(*hpage);
 	/* TODO: tracepoints */
+	return result;
 }
 
-static void khugepaged_scan_file(struct mm_struct *mm,
+static int khugepaged_scan_file(struct mm_struct *mm,
 		struct file *file, pgoff_t start, struct page **hpage)
 {
 	struct page *page = NULL;
@@ -2049,17 +2086,19 @@ static void khugepaged_scan_file(struct mm_struct *mm,
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
 			node = khugepaged_find_target_node();
-			collapse_file(mm, file, start, hpage, node);
+			result = collapse_file(mm, file, start, hpage, node);
 		}
 	}
 
 	/* TODO: tracepoints */
+	return result;
 }
 #else
-static void khugepaged_scan_file(struct mm_struct *mm,
+static int khugepaged_scan_file(struct mm_struct *mm,
 		struct file *file, pgoff_t start, struct page **hpage)
 {
 	BUILD_BUG();
+	return SCAN_FAIL;
 }
 
 static int khugepaged_collapse_pte_mapped_thps(struct mm_slot *mm_slot)
@@ -2068,6 +2107,100 @@ static int khugepaged_collapse_pte_mapped_thps(struct mm_slot *mm_slot)
 }
 #endif
 
+/**
+ * madvise_collapse - collapse the file THPs of a range right away
+ * @vma: the vma the range is in, with mmap_lock held for read
+ * @prev: set to %NULL, as mmap_lock is dropped
+ * @start: start of the range
+ * @end: end of the range
+ *
+ * Collapses the read-only file or shmem pages of every huge page aligned
+ * part of the range into THPs, in the context of the caller rather than
+ * whenever khugepaged's scan gets there, and maps them with PMDs. Ranges
+ * whose page cache is already huge only get their page tables retracted.
+ *
+ * Return: 0 if every range was collapsed, -EINVAL if the vma does not
+ * qualify for file THPs, -ENOMEM if no huge page could be allocated and
+ * -EAGAIN if a range failed for a transient reason or the max_sync_collapse
+ * budget of the process ran out.
+ */
+int madvise_collapse(struct vm_area_struct *vma, struct vm_area_struct **prev,
+		     unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct file *file = vma->vm_file;
+	unsigned long hstart, hend, addr;
+	struct page *hpage = NULL;
+	bool wait = false;
+	pgoff_t pgoff;
+	int ret = 0;
+
+	*prev = vma;
+	if (!IS_ENABLED(CONFIG_SHMEM) || !file ||
+	    !hugepage_vma_check(vma, vma->vm_flags | VM_HUGEPAGE))
+		return -EINVAL;
+
+	hstart = ALIGN(start, HPAGE_PMD_SIZE);
+	hend = end & HPAGE_PMD_MASK;
+	if (hstart >= hend)
+		return 0;
+
+	*prev = NULL;	/* tell sys_madvise we drop mmap_lock */
+	get_file(file);
+	pgoff = linear_page_index(vma, hstart);
+	mmap_read_unlock(mm);
+
+	/* pages still in the per-cpu pagevecs fail the refcount check */
+	lru_add_drain_all();
+
+	for (addr = hstart; addr < hend;
+	     addr += HPAGE_PMD_SIZE, pgoff += HPAGE_PMD_NR) {
+		int result;
+
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		if (atomic_read(&mm->thp_sync_collapsed) >=
+		    READ_ONCE(khugepaged_max_sync_collapse)) {
+			ret = -EAGAIN;
+			break;
+		}
+
+		if (!khugepaged_prealloc_page(&hpage, &wait)) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		/*
+		 * khugepaged_node_load is shared with khugepaged, a concurrent
+		 * scan can at worst skew the node the huge page comes from.
+		 */
+		result = khugepaged_scan_file(mm, file, pgoff, &hpage);
+		if (result == SCAN_SUCCEED) {
+			atomic_inc(&mm->thp_sync_collapsed);
+		} else if (result == SCAN_PAGE_COMPOUND) {
+			/* already huge, maybe still mapped by ptes here */
+			mmap_write_lock(mm);
+			collapse_pte_mapped_thp(mm, addr);
+			mmap_write_unlock(mm);
+		} else if (result == SCAN_ALLOC_HUGE_PAGE_FAIL) {
+			ret = -ENOMEM;
+		} else {
+			ret = -EAGAIN;
+		}
+
+		cond_resched();
+	}
+
+	if (!IS_ERR_OR_NULL(hpage))
+		put_page(hpage);
+	fput(file);
+	mmap_read_lock(mm);
+	return ret;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
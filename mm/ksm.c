@@ -116,12 +116,18 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @nr_merged: pages of this mm that got merged during the current scan
+ * @idle_passes: number of consecutive full scans that merged nothing here
+ * @skip_passes: number of full scans left to skip this mm for
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	unsigned long nr_merged;
+	unsigned short idle_passes;
+	unsigned short skip_passes;
 };
 
 /**
@@ -272,6 +278,20 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Whether ksmd adjusts pages_to_scan to the yield of each full scan */
+static bool ksm_autotune __read_mostly;
+
+/* Range autotuning keeps pages_to_scan in */
+static unsigned int ksm_autotune_min_pages = 100;
+static unsigned int ksm_autotune_max_pages = 4000;
+
+/* Pages scanned and merged in the current full scan */
+static unsigned long ksm_pass_scanned;
+static unsigned long ksm_pass_merged;
+
+/* Most full scans an mm that merges nothing is skipped for */
+#define KSM_MAX_SKIP_PASSES	8
+
 /* Checksum of an empty (zeroed) page */
 static unsigned int zero_checksum __read_mostly;
 
@@ -2223,6 +2243,70 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Called at the end of every full scan: double pages_to_scan while at least
+ * one in 64 of the scanned pages got merged, halve it once fewer than one
+ * in 1024 did.
+ */
+static void ksm_autotune_pass(void)
+{
+	unsigned long scanned = ksm_pass_scanned;
+	unsigned long merged = ksm_pass_merged;
+	unsigned int pages;
+
+	ksm_pass_scanned = 0;
+	ksm_pass_merged = 0;
+	if (!READ_ONCE(ksm_autotune) || !scanned)
+		return;
+
+	pages = min(READ_ONCE(ksm_thread_pages_to_scan), ksm_autotune_max_pages);
+	if (merged * 64 >= scanned)
+		pages *= 2;
+	else if (merged * 1024 < scanned)
+		pages /= 2;
+
+	pages = clamp(pages, ksm_autotune_min_pages, ksm_autotune_max_pages);
+	WRITE_ONCE(ksm_thread_pages_to_scan, pages);
+}
+
+/*
+ * Account the yield of the full scan of @slot that just ended. An mm that
+ * keeps merging nothing is skipped for 1, 2, 4 and at most 8 scans, which
+ * leaves the pages_to_scan budget to the processes that do share pages.
+ */
+static void ksm_slot_end_pass(struct mm_slot *slot)
+{
+	ksm_pass_merged += slot->nr_merged;
+
+	if (slot->nr_merged)
+		slot->idle_passes = 0;
+	else if (slot->idle_passes < 5)
+		slot->idle_passes++;
+	/* the first idle scan only filled the unstable tree */
+	slot->skip_passes = slot->idle_passes > 1 ?
+			    min(1 << (slot->idle_passes - 2),
+				KSM_MAX_SKIP_PASSES) : 0;
+	slot->nr_merged = 0;
+}
+
+static bool ksm_slot_skip_pass(struct mm_slot *slot)
+{
+	struct rmap_item *rmap_item;
+
+	if (!slot->skip_passes || ksm_test_exit(slot->mm))
+		return false;
+
+	slot->skip_passes--;
+
+	/* the unstable tree is rebuilt every scan, forget the stale nodes */
+	for (rmap_item = slot->rmap_list; rmap_item;
+	     rmap_item = rmap_item->rmap_list) {
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+	}
+	return true;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -2282,6 +2366,19 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		if (slot == &ksm_mm_head)
 			return NULL;
 next_mm:
+		if (ksm_slot_skip_pass(slot)) {
+			spin_lock(&ksm_mmlist_lock);
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			ksm_scan.mm_slot = slot;
+			spin_unlock(&ksm_mmlist_lock);
+			if (slot != &ksm_mm_head)
+				goto next_mm;
+
+			ksm_scan.seqnr++;
+			ksm_autotune_pass();
+			return NULL;
+		}
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
 	}
@@ -2339,6 +2436,7 @@ next_mm:
 	 * because there were no VM_MERGEABLE vmas with such addresses.
 	 */
 	remove_trailing_rmap_items(slot, ksm_scan.rmap_list);
+	ksm_slot_end_pass(slot);
 
 	spin_lock(&ksm_mmlist_lock);
 	ksm_scan.mm_slot = list_entry(slot->mm_list.next,
@@ -2379,6 +2477,7 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
+	ksm_autotune_pass();
 	return NULL;
 }
 
@@ -2392,11 +2491,18 @@ static void ksm_do_scan(unsigned int scan_npages)
 	struct page *page;
 
 	while (scan_npages-- && likely(!freezing(current))) {
+		bool was_stable;
+
 		cond_resched();
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		was_stable = rmap_item->address & STABLE_FLAG;
 		cmp_and_merge_page(page, rmap_item);
+		/* the rmap_item belongs to the mm at the cursor */
+		if (!was_stable && (rmap_item->address & STABLE_FLAG))
+			ksm_scan.mm_slot->nr_merged++;
+		ksm_pass_scanned++;
 		put_page(page);
 	}
 }
@@ -2435,6 +2541,39 @@ static int ksm_scan_thread(void *nothing)
 	return 0;
 }
 
+/* Whether a mapping of @file with @vm_flags may have its pages merged */
+static bool ksm_compatible(struct file *file, unsigned long vm_flags)
+{
+	/*
+	 * Be somewhat over-protective for now!
+	 */
+	if (vm_flags & (VM_SHARED  | VM_MAYSHARE   |
+			VM_PFNMAP  | VM_IO      | VM_DONTEXPAND |
+			VM_HUGETLB | VM_MIXEDMAP))
+		return false;
+
+	if (file && IS_DAX(file->f_mapping->host))
+		return false;
+
+#ifdef VM_SAO
+	if (vm_flags & VM_SAO)
+		return false;
+#endif
+#ifdef VM_SPARC_ADI
+	if (vm_flags & VM_SPARC_ADI)
+		return false;
+#endif
+
+	return true;
+}
+
+static int ksm_enter_mm(struct mm_struct *mm)
+{
+	if (test_bit(MMF_VM_MERGEABLE, &mm->flags))
+		return 0;
+	return __ksm_enter(mm);
+}
+
 int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		unsigned long end, int advice, unsigned long *vm_flags)
 {
@@ -2443,31 +2582,13 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 
 	switch (advice) {
 	case MADV_MERGEABLE:
-		/*
-		 * Be somewhat over-protective for now!
-		 */
-		if (*vm_flags & (VM_MERGEABLE | VM_SHARED  | VM_MAYSHARE   |
-				 VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
-				 VM_HUGETLB | VM_MIXEDMAP))
+		if ((*vm_flags & VM_MERGEABLE) ||
+		    !ksm_compatible(vma->vm_file, *vm_flags))
 			return 0;		/* just ignore the advice */
 
-		if (vma_is_dax(vma))
-			return 0;
-
-#ifdef VM_SAO
-		if (*vm_flags & VM_SAO)
-			return 0;
-#endif
-#ifdef VM_SPARC_ADI
-		if (*vm_flags & VM_SPARC_ADI)
-			return 0;
-#endif
-
-		if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
-			err = __ksm_enter(mm);
-			if (err)
-				return err;
-		}
+		err = ksm_enter_mm(mm);
+		if (err)
+			return err;
 
 		*vm_flags |= VM_MERGEABLE;
 		break;
@@ -2490,6 +2611,86 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 }
 EXPORT_SYMBOL_GPL(ksm_madvise);
 
+/*
+ * Anonymous vmas of a PR_SET_MEMORY_MERGE process are created mergeable.
+ * File vmas are left to __ksm_add_vma(), as ->mmap() may still add VM_IO
+ * and friends to their flags.
+ */
+unsigned long __ksm_vma_flags(struct mm_struct *mm, struct file *file,
+			      unsigned long vm_flags)
+{
+	if (file || !ksm_compatible(NULL, vm_flags) || ksm_enter_mm(mm))
+		return vm_flags;
+	return vm_flags | VM_MERGEABLE;
+}
+
+void __ksm_add_vma(struct vm_area_struct *vma)
+{
+	if ((vma->vm_flags & VM_MERGEABLE) ||
+	    !ksm_compatible(vma->vm_file, vma->vm_flags) ||
+	    ksm_enter_mm(vma->vm_mm))
+		return;
+
+	vma->vm_flags |= VM_MERGEABLE;
+}
+
+/**
+ * ksm_enable_merge_any - let KSM merge the whole address space of @mm
+ * @mm: the mm, with mmap_lock held for write
+ *
+ * Marks every compatible vma of @mm mergeable, as MADV_MERGEABLE would,
+ * and makes the vmas created later mergeable too. The setting is inherited
+ * over fork() and exec(), so a zygote only has to set it once.
+ */
+int ksm_enable_merge_any(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+	if (test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	err = ksm_enter_mm(mm);
+	if (err)
+		return err;
+
+	set_bit(MMF_VM_MERGE_ANY, &mm->flags);
+	for (vma = mm->mmap; vma; vma = vma->vm_next)
+		__ksm_add_vma(vma);
+
+	return 0;
+}
+
+/**
+ * ksm_disable_merge_any - undo ksm_enable_merge_any()
+ * @mm: the mm, with mmap_lock held for write
+ *
+ * Unmerges all the vmas of @mm, including the ones that were marked with
+ * MADV_MERGEABLE on their own.
+ */
+int ksm_disable_merge_any(struct mm_struct *mm)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+	if (!test_bit(MMF_VM_MERGE_ANY, &mm->flags))
+		return 0;
+
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (!(vma->vm_flags & VM_MERGEABLE))
+			continue;
+		if (vma->anon_vma) {
+			err = unmerge_ksm_pages(vma, vma->vm_start, vma->vm_end);
+			if (err)
+				return err;
+		}
+		vma->vm_flags &= ~VM_MERGEABLE;
+	}
+
+	clear_bit(MMF_VM_MERGE_ANY, &mm->flags);
+	return 0;
+}
+
 int __ksm_enter(struct mm_struct *mm)
 {
 	struct mm_slot *mm_slot;
@@ -2878,6 +3079,78 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t autotune_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_autotune);
+}
+
+static ssize_t autotune_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	bool value;
+	int err;
+
+	err = kstrtobool(buf, &value);
+	if (err)
+		return -EINVAL;
+
+	WRITE_ONCE(ksm_autotune, value);
+
+	return count;
+}
+KSM_ATTR(autotune);
+
+static ssize_t autotune_min_pages_to_scan_show(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_autotune_min_pages);
+}
+
+static ssize_t autotune_min_pages_to_scan_store(struct kobject *kobj,
+						struct kobj_attribute *attr,
+						const char *buf, size_t count)
+{
+	unsigned int nr_pages;
+	int err;
+
+	err = kstrtouint(buf, 10, &nr_pages);
+	if (err || !nr_pages || nr_pages > ksm_autotune_max_pages)
+		return -EINVAL;
+
+	ksm_autotune_min_pages = nr_pages;
+
+	return count;
+}
+KSM_ATTR(autotune_min_pages_to_scan);
+
+static ssize_t autotune_max_pages_to_scan_show(struct kobject *kobj,
+					       struct kobj_attribute *attr,
+					       char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_autotune_max_pages);
+}
+
+static ssize_t autotune_max_pages_to_scan_store(struct kobject *kobj,
+						struct kobj_attribute *attr,
+						const char *buf, size_t count)
+{
+	unsigned int nr_pages;
+	int err;
+
+	err = kstrtouint(buf, 10, &nr_pages);
+	if (err || nr_pages < ksm_autotune_min_pages ||
+	    nr_pages > UINT_MAX / 2)
+		return -EINVAL;
+
+	ksm_autotune_max_pages = nr_pages;
+
+	return count;
+}
+KSM_ATTR(autotune_max_pages_to_scan);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -3135,6 +3408,9 @@ KSM_ATTR_RO(full_scans);
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
+	&autotune_attr.attr,
+	&autotune_min_pages_to_scan_attr.attr,
+	&autotune_max_pages_to_scan_attr.attr,
 	&run_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
@@ -18,6 +18,7 @@
 #include <linux/fadvise.h>
 #include <linux/sched.h>
 #include <linux/sched/mm.h>
+#include <linux/cred.h>
 #include <linux/uio.h>
 #include <linux/ksm.h>
 #include <linux/fs.h>
@@ -28,6 +29,7 @@
 #include <linux/swap.h>
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
+#include <linux/khugepaged.h>
 #include <linux/mmu_notifier.h>
 
 #include <asm/tlb.h>
@@ -37,8 +39,89 @@
 struct madvise_walk_private {
 	struct mmu_gather *tlb;
 	bool pageout;
+	/* hand isolated pages to the per-node workers, see below */
+	bool async;
 };
 
+/*
+ * process_madvise(PMADV_ASYNC) queues MADV_COLD and MADV_PAGEOUT requests
+ * instead of walking the target in the caller's context. A single worker
+ * walks the queued requests one after the other and, for MADV_PAGEOUT,
+ * gathers the pages it isolates on per-node lists. Those are reclaimed by
+ * a per-node worker, in batches that mix the pages of several processes,
+ * once MADVISE_ASYNC_NODE_BATCH accumulated or the walker ran out of
+ * requests. Each request is then reported done through the pidfd of its
+ * target, which polls EPOLLPRI when nothing is left pending.
+ */
+#define MADVISE_ASYNC_NODE_BATCH	(SWAP_CLUSTER_MAX * 16)
+
+struct madvise_async_req {
+	struct list_head list;
+	struct mm_struct *mm;
+	struct pid *pid;
+	const struct cred *cred;
+	int behavior;
+	unsigned int nr_ranges;
+	struct {
+		unsigned long start;
+		unsigned long end;
+	} ranges[];
+};
+
+struct madvise_async_node {
+	spinlock_t lock;
+	struct list_head pages;
+	unsigned long nr_pages;
+	struct work_struct work;
+};
+
+static struct madvise_async_node madvise_async_nodes[MAX_NUMNODES];
+static LIST_HEAD(madvise_async_list);
+static DEFINE_SPINLOCK(madvise_async_lock);
+
+static void madvise_async_add_pages(struct list_head *page_list)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, page_list, lru) {
+		int nid = page_to_nid(page);
+		struct madvise_async_node *node = &madvise_async_nodes[nid];
+		bool kick;
+
+		spin_lock(&node->lock);
+		list_move_tail(&page->lru, &node->pages);
+		kick = ++node->nr_pages >= MADVISE_ASYNC_NODE_BATCH;
+		spin_unlock(&node->lock);
+
+		if (kick)
+			queue_work_node(nid, system_unbound_wq, &node->work);
+	}
+}
+
+static void madvise_async_node_fn(struct work_struct *work)
+{
+	struct madvise_async_node *node = container_of(work,
+					struct madvise_async_node, work);
+	LIST_HEAD(page_list);
+
+	spin_lock(&node->lock);
+	list_splice_init(&node->pages, &page_list);
+	node->nr_pages = 0;
+	spin_unlock(&node->lock);
+
+	if (!list_empty(&page_list))
+		reclaim_pages(&page_list);
+}
+
+static void madvise_pageout_isolated(struct madvise_walk_private *private,
+				     struct list_head *page_list)
+{
+	if (private->async)
+		madvise_async_add_pages(page_list);
+	else
+		reclaim_pages(page_list);
+}
+
 /*
  * Any behaviour which results in changes to the vma->vm_flags needs to
  * take mmap_lock for writing. Others, which simply traverse vmas, need
@@ -53,6 +136,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_COLD:
 	case MADV_PAGEOUT:
 	case MADV_FREE:
+	case MADV_COLLAPSE:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -384,7 +468,7 @@ static int madvise_cold_or_pageout_pte_range(pmd_t *pmd,
 huge_unlock:
 		spin_unlock(ptl);
 		if (pageout)
-			reclaim_pages(&page_list);
+			madvise_pageout_isolated(private, &page_list);
 		return 0;
 	}
 
@@ -472,7 +556,7 @@ regular_page:
 	arch_leave_lazy_mmu_mode();
 	pte_unmap_unlock(orig_pte, ptl);
 	if (pageout)
-		reclaim_pages(&page_list);
+		madvise_pageout_isolated(private, &page_list);
 	cond_resched();
 
 	return 0;
@@ -947,6 +1031,8 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	case MADV_FREE:
 	case MADV_DONTNEED:
 		return madvise_dontneed_free(vma, prev, start, end, behavior);
+	case MADV_COLLAPSE:
+		return madvise_collapse(vma, prev, start, end);
 	default:
 		return madvise_behavior(vma, prev, start, end, behavior);
 	}
@@ -974,6 +1060,7 @@ madvise_behavior_valid(int behavior)
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	case MADV_HUGEPAGE:
 	case MADV_NOHUGEPAGE:
+	case MADV_COLLAPSE:
 #endif
 	case MADV_DONTDUMP:
 	case MADV_DODUMP:
@@ -1055,6 +1142,8 @@ process_madvise_behavior_valid(int behavior)
  *		easily if memory pressure hanppens.
  *  MADV_PAGEOUT - the application is not expected to use this memory soon,
  *		page out the pages in this range immediately.
+ *  MADV_COLLAPSE - collapse the read-only file or shmem pages in this range
+ *		into transparent huge pages now, in the caller's context.
  *
  * return values:
  *  zero    - success
@@ -1172,6 +1261,153 @@ SYSCALL_DEFINE3(madvise, unsigned long, start, size_t, len_in, int, behavior)
 	return do_madvise(current->mm, start, len_in, behavior);
 }
 
+static void madvise_async_range(struct mm_struct *mm, unsigned long start,
+				unsigned long end, bool pageout)
+{
+	struct madvise_walk_private walk_private = {
+		.pageout = pageout,
+		.async = true,
+	};
+	struct vm_area_struct *vma;
+	struct mmu_gather tlb;
+
+	lru_add_drain();
+	mmap_read_lock(mm);
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		unsigned long vstart = max(start, vma->vm_start);
+		unsigned long vend = min(end, vma->vm_end);
+
+		if (!can_madv_lru_vma(vma) ||
+		    (pageout && !can_do_pageout(vma)))
+			continue;
+
+		tlb_gather_mmu(&tlb, mm, vstart, vend);
+		walk_private.tlb = &tlb;
+		vm_write_begin(vma);
+		tlb_start_vma(&tlb, vma);
+		walk_page_range(mm, vstart, vend, &cold_walk_ops,
+				&walk_private);
+		tlb_end_vma(&tlb, vma);
+		vm_write_end(vma);
+		tlb_finish_mmu(&tlb, vstart, vend);
+	}
+	mmap_read_unlock(mm);
+}
+
+static void madvise_async_run(struct madvise_async_req *req)
+{
+	const struct cred *old_cred;
+	unsigned int i;
+
+	/* the target exited meanwhile, its memory is going away anyway */
+	if (!mmget_not_zero(req->mm))
+		return;
+
+	/* can_do_pageout() checks file permissions against the requester */
+	old_cred = override_creds(req->cred);
+	for (i = 0; i < req->nr_ranges; i++) {
+		madvise_async_range(req->mm, req->ranges[i].start,
+				    req->ranges[i].end,
+				    req->behavior == MADV_PAGEOUT);
+		cond_resched();
+	}
+	revert_creds(old_cred);
+	mmput(req->mm);
+}
+
+static void madvise_async_fn(struct work_struct *work)
+{
+	struct madvise_async_req *req, *next;
+	LIST_HEAD(batch);
+	int nid;
+
+	spin_lock(&madvise_async_lock);
+	list_splice_init(&madvise_async_list, &batch);
+	spin_unlock(&madvise_async_lock);
+
+	list_for_each_entry(req, &batch, list)
+		madvise_async_run(req);
+
+	/* reclaim what the batch isolated before reporting it done */
+	for_each_node(nid)
+		queue_work_node(nid, system_unbound_wq,
+				&madvise_async_nodes[nid].work);
+	for_each_node(nid)
+		flush_work(&madvise_async_nodes[nid].work);
+
+	list_for_each_entry_safe(req, next, &batch, list) {
+		if (atomic_dec_and_test(&req->pid->async_madvise_pending))
+			wake_up_all(&req->pid->wait_pidfd);
+		put_pid(req->pid);
+		mmdrop(req->mm);
+		put_cred(req->cred);
+		kvfree(req);
+	}
+}
+static DECLARE_WORK(madvise_async_work, madvise_async_fn);
+
+static int madvise_queue_async(struct mm_struct *mm, struct pid *pid,
+			       int behavior, struct iov_iter *iter)
+{
+	struct madvise_async_req *req;
+	unsigned int nr = 0;
+
+	req = kvzalloc(struct_size(req, ranges, iter->nr_segs), GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	/* the same checks as do_madvise(), so that errors are synchronous */
+	while (iov_iter_count(iter)) {
+		struct iovec iovec = iov_iter_iovec(iter);
+		unsigned long start = untagged_addr((unsigned long)iovec.iov_base);
+		size_t len = PAGE_ALIGN(iovec.iov_len);
+
+		if (!PAGE_ALIGNED(start) || (iovec.iov_len && !len) ||
+		    start + len < start) {
+			kvfree(req);
+			return -EINVAL;
+		}
+		if (len) {
+			req->ranges[nr].start = start;
+			req->ranges[nr].end = start + len;
+			nr++;
+		}
+		iov_iter_advance(iter, iovec.iov_len);
+	}
+
+	req->nr_ranges = nr;
+	req->behavior = behavior;
+	mmgrab(mm);
+	req->mm = mm;
+	req->pid = get_pid(pid);
+	req->cred = get_current_cred();
+
+	atomic_inc(&pid->async_madvise_pending);
+	WRITE_ONCE(pid->async_madvise_issued, true);
+
+	spin_lock(&madvise_async_lock);
+	list_add_tail(&req->list, &madvise_async_list);
+	spin_unlock(&madvise_async_lock);
+	queue_work(system_unbound_wq, &madvise_async_work);
+	return 0;
+}
+
+static int __init madvise_async_init(void)
+{
+	int nid;
+
+	for (nid = 0; nid < MAX_NUMNODES; nid++) {
+		struct madvise_async_node *node = &madvise_async_nodes[nid];
+
+		spin_lock_init(&node->lock);
+		INIT_LIST_HEAD(&node->pages);
+		INIT_WORK(&node->work, madvise_async_node_fn);
+	}
+	return 0;
+}
+early_initcall(madvise_async_init);
+
 SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 		size_t, vlen, int, behavior, unsigned int, flags)
 {
@@ -1185,7 +1421,7 @@ SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 	size_t total_len;
 	unsigned int f_flags;
 
-	if (flags != 0) {
+	if (flags & ~PMADV_ASYNC) {
 		ret = -EINVAL;
 		goto out;
 	}
@@ -1206,7 +1442,9 @@ SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 		goto put_pid;
 	}
 
-	if (!process_madvise_behavior_valid(behavior)) {
+	if (!process_madvise_behavior_valid(behavior) ||
+	    ((flags & PMADV_ASYNC) && behavior != MADV_COLD &&
+	     behavior != MADV_PAGEOUT)) {
 		ret = -EINVAL;
 		goto release_task;
 	}
@@ -1229,6 +1467,13 @@ SYSCALL_DEFINE5(process_madvise, int, pidfd, const struct iovec __user *, vec,
 
 	total_len = iov_iter_count(&iter);
 
+	if (flags & PMADV_ASYNC) {
+		ret = madvise_queue_async(mm, pid, behavior, &iter);
+		if (ret == 0)
+			ret = total_len;
+		goto release_mm;
+	}
+
 	while (iov_iter_count(&iter)) {
 		iovec = iov_iter_iovec(&iter);
 		ret = do_madvise(mm, (unsigned long)iovec.iov_base,
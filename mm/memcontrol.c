@@ -1498,6 +1498,7 @@ static struct memory_stat memory_stats[] = {
 	{ "kernel_stack", 1024, NR_KERNEL_STACK_KB },
 	{ "percpu", 1, MEMCG_PERCPU_B },
 	{ "sock", PAGE_SIZE, MEMCG_SOCK },
+	{ "dmabuf", PAGE_SIZE, MEMCG_DMABUF },
 	{ "shmem", PAGE_SIZE, NR_SHMEM },
 	{ "file_mapped", PAGE_SIZE, NR_FILE_MAPPED },
 	{ "file_dirty", PAGE_SIZE, NR_FILE_DIRTY },
@@ -2200,13 +2201,24 @@ void unlock_page_memcg(struct page *page)
 }
 EXPORT_SYMBOL(unlock_page_memcg);
 
+/*
+ * Number of memcgs a cpu stocks charges for at once. With every app in its
+ * own cgroup, a single entry gets drained on nearly every context switch.
+ */
+#define NR_MEMCG_STOCK 4
+
 struct memcg_stock_pcp {
-	struct mem_cgroup *cached; /* this never be root cgroup */
-	unsigned int nr_pages;
+	struct mem_cgroup *cached[NR_MEMCG_STOCK]; /* never the root cgroup */
+	unsigned int nr_pages[NR_MEMCG_STOCK];
+	unsigned int evict; /* entry refill_stock() reuses when all are taken */
 
 #ifdef CONFIG_MEMCG_KMEM
 	struct obj_cgroup *cached_objcg;
 	unsigned int nr_bytes;
+	/* slab stats of cached_objcg on cached_pgdat, not yet flushed */
+	struct pglist_data *cached_pgdat;
+	int nr_slab_reclaimable_b;
+	int nr_slab_unreclaimable_b;
 #endif
 
 	struct work_struct work;
@@ -2237,9 +2249,9 @@ static bool obj_stock_flush_required(struct memcg_stock_pcp *stock,
  * @memcg: memcg to consume from.
  * @nr_pages: how many pages to charge.
  *
- * The charges will only happen if @memcg matches the current cpu's memcg
- * stock, and at least @nr_pages are available in that stock.  Failure to
- * service an allocation will refill the stock.
+ * The charges will only happen if @memcg is one of the current cpu's
+ * stocked memcgs, and at least @nr_pages are available in its stock.
+ * Failure to service an allocation will refill the stock.
  *
  * returns true if successful, false otherwise.
  */
@@ -2248,6 +2260,7 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	struct memcg_stock_pcp *stock;
 	unsigned long flags;
 	bool ret = false;
+	int i;
 
 	if (nr_pages > MEMCG_CHARGE_BATCH)
 		return ret;
@@ -2255,9 +2268,14 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (memcg == stock->cached && stock->nr_pages >= nr_pages) {
-		stock->nr_pages -= nr_pages;
-		ret = true;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (memcg != stock->cached[i])
+			continue;
+		if (stock->nr_pages[i] >= nr_pages) {
+			stock->nr_pages[i] -= nr_pages;
+			ret = true;
+		}
+		break;
 	}
 
 	local_irq_restore(flags);
@@ -2266,24 +2284,35 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 }
 
 /*
- * Returns stocks cached in percpu and reset cached information.
+ * Returns the charges stocked in entry @i and resets it.
  */
-static void drain_stock(struct memcg_stock_pcp *stock)
+static void drain_stock_entry(struct memcg_stock_pcp *stock, int i)
 {
-	struct mem_cgroup *old = stock->cached;
+	struct mem_cgroup *old = stock->cached[i];
 
 	if (!old)
 		return;
 
-	if (stock->nr_pages) {
-		page_counter_uncharge(&old->memory, stock->nr_pages);
+	if (stock->nr_pages[i]) {
+		page_counter_uncharge(&old->memory, stock->nr_pages[i]);
 		if (do_memsw_account())
-			page_counter_uncharge(&old->memsw, stock->nr_pages);
-		stock->nr_pages = 0;
+			page_counter_uncharge(&old->memsw, stock->nr_pages[i]);
+		stock->nr_pages[i] = 0;
 	}
 
 	css_put(&old->css);
-	stock->cached = NULL;
+	stock->cached[i] = NULL;
+}
+
+/*
+ * Returns stocks cached in percpu and reset cached information.
+ */
+static void drain_stock(struct memcg_stock_pcp *stock)
+{
+	int i;
+
+	for (i = 0; i < NR_MEMCG_STOCK; i++)
+		drain_stock_entry(stock, i);
 }
 
 static void drain_local_stock(struct work_struct *dummy)
@@ -2313,19 +2342,32 @@ static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 {
 	struct memcg_stock_pcp *stock;
 	unsigned long flags;
+	int i, empty = -1;
 
 	local_irq_save(flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	if (stock->cached != memcg) { /* reset if necessary */
-		drain_stock(stock);
-		css_get(&memcg->css);
-		stock->cached = memcg;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (stock->cached[i] == memcg)
+			goto found;
+		if (!stock->cached[i] && empty < 0)
+			empty = i;
+	}
+
+	/* all entries are taken, evict them in turn */
+	if (empty < 0) {
+		empty = stock->evict;
+		stock->evict = (stock->evict + 1) % NR_MEMCG_STOCK;
+		drain_stock_entry(stock, empty);
 	}
-	stock->nr_pages += nr_pages;
+	i = empty;
+	css_get(&memcg->css);
+	stock->cached[i] = memcg;
+found:
+	stock->nr_pages[i] += nr_pages;
 
-	if (stock->nr_pages > MEMCG_CHARGE_BATCH)
-		drain_stock(stock);
+	if (stock->nr_pages[i] > MEMCG_CHARGE_BATCH)
+		drain_stock_entry(stock, i);
 
 	local_irq_restore(flags);
 }
@@ -2352,12 +2394,15 @@ static void drain_all_stock(struct mem_cgroup *root_memcg)
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
 		struct mem_cgroup *memcg;
 		bool flush = false;
+		int i;
 
 		rcu_read_lock();
-		memcg = stock->cached;
-		if (memcg && stock->nr_pages &&
-		    mem_cgroup_is_descendant(memcg, root_memcg))
-			flush = true;
+		for (i = 0; i < NR_MEMCG_STOCK && !flush; i++) {
+			memcg = stock->cached[i];
+			if (memcg && stock->nr_pages[i] &&
+			    mem_cgroup_is_descendant(memcg, root_memcg))
+				flush = true;
+		}
 		if (obj_stock_flush_required(stock, root_memcg))
 			flush = true;
 		rcu_read_unlock();
@@ -2380,6 +2425,7 @@ static int memcg_hotplug_cpu_dead(unsigned int cpu)
 	struct mem_cgroup *memcg, *mi;
 
 	stock = &per_cpu(memcg_stock, cpu);
+	drain_obj_stock(stock);
 	drain_stock(stock);
 
 	for_each_mem_cgroup(memcg) {
@@ -3151,6 +3197,79 @@ static bool consume_obj_stock(struct obj_cgroup *objcg, unsigned int nr_bytes)
 	return ret;
 }
 
+static void flush_obj_stock_stats(struct memcg_stock_pcp *stock)
+{
+	struct pglist_data *pgdat = stock->cached_pgdat;
+	struct mem_cgroup *memcg;
+	struct lruvec *lruvec;
+
+	if (!pgdat)
+		return;
+
+	rcu_read_lock();
+	memcg = obj_cgroup_memcg(stock->cached_objcg);
+	lruvec = mem_cgroup_lruvec(memcg, pgdat);
+	if (stock->nr_slab_reclaimable_b) {
+		mod_memcg_lruvec_state(lruvec, NR_SLAB_RECLAIMABLE_B,
+				       stock->nr_slab_reclaimable_b);
+		stock->nr_slab_reclaimable_b = 0;
+	}
+	if (stock->nr_slab_unreclaimable_b) {
+		mod_memcg_lruvec_state(lruvec, NR_SLAB_UNRECLAIMABLE_B,
+				       stock->nr_slab_unreclaimable_b);
+		stock->nr_slab_unreclaimable_b = 0;
+	}
+	rcu_read_unlock();
+
+	stock->cached_pgdat = NULL;
+}
+
+/**
+ * mod_objcg_state - update the slab stats of an object cgroup
+ * @objcg: the object cgroup the slab objects are charged to
+ * @pgdat: the node the objects live on
+ * @idx: NR_SLAB_RECLAIMABLE_B or NR_SLAB_UNRECLAIMABLE_B
+ * @nr: bytes to add, can be negative
+ *
+ * Updates for the objcg of the local obj stock are summed up in the stock
+ * and only flushed to the memcg per page worth of bytes, or when the stock
+ * moves on to another objcg or node.
+ */
+void mod_objcg_state(struct obj_cgroup *objcg, struct pglist_data *pgdat,
+		     enum node_stat_item idx, int nr)
+{
+	struct memcg_stock_pcp *stock;
+	struct mem_cgroup *memcg;
+	struct lruvec *lruvec;
+	unsigned long flags;
+	int *bytes;
+
+	local_irq_save(flags);
+
+	stock = this_cpu_ptr(&memcg_stock);
+	if (stock->cached_objcg != objcg) {
+		rcu_read_lock();
+		memcg = obj_cgroup_memcg(objcg);
+		lruvec = mem_cgroup_lruvec(memcg, pgdat);
+		__mod_memcg_lruvec_state(lruvec, idx, nr);
+		rcu_read_unlock();
+		goto out;
+	}
+
+	if (stock->cached_pgdat != pgdat) {
+		flush_obj_stock_stats(stock);
+		stock->cached_pgdat = pgdat;
+	}
+
+	bytes = idx == NR_SLAB_RECLAIMABLE_B ? &stock->nr_slab_reclaimable_b :
+					       &stock->nr_slab_unreclaimable_b;
+	*bytes += nr;
+	if (abs(*bytes) > PAGE_SIZE)
+		flush_obj_stock_stats(stock);
+out:
+	local_irq_restore(flags);
+}
+
 static void drain_obj_stock(struct memcg_stock_pcp *stock)
 {
 	struct obj_cgroup *old = stock->cached_objcg;
@@ -3158,6 +3277,8 @@ static void drain_obj_stock(struct memcg_stock_pcp *stock)
 	if (!old)
 		return;
 
+	flush_obj_stock_stats(stock);
+
 	if (stock->nr_bytes) {
 		unsigned int nr_pages = stock->nr_bytes >> PAGE_SHIFT;
 		unsigned int nr_bytes = stock->nr_bytes & (PAGE_SIZE - 1);
@@ -3954,6 +4075,68 @@ static int mem_cgroup_move_charge_write(struct cgroup_subsys_state *css,
 }
 #endif
 
+/**
+ * mem_cgroup_note_refault - account a workingset refault distance
+ * @memcg: memcg the refaulting page is charged to
+ * @file: whether the page is on the file LRU
+ * @distance: refault distance in pages
+ *
+ * The distance is accounted to @memcg and all of its ancestors, so that the
+ * histogram of a cgroup covers its whole subtree and survives the removal of
+ * its children.
+ */
+void mem_cgroup_note_refault(struct mem_cgroup *memcg, bool file,
+			     unsigned long distance)
+{
+	unsigned int bucket = 0;
+
+	if (mem_cgroup_disabled() || !memcg)
+		return;
+
+	if (distance >> MEMCG_REFAULT_HIST_SHIFT)
+		bucket = min_t(unsigned int,
+			       ilog2(distance) - MEMCG_REFAULT_HIST_SHIFT + 1,
+			       MEMCG_REFAULT_HIST_BUCKETS - 1);
+
+	for (; memcg; memcg = parent_mem_cgroup(memcg))
+		this_cpu_inc(memcg->refault_hist->count[file][bucket]);
+}
+
+/*
+ * One line per LRU type, one "<upper bound in bytes>=<refaults>" field per
+ * bucket, e.g. "file 1048576=12 2097152=3 ... max=0".
+ */
+static int memcg_refault_distance_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_seq(m);
+	int file;
+
+	for (file = 0; file < 2; file++) {
+		int i;
+
+		seq_puts(m, file ? "file" : "anon");
+		for (i = 0; i < MEMCG_REFAULT_HIST_BUCKETS; i++) {
+			unsigned long count = 0;
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				count += per_cpu_ptr(memcg->refault_hist,
+						     cpu)->count[file][i];
+
+			if (i == MEMCG_REFAULT_HIST_BUCKETS - 1)
+				seq_printf(m, " max=%lu", count);
+			else
+				seq_printf(m, " %llu=%lu",
+					   (u64)PAGE_SIZE <<
+					   (MEMCG_REFAULT_HIST_SHIFT + i),
+					   count);
+		}
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_NUMA
 
 #define LRU_ALL_FILE (BIT(LRU_INACTIVE_FILE) | BIT(LRU_ACTIVE_FILE))
@@ -4053,6 +4236,7 @@ static const unsigned int memcg1_stats[] = {
 	NR_FILE_DIRTY,
 	NR_WRITEBACK,
 	MEMCG_SWAP,
+	MEMCG_DMABUF,
 };
 
 static const char *const memcg1_stat_names[] = {
@@ -4066,6 +4250,7 @@ static const char *const memcg1_stat_names[] = {
 	"dirty",
 	"writeback",
 	"swap",
+	"dmabuf",
 };
 
 /* Universal VM events cgroup1 shows, original sort order */
@@ -5064,6 +5249,10 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.seq_show = memcg_numa_stat_show,
 	},
 #endif
+	{
+		.name = "refault_distance",
+		.seq_show = memcg_refault_distance_show,
+	},
 	{
 		.name = "kmem.limit_in_bytes",
 		.private = MEMFILE_PRIVATE(_KMEM, RES_LIMIT),
@@ -5250,6 +5439,7 @@ static void __mem_cgroup_free(struct mem_cgroup *memcg)
 	trace_android_vh_mem_cgroup_free(memcg);
 	for_each_node(node)
 		free_mem_cgroup_per_node_info(memcg, node);
+	free_percpu(memcg->refault_hist);
 	free_percpu(memcg->vmstats_percpu);
 	free_percpu(memcg->vmstats_local);
 	kfree(memcg);
@@ -5300,6 +5490,11 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 	if (!memcg->vmstats_percpu)
 		goto fail;
 
+	memcg->refault_hist = alloc_percpu_gfp(struct memcg_refault_hist,
+					       GFP_KERNEL_ACCOUNT);
+	if (!memcg->refault_hist)
+		goto fail;
+
 	for_each_node(node)
 		if (alloc_mem_cgroup_per_node_info(memcg, node))
 			goto fail;
@@ -6561,6 +6756,10 @@ static struct cftype memory_files[] = {
 		.seq_show = memory_numa_stat_show,
 	},
 #endif
+	{
+		.name = "refault_distance",
+		.seq_show = memcg_refault_distance_show,
+	},
 	{
 		.name = "oom.group",
 		.flags = CFTYPE_NOT_ON_ROOT | CFTYPE_NS_DELEGATABLE,
@@ -7060,6 +7259,45 @@ void mem_cgroup_sk_free(struct sock *sk)
 		css_put(&sk->sk_memcg->css);
 }
 
+/**
+ * mem_cgroup_charge_dmabuf - charge dma-buf memory
+ * @memcg: memcg to charge
+ * @nr_pages: number of pages to charge
+ * @gfp_mask: reclaim mode
+ *
+ * Charges @nr_pages of a dma-buf to @memcg, reclaiming from it as needed.
+ * Returns 0 on success, -ENOMEM if the charge doesn't fit the limit.
+ */
+int mem_cgroup_charge_dmabuf(struct mem_cgroup *memcg, unsigned int nr_pages,
+			     gfp_t gfp_mask)
+{
+	int ret;
+
+	ret = try_charge(memcg, gfp_mask, nr_pages);
+	if (ret)
+		return ret;
+
+	mod_memcg_state(memcg, MEMCG_DMABUF, nr_pages);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_charge_dmabuf);
+
+/**
+ * mem_cgroup_uncharge_dmabuf - uncharge dma-buf memory
+ * @memcg: memcg to uncharge
+ * @nr_pages: number of pages to uncharge
+ */
+void mem_cgroup_uncharge_dmabuf(struct mem_cgroup *memcg,
+				unsigned int nr_pages)
+{
+	mod_memcg_state(memcg, MEMCG_DMABUF, -nr_pages);
+
+	/* try_charge() doesn't charge the root */
+	if (!mem_cgroup_is_root(memcg))
+		refill_stock(memcg, nr_pages);
+}
+EXPORT_SYMBOL_GPL(mem_cgroup_uncharge_dmabuf);
+
 /**
  * mem_cgroup_charge_skmem - charge socket memory
  * @memcg: memcg to charge
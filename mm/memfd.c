@@ -245,7 +245,7 @@ long memfd_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 #define MFD_NAME_PREFIX_LEN (sizeof(MFD_NAME_PREFIX) - 1)
 #define MFD_NAME_MAX_LEN (NAME_MAX - MFD_NAME_PREFIX_LEN)
 
-#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB)
+#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB | MFD_THP)
 
 SYSCALL_DEFINE2(memfd_create,
 		const char __user *, uname,
@@ -265,6 +265,9 @@ SYSCALL_DEFINE2(memfd_create,
 		if (flags & ~(unsigned int)(MFD_ALL_FLAGS |
 				(MFD_HUGE_MASK << MFD_HUGE_SHIFT)))
 			return -EINVAL;
+		/* hugetlbfs pages are huge already */
+		if (flags & MFD_THP)
+			return -EINVAL;
 	}
 
 	/* length includes terminating zero */
@@ -317,6 +320,13 @@ SYSCALL_DEFINE2(memfd_create,
 		*file_seals &= ~F_SEAL_SEAL;
 	}
 
+	/*
+	 * Huge pages for this memfd only, whatever the huge= policy of the
+	 * internal shm mount says; see shmem_inode_thp().
+	 */
+	if (flags & MFD_THP)
+		SHMEM_I(file_inode(file))->flags |= VM_HUGEPAGE;
+
 	fd_install(fd, file);
 	kfree(name);
 	return fd;
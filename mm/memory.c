@@ -1253,6 +1253,8 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	pte_t *start_pte;
 	pte_t *pte;
 	swp_entry_t entry;
+	swp_entry_t swap_batch[SWAP_FREE_BATCH];
+	int nr_swap = 0;
 
 	tlb_change_page_size(tlb, PAGE_SIZE);
 again:
@@ -1337,6 +1339,18 @@ again:
 		if (unlikely(details))
 			continue;
 
+		/* the whole mm goes away, free its swap in batches */
+		if (tlb->fullmm && !non_swap_entry(entry)) {
+			rss[MM_SWAPENTS]--;
+			swap_batch[nr_swap++] = entry;
+			if (nr_swap == SWAP_FREE_BATCH) {
+				free_swap_and_cache_nr(swap_batch, nr_swap);
+				nr_swap = 0;
+			}
+			pte_clear_not_present_full(mm, addr, pte, tlb->fullmm);
+			continue;
+		}
+
 		if (!non_swap_entry(entry))
 			rss[MM_SWAPENTS]--;
 		else if (is_migration_entry(entry)) {
@@ -1350,6 +1364,11 @@ again:
 		pte_clear_not_present_full(mm, addr, pte, tlb->fullmm);
 	} while (pte++, addr += PAGE_SIZE, addr != end);
 
+	if (nr_swap) {
+		free_swap_and_cache_nr(swap_batch, nr_swap);
+		nr_swap = 0;
+	}
+
 	add_mm_rss_vec(mm, rss);
 	arch_leave_lazy_mmu_mode();
 
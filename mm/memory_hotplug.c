@@ -1007,7 +1007,7 @@ static int check_hotplug_memory_range(u64 start, u64 size)
 
 static int online_memory_block(struct memory_block *mem, void *arg)
 {
-	mem->online_type = memhp_default_online_type;
+	mem->online_type = *(int *)arg;
 	return device_online(&mem->dev);
 }
 
@@ -1020,6 +1020,7 @@ static int online_memory_block(struct memory_block *mem, void *arg)
 int __ref add_memory_resource(int nid, struct resource *res, mhp_t mhp_flags)
 {
 	struct mhp_params params = { .pgprot = pgprot_mhp(PAGE_KERNEL) };
+	int online_type = memhp_default_online_type;
 	u64 start, size;
 	bool new_node = false;
 	int ret;
@@ -1088,8 +1089,12 @@ int __ref add_memory_resource(int nid, struct resource *res, mhp_t mhp_flags)
 		merge_system_ram_resource(res);
 
 	/* online pages if requested */
-	if (memhp_default_online_type != MMOP_OFFLINE)
-		walk_memory_blocks(start, size, NULL, online_memory_block);
+	if (online_type != MMOP_OFFLINE) {
+		if (mhp_flags & MEMHP_ONLINE_MOVABLE)
+			online_type = MMOP_ONLINE_MOVABLE;
+		walk_memory_blocks(start, size, &online_type,
+				   online_memory_block);
+	}
 
 	return ret;
 error:
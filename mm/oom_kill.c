@@ -43,6 +43,7 @@
 #include <linux/kthread.h>
 #include <linux/init.h>
 #include <linux/mmu_notifier.h>
+#include <linux/workqueue.h>
 
 #include <asm/tlb.h>
 #include "internal.h"
@@ -57,6 +58,12 @@
 int sysctl_panic_on_oom;
 int sysctl_oom_kill_allocating_task;
 int sysctl_oom_dump_tasks = 1;
+int sysctl_oom_fast_select;
+
+/*
+ * Number of OOM victims in flight
+ */
+static atomic_t oom_victims = ATOMIC_INIT(0);
 
 /*
  * Serializes oom killer invocations (out_of_memory()) from all contexts to
@@ -308,6 +315,157 @@ static enum oom_constraint constrained_alloc(struct oom_control *oc)
 	return CONSTRAINT_NONE;
 }
 
+/*
+ * Thread group leaders are kept in buckets of OOM_BUCKET_ADJ oom_score_adj
+ * points each, together with an estimate of their footprint that kswapd
+ * refreshes while memory is short. With vm.oom_fast_select set, a global
+ * OOM only evaluates the OOM_FAST_CANDIDATES tasks with the highest
+ * estimated badness instead of every task in the system, and can stop at
+ * the first bucket that cannot beat them.
+ */
+#define OOM_BUCKET_ADJ		100
+#define NR_OOM_BUCKETS \
+	((OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN) / OOM_BUCKET_ADJ + 1)
+#define OOM_FAST_CANDIDATES	8
+#define OOM_REFRESH_INTERVAL	(HZ / 2)
+/* Estimates older than this are not trusted to pick a victim */
+#define OOM_REFRESH_EXPIRE	(10 * HZ)
+
+struct oom_bucket {
+	struct hlist_head tasks;
+	/* largest oom_rss_cache in the bucket since the last refresh */
+	unsigned long max_rss;
+	/* largest oom_rss_cache inserted since the current refresh began */
+	unsigned long new_rss;
+};
+
+/* Also used for the first forks, long before any initcall */
+static struct oom_bucket oom_buckets[NR_OOM_BUCKETS];
+static DEFINE_SPINLOCK(oom_bucket_lock);
+static unsigned long oom_refresh_stamp;
+
+static inline struct oom_bucket *oom_bucket_of(struct task_struct *p)
+{
+	return &oom_buckets[(p->signal->oom_score_adj - OOM_SCORE_ADJ_MIN) /
+			    OOM_BUCKET_ADJ];
+}
+
+static void __oom_bucket_insert(struct task_struct *p)
+{
+	struct oom_bucket *b = oom_bucket_of(p);
+
+	hlist_del_init(&p->oom_bucket_node);
+	hlist_add_head(&p->oom_bucket_node, &b->tasks);
+	b->max_rss = max(b->max_rss, p->oom_rss_cache);
+	b->new_rss = max(b->new_rss, p->oom_rss_cache);
+}
+
+/*
+ * Called for a new thread group leader under tasklist_lock. Until the next
+ * refresh it is assumed to be as big as its parent, which it shares all
+ * its memory with right after fork.
+ */
+void oom_bucket_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	p->oom_rss_cache = READ_ONCE(current->group_leader->oom_rss_cache);
+	spin_lock_irqsave(&oom_bucket_lock, flags);
+	__oom_bucket_insert(p);
+	spin_unlock_irqrestore(&oom_bucket_lock, flags);
+}
+
+void oom_bucket_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_bucket_lock, flags);
+	hlist_del_init(&p->oom_bucket_node);
+	spin_unlock_irqrestore(&oom_bucket_lock, flags);
+}
+
+/* Move the thread group of @p after its oom_score_adj changed */
+void oom_bucket_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_bucket_lock, flags);
+	/* de_thread() switches the leader before oom_bucket_replace() */
+	leader = READ_ONCE(p->group_leader);
+	if (!hlist_unhashed(&leader->oom_bucket_node))
+		__oom_bucket_insert(leader);
+	spin_unlock_irqrestore(&oom_bucket_lock, flags);
+}
+
+/* A non-leader thread took over the thread group in de_thread() */
+void oom_bucket_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&oom_bucket_lock, flags);
+	new->oom_rss_cache = old->oom_rss_cache;
+	if (!hlist_unhashed(&old->oom_bucket_node)) {
+		hlist_del_init(&old->oom_bucket_node);
+		__oom_bucket_insert(new);
+	}
+	spin_unlock_irqrestore(&oom_bucket_lock, flags);
+}
+
+/**
+ * oom_refresh_candidates - refresh the footprint estimates of all processes
+ *
+ * Called by kswapd whenever it starts reclaiming, so that the estimates are
+ * fresh by the time reclaim fails. Does nothing unless vm.oom_fast_select is
+ * set, or if another refresh ran less than OOM_REFRESH_INTERVAL ago.
+ */
+void oom_refresh_candidates(void)
+{
+	unsigned long max_rss[NR_OOM_BUCKETS] = { 0 };
+	unsigned long stamp = READ_ONCE(oom_refresh_stamp);
+	struct task_struct *p;
+	int i;
+
+	if (!READ_ONCE(sysctl_oom_fast_select))
+		return;
+	if (stamp && time_before(jiffies, stamp + OOM_REFRESH_INTERVAL))
+		return;
+	/* kswapd runs per node, one refresh is enough */
+	if (cmpxchg(&oom_refresh_stamp, stamp, jiffies ?: 1) != stamp)
+		return;
+
+	spin_lock_irq(&oom_bucket_lock);
+	for (i = 0; i < NR_OOM_BUCKETS; i++)
+		oom_buckets[i].new_rss = 0;
+	spin_unlock_irq(&oom_bucket_lock);
+
+	/* Only the task lock of each process is taken during the walk */
+	rcu_read_lock();
+	for_each_process(p) {
+		struct task_struct *t = find_lock_task_mm(p);
+		unsigned long rss = 0;
+
+		if (t) {
+			rss = get_mm_rss(t->mm) +
+			      get_mm_counter(t->mm, MM_SWAPENTS) +
+			      mm_pgtables_bytes(t->mm) / PAGE_SIZE;
+			task_unlock(t);
+		}
+		WRITE_ONCE(p->oom_rss_cache, rss);
+		i = oom_bucket_of(p) - oom_buckets;
+		max_rss[i] = max(max_rss[i], rss);
+	}
+	rcu_read_unlock();
+
+	/* tasks forked or moved during the walk may be bigger */
+	spin_lock_irq(&oom_bucket_lock);
+	for (i = 0; i < NR_OOM_BUCKETS; i++)
+		oom_buckets[i].max_rss = max(max_rss[i],
+					     oom_buckets[i].new_rss);
+	spin_unlock_irq(&oom_bucket_lock);
+	WRITE_ONCE(oom_refresh_stamp, jiffies ?: 1);
+}
+
 static int oom_evaluate_task(struct task_struct *task, void *arg)
 {
 	struct oom_control *oc = arg;
@@ -380,6 +538,73 @@ abort:
 	return 1;
 }
 
+/*
+ * Evaluate the OOM_FAST_CANDIDATES tasks with the highest estimated badness
+ * only. Returns false if the estimates cannot be used or none of the
+ * candidates could be chosen, and the caller has to scan all tasks.
+ */
+static bool select_bad_process_fast(struct oom_control *oc)
+{
+	struct task_struct *cand[OOM_FAST_CANDIDATES];
+	long est[OOM_FAST_CANDIDATES];
+	unsigned long stamp = READ_ONCE(oom_refresh_stamp);
+	long unit = oc->totalpages / 1000;
+	int b, i, nr = 0;
+
+	if (!READ_ONCE(sysctl_oom_fast_select) || is_memcg_oom(oc) ||
+	    !stamp || time_after(jiffies, stamp + OOM_REFRESH_EXPIRE))
+		return false;
+
+	/* only a full scan finds the victims still on their way out */
+	if (atomic_read(&oom_victims))
+		return false;
+
+	spin_lock_irq(&oom_bucket_lock);
+	for (b = NR_OOM_BUCKETS - 1; b >= 0; b--) {
+		long adj_max = OOM_SCORE_ADJ_MIN + (b + 1) * OOM_BUCKET_ADJ - 1;
+		struct task_struct *p;
+
+		adj_max = min_t(long, adj_max, OOM_SCORE_ADJ_MAX);
+		/* nothing below can beat the candidates found so far */
+		if (nr == OOM_FAST_CANDIDATES &&
+		    (long)oom_buckets[b].max_rss + adj_max * unit <= est[nr - 1])
+			break;
+
+		hlist_for_each_entry(p, &oom_buckets[b].tasks, oom_bucket_node) {
+			long e = (long)READ_ONCE(p->oom_rss_cache) +
+				 p->signal->oom_score_adj * unit;
+
+			if (nr == OOM_FAST_CANDIDATES && e <= est[nr - 1])
+				continue;
+			if (nr < OOM_FAST_CANDIDATES)
+				nr++;
+			/* keep the candidates sorted by decreasing estimate */
+			for (i = nr - 1; i > 0 && est[i - 1] < e; i--) {
+				cand[i] = cand[i - 1];
+				est[i] = est[i - 1];
+			}
+			cand[i] = p;
+			est[i] = e;
+		}
+	}
+	for (i = 0; i < nr; i++)
+		get_task_struct(cand[i]);
+	spin_unlock_irq(&oom_bucket_lock);
+
+	rcu_read_lock();
+	for (i = 0; i < nr; i++) {
+		if (oc->chosen != (void *)-1UL)
+			oom_evaluate_task(cand[i], oc);
+		put_task_struct(cand[i]);
+	}
+	/* tasks like swapoff ask to be killed first, see oom_task_origin() */
+	if (oc->chosen != (void *)-1UL && oom_task_origin(current))
+		oom_evaluate_task(current, oc);
+	rcu_read_unlock();
+
+	return oc->chosen != NULL;
+}
+
 /*
  * Simple selection loop. We choose the process with the highest number of
  * 'points'. In case scan was aborted, oc->chosen is set to -1.
@@ -392,7 +617,7 @@ static void select_bad_process(struct oom_control *oc)
 
 	if (is_memcg_oom(oc))
 		mem_cgroup_scan_tasks(oc->memcg, oom_evaluate_task, oc);
-	else {
+	else if (!select_bad_process_fast(oc)) {
 		struct task_struct *p;
 
 		rcu_read_lock();
@@ -511,10 +736,6 @@ static void dump_header(struct oom_control *oc, struct task_struct *p)
 		dump_oom_summary(oc, p);
 }
 
-/*
- * Number of OOM victims in flight
- */
-static atomic_t oom_victims = ATOMIC_INIT(0);
 static DECLARE_WAIT_QUEUE_HEAD(oom_victims_wait);
 
 static bool oom_killer_disabled __read_mostly;
@@ -549,10 +770,122 @@ static DECLARE_WAIT_QUEUE_HEAD(oom_reaper_wait);
 static struct task_struct *oom_reaper_list;
 static DEFINE_SPINLOCK(oom_reaper_lock);
 
-bool __oom_reap_task_mm(struct mm_struct *mm)
+/*
+ * Big victims are torn down by up to OOM_REAP_MAX_WORKERS workers at once,
+ * each taking OOM_REAP_CHUNK aligned chunks of the address space from a
+ * shared cursor, so that a single huge VMA is split up as well.
+ */
+#define OOM_REAP_MAX_WORKERS	8
+#define OOM_REAP_CHUNK		SZ_8M
+/* Smaller victims are reaped faster than the workers are woken up */
+#define OOM_REAP_PARALLEL_PAGES	(SZ_64M >> PAGE_SHIFT)
+
+static struct workqueue_struct *oom_reap_wq;
+
+struct oom_reap_control {
+	struct mm_struct *mm;
+	spinlock_t lock;
+	/* next vma and address in it to hand out */
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	/* false if part of the address space could not be reaped */
+	bool ret;
+};
+
+struct oom_reap_work {
+	struct work_struct work;
+	struct oom_reap_control *rc;
+};
+
+static bool oom_reap_vma_eligible(struct vm_area_struct *vma)
+{
+	if (!can_madv_lru_vma(vma))
+		return false;
+
+	/*
+	 * Only anonymous pages have a good chance to be dropped
+	 * without additional steps which we cannot afford as we
+	 * are OOM already.
+	 *
+	 * We do not even care about fs backed pages because all
+	 * which are reclaimable have already been reclaimed and
+	 * we do not want to block exit_mmap by keeping mm ref
+	 * count elevated without a good reason.
+	 */
+	return vma_is_anonymous(vma) || !(vma->vm_flags & VM_SHARED);
+}
+
+static bool oom_reap_next_chunk(struct oom_reap_control *rc,
+				struct vm_area_struct **vmap,
+				unsigned long *start, unsigned long *end)
 {
 	struct vm_area_struct *vma;
-	bool ret = true;
+
+	spin_lock(&rc->lock);
+	vma = rc->vma;
+	while (vma && (rc->addr >= vma->vm_end ||
+		       !oom_reap_vma_eligible(vma))) {
+		vma = vma->vm_next;
+		if (vma)
+			rc->addr = vma->vm_start;
+	}
+	rc->vma = vma;
+	if (vma) {
+		*vmap = vma;
+		*start = rc->addr;
+		*end = min(vma->vm_end, ALIGN(rc->addr + 1, OOM_REAP_CHUNK));
+		rc->addr = *end;
+	}
+	spin_unlock(&rc->lock);
+
+	return vma != NULL;
+}
+
+static void oom_reap_chunks(struct oom_reap_control *rc)
+{
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+
+	while (oom_reap_next_chunk(rc, &vma, &start, &end)) {
+		struct mmu_notifier_range range;
+		struct mmu_gather tlb;
+
+		mmu_notifier_range_init(&range, MMU_NOTIFY_UNMAP, 0,
+					vma, rc->mm, start, end);
+		tlb_gather_mmu(&tlb, rc->mm, range.start, range.end);
+		if (mmu_notifier_invalidate_range_start_nonblock(&range)) {
+			tlb_finish_mmu(&tlb, range.start, range.end);
+			WRITE_ONCE(rc->ret, false);
+			continue;
+		}
+		unmap_page_range(&tlb, vma, range.start, range.end, NULL);
+		mmu_notifier_invalidate_range_end(&range);
+		tlb_finish_mmu(&tlb, range.start, range.end);
+	}
+}
+
+static void oom_reap_work_fn(struct work_struct *work)
+{
+	struct oom_reap_work *w = container_of(work, struct oom_reap_work, work);
+
+	oom_reap_chunks(w->rc);
+}
+
+/*
+ * The workers rely on the caller's mmap_lock, and on the caller waiting
+ * for all of them before it drops it.
+ */
+static bool __oom_reap_task_mm_workers(struct mm_struct *mm, int nr_workers)
+{
+	struct oom_reap_work works[OOM_REAP_MAX_WORKERS - 1];
+	struct oom_reap_control rc = {
+		.mm = mm,
+		.lock = __SPIN_LOCK_UNLOCKED(rc.lock),
+		.vma = mm->mmap,
+		.addr = mm->mmap ? mm->mmap->vm_start : 0,
+		.ret = true,
+	};
+	int i;
 
 	/*
 	 * Tell all users of get_user/copy_from_user etc... that the content
@@ -562,40 +895,26 @@ bool __oom_reap_task_mm(struct mm_struct *mm)
 	 */
 	set_bit(MMF_UNSTABLE, &mm->flags);
 
-	for (vma = mm->mmap ; vma; vma = vma->vm_next) {
-		if (!can_madv_lru_vma(vma))
-			continue;
+	for (i = 0; i < nr_workers - 1; i++) {
+		INIT_WORK_ONSTACK(&works[i].work, oom_reap_work_fn);
+		works[i].rc = &rc;
+		queue_work(oom_reap_wq, &works[i].work);
+	}
 
-		/*
-		 * Only anonymous pages have a good chance to be dropped
-		 * without additional steps which we cannot afford as we
-		 * are OOM already.
-		 *
-		 * We do not even care about fs backed pages because all
-		 * which are reclaimable have already been reclaimed and
-		 * we do not want to block exit_mmap by keeping mm ref
-		 * count elevated without a good reason.
-		 */
-		if (vma_is_anonymous(vma) || !(vma->vm_flags & VM_SHARED)) {
-			struct mmu_notifier_range range;
-			struct mmu_gather tlb;
-
-			mmu_notifier_range_init(&range, MMU_NOTIFY_UNMAP, 0,
-						vma, mm, vma->vm_start,
-						vma->vm_end);
-			tlb_gather_mmu(&tlb, mm, range.start, range.end);
-			if (mmu_notifier_invalidate_range_start_nonblock(&range)) {
-				tlb_finish_mmu(&tlb, range.start, range.end);
-				ret = false;
-				continue;
-			}
-			unmap_page_range(&tlb, vma, range.start, range.end, NULL);
-			mmu_notifier_invalidate_range_end(&range);
-			tlb_finish_mmu(&tlb, range.start, range.end);
-		}
+	/* the caller does its share, so progress never depends on a worker */
+	oom_reap_chunks(&rc);
+
+	for (i = 0; i < nr_workers - 1; i++) {
+		flush_work(&works[i].work);
+		destroy_work_on_stack(&works[i].work);
 	}
 
-	return ret;
+	return rc.ret;
+}
+
+bool __oom_reap_task_mm(struct mm_struct *mm)
+{
+	return __oom_reap_task_mm_workers(mm, 1);
 }
 
 /*
@@ -606,6 +925,7 @@ bool __oom_reap_task_mm(struct mm_struct *mm)
  */
 static bool oom_reap_task_mm(struct task_struct *tsk, struct mm_struct *mm)
 {
+	int nr_workers = 1;
 	bool ret = true;
 
 	if (!mmap_read_trylock(mm)) {
@@ -626,8 +946,11 @@ static bool oom_reap_task_mm(struct task_struct *tsk, struct mm_struct *mm)
 
 	trace_start_task_reaping(tsk->pid);
 
+	if (oom_reap_wq && get_mm_rss(mm) >= OOM_REAP_PARALLEL_PAGES)
+		nr_workers = min_t(int, num_online_cpus(), OOM_REAP_MAX_WORKERS);
+
 	/* failed to reap part of the address space. Try again later */
-	ret = __oom_reap_task_mm(mm);
+	ret = __oom_reap_task_mm_workers(mm, nr_workers);
 	if (!ret)
 		goto out_finish;
 
@@ -715,6 +1038,9 @@ static void wake_oom_reaper(struct task_struct *tsk)
 static int __init oom_init(void)
 {
 	oom_reaper_th = kthread_run(oom_reaper, NULL, "oom_reaper");
+	/* the rescuer keeps at least one worker going while OOM */
+	oom_reap_wq = alloc_workqueue("oom_reap", WQ_UNBOUND | WQ_MEM_RECLAIM,
+				      OOM_REAP_MAX_WORKERS);
 	return 0;
 }
 subsys_initcall(oom_init)
@@ -1195,6 +1521,117 @@ void pagefault_out_of_memory(void)
 	mutex_unlock(&oom_lock);
 }
 
+struct psi_kill_control {
+	short min_score_adj;
+	short chosen_adj;
+	unsigned long chosen_rss;
+	struct task_struct *chosen;
+	/* an earlier victim is still on its way out */
+	bool busy;
+};
+
+static int psi_kill_evaluate(struct task_struct *task, void *arg)
+{
+	struct psi_kill_control *pk = arg;
+	struct task_struct *p;
+	unsigned long rss;
+	short adj;
+
+	if (oom_unkillable_task(task))
+		return 0;
+
+	if (tsk_is_oom_victim(task) &&
+	    !test_bit(MMF_OOM_SKIP, &task->signal->oom_mm->flags)) {
+		pk->busy = true;
+		return 1;
+	}
+
+	p = find_lock_task_mm(task);
+	if (!p)
+		return 0;
+
+	adj = p->signal->oom_score_adj;
+	if (adj < pk->min_score_adj || adj == OOM_SCORE_ADJ_MIN ||
+	    test_bit(MMF_OOM_SKIP, &p->mm->flags) || in_vfork(p)) {
+		task_unlock(p);
+		return 0;
+	}
+	rss = get_mm_rss(p->mm) + get_mm_counter(p->mm, MM_SWAPENTS);
+	task_unlock(p);
+
+	if (pk->chosen && (adj < pk->chosen_adj ||
+			   (adj == pk->chosen_adj && rss <= pk->chosen_rss)))
+		return 0;
+
+	if (pk->chosen)
+		put_task_struct(pk->chosen);
+	get_task_struct(task);
+	pk->chosen = task;
+	pk->chosen_adj = adj;
+	pk->chosen_rss = rss;
+	return 0;
+}
+
+/**
+ * oom_kill_psi_victim - kill a task on behalf of a memory PSI trigger
+ * @cgrp: cgroup of the trigger, %NULL for a system wide trigger
+ * @min_score_adj: lowest oom_score_adj that may be killed
+ *
+ * Applies the policy lmkd uses itself: the task with the highest
+ * oom_score_adj, the biggest one among equals. The victim is queued for
+ * the oom reaper like after a reap-on-kill SIGKILL from lmkd. Nothing is
+ * killed while an earlier victim is still being torn down.
+ *
+ * Return: true if a task was killed.
+ */
+bool oom_kill_psi_victim(struct cgroup *cgrp, short min_score_adj)
+{
+	struct psi_kill_control pk = { .min_score_adj = min_score_adj };
+	struct cgroup_subsys_state *css = NULL;
+	struct mem_cgroup *memcg = NULL;
+	struct task_struct *victim;
+
+#ifdef CONFIG_MEMCG
+	if (cgrp && !mem_cgroup_disabled()) {
+		css = cgroup_get_e_css(cgrp, &memory_cgrp_subsys);
+		memcg = mem_cgroup_from_css(css);
+	}
+#endif
+	/* never kill outside of the cgroup that asked for it */
+	if (cgrp && !memcg)
+		return false;
+
+	if (memcg && !mem_cgroup_is_root(memcg)) {
+		mem_cgroup_scan_tasks(memcg, psi_kill_evaluate, &pk);
+	} else {
+		struct task_struct *p;
+
+		rcu_read_lock();
+		for_each_process(p)
+			if (psi_kill_evaluate(p, &pk))
+				break;
+		rcu_read_unlock();
+	}
+	if (css)
+		css_put(css);
+
+	victim = pk.chosen;
+	if (!victim)
+		return false;
+	if (pk.busy) {
+		put_task_struct(victim);
+		return false;
+	}
+
+	pr_info("psi: killing process %d (%s), oom_score_adj %hd, rss %lukB\n",
+		task_pid_nr(victim), victim->comm, pk.chosen_adj,
+		K(pk.chosen_rss));
+	do_send_sig_info(SIGKILL, SEND_SIG_PRIV, victim, PIDTYPE_TGID);
+	add_to_oom_reaper(victim);
+	put_task_struct(victim);
+	return true;
+}
+
 void add_to_oom_reaper(struct task_struct *p)
 {
 	p = find_lock_task_mm(p);
@@ -370,6 +370,37 @@ int __swap_writepage(struct page *page, struct writeback_control *wbc,
 	return 0;
 }
 
+/**
+ * swap_readpage_batch - start reading a batch of swap cache pages
+ * @pages: locked swap cache pages that are not uptodate
+ * @nr: number of pages, at most SWAP_READ_BATCH
+ *
+ * Like swap_readpage(page, false) on each page, except that all the pages
+ * frontswap holds are loaded from it in a single call.
+ */
+void swap_readpage_batch(struct page **pages, unsigned int nr)
+{
+	DECLARE_BITMAP(loaded, SWAP_READ_BATCH);
+	unsigned long pflags;
+	unsigned int i;
+
+	bitmap_zero(loaded, SWAP_READ_BATCH);
+	if (nr > 1 && frontswap_enabled()) {
+		psi_memstall_enter(&pflags);
+		frontswap_load_batch(pages, nr, loaded);
+		psi_memstall_leave(&pflags);
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (test_bit(i, loaded)) {
+			SetPageUptodate(pages[i]);
+			unlock_page(pages[i]);
+		} else {
+			swap_readpage(pages[i], false);
+		}
+	}
+}
+
 int swap_readpage(struct page *page, bool synchronous)
 {
 	struct bio *bio;
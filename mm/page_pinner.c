@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 #include <linux/debugfs.h>
+#include <linux/hash.h>
 #include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
@@ -11,11 +12,13 @@
 #include <linux/stackdepot.h>
 #include <linux/seq_file.h>
 #include <linux/sched/clock.h>
+#include <linux/vmalloc.h>
 
 #include "internal.h"
 
 #define PAGE_PINNER_STACK_DEPTH 16
 #define LONGTERM_PIN_BUCKETS	4096
+#define PIN_SITE_BUCKETS	1024
 
 struct page_pinner {
 	depot_stack_handle_t handle;
@@ -50,6 +53,44 @@ static struct longterm_pinner lt_pinner = {
 
 static s64 threshold_usec = 300000;
 
+/* Only every sample_rate'th pin gets its stack captured and tracked */
+static unsigned int sample_rate = 1;
+static DEFINE_PER_CPU(unsigned int, pin_sample_count);
+
+/* Pins aggregated per call site, i.e. per stack depot handle */
+struct pin_site {
+	depot_stack_handle_t handle;
+	u64 nr_pins;
+	u64 nr_unpins;
+	u64 nr_longterm;
+	u64 total_usec;
+	u64 max_usec;
+};
+
+static struct pin_site pin_sites[PIN_SITE_BUCKETS];
+static DEFINE_SPINLOCK(pin_sites_lock);
+static unsigned long pin_sites_dropped;
+
+/*
+ * Record layout of the "pin_sites" file: one per call site, in native
+ * endianness, the stack padded with zeroes to PAGE_PINNER_STACK_DEPTH.
+ */
+struct pin_site_record {
+	u64 nr_pins;
+	u64 nr_unpins;
+	u64 nr_longterm;
+	u64 total_usec;
+	u64 max_usec;
+	u32 nr_entries;
+	u32 reserved;
+	u64 entries[PAGE_PINNER_STACK_DEPTH];
+};
+
+struct pin_sites_snapshot {
+	size_t size;
+	struct pin_site_record records[PIN_SITE_BUCKETS];
+};
+
 /* alloc_contig failed pinner */
 static struct longterm_pinner acf_pinner = {
 	.lock = __SPIN_LOCK_UNLOCKED(acf_pinner.lock),
@@ -118,6 +159,60 @@ static noinline depot_stack_handle_t save_stack(gfp_t flags)
 	return handle;
 }
 
+/* Called with pin_sites_lock held, NULL once the table is full */
+static struct pin_site *pin_site_lookup(depot_stack_handle_t handle)
+{
+	unsigned int i, idx = hash_32(handle, ilog2(PIN_SITE_BUCKETS));
+
+	if (!handle)
+		return NULL;
+
+	for (i = 0; i < PIN_SITE_BUCKETS; i++) {
+		struct pin_site *site = &pin_sites[idx];
+
+		if (site->handle == handle)
+			return site;
+		if (!site->handle) {
+			site->handle = handle;
+			return site;
+		}
+		idx = (idx + 1) % PIN_SITE_BUCKETS;
+	}
+
+	pin_sites_dropped++;
+	return NULL;
+}
+
+static void pin_site_pinned(depot_stack_handle_t handle, unsigned int nr)
+{
+	struct pin_site *site;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pin_sites_lock, flags);
+	site = pin_site_lookup(handle);
+	if (site)
+		site->nr_pins += nr;
+	spin_unlock_irqrestore(&pin_sites_lock, flags);
+}
+
+static void pin_site_unpinned(depot_stack_handle_t handle, s64 delta)
+{
+	struct pin_site *site;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pin_sites_lock, flags);
+	site = pin_site_lookup(handle);
+	if (site) {
+		site->nr_unpins++;
+		site->total_usec += delta;
+		if (delta > site->max_usec)
+			site->max_usec = delta;
+		if (delta > threshold_usec)
+			site->nr_longterm++;
+	}
+	spin_unlock_irqrestore(&pin_sites_lock, flags);
+}
+
 static void capture_page_state(struct page *page,
 			       struct captured_pinner *record)
 {
@@ -142,6 +237,7 @@ static void check_longterm_pin(struct page_pinner *page_pinner,
 	if (page_pinner->ts_usec < now)
 		delta = now - page_pinner->ts_usec;
 
+	pin_site_unpinned(page_pinner->handle, delta);
 	if (delta <= threshold_usec)
 		return;
 
@@ -208,11 +304,17 @@ noinline void __set_page_pinner(struct page *page, unsigned int order)
 {
 	struct page_ext *page_ext = lookup_page_ext(page);
 	depot_stack_handle_t handle;
+	unsigned int rate = READ_ONCE(sample_rate);
 
 	if (unlikely(!page_ext))
 		return;
 
+	/* unsampled pins are not tracked at all, not even their unpin */
+	if (rate > 1 && this_cpu_inc_return(pin_sample_count) % rate)
+		return;
+
 	handle = save_stack(GFP_NOWAIT|__GFP_NOWARN);
+	pin_site_pinned(handle, 1 << order);
 	__set_page_pinner_handle(page, page_ext, handle, order);
 }
 
@@ -441,6 +543,106 @@ static const struct file_operations proc_alloc_contig_failed_operations = {
 	.read		= read_alloc_contig_failed,
 };
 
+static int pin_sites_open(struct inode *inode, struct file *file)
+{
+	struct pin_sites_snapshot *snap;
+	struct pin_site *sites;
+	unsigned long flags;
+	size_t nr = 0;
+	int i;
+
+	if (!static_branch_unlikely(&page_pinner_inited))
+		return -EINVAL;
+
+	sites = vmalloc(sizeof(pin_sites));
+	snap = vzalloc(sizeof(*snap));
+	if (!sites || !snap) {
+		vfree(sites);
+		vfree(snap);
+		return -ENOMEM;
+	}
+
+	/* snapshot first, the stack depot lookups need no lock */
+	spin_lock_irqsave(&pin_sites_lock, flags);
+	memcpy(sites, pin_sites, sizeof(pin_sites));
+	spin_unlock_irqrestore(&pin_sites_lock, flags);
+
+	for (i = 0; i < PIN_SITE_BUCKETS; i++) {
+		struct pin_site_record *record = &snap->records[nr];
+		unsigned long *entries;
+		unsigned int j;
+
+		if (!sites[i].handle)
+			continue;
+
+		record->nr_pins = sites[i].nr_pins;
+		record->nr_unpins = sites[i].nr_unpins;
+		record->nr_longterm = sites[i].nr_longterm;
+		record->total_usec = sites[i].total_usec;
+		record->max_usec = sites[i].max_usec;
+		record->nr_entries = stack_depot_fetch(sites[i].handle, &entries);
+		record->nr_entries = min_t(u32, record->nr_entries,
+					   PAGE_PINNER_STACK_DEPTH);
+		for (j = 0; j < record->nr_entries; j++)
+			record->entries[j] = entries[j];
+		nr++;
+	}
+	vfree(sites);
+
+	snap->size = nr * sizeof(struct pin_site_record);
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t read_pin_sites(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct pin_sites_snapshot *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->records,
+				       snap->size);
+}
+
+static int pin_sites_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations pin_sites_operations = {
+	.open		= pin_sites_open,
+	.read		= read_pin_sites,
+	.release	= pin_sites_release,
+};
+
+static void pin_sites_reset(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pin_sites_lock, flags);
+	memset(pin_sites, 0, sizeof(pin_sites));
+	pin_sites_dropped = 0;
+	spin_unlock_irqrestore(&pin_sites_lock, flags);
+}
+
+static int sample_rate_set(void *data, u64 val)
+{
+	if (!val || val > UINT_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(sample_rate, val);
+	pin_sites_reset();
+	return 0;
+}
+
+static int sample_rate_get(void *data, u64 *val)
+{
+	*val = READ_ONCE(sample_rate);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(sample_rate_fops, sample_rate_get,
+			 sample_rate_set, "%llu\n");
+
 static int pp_threshold_set(void *data, unsigned long long val)
 {
 	unsigned long flags;
@@ -509,6 +711,15 @@ static int __init page_pinner_init(void)
 	debugfs_create_file("failure_tracking", 0644,
 			    pp_debugfs_root, NULL,
 			    &failure_tracking_fops);
+
+	debugfs_create_file("sample_rate", 0644, pp_debugfs_root, NULL,
+			    &sample_rate_fops);
+
+	debugfs_create_file("pin_sites", 0400, pp_debugfs_root, NULL,
+			    &pin_sites_operations);
+
+	debugfs_create_ulong("pin_sites_dropped", 0444, pp_debugfs_root,
+			     &pin_sites_dropped);
 	return 0;
 }
 late_initcall(page_pinner_init)
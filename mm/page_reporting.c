@@ -13,12 +13,31 @@
 #define PAGE_REPORTING_DELAY	(2 * HZ)
 static struct page_reporting_dev_info __rcu *pr_dev_info __read_mostly;
 
+/* Lowest order whose freeing triggers a reporting request */
+unsigned int page_reporting_order = MAX_ORDER;
+
 enum {
 	PAGE_REPORTING_IDLE = 0,
 	PAGE_REPORTING_REQUESTED,
 	PAGE_REPORTING_ACTIVE
 };
 
+static unsigned int
+page_reporting_min_order(struct page_reporting_dev_info *prdev)
+{
+	unsigned int order = READ_ONCE(prdev->order);
+
+	return order ? order : PAGE_REPORTING_MIN_ORDER;
+}
+
+static unsigned long
+page_reporting_delay(struct page_reporting_dev_info *prdev)
+{
+	unsigned long delay = READ_ONCE(prdev->delay);
+
+	return delay ? delay : PAGE_REPORTING_DELAY;
+}
+
 /* request page reporting */
 static void
 __page_reporting_request(struct page_reporting_dev_info *prdev)
@@ -39,11 +58,11 @@ __page_reporting_request(struct page_reporting_dev_info *prdev)
 		return;
 
 	/*
-	 * Delay the start of work to allow a sizable queue to build. For
-	 * now we are limiting this to running no more than once every
-	 * couple of seconds.
+	 * Delay the start of work to allow a sizable queue to build. Unless
+	 * the device asks otherwise we are limiting this to running no more
+	 * than once every couple of seconds.
 	 */
-	schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+	schedule_delayed_work(&prdev->work, page_reporting_delay(prdev));
 }
 
 /* notify prdev of free page reporting request */
@@ -221,7 +240,8 @@ page_reporting_cycle(struct page_reporting_dev_info *prdev, struct zone *zone,
 
 static int
 page_reporting_process_zone(struct page_reporting_dev_info *prdev,
-			    struct scatterlist *sgl, struct zone *zone)
+			    struct scatterlist *sgl, struct zone *zone,
+			    unsigned int min_order)
 {
 	unsigned int order, mt, leftover, offset = PAGE_REPORTING_CAPACITY;
 	unsigned long watermark;
@@ -229,7 +249,7 @@ page_reporting_process_zone(struct page_reporting_dev_info *prdev,
 
 	/* Generate minimum watermark to be able to guarantee progress */
 	watermark = low_wmark_pages(zone) +
-		    (PAGE_REPORTING_CAPACITY << PAGE_REPORTING_MIN_ORDER);
+		    (PAGE_REPORTING_CAPACITY << min_order);
 
 	/*
 	 * Cancel request if insufficient free memory or if we failed
@@ -239,7 +259,7 @@ page_reporting_process_zone(struct page_reporting_dev_info *prdev,
 		return err;
 
 	/* Process each free list starting from lowest order/mt */
-	for (order = PAGE_REPORTING_MIN_ORDER; order < MAX_ORDER; order++) {
+	for (order = min_order; order < MAX_ORDER; order++) {
 		for (mt = 0; mt < MIGRATE_TYPES; mt++) {
 			/* We do not pull pages from the isolate free list */
 			if (is_migrate_isolate(mt))
@@ -273,6 +293,7 @@ static void page_reporting_process(struct work_struct *work)
 	struct page_reporting_dev_info *prdev =
 		container_of(d_work, struct page_reporting_dev_info, work);
 	int err = 0, state = PAGE_REPORTING_ACTIVE;
+	unsigned int min_order = page_reporting_min_order(prdev);
 	struct scatterlist *sgl;
 	struct zone *zone;
 
@@ -283,6 +304,11 @@ static void page_reporting_process(struct work_struct *work)
 	 * to idle and quit scheduling reporting runs.
 	 */
 	atomic_set(&prdev->state, state);
+	WRITE_ONCE(page_reporting_order, min_order);
+
+	/* nothing to do while the device has suspended reporting */
+	if (min_order >= MAX_ORDER)
+		goto err_out;
 
 	/* allocate scatterlist to store pages being reported on */
 	sgl = kmalloc_array(PAGE_REPORTING_CAPACITY, sizeof(*sgl), GFP_KERNEL);
@@ -292,7 +318,7 @@ static void page_reporting_process(struct work_struct *work)
 	sg_init_table(sgl, PAGE_REPORTING_CAPACITY);
 
 	for_each_zone(zone) {
-		err = page_reporting_process_zone(prdev, sgl, zone);
+		err = page_reporting_process_zone(prdev, sgl, zone, min_order);
 		if (err)
 			break;
 	}
@@ -301,12 +327,12 @@ static void page_reporting_process(struct work_struct *work)
 err_out:
 	/*
 	 * If the state has reverted back to requested then there may be
-	 * additional pages to be processed. We will defer for 2s to allow
-	 * more pages to accumulate.
+	 * additional pages to be processed. We will defer for the reporting
+	 * delay to allow more pages to accumulate.
 	 */
 	state = atomic_cmpxchg(&prdev->state, state, PAGE_REPORTING_IDLE);
 	if (state == PAGE_REPORTING_REQUESTED)
-		schedule_delayed_work(&prdev->work, PAGE_REPORTING_DELAY);
+		schedule_delayed_work(&prdev->work, page_reporting_delay(prdev));
 }
 
 static DEFINE_MUTEX(page_reporting_mutex);
@@ -329,6 +355,7 @@ int page_reporting_register(struct page_reporting_dev_info *prdev)
 	INIT_DELAYED_WORK(&prdev->work, &page_reporting_process);
 
 	/* Begin initial flush of zones */
+	WRITE_ONCE(page_reporting_order, page_reporting_min_order(prdev));
 	__page_reporting_request(prdev);
 
 	/* Assign device to allow notifications */
@@ -362,3 +389,23 @@ void page_reporting_unregister(struct page_reporting_dev_info *prdev)
 	mutex_unlock(&page_reporting_mutex);
 }
 EXPORT_SYMBOL_GPL(page_reporting_unregister);
+
+/**
+ * page_reporting_request - schedule a reporting pass
+ * @prdev: registered page reporting device
+ *
+ * Called by the device after changing its reporting order or delay so the
+ * new settings take effect, and free pages that were skipped before are
+ * considered again.
+ */
+void page_reporting_request(struct page_reporting_dev_info *prdev)
+{
+	rcu_read_lock();
+	if (rcu_access_pointer(pr_dev_info) == prdev) {
+		WRITE_ONCE(page_reporting_order,
+			   page_reporting_min_order(prdev));
+		__page_reporting_request(prdev);
+	}
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(page_reporting_request);
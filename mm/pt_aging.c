@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mm/pt_aging.c - page table walk based aging of the active LRU lists.
+ *
+ * The classic reclaim ages the active lists with page_referenced(), an rmap
+ * walk per page that touches the page tables of every process mapping the
+ * page and mostly finds nothing. With pt_aging enabled, kswapd instead walks
+ * the page tables of all processes at most once per aging interval, moving
+ * the accessed bits it finds into PG_young and clearing PG_idle in a single
+ * sequential pass. shrink_active_list() keeps the pages that are not idle
+ * active and marks them idle again, so a page is demoted when no walk found
+ * it accessed since the previous scan, without any rmap walk. Eviction from
+ * the inactive lists is unchanged and still double checks the page tables
+ * and PG_young, so a page used after the last walk is not lost.
+ *
+ * The classic aging stays in use while pt_aging is disabled at runtime, and
+ * whenever the last walk is too old to be trusted, e.g. when only direct
+ * reclaim is running.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/mmu_notifier.h>
+#include <linux/page_idle.h>
+#include <linux/pagewalk.h>
+#include <linux/sched/mm.h>
+#include <linux/swap.h>
+
+#include "internal.h"
+
+static bool pt_aging_enabled __read_mostly;
+static unsigned int pt_aging_aging_interval_ms __read_mostly = 1000;
+
+/* every mm with user page tables, walked round robin */
+static LIST_HEAD(pt_aging_mm_list);
+static DEFINE_SPINLOCK(pt_aging_mm_lock);
+static unsigned long pt_aging_nr_mms;
+
+static DEFINE_MUTEX(pt_aging_walk_mutex);
+static unsigned long pt_aging_last_walk;
+static unsigned long pt_aging_seq;
+
+void pt_aging_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&pt_aging_mm_lock);
+	list_add_tail(&mm->pt_aging_list, &pt_aging_mm_list);
+	pt_aging_nr_mms++;
+	spin_unlock(&pt_aging_mm_lock);
+}
+
+void pt_aging_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&pt_aging_mm_lock);
+	list_del(&mm->pt_aging_list);
+	pt_aging_nr_mms--;
+	spin_unlock(&pt_aging_mm_lock);
+}
+
+static void pt_aging_note_young(struct page *page)
+{
+	clear_page_idle(page);
+	set_page_young(page);
+}
+
+static int pt_aging_pmd_entry(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+	pte_t *orig_pte, *pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		pmd_t orig_pmd = *pmd;
+
+		if (pmd_present(orig_pmd) && !is_huge_zero_pmd(orig_pmd) &&
+		    pmd_young(orig_pmd) &&
+		    pmdp_clear_young_notify(vma, addr, pmd))
+			pt_aging_note_young(pmd_page(orig_pmd));
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	for (; addr < end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		if (ptep_clear_young_notify(vma, addr, pte))
+			pt_aging_note_young(compound_head(page));
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	cond_resched();
+	return 0;
+}
+
+static int pt_aging_test_walk(unsigned long start, unsigned long end,
+			     struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->vma;
+
+	/* page_referenced() ignores the accesses through VM_SEQ_READ too */
+	if (vma->vm_flags & (VM_LOCKED | VM_HUGETLB | VM_SEQ_READ | VM_SPECIAL))
+		return 1;
+	return 0;
+}
+
+static const struct mm_walk_ops pt_aging_walk_ops = {
+	.pmd_entry		= pt_aging_pmd_entry,
+	.test_walk		= pt_aging_test_walk,
+};
+
+static void pt_aging_walk_mms(void)
+{
+	unsigned long nr;
+
+	spin_lock(&pt_aging_mm_lock);
+	nr = pt_aging_nr_mms;
+	spin_unlock(&pt_aging_mm_lock);
+
+	while (nr--) {
+		struct mm_struct *mm = NULL;
+
+		spin_lock(&pt_aging_mm_lock);
+		if (!list_empty(&pt_aging_mm_list)) {
+			mm = list_first_entry(&pt_aging_mm_list,
+					      struct mm_struct, pt_aging_list);
+			list_move_tail(&mm->pt_aging_list, &pt_aging_mm_list);
+			if (!mmget_not_zero(mm))
+				mm = NULL;
+		}
+		spin_unlock(&pt_aging_mm_lock);
+		if (!mm)
+			continue;
+
+		/* never wait behind a writer, the next walk catches up */
+		if (mmap_read_trylock(mm)) {
+			walk_page_range(mm, 0, mm->highest_vm_end,
+					&pt_aging_walk_ops, NULL);
+			mmap_read_unlock(mm);
+		}
+		mmput_async(mm);
+	}
+}
+
+/**
+ * pt_aging_ready - run the page table walk aging if it is due
+ * @may_walk: whether the caller can afford to walk the page tables itself
+ *
+ * Return: true if the active lists should be aged from PG_idle, false if
+ * the caller has to fall back to page_referenced().
+ */
+bool pt_aging_ready(bool may_walk)
+{
+	unsigned long interval, last;
+
+	if (!READ_ONCE(pt_aging_enabled))
+		return false;
+
+	interval = msecs_to_jiffies(READ_ONCE(pt_aging_aging_interval_ms));
+	last = READ_ONCE(pt_aging_last_walk);
+	if (may_walk && (!READ_ONCE(pt_aging_seq) ||
+			 time_after(jiffies, last + interval)) &&
+	    mutex_trylock(&pt_aging_walk_mutex)) {
+		pt_aging_walk_mms();
+		WRITE_ONCE(pt_aging_last_walk, jiffies);
+		WRITE_ONCE(pt_aging_seq, pt_aging_seq + 1);
+		mutex_unlock(&pt_aging_walk_mutex);
+		return true;
+	}
+
+	return READ_ONCE(pt_aging_seq) &&
+	       time_before(jiffies, last + 2 * interval);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", READ_ONCE(pt_aging_enabled));
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enabled;
+
+	if (kstrtobool(buf, &enabled))
+		return -EINVAL;
+
+	WRITE_ONCE(pt_aging_enabled, enabled);
+	return count;
+}
+static struct kobj_attribute pt_aging_enabled_attr = __ATTR_RW(enabled);
+
+static ssize_t aging_interval_ms_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(pt_aging_aging_interval_ms));
+}
+
+static ssize_t aging_interval_ms_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned int msecs;
+
+	if (kstrtouint(buf, 0, &msecs) || !msecs)
+		return -EINVAL;
+
+	WRITE_ONCE(pt_aging_aging_interval_ms, msecs);
+	return count;
+}
+static struct kobj_attribute pt_aging_aging_interval_ms_attr =
+	__ATTR_RW(aging_interval_ms);
+
+static ssize_t seq_show(struct kobject *kobj,
+			struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", READ_ONCE(pt_aging_seq));
+}
+static struct kobj_attribute pt_aging_seq_attr = __ATTR_RO(seq);
+
+static struct attribute *pt_aging_attrs[] = {
+	&pt_aging_enabled_attr.attr,
+	&pt_aging_aging_interval_ms_attr.attr,
+	&pt_aging_seq_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group pt_aging_attr_group = {
+	.attrs = pt_aging_attrs,
+	.name = "pt_aging",
+};
+
+static int __init pt_aging_init(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &pt_aging_attr_group);
+	if (err) {
+		pr_err("pt_aging: register sysfs failed\n");
+		return err;
+	}
+	return 0;
+}
+subsys_initcall(pt_aging_init);
+#endif
@@ -21,6 +21,7 @@
 #include <linux/file.h>
 #include <linux/mm_inline.h>
 #include <linux/blk-cgroup.h>
+#include <linux/cpuset.h>
 #include <linux/fadvise.h>
 #include <linux/sched/mm.h>
 #include <trace/hooks/mm.h>
@@ -167,6 +168,54 @@ out:
 		rac->_index++;
 }
 
+/* Largest physically contiguous block readahead tries to allocate at once */
+#define RA_CONTIG_ORDER		3
+
+struct ra_contig_pool {
+	struct page *page;
+	unsigned int nr;
+};
+
+/*
+ * Hand out the pages of a split high-order allocation one by one, so that
+ * consecutive page cache indices end up physically contiguous. The
+ * high-order allocation never reclaims or warns; when it fails, or the
+ * mapping did not ask for it, this is a plain __page_cache_alloc().
+ */
+static struct page *ra_contig_alloc(struct address_space *mapping,
+		struct ra_contig_pool *pool, gfp_t gfp_mask,
+		unsigned long nr_left)
+{
+	unsigned int order;
+	struct page *page;
+
+	if (!pool->nr && mapping_ra_contig(mapping) && nr_left > 1 &&
+	    !cpuset_do_page_mem_spread()) {
+		order = min_t(unsigned int, RA_CONTIG_ORDER, ilog2(nr_left));
+		page = alloc_pages((gfp_mask & ~__GFP_DIRECT_RECLAIM) |
+				   __GFP_NOWARN | __GFP_NORETRY, order);
+		if (page) {
+			split_page(page, order);
+			pool->page = page;
+			pool->nr = 1U << order;
+		}
+	}
+
+	if (pool->nr) {
+		pool->nr--;
+		return pool->page++;
+	}
+	return __page_cache_alloc(gfp_mask);
+}
+
+static void ra_contig_drain(struct ra_contig_pool *pool)
+{
+	while (pool->nr) {
+		pool->nr--;
+		put_page(pool->page++);
+	}
+}
+
 /**
  * page_cache_ra_unbounded - Start unchecked readahead.
  * @ractl: Readahead control.
@@ -187,6 +236,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	struct address_space *mapping = ractl->mapping;
 	unsigned long index = readahead_index(ractl);
 	LIST_HEAD(page_pool);
+	struct ra_contig_pool contig = { };
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
 	unsigned long i;
 
@@ -223,7 +273,8 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 			continue;
 		}
 
-		page = __page_cache_alloc(gfp_mask);
+		page = ra_contig_alloc(mapping, &contig, gfp_mask,
+				       nr_to_read - i);
 		if (!page)
 			break;
 		if (mapping->a_ops->readpages) {
@@ -246,6 +297,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	 * will then handle the error.
 	 */
 	read_pages(ractl, &page_pool, false);
+	ra_contig_drain(&contig);
 	memalloc_nofs_restore(nofs);
 }
 EXPORT_SYMBOL_GPL(page_cache_ra_unbounded);
@@ -564,6 +616,8 @@ void page_cache_sync_ra(struct readahead_control *ractl,
 {
 	bool do_forced_ra = ractl->file && (ractl->file->f_mode & FMODE_RANDOM);
 
+	readahead_profile_note(ractl->file, readahead_index(ractl), req_count);
+
 	/*
 	 * Even if read-ahead is disabled, issue this request as read-ahead
 	 * as we'll need it to satisfy the requested range. The forced
@@ -596,6 +650,8 @@ void page_cache_async_ra(struct readahead_control *ractl,
 	if (!ra->ra_pages)
 		return;
 
+	readahead_profile_note(ractl->file, readahead_index(ractl), req_count);
+
 	/*
 	 * Same bit is used for PG_readahead and PG_reclaim.
 	 */
@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * mm/readahead_profile.c - replay the page cache misses of earlier opens.
+ *
+ * The on-demand readahead only sees the pattern of the current open, so
+ * every cold start of an application re-learns how each of its files is
+ * accessed. With vm.readahead_profile set, the ranges of a file that missed
+ * the page cache are recorded as a bitmap of fixed size chunks while the
+ * file is open, and merged into a "trusted." xattr of the file on the last
+ * close. The next open that misses the cache loads that bitmap and prefetches
+ * all the recorded chunks from a worker, ahead of the application.
+ *
+ * The profile is only trusted while the file keeps the size and mtime it
+ * was recorded with, and it is only rewritten when a run adds chunks to
+ * it, so warm starts leave the file alone.
+ */
+
+#include <linux/kernel.h>
+#include <linux/capability.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/mount.h>
+#include <linux/pagemap.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/xattr.h>
+
+#include "internal.h"
+
+#define RA_PROFILE_XATTR	XATTR_TRUSTED_PREFIX "ra_profile"
+#define RA_PROFILE_VERSION	1
+
+/* Chunks of at least 128K, at most 4096 of them per file */
+#define RA_PROFILE_MIN_SHIFT	(17 - PAGE_SHIFT)
+#define RA_PROFILE_MAX_BITS	4096
+
+/* Smaller files are read in full by the regular readahead anyway */
+#define RA_PROFILE_MIN_SIZE	SZ_512K
+
+/* Replay in the same 2M units force_page_cache_ra() uses */
+#define RA_PROFILE_REPLAY_PAGES	(SZ_2M / PAGE_SIZE)
+
+/*
+ * 0: disabled
+ * 1: replay existing profiles only
+ * 2: record new profiles and replay them
+ */
+int sysctl_readahead_profile __read_mostly;
+
+struct ra_profile_disk {
+	__u8	version;
+	__u8	chunk_shift;
+	__le16	reserved;
+	__le32	nr_bits;
+	__le64	i_size;
+	__le64	mtime;
+	__le32	bits[];
+};
+
+struct ra_profile {
+	struct work_struct work;
+	struct file *file;
+	loff_t i_size;
+	time64_t mtime;
+	unsigned int chunk_shift;
+	unsigned int nr_bits;
+	/* chunks recorded by earlier opens, NULL if there is no profile */
+	unsigned long *base;
+	/* chunks that missed the page cache during this open */
+	unsigned long bits[];
+};
+
+static size_t ra_profile_disk_size(unsigned int nr_bits)
+{
+	return struct_size((struct ra_profile_disk *)NULL, bits,
+			   BITS_TO_U32(nr_bits));
+}
+
+static void ra_profile_replay(struct ra_profile *prof)
+{
+	struct file *file = prof->file;
+	struct address_space *mapping = file->f_mapping;
+	unsigned long start, end = 0;
+
+	if (unlikely(!mapping->a_ops->readpage && !mapping->a_ops->readpages &&
+			!mapping->a_ops->readahead))
+		return;
+
+	for (;;) {
+		pgoff_t index;
+		unsigned long nr_pages;
+
+		start = find_next_bit(prof->base, prof->nr_bits, end);
+		if (start >= prof->nr_bits)
+			break;
+		end = find_next_zero_bit(prof->base, prof->nr_bits, start);
+
+		index = (pgoff_t)start << prof->chunk_shift;
+		nr_pages = (end - start) << prof->chunk_shift;
+		while (nr_pages) {
+			unsigned long this_chunk = min_t(unsigned long, nr_pages,
+						RA_PROFILE_REPLAY_PAGES);
+			DEFINE_READAHEAD(ractl, file, mapping, index);
+
+			do_page_cache_ra(&ractl, this_chunk, 0);
+			index += this_chunk;
+			nr_pages -= this_chunk;
+			cond_resched();
+		}
+	}
+}
+
+/*
+ * Load the profile recorded by earlier opens and, once per cached inode,
+ * prefetch it. Runs from a worker so that the xattr read and the page
+ * allocations never stall the fault or read() that noticed the miss.
+ * The worker holds a reference to the file, so the profile is not released
+ * before it is done.
+ */
+static void ra_profile_load_fn(struct work_struct *work)
+{
+	struct ra_profile *prof = container_of(work, struct ra_profile, work);
+	struct file *file = prof->file;
+	struct ra_profile_disk *disk;
+	size_t size = ra_profile_disk_size(prof->nr_bits);
+	unsigned int i;
+	ssize_t ret;
+
+	disk = kmalloc(size, GFP_KERNEL);
+	if (!disk)
+		goto out_fput;
+
+	ret = __vfs_getxattr(file->f_path.dentry, file_inode(file),
+			     RA_PROFILE_XATTR, disk, size, XATTR_NOSECURITY);
+	if (ret != size || disk->version != RA_PROFILE_VERSION ||
+	    disk->chunk_shift != prof->chunk_shift ||
+	    le32_to_cpu(disk->nr_bits) != prof->nr_bits ||
+	    le64_to_cpu(disk->i_size) != prof->i_size ||
+	    le64_to_cpu(disk->mtime) != prof->mtime)
+		goto out;
+
+	prof->base = bitmap_zalloc(prof->nr_bits, GFP_KERNEL);
+	if (!prof->base)
+		goto out;
+	for (i = 0; i < BITS_TO_U32(prof->nr_bits); i++)
+		le32_to_cpus(&disk->bits[i]);
+	bitmap_from_arr32(prof->base, (u32 *)disk->bits, prof->nr_bits);
+
+	if (!test_and_set_bit(AS_RA_PROFILE_REPLAYED, &file->f_mapping->flags))
+		ra_profile_replay(prof);
+out:
+	kfree(disk);
+out_fput:
+	/* may be the last reference, nothing can touch prof after this */
+	fput(file);
+}
+
+/*
+ * Set up the profile of @file on its first page cache miss. Returns NULL if
+ * the file does not qualify or memory is short; the miss is then simply not
+ * recorded.
+ */
+static struct ra_profile *ra_profile_start(struct file *file)
+{
+	struct inode *inode = file_inode(file);
+	struct ra_profile *prof;
+	unsigned long nr_pages, nr_bits;
+	unsigned int shift = RA_PROFILE_MIN_SHIFT;
+	loff_t isize = i_size_read(inode);
+
+	if (!S_ISREG(inode->i_mode) || (file->f_mode & FMODE_WRITE) ||
+	    !(inode->i_opflags & IOP_XATTR) || isize < RA_PROFILE_MIN_SIZE)
+		return NULL;
+
+	nr_pages = DIV_ROUND_UP_ULL(isize, PAGE_SIZE);
+	while ((nr_pages >> shift) >= RA_PROFILE_MAX_BITS)
+		shift++;
+	nr_bits = DIV_ROUND_UP(nr_pages, 1UL << shift);
+
+	prof = kzalloc(struct_size(prof, bits, BITS_TO_LONGS(nr_bits)),
+		       GFP_NOFS | __GFP_NOWARN);
+	if (!prof)
+		return NULL;
+
+	INIT_WORK(&prof->work, ra_profile_load_fn);
+	prof->file = file;
+	prof->i_size = isize;
+	prof->mtime = inode->i_mtime.tv_sec;
+	prof->chunk_shift = shift;
+	prof->nr_bits = nr_bits;
+
+	if (cmpxchg(&file->f_ra_profile, NULL, prof)) {
+		kfree(prof);
+		return READ_ONCE(file->f_ra_profile);
+	}
+
+	get_file(file);
+	queue_work(system_unbound_wq, &prof->work);
+	return prof;
+}
+
+/**
+ * readahead_profile_note - record a page cache miss of a file
+ * @file: the file that missed, may be %NULL
+ * @index: first page of the miss
+ * @nr_pages: number of pages the caller is going to read
+ */
+void readahead_profile_note(struct file *file, pgoff_t index,
+			    unsigned long nr_pages)
+{
+	struct ra_profile *prof;
+	unsigned long first, last;
+
+	if (!file || !READ_ONCE(sysctl_readahead_profile))
+		return;
+
+	prof = READ_ONCE(file->f_ra_profile);
+	if (!prof) {
+		prof = ra_profile_start(file);
+		if (!prof)
+			return;
+	}
+
+	first = index >> prof->chunk_shift;
+	last = (index + max(nr_pages, 1UL) - 1) >> prof->chunk_shift;
+	for (; first <= last && first < prof->nr_bits; first++) {
+		if (!test_bit(first, prof->bits))
+			set_bit(first, prof->bits);
+	}
+}
+
+/*
+ * Only write the trusted.* xattr on behalf of an opener that could have
+ * written the file, or set the xattr itself.
+ */
+static bool ra_profile_may_store(struct file *file)
+{
+	const struct cred *old_cred;
+	bool ret;
+
+	if (file_ns_capable(file, &init_user_ns, CAP_SYS_ADMIN))
+		return true;
+
+	old_cred = override_creds(file->f_cred);
+	ret = !inode_permission(file_inode(file), MAY_WRITE);
+	revert_creds(old_cred);
+	return ret;
+}
+
+static void ra_profile_store(struct ra_profile *prof)
+{
+	struct file *file = prof->file;
+	struct inode *inode = file_inode(file);
+	struct super_block *sb = inode->i_sb;
+	struct ra_profile_disk *disk;
+	size_t size = ra_profile_disk_size(prof->nr_bits);
+	unsigned int i;
+
+	if (bitmap_empty(prof->bits, prof->nr_bits))
+		return;
+	if (prof->base) {
+		if (bitmap_subset(prof->bits, prof->base, prof->nr_bits))
+			return;
+		bitmap_or(prof->bits, prof->bits, prof->base, prof->nr_bits);
+	}
+
+	/* the file changed under us, the profile would not match anyway */
+	if (i_size_read(inode) != prof->i_size ||
+	    inode->i_mtime.tv_sec != prof->mtime)
+		return;
+
+	if (IS_IMMUTABLE(inode) || IS_APPEND(inode) || sb_rdonly(sb) ||
+	    __mnt_is_readonly(file->f_path.mnt) || !ra_profile_may_store(file))
+		return;
+
+	disk = kzalloc(size, GFP_KERNEL);
+	if (!disk)
+		return;
+
+	disk->version = RA_PROFILE_VERSION;
+	disk->chunk_shift = prof->chunk_shift;
+	disk->nr_bits = cpu_to_le32(prof->nr_bits);
+	disk->i_size = cpu_to_le64(prof->i_size);
+	disk->mtime = cpu_to_le64(prof->mtime);
+	bitmap_to_arr32((u32 *)disk->bits, prof->bits, prof->nr_bits);
+	for (i = 0; i < BITS_TO_U32(prof->nr_bits); i++)
+		cpu_to_le32s(&disk->bits[i]);
+
+	/* Never wait for a frozen filesystem from the close path */
+	if (sb_start_write_trylock(sb)) {
+		inode_lock(inode);
+		__vfs_setxattr_noperm(file->f_path.dentry, RA_PROFILE_XATTR,
+				      disk, size, 0);
+		inode_unlock(inode);
+		sb_end_write(sb);
+	}
+
+	kfree(disk);
+}
+
+/**
+ * readahead_profile_release - persist and free the profile of a file
+ * @file: the file being released
+ *
+ * Called from __fput() while @file is still fully set up.
+ */
+void readahead_profile_release(struct file *file)
+{
+	struct ra_profile *prof = file->f_ra_profile;
+
+	if (!prof)
+		return;
+
+	/* the loader held a reference to @file, so it is done with prof */
+	if (READ_ONCE(sysctl_readahead_profile) >= 2)
+		ra_profile_store(prof);
+
+	file->f_ra_profile = NULL;
+	bitmap_free(prof->base);
+	kfree(prof);
+}
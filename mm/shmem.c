@@ -658,6 +658,19 @@ static unsigned long shmem_unused_huge_shrink(struct shmem_sb_info *sbinfo,
 }
 #endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 
+/*
+ * memfd_create(MFD_THP) marks its inode VM_HUGEPAGE: it gets huge pages
+ * wherever they fit, as with huge=always, unless shmem_enabled is "deny".
+ * Unlike the mount policy, the huge page is only taken if it is available
+ * without direct reclaim or compaction, otherwise the memfd quietly falls
+ * back to small pages and leaves khugepaged to collapse them later.
+ */
+static inline bool shmem_inode_thp(struct shmem_inode_info *info)
+{
+	return IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) &&
+	       (info->flags & VM_HUGEPAGE) && shmem_huge != SHMEM_HUGE_DENY;
+}
+
 static inline bool is_huge_enabled(struct shmem_sb_info *sbinfo)
 {
 	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) &&
@@ -1811,6 +1824,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 	struct mm_struct *charge_mm;
 	struct page *page;
 	enum sgp_type sgp_huge = sgp;
+	gfp_t huge_gfp = gfp;
 	pgoff_t hindex = index;
 	int error;
 	int once = 0;
@@ -1884,6 +1898,10 @@ repeat:
 		goto alloc_nohuge;
 	if (shmem_huge == SHMEM_HUGE_FORCE)
 		goto alloc_huge;
+	if (shmem_inode_thp(info) && sbinfo->huge != SHMEM_HUGE_ALWAYS) {
+		huge_gfp &= ~__GFP_DIRECT_RECLAIM;
+		goto alloc_huge;
+	}
 	switch (sbinfo->huge) {
 	case SHMEM_HUGE_NEVER:
 		goto alloc_nohuge;
@@ -1907,7 +1925,7 @@ repeat:
 	}
 
 alloc_huge:
-	page = shmem_alloc_and_acct_page(gfp, inode, index, true);
+	page = shmem_alloc_and_acct_page(huge_gfp, inode, index, true);
 	if (IS_ERR(page)) {
 alloc_nohuge:
 		page = shmem_alloc_and_acct_page(gfp, inode,
@@ -2195,7 +2213,8 @@ unsigned long shmem_get_unmapped_area(struct file *file,
 				return addr;
 			sb = shm_mnt->mnt_sb;
 		}
-		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER &&
+		    !(file && shmem_inode_thp(SHMEM_I(file_inode(file)))))
 			return addr;
 	}
 
@@ -4057,6 +4076,8 @@ bool shmem_huge_enabled(struct vm_area_struct *vma)
 		return true;
 	if (shmem_huge == SHMEM_HUGE_DENY)
 		return false;
+	if (shmem_inode_thp(SHMEM_I(inode)))
+		return true;
 	switch (sbinfo->huge) {
 		case SHMEM_HUGE_NEVER:
 			return false;
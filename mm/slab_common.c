@@ -260,6 +260,7 @@ static struct kmem_cache *create_cache(const char *name,
 	if (err)
 		goto out_free_cache;
 
+	kfence_init_cache(s);
 	s->refcount = 1;
 	list_add(&s->list, &slab_caches);
 out:
@@ -572,6 +573,8 @@ void __init create_boot_cache(struct kmem_cache *s, const char *name,
 		panic("Creation of kmalloc slab %s size=%u failed. Reason %d\n",
 					name, size, err);
 
+	kfence_init_cache(s);
+
 	s->refcount = -1;	/* Exempt from merging for now */
 }
 
@@ -1983,6 +1983,60 @@ static inline void *acquire_slab(struct kmem_cache *s,
 }
 
 static void put_cpu_partial(struct kmem_cache *s, struct page *page, int drain);
+
+#ifdef CONFIG_SLUB_CPU_PARTIAL
+/*
+ * A cache taking a node list_lock more often than CPU_PARTIAL_HOT_TRIPS
+ * times a second on its alloc and free paths gets its cpu_partial doubled,
+ * up to CPU_PARTIAL_MAX_SCALE times the configured value. Below
+ * CPU_PARTIAL_COLD_TRIPS it is halved back towards the configured value.
+ */
+#define CPU_PARTIAL_HOT_TRIPS	1000
+#define CPU_PARTIAL_COLD_TRIPS	100
+#define CPU_PARTIAL_MAX_SCALE	8
+
+static void tune_cpu_partial(struct kmem_cache *s, struct kmem_cache_node *n)
+{
+	unsigned long elapsed = jiffies - n->tune_jiffies;
+	unsigned long rate;
+	unsigned int base, cur, new;
+
+	if (elapsed < HZ)
+		return;
+
+	rate = (n->nr_list_lock - n->tune_list_lock) * HZ / elapsed;
+	n->tune_jiffies = jiffies;
+	n->tune_list_lock = n->nr_list_lock;
+
+	base = READ_ONCE(s->cpu_partial_base);
+	cur = READ_ONCE(s->cpu_partial);
+	if (!base)
+		return;
+
+	if (rate > CPU_PARTIAL_HOT_TRIPS)
+		new = min(cur * 2, base * CPU_PARTIAL_MAX_SCALE);
+	else if (rate < CPU_PARTIAL_COLD_TRIPS)
+		new = max(cur / 2, base);
+	else
+		return;
+
+	if (new != cur)
+		WRITE_ONCE(s->cpu_partial, new);
+}
+#else
+static inline void tune_cpu_partial(struct kmem_cache *s,
+				    struct kmem_cache_node *n)
+{
+}
+#endif
+
+/* Must be called with n->list_lock held */
+static inline void note_list_lock(struct kmem_cache *s,
+				  struct kmem_cache_node *n)
+{
+	n->nr_list_lock++;
+	tune_cpu_partial(s, n);
+}
 static inline bool pfmemalloc_match(struct page *page, gfp_t gfpflags);
 
 /*
@@ -2006,6 +2060,7 @@ static void *get_partial_node(struct kmem_cache *s, struct kmem_cache_node *n,
 		return NULL;
 
 	spin_lock(&n->list_lock);
+	note_list_lock(s, n);
 	list_for_each_entry_safe(page, page2, &n->partial, slab_list) {
 		void *t;
 
@@ -2285,6 +2340,7 @@ redo:
 			 * is frozen
 			 */
 			spin_lock(&n->list_lock);
+			note_list_lock(s, n);
 		}
 	} else {
 		m = M_FULL;
@@ -2364,6 +2420,7 @@ static void unfreeze_partials(struct kmem_cache *s,
 
 			n = n2;
 			spin_lock(&n->list_lock);
+			note_list_lock(s, n);
 		}
 
 		do {
@@ -3063,6 +3120,7 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 				 * other processors updating the list of slabs.
 				 */
 				spin_lock_irqsave(&n->list_lock, flags);
+				note_list_lock(s, n);
 
 			}
 		}
@@ -3691,6 +3749,7 @@ static void set_cpu_partial(struct kmem_cache *s)
 		slub_set_cpu_partial(s, 13);
 	else
 		slub_set_cpu_partial(s, 30);
+	s->cpu_partial_base = slub_cpu_partial(s);
 #endif
 }
 
@@ -5080,6 +5139,9 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 		return -EINVAL;
 
 	slub_set_cpu_partial(s, objects);
+#ifdef CONFIG_SLUB_CPU_PARTIAL
+	s->cpu_partial_base = objects;
+#endif
 	flush_all(s);
 	return length;
 }
@@ -5105,6 +5167,19 @@ static ssize_t partial_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(partial);
 
+static ssize_t list_lock_count_show(struct kmem_cache *s, char *buf)
+{
+	struct kmem_cache_node *n;
+	unsigned long sum = 0;
+	int node;
+
+	for_each_kmem_cache_node(s, node, n)
+		sum += READ_ONCE(n->nr_list_lock);
+
+	return sprintf(buf, "%lu\n", sum);
+}
+SLAB_ATTR_RO(list_lock_count);
+
 static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_CPU);
@@ -5397,6 +5472,7 @@ static struct attribute *slab_attrs[] = {
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
+	&list_lock_count_attr.attr,
 	&cpu_slabs_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
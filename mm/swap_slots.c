@@ -50,6 +50,16 @@ static void reactivate_swap_slots_cache(void);
 #define SLOTS_CACHE 0x1
 #define SLOTS_CACHE_RET 0x2
 
+/*
+ * A cpu that refills its cache again within SLOTS_GROW_INTERVAL gets twice
+ * the slots next time, up to SWAP_SLOTS_CACHE_MAX, so that heavy swap out
+ * takes si->lock less often. One that waited longer than
+ * SLOTS_SHRINK_INTERVAL gets half, down to SWAP_SLOTS_CACHE_SIZE, so that
+ * idle cpus do not sit on slots.
+ */
+#define SLOTS_GROW_INTERVAL	(HZ / 10)
+#define SLOTS_SHRINK_INTERVAL	HZ
+
 static void deactivate_swap_slots_cache(void)
 {
 	mutex_lock(&swap_slots_cache_mutex);
@@ -121,12 +131,12 @@ static int alloc_swap_slot_cache(unsigned int cpu)
 	 * as kvzalloc could trigger reclaim and get_swap_page,
 	 * which can lock swap_slots_cache_mutex.
 	 */
-	slots = kvcalloc(SWAP_SLOTS_CACHE_SIZE, sizeof(swp_entry_t),
+	slots = kvcalloc(SWAP_SLOTS_CACHE_MAX, sizeof(swp_entry_t),
 			 GFP_KERNEL);
 	if (!slots)
 		return -ENOMEM;
 
-	slots_ret = kvcalloc(SWAP_SLOTS_CACHE_SIZE, sizeof(swp_entry_t),
+	slots_ret = kvcalloc(SWAP_SLOTS_CACHE_MAX, sizeof(swp_entry_t),
 			     GFP_KERNEL);
 	if (!slots_ret) {
 		kvfree(slots);
@@ -152,6 +162,8 @@ static int alloc_swap_slot_cache(unsigned int cpu)
 	}
 	cache->nr = 0;
 	cache->cur = 0;
+	cache->batch = SWAP_SLOTS_CACHE_SIZE;
+	cache->refill_time = jiffies;
 	cache->n_ret = 0;
 	/*
 	 * We initialized alloc_lock and free_lock earlier.  We use
@@ -263,17 +275,32 @@ static int refill_swap_slots_cache(struct swap_slots_cache *cache)
 	if (!use_swap_slot_cache || cache->nr)
 		return 0;
 
+	if (time_before(jiffies, cache->refill_time + SLOTS_GROW_INTERVAL))
+		cache->batch = min(cache->batch * 2, SWAP_SLOTS_CACHE_MAX);
+	else if (time_after(jiffies,
+			    cache->refill_time + SLOTS_SHRINK_INTERVAL))
+		cache->batch = max(cache->batch / 2, SWAP_SLOTS_CACHE_SIZE);
+	cache->refill_time = jiffies;
+
 	cache->cur = 0;
 	if (swap_slot_cache_active)
-		cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE,
-					   cache->slots, 1);
+		cache->nr = get_swap_pages(cache->batch, cache->slots, 1);
 
 	return cache->nr;
 }
 
-int free_swap_slot(swp_entry_t entry)
+/**
+ * free_swap_slots - return swap slots to the slots cache
+ * @entries: slots whose swap_map is down to SWAP_HAS_CACHE
+ * @n: number of @entries
+ *
+ * The slots are queued on this cpu's cache under a single lock, and only
+ * handed back to the global pool in batches of SWAP_SLOTS_CACHE_MAX.
+ */
+void free_swap_slots(swp_entry_t *entries, int n)
 {
 	struct swap_slots_cache *cache;
+	int i;
 
 	cache = raw_cpu_ptr(&swp_slots);
 	if (likely(use_swap_slot_cache && cache->slots_ret)) {
@@ -283,23 +310,30 @@ int free_swap_slot(swp_entry_t entry)
 			spin_unlock_irq(&cache->free_lock);
 			goto direct_free;
 		}
-		if (cache->n_ret >= SWAP_SLOTS_CACHE_SIZE) {
-			/*
-			 * Return slots to global pool.
-			 * The current swap_map value is SWAP_HAS_CACHE.
-			 * Set it to 0 to indicate it is available for
-			 * allocation in global pool
-			 */
-			swapcache_free_entries(cache->slots_ret, cache->n_ret);
-			cache->n_ret = 0;
+		for (i = 0; i < n; i++) {
+			if (cache->n_ret >= SWAP_SLOTS_CACHE_MAX) {
+				/*
+				 * Return slots to global pool.
+				 * The current swap_map value is SWAP_HAS_CACHE.
+				 * Set it to 0 to indicate it is available for
+				 * allocation in global pool
+				 */
+				swapcache_free_entries(cache->slots_ret,
+						       cache->n_ret);
+				cache->n_ret = 0;
+			}
+			cache->slots_ret[cache->n_ret++] = entries[i];
 		}
-		cache->slots_ret[cache->n_ret++] = entry;
 		spin_unlock_irq(&cache->free_lock);
 	} else {
 direct_free:
-		swapcache_free_entries(&entry, 1);
+		swapcache_free_entries(entries, n);
 	}
+}
 
+int free_swap_slot(swp_entry_t entry)
+{
+	free_swap_slots(&entry, 1);
 	return 0;
 }
 
@@ -608,13 +608,33 @@ static unsigned int __swapin_nr_pages(unsigned long prev_offset,
 	return pages;
 }
 
-static unsigned long swapin_nr_pages(unsigned long offset)
+/*
+ * Swap devices with synchronous IO, like zram, read ahead at most
+ * 1 << swap_sync_ra_order pages. Each page costs a decompression there
+ * and a fault on a neighbour is about as cheap as reading it ahead.
+ */
+static unsigned int swap_sync_ra_order __read_mostly;
+
+/* The largest readahead order worth using on @si */
+static unsigned int swap_ra_order(struct swap_info_struct *si)
+{
+	unsigned int order = READ_ONCE(page_cluster);
+
+	if (si->flags & SWP_NO_READAHEAD)
+		return 0;
+	if (si->flags & SWP_SYNCHRONOUS_IO)
+		order = min(order, READ_ONCE(swap_sync_ra_order));
+	return order;
+}
+
+static unsigned long swapin_nr_pages(struct swap_info_struct *si,
+				     unsigned long offset)
 {
 	static unsigned long prev_offset;
 	unsigned int hits, pages, max_pages;
 	static atomic_t last_readahead_pages;
 
-	max_pages = 1 << READ_ONCE(page_cluster);
+	max_pages = 1 << swap_ra_order(si);
 	if (max_pages <= 1)
 		return 1;
 
@@ -651,10 +671,21 @@ static unsigned long swapin_nr_pages(unsigned long offset)
  * hold the mmap_sem. Callees are assumed to take care of reading VMA's fields
  * using READ_ONCE() to read consistent values.
  */
+static void swap_ra_read_batch(struct page **pages, unsigned int *nr)
+{
+	unsigned int i;
+
+	swap_readpage_batch(pages, *nr);
+	for (i = 0; i < *nr; i++)
+		put_page(pages[i]);
+	*nr = 0;
+}
+
 struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 				struct vm_fault *vmf)
 {
-	struct page *page;
+	struct page *page, *batch[SWAP_READ_BATCH];
+	unsigned int nr_batch = 0;
 	unsigned long entry_offset = swp_offset(entry);
 	unsigned long offset = entry_offset;
 	unsigned long start_offset, end_offset;
@@ -665,7 +696,7 @@ struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	struct vm_area_struct *vma = vmf->vma;
 	unsigned long addr = vmf->address;
 
-	mask = swapin_nr_pages(offset) - 1;
+	mask = swapin_nr_pages(si, offset) - 1;
 	if (!mask)
 		goto skip;
 
@@ -694,14 +725,19 @@ struct page *swap_cluster_readahead(swp_entry_t entry, gfp_t gfp_mask,
 		if (!page)
 			continue;
 		if (page_allocated) {
-			swap_readpage(page, false);
 			if (offset != entry_offset) {
 				SetPageReadahead(page);
 				count_vm_event(SWAP_RA);
 			}
+			batch[nr_batch++] = page;
+			if (nr_batch == SWAP_READ_BATCH)
+				swap_ra_read_batch(batch, &nr_batch);
+			continue;
 		}
 		put_page(page);
 	}
+	if (nr_batch)
+		swap_ra_read_batch(batch, &nr_batch);
 	blk_finish_plug(&plug);
 
 	lru_add_drain();	/* Push any new pages onto the LRU now */
@@ -752,7 +788,7 @@ static inline void swap_ra_clamp_pfn(struct vm_area_struct *vma,
 		    PFN_DOWN((faddr & PMD_MASK) + PMD_SIZE));
 }
 
-static void swap_ra_info(struct vm_fault *vmf,
+static void swap_ra_info(struct vm_fault *vmf, struct swap_info_struct *si,
 			struct vma_swap_readahead *ra_info)
 {
 	struct vm_area_struct *vma = vmf->vma;
@@ -766,7 +802,7 @@ static void swap_ra_info(struct vm_fault *vmf,
 	pte_t *tpte;
 #endif
 
-	max_win = 1 << min_t(unsigned int, READ_ONCE(page_cluster),
+	max_win = 1 << min_t(unsigned int, swap_ra_order(si),
 			     SWAP_RA_ORDER_CEILING);
 	if (max_win == 1) {
 		ra_info->win = 1;
@@ -839,14 +875,15 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 {
 	struct blk_plug plug;
 	struct vm_area_struct *vma = vmf->vma;
-	struct page *page;
+	struct page *page, *batch[SWAP_READ_BATCH];
+	unsigned int nr_batch = 0;
 	pte_t *pte, pentry;
 	swp_entry_t entry;
 	unsigned int i;
 	bool page_allocated;
 	struct vma_swap_readahead ra_info = {0,};
 
-	swap_ra_info(vmf, &ra_info);
+	swap_ra_info(vmf, swp_swap_info(fentry), &ra_info);
 	if (ra_info.win == 1)
 		goto skip;
 
@@ -866,14 +903,19 @@ static struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
 		if (!page)
 			continue;
 		if (page_allocated) {
-			swap_readpage(page, false);
 			if (i != ra_info.offset) {
 				SetPageReadahead(page);
 				count_vm_event(SWAP_RA);
 			}
+			batch[nr_batch++] = page;
+			if (nr_batch == SWAP_READ_BATCH)
+				swap_ra_read_batch(batch, &nr_batch);
+			continue;
 		}
 		put_page(page);
 	}
+	if (nr_batch)
+		swap_ra_read_batch(batch, &nr_batch);
 	blk_finish_plug(&plug);
 	lru_add_drain();
 skip:
@@ -924,8 +966,29 @@ static struct kobj_attribute vma_ra_enabled_attr =
 	__ATTR(vma_ra_enabled, 0644, vma_ra_enabled_show,
 	       vma_ra_enabled_store);
 
+static ssize_t sync_ra_order_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(swap_sync_ra_order));
+}
+static ssize_t sync_ra_order_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned int order;
+
+	if (kstrtouint(buf, 0, &order) || order > SWAP_RA_ORDER_CEILING)
+		return -EINVAL;
+
+	WRITE_ONCE(swap_sync_ra_order, order);
+	return count;
+}
+static struct kobj_attribute sync_ra_order_attr =
+	__ATTR(sync_ra_order, 0644, sync_ra_order_show, sync_ra_order_store);
+
 static struct attribute *swap_attrs[] = {
 	&vma_ra_enabled_attr.attr,
+	&sync_ra_order_attr.attr,
 	NULL,
 };
 
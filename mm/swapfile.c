@@ -1066,7 +1066,7 @@ int get_swap_pages(int n_goal, swp_entry_t swp_entries[], int entry_size)
 		goto noswap;
 	}
 
-	n_goal = min3((long)n_goal, (long)SWAP_BATCH, avail_pgs);
+	n_goal = min3((long)n_goal, (long)SWAP_SLOTS_CACHE_MAX, avail_pgs);
 
 	atomic_long_sub(n_goal * size, &nr_swap_pages);
 
@@ -1806,6 +1806,61 @@ int free_swap_and_cache(swp_entry_t entry)
 	return p != NULL;
 }
 
+/**
+ * free_swap_and_cache_nr - free_swap_and_cache() for a batch of entries
+ * @entries: swap entries, at most SWAP_FREE_BATCH; clobbered
+ * @n: number of @entries
+ *
+ * Used when an exiting process drops its swap entries. Neighbouring entries
+ * usually sit in the same cluster, so the cluster lock is only retaken when
+ * the cluster changes, and the freed slots are returned to the slots cache
+ * under one lock. Bad entries are reported by _swap_info_get() and skipped.
+ */
+void free_swap_and_cache_nr(swp_entry_t *entries, int n)
+{
+	swp_entry_t freed[SWAP_FREE_BATCH];
+	struct swap_info_struct *p, *locked = NULL;
+	struct swap_cluster_info *ci = NULL;
+	unsigned long cluster = 0;
+	int i, nr_freed = 0, nr_cached = 0;
+
+	for (i = 0; i < n; i++) {
+		unsigned long offset = swp_offset(entries[i]);
+		unsigned char usage;
+
+		p = _swap_info_get(entries[i]);
+		if (!p)
+			continue;
+
+		if (p != locked || (p->cluster_info &&
+				    offset / SWAPFILE_CLUSTER != cluster)) {
+			if (locked)
+				unlock_cluster_or_swap_info(locked, ci);
+			ci = lock_cluster_or_swap_info(p, offset);
+			locked = p;
+			cluster = offset / SWAPFILE_CLUSTER;
+		}
+
+		usage = __swap_entry_free_locked(p, offset, 1);
+		if (!usage)
+			freed[nr_freed++] = entries[i];
+		else if (usage == SWAP_HAS_CACHE)
+			entries[nr_cached++] = entries[i];
+	}
+	if (locked)
+		unlock_cluster_or_swap_info(locked, ci);
+
+	if (nr_freed)
+		free_swap_slots(freed, nr_freed);
+
+	for (i = 0; i < nr_cached; i++) {
+		p = swp_swap_info(entries[i]);
+		if (!swap_page_trans_huge_swapped(p, entries[i]))
+			__try_to_reclaim_swap(p, swp_offset(entries[i]),
+					      TTRS_UNMAPPED | TTRS_FULL);
+	}
+}
+
 #ifdef CONFIG_HIBERNATION
 /*
  * Find the swap type that corresponds to given device (if any).
@@ -3256,6 +3311,9 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	if (p->bdev && p->bdev->bd_disk->fops->rw_page)
 		p->flags |= SWP_SYNCHRONOUS_IO;
 
+	if (swap_flags & SWAP_FLAG_NO_READAHEAD)
+		p->flags |= SWP_NO_READAHEAD;
+
 	if (p->bdev && blk_queue_nonrot(bdev_get_queue(p->bdev))) {
 		int cpu;
 		unsigned long ci, nr_cluster;
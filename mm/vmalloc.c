@@ -31,6 +31,7 @@
 #include <linux/atomic.h>
 #include <linux/compiler.h>
 #include <linux/llist.h>
+#include <linux/list_sort.h>
 #include <linux/bitops.h>
 #include <linux/rbtree_augmented.h>
 #include <linux/overflow.h>
@@ -318,6 +319,61 @@ int map_kernel_range_noflush(unsigned long addr, unsigned long size,
 	return 0;
 }
 
+static bool vmap_pmd_supported(void)
+{
+#ifdef CONFIG_HAVE_ARCH_HUGE_VMAP
+	return arch_ioremap_pmd_supported();
+#else
+	return false;
+#endif
+}
+
+/*
+ * Map @pages, which come in physically contiguous and aligned runs of
+ * PMD_SIZE, with one PMD entry per run. @addr and @size are PMD aligned.
+ */
+static int vmap_pmd_range_noflush(unsigned long addr, unsigned long size,
+				  pgprot_t prot, struct page **pages)
+{
+	unsigned long start = addr, end = addr + size;
+	pgtbl_mod_mask mask = 0;
+	unsigned int nr = 0;
+	int err = 0;
+
+	for (; addr != end; addr += PMD_SIZE, nr += PMD_SIZE >> PAGE_SHIFT) {
+		pgd_t *pgd = pgd_offset_k(addr);
+		p4d_t *p4d;
+		pud_t *pud;
+		pmd_t *pmd;
+
+		p4d = p4d_alloc_track(&init_mm, pgd, addr, &mask);
+		pud = p4d ? pud_alloc_track(&init_mm, p4d, addr, &mask) : NULL;
+		pmd = pud ? pmd_alloc_track(&init_mm, pud, addr, &mask) : NULL;
+		if (!pmd) {
+			err = -ENOMEM;
+			break;
+		}
+
+		/* an earlier small mapping may have left a page table */
+		if (pmd_present(*pmd) && !pmd_free_pte_page(pmd, addr)) {
+			err = -EBUSY;
+			break;
+		}
+		if (!pmd_set_huge(pmd, page_to_phys(pages[nr]), prot)) {
+			err = -EINVAL;
+			break;
+		}
+		mask |= PGTBL_PMD_MODIFIED;
+	}
+
+	if (mask & ARCH_PAGE_TABLE_SYNC_MASK)
+		arch_sync_kernel_mappings(start, end);
+
+	if (err && addr != start)
+		unmap_kernel_range_noflush(start, addr - start);
+	return err;
+}
+
 int map_kernel_range(unsigned long start, unsigned long size, pgprot_t prot,
 		struct page **pages)
 {
@@ -382,6 +438,9 @@ struct page *vmalloc_to_page(const void *vmalloc_addr)
 	if (pud_none(*pud) || pud_bad(*pud))
 		return NULL;
 	pmd = pmd_offset(pud, addr);
+	/* vmalloc_huge() areas are backed by split pages, see there */
+	if (pmd_leaf(*pmd))
+		return pmd_page(*pmd) + ((addr & ~PMD_MASK) >> PAGE_SHIFT);
 	WARN_ON_ONCE(pmd_bad(*pmd));
 	if (pmd_none(*pmd) || pmd_bad(*pmd))
 		return NULL;
@@ -1304,6 +1363,36 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_long_t vmap_lazy_nr = ATOMIC_LONG_INIT(0);
 
+/*
+ * Lazily freed areas are batched per cpu first, and only published to the
+ * global vmap_purge_list once VMAP_LAZY_BATCH pages worth gathered, so that
+ * frequent small vunmaps from many cpus do not all bounce the same list
+ * head. They are accounted in vmap_lazy_nr right away, so the purge
+ * threshold sees every cpu's batch. A purge publishes all batches first.
+ */
+#define VMAP_LAZY_BATCH		(SZ_1M >> PAGE_SHIFT)
+
+struct vmap_lazy_pcp {
+	struct llist_head list;
+	atomic_long_t nr;
+};
+static DEFINE_PER_CPU(struct vmap_lazy_pcp, vmap_lazy_pcp);
+
+/*
+ * The purge flushes lazily freed areas as up to VMAP_PURGE_RANGES ranges,
+ * merging areas less than VMAP_PURGE_GAP apart, as long as the ranges
+ * cover at most VMAP_PURGE_SPLIT_PAGES. Otherwise it flushes their span.
+ */
+#define VMAP_PURGE_RANGES	8
+#define VMAP_PURGE_GAP		(32 * PAGE_SIZE)
+#define VMAP_PURGE_SPLIT_PAGES	512
+
+/* Purge statistics for /proc/vmallocinfo, under vmap_purge_lock */
+static unsigned long vmap_nr_purges;
+static unsigned long vmap_nr_purged_areas;
+static unsigned long vmap_nr_flushes;
+static unsigned long vmap_flushed_bytes;
+
 /*
  * Serialize vmap purging.  There is no actual criticial section protected
  * by this look, but we want to avoid concurrent calls for performance
@@ -1323,6 +1412,98 @@ void set_iounmap_nonlazy(void)
 	atomic_long_set(&vmap_lazy_nr, lazy_max_pages()+1);
 }
 
+/* Move the areas batched on @pcp to the global purge list */
+static void vmap_lazy_publish(struct vmap_lazy_pcp *pcp)
+{
+	struct llist_node *first, *last = NULL;
+	struct vmap_area *va;
+	unsigned long nr = 0;
+
+	first = llist_del_all(&pcp->list);
+	if (!first)
+		return;
+
+	llist_for_each_entry(va, first, purge_list) {
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		last = &va->purge_list;
+	}
+
+	atomic_long_sub(nr, &pcp->nr);
+	llist_add_batch(first, last, &vmap_purge_list);
+}
+
+static int vmap_area_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct vmap_area *va_a = list_entry(a, struct vmap_area, list);
+	struct vmap_area *va_b = list_entry(b, struct vmap_area, list);
+
+	return va_a->va_start < va_b->va_start ? -1 : 1;
+}
+
+/*
+ * Flush the TLB for the lazily freed areas on @valist, plus [start, end)
+ * if that is not empty. The areas are sorted through their ->list, which
+ * is unused until they get back into the free tree.
+ */
+static void vmap_purge_flush(struct llist_node *valist, unsigned long start,
+			     unsigned long end)
+{
+	struct {
+		unsigned long start;
+		unsigned long end;
+	} ranges[VMAP_PURGE_RANGES];
+	bool split = start >= end;
+	unsigned long pages = 0;
+	struct vmap_area *va;
+	LIST_HEAD(sorted);
+	int i, nr = 0;
+
+	llist_for_each_entry(va, valist, purge_list) {
+		if (va->va_start < start)
+			start = va->va_start;
+		if (va->va_end > end)
+			end = va->va_end;
+		list_add_tail(&va->list, &sorted);
+	}
+
+	if (split) {
+		list_sort(NULL, &sorted, vmap_area_cmp);
+		list_for_each_entry(va, &sorted, list) {
+			if (nr && va->va_start <=
+				  ranges[nr - 1].end + VMAP_PURGE_GAP) {
+				ranges[nr - 1].end = max(ranges[nr - 1].end,
+							 va->va_end);
+				continue;
+			}
+			if (nr == VMAP_PURGE_RANGES) {
+				split = false;
+				break;
+			}
+			ranges[nr].start = va->va_start;
+			ranges[nr].end = va->va_end;
+			nr++;
+		}
+	}
+
+	for (i = 0; split && i < nr; i++)
+		pages += (ranges[i].end - ranges[i].start) >> PAGE_SHIFT;
+	if (pages > VMAP_PURGE_SPLIT_PAGES)
+		split = false;
+
+	if (!split) {
+		flush_tlb_kernel_range(start, end);
+		vmap_nr_flushes++;
+		vmap_flushed_bytes += end - start;
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		flush_tlb_kernel_range(ranges[i].start, ranges[i].end);
+		vmap_flushed_bytes += ranges[i].end - ranges[i].start;
+	}
+	vmap_nr_flushes += nr;
+}
+
 /*
  * Purges all lazily-freed vmap areas.
  */
@@ -1332,25 +1513,19 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 	struct llist_node *valist;
 	struct vmap_area *va;
 	struct vmap_area *n_va;
+	int cpu;
 
 	lockdep_assert_held(&vmap_purge_lock);
 
+	for_each_possible_cpu(cpu)
+		vmap_lazy_publish(per_cpu_ptr(&vmap_lazy_pcp, cpu));
+
 	valist = llist_del_all(&vmap_purge_list);
 	if (unlikely(valist == NULL))
 		return false;
 
-	/*
-	 * TODO: to calculate a flush range without looping.
-	 * The list can be up to lazy_max_pages() elements.
-	 */
-	llist_for_each_entry(va, valist, purge_list) {
-		if (va->va_start < start)
-			start = va->va_start;
-		if (va->va_end > end)
-			end = va->va_end;
-	}
-
-	flush_tlb_kernel_range(start, end);
+	vmap_purge_flush(valist, start, end);
+	vmap_nr_purges++;
 	resched_threshold = lazy_max_pages() << 1;
 
 	spin_lock(&free_vmap_area_lock);
@@ -1364,6 +1539,7 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 		 * detached and there is no need to "unlink" it from
 		 * anything.
 		 */
+		vmap_nr_purged_areas++;
 		va = merge_or_add_vmap_area(va, &free_vmap_area_root,
 					    &free_vmap_area_list);
 
@@ -1413,17 +1589,23 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	unsigned long nr = (va->va_end - va->va_start) >> PAGE_SHIFT;
 	unsigned long nr_lazy;
+	struct vmap_lazy_pcp *pcp;
 
 	spin_lock(&vmap_area_lock);
 	unlink_va(va, &vmap_area_root);
 	spin_unlock(&vmap_area_lock);
 
-	nr_lazy = atomic_long_add_return((va->va_end - va->va_start) >>
-				PAGE_SHIFT, &vmap_lazy_nr);
+	/* any cpu's batch will do, a migration in between is harmless */
+	pcp = raw_cpu_ptr(&vmap_lazy_pcp);
 
 	/* After this point, we may free va at any time */
-	llist_add(&va->purge_list, &vmap_purge_list);
+	nr_lazy = atomic_long_add_return(nr, &vmap_lazy_nr);
+	llist_add(&va->purge_list, &pcp->list);
+
+	if (atomic_long_add_return(nr, &pcp->nr) >= VMAP_LAZY_BATCH)
+		vmap_lazy_publish(pcp);
 
 	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
@@ -2463,6 +2645,39 @@ void *vmap_pfn(unsigned long *pfns, unsigned int count, pgprot_t prot)
 EXPORT_SYMBOL_GPL(vmap_pfn);
 #endif /* CONFIG_VMAP_PFN */
 
+/*
+ * Back a VM_HUGE_VMAP area with PMD sized runs of pages. The runs are split
+ * into order-0 pages, so that the area can be freed and looked up page by
+ * page like any other.
+ */
+static bool vmalloc_alloc_huge(struct vm_struct *area, gfp_t gfp_mask,
+			       int node)
+{
+	unsigned int order = PMD_SHIFT - PAGE_SHIFT;
+	unsigned int i, j;
+
+	for (i = 0; i < area->nr_pages; i += 1U << order) {
+		struct page *page;
+
+		page = alloc_pages_node(node, gfp_mask | __GFP_NORETRY, order);
+		if (!page)
+			goto fail;
+
+		split_page(page, order);
+		for (j = 0; j < (1U << order); j++)
+			area->pages[i + j] = page + j;
+
+		if (gfpflags_allow_blocking(gfp_mask))
+			cond_resched();
+	}
+	return true;
+
+fail:
+	while (i--)
+		__free_page(area->pages[i]);
+	return false;
+}
+
 static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 				 pgprot_t prot, int node)
 {
@@ -2492,6 +2707,23 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	area->pages = pages;
 	area->nr_pages = nr_pages;
 
+	if (area->flags & VM_HUGE_VMAP) {
+		if (vmalloc_alloc_huge(area, gfp_mask, node)) {
+			atomic_long_add(area->nr_pages, &nr_vmalloc_pages);
+			if (!vmap_pmd_range_noflush((unsigned long)area->addr,
+						    get_vm_area_size(area),
+						    prot, pages)) {
+				flush_cache_vmap((unsigned long)area->addr,
+					(unsigned long)area->addr +
+					get_vm_area_size(area));
+				return area->addr;
+			}
+			area->flags &= ~VM_HUGE_VMAP;
+			goto map;
+		}
+		area->flags &= ~VM_HUGE_VMAP;
+	}
+
 	for (i = 0; i < area->nr_pages; i++) {
 		struct page *page;
 
@@ -2512,6 +2744,7 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	}
 	atomic_long_add(area->nr_pages, &nr_vmalloc_pages);
 
+map:
 	if (map_kernel_range((unsigned long)area->addr, get_vm_area_size(area),
 			prot, pages) < 0)
 		goto fail;
@@ -2557,6 +2790,14 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	if (!size || (size >> PAGE_SHIFT) > totalram_pages())
 		goto fail;
 
+	if ((vm_flags & VM_HUGE_VMAP) && size >= PMD_SIZE &&
+	    vmap_pmd_supported()) {
+		size = real_size = ALIGN(size, PMD_SIZE);
+		align = max_t(unsigned long, align, PMD_SIZE);
+	} else {
+		vm_flags &= ~VM_HUGE_VMAP;
+	}
+
 	area = __get_vm_area_node(real_size, align, VM_ALLOC | VM_UNINITIALIZED |
 				vm_flags, start, end, node, gfp_mask, caller);
 	if (!area)
@@ -2681,6 +2922,27 @@ void *vmalloc_user(unsigned long size)
 }
 EXPORT_SYMBOL(vmalloc_user);
 
+/**
+ * vmalloc_huge - allocate virtually contiguous memory, mapped with PMDs
+ * @size:	  allocation size
+ * @gfp_mask:	  flags for the page level allocator
+ *
+ * Like __vmalloc(), but allocations of at least PMD_SIZE are rounded up to
+ * whole PMDs and, where the architecture and the page allocator allow,
+ * backed by PMD sized pages mapped with PMD entries. This saves TLB
+ * entries for large buffers that are accessed all over. The memory must
+ * not have its permissions changed with set_memory_*().
+ *
+ * Return: pointer to the allocated memory or %NULL on error
+ */
+void *vmalloc_huge(unsigned long size, gfp_t gfp_mask)
+{
+	return __vmalloc_node_range(size, 1, VMALLOC_START, VMALLOC_END,
+				    gfp_mask, PAGE_KERNEL, VM_HUGE_VMAP,
+				    NUMA_NO_NODE, __builtin_return_address(0));
+}
+EXPORT_SYMBOL_GPL(vmalloc_huge);
+
 /**
  * vmalloc_node - allocate memory on a specific node
  * @size:	  allocation size
@@ -3492,14 +3754,16 @@ static void show_purge_info(struct seq_file *m)
 	struct vmap_area *va;
 
 	head = READ_ONCE(vmap_purge_list.first);
-	if (head == NULL)
-		return;
-
 	llist_for_each_entry(va, head, purge_list) {
 		seq_printf(m, "0x%pK-0x%pK %7ld unpurged vm_area\n",
 			(void *)va->va_start, (void *)va->va_end,
 			va->va_end - va->va_start);
 	}
+
+	seq_printf(m, "purges=%lu purged_areas=%lu flushes=%lu flushed_bytes=%lu lazy_pages=%ld\n",
+		   READ_ONCE(vmap_nr_purges), READ_ONCE(vmap_nr_purged_areas),
+		   READ_ONCE(vmap_nr_flushes), READ_ONCE(vmap_flushed_bytes),
+		   atomic_long_read(&vmap_lazy_nr));
 }
 
 static int s_show(struct seq_file *m, void *p)
@@ -3550,6 +3814,9 @@ static int s_show(struct seq_file *m, void *p)
 	if (v->flags & VM_DMA_COHERENT)
 		seq_puts(m, " dma-coherent");
 
+	if (v->flags & VM_HUGE_VMAP)
+		seq_puts(m, " huge");
+
 	if (is_vmalloc_addr(v->pages))
 		seq_puts(m, " vpages");
 
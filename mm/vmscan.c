@@ -51,6 +51,7 @@
 #include <linux/printk.h>
 #include <linux/dax.h>
 #include <linux/psi.h>
+#include <linux/page_idle.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -2082,6 +2083,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	unsigned nr_rotated = 0;
 	int file = is_file_lru(lru);
 	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	bool pt_aging = pt_aging_ready(current_is_kswapd());
 
 	lru_add_drain();
 
@@ -2116,8 +2118,22 @@ static void shrink_active_list(unsigned long nr_to_scan,
 			}
 		}
 
-		if (page_referenced(page, 0, sc->target_mem_cgroup,
-				    &vm_flags)) {
+		/*
+		 * The page table walk of pt_aging_ready() already cleared
+		 * PG_idle of the pages it found accessed: keep what was used
+		 * since the last scan active, whatever kind of page it is,
+		 * and mark it idle for the next one. PG_young is left for
+		 * page_referenced() to find when the page is evicted.
+		 */
+		if (pt_aging) {
+			if (!page_is_idle(page)) {
+				set_page_idle(page);
+				nr_rotated += thp_nr_pages(page);
+				list_add(&page->lru, &l_active);
+				continue;
+			}
+		} else if (page_referenced(page, 0, sc->target_mem_cgroup,
+					   &vm_flags)) {
 			/*
 			 * Identify referenced, file-backed active pages and
 			 * give them one more trip around the active list. So
@@ -3628,6 +3644,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int highest_zoneidx)
 	__fs_reclaim_acquire();
 
 	count_vm_event(PAGEOUTRUN);
+	oom_refresh_candidates();
 
 	/*
 	 * Account for the reclaim boost. Note that the zone boost is left in
@@ -1233,6 +1233,8 @@ const char * const vmstat_text[] = {
 	"pgactivate",
 	"pgdeactivate",
 	"pglazyfree",
+	"zone_lock_alloc",
+	"zone_lock_free",
 
 	"pgfault",
 	"pgmajfault",
@@ -1290,6 +1292,8 @@ const char * const vmstat_text[] = {
 	"compact_daemon_wake",
 	"compact_daemon_migrate_scanned",
 	"compact_daemon_free_scanned",
+	"compact_demand_run",
+	"compact_demand_success",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
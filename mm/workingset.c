@@ -349,6 +349,7 @@ void workingset_refault(struct page *page, void *shadow)
 	lruvec = mem_cgroup_lruvec(memcg, pgdat);
 
 	inc_lruvec_state(lruvec, WORKINGSET_REFAULT_BASE + file);
+	mem_cgroup_note_refault(memcg, file, refault_distance);
 
 	/*
 	 * Compare the distance to the existing workingset size. We
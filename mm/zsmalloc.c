@@ -33,6 +33,7 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/magic.h>
 #include <linux/bitops.h>
 #include <linux/errno.h>
@@ -211,6 +212,44 @@ struct size_class {
 
 	unsigned int index;
 	struct zs_size_stat stats;
+#ifdef CONFIG_ZSMALLOC_STAT
+	/* contended acquisitions of @lock and the time spent waiting */
+	unsigned long lock_contended;
+	u64 lock_wait_ns;
+#endif
+};
+
+static inline void zs_class_lock(struct size_class *class)
+{
+#ifdef CONFIG_ZSMALLOC_STAT
+	u64 start;
+
+	if (spin_trylock(&class->lock))
+		return;
+
+	start = local_clock();
+	spin_lock(&class->lock);
+	class->lock_contended++;
+	class->lock_wait_ns += local_clock() - start;
+#else
+	spin_lock(&class->lock);
+#endif
+}
+
+/*
+ * Every CPU keeps up to ZS_PCP_OBJS objects per size class that are fully
+ * allocated and recorded in their handle, but not handed out yet. zs_malloc()
+ * pops one without touching the class lock, and refills the cache with a
+ * batch of objects under a single acquisition of it. Cached objects are
+ * ordinary allocated objects to migration and compaction; zs_compact()
+ * returns them first so that they do not keep zspages alive.
+ */
+#define ZS_PCP_OBJS	4
+
+struct zs_pcp_cache {
+	spinlock_t lock;
+	unsigned char nr[ZS_SIZE_CLASSES];
+	unsigned long handles[ZS_SIZE_CLASSES][ZS_PCP_OBJS];
 };
 
 /* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
@@ -263,6 +302,8 @@ struct zs_pool {
 	/* Compact classes */
 	struct shrinker shrinker;
 
+	struct zs_pcp_cache __percpu *pcp;
+
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
 #endif
@@ -594,11 +635,14 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 	unsigned long total_class_almost_full = 0, total_class_almost_empty = 0;
 	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
 	unsigned long total_freeable = 0;
+	unsigned long lock_contended, total_lock_contended = 0;
+	u64 lock_wait_ns, total_lock_wait_ns = 0;
 
-	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s\n",
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %8s %14s %12s\n",
 			"class", "size", "almost_full", "almost_empty",
 			"obj_allocated", "obj_used", "pages_used",
-			"pages_per_zspage", "freeable");
+			"pages_per_zspage", "freeable", "lock_contended",
+			"lock_wait_us");
 
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		class = pool->size_class[i];
@@ -606,12 +650,14 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		if (class->index != i)
 			continue;
 
-		spin_lock(&class->lock);
+		zs_class_lock(class);
 		class_almost_full = zs_stat_get(class, CLASS_ALMOST_FULL);
 		class_almost_empty = zs_stat_get(class, CLASS_ALMOST_EMPTY);
 		obj_allocated = zs_stat_get(class, OBJ_ALLOCATED);
 		obj_used = zs_stat_get(class, OBJ_USED);
 		freeable = zs_can_compact(class);
+		lock_contended = class->lock_contended;
+		lock_wait_ns = class->lock_wait_ns;
 		spin_unlock(&class->lock);
 
 		objs_per_zspage = class->objs_per_zspage;
@@ -619,10 +665,11 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 				class->pages_per_zspage;
 
 		seq_printf(s, " %5u %5u %11lu %12lu %13lu"
-				" %10lu %10lu %16d %8lu\n",
+				" %10lu %10lu %16d %8lu %14lu %12llu\n",
 			i, class->size, class_almost_full, class_almost_empty,
 			obj_allocated, obj_used, pages_used,
-			class->pages_per_zspage, freeable);
+			class->pages_per_zspage, freeable, lock_contended,
+			div_u64(lock_wait_ns, NSEC_PER_USEC));
 
 		total_class_almost_full += class_almost_full;
 		total_class_almost_empty += class_almost_empty;
@@ -630,13 +677,17 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		total_used_objs += obj_used;
 		total_pages += pages_used;
 		total_freeable += freeable;
+		total_lock_contended += lock_contended;
+		total_lock_wait_ns += lock_wait_ns;
 	}
 
 	seq_puts(s, "\n");
-	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu\n",
+	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %8lu %14lu %12llu\n",
 			"Total", "", total_class_almost_full,
 			total_class_almost_empty, total_objs,
-			total_used_objs, total_pages, "", total_freeable);
+			total_used_objs, total_pages, "", total_freeable,
+			total_lock_contended,
+			div_u64(total_lock_wait_ns, NSEC_PER_USEC));
 
 	return 0;
 }
@@ -1400,6 +1451,95 @@ static unsigned long obj_malloc(struct size_class *class,
 }
 
 
+static unsigned long zs_pcp_pop(struct zs_pool *pool, struct size_class *class)
+{
+	struct zs_pcp_cache *pcp = raw_cpu_ptr(pool->pcp);
+	unsigned long handle = 0;
+
+	spin_lock(&pcp->lock);
+	if (pcp->nr[class->index])
+		handle = pcp->handles[class->index][--pcp->nr[class->index]];
+	spin_unlock(&pcp->lock);
+
+	return handle;
+}
+
+/*
+ * Allocate a batch of objects from the zspages @class already has, under a
+ * single acquisition of the class lock. One of them is returned, the rest
+ * go to the per-CPU cache. Returns 0 if the class has no free object, the
+ * caller then allocates a new zspage the usual way.
+ */
+static unsigned long zs_pcp_refill(struct zs_pool *pool,
+				   struct size_class *class, gfp_t gfp)
+{
+	unsigned long handles[ZS_PCP_OBJS];
+	struct zs_pcp_cache *pcp;
+	struct zspage *zspage;
+	int nr, got = 0;
+
+	for (nr = 0; nr < ZS_PCP_OBJS; nr++) {
+		handles[nr] = cache_alloc_handle(pool, gfp);
+		if (!handles[nr])
+			break;
+	}
+	if (!nr)
+		return 0;
+
+	zs_class_lock(class);
+	while (got < nr && (zspage = find_get_zspage(class))) {
+		unsigned long obj = obj_malloc(class, zspage, handles[got]);
+
+		fix_fullness_group(class, zspage);
+		record_obj(handles[got], obj);
+		got++;
+	}
+	spin_unlock(&class->lock);
+
+	while (nr > got)
+		cache_free_handle(pool, handles[--nr]);
+	if (!got)
+		return 0;
+
+	pcp = raw_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	while (got > 1 && pcp->nr[class->index] < ZS_PCP_OBJS)
+		pcp->handles[class->index][pcp->nr[class->index]++] =
+			handles[--got];
+	spin_unlock(&pcp->lock);
+
+	/* someone else filled the cache meanwhile */
+	while (got > 1)
+		zs_free(pool, handles[--got]);
+
+	return handles[0];
+}
+
+/* Give all the per-CPU cached objects back to their zspages */
+static void zs_pcp_drain(struct zs_pool *pool)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_pcp_cache *pcp = per_cpu_ptr(pool->pcp, cpu);
+		int i;
+
+		for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+			unsigned long handles[ZS_PCP_OBJS];
+			int nr;
+
+			spin_lock(&pcp->lock);
+			nr = pcp->nr[i];
+			memcpy(handles, pcp->handles[i], nr * sizeof(handles[0]));
+			pcp->nr[i] = 0;
+			spin_unlock(&pcp->lock);
+
+			while (nr)
+				zs_free(pool, handles[--nr]);
+		}
+	}
+}
+
 /**
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
@@ -1420,15 +1560,23 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
+	/* extra space in chunk to keep the handle */
+	class = pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	/* huge objects take a whole zspage each, never cache those */
+	if (class->objs_per_zspage > 1) {
+		handle = zs_pcp_pop(pool, class);
+		if (!handle)
+			handle = zs_pcp_refill(pool, class, gfp);
+		if (handle)
+			return handle;
+	}
+
 	handle = cache_alloc_handle(pool, gfp);
 	if (!handle)
 		return 0;
 
-	/* extra space in chunk to keep the handle */
-	size += ZS_HANDLE_SIZE;
-	class = pool->size_class[get_size_class_index(size)];
-
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	zspage = find_get_zspage(class);
 	if (likely(zspage)) {
 		obj = obj_malloc(class, zspage, handle);
@@ -1448,7 +1596,7 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 		return 0;
 	}
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	obj = obj_malloc(class, zspage, handle);
 	newfg = get_fullness_group(class, zspage);
 	insert_zspage(class, zspage, newfg);
@@ -1515,7 +1663,7 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	get_zspage_mapping(zspage, &class_idx, &fullness);
 	class = pool->size_class[class_idx];
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	obj_free(class, obj);
 	fullness = fix_fullness_group(class, zspage);
 	if (fullness != ZS_EMPTY) {
@@ -1654,9 +1802,17 @@ static int migrate_zspage(struct zs_pool *pool, struct size_class *class,
 	struct page *s_page = cc->s_page;
 	struct page *d_page = cc->d_page;
 	int obj_idx = cc->obj_idx;
+	int nr_moved = 0;
 	int ret = 0;
 
 	while (1) {
+		/* let allocations and frees in, compaction picks up later */
+		if (nr_moved && (need_resched() ||
+				 spin_needbreak(&class->lock))) {
+			ret = -EAGAIN;
+			break;
+		}
+
 		handle = find_alloced_obj(class, s_page, &obj_idx);
 		if (!handle) {
 			s_page = get_next_page(s_page);
@@ -1687,6 +1843,7 @@ static int migrate_zspage(struct zs_pool *pool, struct size_class *class,
 		record_obj(handle, free_obj);
 		unpin_tag(handle);
 		obj_free(class, used_obj);
+		nr_moved++;
 	}
 
 	/* Remember last position in this iteration */
@@ -1894,7 +2051,7 @@ static bool zs_page_isolate(struct page *page, isolate_mode_t mode)
 	pool = mapping->private_data;
 	class = pool->size_class[class_idx];
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	if (get_zspage_inuse(zspage) == 0) {
 		spin_unlock(&class->lock);
 		return false;
@@ -1958,7 +2115,7 @@ static int zs_page_migrate(struct address_space *mapping, struct page *newpage,
 	class = pool->size_class[class_idx];
 	offset = get_first_obj_offset(page);
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	if (!get_zspage_inuse(zspage)) {
 		/*
 		 * Set "offset" to end of the page so that every loops
@@ -2069,7 +2226,7 @@ static void zs_page_putback(struct page *page)
 	pool = mapping->private_data;
 	class = pool->size_class[class_idx];
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	dec_zspage_isolation(zspage);
 	if (!is_zspage_isolated(zspage)) {
 		/*
@@ -2155,7 +2312,7 @@ static void async_free_zspage(struct work_struct *work)
 		if (class->index != i)
 			continue;
 
-		spin_lock(&class->lock);
+		zs_class_lock(class);
 		list_splice_init(&class->fullness_list[ZS_EMPTY], &free_pages);
 		spin_unlock(&class->lock);
 	}
@@ -2168,7 +2325,7 @@ static void async_free_zspage(struct work_struct *work)
 		get_zspage_mapping(zspage, &class_idx, &fullness);
 		VM_BUG_ON(fullness != ZS_EMPTY);
 		class = pool->size_class[class_idx];
-		spin_lock(&class->lock);
+		zs_class_lock(class);
 		__free_zspage(pool, pool->size_class[class_idx], zspage);
 		spin_unlock(&class->lock);
 	}
@@ -2216,18 +2373,26 @@ static unsigned long zs_can_compact(struct size_class *class)
 	return obj_wasted * class->pages_per_zspage;
 }
 
+/*
+ * Compact @class until @budget pages were freed. The class lock is dropped
+ * between source zspages, and also within one as soon as someone else wants
+ * the lock, so that zs_malloc() and zs_free() are never held off for the
+ * migration of a whole zspage.
+ */
 static unsigned long __zs_compact(struct zs_pool *pool,
-				  struct size_class *class)
+				  struct size_class *class,
+				  unsigned long budget)
 {
 	struct zs_compact_control cc;
 	struct zspage *src_zspage;
 	struct zspage *dst_zspage = NULL;
 	unsigned long pages_freed = 0;
+	int ret;
 
-	spin_lock(&class->lock);
+	zs_class_lock(class);
 	while ((src_zspage = isolate_zspage(class, true))) {
 
-		if (!zs_can_compact(class))
+		if (!zs_can_compact(class) || pages_freed >= budget)
 			break;
 
 		cc.obj_idx = 0;
@@ -2239,7 +2404,8 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 			 * If there is no more space in dst_page, resched
 			 * and see if anyone had allocated another zspage.
 			 */
-			if (!migrate_zspage(pool, class, &cc))
+			ret = migrate_zspage(pool, class, &cc);
+			if (!ret || ret == -EAGAIN)
 				break;
 
 			putback_zspage(class, dst_zspage);
@@ -2256,7 +2422,7 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 		}
 		spin_unlock(&class->lock);
 		cond_resched();
-		spin_lock(&class->lock);
+		zs_class_lock(class);
 	}
 
 	if (src_zspage)
@@ -2267,24 +2433,32 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 	return pages_freed;
 }
 
-unsigned long zs_compact(struct zs_pool *pool)
+static unsigned long zs_compact_budget(struct zs_pool *pool,
+				       unsigned long budget)
 {
 	int i;
 	struct size_class *class;
 	unsigned long pages_freed = 0;
 
-	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
+	zs_pcp_drain(pool);
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0 && pages_freed < budget; i--) {
 		class = pool->size_class[i];
 		if (!class)
 			continue;
 		if (class->index != i)
 			continue;
-		pages_freed += __zs_compact(pool, class);
+		pages_freed += __zs_compact(pool, class, budget - pages_freed);
 	}
 	atomic_long_add(pages_freed, &pool->stats.pages_compacted);
 
 	return pages_freed;
 }
+
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	return zs_compact_budget(pool, ULONG_MAX);
+}
 EXPORT_SYMBOL_GPL(zs_compact);
 
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
@@ -2303,9 +2477,10 @@ static unsigned long zs_shrinker_scan(struct shrinker *shrinker,
 	/*
 	 * Compact classes and calculate compaction delta.
 	 * Can run concurrently with a manually triggered
-	 * (by user) compaction.
+	 * (by user) compaction. Only compact what was asked
+	 * for, the shrinker calls back for more.
 	 */
-	pages_freed = zs_compact(pool);
+	pages_freed = zs_compact_budget(pool, sc->nr_to_scan);
 
 	return pages_freed ? pages_freed : SHRINK_STOP;
 }
@@ -2380,6 +2555,12 @@ struct zs_pool *zs_create_pool(const char *name)
 	if (create_cache(pool))
 		goto err;
 
+	pool->pcp = alloc_percpu(struct zs_pcp_cache);
+	if (!pool->pcp)
+		goto err;
+	for_each_possible_cpu(i)
+		spin_lock_init(&per_cpu_ptr(pool->pcp, i)->lock);
+
 	/*
 	 * Iterate reversely, because, size of size_class that we want to use
 	 * for merging should be larger or equal to current size.
@@ -2478,6 +2659,10 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+	if (pool->pcp) {
+		zs_pcp_drain(pool);
+		free_percpu(pool->pcp);
+	}
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
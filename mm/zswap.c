@@ -33,6 +33,7 @@
 #include <linux/writeback.h>
 #include <linux/pagemap.h>
 #include <linux/workqueue.h>
+#include <linux/blkdev.h>
 
 /*********************************
 * statistics
@@ -55,10 +56,14 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 static u64 zswap_pool_limit_hit;
 /* Pages written back when pool limit was reached */
 static u64 zswap_written_back_pages;
+/* Pages written back by the idle writeback (included in the above) */
+static u64 zswap_idle_written_back_pages;
 /* Store failed due to a reclaim failure after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
 /* Compressed page was too big for the allocator to (optimally) store */
 static u64 zswap_reject_compress_poor;
+/* Compressed page was above bypass_ratio_percent and went to swap directly */
+static u64 zswap_reject_compress_bypass;
 /* Store failed because underlying allocator could not get memory */
 static u64 zswap_reject_alloc_fail;
 /* Store failed because the entry metadata could not be allocated (rare) */
@@ -123,6 +128,29 @@ static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 		   bool, 0644);
 
+/*
+ * Send pages that compress to more than this percentage of their size
+ * straight to the swap device, 0 disables the bypass
+ */
+static unsigned int zswap_bypass_ratio_percent;
+module_param_named(bypass_ratio_percent, zswap_bypass_ratio_percent,
+		   uint, 0644);
+
+/* Write back entries not loaded for this many seconds, 0 disables */
+static unsigned int zswap_idle_writeback_secs;
+static int zswap_idle_writeback_param_set(const char *,
+					  const struct kernel_param *);
+static struct kernel_param_ops zswap_idle_writeback_param_ops = {
+	.set =		zswap_idle_writeback_param_set,
+	.get =		param_get_uint,
+};
+module_param_cb(idle_writeback_secs, &zswap_idle_writeback_param_ops,
+		&zswap_idle_writeback_secs, 0644);
+
+/* The maximum number of idle entries written back per swap type and pass */
+static unsigned int zswap_writeback_batch = 256;
+module_param_named(writeback_batch, zswap_writeback_batch, uint, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -155,6 +183,8 @@ struct zswap_pool {
  * length - the length in bytes of the compressed page data.  Needed during
  *          decompression. For a same value filled page length is 0.
  * pool - the zswap_pool the entry's data is in
+ * last_access - jiffies of the store or of the last load, whichever is later.
+ *               Protected by the tree lock.
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
  */
@@ -164,6 +194,7 @@ struct zswap_entry {
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
+	unsigned long last_access;
 	union {
 		unsigned long handle;
 		unsigned long value;
@@ -211,6 +242,8 @@ static bool zswap_has_pool;
 		 zpool_get_type((p)->zpool))
 
 static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
+static void zswap_decompress_entry(struct zswap_entry *entry,
+				   struct page *page);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
@@ -298,6 +331,27 @@ static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
 	return NULL;
 }
 
+/* first entry at or after @offset, caller must hold the tree lock */
+static struct zswap_entry *zswap_rb_search_next(struct rb_root *root,
+						pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry, *next = NULL;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset < offset) {
+			node = node->rb_right;
+		} else {
+			next = entry;
+			if (entry->offset == offset)
+				break;
+			node = node->rb_left;
+		}
+	}
+	return next;
+}
+
 /*
  * In the case that a entry with the same offset is found, a pointer to
  * the existing entry is stored in dupentry and the function returns -EEXIST
@@ -868,25 +922,17 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * the swap cache, the compressed version stored by zswap can be
  * freed.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_swpentry(swp_entry_t swpentry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
 	struct zswap_tree *tree;
 	pgoff_t offset;
 	struct zswap_entry *entry;
 	struct page *page;
-	struct crypto_comp *tfm;
-	u8 *src, *dst;
-	unsigned int dlen;
-	int ret;
+	int ret = 0;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
 	tree = zswap_trees[swp_type(swpentry)];
 	offset = swp_offset(swpentry);
 
@@ -896,7 +942,6 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	if (!entry) {
 		/* entry was invalidated */
 		spin_unlock(&tree->lock);
-		zpool_unmap_handle(pool, handle);
 		return 0;
 	}
 	spin_unlock(&tree->lock);
@@ -916,16 +961,7 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
 		/* decompress */
-		dlen = PAGE_SIZE;
-		src = (u8 *)zhdr + sizeof(struct zswap_header);
-		dst = kmap_atomic(page);
-		tfm = *get_cpu_ptr(entry->pool->tfm);
-		ret = crypto_comp_decompress(tfm, src, entry->length,
-					     dst, &dlen);
-		put_cpu_ptr(entry->pool->tfm);
-		kunmap_atomic(dst);
-		BUG_ON(ret);
-		BUG_ON(dlen != PAGE_SIZE);
+		zswap_decompress_entry(entry, page);
 
 		/* page is up to date */
 		SetPageUptodate(page);
@@ -954,7 +990,7 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
-	goto end;
+	return ret;
 
 	/*
 	* if we get here due to ZSWAP_SWAPCACHE_EXIST
@@ -968,8 +1004,119 @@ fail:
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
-end:
+	return ret;
+}
+
+/* zpool evict callback, only used with allocators that store the header */
+static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+{
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
+
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
 	zpool_unmap_handle(pool, handle);
+
+	return zswap_writeback_swpentry(swpentry);
+}
+
+/*********************************
+* idle writeback
+**********************************/
+/* entries written back per plug, and 8 times that scanned per tree lock hold */
+#define ZSWAP_IDLE_CHUNK	64
+
+static void zswap_idle_writeback_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(zswap_idle_work, zswap_idle_writeback_fn);
+/* keeps invalidate_area from freeing a tree under the idle writeback */
+static DEFINE_MUTEX(zswap_idle_lock);
+
+/*
+ * Write back up to @budget compressed entries of swap type @type that were
+ * not loaded since @cutoff. The tree is walked in swap offset order, so the
+ * writes of one chunk land next to each other on the device and merge into
+ * large bios under the plug. Same filled entries cost no pool memory and
+ * are left alone.
+ */
+static unsigned int zswap_writeback_idle(unsigned int type,
+					 unsigned long cutoff,
+					 unsigned int budget)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	pgoff_t offsets[ZSWAP_IDLE_CHUNK];
+	struct zswap_entry *entry;
+	struct blk_plug plug;
+	unsigned int nr, scanned, i, done = 0;
+	pgoff_t next = 0;
+	bool more;
+
+	if (!tree)
+		return 0;
+
+	do {
+		nr = 0;
+		scanned = 0;
+		spin_lock(&tree->lock);
+		entry = zswap_rb_search_next(&tree->rbroot, next);
+		while (entry && nr < min_t(unsigned int, budget - done,
+					   ZSWAP_IDLE_CHUNK) &&
+		       scanned++ < 8 * ZSWAP_IDLE_CHUNK) {
+			if (entry->length &&
+			    time_before(entry->last_access, cutoff))
+				offsets[nr++] = entry->offset;
+			next = entry->offset + 1;
+			entry = rb_entry_safe(rb_next(&entry->rbnode),
+					      struct zswap_entry, rbnode);
+		}
+		more = entry != NULL;
+		spin_unlock(&tree->lock);
+
+		blk_start_plug(&plug);
+		for (i = 0; i < nr; i++) {
+			if (!zswap_writeback_swpentry(swp_entry(type, offsets[i])))
+				done++;
+		}
+		blk_finish_plug(&plug);
+
+		cond_resched();
+	} while (more && done < budget);
+
+	return done;
+}
+
+static void zswap_idle_writeback_fn(struct work_struct *work)
+{
+	unsigned int secs = READ_ONCE(zswap_idle_writeback_secs);
+	unsigned int budget = READ_ONCE(zswap_writeback_batch);
+	unsigned long age = (unsigned long)secs * HZ;
+	unsigned int type;
+
+	if (!secs)
+		return;
+
+	for (type = 0; type < MAX_SWAPFILES && budget; type++) {
+		unsigned int done;
+
+		mutex_lock(&zswap_idle_lock);
+		done = zswap_writeback_idle(type, jiffies - age, budget);
+		mutex_unlock(&zswap_idle_lock);
+		zswap_idle_written_back_pages += done;
+	}
+
+	/* look again when the youngest skipped entries may have gone idle */
+	queue_delayed_work(system_unbound_wq, &zswap_idle_work,
+			   max(age / 2, (unsigned long)HZ));
+}
+
+static int zswap_idle_writeback_param_set(const char *val,
+					  const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	/* init_zswap() starts the worker if the param was set at boot */
+	if (!ret && zswap_init_started && !zswap_init_failed)
+		mod_delayed_work(system_unbound_wq, &zswap_idle_work, 0);
 	return ret;
 }
 
@@ -1085,6 +1232,14 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto put_dstmem;
 	}
 
+	/* leave the pool to pages that actually compress */
+	if (zswap_bypass_ratio_percent &&
+	    dlen > PAGE_SIZE * zswap_bypass_ratio_percent / 100) {
+		zswap_reject_compress_bypass++;
+		ret = -ENOSPC;
+		goto put_dstmem;
+	}
+
 	/* store */
 	hlen = zpool_evictable(entry->pool->zpool) ? sizeof(zhdr) : 0;
 	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
@@ -1111,6 +1266,8 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	entry->length = dlen;
 
 insert_entry:
+	entry->last_access = jiffies;
+
 	/* map */
 	spin_lock(&tree->lock);
 	do {
@@ -1139,38 +1296,22 @@ reject:
 	return ret;
 }
 
-/*
- * returns 0 if the page was successfully decompressed
- * return -1 on entry not found or error
-*/
-static int zswap_frontswap_load(unsigned type, pgoff_t offset,
-				struct page *page)
+/* fills @page with the data of @entry, which the caller holds a ref on */
+static void zswap_decompress_entry(struct zswap_entry *entry,
+				   struct page *page)
 {
-	struct zswap_tree *tree = zswap_trees[type];
-	struct zswap_entry *entry;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
 	unsigned int dlen;
 	int ret;
 
-	/* find */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was written back */
-		spin_unlock(&tree->lock);
-		return -1;
-	}
-	spin_unlock(&tree->lock);
-
 	if (!entry->length) {
 		dst = kmap_atomic(page);
 		zswap_fill_page(dst, entry->value);
 		kunmap_atomic(dst);
-		goto freeentry;
+		return;
 	}
 
-	/* decompress */
 	dlen = PAGE_SIZE;
 	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
 	if (zpool_evictable(entry->pool->zpool))
@@ -1182,8 +1323,32 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	kunmap_atomic(dst);
 	zpool_unmap_handle(entry->pool->zpool, entry->handle);
 	BUG_ON(ret);
+}
+
+/*
+ * returns 0 if the page was successfully decompressed
+ * return -1 on entry not found or error
+*/
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	/* find */
+	spin_lock(&tree->lock);
+	entry = zswap_entry_find_get(&tree->rbroot, offset);
+	if (!entry) {
+		/* entry was written back */
+		spin_unlock(&tree->lock);
+		return -1;
+	}
+	entry->last_access = jiffies;
+	spin_unlock(&tree->lock);
+
+	/* decompress */
+	zswap_decompress_entry(entry, page);
 
-freeentry:
 	spin_lock(&tree->lock);
 	zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
@@ -1191,6 +1356,63 @@ freeentry:
 	return 0;
 }
 
+/*
+ * Swap readahead loads a whole cluster at once: look all the entries up
+ * and drop them again with one tree lock round trip per swap type, instead
+ * of two per page.
+ */
+static void zswap_frontswap_load_batch(swp_entry_t *entries,
+				       struct page **pages, unsigned int nr,
+				       unsigned long *pending)
+{
+	struct zswap_entry *zentries[SWAP_READ_BATCH];
+	struct zswap_tree *tree = NULL;
+	unsigned int i;
+
+	/* find */
+	for_each_set_bit(i, pending, nr) {
+		struct zswap_tree *next = zswap_trees[swp_type(entries[i])];
+
+		if (next != tree) {
+			if (tree)
+				spin_unlock(&tree->lock);
+			tree = next;
+			spin_lock(&tree->lock);
+		}
+		zentries[i] = zswap_entry_find_get(&tree->rbroot,
+						   swp_offset(entries[i]));
+		if (zentries[i])
+			zentries[i]->last_access = jiffies;
+	}
+	if (tree)
+		spin_unlock(&tree->lock);
+
+	/* decompress */
+	for_each_set_bit(i, pending, nr) {
+		if (zentries[i])
+			zswap_decompress_entry(zentries[i], pages[i]);
+	}
+
+	/* drop the references, entries that were written back stay pending */
+	tree = NULL;
+	for_each_set_bit(i, pending, nr) {
+		struct zswap_tree *next = zswap_trees[swp_type(entries[i])];
+
+		if (!zentries[i])
+			continue;
+		if (next != tree) {
+			if (tree)
+				spin_unlock(&tree->lock);
+			tree = next;
+			spin_lock(&tree->lock);
+		}
+		zswap_entry_put(tree, zentries[i]);
+		__clear_bit(i, pending);
+	}
+	if (tree)
+		spin_unlock(&tree->lock);
+}
+
 /* frees an entry in zswap */
 static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
 {
@@ -1225,6 +1447,7 @@ static void zswap_frontswap_invalidate_area(unsigned type)
 		return;
 
 	/* walk the tree and free everything */
+	mutex_lock(&zswap_idle_lock);
 	spin_lock(&tree->lock);
 	rbtree_postorder_for_each_entry_safe(entry, n, &tree->rbroot, rbnode)
 		zswap_free_entry(entry);
@@ -1232,6 +1455,7 @@ static void zswap_frontswap_invalidate_area(unsigned type)
 	spin_unlock(&tree->lock);
 	kfree(tree);
 	zswap_trees[type] = NULL;
+	mutex_unlock(&zswap_idle_lock);
 }
 
 static void zswap_frontswap_init(unsigned type)
@@ -1252,6 +1476,7 @@ static void zswap_frontswap_init(unsigned type)
 static struct frontswap_ops zswap_frontswap_ops = {
 	.store = zswap_frontswap_store,
 	.load = zswap_frontswap_load,
+	.load_batch = zswap_frontswap_load_batch,
 	.invalidate_page = zswap_frontswap_invalidate_page,
 	.invalidate_area = zswap_frontswap_invalidate_area,
 	.init = zswap_frontswap_init
@@ -1282,8 +1507,12 @@ static int __init zswap_debugfs_init(void)
 			   zswap_debugfs_root, &zswap_reject_kmemcache_fail);
 	debugfs_create_u64("reject_compress_poor", 0444,
 			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_compress_bypass", 0444,
+			   zswap_debugfs_root, &zswap_reject_compress_bypass);
 	debugfs_create_u64("written_back_pages", 0444,
 			   zswap_debugfs_root, &zswap_written_back_pages);
+	debugfs_create_u64("idle_written_back_pages", 0444,
+			   zswap_debugfs_root, &zswap_idle_written_back_pages);
 	debugfs_create_u64("duplicate_entry", 0444,
 			   zswap_debugfs_root, &zswap_duplicate_entry);
 	debugfs_create_u64("pool_total_size", 0444,
@@ -1356,6 +1585,8 @@ static int __init init_zswap(void)
 	frontswap_register_ops(&zswap_frontswap_ops);
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
+	if (zswap_idle_writeback_secs)
+		queue_delayed_work(system_unbound_wq, &zswap_idle_work, 0);
 	return 0;
 
 fallback_fail:
@@ -46,6 +46,7 @@ int __get_compat_msghdr(struct msghdr *kmsg,
 
 	kmsg->msg_flags = msg.msg_flags;
 	kmsg->msg_namelen = msg.msg_namelen;
+	kmsg->msg_ubuf = NULL;
 
 	if (!msg.msg_name)
 		kmsg->msg_namelen = 0;
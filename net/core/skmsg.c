@@ -760,7 +760,44 @@ static struct sk_psock *sk_psock_from_strp(struct strparser *strp)
 	return container_of(parser, struct sk_psock, parser);
 }
 
-static void sk_psock_skb_redirect(struct sk_buff *skb)
+/* Receive an skb redirected to the ingress of @psock right away instead of
+ * from the backlog worker, when nothing is queued ahead of it and the
+ * socket is neither owned by a user nor the one the skb is redirected from.
+ * The skb is left alone unless true is returned.
+ *
+ * The caller holds the lock of the socket the skb is redirected from, so
+ * the target's lock is only tried: two sockets redirecting to each other
+ * would otherwise deadlock.
+ */
+static bool sk_psock_skb_ingress_direct(struct sk_psock *psock,
+					struct sock *from, struct sk_buff *skb)
+{
+	struct sock *sk = psock->sk;
+	int ret = -EAGAIN;
+
+	if (sk == from || !tcp_skb_bpf_ingress(skb) ||
+	    !skb_queue_empty(&psock->ingress_skb) ||
+	    atomic_read(&sk->sk_rmem_alloc) + skb->truesize > sk->sk_rcvbuf)
+		return false;
+
+	local_bh_disable();
+	if (!spin_trylock(&sk->sk_lock.slock)) {
+		local_bh_enable();
+		return false;
+	}
+	/* the backlog worker owns the socket while it runs and may have
+	 * a partially processed skb left over
+	 */
+	if (!sock_owned_by_user(sk) && sk->sk_socket &&
+	    skb_queue_empty(&psock->ingress_skb) && !psock->work_state.skb)
+		ret = sk_psock_skb_ingress(psock, skb);
+	bh_unlock_sock(sk);
+	local_bh_enable();
+
+	return ret > 0;
+}
+
+static void sk_psock_skb_redirect(struct sock *from, struct sk_buff *skb)
 {
 	struct sk_psock *psock_other;
 	struct sock *sk_other;
@@ -784,6 +821,9 @@ static void sk_psock_skb_redirect(struct sk_buff *skb)
 		return;
 	}
 
+	if (sk_psock_skb_ingress_direct(psock_other, from, skb))
+		return;
+
 	skb_queue_tail(&psock_other->ingress_skb, skb);
 	schedule_work(&psock_other->work);
 }
@@ -792,7 +832,7 @@ static void sk_psock_tls_verdict_apply(struct sk_buff *skb, struct sock *sk, int
 {
 	switch (verdict) {
 	case __SK_REDIRECT:
-		sk_psock_skb_redirect(skb);
+		sk_psock_skb_redirect(sk, skb);
 		break;
 	case __SK_PASS:
 	case __SK_DROP:
@@ -854,7 +894,7 @@ static void sk_psock_verdict_apply(struct sk_psock *psock,
 		}
 		break;
 	case __SK_REDIRECT:
-		sk_psock_skb_redirect(skb);
+		sk_psock_skb_redirect(psock->sk, skb);
 		break;
 	case __SK_DROP:
 	default:
@@ -23,6 +23,8 @@
 #include <linux/list.h>
 #include <linux/rcupdate.h>
 #include <linux/export.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
 #include <net/ip.h>
 #include <net/route.h>
 #include <net/tcp.h>
@@ -77,6 +79,110 @@ unsigned int fib4_rules_seq_read(struct net *net)
 	return fib_rules_seq_read(net, AF_INET);
 }
 
+/*
+ * Per-CPU cache of __fib_lookup() results.
+ *
+ * Android installs several rules per uid and network, so a lookup that
+ * misses the socket dst walks dozens of rules and tables, for every new
+ * connection and every unconnected sendto(). Successful results are cached
+ * per CPU, keyed by the flow fields that rules and tables look at.
+ *
+ * An entry is used while rt_genid, bumped by rt_cache_flush() after route,
+ * rule and device changes, and fib4_lookup_cache_gen, bumped before a
+ * fib_info or trie leaf is freed, are the values seen when it was filled.
+ * Rules matching on ports or protocol and nexthop objects bypass the cache.
+ */
+#define FIB4_LOOKUP_CACHE_BITS	6
+
+struct fib4_lookup_key {
+	const struct net	*net;
+	__be32			daddr;
+	__be32			saddr;
+	int			oif;
+	int			iif;
+	u32			mark;
+	kuid_t			uid;
+	__be64			tun_id;
+	unsigned int		flags;
+	__u8			tos;
+	__u8			scope;
+	__u8			flowi_flags;
+};
+
+struct fib4_lookup_entry {
+	struct fib4_lookup_key	key;
+	struct fib_result	res;
+	int			rt_genid;
+	int			gen;
+};
+
+struct fib4_lookup_cache {
+	struct fib4_lookup_entry entries[1 << FIB4_LOOKUP_CACHE_BITS];
+};
+
+static DEFINE_PER_CPU(struct fib4_lookup_cache, fib4_lookup_cache);
+atomic_t fib4_lookup_cache_gen;
+
+static void fib4_lookup_key_init(struct fib4_lookup_key *key,
+				 const struct net *net,
+				 const struct flowi4 *flp, unsigned int flags)
+{
+	memset(key, 0, sizeof(*key));
+	key->net = net;
+	key->daddr = flp->daddr;
+	key->saddr = flp->saddr;
+	key->oif = flp->flowi4_oif;
+	key->iif = flp->flowi4_iif;
+	key->mark = flp->flowi4_mark;
+	key->uid = flp->flowi4_uid;
+	key->tun_id = flp->flowi4_tun_key.tun_id;
+	key->flags = flags;
+	key->tos = flp->flowi4_tos;
+	key->scope = flp->flowi4_scope;
+	key->flowi_flags = flp->flowi4_flags;
+}
+
+static struct fib4_lookup_entry *
+fib4_lookup_cache_slot(const struct fib4_lookup_key *key)
+{
+	u32 hash = jhash(key, sizeof(*key), 0);
+
+	return this_cpu_ptr(&fib4_lookup_cache.entries[hash >>
+			    (32 - FIB4_LOOKUP_CACHE_BITS)]);
+}
+
+/* Called under rcu_read_lock() with BHs disabled */
+static bool fib4_lookup_cache_get(struct net *net,
+				  const struct fib4_lookup_key *key,
+				  struct fib_result *res)
+{
+	struct fib4_lookup_entry *e = fib4_lookup_cache_slot(key);
+
+	if (e->rt_genid != rt_genid_ipv4(net) ||
+	    e->gen != atomic_read(&fib4_lookup_cache_gen) ||
+	    memcmp(&e->key, key, sizeof(*key)))
+		return false;
+
+	*res = e->res;
+	return true;
+}
+
+static void fib4_lookup_cache_put(const struct fib4_lookup_key *key,
+				  const struct fib_result *res,
+				  int rt_genid, int gen)
+{
+	struct fib4_lookup_entry *e;
+
+	if (!res->fi || res->fi->nh)
+		return;
+
+	e = fib4_lookup_cache_slot(key);
+	e->key = *key;
+	e->res = *res;
+	e->rt_genid = rt_genid;
+	e->gen = gen;
+}
+
 int __fib_lookup(struct net *net, struct flowi4 *flp,
 		 struct fib_result *res, unsigned int flags)
 {
@@ -84,11 +190,31 @@ int __fib_lookup(struct net *net, struct flowi4 *flp,
 		.result = res,
 		.flags = flags,
 	};
+	struct fib4_lookup_key key;
+	int rt_genid = 0, gen = 0;
+	bool cache;
 	int err;
 
 	/* update flow if oif or iif point to device enslaved to l3mdev */
 	l3mdev_update_flow(net, flowi4_to_flowi(flp));
 
+	cache = !net->ipv4.fib_rules_require_fldissect;
+	if (cache) {
+		fib4_lookup_key_init(&key, net, flp, flags);
+
+		rcu_read_lock_bh();
+		if (fib4_lookup_cache_get(net, &key, res)) {
+			rcu_read_unlock_bh();
+			return 0;
+		}
+		rcu_read_unlock_bh();
+
+		/* the result is only valid for what was seen before it */
+		rt_genid = rt_genid_ipv4(net);
+		gen = atomic_read(&fib4_lookup_cache_gen);
+		smp_rmb();
+	}
+
 	err = fib_rules_lookup(net->ipv4.rules_ops, flowi4_to_flowi(flp), 0, &arg);
 #ifdef CONFIG_IP_ROUTE_CLASSID
 	if (arg.rule)
@@ -100,6 +226,12 @@ int __fib_lookup(struct net *net, struct flowi4 *flp,
 	if (err == -ESRCH)
 		err = -ENETUNREACH;
 
+	if (cache && !err) {
+		local_bh_disable();
+		fib4_lookup_cache_put(&key, res, rt_genid, gen);
+		local_bh_enable();
+	}
+
 	return err;
 }
 EXPORT_SYMBOL_GPL(__fib_lookup);
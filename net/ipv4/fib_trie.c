@@ -314,7 +314,11 @@ static void __node_free_rcu(struct rcu_head *head)
 		kvfree(n);
 }
 
-#define node_free(n) call_rcu(&tn_info(n)->rcu, __node_free_rcu)
+#define node_free(n)						\
+	do {							\
+		fib4_lookup_cache_invalidate();			\
+		call_rcu(&tn_info(n)->rcu, __node_free_rcu);	\
+	} while (0)
 
 static struct tnode *tnode_alloc(int bits)
 {
@@ -1190,7 +1190,7 @@ static int tcp_sendmsg_fastopen(struct sock *sk, struct msghdr *msg,
 int tcp_sendmsg_locked(struct sock *sk, struct msghdr *msg, size_t size)
 {
 	struct tcp_sock *tp = tcp_sk(sk);
-	struct ubuf_info *uarg = NULL;
+	struct ubuf_info *uarg = NULL, *caller_uarg = NULL;
 	struct sk_buff *skb;
 	struct sockcm_cookie sockc;
 	int flags, err, copied = 0;
@@ -1202,7 +1202,15 @@ int tcp_sendmsg_locked(struct sock *sk, struct msghdr *msg, size_t size)
 	trace_android_rvh_tcp_sendmsg_locked(sk, size);
 	flags = msg->msg_flags;
 
-	if (flags & MSG_ZEROCOPY && size && sock_flag(sk, SOCK_ZEROCOPY)) {
+	/* not all in-kernel callers initialize msg_ubuf */
+	if (flags & MSG_UBUF)
+		caller_uarg = msg->msg_ubuf;
+
+	if (flags & MSG_ZEROCOPY && size && caller_uarg) {
+		/* completion owned and referenced by the caller */
+		uarg = caller_uarg;
+		zc = sk->sk_route_caps & NETIF_F_SG;
+	} else if (flags & MSG_ZEROCOPY && size && sock_flag(sk, SOCK_ZEROCOPY)) {
 		skb = tcp_write_queue_tail(sk);
 		uarg = sock_zerocopy_realloc(sk, size, skb_zcopy(skb));
 		if (!uarg) {
@@ -1416,7 +1424,8 @@ out:
 		tcp_push(sk, flags, mss_now, tp->nonagle, size_goal);
 	}
 out_nopush:
-	sock_zerocopy_put(uarg);
+	if (uarg != caller_uarg)
+		sock_zerocopy_put(uarg);
 	return copied + copied_syn;
 
 do_error:
@@ -1427,7 +1436,8 @@ do_fault:
 	if (copied + copied_syn)
 		goto out;
 out_err:
-	sock_zerocopy_put_abort(uarg, true);
+	if (uarg != caller_uarg)
+		sock_zerocopy_put_abort(uarg, true);
 	err = sk_stream_error(sk, flags, err);
 	/* make sure we wake any epoll edge trigger waiter */
 	if (unlikely(tcp_rtx_and_write_queues_empty(sk) && err == -EAGAIN)) {
@@ -1904,6 +1914,72 @@ out:
 	zc->length = length;
 	return ret;
 }
+
+/*
+ * Copy what could not be mapped at the head of the receive queue into the
+ * copy buffer, so that the next call starts mapping at a page boundary
+ * again instead of falling back to recvmsg().
+ */
+static int tcp_zerocopy_copy_tail(struct sock *sk,
+				  struct tcp_zerocopy_receive *zc, u32 len)
+{
+	void __user *ubuf = u64_to_user_ptr(zc->copybuf_address);
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct iov_iter to;
+	struct iovec iov;
+	u32 copied = 0, offset;
+	int err;
+
+	err = import_single_range(READ, ubuf, len, &iov, &to);
+	if (err)
+		return err;
+
+	while (copied < len) {
+		struct sk_buff *skb = tcp_recv_skb(sk, tp->copied_seq, &offset);
+		u32 chunk;
+
+		if (!skb || offset >= skb->len)
+			break;
+		chunk = min_t(u32, skb->len - offset, len - copied);
+		err = skb_copy_datagram_iter(skb, offset, &to, chunk);
+		if (err)
+			break;
+		WRITE_ONCE(tp->copied_seq, tp->copied_seq + chunk);
+		copied += chunk;
+	}
+
+	if (!copied)
+		return err;
+
+	tcp_rcv_space_adjust(sk);
+	tcp_recv_skb(sk, tp->copied_seq, &offset);
+	tcp_cleanup_rbuf(sk, copied);
+	return copied;
+}
+
+static int tcp_zerocopy_receive_copy(struct sock *sk,
+				     struct tcp_zerocopy_receive *zc)
+{
+	int ret, copied = 0;
+
+	if (zc->flags || zc->copybuf_len < 0)
+		return -EINVAL;
+
+	ret = tcp_zerocopy_receive(sk, zc);
+	if (ret || !zc->copybuf_len)
+		return ret;
+
+	/* the bytes right after the mapped ones could not be mapped */
+	if (zc->recv_skip_hint) {
+		copied = tcp_zerocopy_copy_tail(sk, zc,
+						min_t(u32, zc->copybuf_len,
+						      zc->recv_skip_hint));
+		if (copied > 0)
+			zc->recv_skip_hint -= copied;
+	}
+	zc->copybuf_len = copied;
+	return 0;
+}
 #endif
 
 static void tcp_update_recv_tstamps(struct sk_buff *skb,
@@ -3835,7 +3911,7 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 	}
 #ifdef CONFIG_MMU
 	case TCP_ZEROCOPY_RECEIVE: {
-		struct tcp_zerocopy_receive zc;
+		struct tcp_zerocopy_receive zc = {};
 		int err;
 
 		if (get_user(len, optlen))
@@ -3851,11 +3927,13 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 		if (copy_from_user(&zc, optval, len))
 			return -EFAULT;
 		lock_sock(sk);
-		err = tcp_zerocopy_receive(sk, &zc);
+		err = tcp_zerocopy_receive_copy(sk, &zc);
 		release_sock(sk);
 		if (len == sizeof(zc))
 			goto zerocopy_rcv_sk_err;
 		switch (len) {
+		case offsetofend(struct tcp_zerocopy_receive, copybuf_len):
+		case offsetofend(struct tcp_zerocopy_receive, copybuf_address):
 		case offsetofend(struct tcp_zerocopy_receive, err):
 			goto zerocopy_rcv_sk_err;
 		case offsetofend(struct tcp_zerocopy_receive, inq):
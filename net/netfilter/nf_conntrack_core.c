@@ -766,6 +766,79 @@ begin:
 	return NULL;
 }
 
+/*
+ * Per-CPU cache of the last conntracks found for established flows, indexed
+ * by the low bits of the raw tuple hash. Most packets of a busy flow are
+ * looked up on the same CPU, and the cache saves walking a hash chain that
+ * grows with the number of sockets netd tracks.
+ *
+ * Entries are not trusted: a hit is checked like a chain entry, and a
+ * conntrack that is no longer found by its tuple, is dying or expired is a
+ * miss. nf_conntrack_free() clears the entries of a conntrack before it goes
+ * back to the SLAB_TYPESAFE_BY_RCU cache, so an entry never outlives the
+ * memory it points to.
+ */
+#define NF_CT_PCPU_CACHE_BITS	8
+#define NF_CT_PCPU_CACHE_SIZE	(1 << NF_CT_PCPU_CACHE_BITS)
+
+struct nf_ct_pcpu_cache {
+	struct nf_conntrack_tuple_hash *h[NF_CT_PCPU_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct nf_ct_pcpu_cache, nf_ct_pcpu_cache);
+
+static struct nf_conntrack_tuple_hash *
+nf_ct_pcpu_cache_lookup(struct net *net, const struct nf_conntrack_zone *zone,
+			const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct nf_conn *ct;
+
+	h = this_cpu_read(nf_ct_pcpu_cache.h[hash & (NF_CT_PCPU_CACHE_SIZE - 1)]);
+	if (!h)
+		return NULL;
+
+	ct = nf_ct_tuplehash_to_ctrack(h);
+	if (nf_ct_is_expired(ct) || nf_ct_is_dying(ct) ||
+	    !nf_ct_key_equal(h, tuple, zone, net))
+		return NULL;
+
+	return h;
+}
+
+/* Caller holds a reference on the conntrack of @h */
+static void nf_ct_pcpu_cache_fill(struct nf_conntrack_tuple_hash *h, u32 hash)
+{
+	struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+	if (!test_bit(IPS_ASSURED_BIT, &ct->status))
+		return;
+
+	this_cpu_write(nf_ct_pcpu_cache.h[hash & (NF_CT_PCPU_CACHE_SIZE - 1)], h);
+}
+
+static void nf_ct_pcpu_cache_flush(struct nf_conn *ct)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct net *net = nf_ct_net(ct);
+	int cpu, dir;
+
+	/* only confirmed conntracks can be found, hence cached */
+	if (!nf_ct_is_confirmed(ct))
+		return;
+
+	for (dir = 0; dir < IP_CT_DIR_MAX; dir++) {
+		unsigned int idx;
+
+		h = &ct->tuplehash[dir];
+		idx = hash_conntrack_raw(&h->tuple, net) &
+		      (NF_CT_PCPU_CACHE_SIZE - 1);
+		for_each_possible_cpu(cpu)
+			cmpxchg(&per_cpu_ptr(&nf_ct_pcpu_cache, cpu)->h[idx],
+				h, NULL);
+	}
+}
+
 /* Find a connection corresponding to a tuple. */
 static struct nf_conntrack_tuple_hash *
 __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
@@ -776,6 +849,16 @@ __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 
 	rcu_read_lock();
 
+	h = nf_ct_pcpu_cache_lookup(net, zone, tuple, hash);
+	if (h) {
+		ct = nf_ct_tuplehash_to_ctrack(h);
+		if (likely(atomic_inc_not_zero(&ct->ct_general.use))) {
+			if (likely(nf_ct_key_equal(h, tuple, zone, net)))
+				goto found;
+			nf_ct_put(ct);
+		}
+	}
+
 	h = ____nf_conntrack_find(net, zone, tuple, hash);
 	if (h) {
 		/* We have a candidate that matches the tuple we're interested
@@ -783,8 +866,10 @@ __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
 		 */
 		ct = nf_ct_tuplehash_to_ctrack(h);
 		if (likely(atomic_inc_not_zero(&ct->ct_general.use))) {
-			if (likely(nf_ct_key_equal(h, tuple, zone, net)))
+			if (likely(nf_ct_key_equal(h, tuple, zone, net))) {
+				nf_ct_pcpu_cache_fill(h, hash);
 				goto found;
+			}
 
 			/* TYPESAFE_BY_RCU recycled the candidate */
 			nf_ct_put(ct);
@@ -1546,6 +1631,7 @@ void nf_conntrack_free(struct nf_conn *ct)
 	 */
 	WARN_ON(atomic_read(&ct->ct_general.use) != 0);
 
+	nf_ct_pcpu_cache_flush(ct);
 	nf_ct_ext_destroy(ct);
 	kmem_cache_free(nf_conntrack_cachep, ct);
 	smp_mb__before_atomic();
@@ -171,10 +171,34 @@ static unsigned int ipv4_confirm(void *priv,
 			  ct, ctinfo);
 }
 
+/* Traffic with the host over the link-local address of a virtual NIC
+ * never leaves the machine, tracking it only costs a lookup per packet and
+ * a conntrack per connection. Skbs a CT target already gave a template
+ * are left alone.
+ */
+static bool ipv4_conntrack_skip_linklocal(struct sk_buff *skb,
+					  const struct nf_hook_state *state)
+{
+	const struct iphdr *iph = ip_hdr(skb);
+
+	if (!READ_ONCE(state->net->ct.sysctl_skip_linklocal) || skb_nfct(skb))
+		return false;
+
+	if (!ipv4_is_linklocal_169(iph->saddr) &&
+	    !ipv4_is_linklocal_169(iph->daddr))
+		return false;
+
+	nf_ct_set(skb, NULL, IP_CT_UNTRACKED);
+	return true;
+}
+
 static unsigned int ipv4_conntrack_in(void *priv,
 				      struct sk_buff *skb,
 				      const struct nf_hook_state *state)
 {
+	if (ipv4_conntrack_skip_linklocal(skb, state))
+		return NF_ACCEPT;
+
 	return nf_conntrack_in(skb, state);
 }
 
@@ -197,6 +221,9 @@ static unsigned int ipv4_conntrack_local(void *priv,
 		return NF_ACCEPT;
 	}
 
+	if (ipv4_conntrack_skip_linklocal(skb, state))
+		return NF_ACCEPT;
+
 	return nf_conntrack_in(skb, state);
 }
 
@@ -1166,6 +1166,14 @@ struct sock *netlink_getsockbyfilp(struct file *filp)
 	return sock;
 }
 
+/* Dump skbs are kmalloc()ed up to NETLINK_DUMP_KMALLOC_MAX. With
+ * NETLINK_LARGE_DUMP they are vmalloc()ed up to NETLINK_LARGE_DUMP_MAX,
+ * bounded by the receive buffer, so that one recvmsg() returns the
+ * messages of a large dump that would otherwise take dozens of calls.
+ */
+#define NETLINK_DUMP_KMALLOC_MAX	SKB_WITH_OVERHEAD(32768)
+#define NETLINK_LARGE_DUMP_MAX		SKB_WITH_OVERHEAD(1 << 20)
+
 static struct sk_buff *netlink_alloc_large_skb(unsigned int size,
 					       int broadcast)
 {
@@ -1715,6 +1723,13 @@ static int netlink_setsockopt(struct socket *sock, int level, int optname,
 			nlk->flags &= ~NETLINK_F_STRICT_CHK;
 		err = 0;
 		break;
+	case NETLINK_LARGE_DUMP:
+		if (val)
+			nlk->flags |= NETLINK_F_LARGE_DUMP;
+		else
+			nlk->flags &= ~NETLINK_F_LARGE_DUMP;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1817,6 +1832,15 @@ static int netlink_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		err = 0;
 		break;
+	case NETLINK_LARGE_DUMP:
+		if (len < sizeof(int))
+			return -EINVAL;
+		len = sizeof(int);
+		val = nlk->flags & NETLINK_F_LARGE_DUMP ? 1 : 0;
+		if (put_user(len, optlen) || put_user(val, optval))
+			return -EFAULT;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1965,7 +1989,9 @@ static int netlink_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	/* Record the max length of recvmsg() calls for future allocations */
 	nlk->max_recvmsg_len = max(nlk->max_recvmsg_len, len);
 	nlk->max_recvmsg_len = min_t(size_t, nlk->max_recvmsg_len,
-				     SKB_WITH_OVERHEAD(32768));
+				     nlk->flags & NETLINK_F_LARGE_DUMP ?
+				     NETLINK_LARGE_DUMP_MAX :
+				     NETLINK_DUMP_KMALLOC_MAX);
 
 	copied = data_skb->len;
 	if (len < copied) {
@@ -2239,9 +2265,16 @@ static int netlink_dump(struct sock *sk)
 
 	if (alloc_min_size < nlk->max_recvmsg_len) {
 		alloc_size = nlk->max_recvmsg_len;
-		skb = alloc_skb(alloc_size,
-				(GFP_KERNEL & ~__GFP_DIRECT_RECLAIM) |
-				__GFP_NOWARN | __GFP_NORETRY);
+		if (alloc_size > NETLINK_DUMP_KMALLOC_MAX) {
+			alloc_size = max_t(int, alloc_min_size,
+					   min_t(int, alloc_size,
+						 sk->sk_rcvbuf));
+			skb = netlink_alloc_large_skb(alloc_size, 0);
+		} else {
+			skb = alloc_skb(alloc_size,
+					(GFP_KERNEL & ~__GFP_DIRECT_RECLAIM) |
+					__GFP_NOWARN | __GFP_NORETRY);
+		}
 	}
 	if (!skb) {
 		alloc_size = alloc_min_size;
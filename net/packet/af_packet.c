@@ -87,6 +87,7 @@
 #include <net/inet_common.h>
 #endif
 #include <linux/bpf.h>
+#include <net/busy_poll.h>
 #include <net/compat.h>
 
 #include "internal.h"
@@ -939,6 +940,24 @@ static int prb_curr_blk_in_use(struct tpacket_block_desc *pbd)
 	return TP_STATUS_USER & BLOCK_STATUS(pbd);
 }
 
+/*
+ * A busy polling reader spins on poll() for the packets the device was just
+ * polled for. Waiting for the block to fill up or for the retire timer would
+ * defeat the purpose, so hand out a partially filled block right away.
+ * Called with sk_receive_queue.lock held.
+ */
+static void prb_busy_poll_retire(struct packet_sock *po)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	struct tpacket_block_desc *pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+
+	if (prb_queue_frozen(pkc) || !BLOCK_NUM_PKTS(pbd))
+		return;
+
+	prb_retire_current_block(pkc, po, 0);
+	prb_dispatch_next_block(pkc, po);
+}
+
 static int prb_queue_frozen(struct tpacket_kbdq_core *pkc)
 {
 	return pkc->reset_pending_on_curr_blk;
@@ -2107,6 +2126,7 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	res = run_filter(skb, sk, snaplen);
 	if (!res)
 		goto drop_n_restore;
+	sk_mark_napi_id(sk, skb);
 	if (snaplen > res)
 		snaplen = res;
 
@@ -2230,6 +2250,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	if (!res)
 		goto drop_n_restore;
 
+	sk_mark_napi_id(sk, skb);
+
 	/* If we are flooded, just give up */
 	if (__packet_rcv_has_room(po, skb) == ROOM_NONE) {
 		atomic_inc(&po->tp_drops);
@@ -4184,6 +4206,8 @@ static __poll_t packet_poll(struct file *file, struct socket *sock,
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
 	if (po->rx_ring.pg_vec) {
+		if (po->tp_version == TPACKET_V3 && sk_can_busy_loop(sk))
+			prb_busy_poll_retire(po);
 		if (!packet_previous_rx_frame(po, &po->rx_ring,
 			TP_STATUS_KERNEL))
 			mask |= EPOLLIN | EPOLLRDNORM;
@@ -26,6 +26,10 @@
 #include <linux/uaccess.h>
 #include <linux/module.h>
 #include <linux/compat.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/sync_file.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/info.h>
@@ -53,11 +57,47 @@
 
 static DEFINE_MUTEX(device_mutex);
 
+/*
+ * A dma-buf attached with SNDRV_COMPRESS_DMABUF_ATTACH replaces the ring
+ * buffer, the driver finds it in runtime->dma_buffer_p as if it had been
+ * allocated with snd_compr_malloc_pages(). Commits with a fence wait for
+ * it on @commits, and are handed to the driver in order.
+ */
+struct snd_compr_dmabuf_state {
+	struct dma_buf *dmabuf;
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+	struct snd_dma_buffer buffer;
+	struct list_head commits;
+	u64 pending;
+	struct work_struct work;
+};
+
+struct snd_compr_dmabuf_fenced {
+	struct list_head list;
+	struct snd_compr_dmabuf_state *state;
+	struct dma_fence *fence;
+	struct dma_fence_cb cb;
+	u32 bytes;
+};
+
 struct snd_compr_file {
 	unsigned long caps;
 	struct snd_compr_stream stream;
+	struct snd_compr_dmabuf_state dmabuf;
 };
 
+static inline struct snd_compr_file *
+snd_compr_file(struct snd_compr_stream *stream)
+{
+	return container_of(stream, struct snd_compr_file, stream);
+}
+
+static void snd_compr_dmabuf_work(struct work_struct *work);
+static void snd_compr_dmabuf_flush(struct snd_compr_stream *stream);
+static void snd_compr_dmabuf_cancel(struct snd_compr_stream *stream);
+static void snd_compr_dmabuf_detach(struct snd_compr_stream *stream);
+
 static void error_delayed_work(struct work_struct *work);
 
 /*
@@ -118,6 +158,8 @@ static int snd_compr_open(struct inode *inode, struct file *f)
 	}
 
 	INIT_DELAYED_WORK(&data->stream.error_work, error_delayed_work);
+	INIT_LIST_HEAD(&data->dmabuf.commits);
+	INIT_WORK(&data->dmabuf.work, snd_compr_dmabuf_work);
 
 	data->stream.ops = compr->ops;
 	data->stream.direction = dirn;
@@ -161,8 +203,11 @@ static int snd_compr_free(struct inode *inode, struct file *f)
 		break;
 	}
 
+	snd_compr_dmabuf_cancel(&data->stream);
 	data->stream.ops->free(&data->stream);
-	if (!data->stream.runtime->dma_buffer_p)
+	/* the driver may access the buffer until it is freed */
+	snd_compr_dmabuf_detach(&data->stream);
+	if (!data->stream.runtime->dma_buffer_p && !data->dmabuf.dmabuf)
 		kfree(data->stream.runtime->buffer);
 	kfree(data->stream.runtime);
 	kfree(data);
@@ -306,6 +351,12 @@ static ssize_t snd_compr_write(struct file *f, const char __user *buf,
 		return -EBADFD;
 	}
 
+	/* data is committed in place instead */
+	if (data->dmabuf.dmabuf) {
+		mutex_unlock(&stream->device->lock);
+		return -EBUSY;
+	}
+
 	avail = snd_compr_get_avail(stream);
 	pr_debug("avail returned %ld\n", (unsigned long)avail);
 	/* calculate how much we can write to buffer */
@@ -499,6 +550,9 @@ int snd_compr_malloc_pages(struct snd_compr_stream *stream, size_t size)
 
 	if (snd_BUG_ON(!(stream) || !(stream)->runtime))
 		return -EINVAL;
+	/* the attached dma-buf is the buffer */
+	if (snd_compr_file(stream)->dmabuf.dmabuf)
+		return size <= stream->runtime->dma_bytes ? 0 : -ENOMEM;
 	dmab = kzalloc(sizeof(*dmab), GFP_KERNEL);
 	if (!dmab)
 		return -ENOMEM;
@@ -524,7 +578,8 @@ int snd_compr_free_pages(struct snd_compr_stream *stream)
 	runtime = stream->runtime;
 	if (runtime->dma_area == NULL)
 		return 0;
-	if (runtime->dma_buffer_p != &stream->dma_buffer) {
+	if (runtime->dma_buffer_p != &stream->dma_buffer &&
+	    runtime->dma_buffer_p != &snd_compr_file(stream)->dmabuf.buffer) {
 		/* It's a newly allocated buffer. Release it now. */
 		snd_dma_free_pages(runtime->dma_buffer_p);
 		kfree(runtime->dma_buffer_p);
@@ -795,6 +850,7 @@ static int snd_compr_stop(struct snd_compr_stream *stream)
 		stream->partial_drain = false;
 		stream->metadata_set = false;
 		snd_compr_drain_notify(stream);
+		snd_compr_dmabuf_flush(stream);
 		stream->runtime->total_bytes_available = 0;
 		stream->runtime->total_bytes_transferred = 0;
 	}
@@ -963,6 +1019,231 @@ static int snd_compr_partial_drain(struct snd_compr_stream *stream)
 	return snd_compress_wait_for_drain(stream);
 }
 
+/* The data must be accounted before the driver is told about it */
+static void snd_compr_dmabuf_hand_over(struct snd_compr_stream *stream,
+				       u32 bytes)
+{
+	stream->runtime->total_bytes_available += bytes;
+	if (stream->ops->ack)
+		stream->ops->ack(stream, bytes);
+	if (stream->runtime->state == SNDRV_PCM_STATE_SETUP)
+		stream->runtime->state = SNDRV_PCM_STATE_PREPARED;
+}
+
+static void snd_compr_dmabuf_fence_cb(struct dma_fence *fence,
+				      struct dma_fence_cb *cb)
+{
+	struct snd_compr_dmabuf_fenced *c;
+
+	c = container_of(cb, struct snd_compr_dmabuf_fenced, cb);
+	schedule_work(&c->state->work);
+}
+
+static void snd_compr_dmabuf_free_commit(struct snd_compr_dmabuf_state *state,
+					 struct snd_compr_dmabuf_fenced *c)
+{
+	list_del(&c->list);
+	state->pending -= c->bytes;
+	dma_fence_put(c->fence);
+	kfree(c);
+}
+
+static void snd_compr_dmabuf_work(struct work_struct *work)
+{
+	struct snd_compr_file *data = container_of(work, struct snd_compr_file,
+						   dmabuf.work);
+	struct snd_compr_dmabuf_state *state = &data->dmabuf;
+	struct snd_compr_stream *stream = &data->stream;
+	struct snd_compr_dmabuf_fenced *c, *tmp;
+
+	mutex_lock(&stream->device->lock);
+	list_for_each_entry_safe(c, tmp, &state->commits, list) {
+		/*
+		 * Data behind a fence signaled with an error is handed over
+		 * too, the position of all later data depends on it.
+		 */
+		if (c->fence && !dma_fence_is_signaled(c->fence))
+			break;
+		snd_compr_dmabuf_hand_over(stream, c->bytes);
+		snd_compr_dmabuf_free_commit(state, c);
+	}
+	mutex_unlock(&stream->device->lock);
+}
+
+/* Drop the commits still waiting, called with the device lock held */
+static void snd_compr_dmabuf_flush(struct snd_compr_stream *stream)
+{
+	struct snd_compr_dmabuf_state *state = &snd_compr_file(stream)->dmabuf;
+	struct snd_compr_dmabuf_fenced *c, *tmp;
+
+	list_for_each_entry_safe(c, tmp, &state->commits, list) {
+		if (c->fence)
+			dma_fence_remove_callback(c->fence, &c->cb);
+		snd_compr_dmabuf_free_commit(state, c);
+	}
+}
+
+static int
+snd_compr_dmabuf_attach(struct snd_compr_stream *stream, unsigned long arg)
+{
+	struct snd_compr_dmabuf_state *state = &snd_compr_file(stream)->dmabuf;
+	struct dma_buf_attachment *attach;
+	struct snd_compr_dmabuf info;
+	struct dma_buf *dmabuf;
+	struct sg_table *sgt;
+	struct device *dev;
+	void *vaddr;
+	int ret;
+
+	if (copy_from_user(&info, (void __user *)arg, sizeof(info)))
+		return -EFAULT;
+	if (info.reserved)
+		return -EINVAL;
+
+	/* the ring buffer is set up by SNDRV_COMPRESS_SET_PARAMS */
+	if (stream->runtime->state != SNDRV_PCM_STATE_OPEN || state->dmabuf)
+		return -EBADFD;
+	if (stream->direction != SND_COMPRESS_PLAYBACK || stream->ops->copy)
+		return -ENXIO;
+	/* a buffer the driver allocated at open stays in use */
+	if (stream->runtime->dma_buffer_p)
+		return -EBUSY;
+
+	dev = stream->dma_buffer.dev.dev ?: stream->device->card->dev;
+	if (!dev)
+		return -ENODEV;
+
+	dmabuf = dma_buf_get(info.fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	attach = dma_buf_attach(dmabuf, dev);
+	if (IS_ERR(attach)) {
+		ret = PTR_ERR(attach);
+		goto err_put;
+	}
+
+	sgt = dma_buf_map_attachment(attach, DMA_TO_DEVICE);
+	if (IS_ERR(sgt)) {
+		ret = PTR_ERR(sgt);
+		goto err_detach;
+	}
+
+	/* drivers take a single bus address, as from snd_compr_malloc_pages */
+	ret = -EINVAL;
+	if (sgt->nents != 1)
+		goto err_unmap;
+
+	ret = -ENOMEM;
+	vaddr = dma_buf_vmap(dmabuf);
+	if (!vaddr)
+		goto err_unmap;
+
+	state->dmabuf = dmabuf;
+	state->attach = attach;
+	state->sgt = sgt;
+	state->buffer.dev = stream->dma_buffer.dev;
+	state->buffer.area = vaddr;
+	state->buffer.addr = sg_dma_address(sgt->sgl);
+	state->buffer.bytes = dmabuf->size;
+	snd_compr_set_runtime_buffer(stream, &state->buffer);
+	stream->runtime->dma_bytes = dmabuf->size;
+	return 0;
+
+err_unmap:
+	dma_buf_unmap_attachment(attach, sgt, DMA_TO_DEVICE);
+err_detach:
+	dma_buf_detach(dmabuf, attach);
+err_put:
+	dma_buf_put(dmabuf);
+	return ret;
+}
+
+/* Called on release before ops->free(), nothing is handed over after it */
+static void snd_compr_dmabuf_cancel(struct snd_compr_stream *stream)
+{
+	struct snd_compr_dmabuf_state *state = &snd_compr_file(stream)->dmabuf;
+
+	if (!state->dmabuf)
+		return;
+
+	mutex_lock(&stream->device->lock);
+	snd_compr_dmabuf_flush(stream);
+	mutex_unlock(&stream->device->lock);
+	cancel_work_sync(&state->work);
+}
+
+/* Called on release after ops->free(), the runtime still points at it */
+static void snd_compr_dmabuf_detach(struct snd_compr_stream *stream)
+{
+	struct snd_compr_dmabuf_state *state = &snd_compr_file(stream)->dmabuf;
+
+	if (!state->dmabuf)
+		return;
+
+	dma_buf_vunmap(state->dmabuf, state->buffer.area);
+	dma_buf_unmap_attachment(state->attach, state->sgt, DMA_TO_DEVICE);
+	dma_buf_detach(state->dmabuf, state->attach);
+	dma_buf_put(state->dmabuf);
+}
+
+static int
+snd_compr_dmabuf_commit(struct snd_compr_stream *stream, unsigned long arg)
+{
+	struct snd_compr_dmabuf_state *state = &snd_compr_file(stream)->dmabuf;
+	struct snd_compr_dmabuf_commit commit;
+	struct snd_compr_dmabuf_fenced *c;
+	struct dma_fence *fence = NULL;
+
+	if (copy_from_user(&commit, (void __user *)arg, sizeof(commit)))
+		return -EFAULT;
+
+	if (!state->dmabuf)
+		return -EBADFD;
+	switch (stream->runtime->state) {
+	case SNDRV_PCM_STATE_SETUP:
+	case SNDRV_PCM_STATE_PREPARED:
+	case SNDRV_PCM_STATE_RUNNING:
+		break;
+	default:
+		return -EBADFD;
+	}
+
+	if (!commit.bytes ||
+	    state->pending + commit.bytes > snd_compr_get_avail(stream))
+		return -EINVAL;
+
+	if (commit.fence_fd >= 0) {
+		fence = sync_file_get_fence(commit.fence_fd);
+		if (!fence)
+			return -EINVAL;
+	}
+
+	if (list_empty(&state->commits) &&
+	    (!fence || dma_fence_is_signaled(fence))) {
+		dma_fence_put(fence);
+		snd_compr_dmabuf_hand_over(stream, commit.bytes);
+		return 0;
+	}
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c) {
+		dma_fence_put(fence);
+		return -ENOMEM;
+	}
+	c->state = state;
+	c->fence = fence;
+	c->bytes = commit.bytes;
+	list_add_tail(&c->list, &state->commits);
+	state->pending += commit.bytes;
+
+	/* an unfenced commit waits for the ones before it only */
+	if (!fence || dma_fence_add_callback(fence, &c->cb,
+					     snd_compr_dmabuf_fence_cb))
+		schedule_work(&state->work);
+	return 0;
+}
+
 static long snd_compr_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 {
 	struct snd_compr_file *data = f->private_data;
@@ -1027,6 +1308,12 @@ static long snd_compr_ioctl(struct file *f, unsigned int cmd, unsigned long arg)
 	case _IOC_NR(SNDRV_COMPRESS_NEXT_TRACK):
 		retval = snd_compr_next_track(stream);
 		break;
+	case _IOC_NR(SNDRV_COMPRESS_DMABUF_ATTACH):
+		retval = snd_compr_dmabuf_attach(stream, arg);
+		break;
+	case _IOC_NR(SNDRV_COMPRESS_DMABUF_COMMIT):
+		retval = snd_compr_dmabuf_commit(stream, arg);
+		break;
 
 	}
 	mutex_unlock(&stream->device->lock);
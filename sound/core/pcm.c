@@ -939,7 +939,7 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 	if (substream == NULL)
 		return -EAGAIN;
 
-	runtime = kzalloc(sizeof(*runtime), GFP_KERNEL);
+	runtime = kzalloc(sizeof(struct snd_pcm_runtime_priv), GFP_KERNEL);
 	if (runtime == NULL)
 		return -ENOMEM;
 
@@ -967,6 +967,7 @@ int snd_pcm_attach_substream(struct snd_pcm *pcm, int stream,
 	runtime->status->state = SNDRV_PCM_STATE_OPEN;
 
 	substream->runtime = runtime;
+	snd_pcm_vpos_init(substream);
 	substream->private_data = pcm->private_data;
 	substream->ref_count = 1;
 	substream->f_flags = file->f_flags;
@@ -983,6 +984,7 @@ void snd_pcm_detach_substream(struct snd_pcm_substream *substream)
 	if (PCM_RUNTIME_CHECK(substream))
 		return;
 	runtime = substream->runtime;
+	snd_pcm_vpos_done(substream);
 	if (runtime->private_free != NULL)
 		runtime->private_free(runtime);
 	free_pages_exact(runtime->status,
@@ -307,6 +307,7 @@ static int snd_pcm_update_hw_ptr0(struct snd_pcm_substream *substream,
 		}
 		pos = 0;
 	}
+	pos = snd_pcm_vpos_adjust(substream, pos);
 	pos -= pos % runtime->min_align;
 	trace_hwptr(substream, pos, in_interrupt);
 	hw_base = runtime->hw_ptr_base;
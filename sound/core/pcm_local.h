@@ -8,6 +8,8 @@
 #ifndef __SOUND_CORE_PCM_LOCAL_H
 #define __SOUND_CORE_PCM_LOCAL_H
 
+#include <linux/hrtimer.h>
+
 extern const struct snd_pcm_hw_constraint_list snd_pcm_known_rates;
 
 void snd_interval_mul(const struct snd_interval *a,
@@ -61,6 +63,37 @@ static inline void snd_pcm_timer_init(struct snd_pcm_substream *substream) {}
 static inline void snd_pcm_timer_done(struct snd_pcm_substream *substream) {}
 #endif
 
+/* virtual position state, see pcm_vpos.c */
+struct snd_pcm_vpos {
+	struct snd_pcm_substream *substream;
+	struct hrtimer timer;
+	ktime_t interval;
+	bool running;
+	snd_pcm_uframes_t pos;		/* last position handed to the core */
+	snd_pcm_uframes_t drv_pos;	/* last position of the driver */
+	ktime_t drv_time;		/* when drv_pos was first seen */
+};
+
+/* the runtime as allocated by snd_pcm_attach_substream() */
+struct snd_pcm_runtime_priv {
+	struct snd_pcm_runtime runtime;
+	struct snd_pcm_vpos vpos;
+};
+
+static inline struct snd_pcm_vpos *
+snd_pcm_runtime_vpos(struct snd_pcm_runtime *runtime)
+{
+	return &container_of(runtime, struct snd_pcm_runtime_priv,
+			     runtime)->vpos;
+}
+
+void snd_pcm_vpos_init(struct snd_pcm_substream *substream);
+void snd_pcm_vpos_done(struct snd_pcm_substream *substream);
+void snd_pcm_vpos_start(struct snd_pcm_substream *substream);
+void snd_pcm_vpos_stop(struct snd_pcm_substream *substream);
+snd_pcm_uframes_t snd_pcm_vpos_adjust(struct snd_pcm_substream *substream,
+				      snd_pcm_uframes_t pos);
+
 void __snd_pcm_xrun(struct snd_pcm_substream *substream);
 void snd_pcm_group_init(struct snd_pcm_group *group);
 void snd_pcm_sync_stop(struct snd_pcm_substream *substream, bool sync_irq);
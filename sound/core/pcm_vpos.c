@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *  Virtual PCM position between driver updates
+ *
+ *  Virtual sound cards often learn the position of the host only once per
+ *  period, so hw_ptr advances and poll() wakes up in coarse and jittery
+ *  steps and applications need several periods of buffering. With
+ *  vpos_interval_us set, an hrtimer updates the position of each running
+ *  stream at that interval, and while the position of a playback driver
+ *  does not change it is extrapolated from the elapsed time and the rate.
+ *  The extrapolation never gets a period ahead of the driver and never
+ *  moves the position backwards. Waiters are woken as for any position
+ *  update, so with a small avail_min poll() returns within a period.
+ */
+
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <sound/core.h>
+#include <sound/pcm.h>
+
+#include "pcm_local.h"
+
+static unsigned int vpos_interval_us;
+module_param(vpos_interval_us, uint, 0644);
+MODULE_PARM_DESC(vpos_interval_us, "Virtual PCM position update interval in us (0 = off)");
+
+static enum hrtimer_restart snd_pcm_vpos_timer(struct hrtimer *timer)
+{
+	struct snd_pcm_vpos *vpos = container_of(timer, struct snd_pcm_vpos,
+						 timer);
+	struct snd_pcm_substream *substream = vpos->substream;
+	unsigned long flags;
+	bool running;
+
+	snd_pcm_stream_lock_irqsave(substream, flags);
+	if (vpos->running && snd_pcm_running(substream))
+		snd_pcm_update_hw_ptr(substream);
+	/*
+	 * The update may have stopped the stream on an xrun, and a restart
+	 * while we waited for the lock has queued the timer again already.
+	 */
+	running = vpos->running && !hrtimer_is_queued(timer);
+	snd_pcm_stream_unlock_irqrestore(substream, flags);
+
+	if (!running)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, vpos->interval);
+	return HRTIMER_RESTART;
+}
+
+void snd_pcm_vpos_init(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_vpos *vpos = snd_pcm_runtime_vpos(substream->runtime);
+
+	vpos->substream = substream;
+	hrtimer_init(&vpos->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	vpos->timer.function = snd_pcm_vpos_timer;
+}
+
+void snd_pcm_vpos_done(struct snd_pcm_substream *substream)
+{
+	hrtimer_cancel(&snd_pcm_runtime_vpos(substream->runtime)->timer);
+}
+
+/* Called with the stream lock held when the stream starts running */
+void snd_pcm_vpos_start(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_vpos *vpos = snd_pcm_runtime_vpos(runtime);
+	u64 interval = (u64)READ_ONCE(vpos_interval_us) * NSEC_PER_USEC;
+
+	/* the timer cannot take the mutex of nonatomic streams */
+	if (!interval || substream->pcm->nonatomic)
+		return;
+
+	/* nothing to gain unless the timer beats the period interrupts */
+	if (interval >= div_u64((u64)runtime->period_size * NSEC_PER_SEC,
+				runtime->rate))
+		return;
+
+	vpos->interval = ns_to_ktime(interval);
+	vpos->pos = runtime->status->hw_ptr % runtime->buffer_size;
+	vpos->drv_pos = vpos->pos;
+	vpos->drv_time = ktime_get();
+	vpos->running = true;
+	hrtimer_start(&vpos->timer, vpos->interval, HRTIMER_MODE_REL_SOFT);
+}
+
+/*
+ * Called with the stream lock held when the stream stops running. The timer
+ * callback takes that lock too, so it is only told to not restart here.
+ */
+void snd_pcm_vpos_stop(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_vpos *vpos = snd_pcm_runtime_vpos(substream->runtime);
+
+	vpos->running = false;
+	hrtimer_try_to_cancel(&vpos->timer);
+}
+
+/**
+ * snd_pcm_vpos_adjust - extrapolate the position reported by the driver
+ * @substream: the PCM substream
+ * @pos: position in the buffer returned by the pointer callback
+ *
+ * Called with the stream lock held by snd_pcm_update_hw_ptr0().
+ *
+ * Return: the position to use instead of @pos.
+ */
+snd_pcm_uframes_t snd_pcm_vpos_adjust(struct snd_pcm_substream *substream,
+				      snd_pcm_uframes_t pos)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct snd_pcm_vpos *vpos = snd_pcm_runtime_vpos(runtime);
+	snd_pcm_uframes_t extra, back;
+	ktime_t now;
+
+	if (!vpos->running)
+		return pos;
+
+	now = ktime_get();
+	if (pos != vpos->drv_pos) {
+		vpos->drv_pos = pos;
+		vpos->drv_time = now;
+	} else if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		/* capture data is only there once the driver says so */
+		extra = div_u64(ktime_to_ns(ktime_sub(now, vpos->drv_time)) *
+				runtime->rate, NSEC_PER_SEC);
+		extra = min(extra, runtime->period_size - 1);
+		pos = (pos + extra) % runtime->buffer_size;
+	}
+
+	/* a driver update behind the extrapolation keeps the position */
+	back = (vpos->pos + runtime->buffer_size - pos) % runtime->buffer_size;
+	if (back && back < runtime->buffer_size / 2)
+		pos = vpos->pos;
+
+	vpos->pos = pos;
+	return pos;
+}
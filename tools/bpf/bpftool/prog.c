@@ -368,6 +368,17 @@ static void print_prog_header_json(struct bpf_prog_info *info)
 		jsonw_uint_field(json_wtr, "run_time_ns", info->run_time_ns);
 		jsonw_uint_field(json_wtr, "run_cnt", info->run_cnt);
 	}
+	if (info->run_sampled_cnt) {
+		unsigned int i;
+
+		jsonw_uint_field(json_wtr, "run_sampled_cnt",
+				 info->run_sampled_cnt);
+		jsonw_name(json_wtr, "run_time_hist");
+		jsonw_start_array(json_wtr);
+		for (i = 0; i < BPF_PROG_RUN_HIST_LEN; i++)
+			jsonw_uint(json_wtr, info->run_time_hist[i]);
+		jsonw_end_array(json_wtr);
+	}
 }
 
 static void print_prog_json(struct bpf_prog_info *info, int fd)
@@ -446,9 +457,31 @@ static void print_prog_header_plain(struct bpf_prog_info *info)
 	if (info->run_time_ns)
 		printf(" run_time_ns %lld run_cnt %lld",
 		       info->run_time_ns, info->run_cnt);
+	if (info->run_sampled_cnt && info->run_sampled_cnt != info->run_cnt)
+		printf(" sampled %lld", info->run_sampled_cnt);
 	printf("\n");
 }
 
+/* Only the buckets with sampled runs, each named by its lower bound */
+static void print_run_time_hist_plain(struct bpf_prog_info *info)
+{
+	unsigned int i;
+
+	if (!info->run_sampled_cnt)
+		return;
+
+	printf("\n\trun_time_hist");
+	for (i = 0; i < BPF_PROG_RUN_HIST_LEN; i++) {
+		if (!info->run_time_hist[i])
+			continue;
+		if (i)
+			printf("  >=%lluns %lld", 64ULL << i,
+			       info->run_time_hist[i]);
+		else
+			printf("  <128ns %lld", info->run_time_hist[i]);
+	}
+}
+
 static void print_prog_plain(struct bpf_prog_info *info, int fd)
 {
 	char *memlock;
@@ -491,6 +524,8 @@ static void print_prog_plain(struct bpf_prog_info *info, int fd)
 	if (info->btf_id)
 		printf("\n\tbtf_id %d", info->btf_id);
 
+	print_run_time_hist_plain(info);
+
 	emit_obj_refs_plain(&refs_table, info->id, "\n\tpids ");
 
 	printf("\n");
@@ -157,6 +157,13 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_STRUCT_OPS,
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
+
+	/*
+	 * Map types not in upstream start at 64, so that new upstream
+	 * types can be taken in with their upstream value.
+	 */
+	BPF_MAP_TYPE_PERCPU_RINGBUF = 64,
+	BPF_MAP_TYPE_RHASH,
 };
 
 /* Note that tracing related programs such as
@@ -240,6 +247,8 @@ enum bpf_attach_type {
 	BPF_XDP_CPUMAP,
 	BPF_SK_LOOKUP,
 	BPF_XDP,
+	/* 38 - 41 are used upstream, keep the upstream value */
+	BPF_TRACE_KPROBE_MULTI = 42,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -253,6 +262,8 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_ITER = 4,
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
+	/* 7 is BPF_LINK_TYPE_PERF_EVENT upstream */
+	BPF_LINK_TYPE_KPROBE_MULTI = 8,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -355,6 +366,13 @@ enum bpf_link_type {
  */
 #define BPF_F_SLEEPABLE		(1U << 4)
 
+/* If BPF_F_XDP_HAS_FRAGS is used in BPF_PROG_LOAD command, the XDP program
+ * accepts packets the driver received in several buffers. data and data_end
+ * then only cover the first buffer, and the program must leave data_end
+ * alone on XDP_PASS.
+ */
+#define BPF_F_XDP_HAS_FRAGS	(1U << 5)
+
 /* When BPF ldimm64's insn[0].src_reg != 0 then this can have
  * the following extensions:
  *
@@ -438,6 +456,13 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Approximate the LRU of a BPF_MAP_TYPE_LRU_[PERCPU_]HASH map with
+ * per-CPU CLOCK eviction, which never takes a map-wide lock on update.
+ * Cannot be combined with BPF_F_NO_COMMON_LRU. Flags not in upstream are
+ * allocated from bit 30 down, upstream allocates from the bottom.
+ */
+	BPF_F_LRU_APPROX	= (1U << 30),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -502,6 +527,15 @@ union bpf_attr {
 						   * struct stored as the
 						   * map value
 						   */
+		/* Any per-map-type extra fields
+		 *
+		 * BPF_MAP_TYPE_RINGBUF, BPF_MAP_TYPE_PERCPU_RINGBUF - the
+		 * consumer wakeup batching thresholds: the lower 32 bits are
+		 * the bytes pending and the upper 32 bits the microseconds
+		 * since the first pending record after which the consumer is
+		 * woken up. Zero wakes it up on the first pending record.
+		 */
+		__u64	map_extra;
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -669,6 +703,15 @@ union bpf_attr {
 				__aligned_u64	iter_info;	/* extra bpf_iter_link_info */
 				__u32		iter_info_len;	/* iter_info length */
 			};
+			struct {
+				__u32		flags;	/* must be zero */
+				__u32		cnt;	/* number of syms or addrs */
+				/* array of function names, or zero */
+				__aligned_u64	syms;
+				/* array of function addresses, or zero */
+				__aligned_u64	addrs;
+				__aligned_u64	cookies;	/* must be zero */
+			} kprobe_multi;
 		};
 	} link_create;
 
@@ -4359,6 +4402,12 @@ struct sk_reuseport_md {
 
 #define BPF_TAG_SIZE	8
 
+/* run_time_hist[0] counts the sampled runs shorter than 128ns,
+ * run_time_hist[i] the ones of [64 << i, 128 << i) ns, and the
+ * last bucket all the longer ones.
+ */
+#define BPF_PROG_RUN_HIST_LEN	16
+
 struct bpf_prog_info {
 	__u32 type;
 	__u32 id;
@@ -4395,6 +4444,15 @@ struct bpf_prog_info {
 	__aligned_u64 prog_tags;
 	__u64 run_time_ns;
 	__u64 run_cnt;
+	/* upstream fields, this kernel only reports attach_btf_id */
+	__u64 recursion_misses;
+	__u32 verified_insns;
+	__u32 attach_btf_obj_id;
+	__u32 attach_btf_id;
+	__u32 :32; /* alignment pad */
+	/* fields not in upstream */
+	__u64 run_sampled_cnt;
+	__u64 run_time_hist[BPF_PROG_RUN_HIST_LEN];
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
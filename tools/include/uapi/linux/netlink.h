@@ -156,6 +156,7 @@ enum nlmsgerr_attrs {
 #define NETLINK_CAP_ACK			10
 #define NETLINK_EXT_ACK			11
 #define NETLINK_GET_STRICT_CHK		12
+#define NETLINK_LARGE_DUMP		13
 
 struct nl_pktinfo {
 	__u32	group;
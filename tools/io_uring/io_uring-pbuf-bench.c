@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare the cost of recycling provided buffers through
+ * IORING_OP_PROVIDE_BUFFERS against a ring mapped buffer group
+ * (IORING_REGISTER_PBUF_RING). Each iteration writes one batch worth of
+ * data into a pipe, reads it back with IOSQE_BUFFER_SELECT reads and then
+ * hands the consumed buffers back to the kernel:
+ *
+ *   list: one PROVIDE_BUFFERS sqe (and cqe) per returned buffer
+ *   ring: store the buffers in the shared ring and bump its tail once
+ *
+ * Usage: io_uring-pbuf-bench [-m list|ring|both] [-b batch] [-s bufsize]
+ *                            [-n iterations]
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "liburing.h"
+#include "barrier.h"
+
+#define BGID		1
+
+static unsigned int batch = 32;
+static unsigned int buf_size = 64;
+static unsigned long iterations = 100000;
+
+static char *bufs;
+static unsigned int nr_bufs;
+static struct io_uring_buf_ring *br;
+static unsigned short br_tail;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void prep_provide(struct io_uring_sqe *sqe, unsigned int bid,
+			 unsigned int nr)
+{
+	io_uring_prep_rw(IORING_OP_PROVIDE_BUFFERS, sqe, nr,
+			 bufs + (size_t)bid * buf_size, buf_size, bid);
+	sqe->buf_group = BGID;
+	sqe->user_data = 0;
+}
+
+static void prep_read(struct io_uring_sqe *sqe, int fd)
+{
+	io_uring_prep_rw(IORING_OP_READ, sqe, fd, NULL, buf_size, 0);
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	sqe->user_data = 1;
+}
+
+static void ring_add(unsigned int bid)
+{
+	struct io_uring_buf *buf = &br->bufs[br_tail & (nr_bufs - 1)];
+
+	buf->addr = (unsigned long)(bufs + (size_t)bid * buf_size);
+	buf->len = buf_size;
+	buf->bid = bid;
+	br_tail++;
+}
+
+static void ring_publish(void)
+{
+	/* the kernel reads the tail with acquire semantics */
+	write_barrier();
+	br->tail = br_tail;
+}
+
+static int setup_list(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	prep_provide(io_uring_get_sqe(ring), 0, nr_bufs);
+	io_uring_submit(ring);
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret)
+		return ret;
+	ret = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+	return ret < 0 ? ret : 0;
+}
+
+static int setup_ring(struct io_uring *ring)
+{
+	struct io_uring_buf_reg reg;
+	size_t len = nr_bufs * sizeof(struct io_uring_buf);
+	unsigned int i;
+
+	br = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (br == MAP_FAILED)
+		return -errno;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long)br;
+	reg.ring_entries = nr_bufs;
+	reg.bgid = BGID;
+	if (io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING,
+			      &reg, 1) < 0)
+		return -errno;
+
+	br_tail = 0;
+	for (i = 0; i < nr_bufs; i++)
+		ring_add(i);
+	ring_publish();
+	return 0;
+}
+
+static int run(const char *mode)
+{
+	int use_ring = !strcmp(mode, "ring");
+	unsigned int *done_bids;
+	unsigned long long start, elapsed;
+	unsigned long it, cqes = 0;
+	struct io_uring ring;
+	int fds[2], ret;
+	char *data;
+
+	ret = io_uring_queue_init(2 * batch, &ring, 0);
+	if (ret < 0) {
+		fprintf(stderr, "queue_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	data = calloc(batch, buf_size);
+	done_bids = calloc(batch, sizeof(*done_bids));
+	if (!data || !done_bids)
+		return 1;
+
+	ret = use_ring ? setup_ring(&ring) : setup_list(&ring);
+	if (ret) {
+		fprintf(stderr, "%s setup: %s\n", mode, strerror(-ret));
+		return 1;
+	}
+
+	start = now_ns();
+	for (it = 0; it < iterations; it++) {
+		unsigned int i, nr_done = 0, pending = batch;
+
+		if (write(fds[1], data, (size_t)batch * buf_size) < 0) {
+			perror("write");
+			return 1;
+		}
+		for (i = 0; i < batch; i++)
+			prep_read(io_uring_get_sqe(&ring), fds[0]);
+		io_uring_submit(&ring);
+
+		while (pending) {
+			struct io_uring_cqe *cqe;
+
+			ret = io_uring_wait_cqe(&ring, &cqe);
+			if (ret) {
+				fprintf(stderr, "wait_cqe: %s\n", strerror(-ret));
+				return 1;
+			}
+			cqes++;
+			if (cqe->user_data) {
+				if (cqe->res < 0 ||
+				    !(cqe->flags & IORING_CQE_F_BUFFER)) {
+					fprintf(stderr, "read: %d\n", cqe->res);
+					return 1;
+				}
+				done_bids[nr_done++] =
+					cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				pending--;
+			}
+			io_uring_cqe_seen(&ring, cqe);
+		}
+
+		/* hand the consumed buffers back */
+		for (i = 0; i < nr_done; i++) {
+			if (use_ring)
+				ring_add(done_bids[i]);
+			else
+				prep_provide(io_uring_get_sqe(&ring),
+					     done_bids[i], 1);
+		}
+		if (use_ring)
+			ring_publish();
+		else
+			io_uring_submit(&ring);
+	}
+	elapsed = now_ns() - start;
+
+	printf("%-4s: %lu reads in %llu ms, %.1f ns/read, %.2f cqes/read\n",
+	       mode, iterations * batch, elapsed / 1000000,
+	       (double)elapsed / (iterations * batch),
+	       (double)cqes / (iterations * batch));
+
+	io_uring_queue_exit(&ring);
+	close(fds[0]);
+	close(fds[1]);
+	free(data);
+	free(done_bids);
+	if (use_ring)
+		munmap(br, nr_bufs * sizeof(struct io_uring_buf));
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *mode = "both";
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "m:b:s:n:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			mode = optarg;
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 's':
+			buf_size = atoi(optarg);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-m list|ring|both] "
+				"[-b batch] [-s bufsize] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (!batch || batch > 2048 || !buf_size ||
+	    (size_t)batch * buf_size > 65536) {
+		fprintf(stderr, "batch * bufsize must fit in a pipe\n");
+		return 1;
+	}
+
+	/* twice the batch, rounded up to the power of 2 the ring needs */
+	nr_bufs = 1;
+	while (nr_bufs < 2 * batch)
+		nr_bufs <<= 1;
+	bufs = malloc((size_t)nr_bufs * buf_size);
+	if (!bufs)
+		return 1;
+
+	if (!strcmp(mode, "list") || !strcmp(mode, "both"))
+		ret |= run("list");
+	if (!strcmp(mode, "ring") || !strcmp(mode, "both"))
+		ret |= run("ring");
+	free(bufs);
+	return ret;
+}
@@ -240,6 +240,7 @@ bool bpf_probe_map_type(enum bpf_map_type map_type, __u32 ifindex)
 			return false;
 		break;
 	case BPF_MAP_TYPE_RINGBUF:
+	case BPF_MAP_TYPE_PERCPU_RINGBUF:
 		key_size = 0;
 		value_size = 0;
 		max_entries = 4096;
@@ -29,6 +29,8 @@ struct ring {
 	unsigned long *producer_pos;
 	unsigned long mask;
 	int map_fd;
+	/* rings behind the epoll entry of this first ring of a map */
+	int nr_rings;
 };
 
 struct ring_buffer {
@@ -51,16 +53,60 @@ static void ringbuf_unmap_ring(struct ring_buffer *rb, struct ring *r)
 	}
 }
 
-/* Add extra RINGBUF maps to this ring buffer manager */
+/* Map the consumer, producer and data pages found at offset off of map_fd */
+static int ringbuf_map_ring(struct ring_buffer *rb, struct ring *r, int map_fd,
+			    off_t off, __u32 max_entries)
+{
+	void *tmp;
+	int err;
+
+	r->map_fd = map_fd;
+	r->mask = max_entries - 1;
+
+	/* Map writable consumer page */
+	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   map_fd, off);
+	if (tmp == MAP_FAILED) {
+		err = -errno;
+		pr_warn("ringbuf: failed to mmap consumer page for map fd=%d: %d\n",
+			map_fd, err);
+		return err;
+	}
+	r->consumer_pos = tmp;
+
+	/* Map read-only producer page and data pages. We map twice as big
+	 * data size to allow simple reading of samples that wrap around the
+	 * end of a ring buffer. See kernel implementation for details.
+	 * */
+	tmp = mmap(NULL, rb->page_size + 2 * max_entries, PROT_READ,
+		   MAP_SHARED, map_fd, off + rb->page_size);
+	if (tmp == MAP_FAILED) {
+		err = -errno;
+		ringbuf_unmap_ring(rb, r);
+		pr_warn("ringbuf: failed to mmap data pages for map fd=%d: %d\n",
+			map_fd, err);
+		return err;
+	}
+	r->producer_pos = tmp;
+	r->data = tmp + rb->page_size;
+	return 0;
+}
+
+/* Add extra RINGBUF or PERCPU_RINGBUF maps to this ring buffer manager. The
+ * rings of all CPUs of a PERCPU_RINGBUF map share one epoll entry and are
+ * all consumed when it fires.
+ */
 int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 		     ring_buffer_sample_fn sample_cb, void *ctx)
 {
 	struct bpf_map_info info;
 	__u32 len = sizeof(info);
+	int i, nr_rings = 1, err;
+	bool *mask = NULL;
 	struct epoll_event *e;
 	struct ring *r;
+	off_t span = 0;
 	void *tmp;
-	int err;
 
 	memset(&info, 0, sizeof(info));
 
@@ -72,56 +118,58 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 		return err;
 	}
 
-	if (info.type != BPF_MAP_TYPE_RINGBUF) {
+	if (info.type != BPF_MAP_TYPE_RINGBUF &&
+	    info.type != BPF_MAP_TYPE_PERCPU_RINGBUF) {
 		pr_warn("ringbuf: map fd=%d is not BPF_MAP_TYPE_RINGBUF\n",
 			map_fd);
 		return -EINVAL;
 	}
 
-	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + 1, sizeof(*rb->rings));
-	if (!tmp)
-		return -ENOMEM;
+	/* The kernel lays out the rings of all possible CPUs one after
+	 * another, indexed by CPU number.
+	 */
+	if (info.type == BPF_MAP_TYPE_PERCPU_RINGBUF) {
+		err = parse_cpu_mask_file("/sys/devices/system/cpu/possible",
+					  &mask, &nr_rings);
+		if (err)
+			return err;
+		span = 2 * rb->page_size + 2 * (off_t)info.max_entries;
+	}
+
+	tmp = libbpf_reallocarray(rb->rings, rb->ring_cnt + nr_rings,
+				  sizeof(*rb->rings));
+	if (!tmp) {
+		err = -ENOMEM;
+		goto out;
+	}
 	rb->rings = tmp;
 
-	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + 1, sizeof(*rb->events));
-	if (!tmp)
-		return -ENOMEM;
+	tmp = libbpf_reallocarray(rb->events, rb->ring_cnt + nr_rings,
+				  sizeof(*rb->events));
+	if (!tmp) {
+		err = -ENOMEM;
+		goto out;
+	}
 	rb->events = tmp;
 
-	r = &rb->rings[rb->ring_cnt];
-	memset(r, 0, sizeof(*r));
+	for (i = 0; i < nr_rings; i++) {
+		r = &rb->rings[rb->ring_cnt + i];
+		memset(r, 0, sizeof(*r));
+		r->sample_cb = sample_cb;
+		r->ctx = ctx;
 
-	r->map_fd = map_fd;
-	r->sample_cb = sample_cb;
-	r->ctx = ctx;
-	r->mask = info.max_entries - 1;
+		/* not possible CPUs keep an empty ring */
+		if (mask && !mask[i])
+			continue;
 
-	/* Map writable consumer page */
-	tmp = mmap(NULL, rb->page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
-		   map_fd, 0);
-	if (tmp == MAP_FAILED) {
-		err = -errno;
-		pr_warn("ringbuf: failed to mmap consumer page for map fd=%d: %d\n",
-			map_fd, err);
-		return err;
+		err = ringbuf_map_ring(rb, r, map_fd, i * span,
+				       info.max_entries);
+		if (err)
+			goto err_unmap;
 	}
-	r->consumer_pos = tmp;
 
-	/* Map read-only producer page and data pages. We map twice as big
-	 * data size to allow simple reading of samples that wrap around the
-	 * end of a ring buffer. See kernel implementation for details.
-	 * */
-	tmp = mmap(NULL, rb->page_size + 2 * info.max_entries, PROT_READ,
-		   MAP_SHARED, map_fd, rb->page_size);
-	if (tmp == MAP_FAILED) {
-		err = -errno;
-		ringbuf_unmap_ring(rb, r);
-		pr_warn("ringbuf: failed to mmap data pages for map fd=%d: %d\n",
-			map_fd, err);
-		return err;
-	}
-	r->producer_pos = tmp;
-	r->data = tmp + rb->page_size;
+	r = &rb->rings[rb->ring_cnt];
+	r->nr_rings = nr_rings;
 
 	e = &rb->events[rb->ring_cnt];
 	memset(e, 0, sizeof(*e));
@@ -130,14 +178,22 @@ int ring_buffer__add(struct ring_buffer *rb, int map_fd,
 	e->data.fd = rb->ring_cnt;
 	if (epoll_ctl(rb->epoll_fd, EPOLL_CTL_ADD, map_fd, e) < 0) {
 		err = -errno;
-		ringbuf_unmap_ring(rb, r);
 		pr_warn("ringbuf: failed to epoll add map fd=%d: %d\n",
 			map_fd, err);
-		return err;
+		i = nr_rings;
+		goto err_unmap;
 	}
 
-	rb->ring_cnt++;
-	return 0;
+	rb->ring_cnt += nr_rings;
+	err = 0;
+	goto out;
+
+err_unmap:
+	while (i--)
+		ringbuf_unmap_ring(rb, &rb->rings[rb->ring_cnt + i]);
+out:
+	free(mask);
+	return err;
 }
 
 void ring_buffer__free(struct ring_buffer *rb)
@@ -211,6 +267,10 @@ static int64_t ringbuf_process_ring(struct ring* r)
 	bool got_new_data;
 	void *sample;
 
+	/* not possible CPU of a PERCPU_RINGBUF map */
+	if (!r->consumer_pos)
+		return 0;
+
 	cons_pos = smp_load_acquire(r->consumer_pos);
 	do {
 		got_new_data = false;
@@ -284,11 +344,14 @@ int ring_buffer__poll(struct ring_buffer *rb, int timeout_ms)
 	for (i = 0; i < cnt; i++) {
 		__u32 ring_id = rb->events[i].data.fd;
 		struct ring *ring = &rb->rings[ring_id];
+		int j;
 
-		err = ringbuf_process_ring(ring);
-		if (err < 0)
-			return err;
-		res += err;
+		for (j = 0; j < ring->nr_rings; j++) {
+			err = ringbuf_process_ring(&ring[j]);
+			if (err < 0)
+				return err;
+			res += err;
+		}
 	}
 	if (res > INT_MAX)
 		return INT_MAX;
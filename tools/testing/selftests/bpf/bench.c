@@ -131,9 +131,11 @@ static const struct argp_option opts[] = {
 };
 
 extern struct argp bench_ringbufs_argp;
+extern struct argp bench_hashmap_argp;
 
 static const struct argp_child bench_parsers[] = {
 	{ &bench_ringbufs_argp, 0, "Ring buffers benchmark", 0 },
+	{ &bench_hashmap_argp, 0, "Hash map benchmark", 0 },
 	{},
 };
 
@@ -322,6 +324,9 @@ extern const struct bench bench_rb_libbpf;
 extern const struct bench bench_rb_custom;
 extern const struct bench bench_pb_libbpf;
 extern const struct bench bench_pb_custom;
+extern const struct bench bench_hashmap_prealloc;
+extern const struct bench bench_hashmap_noprealloc;
+extern const struct bench bench_hashmap_rhash;
 
 static const struct bench *benchs[] = {
 	&bench_count_global,
@@ -343,6 +348,9 @@ static const struct bench *benchs[] = {
 	&bench_rb_custom,
 	&bench_pb_libbpf,
 	&bench_pb_custom,
+	&bench_hashmap_prealloc,
+	&bench_hashmap_noprealloc,
+	&bench_hashmap_rhash,
 };
 
 static void setup_benchmark()
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "hashmap_bench.skel.h"
+
+/* Hash map benchmarks: every getpgid() does a batch of lookups, inserts and
+ * deletes of random keys in the same map, preallocated BPF_MAP_TYPE_HASH,
+ * BPF_MAP_TYPE_HASH with BPF_F_NO_PREALLOC or BPF_MAP_TYPE_RHASH.
+ */
+static struct {
+	__u32 nr_keys;
+	__u32 max_entries;
+} args = {
+	.nr_keys = 100000,
+	.max_entries = 1000000,
+};
+
+enum {
+	ARG_HM_NR_KEYS = 3000,
+	ARG_HM_MAX_ENTRIES = 3001,
+};
+
+static const struct argp_option opts[] = {
+	{ "hm-nr-keys", ARG_HM_NR_KEYS, "CNT", 0, "Set number of distinct keys"},
+	{ "hm-max-entries", ARG_HM_MAX_ENTRIES, "CNT", 0, "Set map max_entries"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long val;
+
+	switch (key) {
+	case ARG_HM_NR_KEYS:
+	case ARG_HM_MAX_ENTRIES:
+		val = strtol(arg, NULL, 10);
+		if (val <= 0 || val > UINT32_MAX) {
+			fprintf(stderr, "Invalid count.");
+			argp_usage(state);
+		}
+		if (key == ARG_HM_NR_KEYS)
+			args.nr_keys = val;
+		else
+			args.max_entries = val;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_hashmap_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static struct hashmap_ctx {
+	struct hashmap_bench *skel;
+} ctx;
+
+static void hashmap_validate()
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void hashmap_setup(enum bpf_map_type type, __u32 flags)
+{
+	struct bpf_link *link;
+	int err;
+
+	setup_libbpf();
+
+	ctx.skel = hashmap_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	ctx.skel->rodata->nr_keys = args.nr_keys;
+	bpf_map__set_type(ctx.skel->maps.hmap, type);
+	bpf_map__set_map_flags(ctx.skel->maps.hmap, flags);
+	bpf_map__set_max_entries(ctx.skel->maps.hmap, args.max_entries);
+
+	err = hashmap_bench__load(ctx.skel);
+	if (err) {
+		fprintf(stderr, "failed to load skeleton: %d\n", err);
+		exit(1);
+	}
+
+	link = bpf_program__attach(ctx.skel->progs.bench_hashmap);
+	if (IS_ERR(link)) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+static void hashmap_prealloc_setup()
+{
+	hashmap_setup(BPF_MAP_TYPE_HASH, 0);
+}
+
+static void hashmap_noprealloc_setup()
+{
+	hashmap_setup(BPF_MAP_TYPE_HASH, BPF_F_NO_PREALLOC);
+}
+
+static void hashmap_rhash_setup()
+{
+	hashmap_setup(BPF_MAP_TYPE_RHASH, 0);
+}
+
+static void *hashmap_producer(void *input)
+{
+	while (true)
+		(void)syscall(__NR_getpgid);
+	return NULL;
+}
+
+static void *hashmap_consumer(void *input)
+{
+	return NULL;
+}
+
+static void hashmap_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->hits, 0);
+	res->drops = atomic_swap(&ctx.skel->bss->drops, 0);
+}
+
+const struct bench bench_hashmap_prealloc = {
+	.name = "hashmap-prealloc",
+	.validate = hashmap_validate,
+	.setup = hashmap_prealloc_setup,
+	.producer_thread = hashmap_producer,
+	.consumer_thread = hashmap_consumer,
+	.measure = hashmap_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
+
+const struct bench bench_hashmap_noprealloc = {
+	.name = "hashmap-noprealloc",
+	.validate = hashmap_validate,
+	.setup = hashmap_noprealloc_setup,
+	.producer_thread = hashmap_producer,
+	.consumer_thread = hashmap_consumer,
+	.measure = hashmap_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
+
+const struct bench bench_hashmap_rhash = {
+	.name = "hashmap-rhash",
+	.validate = hashmap_validate,
+	.setup = hashmap_rhash_setup,
+	.producer_thread = hashmap_producer,
+	.consumer_thread = hashmap_consumer,
+	.measure = hashmap_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
@@ -0,0 +1,12 @@
+#!/bin/bash
+
+set -eufo pipefail
+
+for i in prealloc noprealloc rhash
+do
+	for p in 1 4 16
+	do
+		summary=$(sudo ./bench -w2 -d5 -a -p$p hashmap-$i | tail -n1 | cut -d'(' -f1 | cut -d' ' -f3-)
+		printf "%-10s %2d producers: %s\n" $i $p "$summary"
+	done
+done
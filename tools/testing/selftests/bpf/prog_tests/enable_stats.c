@@ -8,7 +8,9 @@ void test_enable_stats(void)
 	int stats_fd, err, prog_fd;
 	struct bpf_prog_info info;
 	__u32 info_len = sizeof(info);
+	__u64 hist_cnt = 0;
 	int duration = 0;
+	int i;
 
 	skel = test_enable_stats__open_and_load();
 	if (CHECK(!skel, "skel_open_and_load", "skeleton open/load failed\n"))
@@ -39,6 +41,16 @@ void test_enable_stats(void)
 	CHECK(info.run_cnt != skel->bss->count, "check_run_cnt_valid",
 	      "invalid run_cnt stats\n");
 
+	/* only 1/kernel.bpf_stats_sample_rate runs are timed */
+	CHECK(!info.run_sampled_cnt || info.run_sampled_cnt > info.run_cnt,
+	      "check_run_sampled_cnt_valid", "invalid run_sampled_cnt %llu\n",
+	      info.run_sampled_cnt);
+	for (i = 0; i < BPF_PROG_RUN_HIST_LEN; i++)
+		hist_cnt += info.run_time_hist[i];
+	CHECK(hist_cnt != info.run_sampled_cnt, "check_run_time_hist_valid",
+	      "run_time_hist has %llu runs, %llu sampled\n", hist_cnt,
+	      info.run_sampled_cnt);
+
 cleanup:
 	test_enable_stats__destroy(skel);
 	close(stats_fd);
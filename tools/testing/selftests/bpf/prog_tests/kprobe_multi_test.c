@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <test_progs.h>
+#include "kprobe_multi.skel.h"
+#include "trace_helpers.h"
+
+static const char * const syms[] = {
+	"bpf_fentry_test1",
+	"bpf_fentry_test2",
+	"bpf_fentry_test3",
+	"bpf_fentry_test4",
+	"bpf_fentry_test5",
+	"bpf_fentry_test6",
+};
+
+#define SYM_CNT	ARRAY_SIZE(syms)
+
+static int kprobe_multi_link(struct kprobe_multi *skel, const void *names,
+			     const unsigned long *addrs, __u64 cookies)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = bpf_program__fd(skel->progs.test_kprobe);
+	attr.link_create.attach_type = BPF_TRACE_KPROBE_MULTI;
+	attr.link_create.kprobe_multi.cnt = SYM_CNT;
+	attr.link_create.kprobe_multi.syms = ptr_to_u64(names);
+	attr.link_create.kprobe_multi.addrs = ptr_to_u64(addrs);
+	attr.link_create.kprobe_multi.cookies = cookies;
+
+	return syscall(__NR_bpf, BPF_LINK_CREATE, &attr, sizeof(attr));
+}
+
+static void kprobe_multi_check(struct kprobe_multi *skel, int link_fd)
+{
+	__u32 duration = 0, retval;
+	int err;
+
+	if (link_fd < 0 && errno == EOPNOTSUPP) {
+		test__skip();
+		return;
+	}
+	if (CHECK(link_fd < 0, "link_create", "err %d errno %d\n",
+		  link_fd, errno))
+		return;
+
+	skel->bss->kprobe_hits = 0;
+	skel->bss->kprobe_args = 0;
+
+	err = bpf_prog_test_run(bpf_program__fd(skel->progs.trigger), 1,
+				NULL, 0, NULL, NULL, &retval, &duration);
+	ASSERT_OK(err, "test_run");
+	ASSERT_EQ(retval, 0, "test_run_retval");
+
+	ASSERT_EQ(skel->bss->kprobe_hits, SYM_CNT, "kprobe_hits");
+	ASSERT_EQ(skel->bss->kprobe_args, SYM_CNT, "kprobe_args");
+
+	close(link_fd);
+}
+
+static void test_attach_syms(struct kprobe_multi *skel)
+{
+	kprobe_multi_check(skel, kprobe_multi_link(skel, syms, NULL, 0));
+}
+
+static void test_attach_addrs(struct kprobe_multi *skel)
+{
+	unsigned long addrs[SYM_CNT];
+	int i;
+
+	if (CHECK(load_kallsyms() < 0, "load_kallsyms", "errno %d\n", errno))
+		return;
+
+	for (i = 0; i < SYM_CNT; i++) {
+		addrs[i] = ksym_get_addr(syms[i]);
+		if (CHECK(!addrs[i], "ksym_get_addr", "%s not found\n",
+			  syms[i]))
+			return;
+	}
+
+	kprobe_multi_check(skel, kprobe_multi_link(skel, NULL, addrs, 0));
+}
+
+static void test_attach_invalid(struct kprobe_multi *skel)
+{
+	unsigned long addrs[SYM_CNT] = {};
+	__u64 cookies[SYM_CNT] = {};
+	int link_fd;
+
+	/* exactly one of syms and addrs */
+	link_fd = kprobe_multi_link(skel, NULL, NULL, 0);
+	if (!ASSERT_EQ(link_fd, -1, "no_funcs"))
+		close(link_fd);
+	link_fd = kprobe_multi_link(skel, syms, addrs, 0);
+	if (!ASSERT_EQ(link_fd, -1, "syms_and_addrs"))
+		close(link_fd);
+
+	/* cookies are not supported */
+	link_fd = kprobe_multi_link(skel, syms, NULL, ptr_to_u64(cookies));
+	if (!ASSERT_EQ(link_fd, -1, "cookies"))
+		close(link_fd);
+}
+
+void test_kprobe_multi_test(void)
+{
+	struct kprobe_multi *skel;
+	int err;
+
+	skel = kprobe_multi__open();
+	if (!ASSERT_OK_PTR(skel, "kprobe_multi__open"))
+		return;
+
+	bpf_program__set_expected_attach_type(skel->progs.test_kprobe,
+					      BPF_TRACE_KPROBE_MULTI);
+
+	err = kprobe_multi__load(skel);
+	if (!ASSERT_OK(err, "kprobe_multi__load"))
+		goto cleanup;
+
+	if (test__start_subtest("syms"))
+		test_attach_syms(skel);
+	if (test__start_subtest("addrs"))
+		test_attach_addrs(skel);
+	if (test__start_subtest("invalid"))
+		test_attach_invalid(skel);
+
+cleanup:
+	kprobe_multi__destroy(skel);
+}
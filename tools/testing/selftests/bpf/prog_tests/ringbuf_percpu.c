@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0
+#define _GNU_SOURCE
+#include <test_progs.h>
+#include <sched.h>
+#include "test_ringbuf_percpu.skel.h"
+
+/* wakeup batching of ringbuf_batch: only after 50ms */
+#define BATCH_WAKEUP_US 50000ULL
+
+static int duration = 0;
+
+struct sample {
+	int cpu;
+	int seq;
+};
+
+static int sample_cnt;
+
+static int process_sample(void *ctx, void *data, size_t len)
+{
+	int *cpus = ctx;
+	struct sample *s = data;
+
+	if (CHECK(s->seq < 0 || s->seq >= sample_cnt, "sample_seq",
+		  "unexpected sample seq %d\n", s->seq))
+		return -1;
+	CHECK(s->cpu != cpus[s->seq], "sample_cpu", "seq %d: exp %d, got %d\n",
+	      s->seq, cpus[s->seq], s->cpu);
+	return 0;
+}
+
+static int trigger_on(int cpu)
+{
+	cpu_set_t cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	if (sched_setaffinity(0, sizeof(cpuset), &cpuset))
+		return -errno;
+	syscall(__NR_getpgid);
+	return 0;
+}
+
+void test_ringbuf_percpu(void)
+{
+	struct test_ringbuf_percpu *skel;
+	struct ring_buffer *ringbuf = NULL;
+	union bpf_attr attr = {};
+	int i, err, cnt = 0, nr_cpus, batch_fd = -1;
+	int *cpus = NULL;
+	cpu_set_t orig;
+
+	nr_cpus = libbpf_num_possible_cpus();
+	if (CHECK(nr_cpus < 0, "nr_cpus", "err %d\n", nr_cpus))
+		return;
+	if (CHECK(sched_getaffinity(0, sizeof(orig), &orig), "getaffinity",
+		  "err %d\n", errno))
+		return;
+
+	skel = test_ringbuf_percpu__open();
+	if (CHECK(!skel, "skel_open", "skeleton open failed\n"))
+		return;
+
+	attr.map_type = BPF_MAP_TYPE_PERCPU_RINGBUF;
+	attr.max_entries = 1 << 12;
+	attr.map_extra = BATCH_WAKEUP_US << 32;
+	batch_fd = syscall(__NR_bpf, BPF_MAP_CREATE, &attr, sizeof(attr));
+	if (CHECK(batch_fd < 0, "batch_map_create", "err %d\n", errno))
+		goto cleanup;
+	err = bpf_map__reuse_fd(skel->maps.ringbuf_batch, batch_fd);
+	if (CHECK(err, "reuse_fd", "err %d\n", err))
+		goto cleanup;
+
+	err = test_ringbuf_percpu__load(skel);
+	if (CHECK(err, "skel_load", "skeleton load failed: %d\n", err))
+		goto cleanup;
+
+	cpus = calloc(nr_cpus + 1, sizeof(*cpus));
+	if (CHECK(!cpus, "alloc", "out of memory\n"))
+		goto cleanup;
+
+	/* only trigger BPF program for current process */
+	skel->bss->pid = getpid();
+
+	ringbuf = ring_buffer__new(bpf_map__fd(skel->maps.ringbuf),
+				   process_sample, cpus, NULL);
+	if (CHECK(!ringbuf, "ringbuf_create", "failed to create ringbuf\n"))
+		goto cleanup;
+
+	err = ring_buffer__add(ringbuf, bpf_map__fd(skel->maps.ringbuf_batch),
+			       process_sample, cpus);
+	if (CHECK(err, "ringbuf_add", "failed to add batched ring\n"))
+		goto cleanup;
+
+	err = test_ringbuf_percpu__attach(skel);
+	if (CHECK(err, "skel_attach", "skeleton attachment failed: %d\n", err))
+		goto cleanup;
+
+	/* one sample from every CPU we may run on, each in its own ring */
+	for (i = 0; i < nr_cpus; i++) {
+		if (!CPU_ISSET(i, &orig))
+			continue;
+		cpus[cnt] = i;
+		sample_cnt = cnt + 1;
+		if (trigger_on(i))
+			continue;
+		cnt++;
+	}
+	sample_cnt = cnt;
+
+	/* a single epoll entry covers the rings of all CPUs */
+	for (i = 0; i < cnt; ) {
+		err = ring_buffer__poll(ringbuf, 1000);
+		if (CHECK(err <= 0, "poll_res", "got %d of %d records, err %d\n",
+			  i, cnt, err))
+			goto cleanup;
+		i += err;
+	}
+	CHECK(i != cnt, "poll_total", "exp %d, got %d\n", cnt, i);
+
+	/* batched ring: nobody is woken up before BATCH_WAKEUP_US */
+	skel->bss->batch = 1;
+	cpus[cnt] = cpus[0];
+	sample_cnt = cnt + 1;
+	if (CHECK(trigger_on(cpus[0]), "trigger_batch", "err %d\n", errno))
+		goto cleanup;
+
+	err = ring_buffer__poll(ringbuf, 0);
+	CHECK(err != 0, "batch_early", "exp 0 records, got %d\n", err);
+
+	err = ring_buffer__poll(ringbuf, 1000);
+	CHECK(err != 1, "batch_late", "exp 1 record, got %d\n", err);
+
+	CHECK(skel->bss->dropped != 0, "err_dropped", "exp %ld, got %ld\n",
+	      0L, skel->bss->dropped);
+	CHECK(skel->bss->total != cnt + 1, "err_total", "exp %ld, got %ld\n",
+	      (long)cnt + 1, skel->bss->total);
+
+cleanup:
+	sched_setaffinity(0, sizeof(orig), &orig);
+	ring_buffer__free(ringbuf);
+	test_ringbuf_percpu__destroy(skel);
+	if (batch_fd >= 0)
+		close(batch_fd);
+	free(cpus);
+}
@@ -1035,6 +1035,171 @@ detach:
 	xbpf_prog_detach2(parser, sock_map, BPF_SK_SKB_STREAM_PARSER);
 }
 
+#define REDIR_CROSSED_BYTES 4096
+
+static void *redir_crossed_writer(void *arg)
+{
+	int fd = *(int *)arg;
+	int i;
+
+	for (i = 0; i < REDIR_CROSSED_BYTES; i++) {
+		if (write(fd, "a", 1) != 1) {
+			FAIL_ERRNO("crossed: write");
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int recv_bytes(int fd, int want)
+{
+	int n, total = 0;
+	char buf[256];
+
+	while (total < want) {
+		n = want - total;
+		if (n > sizeof(buf))
+			n = sizeof(buf);
+		n = recv_timeout(fd, buf, n, 0, IO_TIMEOUT_SEC);
+		if (n <= 0)
+			break;
+		total += n;
+	}
+	return total;
+}
+
+/* Two connected sockets redirecting to each other's ingress, from both
+ * directions at once. Covers the direct ingress path and that it does not
+ * deadlock on the two socket locks.
+ */
+static void redir_ingress_crossed(int family, int sotype, int sock_mapfd,
+				  int peer_mapfd)
+{
+	struct sockaddr_storage addr;
+	int s, c0, c1, p0, p1, n;
+	u64 cookie[2] = {}, value;
+	socklen_t len;
+	pthread_t t;
+	u32 key;
+	int err;
+
+	s = socket_loopback(family, sotype | SOCK_NONBLOCK);
+	if (s < 0)
+		return;
+
+	len = sizeof(addr);
+	err = xgetsockname(s, sockaddr(&addr), &len);
+	if (err)
+		goto close_srv;
+
+	c0 = xsocket(family, sotype, 0);
+	if (c0 < 0)
+		goto close_srv;
+	err = xconnect(c0, sockaddr(&addr), len);
+	if (err)
+		goto close_cli0;
+
+	p0 = xaccept_nonblock(s, NULL, NULL);
+	if (p0 < 0)
+		goto close_cli0;
+
+	c1 = xsocket(family, sotype, 0);
+	if (c1 < 0)
+		goto close_peer0;
+	err = xconnect(c1, sockaddr(&addr), len);
+	if (err)
+		goto close_cli1;
+
+	p1 = xaccept_nonblock(s, NULL, NULL);
+	if (p1 < 0)
+		goto close_cli1;
+
+	key = 0;
+	value = p0;
+	err = xbpf_map_update_elem(sock_mapfd, &key, &value, BPF_NOEXIST);
+	if (err)
+		goto close_peer1;
+
+	key = 1;
+	value = p1;
+	err = xbpf_map_update_elem(sock_mapfd, &key, &value, BPF_NOEXIST);
+	if (err)
+		goto close_peer1;
+
+	/* p0 redirects to p1 and p1 to p0 */
+	len = sizeof(cookie[0]);
+	err = xgetsockopt(p0, SOL_SOCKET, SO_COOKIE, &cookie[0], &len);
+	if (err)
+		goto close_peer1;
+	len = sizeof(cookie[1]);
+	err = xgetsockopt(p1, SOL_SOCKET, SO_COOKIE, &cookie[1], &len);
+	if (err)
+		goto close_peer1;
+
+	key = 1;
+	err = xbpf_map_update_elem(peer_mapfd, &cookie[0], &key, BPF_NOEXIST);
+	if (err)
+		goto close_peer1;
+	key = 0;
+	err = xbpf_map_update_elem(peer_mapfd, &cookie[1], &key, BPF_NOEXIST);
+	if (err)
+		goto del_peers;
+
+	err = xpthread_create(&t, NULL, redir_crossed_writer, &c0);
+	if (err)
+		goto del_peers;
+	redir_crossed_writer(&c1);
+	xpthread_join(t, NULL);
+
+	/* what c0 sent shows up on p1 and the other way round */
+	n = recv_bytes(p1, REDIR_CROSSED_BYTES);
+	if (n != REDIR_CROSSED_BYTES)
+		FAIL_ERRNO("crossed: p1 read %d of %d bytes", n,
+			   REDIR_CROSSED_BYTES);
+	n = recv_bytes(p0, REDIR_CROSSED_BYTES);
+	if (n != REDIR_CROSSED_BYTES)
+		FAIL_ERRNO("crossed: p0 read %d of %d bytes", n,
+			   REDIR_CROSSED_BYTES);
+
+del_peers:
+	bpf_map_delete_elem(peer_mapfd, &cookie[0]);
+	bpf_map_delete_elem(peer_mapfd, &cookie[1]);
+close_peer1:
+	xclose(p1);
+close_cli1:
+	xclose(c1);
+close_peer0:
+	xclose(p0);
+close_cli0:
+	xclose(c0);
+close_srv:
+	xclose(s);
+}
+
+static void test_skb_redir_ingress_crossed(struct test_sockmap_listen *skel,
+					   struct bpf_map *inner_map,
+					   int family, int sotype)
+{
+	int verdict = bpf_program__fd(skel->progs.prog_skb_verdict_ingress);
+	int parser = bpf_program__fd(skel->progs.prog_skb_parser);
+	int peer_map = bpf_map__fd(skel->maps.peer_map);
+	int sock_map = bpf_map__fd(inner_map);
+	int err;
+
+	err = xbpf_prog_attach(parser, sock_map, BPF_SK_SKB_STREAM_PARSER, 0);
+	if (err)
+		return;
+	err = xbpf_prog_attach(verdict, sock_map, BPF_SK_SKB_STREAM_VERDICT, 0);
+	if (err)
+		goto detach;
+
+	redir_ingress_crossed(family, sotype, sock_map, peer_map);
+
+	xbpf_prog_detach2(verdict, sock_map, BPF_SK_SKB_STREAM_VERDICT);
+detach:
+	xbpf_prog_detach2(parser, sock_map, BPF_SK_SKB_STREAM_PARSER);
+}
+
 static void test_msg_redir_to_connected(struct test_sockmap_listen *skel,
 					struct bpf_map *inner_map, int family,
 					int sotype)
@@ -1541,6 +1706,7 @@ static void test_redir(struct test_sockmap_listen *skel, struct bpf_map *map,
 		const char *name;
 	} tests[] = {
 		TEST(test_skb_redir_to_connected),
+		TEST(test_skb_redir_ingress_crossed),
 		TEST(test_skb_redir_to_listening),
 		TEST(test_msg_redir_to_connected),
 		TEST(test_msg_redir_to_listening),
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+#define BATCH_CNT 16
+
+/* type, flags and max_entries are set by the benchmark before loading */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 1);
+	__type(key, __u64);
+	__type(value, __u64);
+} hmap SEC(".maps");
+
+const volatile __u32 nr_keys = 1;
+
+long hits = 0;
+long drops = 0;
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bench_hashmap(void *ctx)
+{
+	__u64 key, one = 1, *val;
+	int i;
+
+	for (i = 0; i < BATCH_CNT; i++) {
+		key = bpf_get_prandom_u32() % nr_keys;
+		val = bpf_map_lookup_elem(&hmap, &key);
+		if (val) {
+			/* retire keys now and then, so that the map churns */
+			if ((__sync_add_and_fetch(val, 1) & 7) == 0)
+				bpf_map_delete_elem(&hmap, &key);
+		} else if (bpf_map_update_elem(&hmap, &key, &one, BPF_NOEXIST)) {
+			__sync_add_and_fetch(&drops, 1);
+		}
+	}
+	__sync_add_and_fetch(&hits, BATCH_CNT);
+	return 0;
+}
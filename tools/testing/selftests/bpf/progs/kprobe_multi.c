@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/bpf.h>
+#include <linux/ptrace.h>
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+
+char _license[] SEC("license") = "GPL";
+
+__u64 kprobe_hits = 0;
+__u64 kprobe_args = 0;
+
+/* Attached to bpf_fentry_test1 to 6 through a kprobe multi link */
+SEC("kprobe/multi")
+int test_kprobe(struct pt_regs *ctx)
+{
+	/* bpf_fentry_test3() takes a char first */
+	__u64 a = PT_REGS_PARM1(ctx) & 0xff;
+
+	__sync_fetch_and_add(&kprobe_hits, 1);
+	/* first arguments passed by bpf_prog_test_run() */
+	if (a == 1 || a == 2 || a == 4 || a == 7 || a == 11 || a == 16)
+		__sync_fetch_and_add(&kprobe_args, 1);
+	return 0;
+}
+
+/* Test run calls bpf_fentry_test1 to 8, it is never attached */
+SEC("fentry/bpf_fentry_test1")
+int BPF_PROG(trigger)
+{
+	return 0;
+}
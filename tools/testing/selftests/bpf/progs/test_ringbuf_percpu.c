@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+struct sample {
+	int cpu;
+	int seq;
+};
+
+struct ringbuf_map {
+	__uint(type, BPF_MAP_TYPE_PERCPU_RINGBUF);
+	__uint(max_entries, 1 << 12);
+} ringbuf SEC(".maps"),
+  ringbuf_batch SEC(".maps");
+
+/* inputs */
+int pid = 0;
+int batch = 0;
+
+/* outputs */
+long total = 0;
+long dropped = 0;
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int test_ringbuf_percpu(void *ctx)
+{
+	int cur_pid = bpf_get_current_pid_tgid() >> 32;
+	struct sample *sample;
+
+	if (cur_pid != pid)
+		return 0;
+
+	if (batch)
+		sample = bpf_ringbuf_reserve(&ringbuf_batch, sizeof(*sample), 0);
+	else
+		sample = bpf_ringbuf_reserve(&ringbuf, sizeof(*sample), 0);
+	if (!sample) {
+		dropped += 1;
+		return 1;
+	}
+
+	sample->cpu = bpf_get_smp_processor_id();
+	sample->seq = total;
+	total += 1;
+
+	bpf_ringbuf_submit(sample, 0);
+
+	return 0;
+}
@@ -28,6 +28,14 @@ struct {
 	__type(value, unsigned int);
 } verdict_map SEC(".maps");
 
+/* socket cookie to the sock_map/sock_hash key of its peer */
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 2);
+	__type(key, __u64);
+	__type(value, __u32);
+} peer_map SEC(".maps");
+
 static volatile bool test_sockmap; /* toggled by user-space */
 
 SEC("sk_skb/stream_parser")
@@ -55,6 +63,32 @@ int prog_skb_verdict(struct __sk_buff *skb)
 	return verdict;
 }
 
+SEC("sk_skb/stream_verdict")
+int prog_skb_verdict_ingress(struct __sk_buff *skb)
+{
+	__u64 cookie = bpf_get_socket_cookie(skb);
+	unsigned int *count;
+	__u32 *peer;
+	int verdict;
+
+	peer = bpf_map_lookup_elem(&peer_map, &cookie);
+	if (!peer)
+		return SK_DROP;
+
+	if (test_sockmap)
+		verdict = bpf_sk_redirect_map(skb, &sock_map, *peer,
+					      BPF_F_INGRESS);
+	else
+		verdict = bpf_sk_redirect_hash(skb, &sock_hash, peer,
+					       BPF_F_INGRESS);
+
+	count = bpf_map_lookup_elem(&verdict_map, &verdict);
+	if (count)
+		(*count)++;
+
+	return verdict;
+}
+
 SEC("sk_msg")
 int prog_msg_verdict(struct sk_msg_md *msg)
 {
@@ -23,6 +23,7 @@
 
 #define LOCAL_FREE_TARGET	(128)
 #define PERCPU_FREE_TARGET	(4)
+#define APPROX_NR_SCANS		(16)
 
 static int nr_cpus;
 
@@ -867,6 +868,83 @@ static void test_lru_sanity8(int map_type, int map_flags)
 	printf("Pass\n");
 }
 
+/* Approximate LRU (BPF_F_LRU_APPROX), size of the map is 2*tgt_free
+ * Insert 1 to 2*tgt_free (+2*tgt_free keys)
+ *   => No key is evicted while another CPU still has free nodes
+ * Lookup 1 to APPROX_NR_SCANS/2
+ * Insert 1+2*tgt_free to 3*tgt_free (+tgt_free keys)
+ *   => The CLOCK hand gives the looked up keys a second chance and
+ *      evicts the oldest tgt_free keys after them
+ */
+static void test_lru_sanity9(int map_type, unsigned int tgt_free)
+{
+	unsigned long long key, end_key, value[nr_cpus];
+	int map_flags = BPF_F_LRU_APPROX;
+	int lru_map_fd, expected_map_fd;
+	unsigned int nr_ref = APPROX_NR_SCANS / 2;
+	unsigned int map_size = 2 * tgt_free;
+	int next_cpu = 0;
+
+	printf("%s (map_type:%d map_flags:0x%X): ", __func__, map_type,
+	       map_flags);
+
+	assert(sched_next_online(0, &next_cpu) != -1);
+
+	assert(create_map(map_type, map_flags | BPF_F_NO_COMMON_LRU,
+			  map_size) == -1 && errno == EINVAL);
+
+	lru_map_fd = create_map(map_type, map_flags, map_size);
+	assert(lru_map_fd != -1);
+
+	expected_map_fd = create_map(BPF_MAP_TYPE_HASH, 0, map_size);
+	assert(expected_map_fd != -1);
+
+	value[0] = 1234;
+
+	/* Insert 1 to 2*tgt_free, nothing is evicted */
+	end_key = 1 + map_size;
+	for (key = 1; key < end_key; key++)
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+	for (key = 1; key < end_key; key++)
+		assert(!bpf_map_lookup_elem(lru_map_fd, &key, value));
+
+	/* Lookup 1 to APPROX_NR_SCANS/2 */
+	end_key = 1 + nr_ref;
+	for (key = 1; key < end_key; key++) {
+		assert(!bpf_map_lookup_elem_with_ref_bit(lru_map_fd, key, value));
+		assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+					    BPF_NOEXIST));
+	}
+
+	/* Keys 1+APPROX_NR_SCANS/2+tgt_free to 2*tgt_free survive */
+	key = 1 + nr_ref + tgt_free;
+	end_key = 1 + map_size;
+	for (; key < end_key; key++)
+		assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+					    BPF_NOEXIST));
+
+	/* Insert 1+2*tgt_free to 3*tgt_free
+	 * => 1+APPROX_NR_SCANS/2 to APPROX_NR_SCANS/2+tgt_free will be
+	 * removed by the CLOCK hand
+	 */
+	key = 1 + map_size;
+	end_key = key + tgt_free;
+	for (; key < end_key; key++) {
+		assert(!bpf_map_update_elem(lru_map_fd, &key, value,
+					    BPF_NOEXIST));
+		assert(!bpf_map_update_elem(expected_map_fd, &key, value,
+					    BPF_NOEXIST));
+	}
+
+	assert(map_equal(lru_map_fd, expected_map_fd));
+
+	close(expected_map_fd);
+	close(lru_map_fd);
+
+	printf("Pass\n");
+}
+
 int main(int argc, char **argv)
 {
 	int map_types[] = {BPF_MAP_TYPE_LRU_HASH,
@@ -899,5 +977,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	for (t = 0; t < sizeof(map_types) / sizeof(*map_types); t++)
+		test_lru_sanity9(map_types[t], LOCAL_FREE_TARGET);
+
 	return 0;
 }
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure blk-mq tag allocation throughput with null_blk.
+ *
+ * null_blk is loaded with a single deep hardware queue that completes the
+ * requests inline, so that the cost of a read is mostly the allocation and
+ * freeing of its request and tag. N threads then keep reading random 4KiB
+ * blocks of /dev/nullb0 with O_DIRECT, all of them sharing the tag map of
+ * the one hardware queue, and the reads per second are reported for each
+ * number of threads.
+ *
+ * The per-cpu tag caches are only used when the queue depth is at least
+ * 32 times the number of possible CPUs, so the depth is raised accordingly.
+ * The test is skipped if null_blk is in use or cannot be loaded.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kselftest.h"
+
+#define NULLB_DEV		"/dev/nullb0"
+#define NULLB_GB		1
+#define BENCH_MAX_THREADS	32
+#define BENCH_BLOCK		4096
+#define BENCH_SECONDS		1
+
+static volatile bool stop;
+static int dev_fd;
+
+struct reader {
+	pthread_t tid;
+	unsigned int seed;
+	unsigned long long reads;
+	int err;
+};
+
+static void *reader(void *arg)
+{
+	const off_t nr_blocks = ((off_t)NULLB_GB << 30) / BENCH_BLOCK;
+	struct reader *r = arg;
+	void *buf;
+
+	if (posix_memalign(&buf, BENCH_BLOCK, BENCH_BLOCK)) {
+		r->err = ENOMEM;
+		return NULL;
+	}
+
+	while (!stop) {
+		off_t off = (rand_r(&r->seed) % nr_blocks) * BENCH_BLOCK;
+
+		if (pread(dev_fd, buf, BENCH_BLOCK, off) != BENCH_BLOCK) {
+			r->err = errno;
+			break;
+		}
+		r->reads++;
+	}
+	free(buf);
+	return NULL;
+}
+
+static int run(int nr_threads)
+{
+	struct reader threads[BENCH_MAX_THREADS] = {};
+	unsigned long long reads = 0;
+	struct timespec start, end;
+	double secs;
+	int i, ret = 0;
+
+	stop = false;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].seed = i + 1;
+		if (pthread_create(&threads[i].tid, NULL, reader, &threads[i]))
+			ksft_exit_fail_msg("Failed to create reader\n");
+	}
+
+	sleep(BENCH_SECONDS);
+	stop = true;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		reads += threads[i].reads;
+		if (threads[i].err) {
+			ksft_print_msg("%s - read failed\n",
+				       strerror(threads[i].err));
+			ret = -1;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	ksft_print_msg("threads %2d: %10.0f reads/s\n", nr_threads,
+		       reads / secs);
+	return ret;
+}
+
+static int unload_null_blk(void)
+{
+	if (system("rmmod null_blk")) {
+		ksft_print_msg("Failed to unload null_blk\n");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long nr_possible = sysconf(_SC_NPROCESSORS_CONF);
+	int depth = 32 * nr_possible, nr_threads, ret = 0;
+	char cmd[256];
+
+	ksft_print_header();
+
+	if (depth < 1024)
+		depth = 1024;
+
+	if (!access(NULLB_DEV, F_OK))
+		ksft_exit_skip("null_blk already loaded\n");
+	snprintf(cmd, sizeof(cmd),
+		 "modprobe null_blk nr_devices=1 queue_mode=2 irqmode=0 submit_queues=1 hw_queue_depth=%d gb=%d",
+		 depth, NULLB_GB);
+	if (system(cmd))
+		ksft_exit_skip("Cannot load null_blk\n");
+
+	dev_fd = open(NULLB_DEV, O_RDONLY | O_DIRECT);
+	if (dev_fd < 0) {
+		int err = errno;
+
+		unload_null_blk();
+		ksft_exit_fail_msg("%s: %s\n", NULLB_DEV, strerror(err));
+	}
+	ksft_print_msg("hw_queue_depth %d, %ld possible CPUs\n", depth,
+		       nr_possible);
+
+	for (nr_threads = 1; nr_threads <= BENCH_MAX_THREADS &&
+	     nr_threads <= nr_cpus; nr_threads *= 2) {
+		if (run(nr_threads))
+			ret = -1;
+	}
+
+	close(dev_fd);
+	if (unload_null_blk())
+		ret = -1;
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
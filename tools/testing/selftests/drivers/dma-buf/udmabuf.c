@@ -8,6 +8,7 @@
 #include <malloc.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <linux/memfd.h>
 #include <linux/udmabuf.h>
@@ -23,7 +24,9 @@ static int memfd_create(const char *name, unsigned int flags)
 int main(int argc, char *argv[])
 {
 	struct udmabuf_create create;
-	int devfd, memfd, buf, ret;
+	int devfd, memfd, filefd, buf, ret;
+	char filename[] = "udmabuf-test-XXXXXX";
+	char page[64];
 	off_t size;
 	void *mem;
 
@@ -95,8 +98,68 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	fprintf(stderr, "%s: ok\n", TEST_PREFIX);
 	close(buf);
+
+	/* should fail (regular file without UDMABUF_FLAGS_FILE) */
+	filefd = mkstemp(filename);
+	memset(page, 0x5a, sizeof(page));
+	if (filefd < 0 || write(filefd, page, sizeof(page)) != sizeof(page) ||
+	    ftruncate(filefd, getpagesize())) {
+		printf("%s: [FAIL,file-create]\n", TEST_PREFIX);
+		exit(1);
+	}
+	close(filefd);
+	filefd = open(filename, O_RDONLY);
+	if (filefd < 0) {
+		printf("%s: [FAIL,file-open]\n", TEST_PREFIX);
+		exit(1);
+	}
+	create.memfd  = filefd;
+	create.offset = 0;
+	create.size   = getpagesize();
+	buf = ioctl(devfd, UDMABUF_CREATE, &create);
+	if (buf >= 0) {
+		printf("%s: [FAIL,test-5]\n", TEST_PREFIX);
+		exit(1);
+	}
+
+	/* should work, unless the kernel predates UDMABUF_FLAGS_FILE */
+	create.flags  = UDMABUF_FLAGS_FILE;
+	buf = ioctl(devfd, UDMABUF_CREATE, &create);
+	if (buf < 0 && (errno == EINVAL || errno == EBADFD)) {
+		printf("%s: [skip,no-file-flag-or-fs]\n", TEST_PREFIX);
+		goto out;
+	}
+	if (buf < 0) {
+		printf("%s: [FAIL,test-6]\n", TEST_PREFIX);
+		exit(1);
+	}
+
+	/* the buffer must show the file contents and stay read-only */
+	mem = mmap(NULL, create.size, PROT_READ, MAP_SHARED, buf, 0);
+	if (mem == MAP_FAILED || memcmp(mem, page, sizeof(page))) {
+		printf("%s: [FAIL,test-7]\n", TEST_PREFIX);
+		exit(1);
+	}
+	munmap(mem, create.size);
+	if (mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 buf, 0) != MAP_FAILED) {
+		printf("%s: [FAIL,test-8]\n", TEST_PREFIX);
+		exit(1);
+	}
+
+	/* the file can't be opened for writing while the buffer lives */
+	ret = open(filename, O_WRONLY);
+	if (ret >= 0 || errno != ETXTBSY) {
+		printf("%s: [FAIL,test-9]\n", TEST_PREFIX);
+		exit(1);
+	}
+	close(buf);
+
+out:
+	fprintf(stderr, "%s: ok\n", TEST_PREFIX);
+	close(filefd);
+	unlink(filename);
 	close(memfd);
 	close(devfd);
 	return 0;
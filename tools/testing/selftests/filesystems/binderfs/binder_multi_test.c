@@ -0,0 +1,372 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Test BC_TRANSACTION_MULTI.
+ *
+ * A server process registers as context manager on a private binderfs
+ * device and reports every transaction it receives over a pipe. The client
+ * sends a valid batch of one-way transactions, which must all arrive, and
+ * batches with one bad entry, which must be refused as a whole without any
+ * entry arriving.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/android/binder.h>
+#include <linux/android/binderfs.h>
+
+#include "../../kselftest.h"
+
+/* Not in the uapi header, see drivers/android/binder_internal.h */
+struct binder_transaction_multi {
+	binder_size_t		count;
+	binder_uintptr_t	txns;
+};
+
+#define BC_TRANSACTION_MULTI	_IOW('c', 19, struct binder_transaction_multi)
+
+#define MULTI_MAP_SIZE		(1024 * 1024)
+#define MULTI_COUNT		4
+#define MULTI_BAD_HANDLE	42
+#define MULTI_WAIT_MS		200
+
+static char binderfs_mntpt[] = "/tmp/binderfs_multi_XXXXXX";
+static char device_path[256];
+
+static int binder_open_device(void)
+{
+	struct binder_version version = { 0 };
+	void *map;
+	int fd;
+
+	fd = open(device_path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, MULTI_MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer = (binder_uintptr_t)(uintptr_t)wbuf,
+		.write_size = wsize,
+		.read_buffer = (binder_uintptr_t)(uintptr_t)rbuf,
+		.read_size = rsize,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+/* Write one byte to @report_fd per transaction received */
+static void run_server(int ready_fd, int report_fd)
+{
+	uint32_t cmd = BC_ENTER_LOOPER;
+	uint8_t rbuf[512];
+	struct {
+		uint32_t cmd;
+		binder_uintptr_t ptr;
+	} __attribute__((packed)) freebuf;
+	int fd;
+
+	fd = binder_open_device();
+	if (fd < 0 || ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		_exit(EXIT_FAILURE);
+
+	if (write(ready_fd, "1", 1) != 1)
+		_exit(EXIT_FAILURE);
+	close(ready_fd);
+
+	if (binder_write_read(fd, &cmd, sizeof(cmd), NULL, 0, NULL))
+		_exit(EXIT_FAILURE);
+
+	for (;;) {
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed))
+			_exit(EXIT_FAILURE);
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd);
+
+			if (cmd == BR_TRANSACTION) {
+				struct binder_transaction_data txn;
+
+				memcpy(&txn, rbuf + pos, sizeof(txn));
+				freebuf.cmd = BC_FREE_BUFFER;
+				freebuf.ptr = txn.data.ptr.buffer;
+				if (binder_write_read(fd, &freebuf,
+						      sizeof(freebuf), NULL, 0,
+						      NULL) ||
+				    write(report_fd, "t", 1) != 1)
+					_exit(EXIT_FAILURE);
+			}
+			pos += _IOC_SIZE(cmd);
+		}
+	}
+}
+
+/* Count the transactions the server reports within MULTI_WAIT_MS */
+static int received(int report_fd, int expected)
+{
+	struct pollfd pfd = { .fd = report_fd, .events = POLLIN };
+	int n = 0;
+	char c;
+
+	while (poll(&pfd, 1, n < expected ? -1 : MULTI_WAIT_MS) == 1) {
+		if (read(report_fd, &c, 1) != 1)
+			return -1;
+		n++;
+	}
+
+	return n;
+}
+
+static int send_multi(int fd, struct binder_transaction_data *txns,
+		      int count)
+{
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_multi multi;
+	} __attribute__((packed)) wbuf = {
+		.cmd = BC_TRANSACTION_MULTI,
+		.multi = {
+			.count = count,
+			.txns = (binder_uintptr_t)(uintptr_t)txns,
+		},
+	};
+	int completed = 0;
+
+	if (binder_write_read(fd, &wbuf, sizeof(wbuf), NULL, 0, NULL))
+		return -errno;
+
+	/* Each entry gets its own BR_TRANSACTION_COMPLETE */
+	while (completed < count) {
+		uint8_t rbuf[64];
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed))
+			return -errno;
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			uint32_t cmd;
+
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd) + _IOC_SIZE(cmd);
+			if (cmd == BR_TRANSACTION_COMPLETE)
+				completed++;
+			else if (cmd == BR_FAILED_REPLY ||
+				 cmd == BR_DEAD_REPLY)
+				return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+static void init_txns(struct binder_transaction_data *txns)
+{
+	int i;
+
+	memset(txns, 0, MULTI_COUNT * sizeof(*txns));
+	for (i = 0; i < MULTI_COUNT; i++) {
+		txns[i].target.handle = 0;
+		txns[i].flags = TF_ONE_WAY;
+	}
+}
+
+static void test_valid(int fd, int report_fd)
+{
+	struct binder_transaction_data txns[MULTI_COUNT];
+	int ret, n;
+
+	init_txns(txns);
+	ret = send_multi(fd, txns, MULTI_COUNT);
+	if (ret) {
+		ksft_test_result_fail("valid batch: %s\n", strerror(-ret));
+		return;
+	}
+
+	n = received(report_fd, MULTI_COUNT);
+	if (n != MULTI_COUNT) {
+		ksft_test_result_fail("valid batch: %d of %d received\n", n,
+				      MULTI_COUNT);
+		return;
+	}
+	ksft_test_result_pass("valid batch\n");
+}
+
+/* Break the entry in the middle of a batch in some way */
+static void test_invalid(int fd, int report_fd, const char *name,
+			 void (*spoil)(struct binder_transaction_data *))
+{
+	struct binder_transaction_data txns[MULTI_COUNT];
+	int ret, n;
+
+	init_txns(txns);
+	spoil(&txns[MULTI_COUNT / 2]);
+
+	ret = send_multi(fd, txns, MULTI_COUNT);
+	if (ret != -EINVAL) {
+		ksft_test_result_fail("%s: returned %d, expected %d\n", name,
+				      ret, -EINVAL);
+		return;
+	}
+
+	n = received(report_fd, 0);
+	if (n) {
+		ksft_test_result_fail("%s: %d entries sent before the bad one\n",
+				      name, n);
+		return;
+	}
+	ksft_test_result_pass("%s\n", name);
+}
+
+static void spoil_oneway(struct binder_transaction_data *txn)
+{
+	txn->flags = 0;
+}
+
+static void spoil_handle(struct binder_transaction_data *txn)
+{
+	txn->target.handle = MULTI_BAD_HANDLE;
+}
+
+static void spoil_offsets(struct binder_transaction_data *txn)
+{
+	txn->offsets_size = 1;
+}
+
+static int run_client(int report_fd)
+{
+	int fd;
+
+	fd = binder_open_device();
+	if (fd < 0) {
+		ksft_print_msg("%s - Failed to open %s\n", strerror(errno),
+			       device_path);
+		return -1;
+	}
+
+	ksft_set_plan(4);
+	test_valid(fd, report_fd);
+	test_invalid(fd, report_fd, "two-way entry", spoil_oneway);
+	test_invalid(fd, report_fd, "invalid handle", spoil_handle);
+	test_invalid(fd, report_fd, "unaligned offsets", spoil_offsets);
+
+	close(fd);
+	return ksft_get_fail_cnt() ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct binderfs_device device = { .name = "multi" };
+	int fd, readyfd[2], reportfd[2], status, ret = KSFT_FAIL;
+	char control[256];
+	pid_t server;
+	char c;
+
+	ksft_print_header();
+
+	if (geteuid() != 0)
+		ksft_exit_skip("Needs root to mount binderfs\n");
+
+	if (unshare(CLONE_NEWNS) ||
+	    mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL))
+		ksft_exit_fail_msg("%s - Failed to set up mount namespace\n",
+				   strerror(errno));
+
+	if (!mkdtemp(binderfs_mntpt))
+		ksft_exit_fail_msg("%s - Failed to create mountpoint\n",
+				   strerror(errno));
+
+	if (mount(NULL, binderfs_mntpt, "binder", 0, 0)) {
+		rmdir(binderfs_mntpt);
+		if (errno == ENODEV)
+			ksft_exit_skip("binderfs missing\n");
+		ksft_exit_fail_msg("%s - Failed to mount binderfs\n",
+				   strerror(errno));
+	}
+
+	snprintf(control, sizeof(control), "%s/binder-control",
+		 binderfs_mntpt);
+	fd = open(control, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || ioctl(fd, BINDER_CTL_ADD, &device) < 0) {
+		ksft_print_msg("%s - Failed to allocate binder device\n",
+			       strerror(errno));
+		goto out_umount;
+	}
+	close(fd);
+	snprintf(device_path, sizeof(device_path), "%s/%s", binderfs_mntpt,
+		 device.name);
+
+	if (pipe(readyfd) || pipe(reportfd))
+		goto out_umount;
+
+	server = fork();
+	if (server < 0)
+		goto out_umount;
+	if (server == 0) {
+		close(readyfd[0]);
+		close(reportfd[0]);
+		run_server(readyfd[1], reportfd[1]);
+	}
+
+	close(readyfd[1]);
+	close(reportfd[1]);
+	if (read(readyfd[0], &c, 1) != 1) {
+		ksft_print_msg("Server failed to become context manager\n");
+		goto out_kill;
+	}
+	close(readyfd[0]);
+
+	if (!run_client(reportfd[0]))
+		ret = KSFT_PASS;
+
+out_kill:
+	kill(server, SIGKILL);
+	waitpid(server, &status, 0);
+out_umount:
+	umount2(binderfs_mntpt, MNT_DETACH);
+	rmdir(binderfs_mntpt);
+	return ret;
+}
@@ -0,0 +1,335 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure binder one-way transaction throughput against the number of
+ * sending threads in a single process.
+ *
+ * A server process registers as context manager on a private binderfs
+ * device and frees every buffer it receives. A client process then sends
+ * empty one-way transactions to handle 0 from 1, 2, 4, ... threads sharing
+ * one binder fd for a fixed amount of time and reports transactions per
+ * second for each thread count.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/android/binder.h>
+#include <linux/android/binderfs.h>
+
+#include "../../kselftest.h"
+
+#define BENCH_MAP_SIZE		(1024 * 1024)
+#define BENCH_MAX_THREADS	32
+#define BENCH_SERVER_THREADS	4
+#define BENCH_SECONDS		2
+
+static char binderfs_mntpt[] = "/tmp/binderfs_bench_XXXXXX";
+static char device_path[256];
+
+static int binder_fd;
+static volatile bool bench_stop;
+
+struct bench_thread {
+	pthread_t tid;
+	unsigned long long sent;
+	unsigned long long retried;
+	int err;
+};
+
+static int binder_open_device(void)
+{
+	struct binder_version version = { 0 };
+	void *map;
+	int fd;
+
+	fd = open(device_path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, BENCH_MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer = (binder_uintptr_t)(uintptr_t)wbuf,
+		.write_size = wsize,
+		.read_buffer = (binder_uintptr_t)(uintptr_t)rbuf,
+		.read_size = rsize,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+static void *server_loop(void *arg)
+{
+	uint32_t cmd = (uintptr_t)arg;
+	uint8_t rbuf[512];
+	struct {
+		uint32_t cmd;
+		binder_uintptr_t ptr;
+	} __attribute__((packed)) freebuf[8];
+
+	if (binder_write_read(binder_fd, &cmd, sizeof(cmd), NULL, 0, NULL))
+		return NULL;
+
+	for (;;) {
+		size_t consumed, pos = 0, nfree = 0;
+
+		if (binder_write_read(binder_fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed))
+			return NULL;
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd);
+
+			if (cmd == BR_TRANSACTION) {
+				struct binder_transaction_data txn;
+
+				memcpy(&txn, rbuf + pos, sizeof(txn));
+				freebuf[nfree].cmd = BC_FREE_BUFFER;
+				freebuf[nfree].ptr = txn.data.ptr.buffer;
+				nfree++;
+			}
+			pos += _IOC_SIZE(cmd);
+		}
+
+		if (nfree && binder_write_read(binder_fd, freebuf,
+					       nfree * sizeof(freebuf[0]),
+					       NULL, 0, NULL))
+			return NULL;
+	}
+
+	return NULL;
+}
+
+static void run_server(int ready_fd)
+{
+	pthread_t tid;
+	int i;
+
+	binder_fd = binder_open_device();
+	if (binder_fd < 0 || ioctl(binder_fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		_exit(EXIT_FAILURE);
+
+	for (i = 1; i < BENCH_SERVER_THREADS; i++)
+		pthread_create(&tid, NULL, server_loop,
+			       (void *)(uintptr_t)BC_REGISTER_LOOPER);
+
+	/* Tell the client the context manager exists. */
+	if (write(ready_fd, "1", 1) != 1)
+		_exit(EXIT_FAILURE);
+	close(ready_fd);
+
+	server_loop((void *)(uintptr_t)BC_ENTER_LOOPER);
+	_exit(EXIT_FAILURE);
+}
+
+static void *client_loop(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct {
+		uint32_t cmd;
+		struct binder_transaction_data txn;
+	} __attribute__((packed)) wbuf = {
+		.cmd = BC_TRANSACTION,
+		.txn = {
+			.target.handle = 0,
+			.flags = TF_ONE_WAY,
+		},
+	};
+	uint8_t rbuf[64];
+
+	while (!bench_stop) {
+		size_t consumed, pos = 0;
+		bool failed = false;
+
+		if (binder_write_read(binder_fd, &wbuf, sizeof(wbuf),
+				      rbuf, sizeof(rbuf), &consumed)) {
+			bt->err = errno;
+			return NULL;
+		}
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			uint32_t cmd;
+
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd) + _IOC_SIZE(cmd);
+			if (cmd == BR_FAILED_REPLY)
+				failed = true;
+		}
+
+		/*
+		 * The async buffer space of the server is exhausted; back off
+		 * and let it catch up instead of counting the failure.
+		 */
+		if (failed) {
+			bt->retried++;
+			sched_yield();
+			continue;
+		}
+		bt->sent++;
+	}
+
+	return NULL;
+}
+
+static int run_client(void)
+{
+	struct bench_thread threads[BENCH_MAX_THREADS];
+	int nthreads, max_threads, i;
+
+	binder_fd = binder_open_device();
+	if (binder_fd < 0) {
+		ksft_print_msg("%s - Failed to open %s\n", strerror(errno),
+			       device_path);
+		return -1;
+	}
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+	if (max_threads > BENCH_MAX_THREADS)
+		max_threads = BENCH_MAX_THREADS;
+
+	for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+		unsigned long long sent = 0, retried = 0;
+		struct timespec start, end;
+		double secs;
+
+		bench_stop = false;
+		memset(threads, 0, sizeof(threads));
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < nthreads; i++)
+			pthread_create(&threads[i].tid, NULL, client_loop,
+				       &threads[i]);
+
+		sleep(BENCH_SECONDS);
+		bench_stop = true;
+
+		for (i = 0; i < nthreads; i++) {
+			pthread_join(threads[i].tid, NULL);
+			if (threads[i].err) {
+				ksft_print_msg("%s - BINDER_WRITE_READ failed\n",
+					       strerror(threads[i].err));
+				return -1;
+			}
+			sent += threads[i].sent;
+			retried += threads[i].retried;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		secs = (end.tv_sec - start.tv_sec) +
+		       (end.tv_nsec - start.tv_nsec) / 1e9;
+		ksft_print_msg("threads %2d: %10.0f txn/s (%llu sent, %llu retried)\n",
+			       nthreads, sent / secs, sent, retried);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct binderfs_device device = { .name = "bench" };
+	char control[256];
+	int fd, pipefd[2], status, ret = KSFT_FAIL;
+	pid_t server;
+	char c;
+
+	if (geteuid() != 0)
+		ksft_exit_skip("Needs root to mount binderfs\n");
+
+	if (unshare(CLONE_NEWNS) ||
+	    mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL))
+		ksft_exit_fail_msg("%s - Failed to set up mount namespace\n",
+				   strerror(errno));
+
+	if (!mkdtemp(binderfs_mntpt))
+		ksft_exit_fail_msg("%s - Failed to create mountpoint\n",
+				   strerror(errno));
+
+	if (mount(NULL, binderfs_mntpt, "binder", 0, 0)) {
+		rmdir(binderfs_mntpt);
+		if (errno == ENODEV)
+			ksft_exit_skip("binderfs missing\n");
+		ksft_exit_fail_msg("%s - Failed to mount binderfs\n",
+				   strerror(errno));
+	}
+
+	snprintf(control, sizeof(control), "%s/binder-control",
+		 binderfs_mntpt);
+	fd = open(control, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || ioctl(fd, BINDER_CTL_ADD, &device) < 0) {
+		ksft_print_msg("%s - Failed to allocate binder device\n",
+			       strerror(errno));
+		goto out_umount;
+	}
+	close(fd);
+	snprintf(device_path, sizeof(device_path), "%s/%s", binderfs_mntpt,
+		 device.name);
+
+	if (pipe(pipefd))
+		goto out_umount;
+
+	server = fork();
+	if (server < 0)
+		goto out_umount;
+	if (server == 0) {
+		close(pipefd[0]);
+		run_server(pipefd[1]);
+	}
+
+	close(pipefd[1]);
+	if (read(pipefd[0], &c, 1) != 1) {
+		ksft_print_msg("Server failed to become context manager\n");
+		goto out_kill;
+	}
+	close(pipefd[0]);
+
+	if (!run_client())
+		ret = KSFT_PASS;
+
+out_kill:
+	kill(server, SIGKILL);
+	waitpid(server, &status, 0);
+out_umount:
+	umount2(binderfs_mntpt, MNT_DETACH);
+	rmdir(binderfs_mntpt);
+	return ret;
+}
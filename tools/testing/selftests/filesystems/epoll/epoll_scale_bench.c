@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure epoll event delivery throughput against the number of threads.
+ *
+ * N producer threads keep signalling their own set of eventfds while N
+ * consumer threads harvest them with epoll_wait() and read the counters
+ * back. Two setups are measured for each thread count:
+ *
+ *   shared: one epoll instance waited on by every consumer
+ *   excl:   one epoll instance per consumer, every eventfd added to all of
+ *           them with EPOLLEXCLUSIVE
+ *
+ * For each run the events per second and the average number of events a
+ * single epoll_wait() call returned (how well wakeups were batched) are
+ * reported. After the producers stop, the consumers must drain every
+ * eventfd; a count left behind means a wakeup was lost and fails the run.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kselftest.h"
+
+#define BENCH_MAX_THREADS	32
+#define BENCH_FDS_PER_THREAD	16
+#define BENCH_MAX_EVENTS	64
+#define BENCH_SECONDS		1
+#define BENCH_DRAIN_MS		200
+
+static int efds[BENCH_MAX_THREADS * BENCH_FDS_PER_THREAD];
+static int epfds[BENCH_MAX_THREADS];
+static int nr_fds;
+static volatile bool producers_stop;
+static volatile bool consumers_stop;
+
+struct bench_thread {
+	pthread_t tid;
+	int idx;
+	int epfd;
+	unsigned long long count;
+	unsigned long long waits;
+	int err;
+};
+
+static void *producer(void *arg)
+{
+	struct bench_thread *t = arg;
+	uint64_t one = 1;
+	int i = 0;
+
+	while (!producers_stop) {
+		int fd = efds[t->idx * BENCH_FDS_PER_THREAD + i];
+
+		if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+			t->err = errno;
+			break;
+		}
+		t->count++;
+		i = (i + 1) % BENCH_FDS_PER_THREAD;
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct bench_thread *t = arg;
+	struct epoll_event events[BENCH_MAX_EVENTS];
+
+	for (;;) {
+		int i, n;
+
+		n = epoll_wait(t->epfd, events, BENCH_MAX_EVENTS,
+			       BENCH_DRAIN_MS);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			t->err = errno;
+			break;
+		}
+		if (!n) {
+			/* only quit once a full drain period passed idle */
+			if (consumers_stop)
+				break;
+			continue;
+		}
+
+		t->waits++;
+		for (i = 0; i < n; i++) {
+			uint64_t val;
+
+			if (read(events[i].data.fd, &val, sizeof(val)) ==
+			    sizeof(val))
+				t->count += val;
+			else if (errno != EAGAIN)
+				t->err = errno;
+		}
+	}
+
+	return NULL;
+}
+
+static int setup(int nr_threads, bool excl)
+{
+	int i, j;
+
+	nr_fds = nr_threads * BENCH_FDS_PER_THREAD;
+	for (i = 0; i < nr_fds; i++) {
+		efds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (efds[i] < 0)
+			return -1;
+	}
+
+	for (j = 0; j < (excl ? nr_threads : 1); j++) {
+		epfds[j] = epoll_create1(EPOLL_CLOEXEC);
+		if (epfds[j] < 0)
+			return -1;
+
+		for (i = 0; i < nr_fds; i++) {
+			struct epoll_event ev = {
+				.events = EPOLLIN | EPOLLET,
+				.data.fd = efds[i],
+			};
+
+			if (excl)
+				ev.events |= EPOLLEXCLUSIVE;
+			if (epoll_ctl(epfds[j], EPOLL_CTL_ADD, efds[i], &ev))
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void teardown(int nr_threads, bool excl)
+{
+	int i;
+
+	for (i = 0; i < (excl ? nr_threads : 1); i++)
+		close(epfds[i]);
+	for (i = 0; i < nr_fds; i++)
+		close(efds[i]);
+}
+
+static int run(int nr_threads, bool excl)
+{
+	struct bench_thread prod[BENCH_MAX_THREADS] = {};
+	struct bench_thread cons[BENCH_MAX_THREADS] = {};
+	unsigned long long sent = 0, recv = 0, waits = 0, left = 0;
+	struct timespec start, end;
+	double secs;
+	int i, ret = 0;
+
+	if (setup(nr_threads, excl)) {
+		ksft_print_msg("%s - Failed to set up %d threads\n",
+			       strerror(errno), nr_threads);
+		return -1;
+	}
+
+	producers_stop = false;
+	consumers_stop = false;
+
+	for (i = 0; i < nr_threads; i++) {
+		cons[i].idx = i;
+		cons[i].epfd = epfds[excl ? i : 0];
+		if (pthread_create(&cons[i].tid, NULL, consumer, &cons[i]))
+			ksft_exit_fail_msg("Failed to create consumer\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		prod[i].idx = i;
+		if (pthread_create(&prod[i].tid, NULL, producer, &prod[i]))
+			ksft_exit_fail_msg("Failed to create producer\n");
+	}
+
+	sleep(BENCH_SECONDS);
+	producers_stop = true;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(prod[i].tid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	consumers_stop = true;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(cons[i].tid, NULL);
+
+	for (i = 0; i < nr_threads; i++) {
+		sent += prod[i].count;
+		recv += cons[i].count;
+		waits += cons[i].waits;
+		if (prod[i].err || cons[i].err) {
+			ksft_print_msg("%s - I/O error\n",
+				       strerror(prod[i].err ?: cons[i].err));
+			ret = -1;
+		}
+	}
+
+	for (i = 0; i < nr_fds; i++) {
+		uint64_t val;
+
+		if (read(efds[i], &val, sizeof(val)) == sizeof(val))
+			left += val;
+	}
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	ksft_print_msg("%-6s threads %2d: %10.0f events/s, %6.1f events/wait\n",
+		       excl ? "excl" : "shared", nr_threads, recv / secs,
+		       waits ? (double)recv / waits : 0.0);
+
+	if (left || recv != sent) {
+		ksft_print_msg("%llu events sent, %llu received, %llu left behind\n",
+			       sent, recv, left);
+		ret = -1;
+	}
+
+	teardown(nr_threads, excl);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nr_threads, ret = 0;
+
+	ksft_print_header();
+
+	for (nr_threads = 1; nr_threads <= BENCH_MAX_THREADS &&
+	     nr_threads <= nr_cpus; nr_threads *= 2) {
+		if (run(nr_threads, false))
+			ret = -1;
+		if (run(nr_threads, true))
+			ret = -1;
+	}
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
@@ -3315,6 +3315,112 @@ out:
 	return result;
 }
 
+static int emit_test_file_range(const char *mount_dir, struct test_file *file)
+{
+	const size_t max_blocks =
+		INCFS_FILL_RANGE_MAX_SIZE / INCFS_DATA_FILE_BLOCK_SIZE;
+	int block_count = 1 + (file->size - 1) / INCFS_DATA_FILE_BLOCK_SIZE;
+	int range_count = (block_count + max_blocks - 1) / max_blocks;
+	uint8_t *data = malloc((size_t)block_count *
+			       INCFS_DATA_FILE_BLOCK_SIZE);
+	struct incfs_fill_block *ranges =
+		calloc(range_count, sizeof(*ranges));
+	struct incfs_fill_blocks fill_blocks = {
+		.count = range_count,
+		.fill_blocks = ptr_to_u64(ranges),
+	};
+	int result = TEST_FAILURE;
+	int fd = -1;
+	int i;
+
+	TESTCOND(data && ranges);
+	for (i = 0; i < block_count; i++)
+		rnd_buf(data + (size_t)i * INCFS_DATA_FILE_BLOCK_SIZE,
+			INCFS_DATA_FILE_BLOCK_SIZE,
+			get_file_block_seed(file->index, i));
+
+	for (i = 0; i < range_count; i++) {
+		off_t start = (off_t)i * INCFS_FILL_RANGE_MAX_SIZE;
+
+		ranges[i] = (struct incfs_fill_block){
+			.block_index = i * max_blocks,
+			.data_len = min(INCFS_FILL_RANGE_MAX_SIZE,
+					file->size - start),
+			.data = ptr_to_u64(data + start),
+			.flags = INCFS_BLOCK_FLAGS_RANGE,
+		};
+	}
+
+	TEST(fd = open_file_by_id(mount_dir, file->id, true), fd != -1);
+
+	/* Ranges can only hold uncompressed blocks */
+	ranges[0].compression = COMPRESSION_LZ4;
+	TESTEQUAL(ioctl(fd, INCFS_IOC_FILL_BLOCKS, &fill_blocks), -1);
+	TESTEQUAL(errno, EINVAL);
+	ranges[0].compression = COMPRESSION_NONE;
+
+	TESTEQUAL(ioctl(fd, INCFS_IOC_FILL_BLOCKS, &fill_blocks), range_count);
+	result = TEST_SUCCESS;
+out:
+	close(fd);
+	free(ranges);
+	free(data);
+	return result;
+}
+
+static int fill_range_test(const char *mount_dir)
+{
+	int result = TEST_FAILURE;
+	char *backing_dir;
+	char *filename = NULL;
+	int cmd_fd = -1;
+	int fd = -1;
+	int i;
+	struct test_files_set test = get_test_files_set();
+
+	TEST(backing_dir = create_backing_dir(mount_dir), backing_dir);
+	TESTEQUAL(mount_fs_opt(mount_dir, backing_dir, "readahead=0", false),
+		  0);
+	TEST(cmd_fd = open_commands_file(mount_dir), cmd_fd != -1);
+
+	for (i = 0; i < test.files_count; ++i) {
+		struct test_file *file = &test.files[i];
+		int block_count = 1 + (file->size - 1) /
+					INCFS_DATA_FILE_BLOCK_SIZE;
+		struct incfs_get_block_count_args bca = {};
+
+		TESTEQUAL(emit_file(cmd_fd, NULL, file->name, &file->id,
+				    file->size, NULL),
+			  0);
+
+		/* Blocks that are already present must be left alone */
+		if (block_count > 1)
+			TESTEQUAL(emit_test_block(mount_dir, file, 1), 0);
+
+		TESTEQUAL(emit_test_file_range(mount_dir, file), TEST_SUCCESS);
+		TESTEQUAL(validate_test_file_content(mount_dir, file), 0);
+
+		TEST(filename = concat_file_name(mount_dir, file->name),
+		     filename);
+		TEST(fd = open(filename, O_RDONLY | O_CLOEXEC), fd != -1);
+		TESTEQUAL(ioctl(fd, INCFS_IOC_GET_BLOCK_COUNT, &bca), 0);
+		TESTEQUAL(bca.filled_data_blocks_out, block_count);
+		close(fd);
+		fd = -1;
+		free(filename);
+		filename = NULL;
+	}
+
+	result = TEST_SUCCESS;
+out:
+	close(fd);
+	free(filename);
+	close(cmd_fd);
+	umount(mount_dir);
+	free(backing_dir);
+	return result;
+}
+
 static int validate_hash_block_count(const char *mount_dir,
 				     const char *backing_dir,
 				     struct test_file *file)
@@ -4721,6 +4827,7 @@ int main(int argc, char *argv[])
 		MAKE_TEST(compatibility_test),
 		MAKE_TEST(data_block_count_test),
 		MAKE_TEST(hash_block_count_test),
+		MAKE_TEST(fill_range_test),
 		MAKE_TEST(per_uid_read_timeouts_test),
 		MAKE_TEST(inotify_test),
 		MAKE_TEST(verity_test),
@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "../kselftest.h"
 
@@ -14,6 +16,12 @@ static int sys_membarrier(int cmd, int flags)
 	return syscall(__NR_membarrier, cmd, flags);
 }
 
+static int sys_membarrier_targets(int cmd, int flags, const void *targets,
+				  unsigned int size)
+{
+	return syscall(__NR_membarrier, cmd, flags, 0, targets, size);
+}
+
 static int test_membarrier_cmd_fail(void)
 {
 	int cmd = -1, flags = 0;
@@ -133,6 +141,56 @@ static int test_membarrier_private_expedited_success(void)
 	return 0;
 }
 
+static int test_membarrier_private_expedited_cpu_mask_success(void)
+{
+	int cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED,
+	    flags = MEMBARRIER_CMD_FLAG_CPU_MASK;
+	const char *test_name = "sys membarrier MEMBARRIER_CMD_PRIVATE_EXPEDITED with CPU mask";
+	cpu_set_t cpus;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		ksft_exit_fail_msg("sched_getaffinity failed: %s\n",
+				   strerror(errno));
+
+	if (sys_membarrier_targets(cmd, flags, &cpus, sizeof(cpus)) != 0) {
+		ksft_exit_fail_msg(
+			"%s test: flags = %d, errno = %d\n",
+			test_name, flags, errno);
+	}
+
+	ksft_test_result_pass(
+		"%s test: flags = %d\n",
+		test_name, flags);
+	return 0;
+}
+
+static int test_membarrier_private_expedited_tids_success(void)
+{
+	int cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED,
+	    flags = MEMBARRIER_CMD_FLAG_TIDS;
+	const char *test_name = "sys membarrier MEMBARRIER_CMD_PRIVATE_EXPEDITED with thread IDs";
+	pid_t tids[2] = { getpid(), syscall(__NR_gettid) };
+
+	if (sys_membarrier_targets(cmd, flags, tids, sizeof(tids)) != 0) {
+		ksft_exit_fail_msg(
+			"%s test: flags = %d, errno = %d\n",
+			test_name, flags, errno);
+	}
+
+	/* the size must be a whole number of thread IDs */
+	if (sys_membarrier_targets(cmd, flags, tids, 1) != -1 ||
+	    errno != EINVAL) {
+		ksft_exit_fail_msg(
+			"%s test: flags = %d, size = 1. Should fail with EINVAL\n",
+			test_name, flags);
+	}
+
+	ksft_test_result_pass(
+		"%s test: flags = %d\n",
+		test_name, flags);
+	return 0;
+}
+
 static int test_membarrier_private_expedited_sync_core_fail(void)
 {
 	int cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, flags = 0;
@@ -261,6 +319,12 @@ static int test_membarrier_success(void)
 	if (status)
 		return status;
 	status = test_membarrier_private_expedited_success();
+	if (status)
+		return status;
+	status = test_membarrier_private_expedited_cpu_mask_success();
+	if (status)
+		return status;
+	status = test_membarrier_private_expedited_tids_success();
 	if (status)
 		return status;
 	status = sys_membarrier(MEMBARRIER_CMD_QUERY, 0);
@@ -681,6 +681,13 @@ static void test_create(void)
 	/* verify MFD_ALLOW_SEALING | MFD_CLOEXEC is allowed */
 	fd = mfd_assert_new("", 0, MFD_ALLOW_SEALING | MFD_CLOEXEC);
 	close(fd);
+
+	/* verify MFD_THP is allowed, but not together with MFD_HUGETLB */
+	if (!hugetlbfs_test) {
+		fd = mfd_assert_new("", 0, MFD_THP | MFD_CLOEXEC);
+		close(fd);
+	}
+	mfd_fail_new("", MFD_THP | MFD_HUGETLB);
 }
 
 /*
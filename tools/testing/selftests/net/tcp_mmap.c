@@ -191,6 +191,8 @@ void *child_thread(void *arg)
 			memset(&zc, 0, sizeof(zc));
 			zc.address = (__u64)((unsigned long)addr);
 			zc.length = chunk_size;
+			zc.copybuf_address = (__u64)((unsigned long)buffer);
+			zc.copybuf_len = chunk_size;
 
 			res = getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
 					 &zc, &zc_len);
@@ -208,6 +210,12 @@ void *child_thread(void *arg)
 				madvise(addr, zc.length, MADV_DONTNEED);
 				total += zc.length;
 			}
+			/* the unaligned tail was copied in the same call */
+			if (zc.copybuf_len > 0) {
+				if (xflg)
+					hash_zone(buffer, zc.copybuf_len);
+				total += zc.copybuf_len;
+			}
 			if (zc.recv_skip_hint) {
 				assert(zc.recv_skip_hint <= chunk_size);
 				lu = read(fd, buffer, zc.recv_skip_hint);
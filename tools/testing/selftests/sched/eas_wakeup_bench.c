@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure the cost of a CFS wake-up with energy aware scheduling on and off.
+ *
+ * Pairs of threads ping-pong a token over pipes, so every round trip is two
+ * wake-ups going through select_task_rq_fair(). With EAS enabled, and the
+ * root domain not overutilized, those wake-ups go through
+ * find_energy_efficient_cpu(). The run is repeated with
+ * /proc/sys/kernel/sched_energy_aware set to 0 and 1, and the average round
+ * trip time is reported for each. The original setting is restored on exit.
+ *
+ * Systems without an Energy Model, or where the sysctl cannot be written,
+ * only get the run with the current setting.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define EAS_SYSCTL		"/proc/sys/kernel/sched_energy_aware"
+#define BENCH_MAX_PAIRS		16
+#define BENCH_ROUNDS		50000
+
+struct pair {
+	pthread_t ping, pong;
+	int to_pong[2];
+	int to_ping[2];
+	int err;
+};
+
+static void *pong(void *arg)
+{
+	struct pair *p = arg;
+	char c;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if (read(p->to_pong[0], &c, 1) != 1 ||
+		    write(p->to_ping[1], &c, 1) != 1) {
+			p->err = errno;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *ping(void *arg)
+{
+	struct pair *p = arg;
+	char c = 0;
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if (write(p->to_pong[1], &c, 1) != 1 ||
+		    read(p->to_ping[0], &c, 1) != 1) {
+			p->err = errno;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int eas_get(void)
+{
+	char buf[16] = {};
+	int fd, ret;
+
+	fd = open(EAS_SYSCTL, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	return ret > 0 ? atoi(buf) : -1;
+}
+
+static int eas_set(int val)
+{
+	char buf[4];
+	int fd, len, ret;
+
+	fd = open(EAS_SYSCTL, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	len = snprintf(buf, sizeof(buf), "%d\n", val);
+	ret = write(fd, buf, len);
+	close(fd);
+	return ret == len && eas_get() == val ? 0 : -1;
+}
+
+static int run(int nr_pairs, int eas)
+{
+	struct pair pairs[BENCH_MAX_PAIRS] = {};
+	struct timespec start, end;
+	double usecs;
+	int i, ret = 0;
+
+	for (i = 0; i < nr_pairs; i++) {
+		if (pipe(pairs[i].to_pong) || pipe(pairs[i].to_ping))
+			ksft_exit_fail_msg("pipe: %s\n", strerror(errno));
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_pairs; i++) {
+		if (pthread_create(&pairs[i].pong, NULL, pong, &pairs[i]) ||
+		    pthread_create(&pairs[i].ping, NULL, ping, &pairs[i]))
+			ksft_exit_fail_msg("Failed to create threads\n");
+	}
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].ping, NULL);
+		pthread_join(pairs[i].pong, NULL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	usecs = (end.tv_sec - start.tv_sec) * 1e6 +
+		(end.tv_nsec - start.tv_nsec) / 1e3;
+	ksft_print_msg("eas %-3s pairs %2d: %8.2f us/round trip\n",
+		       eas < 0 ? "?" : eas ? "on" : "off", nr_pairs,
+		       usecs / BENCH_ROUNDS);
+
+	for (i = 0; i < nr_pairs; i++) {
+		if (pairs[i].err) {
+			ksft_print_msg("%s - pipe I/O failed\n",
+				       strerror(pairs[i].err));
+			ret = -1;
+		}
+		close(pairs[i].to_pong[0]);
+		close(pairs[i].to_pong[1]);
+		close(pairs[i].to_ping[0]);
+		close(pairs[i].to_ping[1]);
+	}
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int orig = eas_get();
+	int nr_pairs, eas, ret = 0;
+
+	ksft_print_header();
+
+	if (orig < 0)
+		ksft_print_msg("%s not available, EAS setting unchanged\n",
+			       EAS_SYSCTL);
+
+	for (eas = 0; eas <= 1; eas++) {
+		if (orig >= 0 && eas_set(eas)) {
+			ksft_print_msg("Cannot set %s to %d\n", EAS_SYSCTL, eas);
+			continue;
+		}
+		for (nr_pairs = 1; nr_pairs <= BENCH_MAX_PAIRS &&
+		     nr_pairs <= nr_cpus; nr_pairs *= 2) {
+			if (run(nr_pairs, orig >= 0 ? eas : orig))
+				ret = -1;
+		}
+		if (orig < 0)
+			break;
+	}
+
+	if (orig >= 0)
+		eas_set(orig);
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
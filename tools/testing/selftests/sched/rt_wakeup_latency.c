@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure the wakeup latency of RT threads that all wake up together, in
+ * the spirit of cyclictest.
+ *
+ * Twice as many SCHED_FIFO threads as CPUs sleep until the same absolute
+ * deadline, run for a short while and sleep until the next period. Every
+ * period therefore overloads some runqueues and has the RT push/pull logic
+ * spread the threads over the CPUs. The latency of a wakeup is how late the
+ * thread starts running after its deadline; the average and the maximum
+ * over all threads are reported.
+ *
+ * The run is repeated with the RT_PUSH_IPI_BATCH scheduler feature off and
+ * on when /sys/kernel/debug/sched_features can be written, and the original
+ * setting is restored on exit. Without CAP_SYS_NICE the test is skipped.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define SCHED_FEATURES		"/sys/kernel/debug/sched_features"
+#define RT_FEATURE		"RT_PUSH_IPI_BATCH"
+#define BENCH_MAX_THREADS	128
+#define BENCH_PERIOD_NS		1000000
+#define BENCH_RUN_NS		50000
+#define BENCH_LOOPS		2000
+#define BENCH_PRIO		80
+
+struct rt_thread {
+	pthread_t tid;
+	struct timespec start;
+	unsigned long long sum_ns;
+	unsigned long long max_ns;
+	int err;
+};
+
+static long long ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void ts_add(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000L) {
+		ts->tv_nsec -= 1000000000L;
+		ts->tv_sec++;
+	}
+}
+
+static void *rt_thread(void *arg)
+{
+	struct rt_thread *t = arg;
+	struct timespec next = t->start, now;
+	int i;
+
+	for (i = 0; i < BENCH_LOOPS; i++) {
+		long long lat;
+		int ret;
+
+		ts_add(&next, BENCH_PERIOD_NS);
+		ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				      NULL);
+		if (ret) {
+			t->err = ret;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		lat = ts_ns(&now) - ts_ns(&next);
+		if (lat < 0)
+			lat = 0;
+		t->sum_ns += lat;
+		if (lat > t->max_ns)
+			t->max_ns = lat;
+
+		/* some work, so that the threads overlap on the runqueues */
+		do {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		} while (ts_ns(&now) - ts_ns(&next) < BENCH_RUN_NS);
+	}
+	return NULL;
+}
+
+/* Return 1 if the feature is on, 0 if off and -1 if it cannot be read */
+static int feature_get(void)
+{
+	char buf[4096] = {}, *tok, *save;
+	int fd, ret;
+
+	fd = open(SCHED_FEATURES, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (ret <= 0)
+		return -1;
+
+	for (tok = strtok_r(buf, " \n", &save); tok;
+	     tok = strtok_r(NULL, " \n", &save)) {
+		if (!strcmp(tok, RT_FEATURE))
+			return 1;
+		if (!strcmp(tok, "NO_" RT_FEATURE))
+			return 0;
+	}
+	return -1;
+}
+
+static int feature_set(int val)
+{
+	const char *str = val ? RT_FEATURE : "NO_" RT_FEATURE;
+	int fd, ret;
+
+	fd = open(SCHED_FEATURES, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, str, strlen(str));
+	close(fd);
+	return ret == (int)strlen(str) && feature_get() == val ? 0 : -1;
+}
+
+static int run(int nr_threads, int batch)
+{
+	struct rt_thread threads[BENCH_MAX_THREADS] = {};
+	struct sched_param param = { .sched_priority = BENCH_PRIO };
+	unsigned long long sum = 0, max = 0;
+	struct timespec start;
+	pthread_attr_t attr;
+	int i, ret = 0;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+
+	/* leave the threads some time to get created before the first period */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ts_add(&start, 100 * BENCH_PERIOD_NS);
+
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].start = start;
+		ret = pthread_create(&threads[i].tid, &attr, rt_thread,
+				     &threads[i]);
+		if (ret == EPERM)
+			ksft_exit_skip("SCHED_FIFO not permitted\n");
+		if (ret)
+			ksft_exit_fail_msg("Failed to create thread: %s\n",
+					   strerror(ret));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i].tid, NULL);
+	pthread_attr_destroy(&attr);
+
+	for (i = 0; i < nr_threads; i++) {
+		if (threads[i].err) {
+			ksft_print_msg("%s - clock_nanosleep failed\n",
+				       strerror(threads[i].err));
+			ret = -1;
+		}
+		sum += threads[i].sum_ns;
+		if (threads[i].max_ns > max)
+			max = threads[i].max_ns;
+	}
+
+	ksft_print_msg("batch %-3s threads %3d: avg %8.2f us, max %8.2f us\n",
+		       batch < 0 ? "?" : batch ? "on" : "off", nr_threads,
+		       sum / 1e3 / ((double)nr_threads * BENCH_LOOPS),
+		       max / 1e3);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nr_threads = 2 * nr_cpus;
+	int orig = feature_get();
+	int batch, ret = 0;
+
+	ksft_print_header();
+
+	if (nr_threads > BENCH_MAX_THREADS)
+		nr_threads = BENCH_MAX_THREADS;
+
+	if (orig < 0)
+		ksft_print_msg("%s not available, %s unchanged\n",
+			       SCHED_FEATURES, RT_FEATURE);
+
+	for (batch = 0; batch <= 1; batch++) {
+		if (orig >= 0 && feature_set(batch)) {
+			ksft_print_msg("Cannot set %s to %d\n", RT_FEATURE,
+				       batch);
+			continue;
+		}
+		if (run(nr_threads, orig >= 0 ? batch : orig))
+			ret = -1;
+		if (orig < 0)
+			break;
+	}
+
+	if (orig >= 0)
+		feature_set(orig);
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
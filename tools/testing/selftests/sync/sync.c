@@ -163,6 +163,57 @@ int sync_fence_count_with_status(int fd, int status)
 	return count;
 }
 
+int sync_waitset_create(void)
+{
+	return open("/dev/sync_waitset", O_RDWR | O_CLOEXEC);
+}
+
+static int sync_waitset_update(int ws, unsigned long cmd, int fd,
+			       uint64_t cookie)
+{
+	struct sync_waitset_fence fence = {};
+	struct sync_waitset_data data = {};
+
+	fence.cookie = cookie;
+	fence.fd = fd;
+	data.ptr = (uint64_t)(unsigned long)&fence;
+	data.count = 1;
+
+	return ioctl(ws, cmd, &data);
+}
+
+int sync_waitset_add(int ws, int fd, uint64_t cookie)
+{
+	return sync_waitset_update(ws, SYNC_IOC_WAITSET_ADD, fd, cookie);
+}
+
+int sync_waitset_remove(int ws, uint64_t cookie)
+{
+	return sync_waitset_update(ws, SYNC_IOC_WAITSET_REMOVE, -1, cookie);
+}
+
+int sync_waitset_read(int ws, uint64_t *cookies, int count)
+{
+	struct sync_waitset_event events[16];
+	struct sync_waitset_data data = {};
+	int i, err;
+
+	if (count > 16)
+		count = 16;
+
+	data.ptr = (uint64_t)(unsigned long)events;
+	data.count = count;
+
+	err = ioctl(ws, SYNC_IOC_WAITSET_READ, &data);
+	if (err < 0)
+		return err;
+
+	for (i = 0; i < (int)data.count; i++)
+		cookies[i] = events[i].cookie;
+
+	return data.count;
+}
+
 int sw_sync_timeline_create(void)
 {
 	return open("/sys/kernel/debug/sync/sw_sync", O_RDWR);
@@ -28,6 +28,8 @@
 #ifndef SELFTESTS_SYNC_H
 #define SELFTESTS_SYNC_H
 
+#include <stdint.h>
+
 #define FENCE_STATUS_ERROR	(-1)
 #define FENCE_STATUS_ACTIVE	(0)
 #define FENCE_STATUS_SIGNALED	(1)
@@ -37,4 +39,9 @@ int sync_merge(const char *name, int fd1, int fd2);
 int sync_fence_size(int fd);
 int sync_fence_count_with_status(int fd, int status);
 
+int sync_waitset_create(void);
+int sync_waitset_add(int ws, int fd, uint64_t cookie);
+int sync_waitset_remove(int ws, uint64_t cookie);
+int sync_waitset_read(int ws, uint64_t *cookies, int count);
+
 #endif
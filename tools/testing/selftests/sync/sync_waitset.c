@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  sync fence waitset tests
+ */
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "sync.h"
+#include "sw_sync.h"
+#include "synctest.h"
+
+#define NUM_FENCES	8
+
+int test_fence_waitset(void)
+{
+	int timeline, ws, fences[NUM_FENCES];
+	uint64_t cookies[NUM_FENCES];
+	int i, ret;
+
+	ws = sync_waitset_create();
+	if (ws < 0) {
+		ksft_print_msg("[SKIP]\t/dev/sync_waitset not available\n");
+		return 0;
+	}
+
+	timeline = sw_sync_timeline_create();
+	for (i = 0; i < NUM_FENCES; i++) {
+		fences[i] = sw_sync_fence_create(timeline, "waitset", i + 1);
+		ret = sync_waitset_add(ws, fences[i], 100 + i);
+		ASSERT(ret == 0, "Failure adding fence to waitset\n");
+	}
+
+	ret = sync_wait(ws, 0);
+	ASSERT(ret == 0, "Waitset ready before any fence signaled\n");
+
+	ret = sync_waitset_remove(ws, 100 + NUM_FENCES - 1);
+	ASSERT(ret == 0, "Failure removing fence from waitset\n");
+	ret = sync_waitset_remove(ws, 100 + NUM_FENCES - 1);
+	ASSERT(ret < 0, "Removed the same fence twice\n");
+
+	/* Signal all but the last two fences in one go */
+	sw_sync_timeline_inc(timeline, NUM_FENCES - 2);
+
+	ret = sync_wait(ws, 100);
+	ASSERT(ret > 0, "Waitset not ready after fences signaled\n");
+
+	ret = sync_waitset_read(ws, cookies, NUM_FENCES);
+	ASSERT(ret == NUM_FENCES - 2, "Wrong number of signaled fences\n");
+	for (i = 0; i < ret; i++)
+		ASSERT(cookies[i] == (uint64_t)(100 + i),
+		       "Fences read out of signaling order\n");
+
+	ret = sync_wait(ws, 0);
+	ASSERT(ret == 0, "Waitset still ready after reading all fences\n");
+	ret = sync_waitset_read(ws, cookies, NUM_FENCES);
+	ASSERT(ret == 0, "Read fences that did not signal\n");
+
+	/* An already signaled fence is ready right away */
+	ret = sync_waitset_add(ws, fences[0], 42);
+	ASSERT(ret == 0, "Failure adding signaled fence to waitset\n");
+	ret = sync_waitset_read(ws, cookies, NUM_FENCES);
+	ASSERT(ret == 1 && cookies[0] == 42,
+	       "Signaled fence not readable after adding\n");
+
+	/* Leave one fence pending when closing the waitset */
+	close(ws);
+
+	for (i = 0; i < NUM_FENCES; i++)
+		sw_sync_fence_destroy(fences[i]);
+	sw_sync_timeline_destroy(timeline);
+
+	return 0;
+}
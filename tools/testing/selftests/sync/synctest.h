@@ -55,6 +55,9 @@ int test_fence_merge_same_fence(void);
 /* Fence wait tests */
 int test_fence_multi_timeline_wait(void);
 
+/* Fence waitset tests */
+int test_fence_waitset(void);
+
 /* Stress test - parallelism */
 int test_stress_two_threads_shared_timeline(void);
 
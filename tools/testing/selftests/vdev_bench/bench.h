@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Sample collection and result lines shared by the virtual device
+ * benchmarks.
+ *
+ * Every result is a single line of key=value pairs after "# bench: ", e.g.
+ *
+ *   # bench: name=binder_twoway unit=ns samples=10000 min=... avg=... p50=...
+ *            p99=... max=...
+ *
+ * (on one line), so that a script can collect the results of a run with
+ * grep "^# bench: " and compare them against those of another kernel.
+ */
+#ifndef __VDEV_BENCH_H
+#define __VDEV_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../kselftest.h"
+
+struct bench_samples {
+	unsigned long long *v;
+	int nr;
+	int max;
+};
+
+static inline unsigned long long bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void bench_samples_init(struct bench_samples *s, int max)
+{
+	s->v = calloc(max, sizeof(*s->v));
+	if (!s->v)
+		ksft_exit_fail_msg("Out of memory\n");
+	s->nr = 0;
+	s->max = max;
+}
+
+static inline void bench_samples_free(struct bench_samples *s)
+{
+	free(s->v);
+	s->v = NULL;
+}
+
+static inline void bench_add(struct bench_samples *s, unsigned long long val)
+{
+	if (s->nr < s->max)
+		s->v[s->nr++] = val;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* @name may carry more key=value pairs, e.g. "dma_heap_alloc heap=system" */
+static inline void bench_report(const char *name, const char *unit,
+				 struct bench_samples *s)
+{
+	unsigned long long sum = 0;
+	int i;
+
+	if (!s->nr)
+		return;
+
+	qsort(s->v, s->nr, sizeof(*s->v), bench_cmp);
+	for (i = 0; i < s->nr; i++)
+		sum += s->v[i];
+
+	ksft_print_msg("bench: name=%s unit=%s samples=%d min=%llu avg=%llu p50=%llu p99=%llu max=%llu\n",
+		       name, unit, s->nr, s->v[0], sum / s->nr,
+		       s->v[s->nr / 2], s->v[(s->nr * 99) / 100],
+		       s->v[s->nr - 1]);
+}
+
+#endif /* __VDEV_BENCH_H */
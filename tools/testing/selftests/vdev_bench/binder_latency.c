@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure binder one-way and two-way transaction latency.
+ *
+ * A server process registers as context manager on a private binderfs
+ * device. For one-way latency the client puts the send time into each
+ * one-way transaction and the server takes the difference on receipt;
+ * the client waits for the server to have seen a transaction before it
+ * sends the next one, so queueing in the async buffer space does not add
+ * up. For two-way latency the client times each transaction until the
+ * empty reply arrives.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/android/binder.h>
+#include <linux/android/binderfs.h>
+
+#include "bench.h"
+
+#define BENCH_MAP_SIZE		(128 * 1024)
+#define BENCH_LOOPS		10000
+#define BENCH_WARMUP		100
+
+/* Shared between client and server */
+struct bench_shared {
+	volatile unsigned long long received;
+	unsigned long long oneway_ns[BENCH_LOOPS + BENCH_WARMUP];
+};
+
+static char binderfs_mntpt[] = "/tmp/binderfs_latency_XXXXXX";
+static char device_path[256];
+static struct bench_shared *shared;
+
+struct bench_payload {
+	unsigned long long sent_ns;
+};
+
+struct bench_txn {
+	uint32_t cmd;
+	struct binder_transaction_data txn;
+} __attribute__((packed));
+
+struct bench_free {
+	uint32_t cmd;
+	binder_uintptr_t ptr;
+} __attribute__((packed));
+
+static int binder_open_device(void)
+{
+	struct binder_version version = { 0 };
+	void *map;
+	int fd;
+
+	fd = open(device_path, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (ioctl(fd, BINDER_VERSION, &version) < 0 ||
+	    version.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, BENCH_MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int binder_write_read(int fd, void *wbuf, size_t wsize,
+			     void *rbuf, size_t rsize, size_t *consumed)
+{
+	struct binder_write_read bwr = {
+		.write_buffer = (binder_uintptr_t)(uintptr_t)wbuf,
+		.write_size = wsize,
+		.read_buffer = (binder_uintptr_t)(uintptr_t)rbuf,
+		.read_size = rsize,
+	};
+	int ret;
+
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+
+	if (consumed)
+		*consumed = bwr.read_consumed;
+	return ret;
+}
+
+static void run_server(int ready_fd)
+{
+	uint32_t cmd = BC_ENTER_LOOPER;
+	uint8_t rbuf[512];
+	int fd;
+
+	fd = binder_open_device();
+	if (fd < 0 || ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0)
+		_exit(EXIT_FAILURE);
+
+	if (write(ready_fd, "1", 1) != 1)
+		_exit(EXIT_FAILURE);
+	close(ready_fd);
+
+	if (binder_write_read(fd, &cmd, sizeof(cmd), NULL, 0, NULL))
+		_exit(EXIT_FAILURE);
+
+	for (;;) {
+		struct {
+			struct bench_free free;
+			struct bench_txn reply;
+		} __attribute__((packed)) wbuf;
+		size_t consumed, pos = 0;
+
+		if (binder_write_read(fd, NULL, 0, rbuf, sizeof(rbuf),
+				      &consumed))
+			_exit(EXIT_FAILURE);
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			struct binder_transaction_data txn;
+			unsigned long long now = bench_now_ns();
+			size_t wsize;
+
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd);
+			if (cmd != BR_TRANSACTION) {
+				pos += _IOC_SIZE(cmd);
+				continue;
+			}
+
+			memcpy(&txn, rbuf + pos, sizeof(txn));
+			pos += sizeof(txn);
+
+			if (txn.flags & TF_ONE_WAY) {
+				unsigned long long n = shared->received;
+				struct bench_payload *p;
+
+				p = (void *)(uintptr_t)txn.data.ptr.buffer;
+				if (n < BENCH_LOOPS + BENCH_WARMUP)
+					shared->oneway_ns[n] = now - p->sent_ns;
+				__atomic_store_n(&shared->received, n + 1,
+						 __ATOMIC_RELEASE);
+			}
+
+			wbuf.free.cmd = BC_FREE_BUFFER;
+			wbuf.free.ptr = txn.data.ptr.buffer;
+			wsize = sizeof(wbuf.free);
+			if (!(txn.flags & TF_ONE_WAY)) {
+				memset(&wbuf.reply, 0, sizeof(wbuf.reply));
+				wbuf.reply.cmd = BC_REPLY;
+				wsize = sizeof(wbuf);
+			}
+			if (binder_write_read(fd, &wbuf, wsize, NULL, 0, NULL))
+				_exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/* Send one transaction and wait for it to complete, or for the reply */
+static int client_transact(int fd, bool oneway)
+{
+	struct bench_payload payload;
+	binder_uintptr_t data = (binder_uintptr_t)(uintptr_t)&payload;
+	struct bench_txn wbuf = {
+		.cmd = BC_TRANSACTION,
+		.txn = {
+			.target.handle = 0,
+			.flags = oneway ? TF_ONE_WAY : 0,
+			.data_size = sizeof(payload),
+			.data.ptr.buffer = data,
+		},
+	};
+	uint8_t rbuf[256];
+	bool done = false;
+	void *w = &wbuf;
+	size_t wsize = sizeof(wbuf);
+
+	payload.sent_ns = bench_now_ns();
+	while (!done) {
+		size_t consumed, pos = 0;
+		struct bench_free freebuf = { .cmd = 0 };
+
+		if (binder_write_read(fd, w, wsize, rbuf, sizeof(rbuf),
+				      &consumed))
+			return -1;
+		w = NULL;
+		wsize = 0;
+
+		while (pos + sizeof(uint32_t) <= consumed) {
+			uint32_t cmd;
+
+			memcpy(&cmd, rbuf + pos, sizeof(cmd));
+			pos += sizeof(cmd);
+
+			switch (cmd) {
+			case BR_TRANSACTION_COMPLETE:
+				if (oneway)
+					done = true;
+				break;
+			case BR_REPLY: {
+				struct binder_transaction_data txn;
+
+				memcpy(&txn, rbuf + pos, sizeof(txn));
+				freebuf.cmd = BC_FREE_BUFFER;
+				freebuf.ptr = txn.data.ptr.buffer;
+				done = true;
+				break;
+			}
+			case BR_DEAD_REPLY:
+			case BR_FAILED_REPLY:
+				errno = EIO;
+				return -1;
+			}
+			pos += _IOC_SIZE(cmd);
+		}
+
+		if (freebuf.cmd &&
+		    binder_write_read(fd, &freebuf, sizeof(freebuf), NULL, 0,
+				      NULL))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int run_client(void)
+{
+	struct bench_samples s;
+	unsigned long long start;
+	int fd, i;
+
+	fd = binder_open_device();
+	if (fd < 0) {
+		ksft_print_msg("%s - Failed to open %s\n", strerror(errno),
+			       device_path);
+		return -1;
+	}
+
+	for (i = 0; i < BENCH_LOOPS + BENCH_WARMUP; i++) {
+		if (client_transact(fd, true))
+			goto err;
+		while (__atomic_load_n(&shared->received, __ATOMIC_ACQUIRE) <=
+		       (unsigned long long)i)
+			sched_yield();
+	}
+	bench_samples_init(&s, BENCH_LOOPS);
+	for (i = BENCH_WARMUP; i < BENCH_LOOPS + BENCH_WARMUP; i++)
+		bench_add(&s, shared->oneway_ns[i]);
+	bench_report("binder_oneway", "ns", &s);
+	bench_samples_free(&s);
+
+	bench_samples_init(&s, BENCH_LOOPS);
+	for (i = 0; i < BENCH_LOOPS + BENCH_WARMUP; i++) {
+		start = bench_now_ns();
+		if (client_transact(fd, false))
+			goto err;
+		if (i >= BENCH_WARMUP)
+			bench_add(&s, bench_now_ns() - start);
+	}
+	bench_report("binder_twoway", "ns", &s);
+	bench_samples_free(&s);
+
+	close(fd);
+	return 0;
+
+err:
+	ksft_print_msg("%s - Transaction failed\n", strerror(errno));
+	close(fd);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct binderfs_device device = { .name = "latency" };
+	char control[256];
+	int fd, pipefd[2], status, ret = KSFT_FAIL;
+	pid_t server;
+	char c;
+
+	ksft_print_header();
+
+	if (geteuid() != 0)
+		ksft_exit_skip("Needs root to mount binderfs\n");
+
+	shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+		      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED)
+		ksft_exit_fail_msg("%s - mmap\n", strerror(errno));
+
+	if (unshare(CLONE_NEWNS) ||
+	    mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL))
+		ksft_exit_fail_msg("%s - Failed to set up mount namespace\n",
+				   strerror(errno));
+
+	if (!mkdtemp(binderfs_mntpt))
+		ksft_exit_fail_msg("%s - Failed to create mountpoint\n",
+				   strerror(errno));
+
+	if (mount(NULL, binderfs_mntpt, "binder", 0, 0)) {
+		rmdir(binderfs_mntpt);
+		if (errno == ENODEV)
+			ksft_exit_skip("binderfs missing\n");
+		ksft_exit_fail_msg("%s - Failed to mount binderfs\n",
+				   strerror(errno));
+	}
+
+	snprintf(control, sizeof(control), "%s/binder-control",
+		 binderfs_mntpt);
+	fd = open(control, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || ioctl(fd, BINDER_CTL_ADD, &device) < 0) {
+		ksft_print_msg("%s - Failed to allocate binder device\n",
+			       strerror(errno));
+		goto out_umount;
+	}
+	close(fd);
+	snprintf(device_path, sizeof(device_path), "%s/%s", binderfs_mntpt,
+		 device.name);
+
+	if (pipe(pipefd))
+		goto out_umount;
+
+	server = fork();
+	if (server < 0)
+		goto out_umount;
+	if (server == 0) {
+		close(pipefd[0]);
+		run_server(pipefd[1]);
+	}
+
+	close(pipefd[1]);
+	if (read(pipefd[0], &c, 1) != 1) {
+		ksft_print_msg("Server failed to become context manager\n");
+		goto out_kill;
+	}
+	close(pipefd[0]);
+
+	if (!run_client())
+		ret = KSFT_PASS;
+
+out_kill:
+	kill(server, SIGKILL);
+	waitpid(server, &status, 0);
+out_umount:
+	umount2(binderfs_mntpt, MNT_DETACH);
+	rmdir(binderfs_mntpt);
+	return ret;
+}
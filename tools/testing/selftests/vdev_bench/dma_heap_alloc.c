@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure the time to allocate and to free buffers from every dma-buf heap
+ * in /dev/dma_heap, for a few buffer sizes. A buffer is freed by closing
+ * its last fd.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "../../../../include/uapi/linux/dma-heap.h"
+
+#include "bench.h"
+
+#define DEVPATH		"/dev/dma_heap"
+#define BENCH_BYTES	(256 << 20)
+#define BENCH_MAX_LOOPS	1000
+
+static const unsigned long long sizes[] = {
+	4096, 64 << 10, 1 << 20, 8 << 20,
+};
+
+static int bench_heap(const char *heap)
+{
+	struct bench_samples alloc, release;
+	char path[256], name[128];
+	unsigned int i;
+	int heap_fd;
+
+	snprintf(path, sizeof(path), "%s/%s", DEVPATH, heap);
+	heap_fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (heap_fd < 0) {
+		ksft_print_msg("%s - Failed to open %s\n", strerror(errno),
+			       path);
+		return -1;
+	}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int loops = BENCH_BYTES / sizes[i];
+		int n;
+
+		if (loops > BENCH_MAX_LOOPS)
+			loops = BENCH_MAX_LOOPS;
+
+		bench_samples_init(&alloc, loops);
+		bench_samples_init(&release, loops);
+		for (n = 0; n < loops; n++) {
+			struct dma_heap_allocation_data data = {
+				.len = sizes[i],
+				.fd_flags = O_RDWR | O_CLOEXEC,
+			};
+			unsigned long long start = bench_now_ns();
+
+			if (ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data) < 0) {
+				ksft_print_msg("%s - %s: %llu byte allocation failed\n",
+					       strerror(errno), heap, sizes[i]);
+				break;
+			}
+			bench_add(&alloc, bench_now_ns() - start);
+
+			start = bench_now_ns();
+			close(data.fd);
+			bench_add(&release, bench_now_ns() - start);
+		}
+
+		snprintf(name, sizeof(name), "dma_heap_alloc heap=%s size=%llu",
+			 heap, sizes[i]);
+		bench_report(name, "ns", &alloc);
+		snprintf(name, sizeof(name), "dma_heap_free heap=%s size=%llu",
+			 heap, sizes[i]);
+		bench_report(name, "ns", &release);
+		bench_samples_free(&alloc);
+		bench_samples_free(&release);
+	}
+
+	close(heap_fd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct dirent *dir;
+	int ret = 0;
+	DIR *d;
+
+	ksft_print_header();
+
+	d = opendir(DEVPATH);
+	if (!d)
+		ksft_exit_skip("No %s directory\n", DEVPATH);
+
+	while ((dir = readdir(d))) {
+		if (dir->d_name[0] == '.')
+			continue;
+		if (bench_heap(dir->d_name))
+			ret = -1;
+	}
+	closedir(d);
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Hyper-V virtual device benchmarks.
+ *
+ * vmbus_ring:    ring buffer write and read cost per packet, measured by the
+ *                kernel in /sys/kernel/debug/hyperv/ring_bench
+ *                (CONFIG_HYPERV_TESTING).
+ * netvsc_send:   latency of sending a small raw frame to ourselves through
+ *                the first hv_netvsc interface, bypassing the qdisc, and the
+ *                resulting packet rate.
+ * storvsc_read:  4k O_DIRECT random read latency at queue depth 1 from the
+ *                first disk behind a storvsc host.
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/fs.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+
+#define RING_BENCH_PATH		"/sys/kernel/debug/hyperv/ring_bench"
+
+#define NET_LOOPS		100000
+#define NET_FRAME_LEN		64
+#define NET_ETHERTYPE		0x88b5	/* local experimental */
+
+#define BLK_LOOPS		2000
+#define BLK_IO_SIZE		4096
+#define BLK_SPAN		(1ULL << 30)
+
+static int read_sysfs(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -1;
+	while (len > 0 && buf[len - 1] == '\n')
+		len--;
+	buf[len] = '\0';
+	return 0;
+}
+
+static void bench_vmbus_ring(void)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen(RING_BENCH_PATH, "r");
+	if (!f) {
+		ksft_test_result_skip("vmbus_ring: %s - %s\n", strerror(errno),
+				      RING_BENCH_PATH);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		/* "vmbus_ring size=..." */
+		ksft_print_msg("bench: name=%s", line);
+	}
+	fclose(f);
+	ksft_test_result_pass("vmbus_ring\n");
+}
+
+static int find_netvsc(char *ifname)
+{
+	char path[PATH_MAX], target[PATH_MAX];
+	struct dirent *dir;
+	ssize_t len;
+	DIR *d;
+
+	d = opendir("/sys/class/net");
+	if (!d)
+		return -1;
+
+	while ((dir = readdir(d))) {
+		if (dir->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/sys/class/net/%s/device/driver",
+			 dir->d_name);
+		len = readlink(path, target, sizeof(target) - 1);
+		if (len < 0)
+			continue;
+		target[len] = '\0';
+		if (!strcmp(basename(target), "hv_netvsc")) {
+			snprintf(ifname, IFNAMSIZ, "%s", dir->d_name);
+			closedir(d);
+			return 0;
+		}
+	}
+
+	closedir(d);
+	return -1;
+}
+
+static void bench_netvsc(void)
+{
+	unsigned char frame[NET_FRAME_LEN] = { 0 };
+	struct sockaddr_ll addr = { 0 };
+	unsigned long long start, total;
+	char ifname[IFNAMSIZ], name[64];
+	struct bench_samples s;
+	struct ifreq ifr;
+	int fd, one = 1;
+	int i;
+
+	if (find_netvsc(ifname)) {
+		ksft_test_result_skip("netvsc_send: no hv_netvsc interface\n");
+		return;
+	}
+
+	fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		ksft_test_result_skip("netvsc_send: %s - raw socket\n",
+				      strerror(errno));
+		return;
+	}
+	setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+	memset(&ifr, 0, sizeof(ifr));
+	snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+		ksft_test_result_fail("netvsc_send: %s - SIOCGIFHWADDR\n",
+				      strerror(errno));
+		close(fd);
+		return;
+	}
+
+	addr.sll_family = AF_PACKET;
+	addr.sll_ifindex = if_nametoindex(ifname);
+	addr.sll_protocol = htons(NET_ETHERTYPE);
+	addr.sll_halen = ETH_ALEN;
+	memcpy(addr.sll_addr, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+
+	memcpy(frame, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	memcpy(frame + ETH_ALEN, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+	frame[2 * ETH_ALEN] = NET_ETHERTYPE >> 8;
+	frame[2 * ETH_ALEN + 1] = NET_ETHERTYPE & 0xff;
+
+	bench_samples_init(&s, NET_LOOPS);
+	total = bench_now_ns();
+	for (i = 0; i < NET_LOOPS; i++) {
+		start = bench_now_ns();
+		if (sendto(fd, frame, sizeof(frame), 0,
+			   (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			/* send sections or ring full, give the host a moment */
+			if (errno == ENOBUFS || errno == EAGAIN) {
+				sched_yield();
+				continue;
+			}
+			ksft_test_result_fail("netvsc_send: %s - sendto\n",
+					      strerror(errno));
+			goto out;
+		}
+		bench_add(&s, bench_now_ns() - start);
+	}
+	total = bench_now_ns() - total;
+
+	snprintf(name, sizeof(name), "netvsc_send dev=%s", ifname);
+	bench_report(name, "ns", &s);
+	if (total)
+		ksft_print_msg("bench: name=netvsc_send_rate dev=%s unit=pps value=%llu\n",
+			       ifname, s.nr * 1000000000ULL / total);
+	ksft_test_result_pass("netvsc_send\n");
+out:
+	bench_samples_free(&s);
+	close(fd);
+}
+
+/* Block device of the first disk whose SCSI host is driven by storvsc */
+static int find_storvsc_disk(char *disk, size_t size)
+{
+	char path[PATH_MAX], buf[64], host[32], *real;
+	struct dirent *hdir, *bdir;
+	DIR *hosts, *blocks;
+	int ret = -1;
+
+	hosts = opendir("/sys/class/scsi_host");
+	if (!hosts)
+		return -1;
+
+	while (ret && (hdir = readdir(hosts))) {
+		if (hdir->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path),
+			 "/sys/class/scsi_host/%s/proc_name", hdir->d_name);
+		if (read_sysfs(path, buf, sizeof(buf)) ||
+		    strcmp(buf, "storvsc"))
+			continue;
+		snprintf(host, sizeof(host), "/%s/", hdir->d_name);
+
+		blocks = opendir("/sys/block");
+		if (!blocks)
+			break;
+		while ((bdir = readdir(blocks))) {
+			if (bdir->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "/sys/block/%s/device",
+				 bdir->d_name);
+			real = realpath(path, NULL);
+			if (!real)
+				continue;
+			if (strstr(real, host)) {
+				snprintf(disk, size, "/dev/%s", bdir->d_name);
+				ret = 0;
+			}
+			free(real);
+			if (!ret)
+				break;
+		}
+		closedir(blocks);
+	}
+
+	closedir(hosts);
+	return ret;
+}
+
+static void bench_storvsc(void)
+{
+	unsigned long long bytes, start, blocks;
+	char disk[PATH_MAX], name[PATH_MAX + 32];
+	struct bench_samples s;
+	void *buf;
+	int fd, i;
+
+	if (find_storvsc_disk(disk, sizeof(disk))) {
+		ksft_test_result_skip("storvsc_read: no storvsc disk\n");
+		return;
+	}
+
+	fd = open(disk, O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if (fd < 0) {
+		ksft_test_result_skip("storvsc_read: %s - %s\n",
+				      strerror(errno), disk);
+		return;
+	}
+
+	if (ioctl(fd, BLKGETSIZE64, &bytes) < 0 || bytes < BLK_IO_SIZE) {
+		ksft_test_result_skip("storvsc_read: %s too small\n", disk);
+		close(fd);
+		return;
+	}
+	if (bytes > BLK_SPAN)
+		bytes = BLK_SPAN;
+	blocks = bytes / BLK_IO_SIZE;
+
+	if (posix_memalign(&buf, BLK_IO_SIZE, BLK_IO_SIZE))
+		ksft_exit_fail_msg("Out of memory\n");
+
+	srandom(getpid());
+	bench_samples_init(&s, BLK_LOOPS);
+	for (i = 0; i < BLK_LOOPS; i++) {
+		off_t off = (random() % blocks) * BLK_IO_SIZE;
+
+		start = bench_now_ns();
+		if (pread(fd, buf, BLK_IO_SIZE, off) != BLK_IO_SIZE) {
+			ksft_test_result_fail("storvsc_read: %s - pread\n",
+					      strerror(errno));
+			goto out;
+		}
+		bench_add(&s, bench_now_ns() - start);
+	}
+
+	snprintf(name, sizeof(name), "storvsc_read dev=%s bs=%d qd=1", disk,
+		 BLK_IO_SIZE);
+	bench_report(name, "ns", &s);
+	ksft_test_result_pass("storvsc_read\n");
+out:
+	bench_samples_free(&s);
+	free(buf);
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	ksft_print_header();
+	ksft_set_plan(3);
+
+	bench_vmbus_ring();
+	bench_netvsc();
+	bench_storvsc();
+
+	if (ksft_get_fail_cnt())
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
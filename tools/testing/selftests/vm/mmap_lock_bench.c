@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure page fault throughput while the mmap_lock is taken for write.
+ *
+ * N threads keep faulting in the pages of their own part of an anonymous
+ * area, zapping them again with MADV_DONTNEED once all are touched, while
+ * another thread maps, touches and unmaps a small area in a loop, like a
+ * JIT or a garbage collector would. For each run the faults per second and
+ * the mmap/munmap cycles per second are reported.
+ *
+ * With CONFIG_LOCK_STAT, /proc/lock_stat is cleared before each run and the
+ * contentions and total wait time of the mmap_lock class are reported too.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define LOCK_STAT		"/proc/lock_stat"
+#define BENCH_MAX_THREADS	32
+#define BENCH_PAGES_PER_THREAD	1024
+#define BENCH_MAP_PAGES		16
+#define BENCH_SECONDS		1
+
+static long page_size;
+static char *area;
+static volatile bool stop;
+
+struct faulter {
+	pthread_t tid;
+	int idx;
+	unsigned long long faults;
+	int err;
+};
+
+static void *faulter(void *arg)
+{
+	struct faulter *f = arg;
+	size_t len = (size_t)BENCH_PAGES_PER_THREAD * page_size;
+	char *start = area + f->idx * len;
+	int i;
+
+	while (!stop) {
+		for (i = 0; i < BENCH_PAGES_PER_THREAD; i++)
+			start[(size_t)i * page_size] = 1;
+		f->faults += BENCH_PAGES_PER_THREAD;
+		if (madvise(start, len, MADV_DONTNEED)) {
+			f->err = errno;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *mapper(void *arg)
+{
+	unsigned long long *cycles = arg;
+	size_t len = BENCH_MAP_PAGES * page_size;
+
+	while (!stop) {
+		char *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED)
+			break;
+		p[0] = 1;
+		munmap(p, len);
+		(*cycles)++;
+	}
+	return NULL;
+}
+
+static bool lock_stat_clear(void)
+{
+	int fd = open(LOCK_STAT, O_WRONLY);
+	bool ret;
+
+	if (fd < 0)
+		return false;
+	ret = write(fd, "0", 1) == 1;
+	close(fd);
+	return ret;
+}
+
+/*
+ * The class lines of /proc/lock_stat read
+ * "<class>: con-bounces contentions waittime-min waittime-max
+ * waittime-total ...", report the first one for the mmap_lock.
+ */
+static void lock_stat_report(void)
+{
+	char line[512];
+	FILE *f = fopen(LOCK_STAT, "r");
+
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long bounces, contentions;
+		double wmin, wmax, wtotal;
+		char *p = strstr(line, "mmap_lock");
+
+		if (!p)
+			continue;
+		p = strchr(p, ':');
+		if (!p)
+			continue;
+		if (sscanf(p + 1, "%llu %llu %lf %lf %lf", &bounces,
+			   &contentions, &wmin, &wmax, &wtotal) != 5)
+			continue;
+		ksft_print_msg("    mmap_lock: %llu contentions, %.2f us waited\n",
+			       contentions, wtotal);
+		break;
+	}
+	fclose(f);
+}
+
+static int run(int nr_threads, bool lock_stat)
+{
+	struct faulter threads[BENCH_MAX_THREADS] = {};
+	unsigned long long faults = 0, cycles = 0;
+	size_t len = (size_t)nr_threads * BENCH_PAGES_PER_THREAD * page_size;
+	struct timespec start, end;
+	pthread_t map_tid;
+	double secs;
+	int i, ret = 0;
+
+	area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+
+	if (lock_stat)
+		lock_stat_clear();
+
+	stop = false;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].idx = i;
+		if (pthread_create(&threads[i].tid, NULL, faulter, &threads[i]))
+			ksft_exit_fail_msg("Failed to create faulter\n");
+	}
+	if (pthread_create(&map_tid, NULL, mapper, &cycles))
+		ksft_exit_fail_msg("Failed to create mapper\n");
+
+	sleep(BENCH_SECONDS);
+	stop = true;
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		faults += threads[i].faults;
+		if (threads[i].err) {
+			ksft_print_msg("%s - madvise failed\n",
+				       strerror(threads[i].err));
+			ret = -1;
+		}
+	}
+	pthread_join(map_tid, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	ksft_print_msg("threads %2d: %10.0f faults/s, %8.0f mmap cycles/s\n",
+		       nr_threads, faults / secs, cycles / secs);
+	if (lock_stat)
+		lock_stat_report();
+
+	munmap(area, len);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	bool lock_stat = lock_stat_clear();
+	int nr_threads, ret = 0;
+
+	ksft_print_header();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (!lock_stat)
+		ksft_print_msg("%s not writable, no contention statistics\n",
+			       LOCK_STAT);
+
+	for (nr_threads = 1; nr_threads <= BENCH_MAX_THREADS &&
+	     nr_threads <= nr_cpus; nr_threads *= 2) {
+		if (run(nr_threads, lock_stat))
+			ret = -1;
+	}
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * Measure how many userfaultfd missing faults per second a single monitor
+ * thread resolves.
+ *
+ * N threads fault on disjoint parts of a registered anonymous area, so up
+ * to N faults are pending at any time. The monitor reads as many events as
+ * one read() returns and resolves them either:
+ *
+ *   copy:  with one UFFDIO_COPY per event
+ *   multi: with one UFFDIO_COPY_MULTI for all events of the read
+ *
+ * For each run the faults per second and the average number of events a
+ * single read() returned are reported. Every page must end up with the
+ * contents the monitor copied in, otherwise the run fails.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifdef __NR_userfaultfd
+
+#define BENCH_MAX_THREADS	64
+#define BENCH_PAGES_PER_THREAD	4096
+#define BENCH_MAX_EVENTS	64
+
+static long page_size;
+static char *area;
+static char *src_page;
+static int uffd;
+
+struct faulter {
+	pthread_t tid;
+	int idx;
+	unsigned long bad;
+};
+
+static void *faulter(void *arg)
+{
+	struct faulter *f = arg;
+	char *start = area + (size_t)f->idx * BENCH_PAGES_PER_THREAD * page_size;
+	int i;
+
+	for (i = 0; i < BENCH_PAGES_PER_THREAD; i++) {
+		if (*(volatile char *)(start + (size_t)i * page_size) != 0x5a)
+			f->bad++;
+	}
+	return NULL;
+}
+
+static int uffd_setup(size_t len)
+{
+	struct uffdio_api api = { .api = UFFD_API };
+	struct uffdio_register reg = {
+		.range = { .start = (unsigned long)area, .len = len },
+		.mode = UFFDIO_REGISTER_MODE_MISSING,
+	};
+
+	uffd = syscall(__NR_userfaultfd,
+		       O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if (uffd < 0)
+		return -1;
+	if (ioctl(uffd, UFFDIO_API, &api) || ioctl(uffd, UFFDIO_REGISTER, &reg))
+		return -1;
+	return 0;
+}
+
+/*
+ * Both return the number of pages mapped, or -1. A page may have been
+ * mapped already for a duplicate event, which fails with EEXIST.
+ */
+static int resolve_copy(struct uffd_msg *msgs, int n)
+{
+	int i, copied = 0;
+
+	for (i = 0; i < n; i++) {
+		struct uffdio_copy copy = {
+			.dst = msgs[i].arg.pagefault.address &
+			       ~(page_size - 1),
+			.src = (unsigned long)src_page,
+			.len = page_size,
+		};
+
+		if (!ioctl(uffd, UFFDIO_COPY, &copy))
+			copied++;
+		else if (errno != EEXIST)
+			return -1;
+	}
+	return copied;
+}
+
+static int resolve_multi(struct uffd_msg *msgs, int n)
+{
+	struct uffdio_copy_range ranges[BENCH_MAX_EVENTS];
+	struct uffdio_copy_multi multi;
+	int i, done = 0, copied = 0;
+
+	for (i = 0; i < n; i++) {
+		ranges[i].dst = msgs[i].arg.pagefault.address &
+				~(page_size - 1);
+		ranges[i].src = (unsigned long)src_page;
+		ranges[i].len = page_size;
+	}
+
+	while (done < n) {
+		multi.ranges = (unsigned long)&ranges[done];
+		multi.nr_ranges = n - done;
+		multi.mode = 0;
+		multi.copy = 0;
+		if (!ioctl(uffd, UFFDIO_COPY_MULTI, &multi))
+			return copied + n - done;
+		if (errno != EEXIST)
+			return -1;
+		/* skip past the ranges copied and the one already mapped */
+		if (multi.copy > 0) {
+			copied += multi.copy / page_size;
+			done += multi.copy / page_size;
+		}
+		done++;
+	}
+	return copied;
+}
+
+static int run(int nr_threads, bool multi)
+{
+	struct faulter threads[BENCH_MAX_THREADS] = {};
+	struct uffd_msg msgs[BENCH_MAX_EVENTS];
+	unsigned long long faults = 0, resolved = 0, reads = 0, bad = 0;
+	size_t len = (size_t)nr_threads * BENCH_PAGES_PER_THREAD * page_size;
+	struct timespec start, end;
+	struct pollfd pfd;
+	double secs;
+	int i, ret = 0;
+
+	area = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED)
+		ksft_exit_fail_msg("mmap: %s\n", strerror(errno));
+	if (uffd_setup(len)) {
+		if (errno == EPERM || errno == ENOSYS)
+			ksft_exit_skip("userfaultfd: %s\n", strerror(errno));
+		ksft_exit_fail_msg("userfaultfd setup: %s\n", strerror(errno));
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].idx = i;
+		if (pthread_create(&threads[i].tid, NULL, faulter, &threads[i]))
+			ksft_exit_fail_msg("Failed to create faulter\n");
+	}
+
+	pfd.fd = uffd;
+	pfd.events = POLLIN;
+	while (resolved < (unsigned long long)nr_threads *
+			  BENCH_PAGES_PER_THREAD) {
+		ssize_t n;
+		int copied;
+
+		if (poll(&pfd, 1, 1000) <= 0)
+			ksft_exit_fail_msg("Timed out waiting for faults\n");
+
+		n = read(uffd, msgs, sizeof(msgs));
+		if (n < 0) {
+			if (errno == EAGAIN)
+				continue;
+			ksft_exit_fail_msg("read: %s\n", strerror(errno));
+		}
+		n /= sizeof(msgs[0]);
+		reads++;
+
+		for (i = 0; i < n; i++) {
+			if (msgs[i].event != UFFD_EVENT_PAGEFAULT)
+				ksft_exit_fail_msg("Unexpected event %u\n",
+						   msgs[i].event);
+		}
+
+		/* the faulters would never finish, give up right away */
+		copied = multi ? resolve_multi(msgs, n) : resolve_copy(msgs, n);
+		if (copied < 0)
+			ksft_exit_fail_msg("%s failed: %s\n",
+					   multi ? "UFFDIO_COPY_MULTI" :
+					   "UFFDIO_COPY", strerror(errno));
+		faults += n;
+		resolved += copied;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+		bad += threads[i].bad;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	       (end.tv_nsec - start.tv_nsec) / 1e9;
+	ksft_print_msg("%-5s threads %2d: %10.0f faults/s, %5.1f events/read\n",
+		       multi ? "multi" : "copy", nr_threads, resolved / secs,
+		       reads ? (double)faults / reads : 0.0);
+
+	if (bad) {
+		ksft_print_msg("%llu pages with wrong contents\n", bad);
+		ret = -1;
+	}
+
+	close(uffd);
+	munmap(area, len);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nr_threads, ret = 0;
+
+	ksft_print_header();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	src_page = aligned_alloc(page_size, page_size);
+	if (!src_page)
+		ksft_exit_fail_msg("Out of memory\n");
+	memset(src_page, 0x5a, page_size);
+
+	for (nr_threads = 1; nr_threads <= BENCH_MAX_THREADS &&
+	     nr_threads <= 4 * nr_cpus; nr_threads *= 2) {
+		if (run(nr_threads, false))
+			ret = -1;
+		if (run(nr_threads, true))
+			ret = -1;
+	}
+
+	if (ret)
+		ksft_exit_fail();
+	ksft_exit_pass();
+}
+
+#else /* __NR_userfaultfd */
+
+int main(void)
+{
+	ksft_exit_skip("missing __NR_userfaultfd definition\n");
+}
+
+#endif /* __NR_userfaultfd */